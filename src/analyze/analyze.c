@@ -20,6 +20,7 @@
 #include "conf-files.h"
 #include "copy.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "glob-util.h"
 #include "hashmap.h"
 #include "locale-util.h"
@@ -27,6 +28,7 @@
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "readahead-util.h"
 #if HAVE_SECCOMP
 #include "seccomp-util.h"
 #endif
@@ -812,6 +814,208 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+struct trace_unit {
+        unsigned tid;
+        usec_t installed;
+        usec_t started;
+};
+
+static void trace_print_string(const char *s) {
+        const char *p;
+
+        /* Prints a string as JSON string literal */
+
+        putchar('"');
+
+        for (p = s; *p; p++)
+                if (IN_SET(*p, '"', '\\'))
+                        printf("\\%c", *p);
+                else if ((unsigned char) *p < ' ')
+                        printf("\\u%04x", (unsigned) *p);
+                else
+                        putchar(*p);
+
+        putchar('"');
+}
+
+static void trace_print_event(
+                bool *first,
+                const char *name,
+                const char *category,
+                char phase,
+                usec_t ts,
+                usec_t dur,
+                unsigned tid,
+                const char *detail) {
+
+        assert(first);
+
+        /* Prints one event in the Trace Event Format understood by chrome://tracing and Perfetto. Timestamps and
+         * durations are in µs there, just like ours. */
+
+        printf("%s\n{\"name\":", *first ? "" : ",");
+        trace_print_string(name);
+        printf(",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":" USEC_FMT, category, phase, tid, ts);
+
+        if (phase == 'X')
+                printf(",\"dur\":" USEC_FMT, dur);
+        else if (phase == 'i')
+                printf(",\"s\":\"t\"");
+
+        if (detail) {
+                printf(",\"args\":{\"detail\":");
+                trace_print_string(detail);
+                putchar('}');
+        }
+
+        putchar('}');
+        *first = false;
+}
+
+static int analyze_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(hashmap_free_free_freep) Hashmap *units = NULL;
+        struct boot_times *boot;
+        struct trace_unit *tu;
+        bool first = true;
+        const char *name;
+        Iterator i;
+        size_t j;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = acquire_boot_times(bus, &boot);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetBootTrace",
+                        &error,
+                        &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get boot trace: %s", bus_error_message(&error, r));
+
+        units = hashmap_new(&string_hash_ops);
+        if (!units)
+                return log_oom();
+
+        printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+        /* The phases of the manager itself go on a track of their own */
+        {
+                const struct {
+                        const char *name;
+                        usec_t start, finish;
+                } phases[] = {
+                        { "initrd-security",   boot->initrd_security_start_time,   boot->initrd_security_finish_time   },
+                        { "initrd-generators", boot->initrd_generators_start_time, boot->initrd_generators_finish_time },
+                        { "initrd-units-load", boot->initrd_unitsload_start_time,  boot->initrd_unitsload_finish_time  },
+                        { "security",          boot->security_start_time,          boot->security_finish_time          },
+                        { "generators",        boot->generators_start_time,        boot->generators_finish_time        },
+                        { "units-load",        boot->unitsload_start_time,         boot->unitsload_finish_time         },
+                        { "startup",           boot->userspace_time,               boot->finish_time                   },
+                };
+
+                for (j = 0; j < ELEMENTSOF(phases); j++)
+                        if (phases[j].finish > 0)
+                                trace_print_event(&first, phases[j].name, "manager", 'X', phases[j].start,
+                                                  usec_sub_unsigned(phases[j].finish, phases[j].start), 0, NULL);
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(tsss)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                const char *type, *unit, *detail;
+                usec_t ts;
+
+                r = sd_bus_message_read(reply, "(tsss)", &ts, &type, &unit, &detail);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                /* Same as for "plot", see acquire_boot_times() */
+                ts = usec_sub_unsigned(ts, boot->reverse_offset);
+
+                /* Every unit gets a track of its own */
+                tu = hashmap_get(units, unit);
+                if (!tu) {
+                        _cleanup_free_ char *k = NULL;
+
+                        k = strdup(unit);
+                        if (!k)
+                                return log_oom();
+
+                        tu = new0(struct trace_unit, 1);
+                        if (!tu)
+                                return log_oom();
+
+                        tu->tid = hashmap_size(units) + 1;
+
+                        r = hashmap_put(units, k, tu);
+                        if (r < 0) {
+                                free(tu);
+                                return log_oom();
+                        }
+
+                        k = NULL;
+                }
+
+                if (streq(type, "job-installed"))
+                        tu->installed = ts;
+
+                else if (streq(type, "job-started")) {
+                        /* The time the job was waiting for others is what matters for the critical path */
+                        if (tu->installed > 0) {
+                                trace_print_event(&first, strjoina(unit, " (waiting)"), "job-wait", 'X', tu->installed,
+                                                  usec_sub_unsigned(ts, tu->installed), tu->tid, detail);
+                                tu->installed = 0;
+                        }
+
+                        tu->started = ts;
+
+                } else if (streq(type, "job-finished")) {
+                        if (tu->started > 0) {
+                                trace_print_event(&first, unit, "job", 'X', tu->started,
+                                                  usec_sub_unsigned(ts, tu->started), tu->tid, detail);
+                                tu->started = 0;
+                        }
+
+                        tu->installed = 0;
+
+                } else
+                        trace_print_event(&first, type, type, 'i', ts, 0, tu->tid, detail);
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        /* Name the tracks after the units */
+        printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"manager\"}}");
+        HASHMAP_FOREACH_KEY(tu, name, units, i) {
+                printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", tu->tid);
+                trace_print_string(name);
+                printf("}}");
+        }
+
+        printf("\n]}\n");
+
+        return 0;
+}
+
 static int list_dependencies_print(const char *name, unsigned int level, unsigned int branches,
                                    bool last, struct unit_times *times, struct boot_times *boot) {
         unsigned int i;
@@ -1070,6 +1274,84 @@ static int analyze_blame(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+struct generator_time {
+        const char *name;
+        usec_t time;
+        int status;
+};
+
+static int compare_generator_time(const void *a, const void *b) {
+        return compare(((struct generator_time *)b)->time,
+                       ((struct generator_time *)a)->time);
+}
+
+static int analyze_generators(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ struct generator_time *times = NULL;
+        size_t n = 0, n_allocated = 0, i;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimings",
+                        &error,
+                        &reply,
+                        "a(sti)");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get generator timings: %s", bus_error_message(&error, -r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sti)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                struct generator_time t;
+
+                r = sd_bus_message_read(reply, "(sti)", &t.name, &t.time, &t.status);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                if (!GREEDY_REALLOC(times, n_allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = t;
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(times, n, sizeof(struct generator_time), compare_generator_time);
+
+        (void) pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %s", format_timespan(ts, sizeof(ts), times[i].time, USEC_PER_MSEC), times[i].name);
+
+                if (times[i].status < 0)
+                        printf(" (timed out)");
+                else if (times[i].status > 0)
+                        printf(" (exit status %i)", times[i].status);
+
+                putchar('\n');
+        }
+
+        return 0;
+}
+
 static int analyze_time(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -1668,6 +1950,76 @@ static int service_watchdogs(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+static int analyze_readahead(int argc, char *argv[], void *userdata) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL;
+        _cleanup_free_ char *files = NULL, *bytes = NULL, *usec = NULL;
+        char ts[CONST_MAX(FORMAT_TIMESPAN_MAX, FORMAT_TIMESTAMP_RELATIVE_MAX)], sz[FORMAT_BYTES_MAX];
+        uint64_t b = 0;
+        usec_t u = 0, done_usec;
+        int r;
+
+        r = readahead_pack_load(READAHEAD_PACK, &p);
+        if (r == -ENOENT) {
+                log_info("No readahead pack has been collected yet.");
+                return 0;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to load " READAHEAD_PACK ": %m");
+
+        printf("          Pack: %s\n", READAHEAD_PACK);
+        printf("     Collected: %s\n", format_timestamp_relative(ts, sizeof(ts), p->mtime));
+        printf("         Files: %zu (%s), in %s order\n",
+               p->n_entries,
+               format_bytes(sz, sizeof(sz), readahead_pack_bytes(p)),
+               p->rotational ? "physical" : "access");
+
+        /* The CLOCK_MONOTONIC timestamps of the "done" flag are comparable between boots, and since the collecting
+         * boot didn't read ahead, its timestamp is the baseline for the current boot. */
+        if (p->done_usec > 0)
+                printf(" Baseline boot: done after %s\n", format_timespan(ts, sizeof(ts), p->done_usec, USEC_PER_MSEC));
+
+        r = parse_env_file(NULL, READAHEAD_REPLAY_STATS, NEWLINE,
+                           "FILES", &files,
+                           "BYTES", &bytes,
+                           "USEC", &usec,
+                           NULL);
+        if (r == -ENOENT) {
+                printf("     This boot: not read ahead\n");
+                return 0;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to read " READAHEAD_REPLAY_STATS ": %m");
+
+        if (bytes)
+                (void) safe_atou64(bytes, &b);
+        if (usec)
+                (void) safe_atou64(usec, &u);
+
+        printf("      Replayed: %s files (%s) in %s\n",
+               strna(files),
+               format_bytes(sz, sizeof(sz), b),
+               format_timespan(ts, sizeof(ts), u, USEC_PER_MSEC));
+
+        r = readahead_read_usec_file(READAHEAD_DONE, &done_usec);
+        if (r == -ENOENT) {
+                printf("     This boot: not done yet\n");
+                return 0;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to read " READAHEAD_DONE ": %m");
+
+        printf("     This boot: done after %s", format_timespan(ts, sizeof(ts), done_usec, USEC_PER_MSEC));
+        if (p->done_usec > 0)
+                printf(" (%s %s)",
+                       format_timespan(ts, sizeof(ts),
+                                       done_usec < p->done_usec ? p->done_usec - done_usec : done_usec - p->done_usec,
+                                       USEC_PER_MSEC),
+                       done_usec < p->done_usec ? "faster" : "slower");
+        putchar('\n');
+
+        return 0;
+}
+
 static int do_verify(int argc, char *argv[], void *userdata) {
         return verify_units(strv_skip(argv, 1), arg_scope, arg_man, arg_generators);
 }
@@ -1703,8 +2055,10 @@ static int help(int argc, char *argv[], void *userdata) {
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generators               Print list of generators ordered by their run time\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
+               "  trace                    Output boot trace in Chrome trace event format\n"
                "  dot [UNIT...]            Output dependency graph in man:dot(1) format\n"
                "  log-level [LEVEL]        Get/set logging threshold for manager\n"
                "  log-target [TARGET]      Get/set logging target for manager\n"
@@ -1715,6 +2069,7 @@ static int help(int argc, char *argv[], void *userdata) {
                "  verify FILE...           Check unit files for correctness\n"
                "  calendar SPEC...         Validate repetitive calendar time events\n"
                "  service-watchdogs [BOOL] Get/set service watchdog state\n"
+               "  readahead                Show boot readahead statistics\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
                , link
@@ -1888,8 +2243,10 @@ int main(int argc, char *argv[]) {
                 { "help",              VERB_ANY, VERB_ANY, 0,            help                   },
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
+                { "generators",        VERB_ANY, 1,        0,            analyze_generators     },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
+                { "trace",             VERB_ANY, 1,        0,            analyze_trace          },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
                 { "log-level",         VERB_ANY, 2,        0,            get_or_set_log_level   },
                 { "log-target",        VERB_ANY, 2,        0,            get_or_set_log_target  },
@@ -1905,6 +2262,7 @@ int main(int argc, char *argv[]) {
                 { "verify",            2,        VERB_ANY, 0,            do_verify              },
                 { "calendar",          2,        VERB_ANY, 0,            test_calendar          },
                 { "service-watchdogs", VERB_ANY, 2,        0,            service_watchdogs      },
+                { "readahead",         VERB_ANY, 1,        0,            analyze_readahead      },
                 {}
         };
 
@@ -1098,17 +1098,45 @@ int calendar_spec_from_string(const char *p, CalendarSpec **spec) {
         return 0;
 }
 
-static int find_end_of_month(struct tm *tm, bool utc, int day) {
-        struct tm t = *tm;
+static bool is_leap_year(int year) {
+        return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+static int days_in_month(int year, int month) {
+        static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        /* year is the full year, month is counted from 0, as in struct tm */
+
+        if (month == 1 && is_leap_year(year))
+                return 29;
+
+        return days[month];
+}
+
+static int weekday_of_date(int year, int month, int day) {
+        static const int offset[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+        int k;
+
+        /* Returns the day of the week of a valid date, with 0 being Monday, as in weekdays_bits. This only
+         * depends on the date, not the timezone, hence there's no need to go through mktime() for this. */
+
+        if (month < 2)
+                year--;
 
-        t.tm_mon++;
-        t.tm_mday = 1 - day;
+        k = (year + year / 4 - year / 100 + year / 400 + offset[month] + day) % 7; /* 0 is Sunday */
 
-        if (mktime_or_timegm(&t, utc) < 0 ||
-            t.tm_mon != tm->tm_mon)
+        return k == 0 ? 6 : k - 1;
+}
+
+static int find_end_of_month(const struct tm *tm, int day) {
+        int n, d;
+
+        n = days_in_month(tm->tm_year + 1900, tm->tm_mon);
+        d = n + 1 - day;
+        if (d < 1 || d > n)
                 return -1;
 
-        return t.tm_mday;
+        return d;
 }
 
 static int find_matching_component(const CalendarSpec *spec, const CalendarComponent *c,
@@ -1128,8 +1156,8 @@ static int find_matching_component(const CalendarSpec *spec, const CalendarCompo
                 stop = c->stop;
 
                 if (spec->end_of_month && p == spec->day) {
-                        start = find_end_of_month(tm, spec->utc, start);
-                        stop = find_end_of_month(tm, spec->utc, stop);
+                        start = find_end_of_month(tm, start);
+                        stop = find_end_of_month(tm, stop);
 
                         if (stop > 0)
                                 SWAP_TWO(start, stop);
@@ -1168,11 +1196,6 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
         struct tm t;
         assert(tm);
 
-        t = *tm;
-
-        if (mktime_or_timegm(&t, utc) < 0)
-                return true;
-
         /*
          * Set an upper bound on the year so impossible dates like "*-02-31"
          * don't cause find_next() to loop forever. tm_year contains years
@@ -1181,6 +1204,26 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
         if (tm->tm_year + 1900 > MAX_YEAR)
                 return true;
 
+        /* Catch invalid fields first, that's cheaper than having mktime() normalize them. It also takes care of
+         * impossible dates quickly, as the day of month is the field that is out of bounds most of the time. */
+        if (tm->tm_year < 70 ||
+            tm->tm_mon < 0 || tm->tm_mon > 11 ||
+            tm->tm_mday < 1 || tm->tm_mday > days_in_month(tm->tm_year + 1900, tm->tm_mon) ||
+            tm->tm_hour < 0 || tm->tm_hour > 23 ||
+            tm->tm_min < 0 || tm->tm_min > 59 ||
+            tm->tm_sec < 0 || tm->tm_sec > 59)
+                return true;
+
+        /* In UTC every valid date and time exists exactly once, hence we are done. */
+        if (utc)
+                return false;
+
+        /* In local time a valid time might still not exist, because of a DST change. */
+        t = *tm;
+
+        if (mktime_or_timegm(&t, utc) < 0)
+                return true;
+
         /* Did any normalization take place? If so, it was out of bounds before */
         return
                 t.tm_year != tm->tm_year ||
@@ -1191,19 +1234,22 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
                 t.tm_sec != tm->tm_sec;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
-        struct tm t;
-        int k;
+static int skip_to_weekday(int weekdays_bits, const struct tm *tm) {
+        int k, n;
+
+        /* Returns the number of days to skip from the date in tm to the next day matching weekdays_bits. tm
+         * must contain a valid date, see tm_out_of_bounds() above. */
 
         if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
-                return true;
+                return 0;
 
-        t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
-                return false;
+        k = weekday_of_date(tm->tm_year + 1900, tm->tm_mon, tm->tm_mday);
+        for (n = 0; n < 7; n++)
+                if (weekdays_bits & (1 << ((k + n) % 7)))
+                        return n;
 
-        k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
-        return (weekdays_bits & (1 << k));
+        /* No weekday matches at all, skip a full week, the year bound will end things eventually */
+        return 7;
 }
 
 static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
@@ -1262,8 +1308,10 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                         continue;
                 }
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
-                        c.tm_mday++;
+                /* Jump to the next matching weekday right away, none of the days in between can match */
+                r = skip_to_weekday(spec->weekdays_bits, &c);
+                if (r > 0) {
+                        c.tm_mday += r;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
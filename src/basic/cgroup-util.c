@@ -2,6 +2,7 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <ftw.h>
 #include <limits.h>
 #include <signal.h>
@@ -40,6 +41,7 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unaligned.h"
 #include "unit-name.h"
 #include "user-util.h"
 
@@ -87,6 +89,182 @@ int cg_read_pid(FILE *f, pid_t *_pid) {
         return 1;
 }
 
+static int read_virtual_file_at(int dir_fd, const char *fn, char **ret) {
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_close_ int fd = -1;
+        size_t n = 0, allocated = 0;
+
+        assert(fn);
+        assert(ret);
+
+        /* Reads a file from procfs or cgroupfs in one go, bypassing stdio. These files don't know their size in
+         * advance, hence read until EOF. The result is NUL terminated. */
+
+        fd = openat(dir_fd, fn, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        for (;;) {
+                ssize_t k;
+
+                if (!GREEDY_REALLOC(buf, allocated, n + 4096 + 1))
+                        return -ENOMEM;
+
+                k = read(fd, buf + n, allocated - n - 1);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+                if (k == 0)
+                        break;
+
+                n += k;
+        }
+
+        buf[n] = 0;
+        *ret = TAKE_PTR(buf);
+
+        return 0;
+}
+
+static int parse_pids(char *p, pid_t **ret, size_t *ret_n) {
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t n = 0, allocated = 0;
+        char *line;
+
+        while ((line = strsep(&p, "\n"))) {
+                pid_t pid;
+
+                if (isempty(line))
+                        continue;
+
+                if (parse_pid(line, &pid) < 0)
+                        return -EIO;
+
+                if (!GREEDY_REALLOC(pids, allocated, n + 1))
+                        return -ENOMEM;
+
+                pids[n++] = pid;
+        }
+
+        *ret = TAKE_PTR(pids);
+        *ret_n = n;
+
+        return 0;
+}
+
+int cg_read_pids_at(int dir_fd, pid_t **ret, size_t *ret_n) {
+        _cleanup_free_ char *content = NULL;
+        int r;
+
+        assert(dir_fd >= 0);
+        assert(ret);
+        assert(ret_n);
+
+        /* Reads all PIDs from cgroup.procs of the cgroup directory at once. Like with cg_read_pid(), the list
+         * might contain duplicates. */
+
+        r = read_virtual_file_at(dir_fd, "cgroup.procs", &content);
+        if (r < 0)
+                return r;
+
+        return parse_pids(content, ret, ret_n);
+}
+
+int cg_read_pids(const char *controller, const char *path, pid_t **ret, size_t *ret_n) {
+        _cleanup_free_ char *fs = NULL, *content = NULL;
+        int r;
+
+        assert(ret);
+        assert(ret_n);
+
+        r = cg_get_path(controller, path, "cgroup.procs", &fs);
+        if (r < 0)
+                return r;
+
+        r = read_virtual_file_at(AT_FDCWD, fs, &content);
+        if (r < 0)
+                return r;
+
+        return parse_pids(content, ret, ret_n);
+}
+
+int cg_open(const char *controller, const char *path) {
+        _cleanup_free_ char *fs = NULL;
+        int fd, r;
+
+        /* Opens the cgroup directory, so that its attributes can be accessed relative to it, without building
+         * and resolving the full path every time */
+
+        r = cg_get_path(controller, path, NULL, &fs);
+        if (r < 0)
+                return r;
+
+        fd = open(fs, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        return fd;
+}
+
+int cg_get_attribute_at(int dir_fd, const char *attribute, char **ret) {
+        char *content;
+        int r;
+
+        assert(dir_fd >= 0);
+        assert(attribute);
+        assert(ret);
+
+        /* Like cg_get_attribute(), returns the first line of the attribute only */
+
+        r = read_virtual_file_at(dir_fd, attribute, &content);
+        if (r < 0)
+                return r;
+
+        content[strcspn(content, "\n")] = 0;
+        *ret = content;
+
+        return 0;
+}
+
+static int get_cgroupid_at(int fd, const char *path, int flags, uint64_t *ret) {
+        union {
+                struct file_handle handle;
+                uint8_t space[offsetof(struct file_handle, f_handle) + sizeof(uint64_t)];
+        } fh = {
+                .handle.handle_bytes = sizeof(uint64_t),
+        };
+        int mnt_id = -1;
+
+        assert(ret);
+
+        /* On the unified hierarchy, the file handle of a cgroup directory is its 64bit cgroup ID, the same one the
+         * kernel uses elsewhere, e.g. for BPF and in the socket cgroup match */
+
+        if (name_to_handle_at(fd, path, &fh.handle, &mnt_id, flags) < 0)
+                return -errno;
+
+        if (fh.handle.handle_bytes != sizeof(uint64_t))
+                return -EOPNOTSUPP;
+
+        *ret = unaligned_read_ne64(fh.handle.f_handle);
+        return 0;
+}
+
+int cg_path_get_cgroupid(const char *path, uint64_t *ret) {
+        assert(path);
+
+        return get_cgroupid_at(AT_FDCWD, path, 0, ret);
+}
+
+int cg_fd_get_cgroupid(int fd, uint64_t *ret) {
+        assert(fd >= 0);
+
+        return get_cgroupid_at(fd, "", AT_EMPTY_PATH, ret);
+}
+
 int cg_read_event(
                 const char *controller,
                 const char *path,
@@ -245,11 +423,11 @@ int cg_kill(
         my_pid = getpid_cached();
 
         do {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid = 0;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n_pids = 0, i;
                 done = true;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                r = cg_read_pids(controller, path, &pids, &n_pids);
                 if (r < 0) {
                         if (ret >= 0 && r != -ENOENT)
                                 return r;
@@ -257,7 +435,8 @@ int cg_kill(
                         return ret;
                 }
 
-                while ((r = cg_read_pid(f, &pid)) > 0) {
+                for (i = 0; i < n_pids; i++) {
+                        pid_t pid = pids[i];
 
                         if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
                                 continue;
@@ -292,13 +471,6 @@ int cg_kill(
                         }
                 }
 
-                if (r < 0) {
-                        if (ret >= 0)
-                                return r;
-
-                        return ret;
-                }
-
                 /* To avoid racing against processes which fork
                  * quicker than we can kill them we repeat this until
                  * no new pids need to be killed. */
@@ -984,11 +1156,11 @@ int cg_get_xattr(const char *controller, const char *path, const char *name, voi
 }
 
 int cg_pid_get_path(const char *controller, pid_t pid, char **path) {
-        _cleanup_fclose_ FILE *f = NULL;
-        char line[LINE_MAX];
+        _cleanup_free_ char *content = NULL;
         const char *fs, *controller_str;
+        char *p, *line;
         size_t cs = 0;
-        int unified;
+        int unified, r;
 
         assert(path);
         assert(pid >= 0);
@@ -1011,17 +1183,16 @@ int cg_pid_get_path(const char *controller, pid_t pid, char **path) {
                 cs = strlen(controller_str);
         }
 
+        /* This is called for every message logged, every notification received and every client connecting, hence
+         * read the file in one go rather than line by line through stdio */
         fs = procfs_file_alloca(pid, "cgroup");
-        f = fopen(fs, "re");
-        if (!f)
-                return errno == ENOENT ? -ESRCH : -errno;
-
-        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-
-        FOREACH_LINE(line, f, return -errno) {
-                char *e, *p;
+        r = read_virtual_file_at(AT_FDCWD, fs, &content);
+        if (r < 0)
+                return r == -ENOENT ? -ESRCH : r;
 
-                truncate_nl(line);
+        p = content;
+        while ((line = strsep(&p, "\n"))) {
+                char *e, *q;
 
                 if (unified) {
                         e = startswith(line, "0:");
@@ -1056,16 +1227,16 @@ int cg_pid_get_path(const char *controller, pid_t pid, char **path) {
                                 continue;
                 }
 
-                p = strdup(e + 1);
-                if (!p)
+                q = strdup(e + 1);
+                if (!q)
                         return -ENOMEM;
 
                 /* Truncate suffix indicating the process is a zombie */
-                e = endswith(p, " (deleted)");
+                e = endswith(q, " (deleted)");
                 if (e)
                         *e = 0;
 
-                *path = p;
+                *path = q;
                 return 0;
         }
 
@@ -127,6 +127,8 @@ typedef enum CGroupUnified {
 
 int cg_enumerate_processes(const char *controller, const char *path, FILE **_f);
 int cg_read_pid(FILE *f, pid_t *_pid);
+int cg_read_pids(const char *controller, const char *path, pid_t **ret, size_t *ret_n);
+int cg_read_pids_at(int dir_fd, pid_t **ret, size_t *ret_n);
 int cg_read_event(const char *controller, const char *path, const char *event,
                   char **val);
 
@@ -169,6 +171,12 @@ int cg_set_attribute(const char *controller, const char *path, const char *attri
 int cg_get_attribute(const char *controller, const char *path, const char *attribute, char **ret);
 int cg_get_keyed_attribute(const char *controller, const char *path, const char *attribute, char **keys, char **values);
 
+int cg_open(const char *controller, const char *path);
+int cg_get_attribute_at(int dir_fd, const char *attribute, char **ret);
+
+int cg_path_get_cgroupid(const char *path, uint64_t *ret);
+int cg_fd_get_cgroupid(int fd, uint64_t *ret);
+
 int cg_set_access(const char *controller, const char *path, uid_t uid, gid_t gid);
 
 int cg_set_xattr(const char *controller, const char *path, const char *name, const void *value, size_t size, int flags);
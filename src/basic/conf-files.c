@@ -2,6 +2,8 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,13 +18,157 @@
 #include "macro.h"
 #include "missing.h"
 #include "path-util.h"
+#include "refcnt.h"
 #include "set.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "util.h"
 
+/* Many programs enumerate the same directories again and again, PID 1 for example looks at the drop-in
+ * directories of all units on every reload. Hence, remember the names found in each directory, and only read it
+ * again if it changed since. Whether an entry is a mask, or of the right type, or executable may change without the
+ * directory changing, hence that's still checked on every call. */
+
+#define DIRECTORY_CACHE_MAX 1024U
+
+/* Timestamps have a limited granularity, thus if a directory was changed very recently, it might be changed again
+ * without the timestamp changing. Don't cache such directories. */
+#define DIRECTORY_CHANGE_GRANULARITY_USEC (2 * USEC_PER_SEC)
+
+typedef struct DirectoryListing {
+        RefCount n_ref;
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        usec_t ctime;
+        char **names;
+} DirectoryListing;
+
+static pthread_mutex_t directory_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Hashmap *directory_cache = NULL;
+
+static DirectoryListing *directory_listing_unref(DirectoryListing *l) {
+        if (!l)
+                return NULL;
+
+        if (REFCNT_DEC(l->n_ref) > 0)
+                return NULL;
+
+        free(l->path);
+        strv_free(l->names);
+        return mfree(l);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DirectoryListing*, directory_listing_unref);
+
+static bool directory_listing_matches(DirectoryListing *l, const struct stat *st) {
+        return l->dev == st->st_dev &&
+               l->ino == st->st_ino &&
+               l->ctime == timespec_load(&st->st_ctim);
+}
+
+static DirectoryListing *directory_cache_get(const char *path, const struct stat *st) {
+        DirectoryListing *l;
+
+        assert_se(pthread_mutex_lock(&directory_cache_mutex) == 0);
+
+        l = hashmap_get(directory_cache, path);
+        if (l && directory_listing_matches(l, st))
+                REFCNT_INC(l->n_ref);
+        else
+                l = NULL;
+
+        assert_se(pthread_mutex_unlock(&directory_cache_mutex) == 0);
+
+        return l;
+}
+
+static void directory_cache_put(DirectoryListing *l) {
+        DirectoryListing *old;
+
+        assert_se(pthread_mutex_lock(&directory_cache_mutex) == 0);
+
+        old = hashmap_remove(directory_cache, l->path);
+        if (old)
+                directory_listing_unref(old);
+        else if (hashmap_size(directory_cache) >= DIRECTORY_CACHE_MAX) {
+                /* Something enumerates a lot of different directories, don't let the cache grow without bounds */
+                while ((old = hashmap_steal_first(directory_cache)))
+                        directory_listing_unref(old);
+        }
+
+        if (hashmap_ensure_allocated(&directory_cache, &path_hash_ops) >= 0 &&
+            hashmap_put(directory_cache, l->path, l) >= 0)
+                REFCNT_INC(l->n_ref);
+
+        assert_se(pthread_mutex_unlock(&directory_cache_mutex) == 0);
+}
+
+static int directory_listing_get(int fd, const char *path, DirectoryListing **ret) {
+        _cleanup_(directory_listing_unrefp) DirectoryListing *l = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        size_t n_allocated = 0, n = 0;
+        struct dirent *de;
+        struct stat st;
+        int dfd;
+
+        assert(fd >= 0);
+        assert(path);
+        assert(ret);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        l = directory_cache_get(path, &st);
+        if (l) {
+                *ret = TAKE_PTR(l);
+                return 0;
+        }
+
+        l = new0(DirectoryListing, 1);
+        if (!l)
+                return -ENOMEM;
+
+        l->n_ref = REFCNT_INIT;
+        l->dev = st.st_dev;
+        l->ino = st.st_ino;
+        l->ctime = timespec_load(&st.st_ctim);
+
+        l->path = strdup(path);
+        if (!l->path)
+                return -ENOMEM;
+
+        dfd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (dfd < 0)
+                return -errno;
+
+        dir = fdopendir(dfd);
+        if (!dir) {
+                safe_close(dfd);
+                return -errno;
+        }
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                if (!GREEDY_REALLOC(l->names, n_allocated, n + 2))
+                        return -ENOMEM;
+
+                l->names[n] = strdup(de->d_name);
+                if (!l->names[n])
+                        return -ENOMEM;
+
+                l->names[++n] = NULL;
+        }
+
+        if (usec_add(l->ctime, DIRECTORY_CHANGE_GRANULARITY_USEC) < now(CLOCK_REALTIME))
+                directory_cache_put(l);
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
 static int files_add(
                 Hashmap *h,
                 Set *masked,
@@ -31,9 +177,10 @@ static int files_add(
                 unsigned flags,
                 const char *path) {
 
-        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_(directory_listing_unrefp) DirectoryListing *l = NULL;
+        _cleanup_close_ int fd = -1;
         const char *dirpath;
-        struct dirent *de;
+        char **name;
         int r;
 
         assert(h);
@@ -42,38 +189,42 @@ static int files_add(
 
         dirpath = prefix_roota(root, path);
 
-        dir = opendir(dirpath);
-        if (!dir) {
+        fd = open(dirpath, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
                 if (errno == ENOENT)
                         return 0;
 
                 return log_debug_errno(errno, "Failed to open directory '%s': %m", dirpath);
         }
 
-        FOREACH_DIRENT(de, dir, return -errno) {
+        r = directory_listing_get(fd, dirpath, &l);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to enumerate directory '%s': %m", dirpath);
+
+        STRV_FOREACH(name, l->names) {
                 struct stat st;
                 char *p, *key;
 
                 /* Does this match the suffix? */
-                if (suffix && !endswith(de->d_name, suffix))
+                if (suffix && !endswith(*name, suffix))
                         continue;
 
                 /* Has this file already been found in an earlier directory? */
-                if (hashmap_contains(h, de->d_name)) {
-                        log_debug("Skipping overridden file '%s/%s'.", dirpath, de->d_name);
+                if (hashmap_contains(h, *name)) {
+                        log_debug("Skipping overridden file '%s/%s'.", dirpath, *name);
                         continue;
                 }
 
                 /* Has this been masked in an earlier directory? */
-                if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, de->d_name)) {
-                        log_debug("File '%s/%s' is masked by previous entry.", dirpath, de->d_name);
+                if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, *name)) {
+                        log_debug("File '%s/%s' is masked by previous entry.", dirpath, *name);
                         continue;
                 }
 
                 /* Read file metadata if we shall validate the check for file masks, for node types or whether the node is marked executable. */
                 if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))
-                        if (fstatat(dirfd(dir), de->d_name, &st, 0) < 0) {
-                                log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, de->d_name);
+                        if (fstatat(fd, *name, &st, 0) < 0) {
+                                log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, *name);
                                 continue;
                         }
 
@@ -81,11 +232,11 @@ static int files_add(
                 if ((flags & CONF_FILES_FILTER_MASKED))
                         if (null_or_empty(&st)) {
                                 /* Mark this one as masked */
-                                r = set_put_strdup(masked, de->d_name);
+                                r = set_put_strdup(masked, *name);
                                 if (r < 0)
                                         return r;
 
-                                log_debug("File '%s/%s' is a mask.", dirpath, de->d_name);
+                                log_debug("File '%s/%s' is a mask.", dirpath, *name);
                                 continue;
                         }
 
@@ -93,7 +244,7 @@ static int files_add(
                 if (flags & (CONF_FILES_REGULAR|CONF_FILES_DIRECTORY))
                         if (!((flags & CONF_FILES_DIRECTORY) && S_ISDIR(st.st_mode)) &&
                             !((flags & CONF_FILES_REGULAR) && S_ISREG(st.st_mode))) {
-                                log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, de->d_name);
+                                log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, *name);
                                 continue;
                         }
 
@@ -104,18 +255,18 @@ static int files_add(
                          * executable for us, because if so, such errors are stuff we should log about. */
 
                         if ((st.st_mode & 0111) == 0) { /* not executable */
-                                log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, de->d_name);
+                                log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, *name);
                                 continue;
                         }
 
                 if (flags & CONF_FILES_BASENAME) {
-                        p = strdup(de->d_name);
+                        p = strdup(*name);
                         if (!p)
                                 return -ENOMEM;
 
                         key = p;
                 } else {
-                        p = strjoin(dirpath, "/", de->d_name);
+                        p = strjoin(dirpath, "/", *name);
                         if (!p)
                                 return -ENOMEM;
 
@@ -85,6 +85,34 @@ static int fd_is_nonblock_pipe(int fd) {
         return FLAGS_SET(flags, O_NONBLOCK) ? FD_IS_NONBLOCKING_PIPE : FD_IS_BLOCKING_PIPE;
 }
 
+static int create_hole(int fd, off_t size) {
+        off_t offset, end;
+
+        /* Skips over size bytes in the output, leaving a hole there. Existing data in the way is punched out. */
+
+        offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0)
+                return -errno;
+
+        end = lseek(fd, 0, SEEK_END);
+        if (end < 0)
+                return -errno;
+
+        if (offset < end &&
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, MIN(size, end - offset)) < 0)
+                return -errno;
+
+        /* Grow the file if the hole extends beyond its end, so that trailing holes are kept too */
+        if (offset + size > end &&
+            ftruncate(fd, offset + size) < 0)
+                return -errno;
+
+        if (lseek(fd, offset + size, SEEK_SET) < 0)
+                return -errno;
+
+        return 0;
+}
+
 int copy_bytes_full(
                 int fdf, int fdt,
                 uint64_t max_bytes,
@@ -92,7 +120,7 @@ int copy_bytes_full(
                 void **ret_remains,
                 size_t *ret_remains_size) {
 
-        bool try_cfr = true, try_sendfile = true, try_splice = true;
+        bool try_cfr = true, try_sendfile = true, try_splice = true, sparse = false;
         int r, nonblock_pipe = -1;
         size_t m = SSIZE_MAX; /* that is the maximum that sendfile and c_f_r accept */
 
@@ -167,18 +195,95 @@ int copy_bytes_full(
                 }
         }
 
+        /* Looking for holes only makes sense when copying between regular files. If the source is a stream we
+         * can't ask it where holes are, but if we are appending to a regular file we can still skip over runs of
+         * zeroes, instead of writing them out. */
+        if (copy_flags & COPY_HOLES) {
+                struct stat a, b;
+
+                if (fstat(fdf, &a) < 0 || fstat(fdt, &b) < 0)
+                        return -errno;
+
+                if (!S_ISREG(a.st_mode) && S_ISREG(b.st_mode) && !ret_remains) {
+                        off_t offset;
+
+                        offset = lseek(fdt, 0, SEEK_CUR);
+                        if (offset < 0)
+                                return -errno;
+
+                        /* Skipping only leaves zeroes behind if there's no data in the way yet */
+                        sparse = offset >= b.st_size;
+                }
+
+                if (sparse)
+                        try_cfr = try_sendfile = try_splice = false;
+
+                if (!S_ISREG(a.st_mode) || !S_ISREG(b.st_mode))
+                        copy_flags &= ~COPY_HOLES;
+        }
+
         for (;;) {
+                size_t chunk;
                 ssize_t n;
 
                 if (max_bytes <= 0)
-                        return 1; /* return > 0 if we hit the max_bytes limit */
+                        break;
 
                 if (max_bytes != UINT64_MAX && m > max_bytes)
                         m = max_bytes;
 
+                chunk = m;
+
+                if (copy_flags & COPY_HOLES) {
+                        off_t c, e;
+
+                        c = lseek(fdf, 0, SEEK_CUR);
+                        if (c < 0)
+                                return -errno;
+
+                        /* If the next data is not right here, we are in a hole */
+                        e = lseek(fdf, c, SEEK_DATA);
+                        if (e < 0 && errno == ENXIO) /* Nothing but a hole until the end of the file */
+                                e = lseek(fdf, 0, SEEK_END);
+                        if (e < 0)
+                                return -errno;
+
+                        if (e > c) {
+                                if (max_bytes != UINT64_MAX && (uint64_t) (e - c) > max_bytes)
+                                        e = c + max_bytes;
+
+                                r = create_hole(fdt, e - c);
+                                if (r < 0)
+                                        return r;
+
+                                if (lseek(fdf, e, SEEK_SET) < 0)
+                                        return -errno;
+
+                                if (max_bytes != UINT64_MAX)
+                                        max_bytes -= e - c;
+
+                                continue;
+                        }
+
+                        /* We are in data, copy it up to where the next hole begins */
+                        e = lseek(fdf, c, SEEK_HOLE);
+                        if (e < 0) {
+                                if (errno == ENXIO) /* EOF */
+                                        break;
+
+                                return -errno;
+                        }
+
+                        if (lseek(fdf, c, SEEK_SET) < 0)
+                                return -errno;
+
+                        if ((uint64_t) (e - c) < chunk)
+                                chunk = e - c;
+                }
+
                 /* First try copy_file_range(), unless we already tried */
                 if (try_cfr) {
-                        n = try_copy_file_range(fdf, NULL, fdt, NULL, m, 0u);
+                        n = try_copy_file_range(fdf, NULL, fdt, NULL, chunk, 0u);
                         if (n < 0) {
                                 if (!IN_SET(n, -EINVAL, -ENOSYS, -EXDEV, -EBADF))
                                         return n;
@@ -194,7 +299,7 @@ int copy_bytes_full(
 
                 /* First try sendfile(), unless we already tried */
                 if (try_sendfile) {
-                        n = sendfile(fdt, fdf, NULL, m);
+                        n = sendfile(fdt, fdf, NULL, chunk);
                         if (n < 0) {
                                 if (!IN_SET(errno, EINVAL, ENOSYS))
                                         return -errno;
@@ -252,7 +357,7 @@ int copy_bytes_full(
                 }
 
                 if (try_splice) {
-                        n = splice(fdf, NULL, fdt, NULL, m, nonblock_pipe ? SPLICE_F_NONBLOCK : 0);
+                        n = splice(fdf, NULL, fdt, NULL, chunk, nonblock_pipe ? SPLICE_F_NONBLOCK : 0);
                         if (n < 0) {
                                 if (!IN_SET(errno, EINVAL, ENOSYS))
                                         return -errno;
@@ -268,7 +373,7 @@ int copy_bytes_full(
 
                 /* As a fallback just copy bits by hand */
                 {
-                        uint8_t buf[MIN(m, COPY_BUFFER_SIZE)], *p = buf;
+                        uint8_t buf[MIN(chunk, COPY_BUFFER_SIZE)], *p = buf;
                         ssize_t z;
 
                         n = read(fdf, buf, sizeof buf);
@@ -277,6 +382,14 @@ int copy_bytes_full(
                         if (n == 0) /* EOF */
                                 break;
 
+                        if (sparse) {
+                                z = sparse_write(fdt, buf, n, 64);
+                                if (z < 0)
+                                        return z;
+
+                                goto next;
+                        }
+
                         z = (size_t) n;
                         do {
                                 ssize_t k;
@@ -319,7 +432,20 @@ int copy_bytes_full(
                 m = MAX(MIN(COPY_BUFFER_SIZE, max_bytes), m - n);
         }
 
-        return 0; /* return 0 if we hit EOF earlier than the size limit */
+        if (sparse) {
+                off_t offset;
+
+                /* If we skipped over zeroes at the end, the file doesn't cover them yet */
+                offset = lseek(fdt, 0, SEEK_CUR);
+                if (offset < 0)
+                        return -errno;
+
+                if (ftruncate(fdt, offset) < 0)
+                        return -errno;
+        }
+
+        /* Return > 0 if we hit the max_bytes limit, and 0 if we hit EOF earlier than that */
+        return max_bytes <= 0;
 }
 
 static int fd_copy_symlink(
@@ -11,6 +11,8 @@ typedef enum CopyFlags {
         COPY_MERGE      = 1 << 1, /* Merge existing trees with our new one to copy */
         COPY_REPLACE    = 1 << 2, /* Replace an existing file if there's one */
         COPY_SAME_MOUNT = 1 << 3, /* Don't descend recursively into other file systems, across mount point boundaries */
+        COPY_HOLES      = 1 << 4, /* Keep holes in regular files as they are, instead of filling them with zeroes. When
+                                   * copying a stream to the end of a regular file, skip runs of zeroes instead. */
 } CopyFlags;
 
 int copy_file_fd(const char *from, int to, CopyFlags copy_flags);
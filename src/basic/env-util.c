@@ -154,6 +154,30 @@ bool strv_env_name_or_assignment_is_valid(char **l) {
         return true;
 }
 
+static char **env_slot(char **r, char ***k, const char *a) {
+        char **j;
+        size_t n;
+
+        /* Returns where to put a in r: the existing entry for the same variable, which is freed, or a new one
+         * at *k. This assumes there is enough space in the r array. */
+
+        n = strcspn(a, "=");
+
+        if (a[n] == '=')
+                n++;
+
+        for (j = r; j < *k; j++)
+                if (strneq(*j, a, n))
+                        break;
+
+        if (j >= *k)
+                (*k)++;
+        else
+                free(*j);
+
+        return j;
+}
+
 static int env_append(char **r, char ***k, char **a) {
         assert(r);
         assert(k);
@@ -167,21 +191,8 @@ static int env_append(char **r, char ***k, char **a) {
 
         for (; *a; a++) {
                 char **j;
-                size_t n;
 
-                n = strcspn(*a, "=");
-
-                if ((*a)[n] == '=')
-                        n++;
-
-                for (j = r; j < *k; j++)
-                        if (strneq(*j, *a, n))
-                                break;
-
-                if (j >= *k)
-                        (*k)++;
-                else
-                        free(*j);
+                j = env_slot(r, k, *a);
 
                 *j = strdup(*a);
                 if (!*j)
@@ -231,6 +242,50 @@ fail:
         return NULL;
 }
 
+int strv_env_merge_consume(char ***l, char **a) {
+        char **r, **k, **i;
+        size_t n;
+
+        assert(l);
+
+        /* Like strv_env_merge() for two lists, but merges a into *l in place, and takes possession of a and its
+         * strings instead of copying them. a is freed in any case. Unlike strv_env_merge(), this expects *l to
+         * not contain any variable twice already, which is the case for the result of strv_env_clean(). */
+
+        if (strv_isempty(a)) {
+                strv_free(a);
+                return 0;
+        }
+
+        if (!*l) {
+                *l = a;
+                return 0;
+        }
+
+        n = strv_length(*l);
+
+        r = reallocarray(*l, n + strv_length(a) + 1, sizeof(char*));
+        if (!r) {
+                strv_free(a);
+                return -ENOMEM;
+        }
+
+        *l = r;
+        k = r + n;
+
+        for (i = a; *i; i++) {
+                char **j;
+
+                j = env_slot(r, &k, *i);
+                *j = *i;
+        }
+
+        *k = NULL;
+        free(a);
+
+        return 0;
+}
+
 static bool env_match(const char *t, const char *pattern) {
         assert(t);
         assert(pattern);
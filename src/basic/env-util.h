@@ -33,6 +33,7 @@ bool strv_env_name_is_valid(char **l);
 bool strv_env_name_or_assignment_is_valid(char **l);
 
 char **strv_env_merge(size_t n_lists, ...);
+int strv_env_merge_consume(char ***l, char **a); /* In place ... */
 char **strv_env_delete(char **x, size_t n_lists, ...); /* New copy */
 
 char **strv_env_set(char **x, const char *p); /* New copy ... */
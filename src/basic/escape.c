@@ -88,8 +88,15 @@ char *cescape_length(const char *s, size_t n) {
         if (!r)
                 return NULL;
 
-        for (f = s, t = r; f < s + n; f++)
+        for (f = s, t = r; f < s + n; f++) {
+                /* Shortcut for the characters cescape_char() would copy as they are */
+                if (*f >= ' ' && *f < 127 && !IN_SET(*f, '\\', '"', '\'')) {
+                        *(t++) = *f;
+                        continue;
+                }
+
                 t += cescape_char(*f, t);
+        }
 
         *t = 0;
 
@@ -6,7 +6,6 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-table.h"
-#include "gunicode.h"
 #include "pager.h"
 #include "parse-util.h"
 #include "string-util.h"
@@ -59,6 +58,7 @@ typedef struct TableData {
 
         const char *color;          /* ANSI color string to use for this cell. When written to terminal should not move cursor. Will automatically be reset after the cell */
         char *formatted;            /* A cached textual representation of the cell data, before ellipsation/alignment */
+        size_t formatted_width;     /* The cached width of the textual representation on screen, or (size_t) -1 */
 
         union {
                 uint8_t data[0];    /* data is generic array */
@@ -290,6 +290,7 @@ static TableData *table_data_new(
         d->weight = weight;
         d->align_percent = align_percent;
         d->ellipsize_percent = ellipsize_percent;
+        d->formatted_width = (size_t) -1;
         memcpy_safe(d->data, data, data_size);
 
         return d;
@@ -738,15 +739,7 @@ static int table_data_compare(const void *x, const void *y, void *userdata) {
         assert(t);
         assert(t->sort_map);
 
-        /* Make sure the header stays at the beginning */
-        if (*a < t->n_columns && *b < t->n_columns)
-                return 0;
-        if (*a < t->n_columns)
-                return -1;
-        if (*b < t->n_columns)
-                return 1;
-
-        /* Order other lines by the sorting map */
+        /* Order lines by the sorting map */
         for (i = 0; i < t->n_sort_map; i++) {
                 TableData *d, *dd;
 
@@ -844,75 +837,45 @@ static const char *table_data_format(TableData *d) {
         return d->formatted;
 }
 
-static int table_data_requested_width(TableData *d, size_t *ret) {
+static int table_data_console_width(TableData *d, size_t *ret) {
         const char *t;
-        size_t l;
 
-        t = table_data_format(d);
-        if (!t)
-                return -ENOMEM;
+        assert(d);
+        assert(ret);
 
-        l = utf8_console_width(t);
-        if (l == (size_t) -1)
-                return -EINVAL;
+        /* Cells are usually shared between rows when they have the same contents, and both passes of
+         * table_print() need the width, hence calculate it only once. */
 
-        if (d->maximum_width != (size_t) -1 && l > d->maximum_width)
-                l = d->maximum_width;
+        if (d->formatted_width == (size_t) -1) {
+                t = table_data_format(d);
+                if (!t)
+                        return -ENOMEM;
 
-        if (l < d->minimum_width)
-                l = d->minimum_width;
+                d->formatted_width = utf8_console_width(t);
+                if (d->formatted_width == (size_t) -1)
+                        return -EINVAL;
+        }
 
-        *ret = l;
+        *ret = d->formatted_width;
         return 0;
 }
 
-static char *align_string_mem(const char *str, size_t new_length, unsigned percent) {
-        size_t w = 0, space, lspace, old_length;
-        const char *p;
-        char *ret;
-        size_t i;
-
-        /* As with ellipsize_mem(), 'old_length' is a byte size while 'new_length' is a width in character cells */
-
-        assert(str);
-        assert(percent <= 100);
-
-        old_length = strlen(str);
-
-        /* Determine current width on screen */
-        p = str;
-        while (p < str + old_length) {
-                char32_t c;
-
-                if (utf8_encoded_to_unichar(p, &c) < 0) {
-                        p++, w++; /* count invalid chars as 1 */
-                        continue;
-                }
-
-                p = utf8_next_char(p);
-                w += unichar_iswide(c) ? 2 : 1;
-        }
-
-        /* Already wider than the target, if so, don't do anything */
-        if (w >= new_length)
-                return strndup(str, old_length);
+static int table_data_requested_width(TableData *d, size_t *ret) {
+        size_t l;
+        int r;
 
-        /* How much spaces shall we add? An how much on the left side? */
-        space = new_length - w;
-        lspace = space * percent / 100U;
+        r = table_data_console_width(d, &l);
+        if (r < 0)
+                return r;
 
-        ret = new(char, space + old_length + 1);
-        if (!ret)
-                return NULL;
+        if (d->maximum_width != (size_t) -1 && l > d->maximum_width)
+                l = d->maximum_width;
 
-        for (i = 0; i < lspace; i++)
-                ret[i] = ' ';
-        memcpy(ret + lspace, str, old_length);
-        for (i = lspace + old_length; i < space + old_length; i++)
-                ret[i] = ' ';
+        if (l < d->minimum_width)
+                l = d->minimum_width;
 
-        ret[space + old_length] = 0;
-        return ret;
+        *ret = l;
+        return 0;
 }
 
 int table_print(Table *t, FILE *f) {
@@ -944,7 +907,8 @@ int table_print(Table *t, FILE *f) {
                 for (i = 0; i < n_rows; i++)
                         sorted[i] = i * t->n_columns;
 
-                qsort_r_safe(sorted, n_rows, sizeof(size_t), table_data_compare, t);
+                /* The header always stays at the beginning */
+                qsort_r_safe(sorted + 1, n_rows - 1, sizeof(size_t), table_data_compare, t);
         }
 
         if (t->display_map)
@@ -1141,9 +1105,9 @@ int table_print(Table *t, FILE *f) {
 
                 for (j = 0; j < display_columns; j++) {
                         _cleanup_free_ char *buffer = NULL;
+                        size_t l, lspace = 0, rspace = 0;
                         const char *field;
                         TableData *d;
-                        size_t l;
 
                         assert_se(d = row[t->display_map ? t->display_map[j] : j]);
 
@@ -1151,7 +1115,10 @@ int table_print(Table *t, FILE *f) {
                         if (!field)
                                 return -ENOMEM;
 
-                        l = utf8_console_width(field);
+                        r = table_data_console_width(d, &l);
+                        if (r < 0)
+                                return r;
+
                         if (l > width[j]) {
                                 /* Field is wider than allocated space. Let's ellipsize */
 
@@ -1162,13 +1129,11 @@ int table_print(Table *t, FILE *f) {
                                 field = buffer;
 
                         } else if (l < width[j]) {
-                                /* Field is shorter than allocated space. Let's align with spaces */
+                                /* Field is shorter than allocated space. Let's align with spaces, which we write
+                                 * out directly rather than building a padded copy of the field for every cell. */
 
-                                buffer = align_string_mem(field, width[j], d->align_percent);
-                                if (!buffer)
-                                        return -ENOMEM;
-
-                                field = buffer;
+                                lspace = (width[j] - l) * d->align_percent / 100U;
+                                rspace = width[j] - l - lspace;
                         }
 
                         if (j > 0)
@@ -1177,8 +1142,14 @@ int table_print(Table *t, FILE *f) {
                         if (d->color)
                                 fputs(d->color, f);
 
+                        if (lspace > 0)
+                                fprintf(f, "%*s", (int) lspace, "");
+
                         fputs(field, f);
 
+                        if (rspace > 0)
+                                fprintf(f, "%*s", (int) rspace, "");
+
                         if (d->color)
                                 fputs(ansi_normal(), f);
                 }
@@ -4,6 +4,7 @@
 
 #include "hash-funcs.h"
 #include "path-util.h"
+#include "string-util.h"
 
 void string_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(p, strlen(p) + 1, state);
@@ -19,8 +20,7 @@ const struct hash_ops string_hash_ops = {
 };
 
 void path_hash_func(const void *p, struct siphash *state) {
-        const char *q = p;
-        size_t n;
+        const char *q = p, *run, *e;
 
         assert(q);
         assert(state);
@@ -28,36 +28,44 @@ void path_hash_func(const void *p, struct siphash *state) {
         /* Calculates a hash for a path in a way this duplicate inner slashes don't make a differences, and also
          * whether there's a trailing slash or not. This fits well with the semantics of path_compare(), which does
          * similar checks and also doesn't care for trailing slashes. Note that relative and absolute paths (i.e. those
-         * which begin in a slash or not) will hash differently though. */
-
-        n = strspn(q, "/");
-        if (n > 0) { /* Eat up initial slashes, and add one "/" to the hash for all of them */
-                siphash24_compress(q, 1, state);
-                q += n;
-        }
+         * which begin in a slash or not) will hash differently though.
+         *
+         * Since hashing data in pieces is the same as hashing it in one go, we only need to split up the path
+         * where slashes are skipped. For paths that are already normalized, that's never. */
 
+        run = q;
         for (;;) {
-                /* Determine length of next component */
-                n = strcspn(q, "/");
-                if (n == 0) /* Reached the end? */
+                q = strchrnul(q, '/');
+                if (*q == 0) /* Reached the end? */
                         break;
 
-                /* Add this component to the hash and skip over it */
-                siphash24_compress(q, n, state);
-                q += n;
-
-                /* How many slashes follow this component? */
-                n = strspn(q, "/");
-                if (q[n] == 0) /* Is this a trailing slash? If so, we are at the end, and don't care about the slashes anymore */
+                /* How many slashes follow? */
+                for (e = q + 1; *e == '/'; e++)
+                        ;
+                if (*e == 0) { /* Is this a trailing slash? If so, we are at the end, and don't care about the slashes anymore */
+                        if (q == p) /* … unless there's nothing but slashes, i.e. this is the root directory */
+                                q++;
                         break;
+                }
 
-                /* We are not add the end yet. Hash exactly one slash for all of the ones we just encountered. */
-                siphash24_compress(q, 1, state);
-                q += n;
+                /* We are not at the end yet. Hash exactly one slash for all of the ones we just encountered. */
+                if (e > q + 1) {
+                        siphash24_compress(run, q + 1 - run, state);
+                        run = e;
+                }
+
+                q = e;
         }
+
+        siphash24_compress(run, q - run, state);
 }
 
 int path_compare_func(const void *a, const void *b) {
+        /* Lookups are mostly done with the very same string as the key, which is much cheaper to check
+         * than comparing component by component */
+        if (streq(a, b))
+                return 0;
+
         return path_compare(a, b);
 }
 
@@ -6,7 +6,6 @@
 #include <string.h>
 
 #include "alloc-util.h"
-#include "env-util.h"
 #include "fileio.h"
 #include "hashmap.h"
 #include "macro.h"
@@ -190,12 +189,11 @@ assert_cc(DIRECT_BUCKETS(struct ordered_hashmap_entry) >= 1);
 /* We have 3 bits for n_direct_entries. */
 assert_cc(DIRECT_BUCKETS(struct set_entry) < (1 << 3));
 
-/* Hashmaps with directly stored entries all use this shared hash key.
- * It's no big deal if the key is guessed, because there can be only
- * a handful of directly stored entries in a hashmap. When a hashmap
- * outgrows direct storage, it gets its own key for indirect storage. */
-static uint8_t shared_hash_key[HASH_KEY_SIZE];
-static bool shared_hash_key_initialized;
+/* Hashmaps with directly stored entries don't hash their keys at all: all entries are considered to hash to the
+ * first bucket, so that the direct storage is just a small array that is scanned linearly, in the order the
+ * entries were added. With only a handful of entries that's cheaper than calculating a hash, and nothing can
+ * be gained by guessing the order anyway. When a hashmap outgrows direct storage, it gets its own key for
+ * indirect storage. */
 
 /* Fields that all hashmap/set types must have */
 struct HashmapBase {
@@ -210,7 +208,6 @@ struct HashmapBase {
         bool has_indirect:1;         /* whether indirect storage is used */
         unsigned n_direct_entries:3; /* Number of entries in direct storage.
                                       * Only valid if !has_indirect. */
-        bool from_pool:1;            /* whether was allocated from mempool */
         bool dirty:1;                /* whether dirtied since last iterated_cache_get() */
         bool cached:1;               /* whether this hashmap is being cached */
         HASHMAP_DEBUG_FIELDS         /* optional hashmap_debug_info */
@@ -243,15 +240,15 @@ struct IteratedCache {
         CacheMem keys, values;
 };
 
-DEFINE_MEMPOOL(hashmap_pool,         Hashmap,        8);
-DEFINE_MEMPOOL(ordered_hashmap_pool, OrderedHashmap, 8);
+DEFINE_THREADED_MEMPOOL(hashmap_pool,         Hashmap,        8);
+DEFINE_THREADED_MEMPOOL(ordered_hashmap_pool, OrderedHashmap, 8);
 /* No need for a separate Set pool */
 assert_cc(sizeof(Hashmap) == sizeof(Set));
 
 struct hashmap_type_info {
         size_t head_size;
         size_t entry_size;
-        struct mempool *mempool;
+        struct threaded_mempool *mempool;
         unsigned n_direct_buckets;
 };
 
@@ -283,9 +280,8 @@ __attribute__((destructor)) static void cleanup_pools(void) {
 
         /* Be nice to valgrind */
 
-        /* The pool is only allocated by the main thread, but the memory can
-         * be passed to other threads. Let's clean up if we are the main thread
-         * and no other threads are live. */
+        /* Tiles can be passed between threads. Let's clean up if we are the
+         * main thread and no other threads are live. */
         if (!is_main_thread())
                 return;
 
@@ -293,8 +289,8 @@ __attribute__((destructor)) static void cleanup_pools(void) {
         if (r < 0 || !streq(t, "1"))
                 return;
 
-        mempool_drop(&hashmap_pool);
-        mempool_drop(&ordered_hashmap_pool);
+        threaded_mempool_drop(&hashmap_pool);
+        threaded_mempool_drop(&ordered_hashmap_pool);
 }
 #endif
 
@@ -327,22 +323,22 @@ static void *storage_ptr(HashmapBase *h) {
                                : h->direct.storage;
 }
 
-static uint8_t *hash_key(HashmapBase *h) {
-        return h->has_indirect ? h->indirect.hash_key
-                               : shared_hash_key;
-}
-
 static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (!h->has_indirect)
+                return 0;
+
+        siphash24_init(&state, h->indirect.hash_key);
 
         h->hash_ops->hash(p, &state);
 
         hash = siphash24_finalize(&state);
 
-        return (unsigned) (hash % n_buckets(h));
+        /* Map the hash onto the buckets with a multiplication instead of a much slower 64bit division. This
+         * uses the upper 32 bits of the hash, which SipHash distributes as evenly as the lower ones. */
+        return (unsigned) (((hash >> 32) * n_buckets(h)) >> 32);
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
@@ -767,31 +763,15 @@ static void reset_direct_storage(HashmapBase *h) {
         memset(p, DIB_RAW_INIT, sizeof(dib_raw_t) * hi->n_direct_buckets);
 }
 
-static bool use_pool(void) {
-        static int b = -1;
-
-        if (!is_main_thread())
-                return false;
-
-        if (b < 0)
-                b = getenv_bool("SYSTEMD_MEMPOOL") != 0;
-
-        return b;
-}
-
 static struct HashmapBase *hashmap_base_new(const struct hash_ops *hash_ops, enum HashmapType type HASHMAP_DEBUG_PARAMS) {
         HashmapBase *h;
         const struct hashmap_type_info *hi = &hashmap_type_info[type];
-        bool up;
-
-        up = use_pool();
 
-        h = up ? mempool_alloc0_tile(hi->mempool) : malloc0(hi->head_size);
+        h = threaded_mempool_alloc0_tile(hi->mempool);
         if (!h)
                 return NULL;
 
         h->type = type;
-        h->from_pool = up;
         h->hash_ops = hash_ops ? hash_ops : &trivial_hash_ops;
 
         if (type == HASHMAP_TYPE_ORDERED) {
@@ -801,11 +781,6 @@ static struct HashmapBase *hashmap_base_new(const struct hash_ops *hash_ops, enu
 
         reset_direct_storage(h);
 
-        if (!shared_hash_key_initialized) {
-                random_bytes(shared_hash_key, sizeof(shared_hash_key));
-                shared_hash_key_initialized= true;
-        }
-
 #if ENABLE_DEBUG_HASHMAP
         h->debug.func = func;
         h->debug.file = file;
@@ -869,12 +844,7 @@ static void hashmap_free_no_clear(HashmapBase *h) {
         assert_se(pthread_mutex_unlock(&hashmap_debug_list_mutex) == 0);
 #endif
 
-        if (h->from_pool) {
-                /* Ensure that the object didn't get migrated between threads. */
-                assert_se(is_main_thread());
-                mempool_free_tile(hashmap_type_info[h->type].mempool, h);
-        } else
-                free(h);
+        threaded_mempool_free_tile(hashmap_type_info[h->type].mempool, h);
 }
 
 HashmapBase *internal_hashmap_free(HashmapBase *h) {
@@ -1148,8 +1118,8 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         }
 
         /* Get a new hash key. If we've just upgraded to indirect storage,
-         * allow reusing a previously generated key. It's still a different key
-         * from the shared one that we used for direct storage. */
+         * allow reusing a previously generated key, since the entries of
+         * direct storage weren't hashed at all. */
         get_hash_key(h->indirect.hash_key, !h->has_indirect);
 
         h->has_indirect = true;
@@ -1274,6 +1244,34 @@ int hashmap_put(Hashmap *h, const void *key, void *value) {
         return hashmap_put_boldly(h, hash, &swap, true);
 }
 
+int hashmap_put_many(Hashmap *h, const void * const keys[], void * const values[], unsigned n) {
+        unsigned i;
+        int r, k = 0;
+
+        assert(h);
+        assert(keys || n == 0);
+        assert(values || n == 0);
+
+        /* Adds n entries in one go. The storage is sized for all of them first, so that it's not grown and
+         * rehashed repeatedly while they are added. Returns the number of entries added. If a key is
+         * already in the hashmap with a different value, fails with -EEXIST, but keeps the entries added
+         * until then. */
+
+        r = resize_buckets(HASHMAP_BASE(h), n);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++) {
+                r = hashmap_put(h, keys[i], values[i]);
+                if (r < 0)
+                        return r;
+
+                k += r;
+        }
+
+        return k;
+}
+
 int set_put(Set *s, const void *key) {
         struct swap_entries swap;
         struct hashmap_base_entry *e;
@@ -1856,12 +1854,40 @@ int set_put_strdup(Set *s, const char *p) {
         return set_consume(s, c);
 }
 
+int set_put_many(Set *s, const void * const keys[], unsigned n) {
+        unsigned i;
+        int r, k = 0;
+
+        assert(s);
+        assert(keys || n == 0);
+
+        /* Like hashmap_put_many(), but for sets, where nothing can conflict */
+
+        r = resize_buckets(HASHMAP_BASE(s), n);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++) {
+                r = set_put(s, keys[i]);
+                if (r < 0)
+                        return r;
+
+                k += r;
+        }
+
+        return k;
+}
+
 int set_put_strdupv(Set *s, char **l) {
         int n = 0, r;
         char **i;
 
         assert(s);
 
+        r = resize_buckets(HASHMAP_BASE(s), strv_length(l));
+        if (r < 0)
+                return r;
+
         STRV_FOREACH(i, l) {
                 r = set_put_strdup(s, *i);
                 if (r < 0)
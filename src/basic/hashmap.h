@@ -137,6 +137,11 @@ static inline int ordered_hashmap_put(OrderedHashmap *h, const void *key, void *
         return hashmap_put(PLAIN_HASHMAP(h), key, value);
 }
 
+int hashmap_put_many(Hashmap *h, const void * const keys[], void * const values[], unsigned n);
+static inline int ordered_hashmap_put_many(OrderedHashmap *h, const void * const keys[], void * const values[], unsigned n) {
+        return hashmap_put_many(PLAIN_HASHMAP(h), keys, values, n);
+}
+
 int hashmap_update(Hashmap *h, const void *key, void *value);
 static inline int ordered_hashmap_update(OrderedHashmap *h, const void *key, void *value) {
         return hashmap_update(PLAIN_HASHMAP(h), key, value);
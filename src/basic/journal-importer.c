@@ -35,6 +35,11 @@ static void iovw_free_contents(struct iovec_wrapper *iovw) {
         iovw->size_bytes = iovw->count = 0;
 }
 
+static void iovw_reset(struct iovec_wrapper *iovw) {
+        /* Forget the entries, but keep the array around for the next entry */
+        iovw->count = 0;
+}
+
 static void iovw_rebase(struct iovec_wrapper *iovw, char *old, char *new) {
         size_t i;
 
@@ -309,7 +314,7 @@ static int process_special_field(JournalImporter *imp, char *line) {
         return 0;
 }
 
-int journal_importer_process_data(JournalImporter *imp) {
+static int process_field(JournalImporter *imp) {
         int r;
 
         switch(imp->state) {
@@ -442,6 +447,22 @@ int journal_importer_process_data(JournalImporter *imp) {
         }
 }
 
+int journal_importer_process_data(JournalImporter *imp) {
+        int r;
+
+        assert(imp);
+
+        /* Processes fields until an entry is complete (returns 1), the end of the input is reached
+         * (returns 0), or more data is needed or an error occurs (returns negative). The fields of the
+         * entry point directly into the buffer, nothing is copied. */
+
+        for (;;) {
+                r = process_field(imp);
+                if (r != 0 || imp->state == IMPORTER_STATE_EOF)
+                        return r;
+        }
+}
+
 int journal_importer_push_data(JournalImporter *imp, const char *data, size_t size) {
         assert(imp);
         assert(imp->state != IMPORTER_STATE_EOF);
@@ -464,7 +485,7 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
 
         /* This function drops processed data that along with the iovw that points at it */
 
-        iovw_free_contents(&imp->iovw);
+        iovw_reset(&imp->iovw);
 
         /* possibly reset buffer position */
         remain = imp->filled - imp->offset;
@@ -61,6 +61,16 @@ static bool always_reopen_console = false;
 static bool open_when_needed = false;
 static bool prohibit_ipc = false;
 
+/* Messages for the journal that couldn't be sent without blocking, if queueing is enabled. Only the process that
+ * enabled queueing uses the queue, forked off children fall back to the blocking behaviour. */
+#define LOG_QUEUE_MAX 1024U
+
+static bool queue_journal = false;
+static pid_t queue_journal_pid = 0;
+static struct iovec log_queue[LOG_QUEUE_MAX];
+static size_t log_queue_first = 0, log_queue_n = 0;
+static unsigned log_queue_dropped = 0;
+
 /* Akin to glibc's __abort_msg; which is private and we hence cannot
  * use here. */
 static char *log_abort_msg = NULL;
@@ -520,6 +530,141 @@ static int log_do_header(
         return 0;
 }
 
+static void log_queue_clear(void) {
+        for (; log_queue_n > 0; log_queue_n--) {
+                free(log_queue[log_queue_first].iov_base);
+                log_queue_first = (log_queue_first + 1) % LOG_QUEUE_MAX;
+        }
+
+        log_queue_first = 0;
+        log_queue_dropped = 0;
+}
+
+static bool log_queue_enabled(void) {
+
+        if (!queue_journal)
+                return false;
+
+        if (queue_journal_pid != getpid_cached()) {
+                /* We are a forked off child, the queued messages are our parent's business */
+                log_queue_clear();
+                queue_journal = false;
+                return false;
+        }
+
+        return true;
+}
+
+static int log_queue_push(const struct iovec *iovec, size_t n) {
+        size_t i;
+        char *p;
+
+        /* If the message can't be queued it is dropped (and counted), and we return -EAGAIN like a full socket
+         * buffer would. The connection itself is fine after all, hence callers shouldn't close it. */
+
+        if (log_queue_n >= LOG_QUEUE_MAX) {
+                log_queue_dropped++;
+                return -EAGAIN;
+        }
+
+        p = malloc(IOVEC_TOTAL_SIZE(iovec, n));
+        if (!p) {
+                log_queue_dropped++;
+                return -EAGAIN;
+        }
+
+        i = (log_queue_first + log_queue_n) % LOG_QUEUE_MAX;
+        log_queue[i] = IOVEC_MAKE(p, IOVEC_TOTAL_SIZE(iovec, n));
+        log_queue_n++;
+
+        for (i = 0; i < n; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+        return 0;
+}
+
+static int log_queue_flush(bool block) {
+        int flags = MSG_NOSIGNAL | (block ? 0 : MSG_DONTWAIT);
+
+        if (journal_fd < 0)
+                return 0;
+
+        while (log_queue_n > 0) {
+                struct msghdr mh = {
+                        .msg_iov = log_queue + log_queue_first,
+                        .msg_iovlen = 1,
+                };
+
+                if (sendmsg(journal_fd, &mh, flags) < 0)
+                        return -errno;
+
+                free(log_queue[log_queue_first].iov_base);
+                log_queue_first = (log_queue_first + 1) % LOG_QUEUE_MAX;
+                log_queue_n--;
+        }
+
+        if (log_queue_dropped > 0) {
+                char header[LINE_MAX], message[STRLEN("MESSAGE=Dropped  log messages, the journal socket was congested.\n") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[2];
+                struct msghdr mh = {
+                        .msg_iov = iovec,
+                        .msg_iovlen = ELEMENTSOF(iovec),
+                };
+
+                log_do_header(header, sizeof(header), log_facility|LOG_WARNING, 0, NULL, 0, NULL, NULL, NULL, NULL, NULL);
+                xsprintf(message, "MESSAGE=Dropped %u log messages, the journal socket was congested.\n", log_queue_dropped);
+
+                iovec[0] = IOVEC_MAKE_STRING(header);
+                iovec[1] = IOVEC_MAKE_STRING(message);
+
+                if (sendmsg(journal_fd, &mh, flags) < 0)
+                        return -errno;
+
+                log_queue_dropped = 0;
+        }
+
+        return 0;
+}
+
+static int write_iovec_to_journal(int level, const struct iovec *iovec, size_t n) {
+        struct msghdr mh = {
+                .msg_iov = (struct iovec*) iovec,
+                .msg_iovlen = n,
+        };
+        bool block;
+        int r;
+
+        if (!log_queue_enabled()) {
+                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
+                        return -errno;
+
+                return 1;
+        }
+
+        /* Only emergency messages may block, everything else is queued if the socket buffer is full, so that a
+         * slow journald doesn't stall us. Anything queued earlier goes first, to keep messages in order. */
+        block = LOG_PRI(level) <= LOG_CRIT;
+
+        r = log_queue_flush(block);
+        if (r < 0 && r != -EAGAIN)
+                return r;
+
+        if (log_queue_n == 0 && log_queue_dropped == 0) {
+                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL | (block ? 0 : MSG_DONTWAIT)) >= 0)
+                        return 1;
+
+                if (errno != EAGAIN || block)
+                        return -errno;
+        } else if (block)
+                return r;
+
+        r = log_queue_push(iovec, n);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 static int write_to_journal(
                 int level,
                 int error,
@@ -534,7 +679,6 @@ static int write_to_journal(
 
         char header[LINE_MAX];
         struct iovec iovec[4] = {};
-        struct msghdr mh = {};
 
         if (journal_fd < 0)
                 return 0;
@@ -546,13 +690,7 @@ static int write_to_journal(
         iovec[2] = IOVEC_MAKE_STRING(buffer);
         iovec[3] = IOVEC_MAKE_STRING("\n");
 
-        mh.msg_iov = iovec;
-        mh.msg_iovlen = ELEMENTSOF(iovec);
-
-        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
-
-        return 1;
+        return write_iovec_to_journal(level, iovec, ELEMENTSOF(iovec));
 }
 
 int log_dispatch_internal(
@@ -917,9 +1055,6 @@ int log_struct_internal(
                         struct iovec iovec[17] = {};
                         size_t n = 0, i;
                         int r;
-                        struct msghdr mh = {
-                                .msg_iov = iovec,
-                        };
                         bool fallback = false;
 
                         /* If the journal is available do structured logging */
@@ -930,10 +1065,8 @@ int log_struct_internal(
                         r = log_format_iovec(iovec, ELEMENTSOF(iovec), &n, true, error, format, ap);
                         if (r < 0)
                                 fallback = true;
-                        else {
-                                mh.msg_iovlen = n;
-                                (void) sendmsg(journal_fd, &mh, MSG_NOSIGNAL);
-                        }
+                        else
+                                (void) write_iovec_to_journal(level, iovec, n);
 
                         va_end(ap);
                         for (i = 1; i < n; i += 2)
@@ -1014,10 +1147,6 @@ int log_struct_iovec_internal(
 
                 struct iovec iovec[1 + n_input_iovec*2];
                 char header[LINE_MAX];
-                struct msghdr mh = {
-                        .msg_iov = iovec,
-                        .msg_iovlen = 1 + n_input_iovec*2,
-                };
 
                 log_do_header(header, sizeof(header), level, error, file, line, func, NULL, NULL, NULL, NULL);
                 iovec[0] = IOVEC_MAKE_STRING(header);
@@ -1027,7 +1156,7 @@ int log_struct_iovec_internal(
                         iovec[1+i*2+1] = IOVEC_MAKE_STRING("\n");
                 }
 
-                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) >= 0)
+                if (write_iovec_to_journal(level, iovec, ELEMENTSOF(iovec)) >= 0)
                         return -error;
         }
 
@@ -1314,6 +1443,34 @@ void log_set_prohibit_ipc(bool b) {
         prohibit_ipc = b;
 }
 
+void log_set_queue_journal(bool b) {
+
+        if (!b && log_queue_enabled())
+                (void) log_queue_flush(true);
+
+        log_queue_clear();
+
+        queue_journal = b;
+        queue_journal_pid = b ? getpid_cached() : 0;
+}
+
+int log_flush_queue(void) {
+        int r;
+
+        if (!log_queue_enabled())
+                return 0;
+
+        r = log_queue_flush(false);
+        if (r < 0 && r != -EAGAIN)
+                log_close_journal();
+
+        return r;
+}
+
+bool log_has_queued(void) {
+        return log_queue_enabled() && (log_queue_n > 0 || log_queue_dropped > 0);
+}
+
 int log_emergency_level(void) {
         /* Returns the log level to use for log_emergency() logging. We use LOG_EMERG only when we are PID 1, as only
          * then the system of the whole system is obviously affected. */
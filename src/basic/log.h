@@ -278,6 +278,14 @@ void log_set_open_when_needed(bool b);
  * stderr, the console or kmsg */
 void log_set_prohibit_ipc(bool b);
 
+/* If turned on, messages for the journal that cannot be sent without blocking are kept in a bounded queue, instead
+ * of stalling the caller until journald catches up. Only messages of LOG_CRIT and above are still sent
+ * synchronously. The queue is flushed with every new message, and on log_flush_queue(), which should be called
+ * regularly from the event loop as long as log_has_queued() returns true. */
+void log_set_queue_journal(bool b);
+int log_flush_queue(void);
+bool log_has_queued(void);
+
 int log_dup_console(void);
 
 int log_syntax_internal(
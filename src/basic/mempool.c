@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "alloc-util.h"
+#include "env-util.h"
 #include "macro.h"
 #include "mempool.h"
 #include "util.h"
@@ -70,8 +72,6 @@ void mempool_free_tile(struct mempool *mp, void *p) {
         mp->freelist = p;
 }
 
-#if VALGRIND
-
 void mempool_drop(struct mempool *mp) {
         struct pool *p = mp->first_pool;
         while (p) {
@@ -80,6 +80,270 @@ void mempool_drop(struct mempool *mp) {
                 free(p);
                 p = n;
         }
+
+        mp->first_pool = NULL;
+        mp->freelist = NULL;
+}
+
+struct mempool_cache {
+        struct mempool pool;             /* only ever touched by the thread owning the cache */
+        void *remote_freelist;           /* tiles freed by other threads, a lock-free stack */
+        struct threaded_mempool *parent;
+        struct mempool_cache *orphans_next;
+};
+
+/* Every tile is prefixed by a pointer to the cache it was allocated from, or NULL if it was
+ * allocated with malloc() because pooling is turned off. */
+#define TILE_HEADER_SIZE ALIGN(sizeof(struct mempool_cache*))
+
+/* All threaded pools that allocated a thread-specific key, so that we can delete the keys again */
+static pthread_mutex_t pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct threaded_mempool *pools = NULL;
+
+bool mempool_enabled(void) {
+        static int b = -1;
+
+        if (_unlikely_(b < 0))
+                b = getenv_bool("SYSTEMD_MEMPOOL") != 0;
+
+        return b;
+}
+
+static void cache_orphan(void *p) {
+        struct mempool_cache *c = p;
+        struct threaded_mempool *mp = c->parent;
+
+        /* The owning thread exits. Tiles allocated from the cache might still be in use elsewhere, hence
+         * keep it around for the next thread that needs one. */
+
+        assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+        c->orphans_next = mp->orphans;
+        mp->orphans = c;
+        assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+}
+
+static struct mempool_cache *cache_get_slow(struct threaded_mempool *mp) {
+        struct mempool_cache *c;
+
+        if (!mp->key_allocated) {
+                if (pthread_key_create(&mp->key, cache_orphan) != 0)
+                        return NULL;
+
+                assert_se(pthread_mutex_lock(&pools_mutex) == 0);
+                mp->pools_next = pools;
+                pools = mp;
+                assert_se(pthread_mutex_unlock(&pools_mutex) == 0);
+
+                __atomic_store_n(&mp->key_allocated, true, __ATOMIC_RELEASE);
+        }
+
+        c = mp->orphans;
+        if (c)
+                mp->orphans = c->orphans_next;
+        else {
+                c = new(struct mempool_cache, 1);
+                if (!c)
+                        return NULL;
+
+                *c = (struct mempool_cache) {
+                        .pool.tile_size = TILE_HEADER_SIZE + mp->tile_size,
+                        .pool.at_least = mp->at_least,
+                        .parent = mp,
+                };
+        }
+
+        if (pthread_setspecific(mp->key, c) != 0) {
+                c->orphans_next = mp->orphans;
+                mp->orphans = c;
+                return NULL;
+        }
+
+        return c;
+}
+
+static struct mempool_cache *cache_get(struct threaded_mempool *mp) {
+        struct mempool_cache *c;
+
+        if (_likely_(__atomic_load_n(&mp->key_allocated, __ATOMIC_ACQUIRE))) {
+                c = pthread_getspecific(mp->key);
+                if (_likely_(c))
+                        return c;
+        }
+
+        assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+        c = cache_get_slow(mp);
+        assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+
+        return c;
+}
+
+void* threaded_mempool_alloc_tile(struct threaded_mempool *mp) {
+        struct mempool_cache *c;
+        uint8_t *t;
+
+        assert(mp);
+        assert(mp->tile_size > 0);
+
+        if (!mempool_enabled()) {
+                t = malloc(TILE_HEADER_SIZE + mp->tile_size);
+                if (!t)
+                        return NULL;
+
+                * (struct mempool_cache**) t = NULL;
+                return t + TILE_HEADER_SIZE;
+        }
+
+        c = cache_get(mp);
+        if (!c)
+                return NULL;
+
+        /* Only pick up the tiles other threads returned to us once we ran out of locally freed ones, so
+         * that we touch the shared list as rarely as possible. We take the whole list at once, which makes
+         * this safe against concurrent pushes without any further synchronization. */
+        if (!c->pool.freelist && __atomic_load_n(&c->remote_freelist, __ATOMIC_RELAXED))
+                c->pool.freelist = __sync_lock_test_and_set(&c->remote_freelist, NULL);
+
+        t = mempool_alloc_tile(&c->pool);
+        if (!t)
+                return NULL;
+
+        * (struct mempool_cache**) t = c;
+        return t + TILE_HEADER_SIZE;
+}
+
+void* threaded_mempool_alloc0_tile(struct threaded_mempool *mp) {
+        void *p;
+
+        p = threaded_mempool_alloc_tile(mp);
+        if (p)
+                memzero(p, mp->tile_size);
+        return p;
+}
+
+void threaded_mempool_free_tile(struct threaded_mempool *mp, void *p) {
+        struct mempool_cache *c;
+        uint8_t *t;
+        void *head;
+
+        assert(mp);
+
+        if (!p)
+                return;
+
+        t = (uint8_t*) p - TILE_HEADER_SIZE;
+        c = * (struct mempool_cache**) t;
+        if (!c) {
+                free(t);
+                return;
+        }
+
+        assert(c->parent == mp);
+
+        if (c == pthread_getspecific(mp->key)) {
+                mempool_free_tile(&c->pool, t);
+                return;
+        }
+
+        /* Not ours, push it onto the owner's list. Only the owner ever takes anything off it, and always the
+         * whole list at once, hence there's no ABA problem here. */
+        do {
+                head = __atomic_load_n(&c->remote_freelist, __ATOMIC_RELAXED);
+                * (void**) t = head;
+        } while (!__sync_bool_compare_and_swap(&c->remote_freelist, head, t));
 }
 
-#endif
+void threaded_mempool_drop(struct threaded_mempool *mp) {
+        struct mempool_cache *c;
+
+        assert(mp);
+
+        /* Releases the cache of the calling thread and all orphaned ones. Only call this if none of their
+         * tiles are in use anymore. */
+
+        assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+
+        if (mp->key_allocated) {
+                c = pthread_getspecific(mp->key);
+                if (c) {
+                        assert_se(pthread_setspecific(mp->key, NULL) == 0);
+                        c->orphans_next = mp->orphans;
+                        mp->orphans = c;
+                }
+        }
+
+        while ((c = mp->orphans)) {
+                mp->orphans = c->orphans_next;
+                mempool_drop(&c->pool);
+                free(c);
+        }
+
+        assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+}
+
+static bool cache_unused(struct mempool_cache *c) {
+        struct pool *p;
+        size_t n = 0;
+        void **i;
+
+        assert(c);
+
+        /* Move the tiles other threads returned onto the local list first. The cache has no owner anymore,
+         * hence we may touch that list. */
+        i = &c->pool.freelist;
+        while (*i)
+                i = (void**) *i;
+        *i = __sync_lock_test_and_set(&c->remote_freelist, NULL);
+
+        for (p = c->pool.first_pool; p; p = p->next)
+                n += p->n_used;
+
+        for (i = c->pool.freelist; i; i = (void**) *i)
+                n--;
+
+        return n == 0;
+}
+
+_destructor_ void threaded_mempool_shutdown(void) {
+        struct threaded_mempool *mp, *l;
+        struct mempool_cache *c, **i;
+
+        /* Called when the binary is unloaded or the process exits. Deletes the thread-specific keys of all
+         * pools, so that threads exiting later don't call into cache_orphan() anymore, which isn't even
+         * mapped anymore after dlclose(), and so that loading the binary over and over doesn't leak keys. The cache of the calling thread is
+         * orphaned, and all orphans none of whose tiles are in use anymore are released. The caches of
+         * other threads that are still alive are left alone, as those might still allocate from them. */
+
+        assert_se(pthread_mutex_lock(&pools_mutex) == 0);
+        l = TAKE_PTR(pools);
+        assert_se(pthread_mutex_unlock(&pools_mutex) == 0);
+
+        while ((mp = l)) {
+                l = mp->pools_next;
+                mp->pools_next = NULL;
+
+                assert_se(pthread_mutex_lock(&mp->mutex) == 0);
+
+                c = pthread_getspecific(mp->key);
+                if (c) {
+                        c->orphans_next = mp->orphans;
+                        mp->orphans = c;
+                }
+
+                __atomic_store_n(&mp->key_allocated, false, __ATOMIC_RELEASE);
+                assert_se(pthread_key_delete(mp->key) == 0);
+
+                i = &mp->orphans;
+                while ((c = *i)) {
+                        if (!cache_unused(c)) {
+                                i = &c->orphans_next;
+                                continue;
+                        }
+
+                        *i = c->orphans_next;
+                        mempool_drop(&c->pool);
+                        free(c);
+                }
+
+                assert_se(pthread_mutex_unlock(&mp->mutex) == 0);
+        }
+}
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 struct pool;
@@ -22,6 +24,43 @@ static struct mempool pool_name = { \
         .at_least = alloc_at_least, \
 }
 
-#if VALGRIND
 void mempool_drop(struct mempool *mp);
-#endif
+
+/* A mempool that may be used from any thread. Every thread allocates tiles from its own cache, hence no locking
+ * is needed for that. Tiles may be freed from any thread: when that's not the thread that allocated the tile, the
+ * tile is pushed onto a lock-free list of the owning cache, from which the owner recycles it on one of its next
+ * allocations. The cache of a thread that exits is handed to the next thread that needs one, so that tiles which
+ * outlive the thread that allocated them stay valid. If pooling is turned off with $SYSTEMD_MEMPOOL=0, tiles are
+ * allocated with malloc() instead. When the binary containing the pools is unloaded, or the process exits, the
+ * thread-specific keys are deleted again, and the caches none of whose tiles are in use anymore are released. */
+
+struct mempool_cache;
+
+struct threaded_mempool {
+        size_t tile_size;
+        unsigned at_least;
+
+        pthread_mutex_t mutex;
+        pthread_key_t key;
+        bool key_allocated;
+
+        struct mempool_cache *orphans;
+
+        struct threaded_mempool *pools_next;
+};
+
+void* threaded_mempool_alloc_tile(struct threaded_mempool *mp);
+void* threaded_mempool_alloc0_tile(struct threaded_mempool *mp);
+void threaded_mempool_free_tile(struct threaded_mempool *mp, void *p);
+
+#define DEFINE_THREADED_MEMPOOL(pool_name, tile_type, alloc_at_least) \
+static struct threaded_mempool pool_name = { \
+        .tile_size = sizeof(tile_type), \
+        .at_least = alloc_at_least, \
+        .mutex = PTHREAD_MUTEX_INITIALIZER, \
+}
+
+void threaded_mempool_drop(struct threaded_mempool *mp);
+void threaded_mempool_shutdown(void);
+
+bool mempool_enabled(void);
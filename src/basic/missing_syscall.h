@@ -428,3 +428,38 @@ static inline ssize_t missing_statx(int dfd, const char *filename, unsigned flag
 
 #  define statx missing_statx
 #endif
+
+/* ======================================================================= */
+
+#if !HAVE_PIDFD_OPEN
+#  ifndef __NR_pidfd_open
+#    if defined __alpha__
+#      define __NR_pidfd_open 544
+#    elif defined __ia64__
+#      define __NR_pidfd_open 1458
+#    elif defined _MIPS_SIM
+#      if _MIPS_SIM == _MIPS_SIM_ABI32
+#        define __NR_pidfd_open 4434
+#      endif
+#      if _MIPS_SIM == _MIPS_SIM_NABI32
+#        define __NR_pidfd_open 6434
+#      endif
+#      if _MIPS_SIM == _MIPS_SIM_ABI64
+#        define __NR_pidfd_open 5434
+#      endif
+#    else
+#      define __NR_pidfd_open 434
+#    endif
+#  endif
+
+static inline int missing_pidfd_open(pid_t pid, unsigned flags) {
+#  ifdef __NR_pidfd_open
+        return syscall(__NR_pidfd_open, pid, flags);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define pidfd_open missing_pidfd_open
+#endif
@@ -412,7 +412,7 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
 
         for (;;) {
                 _cleanup_set_free_free_ Set *todo = NULL;
-                bool top_autofs = false;
+                bool top_autofs = false, mounted = false;
                 char *x;
                 unsigned long orig_flags;
 
@@ -521,6 +521,7 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
                                 return -errno;
 
                         log_debug("Made top-level directory %s a mount point.", prefix);
+                        mounted = true;
 
                         x = strdup(cleaned);
                         if (!x)
@@ -568,6 +569,13 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
 
                         log_debug("Remounted %s read-only.", x);
                 }
+
+                /* Remounting doesn't change the mount table, hence unless we established a new mount above, another
+                 * pass would find exactly the same mounts again, all of which are done now. Parsing the mount table
+                 * is the expensive part here, with lots of mounts on the host and many read-only paths in a unit's
+                 * mount namespace, so don't do it without reason. */
+                if (!mounted)
+                        return 0;
         }
 }
 
@@ -662,6 +662,60 @@ int get_process_ppid(pid_t pid, pid_t *_ppid) {
         return 0;
 }
 
+int get_process_starttime(pid_t pid, unsigned long long *ret) {
+        _cleanup_free_ char *line = NULL;
+        unsigned long long t;
+        const char *p;
+        int r;
+
+        assert(pid >= 0);
+        assert(ret);
+
+        /* Returns the start time of the process in clock ticks since boot. Together with the PID this
+         * identifies a process reliably, as PIDs may be recycled but not within the same clock tick. */
+
+        p = procfs_file_alloca(pid, "stat");
+        r = read_one_line_file(p, &line);
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
+
+        p = strrchr(line, ')');
+        if (!p)
+                return -EIO;
+
+        p++;
+
+        if (sscanf(p, " "
+                   "%*c "  /* state */
+                   "%*s "  /* ppid */
+                   "%*s "  /* pgrp */
+                   "%*s "  /* session */
+                   "%*s "  /* tty_nr */
+                   "%*s "  /* tpgid */
+                   "%*s "  /* flags */
+                   "%*s "  /* minflt */
+                   "%*s "  /* cminflt */
+                   "%*s "  /* majflt */
+                   "%*s "  /* cmajflt */
+                   "%*s "  /* utime */
+                   "%*s "  /* stime */
+                   "%*s "  /* cutime */
+                   "%*s "  /* cstime */
+                   "%*s "  /* priority */
+                   "%*s "  /* nice */
+                   "%*s "  /* num_threads */
+                   "%*s "  /* itrealvalue */
+                   "%llu ", /* starttime */
+                   &t) != 1)
+                return -EIO;
+
+        *ret = t;
+
+        return 0;
+}
+
 int wait_for_terminate(pid_t pid, siginfo_t *status) {
         siginfo_t dummy;
 
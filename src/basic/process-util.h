@@ -41,6 +41,7 @@ int get_process_cwd(pid_t pid, char **cwd);
 int get_process_root(pid_t pid, char **root);
 int get_process_environ(pid_t pid, char **environ);
 int get_process_ppid(pid_t pid, pid_t *ppid);
+int get_process_starttime(pid_t pid, unsigned long long *ret);
 
 int wait_for_terminate(pid_t pid, siginfo_t *status);
 
@@ -15,12 +15,25 @@
  * strings. Will call a callback for each replacement.
  */
 
-static int get_variable(const char *b, char **r) {
+typedef struct ReplaceVarSegment {
+        /* Either a literal part of the text, or the name of a variable, NUL terminated */
+        const char *text;
+        size_t length;
+        bool variable;
+} ReplaceVarSegment;
+
+struct ReplaceVarTemplate {
+        /* A copy of the text, with the closing '@' of each variable replaced by NUL */
+        char *text;
+
+        ReplaceVarSegment *segments;
+        size_t n_segments;
+};
+
+static size_t get_variable(const char *b) {
         size_t k;
-        char *t;
 
         assert(b);
-        assert(r);
 
         if (*b != '@')
                 return 0;
@@ -29,66 +42,125 @@ static int get_variable(const char *b, char **r) {
         if (k <= 0 || b[k+1] != '@')
                 return 0;
 
-        t = strndup(b + 1, k);
+        return k;
+}
+
+int replace_var_template_new(const char *text, ReplaceVarTemplate **ret) {
+        _cleanup_(replace_var_template_freep) ReplaceVarTemplate *t = NULL;
+        size_t n_allocated = 0;
+        char *f, *literal;
+
+        assert(text);
+        assert(ret);
+
+        t = new0(ReplaceVarTemplate, 1);
         if (!t)
                 return -ENOMEM;
 
-        *r = t;
-        return 1;
+        t->text = strdup(text);
+        if (!t->text)
+                return -ENOMEM;
+
+        for (f = literal = t->text;; ) {
+                size_t k = 0;
+
+                if (*f) {
+                        k = get_variable(f);
+                        if (k == 0) {
+                                f++;
+                                continue;
+                        }
+                }
+
+                /* We reached a variable or the end, let's add a segment at least for the literal text before */
+                if (!GREEDY_REALLOC(t->segments, n_allocated, t->n_segments + 2))
+                        return -ENOMEM;
+
+                if (f > literal)
+                        t->segments[t->n_segments++] = (ReplaceVarSegment) {
+                                .text = literal,
+                                .length = f - literal,
+                        };
+
+                if (k == 0)
+                        break;
+
+                f[k+1] = 0;
+                t->segments[t->n_segments++] = (ReplaceVarSegment) {
+                        .text = f + 1,
+                        .length = k,
+                        .variable = true,
+                };
+
+                f += k + 2;
+                literal = f;
+        }
+
+        *ret = TAKE_PTR(t);
+        return 0;
 }
 
-char *replace_var(const char *text, char *(*lookup)(const char *variable, void *userdata), void *userdata) {
-        char *r, *t;
-        const char *f;
-        size_t l;
+ReplaceVarTemplate *replace_var_template_free(ReplaceVarTemplate *t) {
+        if (!t)
+                return NULL;
 
-        assert(text);
+        free(t->segments);
+        free(t->text);
+        return mfree(t);
+}
+
+char *replace_var_template_apply(const ReplaceVarTemplate *t, char *(*lookup)(const char *variable, void *userdata), void *userdata) {
+        _cleanup_free_ char **values = NULL;
+        char *r = NULL, *p;
+        size_t i, l = 0;
+
+        assert(t);
         assert(lookup);
 
-        l = strlen(text);
-        r = new(char, l+1);
-        if (!r)
+        /* First look up all variables, so that we know how much to allocate */
+        values = new0(char*, t->n_segments + 1);
+        if (!values)
                 return NULL;
 
-        f = text;
-        t = r;
-        while (*f) {
-                _cleanup_free_ char *v = NULL, *n = NULL;
-                char *a;
-                int k;
-                size_t skip, d, nl;
-
-                k = get_variable(f, &v);
-                if (k < 0)
-                        goto oom;
-                if (k == 0) {
-                        *(t++) = *(f++);
+        for (i = 0; i < t->n_segments; i++) {
+                if (!t->segments[i].variable) {
+                        l += t->segments[i].length;
                         continue;
                 }
 
-                n = lookup(v, userdata);
-                if (!n)
-                        goto oom;
+                values[i] = lookup(t->segments[i].text, userdata);
+                if (!values[i])
+                        goto finish;
 
-                skip = strlen(v) + 2;
+                l += strlen(values[i]);
+        }
 
-                d = t - r;
-                nl = l - skip + strlen(n);
-                a = realloc(r, nl + 1);
-                if (!a)
-                        goto oom;
+        r = new(char, l + 1);
+        if (!r)
+                goto finish;
 
-                l = nl;
-                r = a;
-                t = r + d;
+        for (i = 0, p = r; i < t->n_segments; i++)
+                if (values[i])
+                        p = stpcpy(p, values[i]);
+                else
+                        p = mempcpy(p, t->segments[i].text, t->segments[i].length);
+        *p = 0;
 
-                t = stpcpy(t, n);
-                f += skip;
-        }
+finish:
+        for (i = 0; i < t->n_segments; i++)
+                free(values[i]);
 
-        *t = 0;
         return r;
+}
+
+char *replace_var(const char *text, char *(*lookup)(const char *variable, void *userdata), void *userdata) {
+        _cleanup_(replace_var_template_freep) ReplaceVarTemplate *t = NULL;
+
+        assert(text);
+        assert(lookup);
+
+        if (replace_var_template_new(text, &t) < 0)
+                return NULL;
 
-oom:
-        return mfree(r);
+        return replace_var_template_apply(t, lookup, userdata);
 }
@@ -1,4 +1,15 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include "macro.h"
+
+typedef struct ReplaceVarTemplate ReplaceVarTemplate;
+
 char *replace_var(const char *text, char *(*lookup)(const char *variable, void *userdata), void *userdata);
+
+/* For texts that are substituted many times: find the variables only once */
+int replace_var_template_new(const char *text, ReplaceVarTemplate **ret);
+ReplaceVarTemplate *replace_var_template_free(ReplaceVarTemplate *t);
+char *replace_var_template_apply(const ReplaceVarTemplate *t, char *(*lookup)(const char *variable, void *userdata), void *userdata);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ReplaceVarTemplate*, replace_var_template_free);
@@ -25,10 +25,32 @@ static bool is_physical_fs(const struct statfs *sfs) {
         return !is_temporary_fs(sfs) && !is_cgroup_fs(sfs);
 }
 
+static int is_mount_point_child(int fd, const char *name, int *parent_mnt_id) {
+        int mnt_id;
+
+        assert(fd >= 0);
+        assert(name);
+        assert(parent_mnt_id);
+
+        /* Like fd_is_mount_point(), but remembers the mount ID of the directory we are looking at between calls, so
+         * that it is only queried once, instead of once per subdirectory. If mount IDs are not available this
+         * falls back to fd_is_mount_point(). */
+
+        if (*parent_mnt_id == -2 &&
+            name_to_handle_at_loop(fd, "", NULL, parent_mnt_id, AT_EMPTY_PATH) < 0)
+                *parent_mnt_id = -1;
+
+        if (*parent_mnt_id >= 0 &&
+            name_to_handle_at_loop(fd, name, NULL, &mnt_id, 0) >= 0)
+                return mnt_id != *parent_mnt_id;
+
+        return fd_is_mount_point(fd, name, 0);
+}
+
 int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
-        int ret = 0, r;
+        int ret = 0, r, mnt_id = -2;
         struct statfs sfs;
 
         assert(fd >= 0);
@@ -99,7 +121,7 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
                         }
 
                         /* Stop at mount points */
-                        r = fd_is_mount_point(fd, de->d_name, 0);
+                        r = is_mount_point_child(fd, de->d_name, &mnt_id);
                         if (r < 0) {
                                 if (ret == 0 && r != -ENOENT)
                                         ret = r;
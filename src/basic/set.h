@@ -28,6 +28,7 @@ int internal_set_ensure_allocated(Set **s, const struct hash_ops *hash_ops HASHM
 #define set_ensure_allocated(h, ops) internal_set_ensure_allocated(h, ops HASHMAP_DEBUG_SRC_ARGS)
 
 int set_put(Set *s, const void *key);
+int set_put_many(Set *s, const void * const keys[], unsigned n);
 /* no set_update */
 /* no set_replace */
 static inline void *set_get(Set *s, void *key) {
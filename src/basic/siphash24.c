@@ -68,15 +68,21 @@ void siphash24_init(struct siphash *state, const uint8_t k[16]) {
         };
 }
 
-void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
+void siphash24_compress(const void *_in, size_t inlen, struct siphash *_state) {
 
         const uint8_t *in = _in;
         const uint8_t *end = in + inlen;
-        size_t left = state->inlen & 7;
+        struct siphash s, *state = &s;
+        size_t left;
         uint64_t m;
 
         assert(in);
-        assert(state);
+        assert(_state);
+
+        /* Work on a copy of the state: the input might alias it as far as the compiler is concerned, which
+         * would otherwise force it to write the state back to memory after every round */
+        s = *_state;
+        left = state->inlen & 7;
 
         /* Update total length */
         state->inlen += inlen;
@@ -86,9 +92,11 @@ void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
                 for ( ; in < end && left < 8; in ++, left ++)
                         state->padding |= ((uint64_t) *in) << (left * 8);
 
-                if (in == end && left < 8)
+                if (in == end && left < 8) {
                         /* We did not have enough input to fill out the padding completely */
+                        *_state = s;
                         return;
+                }
 
 #ifdef DEBUG
                 printf("(%3zu) v0 %08x %08x\n", state->inlen, (uint32_t) (state->v0 >> 32), (uint32_t) state->v0);
@@ -149,6 +157,8 @@ void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
                 case 0:
                         break;
         }
+
+        *_state = s;
 }
 
 uint64_t siphash24_finalize(struct siphash *state) {
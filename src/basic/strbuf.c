@@ -36,6 +36,7 @@ struct strbuf *strbuf_new(void) {
                 .buf = new0(char, 1),
                 .root = new0(struct strbuf_node, 1),
                 .len = 1,
+                .allocated = 1,
                 .nodes_count = 1,
         };
         if (!str->buf || !str->root) {
@@ -106,7 +107,6 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
         uint8_t c;
         struct strbuf_node *node;
         size_t depth;
-        char *buf_new;
         struct strbuf_child_entry *child;
         struct strbuf_node *node_child;
         ssize_t off;
@@ -125,7 +125,7 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
 
         node = str->root;
         for (depth = 0; depth <= len; depth++) {
-                struct strbuf_child_entry search;
+                size_t left, right;
 
                 /* match against current node */
                 off = node->value_off + node->value_len - len;
@@ -137,21 +137,30 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
 
                 c = s[len - 1 - depth];
 
-                /* lookup child node */
-                search.c = c;
-                child = bsearch_safe(&search, node->children, node->children_count,
-                                     sizeof(struct strbuf_child_entry),
-                                     (__compar_fn_t) strbuf_children_cmp);
+                /* lookup child node, this is the hot path when adding many strings, hence bisect inline */
+                child = NULL;
+                left = 0;
+                right = node->children_count;
+                while (right > left) {
+                        size_t middle = (left + right) / 2;
+
+                        if (node->children[middle].c == c) {
+                                child = &node->children[middle];
+                                break;
+                        }
+                        if (node->children[middle].c < c)
+                                left = middle + 1;
+                        else
+                                right = middle;
+                }
                 if (!child)
                         break;
                 node = child->child;
         }
 
         /* add new string */
-        buf_new = realloc(str->buf, str->len + len+1);
-        if (!buf_new)
+        if (!GREEDY_REALLOC(str->buf, str->allocated, str->len + len+1))
                 return -ENOMEM;
-        str->buf = buf_new;
         off = str->len;
         memcpy(str->buf + off, s, len);
         str->len += len;
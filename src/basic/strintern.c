@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "hash-funcs.h"
+#include "set.h"
+#include "strintern.h"
+
+/* Each interned string is stored in a single allocation together with its reference counter. The table only
+ * knows about the string part, and we get from there to the header with container_of(). This way lookups
+ * can be done with plain, non-interned strings. */
+
+typedef struct InternedString {
+        unsigned n_ref;
+        char string[];
+} InternedString;
+
+static Set *table = NULL;
+
+static InternedString *interned_string_from_string(const char *s) {
+        return container_of((char*) s, InternedString, string[0]);
+}
+
+const char *strintern(const char *s) {
+        InternedString *i;
+        const char *e;
+        size_t l;
+
+        if (!s)
+                return NULL;
+
+        e = set_get(table, (char*) s);
+        if (e)
+                return strintern_ref(e);
+
+        if (set_ensure_allocated(&table, &string_hash_ops) < 0)
+                return NULL;
+
+        l = strlen(s);
+        i = malloc(offsetof(InternedString, string) + l + 1);
+        if (!i)
+                return NULL;
+
+        i->n_ref = 1;
+        memcpy(i->string, s, l + 1);
+
+        if (set_put(table, i->string) < 0) {
+                free(i);
+                return NULL;
+        }
+
+        return i->string;
+}
+
+const char *strintern_ref(const char *s) {
+        if (!s)
+                return NULL;
+
+        assert(strintern_is_interned(s));
+
+        interned_string_from_string(s)->n_ref++;
+        return s;
+}
+
+const char *strintern_unref(const char *s) {
+        InternedString *i;
+
+        if (!s)
+                return NULL;
+
+        assert(strintern_is_interned(s));
+
+        i = interned_string_from_string(s);
+        assert(i->n_ref > 0);
+
+        if (--i->n_ref > 0)
+                return NULL;
+
+        assert_se(set_remove(table, s) == s);
+        if (set_isempty(table))
+                table = set_free(table);
+
+        free(i);
+        return NULL;
+}
+
+bool strintern_is_interned(const char *s) {
+        if (!s)
+                return false;
+
+        return set_get(table, (char*) s) == s;
+}
+
+unsigned strintern_size(void) {
+        return set_size(table);
+}
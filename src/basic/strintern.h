@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "macro.h"
+
+/* A process-wide table of reference counted, immutable strings. Interning the same string twice returns the
+ * same pointer, hence two interned strings are equal if and only if their pointers are, and a string that is
+ * referenced from many places is kept in memory only once. Not thread-safe, only use this from the main
+ * thread. */
+
+const char *strintern(const char *s);
+const char *strintern_ref(const char *s);
+const char *strintern_unref(const char *s);
+
+bool strintern_is_interned(const char *s);
+unsigned strintern_size(void);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(const char*, strintern_unref);
@@ -136,17 +136,12 @@ void strv_print(char **l);
                 _x && strv_contains(STRV_MAKE(__VA_ARGS__), _x); \
         })
 
-#define FOREACH_STRING(x, ...)                               \
-        for (char **_l = ({                                  \
-                char **_ll = STRV_MAKE(__VA_ARGS__);         \
-                x = _ll ? _ll[0] : NULL;                     \
-                _ll;                                         \
-        });                                                  \
-        _l && *_l;                                           \
-        x = ({                                               \
-                _l ++;                                       \
-                _l[0];                                       \
-        }))
+/* The array is created in the init clause of the loop, so that it lives as long as the loop itself. A
+ * compound literal inside a statement expression would go out of scope before the loop body runs. */
+#define FOREACH_STRING(x, ...)                                  \
+        for (char **_l = STRV_MAKE(__VA_ARGS__);                \
+             (x = _l[0]);                                       \
+             _l++)
 
 char **strv_reverse(char **l);
 char **strv_shell_escape(char **l, const char *bad);
@@ -127,6 +127,27 @@ int utf8_encoded_to_unichar(const char *str, char32_t *ret_unichar) {
         return 0;
 }
 
+static bool word_is_printable_ascii(uint64_t w) {
+        const uint64_t ones = UINT64_C(0x0101010101010101), highs = UINT64_C(0x8080808080808080);
+        uint64_t x;
+
+        /* Checks whether all eight bytes of the word are in the range ' '…'~', without looking at each byte
+         * individually. Any byte ≥ 0x80 sets its high bit, any byte < ' ' wraps around when subtracting ' ' from it
+         * and thus sets the high bit of the difference, and DEL becomes zero after xoring 0x7F into it. */
+
+        if (w & highs)
+                return false;
+
+        if ((w - ones * ' ') & ~w & highs)
+                return false;
+
+        x = w ^ (ones * 0x7F);
+        if ((x - ones) & ~x & highs)
+                return false;
+
+        return true;
+}
+
 bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
         const char *p;
 
@@ -136,6 +157,24 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
                 int encoded_len, r;
                 char32_t val;
 
+                /* Shortcut for runs of plain printable ASCII, which is what most strings consist of */
+                if (length >= sizeof(uint64_t)) {
+                        uint64_t w;
+
+                        memcpy(&w, p, sizeof(w));
+                        if (word_is_printable_ascii(w)) {
+                                p += sizeof(w);
+                                length -= sizeof(w);
+                                continue;
+                        }
+                }
+
+                if ((uint8_t) *p >= ' ' && (uint8_t) *p < 0x7F) {
+                        p++;
+                        length--;
+                        continue;
+                }
+
                 encoded_len = utf8_encoded_valid_unichar(p);
                 if (encoded_len < 0 ||
                     (size_t) encoded_len > length)
@@ -162,6 +201,12 @@ const char *utf8_is_valid(const char *str) {
         for (p = (const uint8_t*) str; *p; ) {
                 int len;
 
+                /* Shortcut for plain ASCII, which is always valid */
+                if (*p < 0x80) {
+                        p++;
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar((const char *)p);
                 if (len < 0)
                         return NULL;
@@ -184,6 +229,12 @@ char *utf8_escape_invalid(const char *str) {
         while (*str) {
                 int len;
 
+                /* Shortcut for plain ASCII, which is always valid */
+                if ((uint8_t) *str < 0x80) {
+                        *(s++) = *(str++);
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(str);
                 if (len > 0) {
                         s = mempcpy(s, str, len);
@@ -211,6 +262,12 @@ char *utf8_escape_non_printable(const char *str) {
         while (*str) {
                 int len;
 
+                /* Shortcut for printable ASCII */
+                if ((uint8_t) *str >= ' ' && (uint8_t) *str < 0x7F) {
+                        *(s++) = *(str++);
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(str);
                 if (len > 0) {
                         if (utf8_is_printable(str, len)) {
@@ -437,6 +494,13 @@ size_t utf8_console_width(const char *str) {
         while (*str != 0) {
                 char32_t c;
 
+                /* Shortcut for plain ASCII, which is never wide */
+                if ((uint8_t) *str < 0x80) {
+                        str++;
+                        n++;
+                        continue;
+                }
+
                 if (utf8_encoded_to_unichar(str, &c) < 0)
                         return (size_t) -1;
 
@@ -30,6 +30,7 @@
 
 size_t page_size(void) _pure_;
 #define PAGE_ALIGN(l) ALIGN_TO((l), page_size())
+#define PAGE_ALIGN_DOWN(l) ((l) & ~(page_size() - 1))
 
 static inline const char* yes_no(bool b) {
         return b ? "yes" : "no";
@@ -52,6 +52,9 @@ static usec_t arg_timeout = 0;
 #define NAME_IS_ACQUIRED INT_TO_PTR(1)
 #define NAME_IS_ACTIVATABLE INT_TO_PTR(2)
 
+/* Captured frames are collected in a buffer of this size, and written out in one go */
+#define CAPTURE_BUFFER_SIZE (1024U*1024U)
+
 static int acquire_bus(bool set_monitor, sd_bus **ret) {
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         int r;
@@ -1223,8 +1226,9 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 }
 
                 if (m) {
+                        /* Don't flush after every message, but only once we ran out of messages to process, so
+                         * that we keep up with message storms */
                         dump(m, stdout);
-                        fflush(stdout);
 
                         if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
                                 log_info("Connection terminated, exiting.");
@@ -1237,6 +1241,10 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 if (r > 0)
                         continue;
 
+                r = fflush_and_check(stdout);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write messages: %m");
+
                 r = sd_bus_wait(bus, (uint64_t) -1);
                 if (r < 0)
                         return log_error_errno(r, "Failed to wait for bus: %m");
@@ -1248,6 +1256,7 @@ static int verb_monitor(int argc, char **argv, void *userdata) {
 }
 
 static int verb_capture(int argc, char **argv, void *userdata) {
+        static char buffer[CAPTURE_BUFFER_SIZE];
         int r;
 
         if (isatty(fileno(stdout)) > 0) {
@@ -1255,6 +1264,10 @@ static int verb_capture(int argc, char **argv, void *userdata) {
                 return -EINVAL;
         }
 
+        /* Frames are written as they are on the wire, and only flushed in batches */
+        if (setvbuf(stdout, buffer, _IOFBF, sizeof(buffer)) != 0)
+                log_debug_errno(errno, "Failed to enlarge output buffer, ignoring: %m");
+
         bus_pcap_header(arg_snaplen, stdout);
 
         r = monitor(argc, argv, message_pcap);
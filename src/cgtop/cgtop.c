@@ -33,6 +33,11 @@
 typedef struct Group {
         char *path;
 
+        /* On the unified hierarchy, the cgroup directory is kept open between iterations */
+        int fd;
+        uint64_t cgroupid;
+        unsigned fd_iteration;
+
         bool n_tasks_valid:1;
         bool cpu_valid:1;
         bool memory_valid:1;
@@ -85,6 +90,7 @@ static enum {
 static void group_free(Group *g) {
         assert(g);
 
+        safe_close(g->fd);
         free(g->path);
         free(g);
 }
@@ -132,6 +138,53 @@ static bool is_root_cgroup(const char *path) {
         return empty_or_root(path);
 }
 
+static int group_open(Group *g, const char *controller, unsigned iteration) {
+        _cleanup_free_ char *fs = NULL;
+        uint64_t id;
+        int r;
+
+        assert(g);
+
+        /* Returns the open cgroup directory of the group, or -1 if attributes shall be read by path. Once per
+         * iteration, checks by its ID that the directory is still the one at the path, as the cgroup might have
+         * been removed and created again in the meantime. */
+
+        if (g->fd_iteration == iteration)
+                return g->fd;
+
+        g->fd_iteration = iteration;
+
+        if (g->fd >= 0) {
+                if (cg_get_path(controller, g->path, NULL, &fs) >= 0 &&
+                    cg_path_get_cgroupid(fs, &id) >= 0 &&
+                    id == g->cgroupid)
+                        return g->fd;
+
+                g->fd = safe_close(g->fd);
+        }
+
+        r = cg_open(controller, g->path);
+        if (r < 0)
+                return -1;
+
+        g->fd = r;
+
+        if (cg_fd_get_cgroupid(g->fd, &g->cgroupid) < 0)
+                /* Without IDs we can't tell whether the cgroup is still the same, hence don't cache anything */
+                g->fd = safe_close(g->fd);
+
+        return g->fd;
+}
+
+static int group_get_attribute(Group *g, int fd, const char *controller, const char *attribute, char **ret) {
+        assert(g);
+
+        if (fd >= 0)
+                return cg_get_attribute_at(fd, attribute, ret);
+
+        return cg_get_attribute(controller, g->path, attribute, ret);
+}
+
 static int process(
                 const char *controller,
                 const char *path,
@@ -141,7 +194,7 @@ static int process(
                 Group **ret) {
 
         Group *g;
-        int r, all_unified;
+        int r, all_unified, fd = -1;
 
         assert(controller);
         assert(path);
@@ -159,6 +212,8 @@ static int process(
                         if (!g)
                                 return -ENOMEM;
 
+                        g->fd = -1;
+                        g->fd_iteration = iteration - 1;
                         g->path = strdup(path);
                         if (!g->path) {
                                 group_free(g);
@@ -179,21 +234,27 @@ static int process(
                 }
         }
 
+        if (all_unified)
+                fd = group_open(g, controller, iteration);
+
         if (streq(controller, SYSTEMD_CGROUP_CONTROLLER) &&
             IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n_pids = 0, i;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                if (fd >= 0)
+                        r = cg_read_pids_at(fd, &pids, &n_pids);
+                else
+                        r = cg_read_pids(controller, path, &pids, &n_pids);
                 if (r == -ENOENT)
                         return 0;
                 if (r < 0)
                         return r;
 
                 g->n_tasks = 0;
-                while (cg_read_pid(f, &pid) > 0) {
+                for (i = 0; i < n_pids; i++) {
 
-                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pid) > 0)
+                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pids[i]) > 0)
                                 continue;
 
                         g->n_tasks++;
@@ -209,13 +270,9 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        r = cg_get_path(controller, path, "pids.current", &p);
-                        if (r < 0)
-                                return r;
+                        _cleanup_free_ char *v = NULL;
 
-                        r = read_one_line_file(p, &v);
+                        r = group_get_attribute(g, fd, controller, "pids.current", &v);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
@@ -301,16 +358,10 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
+                        _cleanup_free_ char *v = NULL;
 
-                        if (all_unified)
-                                r = cg_get_path(controller, path, "memory.current", &p);
-                        else
-                                r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_get_attribute(g, fd, controller,
+                                                all_unified ? "memory.current" : "memory.usage_in_bytes", &v);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
@@ -422,7 +473,7 @@ static int process(
 }
 
 static int refresh_one(
-                const char *controller,
+                char **controllers,
                 const char *path,
                 Hashmap *a,
                 Hashmap *b,
@@ -432,20 +483,25 @@ static int refresh_one(
 
         _cleanup_closedir_ DIR *d = NULL;
         Group *ours = NULL;
+        char **c;
         int r;
 
-        assert(controller);
+        assert(!strv_isempty(controllers));
         assert(path);
         assert(a);
 
         if (depth > arg_depth)
                 return 0;
 
-        r = process(controller, path, a, b, iteration, &ours);
-        if (r < 0)
-                return r;
+        /* All controllers passed in must be on the same hierarchy, so that we can process them all in a single
+         * walk of the tree */
+        STRV_FOREACH(c, controllers) {
+                r = process(*c, path, a, b, iteration, &ours);
+                if (r < 0)
+                        return r;
+        }
 
-        r = cg_enumerate_subgroups(controller, path, &d);
+        r = cg_enumerate_subgroups(controllers[0], path, &d);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -467,7 +523,7 @@ static int refresh_one(
 
                 path_simplify(p, false);
 
-                r = refresh_one(controller, p, a, b, iteration, depth + 1, &child);
+                r = refresh_one(controllers, p, a, b, iteration, depth + 1, &child);
                 if (r < 0)
                         return r;
 
@@ -475,7 +531,7 @@ static int refresh_one(
                     IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
                     child &&
                     child->n_tasks_valid &&
-                    streq(controller, SYSTEMD_CGROUP_CONTROLLER)) {
+                    streq(controllers[0], SYSTEMD_CGROUP_CONTROLLER)) {
 
                         /* Recursively sum up processes */
 
@@ -495,31 +551,25 @@ static int refresh_one(
 }
 
 static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
+        const char *c;
         int r;
 
         assert(a);
 
-        r = refresh_one(SYSTEMD_CGROUP_CONTROLLER, root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpu", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpuacct", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("memory", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("io", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("blkio", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("pids", root, a, b, iteration, 0, NULL);
+        r = cg_all_unified();
         if (r < 0)
                 return r;
+        if (r > 0)
+                /* On the unified hierarchy all controllers share the same tree, hence walk it only once instead
+                 * of once for each controller, which matters on hosts with lots of cgroups. */
+                return refresh_one(STRV_MAKE(SYSTEMD_CGROUP_CONTROLLER, "cpu", "memory", "io", "pids"),
+                                   root, a, b, iteration, 0, NULL);
+
+        FOREACH_STRING(c, SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids") {
+                r = refresh_one(STRV_MAKE(c), root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+        }
 
         return 0;
 }
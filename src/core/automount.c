@@ -33,6 +33,9 @@
 #include "unit-name.h"
 #include "unit.h"
 
+/* How many autofs packets to process per wakeup at most */
+#define AUTOMOUNT_PACKETS_MAX 256U
+
 static const UnitActiveState state_translation_table[_AUTOMOUNT_STATE_MAX] = {
         [AUTOMOUNT_DEAD] = UNIT_INACTIVE,
         [AUTOMOUNT_WAITING] = UNIT_ACTIVE,
@@ -959,89 +962,141 @@ static bool automount_may_gc(Unit *u) {
         return UNIT_VTABLE(t)->may_gc(t);
 }
 
-static int automount_dispatch_io(sd_event_source *s, int fd, uint32_t events, void *userdata) {
+static int automount_flush_requests(Automount *a, int type) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        union autofs_v5_packet_union packet;
-        Automount *a = AUTOMOUNT(userdata);
         Unit *trigger;
         int r;
 
         assert(a);
-        assert(fd == a->pipe_fd);
 
-        if (events != EPOLLIN) {
-                log_unit_error(UNIT(a), "Got invalid poll event %"PRIu32" on pipe (fd=%d)", events, fd);
-                goto fail;
-        }
-
-        r = loop_read_exact(a->pipe_fd, &packet, sizeof(packet), true);
-        if (r < 0) {
-                log_unit_error_errno(UNIT(a), r, "Invalid read from pipe: %m");
-                goto fail;
-        }
+        /* Acts on a run of packets of the same type at once: the tokens have all been remembered already, and
+         * are acked together once the mount or unmount finished, hence one job is enough for all of them. */
 
-        switch (packet.hdr.type) {
+        switch (type) {
 
         case autofs_ptype_missing_direct:
+                automount_enter_running(a);
+                break;
 
-                if (packet.v5_packet.pid > 0) {
-                        _cleanup_free_ char *p = NULL;
-
-                        get_process_comm(packet.v5_packet.pid, &p);
-                        log_unit_info(UNIT(a), "Got automount request for %s, triggered by %"PRIu32" (%s)", a->where, packet.v5_packet.pid, strna(p));
-                } else
-                        log_unit_debug(UNIT(a), "Got direct mount request on %s", a->where);
-
-                r = set_ensure_allocated(&a->tokens, NULL);
-                if (r < 0) {
-                        log_unit_error(UNIT(a), "Failed to allocate token set.");
-                        goto fail;
+        case autofs_ptype_expire_direct:
+                trigger = UNIT_TRIGGER(UNIT(a));
+                if (!trigger) {
+                        log_unit_error(UNIT(a), "Unit to trigger vanished.");
+                        return -ENOENT;
                 }
 
-                r = set_put(a->tokens, UINT_TO_PTR(packet.v5_packet.wait_queue_token));
+                r = manager_add_job(UNIT(a)->manager, JOB_STOP, trigger, JOB_REPLACE, &error, NULL);
                 if (r < 0) {
-                        log_unit_error_errno(UNIT(a), r, "Failed to remember token: %m");
-                        goto fail;
+                        log_unit_warning(UNIT(a), "Failed to queue umount startup job: %s", bus_error_message(&error, r));
+                        return r;
                 }
-
-                automount_enter_running(a);
                 break;
+        }
 
-        case autofs_ptype_expire_direct:
-                log_unit_debug(UNIT(a), "Got direct umount request on %s", a->where);
+        return 0;
+}
 
-                automount_stop_expire(a);
+static int automount_dispatch_io(sd_event_source *s, int fd, uint32_t events, void *userdata) {
+        union autofs_v5_packet_union packet;
+        Automount *a = AUTOMOUNT(userdata);
+        unsigned n_packets = 0;
+        int r, pending = -1;
 
-                r = set_ensure_allocated(&a->expire_tokens, NULL);
-                if (r < 0) {
-                        log_unit_error(UNIT(a), "Failed to allocate token set.");
-                        goto fail;
-                }
+        assert(a);
+        assert(fd == a->pipe_fd);
+
+        if (events != EPOLLIN) {
+                log_unit_error(UNIT(a), "Got invalid poll event %"PRIu32" on pipe (fd=%d)", events, fd);
+                goto fail;
+        }
 
-                r = set_put(a->expire_tokens, UINT_TO_PTR(packet.v5_packet.wait_queue_token));
+        /* When many processes hit the automount point at the same time, the kernel queues one packet for each of
+         * them. Let's read all that are queued (up to a limit, to not starve other event sources) before acting on
+         * them, so that we enqueue one job for the whole bunch rather than one per packet. The kernel writes each
+         * packet atomically into the pipe, hence a non-blocking read either gets a full one or nothing. */
+        for (;;) {
+                if (n_packets >= AUTOMOUNT_PACKETS_MAX)
+                        break;
+
+                r = loop_read_exact(a->pipe_fd, &packet, sizeof(packet), n_packets == 0);
+                if (r == -EAGAIN)
+                        break;
                 if (r < 0) {
-                        log_unit_error_errno(UNIT(a), r, "Failed to remember token: %m");
+                        log_unit_error_errno(UNIT(a), r, "Invalid read from pipe: %m");
                         goto fail;
                 }
 
-                trigger = UNIT_TRIGGER(UNIT(a));
-                if (!trigger) {
-                        log_unit_error(UNIT(a), "Unit to trigger vanished.");
-                        goto fail;
-                }
+                n_packets++;
 
-                r = manager_add_job(UNIT(a)->manager, JOB_STOP, trigger, JOB_REPLACE, &error, NULL);
-                if (r < 0) {
-                        log_unit_warning(UNIT(a), "Failed to queue umount startup job: %s", bus_error_message(&error, r));
-                        goto fail;
+                /* Act on the previous requests first, if they were of a different type, so that the order of
+                 * mounts and unmounts is kept. */
+                if (pending >= 0 && pending != (int) packet.hdr.type) {
+                        if (automount_flush_requests(a, pending) < 0)
+                                goto fail;
+
+                        /* Acting on the requests might have stopped us */
+                        if (a->pipe_fd != fd)
+                                return 0;
+
+                        pending = -1;
                 }
-                break;
 
-        default:
-                log_unit_error(UNIT(a), "Received unknown automount request %i", packet.hdr.type);
-                break;
+                switch (packet.hdr.type) {
+
+                case autofs_ptype_missing_direct:
+
+                        if (packet.v5_packet.pid > 0) {
+                                _cleanup_free_ char *p = NULL;
+
+                                get_process_comm(packet.v5_packet.pid, &p);
+                                log_unit_info(UNIT(a), "Got automount request for %s, triggered by %"PRIu32" (%s)", a->where, packet.v5_packet.pid, strna(p));
+                        } else
+                                log_unit_debug(UNIT(a), "Got direct mount request on %s", a->where);
+
+                        r = set_ensure_allocated(&a->tokens, NULL);
+                        if (r < 0) {
+                                log_unit_error(UNIT(a), "Failed to allocate token set.");
+                                goto fail;
+                        }
+
+                        r = set_put(a->tokens, UINT_TO_PTR(packet.v5_packet.wait_queue_token));
+                        if (r < 0) {
+                                log_unit_error_errno(UNIT(a), r, "Failed to remember token: %m");
+                                goto fail;
+                        }
+
+                        pending = packet.hdr.type;
+                        break;
+
+                case autofs_ptype_expire_direct:
+                        log_unit_debug(UNIT(a), "Got direct umount request on %s", a->where);
+
+                        automount_stop_expire(a);
+
+                        r = set_ensure_allocated(&a->expire_tokens, NULL);
+                        if (r < 0) {
+                                log_unit_error(UNIT(a), "Failed to allocate token set.");
+                                goto fail;
+                        }
+
+                        r = set_put(a->expire_tokens, UINT_TO_PTR(packet.v5_packet.wait_queue_token));
+                        if (r < 0) {
+                                log_unit_error_errno(UNIT(a), r, "Failed to remember token: %m");
+                                goto fail;
+                        }
+
+                        pending = packet.hdr.type;
+                        break;
+
+                default:
+                        log_unit_error(UNIT(a), "Received unknown automount request %i", packet.hdr.type);
+                        break;
+                }
         }
 
+        if (pending >= 0 && automount_flush_requests(a, pending) < 0)
+                goto fail;
+
         return 0;
 
 fail:
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "boot-trace.h"
+#include "manager.h"
+#include "string-table.h"
+
+BootTraceEvent* boot_trace_free(BootTraceEvent *events, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+                free(events[i].unit);
+                free(events[i].detail);
+        }
+
+        return mfree(events);
+}
+
+void manager_boot_trace(Manager *m, BootTraceEventType type, const char *unit, const char *format, ...) {
+        _cleanup_free_ char *u = NULL, *detail = NULL;
+        va_list ap;
+        int r;
+
+        assert(m);
+        assert(type >= 0);
+        assert(type < _BOOT_TRACE_EVENT_TYPE_MAX);
+        assert(unit);
+
+        /* Records an event for "systemd-analyze trace", but only until the system finished starting up. Failing
+         * to record an event is not fatal, the trace will just be incomplete. */
+
+        if (dual_timestamp_is_set(m->timestamps + MANAGER_TIMESTAMP_FINISH))
+                return;
+
+        if (m->n_boot_trace >= BOOT_TRACE_EVENTS_MAX)
+                return;
+
+        u = strdup(unit);
+        if (!u)
+                return;
+
+        if (format) {
+                va_start(ap, format);
+                r = vasprintf(&detail, format, ap);
+                va_end(ap);
+                if (r < 0)
+                        return;
+        }
+
+        if (!GREEDY_REALLOC(m->boot_trace, m->n_boot_trace_allocated, m->n_boot_trace + 1))
+                return;
+
+        m->boot_trace[m->n_boot_trace++] = (BootTraceEvent) {
+                .timestamp = now(CLOCK_MONOTONIC),
+                .type = type,
+                .unit = TAKE_PTR(u),
+                .detail = TAKE_PTR(detail),
+        };
+}
+
+static const char* const boot_trace_event_type_table[_BOOT_TRACE_EVENT_TYPE_MAX] = {
+        [BOOT_TRACE_JOB_INSTALLED] = "job-installed",
+        [BOOT_TRACE_JOB_STARTED] = "job-started",
+        [BOOT_TRACE_JOB_FINISHED] = "job-finished",
+        [BOOT_TRACE_UNIT_STATE] = "unit-state",
+        [BOOT_TRACE_SPAWN] = "spawn",
+        [BOOT_TRACE_CGROUP_REALIZED] = "cgroup-realized",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(boot_trace_event_type, BootTraceEventType);
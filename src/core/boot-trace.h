@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+typedef struct Manager Manager;
+
+/* Don't record more than this many events, in case the system never finishes booting */
+#define BOOT_TRACE_EVENTS_MAX 16384U
+
+typedef enum BootTraceEventType {
+        BOOT_TRACE_JOB_INSTALLED,
+        BOOT_TRACE_JOB_STARTED,
+        BOOT_TRACE_JOB_FINISHED,
+        BOOT_TRACE_UNIT_STATE,
+        BOOT_TRACE_SPAWN,
+        BOOT_TRACE_CGROUP_REALIZED,
+        _BOOT_TRACE_EVENT_TYPE_MAX,
+        _BOOT_TRACE_EVENT_TYPE_INVALID = -1,
+} BootTraceEventType;
+
+typedef struct BootTraceEvent {
+        usec_t timestamp; /* CLOCK_MONOTONIC */
+        BootTraceEventType type;
+        char *unit;
+        char *detail;
+} BootTraceEvent;
+
+BootTraceEvent* boot_trace_free(BootTraceEvent *events, size_t n);
+
+void manager_boot_trace(Manager *m, BootTraceEventType type, const char *unit, const char *format, ...) _printf_(4,5);
+
+const char* boot_trace_event_type_to_string(BootTraceEventType t) _const_;
+BootTraceEventType boot_trace_event_type_from_string(const char *s) _pure_;
@@ -19,7 +19,12 @@
 #include "bpf-firewall.h"
 #include "bpf-program.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "hexdecoct.h"
+#include "in-addr-util.h"
 #include "ip-address-access.h"
+#include "manager.h"
+#include "siphash24.h"
 #include "unit.h"
 
 enum {
@@ -32,6 +37,115 @@ enum {
         ACCESS_DENIED  = 2,
 };
 
+/* The LPM trie maps for one verdict, shared among all units with the same effective access list. The maps are
+ * never modified after creation, hence this is safe. */
+struct BPFAccessMaps {
+        unsigned n_ref;
+        Manager *manager;
+        char *key;
+        int ipv4_map_fd;
+        int ipv6_map_fd;
+};
+
+static BPFAccessMaps *bpf_access_maps_ref(BPFAccessMaps *m) {
+        assert(m);
+        assert(m->n_ref > 0);
+
+        m->n_ref++;
+        return m;
+}
+
+BPFAccessMaps *bpf_access_maps_unref(BPFAccessMaps *m) {
+        if (!m)
+                return NULL;
+
+        assert(m->n_ref > 0);
+        m->n_ref--;
+
+        if (m->n_ref > 0)
+                return NULL;
+
+        if (m->manager)
+                (void) hashmap_remove(m->manager->bpf_access_maps, m->key);
+
+        safe_close(m->ipv4_map_fd);
+        safe_close(m->ipv6_map_fd);
+        free(m->key);
+
+        return mfree(m);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFAccessMaps*, bpf_access_maps_unref);
+
+/* A loaded firewall program that doesn't do accounting. Such programs only refer to access maps, which are shared
+ * already, hence lots of units end up with the very same instructions, most prominently all those with just
+ * IPAddressDeny=any. Loading each of them separately means running the verifier again for every unit that is
+ * started. Instead, load it once, and give every unit its own BPFProgram on a duplicate of the kernel fd, so that
+ * each of them can still be attached and detached individually. We keep references on the access maps the
+ * instructions refer to, so that their fds can't be reused for different maps while we are around. */
+struct BPFSharedProgram {
+        unsigned n_ref;
+        Manager *manager;
+        BPFProgram *program;
+        BPFAccessMaps *allow_maps;
+        BPFAccessMaps *deny_maps;
+};
+
+static void bpf_program_hash_func(const void *p, struct siphash *state) {
+        const BPFProgram *a = p;
+
+        siphash24_compress(&a->prog_type, sizeof(a->prog_type), state);
+        siphash24_compress(&a->n_instructions, sizeof(a->n_instructions), state);
+        siphash24_compress(a->instructions, sizeof(struct bpf_insn) * a->n_instructions, state);
+}
+
+static int bpf_program_compare_func(const void *_a, const void *_b) {
+        const BPFProgram *a = _a, *b = _b;
+
+        if (a->prog_type != b->prog_type)
+                return a->prog_type < b->prog_type ? -1 : 1;
+
+        if (a->n_instructions != b->n_instructions)
+                return a->n_instructions < b->n_instructions ? -1 : 1;
+
+        return memcmp(a->instructions, b->instructions, sizeof(struct bpf_insn) * a->n_instructions);
+}
+
+static const struct hash_ops bpf_program_hash_ops = {
+        .hash = bpf_program_hash_func,
+        .compare = bpf_program_compare_func,
+};
+
+static BPFSharedProgram *bpf_shared_program_ref(BPFSharedProgram *s) {
+        assert(s);
+        assert(s->n_ref > 0);
+
+        s->n_ref++;
+        return s;
+}
+
+BPFSharedProgram *bpf_shared_program_unref(BPFSharedProgram *s) {
+        if (!s)
+                return NULL;
+
+        assert(s->n_ref > 0);
+        s->n_ref--;
+
+        if (s->n_ref > 0)
+                return NULL;
+
+        if (s->manager)
+                (void) hashmap_remove(s->manager->bpf_firewall_programs, s->program);
+
+        bpf_program_unref(s->program);
+        bpf_access_maps_unref(s->allow_maps);
+        bpf_access_maps_unref(s->deny_maps);
+
+        return mfree(s);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFSharedProgram*, bpf_shared_program_unref);
+
 /* Compile instructions for one list of addresses, one direction and one specific verdict on matches. */
 
 static int add_lookup_instructions(
@@ -172,19 +286,19 @@ static int bpf_firewall_compile_bpf(
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
         int accounting_map_fd, r;
         bool access_enabled;
+        UnitAccounting *a;
 
         assert(u);
+        assert(u->accounting);
         assert(ret);
 
+        a = u->accounting;
+
         accounting_map_fd = is_ingress ?
-                u->ip_accounting_ingress_map_fd :
-                u->ip_accounting_egress_map_fd;
+                a->ip_accounting_ingress_map_fd :
+                a->ip_accounting_egress_map_fd;
 
-        access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0;
+        access_enabled = a->ip_allow_maps || a->ip_deny_maps;
 
         if (accounting_map_fd < 0 && !access_enabled) {
                 *ret = NULL;
@@ -208,26 +322,26 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (a->ip_deny_maps && a->ip_deny_maps->ipv4_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ip_deny_maps->ipv4_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (a->ip_deny_maps && a->ip_deny_maps->ipv6_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ip_deny_maps->ipv6_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (a->ip_allow_maps && a->ip_allow_maps->ipv4_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ip_allow_maps->ipv4_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (a->ip_allow_maps && a->ip_allow_maps->ipv6_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ip_allow_maps->ipv6_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
@@ -368,19 +482,67 @@ static int bpf_firewall_add_access_items(
         return 0;
 }
 
+static int bpf_firewall_access_key(Unit *u, int verdict, char **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *key = NULL;
+        size_t size = 0;
+        Unit *p;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        /* Serializes the effective access list of the unit for one verdict, to identify identical maps */
+
+        f = open_memstream(&key, &size);
+        if (!f)
+                return -ENOMEM;
+
+        fprintf(f, "%i", verdict);
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                IPAddressAccessItem *a;
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                LIST_FOREACH(items, a, verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny) {
+                        _cleanup_free_ char *h = NULL;
+
+                        h = hexmem(&a->address, FAMILY_ADDRESS_SIZE(a->family));
+                        if (!h)
+                                return -ENOMEM;
+
+                        fprintf(f, " %i/%s/%u", a->family, h, a->prefixlen);
+                }
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        *ret = TAKE_PTR(key);
+        return 0;
+}
+
 static int bpf_firewall_prepare_access_maps(
                 Unit *u,
                 int verdict,
-                int *ret_ipv4_map_fd,
-                int *ret_ipv6_map_fd) {
+                BPFAccessMaps **ret) {
 
-        _cleanup_close_ int ipv4_map_fd = -1, ipv6_map_fd = -1;
+        _cleanup_(bpf_access_maps_unrefp) BPFAccessMaps *m = NULL;
+        _cleanup_free_ char *key = NULL;
         size_t n_ipv4 = 0, n_ipv6 = 0;
+        BPFAccessMaps *existing;
         Unit *p;
         int r;
 
-        assert(ret_ipv4_map_fd);
-        assert(ret_ipv6_map_fd);
+        assert(u);
+        assert(ret);
 
         for (p = u; p; p = UNIT_DEREF(p->slice)) {
                 CGroupContext *cc;
@@ -392,26 +554,58 @@ static int bpf_firewall_prepare_access_maps(
                 bpf_firewall_count_access_items(verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny, &n_ipv4, &n_ipv6);
         }
 
+        if (n_ipv4 == 0 && n_ipv6 == 0) {
+                *ret = NULL;
+                return 0;
+        }
+
+        /* Units in the same slice or instantiated from the same template usually end up with the very same
+         * access lists, hence let's share the maps in that case instead of creating and filling them again. */
+        r = bpf_firewall_access_key(u, verdict, &key);
+        if (r < 0)
+                return r;
+
+        existing = hashmap_get(u->manager->bpf_access_maps, key);
+        if (existing) {
+                *ret = bpf_access_maps_ref(existing);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&u->manager->bpf_access_maps, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        m = new(BPFAccessMaps, 1);
+        if (!m)
+                return -ENOMEM;
+
+        *m = (BPFAccessMaps) {
+                .n_ref = 1,
+                .key = TAKE_PTR(key),
+                .ipv4_map_fd = -1,
+                .ipv6_map_fd = -1,
+        };
+
         if (n_ipv4 > 0) {
-                ipv4_map_fd = bpf_map_new(
+                m->ipv4_map_fd = bpf_map_new(
                                 BPF_MAP_TYPE_LPM_TRIE,
                                 offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t),
                                 sizeof(uint64_t),
                                 n_ipv4,
                                 BPF_F_NO_PREALLOC);
-                if (ipv4_map_fd < 0)
-                        return ipv4_map_fd;
+                if (m->ipv4_map_fd < 0)
+                        return m->ipv4_map_fd;
         }
 
         if (n_ipv6 > 0) {
-                ipv6_map_fd = bpf_map_new(
+                m->ipv6_map_fd = bpf_map_new(
                                 BPF_MAP_TYPE_LPM_TRIE,
                                 offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t)*4,
                                 sizeof(uint64_t),
                                 n_ipv6,
                                 BPF_F_NO_PREALLOC);
-                if (ipv6_map_fd < 0)
-                        return ipv6_map_fd;
+                if (m->ipv6_map_fd < 0)
+                        return m->ipv6_map_fd;
         }
 
         for (p = u; p; p = UNIT_DEREF(p->slice)) {
@@ -422,54 +616,124 @@ static int bpf_firewall_prepare_access_maps(
                         continue;
 
                 r = bpf_firewall_add_access_items(verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny,
-                                                  ipv4_map_fd, ipv6_map_fd, verdict);
+                                                  m->ipv4_map_fd, m->ipv6_map_fd, verdict);
                 if (r < 0)
                         return r;
         }
 
-        *ret_ipv4_map_fd = ipv4_map_fd;
-        *ret_ipv6_map_fd = ipv6_map_fd;
+        r = hashmap_put(u->manager->bpf_access_maps, m->key, m);
+        if (r < 0)
+                return r;
+
+        m->manager = u->manager;
 
-        ipv4_map_fd = ipv6_map_fd = -1;
+        *ret = TAKE_PTR(m);
         return 0;
 }
 
-static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_ingress, int *fd_egress) {
+static int bpf_firewall_prepare_accounting_maps(UnitAccounting *a, bool enabled) {
         int r;
 
-        assert(u);
-        assert(fd_ingress);
-        assert(fd_egress);
+        assert(a);
 
         if (enabled) {
-                if (*fd_ingress < 0) {
+                if (a->ip_accounting_ingress_map_fd < 0) {
                         r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
-                        *fd_ingress = r;
+                        a->ip_accounting_ingress_map_fd = r;
                 }
 
-                if (*fd_egress < 0) {
+                if (a->ip_accounting_egress_map_fd < 0) {
 
                         r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
-                        *fd_egress = r;
+                        a->ip_accounting_egress_map_fd = r;
                 }
 
         } else {
-                *fd_ingress = safe_close(*fd_ingress);
-                *fd_egress = safe_close(*fd_egress);
+                a->ip_accounting_ingress_map_fd = safe_close(a->ip_accounting_ingress_map_fd);
+                a->ip_accounting_egress_map_fd = safe_close(a->ip_accounting_egress_map_fd);
+
+                zero(a->ip_accounting_extra);
+        }
+
+        return 0;
+}
+
+static int bpf_firewall_load_shared(Unit *u, BPFProgram *p, BPFSharedProgram **shared) {
+        _cleanup_(bpf_shared_program_unrefp) BPFSharedProgram *s = NULL;
+        UnitAccounting *a;
+        int r;
+
+        assert(u);
+        assert(u->accounting);
+        assert(shared);
+
+        a = u->accounting;
+
+        /* Programs that do accounting refer to the unit's own maps, hence there's nothing to share. They are loaded
+         * when they are attached. */
+        if (!p || a->ip_accounting_ingress_map_fd >= 0 || a->ip_accounting_egress_map_fd >= 0) {
+                *shared = bpf_shared_program_unref(*shared);
+                return 0;
+        }
 
-                zero(u->ip_accounting_extra);
+        s = hashmap_get(u->manager->bpf_firewall_programs, p);
+        if (s)
+                bpf_shared_program_ref(s);
+        else {
+                _cleanup_(bpf_program_unrefp) BPFProgram *k = NULL;
+
+                r = bpf_program_new(p->prog_type, &k);
+                if (r < 0)
+                        return r;
+
+                r = bpf_program_add_instructions(k, p->instructions, p->n_instructions);
+                if (r < 0)
+                        return r;
+
+                r = bpf_program_load_kernel(k, NULL, 0);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_ensure_allocated(&u->manager->bpf_firewall_programs, &bpf_program_hash_ops);
+                if (r < 0)
+                        return r;
+
+                s = new(BPFSharedProgram, 1);
+                if (!s)
+                        return -ENOMEM;
+
+                *s = (BPFSharedProgram) {
+                        .n_ref = 1,
+                        .program = TAKE_PTR(k),
+                        .allow_maps = a->ip_allow_maps ? bpf_access_maps_ref(a->ip_allow_maps) : NULL,
+                        .deny_maps = a->ip_deny_maps ? bpf_access_maps_ref(a->ip_deny_maps) : NULL,
+                };
+
+                r = hashmap_put(u->manager->bpf_firewall_programs, s->program, s);
+                if (r < 0)
+                        return r;
+
+                s->manager = u->manager;
         }
 
+        p->kernel_fd = fcntl(s->program->kernel_fd, F_DUPFD_CLOEXEC, 3);
+        if (p->kernel_fd < 0)
+                return -errno;
+
+        bpf_shared_program_unref(*shared);
+        *shared = TAKE_PTR(s);
         return 0;
 }
 
 int bpf_firewall_compile(Unit *u) {
+        _cleanup_(bpf_access_maps_unrefp) BPFAccessMaps *allow_maps = NULL, *deny_maps = NULL;
+        UnitAccounting *a;
         CGroupContext *cc;
         int r, supported;
 
@@ -496,18 +760,15 @@ int bpf_firewall_compile(Unit *u) {
                 return -EOPNOTSUPP;
         }
 
-        /* Note that when we compile a new firewall we first flush out the access maps and the BPF programs themselves,
-         * but we reuse the the accounting maps. That way the firewall in effect always maps to the actual
-         * configuration, but we don't flush out the accounting unnecessarily */
-
-        u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
-        u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
+        /* Note that when we compile a new firewall we first flush out the BPF programs themselves and replace the
+         * access maps by ones matching the current configuration (which might be shared with other units), but we
+         * reuse the the accounting maps. That way the firewall in effect always maps to the actual configuration,
+         * but we don't flush out the accounting unnecessarily */
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        if (u->accounting) {
+                u->accounting->ip_bpf_ingress = bpf_program_unref(u->accounting->ip_bpf_ingress);
+                u->accounting->ip_bpf_egress = bpf_program_unref(u->accounting->ip_bpf_egress);
+        }
 
         if (u->type != UNIT_SLICE) {
                 /* In inner nodes we only do accounting, we do not actually bother with access control. However, leaf
@@ -516,32 +777,55 @@ int bpf_firewall_compile(Unit *u) {
                  * means that all configure IP access rules *will* take effect on processes, even though we never
                  * compile them for inner nodes. */
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &allow_maps);
                 if (r < 0)
                         return log_error_errno(r, "Preparation of eBPF allow maps failed: %m");
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &deny_maps);
                 if (r < 0)
                         return log_error_errno(r, "Preparation of eBPF deny maps failed: %m");
         }
 
-        r = bpf_firewall_prepare_accounting_maps(u, cc->ip_accounting, &u->ip_accounting_ingress_map_fd, &u->ip_accounting_egress_map_fd);
+        /* Units that neither do IP accounting nor IP access control, and never did, don't need any BPF state */
+        if (!u->accounting && !allow_maps && !deny_maps && !cc->ip_accounting)
+                return 0;
+
+        a = unit_get_accounting(u);
+        if (!a)
+                return log_oom();
+
+        /* Only drop the old maps now, so that unchanged ones are reused rather than recreated */
+        bpf_access_maps_unref(a->ip_allow_maps);
+        a->ip_allow_maps = TAKE_PTR(allow_maps);
+        bpf_access_maps_unref(a->ip_deny_maps);
+        a->ip_deny_maps = TAKE_PTR(deny_maps);
+
+        r = bpf_firewall_prepare_accounting_maps(a, cc->ip_accounting);
         if (r < 0)
                 return log_error_errno(r, "Preparation of eBPF accounting maps failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, true, &u->ip_bpf_ingress);
+        r = bpf_firewall_compile_bpf(u, true, &a->ip_bpf_ingress);
         if (r < 0)
                 return log_error_errno(r, "Compilation for ingress BPF program failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, false, &u->ip_bpf_egress);
+        r = bpf_firewall_load_shared(u, a->ip_bpf_ingress, &a->ip_bpf_ingress_shared);
+        if (r < 0)
+                return log_error_errno(r, "Loading of ingress BPF program failed: %m");
+
+        r = bpf_firewall_compile_bpf(u, false, &a->ip_bpf_egress);
         if (r < 0)
                 return log_error_errno(r, "Compilation for egress BPF program failed: %m");
 
+        r = bpf_firewall_load_shared(u, a->ip_bpf_egress, &a->ip_bpf_egress_shared);
+        if (r < 0)
+                return log_error_errno(r, "Loading of egress BPF program failed: %m");
+
         return 0;
 }
 
 int bpf_firewall_install(Unit *u) {
         _cleanup_free_ char *path = NULL;
+        UnitAccounting *a;
         CGroupContext *cc;
         int r, supported;
         uint32_t flags;
@@ -568,6 +852,11 @@ int bpf_firewall_install(Unit *u) {
                 return -EOPNOTSUPP;
         }
 
+        /* Nothing was ever compiled for this unit, hence there's nothing to attach or detach either */
+        a = u->accounting;
+        if (!a)
+                return 0;
+
         r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, NULL, &path);
         if (r < 0)
                 return log_error_errno(r, "Failed to determine cgroup path: %m");
@@ -577,24 +866,24 @@ int bpf_firewall_install(Unit *u) {
 
         /* Unref the old BPF program (which will implicitly detach it) right before attaching the new program, to
          * minimize the time window when we don't account for IP traffic. */
-        u->ip_bpf_egress_installed = bpf_program_unref(u->ip_bpf_egress_installed);
-        u->ip_bpf_ingress_installed = bpf_program_unref(u->ip_bpf_ingress_installed);
+        a->ip_bpf_egress_installed = bpf_program_unref(a->ip_bpf_egress_installed);
+        a->ip_bpf_ingress_installed = bpf_program_unref(a->ip_bpf_ingress_installed);
 
-        if (u->ip_bpf_egress) {
-                r = bpf_program_cgroup_attach(u->ip_bpf_egress, BPF_CGROUP_INET_EGRESS, path, flags);
+        if (a->ip_bpf_egress) {
+                r = bpf_program_cgroup_attach(a->ip_bpf_egress, BPF_CGROUP_INET_EGRESS, path, flags);
                 if (r < 0)
                         return log_error_errno(r, "Attaching egress BPF program to cgroup %s failed: %m", path);
 
                 /* Remember that this BPF program is installed now. */
-                u->ip_bpf_egress_installed = bpf_program_ref(u->ip_bpf_egress);
+                a->ip_bpf_egress_installed = bpf_program_ref(a->ip_bpf_egress);
         }
 
-        if (u->ip_bpf_ingress) {
-                r = bpf_program_cgroup_attach(u->ip_bpf_ingress, BPF_CGROUP_INET_INGRESS, path, flags);
+        if (a->ip_bpf_ingress) {
+                r = bpf_program_cgroup_attach(a->ip_bpf_ingress, BPF_CGROUP_INET_INGRESS, path, flags);
                 if (r < 0)
                         return log_error_errno(r, "Attaching ingress BPF program to cgroup %s failed: %m", path);
 
-                u->ip_bpf_ingress_installed = bpf_program_ref(u->ip_bpf_ingress);
+                a->ip_bpf_ingress_installed = bpf_program_ref(a->ip_bpf_ingress);
         }
 
         return 0;
@@ -13,6 +13,9 @@ enum {
 
 int bpf_firewall_supported(void);
 
+BPFAccessMaps *bpf_access_maps_unref(BPFAccessMaps *m);
+BPFSharedProgram *bpf_shared_program_unref(BPFSharedProgram *s);
+
 int bpf_firewall_compile(Unit *u);
 int bpf_firewall_install(Unit *u);
 
@@ -5,6 +5,7 @@
 
 #include "alloc-util.h"
 #include "blockdev-util.h"
+#include "boot-trace.h"
 #include "bpf-firewall.h"
 #include "btrfs-util.h"
 #include "bus-error.h"
@@ -17,6 +18,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "set.h"
 #include "special.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -25,6 +27,9 @@
 
 #define CGROUP_CPU_QUOTA_PERIOD_USEC ((usec_t) 100 * USEC_PER_MSEC)
 
+/* How long a resource counter read from cgroupfs is reused by unit_get_metric_cached() */
+#define CGROUP_METRIC_CACHE_USEC ((usec_t) 500 * USEC_PER_MSEC)
+
 bool manager_owns_root_cgroup(Manager *m) {
         assert(m);
 
@@ -533,12 +538,90 @@ static uint64_t cgroup_context_cpu_shares(CGroupContext *c, ManagerState state)
                 return CGROUP_CPU_SHARES_DEFAULT;
 }
 
+static void unit_forget_cgroup_attribute(Unit *u, const char *key) {
+        char *k = NULL, *v;
+
+        v = hashmap_remove2(u->cgroup_attributes, key, (void**) &k);
+        free(k);
+        free(v);
+}
+
+static int unit_set_cgroup_attribute(Unit *u, const char *attribute, const char *entry, const char *value) {
+        _cleanup_free_ char *key = NULL, *v = NULL;
+        const char *controller;
+        int r;
+
+        assert(u);
+        assert(attribute);
+        assert(value);
+
+        /* Writes a cgroup attribute of the unit, unless we know that it already has this very value since we wrote
+         * it earlier: on reload we re-apply the settings of all units, and most of them didn't change. For
+         * attributes that hold one line per device or so, 'entry' identifies the line 'value' sets. */
+
+        key = entry ? strjoin(attribute, "/", entry) : strdup(attribute);
+        if (!key)
+                return -ENOMEM;
+
+        v = strdup(value);
+        if (!v)
+                return -ENOMEM;
+        delete_trailing_chars(v, NEWLINE);
+
+        if (streq_ptr(hashmap_get(u->cgroup_attributes, key), v))
+                return 0;
+
+        /* The attribute name is prefixed by the controller it belongs to */
+        controller = strndupa(attribute, strcspn(attribute, "."));
+
+        unit_forget_cgroup_attribute(u, key);
+
+        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        if (r < 0)
+                return r;
+
+        /* If we can't remember what we wrote we'll just write it again next time */
+        if (hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops) < 0)
+                return 0;
+        if (hashmap_put(u->cgroup_attributes, key, v) < 0)
+                return 0;
+        key = v = NULL;
+
+        return 0;
+}
+
+static void unit_prune_cgroup_attributes(Unit *u, CGroupMask mask) {
+        Iterator i;
+        char *key;
+        void *v;
+
+        assert(u);
+
+        /* Forget about the attributes of controllers that are not realized anymore: their cgroups might be gone
+         * and be created anew later on, with the kernel's defaults. */
+
+        HASHMAP_FOREACH_KEY(v, key, u->cgroup_attributes, i) {
+                _cleanup_free_ char *controller = NULL;
+                CGroupController c;
+
+                controller = strndup(key, strcspn(key, "."));
+                if (!controller)
+                        return;
+
+                c = cgroup_controller_from_string(controller);
+                if (c >= 0 && (mask & CGROUP_CONTROLLER_TO_MASK(c)))
+                        continue;
+
+                unit_forget_cgroup_attribute(u, key);
+        }
+}
+
 static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t quota) {
         char buf[MAX(DECIMAL_STR_MAX(uint64_t) + 1, (DECIMAL_STR_MAX(usec_t) + 1) * 2)];
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", weight);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.weight", buf);
+        r = unit_set_cgroup_attribute(u, "cpu.weight", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.weight: %m");
@@ -549,7 +632,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         else
                 xsprintf(buf, "max " USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
 
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.max", buf);
+        r = unit_set_cgroup_attribute(u, "cpu.max", NULL, buf);
 
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -561,22 +644,22 @@ static void cgroup_apply_legacy_cpu_config(Unit *u, uint64_t shares, uint64_t qu
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", shares);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.shares", buf);
+        r = unit_set_cgroup_attribute(u, "cpu.shares", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.shares: %m");
 
         xsprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
+        r = unit_set_cgroup_attribute(u, "cpu.cfs_period_us", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_period_us: %m");
 
         if (quota != USEC_INFINITY) {
                 xsprintf(buf, USEC_FMT "\n", quota * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
+                r = unit_set_cgroup_attribute(u, "cpu.cfs_quota_us", NULL, buf);
         } else
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
+                r = unit_set_cgroup_attribute(u, "cpu.cfs_quota_us", NULL, "-1");
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_quota_us: %m");
@@ -641,6 +724,7 @@ static uint64_t cgroup_weight_io_to_blkio(uint64_t io_weight) {
 
 static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_t io_weight) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char devnum[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -648,8 +732,9 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), io_weight);
-        r = cg_set_attribute("io", u->cgroup_path, "io.weight", buf);
+        xsprintf(devnum, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", devnum, io_weight);
+        r = unit_set_cgroup_attribute(u, "io.weight", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.weight: %m");
@@ -657,6 +742,7 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
 
 static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint64_t blkio_weight) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char devnum[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -664,8 +750,9 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), blkio_weight);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.weight_device", buf);
+        xsprintf(devnum, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", devnum, blkio_weight);
+        r = unit_set_cgroup_attribute(u, "blkio.weight_device", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.weight_device: %m");
@@ -673,6 +760,7 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
 
 static void cgroup_apply_io_device_latency(Unit *u, const char *dev_path, usec_t target) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+7+DECIMAL_STR_MAX(uint64_t)+1];
+        char devnum[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -680,12 +768,13 @@ static void cgroup_apply_io_device_latency(Unit *u, const char *dev_path, usec_t
         if (r < 0)
                 return;
 
+        xsprintf(devnum, "%u:%u", major(dev), minor(dev));
         if (target != USEC_INFINITY)
-                xsprintf(buf, "%u:%u target=%" PRIu64 "\n", major(dev), minor(dev), target);
+                xsprintf(buf, "%s target=%" PRIu64 "\n", devnum, target);
         else
-                xsprintf(buf, "%u:%u target=max\n", major(dev), minor(dev));
+                xsprintf(buf, "%s target=max\n", devnum);
 
-        r = cg_set_attribute("io", u->cgroup_path, "io.latency", buf);
+        r = unit_set_cgroup_attribute(u, "io.latency", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.latency on cgroup %s: %m", u->cgroup_path);
@@ -695,6 +784,7 @@ static void cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint64_t
         char limit_bufs[_CGROUP_IO_LIMIT_TYPE_MAX][DECIMAL_STR_MAX(uint64_t)];
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+(6+DECIMAL_STR_MAX(uint64_t)+1)*4];
         CGroupIOLimitType type;
+        char devnum[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -702,16 +792,17 @@ static void cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint64_t
         if (r < 0)
                 return;
 
+        xsprintf(devnum, "%u:%u", major(dev), minor(dev));
         for (type = 0; type < _CGROUP_IO_LIMIT_TYPE_MAX; type++)
                 if (limits[type] != cgroup_io_limit_defaults[type])
                         xsprintf(limit_bufs[type], "%" PRIu64, limits[type]);
                 else
                         xsprintf(limit_bufs[type], "%s", limits[type] == CGROUP_LIMIT_MAX ? "max" : "0");
 
-        xsprintf(buf, "%u:%u rbps=%s wbps=%s riops=%s wiops=%s\n", major(dev), minor(dev),
+        xsprintf(buf, "%s rbps=%s wbps=%s riops=%s wiops=%s\n", devnum,
                  limit_bufs[CGROUP_IO_RBPS_MAX], limit_bufs[CGROUP_IO_WBPS_MAX],
                  limit_bufs[CGROUP_IO_RIOPS_MAX], limit_bufs[CGROUP_IO_WIOPS_MAX]);
-        r = cg_set_attribute("io", u->cgroup_path, "io.max", buf);
+        r = unit_set_cgroup_attribute(u, "io.max", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.max: %m");
@@ -719,6 +810,7 @@ static void cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint64_t
 
 static void cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, uint64_t rbps, uint64_t wbps) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char devnum[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -726,14 +818,15 @@ static void cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, uint6
         if (r < 0)
                 return;
 
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), rbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.read_bps_device", buf);
+        xsprintf(devnum, "%u:%u", major(dev), minor(dev));
+        sprintf(buf, "%s %" PRIu64 "\n", devnum, rbps);
+        r = unit_set_cgroup_attribute(u, "blkio.throttle.read_bps_device", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.read_bps_device: %m");
 
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), wbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.write_bps_device", buf);
+        sprintf(buf, "%s %" PRIu64 "\n", devnum, wbps);
+        r = unit_set_cgroup_attribute(u, "blkio.throttle.write_bps_device", devnum, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.write_bps_device: %m");
@@ -750,7 +843,7 @@ static void cgroup_apply_unified_memory_limit(Unit *u, const char *file, uint64_
         if (v != CGROUP_LIMIT_MAX)
                 xsprintf(buf, "%" PRIu64 "\n", v);
 
-        r = cg_set_attribute("memory", u->cgroup_path, file, buf);
+        r = unit_set_cgroup_attribute(u, file, NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set %s: %m", file);
@@ -859,7 +952,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "default %" PRIu64 "\n", weight);
-                        r = cg_set_attribute("io", path, "io.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "io.weight", "default", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set io.weight: %m");
@@ -938,7 +1031,7 @@ static void cgroup_context_apply(
                                 weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "%" PRIu64 "\n", weight);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "blkio.weight", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set blkio.weight: %m");
@@ -1013,7 +1106,7 @@ static void cgroup_context_apply(
                         else
                                 xsprintf(buf, "%" PRIu64 "\n", val);
 
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = unit_set_cgroup_attribute(u, "memory.limit_in_bytes", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set memory.limit_in_bytes: %m");
@@ -1118,9 +1211,9 @@ static void cgroup_context_apply(
                                 char buf[DECIMAL_STR_MAX(uint64_t) + 2];
 
                                 sprintf(buf, "%" PRIu64 "\n", c->tasks_max);
-                                r = cg_set_attribute("pids", path, "pids.max", buf);
+                                r = unit_set_cgroup_attribute(u, "pids.max", NULL, buf);
                         } else
-                                r = cg_set_attribute("pids", path, "pids.max", "max");
+                                r = unit_set_cgroup_attribute(u, "pids.max", NULL, "max");
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set pids.max: %m");
@@ -1532,6 +1625,12 @@ static int unit_create_cgroup(
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", u->cgroup_path);
         created = !!r;
 
+        /* A new cgroup carries the kernel's defaults, whatever we might have written to an earlier incarnation */
+        if (created)
+                u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+        else
+                unit_prune_cgroup_attributes(u, target_mask);
+
         /* Start watching it */
         (void) unit_watch_cgroup(u);
 
@@ -1800,6 +1899,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         cgroup_context_apply(u, target_mask, apply_bpf, state);
         cgroup_xattr_apply(u);
 
+        manager_boot_trace(u->manager, BOOT_TRACE_CGROUP_REALIZED, u->id, "%s", u->cgroup_path);
+
         return 0;
 }
 
@@ -1903,6 +2004,9 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+        unit_invalidate_metric_cache(u);
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1949,8 +2053,9 @@ void unit_prune_cgroup(Unit *u) {
 }
 
 int unit_search_main_pid(Unit *u, pid_t *ret) {
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
         pid_t pid = 0, npid, mypid;
+        size_t n_pids = 0, i;
         int r;
 
         assert(u);
@@ -1959,14 +2064,16 @@ int unit_search_main_pid(Unit *u, pid_t *ret) {
         if (!u->cgroup_path)
                 return -ENXIO;
 
-        r = cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, &f);
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, &pids, &n_pids);
         if (r < 0)
                 return r;
 
         mypid = getpid_cached();
-        while (cg_read_pid(f, &npid) > 0)  {
+        for (i = 0; i < n_pids; i++) {
                 pid_t ppid;
 
+                npid = pids[i];
+
                 if (npid == pid)
                         continue;
 
@@ -1990,28 +2097,23 @@ int unit_search_main_pid(Unit *u, pid_t *ret) {
 
 static int unit_watch_pids_in_path(Unit *u, const char *path) {
         _cleanup_closedir_ DIR *d = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t n_pids = 0, i;
         int ret = 0, r;
 
         assert(u);
         assert(path);
 
-        r = cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, path, &f);
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, path, &pids, &n_pids);
         if (r < 0)
                 ret = r;
-        else {
-                pid_t pid;
-
-                while ((r = cg_read_pid(f, &pid)) > 0) {
-                        r = unit_watch_pid(u, pid);
+        else
+                for (i = 0; i < n_pids; i++) {
+                        r = unit_watch_pid(u, pids[i]);
                         if (r < 0 && ret >= 0)
                                 ret = r;
                 }
 
-                if (r < 0 && ret >= 0)
-                        ret = r;
-        }
-
         r = cg_enumerate_subgroups(SYSTEMD_CGROUP_CONTROLLER, path, &d);
         if (r < 0) {
                 if (ret >= 0)
@@ -2146,6 +2248,7 @@ void unit_add_to_cgroup_empty_queue(Unit *u) {
         /* Let's verify that the cgroup is really empty */
         if (!u->cgroup_path)
                 return;
+        u->manager->cgroup_empty_n_checks++;
         r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path);
         if (r < 0) {
                 log_unit_debug_errno(u, r, "Failed to determine whether cgroup %s is empty: %m", u->cgroup_path);
@@ -2164,12 +2267,21 @@ void unit_add_to_cgroup_empty_queue(Unit *u) {
 }
 
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_set_free_ Set *units = NULL;
         Manager *m = userdata;
+        bool overflow = false;
+        Iterator i;
+        Unit *u;
+        int r = 0;
 
         assert(s);
         assert(fd >= 0);
         assert(m);
 
+        /* A cgroup.events file is modified a number of times while processes come and go, and every modification
+         * results in an inotify event. Hence, first collect the units with any events pending, and then check
+         * each of them only once. */
+
         for (;;) {
                 union inotify_event_buffer buffer;
                 struct inotify_event *e;
@@ -2178,17 +2290,22 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                 l = read(fd, &buffer, sizeof(buffer));
                 if (l < 0) {
                         if (IN_SET(errno, EINTR, EAGAIN))
-                                return 0;
+                                break;
 
-                        return log_error_errno(errno, "Failed to read control group inotify events: %m");
+                        r = log_error_errno(errno, "Failed to read control group inotify events: %m");
+                        break;
                 }
 
                 FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                        Unit *u;
+                        m->cgroup_inotify_n_events++;
 
-                        if (e->wd < 0)
-                                /* Queue overflow has no watch descriptor */
+                        if (e->wd < 0) {
+                                /* Queue overflow has no watch descriptor, and means we lost events for any of our
+                                 * cgroups */
+                                if (e->mask & IN_Q_OVERFLOW)
+                                        overflow = true;
                                 continue;
+                        }
 
                         if (e->mask & IN_IGNORED)
                                 /* The watch was just removed */
@@ -2202,9 +2319,41 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                                  * this here safely. */
                                 continue;
 
-                        unit_add_to_cgroup_empty_queue(u);
+                        /* If we can't remember the unit for later, check it right away */
+                        if (set_ensure_allocated(&units, NULL) < 0 ||
+                            set_put(units, u) < 0)
+                                unit_add_to_cgroup_empty_queue(u);
                 }
         }
+
+        if (overflow) {
+                log_debug("Control group inotify queue overflowed, checking all watched control groups.");
+                m->cgroup_inotify_n_overflows++;
+
+                HASHMAP_FOREACH(u, m->cgroup_inotify_wd_unit, i)
+                        unit_add_to_cgroup_empty_queue(u);
+        } else
+                SET_FOREACH(u, units, i)
+                        unit_add_to_cgroup_empty_queue(u);
+
+        return r;
+}
+
+void manager_dump_cgroup_statistics(Manager *m, FILE *f, const char *prefix) {
+        assert(m);
+        assert(f);
+
+        prefix = strempty(prefix);
+
+        fprintf(f,
+                "%sControl group inotify watches: %u\n"
+                "%sControl group inotify events: %" PRIu64 "\n"
+                "%sControl group inotify queue overflows: %" PRIu64 "\n"
+                "%sControl group emptiness checks: %" PRIu64 "\n",
+                prefix, hashmap_size(m->cgroup_inotify_wd_unit),
+                prefix, m->cgroup_inotify_n_events,
+                prefix, m->cgroup_inotify_n_overflows,
+                prefix, m->cgroup_empty_n_checks);
 }
 
 int manager_setup_cgroup(Manager *m) {
@@ -2594,23 +2743,26 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
                 return -ENODATA;
 
         r = unit_get_cpu_usage_raw(u, &ns);
-        if (r == -ENODATA && u->cpu_usage_last != NSEC_INFINITY) {
+        if (r == -ENODATA && u->accounting && u->accounting->cpu_usage_last != NSEC_INFINITY) {
                 /* If we can't get the CPU usage anymore (because the cgroup was already removed, for example), use our
                  * cached value. */
 
                 if (ret)
-                        *ret = u->cpu_usage_last;
+                        *ret = u->accounting->cpu_usage_last;
                 return 0;
         }
         if (r < 0)
                 return r;
 
-        if (ns > u->cpu_usage_base)
-                ns -= u->cpu_usage_base;
+        if (!unit_get_accounting(u))
+                return -ENOMEM;
+
+        if (ns > u->accounting->cpu_usage_base)
+                ns -= u->accounting->cpu_usage_base;
         else
                 ns = 0;
 
-        u->cpu_usage_last = ns;
+        u->accounting->cpu_usage_last = ns;
         if (ret)
                 *ret = ns;
 
@@ -2633,9 +2785,13 @@ int unit_get_ip_accounting(
         if (!UNIT_CGROUP_BOOL(u, ip_accounting))
                 return -ENODATA;
 
+        /* The accounting maps live in here, hence if it wasn't allocated yet, there's nothing to read */
+        if (!u->accounting)
+                return -ENODATA;
+
         fd = IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_INGRESS_PACKETS) ?
-                u->ip_accounting_ingress_map_fd :
-                u->ip_accounting_egress_map_fd;
+                u->accounting->ip_accounting_ingress_map_fd :
+                u->accounting->ip_accounting_egress_map_fd;
         if (fd < 0)
                 return -ENODATA;
 
@@ -2650,26 +2806,93 @@ int unit_get_ip_accounting(
          * all BPF programs and maps anew, but serialize the old counters. When deserializing we store them in the
          * ip_accounting_extra[] field, and add them in here transparently. */
 
-        *ret = value + u->ip_accounting_extra[metric];
+        *ret = value + u->accounting->ip_accounting_extra[metric];
 
         return r;
 }
 
+int unit_get_metric_cached(Unit *u, CGroupMetric metric, uint64_t *ret) {
+        usec_t n;
+        int r;
+
+        assert(u);
+        assert(metric >= 0);
+        assert(metric < _CGROUP_METRIC_MAX);
+        assert(ret);
+
+        /* Like unit_get_memory_current(), unit_get_tasks_current() and unit_get_cpu_usage(), but returns the
+         * value read before if that was only very recently. Monitoring tools tend to poll these counters for all
+         * units, frequently, and reading each from cgroupfs every single time is not cheap for us. */
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (u->accounting &&
+            u->accounting->metric_cache_timestamp[metric] > 0 &&
+            n < usec_add(u->accounting->metric_cache_timestamp[metric], CGROUP_METRIC_CACHE_USEC)) {
+                *ret = u->accounting->metric_cache[metric];
+                return 0;
+        }
+
+        switch (metric) {
+
+        case CGROUP_METRIC_MEMORY_CURRENT:
+                r = unit_get_memory_current(u, ret);
+                break;
+
+        case CGROUP_METRIC_TASKS_CURRENT:
+                r = unit_get_tasks_current(u, ret);
+                break;
+
+        case CGROUP_METRIC_CPU_USAGE:
+                r = unit_get_cpu_usage(u, ret);
+                break;
+
+        default:
+                assert_not_reached("Unknown metric");
+        }
+        if (r < 0) {
+                if (u->accounting)
+                        u->accounting->metric_cache_timestamp[metric] = 0;
+                return r;
+        }
+
+        /* Only units that actually account for something get here, hence this doesn't allocate the accounting
+         * data for the others. If that fails, we just don't cache. */
+        if (unit_get_accounting(u)) {
+                u->accounting->metric_cache[metric] = *ret;
+                u->accounting->metric_cache_timestamp[metric] = n;
+        }
+
+        return 0;
+}
+
+void unit_invalidate_metric_cache(Unit *u) {
+        assert(u);
+
+        if (u->accounting)
+                zero(u->accounting->metric_cache_timestamp);
+}
+
 int unit_reset_cpu_accounting(Unit *u) {
         nsec_t ns;
         int r;
 
         assert(u);
 
-        u->cpu_usage_last = NSEC_INFINITY;
+        if (u->accounting) {
+                u->accounting->cpu_usage_last = NSEC_INFINITY;
+                u->accounting->cpu_usage_base = 0;
+                u->accounting->metric_cache_timestamp[CGROUP_METRIC_CPU_USAGE] = 0;
+        }
 
         r = unit_get_cpu_usage_raw(u, &ns);
-        if (r < 0) {
-                u->cpu_usage_base = 0;
+        if (r < 0)
                 return r;
-        }
 
-        u->cpu_usage_base = ns;
+        if (!unit_get_accounting(u))
+                return -ENOMEM;
+
+        u->accounting->cpu_usage_base = ns;
         return 0;
 }
 
@@ -2678,13 +2901,16 @@ int unit_reset_ip_accounting(Unit *u) {
 
         assert(u);
 
-        if (u->ip_accounting_ingress_map_fd >= 0)
-                r = bpf_firewall_reset_accounting(u->ip_accounting_ingress_map_fd);
+        if (!u->accounting)
+                return 0;
+
+        if (u->accounting->ip_accounting_ingress_map_fd >= 0)
+                r = bpf_firewall_reset_accounting(u->accounting->ip_accounting_ingress_map_fd);
 
-        if (u->ip_accounting_egress_map_fd >= 0)
-                q = bpf_firewall_reset_accounting(u->ip_accounting_egress_map_fd);
+        if (u->accounting->ip_accounting_egress_map_fd >= 0)
+                q = bpf_firewall_reset_accounting(u->accounting->ip_accounting_egress_map_fd);
 
-        zero(u->ip_accounting_extra);
+        zero(u->accounting->ip_accounting_extra);
 
         return r < 0 ? r : q;
 }
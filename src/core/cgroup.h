@@ -130,6 +130,15 @@ typedef enum CGroupIPAccountingMetric {
         _CGROUP_IP_ACCOUNTING_METRIC_INVALID = -1,
 } CGroupIPAccountingMetric;
 
+/* The resource counters read from cgroupfs that clients tend to poll for, see unit_get_metric_cached() */
+typedef enum CGroupMetric {
+        CGROUP_METRIC_MEMORY_CURRENT,
+        CGROUP_METRIC_TASKS_CURRENT,
+        CGROUP_METRIC_CPU_USAGE,
+        _CGROUP_METRIC_MAX,
+        _CGROUP_METRIC_INVALID = -1,
+} CGroupMetric;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 
@@ -177,6 +186,7 @@ int unit_attach_pids_to_cgroup(Unit *u, Set *pids, const char *suffix_path);
 
 int manager_setup_cgroup(Manager *m);
 void manager_shutdown_cgroup(Manager *m, bool delete);
+void manager_dump_cgroup_statistics(Manager *m, FILE *f, const char *prefix);
 
 unsigned manager_dispatch_cgroup_realize_queue(Manager *m);
 
@@ -193,6 +203,8 @@ int unit_get_memory_current(Unit *u, uint64_t *ret);
 int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
+int unit_get_metric_cached(Unit *u, CGroupMetric metric, uint64_t *ret);
+void unit_invalidate_metric_cache(Unit *u);
 
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
@@ -3,12 +3,14 @@
 #include "sd-bus.h"
 
 #include "alloc-util.h"
+#include "bus-objects.h"
 #include "dbus-job.h"
 #include "dbus.h"
 #include "job.h"
 #include "log.h"
 #include "selinux-access.h"
 #include "string-util.h"
+#include "strv.h"
 
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_type, job_type, JobType);
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_state, job_state, JobState);
@@ -125,7 +127,7 @@ const sd_bus_vtable bus_job_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
-static int send_new_signal(sd_bus *bus, void *userdata) {
+static int build_new_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_free_ char *p = NULL;
         Job *j = userdata;
@@ -151,12 +153,14 @@ static int send_new_signal(sd_bus *bus, void *userdata) {
         if (r < 0)
                 return r;
 
-        return sd_bus_send(bus, m, NULL);
+        ret[0] = TAKE_PTR(m);
+        return 1;
 }
 
-static int send_changed_signal(sd_bus *bus, void *userdata) {
+static int build_changed_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
         _cleanup_free_ char *p = NULL;
         Job *j = userdata;
+        int r;
 
         assert(bus);
         assert(j);
@@ -165,7 +169,11 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
         if (!p)
                 return -ENOMEM;
 
-        return sd_bus_emit_properties_changed(bus, p, "org.freedesktop.systemd1.Job", "State", NULL);
+        r = bus_message_new_properties_changed(bus, p, "org.freedesktop.systemd1.Job", STRV_MAKE("State"), ret);
+        if (r <= 0)
+                return r;
+
+        return 1;
 }
 
 void bus_job_send_change_signal(Job *j) {
@@ -178,14 +186,14 @@ void bus_job_send_change_signal(Job *j) {
                 j->in_dbus_queue = false;
         }
 
-        r = bus_foreach_bus(j->manager, j->bus_track, j->sent_dbus_new_signal ? send_changed_signal : send_new_signal, j);
+        r = bus_broadcast(j->manager, j->bus_track, j->sent_dbus_new_signal ? build_changed_signal : build_new_signal, j);
         if (r < 0)
                 log_debug_errno(r, "Failed to send job change signal for %u: %m", j->id);
 
         j->sent_dbus_new_signal = true;
 }
 
-static int send_removed_signal(sd_bus *bus, void *userdata) {
+static int build_removed_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_free_ char *p = NULL;
         Job *j = userdata;
@@ -211,7 +219,8 @@ static int send_removed_signal(sd_bus *bus, void *userdata) {
         if (r < 0)
                 return r;
 
-        return sd_bus_send(bus, m, NULL);
+        ret[0] = TAKE_PTR(m);
+        return 1;
 }
 
 void bus_job_send_removed_signal(Job *j) {
@@ -222,7 +231,7 @@ void bus_job_send_removed_signal(Job *j) {
         if (!j->sent_dbus_new_signal)
                 bus_job_send_change_signal(j);
 
-        r = bus_foreach_bus(j->manager, j->bus_track, send_removed_signal, j);
+        r = bus_broadcast(j->manager, j->bus_track, build_removed_signal, j);
         if (r < 0)
                 log_debug_errno(r, "Failed to send job remove signal for %u: %m", j->id);
 }
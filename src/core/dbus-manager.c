@@ -7,8 +7,10 @@
 
 #include "alloc-util.h"
 #include "architecture.h"
+#include "boot-trace.h"
 #include "build.h"
 #include "bus-common-errors.h"
+#include "bus-objects.h"
 #include "dbus-execute.h"
 #include "dbus-job.h"
 #include "dbus-manager.h"
@@ -19,6 +21,7 @@
 #include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "generator-run.h"
 #include "install.h"
 #include "log.h"
 #include "os-util.h"
@@ -236,6 +239,39 @@ static int property_get_show_status(
         return sd_bus_message_append_basic(reply, 'b', &b);
 }
 
+static int property_get_generator_timings(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(sti)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                r = sd_bus_message_append(reply, "(sti)",
+                                          m->generator_timings[i].name,
+                                          m->generator_timings[i].duration,
+                                          m->generator_timings[i].status);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_set_runtime_watchdog(
                 sd_bus *bus,
                 const char *path,
@@ -757,6 +793,198 @@ static int method_list_units_by_names(sd_bus_message *message, void *userdata, s
         return sd_bus_send(NULL, reply, NULL);
 }
 
+static int method_get_units_properties(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **units = NULL, **properties = NULL;
+        _cleanup_set_free_ Set *filter = NULL;
+        Manager *m = userdata;
+        char **unit, **p;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &units);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &properties);
+        if (r < 0)
+                return r;
+
+        /* Returns the properties of all listed units, as GetAll() on each of them would, so that clients showing
+         * many units don't need a round trip for each of them. If properties are listed, only those are returned. */
+
+        if (!strv_isempty(properties)) {
+                filter = set_new(&string_hash_ops);
+                if (!filter)
+                        return -ENOMEM;
+
+                STRV_FOREACH(p, properties) {
+                        r = set_put(filter, *p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(unit, units) {
+                _cleanup_free_ char *path = NULL;
+                Unit *u;
+
+                if (!unit_name_is_valid(*unit, UNIT_NAME_PLAIN|UNIT_NAME_INSTANCE))
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Unit name %s is not valid.", *unit);
+
+                r = bus_load_unit_by_name(m, message, *unit, &u, error);
+                if (r < 0)
+                        return r;
+
+                r = mac_selinux_unit_access_check(u, message, "status", error);
+                if (r < 0)
+                        return r;
+
+                path = unit_dbus_path(u);
+                if (!path)
+                        return -ENOMEM;
+
+                r = sd_bus_message_open_container(reply, 'r', "sa{sv}");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", *unit);
+                if (r < 0)
+                        return r;
+
+                r = bus_message_append_object_properties(sd_bus_message_get_bus(message), reply, path, filter, error);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_get_units_accounting(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttt)");
+        if (r < 0)
+                return r;
+
+        /* Returns the same values as the MemoryCurrent, CPUUsageNSec and TasksCurrent properties, for all units
+         * with a cgroup in one go, so that monitoring tools don't need a property call for each of them. */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                uint64_t memory = (uint64_t) -1, cpu = (uint64_t) -1, tasks = (uint64_t) -1;
+
+                if (k != u->id)
+                        continue;
+
+                if (!u->cgroup_path)
+                        continue;
+
+                r = unit_get_metric_cached(u, CGROUP_METRIC_MEMORY_CURRENT, &memory);
+                if (r < 0 && r != -ENODATA)
+                        log_unit_warning_errno(u, r, "Failed to get memory.usage_in_bytes attribute: %m");
+
+                r = unit_get_metric_cached(u, CGROUP_METRIC_CPU_USAGE, &cpu);
+                if (r < 0 && r != -ENODATA)
+                        log_unit_warning_errno(u, r, "Failed to get cpuacct.usage attribute: %m");
+
+                r = unit_get_metric_cached(u, CGROUP_METRIC_TASKS_CURRENT, &tasks);
+                if (r < 0 && r != -ENODATA)
+                        log_unit_warning_errno(u, r, "Failed to get pids.current attribute: %m");
+
+                r = sd_bus_message_append(reply, "(sttt)", u->id, memory, cpu, tasks);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_get_boot_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(tsss)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_boot_trace; i++) {
+                r = sd_bus_message_append(reply, "(tsss)",
+                                          m->boot_trace[i].timestamp,
+                                          boot_trace_event_type_to_string(m->boot_trace[i].type),
+                                          m->boot_trace[i].unit,
+                                          strempty(m->boot_trace[i].detail));
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_get_unit_processes(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         const char *name;
@@ -933,6 +1161,97 @@ static int method_start_transient_unit(sd_bus_message *message, void *userdata,
         return bus_unit_queue_job(message, u, JOB_START, mode, false, error);
 }
 
+static int method_start_transient_units(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *smode;
+        JobMode mode;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Like StartTransientUnit(), but for many units at once, so that the access checks and the round trips
+         * are paid only once. Units are created and started in order, on failure the ones before stay around. */
+
+        r = mac_selinux_access_check(message, "start", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "s", &smode);
+        if (r < 0)
+                return r;
+
+        mode = job_mode_from_string(smode);
+        if (mode < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Job mode %s is invalid.", smode);
+
+        r = bus_verify_manage_units_async(m, message, error);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "o");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_enter_container(message, 'a', "(sa(sv)a(sa(sv)))");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_enter_container(message, 'r', "sa(sv)a(sa(sv))")) > 0) {
+                _cleanup_free_ char *path = NULL;
+                const char *name;
+                Unit *u;
+                Job *j;
+
+                r = sd_bus_message_read(message, "s", &name);
+                if (r < 0)
+                        return r;
+
+                r = transient_unit_from_message(m, message, name, &u, error);
+                if (r < 0)
+                        return r;
+
+                r = transient_aux_units_from_message(m, message, error);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_exit_container(message);
+                if (r < 0)
+                        return r;
+
+                r = bus_unit_queue_job_one(message, u, JOB_START, mode, false, &j, error);
+                if (r < 0)
+                        return r;
+
+                path = job_dbus_path(j);
+                if (!path)
+                        return -ENOMEM;
+
+                r = sd_bus_message_append(reply, "o", path);
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_exit_container(message);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_get_job(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_free_ char *path = NULL;
         Manager *m = userdata;
@@ -1269,6 +1588,11 @@ static int method_refuse_snapshot(sd_bus_message *message, void *userdata, sd_bu
         return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED, "Support for snapshots has been removed.");
 }
 
+static void flush_transient_units(Manager *m) {
+        /* install.c only knows about the unit files on disk, hence make sure it sees all transient units */
+        (void) manager_write_transient_units(m);
+}
+
 static int verify_run_space(const char *message, sd_bus_error *error) {
         struct statvfs svfs;
         uint64_t available;
@@ -1324,6 +1648,12 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        /* Units are loaded from disk again, hence the transient ones have to be there. Let's check that now, so
+         * that we can tell the caller. */
+        r = manager_write_transient_units(m);
+        if (r < 0)
+                return sd_bus_error_set_errnof(error, r, "Failed to write transient unit files, refusing to reload: %m");
+
         /* Instead of sending the reply back right away, we just
          * remember that we need to and then send it after the reload
          * is finished. That way the caller knows when the reload
@@ -1360,6 +1690,10 @@ static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_erro
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        r = manager_write_transient_units(m);
+        if (r < 0)
+                return sd_bus_error_set_errnof(error, r, "Failed to write transient unit files, refusing to reexecute: %m");
+
         /* We don't send a reply back here, the client should
          * just wait for us disconnecting. */
 
@@ -1803,6 +2137,8 @@ static int list_unit_files_by_patterns(sd_bus_message *message, void *userdata,
         if (!h)
                 return -ENOMEM;
 
+        flush_transient_units(m);
+
         r = unit_file_get_list(m->unit_file_scope, NULL, h, states, patterns);
         if (r < 0)
                 goto fail;
@@ -1870,6 +2206,8 @@ static int method_get_unit_file_state(sd_bus_message *message, void *userdata, s
         if (r < 0)
                 return r;
 
+        flush_transient_units(m);
+
         r = unit_file_get_state(m->unit_file_scope, NULL, name, &state);
         if (r < 0)
                 return r;
@@ -2075,6 +2413,8 @@ static int method_enable_unit_files_generic(
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        flush_transient_units(m);
+
         r = call(m->unit_file_scope, flags, NULL, l, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2144,6 +2484,8 @@ static int method_preset_unit_files_with_mode(sd_bus_message *message, void *use
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        flush_transient_units(m);
+
         r = unit_file_preset(m->unit_file_scope, flags, NULL, l, mm, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2179,6 +2521,8 @@ static int method_disable_unit_files_generic(
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        flush_transient_units(m);
+
         r = call(m->unit_file_scope, runtime ? UNIT_FILE_RUNTIME : 0, NULL, l, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2214,6 +2558,8 @@ static int method_revert_unit_files(sd_bus_message *message, void *userdata, sd_
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        flush_transient_units(m);
+
         r = unit_file_revert(m->unit_file_scope, NULL, l, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2288,6 +2634,8 @@ static int method_preset_all_unit_files(sd_bus_message *message, void *userdata,
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        flush_transient_units(m);
+
         r = unit_file_preset_all(m->unit_file_scope, flags, NULL, mm, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2328,6 +2676,8 @@ static int method_add_dependency_unit_files(sd_bus_message *message, void *userd
         if (dep < 0)
                 return -EINVAL;
 
+        flush_transient_units(m);
+
         r = unit_file_add_dependency(m->unit_file_scope, flags, NULL, l, target, dep, &changes, &n_changes);
         if (r < 0)
                 return install_error(error, r, changes, n_changes);
@@ -2416,6 +2766,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("SecurityFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_SECURITY_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_GENERATORS_START]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_GENERATORS_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("GeneratorTimings", "a(sti)", property_get_generator_timings, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_START]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_UNITS_LOAD_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("InitRDSecurityStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_INITRD_SECURITY_START]), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -2511,7 +2862,11 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("RefUnit", "s", NULL, method_ref_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("UnrefUnit", "s", NULL, method_unref_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("StartTransientUnit", "ssa(sv)a(sa(sv))", "o", method_start_transient_unit, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("StartTransientUnits", "sa(sa(sv)a(sa(sv)))", "ao", method_start_transient_units, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetUnitProcesses", "s", "a(sus)", method_get_unit_processes, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitsProperties", "asas", "a(sa{sv})", method_get_units_properties, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitsAccounting", NULL, "a(sttt)", method_get_units_accounting, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetBootTrace", NULL, "a(tsss)", method_get_boot_trace, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("AttachProcessesToUnit", "ssau", NULL, method_attach_processes_to_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetJob", "u", "o", method_get_job, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetJobAfter", "u", "a(usssoo)", method_get_job_waiting, SD_BUS_VTABLE_UNPRIVILEGED),
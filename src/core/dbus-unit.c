@@ -5,6 +5,7 @@
 #include "alloc-util.h"
 #include "bpf-firewall.h"
 #include "bus-common-errors.h"
+#include "bus-objects.h"
 #include "cgroup-util.h"
 #include "condition.h"
 #include "dbus-job.h"
@@ -697,7 +698,7 @@ static int property_get_current_memory(
         assert(reply);
         assert(u);
 
-        r = unit_get_memory_current(u, &sz);
+        r = unit_get_metric_cached(u, CGROUP_METRIC_MEMORY_CURRENT, &sz);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get memory.usage_in_bytes attribute: %m");
 
@@ -721,7 +722,7 @@ static int property_get_current_tasks(
         assert(reply);
         assert(u);
 
-        r = unit_get_tasks_current(u, &cn);
+        r = unit_get_metric_cached(u, CGROUP_METRIC_TASKS_CURRENT, &cn);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get pids.current attribute: %m");
 
@@ -745,7 +746,7 @@ static int property_get_cpu_usage(
         assert(reply);
         assert(u);
 
-        r = unit_get_cpu_usage(u, &ns);
+        r = unit_get_metric_cached(u, CGROUP_METRIC_CPU_USAGE, &ns);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get cpuacct.usage attribute: %m");
 
@@ -814,31 +815,25 @@ static int append_process(sd_bus_message *reply, const char *p, pid_t pid, Set *
 
 static int append_cgroup(sd_bus_message *reply, const char *p, Set *pids) {
         _cleanup_closedir_ DIR *d = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ pid_t *procs = NULL;
+        size_t n_procs = 0, i;
         int r;
 
         assert(reply);
         assert(p);
 
-        r = cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, p, &f);
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, p, &procs, &n_procs);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
                 return r;
 
-        for (;;) {
-                pid_t pid;
-
-                r = cg_read_pid(f, &pid);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
+        for (i = 0; i < n_procs; i++) {
 
-                if (is_kernel_thread(pid) > 0)
+                if (is_kernel_thread(procs[i]) > 0)
                         continue;
 
-                r = append_process(reply, p, pid, pids);
+                r = append_process(reply, p, procs[i], pids);
                 if (r < 0)
                         return r;
         }
@@ -1084,7 +1079,7 @@ const sd_bus_vtable bus_unit_cgroup_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
-static int send_new_signal(sd_bus *bus, void *userdata) {
+static int build_new_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_free_ char *p = NULL;
         Unit *u = userdata;
@@ -1110,13 +1105,15 @@ static int send_new_signal(sd_bus *bus, void *userdata) {
         if (r < 0)
                 return r;
 
-        return sd_bus_send(bus, m, NULL);
+        ret[0] = TAKE_PTR(m);
+        return 1;
 }
 
-static int send_changed_signal(sd_bus *bus, void *userdata) {
+static int build_changed_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *type_changed = NULL, *unit_changed = NULL;
         _cleanup_free_ char *p = NULL;
         Unit *u = userdata;
-        int r;
+        int r, n = 0;
 
         assert(bus);
         assert(u);
@@ -1129,17 +1126,28 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
          * type, then for the generic unit. The clients may rely on
          * this order to get atomic behavior if needed. */
 
-        r = sd_bus_emit_properties_changed_strv(
+        r = bus_message_new_properties_changed(
                         bus, p,
                         unit_dbus_interface_from_type(u->type),
-                        NULL);
+                        NULL,
+                        &type_changed);
         if (r < 0)
                 return r;
 
-        return sd_bus_emit_properties_changed_strv(
+        r = bus_message_new_properties_changed(
                         bus, p,
                         "org.freedesktop.systemd1.Unit",
-                        NULL);
+                        NULL,
+                        &unit_changed);
+        if (r < 0)
+                return r;
+
+        if (type_changed)
+                ret[n++] = TAKE_PTR(type_changed);
+        if (unit_changed)
+                ret[n++] = TAKE_PTR(unit_changed);
+
+        return n;
 }
 
 void bus_unit_send_change_signal(Unit *u) {
@@ -1154,14 +1162,14 @@ void bus_unit_send_change_signal(Unit *u) {
         if (!u->id)
                 return;
 
-        r = bus_foreach_bus(u->manager, u->bus_track, u->sent_dbus_new_signal ? send_changed_signal : send_new_signal, u);
+        r = bus_broadcast(u->manager, u->bus_track, u->sent_dbus_new_signal ? build_changed_signal : build_new_signal, u);
         if (r < 0)
                 log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
 
         u->sent_dbus_new_signal = true;
 }
 
-static int send_removed_signal(sd_bus *bus, void *userdata) {
+static int build_removed_signal(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_free_ char *p = NULL;
         Unit *u = userdata;
@@ -1187,7 +1195,8 @@ static int send_removed_signal(sd_bus *bus, void *userdata) {
         if (r < 0)
                 return r;
 
-        return sd_bus_send(bus, m, NULL);
+        ret[0] = TAKE_PTR(m);
+        return 1;
 }
 
 void bus_unit_send_removed_signal(Unit *u) {
@@ -1200,20 +1209,20 @@ void bus_unit_send_removed_signal(Unit *u) {
         if (!u->id)
                 return;
 
-        r = bus_foreach_bus(u->manager, u->bus_track, send_removed_signal, u);
+        r = bus_broadcast(u->manager, u->bus_track, build_removed_signal, u);
         if (r < 0)
                 log_unit_debug_errno(u, r, "Failed to send unit remove signal for %s: %m", u->id);
 }
 
-int bus_unit_queue_job(
+int bus_unit_queue_job_one(
                 sd_bus_message *message,
                 Unit *u,
                 JobType type,
                 JobMode mode,
                 bool reload_if_possible,
+                Job **ret,
                 sd_bus_error *error) {
 
-        _cleanup_free_ char *path = NULL;
         Job *j;
         int r;
 
@@ -1255,6 +1264,28 @@ int bus_unit_queue_job(
         if (r < 0)
                 return r;
 
+        if (ret)
+                *ret = j;
+
+        return 0;
+}
+
+int bus_unit_queue_job(
+                sd_bus_message *message,
+                Unit *u,
+                JobType type,
+                JobMode mode,
+                bool reload_if_possible,
+                sd_bus_error *error) {
+
+        _cleanup_free_ char *path = NULL;
+        Job *j;
+        int r;
+
+        r = bus_unit_queue_job_one(message, u, type, mode, reload_if_possible, &j, error);
+        if (r < 0)
+                return r;
+
         path = job_dbus_path(j);
         if (!path)
                 return -ENOMEM;
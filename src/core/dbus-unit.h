@@ -24,6 +24,7 @@ int bus_unit_method_attach_processes(sd_bus_message *message, void *userdata, sd
 int bus_unit_method_ref(sd_bus_message *message, void *userdata, sd_bus_error *error);
 int bus_unit_method_unref(sd_bus_message *message, void *userdata, sd_bus_error *error);
 
+int bus_unit_queue_job_one(sd_bus_message *message, Unit *u, JobType type, JobMode mode, bool reload_if_possible, Job **ret, sd_bus_error *error);
 int bus_unit_queue_job(sd_bus_message *message, Unit *u, JobType type, JobMode mode, bool reload_if_possible, sd_bus_error *error);
 int bus_unit_validate_load_state(Unit *u, sd_bus_error *error);
 
@@ -45,6 +45,11 @@
 
 #define CONNECTIONS_MAX 4096
 
+/* Direct connections with more messages queued for writing than the first limit are not waited for anymore in
+ * manager_bus_n_queued_write(), and get closed once they are above the second */
+#define PRIVATE_BUS_QUEUE_SLOW 1024U
+#define PRIVATE_BUS_QUEUE_MAX (16U*1024U)
+
 static void destroy_bus(Manager *m, sd_bus **bus);
 
 int bus_send_queued_message(Manager *m) {
@@ -522,7 +527,7 @@ static int bus_unit_enumerate(sd_bus *bus, const char *path, void *userdata, cha
         return k;
 }
 
-static int bus_setup_api_vtables(Manager *m, sd_bus *bus) {
+int bus_setup_api_vtables(Manager *m, sd_bus *bus) {
         UnitType t;
         int r;
 
@@ -1201,7 +1206,80 @@ int bus_foreach_bus(
         return ret;
 }
 
-void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix) {
+static void bus_broadcast_free(sd_bus_message *messages[], int n) {
+        int k;
+
+        for (k = 0; k < n; k++)
+                sd_bus_message_unref(messages[k]);
+}
+
+static int bus_broadcast_send(sd_bus *bus, sd_bus_message *messages[], int n) {
+        int k, r;
+
+        for (k = 0; k < n; k++) {
+                r = sd_bus_send(bus, messages[k], NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int bus_broadcast(
+                Manager *m,
+                sd_bus_track *subscribed2,
+                int (*new_messages)(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]),
+                void *userdata) {
+
+        sd_bus_message *messages[BUS_BROADCAST_MESSAGES_MAX];
+        int n = -1, r, ret = 0;
+        Iterator i;
+        sd_bus *b;
+
+        /* Like bus_foreach_bus(), but the messages are built only once and then enqueued on all direct connections,
+         * instead of being built again for each of them. The API bus gets its own copy, since the direct connections
+         * have our sender name patched into the message, and the API bus doesn't. */
+
+        SET_FOREACH(b, m->private_buses, i) {
+
+                if (sd_bus_is_ready(b) <= 0)
+                        continue;
+
+                if (n < 0) {
+                        n = new_messages(b, userdata, messages);
+                        if (n < 0) {
+                                ret = n;
+                                break;
+                        }
+                }
+
+                r = bus_broadcast_send(b, messages, n);
+                if (r < 0)
+                        ret = r;
+        }
+
+        if (n > 0)
+                bus_broadcast_free(messages, n);
+
+        if (m->api_bus &&
+            (sd_bus_track_count(m->subscribed) > 0 ||
+             sd_bus_track_count(subscribed2) > 0)) {
+
+                n = new_messages(m->api_bus, userdata, messages);
+                if (n < 0)
+                        return n;
+
+                r = bus_broadcast_send(m->api_bus, messages, n);
+                if (r < 0)
+                        ret = r;
+
+                bus_broadcast_free(messages, n);
+        }
+
+        return ret;
+}
+
+void bus_track_serialize(sd_bus_track *t, FILE *f, SerializationFormat format, const char *prefix) {
         const char *n;
 
         assert(f);
@@ -1212,12 +1290,8 @@ void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix) {
 
                 c = sd_bus_track_count_name(t, n);
 
-                for (j = 0; j < c; j++) {
-                        fputs(prefix, f);
-                        fputc('=', f);
-                        fputs(n, f);
-                        fputc('\n', f);
-                }
+                for (j = 0; j < c; j++)
+                        serialize_item(f, format, prefix, n);
         }
 }
 
@@ -1263,23 +1337,41 @@ int bus_verify_set_environment_async(Manager *m, sd_bus_message *call, sd_bus_er
 }
 
 uint64_t manager_bus_n_queued_write(Manager *m) {
+        _cleanup_free_ sd_bus **stalled = NULL;
+        size_t n_stalled = 0, n_allocated = 0, j;
         uint64_t c = 0;
         Iterator i;
         sd_bus *b;
         int r;
 
-        /* Returns the total number of messages queued for writing on all our direct and API busses. */
+        /* Returns the total number of messages queued for writing on all our direct and API busses. Direct
+         * connections of clients that don't keep up with reading their messages are left out, so that one slow
+         * client doesn't hold back signals for everybody else. To keep their queues bounded nonetheless, we close
+         * connections once they have more than PRIVATE_BUS_QUEUE_MAX messages queued. */
 
         SET_FOREACH(b, m->private_buses, i) {
                 uint64_t k;
 
                 r = sd_bus_get_n_queued_write(b, &k);
-                if (r < 0)
+                if (r < 0) {
                         log_debug_errno(r, "Failed to query queued messages for private bus: %m");
-                else
+                        continue;
+                }
+
+                if (k > PRIVATE_BUS_QUEUE_MAX) {
+                        log_warning("Client of private bus connection not reading its messages, %" PRIu64 " messages queued, closing connection.", k);
+
+                        if (GREEDY_REALLOC(stalled, n_allocated, n_stalled + 1))
+                                stalled[n_stalled++] = b;
+                } else if (k <= PRIVATE_BUS_QUEUE_SLOW)
                         c += k;
         }
 
+        for (j = 0; j < n_stalled; j++) {
+                b = set_remove(m->private_buses, stalled[j]);
+                destroy_bus(m, &b);
+        }
+
         if (m->api_bus) {
                 uint64_t k;
 
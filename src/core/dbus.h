@@ -4,10 +4,12 @@
 #include "sd-bus.h"
 
 #include "manager.h"
+#include "serialize.h"
 
 int bus_send_queued_message(Manager *m);
 
 int bus_init_private(Manager *m);
+int bus_setup_api_vtables(Manager *m, sd_bus *bus);
 int bus_init_api(Manager *m);
 int bus_init_system(Manager *m);
 
@@ -18,13 +20,17 @@ void bus_done(Manager *m);
 
 int bus_fdset_add_all(Manager *m, FDSet *fds);
 
-void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix);
+void bus_track_serialize(sd_bus_track *t, FILE *f, SerializationFormat format, const char *prefix);
 int bus_track_coldplug(Manager *m, sd_bus_track **t, bool recursive, char **l);
 
 int manager_enqueue_sync_bus_names(Manager *m);
 
 int bus_foreach_bus(Manager *m, sd_bus_track *subscribed2, int (*send_message)(sd_bus *bus, void *userdata), void *userdata);
 
+/* The most messages bus_broadcast() sends at once, i.e. PropertiesChanged for the unit type and generic interfaces */
+#define BUS_BROADCAST_MESSAGES_MAX 2
+int bus_broadcast(Manager *m, sd_bus_track *subscribed2, int (*new_messages)(sd_bus *bus, void *userdata, sd_bus_message *ret[static BUS_BROADCAST_MESSAGES_MAX]), void *userdata);
+
 int bus_verify_manage_units_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
 int bus_verify_manage_unit_files_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
 int bus_verify_reload_daemon_async(Manager *m, sd_bus_message *call, sd_bus_error *error);
@@ -20,6 +20,9 @@
 #include "unit-name.h"
 #include "unit.h"
 
+/* Process at most this many uevents per event loop iteration */
+#define DEVICE_UEVENTS_MAX 64U
+
 static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_DEAD] = UNIT_INACTIVE,
         [DEVICE_TENTATIVE] = UNIT_ACTIVATING,
@@ -875,22 +878,21 @@ static void device_propagate_reload_by_sysfs(Manager *m, const char *sysfs) {
         }
 }
 
-static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+typedef struct DeviceUevent {
+        sd_device *dev;
+        const char *sysfs;
+        bool remove:1;
+        bool ready:1;
+        bool changed:1;
+} DeviceUevent;
+
+static int device_receive_uevent(Manager *m, DeviceUevent *ret) {
         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
-        Manager *m = userdata;
         const char *action, *sysfs;
         int r;
 
         assert(m);
-
-        if (revents != EPOLLIN) {
-                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
-
-                if (ratelimit_below(&limit))
-                        log_warning("Failed to get udev event");
-                if (!(revents & EPOLLIN))
-                        return 0;
-        }
+        assert(ret);
 
         /*
          * libudev might filter-out devices which pass the bloom
@@ -898,55 +900,128 @@ static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
          */
         r = udev_monitor_receive_sd_device(m->udev_monitor, &dev);
         if (r < 0)
-                return 0;
+                return r;
 
         r = sd_device_get_syspath(dev, &sysfs);
-        if (r < 0) {
-                log_error_errno(r, "Failed to get device sys path: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to get device sys path: %m");
 
         r = sd_device_get_property_value(dev, "ACTION", &action);
-        if (r < 0) {
-                log_error_errno(r, "Failed to get udev action string: %m");
-                return 0;
-        }
-
-        if (streq(action, "change"))
-                device_propagate_reload_by_sysfs(m, sysfs);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get udev action string: %m");
 
         /* A change event can signal that a device is becoming ready, in particular if
          * the device is using the SYSTEMD_READY logic in udev
-         * so we need to reach the else block of the follwing if, even for change events */
-        if (streq(action, "remove"))  {
-                r = swap_process_device_remove(m, dev);
+         * so we need to treat it like an add event, even for change events */
+        *ret = (DeviceUevent) {
+                .sysfs = sysfs,
+                .remove = streq(action, "remove"),
+                .changed = streq(action, "change"),
+        };
+        ret->ready = !ret->remove && device_is_ready(dev);
+        ret->dev = TAKE_PTR(dev);
+
+        return 0;
+}
+
+static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        _cleanup_hashmap_free_ Hashmap *by_sysfs = NULL;
+        DeviceUevent events[DEVICE_UEVENTS_MAX];
+        unsigned n = 0, n_received = 0, i;
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        if (revents != EPOLLIN) {
+                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
+
+                if (ratelimit_below(&limit))
+                        log_warning("Failed to get udev event");
+                if (!(revents & EPOLLIN))
+                        return 0;
+        }
+
+        /* During coldplug and when lots of devices show up at once there are usually a lot of uevents queued,
+         * often several for the same device. Hence, let's read a batch of them, and for consecutive add and
+         * change events of a device only process the last one: its properties are what counts. */
+        while (n_received < DEVICE_UEVENTS_MAX) {
+                DeviceUevent e;
+                unsigned k;
+
+                r = device_receive_uevent(m, &e);
+                if (r == -EAGAIN)
+                        break;
+                n_received++;
                 if (r < 0)
-                        log_warning_errno(r, "Failed to process swap device remove event, ignoring: %m");
+                        continue;
 
-                /* If we get notified that a device was removed by
-                 * udev, then it's completely gone, hence unset all
-                 * found bits */
-                device_update_found_by_sysfs(m, sysfs, 0, DEVICE_FOUND_UDEV|DEVICE_FOUND_MOUNT|DEVICE_FOUND_SWAP);
+                /* The index of the last event for this device, plus one */
+                k = PTR_TO_UINT(hashmap_get(by_sysfs, e.sysfs));
+                if (k > 0 && !e.remove && !events[k - 1].remove) {
+                        DeviceUevent *previous = events + k - 1;
 
-        } else if (device_is_ready(dev)) {
+                        (void) hashmap_remove(by_sysfs, previous->sysfs);
+                        sd_device_unref(previous->dev);
 
-                (void) device_process_new(m, dev);
+                        e.changed = e.changed || previous->changed;
+                        *previous = e;
+                } else {
+                        events[n++] = e;
+                        k = n;
+                }
 
-                r = swap_process_device_new(m, dev);
+                if (hashmap_ensure_allocated(&by_sysfs, &path_hash_ops) < 0 ||
+                    hashmap_replace(by_sysfs, e.sysfs, UINT_TO_PTR(k)) < 0)
+                        /* Don't merge anything into this event then */
+                        (void) hashmap_remove(by_sysfs, e.sysfs);
+        }
+
+        if (n == 0)
+                return 0;
+
+        log_debug("Processing %u uevents, %u merged into others.", n, n_received - n);
+
+        /* First set up units for all devices that showed up, and only then load all units they pulled in */
+        for (i = 0; i < n; i++) {
+                if (!events[i].ready)
+                        continue;
+
+                (void) device_process_new(m, events[i].dev);
+
+                r = swap_process_device_new(m, events[i].dev);
                 if (r < 0)
                         log_warning_errno(r, "Failed to process swap device new event, ignoring: %m");
+        }
 
-                manager_dispatch_load_queue(m);
+        manager_dispatch_load_queue(m);
 
-                /* The device is found now, set the udev found bit */
-                device_update_found_by_sysfs(m, sysfs, DEVICE_FOUND_UDEV, DEVICE_FOUND_UDEV);
+        for (i = 0; i < n; i++) {
+                DeviceUevent *e = events + i;
 
-        } else {
-                /* The device is nominally around, but not ready for
-                 * us. Hence unset the udev bit, but leave the rest
-                 * around. */
+                if (e->changed)
+                        device_propagate_reload_by_sysfs(m, e->sysfs);
+
+                if (e->remove) {
+                        r = swap_process_device_remove(m, e->dev);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to process swap device remove event, ignoring: %m");
+
+                        /* If we get notified that a device was removed by
+                         * udev, then it's completely gone, hence unset all
+                         * found bits */
+                        device_update_found_by_sysfs(m, e->sysfs, 0, DEVICE_FOUND_UDEV|DEVICE_FOUND_MOUNT|DEVICE_FOUND_SWAP);
+
+                } else if (e->ready)
+                        /* The device is found now, set the udev found bit */
+                        device_update_found_by_sysfs(m, e->sysfs, DEVICE_FOUND_UDEV, DEVICE_FOUND_UDEV);
+                else
+                        /* The device is nominally around, but not ready for
+                         * us. Hence unset the udev bit, but leave the rest
+                         * around. */
+                        device_update_found_by_sysfs(m, e->sysfs, 0, DEVICE_FOUND_UDEV);
 
-                device_update_found_by_sysfs(m, sysfs, 0, DEVICE_FOUND_UDEV);
+                sd_device_unref(e->dev);
         }
 
         return 0;
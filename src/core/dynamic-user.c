@@ -12,6 +12,7 @@
 #include "io-util.h"
 #include "parse-util.h"
 #include "random-util.h"
+#include "serialize.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -613,7 +614,7 @@ int dynamic_user_serialize(Manager *m, FILE *f, FDSet *fds) {
                 if (copy1 < 0)
                         return copy1;
 
-                fprintf(f, "dynamic-user=%s %i %i\n", d->name, copy0, copy1);
+                serialize_item_format(f, m->serialization_format, "dynamic-user", "%s %i %i", d->name, copy0, copy1);
         }
 
         return 0;
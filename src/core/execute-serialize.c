@@ -0,0 +1,781 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "execute-serialize.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "parse-util.h"
+#include "serialize.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* The executor reads back what we wrote a moment earlier, there's no reason to use anything but the binary format */
+#define FORMAT SERIALIZATION_BINARY
+
+bool exec_context_can_serialize(const ExecContext *c) {
+        assert(c);
+
+        /* All settings exec_invoke() looks at are serialized, except for these */
+
+        if (c->cpuset)
+                return false;
+
+        if (c->stdin_data_size > 0)
+                return false;
+
+        if (c->n_bind_mounts > 0 || c->n_temporary_filesystems > 0)
+                return false;
+
+        if (!hashmap_isempty(c->syscall_filter) ||
+            !set_isempty(c->syscall_archs) ||
+            !set_isempty(c->address_families))
+                return false;
+
+        if (c->dynamic_user)
+                return false;
+
+        return true;
+}
+
+bool exec_parameters_can_serialize(const ExecParameters *p) {
+        assert(p);
+
+        /* Asking for confirmation and waiting for the idle pipe both involve talking to the manager */
+        return !p->confirm_spawn && !p->idle_pipe;
+}
+
+static void serialize_bool(FILE *f, const char *key, bool b) {
+        serialize_item(f, FORMAT, key, yes_no(b));
+}
+
+static void serialize_string(FILE *f, const char *key, const char *s) {
+        if (s)
+                serialize_item(f, FORMAT, key, s);
+}
+
+static void serialize_strv(FILE *f, const char *key, char **l) {
+        char **i;
+
+        STRV_FOREACH(i, l)
+                serialize_item(f, FORMAT, key, *i);
+}
+
+static void serialize_fd(FILE *f, const char *key, int fd) {
+        /* The executor's fd table is a copy of ours, hence the numbers stay valid */
+        if (fd >= 0)
+                serialize_item_format(f, FORMAT, key, "%i", fd);
+}
+
+static int exec_context_serialize(FILE *f, const ExecContext *c) {
+        ExecDirectoryType t;
+        char **i;
+        int r;
+
+        assert(f);
+        assert(c);
+
+        serialize_strv(f, "environment", c->environment);
+        serialize_strv(f, "pass-environment", c->pass_environment);
+        serialize_strv(f, "unset-environment", c->unset_environment);
+
+        for (r = 0; r < _RLIMIT_MAX; r++)
+                if (c->rlimit[r])
+                        serialize_item_format(f, FORMAT, "rlimit", "%i %" PRIu64 " %" PRIu64,
+                                              r, (uint64_t) c->rlimit[r]->rlim_cur, (uint64_t) c->rlimit[r]->rlim_max);
+
+        serialize_string(f, "working-directory", c->working_directory);
+        serialize_string(f, "root-directory", c->root_directory);
+        serialize_string(f, "root-image", c->root_image);
+        serialize_bool(f, "working-directory-missing-ok", c->working_directory_missing_ok);
+        serialize_bool(f, "working-directory-home", c->working_directory_home);
+
+        serialize_item_format(f, FORMAT, "umask", "%04o", c->umask);
+
+        if (c->oom_score_adjust_set)
+                serialize_item_format(f, FORMAT, "oom-score-adjust", "%i", c->oom_score_adjust);
+        if (c->nice_set)
+                serialize_item_format(f, FORMAT, "nice", "%i", c->nice);
+        if (c->ioprio_set)
+                serialize_item_format(f, FORMAT, "ioprio", "%i", c->ioprio);
+        if (c->cpu_sched_set)
+                serialize_item_format(f, FORMAT, "cpu-sched", "%i %i", c->cpu_sched_policy, c->cpu_sched_priority);
+        serialize_bool(f, "cpu-sched-reset-on-fork", c->cpu_sched_reset_on_fork);
+
+        serialize_item_format(f, FORMAT, "std-input", "%i", c->std_input);
+        serialize_item_format(f, FORMAT, "std-output", "%i", c->std_output);
+        serialize_item_format(f, FORMAT, "std-error", "%i", c->std_error);
+
+        for (r = 0; r < 3; r++) {
+                if (c->stdio_fdname[r])
+                        serialize_item_format(f, FORMAT, "stdio-fdname", "%i %s", r, c->stdio_fdname[r]);
+                if (c->stdio_file[r])
+                        serialize_item_format(f, FORMAT, "stdio-file", "%i %s", r, c->stdio_file[r]);
+        }
+
+        serialize_item_format(f, FORMAT, "timer-slack-nsec", NSEC_FMT, c->timer_slack_nsec);
+        serialize_bool(f, "stdio-as-fds", c->stdio_as_fds);
+
+        serialize_string(f, "tty-path", c->tty_path);
+        serialize_bool(f, "tty-reset", c->tty_reset);
+        serialize_bool(f, "tty-vhangup", c->tty_vhangup);
+        serialize_bool(f, "tty-vt-disallocate", c->tty_vt_disallocate);
+
+        serialize_bool(f, "ignore-sigpipe", c->ignore_sigpipe);
+
+        serialize_string(f, "user", c->user);
+        serialize_string(f, "group", c->group);
+        serialize_strv(f, "supplementary-group", c->supplementary_groups);
+
+        serialize_string(f, "pam-name", c->pam_name);
+
+        serialize_string(f, "utmp-id", c->utmp_id);
+        serialize_item_format(f, FORMAT, "utmp-mode", "%i", c->utmp_mode);
+
+        serialize_bool(f, "selinux-context-ignore", c->selinux_context_ignore);
+        serialize_string(f, "selinux-context", c->selinux_context);
+        serialize_bool(f, "apparmor-profile-ignore", c->apparmor_profile_ignore);
+        serialize_string(f, "apparmor-profile", c->apparmor_profile);
+        serialize_bool(f, "smack-process-label-ignore", c->smack_process_label_ignore);
+        serialize_string(f, "smack-process-label", c->smack_process_label);
+
+        serialize_item_format(f, FORMAT, "keyring-mode", "%i", c->keyring_mode);
+
+        serialize_strv(f, "read-write-path", c->read_write_paths);
+        serialize_strv(f, "read-only-path", c->read_only_paths);
+        serialize_strv(f, "inaccessible-path", c->inaccessible_paths);
+        serialize_item_format(f, FORMAT, "mount-flags", "%lu", c->mount_flags);
+
+        serialize_item_format(f, FORMAT, "capability-bounding-set", "%" PRIu64, c->capability_bounding_set);
+        serialize_item_format(f, FORMAT, "capability-ambient-set", "%" PRIu64, c->capability_ambient_set);
+        serialize_item_format(f, FORMAT, "secure-bits", "%i", c->secure_bits);
+
+        serialize_item_format(f, FORMAT, "syslog-priority", "%i", c->syslog_priority);
+        serialize_string(f, "syslog-identifier", c->syslog_identifier);
+        serialize_bool(f, "syslog-level-prefix", c->syslog_level_prefix);
+        serialize_item_format(f, FORMAT, "log-level-max", "%i", c->log_level_max);
+        serialize_item_format(f, FORMAT, "log-rate-limit-interval-usec", USEC_FMT, c->log_rate_limit_interval_usec);
+        serialize_item_format(f, FORMAT, "log-rate-limit-burst", "%u", c->log_rate_limit_burst);
+
+        serialize_bool(f, "non-blocking", c->non_blocking);
+        serialize_bool(f, "private-tmp", c->private_tmp);
+        serialize_bool(f, "private-network", c->private_network);
+        serialize_bool(f, "private-devices", c->private_devices);
+        serialize_bool(f, "private-users", c->private_users);
+        serialize_bool(f, "private-mounts", c->private_mounts);
+        serialize_item_format(f, FORMAT, "protect-system", "%i", c->protect_system);
+        serialize_item_format(f, FORMAT, "protect-home", "%i", c->protect_home);
+        serialize_bool(f, "protect-kernel-tunables", c->protect_kernel_tunables);
+        serialize_bool(f, "protect-kernel-modules", c->protect_kernel_modules);
+        serialize_bool(f, "protect-control-groups", c->protect_control_groups);
+        serialize_bool(f, "mount-api-vfs", c->mount_apivfs);
+
+        serialize_bool(f, "no-new-privileges", c->no_new_privileges);
+        serialize_bool(f, "remove-ipc", c->remove_ipc);
+        serialize_bool(f, "same-pgrp", c->same_pgrp);
+
+        serialize_item_format(f, FORMAT, "personality", "%lu", c->personality);
+        serialize_bool(f, "lock-personality", c->lock_personality);
+        serialize_item_format(f, FORMAT, "restrict-namespaces", "%lu", c->restrict_namespaces);
+
+        serialize_item_format(f, FORMAT, "syscall-errno", "%i", c->syscall_errno);
+        serialize_bool(f, "syscall-whitelist", c->syscall_whitelist);
+        serialize_bool(f, "address-families-whitelist", c->address_families_whitelist);
+
+        serialize_item_format(f, FORMAT, "runtime-directory-preserve-mode", "%i", c->runtime_directory_preserve_mode);
+        for (t = 0; t < _EXEC_DIRECTORY_TYPE_MAX; t++) {
+                serialize_item_format(f, FORMAT, "directory-mode", "%i %04o", t, c->directories[t].mode);
+
+                STRV_FOREACH(i, c->directories[t].paths)
+                        serialize_item_format(f, FORMAT, "directory", "%i %s", t, *i);
+        }
+
+        serialize_bool(f, "memory-deny-write-execute", c->memory_deny_write_execute);
+        serialize_bool(f, "restrict-realtime", c->restrict_realtime);
+
+        return 0;
+}
+
+static int exec_parameters_serialize(FILE *f, const ExecParameters *p) {
+        ExecDirectoryType t;
+        size_t n;
+
+        assert(f);
+        assert(p);
+
+        serialize_strv(f, "parameter-environment", p->environment);
+
+        for (n = 0; n < p->n_socket_fds + p->n_storage_fds; n++)
+                serialize_fd(f, "fd", p->fds[n]);
+        serialize_item_format(f, FORMAT, "n-socket-fds", "%zu", p->n_socket_fds);
+        serialize_item_format(f, FORMAT, "n-storage-fds", "%zu", p->n_storage_fds);
+        serialize_strv(f, "fd-name", p->fd_names);
+
+        serialize_item_format(f, FORMAT, "flags", "%i", (int) p->flags);
+        serialize_bool(f, "selinux-context-net", p->selinux_context_net);
+
+        serialize_item_format(f, FORMAT, "cgroup-supported", "%" PRIu32, (uint32_t) p->cgroup_supported);
+        serialize_string(f, "cgroup-path", p->cgroup_path);
+
+        if (p->prefix)
+                for (t = 0; t < _EXEC_DIRECTORY_TYPE_MAX; t++)
+                        if (p->prefix[t])
+                                serialize_item_format(f, FORMAT, "prefix", "%i %s", t, p->prefix[t]);
+
+        serialize_item_format(f, FORMAT, "watchdog-usec", USEC_FMT, p->watchdog_usec);
+
+        serialize_fd(f, "stdin-fd", p->stdin_fd);
+        serialize_fd(f, "stdout-fd", p->stdout_fd);
+        serialize_fd(f, "stderr-fd", p->stderr_fd);
+        serialize_fd(f, "exec-fd", p->exec_fd);
+
+        return 0;
+}
+
+int exec_serialize_invocation(
+                FILE *f,
+                const Unit *u,
+                const ExecCommand *command,
+                const ExecContext *c,
+                const ExecParameters *p,
+                char **files_env,
+                int user_lookup_fd) {
+
+        int r;
+
+        assert(f);
+        assert(u);
+        assert(command);
+        assert(c);
+        assert(p);
+
+        r = serialize_header(f, FORMAT);
+        if (r < 0)
+                return r;
+
+        serialize_bool(f, "system-manager", MANAGER_IS_SYSTEM(u->manager));
+        serialize_item_format(f, FORMAT, "log-level", "%i", log_get_max_level());
+        serialize_item(f, FORMAT, "log-target", log_target_to_string(log_get_target()));
+
+        serialize_item(f, FORMAT, "unit-id", u->id);
+        if (!sd_id128_is_null(u->invocation_id))
+                serialize_item(f, FORMAT, "invocation-id", u->invocation_id_string);
+
+        serialize_item(f, FORMAT, "path", command->path);
+        serialize_strv(f, "argv", command->argv);
+        serialize_item_format(f, FORMAT, "command-flags", "%i", (int) command->flags);
+
+        r = exec_context_serialize(f, c);
+        if (r < 0)
+                return r;
+
+        r = exec_parameters_serialize(f, p);
+        if (r < 0)
+                return r;
+
+        serialize_strv(f, "files-environment", files_env);
+        serialize_fd(f, "user-lookup-fd", user_lookup_fd);
+
+        serialize_end(f, FORMAT);
+
+        return 0;
+}
+
+void exec_invocation_init(ExecInvocation *i) {
+        assert(i);
+
+        zero(*i);
+
+        i->user_lookup_fd = -1;
+        i->log_level = -1;
+        i->log_target = _LOG_TARGET_INVALID;
+
+        i->manager.unit_file_scope = UNIT_FILE_SYSTEM;
+        i->unit.manager = &i->manager;
+
+        exec_context_init(&i->context);
+
+        i->parameters.stdin_fd = i->parameters.stdout_fd = i->parameters.stderr_fd = i->parameters.exec_fd = -1;
+        i->parameters.prefix = i->prefix;
+}
+
+void exec_invocation_done(ExecInvocation *i) {
+        ExecDirectoryType t;
+
+        assert(i);
+
+        i->unit.id = mfree(i->unit.id);
+
+        exec_command_done_array(&i->command, 1);
+        exec_context_done(&i->context);
+
+        strv_free(i->parameters.environment);
+        free(i->parameters.fds);
+        i->n_fds = i->n_fds_allocated = 0;
+        strv_free(i->parameters.fd_names);
+        i->parameters = (ExecParameters) {};
+
+        i->cgroup_path = mfree(i->cgroup_path);
+        for (t = 0; t < _EXEC_DIRECTORY_TYPE_MAX; t++)
+                i->prefix[t] = mfree(i->prefix[t]);
+
+        i->files_env = strv_free(i->files_env);
+}
+
+static int remap_fd(int *fd, const int *from, const int *to, size_t n) {
+        size_t j;
+
+        if (*fd < 0)
+                return 0;
+
+        for (j = 0; j < n; j++)
+                if (from[j] == *fd) {
+                        *fd = to[j];
+                        return 0;
+                }
+
+        return -EBADF;
+}
+
+int exec_invocation_remap_fds(ExecInvocation *i, const int *from, const int *to, size_t n) {
+        size_t j;
+        int r;
+
+        assert(i);
+        assert(from || n == 0);
+        assert(to || n == 0);
+
+        /* Idle executors get the fds passed over a socket rather than inherited, hence under different numbers than
+         * the serialization refers to them by. */
+
+        for (j = 0; j < i->n_fds; j++) {
+                r = remap_fd(i->parameters.fds + j, from, to, n);
+                if (r < 0)
+                        return r;
+        }
+
+        r = remap_fd(&i->parameters.stdin_fd, from, to, n);
+        if (r < 0)
+                return r;
+        r = remap_fd(&i->parameters.stdout_fd, from, to, n);
+        if (r < 0)
+                return r;
+        r = remap_fd(&i->parameters.stderr_fd, from, to, n);
+        if (r < 0)
+                return r;
+        r = remap_fd(&i->parameters.exec_fd, from, to, n);
+        if (r < 0)
+                return r;
+
+        return remap_fd(&i->user_lookup_fd, from, to, n);
+}
+
+static int deserialize_bool(const char *v, bool *ret) {
+        int r;
+
+        r = parse_boolean(v);
+        if (r < 0)
+                return r;
+
+        *ret = r;
+        return 0;
+}
+
+static int deserialize_indexed(const char *v, int max, int *ret_index, const char **ret_value) {
+        const char *space;
+        char *n;
+        int r;
+
+        /* Parses "<index> <value>" */
+
+        space = strchr(v, ' ');
+        if (!space)
+                return -EINVAL;
+
+        n = strndupa(v, space - v);
+        r = safe_atoi(n, ret_index);
+        if (r < 0)
+                return r;
+        if (*ret_index < 0 || *ret_index >= max)
+                return -ERANGE;
+
+        *ret_value = space + 1;
+        return 0;
+}
+
+static int deserialize_fd(const char *v, int *ret) {
+        int fd, r;
+
+        r = safe_atoi(v, &fd);
+        if (r < 0)
+                return r;
+        if (fd < 0)
+                return -EBADF;
+
+        *ret = fd;
+        return 0;
+}
+
+static int exec_context_deserialize_item(ExecContext *c, const char *key, const char *v) {
+        const char *val;
+        bool b;
+        int r, k;
+
+        assert(c);
+        assert(key);
+        assert(v);
+
+        /* Returns 0 if the key is not a context setting, > 0 if it was handled */
+
+        if (streq(key, "environment"))
+                r = strv_extend(&c->environment, v);
+        else if (streq(key, "pass-environment"))
+                r = strv_extend(&c->pass_environment, v);
+        else if (streq(key, "unset-environment"))
+                r = strv_extend(&c->unset_environment, v);
+        else if (streq(key, "rlimit")) {
+                uint64_t cur, max;
+
+                if (sscanf(v, "%i %" SCNu64 " %" SCNu64, &k, &cur, &max) != 3 || k < 0 || k >= _RLIMIT_MAX)
+                        return -EINVAL;
+
+                if (!c->rlimit[k]) {
+                        c->rlimit[k] = new(struct rlimit, 1);
+                        if (!c->rlimit[k])
+                                return -ENOMEM;
+                }
+
+                c->rlimit[k]->rlim_cur = (rlim_t) cur;
+                c->rlimit[k]->rlim_max = (rlim_t) max;
+                r = 0;
+        } else if (streq(key, "working-directory"))
+                r = free_and_strdup(&c->working_directory, v);
+        else if (streq(key, "root-directory"))
+                r = free_and_strdup(&c->root_directory, v);
+        else if (streq(key, "root-image"))
+                r = free_and_strdup(&c->root_image, v);
+        else if (streq(key, "working-directory-missing-ok"))
+                r = deserialize_bool(v, &c->working_directory_missing_ok);
+        else if (streq(key, "working-directory-home"))
+                r = deserialize_bool(v, &c->working_directory_home);
+        else if (streq(key, "umask"))
+                r = parse_mode(v, &c->umask);
+        else if (streq(key, "oom-score-adjust")) {
+                r = safe_atoi(v, &c->oom_score_adjust);
+                c->oom_score_adjust_set = r >= 0;
+        } else if (streq(key, "nice")) {
+                r = safe_atoi(v, &c->nice);
+                c->nice_set = r >= 0;
+        } else if (streq(key, "ioprio")) {
+                r = safe_atoi(v, &c->ioprio);
+                c->ioprio_set = r >= 0;
+        } else if (streq(key, "cpu-sched")) {
+                if (sscanf(v, "%i %i", &c->cpu_sched_policy, &c->cpu_sched_priority) != 2)
+                        return -EINVAL;
+                c->cpu_sched_set = true;
+                r = 0;
+        } else if (streq(key, "cpu-sched-reset-on-fork"))
+                r = deserialize_bool(v, &c->cpu_sched_reset_on_fork);
+        else if (streq(key, "std-input")) {
+                r = safe_atoi(v, &k);
+                c->std_input = k;
+        } else if (streq(key, "std-output")) {
+                r = safe_atoi(v, &k);
+                c->std_output = k;
+        } else if (streq(key, "std-error")) {
+                r = safe_atoi(v, &k);
+                c->std_error = k;
+        } else if (streq(key, "stdio-fdname")) {
+                r = deserialize_indexed(v, 3, &k, &val);
+                if (r >= 0)
+                        r = free_and_strdup(&c->stdio_fdname[k], val);
+        } else if (streq(key, "stdio-file")) {
+                r = deserialize_indexed(v, 3, &k, &val);
+                if (r >= 0)
+                        r = free_and_strdup(&c->stdio_file[k], val);
+        } else if (streq(key, "timer-slack-nsec"))
+                r = safe_atou64(v, &c->timer_slack_nsec);
+        else if (streq(key, "stdio-as-fds"))
+                r = deserialize_bool(v, &c->stdio_as_fds);
+        else if (streq(key, "tty-path"))
+                r = free_and_strdup(&c->tty_path, v);
+        else if (streq(key, "tty-reset"))
+                r = deserialize_bool(v, &c->tty_reset);
+        else if (streq(key, "tty-vhangup"))
+                r = deserialize_bool(v, &c->tty_vhangup);
+        else if (streq(key, "tty-vt-disallocate"))
+                r = deserialize_bool(v, &c->tty_vt_disallocate);
+        else if (streq(key, "ignore-sigpipe"))
+                r = deserialize_bool(v, &c->ignore_sigpipe);
+        else if (streq(key, "user"))
+                r = free_and_strdup(&c->user, v);
+        else if (streq(key, "group"))
+                r = free_and_strdup(&c->group, v);
+        else if (streq(key, "supplementary-group"))
+                r = strv_extend(&c->supplementary_groups, v);
+        else if (streq(key, "pam-name"))
+                r = free_and_strdup(&c->pam_name, v);
+        else if (streq(key, "utmp-id"))
+                r = free_and_strdup(&c->utmp_id, v);
+        else if (streq(key, "utmp-mode")) {
+                r = safe_atoi(v, &k);
+                c->utmp_mode = k;
+        } else if (streq(key, "selinux-context-ignore"))
+                r = deserialize_bool(v, &c->selinux_context_ignore);
+        else if (streq(key, "selinux-context"))
+                r = free_and_strdup(&c->selinux_context, v);
+        else if (streq(key, "apparmor-profile-ignore"))
+                r = deserialize_bool(v, &c->apparmor_profile_ignore);
+        else if (streq(key, "apparmor-profile"))
+                r = free_and_strdup(&c->apparmor_profile, v);
+        else if (streq(key, "smack-process-label-ignore"))
+                r = deserialize_bool(v, &c->smack_process_label_ignore);
+        else if (streq(key, "smack-process-label"))
+                r = free_and_strdup(&c->smack_process_label, v);
+        else if (streq(key, "keyring-mode")) {
+                r = safe_atoi(v, &k);
+                c->keyring_mode = k;
+        } else if (streq(key, "read-write-path"))
+                r = strv_extend(&c->read_write_paths, v);
+        else if (streq(key, "read-only-path"))
+                r = strv_extend(&c->read_only_paths, v);
+        else if (streq(key, "inaccessible-path"))
+                r = strv_extend(&c->inaccessible_paths, v);
+        else if (streq(key, "mount-flags"))
+                r = safe_atolu(v, &c->mount_flags);
+        else if (streq(key, "capability-bounding-set"))
+                r = safe_atou64(v, &c->capability_bounding_set);
+        else if (streq(key, "capability-ambient-set"))
+                r = safe_atou64(v, &c->capability_ambient_set);
+        else if (streq(key, "secure-bits"))
+                r = safe_atoi(v, &c->secure_bits);
+        else if (streq(key, "syslog-priority"))
+                r = safe_atoi(v, &c->syslog_priority);
+        else if (streq(key, "syslog-identifier"))
+                r = free_and_strdup(&c->syslog_identifier, v);
+        else if (streq(key, "syslog-level-prefix"))
+                r = deserialize_bool(v, &c->syslog_level_prefix);
+        else if (streq(key, "log-level-max"))
+                r = safe_atoi(v, &c->log_level_max);
+        else if (streq(key, "log-rate-limit-interval-usec"))
+                r = safe_atou64(v, &c->log_rate_limit_interval_usec);
+        else if (streq(key, "log-rate-limit-burst"))
+                r = safe_atou(v, &c->log_rate_limit_burst);
+        else if (streq(key, "non-blocking"))
+                r = deserialize_bool(v, &c->non_blocking);
+        else if (streq(key, "private-tmp"))
+                r = deserialize_bool(v, &c->private_tmp);
+        else if (streq(key, "private-network"))
+                r = deserialize_bool(v, &c->private_network);
+        else if (streq(key, "private-devices"))
+                r = deserialize_bool(v, &c->private_devices);
+        else if (streq(key, "private-users"))
+                r = deserialize_bool(v, &c->private_users);
+        else if (streq(key, "private-mounts"))
+                r = deserialize_bool(v, &c->private_mounts);
+        else if (streq(key, "protect-system")) {
+                r = safe_atoi(v, &k);
+                c->protect_system = k;
+        } else if (streq(key, "protect-home")) {
+                r = safe_atoi(v, &k);
+                c->protect_home = k;
+        } else if (streq(key, "protect-kernel-tunables"))
+                r = deserialize_bool(v, &c->protect_kernel_tunables);
+        else if (streq(key, "protect-kernel-modules"))
+                r = deserialize_bool(v, &c->protect_kernel_modules);
+        else if (streq(key, "protect-control-groups"))
+                r = deserialize_bool(v, &c->protect_control_groups);
+        else if (streq(key, "mount-api-vfs"))
+                r = deserialize_bool(v, &c->mount_apivfs);
+        else if (streq(key, "no-new-privileges"))
+                r = deserialize_bool(v, &c->no_new_privileges);
+        else if (streq(key, "remove-ipc"))
+                r = deserialize_bool(v, &c->remove_ipc);
+        else if (streq(key, "same-pgrp"))
+                r = deserialize_bool(v, &c->same_pgrp);
+        else if (streq(key, "personality"))
+                r = safe_atolu(v, &c->personality);
+        else if (streq(key, "lock-personality"))
+                r = deserialize_bool(v, &c->lock_personality);
+        else if (streq(key, "restrict-namespaces"))
+                r = safe_atolu(v, &c->restrict_namespaces);
+        else if (streq(key, "syscall-errno"))
+                r = safe_atoi(v, &c->syscall_errno);
+        else if (streq(key, "syscall-whitelist")) {
+                r = deserialize_bool(v, &b);
+                c->syscall_whitelist = b;
+        } else if (streq(key, "address-families-whitelist")) {
+                r = deserialize_bool(v, &b);
+                c->address_families_whitelist = b;
+        } else if (streq(key, "runtime-directory-preserve-mode")) {
+                r = safe_atoi(v, &k);
+                c->runtime_directory_preserve_mode = k;
+        } else if (streq(key, "directory-mode")) {
+                r = deserialize_indexed(v, _EXEC_DIRECTORY_TYPE_MAX, &k, &val);
+                if (r >= 0)
+                        r = parse_mode(val, &c->directories[k].mode);
+        } else if (streq(key, "directory")) {
+                r = deserialize_indexed(v, _EXEC_DIRECTORY_TYPE_MAX, &k, &val);
+                if (r >= 0)
+                        r = strv_extend(&c->directories[k].paths, val);
+        } else if (streq(key, "memory-deny-write-execute"))
+                r = deserialize_bool(v, &c->memory_deny_write_execute);
+        else if (streq(key, "restrict-realtime"))
+                r = deserialize_bool(v, &c->restrict_realtime);
+        else
+                return 0;
+
+        return r < 0 ? r : 1;
+}
+
+static int exec_parameters_deserialize_item(ExecInvocation *i, const char *key, const char *v) {
+        ExecParameters *p = &i->parameters;
+        const char *val;
+        int r, k;
+
+        /* Returns 0 if the key is not a parameter, > 0 if it was handled */
+
+        if (streq(key, "parameter-environment"))
+                r = strv_extend(&p->environment, v);
+        else if (streq(key, "fd")) {
+                r = deserialize_fd(v, &k);
+                if (r < 0)
+                        return r;
+
+                if (!GREEDY_REALLOC(p->fds, i->n_fds_allocated, i->n_fds + 1))
+                        return -ENOMEM;
+
+                p->fds[i->n_fds++] = k;
+        } else if (streq(key, "n-socket-fds"))
+                r = safe_atozu(v, &p->n_socket_fds);
+        else if (streq(key, "n-storage-fds"))
+                r = safe_atozu(v, &p->n_storage_fds);
+        else if (streq(key, "fd-name"))
+                r = strv_extend(&p->fd_names, v);
+        else if (streq(key, "flags")) {
+                r = safe_atoi(v, &k);
+                p->flags = k;
+        } else if (streq(key, "selinux-context-net")) {
+                bool b;
+
+                r = deserialize_bool(v, &b);
+                p->selinux_context_net = b;
+        } else if (streq(key, "cgroup-supported")) {
+                uint32_t m;
+
+                r = safe_atou32(v, &m);
+                p->cgroup_supported = m;
+        } else if (streq(key, "cgroup-path")) {
+                r = free_and_strdup(&i->cgroup_path, v);
+                p->cgroup_path = i->cgroup_path;
+        } else if (streq(key, "prefix")) {
+                r = deserialize_indexed(v, _EXEC_DIRECTORY_TYPE_MAX, &k, &val);
+                if (r >= 0)
+                        r = free_and_strdup(&i->prefix[k], val);
+        } else if (streq(key, "watchdog-usec"))
+                r = safe_atou64(v, &p->watchdog_usec);
+        else if (streq(key, "stdin-fd"))
+                r = deserialize_fd(v, &p->stdin_fd);
+        else if (streq(key, "stdout-fd"))
+                r = deserialize_fd(v, &p->stdout_fd);
+        else if (streq(key, "stderr-fd"))
+                r = deserialize_fd(v, &p->stderr_fd);
+        else if (streq(key, "exec-fd"))
+                r = deserialize_fd(v, &p->exec_fd);
+        else
+                return 0;
+
+        return r < 0 ? r : 1;
+}
+
+static int exec_invocation_deserialize_item(ExecInvocation *i, const char *key, const char *v) {
+        int r, k;
+
+        if (streq(key, "system-manager")) {
+                bool b;
+
+                r = deserialize_bool(v, &b);
+                if (r < 0)
+                        return r;
+
+                i->manager.unit_file_scope = b ? UNIT_FILE_SYSTEM : UNIT_FILE_USER;
+        } else if (streq(key, "log-level"))
+                r = safe_atoi(v, &i->log_level);
+        else if (streq(key, "log-target")) {
+                i->log_target = log_target_from_string(v);
+                r = i->log_target < 0 ? -EINVAL : 0;
+        } else if (streq(key, "unit-id"))
+                r = free_and_strdup(&i->unit.id, v);
+        else if (streq(key, "invocation-id")) {
+                r = sd_id128_from_string(v, &i->unit.invocation_id);
+                if (r >= 0)
+                        sd_id128_to_string(i->unit.invocation_id, i->unit.invocation_id_string);
+        } else if (streq(key, "path"))
+                r = free_and_strdup(&i->command.path, v);
+        else if (streq(key, "argv"))
+                r = strv_extend(&i->command.argv, v);
+        else if (streq(key, "command-flags")) {
+                r = safe_atoi(v, &k);
+                i->command.flags = k;
+        } else if (streq(key, "files-environment"))
+                r = strv_extend(&i->files_env, v);
+        else if (streq(key, "user-lookup-fd"))
+                r = deserialize_fd(v, &i->user_lookup_fd);
+        else {
+                r = exec_context_deserialize_item(&i->context, key, v);
+                if (r == 0)
+                        r = exec_parameters_deserialize_item(i, key, v);
+                if (r == 0) {
+                        log_debug("Unknown executor serialization item '%s', ignoring.", key);
+                        return 0;
+                }
+        }
+
+        return r;
+}
+
+int exec_deserialize_invocation(FILE *f, ExecInvocation *i) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer b = {};
+        SerializationFormat format;
+        int r;
+
+        assert(f);
+        assert(i);
+
+        r = deserialize_header(f, &format);
+        if (r < 0)
+                return r;
+        if (format != FORMAT)
+                return -EBADMSG;
+
+        for (;;) {
+                char *l, *v;
+
+                r = deserialize_line(f, format, &b, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                v = strchr(l, '=');
+                if (!v)
+                        return -EBADMSG;
+                *(v++) = 0;
+
+                r = exec_invocation_deserialize_item(i, l, v);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to deserialize executor item '%s': %m", l);
+        }
+
+        if (!i->unit.id || !i->command.path)
+                return -EBADMSG;
+        if (i->parameters.n_socket_fds + i->parameters.n_storage_fds != i->n_fds)
+                return -EBADMSG;
+
+        manager_setup_log_fields(&i->manager);
+
+        return 0;
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdio.h>
+
+#include "execute.h"
+#include "manager.h"
+#include "unit.h"
+
+/* Everything systemd-executor needs to run exec_invoke() for a command on our behalf. The executor is always of the
+ * same version as the manager that spawns it (we keep it open from startup on), hence this is not a stable format.
+ *
+ * Not all settings are covered: commands using shared runtime resources (PrivateTmp=, PrivateNetwork=,
+ * JoinsNamespaceOf=), DynamicUser=, or any of the settings exec_context_can_serialize() refuses are forked off as
+ * before. */
+
+typedef struct ExecInvocation {
+        /* Just enough of a manager and a unit for logging, exec_invoke() never looks at anything else */
+        Manager manager;
+        Unit unit;
+
+        ExecCommand command;
+        ExecContext context;
+        ExecParameters parameters;
+
+        /* Backing storage for the const fields of the parameters */
+        size_t n_fds, n_fds_allocated;
+        char *cgroup_path;
+        char *prefix[_EXEC_DIRECTORY_TYPE_MAX];
+
+        char **files_env;
+        int user_lookup_fd;
+
+        int log_level;
+        int log_target;
+} ExecInvocation;
+
+bool exec_context_can_serialize(const ExecContext *c);
+bool exec_parameters_can_serialize(const ExecParameters *p);
+
+int exec_serialize_invocation(
+                FILE *f,
+                const Unit *u,
+                const ExecCommand *command,
+                const ExecContext *c,
+                const ExecParameters *p,
+                char **files_env,
+                int user_lookup_fd);
+
+void exec_invocation_init(ExecInvocation *i);
+void exec_invocation_done(ExecInvocation *i);
+int exec_deserialize_invocation(FILE *f, ExecInvocation *i);
+int exec_invocation_remap_fds(ExecInvocation *i, const int *from, const int *to, size_t n);
@@ -45,6 +45,7 @@
 #endif
 #include "async.h"
 #include "barrier.h"
+#include "boot-trace.h"
 #include "cap-list.h"
 #include "capability-util.h"
 #include "chown-recursive.h"
@@ -52,6 +53,8 @@
 #include "def.h"
 #include "env-util.h"
 #include "errno-list.h"
+#include "execute-serialize.h"
+#include "executor-pool.h"
 #include "execute.h"
 #include "exit-status.h"
 #include "fd-util.h"
@@ -79,11 +82,13 @@
 #include "securebits.h"
 #include "securebits-util.h"
 #include "selinux-util.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "smack-util.h"
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -103,6 +108,8 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+#define SECCOMP_PROGRAMS_CACHE_MAX 256U
+
 static int shift_fds(int fds[], size_t n_fds) {
         int start, restart_from;
 
@@ -1370,16 +1377,9 @@ static bool context_has_syscall_filters(const ExecContext *c) {
                 !hashmap_isempty(c->syscall_filter);
 }
 
-static bool context_has_no_new_privileges(const ExecContext *c) {
+static bool context_has_seccomp(const ExecContext *c) {
         assert(c);
 
-        if (c->no_new_privileges)
-                return true;
-
-        if (have_effective_cap(CAP_SYS_ADMIN)) /* if we are privileged, we don't need NNP */
-                return false;
-
-        /* We need NNP if we have any form of seccomp and are unprivileged */
         return context_has_address_families(c) ||
                 c->memory_deny_write_execute ||
                 c->restrict_realtime ||
@@ -1392,6 +1392,19 @@ static bool context_has_no_new_privileges(const ExecContext *c) {
                 c->lock_personality;
 }
 
+static bool context_has_no_new_privileges(const ExecContext *c) {
+        assert(c);
+
+        if (c->no_new_privileges)
+                return true;
+
+        if (have_effective_cap(CAP_SYS_ADMIN)) /* if we are privileged, we don't need NNP */
+                return false;
+
+        /* We need NNP if we have any form of seccomp and are unprivileged */
+        return context_has_seccomp(c);
+}
+
 #if HAVE_SECCOMP
 
 static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
@@ -1572,8 +1585,256 @@ static int apply_lock_personality(const Unit* u, const ExecContext *c) {
         return seccomp_lock_personality(personality);
 }
 
+static int apply_seccomp(const Unit *u, const ExecContext *c, bool needs_ambient_hack, int log_level, int *exit_status) {
+        int r;
+
+        assert(u);
+        assert(c);
+        assert(exit_status);
+
+        r = apply_address_families(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_ADDRESS_FAMILIES;
+                return log_unit_full(u, log_level, r, "Failed to restrict address families: %m");
+        }
+
+        r = apply_memory_deny_write_execute(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to disable writing to executable memory: %m");
+        }
+
+        r = apply_restrict_realtime(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply realtime restrictions: %m");
+        }
+
+        r = apply_restrict_namespaces(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply namespace restrictions: %m");
+        }
+
+        r = apply_protect_sysctl(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply sysctl restrictions: %m");
+        }
+
+        r = apply_protect_kernel_modules(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply module loading restrictions: %m");
+        }
+
+        r = apply_private_devices(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to set up private devices: %m");
+        }
+
+        r = apply_syscall_archs(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply syscall architecture restrictions: %m");
+        }
+
+        r = apply_lock_personality(u, c);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to lock personalities: %m");
+        }
+
+        /* This really should remain the last step before the execve(), to make sure our own code is unaffected
+         * by the filter as little as possible. */
+        r = apply_syscall_filter(u, c, needs_ambient_hack);
+        if (r < 0) {
+                *exit_status = EXIT_SECCOMP;
+                return log_unit_full(u, log_level, r, "Failed to apply system call filters: %m");
+        }
+
+        return 0;
+}
+
+typedef struct SeccompCompileArgs {
+        const Unit *unit;
+        const ExecContext *context;
+} SeccompCompileArgs;
+
+static int compile_seccomp(void *userdata) {
+        SeccompCompileArgs *args = userdata;
+        int exit_status;
+
+        return apply_seccomp(args->unit, args->context, false, LOG_DEBUG, &exit_status);
+}
+
+static int cmp_uint64(const uint64_t *a, const uint64_t *b) {
+        return CMP(*a, *b);
+}
+
+static void fput_sorted(FILE *f, uint64_t *v, size_t n) {
+        size_t i;
+
+        typesafe_qsort(v, n, cmp_uint64);
+
+        /* The number of items first, so that one list can't be mistaken for the beginning of the next */
+        fprintf(f, ";%zu", n);
+        for (i = 0; i < n; i++)
+                fprintf(f, " %" PRIx64, v[i]);
+}
+
+static int exec_context_seccomp_key(const ExecContext *c, char **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ uint64_t *v = NULL;
+        _cleanup_free_ char *key = NULL;
+        size_t size = 0, n;
+        void *id, *val;
+        Iterator i;
+        int r;
+
+        assert(c);
+        assert(ret);
+
+        /* Serializes all settings the seccomp filters are built from. The hashmaps and sets are sorted, so that
+         * identical settings result in identical keys, regardless of the order they were specified in. */
+
+        f = open_memstream(&key, &size);
+        if (!f)
+                return -ENOMEM;
+
+        fprintf(f, "%i %i %i %i %i %lu %i %i %i %i %lu",
+                c->syscall_whitelist,
+                c->syscall_errno,
+                c->address_families_whitelist,
+                c->memory_deny_write_execute,
+                c->restrict_realtime,
+                c->restrict_namespaces,
+                c->protect_kernel_tunables,
+                c->protect_kernel_modules,
+                c->private_devices,
+                c->lock_personality,
+                c->personality);
+
+        v = new(uint64_t, MAX3(hashmap_size(c->syscall_filter), set_size(c->syscall_archs), set_size(c->address_families)));
+        if (!v)
+                return -ENOMEM;
+
+        n = 0;
+        HASHMAP_FOREACH_KEY(val, id, c->syscall_filter, i)
+                v[n++] = (uint64_t) (uint32_t) PTR_TO_INT(id) << 32 | (uint32_t) PTR_TO_INT(val);
+        fput_sorted(f, v, n);
+
+        n = 0;
+        SET_FOREACH(id, c->syscall_archs, i)
+                v[n++] = PTR_TO_UINT32(id);
+        fput_sorted(f, v, n);
+
+        n = 0;
+        SET_FOREACH(id, c->address_families, i)
+                v[n++] = (uint32_t) PTR_TO_INT(id);
+        fput_sorted(f, v, n);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        *ret = TAKE_PTR(key);
+        return 0;
+}
+
+static const SeccompPrograms *exec_spawn_get_seccomp(
+                Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params) {
+
+        _cleanup_(seccomp_programs_freep) SeccompPrograms *p = NULL;
+        _cleanup_free_ char *key = NULL;
+        const SeccompPrograms *existing;
+        SeccompCompileArgs args = {
+                .unit = unit,
+                .context = context,
+        };
+        Manager *m;
+        int r;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+
+        /* Building the seccomp filters is expensive, and identical for every invocation with the same settings.
+         * Hence, compile them here once, and let the forked off children install the result as is. If anything
+         * goes wrong, the children build the filters themselves, as before. */
+
+        if (!(params->flags & EXEC_APPLY_SANDBOXING))
+                return NULL;
+
+        if (!context_has_seccomp(context))
+                return NULL;
+
+        if (!is_seccomp_available())
+                return NULL;
+
+        /* With the ambient capabilities hack, the system call filter is modified for each invocation */
+        if ((command->flags & EXEC_COMMAND_AMBIENT_MAGIC) && !ambient_capabilities_supported())
+                return NULL;
+
+        m = unit->manager;
+
+        r = exec_context_seccomp_key(context, &key);
+        if (r < 0)
+                goto fail;
+
+        existing = hashmap_get(m->seccomp_programs, key);
+        if (existing)
+                return existing;
+
+        r = seccomp_compile(compile_seccomp, &args, &p);
+        if (r < 0)
+                goto fail;
+
+        /* The number of distinct settings is usually small, but let's not grow without bounds with lots of
+         * transient units */
+        if (hashmap_size(m->seccomp_programs) >= SECCOMP_PROGRAMS_CACHE_MAX)
+                m->seccomp_programs = exec_seccomp_cache_free(m->seccomp_programs);
+
+        r = hashmap_ensure_allocated(&m->seccomp_programs, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_put(m->seccomp_programs, key, p);
+        if (r < 0)
+                goto fail;
+
+        log_unit_debug(unit, "Compiled %zu seccomp filters.", seccomp_programs_size(p));
+
+        TAKE_PTR(key);
+        return TAKE_PTR(p);
+
+fail:
+        log_unit_debug_errno(unit, r, "Failed to compile seccomp filters, leaving that to the child: %m");
+        return NULL;
+}
+
 #endif
 
+Hashmap *exec_seccomp_cache_free(Hashmap *h) {
+#if HAVE_SECCOMP
+        char *key;
+
+        while ((key = hashmap_first_key(h))) {
+                seccomp_programs_free(hashmap_remove(h, key));
+                free(key);
+        }
+#endif
+
+        return hashmap_free(h);
+}
+
 static void do_idle_pipe_dance(int idle_pipe[4]) {
         assert(idle_pipe);
 
@@ -2746,6 +3007,7 @@ static int exec_child(
                 size_t n_storage_fds,
                 char **files_env,
                 int user_lookup_fd,
+                const SeccompPrograms *seccomp_programs,
                 int *exit_status) {
 
         _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **accum_env = NULL, **final_argv = NULL;
@@ -3390,66 +3652,16 @@ static int exec_child(
                         }
 
 #if HAVE_SECCOMP
-                r = apply_address_families(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_ADDRESS_FAMILIES;
-                        return log_unit_error_errno(unit, r, "Failed to restrict address families: %m");
-                }
-
-                r = apply_memory_deny_write_execute(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to disable writing to executable memory: %m");
-                }
-
-                r = apply_restrict_realtime(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply realtime restrictions: %m");
-                }
-
-                r = apply_restrict_namespaces(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply namespace restrictions: %m");
-                }
-
-                r = apply_protect_sysctl(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply sysctl restrictions: %m");
-                }
-
-                r = apply_protect_kernel_modules(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply module loading restrictions: %m");
-                }
-
-                r = apply_private_devices(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to set up private devices: %m");
-                }
-
-                r = apply_syscall_archs(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply syscall architecture restrictions: %m");
-                }
-
-                r = apply_lock_personality(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to lock personalities: %m");
-                }
-
-                /* This really should remain the last step before the execve(), to make sure our own code is unaffected
-                 * by the filter as little as possible. */
-                r = apply_syscall_filter(unit, context, needs_ambient_hack);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return log_unit_error_errno(unit, r, "Failed to apply system call filters: %m");
+                if (seccomp_programs) {
+                        r = seccomp_programs_install(seccomp_programs);
+                        if (r < 0) {
+                                *exit_status = EXIT_SECCOMP;
+                                return log_unit_error_errno(unit, r, "Failed to install seccomp filters: %m");
+                        }
+                } else {
+                        r = apply_seccomp(unit, context, needs_ambient_hack, LOG_ERR, exit_status);
+                        if (r < 0)
+                                return r;
                 }
 #endif
         }
@@ -3529,26 +3741,18 @@ static int exec_child(
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 static int exec_context_named_iofds(const ExecContext *c, const ExecParameters *p, int named_iofds[3]);
 
-int exec_spawn(Unit *unit,
-               ExecCommand *command,
-               const ExecContext *context,
-               const ExecParameters *params,
-               ExecRuntime *runtime,
-               DynamicCreds *dcreds,
-               pid_t *ret) {
-
-        int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds = NULL;
-        _cleanup_strv_free_ char **files_env = NULL;
-        size_t n_storage_fds = 0, n_socket_fds = 0;
-        _cleanup_free_ char *line = NULL;
-        pid_t pid;
+static int exec_spawn_get_fds(
+                const Unit *unit,
+                const ExecContext *context,
+                const ExecParameters *params,
+                int *ret_socket_fd,
+                int **ret_fds,
+                size_t *ret_n_socket_fds,
+                size_t *ret_n_storage_fds) {
 
         assert(unit);
-        assert(command);
         assert(context);
-        assert(ret);
         assert(params);
-        assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
 
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
@@ -3564,14 +3768,213 @@ int exec_spawn(Unit *unit,
                         return -EINVAL;
                 }
 
-                socket_fd = params->fds[0];
+                *ret_socket_fd = params->fds[0];
+                *ret_fds = NULL;
+                *ret_n_socket_fds = *ret_n_storage_fds = 0;
         } else {
-                socket_fd = -1;
-                fds = params->fds;
-                n_socket_fds = params->n_socket_fds;
-                n_storage_fds = params->n_storage_fds;
+                *ret_socket_fd = -1;
+                *ret_fds = params->fds;
+                *ret_n_socket_fds = params->n_socket_fds;
+                *ret_n_storage_fds = params->n_storage_fds;
+        }
+
+        return 0;
+}
+
+int exec_invoke(
+                Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                ExecRuntime *runtime,
+                DynamicCreds *dcreds,
+                char **files_env,
+                int user_lookup_fd,
+                const SeccompPrograms *seccomp_programs) {
+
+        int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds, exit_status = EXIT_SUCCESS;
+        size_t n_storage_fds, n_socket_fds;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+
+        /* Runs in the forked off child, or in systemd-executor, and returns the exit status to use if execve() fails */
+
+        r = exec_spawn_get_fds(unit, context, params, &socket_fd, &fds, &n_socket_fds, &n_storage_fds);
+        if (r < 0)
+                return EXIT_FDS;
+
+        r = exec_context_named_iofds(context, params, named_iofds);
+        if (r < 0) {
+                log_unit_error_errno(unit, r, "Failed to load a named file descriptor: %m");
+                return EXIT_FDS;
+        }
+
+        r = exec_child(unit,
+                       command,
+                       context,
+                       params,
+                       runtime,
+                       dcreds,
+                       socket_fd,
+                       named_iofds,
+                       fds,
+                       n_socket_fds,
+                       n_storage_fds,
+                       files_env,
+                       user_lookup_fd,
+                       seccomp_programs,
+                       &exit_status);
+
+        if (r < 0)
+                log_struct_errno(LOG_ERR, r,
+                                 "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                 LOG_UNIT_ID(unit),
+                                 LOG_UNIT_INVOCATION_ID(unit),
+                                 LOG_UNIT_MESSAGE(unit, "Failed at step %s spawning %s: %m",
+                                                  exit_status_to_string(exit_status, EXIT_STATUS_SYSTEMD),
+                                                  command->path),
+                                 "EXECUTABLE=%s", command->path);
+
+        return exit_status;
+}
+
+static bool exec_spawn_can_use_executor(
+                const Unit *unit,
+                const ExecContext *context,
+                const ExecParameters *params,
+                const ExecRuntime *runtime,
+                const DynamicCreds *dcreds) {
+
+        assert(unit);
+
+        if (unit->manager->executor_fd < 0)
+                return false;
+
+        /* Shared /tmp directories and network namespaces are passed in as part of the runtime, dynamic users as
+         * part of the creds, neither is serialized for the executor. */
+        if (runtime && (runtime->tmp_dir || runtime->var_tmp_dir || runtime->netns_storage_socket[0] >= 0))
+                return false;
+        if (dcreds && (dcreds->user || dcreds->group))
+                return false;
+
+        return exec_context_can_serialize(context) && exec_parameters_can_serialize(params);
+}
+
+static int exec_spawn_executor(
+                Unit *unit,
+                ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                char **files_env,
+                pid_t *ret) {
+
+        _cleanup_free_ int *keep_fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        char deserialize[STRLEN("--deserialize=") + DECIMAL_STR_MAX(int)];
+        size_t n_keep_fds = 0;
+        int fd, r;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+        assert(ret);
+
+        /* Spawns the command through systemd-executor, which gets everything it needs for exec_invoke() passed in a
+         * serialization. */
+
+        fd = open_serialization_fd("systemd-executor");
+        if (fd < 0)
+                return fd;
+
+        f = fdopen(fd, "w+");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
         }
 
+        r = exec_serialize_invocation(f, unit, command, context, params, files_env, unit->manager->user_lookup_fds[1]);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        /* All file descriptors the executor needs have to survive its execve(), or be passed to it. The serialization
+         * has to come first. */
+        keep_fds = new(int, params->n_socket_fds + params->n_storage_fds + 6);
+        if (!keep_fds)
+                return -ENOMEM;
+
+        keep_fds[n_keep_fds++] = fd;
+        memcpy_safe(keep_fds + n_keep_fds, params->fds, (params->n_socket_fds + params->n_storage_fds) * sizeof(int));
+        n_keep_fds += params->n_socket_fds + params->n_storage_fds;
+        if (params->stdin_fd >= 0)
+                keep_fds[n_keep_fds++] = params->stdin_fd;
+        if (params->stdout_fd >= 0)
+                keep_fds[n_keep_fds++] = params->stdout_fd;
+        if (params->stderr_fd >= 0)
+                keep_fds[n_keep_fds++] = params->stderr_fd;
+        if (params->exec_fd >= 0)
+                keep_fds[n_keep_fds++] = params->exec_fd;
+        if (unit->manager->user_lookup_fds[1] >= 0)
+                keep_fds[n_keep_fds++] = unit->manager->user_lookup_fds[1];
+
+        /* Prefer an executor that is already up and waiting, if there is one */
+        if (n_keep_fds <= EXECUTOR_FDS_MAX) {
+                _cleanup_close_ int helper_fd = -1;
+                pid_t pid;
+
+                r = executor_pool_take(unit->manager, &pid, &helper_fd);
+                if (r > 0) {
+                        r = executor_send_invocation(helper_fd, keep_fds, n_keep_fds);
+                        if (r >= 0) {
+                                log_unit_debug(unit, "Handed %s to idle executor "PID_FMT, command->path, pid);
+                                *ret = pid;
+                                return 0;
+                        }
+
+                        /* The executor is gone, it exits as soon as it sees its socket closed otherwise */
+                        log_unit_debug_errno(unit, r, "Failed to pass invocation to idle executor "PID_FMT", ignoring: %m", pid);
+                }
+        }
+
+        xsprintf(deserialize, "--deserialize=%i", fd);
+
+        return executor_clone(unit->manager->executor_fd, STRV_MAKE("systemd-executor", deserialize), keep_fds, n_keep_fds, ret);
+}
+
+int exec_spawn(Unit *unit,
+               ExecCommand *command,
+               const ExecContext *context,
+               const ExecParameters *params,
+               ExecRuntime *runtime,
+               DynamicCreds *dcreds,
+               pid_t *ret) {
+
+        int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds;
+        const SeccompPrograms *seccomp_programs = NULL;
+        _cleanup_strv_free_ char **files_env = NULL;
+        size_t n_storage_fds, n_socket_fds;
+        _cleanup_free_ char *line = NULL;
+        pid_t pid;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(ret);
+        assert(params);
+        assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
+
+        /* Validate the fd setup here already, so that problems with it are reported synchronously */
+        r = exec_spawn_get_fds(unit, context, params, &socket_fd, &fds, &n_socket_fds, &n_storage_fds);
+        if (r < 0)
+                return r;
+
         r = exec_context_named_iofds(context, params, named_iofds);
         if (r < 0)
                 return log_unit_error_errno(unit, r, "Failed to load a named file descriptor: %m");
@@ -3580,53 +3983,48 @@ int exec_spawn(Unit *unit,
         if (r < 0)
                 return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
 
-        line = exec_command_line(command->argv);
-        if (!line)
-                return log_oom();
+        /* Formatting the command line is not free, don't bother unless it's actually logged */
+        if (log_get_max_level() >= LOG_DEBUG) {
+                line = exec_command_line(command->argv);
+                if (!line)
+                        return log_oom();
 
-        log_struct(LOG_DEBUG,
-                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
-                   "EXECUTABLE=%s", command->path,
-                   LOG_UNIT_ID(unit),
-                   LOG_UNIT_INVOCATION_ID(unit));
+                log_struct(LOG_DEBUG,
+                           LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
+                           "EXECUTABLE=%s", command->path,
+                           LOG_UNIT_ID(unit),
+                           LOG_UNIT_INVOCATION_ID(unit));
+        }
+
+        if (exec_spawn_can_use_executor(unit, context, params, runtime, dcreds)) {
+                r = exec_spawn_executor(unit, command, context, params, files_env, &pid);
+                if (r >= 0) {
+                        log_unit_debug(unit, "Spawned %s via executor as "PID_FMT, command->path, pid);
+                        goto spawned;
+                }
+
+                /* Don't try again, fork() works for everything */
+                log_unit_warning_errno(unit, r, "Failed to spawn %s via executor, forking instead: %m", command->path);
+                unit->manager->executor_fd = safe_close(unit->manager->executor_fd);
+                unit->manager->executor_pool = executor_pool_free(unit->manager->executor_pool);
+        }
+
+#if HAVE_SECCOMP
+        seccomp_programs = exec_spawn_get_seccomp(unit, command, context, params);
+#endif
 
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
 
-        if (pid == 0) {
-                int exit_status = EXIT_SUCCESS;
-
-                r = exec_child(unit,
-                               command,
-                               context,
-                               params,
-                               runtime,
-                               dcreds,
-                               socket_fd,
-                               named_iofds,
-                               fds,
-                               n_socket_fds,
-                               n_storage_fds,
-                               files_env,
-                               unit->manager->user_lookup_fds[1],
-                               &exit_status);
-
-                if (r < 0)
-                        log_struct_errno(LOG_ERR, r,
-                                         "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
-                                         LOG_UNIT_ID(unit),
-                                         LOG_UNIT_INVOCATION_ID(unit),
-                                         LOG_UNIT_MESSAGE(unit, "Failed at step %s spawning %s: %m",
-                                                          exit_status_to_string(exit_status, EXIT_STATUS_SYSTEMD),
-                                                          command->path),
-                                         "EXECUTABLE=%s", command->path);
-
-                _exit(exit_status);
-        }
+        if (pid == 0)
+                _exit(exec_invoke(unit, command, context, params, runtime, dcreds, files_env, unit->manager->user_lookup_fds[1], seccomp_programs));
 
         log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
 
+spawned:
+        manager_boot_trace(unit->manager, BOOT_TRACE_SPAWN, unit->id, PID_FMT " %s", pid, command->path);
+
         /* We add the new process to the cgroup both in the child (so
          * that we can be sure that no user code is ever executed
          * outside of the cgroup) and in the parent (so that we can be
@@ -3945,18 +4343,12 @@ static int exec_context_load_environment(const Unit *unit, const ExecContext *c,
                                 p = strv_env_clean_with_callback(p, invalid_env, &info);
                         }
 
-                        if (!r)
-                                r = p;
-                        else {
-                                char **m;
-
-                                m = strv_env_merge(2, r, p);
+                        /* Merge in place, so that the variables of the earlier files aren't copied again for
+                         * each file */
+                        k = strv_env_merge_consume(&r, p);
+                        if (k < 0) {
                                 strv_free(r);
-                                strv_free(p);
-                                if (!m)
-                                        return -ENOMEM;
-
-                                r = m;
+                                return k;
                         }
                 }
         }
@@ -4202,6 +4594,17 @@ void exec_context_dump(const ExecContext *c, FILE* f, const char *prefix) {
                 fprintf(f, "%sLogLevelMax: %s\n", prefix, strna(t));
         }
 
+        if (c->log_rate_limit_interval_usec > 0) {
+                char buf_timespan[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f,
+                        "%sLogRateLimitIntervalSec: %s\n",
+                        prefix, format_timespan(buf_timespan, sizeof(buf_timespan), c->log_rate_limit_interval_usec, USEC_PER_SEC));
+        }
+
+        if (c->log_rate_limit_burst > 0)
+                fprintf(f, "%sLogRateLimitBurst: %u\n", prefix, c->log_rate_limit_burst);
+
         if (c->n_log_extra_fields > 0) {
                 size_t j;
 
@@ -4849,13 +5252,8 @@ int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds) {
         assert(fds);
 
         HASHMAP_FOREACH(rt, m->exec_runtime_by_id, i) {
-                fprintf(f, "exec-runtime=%s", rt->id);
-
-                if (rt->tmp_dir)
-                        fprintf(f, " tmp-dir=%s", rt->tmp_dir);
-
-                if (rt->var_tmp_dir)
-                        fprintf(f, " var-tmp-dir=%s", rt->var_tmp_dir);
+                char socket0[STRLEN(" netns-socket-0=") + DECIMAL_STR_MAX(int)] = "",
+                     socket1[STRLEN(" netns-socket-1=") + DECIMAL_STR_MAX(int)] = "";
 
                 if (rt->netns_storage_socket[0] >= 0) {
                         int copy;
@@ -4864,7 +5262,7 @@ int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds) {
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-0=%i", copy);
+                        xsprintf(socket0, " netns-socket-0=%i", copy);
                 }
 
                 if (rt->netns_storage_socket[1] >= 0) {
@@ -4874,10 +5272,14 @@ int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds) {
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-1=%i", copy);
+                        xsprintf(socket1, " netns-socket-1=%i", copy);
                 }
 
-                fputc('\n', f);
+                serialize_item_format(f, m->serialization_format, "exec-runtime", "%s%s%s%s%s%s%s",
+                                      rt->id,
+                                      rt->tmp_dir ? " tmp-dir=" : "", strempty(rt->tmp_dir),
+                                      rt->var_tmp_dir ? " var-tmp-dir=" : "", strempty(rt->var_tmp_dir),
+                                      socket0, socket1);
         }
 
         return 0;
@@ -7,6 +7,7 @@ typedef struct ExecContext ExecContext;
 typedef struct ExecRuntime ExecRuntime;
 typedef struct ExecParameters ExecParameters;
 typedef struct Manager Manager;
+typedef struct SeccompPrograms SeccompPrograms;
 
 #include <sched.h>
 #include <stdbool.h>
@@ -222,6 +223,9 @@ struct ExecContext {
 
         int log_level_max;
 
+        usec_t log_rate_limit_interval_usec;
+        unsigned log_rate_limit_burst;
+
         struct iovec* log_extra_fields;
         size_t n_log_extra_fields;
 
@@ -341,6 +345,17 @@ int exec_spawn(Unit *unit,
                ExecRuntime *runtime,
                DynamicCreds *dynamic_creds,
                pid_t *ret);
+int exec_invoke(Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                ExecRuntime *runtime,
+                DynamicCreds *dynamic_creds,
+                char **files_env,
+                int user_lookup_fd,
+                const SeccompPrograms *seccomp_programs);
+
+Hashmap *exec_seccomp_cache_free(Hashmap *h);
 
 void exec_command_done_array(ExecCommand *c, size_t n);
 ExecCommand* exec_command_free_list(ExecCommand *c);
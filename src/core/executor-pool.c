@@ -0,0 +1,404 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "executor-pool.h"
+#include "exit-status.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "process-util.h"
+#include "socket-util.h"
+#include "stdio-util.h"
+#include "strv.h"
+#include "time-util.h"
+
+/* How many idle executors we keep around while socket activated per-connection services are being started */
+#define EXECUTOR_POOL_SIZE 4U
+
+/* If no connection asked for an executor for this long, the idle ones are let go */
+#define EXECUTOR_POOL_IDLE_USEC (1*USEC_PER_MINUTE)
+
+#define EXECUTOR_STACK_SIZE (64U*1024U)
+
+typedef struct ExecutorHelper {
+        pid_t pid;
+        int fd;
+} ExecutorHelper;
+
+struct ExecutorPool {
+        Manager *manager;
+
+        /* Oldest first, they had the most time to get ready */
+        ExecutorHelper helpers[EXECUTOR_POOL_SIZE];
+        size_t n_helpers;
+
+        sd_event_source *refill_event_source;
+        sd_event_source *expire_event_source;
+};
+
+typedef struct ExecutorChild {
+        int executor_fd;
+        char **argv;
+        const int *fds;
+        size_t n_fds;
+        int error;
+} ExecutorChild;
+
+static int executor_child(void *userdata) {
+        ExecutorChild *c = userdata;
+        size_t i;
+        int r;
+
+        /* This runs in a vfork()-like child that shares our address space while we are suspended, hence it may not do
+         * more than a few system calls, and in particular may not allocate memory or log. */
+
+        for (i = 0; i < c->n_fds; i++) {
+                r = fd_cloexec(c->fds[i], false);
+                if (r < 0) {
+                        c->error = r;
+                        _exit(EXIT_FDS);
+                }
+        }
+
+        (void) fexecve(c->executor_fd, c->argv, environ);
+
+        c->error = -errno;
+        _exit(EXIT_EXEC);
+}
+
+int executor_clone(int executor_fd, char **argv, const int *fds, size_t n_fds, pid_t *ret) {
+        _cleanup_free_ void *stack = NULL;
+        ExecutorChild c = {
+                .executor_fd = executor_fd,
+                .argv = argv,
+                .fds = fds,
+                .n_fds = n_fds,
+        };
+        sigset_t ss, saved_ss;
+        pid_t pid;
+        int r;
+
+        assert(executor_fd >= 0);
+        assert(argv);
+        assert(fds || n_fds == 0);
+        assert(ret);
+
+        /* Starts systemd-executor with the specified fds kept open. Unlike fork(), this requires no copy of our page
+         * tables, which adds up for a big PID 1. */
+
+        stack = malloc(EXECUTOR_STACK_SIZE);
+        if (!stack)
+                return -ENOMEM;
+
+        /* The child runs on our memory, make sure none of our signal handlers is ever invoked in it. The executor
+         * resets the signal mask before it executes the command. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigprocmask(SIG_SETMASK, &ss, &saved_ss) >= 0);
+
+        pid = clone(executor_child, (uint8_t*) stack + EXECUTOR_STACK_SIZE, CLONE_VM|CLONE_VFORK|SIGCHLD, &c);
+        r = pid < 0 ? -errno : 0;
+
+        assert_se(sigprocmask(SIG_SETMASK, &saved_ss, NULL) >= 0);
+
+        if (r < 0)
+                return r;
+
+        if (c.error < 0) {
+                /* The child exited without executing anything, collect it right-away */
+                (void) wait_for_terminate(pid, NULL);
+                return c.error;
+        }
+
+        *ret = pid;
+        return 0;
+}
+
+static void executor_pool_release(ExecutorPool *p) {
+        size_t i;
+
+        assert(p);
+
+        /* Idle executors exit on their own as soon as they see EOF, and we reap them like any other unknown child */
+        for (i = 0; i < p->n_helpers; i++)
+                safe_close(p->helpers[i].fd);
+
+        p->n_helpers = 0;
+}
+
+ExecutorPool* executor_pool_free(ExecutorPool *p) {
+        if (!p)
+                return NULL;
+
+        executor_pool_release(p);
+
+        sd_event_source_unref(p->refill_event_source);
+        sd_event_source_unref(p->expire_event_source);
+
+        return mfree(p);
+}
+
+static int executor_pool_spawn_one(ExecutorPool *p) {
+        char listen[STRLEN("--listen=") + DECIMAL_STR_MAX(int)];
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        pid_t pid;
+        int r;
+
+        assert(p);
+        assert(p->n_helpers < EXECUTOR_POOL_SIZE);
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        xsprintf(listen, "--listen=%i", pair[1]);
+
+        r = executor_clone(p->manager->executor_fd, STRV_MAKE("systemd-executor", listen), pair + 1, 1, &pid);
+        if (r < 0)
+                return r;
+
+        p->helpers[p->n_helpers++] = (ExecutorHelper) {
+                .pid = pid,
+                .fd = TAKE_FD(pair[0]),
+        };
+
+        log_debug("Spawned idle executor as " PID_FMT ".", pid);
+        return 0;
+}
+
+static int executor_pool_schedule_refill(ExecutorPool *p);
+
+static int executor_pool_dispatch_refill(sd_event_source *source, void *userdata) {
+        ExecutorPool *p = userdata;
+        int r;
+
+        assert(p);
+
+        /* One at a time, so that we get back to whatever else there is to do in between */
+        r = executor_pool_spawn_one(p);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to spawn idle executor, not refilling executor pool: %m");
+                return 0;
+        }
+
+        (void) executor_pool_schedule_refill(p);
+        return 0;
+}
+
+static int executor_pool_schedule_refill(ExecutorPool *p) {
+        int r;
+
+        assert(p);
+
+        if (p->n_helpers >= EXECUTOR_POOL_SIZE || p->manager->executor_fd < 0)
+                return 0;
+
+        if (p->refill_event_source)
+                return sd_event_source_set_enabled(p->refill_event_source, SD_EVENT_ONESHOT);
+
+        r = sd_event_add_defer(p->manager->event, &p->refill_event_source, executor_pool_dispatch_refill, p);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(p->refill_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(p->refill_event_source, "executor-pool-refill");
+
+        return 0;
+}
+
+static int executor_pool_dispatch_expire(sd_event_source *source, usec_t usec, void *userdata) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        ExecutorPool *p = userdata;
+
+        assert(p);
+
+        log_debug("Executor pool unused for %s, releasing idle executors.",
+                  format_timespan(ts, sizeof(ts), EXECUTOR_POOL_IDLE_USEC, 0));
+
+        executor_pool_release(p);
+
+        if (p->refill_event_source)
+                (void) sd_event_source_set_enabled(p->refill_event_source, SD_EVENT_OFF);
+
+        return 0;
+}
+
+int executor_pool_want(Manager *m) {
+        ExecutorPool *p;
+        usec_t until;
+        int r;
+
+        assert(m);
+
+        /* Called whenever a per-connection service is about to be started that systemd-executor can spawn. Makes sure
+         * a few executors are ready to take the next connections, until they aren't needed for a while. */
+
+        if (m->executor_fd < 0)
+                return 0;
+
+        if (!m->executor_pool) {
+                m->executor_pool = new0(ExecutorPool, 1);
+                if (!m->executor_pool)
+                        return -ENOMEM;
+
+                m->executor_pool->manager = m;
+        }
+
+        p = m->executor_pool;
+
+        until = usec_add(now(CLOCK_MONOTONIC), EXECUTOR_POOL_IDLE_USEC);
+
+        if (p->expire_event_source) {
+                r = sd_event_source_set_time(p->expire_event_source, until);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_enabled(p->expire_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        return r;
+        } else {
+                r = sd_event_add_time(m->event, &p->expire_event_source, CLOCK_MONOTONIC, until, 0,
+                                      executor_pool_dispatch_expire, p);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(p->expire_event_source, "executor-pool-expire");
+        }
+
+        return executor_pool_schedule_refill(p);
+}
+
+int executor_pool_take(Manager *m, pid_t *ret_pid, int *ret_fd) {
+        ExecutorPool *p;
+
+        assert(m);
+        assert(ret_pid);
+        assert(ret_fd);
+
+        /* Returns 0 if there's no idle executor, > 0 if one was handed out. The caller owns the returned fd, and
+         * passes the invocation in with executor_send_invocation(). */
+
+        p = m->executor_pool;
+        if (!p || p->n_helpers == 0)
+                return 0;
+
+        *ret_pid = p->helpers[0].pid;
+        *ret_fd = p->helpers[0].fd;
+
+        memmove(p->helpers, p->helpers + 1, (p->n_helpers - 1) * sizeof(ExecutorHelper));
+        p->n_helpers--;
+
+        (void) executor_pool_schedule_refill(p);
+
+        return 1;
+}
+
+int executor_send_invocation(int fd, const int *fds, size_t n_fds) {
+        _cleanup_free_ void *control = NULL;
+        struct iovec iov = IOVEC_INIT((int*) fds, n_fds * sizeof(int));
+        struct msghdr mh = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+        };
+        struct cmsghdr *cmsg;
+
+        assert(fd >= 0);
+        assert(fds);
+        assert(n_fds > 0);
+
+        /* Passes the fds to an idle executor, the serialization first. The payload carries the numbers the fds
+         * have on our side, which is what the serialization refers to. */
+
+        if (n_fds > EXECUTOR_FDS_MAX)
+                return -E2BIG;
+
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        mh.msg_control = control = malloc0(mh.msg_controllen);
+        if (!control)
+                return -ENOMEM;
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int executor_receive_invocation(int fd, int **ret_from, int **ret_to, size_t *ret_n) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * EXECUTOR_FDS_MAX)];
+        } control = {};
+        _cleanup_free_ int *from = NULL, *to = NULL;
+        struct cmsghdr *cmsg, *found = NULL;
+        struct iovec iov;
+        struct msghdr mh = {
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+        };
+        ssize_t k;
+        size_t n;
+
+        assert(fd >= 0);
+        assert(ret_from);
+        assert(ret_to);
+        assert(ret_n);
+
+        /* The counterpart of executor_send_invocation(). Returns 0 on EOF, i.e. when the manager let us go, > 0 if we
+         * got an invocation, with the fds as the manager knows them in ret_from, and as we do in ret_to. */
+
+        from = new(int, EXECUTOR_FDS_MAX);
+        if (!from)
+                return -ENOMEM;
+
+        iov = IOVEC_MAKE(from, sizeof(int) * EXECUTOR_FDS_MAX);
+
+        k = recvmsg(fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+        if (k == 0)
+                return 0;
+
+        CMSG_FOREACH(cmsg, &mh)
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                        found = cmsg;
+                        break;
+                }
+
+        if (!found || (mh.msg_flags & (MSG_CTRUNC|MSG_TRUNC))) {
+                cmsg_close_all(&mh);
+                return -EBADMSG;
+        }
+
+        n = (found->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (n == 0 || (size_t) k != n * sizeof(int)) {
+                cmsg_close_all(&mh);
+                return -EBADMSG;
+        }
+
+        to = newdup(int, CMSG_DATA(found), n);
+        if (!to) {
+                cmsg_close_all(&mh);
+                return -ENOMEM;
+        }
+
+        *ret_from = TAKE_PTR(from);
+        *ret_to = TAKE_PTR(to);
+        *ret_n = n;
+
+        return 1;
+}
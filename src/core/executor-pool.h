@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include "manager.h"
+
+/* The kernel refuses to pass more than SCM_MAX_FD file descriptors in one message */
+#define EXECUTOR_FDS_MAX 253U
+
+int executor_clone(int executor_fd, char **argv, const int *fds, size_t n_fds, pid_t *ret);
+
+ExecutorPool* executor_pool_free(ExecutorPool *p);
+
+int executor_pool_want(Manager *m);
+int executor_pool_take(Manager *m, pid_t *ret_pid, int *ret_fd);
+
+int executor_send_invocation(int fd, const int *fds, size_t n_fds);
+int executor_receive_invocation(int fd, int **ret_from, int **ret_to, size_t *ret_n);
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "execute-serialize.h"
+#include "executor-pool.h"
+#include "exit-status.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "parse-util.h"
+#include "signal-util.h"
+#include "util.h"
+
+/* systemd-executor is spawned by the service manager instead of forking itself, to run exec_invoke() with the
+ * invocation passed in as a serialization. With --listen= it is started ahead of time, and waits for the serialization
+ * and the fds to be passed over a socket. It is not meant to be invoked by anything else. */
+
+static int arg_deserialize = -1;
+static int arg_listen = -1;
+
+static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_DESERIALIZE = 0x100,
+                ARG_LISTEN,
+        };
+
+        static const struct option options[] = {
+                { "deserialize", required_argument, NULL, ARG_DESERIALIZE },
+                { "listen",      required_argument, NULL, ARG_LISTEN      },
+                {}
+        };
+
+        int c, r;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        while ((c = getopt_long(argc, argv, "", options, NULL)) >= 0)
+                switch (c) {
+
+                case ARG_DESERIALIZE:
+                        r = safe_atoi(optarg, &arg_deserialize);
+                        if (r < 0 || arg_deserialize < 0)
+                                return log_error_errno(r < 0 ? r : -EBADF, "Failed to parse serialization fd: %s", optarg);
+
+                        break;
+
+                case ARG_LISTEN:
+                        r = safe_atoi(optarg, &arg_listen);
+                        if (r < 0 || arg_listen < 0)
+                                return log_error_errno(r < 0 ? r : -EBADF, "Failed to parse listening fd: %s", optarg);
+
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+
+        if (optind < argc || (arg_deserialize < 0) == (arg_listen < 0)) {
+                log_error("%s is not meant to be invoked directly.", program_invocation_short_name);
+                return -EINVAL;
+        }
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ int *from = NULL, *to = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecInvocation i;
+        int r, exit_status;
+        size_t n_fds = 0;
+
+        log_set_target(LOG_TARGET_KMSG);
+        log_open();
+
+        r = parse_argv(argc, argv);
+        if (r < 0)
+                return EXIT_FAILURE;
+
+        if (arg_listen >= 0) {
+                /* We were spawned with all signals blocked, don't hold up the manager when it wants us to go */
+                (void) reset_signal_mask();
+
+                r = executor_receive_invocation(arg_listen, &from, &to, &n_fds);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to receive invocation: %m");
+                        return EXIT_FDS;
+                }
+                if (r == 0) /* Not needed anymore */
+                        return EXIT_SUCCESS;
+
+                arg_listen = safe_close(arg_listen);
+                arg_deserialize = to[0];
+        }
+
+        f = fdopen(arg_deserialize, "r");
+        if (!f) {
+                log_error_errno(errno, "Failed to open serialization fd: %m");
+                return EXIT_FDS;
+        }
+
+        r = fd_cloexec(arg_deserialize, true);
+        if (r < 0) {
+                log_error_errno(r, "Failed to mark serialization fd as O_CLOEXEC: %m");
+                return EXIT_FDS;
+        }
+
+        /* We share the file offset with the manager, which left it at the end */
+        rewind(f);
+
+        exec_invocation_init(&i);
+
+        r = exec_deserialize_invocation(f, &i);
+        if (r < 0) {
+                log_error_errno(r, "Failed to deserialize invocation: %m");
+                exit_status = r == -ENOMEM ? EXIT_MEMORY : EXIT_FAILURE;
+                goto finish;
+        }
+
+        if (n_fds > 0) {
+                r = exec_invocation_remap_fds(&i, from, to, n_fds);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to map passed file descriptors: %m");
+                        exit_status = EXIT_FDS;
+                        goto finish;
+                }
+        }
+
+        f = safe_fclose(f);
+
+        if (i.log_level >= 0)
+                log_set_max_level(i.log_level);
+        if (i.log_target >= 0) {
+                log_set_target(i.log_target);
+                log_close();
+                log_open();
+        }
+
+        exit_status = exec_invoke(&i.unit,
+                                  &i.command,
+                                  &i.context,
+                                  &i.parameters,
+                                  NULL,
+                                  NULL,
+                                  i.files_env,
+                                  i.user_lookup_fd,
+                                  NULL);
+
+finish:
+        exec_invocation_done(&i);
+        return exit_status;
+}
@@ -0,0 +1,540 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "conf-files.h"
+#include "copy.h"
+#include "def.h"
+#include "dirent-util.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "generator-run.h"
+#include "log.h"
+#include "macro.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "signal-util.h"
+#include "stat-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "user-util.h"
+#include "util.h"
+
+/* Generators don't depend on each other's output, hence we run them in parallel, but only a few per CPU at a time, so
+ * that a large number of them doesn't swamp the machine early during boot. Each generator writes into a staging
+ * directory of its own, which are merged into the real generator directories in the order the generators are sorted
+ * in, once all of them are done. This way the result doesn't depend on which generator happened to finish first, and
+ * the output of a generator that was killed because it ran into the timeout is dropped as a whole instead of leaving
+ * half-written units around. */
+
+#define GENERATORS_PER_CPU 2U
+
+typedef struct Generator {
+        const char *path;
+        char *staging;
+        pid_t pid;
+        usec_t started;
+        usec_t duration;
+        int status;
+} Generator;
+
+static const char* const generator_subdirs[] = { "normal", "early", "late" };
+
+GeneratorTiming* generator_timings_free(GeneratorTiming *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].name);
+
+        return mfree(t);
+}
+
+static unsigned generators_max_parallel(void) {
+        long n;
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                n = 1;
+
+        return GENERATORS_PER_CPU * (unsigned) n;
+}
+
+static int generator_spawn(Generator *g) {
+        const char *dirs[ELEMENTSOF(generator_subdirs)];
+        size_t i;
+        pid_t pid;
+        int r;
+
+        assert(g);
+
+        if (null_or_empty_path(g->path)) {
+                log_debug("%s is empty (a mask).", g->path);
+                return 0;
+        }
+
+        for (i = 0; i < ELEMENTSOF(generator_subdirs); i++) {
+                dirs[i] = strjoina(g->staging, "/", generator_subdirs[i]);
+
+                r = mkdir_p(dirs[i], 0755);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to create staging directory %s: %m", dirs[i]);
+        }
+
+        r = safe_fork("(direxec)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, &pid);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                execv(g->path, STRV_MAKE((char*) g->path, (char*) dirs[0], (char*) dirs[1], (char*) dirs[2]));
+                log_error_errno(errno, "Failed to execute %s: %m", g->path);
+                _exit(EXIT_FAILURE);
+        }
+
+        g->pid = pid;
+        g->started = now(CLOCK_MONOTONIC);
+        return 1;
+}
+
+static void generator_finished(Generator *g, const siginfo_t *si) {
+        char ts[FORMAT_TIMESPAN_MAX];
+
+        assert(g);
+        assert(si);
+
+        g->duration = usec_sub_unsigned(now(CLOCK_MONOTONIC), g->started);
+        g->pid = 0;
+
+        if (si->si_code == CLD_EXITED) {
+                g->status = si->si_status;
+
+                if (g->status != 0)
+                        log_error("%s failed with exit status %i.", g->path, g->status);
+                else
+                        log_debug("%s finished after %s.", g->path, format_timespan(ts, sizeof(ts), g->duration, USEC_PER_MSEC));
+        } else {
+                g->status = 128 + si->si_status;
+                log_error("%s terminated by signal %s.", g->path, signal_to_string(si->si_status));
+        }
+}
+
+static int generators_wait(Generator *g, size_t n, usec_t timeout) {
+        unsigned n_running = 0, max_parallel;
+        size_t next = 0, i;
+        usec_t deadline;
+        sigset_t ss;
+
+        max_parallel = generators_max_parallel();
+        deadline = usec_add(now(CLOCK_MONOTONIC), timeout);
+
+        assert_se(sigemptyset(&ss) >= 0);
+        assert_se(sigaddset(&ss, SIGCHLD) >= 0);
+        assert_se(sigprocmask(SIG_BLOCK, &ss, NULL) >= 0);
+
+        for (;;) {
+                bool reaped = false;
+                struct timespec ts;
+                usec_t n_now;
+
+                while (next < n && n_running < max_parallel)
+                        if (generator_spawn(g + next++) > 0)
+                                n_running++;
+
+                if (n_running == 0)
+                        return 0;
+
+                for (;;) {
+                        siginfo_t si = {};
+
+                        if (waitid(P_ALL, 0, &si, WEXITED|WNOHANG) < 0) {
+                                if (errno == ECHILD)
+                                        break;
+
+                                return log_error_errno(errno, "Failed to wait for generators: %m");
+                        }
+                        if (si.si_pid == 0)
+                                break;
+
+                        for (i = 0; i < next; i++)
+                                if (g[i].pid == si.si_pid) {
+                                        generator_finished(g + i, &si);
+                                        n_running--;
+                                        reaped = true;
+                                        break;
+                                }
+                }
+
+                if (reaped)
+                        continue;
+
+                n_now = now(CLOCK_MONOTONIC);
+                if (n_now >= deadline)
+                        break;
+
+                if (sigtimedwait(&ss, NULL, timespec_store(&ts, deadline - n_now)) < 0 &&
+                    !IN_SET(errno, EAGAIN, EINTR))
+                        return log_error_errno(errno, "Failed to wait for SIGCHLD: %m");
+        }
+
+        /* Whatever is still running now doesn't get to contribute anything */
+        for (i = 0; i < next; i++) {
+                if (g[i].pid <= 0)
+                        continue;
+
+                log_error("%s timed out, killing.", g[i].path);
+
+                (void) kill(g[i].pid, SIGKILL);
+                (void) wait_for_terminate(g[i].pid, NULL);
+
+                g[i].duration = usec_sub_unsigned(now(CLOCK_MONOTONIC), g[i].started);
+                g[i].pid = 0;
+        }
+
+        for (i = next; i < n; i++)
+                log_error("%s not started, generators timed out.", g[i].path);
+
+        return 0;
+}
+
+static int generator_fixup_symlinks(int fd, const char *staging, const char *dir, const char *generator) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        /* Generators are free to create absolute symlinks pointing into the directory they were handed, but that
+         * is our staging directory, which goes away once its contents are moved into place. Hence point such
+         * symlinks to where their targets will end up instead. */
+
+        d = fdopendir(fd);
+        if (!d) {
+                safe_close(fd);
+                return log_error_errno(errno, "Failed to open staging directory of %s: %m", generator);
+        }
+
+        FOREACH_DIRENT_ALL(de, d, return log_error_errno(errno, "Failed to read staging directory of %s: %m", generator)) {
+                _cleanup_free_ char *target = NULL, *fixed = NULL;
+                const char *e;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                (void) dirent_ensure_type(d, de);
+
+                if (de->d_type == DT_DIR) {
+                        int sub;
+
+                        sub = openat(dirfd(d), de->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                        if (sub < 0)
+                                return log_error_errno(errno, "Failed to open %s in staging directory of %s: %m", de->d_name, generator);
+
+                        r = generator_fixup_symlinks(sub, staging, dir, generator);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                if (de->d_type != DT_LNK)
+                        continue;
+
+                r = readlinkat_malloc(dirfd(d), de->d_name, &target);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read symlink %s generated by %s: %m", de->d_name, generator);
+
+                if (!path_is_absolute(target))
+                        continue;
+
+                e = path_startswith(target, staging);
+                if (!e)
+                        continue;
+
+                fixed = isempty(e) ? strdup(dir) : path_join(NULL, dir, e);
+                if (!fixed)
+                        return log_oom();
+
+                log_debug("Redirecting symlink %s generated by %s from %s to %s.", de->d_name, generator, target, fixed);
+
+                if (unlinkat(dirfd(d), de->d_name, 0) < 0)
+                        return log_error_errno(errno, "Failed to remove symlink %s generated by %s: %m", de->d_name, generator);
+
+                if (symlinkat(fixed, dirfd(d), de->d_name) < 0)
+                        return log_error_errno(errno, "Failed to create symlink %s generated by %s: %m", de->d_name, generator);
+        }
+
+        return 0;
+}
+
+static int generator_merge_dir(int fd_from, int fd_to, const char *generator, const char *path) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        d = fdopendir(fd_from);
+        if (!d) {
+                safe_close(fd_from);
+                return log_error_errno(errno, "Failed to open staging directory for %s: %m", path);
+        }
+
+        FOREACH_DIRENT_ALL(de, d, return log_error_errno(errno, "Failed to read staging directory for %s: %m", path)) {
+                _cleanup_close_ int sub_from = -1, sub_to = -1;
+                _cleanup_free_ char *p = NULL;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                p = path_join(NULL, path, de->d_name);
+                if (!p)
+                        return log_oom();
+
+                /* Whole directories (e.g. .wants/ directories) are moved over in one go if nobody created them
+                 * before us, otherwise we descend into them below */
+                r = rename_noreplace(dirfd(d), de->d_name, fd_to, de->d_name);
+                if (r >= 0)
+                        continue;
+                if (r == -EXDEV) {
+                        r = copy_tree_at(dirfd(d), de->d_name, fd_to, de->d_name, UID_INVALID, GID_INVALID, COPY_MERGE);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to copy %s generated by %s, ignoring: %m", p, generator);
+                        continue;
+                }
+                if (r != -EEXIST) {
+                        log_warning_errno(r, "Failed to move %s generated by %s into place, ignoring: %m", p, generator);
+                        continue;
+                }
+
+                sub_from = openat(dirfd(d), de->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                sub_to = openat(fd_to, de->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                if (sub_from < 0 || sub_to < 0) {
+                        log_warning("%s generated by %s already exists, ignoring.", p, generator);
+                        continue;
+                }
+
+                r = generator_merge_dir(TAKE_FD(sub_from), sub_to, generator, p);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int generators_merge(Generator *g, size_t n, const char *dirs[]) {
+        size_t i, j;
+        int r;
+
+        for (i = 0; i < n; i++) {
+                if (g[i].status < 0)
+                        continue;
+
+                for (j = 0; j < ELEMENTSOF(generator_subdirs); j++) {
+                        _cleanup_close_ int fd_from = -1, fd_to = -1;
+                        const char *p;
+
+                        p = strjoina(g[i].staging, "/", generator_subdirs[j]);
+
+                        fd_from = open(p, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                        if (fd_from < 0)
+                                return log_error_errno(errno, "Failed to open %s: %m", p);
+
+                        r = generator_fixup_symlinks(TAKE_FD(fd_from), p, dirs[j], basename(g[i].path));
+                        if (r < 0)
+                                return r;
+
+                        fd_from = open(p, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                        if (fd_from < 0)
+                                return log_error_errno(errno, "Failed to open %s: %m", p);
+
+                        fd_to = open(dirs[j], O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                        if (fd_to < 0)
+                                return log_error_errno(errno, "Failed to open %s: %m", dirs[j]);
+
+                        r = generator_merge_dir(TAKE_FD(fd_from), fd_to, basename(g[i].path), dirs[j]);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+static int generators_execute(char **paths, const char *dirs[], usec_t timeout, int timings_fd) {
+        _cleanup_(rm_rf_physical_and_freep) char *staging = NULL;
+        _cleanup_strv_free_ char **files = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ Generator *g = NULL;
+        size_t n, i;
+        int r;
+
+        r = conf_files_list_strv(&files, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, (const char* const*) paths);
+        if (r < 0)
+                return log_error_errno(r, "Failed to enumerate generators: %m");
+
+        n = strv_length(files);
+        if (n == 0)
+                return 0;
+
+        /* Next to the real generator directory, so that the output can be renamed into place */
+        r = mkdtemp_malloc(strjoina(dirs[0], ".staging-XXXXXX"), &staging);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create staging directory for generators: %m");
+
+        g = new0(Generator, n);
+        if (!g)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                g[i].path = files[i];
+                g[i].status = -1;
+
+                g[i].staging = path_join(NULL, staging, basename(files[i]));
+                if (!g[i].staging) {
+                        r = log_oom();
+                        goto finish;
+                }
+        }
+
+        r = generators_wait(g, n, timeout);
+        if (r < 0)
+                goto finish;
+
+        r = generators_merge(g, n, dirs);
+        if (r < 0)
+                goto finish;
+
+        f = fdopen(timings_fd, "w");
+        if (!f) {
+                r = log_error_errno(errno, "Failed to open generator timing file: %m");
+                goto finish;
+        }
+
+        for (i = 0; i < n; i++)
+                if (g[i].started > 0)
+                        fprintf(f, USEC_FMT " %i %s\n", g[i].duration, g[i].status, basename(g[i].path));
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                log_error_errno(r, "Failed to write generator timings: %m");
+
+finish:
+        for (i = 0; i < n; i++)
+                free(g[i].staging);
+
+        return r;
+}
+
+static int generator_timings_read(int fd, GeneratorTiming **ret, size_t *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        GeneratorTiming *t = NULL;
+        size_t n = 0, n_allocated = 0;
+        int r;
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        f = fdopen(fd, "r");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *duration = NULL, *status = NULL, *name = NULL;
+                const char *p;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                p = line;
+                r = extract_many_words(&p, " ", 0, &duration, &status, NULL);
+                if (r < 0)
+                        goto fail;
+                if (r != 2 || isempty(p)) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                name = strdup(p);
+                if (!name) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                if (!GREEDY_REALLOC(t, n_allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                t[n] = (GeneratorTiming) {};
+
+                r = safe_atou64(duration, &t[n].duration);
+                if (r < 0)
+                        goto fail;
+
+                r = safe_atoi(status, &t[n].status);
+                if (r < 0)
+                        goto fail;
+
+                t[n++].name = TAKE_PTR(name);
+        }
+
+        *ret = t;
+        *ret_n = n;
+        return 0;
+
+fail:
+        generator_timings_free(t, n);
+        return r;
+}
+
+int generators_run(
+                char **paths,
+                const char *normal_dir,
+                const char *early_dir,
+                const char *late_dir,
+                usec_t timeout,
+                GeneratorTiming **ret_timings,
+                size_t *ret_n_timings) {
+
+        const char *dirs[] = { normal_dir, early_dir, late_dir };
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(normal_dir);
+        assert(early_dir);
+        assert(late_dir);
+        assert(ret_timings);
+        assert(ret_n_timings);
+
+        fd = open_serialization_fd("generator-timings");
+        if (fd < 0)
+                return log_error_errno(fd, "Failed to open generator timing file: %m");
+
+        /* As with execute_directories(), we do all of this from a child process, so that we can wait for the
+         * generators and reap them without interfering with the SIGCHLD handling of the caller */
+        r = safe_fork("(sd-generators)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG|FORK_WAIT, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                r = generators_execute(paths, dirs, timeout, TAKE_FD(fd));
+                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        r = generator_timings_read(TAKE_FD(fd), ret_timings, ret_n_timings);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to read generator timings: %m");
+
+        return 0;
+}
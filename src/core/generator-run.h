@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+
+#include "time-util.h"
+
+typedef struct GeneratorTiming {
+        char *name;
+        usec_t duration;
+        int status; /* exit status, 128 + signal number if killed, -1 if it never finished */
+} GeneratorTiming;
+
+GeneratorTiming* generator_timings_free(GeneratorTiming *t, size_t n);
+
+int generators_run(
+                char **paths,
+                const char *normal_dir,
+                const char *early_dir,
+                const char *late_dir,
+                usec_t timeout,
+                GeneratorTiming **ret_timings,
+                size_t *ret_n_timings);
@@ -7,6 +7,7 @@
 
 #include "alloc-util.h"
 #include "async.h"
+#include "boot-trace.h"
 #include "dbus-job.h"
 #include "dbus.h"
 #include "escape.h"
@@ -14,6 +15,7 @@
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
+#include "serialize.h"
 #include "set.h"
 #include "special.h"
 #include "stdio-util.h"
@@ -230,6 +232,7 @@ Job* job_install(Job *j) {
         log_unit_debug(j->unit,
                        "Installed new job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
+        manager_boot_trace(j->manager, BOOT_TRACE_JOB_INSTALLED, j->unit->id, "%s", job_type_to_string(j->type));
 
         job_add_to_gc_queue(j);
 
@@ -576,6 +579,7 @@ int job_run_and_invalidate(Job *j) {
         job_start_timer(j, true);
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
+        manager_boot_trace(j->manager, BOOT_TRACE_JOB_STARTED, j->unit->id, "%s", job_type_to_string(j->type));
 
         switch (j->type) {
 
@@ -886,6 +890,7 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
         j->result = result;
 
         log_unit_debug(u, "Job %s/%s finished, result=%s", u->id, job_type_to_string(t), job_result_to_string(result));
+        manager_boot_trace(u->manager, BOOT_TRACE_JOB_FINISHED, u->id, "%s %s", job_type_to_string(t), job_result_to_string(result));
 
         /* If this job did nothing to respective unit we don't log the status message */
         if (!already)
@@ -1068,48 +1073,47 @@ char *job_dbus_path(Job *j) {
 }
 
 int job_serialize(Job *j, FILE *f) {
+        SerializationFormat format;
+
         assert(j);
         assert(f);
 
-        fprintf(f, "job-id=%u\n", j->id);
-        fprintf(f, "job-type=%s\n", job_type_to_string(j->type));
-        fprintf(f, "job-state=%s\n", job_state_to_string(j->state));
-        fprintf(f, "job-irreversible=%s\n", yes_no(j->irreversible));
-        fprintf(f, "job-sent-dbus-new-signal=%s\n", yes_no(j->sent_dbus_new_signal));
-        fprintf(f, "job-ignore-order=%s\n", yes_no(j->ignore_order));
+        format = j->manager->serialization_format;
+
+        serialize_item_format(f, format, "job-id", "%u", j->id);
+        serialize_item(f, format, "job-type", job_type_to_string(j->type));
+        serialize_item(f, format, "job-state", job_state_to_string(j->state));
+        serialize_item(f, format, "job-irreversible", yes_no(j->irreversible));
+        serialize_item(f, format, "job-sent-dbus-new-signal", yes_no(j->sent_dbus_new_signal));
+        serialize_item(f, format, "job-ignore-order", yes_no(j->ignore_order));
 
         if (j->begin_usec > 0)
-                fprintf(f, "job-begin="USEC_FMT"\n", j->begin_usec);
+                serialize_item_format(f, format, "job-begin", USEC_FMT, j->begin_usec);
         if (j->begin_running_usec > 0)
-                fprintf(f, "job-begin-running="USEC_FMT"\n", j->begin_running_usec);
+                serialize_item_format(f, format, "job-begin-running", USEC_FMT, j->begin_running_usec);
 
-        bus_track_serialize(j->bus_track, f, "subscribed");
+        bus_track_serialize(j->bus_track, f, format, "subscribed");
 
         /* End marker */
-        fputc('\n', f);
+        serialize_end(f, format);
         return 0;
 }
 
 int job_deserialize(Job *j, FILE *f) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer buf = {};
+
         assert(j);
         assert(f);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
+                char *l, *v;
                 size_t k;
+                int r;
 
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                /* End marker */
-                if (l[0] == 0)
-                        return 0;
+                /* Returns 0 at the end marker */
+                r = deserialize_line(f, j->manager->serialization_format, &buf, &l);
+                if (r <= 0)
+                        return r;
 
                 k = strcspn(l, "=");
 
@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/stat.h>
+
 #include "conf-parser.h"
+#include "fd-util.h"
 #include "fs-util.h"
 #include "load-dropin.h"
 #include "load-fragment.h"
@@ -8,6 +11,7 @@
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "unit.h"
 
@@ -130,13 +134,55 @@ int unit_load_dropin(Unit *u) {
                         return log_oom();
         }
 
-        STRV_FOREACH(f, u->dropin_paths)
-                (void) config_parse(u->id, *f, NULL,
-                                    UNIT_VTABLE(u)->sections,
-                                    config_item_perf_lookup, load_fragment_gperf_lookup,
-                                    0, u);
+        STRV_FOREACH(f, u->dropin_paths) {
+                const ConfigPreparsed *preparsed = NULL;
+                struct stat st;
+
+                if (stat(*f, &st) >= 0)
+                        preparsed = manager_get_preparsed_config(u->manager, *f, NULL, &st);
+                if (preparsed)
+                        (void) config_parse_preparsed(u->id, preparsed,
+                                                      UNIT_VTABLE(u)->sections,
+                                                      config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                      0, u);
+                else
+                        (void) config_parse(u->id, *f, NULL,
+                                            UNIT_VTABLE(u)->sections,
+                                            config_item_perf_lookup, load_fragment_gperf_lookup,
+                                            0, u);
+        }
 
         u->dropin_mtime = now(CLOCK_REALTIME);
 
         return 0;
 }
+
+int unit_preparse_dropin(Unit *u, Hashmap **preparsed) {
+        _cleanup_strv_free_ char **l = NULL;
+        char **f;
+        int r;
+
+        assert(u);
+        assert(preparsed);
+
+        /* Reads the .conf drop-ins of the unit in advance. Like unit_preparse_fragment() this is called on
+         * worker threads. */
+
+        r = unit_find_dropin_paths(u, &l);
+        if (r <= 0)
+                return r;
+
+        STRV_FOREACH(f, l) {
+                _cleanup_fclose_ FILE *file = NULL;
+
+                file = fopen(*f, "re");
+                if (!file)
+                        continue;
+
+                r = unit_preparse_file(u->manager, preparsed, *f, file);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
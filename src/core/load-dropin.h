@@ -17,3 +17,4 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
 }
 
 int unit_load_dropin(Unit *u);
+int unit_preparse_dropin(Unit *u, Hashmap **preparsed);
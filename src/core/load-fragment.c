@@ -52,6 +52,7 @@
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "unit-printf.h"
 #include "user-util.h"
@@ -1628,7 +1629,7 @@ int config_parse_path_spec(const char *unit,
         s->unit = UNIT(p);
         s->path = TAKE_PTR(k);
         s->type = b;
-        s->inotify_fd = -1;
+        s->primary_wd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
@@ -4311,21 +4312,16 @@ static int merge_by_names(Unit **u, Set *names, const char *id) {
         return 0;
 }
 
-static int load_from_path(Unit *u, const char *path) {
-        _cleanup_set_free_free_ Set *symlink_names = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+static int find_fragment(Unit *u, const char *path, Set *symlink_names, char **ret_filename, FILE **ret_f, char **ret_id) {
         _cleanup_free_ char *filename = NULL;
-        char *id = NULL;
-        Unit *merged;
-        struct stat st;
         int r;
 
         assert(u);
         assert(path);
+        assert(symlink_names);
 
-        symlink_names = set_new(&string_hash_ops);
-        if (!symlink_names)
-                return -ENOMEM;
+        /* Looks for the fragment file at the path, or, if the path is just a unit name, in the search path. Only
+         * reads from the unit and the manager, hence may be called from worker threads when preparsing. */
 
         if (path_is_absolute(path)) {
 
@@ -4333,7 +4329,7 @@ static int load_from_path(Unit *u, const char *path) {
                 if (!filename)
                         return -ENOMEM;
 
-                r = open_follow(&filename, &f, symlink_names, &id);
+                r = open_follow(&filename, ret_f, symlink_names, ret_id);
                 if (r < 0) {
                         filename = mfree(filename);
                         if (r != -ENOENT)
@@ -4356,7 +4352,7 @@ static int load_from_path(Unit *u, const char *path) {
                             !set_get(u->manager->unit_path_cache, filename))
                                 r = -ENOENT;
                         else
-                                r = open_follow(&filename, &f, symlink_names, &id);
+                                r = open_follow(&filename, ret_f, symlink_names, ret_id);
                         if (r >= 0)
                                 break;
                         filename = mfree(filename);
@@ -4376,6 +4372,31 @@ static int load_from_path(Unit *u, const char *path) {
                 }
         }
 
+        *ret_filename = TAKE_PTR(filename);
+        return 0;
+}
+
+static int load_from_path(Unit *u, const char *path) {
+        _cleanup_set_free_free_ Set *symlink_names = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *filename = NULL;
+        const ConfigPreparsed *preparsed;
+        char *id = NULL;
+        Unit *merged;
+        struct stat st;
+        int r;
+
+        assert(u);
+        assert(path);
+
+        symlink_names = set_new(&string_hash_ops);
+        if (!symlink_names)
+                return -ENOMEM;
+
+        r = find_fragment(u, path, symlink_names, &filename, &f, &id);
+        if (r < 0)
+                return r;
+
         if (!filename)
                 /* Hmm, no suitable file found? */
                 return 0;
@@ -4405,11 +4426,18 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_LOADED;
                 u->fragment_mtime = timespec_load(&st.st_mtim);
 
-                /* Now, parse the file contents */
-                r = config_parse(u->id, filename, f,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 CONFIG_PARSE_ALLOW_INCLUDE, u);
+                /* Now, parse the file contents, unless that was already done in advance */
+                preparsed = manager_get_preparsed_config(u->manager, filename, f, &st);
+                if (preparsed)
+                        r = config_parse_preparsed(u->id, preparsed,
+                                                   UNIT_VTABLE(u)->sections,
+                                                   config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                   CONFIG_PARSE_ALLOW_INCLUDE, u);
+                else
+                        r = config_parse(u->id, filename, f,
+                                         UNIT_VTABLE(u)->sections,
+                                         config_item_perf_lookup, load_fragment_gperf_lookup,
+                                         CONFIG_PARSE_ALLOW_INCLUDE, u);
                 if (r < 0)
                         return r;
         }
@@ -4516,6 +4544,129 @@ int unit_load_fragment(Unit *u) {
         return 0;
 }
 
+int unit_preparse_file(Manager *m, Hashmap **preparsed, const char *filename, FILE *f) {
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *p = NULL;
+        ConfigPreparsed *known;
+        struct stat st;
+        int r;
+
+        assert(m);
+        assert(preparsed);
+        assert(filename);
+        assert(f);
+
+        if (hashmap_contains(*preparsed, filename))
+                return 0;
+
+        /* Nothing to do if we have an up-to-date version already, e.g. from the unit file cache */
+        known = hashmap_get(m->preparsed_configs, filename);
+        if (known && fstat(fileno(f), &st) >= 0 && config_preparsed_matches(known, &st))
+                return 0;
+
+        r = config_preparse(filename, f, 0, &p);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(preparsed, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(*preparsed, p->filename, p);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(p);
+        return 0;
+}
+
+static int preparse_from_path(Unit *u, const char *path, Hashmap **preparsed) {
+        _cleanup_set_free_free_ Set *symlink_names = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *filename = NULL;
+        char *id = NULL;
+        int r;
+
+        symlink_names = set_new(&string_hash_ops);
+        if (!symlink_names)
+                return -ENOMEM;
+
+        r = find_fragment(u, path, symlink_names, &filename, &f, &id);
+        if (r < 0)
+                return r;
+        if (!filename)
+                return 0;
+
+        r = unit_preparse_file(u->manager, preparsed, filename, f);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int preparse_from_template(Unit *u, const char *name, Hashmap **preparsed) {
+        _cleanup_free_ char *k = NULL;
+        int r;
+
+        r = unit_name_template(name, &k);
+        if (r < 0)
+                return r;
+
+        return preparse_from_path(u, k, preparsed);
+}
+
+int unit_preparse_fragment(Unit *u, Hashmap **preparsed) {
+        Iterator i;
+        const char *t;
+        int r;
+
+        assert(u);
+        assert(preparsed);
+
+        /* Reads the fragment unit_load_fragment() is going to load in advance, trying the same names in the
+         * same order. This is called on worker threads, hence it must not modify the unit or the manager in
+         * any way. */
+
+        if (u->transient || u->load_state != UNIT_STUB)
+                return 0;
+
+        r = preparse_from_path(u, u->id, preparsed);
+        if (r != 0)
+                return r;
+
+        SET_FOREACH(t, u->names, i) {
+                if (t == u->id)
+                        continue;
+
+                r = preparse_from_path(u, t, preparsed);
+                if (r != 0)
+                        return r;
+        }
+
+        if (u->fragment_path) {
+                r = preparse_from_path(u, u->fragment_path, preparsed);
+                if (r != 0)
+                        return r;
+        }
+
+        if (!u->instance)
+                return 0;
+
+        r = preparse_from_template(u, u->id, preparsed);
+        if (r != 0)
+                return r;
+
+        SET_FOREACH(t, u->names, i) {
+                if (t == u->id)
+                        continue;
+
+                r = preparse_from_template(u, t, preparsed);
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 void unit_dump_config_items(FILE *f) {
         static const struct {
                 const ConfigParserCallback callback;
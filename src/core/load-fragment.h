@@ -7,6 +7,8 @@
 /* Read service data from .desktop file style configuration fragments */
 
 int unit_load_fragment(Unit *u);
+int unit_preparse_fragment(Unit *u, Hashmap **preparsed);
+int unit_preparse_file(Manager *m, Hashmap **preparsed, const char *filename, FILE *f);
 
 void unit_dump_config_items(FILE *f);
 
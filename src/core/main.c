@@ -75,6 +75,7 @@
 #include "switch-root.h"
 #include "terminal-util.h"
 #include "umask-util.h"
+#include "unit-file-cache.h"
 #include "user-util.h"
 #include "util.h"
 #include "virt.h"
@@ -127,6 +128,7 @@ static bool arg_default_tasks_accounting = true;
 static uint64_t arg_default_tasks_max = UINT64_MAX;
 static sd_id128_t arg_machine_id = {};
 static EmergencyAction arg_cad_burst_action = EMERGENCY_ACTION_REBOOT_FORCE;
+static bool arg_incremental_reload = false;
 
 _noreturn_ static void freeze_or_reboot(void) {
 
@@ -698,6 +700,7 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultTasksAccounting",    config_parse_bool,             0, &arg_default_tasks_accounting          },
                 { "Manager", "DefaultTasksMax",           config_parse_tasks_max,        0, &arg_default_tasks_max                 },
                 { "Manager", "CtrlAltDelBurstAction",     config_parse_emergency_action, 0, &arg_cad_burst_action                  },
+                { "Manager", "IncrementalReload",         config_parse_bool,             0, &arg_incremental_reload                },
                 {}
         };
 
@@ -751,6 +754,44 @@ static void set_manager_defaults(Manager *m) {
         manager_environment_add(m, NULL, arg_default_environment);
 }
 
+static bool manager_defaults_changed(Manager *m) {
+        int i;
+
+        assert(m);
+
+        /* Checks whether set_manager_defaults() would change anything. Units loaded before keep the defaults they
+         * were set up with, hence they all need to be loaded again in that case. */
+
+        if (m->default_timer_accuracy_usec != arg_default_timer_accuracy_usec ||
+            m->default_std_output != arg_default_std_output ||
+            m->default_std_error != arg_default_std_error ||
+            m->default_timeout_start_usec != arg_default_timeout_start_usec ||
+            m->default_timeout_stop_usec != arg_default_timeout_stop_usec ||
+            m->default_restart_usec != arg_default_restart_usec ||
+            m->default_start_limit_interval != arg_default_start_limit_interval ||
+            m->default_start_limit_burst != arg_default_start_limit_burst ||
+            m->default_cpu_accounting != arg_default_cpu_accounting ||
+            m->default_io_accounting != arg_default_io_accounting ||
+            m->default_ip_accounting != arg_default_ip_accounting ||
+            m->default_blockio_accounting != arg_default_blockio_accounting ||
+            m->default_memory_accounting != arg_default_memory_accounting ||
+            m->default_tasks_accounting != arg_default_tasks_accounting ||
+            m->default_tasks_max != arg_default_tasks_max)
+                return true;
+
+        for (i = 0; i < _RLIMIT_MAX; i++) {
+                if (!m->rlimit[i] != !arg_default_rlimit[i])
+                        return true;
+
+                if (m->rlimit[i] &&
+                    (m->rlimit[i]->rlim_cur != arg_default_rlimit[i]->rlim_cur ||
+                     m->rlimit[i]->rlim_max != arg_default_rlimit[i]->rlim_max))
+                        return true;
+        }
+
+        return false;
+}
+
 static void set_manager_settings(Manager *m) {
 
         assert(m);
@@ -1646,6 +1687,7 @@ static int invoke_main_loop(
                 case MANAGER_RELOAD: {
                         LogTarget saved_log_target;
                         int saved_log_level;
+                        bool incremental;
 
                         log_info("Reloading.");
 
@@ -1659,6 +1701,8 @@ static int invoke_main_loop(
                         if (r < 0)
                                 log_warning_errno(r, "Failed to parse config file, ignoring: %m");
 
+                        incremental = arg_incremental_reload && !manager_defaults_changed(m);
+
                         set_manager_defaults(m);
 
                         if (saved_log_level >= 0)
@@ -1666,7 +1710,10 @@ static int invoke_main_loop(
                         if (saved_log_target >= 0)
                                 manager_override_log_target(m, saved_log_target);
 
-                        r = manager_reload(m);
+                        if (incremental)
+                                r = manager_reload_incremental(m);
+                        else
+                                r = manager_reload(m);
                         if (r < 0)
                                 log_warning_errno(r, "Failed to reload, ignoring: %m");
 
@@ -2190,6 +2237,9 @@ int main(int argc, char *argv[]) {
         /* Make sure that if the user says "syslog" we actually log to the journal. */
         log_set_upgrade_syslog_to_journal(true);
 
+        /* Don't stall everything when journald is slow to pick up our messages, queue them instead */
+        log_set_queue_journal(true);
+
         if (getpid_cached() == 1) {
                 /* When we run as PID 1 force system mode */
                 arg_system = true;
@@ -2410,6 +2460,9 @@ int main(int argc, char *argv[]) {
                         goto finish;
         }
 
+        /* Everything needed for the initial transaction is loaded now, store what we read for the next time */
+        manager_unit_file_cache_end(m);
+
         after_startup = now(CLOCK_MONOTONIC);
 
         log_full(arg_action == ACTION_TEST ? LOG_INFO : LOG_DEBUG,
@@ -2442,6 +2495,9 @@ finish:
         free_arguments();
         mac_selinux_finish();
 
+        /* Hand whatever is still queued to journald, before we execute anything else */
+        log_set_queue_journal(false);
+
         if (reexecute)
                 do_reexecute(argc, argv,
                              &saved_rlimit_nofile,
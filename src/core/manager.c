@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio_ext.h>
 #include <string.h>
@@ -26,6 +27,7 @@
 #include "all-units.h"
 #include "audit-fd.h"
 #include "boot-timestamps.h"
+#include "boot-trace.h"
 #include "bus-common-errors.h"
 #include "bus-error.h"
 #include "bus-kernel.h"
@@ -39,15 +41,20 @@
 #include "dirent-util.h"
 #include "env-util.h"
 #include "escape.h"
+#include "event-util.h"
 #include "exec-util.h"
 #include "execute.h"
+#include "executor-pool.h"
 #include "exit-status.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "generator-run.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
+#include "load-dropin.h"
+#include "load-fragment.h"
 #include "locale-setup.h"
 #include "log.h"
 #include "macro.h"
@@ -61,7 +68,9 @@
 #include "ratelimit.h"
 #include "rlimit-util.h"
 #include "rm-rf.h"
+#include "serialize.h"
 #include "signal-util.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
@@ -74,6 +83,7 @@
 #include "time-util.h"
 #include "transaction.h"
 #include "umask-util.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "user-util.h"
 #include "util.h"
@@ -83,6 +93,11 @@
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
+/* How often the notification socket may be dispatched per interval, so that a flood of messages can't starve
+ * everything of lower priority. Each dispatch picks up NOTIFY_BATCH_MAX messages at most. */
+#define NOTIFY_RATELIMIT_INTERVAL_USEC USEC_PER_SEC
+#define NOTIFY_RATELIMIT_BURST 2500U
+
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
@@ -95,6 +110,12 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* How often to retry sending log messages that are queued because journald didn't keep up */
+#define LOG_QUEUE_RETRY_USEC (100*USEC_PER_MSEC)
+
+/* How long transient units have to be around until we write their unit files */
+#define TRANSIENT_WRITE_DELAY_USEC (5*USEC_PER_SEC)
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -711,6 +732,25 @@ static int manager_setup_sigchld_event_source(Manager *m) {
         return 0;
 }
 
+void manager_setup_log_fields(Manager *m) {
+        assert(m);
+
+        /* Prepare log fields we can use for structured logging */
+        if (MANAGER_IS_SYSTEM(m)) {
+                m->unit_log_field = "UNIT=";
+                m->unit_log_format_string = "UNIT=%s";
+
+                m->invocation_log_field = "INVOCATION_ID=";
+                m->invocation_log_format_string = "INVOCATION_ID=%s";
+        } else {
+                m->unit_log_field = "USER_UNIT=";
+                m->unit_log_format_string = "USER_UNIT=%s";
+
+                m->invocation_log_field = "USER_INVOCATION_ID=";
+                m->invocation_log_format_string = "USER_INVOCATION_ID=%s";
+        }
+}
+
 int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         _cleanup_(manager_freep) Manager *m = NULL;
         int r;
@@ -741,28 +781,17 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
                                 m->timestamps + MANAGER_TIMESTAMP_LOADER);
 #endif
 
-        /* Prepare log fields we can use for structured logging */
-        if (MANAGER_IS_SYSTEM(m)) {
-                m->unit_log_field = "UNIT=";
-                m->unit_log_format_string = "UNIT=%s";
-
-                m->invocation_log_field = "INVOCATION_ID=";
-                m->invocation_log_format_string = "INVOCATION_ID=%s";
-        } else {
-                m->unit_log_field = "USER_UNIT=";
-                m->unit_log_format_string = "USER_UNIT=%s";
-
-                m->invocation_log_field = "USER_INVOCATION_ID=";
-                m->invocation_log_format_string = "USER_INVOCATION_ID=%s";
-        }
+        manager_setup_log_fields(m);
 
         m->idle_pipe[0] = m->idle_pipe[1] = m->idle_pipe[2] = m->idle_pipe[3] = -1;
 
         m->pin_cgroupfs_fd = m->notify_fd = m->cgroups_agent_fd = m->signal_fd = m->time_change_fd =
                 m->dev_autofs_fd = m->private_listen_fd = m->cgroup_inotify_fd =
-                m->ask_password_inotify_fd = -1;
+                m->ask_password_inotify_fd = m->path_inotify_fd = -1;
 
         m->user_lookup_fds[0] = m->user_lookup_fds[1] = -1;
+        m->executor_fd = -1;
+        m->order_valid = true;
 
         m->current_job_id = 1; /* start as id #1, so that we can leave #0 around as "null-like" value */
 
@@ -802,6 +831,12 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         if (r < 0)
                 return r;
 
+        /* There's a job and a unit timeout for every unit that is being started or stopped, which are
+         * rescheduled all the time, keep them in a timer wheel */
+        r = sd_event_set_timer_wheel(m->event, true);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable timer wheel, ignoring: %m");
+
         r = manager_setup_run_queue(m);
         if (r < 0)
                 return r;
@@ -842,6 +877,13 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
                         return r;
         }
 
+        if (test_run_flags == 0) {
+                /* Pin the executor matching our own version, in case it is replaced on disk before we reexecute */
+                m->executor_fd = open(SYSTEMD_EXECUTOR_PATH, O_PATH|O_CLOEXEC);
+                if (m->executor_fd < 0)
+                        log_debug_errno(errno, "Failed to open %s, forking processes directly: %m", SYSTEMD_EXECUTOR_PATH);
+        }
+
         m->taint_usr =
                 !in_initrd() &&
                 dir_is_empty("/usr") > 0;
@@ -909,6 +951,10 @@ static int manager_setup_notify(Manager *m) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to set priority of notify event source: %m");
 
+                r = sd_event_source_set_ratelimit(m->notify_event_source, NOTIFY_RATELIMIT_INTERVAL_USEC, NOTIFY_RATELIMIT_BURST);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to set rate limit of notify event source: %m");
+
                 (void) sd_event_source_set_description(m->notify_event_source, "manager-notify");
         }
 
@@ -1147,9 +1193,74 @@ good:
         unit_gc_mark_good(u, gc_marker);
 }
 
-static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
+static int unit_gc_check_local(Unit *u, unsigned gc_marker) {
+        const UnitRef *ref;
+        bool unsure = false;
+        Unit *other;
+        Iterator i;
+        void *v;
+
+        assert(u);
+
+        /* Tries to decide whether a unit may be collected by looking only at the unit itself and the units
+         * referencing it directly. The number of inbound references is known without any walking, and in the common
+         * case of a unit nobody references anymore (think transient scopes), or one that is referenced by some unit
+         * that clearly stays, this is all that's needed. Returns > 0 if the unit may be collected, 0 if it has to
+         * stay, and -EAGAIN if that can't be decided locally, i.e. if all units referencing it may be collected
+         * themselves, and only the full sweep can tell whether they form a chain to a unit that stays or a loop. */
+
+        if (IN_SET(u->gc_marker - gc_marker,
+                   GC_OFFSET_GOOD, GC_OFFSET_BAD, GC_OFFSET_UNSURE, GC_OFFSET_IN_PATH))
+                return -EAGAIN; /* Already looked at during this run, let unit_gc_sweep() handle this */
+
+        if (u->in_cleanup_queue)
+                return 1;
+
+        if (!unit_may_gc(u))
+                return 0;
+
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
+
+                if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
+                        return 0;
+
+                if (other->gc_marker == gc_marker + GC_OFFSET_BAD || other->in_cleanup_queue)
+                        continue;
+
+                if (IN_SET(other->gc_marker - gc_marker, GC_OFFSET_UNSURE, GC_OFFSET_IN_PATH) || unit_may_gc(other)) {
+                        unsure = true;
+                        continue;
+                }
+
+                unit_gc_mark_good(other, gc_marker);
+                return 0;
+        }
+
+        LIST_FOREACH(refs_by_target, ref, u->refs_by_target) {
+                other = ref->source;
+
+                if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
+                        return 0;
+
+                if (other->gc_marker == gc_marker + GC_OFFSET_BAD || other->in_cleanup_queue)
+                        continue;
+
+                if (IN_SET(other->gc_marker - gc_marker, GC_OFFSET_UNSURE, GC_OFFSET_IN_PATH) || unit_may_gc(other)) {
+                        unsure = true;
+                        continue;
+                }
+
+                unit_gc_mark_good(other, gc_marker);
+                return 0;
+        }
+
+        return unsure ? -EAGAIN : 1;
+}
+
+unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
         Unit *u;
+        int r;
 
         assert(m);
 
@@ -1164,7 +1275,16 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         while ((u = m->gc_unit_queue)) {
                 assert(u->in_gc_queue);
 
-                unit_gc_sweep(u, gc_marker);
+                /* Decide locally where possible, and only fall back to the mark sweep where the references need
+                 * to be followed further, so that the cost of a run is proportional to the units queued, not to
+                 * the size of the dependency graph they are part of. */
+                r = unit_gc_check_local(u, gc_marker);
+                if (r > 0)
+                        u->gc_marker = gc_marker + GC_OFFSET_BAD;
+                else if (r == 0)
+                        unit_gc_mark_good(u, gc_marker);
+                else
+                        unit_gc_sweep(u, gc_marker);
 
                 LIST_REMOVE(gc_queue, m->gc_unit_queue, u);
                 u->in_gc_queue = false;
@@ -1319,12 +1439,19 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
         sd_event_source_unref(m->sync_bus_names_event_source);
+        sd_event_source_unref(m->transient_write_event_source);
 
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
         safe_close(m->cgroups_agent_fd);
         safe_close(m->time_change_fd);
         safe_close_pair(m->user_lookup_fds);
+        executor_pool_free(m->executor_pool);
+        safe_close(m->executor_fd);
+        generator_timings_free(m->generator_timings, m->n_generator_timings);
+        boot_trace_free(m->boot_trace, m->n_boot_trace);
+        free(m->notify_buffers);
+        hashmap_free(m->notify_pid_cache);
 
         manager_close_ask_password(m);
 
@@ -1339,6 +1466,7 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        manager_unit_file_cache_free(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1348,6 +1476,14 @@ Manager* manager_free(Manager *m) {
         assert(hashmap_isempty(m->units_requiring_mounts_for));
         hashmap_free(m->units_requiring_mounts_for);
 
+        assert(hashmap_isempty(m->bpf_firewall_programs));
+        hashmap_free(m->bpf_firewall_programs);
+
+        assert(hashmap_isempty(m->bpf_access_maps));
+        hashmap_free(m->bpf_access_maps);
+
+        exec_seccomp_cache_free(m->seccomp_programs);
+
         hashmap_free(m->uid_refs);
         hashmap_free(m->gid_refs);
 
@@ -1436,6 +1572,79 @@ static void manager_catchup(Manager *m) {
         }
 }
 
+static int unit_path_cache_add(Manager *m, const char *dir, const char *name) {
+        char *p;
+
+        p = strjoin(streq(dir, "/") ? "" : dir, "/", name);
+        if (!p)
+                return -ENOMEM;
+
+        return set_consume(m->unit_path_cache, p);
+}
+
+static bool unit_path_is_dependency_dir(const char *name) {
+        return endswith(name, ".wants") || endswith(name, ".requires") || endswith(name, ".d");
+}
+
+static int unit_path_cache_add_dir(Manager *m, const char *path, bool top) {
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_strv_free_ char **entries = NULL;
+        struct dirent *de;
+        struct stat st;
+        char **cached, **e;
+        int r;
+
+        if (stat(path, &st) < 0) {
+                if (errno != ENOENT)
+                        log_warning_errno(errno, "Failed to stat directory %s, ignoring: %m", path);
+                return 0;
+        }
+
+        if (!top && !S_ISDIR(st.st_mode))
+                return 0;
+
+        cached = manager_unit_file_cache_get_dir(m, path, &st);
+        if (!cached) {
+                d = opendir(path);
+                if (!d) {
+                        if (errno != ENOENT)
+                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", path);
+                        return 0;
+                }
+
+                FOREACH_DIRENT(de, d, return -errno) {
+                        r = strv_extend(&entries, de->d_name);
+                        if (r < 0)
+                                return r;
+                }
+
+                manager_unit_file_cache_put_dir(m, path, &st, entries);
+                cached = entries;
+        }
+
+        STRV_FOREACH(e, cached) {
+                r = unit_path_cache_add(m, path, *e);
+                if (r < 0)
+                        return r;
+
+                /* Also list the .wants/, .requires/ and .d/ directories, so that changes to their contents show up
+                 * when comparing the cache across an incremental reload */
+                if (top && unit_path_is_dependency_dir(*e)) {
+                        _cleanup_free_ char *p = NULL;
+
+                        p = strjoin(streq(path, "/") ? "" : path, "/", *e);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = unit_path_cache_add_dir(m, p, false);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
         char **i;
         int r;
@@ -1451,32 +1660,14 @@ static void manager_build_unit_path_cache(Manager *m) {
         }
 
         /* This simply builds a list of files we know exist, so that
-         * we don't always have to go to disk */
+         * we don't always have to go to disk. Directories that didn't
+         * change since they were put into the unit file cache aren't
+         * read again. */
 
         STRV_FOREACH(i, m->lookup_paths.search_path) {
-                _cleanup_closedir_ DIR *d = NULL;
-                struct dirent *de;
-
-                d = opendir(*i);
-                if (!d) {
-                        if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
-                        continue;
-                }
-
-                FOREACH_DIRENT(de, d, r = -errno; goto fail) {
-                        char *p;
-
-                        p = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
-                        r = set_consume(m->unit_path_cache, p);
-                        if (r < 0)
-                                goto fail;
-                }
+                r = unit_path_cache_add_dir(m, *i, true);
+                if (r < 0)
+                        goto fail;
         }
 
         return;
@@ -1598,6 +1789,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         manager_preset_all(m);
         lookup_paths_reduce(&m->lookup_paths);
+
+        /* Ended by our caller, once the initial transaction has been set up */
+        manager_unit_file_cache_begin(m);
         manager_build_unit_path_cache(m);
 
         /* If we will deserialize make sure that during enumeration
@@ -1680,6 +1874,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_error *e, Job **_ret) {
         int r;
         Transaction *tr;
+        Job *j;
 
         assert(m);
         assert(type < _JOB_TYPE_MAX);
@@ -1696,6 +1891,20 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
 
         type = job_type_collapse(type, unit);
 
+        r = transaction_add_trivial_job(m, type, unit, mode, &j);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                log_unit_debug(unit,
+                               "Enqueued job %s/%s as %u without transaction", unit->id,
+                               job_type_to_string(type), (unsigned) j->id);
+
+                if (_ret)
+                        *_ret = j;
+
+                return 0;
+        }
+
         tr = transaction_new(mode == JOB_REPLACE_IRREVERSIBLY);
         if (!tr)
                 return -ENOMEM;
@@ -1848,6 +2057,128 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
         return r;
 }
 
+/* Preparse unit files on worker threads only if there's enough for each thread to do */
+#define PREPARSE_UNITS_PER_THREAD 16U
+#define PREPARSE_THREADS_MAX 16U
+
+typedef struct PreparseWorker {
+        Unit **units;
+        size_t n_units;
+        size_t *next;
+
+        Hashmap *preparsed;
+        pthread_t thread;
+        bool started;
+} PreparseWorker;
+
+static void *preparse_thread(void *p) {
+        PreparseWorker *w = p;
+
+        for (;;) {
+                size_t i;
+
+                i = __sync_fetch_and_add(w->next, 1);
+                if (i >= w->n_units)
+                        break;
+
+                /* Errors don't matter here, the unit will be loaded the usual way then, and the error
+                 * reported at that time */
+                if (unit_preparse_fragment(w->units[i], &w->preparsed) >= 0)
+                        (void) unit_preparse_dropin(w->units[i], &w->preparsed);
+        }
+
+        return NULL;
+}
+
+static void manager_preparse_load_queue(Manager *m) {
+        PreparseWorker workers[PREPARSE_THREADS_MAX] = {};
+        _cleanup_free_ Unit **units = NULL;
+        size_t n_units = 0, next = 0;
+        unsigned n_threads, k;
+        sigset_t ss, saved_ss;
+        long n_cpus;
+        Unit *u;
+
+        assert(m);
+
+        /* Reading unit files and drop-ins means a lot of blocking file I/O. Do it for all units currently
+         * queued that haven't been looked at yet on a couple of threads, and keep the files around, split
+         * into lines, in m->preparsed_configs. Parsing them into the units happens later, serially, on this
+         * thread, as that modifies the units and the manager. While the workers run we just wait for them,
+         * hence they may read from the units and the manager without further locking. */
+
+        LIST_FOREACH(load_queue, u, m->load_queue)
+                if (!u->load_preparsed)
+                        n_units++;
+
+        if (n_units < 2 * PREPARSE_UNITS_PER_THREAD)
+                return;
+
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = MIN3((unsigned) (n_units / PREPARSE_UNITS_PER_THREAD),
+                         n_cpus > 0 ? (unsigned) n_cpus : 1U,
+                         PREPARSE_THREADS_MAX);
+
+        units = n_threads >= 2 ? new(Unit*, n_units) : NULL;
+
+        /* Mark the units even if we don't preparse anything, so that we don't have to look at them again */
+        n_units = 0;
+        LIST_FOREACH(load_queue, u, m->load_queue)
+                if (!u->load_preparsed) {
+                        if (units)
+                                units[n_units++] = u;
+                        u->load_preparsed = true;
+                }
+
+        if (!units)
+                return;
+
+        /* Start the threads with all signals blocked, so that they don't affect signal handling */
+        assert_se(sigfillset(&ss) >= 0);
+        if (pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) != 0)
+                return;
+
+        for (k = 0; k < n_threads; k++) {
+                workers[k] = (PreparseWorker) {
+                        .units = units,
+                        .n_units = n_units,
+                        .next = &next,
+                };
+
+                if (pthread_create(&workers[k].thread, NULL, preparse_thread, workers + k) != 0)
+                        break;
+
+                workers[k].started = true;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        for (k = 0; k < n_threads; k++) {
+                ConfigPreparsed *p;
+
+                if (!workers[k].started)
+                        break;
+
+                assert_se(pthread_join(workers[k].thread, NULL) == 0);
+
+                if (hashmap_ensure_allocated(&m->preparsed_configs, &path_hash_ops) >= 0)
+                        while ((p = hashmap_steal_first(workers[k].preparsed))) {
+
+                                /* Workers skip files for which we have an up-to-date version already. Hence
+                                 * anything we find here is either outdated, or was preparsed by another worker
+                                 * too, e.g. a template, and either way may be replaced. */
+                                config_preparsed_free(hashmap_remove(m->preparsed_configs, p->filename));
+
+                                if (hashmap_put(m->preparsed_configs, p->filename, p) < 0)
+                                        config_preparsed_free(p);
+                        }
+
+                hashmap_free_with_destructor(workers[k].preparsed, config_preparsed_free);
+        }
+
+        log_debug("Preparsed unit files of %zu units on %u threads.", n_units, k);
+}
+
 unsigned manager_dispatch_load_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
@@ -1866,10 +2197,15 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                if (!u->load_preparsed)
+                        manager_preparse_load_queue(m);
+
                 unit_load(u);
                 n++;
         }
 
+        manager_trim_preparsed_configs(m);
+
         m->dispatching_load_queue = false;
 
         /* Dispatch the units waiting for their target dependencies to be added now, as all targets that we know about
@@ -2018,6 +2354,46 @@ void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
                         unit_dump(u, f, prefix);
 }
 
+void manager_dump_unit_statistics(Manager *s, FILE *f, const char *prefix) {
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        uint64_t fixed = 0, accounting = 0;
+        UnitType t;
+
+        assert(s);
+        assert(f);
+
+        prefix = strempty(prefix);
+
+        /* Only counts the fixed-size unit objects and the lazily allocated accounting data, not the dynamically
+         * allocated strings, dependencies or contexts hanging off them, but that's good enough for spotting which
+         * unit types take up space */
+        for (t = 0; t < _UNIT_TYPE_MAX; t++) {
+                unsigned n = 0, n_accounting = 0;
+                Unit *u;
+
+                LIST_FOREACH(units_by_type, u, s->units_by_type[t]) {
+                        n++;
+                        if (u->accounting)
+                                n_accounting++;
+                }
+
+                if (n == 0)
+                        continue;
+
+                fprintf(f, "%sUnits of type %s: %u (%zu bytes each, %u with accounting data)\n",
+                        prefix, unit_type_to_string(t), n, unit_vtable[t]->object_size, n_accounting);
+
+                fixed += (uint64_t) n * unit_vtable[t]->object_size;
+                accounting += (uint64_t) n_accounting * sizeof(UnitAccounting);
+        }
+
+        fprintf(f,
+                "%sUnit objects: %s\n"
+                "%sUnit accounting data: %s\n",
+                prefix, format_bytes(a, sizeof(a), fixed),
+                prefix, format_bytes(b, sizeof(b), accounting));
+}
+
 void manager_dump(Manager *m, FILE *f, const char *prefix) {
         ManagerTimestamp q;
 
@@ -2036,6 +2412,10 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
 
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
+
+        manager_dump_unit_statistics(m, f, prefix);
+        manager_dump_cgroup_statistics(m, f, prefix);
+        event_dump_statistics(m->event, f, prefix);
 }
 
 int manager_get_dump_string(Manager *m, char **ret) {
@@ -2099,7 +2479,7 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
-static unsigned manager_dispatch_dbus_queue(Manager *m) {
+unsigned manager_dispatch_dbus_queue(Manager *m) {
         unsigned n = 0, budget;
         Unit *u;
         Job *j;
@@ -2114,7 +2494,9 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
                 return 0;
 
         /* Do we have overly many messages queued at the moment? If so, let's not enqueue more on top, let's sit this
-         * cycle out, and process things in a later cycle when the queues got a bit emptier. */
+         * cycle out, and process things in a later cycle when the queues got a bit emptier. Direct connections that
+         * don't keep up aren't counted here, see manager_bus_n_queued_write(). Note that each unit and job is in the
+         * queues below only once, however often it changed, so waiting also coalesces their signals. */
         if (manager_bus_n_queued_write(m) > MANAGER_BUS_BUSY_THRESHOLD)
                 return 0;
 
@@ -2192,11 +2574,24 @@ static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, ui
         return 0;
 }
 
+/* The most notification messages we pick up with a single recvmmsg() */
+#define NOTIFY_BATCH_MAX 16U
+
+struct NotifyBuffer {
+        char buf[NOTIFY_BUFFER_MAX+1];
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
+        } control;
+};
+
 static void manager_invoke_notify_message(
                 Manager *m,
                 Unit *u,
                 const struct ucred *ucred,
                 const char *buf,
+                bool watchdog_ping,
                 FDSet *fds) {
 
         assert(m);
@@ -2208,6 +2603,16 @@ static void manager_invoke_notify_message(
                 return;
         u->notifygen = m->notifygen;
 
+        /* A plain keep-alive ping from the same process again, within the same batch? Then the first one already did
+         * everything this one would do. */
+        if (watchdog_ping) {
+                if (u->notify_watchdog_batchgen == m->notify_batchgen && u->notify_watchdog_pid == ucred->pid)
+                        return;
+
+                u->notify_watchdog_batchgen = m->notify_batchgen;
+                u->notify_watchdog_pid = ucred->pid;
+        }
+
         if (UNIT_VTABLE(u)->notify_message) {
                 _cleanup_strv_free_ char **tags = NULL;
 
@@ -2230,56 +2635,72 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+void manager_notify_pid_cache_forget_pid(Manager *m, pid_t pid) {
+        assert(m);
 
-        _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
-        char buf[NOTIFY_BUFFER_MAX+1];
-        struct iovec iovec = {
-                .iov_base = buf,
-                .iov_len = sizeof(buf)-1,
-        };
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
-        } control = {};
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-        };
+        (void) hashmap_remove(m->notify_pid_cache, PID_TO_PTR(pid));
+}
 
-        struct cmsghdr *cmsg;
-        struct ucred *ucred = NULL;
-        _cleanup_free_ Unit **array_copy = NULL;
-        Unit *u1, *u2, **array;
-        int r, *fd_array = NULL;
-        size_t n_fds = 0;
-        bool found = false;
-        ssize_t n;
+void manager_notify_pid_cache_forget_unit(Manager *m, Unit *u) {
+        Iterator i;
+        Unit *v;
+        void *k;
 
         assert(m);
-        assert(m->notify_fd == fd);
+        assert(u);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        if (!u->in_notify_pid_cache)
+                return;
 
-        n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
-        if (n < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
+        HASHMAP_FOREACH_KEY(v, k, m->notify_pid_cache, i)
+                if (v == u)
+                        (void) hashmap_remove(m->notify_pid_cache, k);
 
-                /* If this is any other, real error, then let's stop processing this socket. This of course means we
-                 * won't take notification messages anymore, but that's still better than busy looping around this:
-                 * being woken up over and over again but being unable to actually read the message off the socket. */
-                return log_error_errno(errno, "Failed to receive notification message: %m");
-        }
+        u->in_notify_pid_cache = false;
+}
+
+static Unit *manager_get_unit_by_notify_pid(Manager *m, pid_t pid, bool watched) {
+        Unit *u;
+
+        assert(m);
+
+        /* Looking up the cgroup of a process means reading a file from /proc. For processes we watch anyway we
+         * remember the result, as the cgroup they are in doesn't change behind our back while we watch them. Any
+         * changes to which units watch a PID drop the entry again, and so does freeing the unit. */
+
+        if (!watched)
+                return manager_get_unit_by_pid_cgroup(m, pid);
+
+        u = hashmap_get(m->notify_pid_cache, PID_TO_PTR(pid));
+        if (u)
+                return u;
+
+        u = manager_get_unit_by_pid_cgroup(m, pid);
+        if (!u)
+                return NULL;
+
+        if (hashmap_ensure_allocated(&m->notify_pid_cache, NULL) >= 0 &&
+            hashmap_put(m->notify_pid_cache, PID_TO_PTR(pid), u) >= 0)
+                u->in_notify_pid_cache = true;
+
+        return u;
+}
+
+static void manager_process_notify_message(Manager *m, struct msghdr *msghdr, size_t n, char *buf) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        struct cmsghdr *cmsg;
+        struct ucred *ucred = NULL;
+        _cleanup_free_ Unit **array_copy = NULL;
+        Unit *u1, *u2, **array;
+        int r, *fd_array = NULL;
+        size_t n_fds = 0;
+        bool found = false, watchdog_ping;
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        assert(m);
+        assert(msghdr);
+        assert(buf);
+
+        CMSG_FOREACH(cmsg, msghdr) {
                 if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
 
                         fd_array = (int*) CMSG_DATA(cmsg);
@@ -2300,37 +2721,40 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return;
         }
 
-        if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
+        if (n >= NOTIFY_BUFFER_MAX+1 || (msghdr->msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return;
         }
 
         /* Make sure it's NUL-terminated. */
         buf[n] = 0;
 
+        /* By far the most common message, sent over and over again by services with WatchdogSec= set */
+        watchdog_ping = STR_IN_SET(buf, "WATCHDOG=1", "WATCHDOG=1\n") && fdset_size(fds) == 0;
+
         /* Increase the generation counter used for filtering out duplicate unit invocations. */
         m->notifygen++;
 
         /* Notify every unit that might be interested, which might be multiple. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
         u2 = hashmap_get(m->watch_pids, PID_TO_PTR(ucred->pid));
         array = hashmap_get(m->watch_pids, PID_TO_PTR(-ucred->pid));
+        u1 = manager_get_unit_by_notify_pid(m, ucred->pid, u2 || array);
         if (array) {
                 size_t k = 0;
 
@@ -2344,16 +2768,16 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         /* And now invoke the per-unit callbacks. Note that manager_invoke_notify_message() will handle duplicate units
          * make sure we only invoke each unit's handler once. */
         if (u1) {
-                manager_invoke_notify_message(m, u1, ucred, buf, fds);
+                manager_invoke_notify_message(m, u1, ucred, buf, watchdog_ping, fds);
                 found = true;
         }
         if (u2) {
-                manager_invoke_notify_message(m, u2, ucred, buf, fds);
+                manager_invoke_notify_message(m, u2, ucred, buf, watchdog_ping, fds);
                 found = true;
         }
         if (array_copy)
                 for (size_t i = 0; array_copy[i]; i++) {
-                        manager_invoke_notify_message(m, array_copy[i], ucred, buf, fds);
+                        manager_invoke_notify_message(m, array_copy[i], ucred, buf, watchdog_ping, fds);
                         found = true;
                 }
 
@@ -2362,6 +2786,61 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
 
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        struct mmsghdr msgs[NOTIFY_BATCH_MAX];
+        struct iovec iovecs[NOTIFY_BATCH_MAX];
+        Manager *m = userdata;
+        unsigned i;
+        int n;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        if (!m->notify_buffers) {
+                m->notify_buffers = new(NotifyBuffer, NOTIFY_BATCH_MAX);
+                if (!m->notify_buffers) {
+                        log_oom();
+                        return 0;
+                }
+        }
+
+        for (i = 0; i < NOTIFY_BATCH_MAX; i++) {
+                NotifyBuffer *b = m->notify_buffers + i;
+
+                iovecs[i] = IOVEC_MAKE(b->buf, sizeof(b->buf) - 1);
+                msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = &b->control,
+                                .msg_controllen = sizeof(b->control),
+                        },
+                };
+        }
+
+        /* Pick up as many messages as are queued, up to NOTIFY_BATCH_MAX, with a single system call */
+        n = recvmmsg(m->notify_fd, msgs, NOTIFY_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0; /* Spurious wakeup, try again */
+
+                /* If this is any other, real error, then let's stop processing this socket. This of course means we
+                 * won't take notification messages anymore, but that's still better than busy looping around this:
+                 * being woken up over and over again but being unable to actually read the message off the socket. */
+                return log_error_errno(errno, "Failed to receive notification message: %m");
+        }
+
+        m->notify_batchgen++;
+
+        for (i = 0; i < (unsigned) n; i++)
+                manager_process_notify_message(m, &msgs[i].msg_hdr, msgs[i].msg_len, m->notify_buffers[i].buf);
 
         return 0;
 }
@@ -2846,6 +3325,10 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Come back soon to log messages journald couldn't take yet, even if nothing else happens */
+                if (log_has_queued() && log_flush_queue() < 0)
+                        wait_usec = MIN(wait_usec, LOG_QUEUE_RETRY_USEC);
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
@@ -3033,9 +3516,33 @@ int manager_open_serialization(Manager *m, FILE **_f) {
         return 0;
 }
 
+static SerializationFormat manager_pick_serialization_format(Manager *m, bool switching_root) {
+        SerializationFormat format;
+        const char *e;
+
+        /* When switching root we might hand over to a systemd version that can't read the binary format yet */
+        if (switching_root)
+                return SERIALIZATION_TEXT;
+
+        /* Allow this to be changed with "systemctl set-environment" too, since PID 1's own environment is hard to
+         * influence */
+        e = strv_env_get(m->environment, "SYSTEMD_SERIALIZATION") ?: getenv("SYSTEMD_SERIALIZATION");
+        if (e) {
+                format = serialization_format_from_string(e);
+                if (format >= 0)
+                        return format;
+
+                log_warning("Failed to parse $SYSTEMD_SERIALIZATION value, ignoring: %s", e);
+        }
+
+        return SERIALIZATION_BINARY;
+}
+
 int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
+        SerializationFormat format;
         ManagerTimestamp q;
         const char *t;
+        char **e;
         Iterator i;
         Unit *u;
         int r;
@@ -3044,24 +3551,38 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         assert(f);
         assert(fds);
 
+        /* Units are loaded from disk again after deserialization, hence make sure transient ones we only kept in
+         * memory so far are there. Without them we'd lose the units, hence refuse. */
+        r = manager_write_transient_units(m);
+        if (r < 0)
+                return r;
+
         m->n_reloading++;
 
-        fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
-        fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
-        fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
-        fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
-        fprintf(f, "ready-sent=%s\n", yes_no(m->ready_sent));
-        fprintf(f, "taint-logged=%s\n", yes_no(m->taint_logged));
-        fprintf(f, "service-watchdogs=%s\n", yes_no(m->service_watchdogs));
+        format = m->serialization_format = manager_pick_serialization_format(m, switching_root);
+
+        r = serialize_header(f, format);
+        if (r < 0) {
+                m->n_reloading--;
+                return r;
+        }
+
+        serialize_item_format(f, format, "current-job-id", "%" PRIu32, m->current_job_id);
+        serialize_item_format(f, format, "n-installed-jobs", "%u", m->n_installed_jobs);
+        serialize_item_format(f, format, "n-failed-jobs", "%u", m->n_failed_jobs);
+        serialize_item(f, format, "taint-usr", yes_no(m->taint_usr));
+        serialize_item(f, format, "ready-sent", yes_no(m->ready_sent));
+        serialize_item(f, format, "taint-logged", yes_no(m->taint_logged));
+        serialize_item(f, format, "service-watchdogs", yes_no(m->service_watchdogs));
 
         t = show_status_to_string(m->show_status);
         if (t)
-                fprintf(f, "show-status=%s\n", t);
+                serialize_item(f, format, "show-status", t);
 
         if (m->log_level_overridden)
-                fprintf(f, "log-level-override=%i\n", log_get_max_level());
+                serialize_item_format(f, format, "log-level-override", "%i", log_get_max_level());
         if (m->log_target_overridden)
-                fprintf(f, "log-target-override=%s\n", log_target_to_string(log_get_target()));
+                serialize_item(f, format, "log-target-override", log_target_to_string(log_get_target()));
 
         for (q = 0; q < _MANAGER_TIMESTAMP_MAX; q++) {
                 /* The following timestamps only apply to the host system, hence only serialize them there */
@@ -3076,12 +3597,22 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 {
                         char field[strlen(t) + STRLEN("-timestamp") + 1];
                         strcpy(stpcpy(field, t), "-timestamp");
-                        dual_timestamp_serialize(f, field, m->timestamps + q);
+                        serialize_dual_timestamp(f, format, field, m->timestamps + q);
                 }
         }
 
         if (!switching_root)
-                (void) serialize_environment(f, m->environment);
+                STRV_FOREACH(e, m->environment) {
+                        _cleanup_free_ char *ce = NULL;
+
+                        ce = cescape(*e);
+                        if (!ce) {
+                                m->n_reloading--;
+                                return -ENOMEM;
+                        }
+
+                        serialize_item(f, format, "env", ce);
+                }
 
         if (m->notify_fd >= 0) {
                 int copy;
@@ -3090,8 +3621,8 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "notify-fd=%i\n", copy);
-                fprintf(f, "notify-socket=%s\n", m->notify_socket);
+                serialize_item_format(f, format, "notify-fd", "%i", copy);
+                serialize_item(f, format, "notify-socket", m->notify_socket);
         }
 
         if (m->cgroups_agent_fd >= 0) {
@@ -3101,7 +3632,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "cgroups-agent-fd=%i\n", copy);
+                serialize_item_format(f, format, "cgroups-agent-fd", "%i", copy);
         }
 
         if (m->user_lookup_fds[0] >= 0) {
@@ -3115,10 +3646,10 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy1 < 0)
                         return copy1;
 
-                fprintf(f, "user-lookup=%i %i\n", copy0, copy1);
+                serialize_item_format(f, format, "user-lookup", "%i %i", copy0, copy1);
         }
 
-        bus_track_serialize(m->subscribed, f, "subscribed");
+        bus_track_serialize(m->subscribed, f, format, "subscribed");
 
         r = dynamic_user_serialize(m, f, fds);
         if (r < 0)
@@ -3131,15 +3662,14 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         if (r < 0)
                 return r;
 
-        (void) fputc('\n', f);
+        serialize_end(f, format);
 
         HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
                 /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
+                serialize_unit(f, format, u->id);
 
                 r = unit_serialize(u, f, fds, !switching_root);
                 if (r < 0) {
@@ -3162,7 +3692,51 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         return 0;
 }
 
+static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer buf = {};
+        int r;
+
+        assert(m);
+        assert(f);
+
+        for (;;) {
+                _cleanup_free_ char *unit_name = NULL;
+                char *name;
+                Unit *u;
+
+                /* Start marker */
+                r = deserialize_unit(f, m->serialization_format, &buf, &name);
+                if (r <= 0)
+                        return r;
+
+                /* Loading the unit might deserialize other things, don't keep pointing into the buffer */
+                unit_name = strdup(name);
+                if (!unit_name)
+                        return -ENOMEM;
+
+                r = manager_load_unit(m, unit_name, NULL, NULL, &u);
+                if (r < 0) {
+                        log_notice_errno(r, "Failed to load unit \"%s\", skipping deserialization: %m", unit_name);
+                        if (r == -ENOMEM)
+                                return r;
+
+                        r = deserialize_skip(f, m->serialization_format, &buf);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                r = unit_deserialize(u, f, fds);
+                if (r < 0) {
+                        log_notice_errno(r, "Failed to deserialize unit \"%s\": %m", unit_name);
+                        if (r == -ENOMEM)
+                                return r;
+                }
+        }
+}
+
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer buf = {};
         int r = 0;
 
         assert(m);
@@ -3172,23 +3746,18 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
 
         m->n_reloading++;
 
-        for (;;) {
-                char line[LINE_MAX];
-                const char *val, *l;
+        r = deserialize_header(f, &m->serialization_format);
+        if (r < 0)
+                goto finish;
 
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
+        for (;;) {
+                const char *val;
+                char *l;
 
+                r = deserialize_line(f, m->serialization_format, &buf, &l);
+                if (r < 0)
                         goto finish;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                if (l[0] == 0)
+                if (r == 0)
                         break;
 
                 if ((val = startswith(l, "current-job-id="))) {
@@ -3363,40 +3932,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 }
         }
 
-        for (;;) {
-                Unit *u;
-                char name[UNIT_NAME_MAX+2];
-                const char* unit_name;
-
-                /* Start marker */
-                if (!fgets(name, sizeof(name), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
-
-                        goto finish;
-                }
-
-                char_array_0(name);
-                unit_name = strstrip(name);
-
-                r = manager_load_unit(m, unit_name, NULL, NULL, &u);
-                if (r < 0) {
-                        log_notice_errno(r, "Failed to load unit \"%s\", skipping deserialization: %m", unit_name);
-                        if (r == -ENOMEM)
-                                goto finish;
-                        unit_deserialize_skip(f);
-                        continue;
-                }
-
-                r = unit_deserialize(u, f, fds);
-                if (r < 0) {
-                        log_notice_errno(r, "Failed to deserialize unit \"%s\": %m", unit_name);
-                        if (r == -ENOMEM)
-                                goto finish;
-                }
-        }
+        r = manager_deserialize_units(m, f, fds);
 
 finish:
         if (ferror(f))
@@ -3419,6 +3955,81 @@ static void manager_flush_finished_jobs(Manager *m) {
         m->pending_finished_jobs = set_free(m->pending_finished_jobs);
 }
 
+static int manager_dispatch_transient_write(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        (void) manager_write_transient_units(m);
+        return 0;
+}
+
+int manager_schedule_transient_write(Manager *m) {
+        usec_t usec;
+        int r;
+
+        assert(m);
+
+        /* Transient units are often gone again shortly after they were created, scopes in particular. Hence we
+         * only write their unit files once they are still around after a while, or when something needs them on
+         * disk earlier. */
+
+        if (m->transient_write_event_source) {
+                int enabled;
+
+                r = sd_event_source_get_enabled(m->transient_write_event_source, &enabled);
+                if (r < 0)
+                        return r;
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+        }
+
+        usec = usec_add(now(CLOCK_MONOTONIC), TRANSIENT_WRITE_DELAY_USEC);
+
+        if (m->transient_write_event_source) {
+                r = sd_event_source_set_time(m->transient_write_event_source, usec);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(m->transient_write_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->transient_write_event_source, CLOCK_MONOTONIC, usec, USEC_PER_SEC,
+                              manager_dispatch_transient_write, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->transient_write_event_source, "manager-transient-write");
+        return 0;
+}
+
+int manager_write_transient_units(Manager *m) {
+        Unit *u, *n;
+        int r = 0, k;
+
+        assert(m);
+
+        /* Units whose file we failed to write stay in the queue, so that we try again when it is needed next */
+        LIST_FOREACH_SAFE(transient_write_queue, u, n, m->transient_write_queue) {
+                assert(u->in_transient_write_queue);
+
+                k = unit_write_transient(u);
+                if (k < 0) {
+                        if (r >= 0)
+                                r = k;
+                        continue;
+                }
+
+                LIST_REMOVE(transient_write_queue, m->transient_write_queue, u);
+                u->in_transient_write_queue = false;
+        }
+
+        if (m->transient_write_event_source)
+                (void) sd_event_source_set_enabled(m->transient_write_event_source, SD_EVENT_OFF);
+
+        return r;
+}
+
 int manager_reload(Manager *m) {
         int r, q;
         _cleanup_fclose_ FILE *f = NULL;
@@ -3473,6 +4084,7 @@ int manager_reload(Manager *m) {
                 r = q;
 
         lookup_paths_reduce(&m->lookup_paths);
+        manager_unit_file_cache_begin(m);
         manager_build_unit_path_cache(m);
 
         /* First, enumerate what we can from all config files */
@@ -3514,6 +4126,9 @@ int manager_reload(Manager *m) {
 
         exec_runtime_vacuum(m);
 
+        /* All units are loaded again, save what we read for the next time */
+        manager_unit_file_cache_end(m);
+
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
@@ -3537,56 +4152,744 @@ int manager_reload(Manager *m) {
         return r;
 }
 
-void manager_reset_failed(Manager *m) {
-        Unit *u;
-        Iterator i;
+/* The dependencies a unit creates itself while being loaded, from its configuration and its name */
+#define UNIT_DEPENDENCY_LOAD_MASK (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_IMPLICIT|UNIT_DEPENDENCY_DEFAULT|UNIT_DEPENDENCY_PATH)
 
-        assert(m);
+typedef struct GeneratedUnit {
+        Unit *unit;
+        uint64_t hash;
+        bool unchanged;
+} GeneratedUnit;
+
+typedef struct ReloadDependency {
+        char *source;
+        char *target;
+        UnitDependency dependency;
+        UnitDependencyMask mask;
+} ReloadDependency;
+
+typedef struct ReloadRef {
+        UnitRef *ref;
+        Unit *source;
+        char *target;
+} ReloadRef;
+
+typedef struct IncrementalReload {
+        /* The units to reload */
+        Set *units;
+
+        /* Units with sources in the generator directories, and the hash of their sources before the generators
+         * were run again */
+        GeneratedUnit *generated;
+        size_t n_generated, n_generated_allocated;
+
+        /* Dependencies and references to the reloaded units that are not recreated by loading them again */
+        ReloadDependency *dependencies;
+        size_t n_dependencies, n_dependencies_allocated;
+
+        ReloadRef *refs;
+        size_t n_refs, n_refs_allocated;
+
+        /* Extra references to the runtime objects of the reloaded units, so that they survive freeing the units */
+        ExecRuntime **runtimes;
+        size_t n_runtimes, n_runtimes_allocated;
+
+        /* All names of the reloaded units */
+        char **names;
+} IncrementalReload;
+
+static void incremental_reload_done(IncrementalReload *r) {
+        size_t k;
+
+        assert(r);
+
+        set_free(r->units);
+        free(r->generated);
+
+        for (k = 0; k < r->n_dependencies; k++) {
+                free(r->dependencies[k].source);
+                free(r->dependencies[k].target);
+        }
+        free(r->dependencies);
 
-        HASHMAP_FOREACH(u, m->units, i)
-                unit_reset_failed(u);
-}
+        for (k = 0; k < r->n_refs; k++)
+                free(r->refs[k].target);
+        free(r->refs);
 
-bool manager_unit_inactive_or_pending(Manager *m, const char *name) {
-        Unit *u;
+        for (k = 0; k < r->n_runtimes; k++)
+                exec_runtime_unref(r->runtimes[k], false);
+        free(r->runtimes);
 
-        assert(m);
-        assert(name);
+        strv_free(r->names);
+}
 
-        /* Returns true if the unit is inactive or going down */
-        u = manager_get_unit(m, name);
-        if (!u)
-                return true;
+static bool path_is_generated(const LookupPaths *p, const char *path) {
+        assert(p);
 
-        return unit_inactive_or_pending(u);
+        if (!path)
+                return false;
+
+        return (p->generator && path_startswith(path, p->generator)) ||
+               (p->generator_early && path_startswith(path, p->generator_early)) ||
+               (p->generator_late && path_startswith(path, p->generator_late));
 }
 
-static void log_taint_string(Manager *m) {
-        _cleanup_free_ char *taint = NULL;
+static int hash_file(struct siphash *state, const char *path) {
+        _cleanup_free_ char *contents = NULL;
+        size_t size;
+        int r;
 
-        assert(m);
+        r = read_full_file(path, &contents, &size);
+        if (r < 0)
+                return r;
 
-        if (MANAGER_IS_USER(m) || m->taint_logged)
-                return;
+        siphash24_compress(path, strlen(path) + 1, state);
+        siphash24_compress(&size, sizeof(size), state);
+        siphash24_compress(contents, size, state);
 
-        m->taint_logged = true; /* only check for taint once */
+        return 0;
+}
 
-        taint = manager_taint_string(m);
-        if (isempty(taint))
-                return;
+static int unit_hash_sources(Unit *u, char **dropin_paths, uint64_t *ret) {
+        static const uint8_t hash_key[] = {
+                0x2e, 0x7c, 0x5a, 0x91, 0x0b, 0xd4, 0x4f, 0x63,
+                0x8a, 0x17, 0xc2, 0x39, 0xe5, 0x6d, 0xf0, 0x48
+        };
 
-        log_struct(LOG_NOTICE,
-                   LOG_MESSAGE("System is tainted: %s", taint),
-                   "TAINT=%s", taint,
-                   "MESSAGE_ID=" SD_MESSAGE_TAINTED_STR);
-}
+        struct siphash state;
+        char **p;
+        int r;
 
-static void manager_notify_finished(Manager *m) {
-        char userspace[FORMAT_TIMESPAN_MAX], initrd[FORMAT_TIMESPAN_MAX], kernel[FORMAT_TIMESPAN_MAX], sum[FORMAT_TIMESPAN_MAX];
-        usec_t firmware_usec, loader_usec, kernel_usec, initrd_usec, userspace_usec, total_usec;
+        assert(u);
+        assert(ret);
 
-        if (m->test_run_flags)
-                return;
+        siphash24_init(&state, hash_key);
+
+        if (u->fragment_path) {
+                r = hash_file(&state, u->fragment_path);
+                if (r < 0)
+                        return r;
+        }
+
+        STRV_FOREACH(p, dropin_paths) {
+                r = hash_file(&state, *p);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static int incremental_reload_hash_generated(Manager *m, IncrementalReload *r) {
+        Iterator i;
+        Unit *u;
+        char *k;
+
+        assert(m);
+        assert(r);
+
+        /* Generators are run again on every reload, hence everything they generate has a new mtime afterwards, even
+         * if nothing changed. Remember what the units with generated sources looked like, so that we can compare
+         * their contents instead. */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                uint64_t hash;
+                char **p;
+                bool generated;
+
+                if (u->id != k)
+                        continue;
+
+                generated = path_is_generated(&m->lookup_paths, u->fragment_path);
+                STRV_FOREACH(p, u->dropin_paths)
+                        generated = generated || path_is_generated(&m->lookup_paths, *p);
+                if (!generated)
+                        continue;
+
+                if (unit_hash_sources(u, u->dropin_paths, &hash) < 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(r->generated, r->n_generated_allocated, r->n_generated + 1))
+                        return -ENOMEM;
+
+                r->generated[r->n_generated++] = (GeneratedUnit) {
+                        .unit = u,
+                        .hash = hash,
+                };
+        }
+
+        return 0;
+}
+
+static bool generated_unit_unchanged(GeneratedUnit *g) {
+        _cleanup_strv_free_ char **dropins = NULL;
+        uint64_t hash;
+
+        assert(g);
+
+        if (g->unit->load_state == UNIT_LOADED)
+                (void) unit_find_dropin_paths(g->unit, &dropins);
+
+        if (!strv_equal(g->unit->dropin_paths, dropins))
+                return false;
+
+        if (unit_hash_sources(g->unit, dropins, &hash) < 0)
+                return false;
+
+        return hash == g->hash;
+}
+
+static void unit_refresh_mtimes(Unit *u) {
+        struct stat st;
+
+        assert(u);
+
+        /* The sources of the unit were recreated with the very same contents, let's take the new mtimes, so that the
+         * unit isn't reported as needing a reload. */
+
+        if (u->fragment_path && stat(u->fragment_path, &st) >= 0 && u->load_state != UNIT_MASKED)
+                u->fragment_mtime = timespec_load(&st.st_mtim);
+
+        if (u->source_path && stat(u->source_path, &st) >= 0)
+                u->source_mtime = timespec_load(&st.st_mtim);
+
+        if (!strv_isempty(u->dropin_paths))
+                u->dropin_mtime = now(CLOCK_REALTIME);
+}
+
+static int unit_path_cache_diff(Set *a, Set *b, Set **ret) {
+        _cleanup_set_free_free_ Set *names = NULL;
+        Set *x = a, *y = b;
+        Iterator i;
+        char *p;
+        int r, k;
+
+        assert(ret);
+
+        /* Returns the file names of all entries that were added or removed in one of the unit search path
+         * directories. For entries in .wants/, .requires/ and .d/ directories that's the name of the unit the
+         * directory belongs to. */
+
+        names = set_new(&string_hash_ops);
+        if (!names)
+                return -ENOMEM;
+
+        for (k = 0; k < 2; k++) {
+                SET_FOREACH(p, x, i) {
+                        _cleanup_free_ char *dir = NULL;
+                        const char *name;
+                        char *e;
+
+                        if (set_contains(y, p))
+                                continue;
+
+                        name = basename(p);
+
+                        dir = dirname_malloc(p);
+                        if (!dir)
+                                return -ENOMEM;
+
+                        /* Only the dependency directories themselves are in the cache, not the search path */
+                        e = endswith(dir, ".wants") ?: endswith(dir, ".requires") ?: endswith(dir, ".d");
+                        if (e && set_contains(x, dir)) {
+                                *e = 0;
+                                name = basename(dir);
+                        }
+
+                        r = set_put_strdup(names, name);
+                        if (r < 0)
+                                return r;
+                }
+
+                SWAP_TWO(x, y);
+        }
+
+        *ret = TAKE_PTR(names);
+        return 0;
+}
+
+static bool unit_names_in_set(Unit *u, Set *names) {
+        _cleanup_free_ char *template = NULL;
+        Iterator i;
+        char *n;
+
+        assert(u);
+
+        SET_FOREACH(n, u->names, i)
+                if (set_contains(names, n))
+                        return true;
+
+        if (u->instance && unit_name_template(u->id, &template) >= 0 && set_contains(names, template))
+                return true;
+
+        return false;
+}
+
+static int incremental_reload_collect(Manager *m, IncrementalReload *r, Set *changed_names) {
+        Iterator i;
+        size_t k;
+        Unit *u;
+        char *n;
+        int q;
+
+        assert(m);
+        assert(r);
+
+        /* Finds the units whose configuration changed. Returns 0 if that includes units we cannot reload on their
+         * own, and hence need a full reload, 1 otherwise. */
+
+        r->units = set_new(NULL);
+        if (!r->units)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(u, n, m->units, i) {
+                bool changed;
+
+                if (u->id != n)
+                        continue;
+
+                if (IN_SET(u->load_state, UNIT_STUB, UNIT_MERGED))
+                        continue;
+
+                if (u->load_state == UNIT_ERROR || unit_names_in_set(u, changed_names))
+                        changed = true;
+                else if (unit_need_daemon_reload(u)) {
+                        GeneratedUnit *g = NULL;
+
+                        for (k = 0; k < r->n_generated; k++)
+                                if (r->generated[k].unit == u) {
+                                        g = r->generated + k;
+                                        break;
+                                }
+
+                        if (g && generated_unit_unchanged(g)) {
+                                g->unchanged = true;
+                                changed = false;
+                        } else
+                                changed = true;
+                } else
+                        changed = false;
+
+                if (!changed)
+                        continue;
+
+                /* Units of types that are enumerated from the system, transient units and perpetual units are
+                 * set up in ways loading them again doesn't replicate. */
+                if (UNIT_VTABLE(u)->enumerate || u->transient || u->perpetual) {
+                        log_debug("Configuration of %s changed, which cannot be reloaded on its own.", u->id);
+                        return 0;
+                }
+
+                q = set_put(r->units, u);
+                if (q < 0)
+                        return q;
+        }
+
+        for (k = 0; k < r->n_generated; k++)
+                if (r->generated[k].unchanged)
+                        unit_refresh_mtimes(r->generated[k].unit);
+
+        return 1;
+}
+
+static int incremental_reload_add_dependency(IncrementalReload *r, Unit *source, UnitDependency d, Unit *target, UnitDependencyMask mask) {
+        _cleanup_free_ char *s = NULL, *t = NULL;
+
+        assert(r);
+        assert(source);
+        assert(target);
+
+        if (mask == 0)
+                return 0;
+
+        s = strdup(source->id);
+        t = strdup(target->id);
+        if (!s || !t)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(r->dependencies, r->n_dependencies_allocated, r->n_dependencies + 1))
+                return -ENOMEM;
+
+        r->dependencies[r->n_dependencies++] = (ReloadDependency) {
+                .source = TAKE_PTR(s),
+                .target = TAKE_PTR(t),
+                .dependency = d,
+                .mask = mask,
+        };
+
+        return 0;
+}
+
+static int incremental_reload_save(Manager *m, IncrementalReload *r, FILE *f, FDSet *fds) {
+        _cleanup_set_free_ Set *neighbors = NULL;
+        UnitDependency d;
+        Iterator i, j;
+        Unit *u, *other;
+        void *v;
+        int q;
+
+        assert(m);
+        assert(r);
+        assert(f);
+        assert(fds);
+
+        /* Remembers everything about the units to reload that isn't restored by loading and deserializing them
+         * again, and serializes them. */
+
+        neighbors = set_new(NULL);
+        if (!neighbors)
+                return -ENOMEM;
+
+        SET_FOREACH(u, r->units, i) {
+                ExecRuntime *rt = NULL;
+                UnitRef *ref;
+
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], j) {
+                                UnitDependencyInfo di = { .data = v };
+
+                                q = incremental_reload_add_dependency(r, u, d, other, di.origin_mask & ~UNIT_DEPENDENCY_LOAD_MASK);
+                                if (q < 0)
+                                        return q;
+
+                                if (!set_contains(r->units, other)) {
+                                        q = set_put(neighbors, other);
+                                        if (q < 0)
+                                                return q;
+                                }
+                        }
+
+                LIST_FOREACH(refs_by_target, ref, u->refs_by_target) {
+                        char *t;
+
+                        if (set_contains(r->units, ref->source))
+                                continue;
+
+                        t = strdup(u->id);
+                        if (!t)
+                                return -ENOMEM;
+
+                        if (!GREEDY_REALLOC(r->refs, r->n_refs_allocated, r->n_refs + 1)) {
+                                free(t);
+                                return -ENOMEM;
+                        }
+
+                        r->refs[r->n_refs++] = (ReloadRef) {
+                                .ref = ref,
+                                .source = ref->source,
+                                .target = t,
+                        };
+                }
+
+                if (exec_runtime_acquire(m, NULL, u->id, false, &rt) > 0) {
+                        if (!GREEDY_REALLOC(r->runtimes, r->n_runtimes_allocated, r->n_runtimes + 1)) {
+                                exec_runtime_unref(rt, false);
+                                return -ENOMEM;
+                        }
+
+                        r->runtimes[r->n_runtimes++] = rt;
+                }
+
+                /* The primary name first, so that it is loaded under that one again */
+                q = strv_extend(&r->names, u->id);
+                if (q < 0)
+                        return q;
+
+                SET_FOREACH(v, u->names, j)
+                        if (v != u->id) {
+                                q = strv_extend(&r->names, v);
+                                if (q < 0)
+                                        return q;
+                        }
+
+                serialize_unit(f, m->serialization_format, u->id);
+
+                q = unit_serialize(u, f, fds, true);
+                if (q < 0)
+                        return q;
+        }
+
+        /* Dependencies the unchanged units configured on the reloaded ones. Targets order themselves after the units
+         * they pull in depending on those units' DefaultDependencies=, hence that part is recalculated. */
+        SET_FOREACH(u, neighbors, i)
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], j) {
+                                UnitDependencyInfo di = { .data = v };
+                                UnitDependencyMask mask = di.origin_mask;
+
+                                if (!set_contains(r->units, other))
+                                        continue;
+
+                                if (u->type == UNIT_TARGET && d == UNIT_AFTER)
+                                        mask &= ~UNIT_DEPENDENCY_DEFAULT;
+
+                                q = incremental_reload_add_dependency(r, u, d, other, mask);
+                                if (q < 0)
+                                        return q;
+                        }
+
+        q = fflush_and_check(f);
+        if (q < 0)
+                return q;
+
+        if (fseeko(f, 0, SEEK_SET) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static void incremental_reload_restore(Manager *m, IncrementalReload *r) {
+        char **n;
+        size_t k;
+        int q;
+
+        assert(m);
+        assert(r);
+
+        /* Load the aliases of the reloaded units again, they are merged into them if they still are aliases */
+        STRV_FOREACH(n, r->names) {
+                Unit *u;
+
+                q = manager_load_unit(m, *n, NULL, NULL, &u);
+                if (q < 0)
+                        log_debug_errno(q, "Failed to load unit %s again, ignoring: %m", *n);
+                else
+                        unit_add_to_target_deps_queue(u);
+        }
+
+        for (k = 0; k < r->n_dependencies; k++) {
+                ReloadDependency *rd = r->dependencies + k;
+                Unit *source, *target;
+
+                source = manager_get_unit(m, rd->source);
+                target = manager_get_unit(m, rd->target);
+                if (!source || !target)
+                        continue;
+
+                q = unit_add_dependency(source, rd->dependency, target, false, rd->mask);
+                if (q < 0)
+                        log_warning_errno(q, "Failed to restore dependency of %s on %s, ignoring: %m", source->id, target->id);
+
+                unit_add_to_target_deps_queue(source);
+        }
+
+        for (k = 0; k < r->n_refs; k++) {
+                Unit *target;
+
+                target = manager_get_unit(m, r->refs[k].target);
+                if (target)
+                        unit_ref_set(r->refs[k].ref, r->refs[k].source, target);
+        }
+
+        /* Recalculates the target dependencies */
+        manager_dispatch_load_queue(m);
+}
+
+int manager_reload_incremental(Manager *m) {
+        _cleanup_(incremental_reload_done) IncrementalReload ir = {};
+        _cleanup_set_free_free_ Set *old_unit_path_cache = NULL, *changed_names = NULL;
+        _cleanup_strv_free_ char **search_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        Unit *u;
+        int r, q;
+
+        assert(m);
+
+        /* Like manager_reload(), but only frees and loads again the units whose configuration changed, leaving all
+         * others alone. Falls back to a full reload if that's not possible. */
+
+        if (!m->unit_path_cache)
+                return manager_reload(m);
+
+        r = incremental_reload_hash_generated(m, &ir);
+        if (r < 0)
+                return r;
+
+        search_path = strv_copy(m->lookup_paths.search_path);
+        if (!search_path)
+                return -ENOMEM;
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return r;
+
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        m->n_reloading++;
+        bus_manager_send_reloading(m, true);
+
+        /* Get rid of merged units first, they point to the units they were merged into */
+        (void) manager_dispatch_cleanup_queue(m);
+
+        lookup_paths_flush_generator(&m->lookup_paths);
+        lookup_paths_free(&m->lookup_paths);
+
+        r = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
+
+        q = manager_run_environment_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        q = manager_run_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        lookup_paths_reduce(&m->lookup_paths);
+
+        if (r < 0 || !strv_equal(search_path, m->lookup_paths.search_path)) {
+                log_debug("Unit search path changed or could not be set up, doing a full reload.");
+                goto full;
+        }
+
+        manager_unit_file_cache_begin(m);
+
+        old_unit_path_cache = TAKE_PTR(m->unit_path_cache);
+        manager_build_unit_path_cache(m);
+        if (!m->unit_path_cache)
+                goto full;
+
+        r = unit_path_cache_diff(old_unit_path_cache, m->unit_path_cache, &changed_names);
+        if (r < 0)
+                goto fail;
+
+        r = incremental_reload_collect(m, &ir, changed_names);
+        if (r < 0)
+                goto fail;
+        if (r == 0)
+                goto full;
+
+        log_debug("Reloading %u units with changed configuration.", set_size(ir.units));
+
+        /* We read back what we wrote ourselves, hence always use the binary format */
+        m->serialization_format = SERIALIZATION_BINARY;
+
+        r = incremental_reload_save(m, &ir, f, fds);
+        if (r < 0)
+                goto fail;
+
+        /* From here on there is no way back. */
+        while ((u = set_steal_first(ir.units)))
+                unit_free(u);
+
+        r = manager_deserialize_units(m, f, fds);
+        if (r < 0)
+                log_error_errno(r, "Deserialization failed: %m");
+
+        f = safe_fclose(f);
+
+        incremental_reload_restore(m, &ir);
+
+        /* The reloaded units took their runtime objects again, if they still need them */
+        incremental_reload_done(&ir);
+        ir = (IncrementalReload) {};
+
+        manager_coldplug(m);
+
+        dynamic_user_vacuum(m, true);
+        manager_vacuum_uid_refs(m);
+        manager_vacuum_gid_refs(m);
+        exec_runtime_vacuum(m);
+
+        manager_unit_file_cache_end(m);
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        manager_recheck_journal(m);
+        manager_recheck_dbus(m);
+
+        manager_catchup(m);
+
+        q = manager_enqueue_sync_bus_names(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        if (!MANAGER_IS_RELOADING(m))
+                manager_flush_finished_jobs(m);
+
+        m->send_reloading_done = true;
+
+        return r;
+
+fail:
+        /* Nothing was freed yet, but the generators already ran again and the lookup paths were replaced, hence
+         * the units we have might not match what is on disk anymore. Let's start over with a full reload. */
+        log_warning_errno(r, "Failed to prepare incremental reload, doing a full reload: %m");
+
+full:
+        manager_unit_file_cache_free(m);
+
+        /* Drop the extra references to the runtime objects again, before the units go */
+        incremental_reload_done(&ir);
+        ir = (IncrementalReload) {};
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        f = safe_fclose(f);
+        r = manager_reload(m);
+
+        /* We announced the reload above, make sure it is announced as finished too, even if manager_reload()
+         * didn't get far enough to do so itself */
+        m->send_reloading_done = true;
+
+        return r;
+}
+
+void manager_reset_failed(Manager *m) {
+        Unit *u;
+        Iterator i;
+
+        assert(m);
+
+        HASHMAP_FOREACH(u, m->units, i)
+                unit_reset_failed(u);
+}
+
+bool manager_unit_inactive_or_pending(Manager *m, const char *name) {
+        Unit *u;
+
+        assert(m);
+        assert(name);
+
+        /* Returns true if the unit is inactive or going down */
+        u = manager_get_unit(m, name);
+        if (!u)
+                return true;
+
+        return unit_inactive_or_pending(u);
+}
+
+static void log_taint_string(Manager *m) {
+        _cleanup_free_ char *taint = NULL;
+
+        assert(m);
+
+        if (MANAGER_IS_USER(m) || m->taint_logged)
+                return;
+
+        m->taint_logged = true; /* only check for taint once */
+
+        taint = manager_taint_string(m);
+        if (isempty(taint))
+                return;
+
+        log_struct(LOG_NOTICE,
+                   LOG_MESSAGE("System is tainted: %s", taint),
+                   "TAINT=%s", taint,
+                   "MESSAGE_ID=" SD_MESSAGE_TAINTED_STR);
+}
+
+static void manager_notify_finished(Manager *m) {
+        char userspace[FORMAT_TIMESPAN_MAX], initrd[FORMAT_TIMESPAN_MAX], kernel[FORMAT_TIMESPAN_MAX], sum[FORMAT_TIMESPAN_MAX];
+        usec_t firmware_usec, loader_usec, kernel_usec, initrd_usec, userspace_usec, total_usec;
+
+        if (m->test_run_flags)
+                return;
 
         if (MANAGER_IS_SYSTEM(m) && detect_container() <= 0) {
                 char ts[FORMAT_TIMESPAN_MAX];
@@ -3793,7 +5096,8 @@ static int manager_run_environment_generators(Manager *m) {
 
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
-        const char *argv[5];
+        GeneratorTiming *timings = NULL;
+        size_t n_timings = 0;
         int r;
 
         assert(m);
@@ -3812,15 +5116,17 @@ static int manager_run_generators(Manager *m) {
         if (r < 0)
                 goto finish;
 
-        argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
-        argv[1] = m->lookup_paths.generator;
-        argv[2] = m->lookup_paths.generator_early;
-        argv[3] = m->lookup_paths.generator_late;
-        argv[4] = NULL;
-
         RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+                if (generators_run(paths,
+                                   m->lookup_paths.generator,
+                                   m->lookup_paths.generator_early,
+                                   m->lookup_paths.generator_late,
+                                   DEFAULT_TIMEOUT_USEC,
+                                   &timings, &n_timings) >= 0) {
+                        generator_timings_free(m->generator_timings, m->n_generator_timings);
+                        m->generator_timings = timings;
+                        m->n_generator_timings = n_timings;
+                }
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
@@ -4330,7 +5636,7 @@ static void manager_serialize_uid_refs_internal(
                 if (!(c & DESTROY_IPC_FLAG))
                         continue;
 
-                fprintf(f, "%s=" UID_FMT "\n", field_name, uid);
+                serialize_item_format(f, m->serialization_format, field_name, UID_FMT, uid);
         }
 }
 
@@ -17,6 +17,10 @@
 
 struct libmnt_monitor;
 typedef struct Unit Unit;
+typedef struct BootTraceEvent BootTraceEvent;
+typedef struct ExecutorPool ExecutorPool;
+typedef struct GeneratorTiming GeneratorTiming;
+typedef struct NotifyBuffer NotifyBuffer;
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
@@ -103,6 +107,7 @@ typedef enum ManagerTimestamp {
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
+#include "serialize.h"
 #include "show-status.h"
 #include "unit-name.h"
 
@@ -130,6 +135,14 @@ struct Manager {
          * type we maintain a per type linked list */
         LIST_HEAD(Unit, units_by_type[_UNIT_TYPE_MAX]);
 
+        /* A topological order of all units along Before=/After=, see unit-order.c. While order_valid is false there
+         * might be an ordering cycle somewhere, order_changed says whether dependencies were removed since we last
+         * checked. */
+        unsigned order_next_rank;
+        unsigned order_generation;
+        bool order_valid:1;
+        bool order_changed:1;
+
         /* Units that need to be loaded */
         LIST_HEAD(Unit, load_queue); /* this is actually more a stack than a queue, but uh. */
 
@@ -162,6 +175,9 @@ struct Manager {
         /* Units that might be subject to StopWhenUnneeded= clean-up */
         LIST_HEAD(Unit, stop_when_unneeded_queue);
 
+        /* Transient units whose unit file we didn't write to disk yet */
+        LIST_HEAD(Unit, transient_write_queue);
+
         sd_event *event;
 
         /* This maps PIDs we care about to units that are interested in. We allow multiple units to he interested in
@@ -203,12 +219,30 @@ struct Manager {
         int user_lookup_fds[2];
         sd_event_source *user_lookup_event_source;
 
+        /* O_PATH fd of systemd-executor, used to spawn processes without fork()ing us, or -1 */
+        int executor_fd;
+
+        /* Idle executors waiting for socket activated per-connection services, see executor-pool.c */
+        ExecutorPool *executor_pool;
+
         sd_event_source *sync_bus_names_event_source;
+        sd_event_source *transient_write_event_source;
 
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* Unit files and drop-ins read in advance, by path. Filled by worker threads while dispatching the load
+         * queue, and from the unit file cache while it is active, i.e. during startup and reloading */
+        Hashmap *preparsed_configs;
+        Hashmap *unit_file_cache_dirs;
+        /* Paths of files in preparsed_configs that are kept around outside of the above too */
+        Set *pinned_configs;
+        usec_t unit_file_cache_timestamp;
+
+        /* The format of the serialization currently written or read */
+        SerializationFormat serialization_format;
+
         char **environment;
 
         usec_t runtime_watchdog;
@@ -216,6 +250,14 @@ struct Manager {
 
         dual_timestamp timestamps[_MANAGER_TIMESTAMP_MAX];
 
+        /* How long each generator took during the last run, in the order they were sorted in */
+        GeneratorTiming *generator_timings;
+        size_t n_generator_timings;
+
+        /* Job, unit and process events until startup finished, for "systemd-analyze trace" */
+        BootTraceEvent *boot_trace;
+        size_t n_boot_trace, n_boot_trace_allocated;
+
         /* Data specific to the device subsystem */
         struct udev_monitor* udev_monitor;
         sd_event_source *udev_event_source;
@@ -225,8 +267,15 @@ struct Manager {
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
 
+        /* The mount table as we processed it last, to find out what changed, and the means to coalesce bursts of
+         * changes to it */
+        OrderedHashmap *mount_info;
+        RateLimit mount_rescan_ratelimit;
+        sd_event_source *mount_rescan_event_source;
+
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
+        char *proc_swaps_last; /* The contents of /proc/swaps when we last processed it */
         sd_event_source *swap_event_source;
         Hashmap *swaps_by_devnode;
 
@@ -257,6 +306,14 @@ struct Manager {
         /* Data specific to the Automount subsystem */
         int dev_autofs_fd;
 
+        /* Data specific to the Path subsystem: one inotify object shared by all path specs. Watches on the same
+         * inode are shared too, hence we keep a map from watch descriptor to the PathInotifyWatch object
+         * listing the specs using it. */
+        int path_inotify_fd;
+        sd_event_source *path_inotify_event_source;
+        Hashmap *path_inotify_watches;
+        Set *path_inotify_pending;
+
         /* Data specific to the cgroup subsystem */
         Hashmap *cgroup_unit;
         CGroupMask cgroup_supported;
@@ -267,6 +324,20 @@ struct Manager {
         sd_event_source *cgroup_inotify_event_source;
         Hashmap *cgroup_inotify_wd_unit;
 
+        /* Statistics about the above, and about the emptiness checks they trigger */
+        uint64_t cgroup_inotify_n_events;
+        uint64_t cgroup_inotify_n_overflows;
+        uint64_t cgroup_empty_n_checks;
+
+        /* BPF access maps, indexed by their contents, so that units with the same IP access lists share them */
+        Hashmap *bpf_access_maps;
+
+        /* Loaded BPF firewall programs, indexed by their instructions, so that identical ones are loaded only once */
+        Hashmap *bpf_firewall_programs;
+
+        /* Compiled seccomp filters, indexed by the settings they were built from, see exec_spawn() */
+        Hashmap *seccomp_programs;
+
         /* A defer event for handling cgroup empty events and processing them after SIGCHLD in all cases. */
         sd_event_source *cgroup_empty_event_source;
 
@@ -284,6 +355,7 @@ struct Manager {
         ManagerExitCode exit_code:5;
 
         bool dispatching_load_queue:1;
+        bool unit_file_cache_active:1;
         bool dispatching_dbus_queue:1;
 
         bool taint_usr:1;
@@ -396,6 +468,14 @@ struct Manager {
          * multiple times on the same unit. */
         unsigned sigchldgen;
         unsigned notifygen;
+        unsigned notify_batchgen;
+
+        /* Buffers for receiving a batch of notification messages at once, allocated on first use */
+        NotifyBuffer *notify_buffers;
+
+        /* Maps PIDs we watch to the unit whose cgroup they are in, so that we don't need to look at /proc for each
+         * notification message they send. Entries are dropped whenever the set of units watching a PID changes. */
+        Hashmap *notify_pid_cache;
 };
 
 #define MANAGER_IS_SYSTEM(m) ((m)->unit_file_scope == UNIT_FILE_SYSTEM)
@@ -408,6 +488,7 @@ struct Manager {
 /* The exit code is set to OK as soon as we enter the main loop, and set otherwise as soon as we are done with it */
 #define MANAGER_IS_RUNNING(m) ((m)->exit_code == MANAGER_OK)
 
+void manager_setup_log_fields(Manager *m);
 int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **m);
 Manager* manager_free(Manager *m);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
@@ -424,12 +505,16 @@ int manager_load_unit(Manager *m, const char *name, const char *path, sd_bus_err
 int manager_load_startable_unit_or_warn(Manager *m, const char *name, const char *path, Unit **ret);
 int manager_load_unit_from_dbus_path(Manager *m, const char *s, sd_bus_error *e, Unit **_u);
 
+void manager_notify_pid_cache_forget_pid(Manager *m, pid_t pid);
+void manager_notify_pid_cache_forget_unit(Manager *m, Unit *u);
+
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_error *e, Job **_ret);
 int manager_add_job_by_name(Manager *m, JobType type, const char *name, JobMode mode, sd_bus_error *e, Job **_ret);
 int manager_add_job_by_name_and_warn(Manager *m, JobType type, const char *name, JobMode mode, Job **ret);
 int manager_propagate_reload(Manager *m, Unit *unit, JobMode mode, sd_bus_error *e);
 
 void manager_dump_units(Manager *s, FILE *f, const char *prefix);
+void manager_dump_unit_statistics(Manager *s, FILE *f, const char *prefix);
 void manager_dump_jobs(Manager *s, FILE *f, const char *prefix);
 void manager_dump(Manager *s, FILE *f, const char *prefix);
 int manager_get_dump_string(Manager *m, char **ret);
@@ -437,6 +522,8 @@ int manager_get_dump_string(Manager *m, char **ret);
 void manager_clear_jobs(Manager *m);
 
 unsigned manager_dispatch_load_queue(Manager *m);
+unsigned manager_dispatch_gc_unit_queue(Manager *m);
+unsigned manager_dispatch_dbus_queue(Manager *m);
 
 int manager_environment_add(Manager *m, char **minus, char **plus);
 int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit);
@@ -449,6 +536,10 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_incremental(Manager *m);
+
+int manager_schedule_transient_write(Manager *m);
+int manager_write_transient_units(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
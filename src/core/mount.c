@@ -53,6 +53,8 @@ static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
 
 static int mount_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int mount_process_proc_self_mountinfo(Manager *m);
+static bool mount_rescan_pending(Manager *m);
 
 static bool MOUNT_STATE_WITH_PROCESS(MountState state) {
         return IN_SET(state,
@@ -1271,7 +1273,12 @@ static void mount_sigchld_event(Unit *u, pid_t pid, int code, int status) {
                       "Mount process exited, code=%s status=%i", sigchld_code_to_string(code), status);
 
         /* Note that due to the io event priority logic, we can be sure the new mountinfo is loaded
-         * before we process the SIGCHLD for the mount command. */
+         * before we process the SIGCHLD for the mount command. Unless we postponed processing it, but
+         * then let's do that now. */
+        if (mount_rescan_pending(u->manager)) {
+                (void) sd_event_source_set_enabled(u->manager->mount_rescan_event_source, SD_EVENT_OFF);
+                (void) mount_process_proc_self_mountinfo(u->manager);
+        }
 
         switch (m->state) {
 
@@ -1587,12 +1594,49 @@ fail:
         return log_warning_errno(r, "Failed to set up mount unit: %m");
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+typedef struct MountInfoEntry {
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+} MountInfoEntry;
+
+static MountInfoEntry* mount_info_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e->where);
+        free(e->options);
+        free(e->fstype);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoEntry*, mount_info_entry_free);
+
+static OrderedHashmap* mount_info_free(OrderedHashmap *h) {
+        return ordered_hashmap_free_with_destructor(h, mount_info_entry_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(OrderedHashmap*, mount_info_free);
+
+static bool mount_info_entry_equal(const MountInfoEntry *a, const MountInfoEntry *b) {
+        return streq(a->what, b->what) &&
+                streq(a->where, b->where) &&
+                streq(a->options, b->options) &&
+                streq(a->fstype, b->fstype);
+}
+
+static int mount_parse_proc_self_mountinfo(OrderedHashmap **ret) {
+        _cleanup_(mount_info_freep) OrderedHashmap *info = NULL;
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
-        int r = 0;
+        int r, n = 0;
 
-        assert(m);
+        assert(ret);
+
+        /* Returns the entries of the table in order, keyed by their mount ID. The ID stays the same for the lifetime
+         * of a mount, hence we can use it to tell which of the entries changed from one time to the next. */
 
         t = mnt_new_table();
         i = mnt_new_iter(MNT_ITER_FORWARD);
@@ -1603,18 +1647,21 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
-        r = 0;
+        info = ordered_hashmap_new(NULL);
+        if (!info)
+                return log_oom();
+
         for (;;) {
-                struct libmnt_fs *fs;
+                _cleanup_(mount_info_entry_freep) MountInfoEntry *e = NULL;
                 const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
-                int k;
+                struct libmnt_fs *fs;
+                int id;
 
-                k = mnt_table_next_fs(t, i, &fs);
-                if (k == 1)
+                r = mnt_table_next_fs(t, i, &fs);
+                if (r == 1)
                         break;
-                if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get next entry from /proc/self/mountinfo: %m");
 
                 device = mnt_fs_get_source(fs);
                 path = mnt_fs_get_target(fs);
@@ -1624,29 +1671,147 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (!device || !path)
                         continue;
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
+                e = new0(MountInfoEntry, 1);
+                if (!e)
+                        return log_oom();
+
+                if (cunescape(device, UNESCAPE_RELAX, &e->what) < 0)
+                        return log_oom();
+
+                if (cunescape(path, UNESCAPE_RELAX, &e->where) < 0)
                         return log_oom();
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+                e->options = strdup(strempty(options));
+                e->fstype = strdup(strempty(fstype));
+                if (!e->options || !e->fstype)
                         return log_oom();
 
-                device_found_node(m, d, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+                /* If there's no ID, key the entry by its position. That's unique too, it just makes any change look
+                 * like a change of all entries after it. */
+                n++;
+                id = mnt_fs_get_id(fs);
+
+                r = -EEXIST;
+                if (id > 0)
+                        r = ordered_hashmap_put(info, INT_TO_PTR(id), e);
+                if (r == -EEXIST)
+                        r = ordered_hashmap_put(info, INT_TO_PTR(-n), e);
+                if (r < 0)
+                        return log_oom();
+
+                e = NULL;
+        }
+
+        *ret = TAKE_PTR(info);
+        return 0;
+}
+
+static int mount_info_diff(OrderedHashmap *old, OrderedHashmap *new, Set **ret) {
+        _cleanup_set_free_free_ Set *touched = NULL;
+        MountInfoEntry *e, *o;
+        Iterator i;
+        void *key;
+        int r;
+
+        assert(ret);
+
+        /* Returns the mount points for which an entry was added, removed or changed */
+
+        touched = set_new(&path_hash_ops);
+        if (!touched)
+                return -ENOMEM;
+
+        ORDERED_HASHMAP_FOREACH_KEY(e, key, new, i) {
+                o = ordered_hashmap_get(old, key);
+                if (o && mount_info_entry_equal(o, e))
+                        continue;
+
+                r = set_put_strdup(touched, e->where);
+                if (r < 0)
+                        return r;
+
+                /* The mount might have been moved elsewhere */
+                if (o) {
+                        r = set_put_strdup(touched, o->where);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        ORDERED_HASHMAP_FOREACH_KEY(o, key, old, i) {
+                if (ordered_hashmap_contains(new, key))
+                        continue;
+
+                r = set_put_strdup(touched, o->where);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(touched);
+        return 0;
+}
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set **ret_touched) {
+        _cleanup_(mount_info_freep) OrderedHashmap *info = NULL;
+        _cleanup_set_free_free_ Set *touched = NULL;
+        MountInfoEntry *e;
+        Iterator i;
+        int r;
+
+        assert(m);
+
+        /* Sets up the mount units for what we find in /proc/self/mountinfo. If 'ret_touched' is non-NULL only the
+         * mount points are looked at for which something changed since the last time we were called, and these
+         * are returned. On container hosts with thousands of mounts this is typically a tiny fraction of them. If
+         * there's nothing to compare with, all of them are looked at, and NULL is returned. */
+
+        r = mount_parse_proc_self_mountinfo(&info);
+        if (r < 0)
+                return r;
+
+        if (ret_touched && m->mount_info)
+                (void) mount_info_diff(m->mount_info, info, &touched);
+
+        r = 0;
+        ORDERED_HASHMAP_FOREACH(e, info, i) {
+                int k;
+
+                if (touched && !set_contains(touched, e->where))
+                        continue;
+
+                device_found_node(m, e->what, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+
+                k = mount_setup_unit(m, e->what, e->where, e->options, e->fstype, set_flags);
                 if (r == 0 && k < 0)
                         r = k;
         }
 
-        return r;
+        mount_info_free(m->mount_info);
+
+        /* If we failed to set up some of the units, let's look at all of them next time */
+        if (r < 0) {
+                m->mount_info = NULL;
+                return r;
+        }
+
+        m->mount_info = TAKE_PTR(info);
+
+        if (ret_touched)
+                *ret_touched = TAKE_PTR(touched);
+
+        return 0;
 }
 
 static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_rescan_event_source = sd_event_source_unref(m->mount_rescan_event_source);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        m->mount_info = mount_info_free(m->mount_info);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1746,9 +1911,11 @@ static void mount_enumerate(Manager *m) {
                 }
 
                 (void) sd_event_source_set_description(m->mount_event_source, "mount-monitor-dispatch");
+
+                RATELIMIT_INIT(m->mount_rescan_ratelimit, 1 * USEC_PER_SEC, 5);
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1758,41 +1925,84 @@ fail:
         mount_shutdown(m);
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static void mount_process_proc_self_mountinfo_unit(Mount *mount, Set **gone) {
+        assert(mount);
+        assert(gone);
+
+        if (!mount_is_mounted(mount)) {
+
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. */
+
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what) {
+
+                        /* Remember that this device might just have disappeared */
+                        if (set_ensure_allocated(gone, &path_hash_ops) < 0 ||
+                            set_put(*gone, mount->parameters_proc_self_mountinfo.what) < 0)
+                                log_oom(); /* we don't care too much about OOM here... */
+                }
+
+                mount->from_proc_self_mountinfo = false;
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(UNIT(mount));
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+}
+
+static int mount_process_proc_self_mountinfo(Manager *m) {
         _cleanup_set_free_ Set *around = NULL, *gone = NULL;
-        Manager *m = userdata;
-        const char *what;
+        _cleanup_set_free_free_ Set *touched = NULL;
+        const char *what, *where;
+        MountInfoEntry *e;
         Iterator i;
         Unit *u;
         int r;
 
         assert(m);
-        assert(revents & EPOLLIN);
-
-        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
-                bool rescan = false;
-
-                /* Drain all events and verify that the event is valid.
-                 *
-                 * Note that libmount also monitors /run/mount mkdir if the
-                 * directory does not exist yet. The mkdir may generate event
-                 * which is irrelevant for us.
-                 *
-                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
-                do {
-                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
-                        if (r == 0)
-                                rescan = true;
-                        else if (r < 0)
-                                return log_error_errno(r, "Failed to drain libmount events");
-                } while (r == 0);
-
-                log_debug("libmount event [rescan: %s]", yes_no(rescan));
-                if (!rescan)
-                        return 0;
-        }
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, &touched);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
@@ -1806,94 +2016,154 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
+        if (touched)
+                /* Only the units of mount points that changed need a look, for all others the flags are
+                 * unset anyway */
+                SET_FOREACH(where, touched, i) {
+                        _cleanup_free_ char *name = NULL;
 
-                if (!mount_is_mounted(mount)) {
+                        if (unit_name_from_path(where, ".mount", &name) < 0)
+                                continue;
 
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
+                        u = manager_get_unit(m, name);
+                        if (!u)
+                                continue;
 
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
+                        mount_process_proc_self_mountinfo_unit(MOUNT(u), &gone);
 
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &path_hash_ops) < 0 ||
-                                    set_put(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
+                        /* Reset the flags for later calls */
+                        MOUNT(u)->is_mounted = MOUNT(u)->just_mounted = MOUNT(u)->just_changed = false;
+                }
+        else
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        mount_process_proc_self_mountinfo_unit(MOUNT(u), &gone);
 
-                        mount->from_proc_self_mountinfo = false;
+                        /* Reset the flags for later calls */
+                        MOUNT(u)->is_mounted = MOUNT(u)->just_mounted = MOUNT(u)->just_changed = false;
+                }
 
-                        switch (mount->state) {
+        if (set_isempty(gone))
+                return 0;
 
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
+        /* A device might still be mounted elsewhere */
+        ORDERED_HASHMAP_FOREACH(e, m->mount_info, i)
+                if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
+                    set_put(around, e->what) < 0)
+                        log_oom();
 
-                        default:
-                                break;
-                        }
+        SET_FOREACH(what, gone, i) {
+                if (set_contains(around, what))
+                        continue;
 
-                } else if (mount->just_mounted || mount->just_changed) {
+                /* Let the device units know that the device is no longer mounted */
+                device_found_node(m, what, 0, DEVICE_FOUND_MOUNT);
+        }
 
-                        /* A mount point was added or changed */
+        return 0;
+}
 
-                        switch (mount->state) {
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
 
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
+        assert(m);
 
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(UNIT(mount));
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+        return mount_process_proc_self_mountinfo(m);
+}
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+static bool mount_rescan_pending(Manager *m) {
+        int enabled;
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
-                }
+        assert(m);
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
+        if (!m->mount_rescan_event_source)
+                return false;
 
-                        if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
+        if (sd_event_source_get_enabled(m->mount_rescan_event_source, &enabled) < 0)
+                return false;
 
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
-        }
+        return enabled != SD_EVENT_OFF;
+}
 
-        SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
-                        continue;
+static int mount_schedule_rescan(Manager *m) {
+        usec_t usec;
+        int r;
 
-                /* Let the device units know that the device is no longer mounted */
-                device_found_node(m, what, 0, DEVICE_FOUND_MOUNT);
+        assert(m);
+
+        /* Process the table when the current rate limit interval is over, by then all changes that came in
+         * until then are coalesced into one run */
+        usec = usec_add(m->mount_rescan_ratelimit.begin, m->mount_rescan_ratelimit.interval);
+
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, usec);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
         }
 
+        r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, usec, 0, mount_dispatch_rescan, m);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(m->mount_rescan_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+
         return 0;
 }
 
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLIN);
+
+        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
+                bool rescan = false;
+
+                /* Drain all events and verify that the event is valid.
+                 *
+                 * Note that libmount also monitors /run/mount mkdir if the
+                 * directory does not exist yet. The mkdir may generate event
+                 * which is irrelevant for us.
+                 *
+                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
+                do {
+                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
+                        if (r == 0)
+                                rescan = true;
+                        else if (r < 0)
+                                return log_error_errno(r, "Failed to drain libmount events");
+                } while (r == 0);
+
+                log_debug("libmount event [rescan: %s]", yes_no(rescan));
+                if (!rescan)
+                        return 0;
+        }
+
+        /* Already scheduled? Then this change will be picked up along with the others */
+        if (mount_rescan_pending(m))
+                return 0;
+
+        /* When mounts come and go in bursts, such as when starting containers on a host, let's not process the
+         * whole table for every single one of them */
+        if (!ratelimit_below(&m->mount_rescan_ratelimit)) {
+                r = mount_schedule_rescan(m);
+                if (r >= 0) {
+                        log_debug("Mount table changes are coming in quickly, processing them in a moment.");
+                        return 0;
+                }
+
+                log_debug_errno(r, "Failed to schedule processing of the mount table, doing it right away: %m");
+        }
+
+        return mount_process_proc_self_mountinfo(m);
+}
+
 static void mount_reset_failed(Unit *u) {
         Mount *m = MOUNT(u);
 
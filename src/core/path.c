@@ -5,15 +5,18 @@
 #include <sys/inotify.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "bus-error.h"
 #include "bus-util.h"
 #include "dbus-path.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
 #include "macro.h"
 #include "mkdir.h"
 #include "path.h"
+#include "set.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-table.h"
@@ -28,9 +31,295 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int path_dispatch_inotify(PathSpec *s, bool changed);
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+typedef struct PathInotifyWatch {
+        int wd;
+
+        /* The mask currently installed in the kernel */
+        uint32_t mask;
+
+        Set *specs;
+} PathInotifyWatch;
+
+static PathInotifyWatch* path_inotify_watch_free(Manager *m, PathInotifyWatch *w) {
+        assert(m);
+
+        if (!w)
+                return NULL;
+
+        (void) hashmap_remove_value(m->path_inotify_watches, INT_TO_PTR(w->wd), w);
+        set_free(w->specs);
+        return mfree(w);
+}
+
+static PathSpecWatch* path_spec_find_watch(PathSpec *s, int wd) {
+        size_t i;
+
+        assert(s);
+
+        for (i = 0; i < s->n_watches; i++)
+                if (s->watches[i].wd == wd)
+                        return s->watches + i;
+
+        return NULL;
+}
+
+static void path_spec_queue(PathSpec *s, bool changed) {
+        Manager *m;
+
+        assert(s);
+        assert(s->unit);
+
+        m = s->unit->manager;
+
+        if (changed && IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED))
+                s->inotify_changed = true;
+
+        if (set_put(m->path_inotify_pending, s) < 0)
+                log_oom();
+}
+
+static void path_spec_queue_event(PathSpec *s, const struct inotify_event *e) {
+        PathSpecWatch *w;
+
+        assert(s);
+        assert(e);
+
+        w = path_spec_find_watch(s, e->wd);
+        if (!w)
+                return;
+
+        /* The kernel watch might have been set up with a larger mask by another spec, filter out what we didn't ask
+         * for, as well as events about unrelated entries of the parent directories. */
+        if (!(e->mask & (w->mask | IN_IGNORED | IN_UNMOUNT)))
+                return;
+        if (w->name && e->len > 0 && !streq(e->name, w->name))
+                return;
+
+        path_spec_queue(s, e->wd == s->primary_wd);
+}
+
+static int on_path_inotify_event(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        PathInotifyWatch *w;
+        bool overflow = false;
+        Iterator i, j;
+        PathSpec *s;
+        int r = 0;
+
+        assert(source);
+        assert(fd >= 0);
+        assert(m);
+
+        /* A single change usually results in a number of events, on the path itself as well as on its parent
+         * directories, and possibly for several specs watching the same inode. Hence, first collect the specs with
+         * any relevant events pending, and then dispatch each of them only once. */
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
+
+                l = read(fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (IN_SET(errno, EINTR, EAGAIN))
+                                break;
+
+                        r = log_error_errno(errno, "Failed to read path inotify events: %m");
+                        break;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        if (e->wd < 0) {
+                                if (e->mask & IN_Q_OVERFLOW)
+                                        overflow = true;
+                                continue;
+                        }
+
+                        /* Note that inotify might deliver events for a watch even after it was removed, because
+                         * they were queued before the removal. Let's ignore these here safely. */
+                        w = hashmap_get(m->path_inotify_watches, INT_TO_PTR(e->wd));
+                        if (!w)
+                                continue;
+
+                        SET_FOREACH(s, w->specs, i)
+                                path_spec_queue_event(s, e);
+
+                        /* The watched inode went away, and the kernel dropped the watch */
+                        if (e->mask & IN_IGNORED)
+                                path_inotify_watch_free(m, w);
+                }
+        }
+
+        if (overflow) {
+                /* We lost events, hence assume everything changed */
+                log_debug("Path inotify queue overflowed, checking all watched paths.");
+
+                HASHMAP_FOREACH(w, m->path_inotify_watches, i)
+                        SET_FOREACH(s, w->specs, j)
+                                path_spec_queue(s, true);
+        }
+
+        /* The handlers might unwatch and rewatch other specs, which removes them from the pending set, hence don't
+         * iterate, but pop one spec at a time. */
+        while ((s = set_steal_first(m->path_inotify_pending))) {
+                bool changed = s->inotify_changed;
+
+                s->inotify_changed = false;
+                (void) s->handler(s, changed);
+        }
+
+        return r;
+}
+
+static int manager_setup_path_inotify(Manager *m) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(m);
+
+        if (m->path_inotify_fd >= 0)
+                return 0;
+
+        r = hashmap_ensure_allocated(&m->path_inotify_watches, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_ensure_allocated(&m->path_inotify_pending, NULL);
+        if (r < 0)
+                return r;
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to create path inotify object: %m");
+
+        r = sd_event_add_io(m->event, &m->path_inotify_event_source, fd, EPOLLIN, on_path_inotify_event, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch path inotify object: %m");
+
+        (void) sd_event_source_set_description(m->path_inotify_event_source, "path");
+
+        m->path_inotify_fd = TAKE_FD(fd);
+        return 0;
+}
+
+static uint32_t path_inotify_watch_mask(PathInotifyWatch *w) {
+        uint32_t mask = 0;
+        PathSpecWatch *sw;
+        Iterator i;
+        PathSpec *s;
+
+        assert(w);
+
+        SET_FOREACH(s, w->specs, i) {
+                sw = path_spec_find_watch(s, w->wd);
+                if (sw)
+                        mask |= sw->mask;
+        }
+
+        return mask;
+}
+
+static int path_spec_add_watch(PathSpec *s, const char *path, uint32_t mask, const char *name, size_t name_len) {
+        _cleanup_free_ char *n = NULL;
+        PathInotifyWatch *w;
+        PathSpecWatch *sw;
+        Manager *m;
+        uint32_t total;
+        int wd, r;
+
+        assert(s);
+        assert(path);
+
+        m = s->unit->manager;
+
+        if (name) {
+                n = strndup(name, name_len);
+                if (!n)
+                        return -ENOMEM;
+        }
+
+        /* Watches on the same inode share the watch descriptor, make sure we don't drop what others asked for */
+        wd = inotify_add_watch(m->path_inotify_fd, path, mask|IN_MASK_ADD);
+        if (wd < 0)
+                return -errno;
+
+        w = hashmap_get(m->path_inotify_watches, INT_TO_PTR(wd));
+        if (!w) {
+                w = new0(PathInotifyWatch, 1);
+                if (!w) {
+                        (void) inotify_rm_watch(m->path_inotify_fd, wd);
+                        return -ENOMEM;
+                }
+
+                w->wd = wd;
+
+                r = hashmap_put(m->path_inotify_watches, INT_TO_PTR(wd), w);
+                if (r < 0) {
+                        free(w);
+                        (void) inotify_rm_watch(m->path_inotify_fd, wd);
+                        return r;
+                }
+        }
+        w->mask |= mask;
+
+        sw = path_spec_find_watch(s, wd);
+        if (!sw) {
+                r = set_ensure_allocated(&w->specs, NULL);
+                if (r < 0)
+                        goto fail;
+
+                if (!GREEDY_REALLOC(s->watches, s->n_watches_allocated, s->n_watches + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                r = set_put(w->specs, s);
+                if (r < 0)
+                        goto fail;
+
+                sw = s->watches + s->n_watches++;
+                *sw = (PathSpecWatch) {
+                        .wd = wd,
+                };
+        }
+
+        /* A later watch on the same inode by the same spec replaces the earlier one, like inotify_add_watch()
+         * without IN_MASK_ADD would */
+        sw->mask = mask;
+        free_and_replace(sw->name, n);
+
+        /* If nobody needs the full mask anymore, narrow the kernel watch down, so that we aren't woken up for
+         * nothing. If the path refers to a different inode by now, don't touch that. */
+        total = path_inotify_watch_mask(w);
+        if (total != w->mask) {
+                r = inotify_add_watch(m->path_inotify_fd, path, total);
+                if (r == wd)
+                        w->mask = total;
+                else if (r >= 0) {
+                        PathInotifyWatch *other;
+
+                        other = hashmap_get(m->path_inotify_watches, INT_TO_PTR(r));
+                        if (other)
+                                (void) inotify_add_watch(m->path_inotify_fd, path, other->mask);
+                        else
+                                (void) inotify_rm_watch(m->path_inotify_fd, r);
+                }
+        }
+
+        return wd;
+
+fail:
+        if (set_isempty(w->specs)) {
+                path_inotify_watch_free(m, w);
+                (void) inotify_rm_watch(m->path_inotify_fd, wd);
+        }
+
+        return r;
+}
+
+int path_spec_watch(PathSpec *s, path_spec_handler_t handler) {
 
         static const int flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
@@ -50,22 +339,18 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
-                goto fail;
-        }
-
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
+        r = manager_setup_path_inotify(s->unit->manager);
         if (r < 0)
-                goto fail;
+                return r;
 
-        (void) sd_event_source_set_description(s->event_source, "path");
+        s->handler = handler;
 
         /* This function assumes the path was passed through path_simplify()! */
         assert(!strstr(s->path, "//"));
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
+                const char *name = NULL;
+                size_t name_len = 0;
                 char *cut = NULL;
                 int flags;
                 char tmp;
@@ -75,19 +360,25 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                         tmp = *cut;
                         *cut = '\0';
 
+                        /* Only the next component is of interest in this directory, unless it is a glob */
+                        if (s->type != PATH_EXISTS_GLOB) {
+                                name = slash + 1;
+                                name_len = strchrnul(name, '/') - name;
+                        }
+
                         flags = IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB | IN_CREATE | IN_MOVED_TO;
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = path_spec_add_watch(s, s->path, flags, name, name_len);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
                                 break;
                         }
 
-                        r = log_warning_errno(errno, "Failed to add watch on %s: %s", s->path, errno == ENOSPC ? "too many watches" : strerror(-r));
+                        log_warning_errno(r, "Failed to add watch on %s: %s", s->path, r == -ENOSPC ? "too many watches" : strerror(-r));
                         if (cut)
                                 *cut = tmp;
                         goto fail;
@@ -100,7 +391,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                                 char tmp2 = *cut2;
                                 *cut2 = '\0';
 
-                                (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                                (void) path_spec_add_watch(s, s->path, IN_MOVE_SELF, NULL, 0);
                                 /* Error is ignored, the worst can happen is we get spurious events. */
 
                                 *cut2 = tmp2;
@@ -120,7 +411,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
@@ -133,38 +424,33 @@ fail:
 }
 
 void path_spec_unwatch(PathSpec *s) {
+        Manager *m;
+        size_t i;
+
         assert(s);
+        assert(s->unit);
 
-        s->event_source = sd_event_source_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
-}
+        m = s->unit->manager;
 
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
-        union inotify_event_buffer buffer;
-        struct inotify_event *e;
-        ssize_t l;
-        int r = 0;
+        for (i = 0; i < s->n_watches; i++) {
+                PathInotifyWatch *w;
 
-        if (revents != EPOLLIN) {
-                log_error("Got invalid poll event on inotify.");
-                return -EINVAL;
-        }
-
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
-        if (l < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+                /* Drop the kernel watch only when we were the last ones using it */
+                w = hashmap_get(m->path_inotify_watches, INT_TO_PTR(s->watches[i].wd));
+                if (w && set_remove(w->specs, s) && set_isempty(w->specs)) {
+                        path_inotify_watch_free(m, w);
+                        (void) inotify_rm_watch(m->path_inotify_fd, s->watches[i].wd);
+                }
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
+                free(s->watches[i].name);
         }
 
-        FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
-                    s->primary_wd == e->wd)
-                        r = 1;
-        }
+        s->watches = mfree(s->watches);
+        s->n_watches = s->n_watches_allocated = 0;
+        s->primary_wd = -1;
 
-        return r;
+        (void) set_remove(m->path_inotify_pending, s);
+        s->inotify_changed = false;
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial) {
@@ -226,7 +512,7 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(s->n_watches == 0);
 
         free(s->path);
 }
@@ -398,7 +684,7 @@ static int path_watch(Path *p) {
         assert(p);
 
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch(s, path_dispatch_inotify);
                 if (r < 0)
                         return r;
         }
@@ -650,34 +936,24 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        PathSpec *s = userdata;
+static int path_dispatch_inotify(PathSpec *s, bool changed) {
+        PathSpec *other;
         Path *p;
-        int changed;
 
         assert(s);
         assert(s->unit);
-        assert(fd >= 0);
 
         p = PATH(s->unit);
 
         if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
                 return 0;
 
-        /* log_debug("inotify wakeup on %s.", u->id); */
-
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
-
-        if (!s) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
-
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
-                goto fail;
+        /* Fold in the events for our other specs from the same batch, so that we only act once */
+        LIST_FOREACH(spec, other, p->specs)
+                if (set_remove(UNIT(p)->manager->path_inotify_pending, other)) {
+                        changed = changed || other->inotify_changed;
+                        other->inotify_changed = false;
+                }
 
         /* If we are already running, then remember that one event was
          * dispatched so that we restart the service only if something
@@ -690,10 +966,20 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
                 path_enter_waiting(p, false, true);
 
         return 0;
+}
 
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
-        return 0;
+static void path_shutdown(Manager *m) {
+        PathInotifyWatch *w;
+
+        assert(m);
+
+        while ((w = hashmap_first(m->path_inotify_watches)))
+                path_inotify_watch_free(m, w);
+
+        m->path_inotify_watches = hashmap_free(m->path_inotify_watches);
+        m->path_inotify_pending = set_free(m->path_inotify_pending);
+        m->path_inotify_event_source = sd_event_source_unref(m->path_inotify_event_source);
+        m->path_inotify_fd = safe_close(m->path_inotify_fd);
 }
 
 static void path_trigger_notify(Unit *u, Unit *other) {
@@ -780,6 +1066,8 @@ const UnitVTable path_vtable = {
 
         .reset_failed = path_reset_failed,
 
+        .shutdown = path_shutdown,
+
         .bus_vtable = bus_path_vtable,
         .bus_set_property = bus_path_set_property,
 };
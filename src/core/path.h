@@ -16,31 +16,43 @@ typedef enum PathType {
         _PATH_TYPE_INVALID = -1
 } PathType;
 
+/* Invoked once per batch of inotify events for a PathSpec, 'changed' is true if the watched path itself was changed
+ * in a way that matters for PathChanged=/PathModified= */
+typedef int (*path_spec_handler_t)(PathSpec *s, bool changed);
+
+typedef struct PathSpecWatch {
+        int wd;
+        uint32_t mask;
+
+        /* For watches on the parent directories: the name of the next path component, events about other
+         * directory entries are not relevant for us */
+        char *name;
+} PathSpecWatch;
+
 typedef struct PathSpec {
         Unit *unit;
 
         char *path;
 
-        sd_event_source *event_source;
-
         LIST_FIELDS(struct PathSpec, spec);
 
         PathType type;
-        int inotify_fd;
         int primary_wd;
 
+        /* The watches we hold on the manager's shared inotify object */
+        PathSpecWatch *watches;
+        size_t n_watches, n_watches_allocated;
+
+        path_spec_handler_t handler;
+        bool inotify_changed;
+
         bool previous_exists;
 } PathSpec;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler);
+int path_spec_watch(PathSpec *s, path_spec_handler_t handler);
 void path_spec_unwatch(PathSpec *s);
-int path_spec_fd_event(PathSpec *s, uint32_t events);
 void path_spec_done(PathSpec *s);
 
-static inline bool path_spec_owns_inotify_fd(PathSpec *s, int fd) {
-        return s->inotify_fd == fd;
-}
-
 typedef enum PathResult {
         PATH_SUCCESS,
         PATH_FAILURE_RESOURCES,
@@ -0,0 +1,327 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "serialize.h"
+#include "string-table.h"
+#include "string-util.h"
+
+/* A NUL byte never shows up in the text format, hence this can't be mistaken for it */
+#define BINARY_MAGIC "\0SDSER1\n"
+#define BINARY_MAGIC_SIZE 8
+
+/* All record types start with a type byte, followed by a 32bit length and that many bytes of payload. Records are
+ * passed between processes on the same host, hence native endianness is fine. */
+enum {
+        RECORD_LINE = 'L',        /* "key=value" */
+        RECORD_UNIT = 'U',        /* unit name, introduces a unit section */
+        RECORD_END = 'E',         /* end of section, no payload */
+};
+
+#define RECORD_SIZE_MAX (16U*1024U*1024U)
+
+static void write_record(FILE *f, uint8_t type, const char *key, const char *value) {
+        size_t k, v = 0;
+        uint32_t l;
+
+        /* Writes a record with "key=value" as payload, or just "key" if value is NULL */
+
+        k = strlen(key);
+        if (value)
+                v = strlen(value) + 1;
+
+        l = (uint32_t) (k + v);
+
+        fputc_unlocked(type, f);
+        fwrite_unlocked(&l, sizeof(l), 1, f);
+        fwrite_unlocked(key, 1, k, f);
+
+        if (value) {
+                fputc_unlocked('=', f);
+                fwrite_unlocked(value, 1, v - 1, f);
+        }
+}
+
+int serialize_header(FILE *f, SerializationFormat format) {
+        assert(f);
+
+        if (format == SERIALIZATION_BINARY)
+                fwrite_unlocked(BINARY_MAGIC, 1, BINARY_MAGIC_SIZE, f);
+
+        return 0;
+}
+
+void serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value) {
+        assert(f);
+        assert(key);
+        assert(value);
+
+        if (format == SERIALIZATION_BINARY) {
+                write_record(f, RECORD_LINE, key, value);
+                return;
+        }
+
+        fputs(key, f);
+        fputc('=', f);
+        fputs(value, f);
+        fputc('\n', f);
+}
+
+void serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *fmt, va_list ap) {
+        _cleanup_free_ char *allocated = NULL;
+        char buf[LINE_MAX];
+        const char *value;
+        va_list aq;
+        int n;
+
+        assert(f);
+        assert(key);
+        assert(fmt);
+
+        if (format != SERIALIZATION_BINARY) {
+                fputs(key, f);
+                fputc('=', f);
+                vfprintf(f, fmt, ap);
+                fputc('\n', f);
+                return;
+        }
+
+        /* We need to know the length before writing the value out, hence format it into a buffer first */
+        va_copy(aq, ap);
+        n = vsnprintf(buf, sizeof(buf), fmt, aq);
+        va_end(aq);
+        if (n < 0)
+                return;
+
+        if ((size_t) n < sizeof(buf))
+                value = buf;
+        else {
+                if (vasprintf(&allocated, fmt, ap) < 0) {
+                        allocated = NULL;
+                        return;
+                }
+
+                value = allocated;
+        }
+
+        write_record(f, RECORD_LINE, key, value);
+}
+
+void serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *fmt, ...) {
+        va_list ap;
+
+        va_start(ap, fmt);
+        serialize_item_formatv(f, format, key, fmt, ap);
+        va_end(ap);
+}
+
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, const dual_timestamp *t) {
+        assert(f);
+        assert(key);
+        assert(t);
+
+        if (!dual_timestamp_is_set(t))
+                return;
+
+        serialize_item_format(f, format, key, USEC_FMT " " USEC_FMT, t->realtime, t->monotonic);
+}
+
+void serialize_marker(FILE *f, SerializationFormat format, const char *marker) {
+        assert(f);
+        assert(marker);
+
+        /* A line without any value */
+
+        if (format == SERIALIZATION_BINARY)
+                write_record(f, RECORD_LINE, marker, NULL);
+        else {
+                fputs(marker, f);
+                fputc('\n', f);
+        }
+}
+
+void serialize_unit(FILE *f, SerializationFormat format, const char *name) {
+        assert(f);
+        assert(name);
+
+        if (format == SERIALIZATION_BINARY)
+                write_record(f, RECORD_UNIT, name, NULL);
+        else {
+                fputs(name, f);
+                fputc('\n', f);
+        }
+}
+
+void serialize_end(FILE *f, SerializationFormat format) {
+        assert(f);
+
+        fputc_unlocked(format == SERIALIZATION_BINARY ? RECORD_END : '\n', f);
+}
+
+int deserialize_header(FILE *f, SerializationFormat *ret) {
+        char magic[BINARY_MAGIC_SIZE];
+        off_t offset;
+
+        assert(f);
+        assert(ret);
+
+        /* Detects the format of a serialization, positioning f after the header */
+
+        offset = ftello(f);
+        if (offset < 0)
+                return -errno;
+
+        if (fread_unlocked(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+            memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0) {
+                *ret = SERIALIZATION_BINARY;
+                return 0;
+        }
+
+        if (ferror(f))
+                return -EIO;
+
+        if (fseeko(f, offset, SEEK_SET) < 0)
+                return -errno;
+
+        *ret = SERIALIZATION_TEXT;
+        return 0;
+}
+
+static int read_record(FILE *f, DeserializationBuffer *b, int *ret_type, char **ret) {
+        uint32_t l;
+        int type;
+
+        type = fgetc_unlocked(f);
+        if (type == EOF)
+                return ferror(f) ? -EIO : 0;
+
+        if (type == RECORD_END) {
+                *ret_type = type;
+                *ret = NULL;
+                return 1;
+        }
+
+        if (!IN_SET(type, RECORD_LINE, RECORD_UNIT))
+                return -EBADMSG;
+
+        if (fread_unlocked(&l, sizeof(l), 1, f) != 1)
+                return ferror(f) ? -EIO : -EBADMSG;
+        if (l > RECORD_SIZE_MAX)
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(b->data, b->allocated, (size_t) l + 1))
+                return -ENOMEM;
+
+        if (fread_unlocked(b->data, 1, l, f) != l)
+                return ferror(f) ? -EIO : -EBADMSG;
+
+        b->data[l] = 0;
+
+        *ret_type = type;
+        *ret = b->data;
+        return 1;
+}
+
+static int read_text_line(FILE *f, DeserializationBuffer *b, char **ret) {
+        if (!GREEDY_REALLOC(b->data, b->allocated, LINE_MAX))
+                return -ENOMEM;
+
+        if (!fgets(b->data, LINE_MAX, f)) {
+                if (feof(f))
+                        return 0;
+                return errno > 0 ? -errno : -EIO;
+        }
+
+        b->data[LINE_MAX-1] = 0;
+        *ret = strstrip(b->data);
+        return 1;
+}
+
+int deserialize_line(FILE *f, SerializationFormat format, DeserializationBuffer *b, char **ret) {
+        char *l;
+        int r, type;
+
+        assert(f);
+        assert(b);
+        assert(ret);
+
+        /* Reads the next item of the current section. Returns 0 at the end of the section or the file, > 0 if an item
+         * was read. The returned string is valid until the buffer is used again. */
+
+        if (format == SERIALIZATION_BINARY) {
+                r = read_record(f, b, &type, &l);
+                if (r <= 0)
+                        return r;
+                if (type == RECORD_END)
+                        return 0;
+                if (type != RECORD_LINE)
+                        return -EBADMSG;
+        } else {
+                r = read_text_line(f, b, &l);
+                if (r <= 0)
+                        return r;
+                if (isempty(l))
+                        return 0;
+        }
+
+        *ret = l;
+        return 1;
+}
+
+int deserialize_unit(FILE *f, SerializationFormat format, DeserializationBuffer *b, char **ret) {
+        char *l;
+        int r, type;
+
+        assert(f);
+        assert(b);
+        assert(ret);
+
+        /* Reads the name introducing the next unit section. Returns 0 at the end of the file. */
+
+        if (format == SERIALIZATION_BINARY) {
+                r = read_record(f, b, &type, &l);
+                if (r <= 0)
+                        return r;
+                if (type != RECORD_UNIT)
+                        return -EBADMSG;
+        } else {
+                r = read_text_line(f, b, &l);
+                if (r <= 0)
+                        return r;
+        }
+
+        *ret = l;
+        return 1;
+}
+
+int deserialize_skip(FILE *f, SerializationFormat format, DeserializationBuffer *b) {
+        char *l;
+        int r;
+
+        assert(f);
+        assert(b);
+
+        /* Skips the rest of the current section, including the job sections nested in it */
+
+        for (;;) {
+                r = deserialize_line(f, format, b, &l);
+                if (r <= 0)
+                        return r;
+
+                if (streq(l, "job")) {
+                        r = deserialize_skip(f, format, b);
+                        if (r < 0)
+                                return r;
+                }
+        }
+}
+
+static const char* const serialization_format_table[_SERIALIZATION_FORMAT_MAX] = {
+        [SERIALIZATION_TEXT] = "text",
+        [SERIALIZATION_BINARY] = "binary",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(serialization_format, SerializationFormat);
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* The manager's state is serialized as a sequence of sections: the manager's own items, followed by one section per
+ * unit (and per job of a unit), each introduced by the unit's name. An item is a "key=value" line.
+ *
+ * In the text format every item is a line of its own and sections are terminated by an empty line. The binary
+ * format carries the same items, but as length-prefixed records, so that reading them back doesn't involve
+ * scanning for line ends, and items aren't limited to LINE_MAX. Versions predating it can't read it, hence it is only
+ * used when reloading or reexecuting ourselves, not when switching root. */
+
+typedef enum SerializationFormat {
+        SERIALIZATION_TEXT,
+        SERIALIZATION_BINARY,
+        _SERIALIZATION_FORMAT_MAX,
+        _SERIALIZATION_FORMAT_INVALID = -1,
+} SerializationFormat;
+
+typedef struct DeserializationBuffer {
+        char *data;
+        size_t allocated;
+} DeserializationBuffer;
+
+static inline void deserialization_buffer_done(DeserializationBuffer *b) {
+        b->data = mfree(b->data);
+        b->allocated = 0;
+}
+
+int serialize_header(FILE *f, SerializationFormat format);
+void serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value);
+void serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *fmt, va_list ap) _printf_(4,0);
+void serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *fmt, ...) _printf_(4,5);
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, const dual_timestamp *t);
+void serialize_marker(FILE *f, SerializationFormat format, const char *marker);
+void serialize_unit(FILE *f, SerializationFormat format, const char *name);
+void serialize_end(FILE *f, SerializationFormat format);
+
+int deserialize_header(FILE *f, SerializationFormat *ret);
+int deserialize_line(FILE *f, SerializationFormat format, DeserializationBuffer *b, char **ret);
+int deserialize_unit(FILE *f, SerializationFormat format, DeserializationBuffer *b, char **ret);
+int deserialize_skip(FILE *f, SerializationFormat format, DeserializationBuffer *b);
+
+const char *serialization_format_to_string(SerializationFormat f) _const_;
+SerializationFormat serialization_format_from_string(const char *s) _pure_;
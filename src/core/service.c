@@ -1,7 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <poll.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "sd-messages.h"
@@ -20,13 +23,16 @@
 #include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "load-dropin.h"
 #include "load-fragment.h"
 #include "log.h"
 #include "manager.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "serialize.h"
 #include "service.h"
 #include "signal-util.h"
 #include "special.h"
@@ -79,7 +85,7 @@ static const UnitActiveState state_translation_table_idle[_SERVICE_STATE_MAX] =
         [SERVICE_AUTO_RESTART] = UNIT_ACTIVATING
 };
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
+static int service_dispatch_inotify_io(PathSpec *p, bool changed);
 static int service_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_exec_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
@@ -99,6 +105,7 @@ static void service_init(Unit *u) {
         s->runtime_max_usec = USEC_INFINITY;
         s->type = _SERVICE_TYPE_INVALID;
         s->socket_fd = -1;
+        s->main_pid_fd = -1;
         s->stdin_fd = s->stdout_fd = s->stderr_fd = -1;
         s->guess_main_pid = true;
 
@@ -118,9 +125,18 @@ static void service_unwatch_control_pid(Service *s) {
         s->control_pid = 0;
 }
 
+static void service_close_main_pid_fd(Service *s) {
+        assert(s);
+
+        s->main_pid_event_source = sd_event_source_unref(s->main_pid_event_source);
+        s->main_pid_fd = safe_close(s->main_pid_fd);
+}
+
 static void service_unwatch_main_pid(Service *s) {
         assert(s);
 
+        service_close_main_pid_fd(s);
+
         if (s->main_pid <= 0)
                 return;
 
@@ -138,8 +154,65 @@ static void service_unwatch_pid_file(Service *s) {
         s->pid_file_pathspec = mfree(s->pid_file_pathspec);
 }
 
+static int service_dispatch_main_pid_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Service *s = SERVICE(userdata);
+        siginfo_t si = {};
+        pid_t pid;
+
+        assert(s);
+        assert(fd == s->main_pid_fd);
+
+        pid = s->main_pid;
+        service_close_main_pid_fd(s);
+
+        /* If the process got reparented to us after all, the SIGCHLD handler will collect its exit status */
+        if (waitid(P_PID, pid, &si, WEXITED|WNOHANG|WNOWAIT) >= 0 && si.si_pid == pid)
+                return 0;
+
+        /* Otherwise there is no exit status we could collect, hence all we can do is treat this as a clean
+         * exit, the same way we do when we notice by other means that an alien main process is gone. */
+        log_unit_debug(UNIT(s), "Main process "PID_FMT", which is not our child, exited.", pid);
+
+        unit_unwatch_pid(UNIT(s), pid);
+        UNIT_VTABLE(UNIT(s))->sigchld_event(UNIT(s), pid, CLD_EXITED, EXIT_SUCCESS);
+
+        return 0;
+}
+
+static int service_watch_main_pid_fd(Service *s) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *source = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(s->main_pid > 0);
+        assert(s->main_pid_fd < 0);
+
+        fd = pidfd_open(s->main_pid, 0);
+        if (fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(UNIT(s)->manager->event, &source, fd, EPOLLIN, service_dispatch_main_pid_fd, s);
+        if (r < 0)
+                return r;
+
+        /* Run after the SIGCHLD handler, so that a process that got reparented to us is reaped there with its
+         * proper exit status */
+        r = sd_event_source_set_priority(source, SD_EVENT_PRIORITY_NORMAL-5);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(source, "service-main-pid");
+
+        s->main_pid_event_source = TAKE_PTR(source);
+        s->main_pid_fd = TAKE_FD(fd);
+
+        return 0;
+}
+
 static int service_set_main_pid(Service *s, pid_t pid) {
         pid_t ppid;
+        int r;
 
         assert(s);
 
@@ -160,9 +233,17 @@ static int service_set_main_pid(Service *s, pid_t pid) {
         s->main_pid = pid;
         s->main_pid_known = true;
 
+        service_close_main_pid_fd(s);
+
         if (get_process_ppid(pid, &ppid) >= 0 && ppid != getpid_cached()) {
-                log_unit_warning(UNIT(s), "Supervising process "PID_FMT" which is not our child. We'll most likely not notice when it exits.", pid);
                 s->main_pid_alien = true;
+
+                r = service_watch_main_pid_fd(s);
+                if (r < 0) {
+                        log_unit_debug_errno(UNIT(s), r, "Failed to watch main process "PID_FMT" via pidfd, ignoring: %m", pid);
+                        log_unit_warning(UNIT(s), "Supervising process "PID_FMT" which is not our child. We'll most likely not notice when it exits.", pid);
+                } else
+                        log_unit_debug(UNIT(s), "Supervising process "PID_FMT" which is not our child, watching it via pidfd.", pid);
         } else
                 s->main_pid_alien = false;
 
@@ -209,6 +290,20 @@ static void service_start_watchdog(Service *s) {
                 return;
 
         if (s->watchdog_event_source) {
+                usec_t armed;
+                int enabled;
+
+                /* Services ping the watchdog much more often than it expires. Rearming the timer on each ping
+                 * means moving it around in the event loop's priority queue every time, hence if the timer
+                 * already fires no later than the new deadline, leave it alone: when it elapses,
+                 * service_dispatch_watchdog() checks the last ping and moves the timer to the actual deadline.
+                 * This way each service's timer is touched at most once per watchdog interval. */
+                if (sd_event_source_get_enabled(s->watchdog_event_source, &enabled) >= 0 &&
+                    enabled != SD_EVENT_OFF &&
+                    sd_event_source_get_time(s->watchdog_event_source, &armed) >= 0 &&
+                    armed <= usec_add(s->watchdog_timestamp.monotonic, watchdog_usec))
+                        return;
+
                 r = sd_event_source_set_time(s->watchdog_event_source, usec_add(s->watchdog_timestamp.monotonic, watchdog_usec));
                 if (r < 0) {
                         log_unit_warning_errno(UNIT(s), r, "Failed to reset watchdog timer: %m");
@@ -1568,8 +1663,18 @@ static int main_pid_good(Service *s) {
 
                 /* If it's an alien child let's check if it is still
                  * alive ... */
-                if (s->main_pid_alien && s->main_pid > 0)
+                if (s->main_pid_alien && s->main_pid > 0) {
+                        /* Unlike the PID the pidfd can't refer to a recycled process */
+                        if (s->main_pid_fd >= 0) {
+                                int r;
+
+                                r = fd_wait_for_event(s->main_pid_fd, POLLIN, 0);
+                                if (r >= 0)
+                                        return r == 0;
+                        }
+
                         return pid_is_alive(s->main_pid);
+                }
 
                 /* .. otherwise assume we'll get a SIGCHLD for it,
                  * which we really should wait for to collect exit
@@ -2471,7 +2576,7 @@ static int service_serialize_exec_command(Unit *u, FILE *f, ExecCommand *command
         if (!p)
                 return -ENOMEM;
 
-        fprintf(f, "%s-command=%s %u %s %s\n", type, service_exec_command_to_string(id), idx, p, args);
+        unit_serialize_item_format(u, f, strjoina(type, "-command"), "%s %u %s %s", service_exec_command_to_string(id), idx, p, args);
 
         return 0;
 }
@@ -2551,8 +2656,8 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
 
         if (s->main_exec_status.pid > 0) {
                 unit_serialize_item_format(u, f, "main-exec-status-pid", PID_FMT, s->main_exec_status.pid);
-                dual_timestamp_serialize(f, "main-exec-status-start", &s->main_exec_status.start_timestamp);
-                dual_timestamp_serialize(f, "main-exec-status-exit", &s->main_exec_status.exit_timestamp);
+                serialize_dual_timestamp(f, u->manager->serialization_format, "main-exec-status-start", &s->main_exec_status.start_timestamp);
+                serialize_dual_timestamp(f, u->manager->serialization_format, "main-exec-status-exit", &s->main_exec_status.exit_timestamp);
 
                 if (dual_timestamp_is_set(&s->main_exec_status.exit_timestamp)) {
                         unit_serialize_item_format(u, f, "main-exec-status-code", "%i", s->main_exec_status.code);
@@ -2560,7 +2665,7 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
                 }
         }
 
-        dual_timestamp_serialize(f, "watchdog-timestamp", &s->watchdog_timestamp);
+        serialize_dual_timestamp(f, u->manager->serialization_format, "watchdog-timestamp", &s->watchdog_timestamp);
 
         unit_serialize_item(u, f, "forbid-restart", yes_no(s->forbid_restart));
 
@@ -2991,15 +3096,14 @@ static int service_demand_pid_file(Service *s) {
         /* PATH_CHANGED would not be enough. There are daemons (sendmail) that
          * keep their PID file open all the time. */
         ps->type = PATH_MODIFIED;
-        ps->inotify_fd = -1;
+        ps->primary_wd = -1;
 
         s->pid_file_pathspec = ps;
 
         return service_watch_pid_file(s);
 }
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata) {
-        PathSpec *p = userdata;
+static int service_dispatch_inotify_io(PathSpec *p, bool changed) {
         Service *s;
 
         assert(p);
@@ -3007,16 +3111,11 @@ static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t
         s = SERVICE(p->unit);
 
         assert(s);
-        assert(fd >= 0);
         assert(IN_SET(s->state, SERVICE_START, SERVICE_START_POST));
-        assert(s->pid_file_pathspec);
-        assert(path_spec_owns_inotify_fd(s->pid_file_pathspec, fd));
+        assert(s->pid_file_pathspec == p);
 
         log_unit_debug(UNIT(s), "inotify event");
 
-        if (path_spec_fd_event(p, events) < 0)
-                goto fail;
-
         if (service_retry_pid_file(s) == 0)
                 return 0;
 
@@ -3178,6 +3277,7 @@ static void service_sigchld_event(Unit *u, pid_t pid, int code, int status) {
                 if (service_load_pid_file(s, false) > 0)
                         return;
 
+                service_close_main_pid_fd(s);
                 s->main_pid = 0;
                 exec_status_exit(&s->main_exec_status, &s->exec_context, pid, code, status);
 
@@ -3549,13 +3649,21 @@ static int service_dispatch_timer(sd_event_source *source, usec_t usec, void *us
 static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void *userdata) {
         Service *s = SERVICE(userdata);
         char t[FORMAT_TIMESPAN_MAX];
-        usec_t watchdog_usec;
+        usec_t watchdog_usec, deadline;
 
         assert(s);
         assert(source == s->watchdog_event_source);
 
         watchdog_usec = service_get_watchdog_usec(s);
 
+        /* The timer is not moved on each ping, see service_start_watchdog(), hence check if the service pinged
+         * us in the meantime, and if so just wait for the new deadline. */
+        deadline = usec_add(s->watchdog_timestamp.monotonic, watchdog_usec);
+        if (deadline > now(CLOCK_MONOTONIC)) {
+                service_start_watchdog(s);
+                return 0;
+        }
+
         if (UNIT(s)->manager->service_watchdogs) {
                 log_unit_error(UNIT(s), "Watchdog timeout (limit %s)!",
                                format_timespan(t, sizeof(t), watchdog_usec, 1));
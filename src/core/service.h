@@ -131,6 +131,13 @@ struct Service {
         DynamicCreds dynamic_creds;
 
         pid_t main_pid, control_pid;
+
+        /* If the main process is not our child we won't see a SIGCHLD for it. If the kernel supports it we
+         * hold a pidfd for it instead, which can't be recycled like the PID can, and which we poll for its
+         * exit. */
+        int main_pid_fd;
+        sd_event_source *main_pid_event_source;
+
         int socket_fd;
         SocketPeer *peer;
         bool socket_fd_selinux_context_net;
@@ -18,6 +18,8 @@
 #include "copy.h"
 #include "dbus-socket.h"
 #include "def.h"
+#include "execute-serialize.h"
+#include "executor-pool.h"
 #include "exit-status.h"
 #include "fd-util.h"
 #include "format-util.h"
@@ -40,10 +42,14 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "unit.h"
 #include "user-util.h"
 
+/* How many connections to accept at most per wakeup of a listening Accept=yes socket */
+#define ACCEPT_BATCH_MAX 16U
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -205,6 +211,7 @@ static int socket_arm_timer(Socket *s, usec_t usec) {
 
 int socket_instantiate_service(Socket *s) {
         _cleanup_free_ char *prefix = NULL, *name = NULL;
+        char **f;
         int r;
         Unit *u;
 
@@ -232,6 +239,13 @@ int socket_instantiate_service(Socket *s) {
         if (r < 0)
                 return r;
 
+        /* All instances are loaded from the same template, keep it preparsed so that the next connection
+         * doesn't have to read it again */
+        if (u->fragment_path)
+                manager_pin_preparsed_config(UNIT(s)->manager, u->fragment_path);
+        STRV_FOREACH(f, u->dropin_paths)
+                manager_pin_preparsed_config(UNIT(s)->manager, *f);
+
         unit_ref_set(&s->service, UNIT(s), u);
 
         return unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, false, UNIT_DEPENDENCY_IMPLICIT);
@@ -2346,6 +2360,13 @@ static void socket_enter_running(Socket *s, int cfd) {
                         goto fail;
                 }
 
+                /* Connections tend to come in bursts, have a few executors ready for the next instances, if they
+                 * can be spawned through one */
+                if (exec_context_can_serialize(&service->exec_context) &&
+                    !service->exec_context.private_tmp &&
+                    !service->exec_context.private_network)
+                        (void) executor_pool_want(UNIT(s)->manager);
+
                 /* Notify clients about changed counters */
                 unit_add_to_dbus_queue(UNIT(s));
         }
@@ -2893,6 +2914,46 @@ shortcut:
         return cfd;
 }
 
+static void socket_accept_more(SocketPort *p, int fd) {
+        unsigned n;
+        int flags, cfd, r;
+
+        assert(p);
+        assert(fd >= 0);
+
+        /* Connections tend to come in bursts. After the first one, pick up whatever else is queued on the
+         * listening socket already, instead of going through the event loop for each of them. This is only done
+         * where accept() doesn't need a helper process, see above. */
+
+        if (IN_SET(p->address.sockaddr.sa.sa_family, AF_INET, AF_INET6)) {
+                r = bpf_firewall_supported();
+                if (r != BPF_FIREWALL_UNSUPPORTED)
+                        return;
+        }
+
+        /* Never block in accept() in here, the socket might have been passed in from outside */
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || !(flags & O_NONBLOCK))
+                return;
+
+        for (n = 1; n < ACCEPT_BATCH_MAX; n++) {
+
+                /* The socket might have been stopped by the previous connection, e.g. by the trigger limit */
+                if (p->socket->state != SOCKET_LISTENING)
+                        return;
+
+                cfd = socket_accept_do(p->socket, fd);
+                if (cfd < 0) {
+                        if (cfd != -EAGAIN)
+                                log_unit_debug_errno(UNIT(p->socket), cfd, "Failed to accept further connection, leaving it for the next iteration: %m");
+                        return;
+                }
+
+                socket_apply_socket_options(p->socket, cfd);
+                socket_enter_running(p->socket, cfd);
+        }
+}
+
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         SocketPort *p = userdata;
         int cfd = -1;
@@ -2923,6 +2984,10 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         goto fail;
 
                 socket_apply_socket_options(p->socket, cfd);
+                socket_enter_running(p->socket, cfd);
+
+                socket_accept_more(p, fd);
+                return 0;
         }
 
         socket_enter_running(p->socket, cfd);
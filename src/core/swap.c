@@ -15,6 +15,7 @@
 #include "escape.h"
 #include "exit-status.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fstab-util.h"
 #include "parse-util.h"
@@ -1120,6 +1121,29 @@ static int swap_load_proc_swaps(Manager *m, bool set_flags) {
         return r;
 }
 
+static int swap_proc_swaps_changed(Manager *m) {
+        _cleanup_free_ char *data = NULL;
+        int r;
+
+        assert(m);
+
+        /* The kernel notifies us about every swapon/swapoff, and presumably about some other things too. /proc/swaps
+         * is small, hence let's compare it with what we saw last time before we parse it and go through all swap
+         * units, which gets costly with many of them. Returns > 0 if the table changed. */
+
+        rewind(m->proc_swaps);
+
+        r = read_full_stream(m->proc_swaps, &data, NULL);
+        if (r < 0)
+                return r;
+
+        if (streq_ptr(data, m->proc_swaps_last))
+                return 0;
+
+        free_and_replace(m->proc_swaps_last, data);
+        return 1;
+}
+
 static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
         Unit *u;
@@ -1128,10 +1152,19 @@ static int swap_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
         assert(m);
         assert(revents & EPOLLPRI);
 
+        r = swap_proc_swaps_changed(m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to read /proc/swaps, processing it anyway: %m");
+        else if (r == 0)
+                return 0;
+
         r = swap_load_proc_swaps(m, true);
         if (r < 0) {
                 log_error_errno(r, "Failed to reread /proc/swaps: %m");
 
+                /* Make sure we look at it again next time */
+                m->proc_swaps_last = mfree(m->proc_swaps_last);
+
                 /* Reset flags, just in case, for late calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_SWAP]) {
                         Swap *swap = SWAP(u);
@@ -1269,6 +1302,7 @@ static void swap_shutdown(Manager *m) {
 
         m->swap_event_source = sd_event_source_unref(m->swap_event_source);
         m->proc_swaps = safe_fclose(m->proc_swaps);
+        m->proc_swaps_last = mfree(m->proc_swaps_last);
         m->swaps_by_devnode = hashmap_free(m->swaps_by_devnode);
 }
 
@@ -1306,6 +1340,9 @@ static void swap_enumerate(Manager *m) {
                 (void) sd_event_source_set_description(m->swap_event_source, "swap-proc");
         }
 
+        /* Remember what we are about to process, so that we only need to look again when it changed */
+        (void) swap_proc_swaps_changed(m);
+
         r = swap_load_proc_swaps(m, false);
         if (r < 0)
                 goto fail;
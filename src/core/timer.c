@@ -310,6 +310,16 @@ static void timer_enter_elapsed(Timer *t, bool leave_around) {
                 timer_enter_dead(t, TIMER_SUCCESS);
 }
 
+static void timer_forget_calendar_elapses(Timer *t) {
+        TimerValue *v;
+
+        assert(t);
+
+        LIST_FOREACH(value, v, t->values)
+                if (v->base == TIMER_CALENDAR)
+                        v->next_elapse = 0;
+}
+
 static void add_random(Timer *t, usec_t *v) {
         char s[FORMAT_TIMESPAN_MAX];
         usec_t add;
@@ -373,9 +383,18 @@ static void timer_enter_waiting(Timer *t, bool initial) {
                                         b = ts.realtime;
                         }
 
-                        r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
-                        if (r < 0)
-                                continue;
+                        /* There's no elapse between the base we calculated the last elapse from and that
+                         * elapse, hence as long as the new base lies in between the result is the same.
+                         * This saves us the calendar calculation on most state changes. */
+                        if (v->next_elapse == 0 || b < v->calendar_base || b >= v->next_elapse) {
+                                r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
+                                if (r < 0) {
+                                        v->next_elapse = 0;
+                                        continue;
+                                }
+
+                                v->calendar_base = b;
+                        }
 
                         if (!found_realtime)
                                 t->next_elapse_realtime = v->next_elapse;
@@ -822,6 +841,9 @@ static void timer_timezone_change(Unit *u) {
         if (t->state != TIMER_WAITING)
                 return;
 
+        /* The cached calendar elapses were calculated in the old timezone */
+        timer_forget_calendar_elapses(t);
+
         log_unit_debug(u, "Timezone change, recalculating next elapse.");
         timer_enter_waiting(t, false);
 }
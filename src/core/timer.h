@@ -24,6 +24,7 @@ typedef struct TimerValue {
         usec_t value; /* only for monotonic events */
         CalendarSpec *calendar_spec; /* only for calendar events */
         usec_t next_elapse;
+        usec_t calendar_base; /* the base next_elapse was calculated from, for calendar events */
 
         LIST_FIELDS(struct TimerValue, value);
 } TimerValue;
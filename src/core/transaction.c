@@ -8,6 +8,7 @@
 #include "bus-error.h"
 #include "terminal-util.h"
 #include "transaction.h"
+#include "unit-order.h"
 #include "dbus-unit.h"
 
 static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependencies);
@@ -533,6 +534,11 @@ static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_erro
 }
 
 static void transaction_minimize_impact(Transaction *tr) {
+        _cleanup_free_ struct {
+                Unit *unit;
+                JobType type;
+        } *drop = NULL;
+        size_t n_drop = 0, n_drop_allocated = 0, k;
         Job *j;
         Iterator i;
 
@@ -541,7 +547,10 @@ static void transaction_minimize_impact(Transaction *tr) {
         /* Drops all unnecessary jobs that reverse already active jobs
          * or that stop a running service. */
 
-rescan:
+        /* Whether a job is one of those doesn't change while we delete
+         * others, hence find them all in one pass first. We have to
+         * remember them by unit and type, as deleting one job might
+         * delete others along with it. */
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 LIST_FOREACH(transaction, j, j) {
                         bool stops_running_service, changes_existing_job;
@@ -574,15 +583,31 @@ rescan:
                                                "%s/%s would change existing job.",
                                                j->unit->id, job_type_to_string(j->type));
 
-                        /* Ok, let's get rid of this */
-                        log_unit_debug(j->unit,
-                                       "Deleting %s/%s to minimize impact.",
-                                       j->unit->id, job_type_to_string(j->type));
+                        if (!GREEDY_REALLOC(drop, n_drop_allocated, n_drop + 1)) {
+                                log_oom();
+                                break;
+                        }
 
-                        transaction_delete_job(tr, j, true);
-                        goto rescan;
+                        drop[n_drop].unit = j->unit;
+                        drop[n_drop].type = j->type;
+                        n_drop++;
                 }
         }
+
+        for (k = 0; k < n_drop; k++) {
+                LIST_FOREACH(transaction, j, hashmap_get(tr->jobs, drop[k].unit))
+                        if (j->type == drop[k].type)
+                                break;
+                if (!j)
+                        continue; /* Already gone with an earlier one */
+
+                /* Ok, let's get rid of this */
+                log_unit_debug(j->unit,
+                               "Deleting %s/%s to minimize impact.",
+                               j->unit->id, job_type_to_string(j->type));
+
+                transaction_delete_job(tr, j, true);
+        }
 }
 
 static int transaction_apply(Transaction *tr, Manager *m, JobMode mode) {
@@ -690,7 +715,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
                         transaction_collect_garbage(tr);
 
                 /* Fifth step: verify order makes sense and correct
-                 * cycles if necessary and possible */
+                 * cycles if necessary and possible. There can't be any
+                 * if the ordering of all units is free of cycles. */
+                if (manager_order_is_acyclic(m))
+                        break;
+
                 r = transaction_verify_order(tr, &generation, e);
                 if (r >= 0)
                         break;
@@ -1094,6 +1123,85 @@ int transaction_add_isolate_jobs(Transaction *tr, Manager *m) {
         return 0;
 }
 
+static bool transaction_dependencies_settled(Unit *u, UnitDependency d, bool active) {
+        Unit *other;
+        Iterator i;
+        void *v;
+
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], i) {
+                UnitActiveState state;
+
+                if (other->job || other->nop_job)
+                        return false;
+
+                state = unit_active_state(other);
+                if (active ? !UNIT_IS_ACTIVE_OR_RELOADING(state) : !UNIT_IS_INACTIVE_OR_FAILED(state))
+                        return false;
+        }
+
+        return true;
+}
+
+int transaction_add_trivial_job(Manager *m, JobType type, Unit *unit, JobMode mode, Job **ret) {
+        Job *j;
+        int r;
+
+        assert(m);
+        assert(unit);
+
+        /* A shortcut for the common case of starting a unit whose requirements are all up already, and which
+         * conflicts with nothing that is running, as it happens for every connection to an Accept=yes socket. The
+         * resulting transaction would consist of the anchor job only, as the jobs for all dependencies would be
+         * dropped as redundant. Hence don't build it, and install the job right-away. Returns 0 if the shortcut
+         * doesn't apply, in which case the job has to go through a full transaction. */
+
+        if (type != JOB_START)
+                return 0;
+        if (!IN_SET(mode, JOB_REPLACE, JOB_FAIL))
+                return 0;
+
+        if (unit->load_state != UNIT_LOADED)
+                return 0;
+        if (unit->job || unit->nop_job)
+                return 0;
+        if (UNIT_VTABLE(unit)->following_set)
+                return 0;
+        if (!UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(unit)))
+                return 0;
+        if (!unit_job_is_applicable(unit, type))
+                return 0;
+
+        if (!transaction_dependencies_settled(unit, UNIT_REQUIRES, true) ||
+            !transaction_dependencies_settled(unit, UNIT_BINDS_TO, true) ||
+            !transaction_dependencies_settled(unit, UNIT_WANTS, true) ||
+            !transaction_dependencies_settled(unit, UNIT_REQUISITE, true) ||
+            !transaction_dependencies_settled(unit, UNIT_CONFLICTS, false) ||
+            !transaction_dependencies_settled(unit, UNIT_CONFLICTED_BY, false))
+                return 0;
+
+        j = job_new(unit, type);
+        if (!j)
+                return -ENOMEM;
+
+        r = hashmap_put(m->jobs, UINT32_TO_PTR(j->id), j);
+        if (r < 0) {
+                job_free(j);
+                return r;
+        }
+
+        assert_se(job_install(j) == j);
+
+        job_add_to_run_queue(j);
+        job_add_to_dbus_queue(j);
+        job_start_timer(j, false);
+        job_shutdown_magic(j);
+
+        if (ret)
+                *ret = j;
+
+        return 1;
+}
+
 Transaction *transaction_new(bool irreversible) {
         Transaction *tr;
 
@@ -0,0 +1,628 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "conf-parser.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "manager.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+#include "unit-file-cache.h"
+
+/* The cache file is only ever read back by the same system, hence everything is stored in native byte order.
+ * It starts with the magic and the version of the code that wrote it, followed by records:
+ *
+ *   'F' path dev ino size mtime ctime mode n_lines [line text]... — a preparsed unit file or drop-in
+ *   'D' path dev ino mtime ctime n_entries [entry]...             — the listing of a unit search path directory
+ *   'E'                                                           — the end
+ *
+ * Strings are prefixed by their 32bit length, dev, ino, size, mtime and ctime (in ns) are 64bit, everything else
+ * is 32bit. Each entry is checked against the inode, size, mtime and ctime of its file or directory before it is
+ * used.
+ * As a change made within the timestamp granularity of the file system would go unnoticed that way, entries
+ * that were modified shortly before we started reading are not written to the cache. */
+
+#define UNIT_FILE_CACHE_MAGIC "SDUFC02\n"
+#define UNIT_FILE_CACHE_RACY_USEC USEC_PER_SEC
+#define UNIT_FILE_CACHE_SIZE_MAX (256U*1024U*1024U)
+
+UnitFileCacheDir *unit_file_cache_dir_free(UnitFileCacheDir *d) {
+        if (!d)
+                return NULL;
+
+        free(d->path);
+        strv_free(d->entries);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFileCacheDir*, unit_file_cache_dir_free);
+
+typedef struct CacheReader {
+        const uint8_t *p;
+        const uint8_t *end;
+} CacheReader;
+
+static int read_bytes(CacheReader *r, void *buf, size_t n) {
+        if ((size_t) (r->end - r->p) < n)
+                return -EBADMSG;
+
+        memcpy(buf, r->p, n);
+        r->p += n;
+        return 0;
+}
+
+static int read_u32(CacheReader *r, uint32_t *ret) {
+        return read_bytes(r, ret, sizeof(*ret));
+}
+
+static int read_u64(CacheReader *r, uint64_t *ret) {
+        return read_bytes(r, ret, sizeof(*ret));
+}
+
+static int read_string(CacheReader *r, char **ret) {
+        uint32_t l;
+        char *s;
+        int k;
+
+        k = read_u32(r, &l);
+        if (k < 0)
+                return k;
+
+        if ((size_t) (r->end - r->p) < l)
+                return -EBADMSG;
+        if (memchr(r->p, 0, l))
+                return -EBADMSG;
+
+        s = strndup((const char*) r->p, l);
+        if (!s)
+                return -ENOMEM;
+
+        r->p += l;
+        *ret = s;
+        return 0;
+}
+
+static int read_config(CacheReader *r, Hashmap *configs) {
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *p = NULL;
+        uint64_t dev, ino, size, mtime, ctime;
+        uint32_t mode, n, i;
+        int k;
+
+        p = new0(ConfigPreparsed, 1);
+        if (!p)
+                return -ENOMEM;
+
+        k = read_string(r, &p->filename);
+        if (k < 0)
+                return k;
+
+        if (read_u64(r, &dev) < 0 ||
+            read_u64(r, &ino) < 0 ||
+            read_u64(r, &size) < 0 ||
+            read_u64(r, &mtime) < 0 ||
+            read_u64(r, &ctime) < 0 ||
+            read_u32(r, &mode) < 0 ||
+            read_u32(r, &n) < 0)
+                return -EBADMSG;
+
+        p->st.st_dev = (dev_t) dev;
+        p->st.st_ino = (ino_t) ino;
+        p->st.st_size = (off_t) size;
+        p->st.st_mode = (mode_t) mode;
+        p->st.st_mtim = (struct timespec) {
+                .tv_sec = mtime / NSEC_PER_SEC,
+                .tv_nsec = mtime % NSEC_PER_SEC,
+        };
+        p->st.st_ctim = (struct timespec) {
+                .tv_sec = ctime / NSEC_PER_SEC,
+                .tv_nsec = ctime % NSEC_PER_SEC,
+        };
+
+        /* Each line takes up at least 8 bytes in the file, refuse line counts that can't be right */
+        if (n > (size_t) (r->end - r->p) / 8)
+                return -EBADMSG;
+
+        p->lines = new(ConfigPreparsedLine, n);
+        if (!p->lines && n > 0)
+                return -ENOMEM;
+        p->n_allocated = n;
+
+        for (i = 0; i < n; i++) {
+                ConfigPreparsedLine *l = p->lines + i;
+
+                k = read_u32(r, &l->line);
+                if (k < 0)
+                        return k;
+
+                k = read_string(r, &l->text);
+                if (k < 0)
+                        return k;
+
+                p->n_lines++;
+        }
+
+        k = hashmap_put(configs, p->filename, p);
+        if (k == -EEXIST)
+                return -EBADMSG;
+        if (k < 0)
+                return k;
+
+        TAKE_PTR(p);
+        return 0;
+}
+
+static int read_dir(CacheReader *r, Hashmap *dirs) {
+        _cleanup_(unit_file_cache_dir_freep) UnitFileCacheDir *d = NULL;
+        uint64_t dev, ino, mtime, ctime;
+        uint32_t n, i;
+        int k;
+
+        d = new0(UnitFileCacheDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        k = read_string(r, &d->path);
+        if (k < 0)
+                return k;
+
+        if (read_u64(r, &dev) < 0 ||
+            read_u64(r, &ino) < 0 ||
+            read_u64(r, &mtime) < 0 ||
+            read_u64(r, &ctime) < 0 ||
+            read_u32(r, &n) < 0)
+                return -EBADMSG;
+
+        d->dev = (dev_t) dev;
+        d->ino = (ino_t) ino;
+        d->mtime = mtime;
+        d->ctime = ctime;
+
+        if (n > (size_t) (r->end - r->p) / 4)
+                return -EBADMSG;
+
+        d->entries = new0(char*, n + 1);
+        if (!d->entries)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                k = read_string(r, d->entries + i);
+                if (k < 0)
+                        return k;
+        }
+
+        k = hashmap_put(dirs, d->path, d);
+        if (k == -EEXIST)
+                return -EBADMSG;
+        if (k < 0)
+                return k;
+
+        TAKE_PTR(d);
+        return 0;
+}
+
+int unit_file_cache_read(const char *path, Hashmap **configs, Hashmap **dirs) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *version = NULL;
+        CacheReader r;
+        struct stat st;
+        void *m;
+        int k;
+
+        assert(path);
+        assert(configs);
+        assert(dirs);
+
+        /* Reads the cache into the two hashmaps. On failure, whatever was read before is left in them. */
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if ((uint64_t) st.st_size < STRLEN(UNIT_FILE_CACHE_MAGIC) ||
+            (uint64_t) st.st_size > UNIT_FILE_CACHE_SIZE_MAX)
+                return -EBADMSG;
+
+        m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED)
+                return -errno;
+
+        r = (CacheReader) {
+                .p = m,
+                .end = (const uint8_t*) m + st.st_size,
+        };
+
+        if (memcmp(r.p, UNIT_FILE_CACHE_MAGIC, STRLEN(UNIT_FILE_CACHE_MAGIC)) != 0) {
+                k = -EBADMSG;
+                goto finish;
+        }
+        r.p += STRLEN(UNIT_FILE_CACHE_MAGIC);
+
+        k = read_string(&r, &version);
+        if (k < 0)
+                goto finish;
+        if (!streq(version, PACKAGE_VERSION)) {
+                k = -EPROTONOSUPPORT;
+                goto finish;
+        }
+
+        k = hashmap_ensure_allocated(configs, &path_hash_ops);
+        if (k < 0)
+                goto finish;
+
+        k = hashmap_ensure_allocated(dirs, &path_hash_ops);
+        if (k < 0)
+                goto finish;
+
+        for (;;) {
+                uint8_t type;
+
+                k = read_bytes(&r, &type, 1);
+                if (k < 0)
+                        break;
+
+                if (type == 'E') {
+                        k = 0;
+                        break;
+                } else if (type == 'F')
+                        k = read_config(&r, *configs);
+                else if (type == 'D')
+                        k = read_dir(&r, *dirs);
+                else
+                        k = -EBADMSG;
+                if (k < 0)
+                        break;
+        }
+
+finish:
+        (void) munmap(m, st.st_size);
+        return k;
+}
+
+static void write_u32(FILE *f, uint32_t v) {
+        fwrite(&v, sizeof(v), 1, f);
+}
+
+static void write_u64(FILE *f, uint64_t v) {
+        fwrite(&v, sizeof(v), 1, f);
+}
+
+static void write_string(FILE *f, const char *s) {
+        size_t l;
+
+        l = strlen(s);
+        write_u32(f, (uint32_t) l);
+        fwrite(s, 1, l, f);
+}
+
+static bool is_racy(const struct stat *st, usec_t timestamp) {
+        return MAX(timespec_load(&st->st_mtim), timespec_load(&st->st_ctim)) + UNIT_FILE_CACHE_RACY_USEC >= timestamp;
+}
+
+int unit_file_cache_write(const char *path, Hashmap *configs, Hashmap *dirs, usec_t timestamp) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *temp = NULL;
+        ConfigPreparsed *p;
+        UnitFileCacheDir *d;
+        unsigned n_configs = 0, n_dirs = 0;
+        Iterator i;
+        int r;
+
+        assert(path);
+
+        /* Writes all entries that are still up-to-date and were not modified too close to the timestamp, i.e.
+         * the time we started reading them. */
+
+        (void) mkdir_parents(path, 0755);
+
+        r = fopen_temporary(path, &f, &temp);
+        if (r < 0)
+                return r;
+
+        fputs(UNIT_FILE_CACHE_MAGIC, f);
+        write_string(f, PACKAGE_VERSION);
+
+        HASHMAP_FOREACH(p, configs, i) {
+                struct stat st;
+                size_t k;
+
+                if (stat(p->filename, &st) < 0 ||
+                    !config_preparsed_matches(p, &st) ||
+                    is_racy(&st, timestamp))
+                        continue;
+
+                fputc('F', f);
+                write_string(f, p->filename);
+                write_u64(f, (uint64_t) p->st.st_dev);
+                write_u64(f, (uint64_t) p->st.st_ino);
+                write_u64(f, (uint64_t) p->st.st_size);
+                write_u64(f, timespec_load_nsec(&p->st.st_mtim));
+                write_u64(f, timespec_load_nsec(&p->st.st_ctim));
+                write_u32(f, (uint32_t) p->st.st_mode);
+                write_u32(f, (uint32_t) p->n_lines);
+
+                for (k = 0; k < p->n_lines; k++) {
+                        write_u32(f, p->lines[k].line);
+                        write_string(f, p->lines[k].text);
+                }
+
+                n_configs++;
+        }
+
+        HASHMAP_FOREACH(d, dirs, i) {
+                struct stat st;
+                char **e;
+
+                if (stat(d->path, &st) < 0 ||
+                    st.st_dev != d->dev ||
+                    st.st_ino != d->ino ||
+                    timespec_load_nsec(&st.st_mtim) != d->mtime ||
+                    timespec_load_nsec(&st.st_ctim) != d->ctime ||
+                    is_racy(&st, timestamp))
+                        continue;
+
+                fputc('D', f);
+                write_string(f, d->path);
+                write_u64(f, (uint64_t) d->dev);
+                write_u64(f, (uint64_t) d->ino);
+                write_u64(f, d->mtime);
+                write_u64(f, d->ctime);
+                write_u32(f, (uint32_t) strv_length(d->entries));
+
+                STRV_FOREACH(e, d->entries)
+                        write_string(f, *e);
+
+                n_dirs++;
+        }
+
+        fputc('E', f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        temp = mfree(temp);
+
+        log_debug("Wrote %u unit files and %u directories to unit file cache %s.", n_configs, n_dirs, path);
+        return 0;
+
+fail:
+        (void) unlink(temp);
+        return r;
+}
+
+static char *manager_unit_file_cache_path(Manager *m) {
+        assert(m);
+
+        return path_join(NULL, m->prefix[EXEC_DIRECTORY_RUNTIME], "systemd/unit-file-cache");
+}
+
+void manager_unit_file_cache_begin(Manager *m) {
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        assert(m);
+
+        /* Test runs shall not leave anything behind in the runtime directory */
+        if (m->test_run_flags != 0)
+                return;
+
+        manager_unit_file_cache_free(m);
+
+        path = manager_unit_file_cache_path(m);
+        if (!path) {
+                log_oom();
+                return;
+        }
+
+        m->unit_file_cache_timestamp = now(CLOCK_REALTIME);
+        m->unit_file_cache_active = true;
+
+        r = unit_file_cache_read(path, &m->preparsed_configs, &m->unit_file_cache_dirs);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to read unit file cache %s, ignoring: %m", path);
+
+                /* Don't use half of a cache */
+                m->preparsed_configs = hashmap_free_with_destructor(m->preparsed_configs, config_preparsed_free);
+                m->unit_file_cache_dirs = hashmap_free_with_destructor(m->unit_file_cache_dirs, unit_file_cache_dir_free);
+        } else
+                log_debug("Read %u unit files and %u directories from unit file cache %s.",
+                          hashmap_size(m->preparsed_configs), hashmap_size(m->unit_file_cache_dirs), path);
+}
+
+void manager_unit_file_cache_end(Manager *m) {
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        assert(m);
+
+        if (!m->unit_file_cache_active)
+                return;
+
+        path = manager_unit_file_cache_path(m);
+        if (!path)
+                log_oom();
+        else {
+                r = unit_file_cache_write(path, m->preparsed_configs, m->unit_file_cache_dirs, m->unit_file_cache_timestamp);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write unit file cache %s, ignoring: %m", path);
+        }
+
+        manager_unit_file_cache_free(m);
+}
+
+void manager_unit_file_cache_free(Manager *m) {
+        assert(m);
+
+        m->preparsed_configs = hashmap_free_with_destructor(m->preparsed_configs, config_preparsed_free);
+        m->unit_file_cache_dirs = hashmap_free_with_destructor(m->unit_file_cache_dirs, unit_file_cache_dir_free);
+        m->pinned_configs = set_free_free(m->pinned_configs);
+        m->unit_file_cache_active = false;
+}
+
+char **manager_unit_file_cache_get_dir(Manager *m, const char *path, const struct stat *st) {
+        UnitFileCacheDir *d;
+
+        assert(m);
+        assert(path);
+        assert(st);
+
+        d = hashmap_get(m->unit_file_cache_dirs, path);
+        if (!d)
+                return NULL;
+
+        if (d->dev != st->st_dev ||
+            d->ino != st->st_ino ||
+            d->mtime != timespec_load_nsec(&st->st_mtim) ||
+            d->ctime != timespec_load_nsec(&st->st_ctim))
+                return NULL;
+
+        return d->entries;
+}
+
+void manager_unit_file_cache_put_dir(Manager *m, const char *path, const struct stat *st, char **entries) {
+        _cleanup_(unit_file_cache_dir_freep) UnitFileCacheDir *d = NULL;
+
+        assert(m);
+        assert(path);
+        assert(st);
+
+        if (!m->unit_file_cache_active)
+                return;
+
+        d = new(UnitFileCacheDir, 1);
+        if (!d)
+                return;
+
+        *d = (UnitFileCacheDir) {
+                .path = strdup(path),
+                .dev = st->st_dev,
+                .ino = st->st_ino,
+                .mtime = timespec_load_nsec(&st->st_mtim),
+                .ctime = timespec_load_nsec(&st->st_ctim),
+                .entries = entries ? strv_copy(entries) : strv_new(NULL, NULL),
+        };
+        if (!d->path || !d->entries)
+                return;
+
+        unit_file_cache_dir_free(hashmap_remove(m->unit_file_cache_dirs, path));
+
+        if (hashmap_ensure_allocated(&m->unit_file_cache_dirs, &path_hash_ops) < 0)
+                return;
+
+        if (hashmap_put(m->unit_file_cache_dirs, d->path, d) < 0)
+                return;
+
+        TAKE_PTR(d);
+}
+
+const ConfigPreparsed *manager_get_preparsed_config(Manager *m, const char *filename, FILE *f, const struct stat *st) {
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *p = NULL;
+        _cleanup_fclose_ FILE *ours = NULL;
+        ConfigPreparsed *existing;
+
+        assert(m);
+        assert(filename);
+        assert(st);
+
+        /* Returns the preparsed version of the file, if we have one that is up-to-date. While the unit file
+         * cache is being filled, reads and remembers the file otherwise. Returns NULL if the file shall be
+         * parsed the usual way, with the FILE object still positioned at the beginning. */
+
+        existing = hashmap_get(m->preparsed_configs, filename);
+        if (existing && config_preparsed_matches(existing, st))
+                return existing;
+
+        if (!m->unit_file_cache_active && !set_contains(m->pinned_configs, filename))
+                return NULL;
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f)
+                        return NULL;
+        }
+
+        if (config_preparse(filename, f, 0, &p) < 0 ||
+            hashmap_ensure_allocated(&m->preparsed_configs, &path_hash_ops) < 0)
+                goto fail;
+
+        if (existing) {
+                assert_se(hashmap_remove(m->preparsed_configs, filename) == existing);
+                config_preparsed_free(existing);
+        }
+
+        if (hashmap_put(m->preparsed_configs, p->filename, p) < 0)
+                goto fail;
+
+        return TAKE_PTR(p);
+
+fail:
+        if (!ours)
+                rewind(f);
+
+        return NULL;
+}
+
+void manager_pin_preparsed_config(Manager *m, const char *filename) {
+        assert(m);
+        assert(filename);
+
+        /* Keeps the file preparsed beyond the dispatching of the current load queue, for templates that are
+         * instantiated over and over again. It is read and split into lines the next time it is needed, and
+         * from then on only applied. Pins are dropped whenever the unit file cache is flushed. */
+
+        if (set_contains(m->pinned_configs, filename))
+                return;
+
+        if (set_ensure_allocated(&m->pinned_configs, &path_hash_ops) < 0)
+                return;
+
+        (void) set_put_strdup(m->pinned_configs, filename);
+}
+
+void manager_trim_preparsed_configs(Manager *m) {
+        ConfigPreparsed *p;
+        Iterator i;
+
+        assert(m);
+
+        /* While the unit file cache is active, everything read is kept until it is written out. Otherwise only
+         * the pinned files stay around. */
+
+        if (m->unit_file_cache_active)
+                return;
+
+        if (set_isempty(m->pinned_configs)) {
+                m->preparsed_configs = hashmap_free_with_destructor(m->preparsed_configs, config_preparsed_free);
+                return;
+        }
+
+        HASHMAP_FOREACH(p, m->preparsed_configs, i)
+                if (!set_contains(m->pinned_configs, p->filename))
+                        config_preparsed_free(hashmap_remove(m->preparsed_configs, p->filename));
+}
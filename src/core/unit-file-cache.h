@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "conf-parser.h"
+#include "hashmap.h"
+#include "time-util.h"
+
+typedef struct Manager Manager;
+
+/* The unit file cache keeps the listings of the unit search path directories and the unit files and drop-ins
+ * read while loading units, split into lines, in the runtime directory, to speed up the next reload or
+ * reexecution. */
+
+typedef struct UnitFileCacheDir {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        nsec_t mtime;
+        nsec_t ctime;
+        char **entries;
+} UnitFileCacheDir;
+
+UnitFileCacheDir *unit_file_cache_dir_free(UnitFileCacheDir *d);
+
+int unit_file_cache_read(const char *path, Hashmap **configs, Hashmap **dirs);
+int unit_file_cache_write(const char *path, Hashmap *configs, Hashmap *dirs, usec_t timestamp);
+
+void manager_unit_file_cache_begin(Manager *m);
+void manager_unit_file_cache_end(Manager *m);
+void manager_unit_file_cache_free(Manager *m);
+
+char **manager_unit_file_cache_get_dir(Manager *m, const char *path, const struct stat *st);
+void manager_unit_file_cache_put_dir(Manager *m, const char *path, const struct stat *st, char **entries);
+
+const ConfigPreparsed *manager_get_preparsed_config(Manager *m, const char *filename, FILE *f, const struct stat *st);
+void manager_pin_preparsed_config(Manager *m, const char *filename);
+void manager_trim_preparsed_configs(Manager *m);
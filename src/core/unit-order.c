@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "list.h"
+#include "log.h"
+#include "unit-order.h"
+#include "util.h"
+
+/* We keep a rank for each unit, so that a unit ordered before another always has the lower rank, i.e. a topological
+ * order of the ordering graph of all units. As long as there is one the graph is free of cycles, and so is the
+ * ordering of any transaction, and transaction_activate() doesn't need to look for them.
+ *
+ * Most dependencies are added in an order that agrees with the ranks already. For the others only the units ranked
+ * between the two ends need to be reordered (see Pearce & Kelly, "A Dynamic Topological Sort Algorithm for Directed
+ * Acyclic Graphs"). If a new dependency closes a cycle we stop maintaining the ranks, and recompute them from scratch
+ * once dependencies have been removed, which might have broken the cycle again. */
+
+void unit_order_init(Unit *u) {
+        assert(u);
+
+        u->order_rank = u->manager->order_next_rank++;
+}
+
+static int order_rank_compare(Unit * const *a, Unit * const *b) {
+        return CMP((*a)->order_rank, (*b)->order_rank);
+}
+
+static int rank_compare(const unsigned *a, const unsigned *b) {
+        return CMP(*a, *b);
+}
+
+static int order_collect(
+                Unit *start,
+                UnitDependency d,
+                Unit *stop,
+                unsigned lower,
+                unsigned upper,
+                unsigned generation,
+                Unit ***units,
+                size_t *n_units,
+                size_t *n_allocated) {
+
+        size_t k;
+
+        /* Collects 'start' and all units reachable from it along 'd' that are ranked between 'lower' and 'upper'.
+         * Returns -ELOOP if 'stop' is reachable. */
+
+        if (!GREEDY_REALLOC(*units, *n_allocated, *n_units + 1))
+                return -ENOMEM;
+
+        start->order_generation = generation;
+        (*units)[(*n_units)++] = start;
+
+        for (k = 0; k < *n_units; k++) {
+                Unit *other;
+                Iterator i;
+                void *v;
+
+                HASHMAP_FOREACH_KEY(v, other, (*units)[k]->dependencies[d], i) {
+                        if (other == stop)
+                                return -ELOOP;
+
+                        if (other->order_generation == generation)
+                                continue;
+                        if (other->order_rank <= lower || other->order_rank >= upper)
+                                continue;
+
+                        if (!GREEDY_REALLOC(*units, *n_allocated, *n_units + 1))
+                                return -ENOMEM;
+
+                        other->order_generation = generation;
+                        (*units)[(*n_units)++] = other;
+                }
+        }
+
+        return 0;
+}
+
+void unit_order_add(Unit *before, Unit *after) {
+        _cleanup_free_ Unit **forward = NULL, **backward = NULL;
+        size_t n_forward = 0, n_backward = 0, n_forward_allocated = 0, n_backward_allocated = 0, k;
+        _cleanup_free_ unsigned *ranks = NULL;
+        unsigned generation;
+        Manager *m;
+        int r;
+
+        assert(before);
+        assert(after);
+        assert(before->manager == after->manager);
+
+        /* Called after 'before' got ordered before 'after' */
+
+        m = before->manager;
+
+        if (!m->order_valid)
+                return;
+
+        if (before->order_rank < after->order_rank)
+                return;
+
+        generation = ++m->order_generation;
+        if (generation == 0) /* Units start out with 0, skip it when wrapping around */
+                generation = ++m->order_generation;
+
+        /* Everything that has to come after 'after' and is ranked before 'before' */
+        r = order_collect(after, UNIT_BEFORE, before, after->order_rank, before->order_rank, generation,
+                          &forward, &n_forward, &n_forward_allocated);
+        if (r == -ELOOP) {
+                log_unit_debug(before, "Ordering %s before %s closes an ordering cycle.", before->id, after->id);
+                m->order_valid = false;
+                return;
+        }
+        if (r < 0)
+                goto fail;
+
+        /* Everything that has to come before 'before' and is ranked after 'after' */
+        r = order_collect(before, UNIT_AFTER, after, after->order_rank, before->order_rank, generation,
+                          &backward, &n_backward, &n_backward_allocated);
+        if (r < 0)
+                goto fail;
+
+        ranks = new(unsigned, n_forward + n_backward);
+        if (!ranks)
+                goto fail;
+
+        for (k = 0; k < n_backward; k++)
+                ranks[k] = backward[k]->order_rank;
+        for (k = 0; k < n_forward; k++)
+                ranks[n_backward + k] = forward[k]->order_rank;
+
+        typesafe_qsort(ranks, n_forward + n_backward, rank_compare);
+        typesafe_qsort(backward, n_backward, order_rank_compare);
+        typesafe_qsort(forward, n_forward, order_rank_compare);
+
+        /* Hand out the same ranks again, the lower ones to the units that have to come first, keeping the order
+         * within each group */
+        for (k = 0; k < n_backward; k++)
+                backward[k]->order_rank = ranks[k];
+        for (k = 0; k < n_forward; k++)
+                forward[k]->order_rank = ranks[n_backward + k];
+
+        return;
+
+fail:
+        log_debug_errno(r < 0 ? r : -ENOMEM, "Failed to update unit ordering ranks, recomputing later: %m");
+        manager_order_invalidate(m);
+}
+
+void manager_order_edges_removed(Manager *m) {
+        assert(m);
+
+        /* Removing dependencies never invalidates the ranks, but it might break a cycle */
+        if (!m->order_valid)
+                m->order_changed = true;
+}
+
+void manager_order_invalidate(Manager *m) {
+        assert(m);
+
+        m->order_valid = false;
+        m->order_changed = true;
+}
+
+static int manager_order_recompute(Manager *m) {
+        _cleanup_free_ Unit **units = NULL, **sorted = NULL;
+        _cleanup_free_ unsigned *n_before = NULL;
+        size_t n = 0, n_allocated = 0, n_sorted = 0, k;
+        UnitType t;
+        Unit *u;
+
+        assert(m);
+
+        /* Kahn's algorithm, over all units */
+
+        for (t = 0; t < _UNIT_TYPE_MAX; t++)
+                LIST_FOREACH(units_by_type, u, m->units_by_type[t]) {
+                        if (!GREEDY_REALLOC(units, n_allocated, n + 1))
+                                return -ENOMEM;
+
+                        /* Index into the arrays below until we are done */
+                        u->order_rank = n;
+                        units[n++] = u;
+                }
+
+        m->order_next_rank = n;
+
+        if (n == 0) {
+                m->order_valid = true;
+                return 0;
+        }
+
+        n_before = new0(unsigned, n);
+        sorted = new(Unit*, n);
+        if (!n_before || !sorted)
+                return -ENOMEM;
+
+        for (k = 0; k < n; k++) {
+                Unit *other;
+                Iterator i;
+                void *v;
+
+                HASHMAP_FOREACH_KEY(v, other, units[k]->dependencies[UNIT_BEFORE], i) {
+                        if (other->order_rank >= n || units[other->order_rank] != other)
+                                return -ESTALE;
+
+                        n_before[other->order_rank]++;
+                }
+        }
+
+        for (k = 0; k < n; k++)
+                if (n_before[k] == 0)
+                        sorted[n_sorted++] = units[k];
+
+        for (k = 0; k < n_sorted; k++) {
+                Unit *other;
+                Iterator i;
+                void *v;
+
+                HASHMAP_FOREACH_KEY(v, other, sorted[k]->dependencies[UNIT_BEFORE], i)
+                        if (--n_before[other->order_rank] == 0)
+                                sorted[n_sorted++] = other;
+        }
+
+        if (n_sorted < n) {
+                log_debug("Ordering graph of all units contains at least one cycle.");
+                return 0;
+        }
+
+        for (k = 0; k < n; k++)
+                sorted[k]->order_rank = k;
+
+        m->order_valid = true;
+        return 0;
+}
+
+bool manager_order_is_acyclic(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->order_valid)
+                return true;
+
+        if (!m->order_changed)
+                return false;
+
+        m->order_changed = false;
+
+        r = manager_order_recompute(m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to recompute unit ordering ranks: %m");
+                return false;
+        }
+
+        return m->order_valid;
+}
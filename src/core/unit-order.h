@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "manager.h"
+#include "unit.h"
+
+void unit_order_init(Unit *u);
+void unit_order_add(Unit *before, Unit *after);
+
+void manager_order_edges_removed(Manager *m);
+void manager_order_invalidate(Manager *m);
+bool manager_order_is_acyclic(Manager *m);
@@ -12,6 +12,8 @@
 
 #include "alloc-util.h"
 #include "all-units.h"
+#include "boot-trace.h"
+#include "bpf-firewall.h"
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
@@ -35,6 +37,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "serialize.h"
 #include "set.h"
 #include "signal-util.h"
 #include "sparse-endian.h"
@@ -44,9 +47,11 @@
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "strintern.h"
 #include "strv.h"
 #include "umask-util.h"
 #include "unit-name.h"
+#include "unit-order.h"
 #include "unit.h"
 #include "user-util.h"
 #include "virt.h"
@@ -92,24 +97,60 @@ Unit *unit_new(Manager *m, size_t size) {
         u->job_running_timeout = USEC_INFINITY;
         u->ref_uid = UID_INVALID;
         u->ref_gid = GID_INVALID;
-        u->cpu_usage_last = NSEC_INFINITY;
         u->cgroup_bpf_state = UNIT_CGROUP_BPF_INVALIDATED;
 
-        u->ip_accounting_ingress_map_fd = -1;
-        u->ip_accounting_egress_map_fd = -1;
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
-
         u->last_section_private = -1;
 
+        unit_order_init(u);
+
         RATELIMIT_INIT(u->start_limit, m->default_start_limit_interval, m->default_start_limit_burst);
         RATELIMIT_INIT(u->auto_stop_ratelimit, 10 * USEC_PER_SEC, 16);
 
         return u;
 }
 
+static UnitAccounting *unit_accounting_free(UnitAccounting *a) {
+        if (!a)
+                return NULL;
+
+        safe_close(a->ip_accounting_ingress_map_fd);
+        safe_close(a->ip_accounting_egress_map_fd);
+
+        bpf_access_maps_unref(a->ip_allow_maps);
+        bpf_access_maps_unref(a->ip_deny_maps);
+
+        bpf_program_unref(a->ip_bpf_ingress);
+        bpf_program_unref(a->ip_bpf_ingress_installed);
+        bpf_program_unref(a->ip_bpf_egress);
+        bpf_program_unref(a->ip_bpf_egress_installed);
+
+        bpf_shared_program_unref(a->ip_bpf_ingress_shared);
+        bpf_shared_program_unref(a->ip_bpf_egress_shared);
+
+        return mfree(a);
+}
+
+UnitAccounting *unit_get_accounting(Unit *u) {
+        UnitAccounting *a;
+
+        assert(u);
+
+        if (u->accounting)
+                return u->accounting;
+
+        a = new(UnitAccounting, 1);
+        if (!a)
+                return NULL;
+
+        *a = (UnitAccounting) {
+                .cpu_usage_last = NSEC_INFINITY,
+                .ip_accounting_ingress_map_fd = -1,
+                .ip_accounting_egress_map_fd = -1,
+        };
+
+        return (u->accounting = a);
+}
+
 int unit_new_for_name(Manager *m, size_t size, const char *name, Unit **ret) {
         _cleanup_(unit_freep) Unit *u = NULL;
         int r;
@@ -181,6 +222,7 @@ static void unit_init(Unit *u) {
 
 int unit_add_name(Unit *u, const char *text) {
         _cleanup_free_ char *s = NULL, *i = NULL;
+        const char *name, *n;
         UnitType t;
         int r;
 
@@ -195,28 +237,27 @@ int unit_add_name(Unit *u, const char *text) {
                 r = unit_name_replace_instance(text, u->instance, &s);
                 if (r < 0)
                         return r;
-        } else {
-                s = strdup(text);
-                if (!s)
-                        return -ENOMEM;
-        }
 
-        if (set_contains(u->names, s))
+                name = s;
+        } else
+                name = text;
+
+        if (set_contains(u->names, name))
                 return 0;
-        if (hashmap_contains(u->manager->units, s))
+        if (hashmap_contains(u->manager->units, name))
                 return -EEXIST;
 
-        if (!unit_name_is_valid(s, UNIT_NAME_PLAIN|UNIT_NAME_INSTANCE))
+        if (!unit_name_is_valid(name, UNIT_NAME_PLAIN|UNIT_NAME_INSTANCE))
                 return -EINVAL;
 
-        t = unit_name_to_type(s);
+        t = unit_name_to_type(name);
         if (t < 0)
                 return -EINVAL;
 
         if (u->type != _UNIT_TYPE_INVALID && t != u->type)
                 return -EINVAL;
 
-        r = unit_name_to_instance(s, &i);
+        r = unit_name_to_instance(name, &i);
         if (r < 0)
                 return r;
 
@@ -235,20 +276,29 @@ int unit_add_name(Unit *u, const char *text) {
         if (hashmap_size(u->manager->units) >= MANAGER_MAX_NAMES)
                 return -E2BIG;
 
-        r = set_put(u->names, s);
-        if (r < 0)
+        /* Unit names are interned, so that the names set, the manager's unit table and everybody else who
+         * wants to keep a unit name around share a single copy of it. */
+        n = strintern(name);
+        if (!n)
+                return -ENOMEM;
+
+        r = set_put(u->names, n);
+        if (r < 0) {
+                strintern_unref(n);
                 return r;
+        }
         assert(r > 0);
 
-        r = hashmap_put(u->manager->units, s, u);
+        r = hashmap_put(u->manager->units, n, u);
         if (r < 0) {
-                (void) set_remove(u->names, s);
+                (void) set_remove(u->names, n);
+                strintern_unref(n);
                 return r;
         }
 
         if (u->type == _UNIT_TYPE_INVALID) {
                 u->type = t;
-                u->id = s;
+                u->id = (char*) n;
                 u->instance = TAKE_PTR(i);
 
                 LIST_PREPEND(units_by_type, u->manager->units_by_type[t], u);
@@ -256,8 +306,6 @@ int unit_add_name(Unit *u, const char *text) {
                 unit_init(u);
         }
 
-        s = NULL;
-
         unit_add_to_dbus_queue(u);
         return 0;
 }
@@ -454,6 +502,27 @@ void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         u->in_stop_when_unneeded_queue = true;
 }
 
+void unit_add_to_transient_write_queue(Unit *u) {
+        int r;
+
+        assert(u);
+
+        if (u->in_transient_write_queue)
+                return;
+
+        if (!u->transient_data)
+                return;
+
+        LIST_PREPEND(transient_write_queue, u->manager->transient_write_queue, u);
+        u->in_transient_write_queue = true;
+
+        r = manager_schedule_transient_write(u->manager);
+        if (r < 0) {
+                log_unit_warning_errno(u, r, "Failed to schedule writing of transient unit file, writing it right away: %m");
+                (void) manager_write_transient_units(u->manager);
+        }
+}
+
 static void bidi_set_free(Unit *u, Hashmap *h) {
         Unit *other;
         Iterator i;
@@ -483,7 +552,7 @@ static void unit_remove_transient(Unit *u) {
         if (!u->transient)
                 return;
 
-        if (u->fragment_path)
+        if (u->fragment_path && !u->transient_data)
                 (void) unlink(u->fragment_path);
 
         STRV_FOREACH(i, u->dropin_paths) {
@@ -510,7 +579,7 @@ static void unit_free_requires_mounts_for(Unit *u) {
         assert(u);
 
         for (;;) {
-                _cleanup_free_ char *path;
+                _cleanup_(strintern_unrefp) const char *path;
 
                 path = hashmap_steal_first_key(u->requires_mounts_for);
                 if (!path)
@@ -530,7 +599,7 @@ static void unit_free_requires_mounts_for(Unit *u) {
 
                                 if (set_isempty(x)) {
                                         (void) hashmap_remove(u->manager->units_requiring_mounts_for, y);
-                                        free(y);
+                                        strintern_unref(y);
                                         set_free(x);
                                 }
                         }
@@ -574,6 +643,8 @@ void unit_free(Unit *u) {
         if (!MANAGER_IS_RELOADING(u->manager))
                 unit_remove_transient(u);
 
+        u->transient_data = mfree(u->transient_data);
+
         bus_unit_send_removed_signal(u);
 
         unit_done(u);
@@ -606,6 +677,7 @@ void unit_free(Unit *u) {
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 bidi_set_free(u, u->dependencies[d]);
+        manager_order_edges_removed(u->manager);
 
         if (u->on_console)
                 manager_unref_console(u->manager);
@@ -621,6 +693,7 @@ void unit_free(Unit *u) {
         set_remove(u->manager->startup_units, u);
 
         unit_unwatch_all_pids(u);
+        manager_notify_pid_cache_forget_unit(u->manager, u);
 
         unit_ref_unset(&u->slice);
         while (u->refs_by_target)
@@ -653,18 +726,10 @@ void unit_free(Unit *u) {
         if (u->in_stop_when_unneeded_queue)
                 LIST_REMOVE(stop_when_unneeded_queue, u->manager->stop_when_unneeded_queue, u);
 
-        safe_close(u->ip_accounting_ingress_map_fd);
-        safe_close(u->ip_accounting_egress_map_fd);
+        if (u->in_transient_write_queue)
+                LIST_REMOVE(transient_write_queue, u->manager->transient_write_queue, u);
 
-        safe_close(u->ipv4_allow_map_fd);
-        safe_close(u->ipv6_allow_map_fd);
-        safe_close(u->ipv4_deny_map_fd);
-        safe_close(u->ipv6_deny_map_fd);
-
-        bpf_program_unref(u->ip_bpf_ingress);
-        bpf_program_unref(u->ip_bpf_ingress_installed);
-        bpf_program_unref(u->ip_bpf_egress);
-        bpf_program_unref(u->ip_bpf_egress_installed);
+        unit_accounting_free(u->accounting);
 
         condition_free_list(u->conditions);
         condition_free_list(u->asserts);
@@ -678,7 +743,7 @@ void unit_free(Unit *u) {
 
         free(u->job_timeout_reboot_arg);
 
-        set_free_free(u->names);
+        set_free_with_destructor(u->names, strintern_unref);
 
         free(u->reboot_arg);
 
@@ -746,7 +811,7 @@ static int merge_names(Unit *u, Unit *other) {
         if (r < 0)
                 return r;
 
-        set_free_free(other->names);
+        set_free_with_destructor(other->names, strintern_unref);
         other->names = NULL;
         other->id = NULL;
 
@@ -900,7 +965,10 @@ int unit_merge(Unit *u, Unit *other) {
         while (other->refs_by_target)
                 unit_ref_set(other->refs_by_target, other->refs_by_target->source, u);
 
-        /* Merge dependencies */
+        /* Merge dependencies. This moves orderings around wholesale, don't bother updating the ranks on the way */
+        if (!hashmap_isempty(other->dependencies[UNIT_BEFORE]) || !hashmap_isempty(other->dependencies[UNIT_AFTER]))
+                manager_order_invalidate(u->manager);
+
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 merge_dependencies(u, other, other_id, d);
 
@@ -1479,6 +1547,7 @@ int unit_load(Unit *u) {
         if (u->in_load_queue) {
                 LIST_REMOVE(load_queue, u->manager->load_queue, u);
                 u->in_load_queue = false;
+                u->load_preparsed = false;
         }
 
         if (u->type == _UNIT_TYPE_INVALID)
@@ -1494,6 +1563,8 @@ int unit_load(Unit *u) {
 
                 u->transient_file = safe_fclose(u->transient_file);
                 u->fragment_mtime = now(CLOCK_REALTIME);
+
+                unit_add_to_transient_write_queue(u);
         }
 
         if (UNIT_VTABLE(u)->load) {
@@ -2338,6 +2409,9 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlag
                         u->active_enter_timestamp = u->state_change_timestamp;
                 else if (UNIT_IS_ACTIVE_OR_RELOADING(os) && !UNIT_IS_ACTIVE_OR_RELOADING(ns))
                         u->active_exit_timestamp = u->state_change_timestamp;
+
+                if (os != ns)
+                        manager_boot_trace(m, BOOT_TRACE_UNIT_STATE, u->id, "%s", unit_active_state_to_string(ns));
         }
 
         /* Keep track of failed units */
@@ -2520,6 +2594,8 @@ int unit_watch_pid(Unit *u, pid_t pid) {
 
         /* Watch a specific PID */
 
+        manager_notify_pid_cache_forget_pid(u->manager, pid);
+
         r = set_ensure_allocated(&u->pids, NULL);
         if (r < 0)
                 return r;
@@ -2583,6 +2659,8 @@ void unit_unwatch_pid(Unit *u, pid_t pid) {
         assert(u);
         assert(pid_is_valid(pid));
 
+        manager_notify_pid_cache_forget_pid(u->manager, pid);
+
         /* First let's drop the unit in case it's keyed as "pid". */
         (void) hashmap_remove_value(u->manager->watch_pids, PID_TO_PTR(pid), u);
 
@@ -2864,10 +2942,19 @@ int unit_add_dependency(
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
                 r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
-                if (r < 0)
+                if (r < 0) {
+                        /* Only one half of the ordering is in place, the ranks might not find it */
+                        if (IN_SET(d, UNIT_BEFORE, UNIT_AFTER))
+                                manager_order_invalidate(u->manager);
                         return r;
+                }
         }
 
+        if (d == UNIT_BEFORE)
+                unit_order_add(u, other);
+        else if (d == UNIT_AFTER)
+                unit_order_add(other, u);
+
         if (add_reference) {
                 r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
@@ -3190,21 +3277,18 @@ bool unit_can_serialize(Unit *u) {
         return UNIT_VTABLE(u)->serialize && UNIT_VTABLE(u)->deserialize_item;
 }
 
-static int unit_serialize_cgroup_mask(FILE *f, const char *key, CGroupMask mask) {
+static int unit_serialize_cgroup_mask(Unit *u, FILE *f, const char *key, CGroupMask mask) {
         _cleanup_free_ char *s = NULL;
         int r = 0;
 
+        assert(u);
         assert(f);
         assert(key);
 
         if (mask != 0) {
                 r = cg_mask_to_string(mask, &s);
-                if (r >= 0) {
-                        fputs(key, f);
-                        fputc('=', f);
-                        fputs(s, f);
-                        fputc('\n', f);
-                }
+                if (r >= 0)
+                        (void) unit_serialize_item(u, f, key, s);
         }
         return r;
 }
@@ -3217,28 +3301,34 @@ static const char *ip_accounting_metric_field[_CGROUP_IP_ACCOUNTING_METRIC_MAX]
 };
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+        SerializationFormat format;
         CGroupIPAccountingMetric m;
+        const char *k;
+        Iterator i;
+        char *value;
         int r;
 
         assert(u);
         assert(f);
         assert(fds);
 
+        format = u->manager->serialization_format;
+
         if (unit_can_serialize(u)) {
                 r = UNIT_VTABLE(u)->serialize(u, f, fds);
                 if (r < 0)
                         return r;
         }
 
-        dual_timestamp_serialize(f, "state-change-timestamp", &u->state_change_timestamp);
+        serialize_dual_timestamp(f, format, "state-change-timestamp", &u->state_change_timestamp);
 
-        dual_timestamp_serialize(f, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
-        dual_timestamp_serialize(f, "active-enter-timestamp", &u->active_enter_timestamp);
-        dual_timestamp_serialize(f, "active-exit-timestamp", &u->active_exit_timestamp);
-        dual_timestamp_serialize(f, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
+        serialize_dual_timestamp(f, format, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
+        serialize_dual_timestamp(f, format, "active-enter-timestamp", &u->active_enter_timestamp);
+        serialize_dual_timestamp(f, format, "active-exit-timestamp", &u->active_exit_timestamp);
+        serialize_dual_timestamp(f, format, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
 
-        dual_timestamp_serialize(f, "condition-timestamp", &u->condition_timestamp);
-        dual_timestamp_serialize(f, "assert-timestamp", &u->assert_timestamp);
+        serialize_dual_timestamp(f, format, "condition-timestamp", &u->condition_timestamp);
+        serialize_dual_timestamp(f, format, "assert-timestamp", &u->assert_timestamp);
 
         if (dual_timestamp_is_set(&u->condition_timestamp))
                 unit_serialize_item(u, f, "condition-result", yes_no(u->condition_result));
@@ -3250,19 +3340,33 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         unit_serialize_item(u, f, "exported-invocation-id", yes_no(u->exported_invocation_id));
         unit_serialize_item(u, f, "exported-log-level-max", yes_no(u->exported_log_level_max));
+        unit_serialize_item(u, f, "exported-log-rate-limit-interval", yes_no(u->exported_log_rate_limit_interval));
+        unit_serialize_item(u, f, "exported-log-rate-limit-burst", yes_no(u->exported_log_rate_limit_burst));
         unit_serialize_item(u, f, "exported-log-extra-fields", yes_no(u->exported_log_extra_fields));
 
-        unit_serialize_item_format(u, f, "cpu-usage-base", "%" PRIu64, u->cpu_usage_base);
-        if (u->cpu_usage_last != NSEC_INFINITY)
-                unit_serialize_item_format(u, f, "cpu-usage-last", "%" PRIu64, u->cpu_usage_last);
+        if (u->accounting) {
+                unit_serialize_item_format(u, f, "cpu-usage-base", "%" PRIu64, u->accounting->cpu_usage_base);
+                if (u->accounting->cpu_usage_last != NSEC_INFINITY)
+                        unit_serialize_item_format(u, f, "cpu-usage-last", "%" PRIu64, u->accounting->cpu_usage_last);
+        }
 
         if (u->cgroup_path)
                 unit_serialize_item(u, f, "cgroup", u->cgroup_path);
         unit_serialize_item(u, f, "cgroup-realized", yes_no(u->cgroup_realized));
-        (void) unit_serialize_cgroup_mask(f, "cgroup-realized-mask", u->cgroup_realized_mask);
-        (void) unit_serialize_cgroup_mask(f, "cgroup-enabled-mask", u->cgroup_enabled_mask);
+        (void) unit_serialize_cgroup_mask(u, f, "cgroup-realized-mask", u->cgroup_realized_mask);
+        (void) unit_serialize_cgroup_mask(u, f, "cgroup-enabled-mask", u->cgroup_enabled_mask);
         unit_serialize_item_format(u, f, "cgroup-bpf-realized", "%i", u->cgroup_bpf_state);
 
+        HASHMAP_FOREACH_KEY(value, k, u->cgroup_attributes, i) {
+                _cleanup_free_ char *a = NULL;
+
+                a = strjoin(k, " ", value);
+                if (!a)
+                        return log_oom();
+
+                (void) unit_serialize_item_escaped(u, f, "cgroup-attribute", a);
+        }
+
         if (uid_is_valid(u->ref_uid))
                 unit_serialize_item_format(u, f, "ref-uid", UID_FMT, u->ref_uid);
         if (gid_is_valid(u->ref_gid))
@@ -3271,7 +3375,7 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (!sd_id128_is_null(u->invocation_id))
                 unit_serialize_item_format(u, f, "invocation-id", SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(u->invocation_id));
 
-        bus_track_serialize(u->bus_track, f, "ref");
+        bus_track_serialize(u->bus_track, f, format, "ref");
 
         for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++) {
                 uint64_t v;
@@ -3283,18 +3387,17 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         if (serialize_jobs) {
                 if (u->job) {
-                        fprintf(f, "job\n");
+                        serialize_marker(f, format, "job");
                         job_serialize(u->job, f);
                 }
 
                 if (u->nop_job) {
-                        fprintf(f, "job\n");
+                        serialize_marker(f, format, "job");
                         job_serialize(u->nop_job, f);
                 }
         }
 
-        /* End marker */
-        fputc('\n', f);
+        serialize_end(f, format);
         return 0;
 }
 
@@ -3306,10 +3409,7 @@ int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value) {
         if (!value)
                 return 0;
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(value, f);
-        fputc('\n', f);
+        serialize_item(f, u->manager->serialization_format, key, value);
 
         return 1;
 }
@@ -3328,10 +3428,7 @@ int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *v
         if (!c)
                 return -ENOMEM;
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(c, f);
-        fputc('\n', f);
+        serialize_item(f, u->manager->serialization_format, key, c);
 
         return 1;
 }
@@ -3350,7 +3447,7 @@ int unit_serialize_item_fd(Unit *u, FILE *f, FDSet *fds, const char *key, int fd
         if (copy < 0)
                 return copy;
 
-        fprintf(f, "%s=%i\n", key, copy);
+        serialize_item_format(f, u->manager->serialization_format, key, "%i", copy);
         return 1;
 }
 
@@ -3362,17 +3459,13 @@ void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *f
         assert(key);
         assert(format);
 
-        fputs(key, f);
-        fputc('=', f);
-
         va_start(ap, format);
-        vfprintf(f, format, ap);
+        serialize_item_formatv(f, u->manager->serialization_format, key, format, ap);
         va_end(ap);
-
-        fputc('\n', f);
 }
 
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer buf = {};
         int r;
 
         assert(u);
@@ -3380,21 +3473,14 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
         assert(fds);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
                 CGroupIPAccountingMetric m;
+                char *l, *v;
                 size_t k;
 
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                /* End marker */
-                if (isempty(l))
+                r = deserialize_line(f, u->manager->serialization_format, &buf, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0) /* End marker */
                         break;
 
                 k = strcspn(l, "=");
@@ -3506,6 +3592,26 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
 
                         continue;
 
+                } else if (streq(l, "exported-log-rate-limit-interval")) {
+
+                        r = parse_boolean(v);
+                        if (r < 0)
+                                log_unit_debug(u, "Failed to parse exported log rate limit interval bool %s, ignoring.", v);
+                        else
+                                u->exported_log_rate_limit_interval = r;
+
+                        continue;
+
+                } else if (streq(l, "exported-log-rate-limit-burst")) {
+
+                        r = parse_boolean(v);
+                        if (r < 0)
+                                log_unit_debug(u, "Failed to parse exported log rate limit burst bool %s, ignoring.", v);
+                        else
+                                u->exported_log_rate_limit_burst = r;
+
+                        continue;
+
                 } else if (streq(l, "exported-log-extra-fields")) {
 
                         r = parse_boolean(v);
@@ -3517,18 +3623,32 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                         continue;
 
                 } else if (STR_IN_SET(l, "cpu-usage-base", "cpuacct-usage-base")) {
+                        nsec_t ns;
 
-                        r = safe_atou64(v, &u->cpu_usage_base);
+                        r = safe_atou64(v, &ns);
                         if (r < 0)
                                 log_unit_debug(u, "Failed to parse CPU usage base %s, ignoring.", v);
+                        else if (ns > 0 || u->accounting) {
+                                if (!unit_get_accounting(u))
+                                        return log_oom();
+
+                                u->accounting->cpu_usage_base = ns;
+                        }
 
                         continue;
 
                 } else if (streq(l, "cpu-usage-last")) {
+                        nsec_t ns;
 
-                        r = safe_atou64(v, &u->cpu_usage_last);
+                        r = safe_atou64(v, &ns);
                         if (r < 0)
                                 log_unit_debug(u, "Failed to read CPU usage last %s, ignoring.", v);
+                        else {
+                                if (!unit_get_accounting(u))
+                                        return log_oom();
+
+                                u->accounting->cpu_usage_last = ns;
+                        }
 
                         continue;
 
@@ -3566,6 +3686,39 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                                 log_unit_debug(u, "Failed to parse cgroup-enabled-mask %s, ignoring.", v);
                         continue;
 
+                } else if (streq(l, "cgroup-attribute")) {
+                        _cleanup_free_ char *a = NULL, *value = NULL;
+                        char *e;
+
+                        r = cunescape(v, 0, &a);
+                        if (r < 0) {
+                                log_unit_debug_errno(u, r, "Failed to unescape cgroup attribute %s, ignoring: %m", v);
+                                continue;
+                        }
+
+                        e = strchr(a, ' ');
+                        if (!e) {
+                                log_unit_debug(u, "Failed to parse cgroup attribute %s, ignoring.", a);
+                                continue;
+                        }
+                        *e = 0;
+
+                        value = strdup(e + 1);
+                        if (!value)
+                                return log_oom();
+
+                        r = hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops);
+                        if (r < 0)
+                                return log_oom();
+
+                        r = hashmap_put(u->cgroup_attributes, a, value);
+                        if (r < 0)
+                                log_unit_debug_errno(u, r, "Failed to store cgroup attribute %s, ignoring: %m", a);
+                        else
+                                a = value = NULL;
+
+                        continue;
+
                 } else if (streq(l, "cgroup-bpf-realized")) {
                         int i;
 
@@ -3632,8 +3785,12 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                         r = safe_atou64(v, &c);
                         if (r < 0)
                                 log_unit_debug(u, "Failed to parse IP accounting value %s, ignoring.", v);
-                        else
-                                u->ip_accounting_extra[m] = c;
+                        else {
+                                if (!unit_get_accounting(u))
+                                        return log_oom();
+
+                                u->accounting->ip_accounting_extra[m] = c;
+                        }
                         continue;
                 }
 
@@ -3669,26 +3826,6 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
         return 0;
 }
 
-void unit_deserialize_skip(FILE *f) {
-        assert(f);
-
-        /* Skip serialized data for this unit. We don't know what it is. */
-
-        for (;;) {
-                char line[LINE_MAX], *l;
-
-                if (!fgets(line, sizeof line, f))
-                        return;
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                /* End marker */
-                if (isempty(l))
-                        return;
-        }
-}
-
 int unit_add_node_dependency(Unit *u, const char *what, bool wants, UnitDependency dep, UnitDependencyMask mask) {
         Unit *device;
         _cleanup_free_ char *e = NULL;
@@ -3806,8 +3943,9 @@ bool unit_need_daemon_reload(Unit *u) {
 
         assert(u);
 
-        /* For unit files, we allow masking… */
-        if (fragment_mtime_newer(u->fragment_path, u->fragment_mtime,
+        /* For unit files, we allow masking… Transient unit files we didn't write yet can't have changed. */
+        if (!u->transient_data &&
+            fragment_mtime_newer(u->fragment_path, u->fragment_mtime,
                                  u->load_state == UNIT_MASKED))
                 return true;
 
@@ -4011,10 +4149,17 @@ UnitFileState unit_get_unit_file_state(Unit *u) {
 
         assert(u);
 
+        /* That's what install.c reports for files in the transient directory, once we wrote it there */
+        if (u->transient_data)
+                return UNIT_FILE_TRANSIENT;
+
         if (u->unit_file_state < 0 && u->fragment_path) {
-                r = unit_file_get_state(
+                /* Use the manager's search path and its cache of the files in there, so that we don't have
+                 * to set up the search path again and probe every directory in it for every unit */
+                r = unit_file_lookup_state(
                                 u->manager->unit_file_scope,
-                                NULL,
+                                &u->manager->lookup_paths,
+                                u->manager->unit_path_cache,
                                 u->id,
                                 &u->unit_file_state);
                 if (r < 0)
@@ -4443,22 +4588,21 @@ int unit_make_transient(Unit *u) {
         if (!UNIT_VTABLE(u)->can_transient)
                 return -EOPNOTSUPP;
 
-        (void) mkdir_p_label(u->manager->lookup_paths.transient, 0755);
-
         path = strjoin(u->manager->lookup_paths.transient, "/", u->id);
         if (!path)
                 return -ENOMEM;
 
-        /* Let's open the file we'll write the transient settings into. This file is kept open as long as we are
-         * creating the transient, and is closed in unit_load(), as soon as we start loading the file. */
+        /* Let's open the stream we'll write the transient settings into. It is kept open as long as we are
+         * creating the transient, and is closed in unit_load(), as soon as we start loading the unit. The
+         * settings are applied directly, the unit file is only needed on reload, see unit_write_transient(). */
 
-        RUN_WITH_UMASK(0022) {
-                f = fopen(path, "we");
-                if (!f)
-                        return -errno;
-        }
+        u->transient_file = safe_fclose(u->transient_file);
+        u->transient_data = mfree(u->transient_data);
+
+        f = open_memstream(&u->transient_data, &u->transient_size);
+        if (!f)
+                return -ENOMEM;
 
-        safe_fclose(u->transient_file);
         u->transient_file = f;
 
         free_and_replace(u->fragment_path, path);
@@ -4480,6 +4624,36 @@ int unit_make_transient(Unit *u) {
         return 0;
 }
 
+int unit_write_transient(Unit *u) {
+        struct stat st;
+        int r;
+
+        assert(u);
+
+        /* Writes out the unit file of a transient unit we kept in memory so far. This needs to happen before
+         * reloading, since units are loaded from disk again after that, and when somebody else might want to
+         * look at the file. */
+
+        if (!u->transient_data || u->transient_file)
+                return 0;
+
+        (void) mkdir_p_label(u->manager->lookup_paths.transient, 0755);
+
+        RUN_WITH_UMASK(0022)
+                r = write_string_file(u->fragment_path, u->transient_data,
+                                      WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to write transient unit file %s: %m", u->fragment_path);
+
+        if (stat(u->fragment_path, &st) >= 0)
+                u->fragment_mtime = timespec_load(&st.st_mtim);
+
+        u->transient_data = mfree(u->transient_data);
+        u->transient_size = 0;
+
+        return 0;
+}
+
 static void log_kill(pid_t pid, int sig, void *userdata) {
         _cleanup_free_ char *comm = NULL;
 
@@ -4636,6 +4810,7 @@ int unit_kill_context(
 }
 
 int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask) {
+        _cleanup_(strintern_unrefp) const char *interned = NULL;
         _cleanup_free_ char *p = NULL;
         char *prefix;
         UnitDependencyInfo di;
@@ -4647,7 +4822,8 @@ int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask)
         /* Registers a unit for requiring a certain path and all its prefixes. We keep a hashtable of these paths in
          * the unit (from the path to the UnitDependencyInfo structure indicating how to the dependency came to
          * be). However, we build a prefix table for all possible prefixes so that new appearing mount units can easily
-         * determine which units to make themselves a dependency of. */
+         * determine which units to make themselves a dependency of. The paths are interned, as
+         * the same few paths and prefixes show up in a large number of units. */
 
         if (!path_is_absolute(path))
                 return -EINVAL;
@@ -4672,10 +4848,14 @@ int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask)
                 .origin_mask = mask
         };
 
-        r = hashmap_put(u->requires_mounts_for, path, di.data);
+        interned = strintern(path);
+        if (!interned)
+                return -ENOMEM;
+
+        r = hashmap_put(u->requires_mounts_for, interned, di.data);
         if (r < 0)
                 return r;
-        p = NULL;
+        interned = NULL;
 
         prefix = alloca(strlen(path) + 1);
         PATH_FOREACH_PREFIX_MORE(prefix, path) {
@@ -4683,13 +4863,13 @@ int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask)
 
                 x = hashmap_get(u->manager->units_requiring_mounts_for, prefix);
                 if (!x) {
-                        _cleanup_free_ char *q = NULL;
+                        _cleanup_(strintern_unrefp) const char *q = NULL;
 
                         r = hashmap_ensure_allocated(&u->manager->units_requiring_mounts_for, &path_hash_ops);
                         if (r < 0)
                                 return r;
 
-                        q = strdup(prefix);
+                        q = strintern(prefix);
                         if (!q)
                                 return -ENOMEM;
 
@@ -5123,6 +5303,8 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
         if (mask == 0)
                 return;
 
+        manager_order_edges_removed(u->manager);
+
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
                 bool done;
 
@@ -5216,6 +5398,60 @@ static int unit_export_log_level_max(Unit *u, const ExecContext *c) {
         return 0;
 }
 
+static int unit_export_log_rate_limit_interval(Unit *u, const ExecContext *c) {
+        _cleanup_free_ char *buf = NULL;
+        const char *p;
+        int r;
+
+        assert(u);
+        assert(c);
+
+        if (u->exported_log_rate_limit_interval)
+                return 0;
+
+        if (c->log_rate_limit_interval_usec == 0)
+                return 0;
+
+        p = strjoina("/run/systemd/units/log-rate-limit-interval:", u->id);
+
+        if (asprintf(&buf, "%" PRIu64, c->log_rate_limit_interval_usec) < 0)
+                return log_oom();
+
+        r = symlink_atomic(buf, p);
+        if (r < 0)
+                return log_unit_debug_errno(u, r, "Failed to create log rate limit interval symlink %s: %m", p);
+
+        u->exported_log_rate_limit_interval = true;
+        return 0;
+}
+
+static int unit_export_log_rate_limit_burst(Unit *u, const ExecContext *c) {
+        _cleanup_free_ char *buf = NULL;
+        const char *p;
+        int r;
+
+        assert(u);
+        assert(c);
+
+        if (u->exported_log_rate_limit_burst)
+                return 0;
+
+        if (c->log_rate_limit_burst == 0)
+                return 0;
+
+        p = strjoina("/run/systemd/units/log-rate-limit-burst:", u->id);
+
+        if (asprintf(&buf, "%u", c->log_rate_limit_burst) < 0)
+                return log_oom();
+
+        r = symlink_atomic(buf, p);
+        if (r < 0)
+                return log_unit_debug_errno(u, r, "Failed to create log rate limit burst symlink %s: %m", p);
+
+        u->exported_log_rate_limit_burst = true;
+        return 0;
+}
+
 static int unit_export_log_extra_fields(Unit *u, const ExecContext *c) {
         _cleanup_close_ int fd = -1;
         struct iovec *iovec;
@@ -5302,6 +5538,8 @@ void unit_export_state_files(Unit *u) {
         c = unit_get_exec_context(u);
         if (c) {
                 (void) unit_export_log_level_max(u, c);
+                (void) unit_export_log_rate_limit_interval(u, c);
+                (void) unit_export_log_rate_limit_burst(u, c);
                 (void) unit_export_log_extra_fields(u, c);
         }
 }
@@ -5333,6 +5571,20 @@ void unit_unlink_state_files(Unit *u) {
                 u->exported_log_level_max = false;
         }
 
+        if (u->exported_log_rate_limit_interval) {
+                p = strjoina("/run/systemd/units/log-rate-limit-interval:", u->id);
+                (void) unlink(p);
+
+                u->exported_log_rate_limit_interval = false;
+        }
+
+        if (u->exported_log_rate_limit_burst) {
+                p = strjoina("/run/systemd/units/log-rate-limit-burst:", u->id);
+                (void) unlink(p);
+
+                u->exported_log_rate_limit_burst = false;
+        }
+
         if (u->exported_log_extra_fields) {
                 p = strjoina("/run/systemd/units/extra-fields:", u->id);
                 (void) unlink(p);
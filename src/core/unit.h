@@ -14,6 +14,8 @@
 #include "cgroup.h"
 
 typedef struct UnitRef UnitRef;
+typedef struct BPFAccessMaps BPFAccessMaps;
+typedef struct BPFSharedProgram BPFSharedProgram;
 
 typedef enum KillOperation {
         KILL_TERMINATE,
@@ -105,6 +107,32 @@ struct UnitRef {
         LIST_FIELDS(UnitRef, refs_by_target);
 };
 
+/* Resource accounting and IP firewalling state. Only units with a cgroup that actually account for something or
+ * filter IP traffic need this, hence it is allocated on first use by unit_get_accounting(), and is NULL otherwise. */
+typedef struct UnitAccounting {
+        /* Where the cpu.stat or cpuacct.usage was at the time the unit was started */
+        nsec_t cpu_usage_base;
+        nsec_t cpu_usage_last; /* the most recently read value */
+
+        /* Recently read resource counters, and when they were read, for unit_get_metric_cached() */
+        uint64_t metric_cache[_CGROUP_METRIC_MAX];
+        usec_t metric_cache_timestamp[_CGROUP_METRIC_MAX];
+
+        /* IP BPF Firewalling/accounting */
+        int ip_accounting_ingress_map_fd;
+        int ip_accounting_egress_map_fd;
+
+        BPFAccessMaps *ip_allow_maps, *ip_deny_maps;
+
+        BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
+        BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
+
+        /* The kernel objects the above were loaded from, if they are shared with other units */
+        BPFSharedProgram *ip_bpf_ingress_shared, *ip_bpf_egress_shared;
+
+        uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+} UnitAccounting;
+
 typedef enum UnitCGroupBPFState {
         UNIT_CGROUP_BPF_OFF = 0,
         UNIT_CGROUP_BPF_ON = 1,
@@ -127,6 +155,10 @@ typedef struct Unit {
          * dependency exists, using the UnitDependencyInfo type */
         Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
 
+        /* Position in the topological order of Before=/After=, and a mark for walking it, see unit-order.c */
+        unsigned order_rank;
+        unsigned order_generation;
+
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
 
@@ -144,6 +176,11 @@ typedef struct Unit {
         /* If this is a transient unit we are currently writing, this is where we are writing it to */
         FILE *transient_file;
 
+        /* The transient unit file, as long as it was not written to fragment_path yet. Scopes in particular are
+         * often gone again before anybody looks at their unit file, hence we write it only when it is needed. */
+        char *transient_data;
+        size_t transient_size;
+
         /* If there is something to do with this unit, then this is the installed job for it */
         Job *job;
 
@@ -215,6 +252,9 @@ typedef struct Unit {
         /* Queue of units with StopWhenUnneeded set that shell be checked for clean-up. */
         LIST_FIELDS(Unit, stop_when_unneeded_queue);
 
+        /* Queue of transient units whose unit file is still to be written */
+        LIST_FIELDS(Unit, transient_write_queue);
+
         /* PIDs we keep an eye on. Note that a unit might have many
          * more, but these are the ones we care enough about to
          * process SIGCHLD for */
@@ -225,6 +265,10 @@ typedef struct Unit {
         unsigned sigchldgen;
         unsigned notifygen;
 
+        /* Used to coalesce repeated WATCHDOG=1 pings of the same PID within one batch of notification messages */
+        unsigned notify_watchdog_batchgen;
+        pid_t notify_watchdog_pid;
+
         /* Used during GC sweeps */
         unsigned gc_marker;
 
@@ -250,10 +294,6 @@ typedef struct Unit {
         UnitFileState unit_file_state;
         int unit_file_preset;
 
-        /* Where the cpu.stat or cpuacct.usage was at the time the unit was started */
-        nsec_t cpu_usage_base;
-        nsec_t cpu_usage_last; /* the most recently read value */
-
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
         CGroupMask cgroup_realized_mask;
@@ -262,19 +302,11 @@ typedef struct Unit {
         CGroupMask cgroup_members_mask;
         int cgroup_inotify_wd;
 
-        /* IP BPF Firewalling/accounting */
-        int ip_accounting_ingress_map_fd;
-        int ip_accounting_egress_map_fd;
-
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
-
-        BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
-        BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
+        /* The cgroup attributes we wrote, and their values, so that we don't write them again if unchanged */
+        Hashmap *cgroup_attributes;
 
-        uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+        /* See above, NULL until needed */
+        UnitAccounting *accounting;
 
         /* Low-priority event source which is used to remove watched PIDs that have gone away, and subscribe to any new
          * ones which might have appeared. */
@@ -319,6 +351,7 @@ typedef struct Unit {
         bool perpetual;
 
         bool in_load_queue:1;
+        bool load_preparsed:1;
         bool in_dbus_queue:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
@@ -326,9 +359,13 @@ typedef struct Unit {
         bool in_cgroup_empty_queue:1;
         bool in_target_deps_queue:1;
         bool in_stop_when_unneeded_queue:1;
+        bool in_transient_write_queue:1;
 
         bool sent_dbus_new_signal:1;
 
+        /* Whether Manager.notify_pid_cache might point to us */
+        bool in_notify_pid_cache:1;
+
         bool in_audit:1;
         bool on_console:1;
 
@@ -352,6 +389,8 @@ typedef struct Unit {
         /* Remember which unit state files we created */
         bool exported_invocation_id:1;
         bool exported_log_level_max:1;
+        bool exported_log_rate_limit_interval:1;
+        bool exported_log_rate_limit_burst:1;
         bool exported_log_extra_fields:1;
 
         /* When writing transient unit files, stores which section we stored last. If < 0, we didn't write any yet. If
@@ -596,6 +635,8 @@ Unit *unit_new(Manager *m, size_t size);
 void unit_free(Unit *u);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Unit *, unit_free);
 
+UnitAccounting *unit_get_accounting(Unit *u);
+
 int unit_new_for_name(Manager *m, size_t size, const char *name, Unit **ret);
 int unit_add_name(Unit *u, const char *name);
 
@@ -618,6 +659,7 @@ void unit_add_to_cleanup_queue(Unit *u);
 void unit_add_to_gc_queue(Unit *u);
 void unit_add_to_target_deps_queue(Unit *u);
 void unit_submit_to_stop_when_unneeded_queue(Unit *u);
+void unit_add_to_transient_write_queue(Unit *u);
 
 int unit_merge(Unit *u, Unit *other);
 int unit_merge_by_name(Unit *u, const char *other);
@@ -684,7 +726,6 @@ bool unit_can_serialize(Unit *u) _pure_;
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs);
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds);
-void unit_deserialize_skip(FILE *f);
 
 int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value);
 int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *value);
@@ -747,6 +788,7 @@ int unit_write_settingf(Unit *u, UnitWriteFlags mode, const char *name, const ch
 int unit_kill_context(Unit *u, KillContext *c, KillOperation k, pid_t main_pid, pid_t control_pid, bool main_pid_alien);
 
 int unit_make_transient(Unit *u);
+int unit_write_transient(Unit *u);
 
 int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask);
 
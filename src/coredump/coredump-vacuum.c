@@ -19,17 +19,28 @@
 #define DEFAULT_KEEP_FREE_UPPER (uint64_t) (4ULL*1024ULL*1024ULL*1024ULL) /* 4 GiB */
 #define DEFAULT_KEEP_FREE (uint64_t) (1024ULL*1024ULL)                    /* 1 MB */
 
+struct vacuum_file {
+        char *name;
+        usec_t mtime;
+        uint64_t size;
+};
+
 struct vacuum_candidate {
-        unsigned n_files;
-        char *oldest_file;
-        usec_t oldest_mtime;
+        struct vacuum_file *files;
+        size_t n_files, n_allocated;
+        size_t n_removed; /* files[] is sorted by age, this many of the oldest are gone already */
 };
 
 static void vacuum_candidate_free(struct vacuum_candidate *c) {
+        size_t i;
+
         if (!c)
                 return;
 
-        free(c->oldest_file);
+        for (i = 0; i < c->n_files; i++)
+                free(c->files[i].name);
+
+        free(c->files);
         free(c);
 }
 
@@ -41,6 +52,21 @@ static void vacuum_candidate_hashmap_free(Hashmap *h) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, vacuum_candidate_hashmap_free);
 
+static int vacuum_file_compare(const void *a, const void *b) {
+        const struct vacuum_file *x = a, *y = b;
+
+        if (x->mtime < y->mtime)
+                return -1;
+        if (x->mtime > y->mtime)
+                return 1;
+
+        return 0;
+}
+
+static size_t vacuum_candidate_left(const struct vacuum_candidate *c) {
+        return c->n_files - c->n_removed;
+}
+
 static int uid_from_file_name(const char *filename, uid_t *uid) {
         const char *p, *e, *u;
 
@@ -111,8 +137,13 @@ static bool vacuum_necessary(int fd, uint64_t sum, uint64_t keep_free, uint64_t
 }
 
 int coredump_vacuum(int exclude_fd, uint64_t keep_free, uint64_t max_use) {
+        _cleanup_(vacuum_candidate_hashmap_freep) Hashmap *h = NULL;
         _cleanup_closedir_ DIR *d = NULL;
+        struct vacuum_candidate *c;
         struct stat exclude_st;
+        struct dirent *de;
+        uint64_t sum = 0;
+        Iterator i;
         int r;
 
         if (keep_free == 0 && max_use == 0)
@@ -137,89 +168,86 @@ int coredump_vacuum(int exclude_fd, uint64_t keep_free, uint64_t max_use) {
                 return log_error_errno(errno, "Can't open coredump directory: %m");
         }
 
-        for (;;) {
-                _cleanup_(vacuum_candidate_hashmap_freep) Hashmap *h = NULL;
-                struct vacuum_candidate *worst = NULL;
-                struct dirent *de;
-                uint64_t sum = 0;
+        /* Read the directory only once, and then keep track of what we removed, rather than rescanning it for each
+         * file we remove. */
 
-                rewinddir(d);
+        FOREACH_DIRENT(de, d, goto fail) {
+                struct vacuum_candidate *candidate;
+                struct stat st;
+                uid_t uid;
+                char *n;
 
-                FOREACH_DIRENT(de, d, goto fail) {
-                        struct vacuum_candidate *c;
-                        struct stat st;
-                        uid_t uid;
-                        usec_t t;
-
-                        r = uid_from_file_name(de->d_name, &uid);
-                        if (r < 0)
-                                continue;
-
-                        if (fstatat(dirfd(d), de->d_name, &st, AT_NO_AUTOMOUNT|AT_SYMLINK_NOFOLLOW) < 0) {
-                                if (errno == ENOENT)
-                                        continue;
+                r = uid_from_file_name(de->d_name, &uid);
+                if (r < 0)
+                        continue;
 
-                                log_warning_errno(errno, "Failed to stat /var/lib/systemd/coredump/%s: %m", de->d_name);
+                if (fstatat(dirfd(d), de->d_name, &st, AT_NO_AUTOMOUNT|AT_SYMLINK_NOFOLLOW) < 0) {
+                        if (errno == ENOENT)
                                 continue;
-                        }
 
-                        if (!S_ISREG(st.st_mode))
-                                continue;
+                        log_warning_errno(errno, "Failed to stat /var/lib/systemd/coredump/%s: %m", de->d_name);
+                        continue;
+                }
 
-                        if (exclude_fd >= 0 &&
-                            exclude_st.st_dev == st.st_dev &&
-                            exclude_st.st_ino == st.st_ino)
-                                continue;
+                if (!S_ISREG(st.st_mode))
+                        continue;
 
-                        r = hashmap_ensure_allocated(&h, NULL);
-                        if (r < 0)
-                                return log_oom();
+                if (exclude_fd >= 0 &&
+                    exclude_st.st_dev == st.st_dev &&
+                    exclude_st.st_ino == st.st_ino)
+                        continue;
 
-                        t = timespec_load(&st.st_mtim);
+                r = hashmap_ensure_allocated(&h, NULL);
+                if (r < 0)
+                        return log_oom();
 
-                        c = hashmap_get(h, UID_TO_PTR(uid));
-                        if (c) {
+                candidate = hashmap_get(h, UID_TO_PTR(uid));
+                if (!candidate) {
+                        _cleanup_(vacuum_candidate_freep) struct vacuum_candidate *nc = NULL;
 
-                                if (t < c->oldest_mtime) {
-                                        char *n;
+                        nc = new0(struct vacuum_candidate, 1);
+                        if (!nc)
+                                return log_oom();
 
-                                        n = strdup(de->d_name);
-                                        if (!n)
-                                                return log_oom();
+                        r = hashmap_put(h, UID_TO_PTR(uid), nc);
+                        if (r < 0)
+                                return log_oom();
 
-                                        free(c->oldest_file);
-                                        c->oldest_file = n;
-                                        c->oldest_mtime = t;
-                                }
+                        candidate = TAKE_PTR(nc);
+                }
 
-                        } else {
-                                _cleanup_(vacuum_candidate_freep) struct vacuum_candidate *n = NULL;
+                if (!GREEDY_REALLOC(candidate->files, candidate->n_allocated, candidate->n_files + 1))
+                        return log_oom();
 
-                                n = new0(struct vacuum_candidate, 1);
-                                if (!n)
-                                        return log_oom();
+                n = strdup(de->d_name);
+                if (!n)
+                        return log_oom();
 
-                                n->oldest_file = strdup(de->d_name);
-                                if (!n->oldest_file)
-                                        return log_oom();
+                candidate->files[candidate->n_files++] = (struct vacuum_file) {
+                        .name = n,
+                        .mtime = timespec_load(&st.st_mtim),
+                        .size = st.st_blocks * 512,
+                };
 
-                                n->oldest_mtime = t;
+                sum += st.st_blocks * 512;
+        }
 
-                                r = hashmap_put(h, UID_TO_PTR(uid), n);
-                                if (r < 0)
-                                        return log_oom();
+        HASHMAP_FOREACH(c, h, i)
+                qsort_safe(c->files, c->n_files, sizeof(struct vacuum_file), vacuum_file_compare);
 
-                                c = TAKE_PTR(n);
-                        }
+        for (;;) {
+                struct vacuum_candidate *worst = NULL;
+                struct vacuum_file *f;
 
-                        c->n_files++;
+                HASHMAP_FOREACH(c, h, i) {
+                        if (vacuum_candidate_left(c) == 0)
+                                continue;
 
                         if (!worst ||
-                            worst->n_files < c->n_files ||
-                            (worst->n_files == c->n_files && c->oldest_mtime < worst->oldest_mtime))
+                            vacuum_candidate_left(worst) < vacuum_candidate_left(c) ||
+                            (vacuum_candidate_left(worst) == vacuum_candidate_left(c) &&
+                             c->files[c->n_removed].mtime < worst->files[worst->n_removed].mtime))
                                 worst = c;
-
-                        sum += st.st_blocks * 512;
                 }
 
                 if (!worst)
@@ -229,13 +257,16 @@ int coredump_vacuum(int exclude_fd, uint64_t keep_free, uint64_t max_use) {
                 if (r <= 0)
                         return r;
 
-                r = unlinkat_deallocate(dirfd(d), worst->oldest_file, 0);
+                f = worst->files + worst->n_removed++;
+                sum -= f->size;
+
+                r = unlinkat_deallocate(dirfd(d), f->name, 0);
                 if (r == -ENOENT)
                         continue;
                 if (r < 0)
-                        return log_error_errno(r, "Failed to remove file %s: %m", worst->oldest_file);
+                        return log_error_errno(r, "Failed to remove file %s: %m", f->name);
 
-                log_info("Removed old coredump %s.", worst->oldest_file);
+                log_info("Removed old coredump %s.", f->name);
         }
 
         return 0;
@@ -13,6 +13,7 @@
 #include "device-util.h"
 #include "escape.h"
 #include "fileio.h"
+#include "lockfile-util.h"
 #include "log.h"
 #include "mount-util.h"
 #include "parse-util.h"
@@ -28,6 +29,8 @@
 #define CRYPT_SECTOR_SIZE 512
 #define CRYPT_MAX_SECTOR_SIZE 4096
 
+#define PASSWORD_LOCK_RETRY_USEC (50 * USEC_PER_MSEC)
+
 static const char *arg_type = NULL; /* ANY_LUKS, CRYPT_LUKS1, CRYPT_LUKS2, CRYPT_TCRYPT or CRYPT_PLAIN */
 static char *arg_cipher = NULL;
 static unsigned arg_key_size = 0;
@@ -52,6 +55,7 @@ static char **arg_tcrypt_keyfiles = NULL;
 static uint64_t arg_offset = 0;
 static uint64_t arg_skip = 0;
 static usec_t arg_timeout = USEC_INFINITY;
+static bool arg_shared_unlock = false;
 
 /* Options Debian's crypttab knows we don't:
 
@@ -195,6 +199,8 @@ static int parse_one_option(const char *option) {
                 arg_verify = true;
         else if (STR_IN_SET(option, "allow-discards", "discard"))
                 arg_discards = true;
+        else if (streq(option, "shared-unlock"))
+                arg_shared_unlock = true;
         else if (streq(option, "luks"))
                 arg_type = ANY_LUKS;
         else if (streq(option, "tcrypt"))
@@ -327,6 +333,26 @@ static char *disk_mount_point(const char *label) {
         return NULL;
 }
 
+static int acquire_password_lock(usec_t until, LockFile *ret) {
+        int r;
+
+        assert(ret);
+
+        /* Waits for the other volumes to finish querying the user, but no longer than we'd wait for the user
+         * ourselves. until == 0 means forever, as for get_password(). */
+
+        for (;;) {
+                r = make_lock_file("/run/systemd/cryptsetup.lock", LOCK_EX|LOCK_NB, ret);
+                if (r != -EBUSY)
+                        return r;
+
+                if (until > 0 && now(CLOCK_MONOTONIC) >= until)
+                        return -ETIMEDOUT;
+
+                (void) usleep(PASSWORD_LOCK_RETRY_USEC);
+        }
+}
+
 static int get_password(const char *vol, const char *src, usec_t until, bool accept_cached, char ***ret) {
         _cleanup_free_ char *description = NULL, *name_buffer = NULL, *mount_point = NULL, *text = NULL, *disk_path = NULL;
         _cleanup_strv_free_erase_ char **passwords = NULL;
@@ -699,6 +725,18 @@ int main(int argc, char *argv[]) {
                         _cleanup_strv_free_erase_ char **passwords = NULL;
 
                         if (!key_file) {
+                                _cleanup_(release_lock_file) LockFile lock = LOCK_FILE_INIT;
+
+                                /* If requested, only one volume queries the user at a time. The passphrase is
+                                 * pushed to the kernel keyring, hence the volumes waiting for the lock will find it
+                                 * there on their first try instead of asking again. The lock is released before the
+                                 * key derivation, so that the volumes are still activated in parallel. */
+                                if (arg_shared_unlock) {
+                                        r = acquire_password_lock(until, &lock);
+                                        if (r < 0)
+                                                log_warning_errno(r, "Failed to acquire password query lock, proceeding without: %m");
+                                }
+
                                 r = get_password(argv[2], argv[3], until, tries == 0 && !arg_verify, &passwords);
                                 if (r == -EAGAIN)
                                         continue;
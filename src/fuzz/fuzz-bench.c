@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "fuzz.h"
+#include "log.h"
+#include "path-util.h"
+#include "stat-util.h"
+#include "strv.h"
+#include "time-util.h"
+
+/* This is a benchmark driver for the systemd fuzzers. It is linked into the same harnesses as fuzz-main.c, and
+ * feeds the files (or the files in the directories) named on the command line to the fuzzer repeatedly, until
+ * BENCH_MIN_USEC have passed for each. It reports the time and the number of allocations per call, so that
+ * performance regressions in the code under test show up when running the corpora through it. */
+
+#define BENCH_MIN_USEC (200 * USEC_PER_MSEC)
+#define BENCH_MIN_ITERATIONS 8U
+
+/* glibc permits replacing the allocator from the executable, which it uses for its own internal allocations,
+ * too. We merely count calls and pass them on. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t n_allocs = 0, n_alloc_bytes = 0;
+
+void *malloc(size_t size) {
+        n_allocs++;
+        n_alloc_bytes += size;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+        n_allocs++;
+        n_alloc_bytes += nmemb * size;
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+        n_allocs++;
+        n_alloc_bytes += size;
+        return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+        __libc_free(ptr);
+}
+
+typedef struct BenchResult {
+        uint64_t n_ops;
+        usec_t usec;
+        uint64_t n_allocs;
+        uint64_t n_alloc_bytes;
+} BenchResult;
+
+static void bench_one(const uint8_t *data, size_t size, BenchResult *ret) {
+        uint64_t n = 1, a, b;
+        usec_t t;
+
+        assert(ret);
+
+        /* Warm up, so that lazy initialization doesn't end up in the numbers */
+        (void) LLVMFuzzerTestOneInput(data, size);
+
+        for (;;) {
+                uint64_t i;
+
+                a = n_allocs;
+                b = n_alloc_bytes;
+                t = now(CLOCK_MONOTONIC);
+
+                for (i = 0; i < n; i++)
+                        (void) LLVMFuzzerTestOneInput(data, size);
+
+                t = now(CLOCK_MONOTONIC) - t;
+
+                if ((t >= BENCH_MIN_USEC && n >= BENCH_MIN_ITERATIONS) || n >= UINT64_MAX / 2)
+                        break;
+
+                n *= 2;
+        }
+
+        *ret = (BenchResult) {
+                .n_ops = n,
+                .usec = t,
+                .n_allocs = n_allocs - a,
+                .n_alloc_bytes = n_alloc_bytes - b,
+        };
+}
+
+static int add_inputs(char ***inputs, const char *path) {
+        _cleanup_strv_free_ char **files = NULL;
+        char **f;
+        int r;
+
+        assert(inputs);
+        assert(path);
+
+        r = is_dir(path, true);
+        if (r < 0)
+                return log_error_errno(r, "Failed to check '%s': %m", path);
+        if (r == 0)
+                return strv_extend(inputs, path);
+
+        r = get_files_in_directory(path, &files);
+        if (r < 0)
+                return log_error_errno(r, "Failed to enumerate '%s': %m", path);
+
+        strv_sort(files);
+
+        STRV_FOREACH(f, files) {
+                char *p;
+
+                p = path_join(NULL, path, *f);
+                if (!p)
+                        return log_oom();
+
+                r = strv_consume(inputs, p);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        return 0;
+}
+
+int main(int argc, char **argv) {
+        _cleanup_strv_free_ char **inputs = NULL;
+        uint64_t n_inputs = 0, total_nsec = 0, total_allocs = 0, total_alloc_bytes = 0;
+        char **i;
+        int k, r;
+
+        log_set_max_level(LOG_ERR);
+        log_parse_environment();
+        log_open();
+
+        for (k = 1; k < argc; k++) {
+                r = add_inputs(&inputs, argv[k]);
+                if (r < 0)
+                        return EXIT_FAILURE;
+        }
+
+        STRV_FOREACH(i, inputs) {
+                _cleanup_free_ char *buf = NULL;
+                uint64_t nsec, allocs, alloc_bytes;
+                BenchResult result;
+                size_t size;
+
+                r = read_full_file(*i, &buf, &size);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to open '%s': %m", *i);
+                        return EXIT_FAILURE;
+                }
+
+                bench_one((uint8_t*) buf, size, &result);
+
+                nsec = result.usec * NSEC_PER_USEC / result.n_ops;
+                allocs = result.n_allocs / result.n_ops;
+                alloc_bytes = result.n_alloc_bytes / result.n_ops;
+
+                printf("%s: %" PRIu64 " ops, %" PRIu64 " ns/op, %" PRIu64 " allocs/op, %" PRIu64 " B/op\n",
+                       *i, result.n_ops, nsec, allocs, alloc_bytes);
+
+                /* Sum up the per-op numbers, so that every input has the same weight in the total */
+                n_inputs++;
+                total_nsec += nsec;
+                total_allocs += allocs;
+                total_alloc_bytes += alloc_bytes;
+        }
+
+        if (n_inputs > 0)
+                printf("total: %" PRIu64 " inputs, %" PRIu64 " ns, %" PRIu64 " allocs, %" PRIu64 " B\n",
+                       n_inputs, total_nsec, total_allocs, total_alloc_bytes);
+
+        return EXIT_SUCCESS;
+}
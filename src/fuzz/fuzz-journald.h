@@ -20,7 +20,7 @@ static void fuzz_journald_processing_function(
                 return;
 
         assert_se(sd_event_default(&s.event) >= 0);
-        s.syslog_fd = s.native_fd = s.stdout_fd = s.dev_kmsg_fd = s.audit_fd = s.hostname_fd = s.notify_fd = -1;
+        s.syslog_fd = s.native_fd = s.stdout_fd = s.dev_kmsg_fd = s.audit_fd = s.hostname_fd = s.notify_fd = s.vacuum_event_fd = -1;
         s.buffer = memdup_suffix0(data, size);
         assert_se(s.buffer);
         s.buffer_size = size + 1;
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "escape.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fuzz.h"
+#include "logs-show.h"
+#include "utf8.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+        _cleanup_free_ char *s = NULL, *e = NULL, *u = NULL, *buf = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t buf_size;
+        int r;
+
+        /* All of these have fast paths for runs of ASCII, make sure they agree with the slow paths */
+
+        s = memdup_suffix0(data, size);
+        assert_se(s);
+
+        (void) utf8_is_printable((const char*) data, size);
+        (void) utf8_is_printable_newline((const char*) data, size, false);
+
+        assert_se(e = utf8_escape_invalid(s));
+        assert_se(utf8_is_valid(e));
+        if (utf8_is_valid(s))
+                assert_se(streq(e, s));
+        e = mfree(e);
+
+        assert_se(e = utf8_escape_non_printable(s));
+        assert_se(utf8_is_printable(e, strlen(e)));
+        e = mfree(e);
+
+        assert_se(e = cescape_length((const char*) data, size));
+        assert_se(ascii_is_valid(e));
+        assert_se(utf8_is_printable_newline(e, strlen(e), false));
+        if (!memchr(data, 0, size)) {
+                r = cunescape(e, 0, &u);
+                assert_se(r >= 0);
+                assert_se((size_t) r == size);
+                assert_se(memcmp(u, data, size) == 0);
+        }
+
+        assert_se(f = open_memstream(&buf, &buf_size));
+        json_escape(f, (const char*) data, size, 0);
+        json_escape(f, (const char*) data, size, OUTPUT_SHOW_ALL);
+        assert_se(fflush_and_check(f) >= 0);
+
+        return 0;
+}
@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "alloc-util.h"
 #include "conf-files.h"
@@ -16,6 +19,7 @@
 #include "mkdir.h"
 #include "path-util.h"
 #include "selinux-util.h"
+#include "siphash24.h"
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
@@ -85,18 +89,33 @@ static int trie_children_cmp(const void *v1, const void *v2) {
 
 static int node_add_child(struct trie *trie, struct trie_node *node, struct trie_node *node_child, uint8_t c) {
         struct trie_child_entry *child;
+        size_t left = 0, right;
 
-        /* extend array, add new entry, sort for bisection */
+        /* extend array, insert new entry in place to keep it sorted for bisection */
         child = reallocarray(node->children, node->children_count + 1, sizeof(struct trie_child_entry));
         if (!child)
                 return -ENOMEM;
 
         node->children = child;
         trie->children_count++;
-        node->children[node->children_count].c = c;
-        node->children[node->children_count].child = node_child;
+
+        right = node->children_count;
+        while (right > left) {
+                size_t middle = (left + right) / 2;
+
+                if (node->children[middle].c <= c)
+                        left = middle + 1;
+                else
+                        right = middle;
+        }
+
+        memmove(node->children + left + 1, node->children + left,
+                (node->children_count - left) * sizeof(struct trie_child_entry));
+        node->children[left] = (struct trie_child_entry) {
+                .c = c,
+                .child = node_child,
+        };
         node->children_count++;
-        qsort(node->children, node->children_count, sizeof(struct trie_child_entry), trie_children_cmp);
         trie->nodes_count++;
 
         return 0;
@@ -147,9 +166,10 @@ static int trie_values_cmp(const void *v1, const void *v2, void *arg) {
 
 static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                                const char *key, const char *value,
-                               const char *filename, uint16_t file_priority, uint32_t line_number) {
-        ssize_t k, v, fn;
+                               size_t filename_off, uint16_t file_priority, uint32_t line_number) {
+        ssize_t k, v;
         struct trie_value_entry *val;
+        size_t left = 0, right;
 
         k = strbuf_add_string(trie->strings, key, strlen(key));
         if (k < 0)
@@ -157,10 +177,6 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
         v = strbuf_add_string(trie->strings, value, strlen(value));
         if (v < 0)
                 return v;
-        fn = strbuf_add_string(trie->strings, filename, strlen(filename));
-        if (fn < 0)
-                return fn;
-
         if (node->values_count) {
                 struct trie_value_entry search = {
                         .key_off = k,
@@ -173,32 +189,46 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                          * Since we process files in order, we just replace the previous value.
                          */
                         val->value_off = v;
-                        val->filename_off = fn;
+                        val->filename_off = filename_off;
                         val->file_priority = file_priority;
                         val->line_number = line_number;
                         return 0;
                 }
         }
 
-        /* extend array, add new entry, sort for bisection */
+        /* extend array, insert new entry in place to keep it sorted for bisection */
         val = reallocarray(node->values, node->values_count + 1, sizeof(struct trie_value_entry));
         if (!val)
                 return -ENOMEM;
         trie->values_count++;
         node->values = val;
-        node->values[node->values_count].key_off = k;
-        node->values[node->values_count].value_off = v;
-        node->values[node->values_count].filename_off = fn;
-        node->values[node->values_count].file_priority = file_priority;
-        node->values[node->values_count].line_number = line_number;
+
+        right = node->values_count;
+        while (right > left) {
+                size_t middle = (left + right) / 2;
+
+                if (strcmp(trie->strings->buf + node->values[middle].key_off, trie->strings->buf + k) <= 0)
+                        left = middle + 1;
+                else
+                        right = middle;
+        }
+
+        memmove(node->values + left + 1, node->values + left,
+                (node->values_count - left) * sizeof(struct trie_value_entry));
+        node->values[left] = (struct trie_value_entry) {
+                .key_off = k,
+                .value_off = v,
+                .filename_off = filename_off,
+                .file_priority = file_priority,
+                .line_number = line_number,
+        };
         node->values_count++;
-        qsort_r(node->values, node->values_count, sizeof(struct trie_value_entry), trie_values_cmp, trie);
         return 0;
 }
 
 static int trie_insert(struct trie *trie, struct trie_node *node, const char *search,
                        const char *key, const char *value,
-                       const char *filename, uint16_t file_priority, uint32_t line_number) {
+                       size_t filename_off, uint16_t file_priority, uint32_t line_number) {
         size_t i = 0;
         int r = 0;
 
@@ -252,7 +282,7 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
 
                 c = search[i];
                 if (c == '\0')
-                        return trie_node_add_value(trie, node, key, value, filename, file_priority, line_number);
+                        return trie_node_add_value(trie, node, key, value, filename_off, file_priority, line_number);
 
                 child = node_lookup(node, c);
                 if (!child) {
@@ -276,7 +306,7 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
                                 return r;
                         }
 
-                        return trie_node_add_value(trie, child, key, value, filename, file_priority, line_number);
+                        return trie_node_add_value(trie, child, key, value, filename_off, file_priority, line_number);
                 }
 
                 node = child;
@@ -366,7 +396,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+static int trie_store(struct trie *trie, const char *filename, uint64_t sources_hash) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -381,6 +411,7 @@ static int trie_store(struct trie *trie, const char *filename) {
                 .node_size = htole64(sizeof(struct trie_node_f)),
                 .child_entry_size = htole64(sizeof(struct trie_child_entry_f)),
                 .value_entry_size = htole64(sizeof(struct trie_value_entry2_f)),
+                .sources_hash = htole64(sources_hash),
         };
         int r;
 
@@ -446,7 +477,7 @@ static int trie_store(struct trie *trie, const char *filename) {
 }
 
 static int insert_data(struct trie *trie, char **match_list, char *line,
-                       const char *filename, uint16_t file_priority, uint32_t line_number) {
+                       const char *filename, size_t filename_off, uint16_t file_priority, uint32_t line_number) {
         char *value, **entry;
 
         assert(line[0] == ' ');
@@ -470,7 +501,7 @@ static int insert_data(struct trie *trie, char **match_list, char *line,
                                   line, value);
 
         STRV_FOREACH(entry, match_list)
-                trie_insert(trie, trie->root, *entry, line, value, filename, file_priority, line_number);
+                trie_insert(trie, trie->root, *entry, line, value, filename_off, file_priority, line_number);
 
         return 0;
 }
@@ -486,12 +517,18 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
         _cleanup_strv_free_ char **match_list = NULL;
         uint32_t line_number = 0;
         char *match = NULL;
+        ssize_t filename_off;
         int r = 0, err;
 
         f = fopen(filename, "re");
         if (!f)
                 return -errno;
 
+        /* Every value records where it came from, add the name to the string store just once */
+        filename_off = strbuf_add_string(trie->strings, filename, strlen(filename));
+        if (filename_off < 0)
+                return filename_off;
+
         while (fgets(line, sizeof(line), f)) {
                 size_t len;
                 char *pos;
@@ -563,7 +600,7 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
 
                         /* first data */
                         state = HW_DATA;
-                        err = insert_data(trie, match_list, line, filename, file_priority, line_number);
+                        err = insert_data(trie, match_list, line, filename, filename_off, file_priority, line_number);
                         if (err < 0)
                                 r = err;
                         break;
@@ -585,7 +622,7 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
                                 break;
                         }
 
-                        err = insert_data(trie, match_list, line, filename, file_priority, line_number);
+                        err = insert_data(trie, match_list, line, filename, filename_off, file_priority, line_number);
                         if (err < 0)
                                 r = err;
                         break;
@@ -620,12 +657,75 @@ static int hwdb_query(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+static int hwdb_sources_hash(char **files, uint64_t *ret) {
+        /* Arbitrary but fixed key, the hash only needs to be stable between invocations */
+        static const uint8_t key[16] = {
+                0x5b, 0x1c, 0x8e, 0x2a, 0x43, 0xd7, 0x96, 0x0f,
+                0xb4, 0x61, 0x3a, 0xe9, 0x27, 0xc8, 0x50, 0x7d,
+        };
+        struct siphash state;
+        char **f;
+        int r;
+
+        siphash24_init(&state, key);
+        siphash24_compress(PACKAGE_VERSION, strlen(PACKAGE_VERSION) + 1, &state);
+
+        STRV_FOREACH(f, files) {
+                _cleanup_free_ char *contents = NULL;
+                size_t size;
+
+                r = read_full_file(*f, &contents, &size);
+                if (r < 0)
+                        return r;
+
+                /* The file names are recorded in the database, and the order defines the priorities */
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+                siphash24_compress(&size, sizeof(size), &state);
+                siphash24_compress(contents, size, &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static bool hwdb_bin_is_current(const char *hwdb_bin, uint64_t sources_hash) {
+        const char sig[] = HWDB_SIG;
+        _cleanup_close_ int fd = -1;
+        struct trie_header_f h;
+        struct stat st;
+        ssize_t n;
+
+        fd = open(hwdb_bin, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return false;
+
+        if (fstat(fd, &st) < 0)
+                return false;
+
+        n = read(fd, &h, sizeof(h));
+        if (n != sizeof(h))
+                return false;
+
+        if (memcmp(h.signature, sig, sizeof(h.signature)) != 0)
+                return false;
+
+        /* Databases written by older versions do not carry the hash */
+        if (le64toh(h.header_size) < offsetof(struct trie_header_f, sources_hash) + sizeof(h.sources_hash))
+                return false;
+
+        if (le64toh(h.file_size) != (uint64_t) st.st_size)
+                return false;
+
+        return h.sources_hash != 0 && le64toh(h.sources_hash) == sources_hash;
+}
+
 static int hwdb_update(int argc, char *argv[], void *userdata) {
         _cleanup_free_ char *hwdb_bin = NULL;
         _cleanup_(trie_freep) struct trie *trie = NULL;
         _cleanup_strv_free_ char **files = NULL;
         char **f;
         uint16_t file_priority = 1;
+        uint64_t sources_hash = 0;
         int r = 0, err;
 
         trie = new0(struct trie, 1);
@@ -648,6 +748,21 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
         if (err < 0)
                 return log_error_errno(err, "Failed to enumerate hwdb files: %m");
 
+        hwdb_bin = path_join(arg_root, arg_hwdb_bin_dir, "hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
+        /* Compiling the database takes a while, and rewriting it makes every udev worker reload it. Skip both if
+         * the sources are exactly the ones the present database was built from. In strict mode the sources are
+         * always parsed, so that errors in them are reported. */
+        err = hwdb_sources_hash(files, &sources_hash);
+        if (err < 0)
+                log_debug_errno(err, "Failed to hash hwdb files, rebuilding database: %m");
+        else if (!arg_strict && hwdb_bin_is_current(hwdb_bin, sources_hash)) {
+                log_debug("%s is up to date, not rebuilding.", hwdb_bin);
+                return 0;
+        }
+
         STRV_FOREACH(f, files) {
                 log_debug("Reading file \"%s\"", *f);
                 err = import_file(trie, *f, file_priority++);
@@ -671,12 +786,8 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = path_join(arg_root, arg_hwdb_bin_dir, "hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
-
         mkdir_parents_label(hwdb_bin, 0755);
-        err = trie_store(trie, hwdb_bin);
+        err = trie_store(trie, hwdb_bin, sources_hash);
         if (err < 0)
                 return log_error_errno(err, "Failure writing database %s: %m", hwdb_bin);
 
@@ -8,12 +8,15 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "import-common.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "ratelimit.h"
 #include "string-util.h"
 #include "util.h"
 
-#define COPY_BUFFER_SIZE (16*1024)
+/* tar and the compressor are separate processes, hence move data between them in large chunks, and make the pipe
+ * equally large, so that the two don't have to take turns all the time */
+#define COPY_BUFFER_SIZE (256*1024)
 
 struct TarExport {
         sd_event *event;
@@ -31,12 +34,15 @@ struct TarExport {
 
         sd_event_source *output_event_source;
 
+        void *input;
+
         void *buffer;
         size_t buffer_size;
         size_t buffer_allocated;
 
         uint64_t written_compressed;
         uint64_t written_uncompressed;
+        usec_t started_usec;
 
         pid_t tar_pid;
 
@@ -72,6 +78,7 @@ TarExport *tar_export_unref(TarExport *e) {
 
         safe_close(e->tar_fd);
 
+        free(e->input);
         free(e->buffer);
         free(e->path);
         return mfree(e);
@@ -114,7 +121,10 @@ int tar_export_new(
 }
 
 static void tar_export_report_progress(TarExport *e) {
+        char buf[FORMAT_BYTES_MAX];
         unsigned percent;
+        usec_t n;
+
         assert(e);
 
         /* Do we have any quota info? If not, we don't know anything about the progress */
@@ -133,7 +143,13 @@ static void tar_export_report_progress(TarExport *e) {
                 return;
 
         sd_notifyf(false, "X_IMPORT_PROGRESS=%u", percent);
-        log_info("Exported %u%%.", percent);
+
+        n = now(CLOCK_MONOTONIC);
+        if (n > e->started_usec)
+                log_info("Exported %u%%, %s/s.", percent,
+                         format_bytes(buf, sizeof(buf), e->written_uncompressed * USEC_PER_SEC / (n - e->started_usec)));
+        else
+                log_info("Exported %u%%.", percent);
 
         e->last_percent = percent;
 }
@@ -166,14 +182,20 @@ static int tar_export_process(TarExport *e) {
         }
 
         while (e->buffer_size <= 0) {
-                uint8_t input[COPY_BUFFER_SIZE];
-
                 if (e->eof) {
                         r = 0;
                         goto finish;
                 }
 
-                l = read(e->tar_fd, input, sizeof(input));
+                if (!e->input) {
+                        e->input = malloc(COPY_BUFFER_SIZE);
+                        if (!e->input) {
+                                r = log_oom();
+                                goto finish;
+                        }
+                }
+
+                l = read(e->tar_fd, e->input, COPY_BUFFER_SIZE);
                 if (l < 0) {
                         r = log_error_errno(errno, "Failed to read tar file: %m");
                         goto finish;
@@ -184,7 +206,7 @@ static int tar_export_process(TarExport *e) {
                         r = import_compress_finish(&e->compress, &e->buffer, &e->buffer_size, &e->buffer_allocated);
                 } else {
                         e->written_uncompressed += l;
-                        r = import_compress(&e->compress, input, l, &e->buffer, &e->buffer_size, &e->buffer_allocated);
+                        r = import_compress(&e->compress, e->input, l, &e->buffer, &e->buffer_size, &e->buffer_allocated);
                 }
                 if (r < 0) {
                         r = log_error_errno(r, "Failed to encode: %m");
@@ -303,6 +325,10 @@ int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType
                 return e->tar_fd;
         }
 
+        if (fcntl(e->tar_fd, F_SETPIPE_SZ, COPY_BUFFER_SIZE) < 0)
+                log_debug_errno(errno, "Failed to enlarge tar pipe, ignoring: %m");
+
         e->output_fd = fd;
+        e->started_usec = now(CLOCK_MONOTONIC);
         return r;
 }
@@ -4,6 +4,19 @@
 #include "string-table.h"
 #include "util.h"
 
+/* xz streams are compressed and decompressed on several threads, if liblzma supports that. Every thread works on
+ * its own block of the stream, and needs memory in the order of the dictionary size for that, hence don't go
+ * overboard. */
+#define XZ_THREADS_MAX 4U
+
+static uint32_t xz_threads(void) {
+#if LZMA_VERSION >= UINT32_C(50020002)
+        return CLAMP(lzma_cputhreads(), 1U, XZ_THREADS_MAX);
+#else
+        return 1;
+#endif
+}
+
 void import_compress_free(ImportCompress *c) {
         assert(c);
 
@@ -50,9 +63,24 @@ int import_uncompress_detect(ImportCompress *c, const void *data, size_t size) {
         assert(data);
 
         if (memcmp(data, xz_signature, sizeof(xz_signature)) == 0) {
-                lzma_ret xzr;
-
-                xzr = lzma_stream_decoder(&c->xz, UINT64_MAX, LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED);
+                lzma_ret xzr = LZMA_OPTIONS_ERROR;
+
+#if LZMA_VERSION >= UINT32_C(50040002)
+                /* Streams made of several blocks, like the ones we generate, may be decoded on several threads.
+                 * It falls back to a single thread on its own for everything else. */
+                if (xz_threads() > 1) {
+                        lzma_mt mt = {
+                                .flags = LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED,
+                                .threads = xz_threads(),
+                                .memlimit_threading = physical_memory() / 4,
+                                .memlimit_stop = UINT64_MAX,
+                        };
+
+                        xzr = lzma_stream_decoder_mt(&c->xz, &mt);
+                }
+#endif
+                if (xzr != LZMA_OK)
+                        xzr = lzma_stream_decoder(&c->xz, UINT64_MAX, LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED);
                 if (xzr != LZMA_OK)
                         return -EIO;
 
@@ -185,9 +213,21 @@ int import_compress_init(ImportCompress *c, ImportCompressType t) {
         switch (t) {
 
         case IMPORT_COMPRESS_XZ: {
-                lzma_ret xzr;
+                lzma_ret xzr = LZMA_OPTIONS_ERROR;
+
+#if LZMA_VERSION >= UINT32_C(50020002)
+                if (xz_threads() > 1) {
+                        lzma_mt mt = {
+                                .threads = xz_threads(),
+                                .preset = LZMA_PRESET_DEFAULT,
+                                .check = LZMA_CHECK_CRC64,
+                        };
 
-                xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+                        xzr = lzma_stream_encoder_mt(&c->xz, &mt);
+                }
+#endif
+                if (xzr != LZMA_OK)
+                        xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
                 if (xzr != LZMA_OK)
                         return -EIO;
 
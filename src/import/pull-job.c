@@ -16,6 +16,15 @@
 #include "strv.h"
 #include "xattr-util.h"
 
+/* The size of the chunks libcurl hands to us. Every chunk goes through the checksum, the decompressor and a write
+ * to disk, hence do this in large pieces rather than in libcurl's default of 16K. */
+#define PULL_JOB_BUFFER_SIZE (512U*1024U)
+
+/* How often to pick up an interrupted download from where it stopped, before giving up */
+#define PULL_JOB_RESUME_MAX 5U
+
+static int pull_job_setup_curl(PullJob *j);
+
 PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
@@ -83,6 +92,71 @@ static int pull_job_restart(PullJob *j) {
         return 0;
 }
 
+static bool pull_job_can_resume(PullJob *j, CURLcode result) {
+        assert(j);
+
+        /* We can only continue where we stopped if the connection went away in the middle of the body, and
+         * the server told us enough to make sure we get the rest of the very same file */
+
+        if (!IN_SET(result, CURLE_PARTIAL_FILE, CURLE_RECV_ERROR, CURLE_OPERATION_TIMEDOUT, CURLE_GOT_NOTHING))
+                return false;
+
+        if (j->state != PULL_JOB_RUNNING)
+                return false;
+
+        if (j->content_length == (uint64_t) -1 || !j->etag)
+                return false;
+
+        if (j->written_compressed == 0 || j->written_compressed >= j->content_length)
+                return false;
+
+        return j->n_resumed < PULL_JOB_RESUME_MAX;
+}
+
+static int pull_job_resume(PullJob *j) {
+        _cleanup_free_ char *hdr = NULL;
+        struct curl_slist *l;
+        int r;
+
+        assert(j);
+
+        /* Continue with a new request for the remaining part. The checksum and the decompressor just carry on, as
+         * they never saw the connection going away. If-Range makes sure we get a 206 only if the ETag still
+         * matches, libcurl fails the transfer with CURLE_RANGE_ERROR otherwise. */
+
+        curl_glue_remove_and_free(j->glue, j->curl);
+        j->curl = NULL;
+
+        hdr = strappend("If-Range: ", j->etag);
+        if (!hdr)
+                return -ENOMEM;
+
+        l = curl_slist_append(j->request_header, hdr);
+        if (!l)
+                return -ENOMEM;
+        j->request_header = l;
+
+        r = curl_glue_make(&j->curl, j->url, j);
+        if (r < 0)
+                return r;
+
+        r = pull_job_setup_curl(j);
+        if (r < 0)
+                return r;
+
+        if (curl_easy_setopt(j->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) j->written_compressed) != CURLE_OK)
+                return -EIO;
+
+        r = curl_glue_add(j->glue, j->curl);
+        if (r < 0)
+                return r;
+
+        j->resume_offset = j->written_compressed;
+        j->n_resumed++;
+
+        return 0;
+}
+
 void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         PullJob *j = NULL;
         CURLcode code;
@@ -96,7 +170,18 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 return;
 
         if (result != CURLE_OK) {
-                log_error("Transfer failed: %s", curl_easy_strerror(result));
+                if (pull_job_can_resume(j, result)) {
+                        log_warning("Transfer of %s interrupted (%s), resuming at byte %" PRIu64 ".",
+                                    j->url, curl_easy_strerror(result), j->written_compressed);
+
+                        r = pull_job_resume(j);
+                        if (r >= 0)
+                                return;
+
+                        log_error_errno(r, "Failed to resume transfer: %m");
+                } else
+                        log_error("Transfer failed: %s", curl_easy_strerror(result));
+
                 r = -EIO;
                 goto finish;
         }
@@ -432,6 +517,11 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 goto fail;
         }
 
+        /* The response to a resumed request describes the remaining part only, we already know all about the
+         * file itself */
+        if (j->state == PULL_JOB_RUNNING && j->resume_offset > 0)
+                return sz;
+
         assert(j->state == PULL_JOB_ANALYZING);
 
         r = curl_header_strdup(contents, sz, "ETag:", &etag);
@@ -509,6 +599,10 @@ static int pull_job_progress_callback(void *userdata, curl_off_t dltotal, curl_o
         if (dltotal <= 0)
                 return 0;
 
+        /* After resuming, libcurl only counts what it transfers itself */
+        dltotal += j->resume_offset;
+        dlnow += j->resume_offset;
+
         percent = ((100 * dlnow) / dltotal);
         n = now(CLOCK_MONOTONIC);
 
@@ -612,11 +706,31 @@ int pull_job_begin(PullJob *j) {
                 }
         }
 
+        r = pull_job_setup_curl(j);
+        if (r < 0)
+                return r;
+
+        r = curl_glue_add(j->glue, j->curl);
+        if (r < 0)
+                return r;
+
+        j->state = PULL_JOB_ANALYZING;
+
+        return 0;
+}
+
+static int pull_job_setup_curl(PullJob *j) {
+        assert(j);
+        assert(j->curl);
+
         if (j->request_header) {
                 if (curl_easy_setopt(j->curl, CURLOPT_HTTPHEADER, j->request_header) != CURLE_OK)
                         return -EIO;
         }
 
+        /* Not fatal, libcurl just sticks to its default */
+        (void) curl_easy_setopt(j->curl, CURLOPT_BUFFERSIZE, (long) PULL_JOB_BUFFER_SIZE);
+
         if (curl_easy_setopt(j->curl, CURLOPT_WRITEFUNCTION, pull_job_write_callback) != CURLE_OK)
                 return -EIO;
 
@@ -638,11 +752,5 @@ int pull_job_begin(PullJob *j) {
         if (curl_easy_setopt(j->curl, CURLOPT_NOPROGRESS, 0) != CURLE_OK)
                 return -EIO;
 
-        r = curl_glue_add(j->glue, j->curl);
-        if (r < 0)
-                return r;
-
-        j->state = PULL_JOB_ANALYZING;
-
         return 0;
 }
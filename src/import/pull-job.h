@@ -53,6 +53,8 @@ struct PullJob {
         bool etag_exists;
 
         uint64_t content_length;
+        uint64_t resume_offset;
+        unsigned n_resumed;
         uint64_t written_compressed;
         uint64_t written_uncompressed;
 
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <zlib.h>
 
 #include "alloc-util.h"
@@ -14,6 +15,13 @@
 #define QCOW2_COMPRESSED (1ULL << 62)
 #define QCOW2_ZERO (1ULL << 0)
 
+/* Uncompressed clusters that are adjacent both in the image and on disk are copied with a single call, up to this
+ * size */
+#define COPY_BATCH_MAX (1024U*1024U)
+
+/* Compressed clusters are decompressed on up to this many threads */
+#define DECOMPRESS_THREADS_MAX 8U
+
 typedef struct _packed_ Header {
       be32_t magic;
       be32_t version;
@@ -61,32 +69,60 @@ static uint32_t HEADER_HEADER_LENGTH(const Header *h) {
         return be32toh(h->header_length);
 }
 
-static int copy_cluster(
+static bool buffer_is_zero(const void *p, size_t n) {
+        const uint8_t *b = p;
+
+        assert(p);
+
+        return n == 0 || (b[0] == 0 && memcmp(b, b + 1, n - 1) == 0);
+}
+
+static int write_sparse(int dfd, uint64_t doffset, const void *buffer, uint64_t size, uint64_t cluster_size) {
+        uint64_t begin = 0, i;
+        ssize_t l;
+
+        /* The destination starts out as one big hole, hence just skip over clusters that are all zeroes, and write
+         * everything in between those in one go */
+
+        for (i = 0; i <= size; i += cluster_size) {
+                if (i < size && !buffer_is_zero((const uint8_t*) buffer + i, MIN(cluster_size, size - i)))
+                        continue;
+
+                if (i > begin) {
+                        l = pwrite(dfd, (const uint8_t*) buffer + begin, i - begin, doffset + begin);
+                        if (l < 0)
+                                return -errno;
+                        if ((uint64_t) l != i - begin)
+                                return -EIO;
+                }
+
+                begin = i + cluster_size;
+        }
+
+        return 0;
+}
+
+static int copy_clusters(
                 int sfd, uint64_t soffset,
                 int dfd, uint64_t doffset,
+                uint64_t size,
                 uint64_t cluster_size,
                 void *buffer) {
 
         ssize_t l;
         int r;
 
-        r = btrfs_clone_range(sfd, soffset, dfd, doffset, cluster_size);
+        r = btrfs_clone_range(sfd, soffset, dfd, doffset, size);
         if (r >= 0)
                 return r;
 
-        l = pread(sfd, buffer, cluster_size, soffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
-
-        l = pwrite(dfd, buffer, cluster_size, doffset);
+        l = pread(sfd, buffer, size, soffset);
         if (l < 0)
                 return -errno;
-        if ((uint64_t) l != cluster_size)
+        if ((uint64_t) l != size)
                 return -EIO;
 
-        return 0;
+        return write_sparse(dfd, doffset, buffer, size, cluster_size);
 }
 
 static int decompress_cluster(
@@ -135,13 +171,118 @@ static int decompress_cluster(
         if (r != Z_STREAM_END || sz != cluster_size)
                 return -EIO;
 
-        l = pwrite(dfd, buffer2, cluster_size, doffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
+        return write_sparse(dfd, doffset, buffer2, cluster_size, cluster_size);
+}
 
-        return 0;
+typedef struct DecompressJob {
+        uint64_t soffset;
+        uint64_t doffset;
+        uint64_t compressed_size;
+} DecompressJob;
+
+typedef struct DecompressWorker {
+        int sfd, dfd;
+        uint64_t cluster_size;
+
+        const DecompressJob *jobs;
+        size_t n_jobs;
+        size_t *next;
+
+        int r;
+        pthread_t thread;
+        bool started;
+} DecompressWorker;
+
+static void *decompress_thread(void *p) {
+        _cleanup_free_ void *buffer1 = NULL, *buffer2 = NULL;
+        DecompressWorker *w = p;
+
+        buffer1 = malloc(w->cluster_size);
+        buffer2 = malloc(w->cluster_size);
+        if (!buffer1 || !buffer2) {
+                w->r = -ENOMEM;
+                return NULL;
+        }
+
+        for (;;) {
+                const DecompressJob *j;
+                size_t i;
+                int r;
+
+                i = __sync_fetch_and_add(w->next, 1);
+                if (i >= w->n_jobs)
+                        break;
+
+                j = w->jobs + i;
+
+                r = decompress_cluster(
+                                w->sfd, j->soffset,
+                                w->dfd, j->doffset,
+                                j->compressed_size, w->cluster_size,
+                                buffer1, buffer2);
+                if (r < 0) {
+                        w->r = r;
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+static int decompress_clusters(
+                int sfd, int dfd,
+                uint64_t cluster_size,
+                const DecompressJob *jobs,
+                size_t n_jobs) {
+
+        DecompressWorker workers[DECOMPRESS_THREADS_MAX] = {};
+        sigset_t ss, saved_ss;
+        size_t next = 0;
+        unsigned n_threads, k;
+        long n_cpus;
+        int r = 0;
+
+        if (n_jobs == 0)
+                return 0;
+
+        /* Decompression is CPU bound, and the clusters are independent of each other, hence spread them over a
+         * couple of threads. The first worker runs on this thread, so that we also make progress if no thread can
+         * be started. */
+
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (unsigned) MIN3(n_jobs, (size_t) MAX(n_cpus, 1L), (size_t) DECOMPRESS_THREADS_MAX);
+
+        for (k = 0; k < n_threads; k++)
+                workers[k] = (DecompressWorker) {
+                        .sfd = sfd,
+                        .dfd = dfd,
+                        .cluster_size = cluster_size,
+                        .jobs = jobs,
+                        .n_jobs = n_jobs,
+                        .next = &next,
+                };
+
+        if (n_threads > 1) {
+                assert_se(sigfillset(&ss) >= 0);
+                assert_se(pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0);
+
+                for (k = 1; k < n_threads; k++)
+                        workers[k].started = pthread_create(&workers[k].thread, NULL, decompress_thread, workers + k) == 0;
+
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        }
+
+        (void) decompress_thread(workers);
+
+        for (k = 0; k < n_threads; k++) {
+                if (workers[k].started)
+                        assert_se(pthread_join(workers[k].thread, NULL) == 0);
+
+                if (workers[k].r < 0 && r == 0)
+                        r = workers[k].r;
+        }
+
+        return r;
 }
 
 static int normalize_offset(
@@ -227,9 +368,10 @@ static int verify_header(const Header *header) {
 }
 
 int qcow2_convert(int qcow2_fd, int raw_fd) {
-        _cleanup_free_ void *buffer1 = NULL, *buffer2 = NULL;
         _cleanup_free_ be64_t *l1_table = NULL, *l2_table = NULL;
-        uint64_t sz, i;
+        _cleanup_free_ DecompressJob *jobs = NULL;
+        _cleanup_free_ void *buffer = NULL;
+        uint64_t sz, i, batch_max;
         Header header;
         ssize_t l;
         int r;
@@ -252,12 +394,13 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
         if (!l2_table)
                 return -ENOMEM;
 
-        buffer1 = malloc(HEADER_CLUSTER_SIZE(&header));
-        if (!buffer1)
+        jobs = new(DecompressJob, HEADER_L2_SIZE(&header));
+        if (!jobs)
                 return -ENOMEM;
 
-        buffer2 = malloc(HEADER_CLUSTER_SIZE(&header));
-        if (!buffer2)
+        batch_max = MAX((uint64_t) COPY_BATCH_MAX, HEADER_CLUSTER_SIZE(&header));
+        buffer = malloc(batch_max);
+        if (!buffer)
                 return -ENOMEM;
 
         /* Empty the file if it exists, we rely on zero bits */
@@ -275,7 +418,8 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
                 return -EIO;
 
         for (i = 0; i < HEADER_L1_SIZE(&header); i ++) {
-                uint64_t l2_begin, j;
+                uint64_t l2_begin, j, run_soffset = 0, run_doffset = 0, run_size = 0;
+                size_t n_jobs = 0;
 
                 r = normalize_offset(&header, l1_table[i], &l2_begin, NULL, NULL);
                 if (r < 0)
@@ -301,20 +445,53 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
                         if (r == 0)
                                 continue;
 
-                        if (compressed)
-                                r = decompress_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                compressed_size, HEADER_CLUSTER_SIZE(&header),
-                                                buffer1, buffer2);
-                        else
-                                r = copy_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                HEADER_CLUSTER_SIZE(&header), buffer1);
+                        if (compressed) {
+                                /* Compressed clusters are collected, and decompressed all at once below */
+                                jobs[n_jobs++] = (DecompressJob) {
+                                        .soffset = data_begin,
+                                        .doffset = p,
+                                        .compressed_size = compressed_size,
+                                };
+                                continue;
+                        }
+
+                        /* Extend the current run of uncompressed clusters, if this one continues it */
+                        if (run_size > 0 &&
+                            data_begin == run_soffset + run_size &&
+                            p == run_doffset + run_size &&
+                            run_size + HEADER_CLUSTER_SIZE(&header) <= batch_max) {
+                                run_size += HEADER_CLUSTER_SIZE(&header);
+                                continue;
+                        }
+
+                        if (run_size > 0) {
+                                r = copy_clusters(
+                                                qcow2_fd, run_soffset,
+                                                raw_fd, run_doffset,
+                                                run_size, HEADER_CLUSTER_SIZE(&header),
+                                                buffer);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        run_soffset = data_begin;
+                        run_doffset = p;
+                        run_size = HEADER_CLUSTER_SIZE(&header);
+                }
+
+                if (run_size > 0) {
+                        r = copy_clusters(
+                                        qcow2_fd, run_soffset,
+                                        raw_fd, run_doffset,
+                                        run_size, HEADER_CLUSTER_SIZE(&header),
+                                        buffer);
                         if (r < 0)
                                 return r;
                 }
+
+                r = decompress_clusters(qcow2_fd, raw_fd, HEADER_CLUSTER_SIZE(&header), jobs, n_jobs);
+                if (r < 0)
+                        return r;
         }
 
         return 0;
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <zlib.h>
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "parse-util.h"
+#include "qcow2-util.h"
+#include "sparse-endian.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Synthesizes a qcow2 image with a mix of holes, zero clusters, uncompressed and compressed clusters, converts it,
+ * verifies the result and reports the throughput. Pass the image size in MB as argument to run it with a different
+ * size than the default. */
+
+#define CLUSTER_BITS 16
+#define CLUSTER_SIZE (1U << CLUSTER_BITS)
+#define L2_SIZE (CLUSTER_SIZE / sizeof(uint64_t))
+
+#define QCOW2_MAGIC 0x514649fb
+#define QCOW2_COMPRESSED (1ULL << 62)
+#define QCOW2_ZERO (1ULL << 0)
+
+typedef struct _packed_ Header {
+        be32_t magic;
+        be32_t version;
+
+        be64_t backing_file_offset;
+        be32_t backing_file_size;
+
+        be32_t cluster_bits;
+        be64_t size;
+        be32_t crypt_method;
+
+        be32_t l1_size;
+        be64_t l1_table_offset;
+
+        be64_t refcount_table_offset;
+        be32_t refcount_table_clusters;
+
+        be32_t nb_snapshots;
+        be64_t snapshots_offset;
+} Header;
+
+typedef enum ClusterType {
+        CLUSTER_HOLE,
+        CLUSTER_ZERO_FLAG,
+        CLUSTER_DATA,
+        CLUSTER_DATA_ZEROES,
+        CLUSTER_COMPRESSED,
+} ClusterType;
+
+static ClusterType cluster_type(uint64_t i) {
+        switch (i % 8) {
+
+        case 0:
+                return CLUSTER_HOLE;
+
+        case 1:
+                return CLUSTER_ZERO_FLAG;
+
+        case 2:
+        case 3:
+                return CLUSTER_DATA;
+
+        case 4:
+                return CLUSTER_DATA_ZEROES;
+
+        default:
+                return CLUSTER_COMPRESSED;
+        }
+}
+
+static void fill_cluster(uint64_t i, uint8_t *buf) {
+        size_t k;
+
+        switch (cluster_type(i)) {
+
+        case CLUSTER_DATA:
+        case CLUSTER_COMPRESSED:
+                /* Compressible, but different for every cluster */
+                for (k = 0; k < CLUSTER_SIZE; k++)
+                        buf[k] = (uint8_t) ((k / 64) ^ (i * 7) ^ (k % 13));
+                break;
+
+        default:
+                memzero(buf, CLUSTER_SIZE);
+        }
+}
+
+static size_t deflate_cluster(const uint8_t *in, uint8_t *out, size_t out_size) {
+        z_stream s = {};
+        size_t sz;
+
+        assert_se(deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -12, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+        s.next_in = (uint8_t*) in;
+        s.avail_in = CLUSTER_SIZE;
+        s.next_out = out;
+        s.avail_out = out_size;
+
+        assert_se(deflate(&s, Z_FINISH) == Z_STREAM_END);
+        sz = out_size - s.avail_out;
+        deflateEnd(&s);
+
+        return sz;
+}
+
+static void write_image(int fd, uint64_t n_clusters) {
+        _cleanup_free_ be64_t *l1_table = NULL, *l2_table = NULL;
+        _cleanup_free_ uint8_t *buf = NULL, *zbuf = NULL;
+        uint64_t n_l2, i, offset;
+        Header header = {};
+
+        n_l2 = DIV_ROUND_UP(n_clusters, L2_SIZE);
+
+        assert_se(l1_table = new0(be64_t, n_l2));
+        assert_se(l2_table = new0(be64_t, n_l2 * L2_SIZE));
+        assert_se(buf = malloc(CLUSTER_SIZE));
+        assert_se(zbuf = malloc(2 * CLUSTER_SIZE));
+
+        /* Cluster 0 is the header, then the L1 table, then the L2 tables, then the data */
+        offset = (uint64_t) (2 + n_l2) * CLUSTER_SIZE;
+
+        for (i = 0; i < n_clusters; i++) {
+                ClusterType t;
+                size_t sz;
+
+                t = cluster_type(i);
+                if (t == CLUSTER_HOLE)
+                        continue;
+                if (t == CLUSTER_ZERO_FLAG) {
+                        l2_table[i] = htobe64(QCOW2_ZERO);
+                        continue;
+                }
+
+                fill_cluster(i, buf);
+
+                if (t == CLUSTER_COMPRESSED) {
+                        uint64_t n_sectors;
+
+                        sz = deflate_cluster(buf, zbuf, 2 * CLUSTER_SIZE);
+                        n_sectors = DIV_ROUND_UP(sz, 512);
+                        memzero(zbuf + sz, n_sectors * 512 - sz);
+
+                        assert_se(pwrite(fd, zbuf, n_sectors * 512, offset) == (ssize_t) (n_sectors * 512));
+                        l2_table[i] = htobe64(QCOW2_COMPRESSED | ((n_sectors - 1) << (62 - (CLUSTER_BITS - 8))) | offset);
+                        offset += n_sectors * 512;
+                } else {
+                        /* Uncompressed clusters need to be cluster aligned */
+                        offset = ALIGN_TO(offset, CLUSTER_SIZE);
+
+                        assert_se(pwrite(fd, buf, CLUSTER_SIZE, offset) == CLUSTER_SIZE);
+                        l2_table[i] = htobe64(offset);
+                        offset += CLUSTER_SIZE;
+                }
+        }
+
+        for (i = 0; i < n_l2; i++)
+                l1_table[i] = htobe64((uint64_t) (2 + i) * CLUSTER_SIZE);
+
+        assert_se(pwrite(fd, l1_table, n_l2 * sizeof(be64_t), CLUSTER_SIZE) == (ssize_t) (n_l2 * sizeof(be64_t)));
+        assert_se(pwrite(fd, l2_table, n_l2 * CLUSTER_SIZE, 2 * CLUSTER_SIZE) == (ssize_t) (n_l2 * CLUSTER_SIZE));
+
+        header = (Header) {
+                .magic = htobe32(QCOW2_MAGIC),
+                .version = htobe32(2),
+                .cluster_bits = htobe32(CLUSTER_BITS),
+                .size = htobe64(n_clusters * CLUSTER_SIZE),
+                .l1_size = htobe32(n_l2),
+                .l1_table_offset = htobe64(CLUSTER_SIZE),
+        };
+
+        assert_se(pwrite(fd, &header, sizeof(header), 0) == sizeof(header));
+}
+
+static void verify_raw(int fd, uint64_t n_clusters) {
+        _cleanup_free_ uint8_t *buf = NULL, *expected = NULL;
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        struct stat st;
+        uint64_t i;
+
+        assert_se(buf = malloc(CLUSTER_SIZE));
+        assert_se(expected = malloc(CLUSTER_SIZE));
+
+        assert_se(fstat(fd, &st) >= 0);
+        assert_se((uint64_t) st.st_size == n_clusters * CLUSTER_SIZE);
+
+        for (i = 0; i < n_clusters; i++) {
+                assert_se(pread(fd, buf, CLUSTER_SIZE, i * CLUSTER_SIZE) == CLUSTER_SIZE);
+                fill_cluster(i, expected);
+                assert_se(memcmp(buf, expected, CLUSTER_SIZE) == 0);
+        }
+
+        /* Only the clusters with actual data should have been written */
+        log_info("raw image uses %s of %s on disk",
+                 format_bytes(a, sizeof(a), (uint64_t) st.st_blocks * 512),
+                 format_bytes(b, sizeof(b), (uint64_t) st.st_size));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_close_ int sfd = -1, dfd = -1;
+        char ts[FORMAT_TIMESPAN_MAX], a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        uint64_t n_clusters, size_mb = 64;
+        usec_t t;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou64(argv[1], &size_mb) >= 0);
+        else {
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                if (r > 0 || (r < 0 && SYSTEMD_SLOW_TESTS_DEFAULT))
+                        size_mb = 1024;
+        }
+
+        n_clusters = size_mb * 1024 * 1024 / CLUSTER_SIZE;
+        assert_se(n_clusters > 0);
+
+        sfd = open_tmpfile_unlinkable("/var/tmp", O_RDWR|O_CLOEXEC);
+        assert_se(sfd >= 0);
+        dfd = open_tmpfile_unlinkable("/var/tmp", O_RDWR|O_CLOEXEC);
+        assert_se(dfd >= 0);
+
+        write_image(sfd, n_clusters);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(qcow2_convert(sfd, dfd) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("converted %s in %s (%s/s)",
+                 format_bytes(a, sizeof(a), n_clusters * CLUSTER_SIZE),
+                 format_timespan(ts, sizeof(ts), t, 1),
+                 format_bytes(b, sizeof(b), t > 0 ? n_clusters * CLUSTER_SIZE * USEC_PER_SEC / t : 0));
+
+        verify_raw(dfd, n_clusters);
+
+        return EXIT_SUCCESS;
+}
@@ -6,6 +6,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
@@ -16,22 +22,34 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
+#include "journal-util.h"
 #include "log.h"
 #include "logs-show.h"
 #include "microhttpd-util.h"
 #include "os-util.h"
 #include "parse-util.h"
+#include "set.h"
 #include "sigbus.h"
+#include "strv.h"
 #include "terminal-util.h"
 #include "util.h"
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* How much output we serialize (and compress) at once before handing it out */
+#define REQUEST_CHUNK_SIZE (64U*1024U)
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
 static char *arg_directory = NULL;
 
+typedef enum RequestEncoding {
+        REQUEST_ENCODING_IDENTITY,
+        REQUEST_ENCODING_GZIP,
+        REQUEST_ENCODING_ZSTD,
+} RequestEncoding;
+
 typedef struct RequestMeta {
         sd_journal *journal;
 
@@ -42,14 +60,32 @@ typedef struct RequestMeta {
         uint64_t n_entries;
         bool n_entries_set;
 
-        FILE *tmp;
-        uint64_t delta, size;
+        /* Serialized entries are appended to this buffer via 'buffer_f', and handed out from there, after
+         * being compressed into 'out' if the client asked for it */
+        FILE *buffer_f;
+        char *buffer;
+        size_t buffer_size, buffer_allocated;
+
+        char *out;
+        size_t out_size, out_allocated, out_pos;
+        bool eof;
+
+        RequestEncoding encoding;
+#if HAVE_ZLIB
+        z_stream gzip;
+        bool gzip_initialized;
+#endif
+#if HAVE_ZSTD
+        ZSTD_CCtx *zstd;
+#endif
 
         int argument_parse_error;
 
         bool follow;
         bool discrete;
 
+        Set *output_fields;
+
         uint64_t n_fields;
         bool n_fields_set;
 } RequestMeta;
@@ -61,6 +97,11 @@ static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_EXPORT] = "application/vnd.fdo.journal",
 };
 
+static const char* const encodings[] = {
+        [REQUEST_ENCODING_GZIP] = "gzip",
+        [REQUEST_ENCODING_ZSTD] = "zstd",
+};
+
 static RequestMeta *request_meta(void **connection_cls) {
         RequestMeta *m;
 
@@ -89,7 +130,19 @@ static void request_meta_free(
 
         sd_journal_close(m->journal);
 
-        safe_fclose(m->tmp);
+        safe_fclose(m->buffer_f);
+        free(m->buffer);
+        free(m->out);
+
+#if HAVE_ZLIB
+        if (m->gzip_initialized)
+                (void) deflateEnd(&m->gzip);
+#endif
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(m->zstd);
+#endif
+
+        set_free_free(m->output_fields);
 
         free(m->cursor);
         free(m);
@@ -107,147 +160,273 @@ static int open_journal(RequestMeta *m) {
                 return sd_journal_open(&m->journal, SD_JOURNAL_LOCAL_ONLY|SD_JOURNAL_SYSTEM);
 }
 
-static int request_meta_ensure_tmp(RequestMeta *m) {
+static ssize_t request_buffer_write(void *cookie, const char *data, size_t size) {
+        RequestMeta *m = cookie;
+
+        if (!GREEDY_REALLOC(m->buffer, m->buffer_allocated, m->buffer_size + size)) {
+                errno = ENOMEM;
+                return -1;
+        }
+
+        memcpy(m->buffer + m->buffer_size, data, size);
+        m->buffer_size += size;
+
+        return (ssize_t) size;
+}
+
+static int request_meta_ensure_buffer(RequestMeta *m) {
         assert(m);
 
-        if (m->tmp)
-                rewind(m->tmp);
-        else {
-                int fd;
+        if (m->buffer_f)
+                return 0;
+
+        /* A stream writing to memory we keep around, so that serializing an entry neither allocates nor
+         * needs any syscalls once the buffer has grown large enough */
+        m->buffer_f = fopencookie(m, "w", (cookie_io_functions_t) {
+                        .write = request_buffer_write,
+                });
+        if (!m->buffer_f)
+                return -errno;
+
+        return 0;
+}
+
+static int request_encode(RequestMeta *m) {
+        assert(m);
 
-                fd = open_tmpfile_unlinkable("/tmp", O_RDWR|O_CLOEXEC);
-                if (fd < 0)
-                        return fd;
+        /* Compresses everything serialized so far into 'out', and flushes the compressor, so that the
+         * client can decode everything it got so far. This matters for following clients, which want to
+         * see entries as they come in. */
 
-                m->tmp = fdopen(fd, "w+");
-                if (!m->tmp) {
-                        safe_close(fd);
-                        return -errno;
+        m->out_size = m->out_pos = 0;
+
+        switch (m->encoding) {
+
+#if HAVE_ZLIB
+        case REQUEST_ENCODING_GZIP: {
+                int flush = m->eof ? Z_FINISH : Z_SYNC_FLUSH;
+
+                m->gzip.next_in = (Bytef*) m->buffer;
+                m->gzip.avail_in = m->buffer_size;
+
+                for (;;) {
+                        int k;
+
+                        if (!GREEDY_REALLOC(m->out, m->out_allocated, m->out_size + MAX(m->buffer_size / 2, 4096U)))
+                                return -ENOMEM;
+
+                        m->gzip.next_out = (Bytef*) m->out + m->out_size;
+                        m->gzip.avail_out = m->out_allocated - m->out_size;
+
+                        k = deflate(&m->gzip, flush);
+                        if (!IN_SET(k, Z_OK, Z_STREAM_END, Z_BUF_ERROR))
+                                return -EIO;
+
+                        m->out_size = m->out_allocated - m->gzip.avail_out;
+
+                        if (flush == Z_FINISH ? k == Z_STREAM_END : m->gzip.avail_out > 0)
+                                break;
+                }
+
+                break;
+        }
+#endif
+
+#if HAVE_ZSTD
+        case REQUEST_ENCODING_ZSTD: {
+                ZSTD_inBuffer input = {
+                        .src = m->buffer,
+                        .size = m->buffer_size,
+                };
+
+                for (;;) {
+                        ZSTD_outBuffer output;
+                        size_t k;
+
+                        if (!GREEDY_REALLOC(m->out, m->out_allocated, m->out_size + MAX(m->buffer_size / 2, 4096U)))
+                                return -ENOMEM;
+
+                        output = (ZSTD_outBuffer) {
+                                .dst = m->out,
+                                .size = m->out_allocated,
+                                .pos = m->out_size,
+                        };
+
+                        k = ZSTD_compressStream2(m->zstd, &output, &input, m->eof ? ZSTD_e_end : ZSTD_e_flush);
+                        if (ZSTD_isError(k)) {
+                                log_error("Failed to compress response: %s", ZSTD_getErrorName(k));
+                                return -EIO;
+                        }
+
+                        m->out_size = output.pos;
+
+                        if (k == 0)
+                                break;
                 }
+
+                break;
+        }
+#endif
+
+        default:
+                return 0;
         }
 
+        m->buffer_size = 0;
         return 0;
 }
 
-static ssize_t request_reader_entries(
-                void *cls,
-                uint64_t pos,
+typedef int (*request_fill_t)(RequestMeta *m, bool wait);
+
+static ssize_t request_reader(
+                RequestMeta *m,
+                request_fill_t fill,
                 char *buf,
                 size_t max) {
 
-        RequestMeta *m = cls;
         int r;
-        size_t n, k;
 
         assert(m);
+        assert(fill);
         assert(buf);
         assert(max > 0);
-        assert(pos >= m->delta);
 
-        pos -= m->delta;
+        /* Serializes output in chunks of REQUEST_CHUNK_SIZE, and hands it out until it is used up. The
+         * fill callback is told whether it may wait for new data: only if there's nothing pending yet,
+         * otherwise we return what we have first. */
 
-        while (pos >= m->size) {
-                off_t sz;
+        for (;;) {
+                bool have_data;
+                const char *p;
+                size_t n;
+
+                if (m->encoding == REQUEST_ENCODING_IDENTITY) {
+                        p = m->buffer + m->out_pos;
+                        n = m->buffer_size - m->out_pos;
+                } else {
+                        p = m->out + m->out_pos;
+                        n = m->out_size - m->out_pos;
+                }
 
-                /* End of this entry, so let's serialize the next
-                 * one */
+                if (n > 0) {
+                        n = MIN(n, max);
+                        memcpy(buf, p, n);
+                        m->out_pos += n;
 
-                if (m->n_entries_set &&
-                    m->n_entries <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                        return (ssize_t) n;
+                }
 
-                if (m->n_skip < 0)
-                        r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
-                else if (m->n_skip > 0)
-                        r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
-                else
-                        r = sd_journal_next(m->journal);
+                if (m->eof)
+                        return MHD_CONTENT_READER_END_OF_STREAM;
 
+                r = request_meta_ensure_buffer(m);
                 if (r < 0) {
-                        log_error_errno(r, "Failed to advance journal pointer: %m");
+                        log_error_errno(r, "Failed to allocate output buffer: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0) {
+                }
 
-                        if (m->follow) {
-                                r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
-                                if (r < 0) {
-                                        log_error_errno(r, "Couldn't wait for journal event: %m");
-                                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                                }
-                                if (r == SD_JOURNAL_NOP)
-                                        break;
+                m->buffer_size = m->out_pos = 0;
+                have_data = false;
 
-                                continue;
-                        }
-
-                        return MHD_CONTENT_READER_END_OF_STREAM;
-                }
+                while (!m->eof && m->buffer_size < REQUEST_CHUNK_SIZE) {
+                        r = fill(m, !have_data);
+                        if (r < 0)
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        if (r == 0)
+                                break;
 
-                if (m->discrete) {
-                        assert(m->cursor);
+                        have_data = true;
 
-                        r = sd_journal_test_cursor(m->journal, m->cursor);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to test cursor: %m");
+                        if (fflush(m->buffer_f) != 0) {
+                                log_oom();
                                 return MHD_CONTENT_READER_END_WITH_ERROR;
                         }
+                }
 
-                        if (r == 0)
-                                return MHD_CONTENT_READER_END_OF_STREAM;
+                r = request_encode(m);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to compress output: %m");
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
 
-                pos -= m->size;
-                m->delta += m->size;
+                /* Nothing new came in while following, come back later */
+                if (!m->eof &&
+                    (m->encoding == REQUEST_ENCODING_IDENTITY ? m->buffer_size : m->out_size) == 0)
+                        return 0;
+        }
+}
 
-                if (m->n_entries_set)
-                        m->n_entries -= 1;
+static int request_fill_entries(RequestMeta *m, bool wait) {
+        int r;
 
-                m->n_skip = 0;
+        assert(m);
 
-                r = request_meta_ensure_tmp(m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+        if (m->n_entries_set &&
+            m->n_entries <= 0) {
+                m->eof = true;
+                return 0;
+        }
 
-                r = show_journal_entry(m->tmp, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
-                                   NULL, NULL, NULL);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to serialize item: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+        for (;;) {
+                if (m->n_skip < 0)
+                        r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
+                else if (m->n_skip > 0)
+                        r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
+                else
+                        r = sd_journal_next(m->journal);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to advance journal pointer: %m");
+                if (r > 0)
+                        break;
 
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                if (!m->follow) {
+                        m->eof = true;
+                        return 0;
                 }
 
-                m->size = (uint64_t) sz;
+                if (!wait)
+                        return 0;
+
+                r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
+                if (r < 0)
+                        return log_error_errno(r, "Couldn't wait for journal event: %m");
+                if (r == SD_JOURNAL_NOP)
+                        return 0;
         }
 
-        if (m->tmp == NULL && m->follow)
-                return 0;
+        if (m->discrete) {
+                assert(m->cursor);
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
+                r = sd_journal_test_cursor(m->journal, m->cursor);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to test cursor: %m");
 
-        n = m->size - pos;
-        if (n < 1)
-                return 0;
-        if (n > max)
-                n = max;
-
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno ? strerror(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+                if (r == 0) {
+                        m->eof = true;
+                        return 0;
+                }
         }
 
-        return (ssize_t) k;
+        if (m->n_entries_set)
+                m->n_entries -= 1;
+
+        m->n_skip = 0;
+
+        r = show_journal_entry_set(m->buffer_f, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
+                                   m->output_fields, NULL, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to serialize item: %m");
+
+        return 1;
+}
+
+static ssize_t request_reader_entries(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        return request_reader(cls, request_fill_entries, buf, max);
 }
 
 static int request_parse_accept(
@@ -275,6 +454,69 @@ static int request_parse_accept(
         return 0;
 }
 
+static int request_parse_accept_encoding(
+                RequestMeta *m,
+                struct MHD_Connection *connection) {
+
+        _cleanup_strv_free_ char **l = NULL;
+        bool gzip = false, zstd = false;
+        const char *header;
+        char **i;
+
+        assert(m);
+        assert(connection);
+
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+        if (!header)
+                return 0;
+
+        l = strv_split(header, ",");
+        if (!l)
+                return -ENOMEM;
+
+        STRV_FOREACH(i, l) {
+                char *q;
+
+                /* We don't care for the weights, except for the one that says "not at all" */
+                q = strchr(*i, ';');
+                if (q) {
+                        *q++ = 0;
+                        q = strstrip(q);
+                        if (startswith(q, "q=") && strspn(q + 2, "0.") == strlen(q + 2))
+                                continue;
+                }
+
+                q = strstrip(*i);
+                if (streq(q, "gzip"))
+                        gzip = true;
+                else if (streq(q, "zstd"))
+                        zstd = true;
+        }
+
+#if HAVE_ZSTD
+        if (zstd) {
+                m->zstd = ZSTD_createCCtx();
+                if (!m->zstd)
+                        return -ENOMEM;
+
+                m->encoding = REQUEST_ENCODING_ZSTD;
+                return 0;
+        }
+#endif
+
+#if HAVE_ZLIB
+        if (gzip) {
+                if (deflateInit2(&m->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                        return -ENOMEM;
+
+                m->gzip_initialized = true;
+                m->encoding = REQUEST_ENCODING_GZIP;
+        }
+#endif
+
+        return 0;
+}
+
 static int request_parse_range(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -388,6 +630,33 @@ static int request_parse_arguments_iterator(
                 return MHD_YES;
         }
 
+        if (streq(key, "fields")) {
+                _cleanup_strv_free_ char **l = NULL;
+                char **f;
+
+                l = strv_split(strempty(value), ",");
+                if (!l) {
+                        m->argument_parse_error = log_oom();
+                        return MHD_NO;
+                }
+
+                STRV_FOREACH(f, l)
+                        if (!journal_field_valid(*f, 0, true)) {
+                                m->argument_parse_error = -EINVAL;
+                                return MHD_NO;
+                        }
+
+                r = set_ensure_allocated(&m->output_fields, &string_hash_ops);
+                if (r >= 0)
+                        r = set_put_strdupv(m->output_fields, l);
+                if (r < 0) {
+                        m->argument_parse_error = r;
+                        return MHD_NO;
+                }
+
+                return MHD_YES;
+        }
+
         if (streq(key, "boot")) {
                 if (isempty(value))
                         r = true;
@@ -448,6 +717,16 @@ static int request_parse_arguments(
         return m->argument_parse_error;
 }
 
+static void request_add_encoding_headers(RequestMeta *m, struct MHD_Response *response) {
+        assert(m);
+        assert(response);
+
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+
+        if (m->encoding != REQUEST_ENCODING_IDENTITY)
+                MHD_add_response_header(response, "Content-Encoding", encodings[m->encoding]);
+}
+
 static int request_handler_entries(
                 struct MHD_Connection *connection,
                 void *connection_cls) {
@@ -466,6 +745,9 @@ static int request_handler_entries(
         if (request_parse_accept(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept header.");
 
+        if (request_parse_accept_encoding(m, connection) < 0)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept-Encoding header.");
+
         if (request_parse_range(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Range header.");
 
@@ -489,11 +771,12 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, REQUEST_CHUNK_SIZE, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         MHD_add_response_header(response, "Content-Type", mime_types[m->mode]);
+        request_add_encoding_headers(m, response);
 
         r = MHD_queue_response(connection, MHD_HTTP_OK, response);
         MHD_destroy_response(response);
@@ -523,86 +806,44 @@ static int output_field(FILE *f, OutputMode m, const char *d, size_t l) {
         return 0;
 }
 
-static ssize_t request_reader_fields(
-                void *cls,
-                uint64_t pos,
-                char *buf,
-                size_t max) {
-
-        RequestMeta *m = cls;
+static int request_fill_fields(RequestMeta *m, bool wait) {
+        const void *d;
+        size_t l;
         int r;
-        size_t n, k;
 
         assert(m);
-        assert(buf);
-        assert(max > 0);
-        assert(pos >= m->delta);
-
-        pos -= m->delta;
-
-        while (pos >= m->size) {
-                off_t sz;
-                const void *d;
-                size_t l;
-
-                /* End of this field, so let's serialize the next
-                 * one */
-
-                if (m->n_fields_set &&
-                    m->n_fields <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
-
-                r = sd_journal_enumerate_unique(m->journal, &d, &l);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to advance field index: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
 
-                pos -= m->size;
-                m->delta += m->size;
-
-                if (m->n_fields_set)
-                        m->n_fields -= 1;
-
-                r = request_meta_ensure_tmp(m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
-
-                r = output_field(m->tmp, m->mode, d, l);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to serialize item: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
-
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
-
-                m->size = (uint64_t) sz;
+        if (m->n_fields_set &&
+            m->n_fields <= 0) {
+                m->eof = true;
+                return 0;
         }
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+        r = sd_journal_enumerate_unique(m->journal, &d, &l);
+        if (r < 0)
+                return log_error_errno(r, "Failed to advance field index: %m");
+        if (r == 0) {
+                m->eof = true;
+                return 0;
         }
 
-        n = m->size - pos;
-        if (n > max)
-                n = max;
+        if (m->n_fields_set)
+                m->n_fields -= 1;
 
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno ? strerror(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
+        r = output_field(m->buffer_f, m->mode, d, l);
+        if (r < 0)
+                return log_error_errno(r, "Failed to serialize item: %m");
+
+        return 1;
+}
 
-        return (ssize_t) k;
+static ssize_t request_reader_fields(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        return request_reader(cls, request_fill_fields, buf, max);
 }
 
 static int request_handler_fields(
@@ -624,15 +865,19 @@ static int request_handler_fields(
         if (request_parse_accept(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept header.");
 
+        if (request_parse_accept_encoding(m, connection) < 0)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept-Encoding header.");
+
         r = sd_journal_query_unique(m->journal, field);
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to query unique fields.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_fields, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, REQUEST_CHUNK_SIZE, request_reader_fields, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         MHD_add_response_header(response, "Content-Type", mime_types[m->mode == OUTPUT_JSON ? OUTPUT_JSON : OUTPUT_SHORT]);
+        request_add_encoding_headers(m, response);
 
         r = MHD_queue_response(connection, MHD_HTTP_OK, response);
         MHD_destroy_response(response);
@@ -31,6 +31,7 @@ static char* arg_listen_https = NULL;
 static char** arg_files = NULL;
 static int arg_compress = true;
 static int arg_seal = false;
+static int arg_writer_threads = false;
 static int http_socket = -1, https_socket = -1;
 static char** arg_gnutls_log = NULL;
 
@@ -196,10 +197,17 @@ static int process_http_upload(
         if (*upload_data_size) {
                 log_trace("Received %zu bytes", *upload_data_size);
 
-                r = journal_importer_push_data(&source->importer,
-                                               upload_data, *upload_data_size);
-                if (r < 0)
+                r = source_push_data(source, upload_data, *upload_data_size);
+                if (r == -ENOMEM)
                         return mhd_respond_oom(connection);
+                else if (r == -E2BIG)
+                        return mhd_respondf(connection,
+                                            r, MHD_HTTP_PAYLOAD_TOO_LARGE,
+                                            "Entry is too large, maximum is " STRINGIFY(ENTRY_SIZE_MAX) " bytes.");
+                else if (r < 0)
+                        return mhd_respondf(connection,
+                                            r, MHD_HTTP_BAD_REQUEST,
+                                            "Failed to decode data: %m.");
 
                 *upload_data_size = 0;
         } else
@@ -238,6 +246,12 @@ static int process_http_upload(
                                     remaining);
         }
 
+        if (source_data_incomplete(source)) {
+                log_warning("Premature EOF in compressed data.");
+                return mhd_respond(connection, MHD_HTTP_EXPECTATION_FAILED,
+                                   "Premature EOF in compressed data.");
+        }
+
         return mhd_respond(connection, MHD_HTTP_ACCEPTED, "OK.");
 };
 
@@ -314,6 +328,20 @@ static int request_handler(
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "%m");
 
         hostname = NULL;
+
+        header = MHD_lookup_connection_value(connection,
+                                             MHD_HEADER_KIND, "Content-Encoding");
+        r = source_set_content_encoding(*connection_cls, header);
+        if (r < 0) {
+                source_free(*connection_cls);
+                *connection_cls = NULL;
+
+                if (r == -ENOMEM)
+                        return respond_oom(connection);
+
+                return mhd_respondf(connection, 0, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                    "Content-Encoding: %s is not supported.", header);
+        }
         return MHD_YES;
 }
 
@@ -559,6 +587,8 @@ static int create_remoteserver(
         if (r < 0)
                 return r;
 
+        s->writer_threads = arg_writer_threads;
+
         setup_signals(s);
 
         n = sd_listen_fds(true);
@@ -725,6 +755,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "WriterThreads",          config_parse_bool,             0, &arg_writer_threads },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -766,6 +797,9 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --writer-threads[=BOOL]\n"
+               "                            Write each output file from a separate thread\n"
+               "                            (default: no)\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
@@ -786,6 +820,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_SPLIT_MODE,
                 ARG_COMPRESS,
                 ARG_SEAL,
+                ARG_WRITER_THREADS,
                 ARG_KEY,
                 ARG_CERT,
                 ARG_TRUST,
@@ -804,6 +839,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "split-mode",   required_argument, NULL, ARG_SPLIT_MODE   },
                 { "compress",     optional_argument, NULL, ARG_COMPRESS     },
                 { "seal",         optional_argument, NULL, ARG_SEAL         },
+                { "writer-threads", optional_argument, NULL, ARG_WRITER_THREADS },
                 { "key",          required_argument, NULL, ARG_KEY          },
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
@@ -970,6 +1006,20 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
 
+                case ARG_WRITER_THREADS:
+                        if (optarg) {
+                                r = parse_boolean(optarg);
+                                if (r < 0) {
+                                        log_error("Failed to parse --writer-threads= parameter.");
+                                        return -EINVAL;
+                                }
+
+                                arg_writer_threads = !!r;
+                        } else
+                                arg_writer_threads = true;
+
+                        break;
+
                 case ARG_GNUTLS_LOG: {
 #if HAVE_GNUTLS
                         const char* p = optarg;
@@ -1146,10 +1196,12 @@ int main(int argc, char **argv) {
         sd_notifyf(false,
                    "STOPPING=1\n"
                    "STATUS=Shutting down after writing %" PRIu64 " entries...", s.event_count);
-        log_info("Finishing after writing %" PRIu64 " entries", s.event_count);
 
+        /* This joins the writer threads, so only count the entries afterwards */
         journal_remote_server_destroy(&s);
 
+        log_info("Finishing after writing %" PRIu64 " entries", s.event_count);
+
         free(arg_key);
         free(arg_cert);
         free(arg_trust);
@@ -13,6 +13,10 @@ void source_free(RemoteSource *source) {
 
         journal_importer_cleanup(&source->importer);
 
+#if HAVE_ZSTD
+        ZSTD_freeDCtx(source->decompress_ctx);
+#endif
+
         log_debug("Writer ref count %i", source->writer->n_ref);
         writer_unref(source->writer);
 
@@ -47,6 +51,86 @@ RemoteSource* source_new(int fd, bool passive_fd, char *name, Writer *writer) {
         return source;
 }
 
+int source_set_content_encoding(RemoteSource *source, const char *encoding) {
+        assert(source);
+
+        if (!encoding || streq(encoding, "identity"))
+                return 0;
+
+#if HAVE_ZSTD
+        if (streq(encoding, "zstd")) {
+                if (!source->decompress_ctx) {
+                        source->decompress_ctx = ZSTD_createDCtx();
+                        if (!source->decompress_ctx)
+                                return -ENOMEM;
+                }
+
+                return 0;
+        }
+#endif
+
+        return -EPROTONOSUPPORT;
+}
+
+int source_push_data(RemoteSource *source, const char *data, size_t size) {
+        assert(source);
+
+#if HAVE_ZSTD
+        if (source->decompress_ctx) {
+                ZSTD_inBuffer input = {
+                        .src = data,
+                        .size = size,
+                };
+
+                /* Decompress straight into the importer's buffer, a block at a time, so that the
+                 * buffer never grows beyond what is needed to hold the unprocessed data. */
+                while (input.pos < input.size) {
+                        char buf[16 * 1024];
+                        ZSTD_outBuffer output = {
+                                .dst = buf,
+                                .size = sizeof(buf),
+                        };
+                        size_t k;
+                        int r;
+
+                        k = ZSTD_decompressStream(source->decompress_ctx, &output, &input);
+                        if (ZSTD_isError(k)) {
+                                log_debug("Failed to decompress received data: %s", ZSTD_getErrorName(k));
+                                return -EBADMSG;
+                        }
+
+                        source->decompress_pending = k != 0;
+
+                        if (output.pos == 0)
+                                continue;
+
+                        if (journal_importer_bytes_remaining(&source->importer) + output.pos > ENTRY_SIZE_MAX) {
+                                log_error("Received data decompresses to more than %u unprocessed bytes.", ENTRY_SIZE_MAX);
+                                return -E2BIG;
+                        }
+
+                        r = journal_importer_push_data(&source->importer, buf, output.pos);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+#endif
+
+        return journal_importer_push_data(&source->importer, data, size);
+}
+
+bool source_data_incomplete(RemoteSource *source) {
+        assert(source);
+
+#if HAVE_ZSTD
+        return source->decompress_pending;
+#else
+        return false;
+#endif
+}
+
 int process_source(RemoteSource *source, bool compress, bool seal) {
         int r;
 
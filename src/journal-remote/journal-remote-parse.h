@@ -1,6 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "sd-event.h"
 
 #include "journal-importer.h"
@@ -11,10 +15,19 @@ typedef struct RemoteSource {
 
         Writer *writer;
 
+#if HAVE_ZSTD
+        /* Set if the data pushed with source_push_data() is zstd compressed */
+        ZSTD_DCtx *decompress_ctx;
+        bool decompress_pending;   /* true while a frame is not complete yet */
+#endif
+
         sd_event_source *event;
         sd_event_source *buffer_event;
 } RemoteSource;
 
 RemoteSource* source_new(int fd, bool passive_fd, char *name, Writer *writer);
 void source_free(RemoteSource *source);
+int source_set_content_encoding(RemoteSource *source, const char *encoding);
+int source_push_data(RemoteSource *source, const char *data, size_t size);
+bool source_data_incomplete(RemoteSource *source);
 int process_source(RemoteSource *source, bool compress, bool seal);
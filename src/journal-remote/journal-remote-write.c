@@ -1,8 +1,28 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <signal.h>
+
 #include "alloc-util.h"
+#include "io-util.h"
 #include "journal-remote.h"
 
+/* How much entry data may be queued for a writer thread before the main loop waits for it to catch up */
+#define WRITER_QUEUE_SIZE_MAX (16U*1024U*1024U)
+
+struct WriterEntry {
+        dual_timestamp ts;
+        bool has_ts;
+        bool compress;
+        bool seal;
+        size_t size;
+        size_t n_iovec;
+
+        LIST_FIELDS(WriterEntry, entries);
+
+        struct iovec iovec[];
+};
+
 static int do_rotate(JournalFile **f, bool compress, bool seal) {
         int r = journal_file_rotate(f, compress, (uint64_t) -1, seal, NULL);
         if (r < 0) {
@@ -34,10 +54,37 @@ Writer* writer_new(RemoteServer *server) {
         return w;
 }
 
+static void writer_stop_thread(Writer *w) {
+        int r;
+
+        assert(w);
+
+        if (!w->thread_running)
+                return;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->thread_stop = true;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        /* The thread only exits once the queue is drained */
+        r = pthread_join(w->thread, NULL);
+        if (r != 0)
+                log_warning_errno(r, "Failed to join writer thread: %m");
+
+        assert(!w->queue);
+
+        (void) pthread_cond_destroy(&w->cond);
+        (void) pthread_mutex_destroy(&w->mutex);
+        w->thread_running = false;
+}
+
 static Writer* writer_free(Writer *w) {
         if (!w)
                 return NULL;
 
+        writer_stop_thread(w);
+
         if (w->journal) {
                 log_debug("Closing journal file %s.", w->journal->path);
                 journal_file_close(w->journal);
@@ -56,16 +103,19 @@ static Writer* writer_free(Writer *w) {
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(Writer, writer, writer_free);
 
-int writer_write(Writer *w,
-                 struct iovec_wrapper *iovw,
-                 dual_timestamp *ts,
-                 bool compress,
-                 bool seal) {
+static int writer_append(
+                Writer *w,
+                const struct iovec *iovec,
+                size_t n_iovec,
+                const dual_timestamp *ts,
+                bool compress,
+                bool seal) {
+
         int r;
 
         assert(w);
-        assert(iovw);
-        assert(iovw->count > 0);
+        assert(iovec);
+        assert(n_iovec > 0);
 
         if (journal_file_rotate_suggested(w->journal, 0)) {
                 log_info("%s: Journal header limits reached or header out-of-date, rotating",
@@ -76,11 +126,11 @@ int writer_write(Writer *w,
         }
 
         r = journal_file_append_entry(w->journal, ts, NULL,
-                                      iovw->iovec, iovw->count,
+                                      iovec, n_iovec,
                                       &w->seqnum, NULL, NULL);
         if (r >= 0) {
                 if (w->server)
-                        w->server->event_count += 1;
+                        __sync_fetch_and_add(&w->server->event_count, 1);
                 return 0;
         } else if (r == -EBADMSG)
                 return r;
@@ -94,12 +144,196 @@ int writer_write(Writer *w,
 
         log_debug("Retrying write.");
         r = journal_file_append_entry(w->journal, ts, NULL,
-                                      iovw->iovec, iovw->count,
+                                      iovec, n_iovec,
                                       &w->seqnum, NULL, NULL);
         if (r < 0)
                 return r;
 
         if (w->server)
-                w->server->event_count += 1;
+                __sync_fetch_and_add(&w->server->event_count, 1);
         return 0;
 }
+
+static void* writer_thread(void *p) {
+        Writer *w = p;
+        int r;
+
+        assert(w);
+
+        (void) pthread_setname_np(pthread_self(), "journal-writer");
+
+        /* The journal file is opened here rather than in the main thread, so that all the hashmaps it
+         * drops when it is rotated were allocated in this thread, too. */
+        r = journal_file_open_reliably(w->thread_path,
+                                       O_RDWR|O_CREAT, 0640,
+                                       w->thread_compress, (uint64_t) -1, w->thread_seal,
+                                       &w->metrics,
+                                       w->mmap, NULL,
+                                       NULL, &w->journal);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        w->thread_result = r < 0 ? r : 1;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+
+        while (r >= 0) {
+                WriterEntry *e;
+
+                while (!w->queue && !w->thread_stop)
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+                e = w->queue;
+                if (!e)
+                        break;
+
+                LIST_REMOVE(entries, w->queue, e);
+                if (w->queue_tail == e)
+                        w->queue_tail = NULL;
+                w->queue_size -= e->size;
+
+                /* Wake up the main loop in case it waits for room in the queue */
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                r = writer_append(w, e->iovec, e->n_iovec, e->has_ts ? &e->ts : NULL, e->compress, e->seal);
+                if (r == -EBADMSG)
+                        log_error_errno(r, "Entry is invalid, ignoring.");
+                else if (r < 0)
+                        log_error_errno(r, "Failed to write entry of %zu bytes: %m", e->size);
+                r = 0;
+
+                free(e);
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+int writer_start_thread(Writer *w, const char *path, bool compress, bool seal) {
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(w);
+        assert(path);
+        assert(!w->journal);
+        assert(!w->thread_running);
+
+        r = pthread_mutex_init(&w->mutex, NULL);
+        if (r != 0)
+                return -r;
+
+        r = pthread_cond_init(&w->cond, NULL);
+        if (r != 0) {
+                pthread_mutex_destroy(&w->mutex);
+                return -r;
+        }
+
+        w->thread_path = path;
+        w->thread_compress = compress;
+        w->thread_seal = seal;
+        w->thread_result = 0;
+
+        /* Make sure the writer thread doesn't handle any signals, the main loop does that */
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r == 0) {
+                r = pthread_create(&w->thread, NULL, writer_thread, w);
+                (void) pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        }
+        if (r != 0) {
+                pthread_cond_destroy(&w->cond);
+                pthread_mutex_destroy(&w->mutex);
+                return -r;
+        }
+
+        w->thread_running = true;
+
+        /* Wait until the thread opened the journal file, so that errors are reported to the caller */
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        while (w->thread_result == 0)
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+        r = w->thread_result;
+        w->thread_path = NULL;
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (r < 0) {
+                writer_stop_thread(w);
+                return r;
+        }
+
+        return 0;
+}
+
+static int writer_enqueue(
+                Writer *w,
+                struct iovec_wrapper *iovw,
+                dual_timestamp *ts,
+                bool compress,
+                bool seal) {
+
+        WriterEntry *e;
+        size_t i, size;
+        uint8_t *p;
+
+        assert(w);
+        assert(iovw);
+
+        /* Copy the entry into a single allocation, the importer reuses its buffers once we return */
+        size = offsetof(WriterEntry, iovec) + sizeof(struct iovec) * iovw->count + iovw_size(iovw);
+
+        e = malloc(size);
+        if (!e)
+                return -ENOMEM;
+
+        *e = (WriterEntry) {
+                .ts = ts ? *ts : DUAL_TIMESTAMP_NULL,
+                .has_ts = !!ts,
+                .compress = compress,
+                .seal = seal,
+                .size = size,
+                .n_iovec = iovw->count,
+        };
+
+        p = (uint8_t*) (e->iovec + iovw->count);
+        for (i = 0; i < iovw->count; i++) {
+                e->iovec[i] = IOVEC_MAKE(p, iovw->iovec[i].iov_len);
+                memcpy_safe(p, iovw->iovec[i].iov_base, iovw->iovec[i].iov_len);
+                p += iovw->iovec[i].iov_len;
+        }
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* Apply backpressure: if this writer's thread falls behind, stop reading input until it caught up */
+        while (w->queue_size >= WRITER_QUEUE_SIZE_MAX)
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+        LIST_INSERT_AFTER(entries, w->queue, w->queue_tail, e);
+        w->queue_tail = e;
+        w->queue_size += size;
+
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return 0;
+}
+
+int writer_write(Writer *w,
+                 struct iovec_wrapper *iovw,
+                 dual_timestamp *ts,
+                 bool compress,
+                 bool seal) {
+
+        assert(w);
+        assert(iovw);
+        assert(iovw->count > 0);
+
+        /* With a writer thread, errors are logged by the thread, and not propagated to the source */
+        if (w->thread_running)
+                return writer_enqueue(w, iovw, ts, compress, seal);
+
+        return writer_append(w, iovw->iovec, iovw->count, ts, compress, seal);
+}
@@ -1,10 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <pthread.h>
+
 #include "journal-file.h"
 #include "journal-importer.h"
+#include "list.h"
 
 typedef struct RemoteServer RemoteServer;
+typedef struct WriterEntry WriterEntry;
 
 typedef struct Writer {
         JournalFile *journal;
@@ -16,6 +20,22 @@ typedef struct Writer {
 
         uint64_t seqnum;
 
+        /* When a writer thread is running, it owns the journal file: entries are queued here and
+         * appended by the thread, see writer_start_thread(). The fields from the mutex on are
+         * protected by it. */
+        bool thread_running;
+        pthread_t thread;
+        const char *thread_path;
+        bool thread_compress;
+        bool thread_seal;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        int thread_result;
+        LIST_HEAD(WriterEntry, queue);
+        WriterEntry *queue_tail;
+        size_t queue_size;
+        bool thread_stop;
+
         unsigned n_ref;
 } Writer;
 
@@ -25,6 +45,8 @@ Writer* writer_unref(Writer *w);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Writer*, writer_unref);
 
+int writer_start_thread(Writer *w, const char *path, bool compress, bool seal);
+
 int writer_write(Writer *s,
                  struct iovec_wrapper *iovw,
                  dual_timestamp *ts,
@@ -62,12 +62,15 @@ static int open_output(RemoteServer *s, Writer *w, const char* host) {
                 assert_not_reached("what?");
         }
 
-        r = journal_file_open_reliably(filename,
-                                       O_RDWR|O_CREAT, 0640,
-                                       s->compress, (uint64_t) -1, s->seal,
-                                       &w->metrics,
-                                       w->mmap, NULL,
-                                       NULL, &w->journal);
+        if (s->writer_threads)
+                r = writer_start_thread(w, filename, s->compress, s->seal);
+        else
+                r = journal_file_open_reliably(filename,
+                                               O_RDWR|O_CREAT, 0640,
+                                               s->compress, (uint64_t) -1, s->seal,
+                                               &w->metrics,
+                                               w->mmap, NULL,
+                                               NULL, &w->journal);
         if (r < 0)
                 return log_error_errno(r, "Failed to open output journal %s: %m", filename);
 
@@ -41,6 +41,7 @@ struct RemoteServer {
         JournalWriteSplitMode split_mode;
         bool compress;
         bool seal;
+        bool writer_threads;                   /* append to each output file from a thread of its own */
         bool check_trust;
 };
 extern RemoteServer *journal_remote_server_global;
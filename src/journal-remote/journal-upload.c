@@ -44,6 +44,7 @@ static const char *arg_machine = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static bool arg_compress = false;
 
 static void close_fd_input(Uploader *u);
 
@@ -163,6 +164,93 @@ static int load_cursor_state(Uploader *u) {
         return 0;
 }
 
+#if HAVE_ZSTD
+static size_t compressed_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
+        Uploader *u = userp;
+        ZSTD_outBuffer output = {
+                .dst = buf,
+                .size = size * nmemb,
+        };
+
+        assert(u);
+        assert(u->compress_ctx);
+        assert(nmemb <= SSIZE_MAX / size);
+
+        /* Hands out the data of the actual input callback as one zstd frame, which is finished when
+         * the input callback signals the end of the upload. */
+
+        while (!u->compress_done && output.pos < output.size) {
+                ZSTD_inBuffer input;
+                size_t k;
+
+                if (u->compress_pos >= u->compress_filled && !u->compress_eof) {
+                        size_t n;
+
+                        n = u->input_callback(u->compress_buffer, 1, u->compress_buffer_size, u->input_data);
+                        if (n == CURL_READFUNC_ABORT)
+                                return CURL_READFUNC_ABORT;
+                        assert(n <= u->compress_buffer_size);
+
+                        u->compress_pos = 0;
+                        u->compress_filled = n;
+                        u->compress_eof = n == 0;
+                }
+
+                input = (ZSTD_inBuffer) {
+                        .src = u->compress_buffer,
+                        .size = u->compress_filled,
+                        .pos = u->compress_pos,
+                };
+
+                k = ZSTD_compressStream2(u->compress_ctx, &output, &input,
+                                         u->compress_eof ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(k)) {
+                        log_error("Failed to compress upload data: %s", ZSTD_getErrorName(k));
+                        return CURL_READFUNC_ABORT;
+                }
+
+                u->compress_pos = input.pos;
+                u->compress_done = u->compress_eof && k == 0;
+        }
+
+        return output.pos;
+}
+#endif
+
+static int reset_compression(Uploader *u) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(u);
+
+        if (!u->compress_ctx) {
+                u->compress_ctx = ZSTD_createCCtx();
+                if (!u->compress_ctx)
+                        return log_oom();
+        }
+
+        if (!u->compress_buffer) {
+                u->compress_buffer_size = ZSTD_CStreamInSize();
+                u->compress_buffer = malloc(u->compress_buffer_size);
+                if (!u->compress_buffer)
+                        return log_oom();
+        }
+
+        k = ZSTD_CCtx_reset(u->compress_ctx, ZSTD_reset_session_only);
+        if (ZSTD_isError(k)) {
+                log_error("Failed to reset compression context: %s", ZSTD_getErrorName(k));
+                return -EIO;
+        }
+
+        u->compress_pos = u->compress_filled = 0;
+        u->compress_eof = u->compress_done = false;
+
+        return 0;
+#else
+        return -EOPNOTSUPP;
+#endif
+}
+
 int start_upload(Uploader *u,
                  size_t (*input_callback)(void *ptr,
                                           size_t size,
@@ -170,6 +258,7 @@ int start_upload(Uploader *u,
                                           void *userdata),
                  void *data) {
         CURLcode code;
+        int r;
 
         assert(u);
         assert(input_callback);
@@ -193,9 +282,26 @@ int start_upload(Uploader *u,
                         return log_oom();
                 }
 
+                if (u->compress) {
+                        h = curl_slist_append(h, "Content-Encoding: zstd");
+                        if (!h) {
+                                curl_slist_free_all(h);
+                                return log_oom();
+                        }
+                }
+
                 u->header = h;
         }
 
+        u->input_callback = input_callback;
+        u->input_data = data;
+
+        if (u->compress) {
+                r = reset_compression(u);
+                if (r < 0)
+                        return r;
+        }
+
         if (!u->easy) {
                 CURL *curl;
 
@@ -220,11 +326,23 @@ int start_upload(Uploader *u,
                             LOG_ERR, return -EXFULL);
 
                 /* set where to read from */
-                easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
-                            LOG_ERR, return -EXFULL);
+                if (u->compress) {
+#if HAVE_ZSTD
+                        easy_setopt(curl, CURLOPT_READFUNCTION, compressed_input_callback,
+                                    LOG_ERR, return -EXFULL);
 
-                easy_setopt(curl, CURLOPT_READDATA, data,
-                            LOG_ERR, return -EXFULL);
+                        easy_setopt(curl, CURLOPT_READDATA, u,
+                                    LOG_ERR, return -EXFULL);
+#else
+                        assert_not_reached("compression without zstd support");
+#endif
+                } else {
+                        easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
+                                    LOG_ERR, return -EXFULL);
+
+                        easy_setopt(curl, CURLOPT_READDATA, data,
+                                    LOG_ERR, return -EXFULL);
+                }
 
                 /* use our special own mime type and chunked transfer */
                 easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
@@ -413,6 +531,14 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
         memzero(u, sizeof(Uploader));
         u->input = -1;
 
+#if !HAVE_ZSTD
+        if (arg_compress) {
+                log_error("Compression of uploads requested, but zstd support is not compiled in.");
+                return -EOPNOTSUPP;
+        }
+#endif
+        u->compress = arg_compress;
+
         if (!(host = startswith(url, "http://")) && !(host = startswith(url, "https://"))) {
                 host = url;
                 proto = "https://";
@@ -456,6 +582,11 @@ static void destroy_uploader(Uploader *u) {
         curl_slist_free_all(u->header);
         free(u->answer);
 
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(u->compress_ctx);
+#endif
+        free(u->compress_buffer);
+
         free(u->last_cursor);
         free(u->current_cursor);
 
@@ -519,6 +650,7 @@ static int parse_config(void) {
                 { "Upload",  "ServerKeyFile",          config_parse_path,   0, &arg_key    },
                 { "Upload",  "ServerCertificateFile",  config_parse_path,   0, &arg_cert   },
                 { "Upload",  "TrustedCertificateFile", config_parse_path,   0, &arg_trust  },
+                { "Upload",  "Compress",               config_parse_bool,   0, &arg_compress },
                 {}};
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/journal-upload.conf",
@@ -558,6 +690,7 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --compress[=BOOL]      Compress the uploaded data with zstd (default: no)\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
                , link
@@ -579,6 +712,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_COMPRESS,
         };
 
         static const struct option options[] = {
@@ -598,6 +732,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "compress",     optional_argument, NULL, ARG_COMPRESS       },
                 {}
         };
 
@@ -725,6 +860,20 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_COMPRESS:
+                        if (optarg) {
+                                r = parse_boolean(optarg);
+                                if (r < 0) {
+                                        log_error("Failed to parse --compress= parameter.");
+                                        return -EINVAL;
+                                }
+
+                                arg_compress = !!r;
+                        } else
+                                arg_compress = true;
+
+                        break;
+
                 case '?':
                         log_error("Unknown option %s.", argv[optind-1]);
                         return -EINVAL;
@@ -758,14 +907,15 @@ static int parse_argv(int argc, char *argv[]) {
 static int open_journal(sd_journal **j) {
         int r;
 
+        /* We only ever move forward through the journal */
         if (arg_directory)
-                r = sd_journal_open_directory(j, arg_directory, arg_journal_type);
+                r = sd_journal_open_directory(j, arg_directory, arg_journal_type | SD_JOURNAL_SEQUENTIAL);
         else if (arg_file)
-                r = sd_journal_open_files(j, (const char**) arg_file, 0);
+                r = sd_journal_open_files(j, (const char**) arg_file, SD_JOURNAL_SEQUENTIAL);
         else if (arg_machine)
-                r = sd_journal_open_container(j, arg_machine, 0);
+                r = sd_journal_open_container(j, arg_machine, SD_JOURNAL_SEQUENTIAL);
         else
-                r = sd_journal_open(j, !arg_merge*SD_JOURNAL_LOCAL_ONLY + arg_journal_type);
+                r = sd_journal_open(j, !arg_merge*SD_JOURNAL_LOCAL_ONLY + arg_journal_type + SD_JOURNAL_SEQUENTIAL);
         if (r < 0)
                 log_error_errno(r, "Failed to open %s: %m",
                                 arg_directory ? arg_directory : arg_file ? "files" : "journal");
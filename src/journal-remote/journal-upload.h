@@ -2,6 +2,10 @@
 
 #include <inttypes.h>
 
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "sd-event.h"
 #include "sd-journal.h"
 #include "time-util.h"
@@ -31,6 +35,18 @@ typedef struct Uploader {
         struct curl_slist *header;
         char *answer;
 
+        /* With compression, curl reads from compressed_input_callback(), which pulls uncompressed data
+         * from input_callback into compress_buffer */
+        bool compress;
+        size_t (*input_callback)(void *ptr, size_t size, size_t nmemb, void *userdata);
+        void *input_data;
+#if HAVE_ZSTD
+        ZSTD_CCtx *compress_ctx;
+#endif
+        char *compress_buffer;
+        size_t compress_buffer_size, compress_pos, compress_filled;
+        bool compress_eof, compress_done;
+
         sd_event_source *input_event;
         uint64_t timeout;
 
@@ -15,6 +15,12 @@
 #include <lz4frame.h>
 #endif
 
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
 #include "alloc-util.h"
 #include "compress.h"
 #include "fd-util.h"
@@ -31,11 +37,28 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_compressionContext_t, LZ4F_freeCompressionConte
 DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_decompressionContext_t, LZ4F_freeDecompressionContext);
 #endif
 
+#if HAVE_ZSTD
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_CCtx*, ZSTD_freeCCtx);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_DCtx*, ZSTD_freeDCtx);
+
+static int zstd_ret_to_errno(size_t ret) {
+        switch (ZSTD_getErrorCode(ret)) {
+        case ZSTD_error_dstSize_tooSmall:
+                return -ENOBUFS;
+        case ZSTD_error_memory_allocation:
+                return -ENOMEM;
+        default:
+                return -EBADMSG;
+        }
+}
+#endif
+
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
 
 static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
         [OBJECT_COMPRESSED_XZ] = "XZ",
         [OBJECT_COMPRESSED_LZ4] = "LZ4",
+        [OBJECT_COMPRESSED_ZSTD] = "ZSTD",
 };
 
 DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
@@ -112,6 +135,31 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        /* Returns < 0 if we couldn't compress the data or the
+         * compressed result is longer than the original */
+
+        k = ZSTD_compress(dst, dst_alloc_size, src, src_size, 0);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
 
@@ -212,6 +260,82 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+#if HAVE_ZSTD
+static int zstd_decompress(
+                ZSTD_DCtx *dctx,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max) {
+
+        ZSTD_inBuffer input;
+        ZSTD_outBuffer output;
+        uint64_t size;
+        size_t k;
+
+        assert(dctx);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size);
+        assert(dst_size);
+        assert(*dst_alloc_size == 0 || *dst);
+
+        /* The compressor always records the decompressed size in the frame header, hence we know exactly
+         * how much space we need (or, if dst_max is set, how much we are going to produce at most). */
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        if (dst_max > 0 && size > dst_max)
+                size = dst_max;
+        if (size > SIZE_MAX)
+                return -E2BIG;
+
+        if (!greedy_realloc(dst, dst_alloc_size, MAX(size, 1u), 1))
+                return -ENOMEM;
+
+        input = (ZSTD_inBuffer) {
+                .src = src,
+                .size = src_size,
+        };
+        output = (ZSTD_outBuffer) {
+                .dst = *dst,
+                .size = size,
+        };
+
+        while (output.pos < size) {
+                k = ZSTD_decompressStream(dctx, &output, &input);
+                if (ZSTD_isError(k)) {
+                        log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                        return zstd_ret_to_errno(k);
+                }
+                if (k == 0 || input.pos >= input.size)
+                        break;
+        }
+
+        if (output.pos < size)
+                return -EBADMSG;
+
+        *dst_size = size;
+        return 0;
+}
+#endif
+
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+
+        dctx = ZSTD_createDCtx();
+        if (!dctx)
+                return -ENOMEM;
+
+        return zstd_decompress(dctx, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_blob(int compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
@@ -221,6 +345,9 @@ int decompress_blob(int compression,
         else if (compression == OBJECT_COMPRESSED_LZ4)
                 return decompress_blob_lz4(src, src_size,
                                            dst, dst_alloc_size, dst_size, dst_max);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_blob_zstd(src, src_size,
+                                            dst, dst_alloc_size, dst_size, dst_max);
         else
                 return -EBADMSG;
 }
@@ -333,6 +460,87 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+#if HAVE_ZSTD
+static int zstd_decompress_startswith(
+                ZSTD_DCtx *dctx,
+                const void *src, uint64_t src_size,
+                void **buffer, size_t *buffer_size,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra) {
+
+        ZSTD_inBuffer input;
+        ZSTD_outBuffer output;
+        uint64_t size;
+        size_t k;
+
+        assert(dctx);
+        assert(src);
+        assert(src_size > 0);
+        assert(buffer);
+        assert(buffer_size);
+        assert(prefix);
+        assert(*buffer_size == 0 || *buffer);
+
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        /* Decompressed text too short to match the prefix and extra */
+        if (size < prefix_len + 1)
+                return 0;
+
+        if (!(greedy_realloc(buffer, buffer_size, ALIGN_8(prefix_len + 1), 1)))
+                return -ENOMEM;
+
+        input = (ZSTD_inBuffer) {
+                .src = src,
+                .size = src_size,
+        };
+        output = (ZSTD_outBuffer) {
+                .dst = *buffer,
+                .size = prefix_len + 1,
+        };
+
+        /* Only decompress as much as we need to compare the prefix */
+        while (output.pos < prefix_len + 1) {
+                k = ZSTD_decompressStream(dctx, &output, &input);
+                if (ZSTD_isError(k)) {
+                        log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                        return zstd_ret_to_errno(k);
+                }
+                if (k == 0 || input.pos >= input.size)
+                        break;
+        }
+
+        if (output.pos < prefix_len + 1)
+                return -EBADMSG;
+
+        return memcmp(*buffer, prefix, prefix_len) == 0 &&
+                ((const uint8_t*) *buffer)[prefix_len] == extra;
+}
+#endif
+
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+
+        /* Checks whether the decompressed blob starts with the
+         * mentioned prefix. The byte extra needs to follow the
+         * prefix */
+
+        dctx = ZSTD_createDCtx();
+        if (!dctx)
+                return -ENOMEM;
+
+        return zstd_decompress_startswith(dctx, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_startswith(int compression,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
@@ -348,6 +556,11 @@ int decompress_startswith(int compression,
                                                  buffer, buffer_size,
                                                  prefix, prefix_len,
                                                  extra);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_startswith_zstd(src, src_size,
+                                                  buffer, buffer_size,
+                                                  prefix, prefix_len,
+                                                  extra);
         else
                 return -EBADMSG;
 }
@@ -521,6 +734,89 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
 #endif
 }
 
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeCCtxp) ZSTD_CCtx *cctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize, z;
+        uint64_t total_in = 0, total_out = 0;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        in_allocsize = ZSTD_CStreamInSize();
+        out_allocsize = ZSTD_CStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        cctx = ZSTD_createCCtx();
+        if (!cctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        if (ZSTD_isError(z))
+                log_debug("Failed to enable ZSTD checksum, ignoring: %s", ZSTD_getErrorName(z));
+
+        /* Read a chunk from the input file, compress all of it, and write out everything that was produced,
+         * until we hit EOF, at which point the frame is finished. */
+        for (;;) {
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                };
+                bool last_chunk, finished = false;
+                ssize_t n;
+
+                n = loop_read(fdf, in_buff, in_allocsize, true);
+                if (n < 0)
+                        return (int) n;
+                last_chunk = n == 0;
+
+                input.size = (size_t) n;
+                total_in += n;
+
+                while (!finished) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                        };
+                        size_t remaining;
+                        int k;
+
+                        remaining = ZSTD_compressStream2(cctx, &output, &input,
+                                                         last_chunk ? ZSTD_e_end : ZSTD_e_continue);
+                        if (ZSTD_isError(remaining)) {
+                                log_debug("ZSTD encoder failed: %s", ZSTD_getErrorName(remaining));
+                                return zstd_ret_to_errno(remaining);
+                        }
+
+                        total_out += output.pos;
+                        if (max_bytes != (uint64_t) -1 && total_out > max_bytes) {
+                                log_debug("Compressed stream longer than %"PRIu64" bytes", max_bytes);
+                                return -EFBIG;
+                        }
+
+                        k = loop_write(fdt, output.dst, output.pos, false);
+                        if (k < 0)
+                                return k;
+
+                        /* On the last chunk we are done when zstd tells us the frame is complete, otherwise
+                         * as soon as all input is consumed. */
+                        finished = last_chunk ? remaining == 0 : input.pos == input.size;
+                }
+
+                if (last_chunk)
+                        break;
+        }
+
+        log_debug("ZSTD compression finished (%"PRIu64" -> %"PRIu64" bytes, %.1f%%)",
+                  total_in, total_out,
+                  total_in > 0 ? (double) total_out / total_in * 100 : 0.0);
+
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 
 #if HAVE_XZ
@@ -657,12 +953,282 @@ int decompress_stream_lz4(int in, int out, uint64_t max_bytes) {
 #endif
 }
 
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize, last_result = 0;
+        uint64_t total_in = 0, total_out = 0;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        in_allocsize = ZSTD_DStreamInSize();
+        out_allocsize = ZSTD_DStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        dctx = ZSTD_createDCtx();
+        if (!dctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        /* The input may consist of multiple concatenated frames. ZSTD_decompressStream() returns 0 exactly
+         * when a frame is complete, and resets itself for the next one. */
+        for (;;) {
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                };
+                ssize_t n;
+
+                n = loop_read(fdf, in_buff, in_allocsize, true);
+                if (n < 0)
+                        return (int) n;
+                if (n == 0)
+                        break;
+
+                input.size = (size_t) n;
+                total_in += n;
+
+                while (input.pos < input.size) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                        };
+                        int k;
+
+                        last_result = ZSTD_decompressStream(dctx, &output, &input);
+                        if (ZSTD_isError(last_result)) {
+                                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(last_result));
+                                return zstd_ret_to_errno(last_result);
+                        }
+
+                        total_out += output.pos;
+                        if (max_bytes != (uint64_t) -1 && total_out > max_bytes) {
+                                log_debug("Decompressed stream longer than %"PRIu64" bytes", max_bytes);
+                                return -EFBIG;
+                        }
+
+                        k = loop_write(fdt, output.dst, output.pos, false);
+                        if (k < 0)
+                                return k;
+                }
+        }
+
+        if (total_in == 0) {
+                log_debug("ZSTD decoder failed: no data read");
+                return -EBADMSG;
+        }
+
+        if (last_result != 0) {
+                /* The last frame is incomplete, the input was likely truncated */
+                log_debug("ZSTD decoder failed: truncated input");
+                return -EBADMSG;
+        }
+
+        log_debug("ZSTD decompression finished (%"PRIu64" -> %"PRIu64" bytes, %.1f%%)",
+                  total_in, total_out,
+                  (double) total_out / total_in * 100);
+
+        return 0;
+#else
+        log_debug("Cannot decompress file. Compiled without ZSTD support.");
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+struct CompressDictionary {
+#if HAVE_ZSTD
+        ZSTD_CDict *cdict;
+        ZSTD_DDict *ddict;
+        ZSTD_CCtx *cctx;
+        ZSTD_DCtx *dctx;
+#endif
+        unsigned id;
+};
+
+int compress_dictionary_new(const void *data, size_t size, CompressDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+
+        assert(data);
+        assert(ret);
+
+        /* Only accept proper zstd dictionaries, otherwise zstd would silently treat the data as raw
+         * content prefix, with a dictionary ID of 0. */
+        if (ZDICT_getDictID(data, size) == 0)
+                return -EBADMSG;
+
+        d = new0(CompressDictionary, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->id = ZDICT_getDictID(data, size);
+
+        d->cdict = ZSTD_createCDict(data, size, 0);
+        d->ddict = ZSTD_createDDict(data, size);
+        d->cctx = ZSTD_createCCtx();
+        d->dctx = ZSTD_createDCtx();
+        if (!d->cdict || !d->ddict || !d->cctx || !d->dctx)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+CompressDictionary *compress_dictionary_free(CompressDictionary *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeDDict(d->ddict);
+        ZSTD_freeCCtx(d->cctx);
+        ZSTD_freeDCtx(d->dctx);
+#endif
+
+        return mfree(d);
+}
+
+unsigned compress_dictionary_id(const CompressDictionary *d) {
+        assert(d);
+
+        return d->id;
+}
+
+int compress_dictionary_train(
+                const void *samples, const size_t *sample_sizes, unsigned n_samples,
+                size_t max_size,
+                void **ret, size_t *ret_size) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buf = NULL;
+        size_t k;
+
+        assert(samples);
+        assert(sample_sizes);
+        assert(max_size > 0);
+        assert(ret);
+        assert(ret_size);
+
+        /* Trains a dictionary of at most max_size bytes from the concatenated samples. Training needs a
+         * decent amount of input to produce anything useful, and will fail otherwise. */
+
+        buf = malloc(max_size);
+        if (!buf)
+                return -ENOMEM;
+
+        k = ZDICT_trainFromBuffer(buf, max_size, samples, sample_sizes, n_samples);
+        if (ZDICT_isError(k)) {
+                log_debug("Failed to train ZSTD dictionary from %u samples: %s", n_samples, ZDICT_getErrorName(k));
+                return -ENODATA;
+        }
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_dictionary(CompressDictionary *d,
+                             const void *src, uint64_t src_size,
+                             void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(d);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        /* Like compress_blob(), returns the compression type used on success */
+
+        k = ZSTD_compress_usingCDict(d->cctx, dst, dst_alloc_size, src, src_size, d->cdict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return OBJECT_COMPRESSED_ZSTD;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+#if HAVE_ZSTD
+static int zstd_frame_uses_dictionary(CompressDictionary *d, const void *src, uint64_t src_size) {
+        unsigned id;
+
+        /* Frames compressed without a dictionary carry no dictionary ID, and must be decoded without
+         * one, too. Frames compressed with a different dictionary can't be decoded at all. */
+
+        id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (id == 0)
+                return false;
+        if (id != d->id)
+                return -EBADMSG;
+
+        /* The context is reused, and might have been left in the middle of a frame by a partial
+         * decompression, hence reset it first. */
+        if (ZSTD_isError(ZSTD_DCtx_reset(d->dctx, ZSTD_reset_session_only)) ||
+            ZSTD_isError(ZSTD_DCtx_refDDict(d->dctx, d->ddict)))
+                return -ENOMEM;
+
+        return true;
+}
+#endif
+
+int decompress_blob_dictionary(CompressDictionary *d,
+                               int compression,
+                               const void *src, uint64_t src_size,
+                               void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+#if HAVE_ZSTD
+        int r;
+
+        if (d && compression == OBJECT_COMPRESSED_ZSTD) {
+                r = zstd_frame_uses_dictionary(d, src, src_size);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        return zstd_decompress(d->dctx, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+        }
+#endif
+
+        return decompress_blob(compression, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int decompress_startswith_dictionary(CompressDictionary *d,
+                                     int compression,
+                                     const void *src, uint64_t src_size,
+                                     void **buffer, size_t *buffer_size,
+                                     const void *prefix, size_t prefix_len,
+                                     uint8_t extra) {
+#if HAVE_ZSTD
+        int r;
+
+        if (d && compression == OBJECT_COMPRESSED_ZSTD) {
+                r = zstd_frame_uses_dictionary(d, src, src_size);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        return zstd_decompress_startswith(d->dctx, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+        }
+#endif
+
+        return decompress_startswith(compression, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes) {
 
         if (endswith(filename, ".lz4"))
                 return decompress_stream_lz4(fdf, fdt, max_bytes);
         else if (endswith(filename, ".xz"))
                 return decompress_stream_xz(fdf, fdt, max_bytes);
+        else if (endswith(filename, ".zst"))
+                return decompress_stream_zstd(fdf, fdt, max_bytes);
         else
                 return -EPROTONOSUPPORT;
 }
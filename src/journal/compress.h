@@ -4,6 +4,7 @@
 #include <unistd.h>
 
 #include "journal-def.h"
+#include "macro.h"
 
 const char* object_compressed_to_string(int compression);
 int object_compressed_from_string(const char *compression);
@@ -12,11 +13,17 @@ int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_lz4(const void *src, uint64_t src_size,
                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size);
 
 static inline int compress_blob(const void *src, uint64_t src_size,
                                 void *dst, size_t dst_alloc_size, size_t *dst_size) {
         int r;
-#if HAVE_LZ4
+#if HAVE_ZSTD
+        r = compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
+        if (r == 0)
+                return OBJECT_COMPRESSED_ZSTD;
+#elif HAVE_LZ4
         r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
         if (r == 0)
                 return OBJECT_COMPRESSED_LZ4;
@@ -32,6 +39,8 @@ int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob(int compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
@@ -44,6 +53,10 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
                               void **buffer, size_t *buffer_size,
                               const void *prefix, size_t prefix_len,
                               uint8_t extra);
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra);
 int decompress_startswith(int compression,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
@@ -52,11 +65,16 @@ int decompress_startswith(int compression,
 
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes);
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes);
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes);
 
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_size);
 int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_LZ4
+#if HAVE_ZSTD
+#  define compress_stream compress_stream_zstd
+#  define COMPRESSED_EXT ".zst"
+#elif HAVE_LZ4
 #  define compress_stream compress_stream_lz4
 #  define COMPRESSED_EXT ".lz4"
 #else
@@ -65,3 +83,29 @@ int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
 #endif
 
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes);
+
+/* Pre-trained dictionaries, for compressing small blobs that share a lot of content. Only zstd supports them. */
+typedef struct CompressDictionary CompressDictionary;
+
+int compress_dictionary_new(const void *data, size_t size, CompressDictionary **ret);
+CompressDictionary *compress_dictionary_free(CompressDictionary *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressDictionary*, compress_dictionary_free);
+unsigned compress_dictionary_id(const CompressDictionary *d);
+
+int compress_dictionary_train(const void *samples, const size_t *sample_sizes, unsigned n_samples,
+                              size_t max_size,
+                              void **ret, size_t *ret_size);
+
+int compress_blob_dictionary(CompressDictionary *d,
+                             const void *src, uint64_t src_size,
+                             void *dst, size_t dst_alloc_size, size_t *dst_size);
+int decompress_blob_dictionary(CompressDictionary *d,
+                               int compression,
+                               const void *src, uint64_t src_size,
+                               void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_startswith_dictionary(CompressDictionary *d,
+                                     int compression,
+                                     const void *src, uint64_t src_size,
+                                     void **buffer, size_t *buffer_size,
+                                     const void *prefix, size_t prefix_len,
+                                     uint8_t extra);
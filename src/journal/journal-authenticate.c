@@ -266,6 +266,17 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                 gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
                 gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
+
+        case OBJECT_DICTIONARY:
+                /* All */
+                gcry_md_write(f->hmac, o->dictionary.payload, le64toh(o->object.size) - offsetof(DictionaryObject, payload));
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                /* All */
+                gcry_md_write(f->hmac, &o->bloom_filter.n_hashes, sizeof(o->bloom_filter.n_hashes));
+                gcry_md_write(f->hmac, o->bloom_filter.bits, le64toh(o->object.size) - offsetof(BloomFilterObject, bits));
+                break;
         default:
                 return -EINVAL;
         }
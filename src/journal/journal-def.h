@@ -23,6 +23,8 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct DictionaryObject DictionaryObject;
+typedef struct BloomFilterObject BloomFilterObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
@@ -39,6 +41,8 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_DICTIONARY,
+        OBJECT_BLOOM_FILTER,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -46,10 +50,11 @@ typedef enum ObjectType {
 enum {
         OBJECT_COMPRESSED_XZ = 1 << 0,
         OBJECT_COMPRESSED_LZ4 = 1 << 1,
+        OBJECT_COMPRESSED_ZSTD = 1 << 2,
         _OBJECT_COMPRESSED_MAX
 };
 
-#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4)
+#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD)
 
 struct ObjectHeader {
         uint8_t type;
@@ -106,7 +111,10 @@ struct HashTableObject {
 struct EntryArrayObject {
         ObjectHeader object;
         le64_t next_entry_array_offset;
-        le64_t items[];
+        union {
+                le64_t regular[0];
+                le32_t compact[0]; /* in files with HEADER_INCOMPATIBLE_COMPACT */
+        } items;
 } _packed_;
 
 #define TAG_LENGTH (256/8)
@@ -118,6 +126,20 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+/* A zstd dictionary, used for compressing DATA objects of this file. */
+struct DictionaryObject {
+        ObjectHeader object;
+        uint8_t payload[];
+} _packed_;
+
+/* A Bloom filter covering the hashes of all DATA objects of this file, so that lookups for data that is not
+ * in the file can be answered without going through the data hash table. */
+struct BloomFilterObject {
+        ObjectHeader object;
+        le64_t n_hashes;
+        uint8_t bits[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -126,6 +148,8 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        DictionaryObject dictionary;
+        BloomFilterObject bloom_filter;
 };
 
 enum {
@@ -139,29 +163,38 @@ enum {
 enum {
         HEADER_INCOMPATIBLE_COMPRESSED_XZ = 1 << 0,
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1,
+        HEADER_INCOMPATIBLE_KEYED_HASH = 1 << 2, /* siphash24 keyed by the file ID instead of jenkins hash64 */
+        HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
+        HEADER_INCOMPATIBLE_ZSTD_DICTIONARY = 1 << 4,
+        HEADER_INCOMPATIBLE_COMPACT = 1 << 5, /* 32bit entry array items, file size limited to 4G */
 };
 
-#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
-
-#if HAVE_XZ && HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
-#elif HAVE_XZ
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_XZ
-#elif HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_LZ4
-#else
-#  define HEADER_INCOMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_INCOMPATIBLE_ANY                \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |   \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |  \
+         HEADER_INCOMPATIBLE_KEYED_HASH |      \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD | \
+         HEADER_INCOMPATIBLE_ZSTD_DICTIONARY | \
+         HEADER_INCOMPATIBLE_COMPACT)
+
+#define HEADER_INCOMPATIBLE_SUPPORTED                                   \
+        ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |            \
+         (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |          \
+         HEADER_INCOMPATIBLE_KEYED_HASH |                               \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |        \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_ZSTD_DICTIONARY : 0) |        \
+         HEADER_INCOMPATIBLE_COMPACT)
 
 enum {
-        HEADER_COMPATIBLE_SEALED = 1
+        HEADER_COMPATIBLE_SEALED = 1 << 0,
+        HEADER_COMPATIBLE_BLOOM_FILTER = 1 << 1,
 };
 
-#define HEADER_COMPATIBLE_ANY HEADER_COMPATIBLE_SEALED
+#define HEADER_COMPATIBLE_ANY (HEADER_COMPATIBLE_SEALED | HEADER_COMPATIBLE_BLOOM_FILTER)
 #if HAVE_GCRYPT
-#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_SEALED
+#  define HEADER_COMPATIBLE_SUPPORTED (HEADER_COMPATIBLE_SEALED | HEADER_COMPATIBLE_BLOOM_FILTER)
 #else
-#  define HEADER_COMPATIBLE_SUPPORTED 0
+#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_BLOOM_FILTER
 #endif
 
 #define HEADER_SIGNATURE ((char[]) { 'L', 'P', 'K', 'S', 'H', 'H', 'R', 'H' })
@@ -197,8 +230,11 @@ struct Header {
         /* Added in 189 */
         le64_t n_tags;
         le64_t n_entry_arrays;
+        /* Added in 240 */
+        le64_t dictionary_offset;
+        le64_t bloom_filter_offset;
 
-        /* Size: 240 */
+        /* Size: 256 */
 } _packed_;
 
 #define FSS_HEADER_SIGNATURE ((char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
@@ -14,6 +14,7 @@
 #include "btrfs-util.h"
 #include "chattr-util.h"
 #include "compress.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "journal-authenticate.h"
@@ -67,8 +68,38 @@
 /* How many entries to keep in the entry array chain cache at max */
 #define CHAIN_CACHE_MAX 20
 
-/* How much to increase the journal file size at once each time we allocate something new. */
+/* How many entry array chains to keep an index of the arrays for at max, and how long a chain needs to be for
+ * that to be worth it */
+#define ENTRY_ARRAY_INDEX_MAX 20
+#define ENTRY_ARRAY_INDEX_MIN_ARRAYS 4
+
+/* How many recently used data objects to remember the location of at max */
+#define DATA_CACHE_MAX 128
+
+/* Data objects shorter than this are not worth compressing, even with a dictionary */
+#define DICTIONARY_COMPRESS_THRESHOLD (32ULL)
+
+/* Bounds for training a compression dictionary from the data objects of another file */
+#define DICTIONARY_SIZE_MAX (16ULL*1024ULL)                     /* 16 KiB */
+#define DICTIONARY_SAMPLES_SIZE_MAX (1024ULL*1024ULL)           /* 1 MiB */
+#define DICTIONARY_SAMPLE_SIZE_MAX (4096ULL)
+#define DICTIONARY_SAMPLES_MIN 64U
+#define DICTIONARY_OBJECTS_MAX 65536U
+
+/* Bloom filter parameters: 10 bits per data object and 7 hash functions make for a false positive rate of
+ * about 1% */
+#define BLOOM_FILTER_BITS_PER_ITEM 10ULL
+#define BLOOM_FILTER_N_HASHES 7ULL
+#define BLOOM_FILTER_N_HASHES_MAX 32ULL
+#define BLOOM_FILTER_SIZE_MAX (4ULL*1024ULL*1024ULL)            /* 4 MiB */
+
+/* How much to increase the journal file size at once each time we allocate something new. Files that fill up
+ * quickly are grown by larger steps, up to the maximum. */
 #define FILE_SIZE_INCREASE (8ULL*1024ULL*1024ULL)              /* 8MB */
+#define FILE_SIZE_INCREASE_MAX (128ULL*1024ULL*1024ULL)        /* 128MB */
+
+/* Growing again within this time counts as fast, not growing for six times as long as slow */
+#define FILE_GROW_FAST_USEC (10*USEC_PER_SEC)
 
 /* Reread fstat() of the file for detecting deletions at least this often */
 #define LAST_STAT_REFRESH_USEC (5*USEC_PER_SEC)
@@ -80,6 +111,10 @@
 #  pragma GCC diagnostic ignored "-Waddress-of-packed-member"
 #endif
 
+static int journal_file_build_bloom_filter(JournalFile *f);
+static int pread_object(int fd, uint64_t p, void *buf, size_t size);
+static DictionaryJob *dictionary_job_free(DictionaryJob *j);
+
 /* This may be called from a separate thread to prevent blocking the caller for the duration of fsync().
  * As a result we use atomic operations on f->offline_state for inter-thread communications with
  * journal_file_set_offline() and journal_file_set_online(). */
@@ -106,6 +141,17 @@ static void journal_file_set_offline_internal(JournalFile *f) {
                         break;
 
                 case OFFLINE_SYNCING:
+                        /* Archived files are never written to again, hence that's the time to add the Bloom
+                         * filter. Sealed files get it from journal_file_close() instead, as it has to be
+                         * covered by the final tag. */
+                        if (f->archive && !f->seal) {
+                                int r;
+
+                                r = journal_file_build_bloom_filter(f);
+                                if (r < 0 && r != -EBUSY)
+                                        log_debug_errno(r, "Failed to add Bloom filter to %s, ignoring: %m", f->path);
+                        }
+
                         (void) fsync(f->fd);
 
                         if (!__sync_bool_compare_and_swap(&f->offline_state, OFFLINE_SYNCING, OFFLINE_OFFLINING))
@@ -334,6 +380,41 @@ bool journal_file_is_offlining(JournalFile *f) {
         return true;
 }
 
+/* The entries of a file or data object are referenced from a chain of entry arrays, each twice the size of the
+ * previous one. To find an entry, generic_array_bisect() used to walk that chain from the start, looking at the last
+ * entry of each array, until the right array was found, which touches a cold page or two for every array in large
+ * files. Hence, we remember the location of all arrays of a chain in a flat array the first time we walk it, so
+ * that the right array can be found by bisecting over that instead. Since existing arrays never change, the index
+ * only ever needs to be extended at the end, when more arrays were appended to the chain. */
+typedef struct EntryArrayIndexItem {
+        uint64_t offset;  /* the entry array object */
+        uint64_t total;   /* the total number of items in all arrays before this one in the chain */
+        uint64_t n_items; /* the number of items this array can hold */
+} EntryArrayIndexItem;
+
+typedef struct EntryArrayIndex {
+        uint64_t first;
+        EntryArrayIndexItem *items;
+        size_t n_items, n_allocated;
+} EntryArrayIndex;
+
+static EntryArrayIndex *entry_array_index_free(EntryArrayIndex *x) {
+        if (!x)
+                return NULL;
+
+        free(x->items);
+        return mfree(x);
+}
+
+static void entry_array_indexes_free(OrderedHashmap *h) {
+        EntryArrayIndex *x;
+
+        while ((x = ordered_hashmap_steal_first(h)))
+                entry_array_index_free(x);
+
+        ordered_hashmap_free(h);
+}
+
 JournalFile* journal_file_close(JournalFile *f) {
         assert(f);
 
@@ -342,6 +423,12 @@ JournalFile* journal_file_close(JournalFile *f) {
         if (f->seal && f->writable) {
                 int r;
 
+                if (f->archive) {
+                        r = journal_file_append_bloom_filter(f);
+                        if (r < 0 && r != -EBUSY)
+                                log_debug_errno(r, "Failed to add Bloom filter to %s, ignoring: %m", f->path);
+                }
+
                 r = journal_file_append_tag(f);
                 if (r < 0)
                         log_error_errno(r, "Failed to append tag when closing journal: %m");
@@ -361,6 +448,9 @@ JournalFile* journal_file_close(JournalFile *f) {
 
         journal_file_set_offline(f, true);
 
+        if (f->released)
+                free(f->header);
+
         if (f->mmap && f->cache_fd)
                 mmap_cache_free_fd(f->mmap, f->cache_fd);
 
@@ -383,10 +473,14 @@ JournalFile* journal_file_close(JournalFile *f) {
         mmap_cache_unref(f->mmap);
 
         ordered_hashmap_free_free(f->chain_cache);
+        entry_array_indexes_free(f->entry_array_indexes);
+        ordered_hashmap_free_free(f->data_cache);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         free(f->compress_buffer);
 #endif
+        compress_dictionary_free(f->compress_dictionary);
+        dictionary_job_free(f->dictionary_job);
 
 #if HAVE_GCRYPT
         if (f->fss_file)
@@ -415,7 +509,10 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
 
         h.incompatible_flags |= htole32(
                 f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ |
-                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
+                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
+                f->compress_zstd * HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |
+                (getenv_bool("SYSTEMD_JOURNAL_COMPACT") > 0) * HEADER_INCOMPATIBLE_COMPACT |
+                (getenv_bool("SYSTEMD_JOURNAL_KEYED_HASH") > 0) * HEADER_INCOMPATIBLE_KEYED_HASH);
 
         h.compatible_flags = htole32(
                 f->seal * HEADER_COMPATIBLE_SEALED);
@@ -485,7 +582,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[3];
+                        const char* strv[6];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -495,6 +592,12 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                 strv[n++] = "xz-compressed";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
                                 strv[n++] = "lz4-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+                                strv[n++] = "zstd-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY))
+                                strv[n++] = "zstd-dictionary";
+                        if (compatible && (flags & HEADER_COMPATIBLE_BLOOM_FILTER))
+                                strv[n++] = "bloom-filter";
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
 
@@ -538,6 +641,12 @@ static int journal_file_verify_header(JournalFile *f) {
         if (JOURNAL_HEADER_SEALED(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 return -EBADMSG;
 
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset))
+                return -EBADMSG;
+
+        if (JOURNAL_HEADER_BLOOM_FILTER(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                return -EBADMSG;
+
         arena_size = le64toh(f->header->arena_size);
 
         if (UINT64_MAX - header_size < arena_size || header_size + arena_size > (uint64_t) f->last_stat.st_size)
@@ -568,6 +677,8 @@ static int journal_file_verify_header(JournalFile *f) {
 
                 if (state == STATE_ARCHIVED)
                         return -ESHUTDOWN; /* Already archived */
+                else if (JOURNAL_HEADER_BLOOM_FILTER(f->header))
+                        return -ESHUTDOWN; /* The Bloom filter is only added when archiving, and can't be updated */
                 else if (state == STATE_ONLINE) {
                         log_debug("Journal file %s is already online. Assuming unclean closing.", f->path);
                         return -EBUSY;
@@ -590,6 +701,7 @@ static int journal_file_verify_header(JournalFile *f) {
 
         f->compress_xz = JOURNAL_HEADER_COMPRESSED_XZ(f->header);
         f->compress_lz4 = JOURNAL_HEADER_COMPRESSED_LZ4(f->header);
+        f->compress_zstd = JOURNAL_HEADER_COMPRESSED_ZSTD(f->header);
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
 
@@ -619,8 +731,35 @@ static int journal_file_fstat(JournalFile *f) {
         return 0;
 }
 
+static uint64_t journal_file_grow_size(JournalFile *f, usec_t n) {
+        uint64_t s;
+
+        assert(f);
+
+        /* On a dedicated log volume, we might as well allocate the whole file right away, which gives the file
+         * system the best chance to lay it out contiguously */
+        if (f->preallocate && f->metrics.max_size > 0)
+                return f->metrics.max_size;
+
+        if (f->grow_size == 0)
+                s = FILE_SIZE_INCREASE;
+        else if (n < usec_add(f->last_grow_usec, FILE_GROW_FAST_USEC))
+                s = MIN(f->grow_size * 2, FILE_SIZE_INCREASE_MAX);
+        else if (n > usec_add(f->last_grow_usec, 6 * FILE_GROW_FAST_USEC))
+                s = MAX(f->grow_size / 2, FILE_SIZE_INCREASE);
+        else
+                s = f->grow_size;
+
+        /* Don't grab more than a quarter of the maximum file size at once */
+        if (f->metrics.max_size > 0)
+                s = MAX(MIN(s, PAGE_ALIGN_DOWN(f->metrics.max_size / 4)), FILE_SIZE_INCREASE);
+
+        return s;
+}
+
 static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size) {
-        uint64_t old_size, new_size;
+        uint64_t old_size, new_size, need, available = UINT64_MAX, grow;
+        usec_t n;
         int r;
 
         assert(f);
@@ -660,12 +799,14 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
         if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
                 return -E2BIG;
 
+        /* Compact files store 32bit offsets in entry arrays, hence can't grow beyond 4G */
+        if (JOURNAL_HEADER_COMPACT(f->header) && new_size > UINT32_MAX)
+                return -E2BIG;
+
         if (new_size > f->metrics.min_size && f->metrics.keep_free > 0) {
                 struct statvfs svfs;
 
                 if (fstatvfs(f->fd, &svfs) >= 0) {
-                        uint64_t available;
-
                         available = LESS_BY((uint64_t) svfs.f_bfree * (uint64_t) svfs.f_bsize, f->metrics.keep_free);
 
                         if (new_size - old_size > available)
@@ -673,10 +814,21 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
                 }
         }
 
-        /* Increase by larger blocks at once */
-        new_size = DIV_ROUND_UP(new_size, FILE_SIZE_INCREASE) * FILE_SIZE_INCREASE;
+        /* Increase by larger blocks at once, and by even larger ones if the file fills up quickly, so that we
+         * need fewer allocations, and the file ends up less fragmented */
+        n = now(CLOCK_MONOTONIC);
+        grow = journal_file_grow_size(f, n);
+
+        need = new_size;
+        new_size = DIV_ROUND_UP(new_size, grow) * grow;
         if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
                 new_size = f->metrics.max_size;
+        if (JOURNAL_HEADER_COMPACT(f->header) && new_size > UINT32_MAX)
+                new_size = PAGE_ALIGN_DOWN((uint64_t) UINT32_MAX);
+
+        /* But don't eat into the space we shall keep free just because of the rounding */
+        if (new_size - old_size > available)
+                new_size = MAX(need, PAGE_ALIGN_DOWN(old_size + available));
 
         /* Note that the glibc fallocate() fallback is very
            inefficient, hence we try to minimize the allocation area
@@ -685,6 +837,9 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
         if (r != 0)
                 return -r;
 
+        f->grow_size = grow;
+        f->last_grow_usec = n;
+
         f->header->arena_size = htole64(new_size - le64toh(f->header->header_size));
 
         return journal_file_fstat(f);
@@ -732,6 +887,8 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
                 [OBJECT_TAG] = sizeof(TagObject),
+                [OBJECT_DICTIONARY] = sizeof(DictionaryObject),
+                [OBJECT_BLOOM_FILTER] = sizeof(BloomFilterObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -861,8 +1018,8 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                 break;
 
         case OBJECT_ENTRY_ARRAY:
-                if ((le64toh(o->object.size) - offsetof(EntryArrayObject, items)) % sizeof(le64_t) != 0 ||
-                    (le64toh(o->object.size) - offsetof(EntryArrayObject, items)) / sizeof(le64_t) <= 0) {
+                if ((le64toh(o->object.size) - offsetof(EntryArrayObject, items)) % journal_file_entry_array_item_size(f) != 0 ||
+                    (le64toh(o->object.size) - offsetof(EntryArrayObject, items)) / journal_file_entry_array_item_size(f) <= 0) {
                         log_debug(
                               "Invalid object entry array size: %"PRIu64": %"PRIu64,
                               le64toh(o->object.size),
@@ -897,6 +1054,39 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(DictionaryObject, payload)) {
+                        log_debug(
+                              "Bad object size (<= %zu): %"PRIu64": %"PRIu64,
+                              offsetof(DictionaryObject, payload),
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                if (le64toh(o->object.size) <= offsetof(BloomFilterObject, bits)) {
+                        log_debug(
+                              "Bad object size (<= %zu): %"PRIu64": %"PRIu64,
+                              offsetof(BloomFilterObject, bits),
+                              le64toh(o->object.size),
+                              offset);
+                        return -EBADMSG;
+                }
+
+                if (le64toh(o->bloom_filter.n_hashes) <= 0 ||
+                    le64toh(o->bloom_filter.n_hashes) > BLOOM_FILTER_N_HASHES_MAX) {
+                        log_debug(
+                              "Invalid number of Bloom filter hashes: %"PRIu64": %"PRIu64,
+                              le64toh(o->bloom_filter.n_hashes),
+                              offset);
+                        return -EBADMSG;
+                }
+
                 break;
         }
 
@@ -972,6 +1162,88 @@ int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset
         return 0;
 }
 
+static int journal_file_get_dictionary(JournalFile *f, CompressDictionary **ret) {
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        /* Returns the compression dictionary of the file, loading it on first use. Returns 0 and NULL if
+         * the file has none. */
+
+        if (f->compress_dictionary) {
+                *ret = f->compress_dictionary;
+                return 1;
+        }
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        p = le64toh(f->header->dictionary_offset);
+        if (p == 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to_object(f, OBJECT_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        r = compress_dictionary_new(o->dictionary.payload,
+                                    le64toh(o->object.size) - offsetof(Object, dictionary.payload),
+                                    &f->compress_dictionary);
+        if (r < 0)
+                return r;
+
+        *ret = f->compress_dictionary;
+        return 1;
+}
+
+int journal_file_decompress_blob(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max) {
+
+        CompressDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        if (compression == OBJECT_COMPRESSED_ZSTD) {
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_blob_dictionary(d, compression, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int journal_file_decompress_startswith(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **buffer, size_t *buffer_size,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra) {
+
+        CompressDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        if (compression == OBJECT_COMPRESSED_ZSTD) {
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_startswith_dictionary(d, compression, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
 static uint64_t journal_file_entry_seqnum(JournalFile *f, uint64_t *seqnum) {
         uint64_t r;
 
@@ -1324,13 +1596,93 @@ int journal_file_find_field_object(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         return journal_file_find_field_object_with_hash(f,
                                                         field, size, hash,
                                                         ret, offset);
 }
 
+typedef struct DataCacheItem {
+        uint64_t hash;   /* the hash of the payload, also the key in the cache */
+        uint64_t size;   /* the uncompressed payload size */
+        uint64_t offset; /* the location of the data object */
+} DataCacheItem;
+
+static void data_cache_put(JournalFile *f, uint64_t hash, uint64_t size, uint64_t offset) {
+        DataCacheItem *ci;
+
+        assert(f);
+
+        /* Remembers where the (uncompressed) data object with the specified hash is located. The least recently
+         * used item is evicted if the cache is full. Failing to allocate is not fatal, the cache is just an
+         * optimization after all. */
+
+        ci = ordered_hashmap_remove(f->data_cache, &hash);
+        if (!ci) {
+                if (ordered_hashmap_ensure_allocated(&f->data_cache, &uint64_hash_ops) < 0)
+                        return;
+
+                if (ordered_hashmap_size(f->data_cache) >= DATA_CACHE_MAX) {
+                        ci = ordered_hashmap_steal_first(f->data_cache);
+                        assert(ci);
+                } else {
+                        ci = new(DataCacheItem, 1);
+                        if (!ci)
+                                return;
+                }
+        }
+
+        ci->hash = hash;
+        ci->size = size;
+        ci->offset = offset;
+
+        if (ordered_hashmap_put(f->data_cache, &ci->hash, ci) < 0)
+                free(ci);
+}
+
+static int data_cache_find(
+                JournalFile *f,
+                const void *data, uint64_t size, uint64_t hash,
+                Object **ret, uint64_t *offset) {
+
+        DataCacheItem *ci;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        ci = ordered_hashmap_get(f->data_cache, &hash);
+        if (!ci || ci->size != size)
+                return 0;
+
+        p = ci->offset;
+
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        /* Only uncompressed objects are cached, but let's verify the payload anyway, so that a hash collision
+         * never makes us return the wrong object. */
+        if (le64toh(o->data.hash) != hash ||
+            (o->object.flags & OBJECT_COMPRESSION_MASK) ||
+            le64toh(o->object.size) != offsetof(Object, data.payload) + size ||
+            memcmp(o->data.payload, data, size) != 0)
+                return 0;
+
+        /* Move the item to the end, so that it is evicted last */
+        data_cache_put(f, hash, size, p);
+
+        if (ret)
+                *ret = o;
+
+        if (offset)
+                *offset = p;
+
+        return 1;
+}
+
 int journal_file_find_data_object_with_hash(
                 JournalFile *f,
                 const void *data, uint64_t size, uint64_t hash,
@@ -1347,6 +1699,15 @@ int journal_file_find_data_object_with_hash(
         if (le64toh(f->header->data_hash_table_size) <= 0)
                 return 0;
 
+        r = data_cache_find(f, data, size, hash, ret, offset);
+        if (r != 0)
+                return r;
+
+        /* If the Bloom filter says the data is not in the file, we can skip the hash table lookup. */
+        r = journal_file_bloom_filter_check(f, hash);
+        if (r <= 0)
+                return r;
+
         /* Map the data hash table, if it isn't mapped yet. */
         r = journal_file_map_data_hash_table(f);
         if (r < 0)
@@ -1372,7 +1733,7 @@ int journal_file_find_data_object_with_hash(
                         goto next;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
                         uint64_t l;
                         size_t rsize = 0;
 
@@ -1382,8 +1743,8 @@ int journal_file_find_data_object_with_hash(
 
                         l -= offsetof(Object, data.payload);
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
+                        r = journal_file_decompress_blob(f, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
@@ -1404,6 +1765,8 @@ int journal_file_find_data_object_with_hash(
                 } else if (le64toh(o->object.size) == osize &&
                            memcmp(o->data.payload, data, size) == 0) {
 
+                        data_cache_put(f, hash, size, p);
+
                         if (ret)
                                 *ret = o;
 
@@ -1430,7 +1793,7 @@ int journal_file_find_data_object(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = journal_file_hash_data(f, data, size);
 
         return journal_file_find_data_object_with_hash(f,
                                                        data, size, hash,
@@ -1450,7 +1813,7 @@ static int journal_file_append_field(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         r = journal_file_find_field_object_with_hash(f, field, size, hash, &o, &p);
         if (r < 0)
@@ -1504,6 +1867,9 @@ static int journal_file_append_data(
                 const void *data, uint64_t size,
                 Object **ret, uint64_t *offset) {
 
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
+        CompressDictionary *d = NULL;
+#endif
         uint64_t hash, p;
         uint64_t osize;
         Object *o;
@@ -1513,7 +1879,7 @@ static int journal_file_append_data(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = journal_file_hash_data(f, data, size);
 
         r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
         if (r < 0)
@@ -1536,11 +1902,21 @@ static int journal_file_append_data(
 
         o->data.hash = htole64(hash);
 
-#if HAVE_XZ || HAVE_LZ4
-        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
+        if (JOURNAL_FILE_COMPRESS(f)) {
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        if (JOURNAL_FILE_COMPRESS(f) &&
+            size >= (d ? MIN(f->compress_threshold_bytes, DICTIONARY_COMPRESS_THRESHOLD) : f->compress_threshold_bytes)) {
                 size_t rsize = 0;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+                if (d)
+                        compression = compress_blob_dictionary(d, data, size, o->data.payload, size - 1, &rsize);
+                else
+                        compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
 
                 if (compression >= 0) {
                         o->object.size = htole64(offsetof(Object, data.payload) + rsize);
@@ -1557,47 +1933,602 @@ static int journal_file_append_data(
         if (compression == 0)
                 memcpy_safe(o->data.payload, data, size);
 
-        r = journal_file_link_data(f, o, p, hash);
+        r = journal_file_link_data(f, o, p, hash);
+        if (r < 0)
+                return r;
+
+        if (compression == 0)
+                data_cache_put(f, hash, size, p);
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        /* The linking might have altered the window, so let's
+         * refresh our pointer */
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        if (!data)
+                eq = NULL;
+        else
+                eq = memchr(data, '=', size);
+        if (eq && eq > data) {
+                Object *fo = NULL;
+                uint64_t fp;
+
+                /* Create field object ... */
+                r = journal_file_append_field(f, data, (uint8_t*) eq - (uint8_t*) data, &fo, &fp);
+                if (r < 0)
+                        return r;
+
+                /* ... and link it in. */
+                o->data.next_field_offset = fo->field.head_data_offset;
+                fo->field.head_data_offset = le64toh(p);
+        }
+
+        if (ret)
+                *ret = o;
+
+        if (offset)
+                *offset = p;
+
+        return 0;
+}
+
+int journal_file_append_dictionary(JournalFile *f, const void *data, size_t size) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(data);
+        assert(size > 0);
+
+        /* Stores a zstd dictionary in the file, which is then used to compress all data objects appended
+         * from now on. This may only be done once, before the first entry is written. */
+
+        if (!f->writable)
+                return -EPERM;
+
+        if (!f->compress_zstd || !JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset))
+                return -EOPNOTSUPP;
+
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) || f->header->n_entries != 0)
+                return -EBUSY;
+
+        r = compress_dictionary_new(data, size, &d);
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_object(f, OBJECT_DICTIONARY, offsetof(Object, dictionary.payload) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        memcpy(o->dictionary.payload, data, size);
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_DICTIONARY, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->dictionary_offset = htole64(p);
+        f->header->incompatible_flags |= htole32(HEADER_INCOMPATIBLE_ZSTD_DICTIONARY);
+
+        compress_dictionary_free(f->compress_dictionary);
+        f->compress_dictionary = TAKE_PTR(d);
+
+        log_debug("Added %zu byte compression dictionary %u to %s.",
+                  size, compress_dictionary_id(f->compress_dictionary), f->path);
+
+        return 0;
+}
+
+static int journal_file_copy_dictionary(JournalFile *f, void **ret, size_t *ret_size) {
+        uint64_t p;
+        void *d;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+        assert(ret_size);
+
+        /* Returns a copy of the compression dictionary of the file, or NULL if it has none */
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                *ret = NULL;
+                *ret_size = 0;
+                return 0;
+        }
+
+        p = le64toh(f->header->dictionary_offset);
+        if (p == 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to_object(f, OBJECT_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        d = memdup(o->dictionary.payload, le64toh(o->object.size) - offsetof(Object, dictionary.payload));
+        if (!d)
+                return -ENOMEM;
+
+        *ret = d;
+        *ret_size = le64toh(o->object.size) - offsetof(Object, dictionary.payload);
+        return 1;
+}
+
+/* Reads the data objects through fd rather than the mmap cache, so that this may be done on a separate
+ * thread, see dictionary_job_start(). dictionary is the one the data objects are compressed with, if any. */
+static int train_dictionary_fd(
+                int fd,
+                uint64_t header_size,
+                uint64_t tail_object_offset,
+                const void *dictionary,
+                size_t dictionary_size,
+                void **ret,
+                size_t *ret_size) {
+
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ uint8_t *samples = NULL, *buf = NULL;
+        _cleanup_free_ size_t *sizes = NULL;
+        _cleanup_free_ void *decompressed = NULL;
+        size_t samples_size = 0, samples_allocated = 0, sizes_allocated = 0, decompressed_size = 0;
+        unsigned n_samples = 0, n_objects = 0;
+        uint64_t p;
+        int r;
+
+        assert(fd >= 0);
+        assert(ret);
+        assert(ret_size);
+
+        if (dictionary) {
+                r = compress_dictionary_new(dictionary, dictionary_size, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        buf = malloc(DICTIONARY_SAMPLE_SIZE_MAX);
+        if (!buf)
+                return -ENOMEM;
+
+        p = tail_object_offset == 0 ? 0 : header_size;
+        while (p > 0 && n_objects < DICTIONARY_OBJECTS_MAX && samples_size < DICTIONARY_SAMPLES_SIZE_MAX) {
+                ObjectHeader o;
+                uint64_t size;
+
+                r = pread_object(fd, p, &o, sizeof(o));
+                if (r < 0)
+                        return r;
+
+                size = le64toh(o.size);
+                if (size < sizeof(o))
+                        return -EBADMSG;
+
+                if (o.type == OBJECT_DATA && size >= offsetof(Object, data.payload)) {
+                        const void *data = buf;
+                        size_t l;
+
+                        n_objects++;
+
+                        /* Payloads this large are too large for a sample, compressed or not */
+                        l = size - offsetof(Object, data.payload);
+                        if (l <= DICTIONARY_SAMPLE_SIZE_MAX) {
+                                r = pread_object(fd, p + offsetof(Object, data.payload), buf, l);
+                                if (r < 0)
+                                        return r;
+
+                                if (o.flags & OBJECT_COMPRESSION_MASK) {
+                                        size_t rsize = 0;
+
+                                        r = decompress_blob_dictionary(d, o.flags & OBJECT_COMPRESSION_MASK, buf, l,
+                                                                       &decompressed, &decompressed_size, &rsize, 0);
+                                        if (r < 0)
+                                                return r;
+
+                                        data = decompressed;
+                                        l = rsize;
+                                }
+
+                                if (l >= DICTIONARY_COMPRESS_THRESHOLD && l <= DICTIONARY_SAMPLE_SIZE_MAX) {
+                                        if (!GREEDY_REALLOC(samples, samples_allocated, samples_size + l) ||
+                                            !GREEDY_REALLOC(sizes, sizes_allocated, n_samples + 1))
+                                                return -ENOMEM;
+
+                                        memcpy(samples + samples_size, data, l);
+                                        samples_size += l;
+                                        sizes[n_samples++] = l;
+                                }
+                        }
+                }
+
+                if (p >= tail_object_offset)
+                        break;
+
+                p += ALIGN64(size);
+        }
+
+        if (n_samples < DICTIONARY_SAMPLES_MIN)
+                return -ENODATA;
+
+        return compress_dictionary_train(samples, sizes, n_samples, DICTIONARY_SIZE_MAX, ret, ret_size);
+}
+
+int journal_file_train_dictionary(JournalFile *f, JournalFile *from) {
+        _cleanup_free_ void *from_dict = NULL, *dict = NULL;
+        size_t from_dict_size = 0, dict_size = 0;
+        int r;
+
+        assert(f);
+        assert(from);
+        assert(from->header);
+
+        /* Trains a dictionary from the data objects of another file and adds it to this file. On rotation this
+         * is done on a separate thread instead, see journal_file_rotate_dictionary(). */
+
+        if (!f->compress_zstd)
+                return -EOPNOTSUPP;
+
+        r = journal_file_copy_dictionary(from, &from_dict, &from_dict_size);
+        if (r < 0)
+                return r;
+
+        r = train_dictionary_fd(from->fd,
+                                le64toh(from->header->header_size),
+                                le64toh(from->header->tail_object_offset),
+                                from_dict, from_dict_size,
+                                &dict, &dict_size);
+        if (r < 0)
+                return r;
+
+        return journal_file_append_dictionary(f, dict, dict_size);
+}
+
+struct DictionaryJob {
+        pthread_t thread;
+
+        int fd;
+        uint64_t header_size;
+        uint64_t tail_object_offset;
+        void *dictionary;
+        size_t dictionary_size;
+
+        void *result;
+        size_t result_size;
+        int error;
+        volatile bool done;
+};
+
+static void *dictionary_job_thread(void *p) {
+        DictionaryJob *j = p;
+
+        (void) pthread_setname_np(pthread_self(), "journal-dict");
+
+        j->error = train_dictionary_fd(j->fd, j->header_size, j->tail_object_offset,
+                                       j->dictionary, j->dictionary_size,
+                                       &j->result, &j->result_size);
+
+        /* Make sure the result is in place before we say so */
+        __sync_synchronize();
+        j->done = true;
+
+        return NULL;
+}
+
+static DictionaryJob *dictionary_job_free(DictionaryJob *j) {
+        if (!j)
+                return NULL;
+
+        (void) pthread_join(j->thread, NULL);
+
+        safe_close(j->fd);
+        free(j->dictionary);
+        free(j->result);
+
+        return mfree(j);
+}
+
+static int dictionary_job_start(JournalFile *from, DictionaryJob **ret) {
+        _cleanup_free_ DictionaryJob *j = NULL;
+        _cleanup_free_ void *dict = NULL;
+        _cleanup_close_ int fd = -1;
+        sigset_t ss, saved_ss;
+        size_t dict_size;
+        int r, k;
+
+        assert(from);
+        assert(from->header);
+        assert(ret);
+
+        r = journal_file_copy_dictionary(from, &dict, &dict_size);
+        if (r < 0)
+                return r;
+
+        /* The file might be closed before we are done */
+        fd = fcntl(from->fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        j = new(DictionaryJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (DictionaryJob) {
+                .fd = fd,
+                .header_size = le64toh(from->header->header_size),
+                .tail_object_offset = le64toh(from->header->tail_object_offset),
+                .dictionary = dict,
+                .dictionary_size = dict_size,
+        };
+
+        if (sigfillset(&ss) < 0)
+                return -errno;
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&j->thread, NULL, dictionary_job_thread, j);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        /* The thread runs, hence it owns all of this now */
+        fd = -1;
+        dict = NULL;
+        *ret = TAKE_PTR(j);
+
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+static void journal_file_rotate_dictionary(JournalFile *old_file, JournalFile *new_file) {
+        _cleanup_free_ void *dict = NULL;
+        size_t dict_size = 0;
+        int r;
+
+        assert(old_file);
+        assert(new_file);
+
+        /* Training a dictionary walks many data objects, hence it is done on a separate thread, from the file
+         * we just archived, and used for the file replacing the new one. Until then, the new file continues to
+         * use the dictionary of the old one. If the previous job isn't done yet, it is handed on rather than
+         * waited for, and no new one is started. */
+
+        if (old_file->dictionary_job && !old_file->dictionary_job->done)
+                new_file->dictionary_job = TAKE_PTR(old_file->dictionary_job);
+        else if (old_file->dictionary_job) {
+                DictionaryJob *j = old_file->dictionary_job;
+
+                __sync_synchronize();
+
+                if (j->error < 0)
+                        log_debug_errno(j->error, "Failed to train compression dictionary from the predecessor of %s, ignoring: %m", old_file->path);
+                else {
+                        dict = TAKE_PTR(j->result);
+                        dict_size = j->result_size;
+                }
+
+                old_file->dictionary_job = dictionary_job_free(j);
+        }
+
+        if (!dict) {
+                r = journal_file_copy_dictionary(old_file, &dict, &dict_size);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read compression dictionary of %s, ignoring: %m", old_file->path);
+        }
+
+        if (dict) {
+                r = journal_file_append_dictionary(new_file, dict, dict_size);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to add compression dictionary to %s, ignoring: %m", new_file->path);
+        }
+
+        if (new_file->dictionary_job)
+                return;
+
+        r = dictionary_job_start(old_file, &new_file->dictionary_job);
+        if (r < 0)
+                log_debug_errno(r, "Failed to start training compression dictionary from %s, ignoring: %m", old_file->path);
+}
+
+static uint64_t bloom_filter_bit(uint64_t hash, uint64_t i, uint64_t n_bits) {
+        /* Derive the bit positions from the two halves of the data hash, so that we only need to hash once */
+        return ((hash & UINT32_MAX) + i * ((hash >> 32) | 1)) % n_bits;
+}
+
+static int pread_object(int fd, uint64_t p, void *buf, size_t size) {
+        ssize_t l;
+
+        l = pread(fd, buf, size, p);
+        if (l < 0)
+                return -errno;
+        if ((size_t) l != size)
+                return -EBADMSG;
+
+        return 0;
+}
+
+/* The file has to be online, and nobody else may append to it meanwhile. This reads and writes through f->fd
+ * rather than the mmap cache, which is shared with other files, so that it may be called from the offline
+ * thread. */
+static int journal_file_build_bloom_filter(JournalFile *f) {
+        _cleanup_free_ HashItem *table = NULL;
+        _cleanup_free_ Object *o = NULL;
+        uint64_t n_data, size, n_bits, m, i, p, end, n = 0;
+        ObjectHeader tail;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                return -EOPNOTSUPP;
+
+        if (JOURNAL_HEADER_BLOOM_FILTER(f->header))
+                return -EBUSY;
+
+        n_data = le64toh(f->header->n_data);
+        if (n_data <= 0)
+                return -ENODATA;
+
+        p = le64toh(f->header->tail_object_offset);
+        if (p == 0)
+                return -EBADMSG;
+
+        r = pread_object(f->fd, p, &tail, sizeof(tail));
+        if (r < 0)
+                return r;
+
+        p += ALIGN64(le64toh(tail.size));
+
+        /* Only use the space that is already allocated: posix_fallocate() and the header update would race
+         * with the main thread, which still thinks it knows the file size. A smaller filter just has more
+         * false positives. */
+        end = le64toh(f->header->header_size) + le64toh(f->header->arena_size);
+        if (end < p + offsetof(Object, bloom_filter.bits))
+                return -E2BIG;
+
+        size = MIN(ALIGN64(DIV_ROUND_UP(n_data * BLOOM_FILTER_BITS_PER_ITEM, 8)), BLOOM_FILTER_SIZE_MAX);
+        size = MIN(size, (end - p - offsetof(Object, bloom_filter.bits)) & ~7ULL);
+        if (size * 8 < n_data)
+                return -E2BIG;
+
+        n_bits = size * 8;
+
+        o = malloc0(offsetof(Object, bloom_filter.bits) + size);
+        if (!o)
+                return -ENOMEM;
+
+        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        if (m <= 0)
+                return -EBADMSG;
+
+        table = new(HashItem, m);
+        if (!table)
+                return -ENOMEM;
+
+        r = pread_object(f->fd, le64toh(f->header->data_hash_table_offset), table, m * sizeof(HashItem));
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m; i++) {
+                DataObject d;
+                uint64_t q;
+
+                for (q = le64toh(table[i].head_hash_offset); q > 0; q = le64toh(d.next_hash_offset)) {
+                        uint64_t h, k;
+
+                        /* Each data object is in exactly one chain, anything else is a corrupted file */
+                        if (++n > n_data)
+                                return -EBADMSG;
+
+                        r = pread_object(f->fd, q, &d, offsetof(DataObject, payload));
+                        if (r < 0)
+                                return r;
+                        if (d.object.type != OBJECT_DATA)
+                                return -EBADMSG;
+
+                        h = le64toh(d.hash);
+                        for (k = 0; k < BLOOM_FILTER_N_HASHES; k++) {
+                                uint64_t b = bloom_filter_bit(h, k, n_bits);
+
+                                o->bloom_filter.bits[b / 8] |= 1U << (b % 8);
+                        }
+                }
+        }
+
+        if (n != n_data)
+                return -EBADMSG;
+
+        o->object.type = OBJECT_BLOOM_FILTER;
+        o->object.size = htole64(offsetof(Object, bloom_filter.bits) + size);
+        o->bloom_filter.n_hashes = htole64(BLOOM_FILTER_N_HASHES);
+
+        r = pwrite(f->fd, o, offsetof(Object, bloom_filter.bits) + size, p);
+        if (r < 0)
+                return -errno;
+        if ((uint64_t) r != offsetof(Object, bloom_filter.bits) + size)
+                return -EIO;
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_BLOOM_FILTER, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        /* Make sure the object is in place before the header refers to it */
+        __sync_synchronize();
+
+        f->header->tail_object_offset = htole64(p);
+        f->header->n_objects = htole64(le64toh(f->header->n_objects) + 1);
+        f->header->bloom_filter_offset = htole64(p);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_BLOOM_FILTER);
+
+        log_debug("Added %"PRIu64" byte Bloom filter for %"PRIu64" data objects to %s.", size, n_data, f->path);
+
+        return 0;
+}
+
+int journal_file_append_bloom_filter(JournalFile *f) {
+        int r;
+
+        assert(f);
+
+        /* Adds a Bloom filter over all data objects to the file. Since the filter can't be updated, this is
+         * done when the file is archived, and the file can't be written to anymore afterwards. Normally that
+         * happens on the offline thread, see journal_file_set_offline_internal(). */
+
+        if (!f->writable)
+                return -EPERM;
+
+        r = journal_file_set_online(f);
         if (r < 0)
                 return r;
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
-        if (r < 0)
-                return r;
-#endif
+        return journal_file_build_bloom_filter(f);
+}
 
-        /* The linking might have altered the window, so let's
-         * refresh our pointer */
-        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+int journal_file_bloom_filter_check(JournalFile *f, uint64_t hash) {
+        uint64_t n_bits, n_hashes, k;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns 0 if data with the specified hash is definitely not in the file, and > 0 if it might be,
+         * including the case where the file has no Bloom filter. */
+
+        if (!JOURNAL_HEADER_BLOOM_FILTER(f->header))
+                return 1;
+
+        r = journal_file_move_to_object(f, OBJECT_BLOOM_FILTER, le64toh(f->header->bloom_filter_offset), &o);
         if (r < 0)
                 return r;
 
-        if (!data)
-                eq = NULL;
-        else
-                eq = memchr(data, '=', size);
-        if (eq && eq > data) {
-                Object *fo = NULL;
-                uint64_t fp;
+        n_bits = (le64toh(o->object.size) - offsetof(Object, bloom_filter.bits)) * 8;
+        n_hashes = le64toh(o->bloom_filter.n_hashes);
 
-                /* Create field object ... */
-                r = journal_file_append_field(f, data, (uint8_t*) eq - (uint8_t*) data, &fo, &fp);
-                if (r < 0)
-                        return r;
+        for (k = 0; k < n_hashes; k++) {
+                uint64_t b = bloom_filter_bit(hash, k, n_bits);
 
-                /* ... and link it in. */
-                o->data.next_field_offset = fo->field.head_data_offset;
-                fo->field.head_data_offset = le64toh(p);
+                if (!(o->bloom_filter.bits[b / 8] & (1U << (b % 8))))
+                        return 0;
         }
 
-        if (ret)
-                *ret = o;
-
-        if (offset)
-                *offset = p;
-
-        return 0;
+        return 1;
 }
 
 uint64_t journal_file_entry_n_items(Object *o) {
@@ -1609,13 +2540,25 @@ uint64_t journal_file_entry_n_items(Object *o) {
         return (le64toh(o->object.size) - offsetof(Object, entry.items)) / sizeof(EntryItem);
 }
 
-uint64_t journal_file_entry_array_n_items(Object *o) {
+uint64_t journal_file_entry_array_n_items(JournalFile *f, Object *o) {
+        assert(f);
         assert(o);
 
         if (o->object.type != OBJECT_ENTRY_ARRAY)
                 return 0;
 
-        return (le64toh(o->object.size) - offsetof(Object, entry_array.items)) / sizeof(uint64_t);
+        return (le64toh(o->object.size) - offsetof(Object, entry_array.items)) / journal_file_entry_array_item_size(f);
+}
+
+static void entry_array_set_item(JournalFile *f, Object *o, uint64_t i, uint64_t p) {
+        assert(f);
+        assert(o);
+
+        if (JOURNAL_HEADER_COMPACT(f->header)) {
+                assert(p <= UINT32_MAX);
+                o->entry_array.items.compact[i] = htole32(p);
+        } else
+                o->entry_array.items.regular[i] = htole64(p);
 }
 
 uint64_t journal_file_hash_table_n_items(Object *o) {
@@ -1649,9 +2592,9 @@ static int link_entry_into_array(JournalFile *f,
                 if (r < 0)
                         return r;
 
-                n = journal_file_entry_array_n_items(o);
+                n = journal_file_entry_array_n_items(f, o);
                 if (i < n) {
-                        o->entry_array.items[i] = htole64(p);
+                        entry_array_set_item(f, o, i, p);
                         *idx = htole64(hidx + 1);
                         return 0;
                 }
@@ -1670,7 +2613,7 @@ static int link_entry_into_array(JournalFile *f,
                 n = 4;
 
         r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
-                                       offsetof(Object, entry_array.items) + n * sizeof(uint64_t),
+                                       offsetof(Object, entry_array.items) + n * journal_file_entry_array_item_size(f),
                                        &o, &q);
         if (r < 0)
                 return r;
@@ -1681,7 +2624,7 @@ static int link_entry_into_array(JournalFile *f,
                 return r;
 #endif
 
-        o->entry_array.items[i] = htole64(p);
+        entry_array_set_item(f, o, i, p);
 
         if (ap == 0)
                 *first = htole64(q);
@@ -1844,6 +2787,8 @@ static int journal_file_append_entry_internal(
 }
 
 void journal_file_post_change(JournalFile *f) {
+        uint64_t n;
+
         assert(f);
 
         /* inotify() does not receive IN_MODIFY events from file
@@ -1851,6 +2796,15 @@ void journal_file_post_change(JournalFile *f) {
          * trigger IN_MODIFY by truncating the journal file to its
          * current size which triggers IN_MODIFY. */
 
+        /* Readers only care about new entries, hence don't wake them
+         * up (and save ourselves the syscall) if no entry was added
+         * since the last time we posted a change. */
+        n = le64toh(f->header->n_entries);
+        if (n == f->posted_n_entries)
+                return;
+
+        f->posted_n_entries = n;
+
         __sync_synchronize();
 
         if (ftruncate(f->fd, f->last_stat.st_size) < 0)
@@ -1943,7 +2897,7 @@ static int entry_item_cmp(const void *_a, const void *_b) {
         return 0;
 }
 
-int journal_file_append_entry(
+static int journal_file_append_entry_one(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
@@ -2001,7 +2955,11 @@ int journal_file_append_entry(
          * times for rotating media. */
         qsort_safe(items, n_iovec, sizeof(EntryItem), entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+        return journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+}
+
+static int journal_file_finish_append(JournalFile *f, int r) {
+        assert(f);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -2019,6 +2977,58 @@ int journal_file_append_entry(
         return r;
 }
 
+int journal_file_append_entry(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        int r;
+
+        assert(f);
+
+        r = journal_file_append_entry_one(f, ts, boot_id, iovec, n_iovec, seqnum, ret, offset);
+
+        return journal_file_finish_append(f, r);
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended) {
+
+        size_t i;
+        int r = 0;
+
+        assert(f);
+        assert(entries || n_entries == 0);
+
+        /* Appends a series of entries in one go. This is equivalent to calling journal_file_append_entry() for
+         * each of them, except that the SIGBUS check and the change notification (either the ftruncate() or the
+         * rescheduling of the coalescing timer) are done only once for the whole batch. Processing stops at the
+         * first entry that cannot be written, in which case the number of entries that made it to disk is
+         * returned in ret_n_appended, so that the caller may rotate and retry with the rest. */
+
+        for (i = 0; i < n_entries; i++) {
+                const JournalEntry *e = entries + i;
+
+                r = journal_file_append_entry_one(f, e->ts, e->boot_id, e->iovec, e->n_iovec, seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        if (ret_n_appended)
+                *ret_n_appended = i;
+
+        if (n_entries == 0)
+                return 0;
+
+        return journal_file_finish_append(f, r);
+}
+
 typedef struct ChainCacheItem {
         uint64_t first; /* the array at the beginning of the chain */
         uint64_t array; /* the cached array */
@@ -2096,9 +3106,9 @@ static int generic_array_get(
                 if (r < 0)
                         return r;
 
-                k = journal_file_entry_array_n_items(o);
+                k = journal_file_entry_array_n_items(f, o);
                 if (i < k) {
-                        p = le64toh(o->entry_array.items[i]);
+                        p = journal_file_entry_array_item(f, o, i);
                         goto found;
                 }
 
@@ -2111,7 +3121,7 @@ static int generic_array_get(
 
 found:
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, le64toh(o->entry_array.items[0]), t, i);
+        chain_cache_put(f->chain_cache, ci, first, a, journal_file_entry_array_item(f, o, 0), t, i);
 
         r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
         if (r < 0)
@@ -2162,6 +3172,188 @@ enum {
         TEST_RIGHT
 };
 
+static int entry_array_index_get(JournalFile *f, uint64_t first, uint64_t n, EntryArrayIndex **ret) {
+        EntryArrayIndex *x;
+        uint64_t a, total;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ret);
+
+        /* Returns the index of the chain starting at first, covering at least n items if the chain is that long */
+
+        x = ordered_hashmap_get(f->entry_array_indexes, &first);
+        if (!x) {
+                r = ordered_hashmap_ensure_allocated(&f->entry_array_indexes, &uint64_hash_ops);
+                if (r < 0)
+                        return r;
+
+                if (ordered_hashmap_size(f->entry_array_indexes) >= ENTRY_ARRAY_INDEX_MAX)
+                        entry_array_index_free(ordered_hashmap_steal_first(f->entry_array_indexes));
+
+                x = new0(EntryArrayIndex, 1);
+                if (!x)
+                        return -ENOMEM;
+
+                x->first = first;
+
+                r = ordered_hashmap_put(f->entry_array_indexes, &x->first, x);
+                if (r < 0) {
+                        entry_array_index_free(x);
+                        return r;
+                }
+        }
+
+        if (x->n_items == 0) {
+                a = first;
+                total = 0;
+        } else {
+                EntryArrayIndexItem *last = x->items + x->n_items - 1;
+
+                total = last->total + last->n_items;
+                if (total >= n)
+                        goto finish;
+
+                /* More items than we know arrays for, see if the chain was extended in the meantime */
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, last->offset, &o);
+                if (r < 0)
+                        return r;
+
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        while (a > 0 && total < n) {
+                uint64_t k;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(f, o);
+                if (k <= 0)
+                        break;
+
+                if (!GREEDY_REALLOC(x->items, x->n_allocated, x->n_items + 1))
+                        return -ENOMEM;
+
+                x->items[x->n_items++] = (EntryArrayIndexItem) {
+                        .offset = a,
+                        .total = total,
+                        .n_items = k,
+                };
+
+                total += k;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+finish:
+        *ret = x;
+        return 0;
+}
+
+static int entry_array_index_test(
+                JournalFile *f,
+                const EntryArrayIndexItem *item,
+                uint64_t n,
+                uint64_t needle,
+                int (*test_object)(JournalFile *f, uint64_t p, uint64_t needle),
+                direction_t direction,
+                uint64_t *ret_last) {
+
+        Object *o;
+        uint64_t p;
+        int r;
+
+        /* Tests the last item of the array that is in use */
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, item->offset, &o);
+        if (r < 0)
+                return r;
+
+        p = journal_file_entry_array_item(f, o, MIN(item->n_items, n - item->total) - 1);
+        if (p <= 0)
+                return -EBADMSG;
+
+        if (ret_last)
+                *ret_last = p;
+
+        if (!test_object)
+                return TEST_LEFT;
+
+        r = test_object(f, p, needle);
+        if (r == TEST_FOUND)
+                r = direction == DIRECTION_DOWN ? TEST_RIGHT : TEST_LEFT;
+
+        return r;
+}
+
+static int entry_array_index_seek(
+                JournalFile *f,
+                uint64_t first,
+                uint64_t n,
+                uint64_t needle,
+                int (*test_object)(JournalFile *f, uint64_t p, uint64_t needle),
+                direction_t direction,
+                uint64_t *ret_array,
+                uint64_t *ret_total,
+                uint64_t *ret_last_p) {
+
+        EntryArrayIndex *x;
+        size_t left, right, m;
+        int r;
+
+        assert(f);
+        assert(ret_array);
+        assert(ret_total);
+        assert(ret_last_p);
+
+        /* Finds the first array in the chain whose last item in use is right of the needle, or the last array
+         * if there is none. Returns 0 if that's the first array, or if we can't tell, in which case the caller
+         * should just walk the chain. */
+
+        r = entry_array_index_get(f, first, n, &x);
+        if (r < 0)
+                return r;
+
+        for (m = 0; m < x->n_items && x->items[m].total < n; m++)
+                ;
+
+        if (m < ENTRY_ARRAY_INDEX_MIN_ARRAYS)
+                return 0;
+
+        left = 0;
+        right = m - 1;
+        while (left < right) {
+                size_t i = (left + right) / 2;
+
+                r = entry_array_index_test(f, x->items + i, n, needle, test_object, direction, NULL);
+                if (r == -EBADMSG)
+                        return 0;
+                if (r < 0)
+                        return r;
+
+                if (r == TEST_RIGHT)
+                        right = i;
+                else
+                        left = i + 1;
+        }
+
+        if (left == 0)
+                return 0;
+
+        /* The caller needs the last item of the previous array too */
+        r = entry_array_index_test(f, x->items + left - 1, n, needle, NULL, direction, ret_last_p);
+        if (r == -EBADMSG)
+                return 0;
+        if (r < 0)
+                return r;
+
+        *ret_array = x->items[left].offset;
+        *ret_total = x->items[left].total;
+        return 1;
+}
+
 static int generic_array_bisect(
                 JournalFile *f,
                 uint64_t first,
@@ -2210,6 +3402,16 @@ static int generic_array_bisect(
                 }
         }
 
+        if (a == first) {
+                /* No luck with the cache, let's find the right array in the chain in one go, rather than
+                 * walking it */
+                r = entry_array_index_seek(f, first, n, needle, test_object, direction, &a, &t, &last_p);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        n -= t;
+        }
+
         while (a > 0) {
                 uint64_t left, right, k, lp;
 
@@ -2217,13 +3419,13 @@ static int generic_array_bisect(
                 if (r < 0)
                         return r;
 
-                k = journal_file_entry_array_n_items(array);
+                k = journal_file_entry_array_n_items(f, array);
                 right = MIN(k, n);
                 if (right <= 0)
                         return 0;
 
                 i = right - 1;
-                lp = p = le64toh(array->entry_array.items[i]);
+                lp = p = journal_file_entry_array_item(f, array, i);
                 if (p <= 0)
                         r = -EBADMSG;
                 else
@@ -2256,7 +3458,7 @@ static int generic_array_bisect(
                                 if (last_index > 0) {
                                         uint64_t x = last_index - 1;
 
-                                        p = le64toh(array->entry_array.items[x]);
+                                        p = journal_file_entry_array_item(f, array, x);
                                         if (p <= 0)
                                                 return -EBADMSG;
 
@@ -2276,7 +3478,7 @@ static int generic_array_bisect(
                                 if (last_index < right) {
                                         uint64_t y = last_index + 1;
 
-                                        p = le64toh(array->entry_array.items[y]);
+                                        p = journal_file_entry_array_item(f, array, y);
                                         if (p <= 0)
                                                 return -EBADMSG;
 
@@ -2306,7 +3508,7 @@ static int generic_array_bisect(
                                 assert(left < right);
                                 i = (left + right) / 2;
 
-                                p = le64toh(array->entry_array.items[i]);
+                                p = journal_file_entry_array_item(f, array, i);
                                 if (p <= 0)
                                         r = -EBADMSG;
                                 else
@@ -2354,14 +3556,14 @@ found:
                 return 0;
 
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, le64toh(array->entry_array.items[0]), t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
+        chain_cache_put(f->chain_cache, ci, first, a, journal_file_entry_array_item(f, array, 0), t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
 
         if (subtract_one && i == 0)
                 p = last_p;
         else if (subtract_one)
-                p = le64toh(array->entry_array.items[i-1]);
+                p = journal_file_entry_array_item(f, array, i-1);
         else
-                p = le64toh(array->entry_array.items[i]);
+                p = journal_file_entry_array_item(f, array, i);
 
         r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
         if (r < 0)
@@ -2520,6 +3722,21 @@ static int test_object_realtime(JournalFile *f, uint64_t p, uint64_t needle) {
                 return TEST_RIGHT;
 }
 
+static bool realtime_beyond_file(JournalFile *f, uint64_t realtime, direction_t direction) {
+        assert(f);
+        assert(f->header);
+
+        /* The header knows the timestamps of the first and last entry. If the timestamp we are looking for
+         * lies outside of them, in the direction we are looking, there's no point in bisecting the entry
+         * arrays, which for big archived files would mean pulling in the last entry of every array just to
+         * find out. */
+
+        if (direction == DIRECTION_DOWN)
+                return realtime > le64toh(f->header->tail_entry_realtime);
+        else
+                return realtime < le64toh(f->header->head_entry_realtime);
+}
+
 int journal_file_move_to_entry_by_realtime(
                 JournalFile *f,
                 uint64_t realtime,
@@ -2529,6 +3746,9 @@ int journal_file_move_to_entry_by_realtime(
         assert(f);
         assert(f->header);
 
+        if (realtime_beyond_file(f, realtime, direction))
+                return 0;
+
         return generic_array_bisect(f,
                                     le64toh(f->header->entry_array_offset),
                                     le64toh(f->header->n_entries),
@@ -2993,6 +4213,9 @@ int journal_file_move_to_entry_by_realtime_for_data(
 
         assert(f);
 
+        if (realtime_beyond_file(f, realtime, direction))
+                return 0;
+
         r = journal_file_move_to_object(f, OBJECT_DATA, data_offset, &d);
         if (r < 0)
                 return r;
@@ -3062,6 +4285,15 @@ void journal_file_dump(JournalFile *f) {
                                le64toh(o->tag.epoch));
                         break;
 
+                case OBJECT_DICTIONARY:
+                        printf("Type: OBJECT_DICTIONARY\n");
+                        break;
+
+                case OBJECT_BLOOM_FILTER:
+                        printf("Type: OBJECT_BLOOM_FILTER n_hashes=%"PRIu64"\n",
+                               le64toh(o->bloom_filter.n_hashes));
+                        break;
+
                 default:
                         printf("Type: unknown (%i)\n", o->object.type);
                         break;
@@ -3106,8 +4338,8 @@ void journal_file_print_header(JournalFile *f) {
                "Boot ID: %s\n"
                "Sequential Number ID: %s\n"
                "State: %s\n"
-               "Compatible Flags:%s%s\n"
-               "Incompatible Flags:%s%s%s\n"
+               "Compatible Flags:%s%s%s\n"
+               "Incompatible Flags:%s%s%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data Hash Table Size: %"PRIu64"\n"
@@ -3129,9 +4361,14 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_ONLINE ? "ONLINE" :
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
                JOURNAL_HEADER_SEALED(f->header) ? " SEALED" : "",
+               JOURNAL_HEADER_BLOOM_FILTER(f->header) ? " BLOOM-FILTER" : "",
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ? " ZSTD-DICTIONARY" : "",
+               JOURNAL_HEADER_COMPACT(f->header) ? " COMPACT" : "",
+               JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3243,7 +4480,10 @@ int journal_file_open(
         f->flags = flags;
         f->prot = prot_from_flags(flags);
         f->writable = (flags & O_ACCMODE) != O_RDONLY;
-#if HAVE_LZ4
+        f->preallocate = f->writable && getenv_bool("SYSTEMD_JOURNAL_PREALLOCATE") > 0;
+#if HAVE_ZSTD
+        f->compress_zstd = compress;
+#elif HAVE_LZ4
         f->compress_lz4 = compress;
 #elif HAVE_XZ
         f->compress_xz = compress;
@@ -3365,6 +4605,7 @@ int journal_file_open(
                 goto fail;
 
         f->header = h;
+        f->posted_n_entries = le64toh(f->header->n_entries);
 
         if (!newly_created) {
                 set_clear_with_destructor(deferred_closes, journal_file_close);
@@ -3446,6 +4687,78 @@ fail:
         return r;
 }
 
+int journal_file_release(JournalFile *f) {
+        Header *h;
+
+        assert(f);
+        assert(!f->writable);
+        assert(f->close_fd);
+
+        /* Closes the fd of a file opened for reading and drops all its memory maps. Only a copy of the header
+         * is kept, so that the file can still be looked at and ordered against others without taking up
+         * resources. Before anything else is read from it, journal_file_reacquire() needs to be called. */
+
+        if (f->released)
+                return 0;
+
+        h = newdup(Header, f->header, 1);
+        if (!h)
+                return -ENOMEM;
+
+        mmap_cache_free_fd(f->mmap, f->cache_fd);
+        f->cache_fd = NULL;
+
+        f->header = h;
+        f->data_hash_table = f->field_hash_table = NULL;
+        f->fd = safe_close(f->fd);
+        f->released = true;
+
+        return 0;
+}
+
+int journal_file_reacquire(JournalFile *f, int fd) {
+        MMapFileDescriptor *cache_fd;
+        struct stat st;
+        void *h;
+        int r;
+
+        assert(f);
+        assert(f->released);
+        assert(fd >= 0);
+
+        /* Takes possession of the fd on success, the caller has to close it otherwise. */
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* The file got replaced under the same name in the meantime, probably due to rotation */
+        if (st.st_dev != f->last_stat.st_dev || st.st_ino != f->last_stat.st_ino)
+                return -ESTALE;
+
+        cache_fd = mmap_cache_add_fd(f->mmap, fd);
+        if (!cache_fd)
+                return -ENOMEM;
+
+        f->fd = fd;
+        f->cache_fd = cache_fd;
+        f->last_stat = st;
+        f->last_stat_usec = now(CLOCK_MONOTONIC);
+
+        r = mmap_cache_get(f->mmap, f->cache_fd, f->prot, CONTEXT_HEADER, true, 0, PAGE_ALIGN(sizeof(Header)), &f->last_stat, &h, NULL);
+        if (r < 0) {
+                mmap_cache_free_fd(f->mmap, f->cache_fd);
+                f->cache_fd = NULL;
+                f->fd = -1;
+                return r;
+        }
+
+        free(f->header);
+        f->header = h;
+        f->released = false;
+
+        return 0;
+}
+
 int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes) {
         _cleanup_free_ char *p = NULL;
         size_t l;
@@ -3504,6 +4817,9 @@ int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_thresh
                               compress_threshold_bytes, seal, NULL, old_file->mmap, deferred_closes,
                               old_file, &new_file);
 
+        if (r >= 0 && new_file->compress_zstd && getenv_bool("SYSTEMD_JOURNAL_COMPRESS_DICTIONARY") > 0)
+                journal_file_rotate_dictionary(old_file, new_file);
+
         if (deferred_closes &&
             set_put(deferred_closes, old_file) >= 0)
                 (void) journal_file_set_offline(old_file, false);
@@ -3627,11 +4943,11 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return -E2BIG;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
                         size_t rsize = 0;
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
+                        r = journal_file_decompress_blob(from, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
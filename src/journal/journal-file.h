@@ -9,11 +9,14 @@
 
 #include "sd-id128.h"
 
+#include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
+#include "lookup3.h"
 #include "macro.h"
 #include "mmap-cache.h"
 #include "sd-event.h"
+#include "siphash24.h"
 #include "sparse-endian.h"
 
 typedef struct JournalMetrics {
@@ -55,6 +58,8 @@ typedef enum OfflineState {
         OFFLINE_DONE
 } OfflineState;
 
+typedef struct DictionaryJob DictionaryJob;
+
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
@@ -66,19 +71,27 @@ typedef struct JournalFile {
         bool writable:1;
         bool compress_xz:1;
         bool compress_lz4:1;
+        bool compress_zstd:1;
         bool seal:1;
         bool defrag_on_close:1;
         bool close_fd:1;
         bool archive:1;
+        bool preallocate:1;
+        bool released:1; /* fd closed and unmapped, header points to a private copy */
 
         direction_t last_direction;
         LocationType location_type;
+        unsigned candidate_idx;
         uint64_t last_n_entries;
 
         char *path;
         struct stat last_stat;
         usec_t last_stat_usec;
 
+        /* How much we grew the file by last time, and when */
+        uint64_t grow_size;
+        usec_t last_grow_usec;
+
         Header *header;
         HashItem *data_hash_table;
         HashItem *field_hash_table;
@@ -95,8 +108,11 @@ typedef struct JournalFile {
 
         sd_event_source *post_change_timer;
         usec_t post_change_timer_period;
+        uint64_t posted_n_entries; /* n_entries when the last change was posted (writer) or seen (reader) */
 
         OrderedHashmap *chain_cache;
+        OrderedHashmap *entry_array_indexes;
+        OrderedHashmap *data_cache;
 
         pthread_t offline_thread;
         volatile OfflineState offline_state;
@@ -104,10 +120,12 @@ typedef struct JournalFile {
         unsigned last_seen_generation;
 
         uint64_t compress_threshold_bytes;
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
+        CompressDictionary *compress_dictionary;
+        DictionaryJob *dictionary_job; /* training the dictionary for the file replacing this one */
 
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
@@ -141,6 +159,9 @@ int journal_file_open(
                 JournalFile *template,
                 JournalFile **ret);
 
+int journal_file_release(JournalFile *f);
+int journal_file_reacquire(JournalFile *f, int fd);
+
 int journal_file_set_offline(JournalFile *f, bool wait);
 bool journal_file_is_offlining(JournalFile *f);
 JournalFile* journal_file_close(JournalFile *j);
@@ -192,12 +213,46 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+
+#define JOURNAL_HEADER_ZSTD_DICTIONARY(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY))
+
+#define JOURNAL_HEADER_BLOOM_FILTER(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_BLOOM_FILTER))
+
+#define JOURNAL_HEADER_COMPACT(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPACT))
+
+#define JOURNAL_HEADER_KEYED_HASH(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_KEYED_HASH))
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
-uint64_t journal_file_entry_array_n_items(Object *o) _pure_;
+uint64_t journal_file_entry_array_n_items(JournalFile *f, Object *o) _pure_;
+
+static inline size_t journal_file_entry_array_item_size(JournalFile *f) {
+        assert(f);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? sizeof(le32_t) : sizeof(le64_t);
+}
+
+static inline uint64_t journal_file_entry_array_item(JournalFile *f, Object *o, size_t i) {
+        assert(f);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? le32toh(o->entry_array.items.compact[i]) : le64toh(o->entry_array.items.regular[i]);
+}
 uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 
+static inline uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz) {
+        assert(f);
+
+        /* With a key that is random per file, log content can't be crafted to collide in the hash tables */
+        return JOURNAL_HEADER_KEYED_HASH(f->header) ? siphash24(data, sz, f->header->file_id.bytes) : hash64(data, sz);
+}
+
 int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_append_entry(
                 JournalFile *f,
@@ -208,6 +263,37 @@ int journal_file_append_entry(
                 Object **ret,
                 uint64_t *offset);
 
+typedef struct JournalEntry {
+        const dual_timestamp *ts;     /* NULL means "now" */
+        const sd_id128_t *boot_id;    /* NULL means the boot ID of the file header */
+        const struct iovec *iovec;
+        unsigned n_iovec;
+} JournalEntry;
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended);
+
+int journal_file_append_dictionary(JournalFile *f, const void *data, size_t size);
+int journal_file_train_dictionary(JournalFile *f, JournalFile *from);
+int journal_file_append_bloom_filter(JournalFile *f);
+int journal_file_bloom_filter_check(JournalFile *f, uint64_t hash);
+
+int journal_file_decompress_blob(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max);
+int journal_file_decompress_startswith(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **buffer, size_t *buffer_size,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
 
@@ -253,5 +339,5 @@ int journal_file_map_field_hash_table(JournalFile *f);
 
 static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
         assert(f);
-        return f->compress_xz || f->compress_lz4;
+        return f->compress_xz || f->compress_lz4 || f->compress_zstd;
 }
@@ -12,6 +12,8 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "ordered-set.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
@@ -74,11 +76,22 @@ struct sd_journal {
         IteratedCache *files_cache;
         MMapCache *mmap;
 
+        /* Files we opened ourselves that currently have their fd open and are mapped, least recently used
+         * first. Beyond n_mapped_files_max, the least recently used ones are released again, and reopened
+         * once they are needed. */
+        OrderedSet *mapped_files;
+        unsigned n_mapped_files_max;
+
         Location current_location;
 
         JournalFile *current_file;
         uint64_t current_field;
 
+        /* Files with a candidate entry for the next step in candidates_direction, ordered by that entry. NULL
+         * when the candidates need to be recomputed for all files. */
+        Prioq *candidates;
+        direction_t candidates_direction;
+
         Match *level0, *level1, *level2;
 
         pid_t original_pid;
@@ -92,6 +105,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_values; /* values returned so far */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -99,6 +113,7 @@ struct sd_journal {
         uint64_t fields_hash_table_index;
         char *fields_buffer;
         size_t fields_buffer_allocated;
+        Set *fields_seen; /* field names returned so far */
 
         int flags;
 
@@ -119,10 +134,15 @@ struct sd_journal {
         Hashmap *directories_by_wd;
 
         Hashmap *errors;
+
+        /* Catalog entries looked up so far, by message ID, with their variables already located */
+        Hashmap *catalog_cache;
 };
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
 
+int journal_acquire_file(sd_journal *j, JournalFile *f);
+
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
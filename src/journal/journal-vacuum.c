@@ -10,6 +10,7 @@
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
@@ -29,6 +30,102 @@ struct vacuum_info {
         bool have_seqnum;
 };
 
+/* Archived journal files are never modified again, hence once we checked that one isn't empty and determined its
+ * age, there's no need to open it or query its extended attributes again on the next vacuuming run, which matters
+ * for directories with many thousands of files. Files are identified by name, inode and size, in case somebody
+ * replaced them behind our back. */
+typedef struct VacuumCacheEntry {
+        char *filename;
+        ino_t inode;
+        uint64_t usage;
+        uint64_t realtime;
+        unsigned generation;
+} VacuumCacheEntry;
+
+struct JournalVacuumCache {
+        Hashmap *entries;
+        unsigned generation;
+};
+
+static VacuumCacheEntry *vacuum_cache_entry_free(VacuumCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->filename);
+        return mfree(e);
+}
+
+JournalVacuumCache *journal_vacuum_cache_free(JournalVacuumCache *c) {
+        VacuumCacheEntry *e;
+
+        if (!c)
+                return NULL;
+
+        while ((e = hashmap_steal_first(c->entries)))
+                vacuum_cache_entry_free(e);
+
+        hashmap_free(c->entries);
+        return mfree(c);
+}
+
+static int vacuum_cache_put(JournalVacuumCache *c, const char *filename, const struct stat *st, uint64_t usage, uint64_t realtime) {
+        VacuumCacheEntry *e;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(st);
+
+        e = hashmap_get(c->entries, filename);
+        if (!e) {
+                r = hashmap_ensure_allocated(&c->entries, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                e = new0(VacuumCacheEntry, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->filename = strdup(filename);
+                if (!e->filename) {
+                        free(e);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(c->entries, e->filename, e);
+                if (r < 0) {
+                        vacuum_cache_entry_free(e);
+                        return r;
+                }
+        }
+
+        e->inode = st->st_ino;
+        e->usage = usage;
+        e->realtime = realtime;
+        e->generation = c->generation;
+
+        return 0;
+}
+
+static void vacuum_cache_remove(JournalVacuumCache *c, const char *filename) {
+        if (!c)
+                return;
+
+        vacuum_cache_entry_free(hashmap_remove(c->entries, filename));
+}
+
+static void vacuum_cache_prune(JournalVacuumCache *c) {
+        VacuumCacheEntry *e;
+        Iterator i;
+
+        assert(c);
+
+        /* Forget about all files not seen in the last run */
+        HASHMAP_FOREACH(e, c->entries, i)
+                if (e->generation != c->generation)
+                        vacuum_cache_entry_free(hashmap_remove(c->entries, e->filename));
+}
+
 static int vacuum_compare(const void *_a, const void *_b) {
         const struct vacuum_info *a, *b;
 
@@ -126,15 +223,17 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
+int journal_directory_vacuum_cached(
                 const char *directory,
                 uint64_t max_use,
                 uint64_t n_max_files,
                 usec_t max_retention_usec,
                 usec_t *oldest_usec,
-                bool verbose) {
+                bool verbose,
+                JournalVacuumCache **cache) {
 
         _cleanup_closedir_ DIR *d = NULL;
+        JournalVacuumCache *c = NULL;
         struct vacuum_info *list = NULL;
         unsigned n_list = 0, i, n_active_files = 0;
         size_t n_allocated = 0;
@@ -161,6 +260,17 @@ int journal_directory_vacuum(
         if (!d)
                 return -errno;
 
+        if (cache) {
+                if (!*cache) {
+                        *cache = new0(JournalVacuumCache, 1);
+                        if (!*cache)
+                                return -ENOMEM;
+                }
+
+                c = *cache;
+                c->generation++;
+        }
+
         FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
 
                 unsigned long long seqnum = 0, realtime;
@@ -253,6 +363,17 @@ int journal_directory_vacuum(
 
                 size = 512UL * (uint64_t) st.st_blocks;
 
+                if (c) {
+                        VacuumCacheEntry *e;
+
+                        e = hashmap_get(c->entries, p);
+                        if (e && e->inode == st.st_ino && e->usage == size) {
+                                e->generation = c->generation;
+                                realtime = e->realtime;
+                                goto add;
+                        }
+                }
+
                 r = journal_file_empty(dirfd(d), p);
                 if (r < 0) {
                         log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
@@ -276,6 +397,15 @@ int journal_directory_vacuum(
 
                 patch_realtime(dirfd(d), p, &st, &realtime);
 
+                if (c) {
+                        r = vacuum_cache_put(c, p, &st, size, realtime);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to cache vacuum information about %s, ignoring: %m", p);
+                                vacuum_cache_remove(c, p);
+                        }
+                }
+
+        add:
                 if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
                         r = -ENOMEM;
                         goto finish;
@@ -305,6 +435,8 @@ int journal_directory_vacuum(
                         break;
 
                 r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
+                if (r >= 0 || r == -ENOENT)
+                        vacuum_cache_remove(c, list[i].filename);
                 if (r >= 0) {
                         log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, list[i].filename, format_bytes(sbytes, sizeof(sbytes), list[i].usage));
                         freed += list[i].usage;
@@ -323,6 +455,9 @@ int journal_directory_vacuum(
 
         r = 0;
 
+        if (c)
+                vacuum_cache_prune(c);
+
 finish:
         for (i = 0; i < n_list; i++)
                 free(list[i].filename);
@@ -4,6 +4,16 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
-int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+typedef struct JournalVacuumCache JournalVacuumCache;
+
+JournalVacuumCache *journal_vacuum_cache_free(JournalVacuumCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumCache*, journal_vacuum_cache_free);
+
+int journal_directory_vacuum_cached(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose, JournalVacuumCache **cache);
+
+static inline int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose) {
+        return journal_directory_vacuum_cached(directory, max_use, n_max_files, max_retention_usec, oldest_usec, verbose, NULL);
+}
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -16,6 +18,7 @@
 #include "journal-verify.h"
 #include "lookup3.h"
 #include "macro.h"
+#include "parse-util.h"
 #include "terminal-util.h"
 #include "util.h"
 
@@ -106,7 +109,11 @@ static void flush_progress(void) {
                 log_error_errno(error, OFSfmt": " _fmt, (uint64_t)_offset, ##__VA_ARGS__); \
         } while (0)
 
-static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o) {
+/* Don't bother with threads for files that are verified in a blink anyway */
+#define VERIFY_PARALLEL_MIN_SIZE (16U*1024U*1024U)
+#define VERIFY_THREADS_MAX 16U
+
+static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o, bool check_hash) {
         uint64_t i;
 
         assert(f);
@@ -147,23 +154,25 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 h1 = le64toh(o->data.hash);
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
-                if (compression) {
+                if (!check_hash)
+                        h2 = h1;
+                else if (compression) {
                         _cleanup_free_ void *b = NULL;
                         size_t alloc = 0, b_size;
 
-                        r = decompress_blob(compression,
-                                            o->data.payload,
-                                            le64toh(o->object.size) - offsetof(Object, data.payload),
-                                            &b, &alloc, &b_size, 0);
+                        r = journal_file_decompress_blob(f, compression,
+                                                         o->data.payload,
+                                                         le64toh(o->object.size) - offsetof(Object, data.payload),
+                                                         &b, &alloc, &b_size, 0);
                         if (r < 0) {
                                 error_errno(offset, r, "%s decompression failed: %m",
                                             object_compressed_to_string(compression));
                                 return r;
                         }
 
-                        h2 = hash64(b, b_size);
+                        h2 = journal_file_hash_data(f, b, b_size);
                 } else
-                        h2 = hash64(o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
+                        h2 = journal_file_hash_data(f, o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
 
                 if (h1 != h2) {
                         error(offset, "Invalid hash (%08"PRIx64" vs. %08"PRIx64, h1, h2);
@@ -300,8 +309,8 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 break;
 
         case OBJECT_ENTRY_ARRAY:
-                if ((le64toh(o->object.size) - offsetof(EntryArrayObject, items)) % sizeof(le64_t) != 0 ||
-                    (le64toh(o->object.size) - offsetof(EntryArrayObject, items)) / sizeof(le64_t) <= 0) {
+                if ((le64toh(o->object.size) - offsetof(EntryArrayObject, items)) % journal_file_entry_array_item_size(f) != 0 ||
+                    (le64toh(o->object.size) - offsetof(EntryArrayObject, items)) / journal_file_entry_array_item_size(f) <= 0) {
                         error(offset,
                               "Invalid object entry array size: %"PRIu64,
                               le64toh(o->object.size));
@@ -315,13 +324,13 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
-                for (i = 0; i < journal_file_entry_array_n_items(o); i++)
-                        if (le64toh(o->entry_array.items[i]) != 0 &&
-                            !VALID64(le64toh(o->entry_array.items[i]))) {
+                for (i = 0; i < journal_file_entry_array_n_items(f, o); i++)
+                        if (journal_file_entry_array_item(f, o, i) != 0 &&
+                            !VALID64(journal_file_entry_array_item(f, o, i))) {
                                 error(offset,
                                       "Invalid object entry array item (%"PRIu64"/%"PRIu64"): "OFSfmt,
-                                      i, journal_file_entry_array_n_items(o),
-                                      le64toh(o->entry_array.items[i]));
+                                      i, journal_file_entry_array_n_items(f, o),
+                                      journal_file_entry_array_item(f, o, i));
                                 return -EBADMSG;
                         }
 
@@ -342,6 +351,31 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) - offsetof(DictionaryObject, payload) <= 0) {
+                        error(offset, "Bad object size (<= %zu): %"PRIu64,
+                              offsetof(DictionaryObject, payload),
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                if (le64toh(o->object.size) - offsetof(BloomFilterObject, bits) <= 0) {
+                        error(offset, "Bad object size (<= %zu): %"PRIu64,
+                              offsetof(BloomFilterObject, bits),
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le64toh(o->bloom_filter.n_hashes) <= 0) {
+                        error(offset, "Bloom filter without hashes");
+                        return -EBADMSG;
+                }
+
                 break;
         }
 
@@ -445,10 +479,10 @@ static int entry_points_to_data(
                 if (r < 0)
                         return r;
 
-                m = journal_file_entry_array_n_items(o);
+                m = journal_file_entry_array_n_items(f, o);
                 u = MIN(n - i, m);
 
-                if (entry_p <= le64toh(o->entry_array.items[u-1])) {
+                if (entry_p <= journal_file_entry_array_item(f, o, u-1)) {
                         uint64_t x, y, z;
 
                         x = 0;
@@ -457,13 +491,13 @@ static int entry_points_to_data(
                         while (x < y) {
                                 z = (x + y) / 2;
 
-                                if (le64toh(o->entry_array.items[z]) == entry_p)
+                                if (journal_file_entry_array_item(f, o, z) == entry_p)
                                         return 0;
 
                                 if (x + 1 >= y)
                                         break;
 
-                                if (entry_p < le64toh(o->entry_array.items[z]))
+                                if (entry_p < journal_file_entry_array_item(f, o, z))
                                         y = z;
                                 else
                                         x = z;
@@ -538,10 +572,10 @@ static int verify_data(
                         return -EBADMSG;
                 }
 
-                m = journal_file_entry_array_n_items(o);
+                m = journal_file_entry_array_n_items(f, o);
                 for (j = 0; i < n && j < m; i++, j++) {
 
-                        q = le64toh(o->entry_array.items[j]);
+                        q = journal_file_entry_array_item(f, o, j);
                         if (q <= last) {
                                 error(p, "Data object's entry array not sorted");
                                 return -EBADMSG;
@@ -761,11 +795,11 @@ static int verify_entry_array(
                         return -EBADMSG;
                 }
 
-                m = journal_file_entry_array_n_items(o);
+                m = journal_file_entry_array_n_items(f, o);
                 for (j = 0; i < n && j < m; i++, j++) {
                         uint64_t p;
 
-                        p = le64toh(o->entry_array.items[j]);
+                        p = journal_file_entry_array_item(f, o, j);
                         if (p <= last) {
                                 error(a, "Entry array not sorted at %"PRIu64" of %"PRIu64, i, n);
                                 return -EBADMSG;
@@ -797,6 +831,227 @@ static int verify_entry_array(
         return 0;
 }
 
+typedef struct DataHashWorker {
+        const uint8_t *map;
+        uint64_t map_size;
+        const void *dictionary;
+        size_t dictionary_size;
+
+        /* For files using the keyed hash: the file ID */
+        bool keyed_hash;
+        sd_id128_t hash_key;
+
+        const uint64_t *offsets;
+        uint64_t first, end;
+
+        pthread_t thread;
+
+        /* The first data object that failed verification, if any */
+        uint64_t failed_offset;
+        int error;
+} DataHashWorker;
+
+static uint64_t data_hash(DataHashWorker *w, const void *data, size_t size) {
+        /* Like journal_file_hash_data(), but without touching the JournalFile object, which belongs to the main
+         * thread */
+        return w->keyed_hash ? siphash24(data, size, w->hash_key.bytes) : hash64(data, size);
+}
+
+static int data_hash_check(DataHashWorker *w, CompressDictionary *d, uint64_t p, void **buffer, size_t *buffer_size) {
+        const Object *o;
+        uint64_t l, h;
+        int compression, r;
+
+        o = (const Object*) (w->map + p);
+        l = le64toh(o->object.size) - offsetof(Object, data.payload);
+
+        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+        if (compression) {
+                size_t rsize;
+
+                r = decompress_blob_dictionary(d, compression, o->data.payload, l, buffer, buffer_size, &rsize, 0);
+                if (r < 0)
+                        return r;
+
+                h = data_hash(w, *buffer, rsize);
+        } else
+                h = data_hash(w, o->data.payload, l);
+
+        return h == le64toh(o->data.hash) ? 0 : -EBADMSG;
+}
+
+static void *data_hash_thread(void *p) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ void *buffer = NULL;
+        DataHashWorker *w = p;
+        size_t buffer_size = 0;
+        uint64_t i;
+        int r;
+
+        if (w->dictionary) {
+                r = compress_dictionary_new(w->dictionary, w->dictionary_size, &d);
+                if (r < 0) {
+                        w->error = r;
+                        return NULL;
+                }
+        }
+
+        for (i = w->first; i < w->end; i++) {
+                uint64_t q = w->offsets[i];
+
+                /* Objects appended after we mapped the file were already checked in the first pass */
+                if (q > w->map_size - sizeof(ObjectHeader) ||
+                    le64toh(((const Object*) (w->map + q))->object.size) > w->map_size - q)
+                        continue;
+
+                r = data_hash_check(w, d, q, &buffer, &buffer_size);
+                if (r < 0) {
+                        w->failed_offset = q;
+                        w->error = r;
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+static unsigned verify_n_threads(uint64_t size) {
+        const char *e;
+        unsigned n;
+        long c;
+
+        e = getenv("SYSTEMD_JOURNAL_VERIFY_THREADS");
+        if (e && safe_atou(e, &n) >= 0 && n > 0)
+                return MIN(n, VERIFY_THREADS_MAX);
+
+        if (size < VERIFY_PARALLEL_MIN_SIZE)
+                return 1;
+
+        c = sysconf(_SC_NPROCESSORS_ONLN);
+        if (c <= 1)
+                return 1;
+
+        return MIN((unsigned) c, VERIFY_THREADS_MAX);
+}
+
+static int verify_data_hashes(
+                JournalFile *f,
+                const uint8_t *map, uint64_t map_size,
+                int data_fd, uint64_t n_data,
+                unsigned n_threads,
+                uint64_t *ret_offset) {
+
+        DataHashWorker *workers;
+        const void *dictionary = NULL;
+        size_t dictionary_size = 0;
+        uint64_t *offsets, failed = UINT64_MAX;
+        sigset_t ss, saved_ss;
+        unsigned i, n_started = 0;
+        int r = 0;
+
+        assert(f);
+        assert(map);
+        assert(n_threads > 1);
+        assert(ret_offset);
+
+        /* Recalculates the hashes of all data objects found in the first pass, which means decompressing
+         * them, and is hence the most expensive part of the verification. Each data object can be checked
+         * on its own, so we split the list of offsets among a number of threads, each reading the file
+         * through a read-only mapping of its own rather than the (single-threaded) mmap cache. */
+
+        if (n_data == 0)
+                return 0;
+
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                const Object *o;
+                uint64_t p;
+
+                p = le64toh(f->header->dictionary_offset);
+                if (p == 0 || p > map_size - sizeof(ObjectHeader))
+                        return -EBADMSG;
+
+                o = (const Object*) (map + p);
+                if (le64toh(o->object.size) > map_size - p ||
+                    le64toh(o->object.size) < offsetof(Object, dictionary.payload))
+                        return -EBADMSG;
+
+                dictionary = o->dictionary.payload;
+                dictionary_size = le64toh(o->object.size) - offsetof(Object, dictionary.payload);
+        }
+
+        offsets = mmap(NULL, n_data * sizeof(uint64_t), PROT_READ, MAP_SHARED, data_fd, 0);
+        if (offsets == MAP_FAILED)
+                return log_error_errno(errno, "Failed to map data object list: %m");
+
+        workers = new0(DataHashWorker, n_threads);
+        if (!workers) {
+                r = log_oom();
+                goto finish;
+        }
+
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                r = -r;
+                goto finish;
+        }
+
+        for (i = 0; i < n_threads; i++) {
+                workers[i] = (DataHashWorker) {
+                        .map = map,
+                        .map_size = map_size,
+                        .dictionary = dictionary,
+                        .dictionary_size = dictionary_size,
+                        .keyed_hash = JOURNAL_HEADER_KEYED_HASH(f->header),
+                        .hash_key = f->header->file_id,
+                        .offsets = offsets,
+                        .first = n_data * i / n_threads,
+                        .end = n_data * (i + 1) / n_threads,
+                };
+
+                r = pthread_create(&workers[i].thread, NULL, data_hash_thread, workers + i);
+                if (r > 0) {
+                        r = log_error_errno(r, "Failed to start verification thread: %m");
+                        break;
+                }
+
+                n_started++;
+        }
+
+        (void) pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+
+        for (i = 0; i < n_started; i++) {
+                assert_se(pthread_join(workers[i].thread, NULL) == 0);
+
+                if (workers[i].error >= 0)
+                        continue;
+
+                /* Report the corruption closest to the beginning of the file, like a serial run would */
+                if (workers[i].failed_offset == 0) {
+                        if (r >= 0)
+                                r = workers[i].error;
+                } else if (workers[i].failed_offset < failed) {
+                        failed = workers[i].failed_offset;
+                        r = workers[i].error;
+                }
+        }
+
+        if (failed != UINT64_MAX) {
+                if (r == -EBADMSG)
+                        error(failed, "Invalid hash");
+                else
+                        error_errno(failed, r, "Decompression failed: %m");
+
+                *ret_offset = failed;
+        }
+
+finish:
+        free(workers);
+        (void) munmap(offsets, n_data * sizeof(uint64_t));
+
+        return r;
+}
+
 int journal_file_verify(
                 JournalFile *f,
                 const char *key,
@@ -808,14 +1063,16 @@ int journal_file_verify(
 
         uint64_t entry_seqnum = 0, entry_monotonic = 0, entry_realtime = 0;
         sd_id128_t entry_boot_id;
-        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
+        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false, found_dictionary = false, found_bloom_filter = false;
         uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
         usec_t last_usec = 0;
         int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
         MMapFileDescriptor *cache_data_fd = NULL, *cache_entry_fd = NULL, *cache_entry_array_fd = NULL;
-        unsigned i;
+        unsigned i, n_threads;
         bool found_last = false;
         const char *tmp_dir = NULL;
+        uint8_t *map = MAP_FAILED;
+        uint64_t map_size = 0;
 
 #if HAVE_GCRYPT
         uint64_t last_tag = 0;
@@ -891,6 +1148,19 @@ int journal_file_verify(
                         goto fail;
                 }
 
+        /* If we can use multiple threads, leave the (expensive) data hash checks for later, and do them in
+         * parallel once we know where all data objects are. */
+        n_threads = verify_n_threads(f->last_stat.st_size);
+        if (n_threads > 1 && (uint64_t) f->last_stat.st_size <= SIZE_MAX) {
+                map_size = f->last_stat.st_size;
+                map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, f->fd, 0);
+                if (map == MAP_FAILED) {
+                        log_debug_errno(errno, "Failed to map %s, verifying with a single thread: %m", f->path);
+                        n_threads = 1;
+                }
+        } else
+                n_threads = 1;
+
         /* First iteration: we go through all objects, verify the
          * superficial structure, headers, hashes. */
 
@@ -917,14 +1187,15 @@ int journal_file_verify(
 
                 n_objects++;
 
-                r = journal_file_object_verify(f, p, o);
+                r = journal_file_object_verify(f, p, o,
+                                               n_threads <= 1 || p + le64toh(o->object.size) > map_size);
                 if (r < 0) {
                         error_errno(p, r, "Invalid object contents: %m");
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
-                    (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
+                if (!IN_SET(o->object.flags & OBJECT_COMPRESSION_MASK,
+                            0, OBJECT_COMPRESSED_XZ, OBJECT_COMPRESSED_LZ4, OBJECT_COMPRESSED_ZSTD)) {
                         error(p, "Objected with double compression");
                         r = -EINVAL;
                         goto fail;
@@ -942,6 +1213,12 @@ int journal_file_verify(
                         goto fail;
                 }
 
+                if ((o->object.flags & OBJECT_COMPRESSED_ZSTD) && !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                        error(p, "ZSTD compressed object in file without ZSTD compression");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
@@ -949,6 +1226,15 @@ int journal_file_verify(
                         if (r < 0)
                                 goto fail;
 
+                        r = journal_file_bloom_filter_check(f, le64toh(o->data.hash));
+                        if (r < 0)
+                                goto fail;
+                        if (r == 0) {
+                                error(p, "Data object missing from Bloom filter");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
                         n_data++;
                         break;
 
@@ -1155,6 +1441,28 @@ int journal_file_verify(
                         n_tags++;
                         break;
 
+                case OBJECT_DICTIONARY:
+                        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+                            p != le64toh(f->header->dictionary_offset)) {
+                                error(p, "Dictionary object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_dictionary = true;
+                        break;
+
+                case OBJECT_BLOOM_FILTER:
+                        if (!JOURNAL_HEADER_BLOOM_FILTER(f->header) ||
+                            p != le64toh(f->header->bloom_filter_offset)) {
+                                error(p, "Bloom filter object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_bloom_filter = true;
+                        break;
+
                 default:
                         n_weird++;
                 }
@@ -1219,6 +1527,18 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (!found_dictionary && JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                error(offsetof(Header, dictionary_offset), "Missing dictionary");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (!found_bloom_filter && JOURNAL_HEADER_BLOOM_FILTER(f->header)) {
+                error(offsetof(Header, bloom_filter_offset), "Missing Bloom filter");
+                r = -EBADMSG;
+                goto fail;
+        }
+
         if (entry_seqnum_set &&
             entry_seqnum != le64toh(f->header->tail_entry_seqnum)) {
                 error(offsetof(Header, tail_entry_seqnum), "Invalid tail seqnum");
@@ -1240,6 +1560,15 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (n_threads > 1) {
+                r = verify_data_hashes(f, map, map_size, data_fd, n_data, n_threads, &p);
+                if (r < 0)
+                        goto fail;
+
+                (void) munmap(map, map_size);
+                map = MAP_FAILED;
+        }
+
         /* Second iteration: we follow all objects referenced from the
          * two entry points: the object hash table and the entry
          * array. We also check that everything referenced (directly
@@ -1314,5 +1643,8 @@ fail:
         if (cache_entry_array_fd)
                 mmap_cache_free_fd(f->mmap, cache_entry_array_fd);
 
+        if (map != MAP_FAILED)
+                (void) munmap(map, map_size);
+
         return r;
 }
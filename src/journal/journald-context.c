@@ -13,6 +13,7 @@
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "string-util.h"
 #include "syslog-util.h"
@@ -44,6 +45,16 @@
  *    stream connection. This should improve cases where a service process logs immediately before exiting and we
  *    previously had trouble associating the log message with the service.
  *
+ * Refreshing is done lazily: when a cache entry is used that is older than 1s (but not older than 5s) we use it as it
+ * is for the message at hand, and queue it for a refresh that is run from a low-priority event source, i.e. once
+ * there's a lull in the stream of incoming messages. Under sustained load entries hence age up to 5s, at which point
+ * they are refreshed synchronously again.
+ *
+ * Moreover, metadata that is read per unit rather than per process (i.e. the invocation ID, the maximum log level
+ * and the extra log fields, which PID 1 stores in /run/systemd/units/) is shared between all cache entries of
+ * processes in the same cgroup: if another entry of the same cgroup has been refreshed recently, we copy the data
+ * from there instead of reading it again. This helps with many short-lived processes of the same unit logging.
+ *
  * NB: With and without the metadata cache: the implicitly added entry metadata in the journal (with the exception of
  *     UID/PID/GID and SELinux label) must be understood as possibly slightly out of sync (i.e. sometimes slighly older
  *     and sometimes slightly newer than what was current at the log event).
@@ -60,6 +71,9 @@
  * clients itself is limited.) */
 #define CACHE_MAX (16*1024)
 
+/* Refresh at most this many entries per iteration of the event loop when refreshing asynchronously */
+#define REFRESH_BATCH_MAX 64U
+
 static int client_context_compare(const void *a, const void *b) {
         const ClientContext *x = a, *y = b;
 
@@ -107,6 +121,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         c->timestamp = USEC_INFINITY;
         c->extra_fields_mtime = NSEC_INFINITY;
         c->log_level_max = -1;
+        c->log_rate_limit_interval = s->rate_limit_interval;
+        c->log_rate_limit_burst = s->rate_limit_burst;
 
         r = hashmap_put(s->client_contexts, PID_TO_PTR(pid), c);
         if (r < 0) {
@@ -118,9 +134,36 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         return 0;
 }
 
-static void client_context_reset(ClientContext *c) {
+static void client_context_unindex_cgroup(Server *s, ClientContext *c) {
+        assert(s);
+        assert(c);
+
+        if (c->cgroup && hashmap_get(s->client_contexts_by_cgroup, c->cgroup) == c)
+                assert_se(hashmap_remove(s->client_contexts_by_cgroup, c->cgroup) == c);
+}
+
+static void client_context_index_cgroup(Server *s, ClientContext *c) {
+        assert(s);
+        assert(c);
+
+        /* Make this entry the one others in the same cgroup copy the per-unit data from. This is only an
+         * optimization, hence ignore failures. */
+
+        if (!c->cgroup)
+                return;
+
+        if (hashmap_ensure_allocated(&s->client_contexts_by_cgroup, &string_hash_ops) < 0)
+                return;
+
+        (void) hashmap_replace(s->client_contexts_by_cgroup, c->cgroup, c);
+}
+
+static void client_context_reset(Server *s, ClientContext *c) {
+        assert(s);
         assert(c);
 
+        client_context_unindex_cgroup(s, c);
+
         c->timestamp = USEC_INFINITY;
 
         c->uid = UID_INVALID;
@@ -153,6 +196,10 @@ static void client_context_reset(ClientContext *c) {
         c->extra_fields_mtime = NSEC_INFINITY;
 
         c->log_level_max = -1;
+
+        c->log_rate_limit_interval = s->rate_limit_interval;
+        c->log_rate_limit_burst = s->rate_limit_burst;
+        c->rate_limit_group = journal_rate_limit_group_unref(c->rate_limit_group);
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -166,7 +213,9 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         if (c->in_lru)
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
-        client_context_reset(c);
+        (void) set_remove(s->client_contexts_refresh, c);
+
+        client_context_reset(s, c);
 
         return mfree(c);
 }
@@ -268,6 +317,7 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
                 return 0;
         }
 
+        client_context_unindex_cgroup(s, c);
         free_and_replace(c->cgroup, t);
 
         (void) cg_path_get_session(c->cgroup, &t);
@@ -339,6 +389,48 @@ static int client_context_read_log_level_max(
         return 0;
 }
 
+static int client_context_read_log_rate_limit_interval(
+                Server *s,
+                ClientContext *c) {
+
+        _cleanup_free_ char *value = NULL;
+        const char *p;
+        int r;
+
+        c->log_rate_limit_interval = s->rate_limit_interval;
+
+        if (!c->unit)
+                return 0;
+
+        p = strjoina("/run/systemd/units/log-rate-limit-interval:", c->unit);
+        r = readlink_malloc(p, &value);
+        if (r < 0)
+                return r;
+
+        return safe_atou64(value, &c->log_rate_limit_interval);
+}
+
+static int client_context_read_log_rate_limit_burst(
+                Server *s,
+                ClientContext *c) {
+
+        _cleanup_free_ char *value = NULL;
+        const char *p;
+        int r;
+
+        c->log_rate_limit_burst = s->rate_limit_burst;
+
+        if (!c->unit)
+                return 0;
+
+        p = strjoina("/run/systemd/units/log-rate-limit-burst:", c->unit);
+        r = readlink_malloc(p, &value);
+        if (r < 0)
+                return r;
+
+        return safe_atou(value, &c->log_rate_limit_burst);
+}
+
 static int client_context_read_extra_fields(
                 Server *s,
                 ClientContext *c) {
@@ -429,6 +521,76 @@ static int client_context_read_extra_fields(
         return 0;
 }
 
+static int client_context_copy_unit_data(ClientContext *c, const ClientContext *from) {
+        assert(c);
+        assert(from);
+
+        c->invocation_id = from->invocation_id;
+        c->log_level_max = from->log_level_max;
+        c->log_rate_limit_interval = from->log_rate_limit_interval;
+        c->log_rate_limit_burst = from->log_rate_limit_burst;
+
+        if (c->extra_fields_mtime == from->extra_fields_mtime)
+                return 0;
+
+        if (from->extra_fields_n_iovec > 0) {
+                _cleanup_free_ struct iovec *iovec = NULL;
+                _cleanup_free_ void *data = NULL;
+                const struct iovec *last;
+                size_t i, size;
+
+                /* The fields are stored back-to-back in the data blob, see client_context_read_extra_fields() */
+                last = from->extra_fields_iovec + from->extra_fields_n_iovec - 1;
+                size = (const uint8_t*) last->iov_base + last->iov_len - (const uint8_t*) from->extra_fields_data;
+
+                data = memdup(from->extra_fields_data, size);
+                if (!data)
+                        return -ENOMEM;
+
+                iovec = newdup(struct iovec, from->extra_fields_iovec, from->extra_fields_n_iovec);
+                if (!iovec)
+                        return -ENOMEM;
+
+                for (i = 0; i < from->extra_fields_n_iovec; i++)
+                        iovec[i].iov_base = (uint8_t*) data + ((const uint8_t*) iovec[i].iov_base - (const uint8_t*) from->extra_fields_data);
+
+                free_and_replace(c->extra_fields_iovec, iovec);
+                free_and_replace(c->extra_fields_data, data);
+        } else {
+                c->extra_fields_iovec = mfree(c->extra_fields_iovec);
+                c->extra_fields_data = mfree(c->extra_fields_data);
+        }
+
+        c->extra_fields_n_iovec = from->extra_fields_n_iovec;
+        c->extra_fields_mtime = from->extra_fields_mtime;
+
+        return 0;
+}
+
+static ClientContext* client_context_find_sibling(Server *s, ClientContext *c, usec_t timestamp) {
+        ClientContext *sibling;
+
+        assert(s);
+        assert(c);
+
+        /* Returns another cache entry for the same cgroup whose per-unit data is recent enough to be used as is */
+
+        if (!c->cgroup || !c->unit)
+                return NULL;
+
+        sibling = hashmap_get(s->client_contexts_by_cgroup, c->cgroup);
+        if (!sibling || sibling == c)
+                return NULL;
+
+        if (sibling->timestamp == USEC_INFINITY || sibling->timestamp + REFRESH_USEC < timestamp)
+                return NULL;
+
+        if (!streq_ptr(sibling->unit, c->unit))
+                return NULL;
+
+        return sibling;
+}
+
 static void client_context_really_refresh(
                 Server *s,
                 ClientContext *c,
@@ -437,6 +599,8 @@ static void client_context_really_refresh(
                 const char *unit_id,
                 usec_t timestamp) {
 
+        ClientContext *sibling;
+
         assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
@@ -452,18 +616,89 @@ static void client_context_really_refresh(
         (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
 
         (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
+
+        sibling = client_context_find_sibling(s, c, timestamp);
+        if (!sibling || client_context_copy_unit_data(c, sibling) < 0) {
+                (void) client_context_read_invocation_id(s, c);
+                (void) client_context_read_log_level_max(s, c);
+                (void) client_context_read_log_rate_limit_interval(s, c);
+                (void) client_context_read_log_rate_limit_burst(s, c);
+                (void) client_context_read_extra_fields(s, c);
+        }
 
         c->timestamp = timestamp;
 
+        client_context_index_cgroup(s, c);
+        (void) set_remove(s->client_contexts_refresh, c);
+
         if (c->in_lru) {
                 assert(c->n_ref == 0);
                 assert_se(prioq_reshuffle(s->client_contexts_lru, c, &c->lru_index) >= 0);
         }
 }
 
+static int on_refresh(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+        ClientContext *c;
+        unsigned n = 0;
+        usec_t ts;
+
+        assert(s);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        while (n < REFRESH_BATCH_MAX && (c = set_steal_first(s->client_contexts_refresh))) {
+
+                /* Might have been refreshed synchronously in the meantime */
+                if (c->timestamp != USEC_INFINITY && c->timestamp + REFRESH_USEC >= ts)
+                        continue;
+
+                client_context_really_refresh(s, c, NULL, NULL, 0, NULL, ts);
+                n++;
+        }
+
+        if (!set_isempty(s->client_contexts_refresh))
+                return sd_event_source_set_enabled(es, SD_EVENT_ONESHOT);
+
+        return 0;
+}
+
+static int client_context_queue_refresh(Server *s, ClientContext *c) {
+        int r;
+
+        assert(s);
+        assert(c);
+
+        if (!s->event)
+                return -EOPNOTSUPP;
+
+        r = set_ensure_allocated(&s->client_contexts_refresh, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(s->client_contexts_refresh, c);
+        if (r <= 0)
+                return r;
+
+        if (s->client_contexts_refresh_event_source)
+                r = sd_event_source_set_enabled(s->client_contexts_refresh_event_source, SD_EVENT_ONESHOT);
+        else {
+                r = sd_event_add_defer(s->event, &s->client_contexts_refresh_event_source, on_refresh, s);
+                if (r >= 0) {
+                        /* Only refresh when there's nothing else to do */
+                        r = sd_event_source_set_priority(s->client_contexts_refresh_event_source, SD_EVENT_PRIORITY_IDLE);
+                        if (r >= 0)
+                                r = sd_event_source_set_enabled(s->client_contexts_refresh_event_source, SD_EVENT_ONESHOT);
+                }
+        }
+        if (r < 0) {
+                (void) set_remove(s->client_contexts_refresh, c);
+                return r;
+        }
+
+        return 0;
+}
+
 void client_context_maybe_refresh(
                 Server *s,
                 ClientContext *c,
@@ -485,12 +720,13 @@ void client_context_maybe_refresh(
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
          * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
         if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
-                client_context_reset(c);
+                client_context_reset(s, c);
                 goto refresh;
         }
 
-        /* If the data is older than the lower limit, we refresh, but keep the old data for all we can't update */
-        if (c->timestamp + REFRESH_USEC < timestamp)
+        /* Pinned data older than the upper limit is refreshed right-away, too, but we keep the old data for all we can't
+         * update */
+        if (c->timestamp + MAX_USEC < timestamp)
                 goto refresh;
 
         /* If the data passed along doesn't match the cached data we also do a refresh */
@@ -503,6 +739,12 @@ void client_context_maybe_refresh(
         if (label_size > 0 && (label_size != c->label_size || memcmp(label, c->label, label_size) != 0))
                 goto refresh;
 
+        /* If the data is older than the lower limit, we use it for now, but refresh it once we have the time. If we
+         * can't queue it, refresh immediately. */
+        if (c->timestamp + REFRESH_USEC < timestamp &&
+            client_context_queue_refresh(s, c) < 0)
+                goto refresh;
+
         return;
 
 refresh:
@@ -544,9 +786,14 @@ void client_context_flush_all(Server *s) {
 
         assert(prioq_size(s->client_contexts_lru) == 0);
         assert(hashmap_size(s->client_contexts) == 0);
+        assert(hashmap_size(s->client_contexts_by_cgroup) == 0);
+        assert(set_size(s->client_contexts_refresh) == 0);
 
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+        s->client_contexts_by_cgroup = hashmap_free(s->client_contexts_by_cgroup);
+        s->client_contexts_refresh = set_free(s->client_contexts_refresh);
+        s->client_contexts_refresh_event_source = sd_event_source_unref(s->client_contexts_refresh_event_source);
 }
 
 static int client_context_get_internal(
@@ -8,6 +8,7 @@
 
 typedef struct ClientContext ClientContext;
 
+#include "journald-rate-limit.h"
 #include "journald-server.h"
 
 struct ClientContext {
@@ -45,6 +46,10 @@ struct ClientContext {
 
         int log_level_max;
 
+        usec_t log_rate_limit_interval;
+        unsigned log_rate_limit_burst;
+        JournalRateLimitGroup *rate_limit_group;
+
         struct iovec *extra_fields_iovec;
         size_t extra_fields_n_iovec;
         void *extra_fields_data;
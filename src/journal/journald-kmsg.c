@@ -10,18 +10,44 @@
 #include "sd-messages.h"
 
 #include "alloc-util.h"
+#include "device-private.h"
 #include "device-util.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "journald-kmsg.h"
 #include "journald-server.h"
 #include "journald-syslog.h"
+#include "libudev-private.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
+
+/* How many records to read from /dev/kmsg per wakeup, before we give the other event sources a chance */
+#define KMSG_READ_MAX 64U
+
+/* How many devices to remember the udev properties of */
+#define KMSG_DEVICES_MAX 1024U
+
+typedef struct KmsgDevice {
+        char *id;
+        char **fields;
+} KmsgDevice;
+
+static KmsgDevice* kmsg_device_free(KmsgDevice *d) {
+        if (!d)
+                return NULL;
+
+        free(d->id);
+        strv_free(d->fields);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KmsgDevice*, kmsg_device_free);
 
 void server_forward_kmsg(
         Server *s,
@@ -94,9 +120,167 @@ static bool is_us(const char *identifier, const char *pid) {
                streq(identifier, program_invocation_short_name);
 }
 
+static int dispatch_udev(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        Server *s = userdata;
+        const char *id;
+        int r;
+
+        assert(s);
+
+        r = udev_monitor_receive_sd_device(s->udev_monitor, &d);
+        if (r < 0) {
+                if (IN_SET(r, -EAGAIN, -EINTR))
+                        return 0;
+
+                /* We might have lost events, hence we can't trust anything we cached anymore */
+                log_debug_errno(r, "Failed to receive udev event, flushing device cache: %m");
+                hashmap_clear_with_destructor(s->kmsg_devices, kmsg_device_free);
+                return 0;
+        }
+
+        if (device_get_id_filename(d, &id) < 0)
+                return 0;
+
+        kmsg_device_free(hashmap_remove(s->kmsg_devices, id));
+        return 0;
+}
+
+static int server_open_udev_monitor(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (s->udev_monitor)
+                return 0;
+
+        s->udev_monitor = udev_monitor_new_from_netlink(NULL, "udev");
+        if (!s->udev_monitor)
+                return -errno;
+
+        r = udev_monitor_enable_receiving(s->udev_monitor);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_add_io(s->event, &s->udev_event_source, udev_monitor_get_fd(s->udev_monitor), EPOLLIN, dispatch_udev, s);
+        if (r < 0)
+                goto fail;
+
+        /* Process invalidations before the kernel messages that might refer to the changed devices */
+        r = sd_event_source_set_priority(s->udev_event_source, SD_EVENT_PRIORITY_IMPORTANT+5);
+        if (r < 0)
+                goto fail;
+
+        (void) sd_event_source_set_description(s->udev_event_source, "udev");
+
+        return 0;
+
+fail:
+        s->udev_event_source = sd_event_source_unref(s->udev_event_source);
+        s->udev_monitor = udev_monitor_unref(s->udev_monitor);
+        return r;
+}
+
+void server_free_kmsg_devices(Server *s) {
+        assert(s);
+
+        s->kmsg_devices = hashmap_free_with_destructor(s->kmsg_devices, kmsg_device_free);
+        s->udev_event_source = sd_event_source_unref(s->udev_event_source);
+        s->udev_monitor = udev_monitor_unref(s->udev_monitor);
+}
+
+static KmsgDevice* kmsg_device_new(const char *id) {
+        _cleanup_(kmsg_device_freep) KmsgDevice *k = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        const char *g;
+        size_t j = 0;
+        char *b;
+
+        assert(id);
+
+        k = new0(KmsgDevice, 1);
+        if (!k)
+                return NULL;
+
+        k->id = strdup(id);
+        if (!k->id)
+                return NULL;
+
+        /* A device that doesn't exist (yet) is remembered too, udev will tell us when it shows up */
+        if (sd_device_new_from_device_id(&d, id) < 0)
+                return TAKE_PTR(k);
+
+        if (sd_device_get_devname(d, &g) >= 0) {
+                b = strappend("_UDEV_DEVNODE=", g);
+                if (!b || strv_consume(&k->fields, b) < 0)
+                        return NULL;
+        }
+
+        if (sd_device_get_sysname(d, &g) >= 0) {
+                b = strappend("_UDEV_SYSNAME=", g);
+                if (!b || strv_consume(&k->fields, b) < 0)
+                        return NULL;
+        }
+
+        FOREACH_DEVICE_DEVLINK(d, g) {
+
+                if (j >= N_IOVEC_UDEV_FIELDS - 2)
+                        break;
+
+                b = strappend("_UDEV_DEVLINK=", g);
+                if (!b || strv_consume(&k->fields, b) < 0)
+                        return NULL;
+
+                j++;
+        }
+
+        return TAKE_PTR(k);
+}
+
+static KmsgDevice* server_get_kmsg_device(Server *s, const char *id, KmsgDevice **uncached) {
+        KmsgDevice *k;
+        bool cache;
+
+        assert(s);
+        assert(id);
+        assert(uncached);
+
+        /* Returns the udev properties of the device. If they can't be cached, they are returned in *uncached
+         * too, and the caller has to free them. */
+
+        k = hashmap_get(s->kmsg_devices, id);
+        if (k)
+                return k;
+
+        /* Without udev events we wouldn't notice changes, hence don't cache anything then. Subscribe before
+         * looking at the device, so that we don't miss a change in between. */
+        cache = server_open_udev_monitor(s) >= 0 &&
+                hashmap_ensure_allocated(&s->kmsg_devices, &string_hash_ops) >= 0;
+
+        k = kmsg_device_new(id);
+        if (!k)
+                return NULL;
+
+        if (!cache) {
+                *uncached = k;
+                return k;
+        }
+
+        if (hashmap_size(s->kmsg_devices) >= KMSG_DEVICES_MAX)
+                hashmap_clear_with_destructor(s->kmsg_devices, kmsg_device_free);
+
+        if (hashmap_put(s->kmsg_devices, k->id, k) < 0) {
+                *uncached = k;
+                return k;
+        }
+
+        return k;
+}
+
 static void dev_kmsg_record(Server *s, char *p, size_t l) {
 
         _cleanup_free_ char *message = NULL, *syslog_priority = NULL, *syslog_pid = NULL, *syslog_facility = NULL, *syslog_identifier = NULL, *source_time = NULL, *identifier = NULL, *pid = NULL;
+        _cleanup_(kmsg_device_freep) KmsgDevice *uncached = NULL;
         struct iovec iovec[N_IOVEC_META_FIELDS + 7 + N_IOVEC_KERNEL_FIELDS + 2 + N_IOVEC_UDEV_FIELDS];
         char *kernel_device = NULL;
         unsigned long long usec;
@@ -210,42 +394,16 @@ static void dev_kmsg_record(Server *s, char *p, size_t l) {
         }
 
         if (kernel_device) {
-                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
-
-                if (sd_device_new_from_device_id(&d, kernel_device) >= 0) {
-                        const char *g;
-                        char *b;
-
-                        if (sd_device_get_devname(d, &g) >= 0) {
-                                b = strappend("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        if (sd_device_get_sysname(d, &g) >= 0) {
-                                b = strappend("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        FOREACH_DEVICE_DEVLINK(d, g) {
-
-                                if (j > N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                b = strappend("_UDEV_DEVLINK=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-
-                                j++;
-                        }
+                KmsgDevice *d;
+
+                /* The fields are owned by the device cache (or 'uncached'), hence they are not counted
+                 * in 'z', and are not freed below. */
+                d = server_get_kmsg_device(s, kernel_device, &uncached);
+                if (d) {
+                        char **field;
+
+                        STRV_FOREACH(field, d->fields)
+                                iovec[n++] = IOVEC_MAKE_STRING(*field);
                 }
         }
 
@@ -349,6 +507,8 @@ int server_flush_dev_kmsg(Server *s) {
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        unsigned i;
+        int r;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -360,7 +520,15 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Every read() returns a single record. Pick up a batch of them at once, so that we keep up with message
+         * storms, but not all of them, so that we don't starve the other event sources. */
+        for (i = 0; i < KMSG_READ_MAX; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
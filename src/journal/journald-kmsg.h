@@ -5,6 +5,7 @@
 
 int server_open_dev_kmsg(Server *s);
 int server_flush_dev_kmsg(Server *s);
+void server_free_kmsg_devices(Server *s);
 
 void server_forward_kmsg(Server *s, int priority, const char *identifier, const char *message, const struct ucred *ucred);
 
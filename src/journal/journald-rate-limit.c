@@ -7,12 +7,10 @@
 #include "hashmap.h"
 #include "journald-rate-limit.h"
 #include "list.h"
-#include "random-util.h"
 #include "string-util.h"
 #include "util.h"
 
 #define POOLS_MAX 5
-#define BUCKETS_MAX 127
 #define GROUPS_MAX 2047
 
 static const int priority_map[] = {
@@ -27,79 +25,96 @@ static const int priority_map[] = {
 };
 
 typedef struct JournalRateLimitPool JournalRateLimitPool;
-typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
 struct JournalRateLimitPool {
-        usec_t begin;
-        unsigned num;
+        /* The point in time at which the token bucket is full again */
+        usec_t full;
         unsigned suppressed;
 };
 
 struct JournalRateLimitGroup {
+        unsigned n_ref;
         JournalRateLimit *parent;
 
         char *id;
         JournalRateLimitPool pools[POOLS_MAX];
-        uint64_t hash;
 
-        LIST_FIELDS(JournalRateLimitGroup, bucket);
         LIST_FIELDS(JournalRateLimitGroup, lru);
 };
 
 struct JournalRateLimit {
-        usec_t interval;
-        unsigned burst;
-
-        JournalRateLimitGroup* buckets[BUCKETS_MAX];
+        Hashmap *groups;
         JournalRateLimitGroup *lru, *lru_tail;
-
-        unsigned n_groups;
-
-        uint8_t hash_key[16];
 };
 
-JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst) {
+JournalRateLimit *journal_rate_limit_new(void) {
         JournalRateLimit *r;
 
-        assert(interval > 0 || burst == 0);
-
         r = new0(JournalRateLimit, 1);
         if (!r)
                 return NULL;
 
-        r->interval = interval;
-        r->burst = burst;
-
-        random_bytes(r->hash_key, sizeof(r->hash_key));
+        r->groups = hashmap_new(&string_hash_ops);
+        if (!r->groups)
+                return mfree(r);
 
         return r;
 }
 
-static void journal_rate_limit_group_free(JournalRateLimitGroup *g) {
+static void journal_rate_limit_group_detach(JournalRateLimitGroup *g) {
         assert(g);
 
-        if (g->parent) {
-                assert(g->parent->n_groups > 0);
+        if (!g->parent)
+                return;
 
-                if (g->parent->lru_tail == g)
-                        g->parent->lru_tail = g->lru_prev;
+        if (g->parent->lru_tail == g)
+                g->parent->lru_tail = g->lru_prev;
 
-                LIST_REMOVE(lru, g->parent->lru, g);
-                LIST_REMOVE(bucket, g->parent->buckets[g->hash % BUCKETS_MAX], g);
+        LIST_REMOVE(lru, g->parent->lru, g);
+        assert_se(hashmap_remove(g->parent->groups, g->id) == g);
 
-                g->parent->n_groups--;
-        }
+        g->parent = NULL;
+}
+
+static void journal_rate_limit_group_free(JournalRateLimitGroup *g) {
+        assert(g);
+
+        journal_rate_limit_group_detach(g);
 
         free(g->id);
         free(g);
 }
 
+JournalRateLimitGroup *journal_rate_limit_group_unref(JournalRateLimitGroup *g) {
+        if (!g)
+                return NULL;
+
+        assert(g->n_ref > 0);
+        g->n_ref--;
+
+        /* Groups that are still part of a rate limit object are kept around until they are vacuumed, so that
+         * their state survives the client context going away. */
+        if (g->n_ref <= 0 && !g->parent)
+                journal_rate_limit_group_free(g);
+
+        return NULL;
+}
+
 void journal_rate_limit_free(JournalRateLimit *r) {
+        JournalRateLimitGroup *g;
+
         assert(r);
 
-        while (r->lru)
-                journal_rate_limit_group_free(r->lru);
+        /* Groups that are still referenced by a client context are merely detached, they are freed when the
+         * last reference is dropped. */
+        while ((g = r->lru)) {
+                if (g->n_ref > 0)
+                        journal_rate_limit_group_detach(g);
+                else
+                        journal_rate_limit_group_free(g);
+        }
 
+        hashmap_free(r->groups);
         free(r);
 }
 
@@ -109,26 +124,33 @@ _pure_ static bool journal_rate_limit_group_expired(JournalRateLimitGroup *g, us
         assert(g);
 
         for (i = 0; i < POOLS_MAX; i++)
-                if (g->pools[i].begin + g->parent->interval >= ts)
+                if (g->pools[i].full > ts)
                         return false;
 
         return true;
 }
 
 static void journal_rate_limit_vacuum(JournalRateLimit *r, usec_t ts) {
+        JournalRateLimitGroup *g, *prev;
+
         assert(r);
 
-        /* Makes room for at least one new item, but drop all
-         * expored items too. */
+        /* Makes room for at least one new item, but drop all expired items too. Groups that are cached in a
+         * client context are skipped, their number is bounded by the size of the context cache. */
+
+        for (g = r->lru_tail; g; g = prev) {
+                prev = g->lru_prev;
 
-        while (r->n_groups >= GROUPS_MAX ||
-               (r->lru_tail && journal_rate_limit_group_expired(r->lru_tail, ts)))
-                journal_rate_limit_group_free(r->lru_tail);
+                if (hashmap_size(r->groups) < GROUPS_MAX && !journal_rate_limit_group_expired(g, ts))
+                        break;
+
+                if (g->n_ref <= 0)
+                        journal_rate_limit_group_free(g);
+        }
 }
 
 static JournalRateLimitGroup* journal_rate_limit_group_new(JournalRateLimit *r, const char *id, usec_t ts) {
         JournalRateLimitGroup *g;
-        struct siphash state;
 
         assert(r);
         assert(id);
@@ -141,17 +163,14 @@ static JournalRateLimitGroup* journal_rate_limit_group_new(JournalRateLimit *r,
         if (!g->id)
                 goto fail;
 
-        siphash24_init(&state, r->hash_key);
-        string_hash_func(g->id, &state);
-        g->hash = siphash24_finalize(&state);
-
         journal_rate_limit_vacuum(r, ts);
 
-        LIST_PREPEND(bucket, r->buckets[g->hash % BUCKETS_MAX], g);
+        if (hashmap_put(r->groups, g->id, g) < 0)
+                goto fail;
+
         LIST_PREPEND(lru, r->lru, g);
         if (!g->lru_next)
                 r->lru_tail = g;
-        r->n_groups++;
 
         g->parent = r;
         return g;
@@ -189,13 +208,53 @@ static unsigned burst_modulate(unsigned burst, uint64_t available) {
         return burst;
 }
 
-int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available) {
-        uint64_t h;
+static JournalRateLimitGroup* journal_rate_limit_group_get(
+                JournalRateLimit *r,
+                JournalRateLimitGroup **cache,
+                const char *id,
+                usec_t ts) {
+
+        JournalRateLimitGroup *g;
+
+        assert(r);
+        assert(id);
+
+        if (cache && *cache) {
+                if ((*cache)->parent == r && streq((*cache)->id, id))
+                        return *cache;
+
+                /* The context moved to a different unit, or the rate limit object was replaced */
+                *cache = journal_rate_limit_group_unref(*cache);
+        }
+
+        g = hashmap_get(r->groups, id);
+        if (!g) {
+                g = journal_rate_limit_group_new(r, id, ts);
+                if (!g)
+                        return NULL;
+        }
+
+        if (cache) {
+                g->n_ref++;
+                *cache = g;
+        }
+
+        return g;
+}
+
+int journal_rate_limit_test(
+                JournalRateLimit *r,
+                JournalRateLimitGroup **cache,
+                const char *id,
+                usec_t rl_interval,
+                unsigned rl_burst,
+                int priority,
+                uint64_t available) {
+
         JournalRateLimitGroup *g;
         JournalRateLimitPool *p;
-        struct siphash state;
-        unsigned burst;
-        usec_t ts;
+        unsigned burst, s;
+        usec_t ts, step;
 
         assert(id);
 
@@ -204,58 +263,46 @@ int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, u
          * 0     → the log message shall be suppressed,
          * 1 + n → the log message shall be permitted, and n messages were dropped from the peer before
          * < 0   → error
+         *
+         * If 'cache' is non-NULL, it is used to remember the group for 'id' between calls, and holds a reference
+         * to it, that the caller has to drop with journal_rate_limit_group_unref() eventually.
          */
 
         if (!r)
                 return 1;
 
-        if (r->interval == 0 || r->burst == 0)
+        if (rl_interval == 0 || rl_burst == 0)
                 return 1;
 
-        burst = burst_modulate(r->burst, available);
+        burst = burst_modulate(rl_burst, available);
 
         ts = now(CLOCK_MONOTONIC);
 
-        siphash24_init(&state, r->hash_key);
-        string_hash_func(id, &state);
-        h = siphash24_finalize(&state);
-        g = r->buckets[h % BUCKETS_MAX];
-
-        LIST_FOREACH(bucket, g, g)
-                if (streq(g->id, id))
-                        break;
-
-        if (!g) {
-                g = journal_rate_limit_group_new(r, id, ts);
-                if (!g)
-                        return -ENOMEM;
-        }
+        g = journal_rate_limit_group_get(r, cache, id, ts);
+        if (!g)
+                return -ENOMEM;
 
         p = &g->pools[priority_map[priority]];
 
-        if (p->begin <= 0) {
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
-                return 1;
-        }
+        /* Every pool is a token bucket that holds up to 'burst' tokens, and gains a new one every 'step'. Instead of
+         * counting tokens, we store when the bucket is full again: taking a token moves that point forward by one
+         * step, and a message is permitted as long as that doesn't take it further than one interval into the
+         * future. This way, refilling the bucket is implicit and doesn't need any per-message bookkeeping. */
 
-        if (p->begin + r->interval < ts) {
-                unsigned s;
+        step = MAX(rl_interval / burst, 1U);
 
-                s = p->suppressed;
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
+        if (p->full < ts)
+                p->full = ts;
 
-                return 1 + s;
+        if (usec_add(p->full, step) > usec_add(ts, rl_interval)) {
+                p->suppressed++;
+                return 0;
         }
 
-        if (p->num < burst) {
-                p->num++;
-                return 1;
-        }
+        p->full = usec_add(p->full, step);
+
+        s = p->suppressed;
+        p->suppressed = 0;
 
-        p->suppressed++;
-        return 0;
+        return 1 + s;
 }
@@ -4,7 +4,9 @@
 #include "util.h"
 
 typedef struct JournalRateLimit JournalRateLimit;
+typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
-JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst);
+JournalRateLimit *journal_rate_limit_new(void);
 void journal_rate_limit_free(JournalRateLimit *r);
-int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available);
+JournalRateLimitGroup *journal_rate_limit_group_unref(JournalRateLimitGroup *g);
+int journal_rate_limit_test(JournalRateLimit *r, JournalRateLimitGroup **cache, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available);
@@ -3,6 +3,8 @@
 #if HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/signalfd.h>
@@ -74,6 +76,21 @@
  * for a bit of additional metadata. */
 #define DEFAULT_LINE_MAX (48*1024)
 
+/* Limits on the entries we queue up before writing them out in one batch */
+#define WRITE_QUEUE_ENTRIES_MAX 64U
+#define WRITE_QUEUE_SIZE_MAX (1024U*1024U)
+
+/* Sync right-away once this many clients wait for their messages to hit the disk */
+#define SYNC_ACKS_MAX 256U
+
+/* How many datagrams to pick up from a socket with a single recvmmsg() call at most, and how large the receive buffers
+ * for all but the first of them are. The latter fits what unprivileged clients can send with the default
+ * net.core.wmem_max, but privileged clients may raise their send buffer beyond that (journal-send.c forces 8M), and
+ * a datagram that doesn't fit is lost. Hence batching is suspended for a while whenever that happens. */
+#define DATAGRAM_BATCH_MAX 16U
+#define DATAGRAM_BUFFER_SIZE (256U*1024U)
+#define DATAGRAM_BATCH_SUSPEND_USEC (1*USEC_PER_MINUTE)
+
 static int determine_path_usage(Server *s, const char *path, uint64_t *ret_used, uint64_t *ret_free) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
@@ -467,6 +484,8 @@ void server_rotate(Server *s) {
 
         log_debug("Rotating...");
 
+        server_flush_write_queue(s);
+
         (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
         (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
 
@@ -487,23 +506,68 @@ void server_rotate(Server *s) {
                 }
 }
 
+static void sync_ack_fail(int fd) {
+        /* Tell the client that its message didn't make it to the disk by writing a byte before closing the fd. The
+         * pipe might be full if the client fills it itself, hence don't wait for it. */
+        (void) fd_nonblock(fd, true);
+        (void) write(fd, "\1", 1);
+        safe_close(fd);
+}
+
+static int sync_journal_file(JournalFile *f, bool wait) {
+        /* The offlining doesn't tell us whether syncing worked, hence if clients wait for an acknowledgement, sync
+         * ourselves first. Offlining only has to write the header then. */
+        if (wait && fsync(f->fd) < 0)
+                return -errno;
+
+        return journal_file_set_offline(f, wait);
+}
+
 void server_sync(Server *s) {
         JournalFile *f;
         Iterator i;
+        bool wait, failed = false;
+        size_t k;
         int r;
 
+        server_flush_write_queue(s);
+
+        /* If clients wait for an acknowledgement, we need to wait for the offlining to complete before we can
+         * give it, including for files we rotated away from in the meantime */
+        wait = s->n_sync_ack_fds > 0;
+
         if (s->system_journal) {
-                r = journal_file_set_offline(s->system_journal, false);
-                if (r < 0)
+                r = sync_journal_file(s->system_journal, wait);
+                if (r < 0) {
                         log_warning_errno(r, "Failed to sync system journal, ignoring: %m");
+                        failed = true;
+                }
         }
 
         ORDERED_HASHMAP_FOREACH(f, s->user_journals, i) {
-                r = journal_file_set_offline(f, false);
-                if (r < 0)
+                r = sync_journal_file(f, wait);
+                if (r < 0) {
                         log_warning_errno(r, "Failed to sync user journal, ignoring: %m");
+                        failed = true;
+                }
         }
 
+        if (wait)
+                SET_FOREACH(f, s->deferred_closes, i) {
+                        r = sync_journal_file(f, true);
+                        if (r < 0) {
+                                log_warning_errno(r, "Failed to sync rotated journal, ignoring: %m");
+                                failed = true;
+                        }
+                }
+
+        for (k = 0; k < s->n_sync_ack_fds; k++)
+                if (failed)
+                        sync_ack_fail(s->sync_ack_fds[k]);
+                else
+                        safe_close(s->sync_ack_fds[k]);
+        s->n_sync_ack_fds = 0;
+
         if (s->sync_event_source) {
                 r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_OFF);
                 if (r < 0)
@@ -513,28 +577,207 @@ void server_sync(Server *s) {
         s->sync_scheduled = false;
 }
 
-static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
+/* Vacuuming a directory means enumerating and possibly unlinking a lot of files, hence we do it in a background
+ * thread, one per storage, unless the caller needs the space right-away. Vacuuming only ever touches archived
+ * files, which we don't write to anymore, hence this is safe to do while we go on logging. */
+struct VacuumJob {
+        Server *server;
+        JournalStorage *storage;
+
+        uint64_t max_use;
+        uint64_t n_max_files;
+        usec_t max_retention_usec;
+        bool verbose;
 
+        pthread_t thread;
+        usec_t oldest_usec;
         int r;
 
+        /* Set by the thread right before it wakes up the main loop, only accessed atomically */
+        int done;
+
+        /* Set if vacuuming was requested again while this job was running */
+        bool again;
+        bool again_verbose;
+};
+
+static void vacuum_done(Server *s, JournalStorage *storage, int r, usec_t oldest_usec) {
         assert(s);
         assert(storage);
 
+        if (r < 0 && r != -ENOENT)
+                log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
+
+        if (oldest_usec > 0 && (s->oldest_file_usec == 0 || oldest_usec < s->oldest_file_usec))
+                s->oldest_file_usec = oldest_usec;
+
+        cache_space_invalidate(&storage->space);
+}
+
+static void *vacuum_thread(void *p) {
+        VacuumJob *j = p;
+
+        assert(j);
+
+        (void) pthread_setname_np(pthread_self(), "journal-vacuum");
+
+        j->r = journal_directory_vacuum_cached(j->storage->path, j->max_use, j->n_max_files, j->max_retention_usec,
+                                               &j->oldest_usec, j->verbose, &j->storage->vacuum_cache);
+
+        /* Wake up the main loop, which will join us. It might see the wakeup before we actually returned,
+         * hence tell it that we are done, so that it knows that joining us won't take long. */
+        (void) __sync_add_and_fetch(&j->done, 1);
+        (void) eventfd_write(j->server->vacuum_event_fd, 1);
+
+        return NULL;
+}
+
+static void do_vacuum(Server *s, JournalStorage *storage, bool verbose, bool wait);
+
+static int vacuum_job_finish(Server *s, JournalStorage *storage, bool wait) {
+        VacuumJob *j;
+        bool again, again_verbose;
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        j = storage->vacuum_job;
+        if (!j)
+                return 0;
+
+        /* If the thread isn't done yet, it'll wake us up again when it is */
+        if (!wait && __sync_add_and_fetch(&j->done, 0) == 0)
+                return 0;
+
+        r = pthread_join(j->thread, NULL);
+        if (r != 0)
+                return log_error_errno(r, "Failed to join vacuum thread for %s: %m", storage->path);
+
+        storage->vacuum_job = NULL;
+
+        vacuum_done(s, storage, j->r, j->oldest_usec);
+
+        again = j->again;
+        again_verbose = j->again_verbose;
+        free(j);
+
+        /* If we are waiting the caller is going to vacuum right after anyway */
+        if (again && !wait)
+                do_vacuum(s, storage, again_verbose, false);
+
+        return 1;
+}
+
+static int dispatch_vacuum_event(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+        eventfd_t v;
+
+        assert(s);
+        assert(fd == s->vacuum_event_fd);
+
+        (void) eventfd_read(fd, &v);
+
+        (void) vacuum_job_finish(s, &s->system_storage, false);
+        (void) vacuum_job_finish(s, &s->runtime_storage, false);
+
+        return 0;
+}
+
+static int vacuum_job_start(Server *s, JournalStorage *storage, bool verbose) {
+        _cleanup_free_ VacuumJob *j = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(storage);
+        assert(!storage->vacuum_job);
+
+        if (s->vacuum_event_fd < 0) {
+                _cleanup_close_ int fd = -1;
+
+                fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+                if (fd < 0)
+                        return -errno;
+
+                r = sd_event_add_io(s->event, &s->vacuum_event_source, fd, EPOLLIN, dispatch_vacuum_event, s);
+                if (r < 0)
+                        return r;
+
+                s->vacuum_event_fd = TAKE_FD(fd);
+        }
+
+        j = new(VacuumJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (VacuumJob) {
+                .server = s,
+                .storage = storage,
+                .max_use = storage->space.limit,
+                .n_max_files = storage->metrics.n_max_files,
+                .max_retention_usec = s->max_retention_usec,
+                .verbose = verbose,
+        };
+
+        /* Make sure the thread doesn't get any of our signals, see journal_file_set_offline() */
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&j->thread, NULL, vacuum_thread, j);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        storage->vacuum_job = TAKE_PTR(j);
+        return 0;
+}
+
+static void do_vacuum(Server *s, JournalStorage *storage, bool verbose, bool wait) {
+        usec_t oldest_usec = 0;
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        if (storage->vacuum_job) {
+                if (!wait) {
+                        /* Already running, let's do another round when it is done */
+                        storage->vacuum_job->again = true;
+                        storage->vacuum_job->again_verbose = storage->vacuum_job->again_verbose || verbose;
+                        return;
+                }
+
+                (void) vacuum_job_finish(s, storage, true);
+        }
+
         (void) cache_space_refresh(s, storage);
 
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
-        if (r < 0 && r != -ENOENT)
-                log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
+        if (!wait) {
+                r = vacuum_job_start(s, storage, verbose);
+                if (r >= 0)
+                        return;
 
-        cache_space_invalidate(&storage->space);
+                log_debug_errno(r, "Failed to vacuum %s in the background, vacuuming synchronously: %m", storage->path);
+        }
+
+        r = journal_directory_vacuum_cached(storage->path, storage->space.limit,
+                                            storage->metrics.n_max_files, s->max_retention_usec,
+                                            &oldest_usec, verbose, &storage->vacuum_cache);
+
+        vacuum_done(s, storage, r, oldest_usec);
 }
 
-int server_vacuum(Server *s, bool verbose) {
+int server_vacuum(Server *s, bool verbose, bool wait) {
         assert(s);
 
         log_debug("Vacuuming...");
@@ -542,9 +785,9 @@ int server_vacuum(Server *s, bool verbose) {
         s->oldest_file_usec = 0;
 
         if (s->system_journal)
-                do_vacuum(s, &s->system_storage, verbose);
+                do_vacuum(s, &s->system_storage, verbose, wait);
         if (s->runtime_journal)
-                do_vacuum(s, &s->runtime_storage, verbose);
+                do_vacuum(s, &s->runtime_storage, verbose, wait);
 
         return 0;
 }
@@ -638,23 +881,16 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
-        bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
+static void write_entries_to_journal(Server *s, uid_t uid, const JournalEntry *entries, size_t n, int priority) {
+        bool vacuumed = false, rotate = false, written = false;
         JournalFile *f;
         int r;
 
         assert(s);
-        assert(iovec);
+        assert(entries);
         assert(n > 0);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
-
-        if (ts.realtime < s->last_realtime_clock) {
+        if (entries[0].ts->realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
                  * regular operation. However, when it does happen, then we should make sure that we start fresh files
                  * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
@@ -676,7 +912,7 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 
         if (rotate) {
                 server_rotate(s);
-                server_vacuum(s, false);
+                server_vacuum(s, false, false);
                 vacuumed = true;
 
                 f = find_journal(s, uid);
@@ -684,32 +920,199 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                         return;
         }
 
-        s->last_realtime_clock = ts.realtime;
+        s->last_realtime_clock = entries[n-1].ts->realtime;
 
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
-        if (r >= 0) {
-                server_schedule_sync(s, priority);
-                return;
+        while (n > 0) {
+                size_t k = 0;
+
+                r = journal_file_append_entries(f, entries, n, &s->seqnum, &k);
+                if (k > 0)
+                        written = true;
+                if (r >= 0)
+                        break;
+
+                entries += k;
+                n -= k;
+
+                if (!vacuumed && shall_try_append_again(f, r)) {
+                        /* We need the space now, hence wait for the vacuuming to finish */
+                        server_rotate(s);
+                        server_vacuum(s, false, true);
+                        vacuumed = true;
+
+                        f = find_journal(s, uid);
+                        if (!f)
+                                return;
+
+                        log_debug("Retrying write.");
+                        continue;
+                }
+
+                if (n == 0)
+                        break;
+
+                /* Skip the entry that failed, and go on with the rest */
+                log_error_errno(r, "Failed to write entry (%u items, %zu bytes)%s, ignoring: %m",
+                                entries->n_iovec, IOVEC_TOTAL_SIZE(entries->iovec, entries->n_iovec),
+                                vacuumed ? " despite vacuuming" : "");
+                entries++;
+                n--;
         }
 
-        if (vacuumed || !shall_try_append_again(f, r)) {
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+        if (written)
+                server_schedule_sync(s, priority);
+}
+
+struct QueuedEntry {
+        dual_timestamp ts;
+        uid_t uid;
+        int priority;
+        size_t iovec_idx;
+        unsigned n_iovec;
+};
+
+void server_flush_write_queue(Server *s) {
+        size_t i = 0;
+
+        assert(s);
+
+        /* Anything that is logged while we are writing the queue out is written directly */
+        if (s->write_queue_busy)
                 return;
+
+        s->write_queue_busy = true;
+
+        /* Write out runs of entries going to the same file in one go */
+        while (i < s->n_write_queue) {
+                JournalEntry entries[WRITE_QUEUE_ENTRIES_MAX];
+                QueuedEntry *q = s->write_queue + i;
+                int priority = q->priority;
+                size_t k;
+
+                for (k = 0; i + k < s->n_write_queue && k < ELEMENTSOF(entries); k++) {
+                        if (k > 0 &&
+                            (q[k].uid != q->uid || q[k].ts.realtime < q[k-1].ts.realtime))
+                                break;
+
+                        entries[k] = (JournalEntry) {
+                                .ts = &q[k].ts,
+                                .iovec = s->write_queue_iovec + q[k].iovec_idx,
+                                .n_iovec = q[k].n_iovec,
+                        };
+
+                        priority = MIN(priority, q[k].priority);
+                }
+
+                write_entries_to_journal(s, q->uid, entries, k, priority);
+                i += k;
         }
 
-        server_rotate(s);
-        server_vacuum(s, false);
+        s->n_write_queue = s->n_write_queue_iovec = s->write_queue_size = 0;
+        s->write_queue_busy = false;
+}
 
-        f = find_journal(s, uid);
-        if (!f)
-                return;
+static int dispatch_write_queue(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
 
-        log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        assert(s);
+
+        server_flush_write_queue(s);
+        return 0;
+}
+
+static int schedule_write_queue(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (s->write_queue_event_source)
+                return sd_event_source_set_enabled(s->write_queue_event_source, SD_EVENT_ONESHOT);
+
+        r = sd_event_add_defer(s->event, &s->write_queue_event_source, dispatch_write_queue, s);
         if (r < 0)
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
-        else
-                server_schedule_sync(s, priority);
+                return r;
+
+        /* Run after the sources feeding the queue, so that a batch picks up all messages that are ready, from
+         * one stream or socket or many. Under load the queue fills up and is written out before that. */
+        r = sd_event_source_set_priority(s->write_queue_event_source, SD_EVENT_PRIORITY_NORMAL+10);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(s->write_queue_event_source, SD_EVENT_ONESHOT);
+}
+
+static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+        struct dual_timestamp ts;
+        struct iovec *v;
+        size_t size, i;
+        uint8_t *p;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+
+        /* Entries are not written right away, but copied into the queue and written out in one batch once we
+         * are done with the input that is ready, or when the queue is full. Messages that are too large to be
+         * worth copying skip the queue. */
+
+        if (s->write_queue_busy)
+                goto write_now;
+
+        size = IOVEC_TOTAL_SIZE(iovec, n);
+        if (size > WRITE_QUEUE_SIZE_MAX)
+                goto flush_and_write_now;
+
+        if (s->n_write_queue >= WRITE_QUEUE_ENTRIES_MAX || s->write_queue_size + size > WRITE_QUEUE_SIZE_MAX)
+                server_flush_write_queue(s);
+
+        /* The data buffer is never reallocated, so that the iovecs can point right into it */
+        if (!s->write_queue_data) {
+                s->write_queue_data = malloc(WRITE_QUEUE_SIZE_MAX);
+                if (!s->write_queue_data)
+                        goto flush_and_write_now;
+        }
+
+        if (!GREEDY_REALLOC(s->write_queue, s->write_queue_allocated, s->n_write_queue + 1) ||
+            !GREEDY_REALLOC(s->write_queue_iovec, s->write_queue_iovec_allocated, s->n_write_queue_iovec + n))
+                goto flush_and_write_now;
+
+        s->write_queue[s->n_write_queue++] = (QueuedEntry) {
+                .ts = ts,
+                .uid = uid,
+                .priority = priority,
+                .iovec_idx = s->n_write_queue_iovec,
+                .n_iovec = n,
+        };
+
+        p = s->write_queue_data + s->write_queue_size;
+        v = s->write_queue_iovec + s->n_write_queue_iovec;
+        for (i = 0; i < n; i++) {
+                v[i] = IOVEC_MAKE(memcpy(p, iovec[i].iov_base, iovec[i].iov_len), iovec[i].iov_len);
+                p += iovec[i].iov_len;
+        }
+
+        s->n_write_queue_iovec += n;
+        s->write_queue_size += size;
+
+        r = schedule_write_queue(s);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to schedule writing of queued entries, writing them right away: %m");
+                server_flush_write_queue(s);
+        }
+
+        return;
+
+flush_and_write_now:
+        server_flush_write_queue(s);
+write_now:
+        write_entries_to_journal(s, uid, &(JournalEntry) { .ts = &ts, .iovec = iovec, .n_iovec = n }, 1, priority);
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -937,7 +1340,9 @@ void server_dispatch_message(
         if (c && c->unit) {
                 (void) determine_space(s, &available, NULL);
 
-                rl = journal_rate_limit_test(s->rate_limit, c->unit, priority & LOG_PRIMASK, available);
+                rl = journal_rate_limit_test(s->rate_limit, &c->rate_limit_group, c->unit,
+                                             c->log_rate_limit_interval, c->log_rate_limit_burst,
+                                             priority & LOG_PRIMASK, available);
                 if (rl == 0)
                         return;
 
@@ -972,6 +1377,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
         if (require_flag_file && !flushed_flag_is_set())
                 return 0;
 
+        server_flush_write_queue(s);
+
         (void) system_journal_open(s, true);
 
         if (!s->system_journal)
@@ -1016,7 +1423,7 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                 }
 
                 server_rotate(s);
-                server_vacuum(s, false);
+                server_vacuum(s, false, true);
 
                 if (!s->system_journal) {
                         log_notice("Didn't flush runtime journal since rotation of system journal wasn't successful.");
@@ -1054,77 +1461,36 @@ finish:
         return r;
 }
 
-int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
-        Server *s = userdata;
+typedef union DatagramControl {
+        struct cmsghdr cmsghdr;
+
+        /* We use NAME_MAX space for the SELinux label
+         * here. The kernel currently enforces no
+         * limit, but according to suggestions from
+         * the SELinux people this will change and it
+         * will probably be identical to NAME_MAX. For
+         * now we use that, but this should be updated
+         * one day when the final limit is known. */
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int)) + /* fd */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} DatagramControl;
+
+static void server_process_datagram_one(Server *s, int fd, struct msghdr *msghdr, char *buffer, size_t n) {
         struct ucred *ucred = NULL;
         struct timeval *tv = NULL;
         struct cmsghdr *cmsg;
         char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
+        size_t label_len = 0;
+        int *fds = NULL;
         size_t n_fds = 0;
 
-        union {
-                struct cmsghdr cmsghdr;
-
-                /* We use NAME_MAX space for the SELinux label
-                 * here. The kernel currently enforces no
-                 * limit, but according to suggestions from
-                 * the SELinux people this will change and it
-                 * will probably be identical to NAME_MAX. For
-                 * now we use that, but this should be updated
-                 * one day when the final limit is known. */
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(struct timeval)) +
-                            CMSG_SPACE(sizeof(int)) + /* fd */
-                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-        } control = {};
-
-        union sockaddr_union sa = {};
-
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
-
         assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
-
-        if (revents != EPOLLIN) {
-                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
-                return -EIO;
-        }
-
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
-
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
-
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
-
-        iovec.iov_base = s->buffer;
-        iovec.iov_len = s->buffer_size - 1; /* Leave room for trailing NUL we add later */
-
-        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (n < 0) {
-                if (IN_SET(errno, EINTR, EAGAIN))
-                        return 0;
-
-                return log_error_errno(errno, "recvmsg() failed: %m");
-        }
+        assert(msghdr);
+        assert(buffer);
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        CMSG_FOREACH(cmsg, msghdr) {
 
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
@@ -1145,20 +1511,42 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 }
         }
 
+        if (msghdr->msg_flags & MSG_TRUNC) {
+                /* Only the first buffer is sized after what SIOCINQ tells us, the others have a fixed size. Don't
+                 * try to make sense of a partial message. */
+                log_warning("Got datagram larger than the receive buffer, dropping it.");
+                goto finish;
+        }
+
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_syslog_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n > 0 && n_fds == 1) {
+                        uint64_t seqnum;
+
+                        /* A message with an fd attached: the client wants to know when the message has hit the disk,
+                         * which we signal by closing the fd. Write it out right-away, so that we know whether it
+                         * was stored at all. */
+                        server_flush_write_queue(s);
+                        seqnum = s->seqnum;
+
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
+                        server_flush_write_queue(s);
+
+                        server_add_sync_ack(s, fds[0], s->seqnum != seqnum);
+                        fds[0] = -1;
+                }
                 else if (n_fds > 0)
                         log_warning("Got too many file descriptors via native socket. Ignoring.");
 
@@ -1166,12 +1554,123 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
+finish:
         close_many(fds, n_fds);
+}
+
+static void server_resize_datagram_pool(Server *s, unsigned n) {
+        char *p;
+
+        assert(s);
+        assert(n < DATAGRAM_BATCH_MAX);
+
+        if (n == s->n_datagram_pool)
+                return;
+
+        if (n == 0) {
+                s->datagram_pool = mfree(s->datagram_pool);
+                s->n_datagram_pool = 0;
+                return;
+        }
+
+        /* If we cannot allocate more, we just go on batching fewer datagrams */
+        p = realloc(s->datagram_pool, n * DATAGRAM_BUFFER_SIZE);
+        if (!p)
+                return;
+
+        s->datagram_pool = p;
+        s->n_datagram_pool = n;
+}
+
+int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+        DatagramControl control[DATAGRAM_BATCH_MAX];
+        union sockaddr_union sa[DATAGRAM_BATCH_MAX];
+        struct iovec iovec[DATAGRAM_BATCH_MAX];
+        struct mmsghdr mmsghdr[DATAGRAM_BATCH_MAX];
+        unsigned n_slots, i;
+        bool batch;
+        size_t m;
+        int v = 0, n;
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN) {
+                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
+                return -EIO;
+        }
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
+                return log_oom();
+
+        /* SIOCINQ only tells us about the size of the next datagram, so all further datagrams picked up in the same
+         * go are received into the fixed-size buffers of the pool. Don't batch if the datagrams we see are larger
+         * than those, since one that doesn't fit is dequeued all the same. */
+        batch = (size_t) v < DATAGRAM_BUFFER_SIZE && now(CLOCK_MONOTONIC) >= s->datagram_batch_suspended_until;
+        n_slots = batch ? 1 + s->n_datagram_pool : 1;
+
+        for (i = 0; i < n_slots; i++) {
+                iovec[i] = i == 0 ?
+                        IOVEC_MAKE(s->buffer, s->buffer_size - 1) : /* Leave room for trailing NUL we add later */
+                        IOVEC_MAKE(s->datagram_pool + (i - 1) * DATAGRAM_BUFFER_SIZE, DATAGRAM_BUFFER_SIZE - 1);
+
+                mmsghdr[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = iovec + i,
+                                .msg_iovlen = 1,
+                                .msg_control = control + i,
+                                .msg_controllen = sizeof(control[i]),
+                                .msg_name = sa + i,
+                                .msg_namelen = sizeof(sa[i]),
+                        },
+                };
+        }
+
+        n = recvmmsg(fd, mmsghdr, n_slots, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                if (i > 0 && (mmsghdr[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                        char buf[FORMAT_TIMESPAN_MAX];
+
+                        log_warning("Received datagram too large for batched receiving, receiving one at a time for %s.",
+                                    format_timespan(buf, sizeof(buf), DATAGRAM_BATCH_SUSPEND_USEC, 0));
+                        s->datagram_batch_suspended_until = usec_add(now(CLOCK_MONOTONIC), DATAGRAM_BATCH_SUSPEND_USEC);
+                }
+
+                server_process_datagram_one(s, fd, &mmsghdr[i].msg_hdr, iovec[i].iov_base, mmsghdr[i].msg_len);
+        }
+
+        /* The pool grows while we keep filling all slots, and is given back as the load goes down again. Without a
+         * pool we cannot tell whether more datagrams were waiting, hence ask. */
+        if (!batch)
+                server_resize_datagram_pool(s, 0);
+        else if ((unsigned) n == n_slots) {
+                if (n_slots > 1 || (ioctl(fd, SIOCINQ, &v) >= 0 && v > 0))
+                        server_resize_datagram_pool(s, MIN(MAX(2 * s->n_datagram_pool, 1U), DATAGRAM_BATCH_MAX - 1));
+        } else if ((unsigned) n * 2 <= n_slots)
+                server_resize_datagram_pool(s, s->n_datagram_pool / 2);
+
         return 0;
 }
 
@@ -1185,7 +1684,7 @@ static int dispatch_sigusr1(sd_event_source *es, const struct signalfd_siginfo *
 
         (void) server_flush_to_var(s, false);
         server_sync(s);
-        server_vacuum(s, false);
+        server_vacuum(s, false, false);
 
         r = touch("/run/systemd/journal/flushed");
         if (r < 0)
@@ -1203,7 +1702,7 @@ static int dispatch_sigusr2(sd_event_source *es, const struct signalfd_siginfo *
 
         log_info("Received request to rotate journal from PID " PID_FMT, si->ssi_pid);
         server_rotate(s);
-        server_vacuum(s, true);
+        server_vacuum(s, true, false);
 
         if (s->system_journal)
                 patch_min_use(&s->system_storage);
@@ -1417,56 +1916,120 @@ static int server_dispatch_sync(sd_event_source *es, usec_t t, void *userdata) {
         return 0;
 }
 
-int server_schedule_sync(Server *s, int priority) {
+static int server_schedule_sync_in(Server *s, usec_t delay) {
+        usec_t when;
         int r;
 
         assert(s);
 
-        if (priority <= LOG_CRIT) {
-                /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
-                server_sync(s);
-                return 0;
-        }
+        r = sd_event_now(s->event, CLOCK_MONOTONIC, &when);
+        if (r < 0)
+                return r;
 
-        if (s->sync_scheduled)
-                return 0;
+        when = usec_add(when, delay);
 
-        if (s->sync_interval_usec > 0) {
-                usec_t when;
+        if (s->sync_scheduled) {
+                usec_t t;
 
-                r = sd_event_now(s->event, CLOCK_MONOTONIC, &when);
+                /* Only ever move a scheduled sync closer, so that everything logged until then is synced in one go */
+                r = sd_event_source_get_time(s->sync_event_source, &t);
                 if (r < 0)
                         return r;
 
-                when += s->sync_interval_usec;
+                if (t <= when)
+                        return 0;
 
-                if (!s->sync_event_source) {
-                        r = sd_event_add_time(
-                                        s->event,
-                                        &s->sync_event_source,
-                                        CLOCK_MONOTONIC,
-                                        when, 0,
-                                        server_dispatch_sync, s);
-                        if (r < 0)
-                                return r;
+                return sd_event_source_set_time(s->sync_event_source, when);
+        }
 
-                        r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
-                } else {
-                        r = sd_event_source_set_time(s->sync_event_source, when);
-                        if (r < 0)
-                                return r;
+        if (!s->sync_event_source) {
+                r = sd_event_add_time(
+                                s->event,
+                                &s->sync_event_source,
+                                CLOCK_MONOTONIC,
+                                when, 0,
+                                server_dispatch_sync, s);
+                if (r < 0)
+                        return r;
 
-                        r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
-                }
+                r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
+        } else {
+                r = sd_event_source_set_time(s->sync_event_source, when);
                 if (r < 0)
                         return r;
 
-                s->sync_scheduled = true;
+                r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
+        }
+        if (r < 0)
+                return r;
+
+        s->sync_scheduled = true;
+
+        return 0;
+}
+
+int server_schedule_sync(Server *s, int priority) {
+        assert(s);
+
+        if (priority <= LOG_CRIT) {
+                /* Sync to disk when this is of priority CRIT, ALERT, EMERG: immediately, or, if configured, within
+                 * the configured delay, so that a burst of such messages is synced together. */
+                if (s->sync_critical_delay_usec == 0) {
+                        server_sync(s);
+                        return 0;
+                }
+
+                return server_schedule_sync_in(s, s->sync_critical_delay_usec);
         }
 
+        if (s->sync_scheduled)
+                return 0;
+
+        if (s->sync_interval_usec > 0)
+                return server_schedule_sync_in(s, s->sync_interval_usec);
+
         return 0;
 }
 
+void server_add_sync_ack(Server *s, int fd, bool stored) {
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+
+        /* Takes possession of the fd, and closes it once everything logged so far has been synced to disk. If the
+         * message was not stored in the first place, or syncing fails, the client is told so instead. The sync
+         * happens from the timer, at the latest after SyncCriticalDelaySec=, so that even without a delay all
+         * messages picked up in one go share a sync. */
+
+        if (!stored) {
+                sync_ack_fail(fd);
+                return;
+        }
+
+        if (!GREEDY_REALLOC(s->sync_ack_fds, s->sync_ack_fds_allocated, s->n_sync_ack_fds + 1)) {
+                log_oom();
+                sync_ack_fail(fd);
+                return;
+        }
+
+        s->sync_ack_fds[s->n_sync_ack_fds++] = fd;
+
+        if (s->n_sync_ack_fds >= SYNC_ACKS_MAX)
+                goto sync_now;
+
+        r = server_schedule_sync_in(s, s->sync_critical_delay_usec);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to schedule sync, syncing right-away: %m");
+                goto sync_now;
+        }
+
+        return;
+
+sync_now:
+        server_sync(s);
+}
+
 static int dispatch_hostname_change(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
 
@@ -1678,7 +2241,7 @@ int server_init(Server *s) {
         assert(s);
 
         zero(*s);
-        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = -1;
+        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = s->vacuum_event_fd = -1;
         s->compress.enabled = true;
         s->compress.threshold_bytes = (uint64_t) -1;
         s->seal = true;
@@ -1687,6 +2250,7 @@ int server_init(Server *s) {
         s->watchdog_usec = USEC_INFINITY;
 
         s->sync_interval_usec = DEFAULT_SYNC_INTERVAL_USEC;
+        s->sync_critical_delay_usec = 0;
         s->sync_scheduled = false;
 
         s->rate_limit_interval = DEFAULT_RATE_LIMIT_INTERVAL;
@@ -1845,7 +2409,7 @@ int server_init(Server *s) {
         if (r < 0)
                 return r;
 
-        s->rate_limit = journal_rate_limit_new(s->rate_limit_interval, s->rate_limit_burst);
+        s->rate_limit = journal_rate_limit_new();
         if (!s->rate_limit)
                 return -ENOMEM;
 
@@ -1891,6 +2455,8 @@ void server_maybe_append_tags(Server *s) {
 void server_done(Server *s) {
         assert(s);
 
+        server_flush_write_queue(s);
+
         set_free_with_destructor(s->deferred_closes, journal_file_close);
 
         while (s->stdout_streams)
@@ -1898,6 +2464,9 @@ void server_done(Server *s) {
 
         client_context_flush_all(s);
 
+        (void) vacuum_job_finish(s, &s->system_storage, true);
+        (void) vacuum_job_finish(s, &s->runtime_storage, true);
+
         if (s->system_journal)
                 (void) journal_file_close(s->system_journal);
 
@@ -1910,8 +2479,14 @@ void server_done(Server *s) {
         sd_event_source_unref(s->native_event_source);
         sd_event_source_unref(s->stdout_event_source);
         sd_event_source_unref(s->dev_kmsg_event_source);
+        server_free_kmsg_devices(s);
         sd_event_source_unref(s->audit_event_source);
         sd_event_source_unref(s->sync_event_source);
+        sd_event_source_unref(s->write_queue_event_source);
+        free(s->write_queue);
+        free(s->write_queue_iovec);
+        free(s->write_queue_data);
+        free(s->stream_buffer);
         sd_event_source_unref(s->sigusr1_event_source);
         sd_event_source_unref(s->sigusr2_event_source);
         sd_event_source_unref(s->sigterm_event_source);
@@ -1919,6 +2494,7 @@ void server_done(Server *s) {
         sd_event_source_unref(s->sigrtmin1_event_source);
         sd_event_source_unref(s->hostname_event_source);
         sd_event_source_unref(s->notify_event_source);
+        sd_event_source_unref(s->vacuum_event_source);
         sd_event_source_unref(s->watchdog_event_source);
         sd_event_unref(s->event);
 
@@ -1929,6 +2505,7 @@ void server_done(Server *s) {
         safe_close(s->audit_fd);
         safe_close(s->hostname_fd);
         safe_close(s->notify_fd);
+        safe_close(s->vacuum_event_fd);
 
         if (s->rate_limit)
                 journal_rate_limit_free(s->rate_limit);
@@ -1937,12 +2514,18 @@ void server_done(Server *s) {
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
         free(s->buffer);
+        free(s->datagram_pool);
+        close_many(s->sync_ack_fds, s->n_sync_ack_fds);
+        free(s->sync_ack_fds);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
         free(s->runtime_storage.path);
         free(s->system_storage.path);
 
+        journal_vacuum_cache_free(s->runtime_storage.vacuum_cache);
+        journal_vacuum_cache_free(s->system_storage.vacuum_cache);
+
         if (s->mmap)
                 mmap_cache_unref(s->mmap);
 }
@@ -7,10 +7,12 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct QueuedEntry QueuedEntry;
 
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
 #include "journald-rate-limit.h"
 #include "journald-stream.h"
@@ -49,12 +51,20 @@ typedef struct JournalStorageSpace {
         uint64_t vfs_available;
 } JournalStorageSpace;
 
+typedef struct VacuumJob VacuumJob;
+
 typedef struct JournalStorage {
         const char *name;
         char *path;
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        VacuumJob *vacuum_job;
+
+        /* What we know about the archived files in the directory since the last vacuuming. Only accessed by
+         * whoever does the vacuuming, i.e. the vacuum job while there is one. */
+        JournalVacuumCache *vacuum_cache;
 } JournalStorage;
 
 struct Server {
@@ -65,6 +75,7 @@ struct Server {
         int audit_fd;
         int hostname_fd;
         int notify_fd;
+        int vacuum_event_fd;
 
         sd_event *event;
 
@@ -74,6 +85,7 @@ struct Server {
         sd_event_source *dev_kmsg_event_source;
         sd_event_source *audit_event_source;
         sd_event_source *sync_event_source;
+        sd_event_source *write_queue_event_source;
         sd_event_source *sigusr1_event_source;
         sd_event_source *sigusr2_event_source;
         sd_event_source *sigterm_event_source;
@@ -81,6 +93,7 @@ struct Server {
         sd_event_source *sigrtmin1_event_source;
         sd_event_source *hostname_event_source;
         sd_event_source *notify_event_source;
+        sd_event_source *vacuum_event_source;
         sd_event_source *watchdog_event_source;
 
         JournalFile *runtime_journal;
@@ -89,11 +102,33 @@ struct Server {
 
         uint64_t seqnum;
 
+        /* Entries waiting to be written out in one batch, see server_flush_write_queue() */
+        QueuedEntry *write_queue;
+        size_t n_write_queue, write_queue_allocated;
+        struct iovec *write_queue_iovec;
+        size_t n_write_queue_iovec, write_queue_iovec_allocated;
+        uint8_t *write_queue_data;
+        size_t write_queue_size;
+
+        /* Read buffer shared by all stdout streams */
+        char *stream_buffer;
+        size_t stream_buffer_size;
+
         char *buffer;
         size_t buffer_size;
 
+        /* Receive buffers for the datagrams following the first one, see server_process_datagram() */
+        char *datagram_pool;
+        unsigned n_datagram_pool;
+        usec_t datagram_batch_suspended_until;
+
+        /* File descriptors passed in by clients which we close once their messages are synced to disk */
+        int *sync_ack_fds;
+        size_t n_sync_ack_fds, sync_ack_fds_allocated;
+
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
+        usec_t sync_critical_delay_usec;
         usec_t rate_limit_interval;
         unsigned rate_limit_burst;
 
@@ -140,9 +175,15 @@ struct Server {
         uint64_t *kernel_seqnum;
         bool dev_kmsg_readable:1;
 
+        /* udev properties of the devices kernel messages refer to, invalidated by udev events */
+        Hashmap *kmsg_devices;
+        struct udev_monitor *udev_monitor;
+        sd_event_source *udev_event_source;
+
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
+        bool write_queue_busy:1;
 
         char machine_id_field[sizeof("_MACHINE_ID=") + 32];
         char boot_id_field[sizeof("_BOOT_ID=") + 32];
@@ -160,6 +201,9 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        Hashmap *client_contexts_by_cgroup; /* cgroup path → most recently refreshed context in it */
+        Set *client_contexts_refresh; /* contexts to refresh asynchronously */
+        sd_event_source *client_contexts_refresh_event_source;
 
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
@@ -183,6 +227,7 @@ struct Server {
 #define N_IOVEC_UDEV_FIELDS 32
 
 void server_dispatch_message(Server *s, struct iovec *iovec, size_t n, size_t m, ClientContext *c, const struct timeval *tv, int priority, pid_t object_pid);
+void server_flush_write_queue(Server *s);
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) _sentinel_ _printf_(4,0);
 
 /* gperf lookup function */
@@ -203,9 +248,10 @@ SplitMode split_mode_from_string(const char *s) _pure_;
 int server_init(Server *s);
 void server_done(Server *s);
 void server_sync(Server *s);
-int server_vacuum(Server *s, bool verbose);
+int server_vacuum(Server *s, bool verbose, bool wait);
 void server_rotate(Server *s);
 int server_schedule_sync(Server *s, int priority);
+void server_add_sync_ack(Server *s, int fd, bool stored);
 int server_flush_to_var(Server *s, bool require_flag_file);
 void server_maybe_append_tags(Server *s);
 int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata);
@@ -35,6 +35,14 @@
 
 #define STDOUT_STREAMS_MAX 4096
 
+/* How much to read from a stream at once, on top of what's left over from the last read */
+#define STDOUT_STREAM_READ_MAX (64U*1024U)
+
+/* How often a single stream may be read from per interval, so that a chatty service can't starve the sources
+ * of lower priority, such as the write queue and SIGTERM */
+#define STDOUT_STREAM_RATELIMIT_INTERVAL_USEC USEC_PER_SEC
+#define STDOUT_STREAM_RATELIMIT_BURST 1000U
+
 typedef enum StdoutStreamState {
         STDOUT_STREAM_IDENTIFIER,
         STDOUT_STREAM_UNIT_ID,
@@ -420,17 +428,11 @@ static int stdout_stream_line(StdoutStream *s, char *p, LineBreak line_break) {
         assert_not_reached("Unknown stream state");
 }
 
-static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
-        char *p;
-        size_t remaining;
+static int stdout_stream_scan(StdoutStream *s, char *p, size_t remaining, bool force_flush) {
         int r;
 
         assert(s);
-
-        p = s->buffer;
-        remaining = s->length;
-
-        /* XXX: This function does nothing if (s->length == 0) */
+        assert(p);
 
         for (;;) {
                 LineBreak line_break;
@@ -450,14 +452,22 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                         skip = end1 - p + 1;
                         line_break = LINE_BREAK_NEWLINE;
                 } else if (remaining >= s->server->line_max) {
-                        /* Force a line break after the maximum line length */
-                        *(p + s->server->line_max) = 0;
-                        skip = remaining;
+                        /* Force a line break after the maximum line length, and continue with the rest */
+                        skip = s->server->line_max;
                         line_break = LINE_BREAK_LINE_MAX;
                 } else
                         break;
 
-                r = stdout_stream_line(s, p, line_break);
+                if (line_break == LINE_BREAK_LINE_MAX) {
+                        char c;
+
+                        /* Terminate the line, but keep the character we overwrite for the next line */
+                        c = p[skip];
+                        p[skip] = 0;
+                        r = stdout_stream_line(s, p, line_break);
+                        p[skip] = c;
+                } else
+                        r = stdout_stream_line(s, p, line_break);
                 if (r < 0)
                         return r;
 
@@ -475,17 +485,20 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                 remaining = 0;
         }
 
-        if (p > s->buffer) {
-                memmove(s->buffer, p, remaining);
-                s->length = remaining;
-        }
+        /* Keep whatever incomplete line is left for the next read */
+        if (remaining > 0 && !GREEDY_REALLOC(s->buffer, s->allocated, remaining))
+                return log_oom();
+
+        memcpy_safe(s->buffer, p, remaining);
+        s->length = remaining;
 
         return 0;
 }
 
 static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         StdoutStream *s = userdata;
-        size_t limit;
+        size_t size, length;
+        char *buffer;
         ssize_t l;
         int r;
 
@@ -496,19 +509,21 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
                 goto terminate;
         }
 
-        /* If the buffer is full already (discounting the extra NUL we need), add room for another 1K */
-        if (s->length + 1 >= s->allocated) {
-                if (!GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + 1024)) {
-                        log_oom();
-                        goto terminate;
-                }
+        /* We read into a buffer shared by all streams, after what was left over from the previous read of this
+         * stream, and parse the lines right there. This way a single read() picks up many lines, while streams
+         * only need to keep an incomplete line around between reads. What's left over is always shorter than
+         * the maximum line length. Leave room for a terminating NUL we might need to add. */
+        size = s->server->line_max + STDOUT_STREAM_READ_MAX + 1;
+        if (!GREEDY_REALLOC(s->server->stream_buffer, s->server->stream_buffer_size, size)) {
+                log_oom();
+                goto terminate;
         }
 
-        /* Try to make use of the allocated buffer in full, but never read more than the configured line size. Also,
-         * always leave room for a terminating NUL we might need to add. */
-        limit = MIN(s->allocated - 1, s->server->line_max);
+        buffer = s->server->stream_buffer;
+        length = s->length;
+        memcpy_safe(buffer, s->buffer, length);
 
-        l = read(s->fd, s->buffer + s->length, limit - s->length);
+        l = read(s->fd, buffer + length, size - 1 - length);
         if (l < 0) {
                 if (errno == EAGAIN)
                         return 0;
@@ -518,12 +533,11 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         }
 
         if (l == 0) {
-                stdout_stream_scan(s, true);
+                (void) stdout_stream_scan(s, buffer, length, true);
                 goto terminate;
         }
 
-        s->length += l;
-        r = stdout_stream_scan(s, false);
+        r = stdout_stream_scan(s, buffer, length + l, false);
         if (r < 0)
                 goto terminate;
 
@@ -575,6 +589,10 @@ static int stdout_stream_install(Server *s, int fd, StdoutStream **ret) {
         if (r < 0)
                 return log_error_errno(r, "Failed to adjust stdout event source priority: %m");
 
+        r = sd_event_source_set_ratelimit(stream->event_source, STDOUT_STREAM_RATELIMIT_INTERVAL_USEC, STDOUT_STREAM_RATELIMIT_BURST);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set rate limit of stdout event source: %m");
+
         stream->fd = fd;
 
         stream->server = s;
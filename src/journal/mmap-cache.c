@@ -55,9 +55,12 @@ struct MMapFileDescriptor {
 struct MMapCache {
         unsigned n_ref;
         unsigned n_windows;
+        unsigned n_unused;
 
         unsigned n_hit, n_missed;
 
+        bool sequential;
+
         Hashmap *fds;
         Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
 
@@ -70,10 +73,19 @@ struct MMapCache {
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define SEQUENTIAL_WINDOW_SIZE (page_size())
 #else
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+# define SEQUENTIAL_WINDOW_SIZE (64ULL*1024ULL*1024ULL)
 #endif
 
+/* In sequential mode, how much to ask the kernel to read ahead of the cursor whenever we map a new
+ * window */
+#define SEQUENTIAL_READAHEAD (4ULL*1024ULL*1024ULL)
+
+/* In sequential mode, we won't come back to windows we left behind, so don't keep many of them around */
+#define SEQUENTIAL_UNUSED_MAX 4U
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -101,6 +113,7 @@ static void window_unlink(Window *w) {
                         w->cache->last_unused = w->unused_prev;
 
                 LIST_REMOVE(unused, w->cache->unused, w);
+                w->cache->n_unused--;
         }
 
         LIST_FOREACH(by_window, c, w->contexts) {
@@ -209,6 +222,12 @@ static void context_detach_window(Context *c) {
                         c->cache->last_unused = w;
 
                 w->in_unused = true;
+                c->cache->n_unused++;
+
+                /* Drop the windows we left behind longest ago right-away */
+                if (c->cache->sequential)
+                        while (c->cache->n_unused > SEQUENTIAL_UNUSED_MAX)
+                                window_free(c->cache->last_unused);
 #endif
         }
 }
@@ -229,6 +248,7 @@ static void context_attach_window(Context *c, Window *w) {
                         c->cache->last_unused = w->unused_prev;
 
                 w->in_unused = false;
+                c->cache->n_unused--;
         }
 
         c->window = w;
@@ -444,7 +464,23 @@ static int add_mmap(
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (m->sequential) {
+                /* We are going to move forward from here, hence map a large window that mostly extends
+                 * beyond the requested offset, with only a small margin before it. */
+                if (wsize < SEQUENTIAL_WINDOW_SIZE) {
+                        uint64_t delta;
+
+                        delta = PAGE_ALIGN((SEQUENTIAL_WINDOW_SIZE - wsize) / 8);
+
+                        if (delta > offset)
+                                woffset = 0;
+                        else
+                                woffset -= delta;
+
+                        wsize = SEQUENTIAL_WINDOW_SIZE;
+                }
+
+        } else if (wsize < WINDOW_SIZE) {
                 uint64_t delta;
 
                 delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
@@ -473,6 +509,18 @@ static int add_mmap(
         if (r < 0)
                 return r;
 
+        if (m->sequential) {
+                uint64_t ra;
+
+                /* Let the kernel read ahead aggressively and reclaim the pages behind us early, and get the
+                 * read-ahead going right-away. */
+                ra = (offset & ~((uint64_t) page_size() - 1ULL)) - woffset;
+
+                (void) madvise(d, wsize, MADV_SEQUENTIAL);
+                if (ra < wsize)
+                        (void) madvise((uint8_t*) d + ra, MIN(wsize - ra, SEQUENTIAL_READAHEAD), MADV_WILLNEED);
+        }
+
         c = context_add(m, context);
         if (!c)
                 goto outofmem;
@@ -535,6 +583,15 @@ int mmap_cache_get(
         return add_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
 }
 
+void mmap_cache_set_sequential(MMapCache *m, bool b) {
+        assert(m);
+
+        /* Optimize for walking through files front to back, mapping them in large windows. This only affects
+         * windows mapped from now on. */
+
+        m->sequential = b;
+}
+
 unsigned mmap_cache_get_hit(MMapCache *m) {
         assert(m);
 
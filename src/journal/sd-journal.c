@@ -41,12 +41,33 @@
 
 #define JOURNAL_FILES_MAX 7168
 
+/* How many of them to keep open and mapped at the same time */
+#define JOURNAL_FILES_MAPPED_MAX 256U
+
 #define JOURNAL_FILES_RECHECK_USEC (2 * USEC_PER_SEC)
 
 #define REPLACE_VAR_MAX 256
 
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
+/* The number of catalog entries we remember */
+#define CATALOG_CACHE_MAX 1024
+
+typedef struct CatalogCacheEntry {
+        sd_id128_t id;
+        ReplaceVarTemplate *template; /* NULL if there's no catalog entry for this ID */
+} CatalogCacheEntry;
+
+static CatalogCacheEntry *catalog_cache_entry_free(CatalogCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        replace_var_template_free(e->template);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CatalogCacheEntry*, catalog_cache_entry_free);
+
 static void remove_file_real(sd_journal *j, JournalFile *f);
 
 static bool journal_pid_changed(sd_journal *j) {
@@ -109,6 +130,8 @@ static void detach_location(sd_journal *j) {
         j->current_file = NULL;
         j->current_field = 0;
 
+        j->candidates = prioq_free(j->candidates);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
 }
@@ -483,6 +506,14 @@ _pure_ static int compare_with_location(JournalFile *f, Location *l) {
         return 0;
 }
 
+static uint64_t match_hash(JournalFile *f, Match *m) {
+        assert(f);
+        assert(m);
+
+        /* The hash we keep in the match is only valid for files using the unkeyed hash */
+        return JOURNAL_HEADER_KEYED_HASH(f->header) ? journal_file_hash_data(f, m->data, m->size) : le64toh(m->le_hash);
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -503,7 +534,7 @@ static int next_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, match_hash(f, m), NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -592,7 +623,7 @@ static int find_location_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, match_hash(f, m), NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -746,12 +777,19 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         n_entries = le64toh(f->header->n_entries);
 
         /* If we hit EOF before, we don't need to look into this file again
-         * unless direction changed or new entries appeared. */
+         * unless direction changed or new entries appeared. For released files
+         * we only have a copy of the header, hence look again every now and
+         * then, in case we missed an IN_MODIFY. */
         if (f->last_direction == direction && f->location_type == LOCATION_TAIL &&
-            n_entries == f->last_n_entries)
+            n_entries == f->last_n_entries &&
+            (!f->released || now(CLOCK_MONOTONIC) < usec_add(f->last_stat_usec, JOURNAL_FILES_RECHECK_USEC)))
                 return 0;
 
-        f->last_n_entries = n_entries;
+        r = journal_acquire_file(j, f);
+        if (r < 0)
+                return r;
+
+        f->last_n_entries = le64toh(f->header->n_entries);
 
         if (f->last_direction == direction && f->current_offset > 0) {
                 /* LOCATION_SEEK here means we did the work in a previous
@@ -803,55 +841,139 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
+static int candidate_compare_down(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) a, (JournalFile*) b);
+}
+
+static int candidate_compare_up(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) b, (JournalFile*) a);
+}
+
+static int update_candidate(sd_journal *j, JournalFile *f, direction_t direction) {
+        int r;
+
+        assert(j);
+        assert(f);
+
+        r = next_beyond_location(j, f, direction);
+        if (r < 0) {
+                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                remove_file_real(j, f);
+                return 0;
+        } else if (r == 0) {
+                f->location_type = LOCATION_TAIL;
+                return 0;
+        }
+
+        return prioq_put(j->candidates, f, &f->candidate_idx);
+}
+
+static int update_candidates(sd_journal *j, direction_t direction) {
         unsigned i, n_files;
         const void **files;
+        int r;
+
+        assert(j);
+
+        /* Keeps j->candidates filled with every file that has an entry beyond the current location. Files
+         * whose candidate is still in the queue from the previous step are left alone, so only the file we
+         * just consumed an entry from, and those that already hit EOF but might have grown since, need to be
+         * looked at. If the direction changed or the location was reset, all files are searched again. */
+
+        if (j->candidates && j->candidates_direction != direction)
+                j->candidates = prioq_free(j->candidates);
+
+        if (!j->candidates) {
+                j->candidates = prioq_new(direction == DIRECTION_DOWN ? candidate_compare_down : candidate_compare_up);
+                if (!j->candidates)
+                        return -ENOMEM;
+
+                j->candidates_direction = direction;
+
+                r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
+                if (r < 0)
+                        goto fail;
+
+                for (i = 0; i < n_files; i++) {
+                        r = update_candidate(j, (JournalFile*) files[i], direction);
+                        if (r < 0)
+                                goto fail;
+                }
+
+                return 0;
+        }
+
+        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
+        if (r < 0)
+                goto fail;
+
+        for (i = 0; i < n_files; i++) {
+                JournalFile *f = (JournalFile*) files[i];
+
+                if (f->location_type == LOCATION_SEEK)
+                        continue;
+
+                r = update_candidate(j, f, direction);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        j->candidates = prioq_free(j->candidates);
+        return r;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file;
         Object *o;
         int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
-        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
+        r = update_candidates(j, direction);
         if (r < 0)
                 return r;
 
-        for (i = 0; i < n_files; i++) {
-                JournalFile *f = (JournalFile *)files[i];
-                bool found;
+        for (;;) {
+                uint64_t offset;
 
-                r = next_beyond_location(j, f, direction);
+                new_file = prioq_peek(j->candidates);
+                if (!new_file)
+                        return 0;
+
+                /* The candidate might be a duplicate of the entry we are currently looking at, in which
+                 * case next_beyond_location() moves past it and the file has to be sorted in again. */
+                offset = new_file->current_offset;
+
+                r = next_beyond_location(j, new_file, direction);
                 if (r < 0) {
-                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
-                        remove_file_real(j, f);
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", new_file->path);
+                        remove_file_real(j, new_file);
                         continue;
                 } else if (r == 0) {
-                        f->location_type = LOCATION_TAIL;
+                        new_file->location_type = LOCATION_TAIL;
+                        (void) prioq_remove(j->candidates, new_file, &new_file->candidate_idx);
                         continue;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
-
-                        k = journal_file_compare_locations(f, new_file);
-
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
-                }
+                if (new_file->current_offset == offset)
+                        break;
 
-                if (found)
-                        new_file = f;
+                (void) prioq_reshuffle(j->candidates, new_file, &new_file->candidate_idx);
         }
 
-        if (!new_file)
-                return 0;
+        r = journal_acquire_file(j, new_file);
+        if (r < 0)
+                return r;
 
         r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
         if (r < 0)
                 return r;
 
+        (void) prioq_remove(j->candidates, new_file, &new_file->candidate_idx);
         set_location(j, new_file, o);
 
         return 1;
@@ -906,6 +1028,52 @@ _public_ int sd_journal_previous_skip(sd_journal *j, uint64_t skip) {
         return real_journal_next_skip(j, DIRECTION_UP, skip);
 }
 
+static int real_journal_next_entries(
+                sd_journal *j,
+                direction_t direction,
+                uint64_t n,
+                sd_journal_entry_handler_t callback,
+                void *userdata) {
+
+        int c = 0, r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(callback, -EINVAL);
+
+        /* Moves through up to n entries and invokes the callback for each of them while the read pointer is
+         * positioned on it. This saves the caller a round trip per entry, and since nothing else touches the
+         * mmap windows in between, the data returned by sd_journal_enumerate_data() and friends from within
+         * the callback points right into the journal file, without being copied anywhere. */
+
+        while (n > 0 && c < INT_MAX) {
+                r = real_journal_next(j, direction);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                c++;
+                n--;
+
+                r = callback(j, userdata);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        break;
+        }
+
+        return c;
+}
+
+_public_ int sd_journal_next_entries(sd_journal *j, uint64_t n, sd_journal_entry_handler_t callback, void *userdata) {
+        return real_journal_next_entries(j, DIRECTION_DOWN, n, callback, userdata);
+}
+
+_public_ int sd_journal_previous_entries(sd_journal *j, uint64_t n, sd_journal_entry_handler_t callback, void *userdata) {
+        return real_journal_next_entries(j, DIRECTION_UP, n, callback, userdata);
+}
+
 _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
         Object *o;
         int r;
@@ -1246,12 +1414,127 @@ static const char *skip_slash(const char *p) {
         return p;
 }
 
+static int open_journal_file_fd(sd_journal *j, const char *path) {
+        int fd, r;
+
+        assert(j);
+        assert(path);
+
+        if (j->toplevel_fd >= 0)
+                /* If there's a top-level fd defined make the path relative, explicitly, since otherwise
+                 * openat() ignores the first argument. */
+
+                fd = openat(j->toplevel_fd, skip_slash(path), O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+        else
+                fd = open(path, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open journal file %s: %m", path);
+
+        r = fd_nonblock(fd, false);
+        if (r < 0) {
+                safe_close(fd);
+                return log_debug_errno(r, "Failed to turn off O_NONBLOCK for %s: %m", path);
+        }
+
+        return fd;
+}
+
+static bool file_is_pinned(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        /* The caller might still look at objects in these files, they need to stay mapped */
+        return f == j->current_file || f == j->unique_file || f == j->fields_file;
+}
+
+static void release_unused_files(sd_journal *j, JournalFile *except) {
+        JournalFile *f;
+        Iterator i;
+        unsigned n;
+        int r;
+
+        assert(j);
+
+        n = ordered_set_size(j->mapped_files);
+
+        ORDERED_SET_FOREACH(f, j->mapped_files, i) {
+                if (n <= j->n_mapped_files_max)
+                        break;
+
+                if (f == except || file_is_pinned(j, f))
+                        continue;
+
+                r = journal_file_release(f);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to release journal file %s, keeping it open: %m", f->path);
+                        continue;
+                }
+
+                (void) ordered_set_remove(j->mapped_files, f);
+                n--;
+        }
+}
+
+static int track_mapped_file(sd_journal *j, JournalFile *f) {
+        int r;
+
+        assert(j);
+        assert(f);
+
+        r = ordered_set_ensure_allocated(&j->mapped_files, NULL);
+        if (r < 0)
+                return r;
+
+        r = ordered_set_put(j->mapped_files, f);
+        if (r < 0)
+                return r;
+
+        release_unused_files(j, f);
+        return 0;
+}
+
+int journal_acquire_file(sd_journal *j, JournalFile *f) {
+        int fd, r;
+
+        assert(j);
+        assert(f);
+
+        /* Makes sure the file is open and mapped, reopening it if it was released before. Only files we opened
+         * ourselves are ever released, those passed in by fd always stay open. */
+
+        if (!f->released) {
+                /* Move it to the end of the LRU list */
+                if (ordered_set_remove(j->mapped_files, f))
+                        (void) ordered_set_put(j->mapped_files, f);
+
+                release_unused_files(j, f);
+                return 0;
+        }
+
+        fd = open_journal_file_fd(j, f->path);
+        if (fd < 0)
+                return fd;
+
+        r = journal_file_reacquire(f, fd);
+        if (r < 0) {
+                safe_close(fd);
+                return log_debug_errno(r, "Failed to reopen journal file %s: %m", f->path);
+        }
+
+        r = track_mapped_file(j, f);
+        if (r < 0)
+                return r;
+
+        log_debug("File %s reopened.", f->path);
+        return 0;
+}
+
 static int add_any_file(
                 sd_journal *j,
                 int fd,
                 const char *path) {
 
-        bool close_fd = false;
+        bool close_fd = false, own_fd;
         JournalFile *f;
         struct stat st;
         int r, k;
@@ -1260,27 +1543,17 @@ static int add_any_file(
         assert(fd >= 0 || path);
 
         if (fd < 0) {
-                if (j->toplevel_fd >= 0)
-                        /* If there's a top-level fd defined make the path relative, explicitly, since otherwise
-                         * openat() ignores the first argument. */
-
-                        fd = openat(j->toplevel_fd, skip_slash(path), O_RDONLY|O_CLOEXEC|O_NONBLOCK);
-                else
-                        fd = open(path, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+                fd = open_journal_file_fd(j, path);
                 if (fd < 0) {
-                        r = log_debug_errno(errno, "Failed to open journal file %s: %m", path);
+                        r = fd;
                         goto finish;
                 }
 
                 close_fd = true;
-
-                r = fd_nonblock(fd, false);
-                if (r < 0) {
-                        r = log_debug_errno(errno, "Failed to turn off O_NONBLOCK for %s: %m", path);
-                        goto finish;
-                }
         }
 
+        own_fd = close_fd;
+
         if (fstat(fd, &st) < 0) {
                 r = log_debug_errno(errno, "Failed to fstat file '%s': %m", path);
                 goto finish;
@@ -1338,6 +1611,19 @@ static int add_any_file(
 
         f->last_seen_generation = j->generation;
 
+        /* Files we opened by path can be closed again and reopened later, so that we don't run out of fds or
+         * address space when there are lots of them. */
+        if (own_fd) {
+                r = track_mapped_file(j, f);
+                if (r < 0) {
+                        remove_file_real(j, f);
+                        goto finish;
+                }
+        }
+
+        /* The new file needs a candidate entry before we can step again */
+        j->candidates = prioq_free(j->candidates);
+
         track_file_disposition(j, f);
         check_network(j, f->fd);
 
@@ -1406,6 +1692,8 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
         assert(f);
 
         (void) ordered_hashmap_remove(j->files, f->path);
+        (void) ordered_set_remove(j->mapped_files, f);
+        (void) prioq_remove(j->candidates, f, &f->candidate_idx);
 
         log_debug("File %s removed.", f->path);
 
@@ -1820,6 +2108,7 @@ static sd_journal *journal_new(int flags, const char *path) {
         j->inotify_fd = -1;
         j->flags = flags;
         j->data_threshold = DEFAULT_DATA_THRESHOLD;
+        j->n_mapped_files_max = JOURNAL_FILES_MAPPED_MAX;
 
         if (path) {
                 char *t;
@@ -1844,13 +2133,17 @@ static sd_journal *journal_new(int flags, const char *path) {
         if (!j->files_cache || !j->directories_by_path || !j->mmap)
                 return NULL;
 
+        if (flags & SD_JOURNAL_SEQUENTIAL)
+                mmap_cache_set_sequential(j->mmap, true);
+
         return TAKE_PTR(j);
 }
 
 #define OPEN_ALLOWED_FLAGS                              \
         (SD_JOURNAL_LOCAL_ONLY |                        \
          SD_JOURNAL_RUNTIME_ONLY |                      \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER)
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SEQUENTIAL)
 
 _public_ int sd_journal_open(sd_journal **ret, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1872,7 +2165,8 @@ _public_ int sd_journal_open(sd_journal **ret, int flags) {
 }
 
 #define OPEN_CONTAINER_ALLOWED_FLAGS                    \
-        (SD_JOURNAL_LOCAL_ONLY | SD_JOURNAL_SYSTEM)
+        (SD_JOURNAL_LOCAL_ONLY | SD_JOURNAL_SYSTEM |    \
+         SD_JOURNAL_SEQUENTIAL)
 
 _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, int flags) {
         _cleanup_free_ char *root = NULL, *class = NULL;
@@ -1914,7 +2208,8 @@ _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, in
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SEQUENTIAL)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1939,13 +2234,15 @@ _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int f
         return 0;
 }
 
+#define OPEN_FILES_ALLOWED_FLAGS SD_JOURNAL_SEQUENTIAL
+
 _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         const char **path;
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL);
         if (!j)
@@ -1965,7 +2262,8 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
 
 #define OPEN_DIRECTORY_FD_ALLOWED_FLAGS         \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SEQUENTIAL)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2008,7 +2306,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         assert_return(ret, -EINVAL);
         assert_return(n_fds > 0, -EBADF);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL);
         if (!j)
@@ -2059,6 +2357,8 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        prioq_free(j->candidates);
+        ordered_set_free(j->mapped_files);
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
 
@@ -2083,7 +2383,10 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->path);
         free(j->prefix);
         free(j->unique_field);
+        set_free_free(j->unique_values);
         free(j->fields_buffer);
+        set_free_free(j->fields_seen);
+        hashmap_free_with_destructor(j->catalog_cache, catalog_cache_entry_free);
         free(j);
 }
 
@@ -2223,11 +2526,11 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
+                        r = journal_file_decompress_startswith(f, compression,
+                                                               o->data.payload, l,
+                                                               &f->compress_buffer, &f->compress_buffer_size,
+                                                               field, field_length, '=');
                         if (r < 0)
                                 log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
                                                 object_compressed_to_string(compression), l, p);
@@ -2235,10 +2538,10 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                                 size_t rsize;
 
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
+                                r = journal_file_decompress_blob(f, compression,
+                                                                 o->data.payload, l,
+                                                                 &f->compress_buffer, &f->compress_buffer_size, &rsize,
+                                                                 j->data_threshold);
                                 if (r < 0)
                                         return r;
 
@@ -2287,13 +2590,13 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
 
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
                 size_t rsize;
                 int r;
 
-                r = decompress_blob(compression,
-                                    o->data.payload, l, &f->compress_buffer,
-                                    &f->compress_buffer_size, &rsize, j->data_threshold);
+                r = journal_file_decompress_blob(f, compression,
+                                                 o->data.payload, l, &f->compress_buffer,
+                                                 &f->compress_buffer_size, &rsize, j->data_threshold);
                 if (r < 0)
                         return r;
 
@@ -2483,15 +2786,50 @@ static void process_q_overflow(sd_journal *j) {
         log_debug("Reiteration complete.");
 }
 
-static void process_inotify_event(sd_journal *j, struct inotify_event *e) {
+static bool process_modify_event(sd_journal *j, Directory *d, const char *filename) {
+        const char *path;
+        JournalFile *f;
+        uint64_t n;
+
+        assert(j);
+        assert(d);
+        assert(filename);
+
+        /* The writer posts IN_MODIFY after appending entries. If we already track the file, there's no point in
+         * reopening and stat()ing it again: replacements show up as IN_CREATE or IN_MOVED_TO. Instead, just look
+         * at the shared header to see if there's actually anything new to report. */
+
+        path = strjoina(d->path, "/", filename);
+        f = ordered_hashmap_get(j->files, path);
+        if (!f)
+                return add_file_by_name(j, d->path, filename) >= 0;
+
+        /* For released files we only have an old copy of the header, assume something changed. Looking at
+         * the file again will tell. */
+        if (f->released) {
+                f->last_n_entries = (uint64_t) -1;
+                return true;
+        }
+
+        n = le64toh(f->header->n_entries);
+        if (n == f->posted_n_entries)
+                return false;
+
+        f->posted_n_entries = n;
+        return true;
+}
+
+static bool process_inotify_event(sd_journal *j, struct inotify_event *e) {
         Directory *d;
 
         assert(j);
         assert(e);
 
+        /* Returns true if the event might have changed what the journal looks like, false if it was a no-op. */
+
         if (e->mask & IN_Q_OVERFLOW) {
                 process_q_overflow(j);
-                return;
+                return true;
         }
 
         /* Is this a subdirectory we watch? */
@@ -2503,7 +2841,9 @@ static void process_inotify_event(sd_journal *j, struct inotify_event *e) {
 
                         /* Event for a journal file */
 
-                        if (e->mask & (IN_CREATE|IN_MOVED_TO|IN_MODIFY|IN_ATTRIB))
+                        if (e->mask & IN_MODIFY)
+                                return process_modify_event(j, d, e->name);
+                        else if (e->mask & (IN_CREATE|IN_MOVED_TO|IN_ATTRIB))
                                 (void) add_file_by_name(j, d->path, e->name);
                         else if (e->mask & (IN_DELETE|IN_MOVED_FROM|IN_UNMOUNT))
                                 remove_file_by_name(j, d->path, e->name);
@@ -2523,13 +2863,14 @@ static void process_inotify_event(sd_journal *j, struct inotify_event *e) {
                                 (void) add_directory(j, d->path, e->name);
                 }
 
-                return;
+                return true;
         }
 
         if (e->mask & IN_IGNORED)
-                return;
+                return false;
 
         log_debug("Unexpected inotify event.");
+        return false;
 }
 
 static int determine_change(sd_journal *j) {
@@ -2568,10 +2909,9 @@ _public_ int sd_journal_process(sd_journal *j) {
                         return -errno;
                 }
 
-                got_something = true;
-
                 FOREACH_INOTIFY_EVENT(e, buffer, l)
-                        process_inotify_event(j, e);
+                        if (process_inotify_event(j, e))
+                                got_something = true;
         }
 }
 
@@ -2636,6 +2976,10 @@ _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from,
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 usec_t fr, t;
 
+                r = journal_acquire_file(j, f);
+                if (r < 0)
+                        return r;
+
                 r = journal_file_get_cutoff_realtime_usec(f, &fr, &t);
                 if (r == -ENOENT)
                         continue;
@@ -2676,6 +3020,10 @@ _public_ int sd_journal_get_cutoff_monotonic_usec(sd_journal *j, sd_id128_t boot
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 usec_t fr, t;
 
+                r = journal_acquire_file(j, f);
+                if (r < 0)
+                        return r;
+
                 r = journal_file_get_cutoff_monotonic_usec(f, boot_id, &fr, &t);
                 if (r == -ENOENT)
                         continue;
@@ -2709,6 +3057,9 @@ void journal_print_header(sd_journal *j) {
         assert(j);
 
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                if (journal_acquire_file(j, f) < 0)
+                        continue;
+
                 if (newline)
                         putchar('\n');
                 else
@@ -2730,6 +3081,12 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 struct stat st;
 
+                /* Don't reopen released files just for this, the size we saw last is good enough */
+                if (f->released) {
+                        sum += (uint64_t) f->last_stat.st_blocks * 512ULL;
+                        continue;
+                }
+
                 if (fstat(f->fd, &st) < 0)
                         return -errno;
 
@@ -2740,6 +3097,74 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         return 0;
 }
 
+/* The values returned by sd_journal_enumerate_unique() so far. We used to check for each value whether it exists in
+ * any of the files enumerated before, which is quadratic in the number of files. Instead, remember what we returned
+ * already. That's never more than what the caller is going to see anyway. What we return might be truncated to the
+ * data threshold, hence the hash of the complete payload, as stored in the object, is part of the key, so that
+ * values that only differ beyond the threshold are told apart. */
+typedef struct UniqueValue {
+        uint64_t hash;
+        size_t size;
+        uint8_t data[];
+} UniqueValue;
+
+static void unique_value_hash_func(const void *p, struct siphash *state) {
+        const UniqueValue *v = p;
+
+        siphash24_compress(&v->hash, sizeof(v->hash), state);
+        siphash24_compress(&v->size, sizeof(v->size), state);
+        siphash24_compress(v->data, v->size, state);
+}
+
+static int unique_value_compare_func(const void *a, const void *b) {
+        const UniqueValue *x = a, *y = b;
+
+        if (x->hash < y->hash)
+                return -1;
+        if (x->hash > y->hash)
+                return 1;
+
+        if (x->size < y->size)
+                return -1;
+        if (x->size > y->size)
+                return 1;
+
+        return memcmp(x->data, y->data, x->size);
+}
+
+static const struct hash_ops unique_value_hash_ops = {
+        .hash = unique_value_hash_func,
+        .compare = unique_value_compare_func,
+};
+
+static int unique_value_remember(Set **s, uint64_t hash, const void *data, size_t size) {
+        UniqueValue *v;
+        int r;
+
+        assert(s);
+        assert(data || size == 0);
+
+        /* Returns 1 if the value is new, 0 if it has been seen before */
+
+        r = set_ensure_allocated(s, &unique_value_hash_ops);
+        if (r < 0)
+                return r;
+
+        v = malloc(offsetof(UniqueValue, data) + size);
+        if (!v)
+                return -ENOMEM;
+
+        v->hash = hash;
+        v->size = size;
+        memcpy_safe(v->data, data, size);
+
+        r = set_put(*s, v);
+        if (r <= 0)
+                free(v);
+
+        return r;
+}
+
 _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         char *f;
 
@@ -2757,6 +3182,7 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        j->unique_values = set_free_free(j->unique_values);
 
         return 0;
 }
@@ -2784,14 +3210,16 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
         }
 
         for (;;) {
-                JournalFile *of;
-                Iterator i;
                 Object *o;
                 const void *odata;
+                uint64_t hash;
                 size_t ol;
-                bool found;
                 int r;
 
+                r = journal_acquire_file(j, j->unique_file);
+                if (r < 0)
+                        return r;
+
                 /* Proceed to next data object in the field's linked list */
                 if (j->unique_offset == 0) {
                         r = journal_file_find_field_object(j->unique_file, j->unique_field, k, &o, NULL);
@@ -2831,6 +3259,8 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
+                hash = le64toh(o->data.hash);
+
                 r = return_data(j, j->unique_file, o, &odata, &ol);
                 if (r < 0)
                         return r;
@@ -2850,33 +3280,15 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
-                /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files, i) {
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
-                        continue;
-
-                r = return_data(j, j->unique_file, o, data, l);
+                /* OK, now let's see if we already returned this data object, from this or an earlier file */
+                r = unique_value_remember(&j->unique_values, hash, odata, ol);
                 if (r < 0)
                         return r;
+                if (r == 0)
+                        continue;
+
+                *data = odata;
+                *l = ol;
 
                 return 1;
         }
@@ -2889,6 +3301,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        j->unique_values = set_free_free(j->unique_values);
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -2911,15 +3324,17 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
         }
 
         for (;;) {
-                JournalFile *f, *of;
-                Iterator i;
+                JournalFile *f;
                 uint64_t m;
                 Object *o;
                 size_t sz;
-                bool found;
 
                 f = j->fields_file;
 
+                r = journal_acquire_file(j, f);
+                if (r < 0)
+                        return r;
+
                 if (j->fields_offset == 0) {
                         bool eof = false;
 
@@ -2986,32 +3401,18 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
 
                 sz = le64toh(o->object.size) - offsetof(Object, field.payload);
 
-                /* Let's see if we already returned this field name before. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files, i) {
-                        if (of == f)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_field_object_with_hash(of, o->field.payload, sz, le64toh(o->field.hash), NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
-                        continue;
-
                 /* Check if this is really a valid string containing no NUL byte */
                 if (memchr(o->field.payload, 0, sz))
                         return -EBADMSG;
 
+                /* Let's see if we already returned this field name before. (The field object of a file is unique
+                 * within that file, hence we only ever see a name again from another file.) */
+                r = unique_value_remember(&j->fields_seen, le64toh(o->field.hash), o->field.payload, sz);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
                 if (sz > j->data_threshold)
                         sz = j->data_threshold;
 
@@ -3037,6 +3438,7 @@ _public_ void sd_journal_restart_fields(sd_journal *j) {
         j->fields_hash_table_index = 0;
         j->fields_offset = 0;
         j->fields_file_lost = false;
+        j->fields_seen = set_free_free(j->fields_seen);
 }
 
 _public_ int sd_journal_reliable_fd(sd_journal *j) {
@@ -3065,11 +3467,63 @@ static char *lookup_field(const char *field, void *userdata) {
         return strndup((const char*) data + d, size - d);
 }
 
+static int catalog_cache_get(sd_journal *j, sd_id128_t id, ReplaceVarTemplate **ret) {
+        _cleanup_(catalog_cache_entry_freep) CatalogCacheEntry *e = NULL;
+        _cleanup_free_ char *text = NULL;
+        CatalogCacheEntry *found;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        /* Looking up a catalog entry means mapping the catalog database, and a binary search in it, and the same
+         * few message IDs tend to show up over and over again, hence remember what we found. Negative results are
+         * cached too. */
+
+        found = hashmap_get(j->catalog_cache, &id);
+        if (found) {
+                *ret = found->template;
+                return found->template ? 0 : -ENOENT;
+        }
+
+        r = catalog_get(CATALOG_DATABASE, id, &text);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        if (hashmap_size(j->catalog_cache) >= CATALOG_CACHE_MAX)
+                hashmap_clear_with_destructor(j->catalog_cache, catalog_cache_entry_free);
+
+        r = hashmap_ensure_allocated(&j->catalog_cache, &id128_hash_ops);
+        if (r < 0)
+                return r;
+
+        e = new0(CatalogCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->id = id;
+
+        if (text) {
+                r = replace_var_template_new(text, &e->template);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_put(j->catalog_cache, &e->id, e);
+        if (r < 0)
+                return r;
+
+        found = TAKE_PTR(e);
+        *ret = found->template;
+        return found->template ? 0 : -ENOENT;
+}
+
 _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
+        ReplaceVarTemplate *template;
         const void *data;
         size_t size;
         sd_id128_t id;
-        _cleanup_free_ char *text = NULL, *cid = NULL;
+        _cleanup_free_ char *cid = NULL;
         char *t;
         int r;
 
@@ -3089,11 +3543,11 @@ _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         if (r < 0)
                 return r;
 
-        r = catalog_get(CATALOG_DATABASE, id, &text);
+        r = catalog_cache_get(j, id, &template);
         if (r < 0)
                 return r;
 
-        t = replace_var(text, lookup_field, j);
+        t = replace_var_template_apply(template, lookup_field, j);
         if (!t)
                 return -ENOMEM;
 
@@ -26,6 +26,12 @@
 # define LZ4_OK -EPROTONOSUPPORT
 #endif
 
+#if HAVE_ZSTD
+# define ZSTD_OK 0
+#else
+# define ZSTD_OK -EPROTONOSUPPORT
+#endif
+
 typedef int (compress_blob_t)(const void *src, uint64_t src_size,
                               void *dst, size_t dst_alloc_size, size_t *dst_size);
 typedef int (decompress_blob_t)(const void *src, uint64_t src_size,
@@ -39,7 +45,7 @@ typedef int (decompress_sw_t)(const void *src, uint64_t src_size,
 typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes);
 typedef int (decompress_stream_t)(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
 static void test_compress_decompress(int compression,
                                      compress_blob_t compress,
                                      decompress_blob_t decompress,
@@ -237,8 +243,75 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+static void test_zstd_dictionary(void) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ char *samples = NULL, *decompressed = NULL;
+        _cleanup_free_ void *dict = NULL;
+        size_t sizes[1024], samples_size = 0, dict_size, plain_size, dict_compressed_size, alloc = 0, size;
+        const char msg[] = "MESSAGE=Started Session 4711 of user lennart, on seat seat0 (pam_unix).";
+        char plain[2 * sizeof(msg)], compressed[sizeof(msg)];
+        unsigned i;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        /* Lots of short, similar messages, which is what dictionaries are good at */
+        samples = new(char, ELEMENTSOF(sizes) * 128);
+        assert_se(samples);
+        for (i = 0; i < ELEMENTSOF(sizes); i++) {
+                r = sprintf(samples + samples_size,
+                            "MESSAGE=%s Session %u of user %s, on seat seat%u (%s).",
+                            i % 3 ? "Started" : "Stopped", i * 7, i % 2 ? "root" : "lennart", i % 4,
+                            i % 5 ? "pam_unix" : "session closed");
+                assert_se(r > 0);
+                sizes[i] = r;
+                samples_size += r;
+        }
+
+        r = compress_dictionary_train(samples, sizes, ELEMENTSOF(sizes), 4096, &dict, &dict_size);
+        assert_se(r == 0);
+        log_info("Trained %zu byte dictionary from %zu bytes of samples", dict_size, samples_size);
+
+        assert_se(compress_dictionary_new(samples, 16, &d) == -EBADMSG);
+        assert_se(compress_dictionary_new(dict, dict_size, &d) == 0);
+        assert_se(compress_dictionary_id(d) != 0);
+
+        r = compress_blob_zstd(msg, sizeof(msg) - 1, plain, sizeof(plain), &plain_size);
+        assert_se(r == 0);
+
+        r = compress_blob_dictionary(d, msg, sizeof(msg) - 1, compressed, sizeof(compressed), &dict_compressed_size);
+        assert_se(r == OBJECT_COMPRESSED_ZSTD);
+        log_info("Compressed %zu → %zu without dictionary, → %zu with dictionary",
+                 sizeof(msg) - 1, plain_size, dict_compressed_size);
+        assert_se(dict_compressed_size < plain_size);
+
+        r = decompress_blob_dictionary(d, OBJECT_COMPRESSED_ZSTD, compressed, dict_compressed_size,
+                                       (void**) &decompressed, &alloc, &size, 0);
+        assert_se(r == 0);
+        assert_se(size == sizeof(msg) - 1);
+        assert_se(memcmp(decompressed, msg, size) == 0);
+
+        /* Frames compressed without a dictionary still work */
+        r = decompress_blob_dictionary(d, OBJECT_COMPRESSED_ZSTD, plain, plain_size,
+                                       (void**) &decompressed, &alloc, &size, 0);
+        assert_se(r == 0);
+        assert_se(size == sizeof(msg) - 1);
+        assert_se(memcmp(decompressed, msg, size) == 0);
+
+        /* … but frames compressed with one don't decompress without it */
+        r = decompress_blob_zstd(compressed, dict_compressed_size, (void**) &decompressed, &alloc, &size, 0);
+        assert_se(r < 0);
+
+        assert_se(decompress_startswith_dictionary(d, OBJECT_COMPRESSED_ZSTD, compressed, dict_compressed_size,
+                                                   (void**) &decompressed, &alloc, "MESSAGE", 7, '=') > 0);
+        assert_se(decompress_startswith_dictionary(d, OBJECT_COMPRESSED_ZSTD, compressed, dict_compressed_size,
+                                                   (void**) &decompressed, &alloc, "MESSAGE", 7, 'x') == 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         const char text[] =
                 "text\0foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
                 "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF";
@@ -303,6 +376,30 @@ int main(int argc, char *argv[]) {
         log_info("/* LZ4 test skipped */");
 #endif
 
+#if HAVE_ZSTD
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 text, sizeof(text), false);
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 data, sizeof(data), true);
+
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   text, sizeof(text), false);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   data, sizeof(data), true);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   huge, sizeof(huge), true);
+
+        test_compress_stream(OBJECT_COMPRESSED_ZSTD, "zstdcat",
+                             compress_stream_zstd, decompress_stream_zstd, srcfile);
+
+        test_zstd_dictionary();
+#else
+        log_info("/* ZSTD test skipped */");
+#endif
+
         return 0;
 #else
         return EXIT_TEST_SKIP;
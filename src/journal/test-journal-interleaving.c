@@ -10,10 +10,12 @@
 
 #include "alloc-util.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "util.h"
 
 /* This program tests skipping around in a multi-file journal.
@@ -190,6 +192,81 @@ static void test_skip(void (*setup)(void)) {
         puts("------------------------------------------------------------");
 }
 
+typedef struct EntryCheck {
+        int next;
+        int step;
+        int stop;
+} EntryCheck;
+
+static int check_entry(sd_journal *j, void *userdata) {
+        EntryCheck *c = userdata;
+
+        test_check_number(j, c->next);
+        if (c->next == c->stop)
+                return 1;
+
+        c->next += c->step;
+        return 0;
+}
+
+static void test_entries(void (*setup)(void)) {
+        char t[] = "/tmp/journal-entries-XXXXXX";
+        EntryCheck c;
+        sd_journal *j;
+        int r;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        setup();
+
+        /* Seek to head, process everything in one go.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        c = (EntryCheck) { .next = 1, .step = 1 };
+        assert_ret(r = sd_journal_next_entries(j, 10, check_entry, &c));
+        assert_se(r == 4);
+        assert_se(c.next == 5);
+        sd_journal_close(j);
+
+        /* Seek to head, process in batches of two.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        c = (EntryCheck) { .next = 1, .step = 1 };
+        assert_ret(r = sd_journal_next_entries(j, 2, check_entry, &c));
+        assert_se(r == 2);
+        assert_ret(r = sd_journal_next_entries(j, 2, check_entry, &c));
+        assert_se(r == 2);
+        assert_ret(r = sd_journal_next_entries(j, 2, check_entry, &c));
+        assert_se(r == 0);
+        sd_journal_close(j);
+
+        /* Seek to tail, iterate up until the callback says stop, then continue from there.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_tail(j));
+        c = (EntryCheck) { .next = 4, .step = -1, .stop = 3 };
+        assert_ret(r = sd_journal_previous_entries(j, 10, check_entry, &c));
+        assert_se(r == 2);
+        test_check_number(j, 3);
+        test_check_numbers_up(j, 3);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_sequence_numbers(void) {
 
         char t[] = "/tmp/journal-seq-XXXXXX";
@@ -273,6 +350,61 @@ static void test_sequence_numbers(void) {
         }
 }
 
+static void test_mapped_files_max(void) {
+        char t[] = "/tmp/journal-mapped-XXXXXX";
+        JournalFile *f[8];
+        sd_journal *j;
+        const void *d;
+        size_t l;
+        unsigned i, n = 0;
+        int r;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(f); i++) {
+                char name[STRLEN("mapped-.journal") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "mapped-%u.journal", i);
+                f[i] = test_open(name);
+        }
+
+        for (i = 0; i < 2 * ELEMENTSOF(f); i++)
+                append_number(f[i % ELEMENTSOF(f)], i + 1, NULL);
+
+        for (i = 0; i < ELEMENTSOF(f); i++)
+                test_close(f[i]);
+
+        /* Only keep two files mapped at a time, the others need to be reopened as we go */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        j->n_mapped_files_max = 2;
+
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(sd_journal_next(j));
+        test_check_numbers_down(j, 2 * ELEMENTSOF(f));
+        assert_se(ordered_set_size(j->mapped_files) <= 3);
+
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(sd_journal_previous(j));
+        test_check_numbers_up(j, 2 * ELEMENTSOF(f));
+        assert_se(ordered_set_size(j->mapped_files) <= 3);
+
+        assert_ret(sd_journal_query_unique(j, "NUMBER"));
+        while ((r = sd_journal_enumerate_unique(j, &d, &l)) > 0)
+                n++;
+        assert_ret(r);
+        assert_se(n == 2 * ELEMENTSOF(f));
+
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
 
@@ -285,7 +417,12 @@ int main(int argc, char *argv[]) {
         test_skip(setup_sequential);
         test_skip(setup_interleaved);
 
+        test_entries(setup_sequential);
+        test_entries(setup_interleaved);
+
         test_sequence_numbers();
 
+        test_mapped_files_max();
+
         return 0;
 }
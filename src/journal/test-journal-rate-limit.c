@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "journald-rate-limit.h"
+#include "log.h"
+#include "macro.h"
+
+static void test_burst(void) {
+        JournalRateLimit *r;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(r = journal_rate_limit_new());
+
+        /* A full bucket lets the whole burst through, and then starts suppressing */
+        for (i = 0; i < 10; i++)
+                assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 1);
+
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 0);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 0);
+
+        /* Other priority pools and other units are not affected */
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 10, LOG_ERR, 0) == 1);
+        assert_se(journal_rate_limit_test(r, NULL, "bar.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 1);
+
+        /* Zero disables rate limiting */
+        for (i = 0; i < 20; i++) {
+                assert_se(journal_rate_limit_test(r, NULL, "foo.service", 0, 10, LOG_INFO, 0) == 1);
+                assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 0, LOG_INFO, 0) == 1);
+        }
+
+        journal_rate_limit_free(r);
+}
+
+static void test_refill(void) {
+        JournalRateLimit *r;
+        unsigned i;
+        int k;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(r = journal_rate_limit_new());
+
+        /* 5 messages per second, i.e. one token every 200ms */
+        for (i = 0; i < 5; i++)
+                assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) == 1);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) == 0);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) == 0);
+
+        /* After one step, exactly one more message is permitted, and the suppressed ones are reported */
+        usleep(250 * USEC_PER_MSEC);
+        k = journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0);
+        assert_se(k == 3);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) == 0);
+
+        /* After a full interval, the bucket is full again */
+        usleep(1100 * USEC_PER_MSEC);
+        for (i = 0; i < 5; i++)
+                assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) >= 1);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", USEC_PER_SEC, 5, LOG_INFO, 0) == 0);
+
+        journal_rate_limit_free(r);
+}
+
+static void test_cache(void) {
+        JournalRateLimitGroup *g = NULL, *h = NULL;
+        JournalRateLimit *r;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(r = journal_rate_limit_new());
+
+        /* Two contexts of the same unit share the state */
+        for (i = 0; i < 5; i++)
+                assert_se(journal_rate_limit_test(r, &g, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 1);
+        assert_se(g);
+        for (i = 0; i < 5; i++)
+                assert_se(journal_rate_limit_test(r, &h, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 1);
+        assert_se(h == g);
+        assert_se(journal_rate_limit_test(r, &g, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 0);
+        assert_se(journal_rate_limit_test(r, NULL, "foo.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 0);
+
+        /* A context that moved to another unit picks up the right group */
+        assert_se(journal_rate_limit_test(r, &h, "bar.service", 10 * USEC_PER_SEC, 10, LOG_INFO, 0) == 1);
+        assert_se(h != g);
+
+        /* Cached groups survive the rate limit object */
+        h = journal_rate_limit_group_unref(h);
+        journal_rate_limit_free(r);
+        g = journal_rate_limit_group_unref(g);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_burst();
+        test_refill();
+        test_cache();
+
+        return 0;
+}
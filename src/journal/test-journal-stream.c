@@ -6,12 +6,15 @@
 #include "sd-journal.h"
 
 #include "alloc-util.h"
+#include "io-util.h"
 #include "journal-file.h"
 #include "journal-internal.h"
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
 #include "util.h"
 
 #define N_ENTRIES 200
@@ -56,12 +59,54 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
+static void test_unique_truncated(void) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        char t[] = "/tmp/journal-stream-unique-XXXXXX";
+        char v[1024];
+        JournalFile *f;
+        const void *data;
+        size_t l;
+        unsigned i, n;
+
+        assert_se(mkdtemp(t));
+        assert_se(journal_file_open(-1, strjoina(t, "/one.journal"), O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Large values are compressed, and hence truncated to the data threshold when read. These only differ in
+         * their very last byte. */
+        memcpy(v, "BIG=", 4);
+        memset(v + 4, 'x', sizeof(v) - 4);
+
+        for (i = 0; i < 3; i++) {
+                struct iovec iovec = IOVEC_MAKE(v, sizeof(v));
+                dual_timestamp ts;
+
+                v[sizeof(v) - 1] = '0' + i;
+
+                dual_timestamp_get(&ts);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 64) >= 0);
+
+        n = 0;
+        assert_se(sd_journal_query_unique(j, "BIG") >= 0);
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                n++;
+        assert_se(n == 3);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         JournalFile *one, *two, *three;
         char t[] = "/tmp/journal-stream-XXXXXX";
-        unsigned i;
+        unsigned i, n;
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         char *z;
+        const char *field;
         const void *data;
         size_t l;
         dual_timestamp previous_ts = DUAL_TIMESTAMP_NULL;
@@ -169,11 +214,37 @@ int main(int argc, char *argv[]) {
 
         verify_contents(j, 0);
 
+        /* Entries with i % 3 == 0 are stored in two of the files, each value must be returned only once */
+        n = 0;
         assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
                 printf("%.*s\n", (int) l, (const char*) data);
+                n++;
+        }
+        assert_se(n == N_ENTRIES);
+
+        n = 0;
+        assert_se(sd_journal_query_unique(j, "MAGIC") >= 0);
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                n++;
+        assert_se(n == 2);
+
+        /* Iterating again must return the same values */
+        n = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                n++;
+        assert_se(n == 2);
+
+        n = 0;
+        SD_JOURNAL_FOREACH_FIELD(j, field) {
+                assert_se(STR_IN_SET(field, "NUMBER", "MAGIC"));
+                n++;
+        }
+        assert_se(n == 2);
 
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
+        test_unique_truncated();
+
         return 0;
 }
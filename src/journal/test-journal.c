@@ -3,11 +3,18 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "env-util.h"
+#include "glob-util.h"
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
+#include "lookup3.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 
 static bool arg_keep = false;
 
@@ -27,6 +34,8 @@ static void test_non_empty(void) {
         assert_se(chdir(t) >= 0);
 
         assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_COMPACT(f->header) == (getenv_bool("SYSTEMD_JOURNAL_COMPACT") > 0));
+        assert_se(JOURNAL_HEADER_KEYED_HASH(f->header) == (getenv_bool("SYSTEMD_JOURNAL_KEYED_HASH") > 0));
 
         assert_se(dual_timestamp_get(&ts));
         assert_se(sd_id128_randomize(&fake_boot_id) == 0);
@@ -90,6 +99,20 @@ static void test_non_empty(void) {
 
         assert_se(journal_file_move_to_entry_by_seqnum(f, 10, DIRECTION_DOWN, &o, NULL) == 0);
 
+        assert_se(journal_file_move_to_entry_by_realtime(f, ts.realtime, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+
+        assert_se(journal_file_move_to_entry_by_realtime(f, ts.realtime, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+
+        assert_se(journal_file_move_to_entry_by_realtime(f, ts.realtime + 1, DIRECTION_DOWN, &o, NULL) == 0);
+        assert_se(journal_file_move_to_entry_by_realtime(f, ts.realtime - 1, DIRECTION_UP, &o, NULL) == 0);
+
+        assert_se(journal_file_find_data_object(f, test, strlen(test), NULL, &p) == 1);
+        assert_se(journal_file_move_to_entry_by_realtime_for_data(f, p, ts.realtime, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+        assert_se(journal_file_move_to_entry_by_realtime_for_data(f, p, ts.realtime + 1, DIRECTION_DOWN, &o, NULL) == 0);
+
         journal_file_rotate(&f, true, (uint64_t) -1, true, NULL);
         journal_file_rotate(&f, true, (uint64_t) -1, true, NULL);
 
@@ -108,6 +131,68 @@ static void test_non_empty(void) {
         puts("------------------------------------------------------------");
 }
 
+static void test_append_entries(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        static const char test[] = "TEST1=1", test2[] = "TEST2=2";
+        struct iovec iovec[2];
+        JournalEntry entries[3];
+        Object *o;
+        uint64_t p, seqnum = 0;
+        size_t n = 0;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        iovec[0] = IOVEC_MAKE_STRING(test);
+        iovec[1] = IOVEC_MAKE_STRING(test2);
+
+        entries[0] = (JournalEntry) { .ts = &ts, .iovec = iovec, .n_iovec = 1 };
+        entries[1] = (JournalEntry) { .ts = &ts, .iovec = iovec + 1, .n_iovec = 1 };
+        entries[2] = (JournalEntry) { .ts = &ts, .iovec = iovec, .n_iovec = 2 };
+
+        assert_se(journal_file_append_entries(f, entries, 0, &seqnum, &n) == 0);
+        assert_se(n == 0);
+
+        assert_se(journal_file_append_entries(f, entries, ELEMENTSOF(entries), &seqnum, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries));
+        assert_se(seqnum == 3);
+        assert_se(le64toh(f->header->n_entries) == 3);
+
+        assert_se(journal_file_next_entry(f, 0, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+        assert_se(journal_file_entry_n_items(o) == 1);
+
+        assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 2);
+
+        assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+        assert_se(journal_file_entry_n_items(o) == 2);
+
+        assert_se(journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) == 0);
+
+        /* Data objects are shared between the entries of a batch */
+        assert_se(journal_file_find_data_object(f, test, strlen(test), &o, NULL) == 1);
+        assert_se(le64toh(o->data.n_entries) == 2);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_empty(void) {
         JournalFile *f1, *f2, *f3, *f4;
         char t[] = "/tmp/journal-XXXXXX";
@@ -150,7 +235,7 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
         JournalFile *f;
@@ -214,6 +299,70 @@ static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         return is_compressed;
 }
 
+#if HAVE_ZSTD
+static void test_compress_dictionary(void) {
+        dual_timestamp ts;
+        JournalFile *a, *b;
+        static const char msg[] = "MESSAGE=Started Session 4711 of user lennart.";
+        char buf[128];
+        struct iovec iovec;
+        Object *o;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "a.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &a) == 0);
+        assert_se(journal_file_open(-1, "b.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &b) == 0);
+        assert_se(b->compress_zstd);
+
+        /* Not enough samples yet */
+        assert_se(journal_file_train_dictionary(b, a) == -ENODATA);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        for (i = 0; i < 512; i++) {
+                xsprintf(buf, "MESSAGE=%s Session %u of user %s.", i % 3 ? "Started" : "Stopped", i, i % 2 ? "root" : "lennart");
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(a, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(journal_file_train_dictionary(b, a) == 0);
+        assert_se(JOURNAL_HEADER_ZSTD_DICTIONARY(b->header));
+        assert_se(journal_file_train_dictionary(b, a) == -EBUSY);
+
+        /* Short data objects are compressed now, well below the usual threshold */
+        iovec = IOVEC_MAKE_STRING(msg);
+        assert_se(journal_file_append_entry(b, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_find_data_object(b, msg, strlen(msg), &o, NULL) == 1);
+        assert_se(o->object.flags & OBJECT_COMPRESSED_ZSTD);
+        assert_se(le64toh(o->object.size) - offsetof(Object, data.payload) < strlen(msg));
+
+        /* Dictionaries may only be added to empty files */
+        assert_se(journal_file_append_dictionary(a, buf, strlen(buf)) == -EBUSY);
+
+        (void) journal_file_close(a);
+        (void) journal_file_close(b);
+
+        /* The dictionary is picked up again when reading the file back */
+        assert_se(journal_file_open(-1, "b.journal", O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &b) == 0);
+        assert_se(journal_file_find_data_object(b, msg, strlen(msg), &o, NULL) == 1);
+        assert_se(journal_file_verify(b, NULL, NULL, NULL, NULL, false) >= 0);
+        journal_file_print_header(b);
+        (void) journal_file_close(b);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
 static void test_min_compress_size(void) {
         /* Note that XZ will actually fail to compress anything under 80 bytes, so you have to choose the limits
          * carefully */
@@ -235,6 +384,279 @@ static void test_min_compress_size(void) {
 }
 #endif
 
+static void test_bloom_filter(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        char buf[64];
+        struct iovec iovec;
+        Object *o;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Nothing to filter yet */
+        assert_se(journal_file_append_bloom_filter(f) == -ENODATA);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        for (i = 0; i < 256; i++) {
+                xsprintf(buf, "TEST=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(journal_file_append_bloom_filter(f) == 0);
+        assert_se(JOURNAL_HEADER_BLOOM_FILTER(f->header));
+        assert_se(journal_file_append_bloom_filter(f) == -EBUSY);
+
+        (void) journal_file_close(f);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 256; i++) {
+                xsprintf(buf, "TEST=%u", i);
+                assert_se(journal_file_bloom_filter_check(f, journal_file_hash_data(f, buf, strlen(buf))) > 0);
+                assert_se(journal_file_find_data_object(f, buf, strlen(buf), &o, NULL) == 1);
+        }
+
+        for (i = 256; i < 512; i++) {
+                xsprintf(buf, "TEST=%u", i);
+                assert_se(journal_file_find_data_object(f, buf, strlen(buf), &o, NULL) == 0);
+        }
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+        journal_file_print_header(f);
+        (void) journal_file_close(f);
+
+        /* The filter can't be kept up-to-date, hence the file can't be appended to anymore */
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR, 0, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == -ESHUTDOWN);
+
+        /* Archived files get it from the offline thread */
+        assert_se(journal_file_open(-1, "archived.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 256; i++) {
+                xsprintf(buf, "TEST=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        f->archive = true;
+        assert_se(journal_file_set_offline(f, false) >= 0);
+        assert_se(journal_file_set_offline(f, true) >= 0);
+        assert_se(JOURNAL_HEADER_BLOOM_FILTER(f->header));
+        assert_se(f->header->state == STATE_ARCHIVED);
+        (void) journal_file_close(f);
+
+        assert_se(journal_file_open(-1, "archived.journal", O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_find_data_object(f, "TEST=17", STRLEN("TEST=17"), &o, NULL) == 1);
+        assert_se(journal_file_find_data_object(f, "TEST=4711", STRLEN("TEST=4711"), &o, NULL) == 0);
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_preallocate(void) {
+        JournalMetrics metrics = {
+                .max_size = 32 * 1024 * 1024,
+                .min_size = 0,
+                .max_use = 0,
+                .min_use = 0,
+                .keep_free = 0,
+                .n_max_files = 0,
+        };
+        JournalFile *f;
+        struct stat st;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        /* By default, the file is grown step by step */
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+        assert_se(fstat(f->fd, &st) >= 0);
+        assert_se(st.st_size > 0 && st.st_size < 32 * 1024 * 1024);
+        (void) journal_file_close(f);
+
+        /* If asked to, all of it is allocated right away */
+        assert_se(setenv("SYSTEMD_JOURNAL_PREALLOCATE", "1", 1) >= 0);
+        assert_se(journal_file_open(-1, "test-preallocate.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+        assert_se(fstat(f->fd, &st) >= 0);
+        assert_se(st.st_size == 32 * 1024 * 1024);
+        assert_se(le64toh(f->header->header_size) + le64toh(f->header->arena_size) == 32 * 1024 * 1024);
+        (void) journal_file_close(f);
+        assert_se(unsetenv("SYSTEMD_JOURNAL_PREALLOCATE") >= 0);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_seek(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        Object *o;
+        uint64_t i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Enough entries for a chain of several entry arrays, with even realtime timestamps */
+        assert_se(dual_timestamp_get(&ts));
+        for (i = 0; i < 2000; i++) {
+                char buf[DECIMAL_STR_MAX(uint64_t) + 8];
+
+                ts.realtime = 1000 + i * 2;
+                ts.monotonic++;
+
+                xsprintf(buf, "NUMBER=%" PRIu64, i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        /* Backwards, so that the entry array chain cache doesn't help */
+        for (i = 2000; i > 0; i--) {
+                assert_se(journal_file_move_to_entry_by_seqnum(f, i, DIRECTION_DOWN, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i);
+
+                assert_se(journal_file_move_to_entry_by_seqnum(f, i, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i);
+
+                /* Right before the entry */
+                assert_se(journal_file_move_to_entry_by_realtime(f, 1000 + i * 2 - 3, DIRECTION_DOWN, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i);
+
+                if (i > 1) {
+                        assert_se(journal_file_move_to_entry_by_realtime(f, 1000 + i * 2 - 3, DIRECTION_UP, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == i - 1);
+                }
+        }
+
+        assert_se(journal_file_move_to_entry_by_seqnum(f, 2001, DIRECTION_DOWN, &o, NULL) == 0);
+        assert_se(journal_file_move_to_entry_by_seqnum(f, 2001, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 2000);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 999, DIRECTION_UP, &o, NULL) == 0);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static unsigned count_archived(void) {
+        _cleanup_globfree_ glob_t g = {};
+
+        if (safe_glob("test@*.journal", 0, &g) < 0)
+                return 0;
+
+        return g.gl_pathc;
+}
+
+static void test_vacuum_cache(void) {
+        _cleanup_(journal_vacuum_cache_freep) JournalVacuumCache *cache = NULL;
+        static const char test[] = "TEST1=1";
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+        iovec = IOVEC_MAKE_STRING(test);
+        assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_rotate(&f, true, (uint64_t) -1, false, NULL) >= 0);
+        assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        assert_se(journal_file_rotate(&f, true, (uint64_t) -1, false, NULL) >= 0);
+        (void) journal_file_close(f);
+
+        assert_se(count_archived() == 2);
+
+        /* Nothing to vacuum, but the second round is served from the cache */
+        assert_se(journal_directory_vacuum_cached(".", (uint64_t) -1, 0, 0, NULL, true, &cache) >= 0);
+        assert_se(cache);
+        assert_se(count_archived() == 2);
+        assert_se(journal_directory_vacuum_cached(".", (uint64_t) -1, 0, 0, NULL, true, &cache) >= 0);
+        assert_se(count_archived() == 2);
+
+        /* Now only room for the active file */
+        assert_se(journal_directory_vacuum_cached(".", 0, 1, 0, NULL, true, &cache) >= 0);
+        assert_se(count_archived() == 0);
+        assert_se(access("test.journal", F_OK) >= 0);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_hash_speed(void) {
+        static const size_t sizes[] = { 8, 32, 128, 1024, 16384 };
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        _cleanup_free_ uint8_t *buf = NULL;
+        uint64_t x = 0;
+        sd_id128_t key;
+        size_t i, k;
+
+        /* Compare the speed of the unkeyed and the keyed hash, on the same amount of data for each field size */
+
+        assert_se(buf = malloc(sizes[ELEMENTSOF(sizes) - 1]));
+        for (k = 0; k < sizes[ELEMENTSOF(sizes) - 1]; k++)
+                buf[k] = (uint8_t) k;
+
+        assert_se(sd_id128_randomize(&key) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(sizes); i++) {
+                size_t n = 64 * 1024 * 1024 / sizes[i];
+                usec_t t1, t2;
+
+                t1 = now(CLOCK_MONOTONIC);
+                for (k = 0; k < n; k++)
+                        x ^= hash64(buf, sizes[i]);
+                t1 = now(CLOCK_MONOTONIC) - t1;
+
+                t2 = now(CLOCK_MONOTONIC);
+                for (k = 0; k < n; k++)
+                        x ^= siphash24(buf, sizes[i], key.bytes);
+                t2 = now(CLOCK_MONOTONIC) - t2;
+
+                log_info("%5zu byte fields: hash64 %s, siphash24 %s for 64M",
+                         sizes[i],
+                         format_timespan(ts1, sizeof(ts1), t1, 1),
+                         format_timespan(ts2, sizeof(ts2), t2, 1));
+        }
+
+        /* Make sure the loops aren't optimized away */
+        log_debug("%" PRIx64, x);
+}
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -243,10 +665,35 @@ int main(int argc, char *argv[]) {
                 return EXIT_TEST_SKIP;
 
         test_non_empty();
+        test_append_entries();
         test_empty();
-#if HAVE_XZ || HAVE_LZ4
+        test_bloom_filter();
+
+        /* And once more with 32bit entry array items */
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "1", 1) >= 0);
+        test_non_empty();
+        test_append_entries();
+        test_bloom_filter();
+        assert_se(unsetenv("SYSTEMD_JOURNAL_COMPACT") >= 0);
+
+        /* And once more with the keyed hash */
+        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "1", 1) >= 0);
+        test_non_empty();
+        test_append_entries();
+        test_bloom_filter();
+        assert_se(unsetenv("SYSTEMD_JOURNAL_KEYED_HASH") >= 0);
+
+        test_preallocate();
+        test_vacuum_cache();
+        test_seek();
+        test_hash_speed();
+
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         test_min_compress_size();
 #endif
+#if HAVE_ZSTD
+        test_compress_dictionary();
+#endif
 
         return 0;
 }
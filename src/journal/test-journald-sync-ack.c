@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "sd-event.h"
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journald-server.h"
+#include "log.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "util.h"
+
+static void send_with_ack(int fd, const char *message, int *ack_fd) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int))];
+        } control = {};
+        struct iovec iovec = IOVEC_MAKE_STRING(message);
+        struct msghdr mh = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        int pipe_fds[2];
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC|O_NONBLOCK) >= 0);
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pipe_fds[1], sizeof(int));
+
+        assert_se(sendmsg(fd, &mh, MSG_NOSIGNAL) >= 0);
+
+        safe_close(pipe_fds[1]);
+        *ack_fd = pipe_fds[0];
+}
+
+/* Returns 0 while the acknowledgement is pending, 1 once it was given, and -1 once the message was refused */
+static int ack_state(int fd) {
+        char c;
+        ssize_t l;
+
+        l = read(fd, &c, 1);
+        if (l < 0) {
+                assert_se(errno == EAGAIN);
+                return 0;
+        }
+
+        return l == 0 ? 1 : -1;
+}
+
+static void run_until_acked(Server *s, int fd) {
+        usec_t deadline;
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), 10 * USEC_PER_SEC);
+
+        while (ack_state(fd) == 0) {
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(s->event, 100 * USEC_PER_MSEC) >= 0);
+        }
+}
+
+static void test_sync_ack(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_close_pair_ int fds[2] = { -1, -1 };
+        _cleanup_close_ int a = -1, b = -1, c = -1;
+        Server s = {
+                .syslog_fd = -1,
+                .native_fd = -1,
+                .audit_fd = -1,
+                .vacuum_event_fd = -1,
+                .max_level_store = LOG_DEBUG,
+        };
+        char ack_byte;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-journald-sync-ack-XXXXXX", &dir) >= 0);
+        assert_se(sd_event_new(&s.event) >= 0);
+
+        s.system_storage.name = "System Journal";
+        s.system_storage.path = dir;
+        journal_reset_metrics(&s.system_storage.metrics);
+
+        assert_se(journal_file_open(-1, strjoina(dir, "/system.journal"), O_RDWR|O_CREAT, 0644,
+                                    false, 0, false, NULL, NULL, NULL, NULL, &s.system_journal) >= 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fds) >= 0);
+        s.native_fd = fds[0];
+
+        /* Messages that are stored are acknowledged by the sync, which is never done right-away, so that all
+         * messages received in one go share it */
+        send_with_ack(fds[1], "MESSAGE=foo\nPRIORITY=6\n", &a);
+        send_with_ack(fds[1], "MESSAGE=bar\nPRIORITY=6\n", &b);
+
+        assert_se(server_process_datagram(NULL, s.native_fd, EPOLLIN, &s) >= 0);
+        assert_se(ack_state(a) == 0);
+        assert_se(s.n_sync_ack_fds == 1);
+
+        assert_se(server_process_datagram(NULL, s.native_fd, EPOLLIN, &s) >= 0);
+        assert_se(s.n_sync_ack_fds == 2);
+
+        run_until_acked(&s, a);
+        assert_se(ack_state(a) == 1);
+        assert_se(ack_state(b) == 1);
+        assert_se(s.n_sync_ack_fds == 0);
+
+        /* Messages that are dropped are refused right-away */
+        s.max_level_store = LOG_ERR;
+        send_with_ack(fds[1], "MESSAGE=baz\nPRIORITY=6\n", &c);
+
+        assert_se(server_process_datagram(NULL, s.native_fd, EPOLLIN, &s) >= 0);
+        assert_se(read(c, &ack_byte, 1) == 1);
+        assert_se(ack_state(c) == 1);
+        assert_se(s.n_sync_ack_fds == 0);
+
+        journal_file_close(s.system_journal);
+        free(s.buffer);
+        free(s.datagram_pool);
+        free(s.sync_ack_fds);
+        sd_event_source_unref(s.sync_event_source);
+        sd_event_unref(s.event);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_sync_ack();
+
+        return 0;
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+
+#include "sd-event.h"
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "journal-file.h"
+#include "journald-server.h"
+#include "log.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "util.h"
+
+static void run_until_vacuumed(Server *s) {
+        usec_t deadline;
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), 10 * USEC_PER_SEC);
+
+        while (s->system_storage.vacuum_job) {
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(s->event, 100 * USEC_PER_MSEC) >= 0);
+        }
+}
+
+static void test_vacuum_back_to_back(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        Server s = {
+                .vacuum_event_fd = -1,
+        };
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-journald-vacuum-XXXXXX", &dir) >= 0);
+        assert_se(sd_event_new(&s.event) >= 0);
+
+        s.system_storage.name = "System Journal";
+        s.system_storage.path = dir;
+        journal_reset_metrics(&s.system_storage.metrics);
+
+        assert_se(journal_file_open(-1, strjoina(dir, "/system.journal"), O_RDWR|O_CREAT, 0644,
+                                    false, 0, false, NULL, NULL, NULL, NULL, &s.system_journal) >= 0);
+
+        /* Each vacuum job has to be picked up, however quickly the next one follows */
+        for (i = 0; i < 200; i++) {
+                assert_se(server_vacuum(&s, false, false) >= 0);
+                assert_se(s.system_storage.vacuum_job);
+
+                run_until_vacuumed(&s);
+        }
+
+        /* A request while a job is running is done once the job finished */
+        assert_se(server_vacuum(&s, false, false) >= 0);
+        assert_se(server_vacuum(&s, false, false) >= 0);
+        run_until_vacuumed(&s);
+
+        /* … and one that waits doesn't leave a job behind */
+        assert_se(server_vacuum(&s, false, false) >= 0);
+        assert_se(server_vacuum(&s, false, true) >= 0);
+        assert_se(!s.system_storage.vacuum_job);
+
+        journal_file_close(s.system_journal);
+        journal_vacuum_cache_free(s.system_storage.vacuum_cache);
+        sd_event_source_unref(s.vacuum_event_source);
+        safe_close(s.vacuum_event_fd);
+        sd_event_unref(s.event);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_vacuum_back_to_back();
+
+        return 0;
+}
@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "fd-util.h"
@@ -17,6 +18,8 @@ int main(int argc, char *argv[]) {
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
         void *p, *q;
+        size_t l;
+        struct stat st;
 
         assert_se(m = mmap_cache_new());
 
@@ -58,6 +61,32 @@ int main(int argc, char *argv[]) {
         mmap_cache_free_fd(m, fx);
         mmap_cache_unref(m);
 
+        /* In sequential mode, windows are large and mostly extend forward from the requested offset */
+        assert_se(m = mmap_cache_new());
+        mmap_cache_set_sequential(m, true);
+
+        assert_se(ftruncate(x, 128ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(x, &st) >= 0);
+        assert_se(fx = mmap_cache_add_fd(m, x));
+
+        r = mmap_cache_get(m, fx, PROT_READ, 0, false, 32ULL*1024ULL*1024ULL, 2, &st, &p, &l);
+        assert_se(r >= 0);
+        assert_se(l >= 48ULL*1024ULL*1024ULL);
+        assert_se(mmap_cache_get_missed(m) == 1);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 0, false, 32ULL*1024ULL*1024ULL + 40ULL*1024ULL*1024ULL, 2, &st, &q, NULL);
+        assert_se(r >= 0);
+        assert_se((uint8_t*) p + 40ULL*1024ULL*1024ULL == (uint8_t*) q);
+        assert_se(mmap_cache_get_missed(m) == 1);
+
+        /* Windows are clamped to the file size */
+        r = mmap_cache_get(m, fx, PROT_READ, 1, false, 127ULL*1024ULL*1024ULL, 2, &st, &p, &l);
+        assert_se(r >= 0);
+        assert_se(l == 1024ULL*1024ULL);
+
+        mmap_cache_free_fd(m, fx);
+        mmap_cache_unref(m);
+
         safe_close(x);
         safe_close(y);
         safe_close(z);
@@ -52,6 +52,7 @@ struct sd_dhcp_server {
 
         Hashmap *leases_by_client_id;
         DHCPLease **bound_leases;
+        uint32_t *bound_bitmap; /* One bit per address in the pool, set when taken in bound_leases */
         DHCPLease invalid_lease;
 
         uint32_t max_lease_time, default_lease_time;
@@ -21,6 +21,7 @@ struct sd_lldp {
 
         Prioq *neighbor_by_expiry;
         Hashmap *neighbor_by_id;
+        Hashmap *neighbor_by_raw; /* Indexed by the unparsed frame, to recognize unchanged ones quickly */
 
         uint64_t neighbors_max;
 
@@ -42,6 +42,29 @@ const struct hash_ops lldp_neighbor_id_hash_ops = {
         .compare = lldp_neighbor_id_compare_func
 };
 
+static void lldp_neighbor_raw_hash_func(const void *p, struct siphash *state) {
+        const sd_lldp_neighbor *n = p;
+
+        siphash24_compress(LLDP_NEIGHBOR_RAW(n), n->raw_size, state);
+        siphash24_compress(&n->raw_size, sizeof(n->raw_size), state);
+}
+
+static int lldp_neighbor_raw_compare_func(const void *a, const void *b) {
+        const sd_lldp_neighbor *x = a, *y = b;
+        int r;
+
+        r = CMP(x->raw_size, y->raw_size);
+        if (r != 0)
+                return r;
+
+        return memcmp(LLDP_NEIGHBOR_RAW(x), LLDP_NEIGHBOR_RAW(y), x->raw_size);
+}
+
+const struct hash_ops lldp_neighbor_raw_hash_ops = {
+        .hash = lldp_neighbor_raw_hash_func,
+        .compare = lldp_neighbor_raw_compare_func
+};
+
 int lldp_neighbor_prioq_compare_func(const void *a, const void *b) {
         const sd_lldp_neighbor *x = a, *y = b;
 
@@ -99,6 +122,7 @@ sd_lldp_neighbor *lldp_neighbor_unlink(sd_lldp_neighbor *n) {
                 return NULL;
 
         assert_se(hashmap_remove(n->lldp->neighbor_by_id, &n->id) == n);
+        assert_se(hashmap_remove(n->lldp->neighbor_by_raw, n) == n);
         assert_se(prioq_remove(n->lldp->neighbor_by_expiry, n, &n->prioq_idx) >= 0);
 
         n->lldp = NULL;
@@ -20,6 +20,9 @@
 #define DHCP_DEFAULT_LEASE_TIME_USEC USEC_PER_HOUR
 #define DHCP_MAX_LEASE_TIME_USEC (USEC_PER_HOUR*12)
 
+/* How many requests to handle at most per wakeup */
+#define RECEIVE_BATCH_MAX 16U
+
 static void dhcp_lease_free(DHCPLease *lease) {
         if (!lease)
                 return;
@@ -28,6 +31,18 @@ static void dhcp_lease_free(DHCPLease *lease) {
         free(lease);
 }
 
+static void server_bind_lease(sd_dhcp_server *server, uint32_t offset, DHCPLease *lease) {
+        assert(server);
+        assert(offset < server->pool_size);
+
+        server->bound_leases[offset] = lease;
+
+        if (lease)
+                server->bound_bitmap[offset / 32] |= UINT32_C(1) << (offset % 32);
+        else
+                server->bound_bitmap[offset / 32] &= ~(UINT32_C(1) << (offset % 32));
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -73,11 +88,24 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                _cleanup_free_ DHCPLease **bound_leases = NULL;
+                _cleanup_free_ uint32_t *bound_bitmap = NULL;
+
+                bound_leases = new0(DHCPLease*, size);
+                if (!bound_leases)
                         return -ENOMEM;
 
+                bound_bitmap = new0(uint32_t, DIV_ROUND_UP(size, 32));
+                if (!bound_bitmap)
+                        return -ENOMEM;
+
+                /* Mark the tail of the last word beyond the end of the pool as taken */
+                if (size % 32 != 0)
+                        bound_bitmap[size / 32] = UINT32_MAX << (size % 32);
+
+                free_and_replace(server->bound_leases, bound_leases);
+                free_and_replace(server->bound_bitmap, bound_bitmap);
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -86,7 +114,7 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 server->subnet = address->s_addr & netmask;
 
                 if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
+                        server_bind_lease(server, server_off - offset, &server->invalid_lease);
 
                 /* Drop any leases associated with the old address range */
                 hashmap_clear_with_destructor(server->leases_by_client_id, dhcp_lease_free);
@@ -154,6 +182,7 @@ static sd_dhcp_server *dhcp_server_free(sd_dhcp_server *server) {
         hashmap_free(server->leases_by_client_id);
 
         free(server->bound_leases);
+        free(server->bound_bitmap);
         return mfree(server);
 }
 
@@ -676,6 +705,58 @@ static int get_pool_offset(sd_dhcp_server *server, be32_t requested_ip) {
         return be32toh(requested_ip & ~server->netmask) - server->pool_offset;
 }
 
+static int server_find_free_offset(sd_dhcp_server *server, uint32_t start) {
+        uint32_t n, w, bits, i;
+
+        assert(server);
+        assert(start < server->pool_size);
+
+        /* Returns the first free address at or after start, wrapping around at the end of the pool. Looks at 32
+         * addresses at once, so that finding one stays cheap even when most of a large pool is taken. */
+
+        n = DIV_ROUND_UP(server->pool_size, 32);
+        w = start / 32;
+        bits = ~server->bound_bitmap[w] & (UINT32_MAX << (start % 32));
+
+        for (i = 0; i <= n; i++) {
+                if (bits != 0)
+                        return w * 32 + u32ctz(bits);
+
+                w = (w + 1) % n;
+                bits = ~server->bound_bitmap[w];
+        }
+
+        return -ENOSPC;
+}
+
+static unsigned server_reclaim_expired_leases(sd_dhcp_server *server) {
+        usec_t time_now;
+        unsigned n = 0;
+        uint32_t i;
+
+        assert(server);
+
+        if (sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now) < 0)
+                return 0;
+
+        for (i = 0; i < server->pool_size; i++) {
+                DHCPLease *lease = server->bound_leases[i];
+
+                if (!lease || lease == &server->invalid_lease)
+                        continue;
+
+                if (lease->expiration > time_now)
+                        continue;
+
+                server_bind_lease(server, i, NULL);
+                hashmap_remove(server->leases_by_client_id, &lease->client_id);
+                dhcp_lease_free(lease);
+                n++;
+        }
+
+        return n;
+}
+
 #define HASH_KEY SD_ID128_MAKE(0d,1d,fe,bd,f1,24,bd,b3,47,f1,dd,6e,73,21,93,30)
 
 int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
@@ -713,7 +794,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -739,14 +819,15 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         hash = htole64(siphash24_finalize(&state));
                         next_offer = hash % server->pool_size;
 
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
+                        r = server_find_free_offset(server, next_offer);
 
-                                next_offer = (next_offer + 1) % server->pool_size;
-                        }
+                        /* When the pool is exhausted, make room by dropping the leases that ran out, and
+                         * try again. Doing this only when needed keeps the common case cheap. */
+                        if (r < 0 && server_reclaim_expired_leases(server) > 0)
+                                r = server_find_free_offset(server, next_offer);
+
+                        if (r >= 0)
+                                address = server->subnet | htobe32(server->pool_offset + r);
                 }
 
                 if (address == INADDR_ANY)
@@ -869,7 +950,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
+                                server_bind_lease(server, pool_offset, lease);
                                 hashmap_put(server->leases_by_client_id,
                                             &lease->client_id, lease);
 
@@ -906,7 +987,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         return 0;
 
                 if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
+                        server_bind_lease(server, pool_offset, NULL);
                         hashmap_remove(server->leases_by_client_id, existing_lease);
                         dhcp_lease_free(existing_lease);
                 }
@@ -917,11 +998,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
         return 0;
 }
 
-static int server_receive_message(sd_event_source *s, int fd,
-                                  uint32_t revents, void *userdata) {
+static int server_receive_one(sd_dhcp_server *server, int fd) {
         _cleanup_free_ DHCPMessage *message = NULL;
         uint8_t cmsgbuf[CMSG_LEN(sizeof(struct in_pktinfo))];
-        sd_dhcp_server *server = userdata;
         struct iovec iov = {};
         struct msghdr msg = {
                 .msg_iov = &iov,
@@ -935,7 +1014,11 @@ static int server_receive_message(sd_event_source *s, int fd,
 
         assert(server);
 
+        /* Returns 1 if a datagram was read (whether it was for us or not), and 0 if there was none */
+
         buflen = next_datagram_size_fd(fd);
+        if (IN_SET(buflen, -EAGAIN, -EINTR))
+                return 0;
         if (buflen < 0)
                 return buflen;
 
@@ -954,7 +1037,7 @@ static int server_receive_message(sd_event_source *s, int fd,
                 return -errno;
         }
         if ((size_t)len < sizeof(DHCPMessage))
-                return 0;
+                return 1;
 
         CMSG_FOREACH(cmsg, &msg) {
                 if (cmsg->cmsg_level == IPPROTO_IP &&
@@ -965,7 +1048,7 @@ static int server_receive_message(sd_event_source *s, int fd,
                         /* TODO figure out if this can be done as a filter on
                          * the socket, like for IPv6 */
                         if (server->ifindex != info->ipi_ifindex)
-                                return 0;
+                                return 1;
 
                         break;
                 }
@@ -975,6 +1058,25 @@ static int server_receive_message(sd_event_source *s, int fd,
         if (r < 0)
                 log_dhcp_server_errno(server, r, "Couldn't process incoming message: %m");
 
+        return 1;
+}
+
+static int server_receive_message(sd_event_source *s, int fd,
+                                  uint32_t revents, void *userdata) {
+        sd_dhcp_server *server = userdata;
+        unsigned i;
+        int r;
+
+        assert(server);
+
+        /* With many clients on the link there's usually more than one request queued up by the time we get
+         * to run, hence handle a batch of them per wakeup, but not so many that others are starved. */
+        for (i = 0; i < RECEIVE_BATCH_MAX; i++) {
+                r = server_receive_one(server, fd);
+                if (r <= 0)
+                        return r;
+        }
+
         return 0;
 }
 
@@ -14,6 +14,7 @@
 #include "ether-addr-util.h"
 
 #define LLDP_DEFAULT_NEIGHBORS_MAX 128U
+#define LLDP_RECEIVE_BATCH_MAX 32U
 
 static void lldp_flush_neighbors(sd_lldp *lldp) {
         sd_lldp_neighbor *n;
@@ -139,9 +140,16 @@ static int lldp_add_neighbor(sd_lldp *lldp, sd_lldp_neighbor *n) {
         if (r < 0)
                 goto finish;
 
+        r = hashmap_put(lldp->neighbor_by_raw, n, n);
+        if (r < 0) {
+                assert_se(hashmap_remove(lldp->neighbor_by_id, &n->id) == n);
+                goto finish;
+        }
+
         r = prioq_put(lldp->neighbor_by_expiry, n, &n->prioq_idx);
         if (r < 0) {
                 assert_se(hashmap_remove(lldp->neighbor_by_id, &n->id) == n);
+                assert_se(hashmap_remove(lldp->neighbor_by_raw, n) == n);
                 goto finish;
         }
 
@@ -160,11 +168,24 @@ finish:
 }
 
 static int lldp_handle_datagram(sd_lldp *lldp, sd_lldp_neighbor *n) {
+        sd_lldp_neighbor *old;
         int r;
 
         assert(lldp);
         assert(n);
 
+        /* Most frames just repeat what the neighbor sent the last time. Recognize those by their unparsed
+         * contents, and only restart the TTL counter for them, without taking them apart again. */
+        old = hashmap_get(lldp->neighbor_by_raw, n);
+        if (old && lldp_keep_neighbor(lldp, old)) {
+                old->timestamp = n->timestamp;
+                lldp_start_timer(lldp, old);
+                lldp_callback(lldp, SD_LLDP_EVENT_REFRESHED, old);
+
+                log_lldp("Refreshed neighbor from unchanged LLDP datagram.");
+                return 0;
+        }
+
         r = lldp_neighbor_parse(n);
         if (r == -EBADMSG) /* Ignore bad messages */
                 return 0;
@@ -181,16 +202,20 @@ static int lldp_handle_datagram(sd_lldp *lldp, sd_lldp_neighbor *n) {
         return 0;
 }
 
-static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+static int lldp_receive_one(sd_lldp *lldp, int fd) {
         _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *n = NULL;
         ssize_t space, length;
-        sd_lldp *lldp = userdata;
         struct timespec ts;
+        int r;
 
-        assert(fd >= 0);
         assert(lldp);
+        assert(fd >= 0);
+
+        /* Returns 1 if a datagram was read, and 0 if there was none left */
 
         space = next_datagram_size_fd(fd);
+        if (IN_SET(space, -EAGAIN, -EINTR))
+                return 0;
         if (space < 0)
                 return log_lldp_errno(space, "Failed to determine datagram size to read: %m");
 
@@ -217,7 +242,30 @@ static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, v
         else
                 triple_timestamp_get(&n->timestamp);
 
-        return lldp_handle_datagram(lldp, n);
+        r = lldp_handle_datagram(lldp, n);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        sd_lldp *lldp = userdata;
+        unsigned i;
+        int r;
+
+        assert(fd >= 0);
+        assert(lldp);
+
+        /* With many neighbors on the port, frames tend to arrive in bunches, hence read all that are queued,
+         * up to a limit, before going back to the event loop */
+        for (i = 0; i < LLDP_RECEIVE_BATCH_MAX; i++) {
+                r = lldp_receive_one(lldp, fd);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 static void lldp_reset(sd_lldp *lldp) {
@@ -337,6 +385,7 @@ static sd_lldp* lldp_free(sd_lldp *lldp) {
         lldp_flush_neighbors(lldp);
 
         hashmap_free(lldp->neighbor_by_id);
+        hashmap_free(lldp->neighbor_by_raw);
         prioq_free(lldp->neighbor_by_expiry);
         return mfree(lldp);
 }
@@ -362,6 +411,10 @@ _public_ int sd_lldp_new(sd_lldp **ret) {
         if (!lldp->neighbor_by_id)
                 return -ENOMEM;
 
+        lldp->neighbor_by_raw = hashmap_new(&lldp_neighbor_raw_hash_ops);
+        if (!lldp->neighbor_by_raw)
+                return -ENOMEM;
+
         r = prioq_ensure_allocated(&lldp->neighbor_by_expiry, lldp_neighbor_prioq_compare_func);
         if (r < 0)
                 return r;
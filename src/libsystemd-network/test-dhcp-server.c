@@ -180,6 +180,72 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+static void test_lease_reclaim(void) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
+        struct {
+                DHCPMessage message;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t type;
+                } _packed_ option_type;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_requested_ip;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_server_id;
+                uint8_t end;
+        } _packed_ test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.xid = htobe32(0x12345678),
+                .message.chaddr = { 'A', 'B', 'C', 'D', 'E', 'F' },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_type.type = DHCP_REQUEST,
+                .option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+                .option_requested_ip.length = 4,
+                .option_requested_ip.address = htobe32(INADDR_LOOPBACK + 1),
+                .option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER,
+                .option_server_id.length = 4,
+                .option_server_id.address = htobe32(INADDR_LOOPBACK),
+                .end = SD_DHCP_OPTION_END,
+        };
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+        DHCPLease *lease;
+
+        /* A pool of a single address, right after our own */
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 8, 2, 1) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+        assert_se(hashmap_size(server->leases_by_client_id) == 1);
+
+        /* Another client finds the pool exhausted ... */
+        test.message.chaddr[5] = 'G';
+        test.option_type.type = DHCP_DISCOVER;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
+
+        /* ... until the lease of the first one runs out */
+        assert_se(lease = hashmap_first(server->leases_by_client_id));
+        lease->expiration = 1;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_OFFER);
+        assert_se(hashmap_isempty(server->leases_by_client_id));
+
+        test.option_type.type = DHCP_REQUEST;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -240,6 +306,7 @@ int main(int argc, char *argv[]) {
                 return r;
 
         test_message_handler();
+        test_lease_reclaim();
         test_client_id_hash();
 
         return 0;
@@ -229,6 +229,60 @@ static void test_receive_oui_packet(sd_event *e) {
         assert_se(stop_lldp(lldp) == 0);
 }
 
+static sd_lldp_event lldp_events[4];
+
+static void lldp_record_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
+        assert_se((size_t) lldp_handler_calls < ELEMENTSOF(lldp_events));
+        lldp_events[lldp_handler_calls++] = event;
+}
+
+static void test_receive_repeated_packet(sd_event *e) {
+        uint8_t frame[] = {
+                /* Ethernet header */
+                0x01, 0x80, 0xc2, 0x00, 0x00, 0x03,     /* Destination MAC */
+                0x01, 0x02, 0x03, 0x04, 0x05, 0x06,     /* Source MAC */
+                0x88, 0xcc,                             /* Ethertype */
+                /* LLDP mandatory TLVs */
+                0x02, 0x07, 0x04, 0x00, 0x01, 0x02,     /* Chassis: MAC, 00:01:02:03:04:05 */
+                0x03, 0x04, 0x05,
+                0x04, 0x04, 0x05, 0x31, 0x2f, 0x33,     /* Port: interface name, "1/3" */
+                0x06, 0x02, 0x00, 0x78,                 /* TTL: 120 seconds */
+                0x00, 0x00                              /* End Of LLDPDU */
+        };
+        sd_lldp_neighbor **neighbors;
+        sd_lldp *lldp;
+        uint16_t ttl;
+
+        lldp_handler_calls = 0;
+        assert_se(start_lldp(&lldp, e, lldp_record_handler, NULL) == 0);
+
+        /* All frames queued up are handled in one go, and repeated ones only refresh the neighbor */
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        sd_event_run(e, 0);
+        assert_se(lldp_handler_calls == 3);
+        assert_se(lldp_events[0] == SD_LLDP_EVENT_ADDED);
+        assert_se(lldp_events[1] == SD_LLDP_EVENT_REFRESHED);
+        assert_se(lldp_events[2] == SD_LLDP_EVENT_REFRESHED);
+
+        /* A changed frame replaces the neighbor */
+        frame[32] = 0x3c;
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        sd_event_run(e, 0);
+        assert_se(lldp_handler_calls == 4);
+        assert_se(lldp_events[3] == SD_LLDP_EVENT_UPDATED);
+
+        assert_se(sd_lldp_get_neighbors(lldp, &neighbors) == 1);
+        assert_se(sd_lldp_neighbor_get_ttl(neighbors[0], &ttl) == 0);
+        assert_se(ttl == 60);
+
+        sd_lldp_neighbor_unref(neighbors[0]);
+        free(neighbors);
+
+        assert_se(stop_lldp(lldp) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *e = NULL;
 
@@ -239,6 +293,7 @@ int main(int argc, char *argv[]) {
         test_receive_basic_packet(e);
         test_receive_incomplete_packet(e);
         test_receive_oui_packet(e);
+        test_receive_repeated_packet(e);
 
         return 0;
 }
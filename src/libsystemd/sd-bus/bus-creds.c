@@ -6,6 +6,7 @@
 #include "alloc-util.h"
 #include "audit-util.h"
 #include "bus-creds.h"
+#include "bus-internal.h"
 #include "bus-label.h"
 #include "bus-message.h"
 #include "bus-util.h"
@@ -14,12 +15,14 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
+#include "hashmap.h"
 #include "hexdecoct.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "util.h"
 
@@ -1093,31 +1096,14 @@ int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
         if (tid > 0 && tid != pid && !pid_is_unwaited(tid))
                 return -ESRCH;
 
-        c->augmented = missing & c->mask;
+        c->augmented |= missing & c->mask;
 
         return 0;
 }
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
-        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
-        int r;
-
+static int bus_creds_copy_fields(sd_bus_creds *n, const sd_bus_creds *c, uint64_t mask) {
+        assert(n);
         assert(c);
-        assert(ret);
-
-        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
-                /* There's already all data we need, or augmentation
-                 * wasn't turned on. */
-
-                *ret = sd_bus_creds_ref(c);
-                return 0;
-        }
-
-        n = bus_creds_new();
-        if (!n)
-                return -ENOMEM;
-
-        /* Copy the original data over */
 
         if (c->mask & mask & SD_BUS_CREDS_PID) {
                 n->pid = c->pid;
@@ -1316,11 +1302,41 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_DESCRIPTION;
         }
 
+        return 0;
+}
+
+int bus_creds_extend_by_pid(sd_bus *bus, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
+        int r;
+
+        assert(c);
+        assert(ret);
+
+        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
+                /* There's already all data we need, or augmentation
+                 * wasn't turned on. */
+
+                *ret = sd_bus_creds_ref(c);
+                return 0;
+        }
+
+        n = bus_creds_new();
+        if (!n)
+                return -ENOMEM;
+
+        /* Copy the original data over */
+        r = bus_creds_copy_fields(n, c, mask);
+        if (r < 0)
+                return r;
+
         n->augmented = c->augmented & n->mask;
 
         /* Get more data */
 
-        r = bus_creds_add_more(n, mask, 0, 0);
+        if (bus)
+                r = bus_creds_add_more_cached(bus, n, mask, 0);
+        else
+                r = bus_creds_add_more(n, mask, 0, 0);
         if (r < 0)
                 return r;
 
@@ -1328,3 +1344,151 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
 
         return 0;
 }
+
+struct creds_cache_entry {
+        pid_t pid;
+        unsigned long long starttime;
+        usec_t timestamp;
+
+        /* The fields that were looked up in /proc when the entry was made, regardless whether they
+         * could actually be read */
+        uint64_t mask;
+
+        sd_bus_creds *creds;
+};
+
+static struct creds_cache_entry* creds_cache_entry_free(struct creds_cache_entry *e) {
+        if (!e)
+                return NULL;
+
+        sd_bus_creds_unref(e->creds);
+        return mfree(e);
+}
+
+void bus_creds_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->creds_cache = hashmap_free_with_destructor(bus->creds_cache, creds_cache_entry_free);
+}
+
+static void creds_cache_put(sd_bus *bus, pid_t pid, unsigned long long starttime, usec_t timestamp, uint64_t mask, sd_bus_creds *c) {
+        struct creds_cache_entry *e;
+        Iterator i;
+
+        assert(bus);
+        assert(c);
+
+        /* The cache is an optimization only, hence failures are silently ignored */
+
+        e = hashmap_remove(bus->creds_cache, PID_TO_PTR(pid));
+        creds_cache_entry_free(e);
+
+        if (hashmap_size(bus->creds_cache) >= CREDS_CACHE_MAX) {
+                usec_t n;
+
+                n = now(CLOCK_MONOTONIC);
+                HASHMAP_FOREACH(e, bus->creds_cache, i)
+                        if (e->timestamp + CREDS_CACHE_USEC < n) {
+                                hashmap_remove(bus->creds_cache, PID_TO_PTR(e->pid));
+                                creds_cache_entry_free(e);
+                        }
+
+                if (hashmap_size(bus->creds_cache) >= CREDS_CACHE_MAX)
+                        return;
+        }
+
+        if (hashmap_ensure_allocated(&bus->creds_cache, NULL) < 0)
+                return;
+
+        e = new(struct creds_cache_entry, 1);
+        if (!e)
+                return;
+
+        *e = (struct creds_cache_entry) {
+                .pid = pid,
+                .starttime = starttime,
+                .timestamp = timestamp,
+                .mask = mask,
+                .creds = sd_bus_creds_ref(c),
+        };
+
+        if (hashmap_put(bus->creds_cache, PID_TO_PTR(pid), e) < 0)
+                creds_cache_entry_free(e);
+}
+
+int bus_creds_add_more_cached(sd_bus *bus, sd_bus_creds *c, uint64_t mask, pid_t pid) {
+        struct creds_cache_entry *e;
+        unsigned long long starttime;
+        uint64_t missing, hit;
+        usec_t timestamp;
+        int r;
+
+        assert(bus);
+        assert(c);
+        assert(c->allocated);
+
+        /* Like bus_creds_add_more(), but remembers the data read from /proc for a short time, so that
+         * repeated lookups for the same peer process don't have to parse the same files again. Entries
+         * are keyed by PID and process start time, so a recycled PID never matches an old entry. Since
+         * augmented data is racy anyway and never used for authorization, serving it slightly stale is
+         * OK. */
+
+        if (!(mask & SD_BUS_CREDS_AUGMENT))
+                return 0;
+
+        if (pid <= 0) {
+                if (!(c->mask & SD_BUS_CREDS_PID))
+                        return 0;
+
+                pid = c->pid;
+        }
+
+        missing = mask & ~(c->mask|SD_BUS_CREDS_PID|SD_BUS_CREDS_TID|SD_BUS_CREDS_UNIQUE_NAME|SD_BUS_CREDS_WELL_KNOWN_NAMES|SD_BUS_CREDS_DESCRIPTION|SD_BUS_CREDS_AUGMENT);
+        if (missing == 0)
+                return bus_creds_add_more(c, mask, pid, 0);
+
+        if (get_process_starttime(pid, &starttime) < 0)
+                return bus_creds_add_more(c, mask, pid, 0);
+
+        timestamp = now(CLOCK_MONOTONIC);
+
+        e = hashmap_get(bus->creds_cache, PID_TO_PTR(pid));
+        if (e && (e->starttime != starttime || e->timestamp + CREDS_CACHE_USEC < timestamp)) {
+                hashmap_remove(bus->creds_cache, PID_TO_PTR(pid));
+                e = creds_cache_entry_free(e);
+        }
+
+        if (!e) {
+                r = bus_creds_add_more(c, mask, pid, 0);
+                if (r < 0)
+                        return r;
+
+                creds_cache_put(bus, pid, starttime, timestamp, missing, c);
+                return 0;
+        }
+
+        /* The thread name depends on the TID, which is not part of the key. Capabilities and the various
+         * cgroup derived fields are stored together, hence don't mix them with fields already there. */
+        hit = missing & e->mask & ~SD_BUS_CREDS_TID_COMM;
+        if (c->capability)
+                hit &= ~(SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS);
+        if (c->cgroup)
+                hit &= ~(SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_USER_SLICE|SD_BUS_CREDS_OWNER_UID);
+
+        r = bus_creds_copy_fields(c, e->creds, hit);
+        if (r < 0)
+                return r;
+
+        c->augmented |= hit & c->mask;
+
+        if ((missing & ~hit) == 0)
+                return 0;
+
+        r = bus_creds_add_more(c, mask & ~hit, pid, 0);
+        if (r < 0)
+                return r;
+
+        /* Replace the entry by one covering everything we know now, but keep the age of the oldest data */
+        creds_cache_put(bus, pid, starttime, e->timestamp, e->mask | missing, c);
+        return 0;
+}
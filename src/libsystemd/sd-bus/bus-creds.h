@@ -69,4 +69,11 @@ void bus_creds_done(sd_bus_creds *c);
 
 int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid);
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
+int bus_creds_extend_by_pid(sd_bus *bus, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
+
+/* Augmented peer credentials are cached per bus for this long, and for at most this many processes */
+#define CREDS_CACHE_USEC (1 * USEC_PER_SEC)
+#define CREDS_CACHE_MAX 64U
+
+int bus_creds_add_more_cached(sd_bus *bus, sd_bus_creds *c, uint64_t mask, pid_t pid);
+void bus_creds_cache_flush(sd_bus *bus);
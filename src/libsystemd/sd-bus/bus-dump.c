@@ -581,5 +581,7 @@ int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
                 snaplen -= w;
         }
 
-        return fflush_and_check(f);
+        /* Don't flush here, capturing many small messages is much cheaper when the caller flushes them in
+         * batches */
+        return ferror(f) ? -EIO : 0;
 }
@@ -12,6 +12,7 @@
 #include "def.h"
 #include "hashmap.h"
 #include "list.h"
+#include "mempool.h"
 #include "prioq.h"
 #include "refcnt.h"
 #include "socket-util.h"
@@ -92,6 +93,9 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* The introspection XML of this interface, generated on first use */
+        char *introspection;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
@@ -188,6 +192,7 @@ struct sd_bus {
         int message_endian;
 
         bool can_fds:1;
+        bool can_memfd:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -209,6 +214,7 @@ struct sd_bus {
         bool watch_bind:1;
         bool is_monitor:1;
         bool accept_fd:1;
+        bool accept_memfd:1;
         bool attach_timestamp:1;
         bool connected_signal:1;
 
@@ -267,6 +273,9 @@ struct sd_bus {
 
         uint64_t creds_mask;
 
+        /* Augmented credentials of peer processes, keyed by PID, see bus_creds_add_more_cached() */
+        Hashmap *creds_cache;
+
         int *fds;
         size_t n_fds;
 
@@ -285,6 +294,15 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* Messages, their additional body parts and their container stacks are allocated from these
+         * pools, and recycled when released. For the same reason as the memfd cache they are protected by
+         * a mutex. Messages keep a reference to the bus, hence the pools are around for as long as
+         * anything allocated from them is. */
+        pthread_mutex_t message_pool_mutex;
+        struct mempool message_pool;
+        struct mempool part_pool;
+        struct mempool container_pool;
+
         pid_t original_pid;
         pid_t busexec_pid;
 
@@ -311,6 +329,10 @@ struct sd_bus {
 
         sd_bus_track *track_queue;
 
+        /* The NameOwnerChanged subscriptions of all track objects, indexed by name, so that each name is only
+         * subscribed to once, however many track objects track it */
+        Hashmap *track_names;
+
         LIST_HEAD(sd_bus_slot, slots);
         LIST_HEAD(sd_bus_track, tracks);
 
@@ -161,6 +161,39 @@ int introspect_write_interface(struct introspect *i, const sd_bus_vtable *v) {
         return 0;
 }
 
+int introspect_format_interface(const sd_bus_vtable *v, bool trusted, char **ret) {
+        struct introspect i = {
+                .trusted = trusted,
+        };
+        int r;
+
+        assert(v);
+        assert(ret);
+
+        /* Formats the members of a single interface into a string, so that it may be reused for later
+         * requests. The result only depends on the vtable and on whether the bus is trusted. */
+
+        i.f = open_memstream(&i.introspection, &i.size);
+        if (!i.f)
+                return -ENOMEM;
+
+        (void) __fsetlocking(i.f, FSETLOCKING_BYCALLER);
+
+        r = introspect_write_interface(&i, v);
+        if (r >= 0)
+                r = fflush_and_check(i.f);
+
+        /* Closing the stream finalizes the buffer */
+        i.f = safe_fclose(i.f);
+        if (r < 0) {
+                free(i.introspection);
+                return r;
+        }
+
+        *ret = i.introspection;
+        return 0;
+}
+
 int introspect_finish(struct introspect *i, sd_bus *bus, sd_bus_message *m, sd_bus_message **reply) {
         sd_bus_message *q;
         int r;
@@ -54,11 +54,38 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_SENDER && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST) ||
                 (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
 }
 
+static inline bool BUS_MATCH_IS_SIMPLE_PATTERN(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
+}
+
+static bool value_node_hashed(enum bus_match_node_type parent_type, const char *value_str) {
+
+        /* Checks whether a value node is stored in the hash table of its parent compare node, or in its child
+         * list. Well-known sender names also match messages from any unique name (see value_node_test()), hence
+         * they can't be looked up directly and are kept in the list. */
+
+        if (!BUS_MATCH_CAN_HASH(parent_type))
+                return false;
+
+        if (parent_type == BUS_MATCH_MESSAGE_TYPE)
+                return true;
+
+        if (!value_str)
+                return false;
+
+        if (parent_type == BUS_MATCH_SENDER)
+                return value_str[0] == ':';
+
+        return true;
+}
+
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
         assert(node->parent);
@@ -66,9 +93,9 @@ static void bus_match_node_free(struct bus_match_node *node) {
         assert(node->type != BUS_MATCH_ROOT);
         assert(node->type < _BUS_MATCH_NODE_TYPE_MAX);
 
-        if (node->parent->child) {
-                /* We are apparently linked into the parent's child
-                 * list. Let's remove us from there. */
+        if (node->type != BUS_MATCH_VALUE || !value_node_hashed(node->parent->type, node->value.str)) {
+                /* We are linked into the parent's child list. Let's
+                 * remove us from there. */
                 if (node->prev) {
                         assert(node->prev->next == node);
                         node->prev->next = node->next;
@@ -87,7 +114,7 @@ static void bus_match_node_free(struct bus_match_node *node) {
 
                 if (node->parent->type == BUS_MATCH_MESSAGE_TYPE)
                         hashmap_remove(node->parent->compare.children, UINT_TO_PTR(node->value.u8));
-                else if (BUS_MATCH_CAN_HASH(node->parent->type) && node->value.str)
+                else if (value_node_hashed(node->parent->type, node->value.str))
                         hashmap_remove(node->parent->compare.children, node->value.str);
 
                 free(node->value.str);
@@ -240,6 +267,78 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_prefix(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                char *buf,
+                size_t len,
+                sd_bus_message *m) {
+
+        struct bus_match_node *found;
+        char saved;
+
+        saved = buf[len];
+        buf[len] = 0;
+        found = hashmap_get(node->compare.children, buf);
+        buf[len] = saved;
+
+        if (!found)
+                return 0;
+
+        return bus_match_run(bus, found, m);
+}
+
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                char separator,
+                const char *value,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *buf = NULL;
+        size_t i, n;
+        int r;
+
+        assert(node);
+        assert(m);
+
+        /* A simple pattern matches a value if it is equal to it, if it is a prefix of it that is followed by the
+         * separator, or if it is a prefix of it that ends in the separator, see simple_pattern_check(). Instead of
+         * testing every pattern, let's look up all prefixes of the value that qualify. That's at most two per
+         * label, regardless of the number of patterns. */
+
+        if (!value)
+                return 0;
+
+        buf = strdup(value);
+        if (!buf)
+                return -ENOMEM;
+
+        n = strlen(buf);
+        for (i = 0; i < n; i++) {
+                if (buf[i] != separator)
+                        continue;
+
+                r = bus_match_run_prefix(bus, node, buf, i, m);
+                if (r != 0)
+                        return r;
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+
+                /* If the separator is the last character, this is the full value, which is looked up below */
+                if (i + 1 >= n)
+                        break;
+
+                r = bus_match_run_prefix(bus, node, buf, i + 1, m);
+                if (r != 0)
+                        return r;
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return bus_match_run_prefix(bus, node, buf, n, m);
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -372,7 +471,16 @@ int bus_match_run(
                 assert_not_reached("Unknown match type.");
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (BUS_MATCH_IS_SIMPLE_PATTERN(node->type)) {
+
+                /* Namespace matches are hashed too, we look up the
+                 * prefixes of the value they might match */
+
+                r = bus_match_run_prefixes(bus, node, node->type == BUS_MATCH_PATH_NAMESPACE ? '/' : '.', test_str, m);
+                if (r != 0)
+                        return r;
+
+        } else if (BUS_MATCH_CAN_HASH(node->type)) {
                 struct bus_match_node *found;
 
                 /* Lookup via hash table, nice! So let's jump directly. */
@@ -402,10 +510,17 @@ int bus_match_run(
                         if (r != 0)
                                 return r;
                 }
-        } else {
+        }
+
+        if (node->child) {
                 struct bus_match_node *c;
 
-                /* No hash table, so let's iterate manually... */
+                /* No hash table, or values that cannot be looked up
+                 * in it (well-known sender names), so let's iterate
+                 * manually... */
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
 
                 for (c = node->child; c; c = c->next) {
                         if (!value_node_test(c, node->type, test_u8, test_str, test_strv, m))
@@ -451,7 +566,7 @@ static int bus_match_add_compare_value(
 
                 if (t == BUS_MATCH_MESSAGE_TYPE)
                         n = hashmap_get(c->compare.children, UINT_TO_PTR(value_u8));
-                else if (BUS_MATCH_CAN_HASH(t))
+                else if (value_node_hashed(t, value_str))
                         n = hashmap_get(c->compare.children, value_str);
                 else {
                         for (n = c->child; n && !value_node_same(n, t, value_u8, value_str); n = n->next)
@@ -511,7 +626,7 @@ static int bus_match_add_compare_value(
         }
 
         n->parent = c;
-        if (c->compare.children) {
+        if (value_node_hashed(t, value_str)) {
 
                 if (t == BUS_MATCH_MESSAGE_TYPE)
                         r = hashmap_put(c->compare.children, UINT_TO_PTR(value_u8), n);
@@ -564,7 +679,7 @@ static int bus_match_find_compare_value(
 
         if (t == BUS_MATCH_MESSAGE_TYPE)
                 n = hashmap_get(c->compare.children, UINT_TO_PTR(value_u8));
-        else if (BUS_MATCH_CAN_HASH(t))
+        else if (value_node_hashed(t, value_str))
                 n = hashmap_get(c->compare.children, value_str);
         else {
                 for (n = c->child; n && !value_node_same(n, t, value_u8, value_str); n = n->next)
@@ -43,7 +43,7 @@ struct bus_match_node {
                         struct match_callback *callback;
                 } leaf;
                 struct {
-                        /* If this is set, then the child is NULL */
+                        /* Value nodes that are stored in here are not in the child list */
                         Hashmap *children;
                 } compare;
         };
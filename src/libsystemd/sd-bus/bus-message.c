@@ -22,8 +22,126 @@
 #include "utf8.h"
 #include "util.h"
 
+/* Messages we construct ourselves carry their header in the same allocation, see sd_bus_message_new(). Incoming
+ * messages are smaller, unless they come with a label, in which case they are not allocated from the pool. */
+#define MESSAGE_TILE_SIZE (ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header))
+
+/* Container stacks up to this depth are allocated from the pool, deeper ones are realloc()ed */
+#define CONTAINERS_POOLED 8U
+
 static int message_append_basic(sd_bus_message *m, char type, const void *p, const void **stored);
 
+void bus_message_pools_init(sd_bus *bus) {
+        assert(bus);
+
+        assert_se(pthread_mutex_init(&bus->message_pool_mutex, NULL) == 0);
+
+        bus->message_pool = (struct mempool) {
+                .tile_size = MESSAGE_TILE_SIZE,
+                .at_least = 16,
+        };
+        bus->part_pool = (struct mempool) {
+                .tile_size = sizeof(struct bus_body_part),
+                .at_least = 64,
+        };
+        bus->container_pool = (struct mempool) {
+                .tile_size = CONTAINERS_POOLED * sizeof(struct bus_container),
+                .at_least = 16,
+        };
+}
+
+void bus_message_pools_done(sd_bus *bus) {
+        assert(bus);
+
+        mempool_drop(&bus->message_pool);
+        mempool_drop(&bus->part_pool);
+        mempool_drop(&bus->container_pool);
+
+        assert_se(pthread_mutex_destroy(&bus->message_pool_mutex) == 0);
+}
+
+static void *message_pool_alloc0(sd_bus *bus, struct mempool *mp) {
+        void *p;
+
+        assert(bus);
+        assert(mp);
+
+        assert_se(pthread_mutex_lock(&bus->message_pool_mutex) == 0);
+        p = mempool_alloc_tile(mp);
+        assert_se(pthread_mutex_unlock(&bus->message_pool_mutex) == 0);
+
+        if (p)
+                memzero(p, mp->tile_size);
+
+        return p;
+}
+
+static void message_pool_free(sd_bus *bus, struct mempool *mp, void *p) {
+        assert(bus);
+        assert(mp);
+
+        if (!p)
+                return;
+
+        assert_se(pthread_mutex_lock(&bus->message_pool_mutex) == 0);
+        mempool_free_tile(mp, p);
+        assert_se(pthread_mutex_unlock(&bus->message_pool_mutex) == 0);
+}
+
+static sd_bus_message *message_alloc0(sd_bus *bus, size_t size) {
+        sd_bus_message *m;
+
+        assert(bus);
+
+        if (size > MESSAGE_TILE_SIZE)
+                return malloc0(size);
+
+        m = message_pool_alloc0(bus, &bus->message_pool);
+        if (m)
+                m->from_pool = true;
+
+        return m;
+}
+
+static int message_grow_containers(sd_bus_message *m) {
+        struct bus_container *n;
+
+        assert(m);
+        assert(m->bus);
+
+        /* Makes sure there's space for one more container on the stack */
+
+        if (m->n_containers < m->containers_allocated)
+                return 0;
+
+        if (m->containers_allocated == 0) {
+                n = message_pool_alloc0(m->bus, &m->bus->container_pool);
+                if (!n)
+                        return -ENOMEM;
+
+                m->containers = n;
+                m->containers_allocated = CONTAINERS_POOLED;
+                m->containers_from_pool = true;
+                return 0;
+        }
+
+        if (!m->containers_from_pool)
+                return GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1) ? 0 : -ENOMEM;
+
+        /* Leaving the pool: copy over into a regular allocation, which can grow from here on */
+        n = new(struct bus_container, m->containers_allocated * 2);
+        if (!n)
+                return -ENOMEM;
+
+        memcpy(n, m->containers, m->n_containers * sizeof(struct bus_container));
+        message_pool_free(m->bus, &m->bus->container_pool, m->containers);
+
+        m->containers = n;
+        m->containers_allocated *= 2;
+        m->containers_from_pool = false;
+        return 0;
+}
+
 static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_base) {
 
         if (p == NULL)
@@ -52,8 +170,9 @@ static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         else if (part->free_this)
                 free(part->data);
 
+        /* All parts but the first one are allocated from the pool, see message_append_part() */
         if (part != &m->body)
-                free(part);
+                message_pool_free(m->bus, &m->bus->part_pool, part);
 }
 
 static void message_reset_parts(sd_bus_message *m) {
@@ -75,32 +194,41 @@ static void message_reset_parts(sd_bus_message *m) {
         m->cached_rindex_part_begin = 0;
 }
 
+static void container_done(struct bus_container *c) {
+        assert(c);
+
+        free(c->signature);
+        free(c->peeked_signature);
+        free(c->offsets);
+        free(c->validated_contents);
+}
+
 static void message_reset_containers(sd_bus_message *m) {
         unsigned i;
 
         assert(m);
 
-        for (i = 0; i < m->n_containers; i++) {
-                free(m->containers[i].signature);
-                free(m->containers[i].offsets);
-        }
-
-        m->containers = mfree(m->containers);
+        for (i = 0; i < m->n_containers; i++)
+                container_done(m->containers + i);
 
-        m->n_containers = m->containers_allocated = 0;
+        /* Keep the container stack around, it's likely to be needed again when the message is read once more,
+         * and it is released together with the message anyway. */
+        m->n_containers = 0;
         m->root_container.index = 0;
 }
 
 static sd_bus_message* message_free(sd_bus_message *m) {
+        sd_bus *bus;
+
         assert(m);
 
+        bus = m->bus;
+
         if (m->free_header)
                 free(m->header);
 
         message_reset_parts(m);
 
-        sd_bus_unref(m->bus);
-
         if (m->free_fds) {
                 close_many(m->fds, m->n_fds);
                 free(m->fds);
@@ -110,13 +238,23 @@ static sd_bus_message* message_free(sd_bus_message *m) {
                 free(m->iovec);
 
         message_reset_containers(m);
-        free(m->root_container.signature);
-        free(m->root_container.offsets);
+        if (m->containers_from_pool)
+                message_pool_free(bus, &bus->container_pool, m->containers);
+        else
+                free(m->containers);
 
-        free(m->root_container.peeked_signature);
+        container_done(&m->root_container);
 
         bus_creds_done(&m->creds);
-        return mfree(m);
+
+        /* Release the message before the bus, the former might have been allocated from the pool of the latter */
+        if (m->from_pool)
+                message_pool_free(bus, &bus->message_pool, m);
+        else
+                free(m);
+
+        sd_bus_unref(bus);
+        return NULL;
 }
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, message_free);
@@ -401,7 +539,7 @@ int bus_message_from_header(
                 size_t extra,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_(message_freep) sd_bus_message *m = NULL;
         struct bus_header *h;
         size_t a, label_sz;
 
@@ -438,11 +576,12 @@ int bus_message_from_header(
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_alloc0(bus, a);
         if (!m)
                 return -ENOMEM;
 
         m->n_ref = 1;
+        m->bus = sd_bus_ref(bus);
         m->sealed = true;
         m->header = header;
         m->header_accessible = header_accessible;
@@ -496,7 +635,6 @@ int bus_message_from_header(
                 m->creds.mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
         }
 
-        m->bus = sd_bus_ref(bus);
         *ret = TAKE_PTR(m);
 
         return 0;
@@ -564,7 +702,7 @@ _public_ int sd_bus_message_new(
         assert_return(m, -EINVAL);
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        t = message_alloc0(bus, MESSAGE_TILE_SIZE);
         if (!t)
                 return -ENOMEM;
 
@@ -1112,7 +1250,7 @@ struct bus_body_part *message_append_part(sd_bus_message *m) {
         } else {
                 assert(m->body_end);
 
-                part = new0(struct bus_body_part, 1);
+                part = message_pool_alloc0(m->bus, &m->bus->part_pool);
                 if (!part) {
                         m->poisoned = true;
                         return NULL;
@@ -1937,7 +2075,7 @@ _public_ int sd_bus_message_open_container(
         assert_return(!m->poisoned, -ESTALE);
 
         /* Make sure we have space for one more container */
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1)) {
+        if (message_grow_containers(m) < 0) {
                 m->poisoned = true;
                 return -ENOMEM;
         }
@@ -1979,6 +2117,9 @@ _public_ int sd_bus_message_open_container(
         w->n_offsets = w->offsets_allocated = 0;
         w->offsets = NULL;
         w->need_offsets = need_offsets;
+        w->peeked_signature = NULL;
+        w->validated_type = 0;
+        w->validated_contents = NULL;
 
         return 0;
 }
@@ -2803,12 +2944,59 @@ static int bus_message_close_header(sd_bus_message *m) {
                 m->footer_accessible = 1 + l + 2 + sz;
         } else {
                 m->header->dbus1.fields_size = m->fields_size;
-                m->header->dbus1.body_size = m->body_size;
+                m->header->dbus1.body_size = m->memfd_body ? 0 : m->body_size;
         }
 
         return 0;
 }
 
+static int message_body_to_memfd(sd_bus_message *m) {
+        _cleanup_close_ int fd = -1;
+        struct bus_body_part *part;
+        unsigned i;
+        int *f, r;
+
+        assert(m);
+        assert(!BUS_MESSAGE_IS_GVARIANT(m));
+
+        /* Copies the body into a sealed memfd, which is sent along with the header instead of writing the body to
+         * the socket. That's a single copy, instead of one into and one out of the socket buffer, and the receiver
+         * just maps it. We keep our own copy of the body as it is, to be able to read the message locally. */
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                r = bus_body_part_map(part);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(fd, part->data, part->size, false);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        f = reallocarray(m->fds, sizeof(int), m->n_fds + 1);
+        if (!f)
+                return -ENOMEM;
+        m->fds = f;
+
+        r = message_append_field_uint32(m, BUS_MESSAGE_HEADER_MEMFD_BODY, m->n_fds);
+        if (r < 0)
+                return r;
+
+        m->fds[m->n_fds++] = TAKE_FD(fd);
+        m->free_fds = true;
+        m->memfd_body = true;
+
+        return 0;
+}
+
 _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t timeout_usec) {
         struct bus_body_part *part;
         size_t a;
@@ -2850,6 +3038,16 @@ _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t ti
                         return r;
         }
 
+        /* Pass large bodies as memfd, if the peer agreed to that */
+        if (m->bus->can_memfd &&
+            !BUS_MESSAGE_IS_GVARIANT(m) &&
+            m->body_size >= MEMFD_MIN_SIZE &&
+            m->n_fds < BUS_FDS_MAX) {
+                r = message_body_to_memfd(m);
+                if (r < 0)
+                        return r;
+        }
+
         if (m->n_fds > 0) {
                 r = message_append_field_uint32(m, BUS_MESSAGE_HEADER_UNIX_FDS, m->n_fds);
                 if (r < 0)
@@ -3189,19 +3387,35 @@ static int message_peek_body(
         if (end > m->user_body_size)
                 return -EBADMSG;
 
-        part = find_part(m, *rindex, padding, (void**) &q);
-        if (!part)
-                return -EBADMSG;
+        /* Usually the padding and the data are in the same part, hence look them up in one go first */
+        part = find_part(m, *rindex, padding + nbytes, (void**) &q);
+        if (part) {
+                if (q) {
+                        /* Verify padding */
+                        for (k = 0; k < padding; k++)
+                                if (q[k] != 0)
+                                        return -EBADMSG;
 
-        if (q) {
-                /* Verify padding */
-                for (k = 0; k < padding; k++)
-                        if (q[k] != 0)
-                                return -EBADMSG;
+                        q += padding;
+                }
+        } else {
+                part = find_part(m, *rindex, padding, (void**) &q);
+                if (!part)
+                        return -EBADMSG;
+
+                if (q) {
+                        /* Verify padding */
+                        for (k = 0; k < padding; k++)
+                                if (q[k] != 0)
+                                        return -EBADMSG;
+                }
+
+                part = find_part(m, start, nbytes, (void**) &q);
+                if (!part)
+                        return -EBADMSG;
         }
 
-        part = find_part(m, start, nbytes, (void**) &q);
-        if (!part || (nbytes > 0 && !q))
+        if (nbytes > 0 && !q)
                 return -EBADMSG;
 
         *rindex = end;
@@ -3504,9 +3718,6 @@ static int bus_message_enter_array(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_single(contents, true))
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
@@ -3621,9 +3832,6 @@ static int bus_message_enter_variant(
         assert(contents);
         assert(item_size);
 
-        if (!signature_is_single(contents, false))
-                return -EINVAL;
-
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
                 return -EINVAL;
 
@@ -3874,9 +4082,6 @@ static int bus_message_enter_struct(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_valid(contents, false))
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
@@ -3912,9 +4117,6 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
-                return -EINVAL;
-
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
                 return -ENXIO;
 
@@ -3938,6 +4140,48 @@ static int bus_message_enter_dict_entry(
         return 1;
 }
 
+static int container_validate_contents(struct bus_container *c, char type, const char *contents) {
+        bool valid;
+
+        assert(c);
+        assert(contents);
+
+        if (c->validated_type == type && streq_ptr(c->validated_contents, contents))
+                return 0;
+
+        switch (type) {
+
+        case SD_BUS_TYPE_ARRAY:
+                valid = signature_is_single(contents, true);
+                break;
+
+        case SD_BUS_TYPE_VARIANT:
+                valid = signature_is_single(contents, false);
+                break;
+
+        case SD_BUS_TYPE_STRUCT:
+                valid = signature_is_valid(contents, false);
+                break;
+
+        case SD_BUS_TYPE_DICT_ENTRY:
+                valid = signature_is_pair(contents);
+                break;
+
+        default:
+                valid = false;
+        }
+
+        if (!valid)
+                return -EINVAL;
+
+        /* If we can't remember this, we'll simply validate again next time */
+        c->validated_type = 0;
+        if (free_and_strdup(&c->validated_contents, contents) >= 0)
+                c->validated_type = type;
+
+        return 0;
+}
+
 _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                                             char type,
                                             const char *contents) {
@@ -3991,8 +4235,9 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         if (m->n_containers >= BUS_CONTAINER_DEPTH)
                 return -EBADMSG;
 
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1))
-                return -ENOMEM;
+        r = message_grow_containers(m);
+        if (r < 0)
+                return r;
 
         if (message_end_of_signature(m))
                 return -ENXIO;
@@ -4002,6 +4247,10 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         c = message_get_container(m);
 
+        r = container_validate_contents(c, type, contents);
+        if (r < 0)
+                return r;
+
         signature = strdup(contents);
         if (!signature)
                 return -ENOMEM;
@@ -4027,6 +4276,8 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         w->enclosing = type;
         w->signature = TAKE_PTR(signature);
         w->peeked_signature = NULL;
+        w->validated_type = 0;
+        w->validated_contents = NULL;
         w->index = 0;
 
         w->before = before;
@@ -4077,9 +4328,7 @@ _public_ int sd_bus_message_exit_container(sd_bus_message *m) {
                         return -EBUSY;
         }
 
-        free(c->signature);
-        free(c->peeked_signature);
-        free(c->offsets);
+        container_done(c);
         m->n_containers--;
 
         c = message_get_container(m);
@@ -4108,8 +4357,7 @@ static void message_quit_container(sd_bus_message *m) {
         m->rindex = c->before;
 
         /* Free container */
-        free(c->signature);
-        free(c->offsets);
+        container_done(c);
         m->n_containers--;
 
         /* Correct index of new top-level container */
@@ -5029,11 +5277,58 @@ static int message_skip_fields(
         }
 }
 
+static int message_parse_memfd_body(sd_bus_message *m, uint32_t idx) {
+        _cleanup_close_ int fd = -1;
+        uint64_t sz;
+        int r;
+
+        assert(m);
+
+        /* The body was passed as memfd, see message_body_to_memfd(). Make it the only body part. */
+
+        if (!m->bus->can_memfd || BUS_MESSAGE_IS_GVARIANT(m))
+                return -EBADMSG;
+
+        if (m->body_size != 0 || idx >= m->n_fds)
+                return -EBADMSG;
+
+        /* We map the memfd, and parse it in place, hence refuse anything the sender could still modify */
+        r = memfd_get_sealed(m->fds[idx]);
+        if (r < 0)
+                return r == -EBADF || r == -EINVAL ? -EBADMSG : r;
+        if (r == 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(m->fds[idx], &sz);
+        if (r < 0)
+                return r;
+        if (sz == 0 || sz > BUS_MESSAGE_SIZE_MAX)
+                return -EBADMSG;
+
+        /* The fd stays in the fd array, so that the message can be passed on as it is, and the body part gets a
+         * copy of its own */
+        fd = fcntl(m->fds[idx], F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        m->body = (struct bus_body_part) {
+                .memfd = TAKE_FD(fd),
+                .size = sz,
+                .sealed = true,
+        };
+        m->n_body_parts = 1;
+        m->body_end = &m->body;
+        m->body_size = m->user_body_size = sz;
+        m->memfd_body = true;
+
+        return 0;
+}
+
 int bus_message_parse_fields(sd_bus_message *m) {
         size_t ri;
         int r;
-        uint32_t unix_fds = 0;
-        bool unix_fds_set = false;
+        uint32_t unix_fds = 0, memfd_body = 0;
+        bool unix_fds_set = false, memfd_body_set = false;
         void *offsets = NULL;
         unsigned n_offsets = 0;
         size_t sz = 0;
@@ -5330,6 +5625,23 @@ int bus_message_parse_fields(sd_bus_message *m) {
                         unix_fds_set = true;
                         break;
 
+                case BUS_MESSAGE_HEADER_MEMFD_BODY:
+                        if (BUS_MESSAGE_IS_GVARIANT(m))
+                                break;
+
+                        if (memfd_body_set)
+                                return -EBADMSG;
+
+                        if (!streq(signature, "u"))
+                                return -EBADMSG;
+
+                        r = message_peek_field_uint32(m, &ri, item_size, &memfd_body);
+                        if (r < 0)
+                                return -EBADMSG;
+
+                        memfd_body_set = true;
+                        break;
+
                 default:
                         if (!BUS_MESSAGE_IS_GVARIANT(m))
                                 r = message_skip_fields(m, &ri, (uint32_t) -1, (const char **) &signature);
@@ -5344,6 +5656,12 @@ int bus_message_parse_fields(sd_bus_message *m) {
         if (m->n_fds != unix_fds)
                 return -EBADMSG;
 
+        if (memfd_body_set) {
+                r = message_parse_memfd_body(m, memfd_body);
+                if (r < 0)
+                        return r;
+        }
+
         switch (m->header->type) {
 
         case SD_BUS_MESSAGE_SIGNAL:
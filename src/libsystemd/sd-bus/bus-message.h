@@ -30,6 +30,11 @@ struct bus_container {
         size_t item_size;
 
         char *peeked_signature;
+
+        /* The contents of the container type we most recently entered from here, which hence don't need
+         * to be validated again, for example when entering each element of an array of structs */
+        char validated_type;
+        char *validated_contents;
 };
 
 struct bus_body_part {
@@ -76,6 +81,9 @@ struct sd_bus_message {
         bool free_header:1;
         bool free_fds:1;
         bool poisoned:1;
+        bool from_pool:1;
+        bool containers_from_pool:1;
+        bool memfd_body:1;
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -157,6 +165,11 @@ static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
                 ALIGN8(m->fields_size);
 }
 
+/* The number of bytes written to the socket: if the body is passed as memfd, only the header */
+static inline size_t BUS_MESSAGE_WIRE_SIZE(sd_bus_message *m) {
+        return m->memfd_body ? BUS_MESSAGE_BODY_BEGIN(m) : BUS_MESSAGE_SIZE(m);
+}
+
 static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
         return (uint8_t*) m->header + sizeof(struct bus_header);
 }
@@ -197,6 +210,9 @@ int bus_message_parse_fields(sd_bus_message *m);
 
 struct bus_body_part *message_append_part(sd_bus_message *m);
 
+void bus_message_pools_init(sd_bus *bus);
+void bus_message_pools_done(sd_bus *bus);
+
 #define MESSAGE_FOREACH_PART(part, i, m) \
         for ((i) = 0, (part) = &(m)->body; (i) < (m)->n_body_parts; (i)++, (part) = (part)->next)
 
@@ -947,9 +947,13 @@ static int process_introspect(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
-                if (r < 0)
-                        goto finish;
+                if (!c->introspection) {
+                        r = introspect_format_interface(c->vtable, bus->trusted, &c->introspection);
+                        if (r < 0)
+                                goto finish;
+                }
+
+                fputs(c->introspection, intro.f);
 
                 previous_interface = c->interface;
         }
@@ -1160,6 +1164,127 @@ static int object_manager_serialize_path_and_fallbacks(
         return 0;
 }
 
+static int object_append_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *prefix,
+                const char *path,
+                bool require_fallback,
+                Set *properties,
+                bool *found_object,
+                sd_bus_error *error) {
+
+        struct node_vtable *c;
+        struct node *n;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(prefix);
+        assert(path);
+        assert(found_object);
+
+        n = hashmap_get(bus->nodes, prefix);
+        if (!n)
+                return 0;
+
+        LIST_FOREACH(vtables, c, n->vtables) {
+                const sd_bus_vtable *v;
+                void *u;
+
+                if (require_fallback && !c->is_fallback)
+                        continue;
+
+                r = node_vtable_get_userdata(bus, path, c, &u, error);
+                if (r < 0)
+                        return r;
+                if (bus->nodes_modified)
+                        return -EAGAIN;
+                if (r == 0)
+                        continue;
+
+                *found_object = true;
+
+                if (set_isempty(properties)) {
+                        r = vtable_append_all_properties(bus, reply, path, c, u, error);
+                        if (r < 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                return -EAGAIN;
+
+                        continue;
+                }
+
+                if (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
+                        continue;
+
+                for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                        if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                                continue;
+
+                        if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                                continue;
+
+                        if (!set_contains(properties, v->x.property.member))
+                                continue;
+
+                        r = vtable_append_one_property(bus, reply, path, c, v, u, error);
+                        if (r < 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                return -EAGAIN;
+                }
+        }
+
+        return 0;
+}
+
+int bus_message_append_object_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                Set *properties,
+                sd_bus_error *error) {
+
+        bool found_object = false;
+        char *prefix;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+
+        /* Appends the properties of the object at the specified path as "a{sv}", the same way as GetAll() with an
+         * empty interface name would return them. This allows services to return the properties of many objects in
+         * a single reply. If 'properties' is non-empty only the listed properties are included, and in that case
+         * also those which GetAll() only returns on explicit request. As with GetAll(), vtables registered for the
+         * path itself take precedence over fallback vtables of any of its prefixes. */
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        r = object_append_properties(bus, reply, path, path, false, properties, &found_object, error);
+        if (r < 0)
+                return r;
+
+        if (!found_object) {
+                prefix = alloca(strlen(path) + 1);
+                OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
+                        r = object_append_properties(bus, reply, prefix, path, true, properties, &found_object, error);
+                        if (r < 0)
+                                return r;
+                        if (found_object)
+                                break;
+                }
+        }
+
+        if (!found_object)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_UNKNOWN_OBJECT, "Unknown object '%s'.", path);
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int process_get_managed_objects(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -1882,7 +2007,8 @@ static int emit_properties_changed_on_interface(
                 const char *interface,
                 bool require_fallback,
                 bool *found_interface,
-                char **names) {
+                char **names,
+                sd_bus_message **ret) {
 
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
@@ -1899,6 +2025,7 @@ static int emit_properties_changed_on_interface(
         assert(path);
         assert(interface);
         assert(found_interface);
+        assert(ret);
 
         n = hashmap_get(bus->nodes, prefix);
         if (!n)
@@ -2075,45 +2202,37 @@ static int emit_properties_changed_on_interface(
         if (r < 0)
                 return r;
 
-        r = sd_bus_send(bus, m, NULL);
-        if (r < 0)
-                return r;
-
+        *ret = TAKE_PTR(m);
         return 1;
 }
 
-_public_ int sd_bus_emit_properties_changed_strv(
+int bus_message_new_properties_changed(
                 sd_bus *bus,
                 const char *path,
                 const char *interface,
-                char **names) {
+                char **names,
+                sd_bus_message **ret) {
 
         bool found_interface = false;
         char *prefix;
         int r;
 
-        assert_return(bus, -EINVAL);
-        assert_return(bus = bus_resolve(bus), -ENOPKG);
-        assert_return(object_path_is_valid(path), -EINVAL);
-        assert_return(interface_name_is_valid(interface), -EINVAL);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert(bus);
+        assert(path);
+        assert(interface);
+        assert(ret);
 
-        if (!BUS_IS_OPEN(bus->state))
-                return -ENOTCONN;
+        /* Builds the PropertiesChanged message sd_bus_emit_properties_changed_strv() would send, without sending
+         * it. Returns 0 and sets *ret to NULL if there is nothing to send. */
 
-        /* A non-NULL but empty names list means nothing needs to be
-           generated. A NULL list OTOH indicates that all properties
-           that are set to EMITS_CHANGE or EMITS_INVALIDATION shall be
-           included in the PropertiesChanged message. */
-        if (names && names[0] == NULL)
-                return 0;
+        *ret = NULL;
 
         BUS_DONT_DESTROY(bus);
 
         do {
                 bus->nodes_modified = false;
 
-                r = emit_properties_changed_on_interface(bus, path, path, interface, false, &found_interface, names);
+                r = emit_properties_changed_on_interface(bus, path, path, interface, false, &found_interface, names, ret);
                 if (r != 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2121,7 +2240,7 @@ _public_ int sd_bus_emit_properties_changed_strv(
 
                 prefix = alloca(strlen(path) + 1);
                 OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                        r = emit_properties_changed_on_interface(bus, prefix, path, interface, true, &found_interface, names);
+                        r = emit_properties_changed_on_interface(bus, prefix, path, interface, true, &found_interface, names, ret);
                         if (r != 0)
                                 return r;
                         if (bus->nodes_modified)
@@ -2133,6 +2252,42 @@ _public_ int sd_bus_emit_properties_changed_strv(
         return found_interface ? 0 : -ENOENT;
 }
 
+_public_ int sd_bus_emit_properties_changed_strv(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(interface_name_is_valid(interface), -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        /* A non-NULL but empty names list means nothing needs to be
+           generated. A NULL list OTOH indicates that all properties
+           that are set to EMITS_CHANGE or EMITS_INVALIDATION shall be
+           included in the PropertiesChanged message. */
+        if (names && names[0] == NULL)
+                return 0;
+
+        r = bus_message_new_properties_changed(bus, path, interface, names, &m);
+        if (r <= 0)
+                return r;
+
+        r = sd_bus_send(bus, m, NULL);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 _public_ int sd_bus_emit_properties_changed(
                 sd_bus *bus,
                 const char *path,
@@ -2734,6 +2889,7 @@ _public_ int sd_bus_emit_interfaces_added(sd_bus *bus, const char *path, const c
 _public_ int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path, char **interfaces) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         struct node *object_manager;
+        char **i;
         int r;
 
         assert_return(bus, -EINVAL);
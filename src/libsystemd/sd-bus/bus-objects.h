@@ -5,3 +5,7 @@
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
+
+int bus_message_append_object_properties(sd_bus *bus, sd_bus_message *reply, const char *path, Set *properties, sd_bus_error *error);
+
+int bus_message_new_properties_changed(sd_bus *bus, const char *path, const char *interface, char **names, sd_bus_message **ret);
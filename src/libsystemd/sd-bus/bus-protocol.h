@@ -75,6 +75,13 @@ enum {
         _BUS_MESSAGE_HEADER_MAX
 };
 
+/* Private header field, not part of the specification, and only used on connections where the peer agreed to it
+ * during authentication: the body is not sent inline after the header, but as sealed memfd, found at the index
+ * of the message's fds this field carries. */
+enum {
+        BUS_MESSAGE_HEADER_MEMFD_BODY = 0x80,
+};
+
 /* RequestName parameters */
 
 enum  {
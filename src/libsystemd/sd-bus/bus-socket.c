@@ -25,12 +25,20 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 #include "util.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* How much to read beyond the end of the current message */
+#define BUS_READ_AHEAD (64U*1024U)
+
+/* Upper bounds for how much is coalesced into a single write */
+#define BUS_WRITE_MESSAGES_MAX 64U
+#define BUS_WRITE_IOVEC_MAX 256U
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -76,7 +84,8 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(!m->iovec);
 
-        n = 1 + m->n_body_parts;
+        /* If the body is passed as memfd, we only write the header */
+        n = m->memfd_body ? 1 : 1 + m->n_body_parts;
         if (n < ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
         else {
@@ -92,6 +101,9 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
                 goto fail;
 
         MESSAGE_FOREACH_PART(part, i, m)  {
+                if (m->memfd_body)
+                        break;
+
                 r = bus_body_part_map(part);
                 if (r < 0)
                         goto fail;
@@ -159,31 +171,48 @@ static int bus_socket_write_auth(sd_bus *b) {
         return 1;
 }
 
+static bool bus_socket_negotiate_memfd(sd_bus *b) {
+        assert(b);
+
+        /* Only on direct connections: a broker in the middle would have to
+         * understand the extension too, to forward the message bodies */
+        return b->accept_fd && b->accept_memfd && !b->bus_client;
+}
+
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *e, *f, *start;
+        char *e, *f, *g, *start;
         sd_id128_t peer;
         unsigned i;
         int r;
 
         assert(b);
 
-        /* We expect two response lines: "OK" and possibly
-         * "AGREE_UNIX_FD" */
+        /* We expect up to three response lines: "OK", and possibly
+         * "AGREE_UNIX_FD" and "EXTENSION_AGREE_MEMFD_BODY" */
 
         e = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
         if (!e)
                 return 0;
 
+        start = e + 2;
+
         if (b->accept_fd) {
-                f = memmem(e + 2, b->rbuffer_size - (e - (char*) b->rbuffer) - 2, "\r\n", 2);
+                f = memmem(start, b->rbuffer_size - (start - (char*) b->rbuffer), "\r\n", 2);
                 if (!f)
                         return 0;
 
                 start = f + 2;
-        } else {
+        } else
                 f = NULL;
-                start = e + 2;
-        }
+
+        if (bus_socket_negotiate_memfd(b)) {
+                g = memmem(start, b->rbuffer_size - (start - (char*) b->rbuffer), "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
 
         /* Nice! We got all the lines we need. First check the OK
          * line */
@@ -222,6 +251,16 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         memcmp(e + 2, "AGREE_UNIX_FD",
                                STRLEN("AGREE_UNIX_FD")) == 0;
 
+        /* And the third one. Peers that don't know the extension
+         * reply with an error here, which is fine. */
+
+        if (g)
+                b->can_memfd =
+                        b->can_fds &&
+                        (g - f == STRLEN("\r\nEXTENSION_AGREE_MEMFD_BODY")) &&
+                        memcmp(f + 2, "EXTENSION_AGREE_MEMFD_BODY",
+                               STRLEN("EXTENSION_AGREE_MEMFD_BODY")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -461,6 +500,15 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "EXTENSION_NEGOTIATE_MEMFD_BODY")) {
+                        /* Our own extension: large bodies may be passed as sealed memfds, see
+                         * BUS_MESSAGE_HEADER_MEMFD_BODY. This requires fd passing to be negotiated first. */
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "EXTENSION_AGREE_MEMFD_BODY\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -629,7 +677,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (!b->auth_buffer)
                 return -ENOMEM;
 
-        if (b->accept_fd)
+        if (bus_socket_negotiate_memfd(b))
+                auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nEXTENSION_NEGOTIATE_MEMFD_BODY\r\nBEGIN\r\n";
+        else if (b->accept_fd)
                 auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n";
         else
                 auth_suffix = "\r\nBEGIN\r\n";
@@ -965,38 +1015,62 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
+        sd_bus_message *m;
         struct iovec *iov;
-        ssize_t k;
-        size_t n;
+        size_t n, i, n_iov = 0;
         unsigned j;
+        ssize_t k;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        m = messages[0];
+
+        if (*idx >= BUS_MESSAGE_WIRE_SIZE(m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        /* Writes the first message, starting at *idx, and as many of the following messages as fit into
+         * one system call. Messages with fds are never appended, since the receiver gets the fds along
+         * with the first byte of the write they were sent with. *idx is advanced by the number of bytes
+         * written, which may hence exceed the size of the first message. */
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+        for (n = 0; n < MIN(n_messages, (size_t) BUS_WRITE_MESSAGES_MAX); n++) {
+                if (n > 0 && messages[n]->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(messages[n]);
+                if (r < 0) {
+                        if (n == 0)
+                                return r;
+                        break;
+                }
+
+                if (n > 0 && n_iov + messages[n]->n_iovec > BUS_WRITE_IOVEC_MAX)
+                        break;
+
+                n_iov += messages[n]->n_iovec;
+        }
+
+        iov = newa(struct iovec, n_iov);
+        for (i = 0, j = 0; i < n; i++) {
+                memcpy_safe(iov + j, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                j += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iov);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iov,
                 };
 
                 if (m->n_fds > 0 && *idx == 0) {
@@ -1012,7 +1086,7 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iov);
                 }
         }
 
@@ -1023,16 +1097,20 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        assert(m);
+
+        return bus_socket_write_messages(bus, &m, 1, idx);
+}
+
+static int bus_socket_message_need(const uint8_t *p, size_t size, size_t *need) {
         uint32_t a, b;
-        uint8_t e;
         uint64_t sum;
 
-        assert(bus);
+        assert(p || size == 0);
         assert(need);
-        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (size < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -1054,16 +1132,13 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
-
-        e = ((const uint8_t*) bus->rbuffer)[0];
-        if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
-        } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
+        /* Messages follow each other in the read buffer, hence the header is not necessarily aligned */
+        if (p[0] == BUS_LITTLE_ENDIAN) {
+                a = unaligned_read_le32(p + 4);
+                b = unaligned_read_le32(p + 12);
+        } else if (p[0] == BUS_BIG_ENDIAN) {
+                a = unaligned_read_be32(p + 4);
+                b = unaligned_read_be32(p + 12);
         } else
                 return -EBADMSG;
 
@@ -1075,53 +1150,248 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+        assert(bus);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        return bus_socket_message_need(bus->rbuffer, bus->rbuffer_size, need);
+}
+
+static uint32_t read_u32(const uint8_t *p, uint8_t endian) {
+        return endian == BUS_BIG_ENDIAN ? unaligned_read_be32(p) : unaligned_read_le32(p);
+}
+
+static int bus_socket_message_n_fds(const uint8_t *p, size_t size, size_t *ret) {
+        size_t ri, end, n = 0;
+        uint8_t endian;
+
+        assert(p);
+        assert(size >= sizeof(struct bus_header));
+        assert(ret);
+
+        /* Looks for the UNIX_FDS field in the header of a complete dbus1 message, without parsing the
+         * message. Returns -EBADMSG if the header contains anything unexpected. */
+
+        endian = p[0];
+        if (p[3] != 1)
+                return -EBADMSG;
+
+        ri = sizeof(struct bus_header);
+        end = ri + read_u32(p + 12, endian);
+        if (end > size)
+                return -EBADMSG;
+
+        while (ri < end) {
+                uint8_t code, type;
+
+                ri = ALIGN_TO(ri, 8);
+                if (ri + 4 > end)
+                        return -EBADMSG;
+
+                /* Every field is a byte and a variant, whose signature has to be a single basic type */
+                code = p[ri];
+                if (p[ri + 1] != 1 || p[ri + 3] != 0)
+                        return -EBADMSG;
+                type = p[ri + 2];
+                ri += 4;
+
+                switch (type) {
+
+                case SD_BUS_TYPE_BYTE:
+                        ri += 1;
+                        break;
+
+                case SD_BUS_TYPE_INT16:
+                case SD_BUS_TYPE_UINT16:
+                        ri = ALIGN_TO(ri, 2) + 2;
+                        break;
+
+                case SD_BUS_TYPE_BOOLEAN:
+                case SD_BUS_TYPE_INT32:
+                case SD_BUS_TYPE_UINT32:
+                case SD_BUS_TYPE_UNIX_FD:
+                        ri = ALIGN_TO(ri, 4);
+                        if (ri + 4 > end)
+                                return -EBADMSG;
+                        if (code == BUS_MESSAGE_HEADER_UNIX_FDS && type == SD_BUS_TYPE_UINT32)
+                                n = read_u32(p + ri, endian);
+                        ri += 4;
+                        break;
+
+                case SD_BUS_TYPE_INT64:
+                case SD_BUS_TYPE_UINT64:
+                case SD_BUS_TYPE_DOUBLE:
+                        ri = ALIGN_TO(ri, 8) + 8;
+                        break;
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        ri = ALIGN_TO(ri, 4);
+                        if (ri + 4 > end)
+                                return -EBADMSG;
+                        ri += 4 + (size_t) read_u32(p + ri, endian) + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        if (ri + 1 > end)
+                                return -EBADMSG;
+                        ri += 1 + (size_t) p[ri] + 1;
+                        break;
+
+                default:
+                        return -EBADMSG;
+                }
+
+                if (ri > end)
+                        return -EBADMSG;
+        }
+
+        *ret = n;
+        return 0;
+}
+
+static int bus_socket_take_fds(sd_bus *bus, const uint8_t *p, size_t size, int **ret_fds, size_t *ret_n_fds) {
+        size_t n;
+        int *fds;
+
+        assert(bus);
+        assert(ret_fds);
+        assert(ret_n_fds);
+
+        /* Since we read ahead, the fds of several messages might have been received at once. Each
+         * message takes as many of them as its header declares, in order. If the header cannot be
+         * scanned, the message gets all of them, and will then fail validation if that's wrong. */
+
+        if (bus->n_fds == 0 ||
+            bus_socket_message_n_fds(p, size, &n) < 0 ||
+            n >= bus->n_fds) {
+                *ret_fds = TAKE_PTR(bus->fds);
+                *ret_n_fds = bus->n_fds;
+                bus->n_fds = 0;
+                return 0;
+        }
+
+        if (n > 0) {
+                fds = newdup(int, bus->fds, n);
+                if (!fds)
+                        return -ENOMEM;
+
+                memmove(bus->fds, bus->fds + n, sizeof(int) * (bus->n_fds - n));
+                bus->n_fds -= n;
+        } else
+                fds = NULL;
+
+        *ret_fds = fds;
+        *ret_n_fds = n;
+        return 0;
+}
+
+static int bus_socket_make_message(sd_bus *bus, size_t offset, size_t size) {
         sd_bus_message *t;
+        size_t n_fds;
+        int *fds;
         void *b;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
+        assert(bus->rbuffer_size >= offset + size);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
+        if (offset == 0 && bus->rbuffer_size == size) {
+                /* The buffer contains exactly this message, pass it on, but don't keep any read-ahead
+                 * space allocated for it */
+                b = realloc(bus->rbuffer, size);
+                if (b)
+                        bus->rbuffer = b;
+                else
+                        b = bus->rbuffer;
+        } else {
+                b = memdup((const uint8_t*) bus->rbuffer + offset, size);
                 if (!b)
                         return -ENOMEM;
-        } else
-                b = NULL;
+        }
+
+        r = bus_socket_take_fds(bus, b, size, &fds, &n_fds);
+        if (r < 0)
+                goto fail;
 
         r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
+                                    b, size,
+                                    fds, n_fds,
                                     NULL,
                                     &t);
         if (r < 0) {
-                free(b);
-                return r;
+                close_many(fds, n_fds);
+                free(fds);
+                goto fail;
         }
 
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
-
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        if (b == bus->rbuffer) {
+                bus->rbuffer = NULL;
+                bus->rbuffer_size = 0;
+        }
 
         bus->rqueue[bus->rqueue_size++] = t;
 
         return 1;
+
+fail:
+        if (b != bus->rbuffer)
+                free(b);
+
+        return r;
+}
+
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0, need;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Splits off all complete messages in the read buffer, and moves the rest to its beginning */
+
+        for (;;) {
+                r = bus_socket_message_need((const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset, &need);
+                if (r < 0)
+                        break;
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                r = bus_socket_make_message(bus, offset, need);
+                if (r < 0)
+                        break;
+
+                ret = 1;
+
+                if (!bus->rbuffer)
+                        break;
+
+                offset += need;
+        }
+
+        if (offset > 0) {
+                memmove(bus->rbuffer, (const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset);
+                bus->rbuffer_size -= offset;
+
+                /* Don't keep the read-ahead space around while idle */
+                if (bus->rbuffer_size == 0)
+                        bus->rbuffer = mfree(bus->rbuffer);
+        }
+
+        /* Errors are only reported for the first message in the buffer, everything before has been queued
+         * already and will be dispatched first */
+        return ret > 0 ? ret : r;
 }
 
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, size;
         int r;
         void *b;
         union {
@@ -1138,16 +1408,20 @@ int bus_socket_read_message(sd_bus *bus) {
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
+
+        /* Read more than we need for the current message, so that when many messages are queued on the
+         * socket, we get several of them with one system call. */
+        size = MAX(need, bus->rbuffer_size + BUS_READ_AHEAD);
 
-        b = realloc(bus->rbuffer, need);
+        b = realloc(bus->rbuffer, size);
         if (!b)
                 return -ENOMEM;
 
         bus->rbuffer = b;
 
         iov.iov_base = (uint8_t*) bus->rbuffer + bus->rbuffer_size;
-        iov.iov_len = need - bus->rbuffer_size;
+        iov.iov_len = size - bus->rbuffer_size;
 
         if (bus->prefer_readv)
                 k = readv(bus->input_fd, &iov, 1);
@@ -1210,7 +1484,7 @@ int bus_socket_read_message(sd_bus *bus) {
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
 
         return 1;
 }
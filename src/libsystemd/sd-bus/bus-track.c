@@ -6,11 +6,21 @@
 #include "bus-internal.h"
 #include "bus-track.h"
 #include "bus-util.h"
+#include "set.h"
 
-struct track_item {
+/* One NameOwnerChanged subscription, shared by all track objects of a bus that track the same name */
+struct track_name {
         unsigned n_ref;
+        sd_bus *bus;
         char *name;
         sd_bus_slot *slot;
+        Set *tracks;
+};
+
+struct track_item {
+        unsigned n_ref;
+        char *name;
+        struct track_name *subscription;
 };
 
 struct sd_bus_track {
@@ -39,17 +49,56 @@ struct sd_bus_track {
                  "member='NameOwnerChanged',"           \
                  "arg0='", name, "'")
 
-static struct track_item* track_item_free(struct track_item *i) {
+static struct track_name* track_name_ref(struct track_name *n) {
+        assert(n);
+        assert(n->n_ref > 0);
+
+        n->n_ref++;
+        return n;
+}
+
+static struct track_name* track_name_unref(struct track_name *n) {
+
+        if (!n)
+                return NULL;
+
+        assert(n->n_ref > 0);
+        n->n_ref--;
+
+        if (n->n_ref > 0)
+                return NULL;
+
+        assert(set_isempty(n->tracks));
+
+        (void) hashmap_remove_value(n->bus->track_names, n->name, n);
+        sd_bus_slot_unref(n->slot);
+        set_free(n->tracks);
+        free(n->name);
+        return mfree(n);
+}
+
+static struct track_item* track_item_free(sd_bus_track *track, struct track_item *i) {
 
         if (!i)
                 return NULL;
 
-        sd_bus_slot_unref(i->slot);
+        if (i->subscription) {
+                (void) set_remove(i->subscription->tracks, track);
+                track_name_unref(i->subscription);
+        }
+
         free(i->name);
         return mfree(i);
 }
 
-DEFINE_TRIVIAL_CLEANUP_FUNC(struct track_item*, track_item_free);
+static void track_item_free_all(sd_bus_track *track) {
+        struct track_item *i;
+
+        assert(track);
+
+        while ((i = hashmap_steal_first(track->names)))
+                track_item_free(track, i);
+}
 
 static void bus_track_add_to_queue(sd_bus_track *track) {
         assert(track);
@@ -102,7 +151,7 @@ static int bus_track_remove_name_fully(sd_bus_track *track, const char *name) {
         if (!i)
                 return 0;
 
-        track_item_free(i);
+        track_item_free(track, i);
 
         bus_track_add_to_queue(track);
 
@@ -150,7 +199,8 @@ static sd_bus_track *track_free(sd_bus_track *track) {
                 LIST_REMOVE(tracks, track->bus->tracks, track);
 
         bus_track_remove_from_queue(track);
-        track->names = hashmap_free_with_destructor(track->names, track_item_free);
+        track_item_free_all(track);
+        track->names = hashmap_free(track->names);
         track->bus = sd_bus_unref(track->bus);
 
         if (track->destroy_callback)
@@ -162,27 +212,99 @@ static sd_bus_track *track_free(sd_bus_track *track) {
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus_track, sd_bus_track, track_free);
 
 static int on_name_owner_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        sd_bus_track *track = userdata;
+        struct track_name *n = userdata;
         const char *name, *old, *new;
+        sd_bus_track *track;
         int r;
 
         assert(message);
-        assert(track);
+        assert(n);
 
         r = sd_bus_message_read(message, "sss", &name, &old, &new);
         if (r < 0)
                 return 0;
 
-        bus_track_remove_name_fully(track, name);
+        /* Removing the name from the last track object releases the subscription, keep it around until we are
+         * done with it */
+        track_name_ref(n);
+
+        while ((track = set_first(n->tracks)))
+                if (bus_track_remove_name_fully(track, n->name) <= 0)
+                        (void) set_remove(n->tracks, track);
+
+        track_name_unref(n);
         return 0;
 }
 
-_public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
-        _cleanup_(track_item_freep) struct track_item *n = NULL;
-        struct track_item *i;
+static int bus_track_subscribe(sd_bus_track *track, struct track_item *i) {
+        struct track_name *n;
         const char *match;
         int r;
 
+        assert(track);
+        assert(i);
+        assert(!i->subscription);
+
+        n = hashmap_get(track->bus->track_names, i->name);
+        if (n) {
+                r = set_put(n->tracks, track);
+                if (r < 0)
+                        return r;
+
+                i->subscription = track_name_ref(n);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&track->bus->track_names, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        n = new0(struct track_name, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->n_ref = 1;
+        n->bus = track->bus;
+
+        n->name = strdup(i->name);
+        if (!n->name) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        r = set_ensure_allocated(&n->tracks, NULL);
+        if (r < 0)
+                goto fail;
+
+        r = set_put(n->tracks, track);
+        if (r < 0)
+                goto fail;
+
+        match = MATCH_FOR_NAME(i->name);
+
+        r = sd_bus_add_match_async(track->bus, &n->slot, match, on_name_owner_changed, NULL, n);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_put(track->bus->track_names, n->name, n);
+        if (r < 0)
+                goto fail;
+
+        i->subscription = n;
+        return 0;
+
+fail:
+        sd_bus_slot_unref(n->slot);
+        set_free(n->tracks);
+        free(n->name);
+        free(n);
+        return r;
+}
+
+_public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
+        struct track_item *i, *n;
+        int r;
+
         assert_return(track, -EINVAL);
         assert_return(service_name_is_valid(name), -EINVAL);
 
@@ -209,25 +331,21 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         if (!n)
                 return -ENOMEM;
         n->name = strdup(name);
-        if (!n->name)
+        if (!n->name) {
+                free(n);
                 return -ENOMEM;
+        }
 
-        /* First, subscribe to this name */
-        match = MATCH_FOR_NAME(name);
-
+        /* First, subscribe to this name, or join an existing subscription of another track object */
         bus_track_remove_from_queue(track); /* don't dispatch this while we work in it */
 
-        r = sd_bus_add_match_async(track->bus, &n->slot, match, on_name_owner_changed, NULL, track);
-        if (r < 0) {
-                bus_track_add_to_queue(track);
-                return r;
-        }
+        r = bus_track_subscribe(track, n);
+        if (r < 0)
+                goto fail;
 
         r = hashmap_put(track->names, n->name, n);
-        if (r < 0) {
-                bus_track_add_to_queue(track);
-                return r;
-        }
+        if (r < 0)
+                goto fail;
 
         /* Second, check if it is currently existing, or maybe doesn't, or maybe disappeared already. */
         track->n_adding++; /* again, make sure this isn't dispatch while we are working in it */
@@ -235,17 +353,20 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         track->n_adding--;
         if (r < 0) {
                 hashmap_remove(track->names, name);
-                bus_track_add_to_queue(track);
-                return r;
+                goto fail;
         }
 
         n->n_ref = 1;
-        n = NULL;
 
         bus_track_remove_from_queue(track);
         track->modified = true;
 
         return 1;
+
+fail:
+        track_item_free(track, n);
+        bus_track_add_to_queue(track);
+        return r;
 }
 
 _public_ int sd_bus_track_remove_name(sd_bus_track *track, const char *name) {
@@ -397,7 +518,7 @@ void bus_track_close(sd_bus_track *track) {
                 return;
 
         /* Let's flush out all names */
-        hashmap_clear_with_destructor(track->names, track_item_free);
+        track_item_free_all(track);
 
         /* Invoke handler */
         if (track->handler)
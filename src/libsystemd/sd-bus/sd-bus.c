@@ -164,6 +164,7 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b);
         assert(!b->track_queue);
         assert(!b->tracks);
+        assert(hashmap_isempty(b->track_names));
 
         b->state = BUS_CLOSED;
 
@@ -198,6 +199,8 @@ static sd_bus* bus_free(sd_bus *b) {
         free(b->description);
         free(b->patch_sender);
 
+        hashmap_free(b->track_names);
+
         free(b->exec_path);
         strv_free(b->exec_argv);
 
@@ -215,6 +218,8 @@ static sd_bus* bus_free(sd_bus *b) {
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
 
+        bus_creds_cache_flush(b);
+
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
 
@@ -222,6 +227,8 @@ static sd_bus* bus_free(sd_bus *b) {
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
 
+        bus_message_pools_done(b);
+
         return mfree(b);
 }
 
@@ -242,11 +249,14 @@ _public_ int sd_bus_new(sd_bus **ret) {
         b->message_version = 1;
         b->creds_mask |= SD_BUS_CREDS_WELL_KNOWN_NAMES|SD_BUS_CREDS_UNIQUE_NAME;
         b->accept_fd = true;
+        b->accept_memfd = true;
         b->original_pid = getpid_cached();
         b->n_groups = (size_t) -1;
 
         assert_se(pthread_mutex_init(&b->memfd_cache_mutex, NULL) == 0);
 
+        bus_message_pools_init(b);
+
         /* We guarantee that wqueue always has space for at least one entry */
         if (!GREEDY_REALLOC(b->wqueue, b->wqueue_allocated, 1))
                 return -ENOMEM;
@@ -1695,6 +1705,23 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void log_message_sent(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         int r;
 
@@ -1705,19 +1732,8 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         if (r <= 0)
                 return r;
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+        if (*idx >= BUS_MESSAGE_WIRE_SIZE(m))
+                log_message_sent(m);
 
         return r;
 }
@@ -1729,28 +1745,27 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                unsigned i;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Write as many of the queued messages as possible with a single system call */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+
+                /* Drop all entries that have been fully written from the queue. */
+                for (i = 0; i < bus->wqueue_size && bus->windex >= BUS_MESSAGE_WIRE_SIZE(bus->wqueue[i]); i++) {
+                        bus->windex -= BUS_MESSAGE_WIRE_SIZE(bus->wqueue[i]);
+
+                        log_message_sent(bus->wqueue[i]);
+                        sd_bus_message_unref(bus->wqueue[i]);
+                }
+
+                if (i > 0) {
+                        bus->wqueue_size -= i;
+                        memmove(bus->wqueue, bus->wqueue + i, sizeof(sd_bus_message*) * bus->wqueue_size);
 
                         ret = 1;
                 }
@@ -1864,7 +1879,7 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                         return r;
                 }
 
-                if (idx < BUS_MESSAGE_SIZE(m))  {
+                if (idx < BUS_MESSAGE_WIRE_SIZE(m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -2215,6 +2230,233 @@ fail:
         return sd_bus_error_set_errno(error, r);
 }
 
+struct call_batch_item {
+        uint64_t cookie;
+        usec_t timeout;
+};
+
+static void call_batch_complete(
+                Hashmap *pending,
+                struct call_batch_item *items,
+                size_t k,
+                sd_bus_error *errors,
+                int error) {
+
+        assert(pending);
+        assert(items);
+
+        assert_se(hashmap_remove(pending, &items[k].cookie));
+
+        if (errors && error < 0 && !sd_bus_error_is_set(errors + k))
+                (void) sd_bus_error_set_errno(errors + k, error);
+}
+
+_public_ int sd_bus_call_batch(
+                sd_bus *bus,
+                sd_bus_message **messages,
+                size_t n,
+                uint64_t usec,
+                sd_bus_error *errors,
+                sd_bus_message **replies) {
+
+        _cleanup_free_ struct call_batch_item *items = NULL;
+        _cleanup_hashmap_free_ Hashmap *pending = NULL;
+        size_t k, n_ok = 0;
+        Iterator it;
+        unsigned i;
+        void *p;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(messages || n == 0, -EINVAL);
+        assert_return(n <= INT_MAX, -ERANGE);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        for (k = 0; k < n; k++) {
+                assert_return(messages[k], -EINVAL);
+                assert_return(messages[k]->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL);
+                assert_return(!(messages[k]->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL);
+                assert_return(!errors || !bus_error_is_dirty(errors + k), -EINVAL);
+        }
+
+        /* Like sd_bus_call(), but sends all specified method calls right-away, and only then waits for
+         * the replies, in whatever order they arrive. Each call has its own timeout. Returns the number
+         * of calls that succeeded. Errors of individual calls are stored in the errors array, if it is
+         * specified. If the bus fails as a whole a negative error is returned, and all calls that
+         * weren't completed yet fail with it. */
+
+        if (replies)
+                for (k = 0; k < n; k++)
+                        replies[k] = NULL;
+
+        if (n == 0)
+                return 0;
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        r = bus_ensure_running(bus);
+        if (r < 0)
+                return r;
+
+        items = new0(struct call_batch_item, n);
+        if (!items)
+                return -ENOMEM;
+
+        pending = hashmap_new(&uint64_hash_ops);
+        if (!pending)
+                return -ENOMEM;
+
+        i = bus->rqueue_size;
+
+        for (k = 0; k < n; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = sd_bus_message_ref(messages[k]);
+
+                r = bus_seal_message(bus, m, usec);
+                if (r >= 0)
+                        r = bus_remarshal_message(bus, &m);
+                if (r >= 0)
+                        r = sd_bus_send(bus, m, &items[k].cookie);
+                if (r < 0) {
+                        if (errors)
+                                (void) sd_bus_error_set_errno(errors + k, r);
+                        continue;
+                }
+
+                items[k].timeout = calc_elapse(bus, m->timeout);
+
+                /* Store the index shifted by one, so that we can distinguish the first item from a miss */
+                r = hashmap_put(pending, &items[k].cookie, SIZE_TO_PTR(k + 1));
+                if (r < 0) {
+                        if (errors)
+                                (void) sd_bus_error_set_errno(errors + k, r);
+                        goto fail;
+                }
+        }
+
+        for (;;) {
+                usec_t left, t, earliest = USEC_INFINITY;
+
+                while (i < bus->rqueue_size) {
+                        sd_bus_message *incoming = bus->rqueue[i];
+                        uint64_t cookie;
+
+                        p = hashmap_get(pending, &incoming->reply_cookie);
+                        if (p) {
+                                k = PTR_TO_SIZE(p) - 1;
+
+                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
+                                bus->rqueue_size--;
+                                log_debug_bus_message(incoming);
+
+                                if (incoming->header->type == SD_BUS_MESSAGE_METHOD_RETURN) {
+
+                                        if (incoming->n_fds <= 0 || bus->accept_fd) {
+                                                call_batch_complete(pending, items, k, errors, 0);
+                                                n_ok++;
+
+                                                if (replies)
+                                                        replies[k] = incoming;
+                                                else
+                                                        sd_bus_message_unref(incoming);
+
+                                                continue;
+                                        }
+
+                                        if (errors)
+                                                (void) sd_bus_error_setf(errors + k, SD_BUS_ERROR_INCONSISTENT_MESSAGE, "Reply message contained file descriptors which I couldn't accept. Sorry.");
+                                        call_batch_complete(pending, items, k, errors, -EBADMSG);
+
+                                } else if (incoming->header->type == SD_BUS_MESSAGE_METHOD_ERROR) {
+                                        if (errors)
+                                                (void) sd_bus_error_copy(errors + k, &incoming->error);
+                                        call_batch_complete(pending, items, k, errors, -EIO);
+                                } else
+                                        call_batch_complete(pending, items, k, errors, -EIO);
+
+                                sd_bus_message_unref(incoming);
+                                continue;
+
+                        }
+
+                        cookie = BUS_MESSAGE_COOKIE(incoming);
+                        p = hashmap_get(pending, &cookie);
+                        if (p &&
+                            bus->unique_name &&
+                            incoming->sender &&
+                            streq(bus->unique_name, incoming->sender)) {
+
+                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
+                                bus->rqueue_size--;
+
+                                /* Our own message? Let's not dead-lock, see sd_bus_call() */
+                                call_batch_complete(pending, items, PTR_TO_SIZE(p) - 1, errors, -ELOOP);
+                                sd_bus_message_unref(incoming);
+                                continue;
+                        }
+
+                        /* Try to read more, right-away */
+                        i++;
+                }
+
+                if (hashmap_isempty(pending))
+                        break;
+
+                r = bus_read_message(bus, false, 0);
+                if (r < 0) {
+                        if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
+                                bus_enter_closing(bus);
+                                r = -ECONNRESET;
+                        }
+
+                        goto fail;
+                }
+                if (r > 0)
+                        continue;
+
+                t = now(CLOCK_MONOTONIC);
+                HASHMAP_FOREACH(p, pending, it) {
+                        k = PTR_TO_SIZE(p) - 1;
+
+                        if (items[k].timeout == 0)
+                                continue;
+
+                        if (t >= items[k].timeout)
+                                call_batch_complete(pending, items, k, errors, -ETIMEDOUT);
+                        else
+                                earliest = MIN(earliest, items[k].timeout);
+                }
+
+                if (hashmap_isempty(pending))
+                        break;
+
+                left = earliest == USEC_INFINITY ? (uint64_t) -1 : earliest - t;
+
+                r = bus_poll(bus, true, left);
+                if (r < 0)
+                        goto fail;
+
+                r = dispatch_wqueue(bus);
+                if (r < 0) {
+                        if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
+                                bus_enter_closing(bus);
+                                r = -ECONNRESET;
+                        }
+
+                        goto fail;
+                }
+        }
+
+        return (int) n_ok;
+
+fail:
+        HASHMAP_FOREACH(p, pending, it)
+                call_batch_complete(pending, items, PTR_TO_SIZE(p) - 1, errors, r);
+
+        return r;
+}
+
 _public_ int sd_bus_get_fd(sd_bus *bus) {
 
         assert_return(bus, -EINVAL);
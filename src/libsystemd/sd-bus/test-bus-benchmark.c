@@ -14,6 +14,7 @@
 #include "util.h"
 
 #define MAX_SIZE (2*1024*1024)
+#define MATCH_MAX 4096U
 
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
 
@@ -204,10 +205,84 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+static int match_noop(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        return 0;
+}
+
+static void benchmark_match(void) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        int pair[2] = { -1, -1 };
+        unsigned i, n;
+        sd_bus *b;
+        usec_t t;
+
+        /* Roughly the matches a service manager with many clients has installed: one per unique name of each
+         * client, plus path and argument namespace matches */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) >= 0);
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        slots = new0(sd_bus_slot, MATCH_MAX);
+        assert_se(slots);
+
+        for (i = 0; i < MATCH_MAX; i++) {
+                struct bus_match_component *components = NULL;
+                _cleanup_free_ char *match = NULL;
+                unsigned n_components = 0;
+
+                switch (i % 4) {
+                case 0:
+                        assert_se(asprintf(&match, "type='signal',sender=':1.%u',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged'", i) >= 0);
+                        break;
+                case 1:
+                        assert_se(asprintf(&match, "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0=':1.%u'", i) >= 0);
+                        break;
+                case 2:
+                        assert_se(asprintf(&match, "type='signal',path_namespace='/org/freedesktop/systemd1/unit/u%u'", i) >= 0);
+                        break;
+                case 3:
+                        assert_se(asprintf(&match, "type='signal',arg0namespace='org.example.n%u'", i) >= 0);
+                        break;
+                }
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+                slots[i].match_callback.callback = match_noop;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        assert_se(sd_bus_message_new_signal(b, &m, "/org/freedesktop/systemd1/unit/u10_2eservice", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_set_sender(m, ":1.8") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "org.freedesktop.systemd1.Unit") >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (n = 0;; n++) {
+                assert_se(bus_match_run(NULL, &root, m) >= 0);
+
+                if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                        break;
+        }
+
+        printf("%u matches: %u dispatches/s\n", MATCH_MAX, (unsigned) ((n * USEC_PER_SEC) / arg_loop_usec));
+
+        bus_match_free(&root);
+        m = sd_bus_message_unref(m);
+        sd_bus_unref(b);
+        safe_close(pair[1]);
+}
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_MATCH,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = { -1, -1 };
@@ -224,6 +299,9 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "match")) {
+                        mode = MODE_MATCH;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
@@ -237,6 +315,11 @@ int main(int argc, char *argv[]) {
 
         assert_se(arg_loop_usec > 0);
 
+        if (mode == MODE_MATCH) {
+                benchmark_match();
+                return 0;
+        }
+
         if (type == TYPE_LEGACY) {
                 const char *e;
 
@@ -299,6 +382,9 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                default:
+                        assert_not_reached("Unexpected mode");
                 }
 
                 _exit(EXIT_SUCCESS);
@@ -1,10 +1,52 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/socket.h>
+
 #include "sd-bus.h"
 
+#include "bus-creds.h"
 #include "bus-dump.h"
+#include "bus-internal.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
+#include "fd-util.h"
+#include "process-util.h"
+
+static void test_creds_cache(void) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *a = NULL, *b = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        const char *comm_a, *comm_b;
+        uint64_t mask = SD_BUS_CREDS_COMM|SD_BUS_CREDS_EXE|SD_BUS_CREDS_AUGMENT;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        pair[0] = -1;
+
+        assert_se(a = bus_creds_new());
+        assert_se(bus_creds_add_more_cached(bus, a, mask, getpid_cached()) >= 0);
+        assert_se(hashmap_size(bus->creds_cache) == 1);
+
+        /* The second lookup is served from the cache, and yields the same data */
+        assert_se(b = bus_creds_new());
+        assert_se(bus_creds_add_more_cached(bus, b, mask, getpid_cached()) >= 0);
+        assert_se(hashmap_size(bus->creds_cache) == 1);
+
+        assert_se(sd_bus_creds_get_comm(a, &comm_a) >= 0);
+        assert_se(sd_bus_creds_get_comm(b, &comm_b) >= 0);
+        assert_se(streq(comm_a, comm_b));
+        assert_se(sd_bus_creds_get_augmented_mask(b) == sd_bus_creds_get_augmented_mask(a));
+        assert_se(sd_bus_creds_get_augmented_mask(b) & SD_BUS_CREDS_COMM);
+
+        /* Asking for more fields extends the entry */
+        b = sd_bus_creds_unref(b);
+        assert_se(b = bus_creds_new());
+        assert_se(bus_creds_add_more_cached(bus, b, mask|SD_BUS_CREDS_CMDLINE, getpid_cached()) >= 0);
+        assert_se(sd_bus_creds_get_augmented_mask(b) & SD_BUS_CREDS_COMM);
+        assert_se(sd_bus_creds_get_augmented_mask(b) & SD_BUS_CREDS_CMDLINE);
+        assert_se(hashmap_size(bus->creds_cache) == 1);
+}
 
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
@@ -27,6 +69,8 @@ int main(int argc, char *argv[]) {
 
         creds = sd_bus_creds_unref(creds);
 
+        test_creds_cache();
+
         r = sd_bus_creds_new_from_pid(&creds, 1, _SD_BUS_CREDS_ALL);
         if (r != -EACCES) {
                 assert_se(r >= 0);
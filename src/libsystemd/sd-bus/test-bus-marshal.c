@@ -103,6 +103,70 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void test_bus_deep_containers(sd_bus *bus) {
+        unsigned i, k, n;
+
+        /* Nest deeper than what fits into a pooled container stack, and rewind, so that the stack is both
+         * moved out of the pool and reused. Do this a couple of times, so that freed messages are recycled. */
+
+        for (k = 0; k < 16; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                unsigned depth = 1 + k * 2;
+                uint32_t u;
+
+                assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Deep") >= 0);
+
+                for (i = 0; i < depth; i++)
+                        assert_se(sd_bus_message_open_container(m, 'v', i + 1 < depth ? "v" : "u") >= 0);
+                assert_se(sd_bus_message_append(m, "u", depth) >= 0);
+                for (i = 0; i < depth; i++)
+                        assert_se(sd_bus_message_close_container(m) >= 0);
+
+                assert_se(sd_bus_message_seal(m, 4711, 0) >= 0);
+
+                for (n = 0; n < 2; n++) {
+                        assert_se(sd_bus_message_rewind(m, true) >= 0);
+
+                        for (i = 0; i < depth; i++)
+                                assert_se(sd_bus_message_enter_container(m, 'v', NULL) > 0);
+                        assert_se(sd_bus_message_read(m, "u", &u) > 0);
+                        assert_se(u == depth);
+                        for (i = 0; i < depth; i++)
+                                assert_se(sd_bus_message_exit_container(m) >= 0);
+                }
+        }
+}
+
+static void test_bus_array_of_structs(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        const char *s;
+        unsigned i;
+        uint32_t u;
+
+        /* The contents of each element are validated only once, make sure mismatching or invalid
+         * contents are still refused afterwards */
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Structs") >= 0);
+        assert_se(sd_bus_message_append(m, "a(su)", 3, "a", 1, "b", 2, "c", 3) >= 0);
+        assert_se(sd_bus_message_seal(m, 4711, 0) >= 0);
+
+        assert_se(sd_bus_message_enter_container(m, 'a', "(su)") > 0);
+
+        for (i = 1; i <= 3; i++) {
+                assert_se(sd_bus_message_enter_container(m, 'r', "us") == -ENXIO);
+                assert_se(sd_bus_message_enter_container(m, 'r', "s(") == -EINVAL);
+
+                assert_se(sd_bus_message_enter_container(m, 'r', "su") > 0);
+                assert_se(sd_bus_message_read(m, "su", &s, &u) > 0);
+                assert_se(u == i);
+                assert_se(s[0] == (char) ('a' + i - 1));
+                assert_se(sd_bus_message_exit_container(m) > 0);
+        }
+
+        assert_se(sd_bus_message_enter_container(m, 'r', "su") == 0);
+        assert_se(sd_bus_message_exit_container(m) > 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -408,6 +472,9 @@ int main(int argc, char *argv[]) {
         assert_se(streq(c, "ccc"));
         assert_se(streq(d, "3"));
 
+        test_bus_deep_containers(bus);
+        test_bus_array_of_structs(bus);
+
         test_bus_label_escape();
         test_bus_path_encode();
         test_bus_path_encode_unique();
@@ -66,6 +66,49 @@ static void test_match_scope(const char *match, enum bus_match_scope scope) {
         bus_match_parse_free(components, n_components);
 }
 
+static void test_match_prefixes(sd_bus *bus) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        sd_bus_slot slots[12];
+
+        /* Namespace and unique sender matches are looked up in hash tables, make sure the pattern rules still apply */
+
+        assert_se(match_add(slots, &root, "path_namespace='/'", 1) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/org'", 2) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/org/freedesktop'", 3) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/org/free'", 4) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/org/freedesktop/systemd1/unit'", 5) >= 0);
+        assert_se(match_add(slots, &root, "arg0namespace='org'", 6) >= 0);
+        assert_se(match_add(slots, &root, "arg0namespace='org.freedesktop.systemd1'", 7) >= 0);
+        assert_se(match_add(slots, &root, "arg0namespace='org.free'", 8) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.42'", 9) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.4'", 10) >= 0);
+        assert_se(match_add(slots, &root, "sender='org.freedesktop.systemd1'", 11) >= 0);
+
+        bus_match_dump(&root, 0);
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", "UnitNew") >= 0);
+        assert_se(sd_bus_message_set_sender(m, ":1.42") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "org.freedesktop.systemd1") >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 1, 2, 3, 6, 7, 9, 11 }, 7));
+
+        assert_se(bus_match_remove(&root, &slots[9].match_callback) >= 0);
+        assert_se(bus_match_remove(&root, &slots[2].match_callback) >= 0);
+
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 1, 3, 6, 7, 11 }, 5));
+
+        bus_match_free(&root);
+}
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -131,6 +174,8 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_match_prefixes(bus);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
@@ -277,6 +277,32 @@ fail:
         return INT_TO_PTR(r);
 }
 
+static void test_call_batch(sd_bus *bus) {
+        sd_bus_error errors[3] = { SD_BUS_ERROR_NULL, SD_BUS_ERROR_NULL, SD_BUS_ERROR_NULL };
+        sd_bus_message *calls[3] = {}, *replies[3];
+        unsigned i;
+
+        assert_se(sd_bus_message_new_method_call(bus, &calls[0], "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation") >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &calls[1], "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoSuchMethod") >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &calls[2], "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Properties", "GetAll") >= 0);
+        assert_se(sd_bus_message_append(calls[2], "s", "") >= 0);
+
+        assert_se(sd_bus_call_batch(bus, calls, ELEMENTSOF(calls), 0, errors, replies) == 2);
+
+        assert_se(replies[0] && !sd_bus_error_is_set(&errors[0]));
+        assert_se(!replies[1] && sd_bus_error_has_name(&errors[1], SD_BUS_ERROR_UNKNOWN_METHOD));
+        assert_se(replies[2] && !sd_bus_error_is_set(&errors[2]));
+        assert_se(sd_bus_message_has_signature(replies[2], "a{sv}"));
+
+        for (i = 0; i < ELEMENTSOF(calls); i++) {
+                sd_bus_message_unref(calls[i]);
+                sd_bus_message_unref(replies[i]);
+                sd_bus_error_free(&errors[i]);
+        }
+
+        assert_se(sd_bus_call_batch(bus, NULL, 0, 0, NULL, NULL) == 0);
+}
+
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
@@ -291,6 +317,8 @@ static int client(struct context *c) {
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", &error, NULL, NULL);
         assert_se(r >= 0);
 
+        test_call_batch(bus);
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "AlterSomething", &error, &reply, "s", "hallo");
         assert_se(r >= 0);
 
@@ -1,16 +1,27 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
 
 #include "sd-bus.h"
 
 #include "bus-internal.h"
+#include "bus-message.h"
 #include "bus-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "macro.h"
 #include "util.h"
 
+/* Number and payload size of the messages sent in a burst before the Exit call, so that they queue up
+ * on both ends, and get coalesced into a few writes and split apart from a few reads again */
+#define N_BURST 64U
+#define BURST_PAYLOAD (16U*1024U)
+
+/* Large enough to be passed as memfd, if both sides do fd passing */
+#define LARGE_PAYLOAD (1024U*1024U)
+
 struct context {
         int fds[2];
 
@@ -19,6 +30,9 @@ struct context {
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+
+        unsigned n_burst;
+        unsigned n_burst_fds;
 };
 
 static void *server(void *p) {
@@ -74,6 +88,44 @@ static void *server(void *p) {
 
                         quit = true;
 
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Burst")) {
+                        const void *d;
+                        size_t sz;
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &d, &sz) > 0);
+                        assert_se(sz == BURST_PAYLOAD);
+                        c->n_burst++;
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Large")) {
+                        const void *d;
+                        size_t sz;
+
+                        assert_se(m->memfd_body == (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &d, &sz) > 0);
+                        assert_se(sz == LARGE_PAYLOAD);
+                        assert_se(((const uint8_t*) d)[0] == 'L' && ((const uint8_t*) d)[sz - 1] == 'L');
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to allocate return: %m");
+                                goto fail;
+                        }
+
+                        r = sd_bus_message_append_array(reply, 'y', d, sz);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to append to return: %m");
+                                goto fail;
+                        }
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "BurstFd")) {
+                        int fd;
+
+                        /* Each fd has to arrive with the message it was sent with */
+                        assert_se(sd_bus_message_read(m, "h", &fd) > 0);
+                        assert_se(fcntl(fd, F_GETFD) >= 0);
+                        c->n_burst_fds++;
+
                 } else if (sd_bus_message_is_method_call(m, NULL, NULL)) {
                         r = sd_bus_message_new_method_error(
                                         m,
@@ -105,9 +157,95 @@ fail:
         return INT_TO_PTR(r);
 }
 
+static int send_burst(struct context *c, sd_bus *bus) {
+        _cleanup_close_ int fd = -1;
+        bool with_fds;
+        unsigned i;
+        int r;
+
+        with_fds = c->client_negotiate_unix_fds && c->server_negotiate_unix_fds;
+
+        fd = open("/dev/null", O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        for (i = 0; i < N_BURST; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &m,
+                                "org.freedesktop.systemd.test",
+                                "/",
+                                "org.freedesktop.systemd.test",
+                                with_fds && i % 4 == 3 ? "BurstFd" : "Burst");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_set_expect_reply(m, false);
+                if (r < 0)
+                        return r;
+
+                if (with_fds && i % 4 == 3)
+                        r = sd_bus_message_append(m, "h", fd);
+                else {
+                        void *p;
+
+                        r = sd_bus_message_append_array_space(m, 'y', BURST_PAYLOAD, &p);
+                        if (r >= 0)
+                                memset(p, 'x', BURST_PAYLOAD);
+                }
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_send(bus, m, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int call_large(struct context *c, sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        const void *d;
+        size_t sz;
+        void *p;
+        int r;
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd.test",
+                        "/",
+                        "org.freedesktop.systemd.test",
+                        "Large");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array_space(m, 'y', LARGE_PAYLOAD, &p);
+        if (r < 0)
+                return r;
+
+        memset(p, 'L', LARGE_PAYLOAD);
+
+        r = sd_bus_call(bus, m, 0, NULL, &reply);
+        if (r < 0)
+                return r;
+
+        assert_se(reply->memfd_body == (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
+
+        assert_se(sd_bus_message_read_array(reply, 'y', &d, &sz) > 0);
+        assert_se(sz == LARGE_PAYLOAD);
+        assert_se(((const uint8_t*) d)[0] == 'L' && ((const uint8_t*) d)[sz - 1] == 'L');
+
+        return 0;
+}
+
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
-        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        /* Close explicitly: if authentication fails, the queued burst messages still pin the bus */
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         sd_bus_error error = SD_BUS_ERROR_NULL;
         int r;
 
@@ -117,6 +255,15 @@ static int client(struct context *c) {
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
+        /* If authentication fails, this fails too, and so does the method call below */
+        r = send_burst(c, bus);
+        if (r < 0)
+                log_debug_errno(r, "Failed to send burst: %m");
+
+        r = call_large(c, bus);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue large method call: %m");
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -167,6 +314,12 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         if (PTR_TO_INT(p) < 0)
                 return PTR_TO_INT(p);
 
+        if (client_negotiate_unix_fds && server_negotiate_unix_fds) {
+                assert_se(c.n_burst == N_BURST / 4 * 3);
+                assert_se(c.n_burst_fds == N_BURST / 4);
+        } else
+                assert_se(c.n_burst == N_BURST);
+
         return 0;
 }
 
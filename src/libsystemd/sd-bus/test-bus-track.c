@@ -5,10 +5,12 @@
 
 #include "sd-bus.h"
 
+#include "bus-internal.h"
 #include "macro.h"
 
 static bool track_cb_called_x = false;
 static bool track_cb_called_y = false;
+static bool track_cb_called_z = false;
 
 static int track_cb_x(sd_bus_track *t, void *userdata) {
 
@@ -17,10 +19,23 @@ static int track_cb_x(sd_bus_track *t, void *userdata) {
         assert_se(!track_cb_called_x);
         track_cb_called_x = true;
 
-        /* This means b's name disappeared. Let's now disconnect, to make sure the track handling on disconnect works
-         * as it should. */
+        /* This means b's name disappeared. Once both track objects watching it noticed, let's disconnect, to make
+         * sure the track handling on disconnect works as it should. */
 
-        assert_se(shutdown(sd_bus_get_fd(sd_bus_track_get_bus(t)), SHUT_RDWR) >= 0);
+        if (track_cb_called_z)
+                assert_se(shutdown(sd_bus_get_fd(sd_bus_track_get_bus(t)), SHUT_RDWR) >= 0);
+        return 1;
+}
+
+static int track_cb_z(sd_bus_track *t, void *userdata) {
+
+        log_error("TRACK CB Z");
+
+        assert_se(!track_cb_called_z);
+        track_cb_called_z = true;
+
+        if (track_cb_called_x)
+                assert_se(shutdown(sd_bus_get_fd(sd_bus_track_get_bus(t)), SHUT_RDWR) >= 0);
         return 1;
 }
 
@@ -42,7 +57,7 @@ static int track_cb_y(sd_bus_track *t, void *userdata) {
 
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *event = NULL;
-        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL;
+        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL, *z = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
         const char *unique;
         int r;
@@ -76,6 +91,14 @@ int main(int argc, char *argv[]) {
         r = sd_bus_track_add_name(x, unique);
         assert_se(r >= 0);
 
+        /* Watch b's name from a a second time, this shares the subscription */
+        r = sd_bus_track_new(a, &z, track_cb_z, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_track_add_name(z, unique);
+        assert_se(r >= 0);
+        assert_se(hashmap_size(a->track_names) == 1);
+
         /* Watch's a's own name from a */
         r = sd_bus_track_new(a, &y, track_cb_y, NULL);
         assert_se(r >= 0);
@@ -85,6 +108,7 @@ int main(int argc, char *argv[]) {
 
         r = sd_bus_track_add_name(y, unique);
         assert_se(r >= 0);
+        assert_se(hashmap_size(a->track_names) == 2);
 
         /* Now make b's name disappear */
         sd_bus_close(b);
@@ -94,6 +118,7 @@ int main(int argc, char *argv[]) {
 
         assert_se(track_cb_called_x);
         assert_se(track_cb_called_y);
+        assert_se(track_cb_called_z);
 
         return 0;
 }
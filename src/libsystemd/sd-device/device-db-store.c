@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db-store.h"
+#include "device-internal.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "macro.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "util.h"
+
+#define DEVICE_DB_STORE_SIGNATURE { 'U', 'D', 'E', 'V', 'D', 'B', '0', '1' }
+
+struct device_db_store_header {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t entry_size;
+        uint64_t generation; /* st_mtim of /run/udev/data/ in nsec when the snapshot was taken */
+        uint64_t n_entries;
+        uint64_t strings_size;
+};
+
+/* sorted by id, all offsets relative to the start of the strings */
+struct device_db_store_entry {
+        uint64_t id_offset;
+        uint64_t data_offset;
+        uint64_t data_size;
+};
+
+struct DeviceDBStore {
+        unsigned n_ref;
+
+        void *map;
+        size_t map_size;
+
+        const struct device_db_store_entry *entries;
+        uint64_t n_entries;
+        const char *strings;
+        uint64_t strings_size;
+};
+
+int device_db_store_get_generation(uint64_t *ret) {
+        struct stat st;
+
+        assert(ret);
+
+        if (stat("/run/udev/data", &st) < 0)
+                return -errno;
+
+        *ret = timespec_load_nsec(&st.st_mtim);
+        return 0;
+}
+
+int device_db_store_open(DeviceDBStore **ret) {
+        _cleanup_(device_db_store_unrefp) DeviceDBStore *store = NULL;
+        const struct device_db_store_header *h;
+        _cleanup_close_ int fd = -1;
+        uint64_t generation, i;
+        struct stat st;
+        int r;
+
+        assert(ret);
+
+        fd = open(DEVICE_DB_STORE, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* only written by udevd, anything else is not to be trusted */
+        if (st.st_uid != 0 || (st.st_mode & 0022) != 0)
+                return -EPERM;
+
+        if ((size_t) st.st_size < sizeof(struct device_db_store_header))
+                return -EBADMSG;
+
+        store = new0(DeviceDBStore, 1);
+        if (!store)
+                return -ENOMEM;
+
+        store->n_ref = 1;
+
+        store->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (store->map == MAP_FAILED) {
+                store->map = NULL;
+                return -errno;
+        }
+        store->map_size = st.st_size;
+
+        h = store->map;
+        if (memcmp(h->signature, (const uint8_t[]) DEVICE_DB_STORE_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->header_size != sizeof(struct device_db_store_header) ||
+            h->entry_size != sizeof(struct device_db_store_entry) ||
+            h->n_entries > (store->map_size - h->header_size) / h->entry_size ||
+            h->header_size + h->n_entries * h->entry_size + h->strings_size != store->map_size ||
+            (h->strings_size > 0 && ((const char*) store->map)[store->map_size - 1] != '\0'))
+                return -EBADMSG;
+
+        /* the snapshot is only good as long as no db file was added, replaced or removed since */
+        r = device_db_store_get_generation(&generation);
+        if (r < 0)
+                return r;
+        if (generation != h->generation)
+                return -ESTALE;
+
+        store->entries = (const struct device_db_store_entry*) ((const uint8_t*) store->map + h->header_size);
+        store->n_entries = h->n_entries;
+        store->strings = (const char*) (store->entries + store->n_entries);
+        store->strings_size = h->strings_size;
+
+        for (i = 0; i < store->n_entries; i++)
+                if (store->entries[i].id_offset >= store->strings_size ||
+                    store->entries[i].data_offset > store->strings_size ||
+                    store->entries[i].data_size >= store->strings_size - store->entries[i].data_offset)
+                        return -EBADMSG;
+
+        *ret = TAKE_PTR(store);
+        return 0;
+}
+
+DeviceDBStore *device_db_store_ref(DeviceDBStore *store) {
+        if (!store)
+                return NULL;
+
+        assert(store->n_ref > 0);
+        store->n_ref++;
+
+        return store;
+}
+
+DeviceDBStore *device_db_store_unref(DeviceDBStore *store) {
+        if (!store)
+                return NULL;
+
+        assert(store->n_ref > 0);
+        if (--store->n_ref > 0)
+                return NULL;
+
+        if (store->map)
+                munmap(store->map, store->map_size);
+
+        return mfree(store);
+}
+
+int device_db_store_lookup(DeviceDBStore *store, const char *id, const char **ret, size_t *ret_size) {
+        uint64_t left, right;
+
+        assert(store);
+        assert(id);
+        assert(ret);
+        assert(ret_size);
+
+        left = 0;
+        right = store->n_entries;
+        while (left < right) {
+                const struct device_db_store_entry *e;
+                uint64_t middle;
+                int c;
+
+                middle = left + (right - left) / 2;
+                e = store->entries + middle;
+
+                c = strcmp(id, store->strings + e->id_offset);
+                if (c == 0) {
+                        *ret = store->strings + e->data_offset;
+                        *ret_size = e->data_size;
+                        return 0;
+                }
+
+                if (c < 0)
+                        right = middle;
+                else
+                        left = middle + 1;
+        }
+
+        return -ENOENT;
+}
+
+void device_set_db_store(sd_device *device, DeviceDBStore *store) {
+        assert(device);
+
+        device_db_store_unref(device->db_store);
+        device->db_store = device_db_store_ref(store);
+}
+
+static int id_compare(const void *a, const void *b) {
+        return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+int device_db_store_write(Hashmap *entries, uint64_t generation) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *temp = NULL;
+        _cleanup_free_ const char **ids = NULL;
+        struct device_db_store_header h = {
+                .signature = DEVICE_DB_STORE_SIGNATURE,
+                .header_size = sizeof(struct device_db_store_header),
+                .entry_size = sizeof(struct device_db_store_entry),
+                .generation = generation,
+        };
+        const char *id, *data;
+        uint64_t offset = 0;
+        size_t n = 0, k;
+        Iterator i;
+        int r;
+
+        ids = new(const char*, hashmap_size(entries) + 1);
+        if (!ids)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(data, id, entries, i)
+                ids[n++] = id;
+
+        qsort_safe(ids, n, sizeof(const char*), id_compare);
+
+        h.n_entries = n;
+        for (k = 0; k < n; k++)
+                h.strings_size += strlen(ids[k]) + 1 + strlen(hashmap_get(entries, ids[k])) + 1;
+
+        r = fopen_temporary(DEVICE_DB_STORE, &f, &temp);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+
+        for (k = 0; k < n; k++) {
+                struct device_db_store_entry e;
+                size_t l;
+
+                l = strlen(ids[k]) + 1;
+                e = (struct device_db_store_entry) {
+                        .id_offset = offset,
+                        .data_offset = offset + l,
+                        .data_size = strlen(hashmap_get(entries, ids[k])),
+                };
+                offset += l + e.data_size + 1;
+
+                fwrite(&e, sizeof(e), 1, f);
+        }
+
+        for (k = 0; k < n; k++) {
+                fwrite(ids[k], strlen(ids[k]) + 1, 1, f);
+                data = hashmap_get(entries, ids[k]);
+                fwrite(data, strlen(data) + 1, 1, f);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp, DEVICE_DB_STORE) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(temp);
+        return r;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "sd-device.h"
+
+#include "hashmap.h"
+
+/* A read-only snapshot of all files in /run/udev/data/, written by udevd whenever its event queue runs empty, so
+ * that enumerating devices maps a single file instead of opening one file per device. A snapshot is only used as
+ * long as the directory did not change since it was taken, otherwise readers fall back to the files. */
+
+#define DEVICE_DB_STORE "/run/udev/data.store"
+
+typedef struct DeviceDBStore DeviceDBStore;
+
+int device_db_store_open(DeviceDBStore **ret);
+DeviceDBStore *device_db_store_ref(DeviceDBStore *store);
+DeviceDBStore *device_db_store_unref(DeviceDBStore *store);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DeviceDBStore*, device_db_store_unref);
+
+int device_db_store_lookup(DeviceDBStore *store, const char *id, const char **ret, size_t *ret_size);
+
+void device_set_db_store(sd_device *device, DeviceDBStore *store);
+
+int device_db_store_get_generation(uint64_t *ret);
+int device_db_store_write(Hashmap *entries, uint64_t generation);
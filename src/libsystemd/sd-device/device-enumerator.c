@@ -3,10 +3,14 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db-store.h"
 #include "device-enumerator-private.h"
+#include "device-internal.h"
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fs-util.h"
+#include "path-util.h"
 #include "prioq.h"
 #include "set.h"
 #include "string-util.h"
@@ -38,6 +42,8 @@ struct sd_device_enumerator {
         Set *match_tag;
         sd_device *match_parent;
         bool match_allow_uninitialized;
+
+        DeviceDBStore *db_store;
 };
 
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
@@ -77,6 +83,7 @@ static sd_device_enumerator *device_enumerator_free(sd_device_enumerator *enumer
         set_free_free(enumerator->match_sysname);
         set_free_free(enumerator->match_tag);
         sd_device_unref(enumerator->match_parent);
+        device_db_store_unref(enumerator->db_store);
 
         return mfree(enumerator);
 }
@@ -440,30 +447,165 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
-static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+static int sysfs_resolve_link(const char *dir, const char *target, char **ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char **components = NULL;
+        _cleanup_free_ char *joined = NULL;
+        size_t n = 0;
+        char **i;
+
+        assert(dir);
+        assert(target);
+        assert(ret);
+
+        /* Resolves a relative symlink target found in 'dir' lexically. This is only correct as long as 'dir' itself
+         * does not contain any symlinks, which holds for the directories in /sys we enumerate. */
+
+        if (path_is_absolute(target))
+                return -EINVAL;
+
+        joined = strjoin(dir, "/", target);
+        if (!joined)
+                return -ENOMEM;
+
+        l = strv_split(joined, "/");
+        if (!l)
+                return -ENOMEM;
+
+        components = new(char*, strv_length(l) + 1);
+        if (!components)
+                return -ENOMEM;
+
+        STRV_FOREACH(i, l) {
+                if (streq(*i, "."))
+                        continue;
+
+                if (streq(*i, "..")) {
+                        if (n == 0)
+                                return -EINVAL;
+
+                        n--;
+                        continue;
+                }
+
+                components[n++] = *i;
+        }
+        components[n] = NULL;
+
+        free(joined);
+        joined = strv_join(components, "/");
+        if (!joined)
+                return -ENOMEM;
+
+        *ret = strappend("/", joined);
+        if (!*ret)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int device_new_from_dirent(int dir_fd, const char *path, const struct dirent *de, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        _cleanup_free_ char *syspath = NULL;
+        int r;
+
+        assert(dir_fd >= 0);
+        assert(path);
+        assert(de);
+        assert(ret);
+
+        /* Does what sd_device_new_from_syspath() does for an entry of a sysfs directory we have already opened,
+         * but relative to that directory, instead of walking all components of the path for every single
+         * device. Everything we can't trivially resolve that way takes the generic path. */
+
+        if (de->d_type == DT_LNK) {
+                _cleanup_free_ char *target = NULL;
+
+                r = readlinkat_malloc(dir_fd, de->d_name, &target);
+                if (r < 0)
+                        return r == -ENOENT ? -ENODEV : r;
+
+                r = sysfs_resolve_link(path, target, &syspath);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0 || !path_startswith(syspath, "/sys/"))
+                        goto fallback;
+
+        } else if (de->d_type == DT_DIR) {
+                syspath = strjoin(path, "/", de->d_name);
+                if (!syspath)
+                        return -ENOMEM;
+        } else
+                goto fallback;
+
+        if (path_startswith(syspath, "/sys/devices/")) {
+                /* all 'devices' require an 'uevent' file */
+                if (faccessat(dir_fd, strjoina(de->d_name, "/uevent"), F_OK, 0) < 0)
+                        return errno == ENOENT ? -ENODEV : -errno;
+        } else {
+                /* everything else just needs to be a directory */
+                struct stat st;
+
+                if (fstatat(dir_fd, de->d_name, &st, 0) < 0)
+                        return errno == ENOENT ? -ENODEV : -errno;
+                if (!S_ISDIR(st.st_mode))
+                        return -ENODEV;
+        }
+
+        r = device_new_aux(&device);
+        if (r < 0)
+                return r;
+
+        r = device_set_syspath(device, syspath, false);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(device);
+
+        return 0;
+
+fallback:
+        return sd_device_new_from_syspath(ret, strjoina(path, "/", de->d_name));
+}
+
+static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, int parent_fd, const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
-        char *path;
+        const char *path, *relpath;
         struct dirent *dent;
-        int r = 0;
+        int fd, r = 0;
 
         assert(enumerator);
         assert(basedir);
 
-        path = strjoina("/sys/", basedir, "/");
+        /* If we are passed the fd of /sys/<basedir>, open the subdirectory relative to it */
+        path = strjoina("/sys/", basedir);
+        relpath = NULL;
 
-        if (subdir1)
-                path = strjoina(path, subdir1, "/");
+        if (subdir1) {
+                path = strjoina(path, "/", subdir1);
+                relpath = subdir1;
+        }
 
-        if (subdir2)
-                path = strjoina(path, subdir2, "/");
+        if (subdir2) {
+                path = strjoina(path, "/", subdir2);
+                relpath = relpath ? strjoina(relpath, "/", subdir2) : subdir2;
+        }
 
-        dir = opendir(path);
-        if (!dir)
+        if (parent_fd >= 0 && relpath)
+                fd = openat(parent_fd, relpath, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        else
+                fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0)
                 return -errno;
 
+        dir = fdopendir(fd);
+        if (!dir) {
+                safe_close(fd);
+                return -errno;
+        }
+
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
                 _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
                 dev_t devnum;
                 int ifindex, initialized, k;
 
@@ -473,9 +615,7 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 if (!match_sysname(enumerator, dent->d_name))
                         continue;
 
-                (void) sprintf(syspath, "%s%s", path, dent->d_name);
-
-                k = sd_device_new_from_syspath(&device, syspath);
+                k = device_new_from_dirent(dirfd(dir), path, dent, &device);
                 if (k < 0) {
                         if (k != -ENODEV)
                                 /* this is necessarily racey, so ignore missing devices */
@@ -484,23 +624,12 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                         continue;
                 }
 
-                k = sd_device_get_devnum(device, &devnum);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
+                device_set_db_store(device, enumerator->db_store);
 
-                k = sd_device_get_ifindex(device, &ifindex);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                k = sd_device_get_is_initialized(device, &initialized);
-                if (k < 0) {
-                        r = k;
+                /* Matches that only need the devpath first, so that everything else is only read from sysfs and
+                 * the db for devices that may actually end up enumerated */
+                if (!match_parent(enumerator, device))
                         continue;
-                }
 
                 /*
                  * All devices with a device node or network interfaces
@@ -512,13 +641,28 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                  * might not store a database, and have no way to find out
                  * for all other types of devices.
                  */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (major(devnum) > 0 || ifindex > 0))
-                        continue;
+                if (!enumerator->match_allow_uninitialized) {
+                        k = sd_device_get_devnum(device, &devnum);
+                        if (k < 0) {
+                                r = k;
+                                continue;
+                        }
 
-                if (!match_parent(enumerator, device))
-                        continue;
+                        k = sd_device_get_ifindex(device, &ifindex);
+                        if (k < 0) {
+                                r = k;
+                                continue;
+                        }
+
+                        k = sd_device_get_is_initialized(device, &initialized);
+                        if (k < 0) {
+                                r = k;
+                                continue;
+                        }
+
+                        if (!initialized && (major(devnum) > 0 || ifindex > 0))
+                                continue;
+                }
 
                 if (!match_tag(enumerator, device))
                         continue;
@@ -583,7 +727,7 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
                 if (!match_subsystem(enumerator, subsystem ? : dent->d_name))
                         continue;
 
-                k = enumerator_scan_dir_and_add_devices(enumerator, basedir, dent->d_name, subdir);
+                k = enumerator_scan_dir_and_add_devices(enumerator, dirfd(dir), basedir, dent->d_name, subdir);
                 if (k < 0)
                         r = k;
         }
@@ -629,6 +773,8 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
                         continue;
                 }
 
+                device_set_db_store(device, enumerator->db_store);
+
                 k = sd_device_get_subsystem(device, &subsystem);
                 if (k < 0) {
                         r = k;
@@ -696,6 +842,8 @@ static int parent_add_child(sd_device_enumerator *enumerator, const char *path)
         else if (r < 0)
                 return r;
 
+        device_set_db_store(device, enumerator->db_store);
+
         r = sd_device_get_subsystem(device, &subsystem);
         if (r == -ENOENT)
                 return 0;
@@ -780,6 +928,19 @@ static int enumerator_scan_devices_children(sd_device_enumerator *enumerator) {
         return r;
 }
 
+static void enumerator_open_db_store(sd_device_enumerator *enumerator) {
+        int r;
+
+        assert(enumerator);
+
+        /* Take a fresh snapshot of the db for every scan, if udevd provides an up-to-date one */
+        enumerator->db_store = device_db_store_unref(enumerator->db_store);
+
+        r = device_db_store_open(&enumerator->db_store);
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "device-enumerator: not using %s, reading db files: %m", DEVICE_DB_STORE);
+}
+
 static int enumerator_scan_devices_all(sd_device_enumerator *enumerator) {
         int r = 0;
 
@@ -822,6 +983,8 @@ int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
         while ((device = prioq_pop(enumerator->devices)))
                 sd_device_unref(device);
 
+        enumerator_open_db_store(enumerator);
+
         if (!set_isempty(enumerator->match_tag)) {
                 k = enumerator_scan_devices_tags(enumerator);
                 if (k < 0)
@@ -881,9 +1044,11 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
         while ((device = prioq_pop(enumerator->devices)))
                 sd_device_unref(device);
 
+        enumerator_open_db_store(enumerator);
+
         /* modules */
         if (match_subsystem(enumerator, "module")) {
-                k = enumerator_scan_dir_and_add_devices(enumerator, "module", NULL, NULL);
+                k = enumerator_scan_dir_and_add_devices(enumerator, -1, "module", NULL, NULL);
                 if (k < 0) {
                         log_debug_errno(k, "device-enumerator: failed to scan modules: %m");
                         r = k;
@@ -897,7 +1062,7 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
 
         /* subsystems (only buses support coldplug) */
         if (match_subsystem(enumerator, "subsystem")) {
-                k = enumerator_scan_dir_and_add_devices(enumerator, subsysdir, NULL, NULL);
+                k = enumerator_scan_dir_and_add_devices(enumerator, -1, subsysdir, NULL, NULL);
                 if (k < 0) {
                         log_debug_errno(k, "device-enumerator: failed to scan subsystems: %m");
                         r = k;
@@ -3,6 +3,7 @@
 
 #include "sd-device.h"
 
+#include "device-db-store.h"
 #include "hashmap.h"
 #include "set.h"
 
@@ -75,6 +76,7 @@ struct sd_device {
 
         bool uevent_loaded; /* don't reread uevent */
         bool db_loaded; /* don't reread db */
+        DeviceDBStore *db_store; /* snapshot of the db to read from instead of the db file */
 
         bool sealed; /* don't read more information from uevent/db */
         bool db_persist; /* don't clean up the db when switching from initrd to real root */
@@ -56,6 +56,7 @@ static sd_device *device_free(sd_device *device) {
         free(device->driver_subsystem);
         free(device->driver);
         free(device->id_filename);
+        device_db_store_unref(device->db_store);
         free(device->properties_strv);
         free(device->properties_nulstr);
 
@@ -1298,14 +1299,29 @@ int device_read_db_aux(sd_device *device, bool force) {
         if (r < 0)
                 return r;
 
-        path = strjoina("/run/udev/data/", id);
+        if (device->db_store && !force) {
+                const char *data;
 
-        r = read_full_file(path, &db, &db_len);
-        if (r < 0) {
+                r = device_db_store_lookup(device->db_store, id, &data, &db_len);
                 if (r == -ENOENT)
                         return 0;
-                else
-                        return log_debug_errno(r, "sd-device: failed to read db '%s': %m", path);
+                if (r < 0)
+                        return r;
+
+                /* the parser below modifies the buffer, hence copy the entry out of the read-only map */
+                db = memdup_suffix0(data, db_len);
+                if (!db)
+                        return -ENOMEM;
+        } else {
+                path = strjoina("/run/udev/data/", id);
+
+                r = read_full_file(path, &db, &db_len);
+                if (r < 0) {
+                        if (r == -ENOENT)
+                                return 0;
+                        else
+                                return log_debug_errno(r, "sd-device: failed to read db '%s': %m", path);
+                }
         }
 
         /* devices with a database entry are initialized */
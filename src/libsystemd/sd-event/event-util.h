@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdio.h>
+
+#include "sd-event.h"
+
+void event_dump_statistics(sd_event *e, FILE *f, const char *prefix);
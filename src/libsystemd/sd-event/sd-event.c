@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
@@ -9,14 +11,17 @@
 #include "sd-id128.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "macro.h"
+#include "mempool.h"
 #include "missing.h"
 #include "prioq.h"
 #include "process-util.h"
+#include "ratelimit.h"
 #include "set.h"
 #include "signal-util.h"
 #include "string-table.h"
@@ -26,6 +31,9 @@
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+#define OFFLOAD_THREADS_DEFAULT 4U
+#define OFFLOAD_THREADS_MAX 64U
+
 typedef enum EventSourceType {
         SOURCE_IO,
         SOURCE_TIME_REALTIME,
@@ -94,15 +102,40 @@ struct sd_event_source {
         bool pending:1;
         bool dispatching:1;
         bool floating:1;
+        bool offload:1;
+        bool offloaded:1;
+        bool ratelimited:1;
 
         int64_t priority;
         unsigned pending_index;
         unsigned prepare_index;
+        unsigned ratelimit_index;
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
 
         sd_event_destroy_t destroy_callback;
 
+        /* Accounting of the time spent in the handler, and waiting for it to be dispatched */
+        sd_event_source_statistics statistics;
+        usec_t pending_since;
+
+        /* At most rate_limit.burst dispatches per rate_limit.interval. While the limit is hit, the source
+         * is turned off, and ratelimit_enabled is what it shall be set to again once the interval is over */
+        RateLimit rate_limit;
+        signed int ratelimit_enabled;
+
+        /* The completion callback of sources with offloading turned on, and the parameters and result of
+         * the handler while it runs on a worker thread */
+        sd_event_handler_t offload_callback;
+        int offload_fd;
+        uint32_t offload_revents;
+        int offload_result;
+        LIST_FIELDS(sd_event_source, offload);
+
+        LIST_FIELDS(sd_event_source, io_update);
+
+        LIST_FIELDS(sd_event_source, wheel);
+
         LIST_FIELDS(sd_event_source, sources);
 
         union {
@@ -111,14 +144,18 @@ struct sd_event_source {
                         int fd;
                         uint32_t events;
                         uint32_t revents;
+                        uint32_t registered_events;
                         bool registered:1;
                         bool owned:1;
+                        bool update_queued:1;
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
                         unsigned earliest_index;
                         unsigned latest_index;
+                        uint8_t wheel_level, wheel_slot;
+                        bool in_wheel:1;
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -165,9 +202,43 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+        /* If the timer wheel is turned on, time sources with a sufficiently large accuracy are kept in
+         * it instead of the two prioqs */
+        struct timer_wheel *wheel;
+
         bool needs_rearm:1;
 };
 
+/* A hierarchical timer wheel, used for the time sources of clocks that never jump backwards if turned on
+ * with sd_event_set_timer_wheel(). Adding, removing and rescheduling a source are O(1), as opposed to
+ * O(log n) for the prioqs.
+ *
+ * Time is counted in ticks of ~1ms. Sources are put into the slot of the tick their accuracy window ends
+ * in, and all sources of a slot are dispatched together once that tick begins. Since only sources whose
+ * accuracy is at least one tick are put into the wheel, that's always within their accuracy window,
+ * and sources with nearby deadlines are coalesced for free. Each level has 64 slots, and each slot of a
+ * level covers all 64 slots of the level below, so that 9 levels cover the whole usec_t range. Sources
+ * are moved to the lower levels as their tick comes closer. */
+#define WHEEL_TICK_SHIFT 10
+#define WHEEL_TICK_USEC (UINT64_C(1) << WHEEL_TICK_SHIFT)
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1U << WHEEL_SLOT_BITS)
+#define WHEEL_LEVELS 9
+
+struct timer_wheel {
+        /* The current tick. All sources in the wheel are due at it or later. */
+        uint64_t tick;
+
+        /* Which slots are non-empty, per level */
+        uint64_t bitmap[WHEEL_LEVELS];
+        LIST_HEAD(sd_event_source, slots[WHEEL_LEVELS][WHEEL_SLOTS]);
+
+        /* For the lowest level, the latest time any source in a slot became ready to be dispatched at (an
+         * upper bound, as it's not updated when sources are removed). Any time between this and the start
+         * of the slot's tick is good for dispatching all of them. */
+        usec_t max_next[WHEEL_SLOTS];
+};
+
 struct signal_data {
         WakeupType wakeup;
 
@@ -271,12 +342,23 @@ struct sd_event {
 
         Hashmap *inotify_data; /* indexed by priority */
 
+        /* Sources that hit their rate limit, ordered by when the limit ends, and the internal timer that
+         * turns them on again */
+        Prioq *ratelimited;
+        sd_event_source *ratelimit_timer;
+
         /* A list of inode structures that still have an fd open, that we need to close before the next loop iteration */
         LIST_HEAD(struct inode_data, inode_data_to_close);
 
         /* A list of inotify objects that already have events buffered which aren't processed yet */
         LIST_HEAD(struct inotify_data, inotify_data_buffered);
 
+        /* A list of I/O sources whose epoll registration needs to be added or modified before we go to sleep
+         * the next time. Sources are often enabled or have their events changed several times per
+         * iteration, hence this is done lazily, so that we only need one epoll_ctl() per source and
+         * iteration at most. */
+        LIST_HEAD(sd_event_source, io_update_queue);
+
         pid_t original_pid;
 
         uint64_t iteration;
@@ -287,6 +369,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool timer_wheel:1;
 
         int exit_code;
 
@@ -299,13 +382,33 @@ struct sd_event {
 
         LIST_HEAD(sd_event_source, sources);
 
+        /* Worker threads running the handlers of sources with offloading turned on. The queue and the list
+         * of completed sources are shared with the workers, and protected by the mutex. The workers
+         * signal completions through the eventfd. */
+        pthread_mutex_t offload_mutex;
+        pthread_cond_t offload_cond;
+        pthread_t *offload_threads;
+        unsigned n_offload_threads, n_offload_threads_max;
+        int offload_fd;
+        bool offload_stop;
+        LIST_HEAD(sd_event_source, offload_queue);
+        LIST_HEAD(sd_event_source, offload_done);
+
         usec_t last_run, last_log;
         unsigned delays[sizeof(usec_t) * 8];
+
+        /* How long dispatching took, per iteration, by the log2 of the time in µs */
+        uint64_t latency_histogram[sizeof(usec_t) * 8];
 };
 
 static thread_local sd_event *default_event = NULL;
 
+/* Event sources are allocated and freed all the time by some programs, e.g. for every incoming connection or
+ * for each timer that is rescheduled, hence take them from a pool. */
+DEFINE_THREADED_MEMPOOL(event_source_pool, sd_event_source, 64);
+
 static void source_disconnect(sd_event_source *s);
+static bool event_pid_changed(sd_event *e);
 static void event_gc_inode_data(sd_event *e, struct inode_data *d);
 
 static sd_event *event_resolve(sd_event *e) {
@@ -426,6 +529,28 @@ static int latest_time_prioq_compare(const void *a, const void *b) {
         return 0;
 }
 
+static usec_t ratelimit_end(const sd_event_source *s) {
+        return usec_add(s->rate_limit.begin, s->rate_limit.interval);
+}
+
+static int ratelimit_prioq_compare(const void *a, const void *b) {
+        const sd_event_source *x = a, *y = b;
+        usec_t p, q;
+
+        assert(x->ratelimited);
+        assert(y->ratelimited);
+
+        /* The ones whose limit ends first, first */
+        p = ratelimit_end(x);
+        q = ratelimit_end(y);
+        if (p < q)
+                return -1;
+        if (p > q)
+                return 1;
+
+        return 0;
+}
+
 static int exit_prioq_compare(const void *a, const void *b) {
         const sd_event_source *x = a, *y = b;
 
@@ -454,6 +579,40 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+        free(d->wheel);
+}
+
+static void event_stop_offload(sd_event *e) {
+        sd_event_source *s;
+        unsigned i;
+
+        assert(e);
+
+        /* The worker threads do not exist anymore in a forked off child */
+        if (e->n_offload_threads > 0 && !event_pid_changed(e)) {
+                assert_se(pthread_mutex_lock(&e->offload_mutex) == 0);
+                e->offload_stop = true;
+                assert_se(pthread_cond_broadcast(&e->offload_cond) == 0);
+                assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+
+                for (i = 0; i < e->n_offload_threads; i++)
+                        (void) pthread_join(e->offload_threads[i], NULL);
+        }
+
+        e->offload_threads = mfree(e->offload_threads);
+        e->n_offload_threads = 0;
+
+        while ((s = e->offload_queue)) {
+                LIST_REMOVE(offload, e->offload_queue, s);
+                s->offloaded = false;
+                sd_event_source_unref(s);
+        }
+
+        while ((s = e->offload_done)) {
+                LIST_REMOVE(offload, e->offload_done, s);
+                s->offloaded = false;
+                sd_event_source_unref(s);
+        }
 }
 
 static sd_event *event_free(sd_event *e) {
@@ -461,6 +620,8 @@ static sd_event *event_free(sd_event *e) {
 
         assert(e);
 
+        event_stop_offload(e);
+
         while ((s = e->sources)) {
                 assert(s->floating);
                 source_disconnect(s);
@@ -484,6 +645,7 @@ static sd_event *event_free(sd_event *e) {
         prioq_free(e->pending);
         prioq_free(e->prepare);
         prioq_free(e->exit);
+        prioq_free(e->ratelimited);
 
         free(e->signal_sources);
         hashmap_free(e->signal_data);
@@ -493,6 +655,9 @@ static sd_event *event_free(sd_event *e) {
         hashmap_free(e->child_sources);
         set_free(e->post_sources);
 
+        assert_se(pthread_cond_destroy(&e->offload_cond) == 0);
+        assert_se(pthread_mutex_destroy(&e->offload_mutex) == 0);
+
         return mfree(e);
 }
 
@@ -527,8 +692,12 @@ _public_ int sd_event_new(sd_event** ret) {
                 .boottime_alarm.next = USEC_INFINITY,
                 .perturb = USEC_INFINITY,
                 .original_pid = getpid_cached(),
+                .offload_fd = -1,
         };
 
+        assert_se(pthread_mutex_init(&e->offload_mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&e->offload_cond, NULL) == 0);
+
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
         if (r < 0)
                 goto fail;
@@ -565,12 +734,37 @@ static bool event_pid_changed(sd_event *e) {
         return e->original_pid != getpid_cached();
 }
 
+static void source_io_dequeue_update(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (!s->io.update_queued)
+                return;
+
+        LIST_REMOVE(io_update, s->event->io_update_queue, s);
+        s->io.update_queued = false;
+}
+
+static void source_io_queue_update(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (s->io.update_queued)
+                return;
+
+        LIST_PREPEND(io_update, s->event->io_update_queue, s);
+        s->io.update_queued = true;
+}
+
 static void source_io_unregister(sd_event_source *s) {
         int r;
 
         assert(s);
         assert(s->type == SOURCE_IO);
 
+        /* Removals are never delayed, since the fd might be closed right after this */
+        source_io_dequeue_update(s);
+
         if (event_pid_changed(s->event))
                 return;
 
@@ -597,11 +791,21 @@ static int source_io_register(
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
 
+        /* While the handler runs on a worker thread the fd stays out of epoll, it is added back once the
+         * handler completed. */
+        if (s->offloaded)
+                return 0;
+
         ev = (struct epoll_event) {
                 .events = events | (enabled == SD_EVENT_ONESHOT ? EPOLLONESHOT : 0),
                 .data.ptr = s,
         };
 
+        /* Nothing changed? Then there's no need to tell the kernel. Edge-triggered updates are never
+         * skipped, so that edges can be reset. */
+        if (s->io.registered && s->io.registered_events == ev.events && !(events & EPOLLET))
+                return 0;
+
         if (s->io.registered)
                 r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev);
         else
@@ -610,10 +814,33 @@ static int source_io_register(
                 return -errno;
 
         s->io.registered = true;
+        s->io.registered_events = ev.events;
 
         return 0;
 }
 
+static void event_flush_io_updates(sd_event *e) {
+        sd_event_source *s;
+        int r;
+
+        assert(e);
+
+        while ((s = e->io_update_queue)) {
+                source_io_dequeue_update(s);
+
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                r = source_io_register(s, s->enabled, s->io.events);
+                if (r < 0) {
+                        /* The caller that changed the source isn't around anymore to be told, hence be loud */
+                        log_warning_errno(r, "Failed to update source %s (type %s) in epoll, disabling: %m",
+                                          strna(s->description), event_source_type_to_string(s->type));
+                        (void) sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+        }
+}
+
 static clockid_t event_source_type_to_clock(EventSourceType t) {
 
         switch (t) {
@@ -687,6 +914,190 @@ static struct clock_data* event_get_clock_data(sd_event *e, EventSourceType t) {
         }
 }
 
+static bool clock_supports_wheel(EventSourceType t) {
+        /* The wheel can't deal with clocks going backwards */
+        return IN_SET(t, SOURCE_TIME_MONOTONIC, SOURCE_TIME_BOOTTIME, SOURCE_TIME_BOOTTIME_ALARM);
+}
+
+static uint64_t time_event_source_tick(const sd_event_source *s) {
+        return time_event_source_latest(s) >> WHEEL_TICK_SHIFT;
+}
+
+static void wheel_link(struct timer_wheel *w, sd_event_source *s) {
+        unsigned level, slot;
+        uint64_t t;
+
+        assert(w);
+        assert(s);
+        assert(!s->time.in_wheel);
+
+        /* Sources whose tick has passed already are dispatched with the current one */
+        t = MAX(time_event_source_tick(s), w->tick);
+
+        /* The level is determined by the highest slot bits the tick differs from the current tick in */
+        if ((t >> WHEEL_SLOT_BITS) == (w->tick >> WHEEL_SLOT_BITS))
+                level = 0;
+        else
+                level = u64log2(t ^ w->tick) / WHEEL_SLOT_BITS;
+
+        assert(level < WHEEL_LEVELS);
+        slot = (t >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+
+        LIST_PREPEND(wheel, w->slots[level][slot], s);
+        w->bitmap[level] |= UINT64_C(1) << slot;
+
+        if (level == 0)
+                w->max_next[slot] = MAX(w->max_next[slot], s->time.next);
+
+        s->time.wheel_level = level;
+        s->time.wheel_slot = slot;
+        s->time.in_wheel = true;
+}
+
+static void wheel_unlink(struct timer_wheel *w, sd_event_source *s) {
+        unsigned level, slot;
+
+        assert(w);
+        assert(s);
+
+        if (!s->time.in_wheel)
+                return;
+
+        level = s->time.wheel_level;
+        slot = s->time.wheel_slot;
+
+        LIST_REMOVE(wheel, w->slots[level][slot], s);
+        if (!w->slots[level][slot]) {
+                w->bitmap[level] &= ~(UINT64_C(1) << slot);
+
+                if (level == 0)
+                        w->max_next[slot] = 0;
+        }
+
+        s->time.in_wheel = false;
+}
+
+static uint64_t wheel_next_cascade(struct timer_wheel *w, unsigned *ret_level) {
+        unsigned level;
+
+        assert(w);
+        assert(ret_level);
+
+        /* Returns the tick at which the first non-empty slot above the lowest level begins */
+
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+                unsigned shift = level * WHEEL_SLOT_BITS;
+
+                if (w->bitmap[level] == 0)
+                        continue;
+
+                *ret_level = level;
+                return ((w->tick >> (shift + WHEEL_SLOT_BITS)) << (shift + WHEEL_SLOT_BITS)) |
+                        ((uint64_t) __builtin_ctzll(w->bitmap[level]) << shift);
+        }
+
+        return UINT64_MAX;
+}
+
+static void wheel_window(struct timer_wheel *w, usec_t *a, usec_t *b) {
+        unsigned level;
+        uint64_t t;
+
+        assert(w);
+        assert(a);
+        assert(b);
+
+        if (w->bitmap[0] != 0) {
+                unsigned slot = __builtin_ctzll(w->bitmap[0]);
+
+                t = (w->tick & ~(uint64_t) (WHEEL_SLOTS - 1)) | slot;
+                *b = t << WHEEL_TICK_SHIFT;
+                *a = MIN(w->max_next[slot], *b);
+                return;
+        }
+
+        /* Nothing on the lowest level, wake up when the next slot needs to be moved down */
+        t = wheel_next_cascade(w, &level);
+        if (t == UINT64_MAX)
+                *a = *b = USEC_INFINITY;
+        else
+                *a = *b = t << WHEEL_TICK_SHIFT;
+}
+
+static int source_time_update(sd_event_source *s) {
+        struct clock_data *d;
+        int r;
+
+        assert(s);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+
+        /* Needs to be called whenever the time, accuracy, enabled or pending state of a time source
+         * changed, so that it is put in the right position in the prioqs or the wheel. */
+
+        d = event_get_clock_data(s->event, s->type);
+        assert(d);
+
+        d->needs_rearm = true;
+
+        if (d->wheel && s->time.accuracy >= WHEEL_TICK_USEC) {
+                if (s->time.earliest_index != PRIOQ_IDX_NULL) {
+                        prioq_remove(d->earliest, s, &s->time.earliest_index);
+                        prioq_remove(d->latest, s, &s->time.latest_index);
+                        s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+                }
+
+                /* Only sources that may still be dispatched are kept in the wheel */
+                wheel_unlink(d->wheel, s);
+                if (s->enabled != SD_EVENT_OFF && !s->pending && s->time.next != USEC_INFINITY)
+                        wheel_link(d->wheel, s);
+
+                return 0;
+        }
+
+        if (d->wheel)
+                wheel_unlink(d->wheel, s);
+
+        if (s->time.earliest_index != PRIOQ_IDX_NULL) {
+                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
+                prioq_reshuffle(d->latest, s, &s->time.latest_index);
+                return 0;
+        }
+
+        r = prioq_put(d->earliest, s, &s->time.earliest_index);
+        if (r < 0)
+                return r;
+
+        r = prioq_put(d->latest, s, &s->time.latest_index);
+        if (r < 0) {
+                prioq_remove(d->earliest, s, &s->time.earliest_index);
+                s->time.earliest_index = PRIOQ_IDX_NULL;
+                return r;
+        }
+
+        return 0;
+}
+
+static void source_time_remove(sd_event_source *s) {
+        struct clock_data *d;
+
+        assert(s);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+
+        d = event_get_clock_data(s->event, s->type);
+        assert(d);
+
+        if (s->time.earliest_index != PRIOQ_IDX_NULL) {
+                prioq_remove(d->earliest, s, &s->time.earliest_index);
+                prioq_remove(d->latest, s, &s->time.latest_index);
+                s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+        }
+
+        if (d->wheel)
+                wheel_unlink(d->wheel, s);
+
+        d->needs_rearm = true;
+}
+
 static int event_make_signal_data(
                 sd_event *e,
                 int sig,
@@ -881,17 +1292,9 @@ static void source_disconnect(sd_event_source *s) {
         case SOURCE_TIME_BOOTTIME:
         case SOURCE_TIME_MONOTONIC:
         case SOURCE_TIME_REALTIME_ALARM:
-        case SOURCE_TIME_BOOTTIME_ALARM: {
-                struct clock_data *d;
-
-                d = event_get_clock_data(s->event, s->type);
-                assert(d);
-
-                prioq_remove(d->earliest, s, &s->time.earliest_index);
-                prioq_remove(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
+        case SOURCE_TIME_BOOTTIME_ALARM:
+                source_time_remove(s);
                 break;
-        }
 
         case SOURCE_SIGNAL:
                 if (s->signal.sig > 0) {
@@ -974,6 +1377,11 @@ static void source_disconnect(sd_event_source *s) {
         if (s->prepare)
                 prioq_remove(s->event->prepare, s, &s->prepare_index);
 
+        if (s->ratelimited) {
+                prioq_remove(s->event->ratelimited, s, &s->ratelimit_index);
+                s->ratelimited = false;
+        }
+
         event = s->event;
 
         s->type = _SOURCE_EVENT_SOURCE_TYPE_INVALID;
@@ -997,7 +1405,7 @@ static void source_free(sd_event_source *s) {
                 s->destroy_callback(s->userdata);
 
         free(s->description);
-        free(s);
+        threaded_mempool_free_tile(&event_source_pool, s);
 }
 
 static int source_set_pending(sd_event_source *s, bool b) {
@@ -1014,6 +1422,9 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                /* Count from when the loop woke up, if it ever did */
+                s->pending_since = s->event->timestamp.monotonic > 0 ? s->event->timestamp.monotonic : now(CLOCK_MONOTONIC);
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -1022,16 +1433,9 @@ static int source_set_pending(sd_event_source *s, bool b) {
         } else
                 assert_se(prioq_remove(s->event->pending, s, &s->pending_index));
 
-        if (EVENT_SOURCE_IS_TIME(s->type)) {
-                struct clock_data *d;
-
-                d = event_get_clock_data(s->event, s->type);
-                assert(d);
-
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
-        }
+        if (EVENT_SOURCE_IS_TIME(s->type))
+                /* This never moves the source between the prioqs and the wheel, hence can't fail */
+                (void) source_time_update(s);
 
         if (s->type == SOURCE_SIGNAL && !b) {
                 struct signal_data *d;
@@ -1062,7 +1466,7 @@ static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType t
 
         assert(e);
 
-        s = new(sd_event_source, 1);
+        s = threaded_mempool_alloc_tile(&event_source_pool);
         if (!s)
                 return NULL;
 
@@ -1073,6 +1477,7 @@ static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType t
                 .type = type,
                 .pending_index = PRIOQ_IDX_NULL,
                 .prepare_index = PRIOQ_IDX_NULL,
+                .ratelimit_index = PRIOQ_IDX_NULL,
         };
 
         if (!floating)
@@ -1227,6 +1632,14 @@ _public_ int sd_event_add_time(
         if (r < 0)
                 return r;
 
+        if (e->timer_wheel && clock_supports_wheel(type) && !d->wheel) {
+                d->wheel = new0(struct timer_wheel, 1);
+                if (!d->wheel)
+                        return -ENOMEM;
+
+                d->wheel->tick = now(clock) >> WHEEL_TICK_SHIFT;
+        }
+
         if (d->fd < 0) {
                 r = event_setup_timer_fd(e, d, clock);
                 if (r < 0)
@@ -1244,13 +1657,7 @@ _public_ int sd_event_add_time(
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
-        d->needs_rearm = true;
-
-        r = prioq_put(d->earliest, s, &s->time.earliest_index);
-        if (r < 0)
-                goto fail;
-
-        r = prioq_put(d->latest, s, &s->time.latest_index);
+        r = source_time_update(s);
         if (r < 0)
                 goto fail;
 
@@ -1980,14 +2387,18 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
         if (s->io.fd == fd)
                 return 0;
 
-        if (s->enabled == SD_EVENT_OFF) {
+        if (s->enabled == SD_EVENT_OFF || !s->io.registered) {
+                /* Not in epoll right now (because disabled, offloaded, or the update is still queued), the
+                 * new fd is added with the next update */
                 s->io.fd = fd;
                 s->io.registered = false;
+
+                if (s->enabled != SD_EVENT_OFF)
+                        source_io_queue_update(s);
         } else {
                 int saved_fd;
 
                 saved_fd = s->io.fd;
-                assert(s->io.registered);
 
                 s->io.fd = fd;
                 s->io.registered = false;
@@ -2047,14 +2458,11 @@ _public_ int sd_event_source_set_io_events(sd_event_source *s, uint32_t events)
         if (r < 0)
                 return r;
 
-        if (s->enabled != SD_EVENT_OFF) {
-                r = source_io_register(s, s->enabled, events);
-                if (r < 0)
-                        return r;
-        }
-
         s->io.events = events;
 
+        if (s->enabled != SD_EVENT_OFF)
+                source_io_queue_update(s);
+
         return 0;
 }
 
@@ -2196,21 +2604,16 @@ _public_ int sd_event_source_get_enabled(sd_event_source *s, int *m) {
         assert_return(m, -EINVAL);
         assert_return(!event_pid_changed(s->event), -ECHILD);
 
-        *m = s->enabled;
+        /* A rate limited source is turned off only temporarily, report what it will be set to again */
+        *m = s->ratelimited ? s->ratelimit_enabled : s->enabled;
         return 0;
 }
 
-_public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
+static int source_set_enabled(sd_event_source *s, int m) {
         int r;
 
-        assert_return(s, -EINVAL);
-        assert_return(IN_SET(m, SD_EVENT_OFF, SD_EVENT_ON, SD_EVENT_ONESHOT), -EINVAL);
-        assert_return(!event_pid_changed(s->event), -ECHILD);
-
-        /* If we are dead anyway, we are fine with turning off
-         * sources, but everything else needs to fail. */
-        if (s->event->state == SD_EVENT_FINISHED)
-                return m == SD_EVENT_OFF ? 0 : -ESTALE;
+        assert(s);
+        assert(IN_SET(m, SD_EVENT_OFF, SD_EVENT_ON, SD_EVENT_ONESHOT));
 
         if (s->enabled == m)
                 return 0;
@@ -2235,18 +2638,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        (void) source_time_update(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
                         s->enabled = m;
@@ -2290,29 +2685,18 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 switch (s->type) {
 
                 case SOURCE_IO:
-                        r = source_io_register(s, m, s->io.events);
-                        if (r < 0)
-                                return r;
-
                         s->enabled = m;
+                        source_io_queue_update(s);
                         break;
 
                 case SOURCE_TIME_REALTIME:
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        (void) source_time_update(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
 
@@ -2369,6 +2753,25 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
         return 0;
 }
 
+_public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
+        assert_return(s, -EINVAL);
+        assert_return(IN_SET(m, SD_EVENT_OFF, SD_EVENT_ON, SD_EVENT_ONESHOT), -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* If we are dead anyway, we are fine with turning off
+         * sources, but everything else needs to fail. */
+        if (s->event->state == SD_EVENT_FINISHED)
+                return m == SD_EVENT_OFF ? 0 : -ESTALE;
+
+        /* While the source is rate limited, only remember what to set it to once the limit is over */
+        if (s->ratelimited) {
+                s->ratelimit_enabled = m;
+                return 0;
+        }
+
+        return source_set_enabled(s, m);
+}
+
 _public_ int sd_event_source_get_time(sd_event_source *s, uint64_t *usec) {
         assert_return(s, -EINVAL);
         assert_return(usec, -EINVAL);
@@ -2380,7 +2783,6 @@ _public_ int sd_event_source_get_time(sd_event_source *s, uint64_t *usec) {
 }
 
 _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
-        struct clock_data *d;
         int r;
 
         assert_return(s, -EINVAL);
@@ -2394,12 +2796,7 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
 
         s->time.next = usec;
 
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
-
-        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        (void) source_time_update(s);
 
         return 0;
 }
@@ -2415,7 +2812,7 @@ _public_ int sd_event_source_get_time_accuracy(sd_event_source *s, uint64_t *use
 }
 
 _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec) {
-        struct clock_data *d;
+        usec_t saved;
         int r;
 
         assert_return(s, -EINVAL);
@@ -2431,13 +2828,16 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         if (usec == 0)
                 usec = DEFAULT_ACCURACY_USEC;
 
+        saved = s->time.accuracy;
         s->time.accuracy = usec;
 
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
-
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        /* This might move the source from the wheel to the prioqs, which can fail */
+        r = source_time_update(s);
+        if (r < 0) {
+                s->time.accuracy = saved;
+                (void) source_time_update(s);
+                return r;
+        }
 
         return 0;
 }
@@ -2607,7 +3007,7 @@ static int event_arm_timer(
 
         struct itimerspec its = {};
         sd_event_source *a, *b;
-        usec_t t;
+        usec_t t, x = USEC_INFINITY, y = USEC_INFINITY;
         int r;
 
         assert(e);
@@ -2619,9 +3019,25 @@ static int event_arm_timer(
                 d->needs_rearm = false;
 
         a = prioq_peek(d->earliest);
-        if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
+        if (a && a->enabled != SD_EVENT_OFF && a->time.next != USEC_INFINITY) {
+                b = prioq_peek(d->latest);
+                assert_se(b && b->enabled != SD_EVENT_OFF);
 
-                if (d->fd < 0)
+                x = a->time.next;
+                y = time_event_source_latest(b);
+        }
+
+        if (d->wheel) {
+                usec_t wa, wb;
+
+                wheel_window(d->wheel, &wa, &wb);
+                x = MIN(x, wa);
+                y = MIN(y, wb);
+        }
+
+        if (x == USEC_INFINITY) {
+
+                if (d->fd < 0)
                         return 0;
 
                 if (d->next == USEC_INFINITY)
@@ -2636,10 +3052,7 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert_se(b && b->enabled != SD_EVENT_OFF);
-
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
+        t = sleep_between(e, x, y);
         if (d->next == t)
                 return 0;
 
@@ -2705,6 +3118,98 @@ static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         return 0;
 }
 
+static int wheel_dispatch_slot(struct timer_wheel *w, unsigned level, unsigned slot) {
+        sd_event_source *s;
+        int r;
+
+        assert(w);
+
+        while ((s = w->slots[level][slot])) {
+                wheel_unlink(w, s);
+
+                r = source_set_pending(s, true);
+                if (r < 0) {
+                        wheel_link(w, s);
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+static int wheel_advance(struct timer_wheel *w, usec_t n) {
+        bool cascaded = false;
+        uint64_t tick, m;
+        int r;
+
+        assert(w);
+
+        tick = n >> WHEEL_TICK_SHIFT;
+        if (tick < w->tick)
+                goto finish;
+
+        for (;;) {
+                unsigned first, last, level, slot;
+                sd_event_source *s;
+                uint64_t t;
+                bool same;
+
+                /* Mark everything due on the lowest level as pending */
+                same = (w->tick >> WHEEL_SLOT_BITS) == (tick >> WHEEL_SLOT_BITS);
+                first = w->tick & (WHEEL_SLOTS - 1);
+                last = same ? (tick & (WHEEL_SLOTS - 1)) : WHEEL_SLOTS - 1;
+
+                m = w->bitmap[0] & ~((UINT64_C(1) << first) - 1);
+                if (last < WHEEL_SLOTS - 1)
+                        m &= (UINT64_C(2) << last) - 1;
+
+                for (; m != 0; m &= m - 1) {
+                        r = wheel_dispatch_slot(w, 0, __builtin_ctzll(m));
+                        if (r < 0)
+                                return r;
+                }
+
+                if (same)
+                        break;
+
+                /* The lowest level is empty now. Skip ahead to where the next slot of a higher level begins,
+                 * and move its sources down, unless that's still in the future. */
+                t = wheel_next_cascade(w, &level);
+                if (t > tick)
+                        break;
+
+                assert(t > w->tick);
+                w->tick = t;
+                cascaded = true;
+
+                /* Relative to the new tick all sources of this slot end up on lower levels */
+                slot = (t >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+                while ((s = w->slots[level][slot])) {
+                        wheel_unlink(w, s);
+                        wheel_link(w, s);
+                }
+        }
+
+        w->tick = tick;
+
+finish:
+        /* We might have been woken up before the tick of a slot begins, as requested by wheel_window(),
+         * if all of its sources are ready already */
+        for (m = w->bitmap[0]; m != 0; m &= m - 1) {
+                unsigned slot = __builtin_ctzll(m);
+
+                if (w->max_next[slot] > n)
+                        continue;
+
+                r = wheel_dispatch_slot(w, 0, slot);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Returns > 0 if sources were moved, and the timer needs to be rearmed */
+        return cascaded;
+}
+
 static int process_timer(
                 sd_event *e,
                 usec_t n,
@@ -2716,6 +3221,14 @@ static int process_timer(
         assert(e);
         assert(d);
 
+        if (d->wheel) {
+                r = wheel_advance(d->wheel, n);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        d->needs_rearm = true;
+        }
+
         for (;;) {
                 s = prioq_peek(d->earliest);
                 if (!s ||
@@ -2727,10 +3240,6 @@ static int process_timer(
                 r = source_set_pending(s, true);
                 if (r < 0)
                         return r;
-
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
         }
 
         return 0;
@@ -3016,8 +3525,344 @@ static int process_inotify(sd_event *e) {
         return done;
 }
 
+static void *offload_thread(void *p) {
+        sd_event *e = p;
+
+        assert(e);
+
+        for (;;) {
+                sd_event_source *s;
+                int r;
+
+                assert_se(pthread_mutex_lock(&e->offload_mutex) == 0);
+
+                while (!e->offload_stop && !e->offload_queue)
+                        assert_se(pthread_cond_wait(&e->offload_cond, &e->offload_mutex) == 0);
+
+                if (e->offload_stop) {
+                        assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+                        return NULL;
+                }
+
+                s = e->offload_queue;
+                LIST_REMOVE(offload, e->offload_queue, s);
+
+                assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+
+                r = s->io.callback(s, s->offload_fd, s->offload_revents, s->userdata);
+
+                assert_se(pthread_mutex_lock(&e->offload_mutex) == 0);
+                s->offload_result = r;
+                LIST_PREPEND(offload, e->offload_done, s);
+                assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+
+                (void) eventfd_write(e->offload_fd, 1);
+        }
+}
+
+static int offload_complete(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        sd_event *e = userdata;
+        sd_event_source *done, *s;
+        eventfd_t x;
+        int r;
+
+        assert(e);
+
+        (void) eventfd_read(fd, &x);
+
+        assert_se(pthread_mutex_lock(&e->offload_mutex) == 0);
+        done = TAKE_PTR(e->offload_done);
+        assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+
+        while ((s = done)) {
+                LIST_REMOVE(offload, done, s);
+                s->offloaded = false;
+
+                /* The source might have been disconnected in the meantime, in which case we only drop our
+                 * reference */
+                if (!s->event) {
+                        sd_event_source_unref(s);
+                        continue;
+                }
+
+                r = s->offload_result;
+
+                if (r >= 0 && s->offload_callback) {
+                        s->dispatching = true;
+                        r = s->offload_callback(s, s->userdata);
+                        s->dispatching = false;
+                }
+
+                if (r < 0)
+                        log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+
+                if (s->event) {
+                        if (r < 0)
+                                sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                        else if (s->enabled != SD_EVENT_OFF)
+                                /* Put the fd back into epoll, so that the source can be dispatched again */
+                                source_io_queue_update(s);
+                }
+
+                sd_event_source_unref(s);
+        }
+
+        return 0;
+}
+
+static int event_start_offload(sd_event *e) {
+        _cleanup_close_ int fd = -1;
+        sigset_t ss, saved_ss;
+        sd_event_source *s;
+        unsigned n, i;
+        int r;
+
+        assert(e);
+
+        if (e->n_offload_threads > 0)
+                return 0;
+
+        n = e->n_offload_threads_max > 0 ? e->n_offload_threads_max : OFFLOAD_THREADS_DEFAULT;
+
+        fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (fd < 0)
+                return -errno;
+
+        fd = fd_move_above_stdio(fd);
+
+        e->offload_threads = new(pthread_t, n);
+        if (!e->offload_threads)
+                return -ENOMEM;
+
+        /* Completions are processed by an internal, floating source, before anything else */
+        s = source_new(e, true, SOURCE_IO);
+        if (!s) {
+                e->offload_threads = mfree(e->offload_threads);
+                return -ENOMEM;
+        }
+
+        s->wakeup = WAKEUP_EVENT_SOURCE;
+        s->io.fd = fd;
+        s->io.events = EPOLLIN;
+        s->io.callback = offload_complete;
+        s->userdata = e;
+        s->enabled = SD_EVENT_ON;
+        s->priority = SD_EVENT_PRIORITY_IMPORTANT;
+
+        r = source_io_register(s, s->enabled, s->io.events);
+        if (r < 0) {
+                source_free(s);
+                e->offload_threads = mfree(e->offload_threads);
+                return r;
+        }
+
+        s->io.owned = true;
+        e->offload_fd = TAKE_FD(fd);
+
+        /* The workers should not receive any signals, the event loop thread takes care of them */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0);
+
+        for (i = 0; i < n; i++) {
+                r = pthread_create(e->offload_threads + i, NULL, offload_thread, e);
+                if (r != 0)
+                        break;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        /* If we got at least one thread, that's good enough */
+        if (i == 0) {
+                source_free(s);
+                e->offload_fd = -1;
+                e->offload_threads = mfree(e->offload_threads);
+                return -r;
+        }
+
+        e->n_offload_threads = i;
+        return 0;
+}
+
+static int source_offload(sd_event_source *s) {
+        sd_event *e;
+        sd_event_source *i, *last = NULL;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_IO);
+        assert(!s->offloaded);
+
+        e = s->event;
+
+        r = event_start_offload(e);
+        if (r < 0)
+                return r;
+
+        /* Take the fd out of epoll while the handler runs, so that the source is never dispatched twice at
+         * the same time, and events on it are processed in order. */
+        source_io_unregister(s);
+        s->offloaded = true;
+
+        s->offload_fd = s->io.fd;
+        s->offload_revents = s->io.revents;
+        sd_event_source_ref(s);
+
+        assert_se(pthread_mutex_lock(&e->offload_mutex) == 0);
+
+        /* Keep the queue ordered by priority, so that the workers pick up the most important handlers first */
+        LIST_FOREACH(offload, i, e->offload_queue) {
+                if (i->priority > s->priority)
+                        break;
+                last = i;
+        }
+
+        LIST_INSERT_AFTER(offload, e->offload_queue, last, s);
+
+        assert_se(pthread_cond_signal(&e->offload_cond) == 0);
+        assert_se(pthread_mutex_unlock(&e->offload_mutex) == 0);
+
+        return 0;
+}
+
+static void source_account_dispatch(sd_event *e, sd_event_source *s, usec_t start) {
+        usec_t end, d;
+
+        assert(e);
+        assert(s);
+
+        end = now(CLOCK_MONOTONIC);
+        d = usec_sub_unsigned(end, start);
+
+        s->statistics.n_dispatched++;
+        s->statistics.dispatch_usec += d;
+        s->statistics.dispatch_usec_max = MAX(s->statistics.dispatch_usec_max, d);
+
+        /* Defer sources stay pending, count from the end of this dispatch on */
+        if (s->pending)
+                s->pending_since = end;
+
+        /* The source might have been disconnected from the event loop by the handler already */
+        e->latency_histogram[u64log2(d)]++;
+}
+
+static int event_source_leave_ratelimited(sd_event_source *s) {
+        assert(s);
+        assert(s->ratelimited);
+
+        prioq_remove(s->event->ratelimited, s, &s->ratelimit_index);
+        s->ratelimited = false;
+
+        /* Start counting from scratch, the interval is over */
+        RATELIMIT_RESET(s->rate_limit);
+
+        return source_set_enabled(s, s->ratelimit_enabled);
+}
+
+static int event_arm_ratelimit_timer(sd_event *e);
+
+static int ratelimit_timer_dispatch(sd_event_source *t, uint64_t usec, void *userdata) {
+        sd_event *e = userdata;
+        sd_event_source *s;
+        usec_t n;
+        int r;
+
+        assert(e);
+
+        r = sd_event_now(e, CLOCK_MONOTONIC, &n);
+        if (r < 0)
+                return r;
+
+        while ((s = prioq_peek(e->ratelimited)) && ratelimit_end(s) <= n) {
+                r = event_source_leave_ratelimited(s);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to turn on rate limited event source %s (type %s) again, ignoring: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+        }
+
+        return event_arm_ratelimit_timer(e);
+}
+
+static int event_arm_ratelimit_timer(sd_event *e) {
+        sd_event_source *s;
+        int r;
+
+        assert(e);
+
+        s = prioq_peek(e->ratelimited);
+        if (!s)
+                return e->ratelimit_timer ? source_set_enabled(e->ratelimit_timer, SD_EVENT_OFF) : 0;
+
+        if (e->ratelimit_timer) {
+                r = sd_event_source_set_time(e->ratelimit_timer, ratelimit_end(s));
+                if (r < 0)
+                        return r;
+
+                return source_set_enabled(e->ratelimit_timer, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(e, &e->ratelimit_timer, CLOCK_MONOTONIC, ratelimit_end(s), 1, ratelimit_timer_dispatch, e);
+        if (r < 0)
+                return r;
+
+        /* The timer is internal, like the offload completion source: it shall not keep the event loop
+         * referenced, and it shall not be starved by the sources it is supposed to turn on again */
+        e->ratelimit_timer->floating = true;
+        e->ratelimit_timer->priority = SD_EVENT_PRIORITY_IMPORTANT;
+        (void) sd_event_source_set_description(e->ratelimit_timer, "ratelimit");
+        sd_event_unref(e);
+
+        return 0;
+}
+
+static int event_source_enter_ratelimited(sd_event_source *s) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        int enabled, r;
+
+        assert(s);
+        assert(!s->ratelimited);
+
+        r = prioq_ensure_allocated(&s->event->ratelimited, ratelimit_prioq_compare);
+        if (r < 0)
+                return r;
+
+        enabled = s->enabled;
+
+        r = source_set_enabled(s, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        s->ratelimited = true;
+        s->ratelimit_enabled = enabled;
+
+        r = prioq_put(s->event->ratelimited, s, &s->ratelimit_index);
+        if (r < 0)
+                goto fail;
+
+        r = event_arm_ratelimit_timer(s->event);
+        if (r < 0) {
+                prioq_remove(s->event->ratelimited, s, &s->ratelimit_index);
+                goto fail;
+        }
+
+        s->statistics.n_ratelimited++;
+
+        log_debug("Event source %s (type %s) was dispatched %u times within %s, turning it off for the rest of the interval.",
+                  strna(s->description), event_source_type_to_string(s->type),
+                  s->rate_limit.burst, format_timespan(buf, sizeof(buf), s->rate_limit.interval, 0));
+
+        return 0;
+
+fail:
+        s->ratelimited = false;
+        (void) source_set_enabled(s, enabled);
+        return r;
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
+        sd_event *e;
+        usec_t start;
         int r = 0;
 
         assert(s);
@@ -3026,11 +3871,32 @@ static int source_dispatch(sd_event_source *s) {
         /* Save the event source type, here, so that we still know it after the event callback which might invalidate
          * the event. */
         saved_type = s->type;
+        e = s->event;
+
+        /* If the source is dispatched more often than it may, turn it off for the rest of the interval, so
+         * that it can't starve the others */
+        if (!ratelimit_below(&s->rate_limit)) {
+                r = event_source_enter_ratelimited(s);
+                if (r < 0)
+                        return r;
+
+                return 1;
+        }
+
+        start = now(CLOCK_MONOTONIC);
+        if (s->pending)
+                s->statistics.pending_usec += usec_sub_unsigned(start, s->pending_since);
 
         if (!IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
                 r = source_set_pending(s, false);
                 if (r < 0)
                         return r;
+        } else if (s->type == SOURCE_DEFER) {
+                /* Defer sources stay pending, but queue them up behind the sources of the same priority that
+                 * became pending in the meantime. Otherwise a defer source that is on permanently would be
+                 * dispatched over and over again, and starve them. */
+                s->pending_iteration = e->iteration;
+                prioq_reshuffle(e->pending, s, &s->pending_index);
         }
 
         if (s->type != SOURCE_POST) {
@@ -3061,7 +3927,10 @@ static int source_dispatch(sd_event_source *s) {
         switch (s->type) {
 
         case SOURCE_IO:
-                r = s->io.callback(s, s->io.fd, s->io.revents, s->userdata);
+                if (s->offload)
+                        r = source_offload(s);
+                else
+                        r = s->io.callback(s, s->io.fd, s->io.revents, s->userdata);
                 break;
 
         case SOURCE_TIME_REALTIME:
@@ -3103,7 +3972,6 @@ static int source_dispatch(sd_event_source *s) {
                 break;
 
         case SOURCE_INOTIFY: {
-                struct sd_event *e = s->event;
                 struct inotify_data *d;
                 size_t sz;
 
@@ -3132,6 +4000,8 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        source_account_dispatch(e, s, start);
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -3319,6 +4189,9 @@ _public_ int sd_event_prepare(sd_event *e) {
 
         event_close_inode_data_fds(e);
 
+        /* Callers might poll the epoll fd themselves after this, hence bring it up-to-date now */
+        event_flush_io_updates(e);
+
         if (event_next_pending(e) || e->need_process_child)
                 goto pending;
 
@@ -3354,6 +4227,8 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         ev_queue_max = MAX(e->n_sources, 1u);
         ev_queue = newa(struct epoll_event, ev_queue_max);
 
+        event_flush_io_updates(e);
+
         /* If we still have inotify data buffered, then query the other fds, but don't wait on it */
         if (e->inotify_data_buffered)
                 timeout = 0;
@@ -3754,3 +4629,246 @@ _public_ int sd_event_source_get_destroy_callback(sd_event_source *s, sd_event_d
 
         return !!s->destroy_callback;
 }
+
+_public_ int sd_event_set_offload_threads(sd_event *e, unsigned n) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(n <= OFFLOAD_THREADS_MAX, -ERANGE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        /* The worker threads are started when the first offloaded handler is dispatched, after that the
+         * number can't be changed anymore */
+        if (e->n_offload_threads > 0)
+                return -EBUSY;
+
+        e->n_offload_threads_max = n;
+        return 0;
+}
+
+_public_ int sd_event_get_offload_threads(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (e->n_offload_threads > 0)
+                *ret = e->n_offload_threads;
+        else
+                *ret = e->n_offload_threads_max > 0 ? e->n_offload_threads_max : OFFLOAD_THREADS_DEFAULT;
+
+        return 0;
+}
+
+_public_ int sd_event_set_timer_wheel(sd_event *e, int b) {
+        sd_event_source *s;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (e->timer_wheel == !!b)
+                return 0;
+
+        /* Existing time sources are not moved between the prioqs and the wheels */
+        LIST_FOREACH(sources, s, e->sources)
+                if (EVENT_SOURCE_IS_TIME(s->type))
+                        return -EBUSY;
+
+        if (!b) {
+                e->boottime.wheel = mfree(e->boottime.wheel);
+                e->monotonic.wheel = mfree(e->monotonic.wheel);
+                e->boottime_alarm.wheel = mfree(e->boottime_alarm.wheel);
+        }
+
+        e->timer_wheel = b;
+        return 1;
+}
+
+_public_ int sd_event_get_timer_wheel(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->timer_wheel;
+}
+
+_public_ int sd_event_get_latency_histogram(sd_event *e, uint64_t *buckets, size_t n_buckets) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(buckets || n_buckets == 0, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        memcpy_safe(buckets, e->latency_histogram, MIN(n_buckets, ELEMENTSOF(e->latency_histogram)) * sizeof(uint64_t));
+
+        return (int) ELEMENTSOF(e->latency_histogram);
+}
+
+_public_ int sd_event_source_get_statistics(sd_event_source *s, sd_event_source_statistics *ret, size_t size) {
+        assert_return(s, -EINVAL);
+        assert_return(ret, -EINVAL);
+        /* Everything up to and including pending_usec was there from the beginning */
+        assert_return(size >= offsetof(sd_event_source_statistics, n_ratelimited), -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* Callers built against an older version of the structure get the fields they know about, those built
+         * against a newer version get the ones we don't know about zeroed */
+        memcpy(ret, &s->statistics, MIN(size, sizeof(s->statistics)));
+        if (size > sizeof(s->statistics))
+                memzero((uint8_t*) ret + sizeof(s->statistics), size - sizeof(s->statistics));
+
+        return 0;
+}
+
+static void event_source_dump_statistics(sd_event_source *s, FILE *f, const char *prefix) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+
+        assert(s);
+        assert(f);
+
+        fprintf(f, "%sEvent source %s (%s): dispatched %" PRIu64 " times, took %s (max %s), pending for %s, rate limited %" PRIu64 " times\n",
+                prefix,
+                strna(s->description),
+                event_source_type_to_string(s->type),
+                s->statistics.n_dispatched,
+                format_timespan(a, sizeof(a), s->statistics.dispatch_usec, 1),
+                format_timespan(b, sizeof(b), s->statistics.dispatch_usec_max, 1),
+                format_timespan(c, sizeof(c), s->statistics.pending_usec, 1),
+                s->statistics.n_ratelimited);
+}
+
+static int source_statistics_compare(const void *a, const void *b) {
+        const sd_event_source *x = *(const sd_event_source* const*) a, *y = *(const sd_event_source* const*) b;
+
+        /* The most expensive sources first */
+        if (x->statistics.dispatch_usec > y->statistics.dispatch_usec)
+                return -1;
+        if (x->statistics.dispatch_usec < y->statistics.dispatch_usec)
+                return 1;
+
+        return 0;
+}
+
+void event_dump_statistics(sd_event *e, FILE *f, const char *prefix) {
+        _cleanup_free_ sd_event_source **sources = NULL;
+        sd_event_source *s;
+        size_t n = 0, i;
+
+        assert(e);
+        assert(f);
+
+        prefix = strempty(prefix);
+
+        fprintf(f, "%sEvent loop iterations: %" PRIu64 "\n", prefix, e->iteration);
+
+        for (i = 0; i < ELEMENTSOF(e->latency_histogram); i++) {
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                if (e->latency_histogram[i] == 0)
+                        continue;
+
+                fprintf(f, "%sEvent loop dispatch latency < %s: %" PRIu64 "\n",
+                        prefix,
+                        format_timespan(buf, sizeof(buf), i + 1 < 64 ? UINT64_C(2) << i : USEC_INFINITY, 1),
+                        e->latency_histogram[i]);
+        }
+
+        /* Try to list the sources in order of their cost, but if we can't get the memory for that, just
+         * list them in the order they are in */
+        sources = new(sd_event_source*, e->n_sources);
+        LIST_FOREACH(sources, s, e->sources) {
+                if (s->statistics.n_dispatched == 0)
+                        continue;
+
+                if (!sources) {
+                        event_source_dump_statistics(s, f, prefix);
+                        continue;
+                }
+
+                sources[n++] = s;
+        }
+
+        qsort_safe(sources, n, sizeof(sd_event_source*), source_statistics_compare);
+
+        for (i = 0; i < n; i++)
+                event_source_dump_statistics(sources[i], f, prefix);
+}
+
+_public_ int sd_event_source_set_offload(sd_event_source *s, int b) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_IO, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* This only affects future dispatches, a handler already running on a worker thread completes as
+         * usual */
+        s->offload = b;
+        return 0;
+}
+
+_public_ int sd_event_source_get_offload(sd_event_source *s) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_IO, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        return s->offload;
+}
+
+_public_ int sd_event_source_set_offload_callback(sd_event_source *s, sd_event_handler_t callback) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_IO, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        s->offload_callback = callback;
+        return 0;
+}
+
+_public_ int sd_event_source_get_offload_callback(sd_event_source *s, sd_event_handler_t *ret) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_IO, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (ret)
+                *ret = s->offload_callback;
+
+        return !!s->offload_callback;
+}
+
+_public_ int sd_event_source_set_ratelimit(sd_event_source *s, uint64_t interval_usec, unsigned burst) {
+        int r;
+
+        assert_return(s, -EINVAL);
+        assert_return(IN_SET(s->type, SOURCE_IO, SOURCE_DEFER) || EVENT_SOURCE_IS_TIME(s->type), -EDOM);
+        assert_return(interval_usec != USEC_INFINITY, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* A limit the source currently hit doesn't apply anymore, turn it on again right away */
+        if (s->ratelimited) {
+                r = event_source_leave_ratelimited(s);
+                if (r < 0)
+                        return r;
+        }
+
+        RATELIMIT_INIT(s->rate_limit, interval_usec, burst);
+        return 0;
+}
+
+_public_ int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_interval_usec, unsigned *ret_burst) {
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (s->rate_limit.interval == 0 || s->rate_limit.burst == 0)
+                return -ENOEXEC;
+
+        if (ret_interval_usec)
+                *ret_interval_usec = s->rate_limit.interval;
+        if (ret_burst)
+                *ret_burst = s->rate_limit.burst;
+
+        return 0;
+}
+
+_public_ int sd_event_source_is_ratelimited(sd_event_source *s) {
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        return s->ratelimited;
+}
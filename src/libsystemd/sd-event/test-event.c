@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -12,6 +14,7 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "random-util.h"
 #include "rm-rf.h"
 #include "signal-util.h"
 #include "stdio-util.h"
@@ -480,6 +483,407 @@ static void test_inotify(unsigned n_create_events) {
         sd_event_unref(e);
 }
 
+static int io_update_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *n = userdata;
+        char x;
+
+        assert_se(revents == EPOLLIN);
+        assert_se(read(fd, &x, 1) == 1);
+        assert_se(x == 'b');
+
+        (*n)++;
+        return 1;
+}
+
+static void test_io_update(void) {
+        int a[2] = { -1, -1 }, b[2] = { -1, -1 };
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+        uint32_t events;
+        unsigned n = 0;
+        int m;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(a, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(b, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(write(a[1], "a", 1) == 1);
+        assert_se(write(b[1], "b", 1) == 1);
+
+        assert_se(sd_event_add_io(e, &s, a[0], EPOLLIN, io_update_handler, &n) >= 0);
+
+        /* Toggle the source around several times, only the final state counts once we go to sleep */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_io_events(s, EPOLLOUT) >= 0);
+        assert_se(sd_event_source_set_io_fd(s, b[0]) >= 0);
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        assert_se(sd_event_source_get_io_fd(s) == b[0]);
+        assert_se(sd_event_source_get_io_events(s, &events) >= 0);
+        assert_se(events == EPOLLIN);
+
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n == 1);
+        assert_se(sd_event_source_get_enabled(s, &m) >= 0);
+        assert_se(m == SD_EVENT_OFF);
+
+        /* Enabling and disabling again in the same iteration never makes it to epoll */
+        assert_se(write(b[1], "b", 1) == 1);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 1);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n == 2);
+
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+
+        safe_close_pair(a);
+        safe_close_pair(b);
+}
+
+#define N_OFFLOAD 64U
+
+struct offload_context {
+        pthread_t main_thread;
+        int fd;
+        unsigned n_read, n_completed;
+        unsigned *n_done;
+        int running;
+};
+
+static int offload_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        struct offload_context *c = userdata;
+        uint8_t x;
+
+        /* Runs on a worker thread, but never twice at the same time for the same source */
+        assert_se(!pthread_equal(pthread_self(), c->main_thread));
+        assert_se(__sync_add_and_fetch(&c->running, 1) == 1);
+
+        assert_se(fd == c->fd);
+        assert_se(revents & EPOLLIN);
+        assert_se(read(fd, &x, 1) == 1);
+
+        /* Bytes are processed in the order they were written */
+        assert_se(x == (uint8_t) c->n_read);
+        c->n_read++;
+
+        assert_se(__sync_sub_and_fetch(&c->running, 1) == 0);
+        return 1;
+}
+
+static int offload_completion(sd_event_source *s, void *userdata) {
+        struct offload_context *c = userdata;
+
+        assert_se(pthread_equal(pthread_self(), c->main_thread));
+        assert_se(c->n_read == ++c->n_completed);
+
+        if (c->n_completed == N_OFFLOAD && ++*c->n_done == 2)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 1;
+}
+
+static void test_offload(void) {
+        struct offload_context c[2] = {};
+        sd_event_source *s[2] = {};
+        int fds[2][2] = { { -1, -1 }, { -1, -1 } };
+        unsigned n_done = 0, n, i, j;
+        sd_event *e = NULL;
+        uint8_t x;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_set_offload_threads(e, 2) >= 0);
+        assert_se(sd_event_get_offload_threads(e, &n) >= 0);
+        assert_se(n == 2);
+
+        for (i = 0; i < 2; i++) {
+                assert_se(pipe2(fds[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+
+                c[i] = (struct offload_context) {
+                        .main_thread = pthread_self(),
+                        .fd = fds[i][0],
+                        .n_done = &n_done,
+                };
+
+                assert_se(sd_event_add_io(e, &s[i], fds[i][0], EPOLLIN, offload_handler, &c[i]) >= 0);
+                assert_se(sd_event_source_get_offload(s[i]) == 0);
+                assert_se(sd_event_source_set_offload(s[i], true) >= 0);
+                assert_se(sd_event_source_get_offload(s[i]) > 0);
+                assert_se(sd_event_source_set_offload_callback(s[i], offload_completion) >= 0);
+                assert_se(sd_event_source_get_offload_callback(s[i], NULL) > 0);
+
+                for (j = 0; j < N_OFFLOAD; j++) {
+                        x = (uint8_t) j;
+                        assert_se(write(fds[i][1], &x, 1) == 1);
+                }
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        /* Once started, the pool can't be resized */
+        assert_se(sd_event_set_offload_threads(e, 3) == -EBUSY);
+
+        for (i = 0; i < 2; i++) {
+                assert_se(c[i].n_read == N_OFFLOAD);
+                assert_se(c[i].n_completed == N_OFFLOAD);
+
+                sd_event_source_unref(s[i]);
+                safe_close_pair(fds[i]);
+        }
+
+        sd_event_unref(e);
+}
+
+static int statistics_handler(sd_event_source *s, void *userdata) {
+        unsigned *n = userdata;
+
+        /* Make sure this takes measurable time */
+        usleep(1000);
+
+        if (++*n == 3)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        return 0;
+}
+
+static void test_statistics(void) {
+        sd_event_source_statistics st;
+        uint64_t h[64], *hh, sum = 0;
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+        unsigned n = 0;
+        int i, k;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_add_defer(e, &s, statistics_handler, &n) >= 0);
+        assert_se(sd_event_source_set_description(s, "statistics") >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+
+        assert_se(sd_event_source_get_statistics(s, &st, sizeof(st)) >= 0);
+        assert_se(st.n_dispatched == 0);
+        assert_se(st.dispatch_usec == 0);
+
+        for (i = 0; i < 5; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 3);
+
+        assert_se(sd_event_source_get_statistics(s, &st, sizeof(st)) >= 0);
+        assert_se(st.n_dispatched == 3);
+        assert_se(st.dispatch_usec >= 3000);
+        assert_se(st.dispatch_usec_max >= 1000);
+        assert_se(st.dispatch_usec_max <= st.dispatch_usec);
+
+        k = sd_event_get_latency_histogram(e, NULL, 0);
+        assert_se(k == (int) ELEMENTSOF(h));
+        assert_se(sd_event_get_latency_histogram(e, h, ELEMENTSOF(h)) == k);
+        for (i = 0; i < k; i++)
+                sum += h[i];
+        assert_se(sum == 3);
+
+        /* Only the first buckets are copied if the array is short */
+        hh = new0(uint64_t, 2);
+        assert_se(hh);
+        assert_se(sd_event_get_latency_histogram(e, hh, 2) == k);
+        assert_se(hh[0] == h[0] && hh[1] == h[1]);
+        free(hh);
+
+        event_dump_statistics(e, stdout, "\t");
+
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+}
+
+static int ratelimit_handler(sd_event_source *s, void *userdata) {
+        unsigned *n = userdata;
+
+        ++*n;
+        return 0;
+}
+
+static void test_ratelimit(void) {
+        sd_event_source_statistics st;
+        sd_event_source *s = NULL, *t = NULL, *x = NULL;
+        sd_event *e = NULL;
+        unsigned n = 0, m = 0, burst;
+        uint64_t interval;
+        usec_t start;
+        int enabled, i;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Two sources of the same priority that are on permanently take turns */
+        assert_se(sd_event_add_defer(e, &s, ratelimit_handler, &n) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_add_defer(e, &t, ratelimit_handler, &m) >= 0);
+        assert_se(sd_event_source_set_enabled(t, SD_EVENT_ON) >= 0);
+
+        for (i = 0; i < 10; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 5);
+        assert_se(m == 5);
+
+        assert_se(sd_event_source_get_ratelimit(s, NULL, NULL) == -ENOEXEC);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_source_set_ratelimit(s, 100 * USEC_PER_MSEC, 3) >= 0);
+        assert_se(sd_event_source_get_ratelimit(s, &interval, &burst) >= 0);
+        assert_se(interval == 100 * USEC_PER_MSEC);
+        assert_se(burst == 3);
+
+        /* After three more dispatches the source is turned off, and the other one gets all the turns */
+        n = m = 0;
+        for (i = 0; i < 20; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 3);
+        assert_se(m == 16);
+
+        assert_se(sd_event_source_is_ratelimited(s) > 0);
+        assert_se(sd_event_source_is_ratelimited(t) == 0);
+        assert_se(sd_event_source_get_statistics(s, &st, sizeof(st)) >= 0);
+        assert_se(st.n_ratelimited == 1);
+
+        /* Callers that don't know about the rate limit yet don't get it */
+        st.n_ratelimited = 0;
+        assert_se(sd_event_source_get_statistics(s, &st, offsetof(sd_event_source_statistics, n_ratelimited)) >= 0);
+        assert_se(st.n_ratelimited == 0);
+        assert_se(st.n_dispatched > 0);
+        assert_se(sd_event_source_get_statistics(s, &st, sizeof(uint64_t)) == -EINVAL);
+
+        /* Changing the state of a rate limited source only takes effect once the limit is over */
+        assert_se(sd_event_source_get_enabled(s, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_ON);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_get_enabled(s, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_ONESHOT);
+        assert_se(sd_event_source_is_ratelimited(s) > 0);
+
+        assert_se(sd_event_source_set_enabled(t, SD_EVENT_OFF) >= 0);
+        while (sd_event_source_is_ratelimited(s) > 0)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+        assert_se(now(CLOCK_MONOTONIC) >= start + 100 * USEC_PER_MSEC);
+
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 4);
+        assert_se(sd_event_source_get_enabled(s, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_OFF);
+
+        assert_se(sd_event_source_set_ratelimit(s, USEC_PER_SEC, 1) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 5);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 5);
+        assert_se(sd_event_source_is_ratelimited(s) > 0);
+
+        /* Turning the limit off lifts it right away */
+        assert_se(sd_event_source_set_ratelimit(s, 0, 0) >= 0);
+        assert_se(sd_event_source_is_ratelimited(s) == 0);
+        assert_se(sd_event_source_get_ratelimit(s, NULL, NULL) == -ENOEXEC);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n == 6);
+
+        assert_se(sd_event_add_exit(e, &x, ratelimit_handler, &n) >= 0);
+        assert_se(sd_event_source_set_ratelimit(x, USEC_PER_SEC, 1) == -EDOM);
+
+        event_dump_statistics(e, stdout, "\t");
+
+        sd_event_source_unref(x);
+        sd_event_source_unref(t);
+        sd_event_source_unref(s);
+        sd_event_unref(e);
+}
+
+#define N_TIMERS 100000U
+#define N_TIMERS 100000U
+
+struct timer_context {
+        unsigned n_fired;
+        usec_t max_delay;
+};
+
+static int timer_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        struct timer_context *c = userdata;
+        uint64_t accuracy;
+        usec_t n;
+
+        /* Never before the requested time, and coalescing stays within the accuracy window */
+        assert_se(sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &n) >= 0);
+        assert_se(n >= usec);
+        assert_se(sd_event_source_get_time_accuracy(s, &accuracy) >= 0);
+        if (n > usec + accuracy)
+                c->max_delay = MAX(c->max_delay, n - usec - accuracy);
+
+        if (++c->n_fired == N_TIMERS)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+static void test_timer_wheel(bool wheel) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        struct timer_context c = {};
+        sd_event_source **s;
+        usec_t start, n;
+        sd_event *e = NULL;
+        unsigned i, j;
+
+        s = new0(sd_event_source*, N_TIMERS);
+        assert_se(s);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_get_timer_wheel(e) == 0);
+        assert_se(sd_event_set_timer_wheel(e, wheel) >= 0);
+        assert_se(sd_event_get_timer_wheel(e) == wheel);
+
+        /* Leave enough time for setting everything up first */
+        n = now(CLOCK_MONOTONIC);
+        start = n + 500 * USEC_PER_MSEC;
+
+        /* Mostly timers that are rescheduled all the time, and some precise ones that never end up in the
+         * wheel, mixed */
+        for (i = 0; i < N_TIMERS; i++)
+                assert_se(sd_event_add_time(e, &s[i], CLOCK_MONOTONIC,
+                                            start + random_u64() % (50 * USEC_PER_MSEC),
+                                            i % 16 == 0 ? 1 : 5 * USEC_PER_MSEC,
+                                            timer_handler, &c) >= 0);
+
+        assert_se(sd_event_set_timer_wheel(e, !wheel) == -EBUSY);
+
+        for (j = 0; j < 3; j++)
+                for (i = 0; i < N_TIMERS; i++)
+                        assert_se(sd_event_source_set_time(s[i], start + random_u64() % ((50 + 100 * j) * USEC_PER_MSEC)) >= 0);
+
+        log_info("%s: %u timers added and rescheduled 3 times in %s", wheel ? "wheel" : "prioq",
+                 N_TIMERS, format_timespan(a, sizeof(a), now(CLOCK_MONOTONIC) - n, 1));
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(c.n_fired == N_TIMERS);
+
+        log_info("%s: all timers dispatched %s after the first one was due, max delay beyond accuracy %s",
+                 wheel ? "wheel" : "prioq",
+                 format_timespan(a, sizeof(a), now(CLOCK_MONOTONIC) - start, 1),
+                 format_timespan(b, sizeof(b), c.max_delay, 1));
+
+        n = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_TIMERS; i++)
+                sd_event_source_unref(s[i]);
+        log_info("%s: %u timers removed in %s", wheel ? "wheel" : "prioq",
+                 N_TIMERS, format_timespan(a, sizeof(a), now(CLOCK_MONOTONIC) - n, 1));
+
+        assert_se(sd_event_set_timer_wheel(e, !wheel) > 0);
+
+        sd_event_unref(e);
+        free(s);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -488,6 +892,12 @@ int main(int argc, char *argv[]) {
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_io_update();
+        test_offload();
+        test_statistics();
+        test_ratelimit();
+        test_timer_wheel(false);
+        test_timer_wheel(true);
 
         test_inotify(100); /* should work without overflow */
         test_inotify(33000); /* should trigger a q overflow */
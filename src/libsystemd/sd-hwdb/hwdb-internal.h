@@ -26,6 +26,9 @@ struct trie_header_f {
         /* size of the nodes and string section */
         le64_t nodes_len;
         le64_t strings_len;
+
+        /* hash of the source files the database was compiled from, 0 if unknown */
+        le64_t sources_hash;
 } _packed_;
 
 struct trie_node_f {
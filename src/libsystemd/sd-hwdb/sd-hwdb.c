@@ -21,6 +21,15 @@
 #include "refcnt.h"
 #include "string-util.h"
 
+/* Lookups for the same modalias tend to come in bursts, e.g. for every CPU or for several identical devices on
+ * the same bus, hence remember the results of the most recent ones */
+#define PROPERTIES_CACHE_SIZE 16
+
+typedef struct PropertiesCacheEntry {
+        char *modalias;
+        OrderedHashmap *properties;
+} PropertiesCacheEntry;
+
 struct sd_hwdb {
         RefCount n_ref;
 
@@ -31,9 +40,14 @@ struct sd_hwdb {
                 const char *map;
         };
 
+        /* Points to the properties of cache[0], or is NULL */
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
+
+        /* Most recently used first */
+        PropertiesCacheEntry cache[PROPERTIES_CACHE_SIZE];
+        size_t n_cache;
 };
 
 struct linebuf {
@@ -193,6 +207,34 @@ static int hwdb_add_property(sd_hwdb *hwdb, const struct trie_value_entry_f *ent
         return 0;
 }
 
+static bool linebuf_literal_tail_in(struct linebuf *buf, const char *search) {
+        const char *pattern;
+        size_t i;
+
+        /* Every run of literal characters of a glob shows up verbatim in any string it matches. Check that
+         * for the trailing run of the pattern built so far, which lets us skip entire subtrees of patterns
+         * which cannot match, instead of calling fnmatch() for every single one of them. */
+
+        pattern = linebuf_get(buf);
+        if (!pattern)
+                return true;
+
+        for (i = buf->len; i > 0; i--) {
+                char c = pattern[i - 1];
+
+                /* Brackets and escapes would require parsing the pattern from the start, leave them to fnmatch() */
+                if (IN_SET(c, '[', ']', '\\'))
+                        return true;
+                if (IN_SET(c, '*', '?'))
+                        break;
+        }
+
+        if (i == buf->len)
+                return true;
+
+        return strstr(search, pattern + i);
+}
+
 static int trie_fnmatch_f(sd_hwdb *hwdb, const struct trie_node_f *node, size_t p,
                           struct linebuf *buf, const char *search) {
         size_t len;
@@ -204,6 +246,11 @@ static int trie_fnmatch_f(sd_hwdb *hwdb, const struct trie_node_f *node, size_t
         len = strlen(prefix + p);
         linebuf_add(buf, prefix + p, len);
 
+        if (!linebuf_literal_tail_in(buf, search)) {
+                linebuf_rem(buf, len);
+                return 0;
+        }
+
         for (i = 0; i < node->children_count; i++) {
                 const struct trie_child_entry_f *child = trie_node_child(hwdb, node, i);
 
@@ -359,13 +406,25 @@ _public_ int sd_hwdb_new(sd_hwdb **ret) {
         return 0;
 }
 
+static void properties_cache_clear(sd_hwdb *hwdb) {
+        size_t i;
+
+        for (i = 0; i < hwdb->n_cache; i++) {
+                free(hwdb->cache[i].modalias);
+                ordered_hashmap_free(hwdb->cache[i].properties);
+        }
+
+        hwdb->n_cache = 0;
+        hwdb->properties = NULL;
+}
+
 static sd_hwdb *hwdb_free(sd_hwdb *hwdb) {
         assert(hwdb);
 
         if (hwdb->map)
                 munmap((void *)hwdb->map, hwdb->st.st_size);
         safe_fclose(hwdb->f);
-        ordered_hashmap_free(hwdb->properties);
+        properties_cache_clear(hwdb);
         return mfree(hwdb);
 }
 
@@ -397,13 +456,54 @@ bool hwdb_validate(sd_hwdb *hwdb) {
 }
 
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
+        PropertiesCacheEntry e = {};
+        size_t i;
+        int r;
+
         assert(hwdb);
         assert(modalias);
 
-        ordered_hashmap_clear(hwdb->properties);
         hwdb->properties_modified = true;
 
-        return trie_search_f(hwdb, modalias);
+        for (i = 0; i < hwdb->n_cache; i++)
+                if (streq(hwdb->cache[i].modalias, modalias)) {
+                        e = hwdb->cache[i];
+                        memmove(hwdb->cache + 1, hwdb->cache, i * sizeof(PropertiesCacheEntry));
+                        hwdb->cache[0] = e;
+                        hwdb->properties = e.properties;
+                        return 0;
+                }
+
+        /* Reuse the hashmap of the least recently used entry */
+        if (hwdb->n_cache == PROPERTIES_CACHE_SIZE) {
+                e = hwdb->cache[--hwdb->n_cache];
+                e.modalias = mfree(e.modalias);
+                ordered_hashmap_clear(e.properties);
+        }
+
+        hwdb->properties = e.properties;
+
+        e.modalias = strdup(modalias);
+        if (!e.modalias)
+                r = -ENOMEM;
+        else
+                r = trie_search_f(hwdb, modalias);
+
+        /* The hashmap is allocated on the first property found */
+        e.properties = hwdb->properties;
+
+        if (r < 0) {
+                free(e.modalias);
+                ordered_hashmap_free(e.properties);
+                hwdb->properties = NULL;
+                return r;
+        }
+
+        memmove(hwdb->cache + 1, hwdb->cache, hwdb->n_cache * sizeof(PropertiesCacheEntry));
+        hwdb->cache[0] = e;
+        hwdb->n_cache++;
+
+        return 0;
 }
 
 _public_ int sd_hwdb_get(sd_hwdb *hwdb, const char *modalias, const char *key, const char **_value) {
@@ -2,8 +2,10 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <stdarg.h>
 #include <string.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "sd-login.h"
@@ -38,6 +40,106 @@
  *    requested metadata on object is missing → -ENODATA
  */
 
+/* Clients such as polkit query the same handful of state files over and over, usually several fields of the
+ * same session in a row. logind always replaces these files atomically via rename(), hence a new version
+ * always comes with a new inode. Keep the parsed contents of the most recently read file around, and only
+ * reread it if stat() tells us the file has been replaced since. */
+static thread_local struct {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtim;
+        off_t size;
+        char **pairs;
+} state_file_cache = {};
+
+static bool state_file_cache_matches(const char *p, const struct stat *st) {
+        return state_file_cache.path &&
+                path_equal(state_file_cache.path, p) &&
+                state_file_cache.dev == st->st_dev &&
+                state_file_cache.ino == st->st_ino &&
+                state_file_cache.mtim.tv_sec == st->st_mtim.tv_sec &&
+                state_file_cache.mtim.tv_nsec == st->st_mtim.tv_nsec &&
+                state_file_cache.size == st->st_size;
+}
+
+static int state_file_cache_load(const char *p) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_strv_free_ char **pairs = NULL;
+        _cleanup_free_ char *path = NULL;
+        struct stat st;
+        int r;
+
+        if (stat(p, &st) < 0)
+                return -errno;
+
+        if (state_file_cache_matches(p, &st))
+                return 0;
+
+        f = fopen(p, "re");
+        if (!f)
+                return -errno;
+
+        /* Take the identity from the file we actually read, in case it was replaced in the meantime */
+        if (fstat(fileno(f), &st) < 0)
+                return -errno;
+
+        r = load_env_file_pairs(f, p, NEWLINE, &pairs);
+        if (r < 0)
+                return r;
+
+        path = strdup(p);
+        if (!path)
+                return -ENOMEM;
+
+        free_and_replace(state_file_cache.path, path);
+        strv_free_and_replace(state_file_cache.pairs, pairs);
+        state_file_cache.dev = st.st_dev;
+        state_file_cache.ino = st.st_ino;
+        state_file_cache.mtim = st.st_mtim;
+        state_file_cache.size = st.st_size;
+
+        return 0;
+}
+
+/* Same semantics as parse_env_file(): fields not found in the file are left untouched. */
+_sentinel_ static int parse_state_file(const char *p, ...) {
+        const char *key;
+        va_list ap;
+        int r;
+
+        assert(p);
+
+        r = state_file_cache_load(p);
+        if (r < 0)
+                return r;
+
+        va_start(ap, p);
+        while ((key = va_arg(ap, const char*))) {
+                char **value = va_arg(ap, char**), **k, **v;
+                const char *found = NULL;
+
+                STRV_FOREACH_PAIR(k, v, state_file_cache.pairs)
+                        if (streq(*k, key))
+                                found = *v;
+
+                if (found) {
+                        char *c;
+
+                        c = strdup(found);
+                        if (!c) {
+                                va_end(ap);
+                                return -ENOMEM;
+                        }
+
+                        free_and_replace(*value, c);
+                }
+        }
+        va_end(ap);
+
+        return 0;
+}
+
 _public_ int sd_pid_get_session(pid_t pid, char **session) {
         int r;
 
@@ -268,7 +370,7 @@ _public_ int sd_uid_get_state(uid_t uid, char**state) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "STATE", &s, NULL);
+        r = parse_state_file(p, "STATE", &s, NULL);
         if (r == -ENOENT) {
                 free(s);
                 s = strdup("offline");
@@ -299,7 +401,7 @@ _public_ int sd_uid_get_display(uid_t uid, char **session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "DISPLAY", &s, NULL);
+        r = parse_state_file(p, "DISPLAY", &s, NULL);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -354,7 +456,7 @@ _public_ int sd_uid_is_on_seat(uid_t uid, int require_active, const char *seat)
 
         variable = require_active ? "ACTIVE_UID" : "UIDS";
 
-        r = parse_env_file(NULL, p, NEWLINE, variable, &s, NULL);
+        r = parse_state_file(p, variable, &s, NULL);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -383,7 +485,7 @@ static int uid_get_array(uid_t uid, const char *variable, char ***array) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, variable, &s, NULL);
+        r = parse_state_file(p, variable, &s, NULL);
         if (r == -ENOENT || (r >= 0 && isempty(s))) {
                 if (array)
                         *array = NULL;
@@ -461,7 +563,7 @@ _public_ int sd_session_is_active(const char *session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "ACTIVE", &s, NULL);
+        r = parse_state_file(p, "ACTIVE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -480,7 +582,7 @@ _public_ int sd_session_is_remote(const char *session) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "REMOTE", &s, NULL);
+        r = parse_state_file(p, "REMOTE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -501,7 +603,7 @@ _public_ int sd_session_get_state(const char *session, char **state) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "STATE", &s, NULL);
+        r = parse_state_file(p, "STATE", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -524,7 +626,7 @@ _public_ int sd_session_get_uid(const char *session, uid_t *uid) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, "UID", &s, NULL);
+        r = parse_state_file(p, "UID", &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -546,7 +648,7 @@ static int session_get_string(const char *session, const char *field, char **val
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE, field, &s, NULL);
+        r = parse_state_file(p, field, &s, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -638,10 +740,10 @@ _public_ int sd_seat_get_active(const char *seat, char **session, uid_t *uid) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           "ACTIVE", &s,
-                           "ACTIVE_UID", &t,
-                           NULL);
+        r = parse_state_file(p,
+                             "ACTIVE", &s,
+                             "ACTIVE_UID", &t,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -676,10 +778,10 @@ _public_ int sd_seat_get_sessions(const char *seat, char ***sessions, uid_t **ui
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           "SESSIONS", &s,
-                           "UIDS", &t,
-                           NULL);
+        r = parse_state_file(p,
+                             "SESSIONS", &s,
+                             "UIDS", &t,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -745,9 +847,9 @@ static int seat_get_can(const char *seat, const char *variable) {
         if (r < 0)
                 return r;
 
-        r = parse_env_file(NULL, p, NEWLINE,
-                           variable, &s,
-                           NULL);
+        r = parse_state_file(p,
+                             variable, &s,
+                             NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -901,7 +1003,7 @@ _public_ int sd_machine_get_class(const char *machine, char **class) {
                         return -EINVAL;
 
                 p = strjoina("/run/systemd/machines/", machine);
-                r = parse_env_file(NULL, p, NEWLINE, "CLASS", &c, NULL);
+                r = parse_state_file(p, "CLASS", &c, NULL);
                 if (r == -ENOENT)
                         return -ENXIO;
                 if (r < 0)
@@ -925,7 +1027,7 @@ _public_ int sd_machine_get_ifindices(const char *machine, int **ifindices) {
         assert_return(ifindices, -EINVAL);
 
         p = strjoina("/run/systemd/machines/", machine);
-        r = parse_env_file(NULL, p, NEWLINE, "NETIF", &netif, NULL);
+        r = parse_state_file(p, "NETIF", &netif, NULL);
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -59,7 +59,14 @@ struct sd_netlink {
         struct nlmsghdr *rbuffer;
         size_t rbuffer_allocated;
 
+        /* Messages sent while corked, written out in batches when uncorking */
+        sd_netlink_message **wqueue;
+        unsigned wqueue_size;
+        size_t wqueue_allocated;
+        size_t wqueue_bytes;
+
         bool processing:1;
+        bool corked:1;
 
         uint32_t serial;
 
@@ -115,6 +122,7 @@ int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount);
 int socket_read_message(sd_netlink *nl);
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl);
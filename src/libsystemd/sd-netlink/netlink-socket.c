@@ -9,6 +9,7 @@
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "missing.h"
 #include "netlink-internal.h"
 #include "netlink-types.h"
@@ -239,6 +240,43 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_nl nl;
+        } addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr),
+        };
+        struct iovec *iovs;
+        ssize_t k;
+        size_t i;
+
+        assert(nl);
+        assert(m);
+        assert(msgcount > 0);
+
+        /* The kernel processes all messages in one datagram in order, and replies to each individually */
+
+        iovs = newa(struct iovec, msgcount);
+        for (i = 0; i < msgcount; i++) {
+                assert(m[i]->hdr);
+                iovs[i] = IOVEC_MAKE(m[i]->hdr, m[i]->hdr->nlmsg_len);
+        }
+
+        mh.msg_iov = iovs;
+        mh.msg_iovlen = msgcount;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool peek) {
         union sockaddr_union sender;
         uint8_t cmsg_buffer[CMSG_SPACE(sizeof(struct nl_pktinfo))];
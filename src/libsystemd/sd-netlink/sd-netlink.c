@@ -16,6 +16,16 @@
 #include "socket-util.h"
 #include "util.h"
 
+/* The kernel sizes the buffers for dump replies by the receive buffer we pass, up to 32K. Use that from the start,
+ * so that big dumps arrive in as few datagrams as possible. */
+#define RBUFFER_SIZE_MIN (32U * 1024U)
+
+/* Maximum size of a datagram with corked messages */
+#define WQUEUE_BATCH_BYTES_MAX (32U * 1024U)
+
+/* Maximum number of messages to process per event loop iteration */
+#define PROCESS_BATCH_MAX 64U
+
 static int sd_netlink_new(sd_netlink **ret) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
 
@@ -35,8 +45,9 @@ static int sd_netlink_new(sd_netlink **ret) {
 
         /* We guarantee that the read buffer has at least space for
          * a message header */
+        assert_cc(RBUFFER_SIZE_MIN >= sizeof(struct nlmsghdr));
         if (!greedy_realloc((void**)&rtnl->rbuffer, &rtnl->rbuffer_allocated,
-                            sizeof(struct nlmsghdr), sizeof(uint8_t)))
+                            RBUFFER_SIZE_MIN, sizeof(uint8_t)))
                 return -ENOMEM;
 
         /* Change notification responses have sequence 0, so we must
@@ -162,6 +173,10 @@ static sd_netlink *netlink_free(sd_netlink *rtnl) {
 
         free(rtnl->rbuffer);
 
+        for (i = 0; i < rtnl->wqueue_size; i++)
+                sd_netlink_message_unref(rtnl->wqueue[i]);
+        free(rtnl->wqueue);
+
         hashmap_free_free(rtnl->reply_callbacks);
         prioq_free(rtnl->reply_callbacks_prioq);
 
@@ -195,26 +210,121 @@ static void rtnl_seal_message(sd_netlink *rtnl, sd_netlink_message *m) {
         return;
 }
 
+static void rtnl_wqueue_fail(sd_netlink *rtnl, sd_netlink_message **m, size_t n, int error) {
+        size_t i;
+
+        assert(rtnl);
+
+        /* Sending failed, hence queue an error reply for each message, so that any reply callbacks are invoked
+         * the same way as if the kernel had refused the messages */
+
+        for (i = 0; i < n; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *e = NULL;
+
+                if (rtnl_message_new_synthetic_error(rtnl, error, rtnl_message_get_serial(m[i]), &e) < 0)
+                        continue;
+
+                if (rtnl_rqueue_make_room(rtnl) < 0)
+                        continue;
+
+                rtnl->rqueue[rtnl->rqueue_size++] = TAKE_PTR(e);
+        }
+}
+
+static int rtnl_wqueue_flush(sd_netlink *rtnl) {
+        unsigned i = 0, j;
+
+        assert(rtnl);
+
+        while (i < rtnl->wqueue_size) {
+                size_t bytes = 0, n;
+                int r;
+
+                /* Pack as many messages into one datagram as fit into the batch size */
+                for (n = 0; i + n < rtnl->wqueue_size && n < IOV_MAX; n++) {
+                        size_t l = rtnl->wqueue[i + n]->hdr->nlmsg_len;
+
+                        if (n > 0 && bytes + l > WQUEUE_BATCH_BYTES_MAX)
+                                break;
+
+                        bytes += l;
+                }
+
+                r = socket_writev_message(rtnl, rtnl->wqueue + i, n);
+                if (r < 0) {
+                        log_debug_errno(r, "sd-netlink: failed to send %zu messages: %m", n);
+                        rtnl_wqueue_fail(rtnl, rtnl->wqueue + i, n, r);
+                }
+
+                for (j = i; j < i + n; j++)
+                        rtnl->wqueue[j] = sd_netlink_message_unref(rtnl->wqueue[j]);
+
+                i += n;
+        }
+
+        rtnl->wqueue_size = 0;
+        rtnl->wqueue_bytes = 0;
+
+        return 0;
+}
+
+static int rtnl_send_internal(sd_netlink *nl, sd_netlink_message *message, bool queue, uint32_t *serial) {
+        int r;
+
+        assert(nl);
+        assert(message);
+
+        rtnl_seal_message(nl, message);
+
+        if (queue) {
+                if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_allocated, nl->wqueue_size + 1))
+                        return -ENOMEM;
+
+                nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(message);
+                nl->wqueue_bytes += message->hdr->nlmsg_len;
+
+                /* Don't let the queue grow without bounds */
+                if (nl->wqueue_bytes >= WQUEUE_BATCH_BYTES_MAX) {
+                        r = rtnl_wqueue_flush(nl);
+                        if (r < 0)
+                                return r;
+                }
+        } else {
+                r = socket_write_message(nl, message);
+                if (r < 0)
+                        return r;
+        }
+
+        if (serial)
+                *serial = rtnl_message_get_serial(message);
+
+        return 1;
+}
+
 int sd_netlink_send(sd_netlink *nl,
                     sd_netlink_message *message,
                     uint32_t *serial) {
-        int r;
 
         assert_return(nl, -EINVAL);
         assert_return(!rtnl_pid_changed(nl), -ECHILD);
         assert_return(message, -EINVAL);
         assert_return(!message->sealed, -EPERM);
 
-        rtnl_seal_message(nl, message);
+        return rtnl_send_internal(nl, message, nl->corked, serial);
+}
 
-        r = socket_write_message(nl, message);
-        if (r < 0)
-                return r;
+int sd_netlink_cork(sd_netlink *nl, int b) {
+        assert_return(nl, -EINVAL);
+        assert_return(!rtnl_pid_changed(nl), -ECHILD);
 
-        if (serial)
-                *serial = rtnl_message_get_serial(message);
+        /* While corked, messages are not written right away, but collected and written in as few datagrams as
+         * possible when uncorking. Errors while writing them are reported to the reply callbacks. */
 
-        return 1;
+        nl->corked = b;
+        if (b)
+                return 0;
+
+        return rtnl_wqueue_flush(nl);
 }
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl) {
@@ -591,8 +701,14 @@ int sd_netlink_call(sd_netlink *rtnl,
         assert_return(rtnl, -EINVAL);
         assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
         assert_return(message, -EINVAL);
+        assert_return(!message->sealed, -EPERM);
+
+        /* We'll wait for the reply right away, hence don't queue this, but keep the order of messages */
+        r = rtnl_wqueue_flush(rtnl);
+        if (r < 0)
+                return r;
 
-        r = sd_netlink_send(rtnl, message, &serial);
+        r = rtnl_send_internal(rtnl, message, false, &serial);
         if (r < 0)
                 return r;
 
@@ -699,13 +815,20 @@ int sd_netlink_get_timeout(sd_netlink *rtnl, uint64_t *timeout_usec) {
 
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         sd_netlink *rtnl = userdata;
+        unsigned i;
         int r;
 
         assert(rtnl);
 
-        r = sd_netlink_process(rtnl, NULL);
-        if (r < 0)
-                return r;
+        /* Process a bunch of messages in one go rather than returning to the event loop after each one, as
+         * configuring many addresses or routes results in a flood of replies. */
+        for (i = 0; i < PROCESS_BATCH_MAX; i++) {
+                r = sd_netlink_process(rtnl, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+        }
 
         return 1;
 }
@@ -272,6 +272,50 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static int cork_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        int *counter = userdata;
+
+        (*counter)--;
+
+        assert_se(sd_netlink_message_get_errno(m) == -ENODEV);
+
+        return 1;
+}
+
+static void test_cork(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *r = NULL;
+        int counter = 0, i;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+        assert_se(sd_netlink_inc_rcvbuf(rtnl, 4 * 1024 * 1024) >= 0);
+        assert_se(sd_netlink_cork(rtnl, true) >= 0);
+
+        /* Enough messages to need more than one datagram. Ask for a nonexistent link, so that the replies are
+         * short errors and all fit into the receive buffer. */
+        for (i = 0; i < 1200; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *q = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &q, RTM_GETLINK, INT_MAX) >= 0);
+
+                counter++;
+                assert_se(sd_netlink_call_async(rtnl, q, cork_handler, &counter, 0, NULL) >= 0);
+        }
+
+        /* A synchronous call pushes out the queued messages first, and still gets its reply */
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, &r) == 1);
+
+        assert_se(sd_netlink_cork(rtnl, false) >= 0);
+
+        while (counter > 0) {
+                assert_se(sd_netlink_wait(rtnl, 0) >= 0);
+                assert_se(sd_netlink_process(rtnl, NULL) >= 0);
+        }
+
+        assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
+}
+
 static void test_container(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -385,6 +429,8 @@ int main(void) {
 
         test_pipe(if_loopback);
 
+        test_cork(if_loopback);
+
         test_event_loop(if_loopback);
 
         test_link_configure(rtnl, if_loopback);
@@ -2,7 +2,11 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "network-util.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "strv.h"
 
 bool network_is_online(void) {
@@ -18,3 +22,34 @@ bool network_is_online(void) {
 
         return false;
 }
+
+int network_link_get_state(int ifindex, bool *ret_required_for_online, char **ret_operational_state, char **ret_setup_state) {
+        char path[STRLEN("/run/systemd/netif/links/") + DECIMAL_STR_MAX(ifindex) + 1];
+        _cleanup_free_ char *required = NULL, *oper = NULL, *admin = NULL;
+        int r;
+
+        assert(ifindex > 0);
+        assert(ret_required_for_online);
+        assert(ret_operational_state);
+        assert(ret_setup_state);
+
+        /* Like sd_network_link_get_required_for_online(), sd_network_link_get_operational_state() and
+         * sd_network_link_get_setup_state() together, but parses the state file only once. Fields that are not
+         * set are returned as NULL. */
+
+        xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
+        r = parse_env_file(NULL, path, NEWLINE,
+                           "REQUIRED_FOR_ONLINE", &required,
+                           "OPER_STATE", &oper,
+                           "ADMIN_STATE", &admin,
+                           NULL);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        /* Missing or unparsable RequiredForOnline= is treated as yes, for compatibility */
+        *ret_required_for_online = isempty(required) || parse_boolean(required) != 0;
+        *ret_operational_state = isempty(oper) ? NULL : TAKE_PTR(oper);
+        *ret_setup_state = isempty(admin) ? NULL : TAKE_PTR(admin);
+
+        return 0;
+}
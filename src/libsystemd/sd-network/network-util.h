@@ -3,4 +3,9 @@
 
 #include "sd-network.h"
 
+#include "set.h"
+
 bool network_is_online(void);
+
+int network_link_get_state(int ifindex, bool *ret_required_for_online, char **ret_operational_state, char **ret_setup_state);
+int network_monitor_flush_links(sd_network_monitor *m, Set **ifindexes);
@@ -12,6 +12,7 @@
 #include "fileio.h"
 #include "fs-util.h"
 #include "macro.h"
+#include "network-util.h"
 #include "parse-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -359,6 +360,66 @@ _public_ int sd_network_monitor_flush(sd_network_monitor *m) {
         return 0;
 }
 
+int network_monitor_flush_links(sd_network_monitor *m, Set **ifindexes) {
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        bool all = false;
+        ssize_t l;
+        int fd, k;
+
+        assert(m);
+        assert(ifindexes);
+
+        /* Like sd_network_monitor_flush(), but also tells which links changed: the ifindex of each link whose state
+         * file was written or removed is added to *ifindexes. Returns > 0 if we can't tell, because the directory
+         * was only just created or events were lost, in which case all links need to be looked at. */
+
+        fd = MONITOR_TO_FD(m);
+
+        l = read(fd, &buffer, sizeof(buffer));
+        if (l < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return -errno;
+        }
+
+        FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                int ifindex;
+
+                if (e->mask & IN_ISDIR) {
+                        k = monitor_add_inotify_watch(fd);
+                        if (k < 0)
+                                return k;
+
+                        k = inotify_rm_watch(fd, e->wd);
+                        if (k < 0)
+                                return -errno;
+
+                        all = true;
+                        continue;
+                }
+
+                if (e->mask & IN_Q_OVERFLOW) {
+                        all = true;
+                        continue;
+                }
+
+                if (e->len <= 0 || parse_ifindex(e->name, &ifindex) < 0)
+                        continue;
+
+                k = set_ensure_allocated(ifindexes, NULL);
+                if (k < 0)
+                        return k;
+
+                k = set_put(*ifindexes, INT_TO_PTR(ifindex));
+                if (k < 0)
+                        return k;
+        }
+
+        return all;
+}
+
 _public_ int sd_network_monitor_get_fd(sd_network_monitor *m) {
 
         assert_return(m, -EINVAL);
@@ -17,25 +17,36 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "fd-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "list.h"
 #include "missing.h"
 #include "socket-util.h"
+#include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 #include "process-util.h"
 
 #define WORKERS_MIN 1U
-#define WORKERS_MAX 16U
-#define QUERIES_MAX 256U
+#define WORKERS_MAX 64U
+
+/* How many queries to hand to the worker threads at the same time. Further queries are queued up locally, and
+ * passed on as the outstanding ones complete. */
+#define QUERIES_OUTSTANDING_MAX 256U
+
 #define BUFSIZE 10240U
 
+/* How many getaddrinfo() results to keep in the cache, if it is enabled */
+#define CACHE_MAX 256U
+
 typedef enum {
         REQUEST_ADDRINFO,
         RESPONSE_ADDRINFO,
         REQUEST_NAMEINFO,
         RESPONSE_NAMEINFO,
         REQUEST_TERMINATE,
-        RESPONSE_DIED
+        RESPONSE_DIED,
+        RESPONSE_CACHED,
 } QueryType;
 
 enum {
@@ -54,13 +65,22 @@ struct sd_resolve {
 
         int fds[_FD_MAX];
 
-        pthread_t workers[WORKERS_MAX];
+        pthread_t *workers;
+        size_t n_allocated_workers;
         unsigned n_valid_workers;
 
         unsigned current_id;
-        sd_resolve_query* query_array[QUERIES_MAX];
+        Hashmap *query_by_id;
         unsigned n_queries, n_done, n_outstanding;
 
+        /* Queries that have not been passed to the worker threads yet, in order */
+        LIST_HEAD(sd_resolve_query, pending);
+        sd_resolve_query *pending_tail;
+
+        /* Successful getaddrinfo() results, if enabled */
+        Hashmap *cache;
+        uint64_t cache_usec;
+
         sd_event_source *event_source;
         sd_event *event;
 
@@ -86,8 +106,18 @@ struct sd_resolve_query {
         int _errno;
         int _h_errno;
         struct addrinfo *addrinfo;
+        bool addrinfo_from_libc:1;
         char *serv, *host;
 
+        /* The request, while the query is pending */
+        bool pending:1;
+        void *request;
+        size_t request_size;
+        LIST_FIELDS(sd_resolve_query, pending);
+
+        /* Where to put the result in the cache */
+        char *cache_key;
+
         union {
                 sd_resolve_getaddrinfo_handler_t getaddrinfo_handler;
                 sd_resolve_getnameinfo_handler_t getnameinfo_handler;
@@ -119,18 +149,17 @@ typedef struct AddrInfoResponse {
         int ret;
         int _errno;
         int _h_errno;
-        /* followed by addrinfo_serialization[] */
+
+        /* The worker threads share our address space, hence the result of getaddrinfo() is passed as is, and
+         * needs to be released with freeaddrinfo() */
+        struct addrinfo *addrinfo;
 } AddrInfoResponse;
 
-typedef struct AddrInfoSerialization {
-        int ai_flags;
-        int ai_family;
-        int ai_socktype;
-        int ai_protocol;
-        size_t ai_addrlen;
-        size_t canonname_len;
-        /* Followed by ai_addr amd ai_canonname with variable lengths */
-} AddrInfoSerialization;
+typedef struct CacheEntry {
+        char *key;
+        usec_t until;
+        struct addrinfo *addrinfo;
+} CacheEntry;
 
 typedef struct NameInfoRequest {
         struct RHeader header;
@@ -159,6 +188,7 @@ static int getaddrinfo_done(sd_resolve_query* q);
 static int getnameinfo_done(sd_resolve_query *q);
 
 static void resolve_query_disconnect(sd_resolve_query *q);
+static void resolve_freeaddrinfo(struct addrinfo *ai);
 
 #define RESOLVE_DONT_DESTROY(resolve) \
         _cleanup_(sd_resolve_unrefp) _unused_ sd_resolve *_dont_destroy_##resolve = sd_resolve_ref(resolve)
@@ -185,39 +215,6 @@ static int send_died(int out_fd) {
         return 0;
 }
 
-static void *serialize_addrinfo(void *p, const struct addrinfo *ai, size_t *length, size_t maxlength) {
-        AddrInfoSerialization s;
-        size_t cnl, l;
-
-        assert(p);
-        assert(ai);
-        assert(length);
-        assert(*length <= maxlength);
-
-        cnl = ai->ai_canonname ? strlen(ai->ai_canonname)+1 : 0;
-        l = sizeof(AddrInfoSerialization) + ai->ai_addrlen + cnl;
-
-        if (*length + l > maxlength)
-                return NULL;
-
-        s = (AddrInfoSerialization) {
-                .ai_flags = ai->ai_flags,
-                .ai_family = ai->ai_family,
-                .ai_socktype = ai->ai_socktype,
-                .ai_protocol = ai->ai_protocol,
-                .ai_addrlen = ai->ai_addrlen,
-                .canonname_len = cnl,
-        };
-
-        memcpy((uint8_t*) p, &s, sizeof(AddrInfoSerialization));
-        memcpy((uint8_t*) p + sizeof(AddrInfoSerialization), ai->ai_addr, ai->ai_addrlen);
-        memcpy_safe((char*) p + sizeof(AddrInfoSerialization) + ai->ai_addrlen,
-                    ai->ai_canonname, cnl);
-
-        *length += l;
-        return (uint8_t*) p + l;
-}
-
 static int send_addrinfo_reply(
                 int out_fd,
                 unsigned id,
@@ -226,13 +223,7 @@ static int send_addrinfo_reply(
                 int _errno,
                 int _h_errno) {
 
-        AddrInfoResponse resp = {};
-        union {
-                AddrInfoSerialization ais;
-                uint8_t space[BUFSIZE];
-        } buffer;
-        struct iovec iov[2];
-        struct msghdr mh;
+        AddrInfoResponse resp;
 
         assert(out_fd >= 0);
 
@@ -243,31 +234,17 @@ static int send_addrinfo_reply(
                 .ret = ret,
                 ._errno = _errno,
                 ._h_errno = _h_errno,
+                .addrinfo = ret == 0 ? ai : NULL,
         };
 
-        if (ret == 0 && ai) {
-                void *p = &buffer;
-                struct addrinfo *k;
-
-                for (k = ai; k; k = k->ai_next) {
-                        p = serialize_addrinfo(p, k, &resp.header.length, (uint8_t*) &buffer + BUFSIZE - (uint8_t*) p);
-                        if (!p) {
-                                freeaddrinfo(ai);
-                                return -ENOBUFS;
-                        }
-                }
-        }
-
-        if (ai)
+        if (ret != 0 && ai)
                 freeaddrinfo(ai);
 
-        iov[0] = (struct iovec) { .iov_base = &resp, .iov_len = sizeof(AddrInfoResponse) };
-        iov[1] = (struct iovec) { .iov_base = &buffer, .iov_len = resp.header.length - sizeof(AddrInfoResponse) };
-
-        mh = (struct msghdr) { .msg_iov = iov, .msg_iovlen = ELEMENTSOF(iov) };
-
-        if (sendmsg(out_fd, &mh, MSG_NOSIGNAL) < 0)
+        if (send(out_fd, &resp, resp.header.length, MSG_NOSIGNAL) < 0) {
+                if (resp.addrinfo)
+                        freeaddrinfo(resp.addrinfo);
                 return -errno;
+        }
 
         return 0;
 }
@@ -425,6 +402,16 @@ static int start_threads(sd_resolve *resolve, unsigned extra) {
         unsigned n;
         int r, k;
 
+        /* We don't need more threads than there are queries being worked on */
+        n = MIN(resolve->n_outstanding + extra, QUERIES_OUTSTANDING_MAX);
+        n = CLAMP(n, WORKERS_MIN, WORKERS_MAX);
+
+        if (resolve->n_valid_workers >= n)
+                return 0;
+
+        if (!GREEDY_REALLOC(resolve->workers, resolve->n_allocated_workers, n))
+                return -ENOMEM;
+
         if (sigfillset(&ss) < 0)
                 return -errno;
 
@@ -434,9 +421,6 @@ static int start_threads(sd_resolve *resolve, unsigned extra) {
         if (r > 0)
                 return -r;
 
-        n = resolve->n_outstanding + extra;
-        n = CLAMP(n, WORKERS_MIN, WORKERS_MAX);
-
         while (resolve->n_valid_workers < n) {
                 r = pthread_create(&resolve->workers[resolve->n_valid_workers], NULL, thread_worker, resolve);
                 if (r > 0) {
@@ -491,10 +475,10 @@ _public_ int sd_resolve_new(sd_resolve **ret) {
         for (i = 0; i < _FD_MAX; i++)
                 resolve->fds[i] = fd_move_above_stdio(resolve->fds[i]);
 
-        (void) fd_inc_sndbuf(resolve->fds[REQUEST_SEND_FD], QUERIES_MAX * BUFSIZE);
-        (void) fd_inc_rcvbuf(resolve->fds[REQUEST_RECV_FD], QUERIES_MAX * BUFSIZE);
-        (void) fd_inc_sndbuf(resolve->fds[RESPONSE_SEND_FD], QUERIES_MAX * BUFSIZE);
-        (void) fd_inc_rcvbuf(resolve->fds[RESPONSE_RECV_FD], QUERIES_MAX * BUFSIZE);
+        (void) fd_inc_sndbuf(resolve->fds[REQUEST_SEND_FD], QUERIES_OUTSTANDING_MAX * BUFSIZE);
+        (void) fd_inc_rcvbuf(resolve->fds[REQUEST_RECV_FD], QUERIES_OUTSTANDING_MAX * BUFSIZE);
+        (void) fd_inc_sndbuf(resolve->fds[RESPONSE_SEND_FD], QUERIES_OUTSTANDING_MAX * BUFSIZE);
+        (void) fd_inc_rcvbuf(resolve->fds[RESPONSE_RECV_FD], QUERIES_OUTSTANDING_MAX * BUFSIZE);
 
         (void) fd_nonblock(resolve->fds[RESPONSE_RECV_FD], true);
 
@@ -543,6 +527,23 @@ _public_ int sd_resolve_get_tid(sd_resolve *resolve, pid_t *tid) {
         return -ENXIO;
 }
 
+static CacheEntry *cache_entry_free(CacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->key);
+        resolve_freeaddrinfo(e->addrinfo);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CacheEntry*, cache_entry_free);
+
+static void resolve_flush_cache(sd_resolve *resolve) {
+        assert(resolve);
+
+        hashmap_clear_with_destructor(resolve->cache, cache_entry_free);
+}
+
 static sd_resolve *resolve_free(sd_resolve *resolve) {
         PROTECT_ERRNO;
         sd_resolve_query *q;
@@ -580,9 +581,33 @@ static sd_resolve *resolve_free(sd_resolve *resolve) {
         for (i = 0; i < resolve->n_valid_workers; i++)
                 (void) pthread_join(resolve->workers[i], NULL);
 
+        /* Release the results nobody picked up anymore */
+        if (resolve->fds[RESPONSE_RECV_FD] >= 0)
+                for (;;) {
+                        union {
+                                Packet packet;
+                                uint8_t space[BUFSIZE];
+                        } buf;
+                        ssize_t l;
+
+                        l = recv(resolve->fds[RESPONSE_RECV_FD], &buf, sizeof buf, MSG_DONTWAIT);
+                        if (l <= 0)
+                                break;
+
+                        if ((size_t) l >= sizeof(AddrInfoResponse) &&
+                            buf.packet.rheader.type == RESPONSE_ADDRINFO &&
+                            buf.packet.addrinfo_response.addrinfo)
+                                freeaddrinfo(buf.packet.addrinfo_response.addrinfo);
+                }
+
         /* Close all communication channels */
         close_many(resolve->fds, _FD_MAX);
 
+        hashmap_free(resolve->query_by_id);
+        resolve_flush_cache(resolve);
+        hashmap_free(resolve->cache);
+        free(resolve->workers);
+
         return mfree(resolve);
 }
 
@@ -612,16 +637,227 @@ _public_ int sd_resolve_get_timeout(sd_resolve *resolve, uint64_t *usec) {
 }
 
 static sd_resolve_query *lookup_query(sd_resolve *resolve, unsigned id) {
+        assert(resolve);
+
+        return hashmap_get(resolve->query_by_id, UINT_TO_PTR(id));
+}
+
+static int send_request(sd_resolve *resolve, const void *request, size_t size) {
+        assert(resolve);
+        assert(request);
+
+        if (send(resolve->fds[REQUEST_SEND_FD], request, size, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        resolve->n_outstanding++;
+        return 0;
+}
+
+static void query_unpend(sd_resolve_query *q) {
+        sd_resolve *resolve;
+
+        assert(q);
+
+        if (!q->pending)
+                return;
+
+        resolve = q->resolve;
+
+        if (resolve->pending_tail == q)
+                resolve->pending_tail = q->pending_prev;
+        LIST_REMOVE(pending, resolve->pending, q);
+
+        q->request = mfree(q->request);
+        q->request_size = 0;
+        q->pending = false;
+}
+
+static int submit_request(sd_resolve *resolve, sd_resolve_query *q, void *request, size_t size) {
+        int r;
+
+        assert(resolve);
+        assert(q);
+        assert(request);
+
+        /* Takes possession of request. If the worker threads have enough to do, the request is queued up
+         * locally, instead of filling up the socket buffers, which would eventually block us. */
+
+        if (resolve->n_outstanding < QUERIES_OUTSTANDING_MAX && !resolve->pending) {
+                r = send_request(resolve, request, size);
+                free(request);
+                return r;
+        }
+
+        q->request = request;
+        q->request_size = size;
+        q->pending = true;
+
+        LIST_INSERT_AFTER(pending, resolve->pending, resolve->pending_tail, q);
+        resolve->pending_tail = q;
+
+        return 0;
+}
+
+static int dispatch_pending(sd_resolve *resolve) {
         sd_resolve_query *q;
+        int r;
 
         assert(resolve);
 
-        q = resolve->query_array[id % QUERIES_MAX];
-        if (q)
-                if (q->id == id)
-                        return q;
+        while ((q = resolve->pending) && resolve->n_outstanding < QUERIES_OUTSTANDING_MAX) {
+                r = send_request(resolve, q->request, q->request_size);
+                if (r < 0)
+                        return r;
 
-        return NULL;
+                query_unpend(q);
+        }
+
+        return 0;
+}
+
+static int addrinfo_copy(const struct addrinfo *ai, struct addrinfo **ret) {
+        struct addrinfo *first = NULL, *prev = NULL;
+
+        assert(ret);
+
+        /* Returns a copy of the list that needs to be released with resolve_freeaddrinfo() */
+
+        for (; ai; ai = ai->ai_next) {
+                struct addrinfo *k;
+
+                k = new(struct addrinfo, 1);
+                if (!k)
+                        goto fail;
+
+                *k = (struct addrinfo) {
+                        .ai_flags = ai->ai_flags,
+                        .ai_family = ai->ai_family,
+                        .ai_socktype = ai->ai_socktype,
+                        .ai_protocol = ai->ai_protocol,
+                        .ai_addrlen = ai->ai_addrlen,
+                };
+
+                if (prev)
+                        prev->ai_next = k;
+                else
+                        first = k;
+                prev = k;
+
+                if (ai->ai_addr) {
+                        k->ai_addr = memdup(ai->ai_addr, ai->ai_addrlen);
+                        if (!k->ai_addr)
+                                goto fail;
+                }
+
+                if (ai->ai_canonname) {
+                        k->ai_canonname = strdup(ai->ai_canonname);
+                        if (!k->ai_canonname)
+                                goto fail;
+                }
+        }
+
+        *ret = first;
+        return 0;
+
+fail:
+        resolve_freeaddrinfo(first);
+        return -ENOMEM;
+}
+
+static char *cache_key(const char *node, const char *service, const struct addrinfo *hints) {
+        char *k;
+
+        /* The lengths make sure that no two different queries result in the same key */
+        if (asprintf(&k, "%i %i %i %i %zi %s %zi %s",
+                     hints ? hints->ai_flags : -1,
+                     hints ? hints->ai_family : -1,
+                     hints ? hints->ai_socktype : -1,
+                     hints ? hints->ai_protocol : -1,
+                     node ? (ssize_t) strlen(node) : -1, strempty(node),
+                     service ? (ssize_t) strlen(service) : -1, strempty(service)) < 0)
+                return NULL;
+
+        return k;
+}
+
+static void cache_put(sd_resolve *resolve, const char *key, const struct addrinfo *ai) {
+        _cleanup_(cache_entry_freep) CacheEntry *e = NULL;
+        CacheEntry *old;
+        Iterator i;
+        usec_t n;
+
+        assert(resolve);
+        assert(key);
+
+        if (resolve->cache_usec == 0)
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+
+        old = hashmap_remove(resolve->cache, key);
+        cache_entry_free(old);
+
+        /* Make room, but only by dropping what expired anyway */
+        if (hashmap_size(resolve->cache) >= CACHE_MAX)
+                HASHMAP_FOREACH(old, resolve->cache, i)
+                        if (old->until <= n) {
+                                hashmap_remove(resolve->cache, old->key);
+                                cache_entry_free(old);
+                        }
+
+        if (hashmap_size(resolve->cache) >= CACHE_MAX)
+                return;
+
+        if (hashmap_ensure_allocated(&resolve->cache, &string_hash_ops) < 0)
+                return;
+
+        e = new0(CacheEntry, 1);
+        if (!e)
+                return;
+
+        e->key = strdup(key);
+        if (!e->key)
+                return;
+
+        if (addrinfo_copy(ai, &e->addrinfo) < 0)
+                return;
+
+        e->until = usec_add(n, resolve->cache_usec);
+
+        if (hashmap_put(resolve->cache, e->key, e) < 0)
+                return;
+
+        TAKE_PTR(e);
+}
+
+static const struct addrinfo *cache_get(sd_resolve *resolve, const char *key) {
+        CacheEntry *e;
+
+        assert(resolve);
+        assert(key);
+
+        e = hashmap_get(resolve->cache, key);
+        if (!e)
+                return NULL;
+
+        if (e->until <= now(CLOCK_MONOTONIC)) {
+                hashmap_remove(resolve->cache, e->key);
+                cache_entry_free(e);
+                return NULL;
+        }
+
+        return e->addrinfo;
+}
+
+_public_ int sd_resolve_set_cache_timeout(sd_resolve *resolve, uint64_t usec) {
+        assert_return(resolve, -EINVAL);
+        assert_return(!resolve_pid_changed(resolve), -ECHILD);
+
+        resolve->cache_usec = usec;
+        if (usec == 0)
+                resolve_flush_cache(resolve);
+
+        return 0;
 }
 
 static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
@@ -662,61 +898,6 @@ static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
         return r;
 }
 
-static int unserialize_addrinfo(const void **p, size_t *length, struct addrinfo **ret_ai) {
-        AddrInfoSerialization s;
-        struct addrinfo *ai;
-        size_t l;
-
-        assert(p);
-        assert(*p);
-        assert(ret_ai);
-        assert(length);
-
-        if (*length < sizeof(AddrInfoSerialization))
-                return -EBADMSG;
-
-        memcpy(&s, *p, sizeof(s));
-
-        l = sizeof(AddrInfoSerialization) + s.ai_addrlen + s.canonname_len;
-        if (*length < l)
-                return -EBADMSG;
-
-        ai = new(struct addrinfo, 1);
-        if (!ai)
-                return -ENOMEM;
-
-        *ai = (struct addrinfo) {
-                .ai_flags = s.ai_flags,
-                .ai_family = s.ai_family,
-                .ai_socktype = s.ai_socktype,
-                .ai_protocol = s.ai_protocol,
-                .ai_addrlen = s.ai_addrlen,
-        };
-
-        if (s.ai_addrlen > 0) {
-                ai->ai_addr = memdup((const uint8_t*) *p + sizeof(AddrInfoSerialization), s.ai_addrlen);
-                if (!ai->ai_addr) {
-                        free(ai);
-                        return -ENOMEM;
-                }
-        }
-
-        if (s.canonname_len > 0) {
-                ai->ai_canonname = memdup((const uint8_t*) *p + sizeof(AddrInfoSerialization) + s.ai_addrlen, s.canonname_len);
-                if (!ai->ai_canonname) {
-                        free(ai->ai_addr);
-                        free(ai);
-                        return -ENOMEM;
-                }
-        }
-
-        *length -= l;
-        *ret_ai = ai;
-        *p = ((const uint8_t*) *p) + l;
-
-        return 0;
-}
-
 static int handle_response(sd_resolve *resolve, const Packet *packet, size_t length) {
         const RHeader *resp;
         sd_resolve_query *q;
@@ -734,47 +915,45 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                 return 0;
         }
 
+        if (resp->type == RESPONSE_CACHED) {
+                /* Answered from the cache, without involving the worker threads, the result is already
+                 * assigned */
+                q = lookup_query(resolve, resp->id);
+                if (!q || q->done)
+                        return 0;
+
+                return complete_query(resolve, q);
+        }
+
         assert(resolve->n_outstanding > 0);
         resolve->n_outstanding--;
 
+        /* A worker thread became available, pass on the next queued query */
+        r = dispatch_pending(resolve);
+        if (r < 0)
+                return r;
+
         q = lookup_query(resolve, resp->id);
-        if (!q)
-                return 0;
 
         switch (resp->type) {
 
         case RESPONSE_ADDRINFO: {
                 const AddrInfoResponse *ai_resp = &packet->addrinfo_response;
-                const void *p;
-                size_t l;
-                struct addrinfo *prev = NULL;
 
                 assert_return(length >= sizeof(AddrInfoResponse), -EBADMSG);
-                assert_return(q->type == REQUEST_ADDRINFO, -EBADMSG);
-
-                query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
 
-                l = length - sizeof(AddrInfoResponse);
-                p = (const uint8_t*) resp + sizeof(AddrInfoResponse);
-
-                while (l > 0 && p) {
-                        struct addrinfo *ai = NULL;
-
-                        r = unserialize_addrinfo(&p, &l, &ai);
-                        if (r < 0) {
-                                query_assign_errno(q, EAI_SYSTEM, r, 0);
-                                freeaddrinfo(q->addrinfo);
-                                q->addrinfo = NULL;
-                                break;
-                        }
+                if (!q || q->type != REQUEST_ADDRINFO) {
+                        if (ai_resp->addrinfo)
+                                freeaddrinfo(ai_resp->addrinfo);
+                        return 0;
+                }
 
-                        if (prev)
-                                prev->ai_next = ai;
-                        else
-                                q->addrinfo = ai;
+                query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
+                q->addrinfo = ai_resp->addrinfo;
+                q->addrinfo_from_libc = true;
 
-                        prev = ai;
-                }
+                if (q->ret == 0 && q->cache_key)
+                        cache_put(resolve, q->cache_key, q->addrinfo);
 
                 return complete_query(resolve, q);
         }
@@ -782,6 +961,9 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
         case RESPONSE_NAMEINFO: {
                 const NameInfoResponse *ni_resp = &packet->nameinfo_response;
 
+                if (!q)
+                        return 0;
+
                 assert_return(length >= sizeof(NameInfoResponse), -EBADMSG);
                 assert_return(q->type == REQUEST_NAMEINFO, -EBADMSG);
 
@@ -876,25 +1058,35 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         assert(resolve);
         assert(_q);
 
-        if (resolve->n_queries >= QUERIES_MAX)
-                return -ENOBUFS;
-
         r = start_threads(resolve, 1);
         if (r < 0)
                 return r;
 
-        while (resolve->query_array[resolve->current_id % QUERIES_MAX])
+        r = hashmap_ensure_allocated(&resolve->query_by_id, NULL);
+        if (r < 0)
+                return r;
+
+        /* Skip IDs that are still in use after wrapping around, 0 is never used */
+        while (resolve->current_id == 0 ||
+               hashmap_contains(resolve->query_by_id, UINT_TO_PTR(resolve->current_id)))
                 resolve->current_id++;
 
-        q = resolve->query_array[resolve->current_id % QUERIES_MAX] = new0(sd_resolve_query, 1);
+        q = new0(sd_resolve_query, 1);
         if (!q)
                 return -ENOMEM;
 
         q->n_ref = 1;
-        q->resolve = resolve;
         q->floating = floating;
         q->id = resolve->current_id++;
 
+        r = hashmap_put(resolve->query_by_id, UINT_TO_PTR(q->id), q);
+        if (r < 0) {
+                free(q);
+                return r;
+        }
+
+        q->resolve = resolve;
+
         if (!floating)
                 sd_resolve_ref(resolve);
 
@@ -913,9 +1105,9 @@ _public_ int sd_resolve_getaddrinfo(
                 sd_resolve_getaddrinfo_handler_t callback, void *userdata) {
 
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q = NULL;
+        _cleanup_free_ void *buf = NULL;
+        const struct addrinfo *cached;
         AddrInfoRequest req = {};
-        struct iovec iov[3];
-        struct msghdr mh = {};
         int r;
         size_t node_len, service_len;
 
@@ -950,18 +1142,40 @@ _public_ int sd_resolve_getaddrinfo(
                 .ai_protocol = hints ? hints->ai_protocol : 0,
         };
 
-        iov[mh.msg_iovlen++] = (struct iovec) { .iov_base = &req, .iov_len = sizeof(AddrInfoRequest) };
-        if (node)
-                iov[mh.msg_iovlen++] = (struct iovec) { .iov_base = (void*) node, .iov_len = req.node_len };
-        if (service)
-                iov[mh.msg_iovlen++] = (struct iovec) { .iov_base = (void*) service, .iov_len = req.service_len };
-        mh.msg_iov = iov;
+        if (resolve->cache_usec > 0) {
+                q->cache_key = cache_key(node, service, hints);
+                if (!q->cache_key)
+                        return -ENOMEM;
 
-        if (sendmsg(resolve->fds[REQUEST_SEND_FD], &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
+                cached = cache_get(resolve, q->cache_key);
+                if (cached && addrinfo_copy(cached, &q->addrinfo) >= 0) {
+                        RHeader h = {
+                                .type = RESPONSE_CACHED,
+                                .id = q->id,
+                                .length = sizeof(RHeader),
+                        };
+
+                        /* The callback must not be called from within this function, hence complete the query
+                         * through the response socket, like any other. If that fails, resolve it for real. */
+                        if (send(resolve->fds[RESPONSE_SEND_FD], &h, sizeof(h), MSG_DONTWAIT|MSG_NOSIGNAL) >= 0)
+                                goto finish;
+
+                        resolve_freeaddrinfo(q->addrinfo);
+                        q->addrinfo = NULL;
+                }
+        }
 
-        resolve->n_outstanding++;
+        buf = malloc(req.header.length);
+        if (!buf)
+                return -ENOMEM;
+
+        memcpy(mempcpy(mempcpy(buf, &req, sizeof(AddrInfoRequest)), strempty(node), node_len), strempty(service), service_len);
+
+        r = submit_request(resolve, q, TAKE_PTR(buf), req.header.length);
+        if (r < 0)
+                return r;
 
+finish:
         if (_q)
                 *_q = q;
         TAKE_PTR(q);
@@ -991,8 +1205,7 @@ _public_ int sd_resolve_getnameinfo(
 
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q = NULL;
         NameInfoRequest req = {};
-        struct iovec iov[2];
-        struct msghdr mh;
+        void *buf;
         int r;
 
         assert_return(resolve, -EINVAL);
@@ -1022,18 +1235,19 @@ _public_ int sd_resolve_getnameinfo(
                 .getserv = !!(get & SD_RESOLVE_GET_SERVICE),
         };
 
-        iov[0] = (struct iovec) { .iov_base = &req, .iov_len = sizeof(NameInfoRequest) };
-        iov[1] = (struct iovec) { .iov_base = (void*) sa, .iov_len = salen };
+        buf = malloc(req.header.length);
+        if (!buf)
+                return -ENOMEM;
 
-        mh = (struct msghdr) { .msg_iov = iov, .msg_iovlen = ELEMENTSOF(iov) };
+        memcpy(mempcpy(buf, &req, sizeof(NameInfoRequest)), sa, salen);
 
-        if (sendmsg(resolve->fds[REQUEST_SEND_FD], &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
+        r = submit_request(resolve, q, buf, req.header.length);
+        if (r < 0)
+                return r;
 
         if (_q)
                 *_q = q;
 
-        resolve->n_outstanding++;
         TAKE_PTR(q);
 
         return 0;
@@ -1064,7 +1278,6 @@ static void resolve_freeaddrinfo(struct addrinfo *ai) {
 
 static void resolve_query_disconnect(sd_resolve_query *q) {
         sd_resolve *resolve;
-        unsigned i;
 
         assert(q);
 
@@ -1079,9 +1292,9 @@ static void resolve_query_disconnect(sd_resolve_query *q) {
                 resolve->n_done--;
         }
 
-        i = q->id % QUERIES_MAX;
-        assert(resolve->query_array[i] == q);
-        resolve->query_array[i] = NULL;
+        query_unpend(q);
+
+        assert_se(hashmap_remove(resolve->query_by_id, UINT_TO_PTR(q->id)) == q);
         LIST_REMOVE(queries, resolve->queries, q);
         resolve->n_queries--;
 
@@ -1095,9 +1308,13 @@ static sd_resolve_query *resolve_query_free(sd_resolve_query *q) {
 
         resolve_query_disconnect(q);
 
-        resolve_freeaddrinfo(q->addrinfo);
+        if (q->addrinfo_from_libc)
+                freeaddrinfo(q->addrinfo);
+        else
+                resolve_freeaddrinfo(q->addrinfo);
         free(q->host);
         free(q->serv);
+        free(q->cache_key);
 
         return mfree(q);
 }
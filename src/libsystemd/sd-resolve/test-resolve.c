@@ -51,6 +51,46 @@ static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, c
         return 0;
 }
 
+static int getaddrinfo_count_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(ret == 0);
+        assert_se(ai);
+
+        (*n)++;
+        return 0;
+}
+
+static void test_many_queries(void) {
+        _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        unsigned i, n = 0;
+        int r;
+
+        /* More queries than there are worker threads and slots in the socket buffer, the rest is queued up */
+
+        assert_se(sd_resolve_new(&resolve) >= 0);
+        assert_se(sd_resolve_set_cache_timeout(resolve, USEC_PER_MINUTE) >= 0);
+
+        for (i = 0; i < 1000; i++)
+                assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", i % 2 ? "http" : NULL, NULL,
+                                                 getaddrinfo_count_handler, &n) >= 0);
+
+        for (;;) {
+                r = sd_resolve_wait(resolve, TEST_TIMEOUT_USEC);
+                if (r == 0)
+                        break;
+                assert_se(r > 0);
+        }
+        assert_se(n == 1000);
+
+        /* The result is cached by now */
+        assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", NULL, NULL, getaddrinfo_count_handler, &n) >= 0);
+        assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) > 0);
+        assert_se(n == 1001);
+
+        assert_se(sd_resolve_set_cache_timeout(resolve, 0) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q1 = NULL, *q2 = NULL;
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
@@ -67,6 +107,8 @@ int main(int argc, char *argv[]) {
                 .sin_port = htons(80)
         };
 
+        test_many_queries();
+
         assert_se(sd_resolve_default(&resolve) >= 0);
 
         /* Test a floating resolver query */
@@ -542,6 +542,58 @@ tag:
         return 0;
 }
 
+/* The same as the subsystem part of passes_filter(), but on the raw properties of a received message, to
+ * not parse every message into a device object just to drop it again. The kernel does not run our socket
+ * filter on its own messages, hence a monitor of the "kernel" source sees every single uevent. */
+static bool passes_subsystem_filter_raw(struct udev_monitor *udev_monitor, const char *buf, size_t buflen)
+{
+        struct udev_list_entry *list_entry;
+        const char *subsystem = NULL, *devtype = NULL;
+        const char *p, *end = buf + buflen;
+
+        if (udev_list_get_entry(&udev_monitor->filter_subsystem_list) == NULL)
+                return true;
+
+        for (p = buf; p < end; ) {
+                size_t l;
+                const char *v;
+
+                l = strnlen(p, end - p);
+                if (p + l >= end)
+                        break;
+
+                v = startswith(p, "SUBSYSTEM=");
+                if (v)
+                        subsystem = v;
+                else {
+                        v = startswith(p, "DEVTYPE=");
+                        if (v)
+                                devtype = v;
+                }
+
+                p += l + 1;
+        }
+
+        /* Leave judging incomplete messages to the full parser */
+        if (!subsystem)
+                return true;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_subsystem_list)) {
+                const char *filter_devtype;
+
+                if (!streq(subsystem, udev_list_entry_get_name(list_entry)))
+                        continue;
+
+                filter_devtype = udev_list_entry_get_value(list_entry);
+                if (filter_devtype == NULL)
+                        return true;
+                if (devtype && streq(devtype, filter_devtype))
+                        return true;
+        }
+
+        return false;
+}
+
 /**
  * udev_monitor_receive_device:
  * @udev_monitor: udev monitor
@@ -577,6 +629,8 @@ _public_ struct udev_device *udev_monitor_receive_device(struct udev_monitor *ud
         ssize_t buflen;
         ssize_t bufpos;
         bool is_initialized = false;
+        struct pollfd pfd[1];
+        int rc;
 
 retry:
         if (udev_monitor == NULL) {
@@ -673,6 +727,9 @@ retry:
                 }
         }
 
+        if (!passes_subsystem_filter_raw(udev_monitor, &buf.raw[bufpos], buflen - bufpos))
+                goto skip;
+
         udev_device = udev_device_new_from_nulstr(udev_monitor->udev, &buf.raw[bufpos], buflen - bufpos);
         if (!udev_device) {
                 log_debug_errno(errno, "could not create device: %m");
@@ -684,23 +741,22 @@ retry:
 
         /* skip device, if it does not pass the current filter */
         if (!passes_filter(udev_monitor, udev_device)) {
-                struct pollfd pfd[1];
-                int rc;
-
                 udev_device_unref(udev_device);
-
-                /* if something is queued, get next device */
-                pfd[0].fd = udev_monitor->sock;
-                pfd[0].events = POLLIN;
-                rc = poll(pfd, 1, 0);
-                if (rc > 0)
-                        goto retry;
-
-                errno = EAGAIN;
-                return NULL;
+                goto skip;
         }
 
         return udev_device;
+
+skip:
+        /* if something is queued, get next device */
+        pfd[0].fd = udev_monitor->sock;
+        pfd[0].events = POLLIN;
+        rc = poll(pfd, 1, 0);
+        if (rc > 0)
+                goto retry;
+
+        errno = EAGAIN;
+        return NULL;
 }
 
 int udev_monitor_receive_sd_device(struct udev_monitor *udev_monitor, sd_device **ret) {
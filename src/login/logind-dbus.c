@@ -2782,8 +2782,8 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                 session->scope_job = mfree(session->scope_job);
                 session_jobs_reply(session, unit, result);
 
-                session_save(session);
-                user_save(session->user);
+                session_add_to_save_queue(session);
+                user_add_to_save_queue(session->user);
                 session_add_to_gc_queue(session);
         }
 
@@ -2801,7 +2801,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                 LIST_FOREACH(sessions_by_user, session, user->sessions)
                         session_jobs_reply(session, unit, result);
 
-                user_save(user);
+                user_add_to_save_queue(user);
                 user_add_to_gc_queue(user);
         }
 
@@ -2936,16 +2936,18 @@ int manager_start_scope(
                 const char *after,
                 const char *after2,
                 sd_bus_message *more_properties,
-                sd_bus_error *error,
-                char **job) {
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                sd_bus_slot **ret_slot) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         int r;
 
         assert(manager);
         assert(scope);
         assert(pid > 1);
-        assert(job);
+        assert(callback);
+        assert(ret_slot);
 
         r = sd_bus_message_new_method_call(
                         manager->bus,
@@ -3019,32 +3021,44 @@ int manager_start_scope(
         if (r < 0)
                 return r;
 
-        r = sd_bus_call(manager->bus, m, 0, error, &reply);
-        if (r < 0)
-                return r;
-
-        return strdup_job(reply, job);
+        /* Don't wait for PID 1 here, so that concurrent logins are not serialized on the round-trip. The
+         * callback picks up the job path, or the error. */
+        return sd_bus_call_async(manager->bus, ret_slot, m, callback, userdata, 0);
 }
 
-int manager_start_unit(Manager *manager, const char *unit, sd_bus_error *error, char **job) {
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        int r;
+int manager_start_unit(
+                Manager *manager,
+                const char *unit,
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                sd_bus_slot **ret_slot) {
 
         assert(manager);
         assert(unit);
-        assert(job);
+        assert(callback);
+        assert(ret_slot);
 
-        r = sd_bus_call_method(
+        return sd_bus_call_method_async(
                         manager->bus,
+                        ret_slot,
                         "org.freedesktop.systemd1",
                         "/org/freedesktop/systemd1",
                         "org.freedesktop.systemd1.Manager",
                         "StartUnit",
-                        error,
-                        &reply,
+                        callback,
+                        userdata,
                         "ss", unit, "replace");
-        if (r < 0)
-                return r;
+}
+
+int manager_read_job_reply(sd_bus_message *reply, sd_bus_error *error, char **job) {
+        assert(reply);
+        assert(error);
+        assert(job);
+
+        /* Parses the reply to an asynchronous StartUnit() or StartTransientUnit() call */
+
+        if (sd_bus_message_is_method_error(reply, NULL))
+                return sd_bus_error_copy(error, sd_bus_message_get_error(reply));
 
         return strdup_job(reply, job);
 }
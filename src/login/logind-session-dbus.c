@@ -405,7 +405,7 @@ static int method_take_device(sd_bus_message *message, void *userdata, sd_bus_er
         if (r < 0)
                 goto error;
 
-        session_save(s);
+        session_add_to_save_queue(s);
         return 1;
 
 error:
@@ -436,7 +436,7 @@ static int method_release_device(sd_bus_message *message, void *userdata, sd_bus
                 return sd_bus_error_setf(error, BUS_ERROR_DEVICE_NOT_TAKEN, "Device not taken");
 
         session_device_free(sd);
-        session_save(s);
+        session_add_to_save_queue(s);
 
         return sd_bus_reply_method_return(message, NULL);
 }
@@ -691,6 +691,7 @@ int session_send_lock_all(Manager *m, bool lock) {
 
 int session_send_create_reply(Session *s, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *c = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
         _cleanup_close_ int fifo_fd = -1;
         _cleanup_free_ char *p = NULL;
 
@@ -703,7 +704,8 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
         if (!s->create_message)
                 return 0;
 
-        if (!sd_bus_error_is_set(error) && (s->scope_job || s->user->service_job))
+        if (!sd_bus_error_is_set(error) &&
+            (s->scope_start_slot || s->scope_job || s->user->service_start_slot || s->user->service_job))
                 return 0;
 
         c = s->create_message;
@@ -724,9 +726,10 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
         if (!p)
                 return -ENOMEM;
 
-        log_debug("Sending reply about created session: "
+        log_debug("Sending reply about created session after %s: "
                   "id=%s object_path=%s uid=%u runtime_path=%s "
                   "session_fd=%d seat=%s vtnr=%u",
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - s->timestamp.monotonic, USEC_PER_MSEC),
                   s->id,
                   p,
                   (uint32_t) s->user->uid,
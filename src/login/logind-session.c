@@ -79,6 +79,9 @@ void session_free(Session *s) {
         if (s->in_gc_queue)
                 LIST_REMOVE(gc_queue, s->manager->session_gc_queue, s);
 
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->session_save_queue, s);
+
         s->timer_event_source = sd_event_source_unref(s->timer_event_source);
 
         session_remove_fifo(s);
@@ -113,6 +116,7 @@ void session_free(Session *s) {
         }
 
         free(s->scope_job);
+        sd_bus_slot_unref(s->scope_start_slot);
 
         sd_bus_message_unref(s->create_message);
 
@@ -539,6 +543,41 @@ int session_activate(Session *s) {
         return 0;
 }
 
+static int session_start_scope_reply(sd_bus_message *reply, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        Session *s = userdata;
+        char *job = NULL;
+        int r;
+
+        assert(reply);
+        assert(s);
+
+        s->scope_start_slot = sd_bus_slot_unref(s->scope_start_slot);
+
+        r = manager_read_job_reply(reply, &error, &job);
+        if (r < 0) {
+                log_error_errno(r, "Failed to start session scope %s: %s", s->scope, bus_error_message(&error, r));
+
+                if (!sd_bus_error_is_set(&error))
+                        (void) sd_bus_error_set_errno(&error, r);
+
+                (void) session_send_create_reply(s, &error);
+
+                session_add_to_gc_queue(s);
+                user_add_to_gc_queue(s->user);
+                return 0;
+        }
+
+        log_debug("Start job for session scope %s enqueued after %s.", s->scope,
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - s->timestamp.monotonic, USEC_PER_MSEC));
+
+        free_and_replace(s->scope_job, job);
+        session_add_to_save_queue(s);
+
+        return 0;
+}
+
 static int session_start_scope(Session *s, sd_bus_message *properties) {
         int r;
 
@@ -546,9 +585,7 @@ static int session_start_scope(Session *s, sd_bus_message *properties) {
         assert(s->user);
 
         if (!s->scope) {
-                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
                 _cleanup_free_ char *scope = NULL;
-                char *job = NULL;
                 const char *description;
 
                 scope = strjoin("session-", s->id, ".scope");
@@ -557,6 +594,8 @@ static int session_start_scope(Session *s, sd_bus_message *properties) {
 
                 description = strjoina("Session ", s->id, " of user ", s->user->name);
 
+                /* The reply is picked up by session_start_scope_reply(), and the CreateSession() call is
+                 * answered once the job is through, see session_send_create_reply(). */
                 r = manager_start_scope(
                                 s->manager,
                                 scope,
@@ -566,14 +605,13 @@ static int session_start_scope(Session *s, sd_bus_message *properties) {
                                 "systemd-logind.service",
                                 "systemd-user-sessions.service",
                                 properties,
-                                &error,
-                                &job);
+                                session_start_scope_reply,
+                                s,
+                                &s->scope_start_slot);
                 if (r < 0)
-                        return log_error_errno(r, "Failed to start session scope %s: %s", scope, bus_error_message(&error, r));
-
+                        return log_error_errno(r, "Failed to start session scope %s: %m", scope);
 
                 s->scope = TAKE_PTR(scope);
-                free_and_replace(s->scope_job, job);
         }
 
         if (s->scope)
@@ -593,6 +631,10 @@ int session_start(Session *s, sd_bus_message *properties) {
         if (s->started)
                 return 0;
 
+        /* Take the timestamp before anything is started, the timings logged for the start jobs are relative to it */
+        if (!dual_timestamp_is_set(&s->timestamp))
+                dual_timestamp_get(&s->timestamp);
+
         r = user_start(s->user);
         if (r < 0)
                 return r;
@@ -609,9 +651,6 @@ int session_start(Session *s, sd_bus_message *properties) {
                    "LEADER="PID_FMT, s->leader,
                    LOG_MESSAGE("New session %s of user %s.", s->id, s->user->name));
 
-        if (!dual_timestamp_is_set(&s->timestamp))
-                dual_timestamp_get(&s->timestamp);
-
         if (s->seat)
                 seat_read_active_vt(s->seat);
 
@@ -620,10 +659,10 @@ int session_start(Session *s, sd_bus_message *properties) {
         user_elect_display(s->user);
 
         /* Save data */
-        session_save(s);
-        user_save(s->user);
+        session_add_to_save_queue(s);
+        user_add_to_save_queue(s->user);
         if (s->seat)
-                seat_save(s->seat);
+                seat_add_to_save_queue(s->seat);
 
         /* Send signals */
         session_send_signal(s, true);
@@ -701,8 +740,8 @@ int session_stop(Session *s, bool force) {
 
         user_elect_display(s->user);
 
-        session_save(s);
-        user_save(s->user);
+        session_add_to_save_queue(s);
+        user_add_to_save_queue(s->user);
 
         return r;
 }
@@ -745,10 +784,10 @@ int session_finalize(Session *s) {
                 if (s->seat->active == s)
                         seat_set_active(s->seat, NULL);
 
-                seat_save(s->seat);
+                seat_add_to_save_queue(s->seat);
         }
 
-        user_save(s->user);
+        user_add_to_save_queue(s->user);
         user_send_changed(s->user, "Display", NULL);
 
         return 0;
@@ -1000,6 +1039,9 @@ bool session_may_gc(Session *s, bool drop_not_started) {
                         return false;
         }
 
+        if (s->scope_start_slot)
+                return false;
+
         if (s->scope_job && manager_job_is_active(s->manager, s->scope_job))
                 return false;
 
@@ -1019,6 +1061,19 @@ void session_add_to_gc_queue(Session *s) {
         s->in_gc_queue = true;
 }
 
+void session_add_to_save_queue(Session *s) {
+        assert(s);
+
+        /* The state file is written out once we are through with the current event, so that multiple changes in a
+         * row only result in a single write */
+
+        if (s->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, s->manager->session_save_queue, s);
+        s->in_save_queue = true;
+}
+
 SessionState session_get_state(Session *s) {
         assert(s);
 
@@ -1026,7 +1081,7 @@ SessionState session_get_state(Session *s) {
         if (s->stopping || s->timer_event_source)
                 return SESSION_CLOSING;
 
-        if (s->scope_job || s->fifo_fd < 0)
+        if (s->scope_start_slot || s->scope_job || s->fifo_fd < 0)
                 return SESSION_OPENING;
 
         if (session_is_active(s))
@@ -1257,7 +1312,7 @@ int session_set_controller(Session *s, const char *sender, bool force, bool prep
 
         session_release_controller(s, true);
         s->controller = TAKE_PTR(name);
-        session_save(s);
+        session_add_to_save_queue(s);
 
         return 0;
 }
@@ -1270,7 +1325,7 @@ void session_drop_controller(Session *s) {
 
         s->track = sd_bus_track_unref(s->track);
         session_release_controller(s, false);
-        session_save(s);
+        session_add_to_save_queue(s);
         session_restore_vt(s);
 }
 
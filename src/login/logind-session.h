@@ -71,6 +71,7 @@ struct Session {
 
         char *scope;
         char *scope_job;
+        sd_bus_slot *scope_start_slot;
 
         Seat *seat;
         unsigned int vtnr;
@@ -90,6 +91,7 @@ struct Session {
         bool locked_hint;
 
         bool in_gc_queue:1;
+        bool in_save_queue:1;
         bool started:1;
         bool stopping:1;
 
@@ -107,6 +109,7 @@ struct Session {
         LIST_FIELDS(Session, sessions_by_seat);
 
         LIST_FIELDS(Session, gc_queue);
+        LIST_FIELDS(Session, save_queue);
 };
 
 Session *session_new(Manager *m, const char *id);
@@ -114,6 +117,7 @@ void session_free(Session *s);
 void session_set_user(Session *s, User *u);
 bool session_may_gc(Session *s, bool drop_not_started);
 void session_add_to_gc_queue(Session *s);
+void session_add_to_save_queue(Session *s);
 int session_activate(Session *s);
 bool session_is_active(Session *s);
 int session_get_idle_hint(Session *s, dual_timestamp *t);
@@ -90,6 +90,9 @@ User *user_free(User *u) {
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->user_gc_queue, u);
 
+        if (u->in_save_queue)
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+
         while (u->sessions)
                 session_free(u->sessions);
 
@@ -103,6 +106,7 @@ User *user_free(User *u) {
 
         u->slice_job = mfree(u->slice_job);
         u->service_job = mfree(u->service_job);
+        u->service_start_slot = sd_bus_slot_unref(u->service_start_slot);
 
         u->service = mfree(u->service);
         u->slice = mfree(u->slice);
@@ -310,25 +314,58 @@ int user_load(User *u) {
         return r;
 }
 
-static int user_start_service(User *u) {
+static int user_start_service_reply(sd_bus_message *reply, void *userdata, sd_bus_error *ret_error) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        char *job;
+        char ts[FORMAT_TIMESPAN_MAX];
+        User *u = userdata;
+        char *job = NULL;
+        Session *s;
+        int r;
+
+        assert(reply);
+        assert(u);
+
+        u->service_start_slot = sd_bus_slot_unref(u->service_start_slot);
+
+        r = manager_read_job_reply(reply, &error, &job);
+        if (r < 0) {
+                /* we don't fail due to this, let's try to continue */
+                log_error_errno(r, "Failed to start user service, ignoring: %s", bus_error_message(&error, r));
+
+                /* Sessions that only waited for us may be answered now */
+                LIST_FOREACH(sessions_by_user, s, u->sessions)
+                        (void) session_send_create_reply(s, NULL);
+
+                return 0;
+        }
+
+        log_debug("Start job for user service %s enqueued after %s.", u->service,
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - u->service_start_usec, USEC_PER_MSEC));
+
+        free_and_replace(u->service_job, job);
+        user_add_to_save_queue(u);
+
+        return 0;
+}
+
+static int user_start_service(User *u) {
         int r;
 
         assert(u);
 
         u->service_job = mfree(u->service_job);
+        u->service_start_slot = sd_bus_slot_unref(u->service_start_slot);
+        u->service_start_usec = now(CLOCK_MONOTONIC);
 
         r = manager_start_unit(
                         u->manager,
                         u->service,
-                        &error,
-                        &job);
+                        user_start_service_reply,
+                        u,
+                        &u->service_start_slot);
         if (r < 0)
                 /* we don't fail due to this, let's try to continue */
-                log_error_errno(r, "Failed to start user service, ignoring: %s", bus_error_message(&error, r));
-        else
-                u->service_job = job;
+                log_error_errno(r, "Failed to start user service, ignoring: %m");
 
         return 0;
 }
@@ -378,7 +415,7 @@ int user_start(User *u) {
         }
 
         /* Save new user data */
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return 0;
 }
@@ -418,7 +455,7 @@ int user_stop(User *u, bool force) {
 
         /* Stop jobs have already been queued */
         if (u->stopping) {
-                user_save(u);
+                user_add_to_save_queue(u);
                 return r;
         }
 
@@ -440,7 +477,7 @@ int user_stop(User *u, bool force) {
 
         u->stopping = true;
 
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return r;
 }
@@ -544,6 +581,9 @@ bool user_may_gc(User *u, bool drop_not_started) {
         if (user_check_linger_file(u) > 0)
                 return false;
 
+        if (u->service_start_slot)
+                return false;
+
         if (u->slice_job && manager_job_is_active(u->manager, u->slice_job))
                 return false;
 
@@ -563,6 +603,16 @@ void user_add_to_gc_queue(User *u) {
         u->in_gc_queue = true;
 }
 
+void user_add_to_save_queue(User *u) {
+        assert(u);
+
+        if (u->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, u->manager->user_save_queue, u);
+        u->in_save_queue = true;
+}
+
 UserState user_get_state(User *u) {
         Session *i;
 
@@ -571,7 +621,7 @@ UserState user_get_state(User *u) {
         if (u->stopping)
                 return USER_CLOSING;
 
-        if (!u->started || u->slice_job || u->service_job)
+        if (!u->started || u->service_start_slot || u->slice_job || u->service_job)
                 return USER_OPENING;
 
         if (u->sessions) {
@@ -30,17 +30,21 @@ struct User {
 
         char *service_job;
         char *slice_job;
+        sd_bus_slot *service_start_slot;
+        usec_t service_start_usec;
 
         Session *display;
 
         dual_timestamp timestamp;
 
         bool in_gc_queue:1;
+        bool in_save_queue:1;
         bool started:1;
         bool stopping:1;
 
         LIST_HEAD(Session, sessions);
         LIST_FIELDS(User, gc_queue);
+        LIST_FIELDS(User, save_queue);
 };
 
 int user_new(User **out, Manager *m, uid_t uid, gid_t gid, const char *name);
@@ -50,6 +54,7 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(User *, user_free);
 
 bool user_may_gc(User *u, bool drop_not_started);
 void user_add_to_gc_queue(User *u);
+void user_add_to_save_queue(User *u);
 int user_start(User *u);
 int user_stop(User *u, bool force);
 int user_finalize(User *u);
@@ -986,6 +986,37 @@ static void manager_gc(Manager *m, bool drop_not_started) {
         }
 }
 
+static void manager_dispatch_save_queue(Manager *m) {
+        Seat *seat;
+        Session *session;
+        User *user;
+
+        assert(m);
+
+        /* Write out the state files of everything that changed since the last time we got here */
+
+        while ((seat = m->seat_save_queue)) {
+                LIST_REMOVE(save_queue, m->seat_save_queue, seat);
+                seat->in_save_queue = false;
+
+                (void) seat_save(seat);
+        }
+
+        while ((session = m->session_save_queue)) {
+                LIST_REMOVE(save_queue, m->session_save_queue, session);
+                session->in_save_queue = false;
+
+                (void) session_save(session);
+        }
+
+        while ((user = m->user_save_queue)) {
+                LIST_REMOVE(save_queue, m->user_save_queue, user);
+                user->in_save_queue = false;
+
+                (void) user_save(user);
+        }
+}
+
 static int manager_dispatch_idle_action(sd_event_source *s, uint64_t t, void *userdata) {
         Manager *m = userdata;
         struct dual_timestamp since;
@@ -1160,8 +1191,10 @@ static int manager_run(Manager *m) {
                 r = sd_event_get_state(m->event);
                 if (r < 0)
                         return r;
-                if (r == SD_EVENT_FINISHED)
+                if (r == SD_EVENT_FINISHED) {
+                        manager_dispatch_save_queue(m);
                         return 0;
+                }
 
                 manager_gc(m, true);
 
@@ -1171,6 +1204,8 @@ static int manager_run(Manager *m) {
                 if (r > 0)
                         continue;
 
+                manager_dispatch_save_queue(m);
+
                 r = sd_event_run(m->event, (uint64_t) -1);
                 if (r < 0)
                         return r;
@@ -35,6 +35,10 @@ struct Manager {
         LIST_HEAD(Session, session_gc_queue);
         LIST_HEAD(User, user_gc_queue);
 
+        LIST_HEAD(Seat, seat_save_queue);
+        LIST_HEAD(Session, session_save_queue);
+        LIST_HEAD(User, user_save_queue);
+
         struct udev_monitor *udev_seat_monitor, *udev_device_monitor, *udev_vcsa_monitor, *udev_button_monitor;
 
         sd_event_source *console_active_event_source;
@@ -161,8 +165,9 @@ int bus_manager_shutdown_or_sleep_now_or_later(Manager *m, const char *unit_name
 
 int manager_send_changed(Manager *manager, const char *property, ...) _sentinel_;
 
-int manager_start_scope(Manager *manager, const char *scope, pid_t pid, const char *slice, const char *description, const char *after, const char *after2, sd_bus_message *more_properties, sd_bus_error *error, char **job);
-int manager_start_unit(Manager *manager, const char *unit, sd_bus_error *error, char **job);
+int manager_start_scope(Manager *manager, const char *scope, pid_t pid, const char *slice, const char *description, const char *after, const char *after2, sd_bus_message *more_properties, sd_bus_message_handler_t callback, void *userdata, sd_bus_slot **ret_slot);
+int manager_start_unit(Manager *manager, const char *unit, sd_bus_message_handler_t callback, void *userdata, sd_bus_slot **ret_slot);
+int manager_read_job_reply(sd_bus_message *reply, sd_bus_error *error, char **job);
 int manager_stop_unit(Manager *manager, const char *unit, sd_bus_error *error, char **job);
 int manager_abandon_scope(Manager *manager, const char *scope, sd_bus_error *error);
 int manager_kill_unit(Manager *manager, const char *unit, KillWho who, int signo, sd_bus_error *error);
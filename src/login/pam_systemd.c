@@ -327,9 +327,11 @@ _public_ PAM_EXTERN int pam_sm_open_session(
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         int session_fd = -1, existing, r;
         bool debug = false, remote;
+        char ts[FORMAT_TIMESPAN_MAX];
         struct passwd *pw;
         uint32_t vtnr = 0;
         uid_t original_uid;
+        usec_t start;
 
         assert(handle);
 
@@ -532,6 +534,8 @@ _public_ PAM_EXTERN int pam_sm_open_session(
                 return PAM_SYSTEM_ERR;
         }
 
+        start = now(CLOCK_MONOTONIC);
+
         r = sd_bus_call(bus, m, 0, &error, &reply);
         if (r < 0) {
                 if (sd_bus_error_has_name(&error, BUS_ERROR_SESSION_BUSY)) {
@@ -559,8 +563,9 @@ _public_ PAM_EXTERN int pam_sm_open_session(
         }
 
         if (debug)
-                pam_syslog(handle, LOG_DEBUG, "Reply from logind: "
+                pam_syslog(handle, LOG_DEBUG, "Reply from logind after %s: "
                            "id=%s object_path=%s runtime_path=%s session_fd=%d seat=%s vtnr=%u original_uid=%u",
+                           format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC),
                            id, object_path, runtime_path, session_fd, seat, vtnr, original_uid);
 
         r = update_environment(handle, "XDG_SESSION_ID", id);
@@ -230,6 +230,8 @@ int bus_image_method_mark_read_only(
         if (r < 0)
                 return r;
 
+        manager_flush_discovered_images(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -269,6 +271,8 @@ int bus_image_method_set_limit(
         if (r < 0)
                 return r;
 
+        manager_flush_discovered_images(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -376,6 +380,59 @@ const sd_bus_vtable image_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+/* Listing all images means stat()ing and opening each of them, and querying btrfs quota for subvolumes. The result
+ * is hence cached, and reused as long as no image was added, removed or renamed in the search path. The usage
+ * reported for images may change without that, hence rescan anyway once the cached result gets too old. */
+#define DISCOVERED_IMAGES_MAX_AGE_USEC (5 * USEC_PER_SEC)
+
+int manager_discover_images(Manager *m, Hashmap **ret) {
+        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
+        uint64_t fingerprint;
+        usec_t n;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns the cached list of images. The hashmap is owned by the manager and only valid until the next
+         * call. */
+
+        r = image_discover_fingerprint(IMAGE_MACHINE, &fingerprint);
+        if (r < 0)
+                return r;
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (m->discovered_images &&
+            m->discovered_images_fingerprint == fingerprint &&
+            m->discovered_images_timestamp + DISCOVERED_IMAGES_MAX_AGE_USEC > n) {
+                *ret = m->discovered_images;
+                return 0;
+        }
+
+        images = hashmap_new(&string_hash_ops);
+        if (!images)
+                return -ENOMEM;
+
+        r = image_discover(IMAGE_MACHINE, images);
+        if (r < 0)
+                return r;
+
+        image_hashmap_free(m->discovered_images);
+        m->discovered_images = TAKE_PTR(images);
+        m->discovered_images_fingerprint = fingerprint;
+        m->discovered_images_timestamp = n;
+
+        *ret = m->discovered_images;
+        return 1;
+}
+
+void manager_flush_discovered_images(Manager *m) {
+        assert(m);
+
+        m->discovered_images = image_hashmap_free(m->discovered_images);
+}
+
 static int image_flush_cache(sd_event_source *s, void *userdata) {
         Manager *m = userdata;
 
@@ -461,8 +518,9 @@ char *image_bus_path(const char *name) {
 }
 
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
-        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
         _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -470,12 +528,9 @@ int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char **
         assert(bus);
         assert(path);
         assert(nodes);
+        assert(m);
 
-        images = hashmap_new(&string_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(IMAGE_MACHINE, images);
+        r = manager_discover_images(m, &images);
         if (r < 0)
                 return r;
 
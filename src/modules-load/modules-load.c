@@ -4,6 +4,7 @@
 #include <getopt.h>
 #include <libkmod.h>
 #include <limits.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -19,10 +20,24 @@
 #include "terminal-util.h"
 #include "util.h"
 
+/* Module initialization may take a while, e.g. because hardware is probed, hence load modules on a couple of threads
+ * at the same time. Dependencies, including soft dependencies, are still loaded in order, by libkmod. */
+#define LOAD_THREADS_MAX 8U
+
 static char **arg_proc_cmdline_modules = NULL;
 
 static const char conf_file_dirs[] = CONF_PATHS_NULSTR("modules-load.d");
 
+typedef struct LoadWorker {
+        char **modules;
+        size_t n_modules;
+        size_t *next;
+
+        int r;
+        pthread_t thread;
+        bool started;
+} LoadWorker;
+
 static void systemd_kmod_log(void *data, int priority, const char *file, int line,
                              const char *fn, const char *format, va_list args) {
 
@@ -31,6 +46,19 @@ static void systemd_kmod_log(void *data, int priority, const char *file, int lin
         REENABLE_WARNING;
 }
 
+static struct kmod_ctx *context_new(void) {
+        struct kmod_ctx *ctx;
+
+        ctx = kmod_new(NULL, NULL);
+        if (!ctx)
+                return NULL;
+
+        kmod_load_resources(ctx);
+        kmod_set_log_fn(ctx, systemd_kmod_log, NULL);
+
+        return ctx;
+}
+
 static int add_modules(const char *p) {
         _cleanup_strv_free_ char **k = NULL;
 
@@ -60,11 +88,25 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
         return 0;
 }
 
-static int apply_file(struct kmod_ctx *ctx, const char *path, bool ignore_enoent) {
+static int add_module(char ***modules, const char *module) {
+        assert(modules);
+        assert(module);
+
+        /* Modules listed more than once are loaded only once, i.e. at the first place listed */
+        if (strv_contains(*modules, module))
+                return 0;
+
+        if (strv_extend(modules, module) < 0)
+                return log_oom();
+
+        return 0;
+}
+
+static int read_file(char ***modules, const char *path, bool ignore_enoent) {
         _cleanup_fclose_ FILE *f = NULL;
         int r;
 
-        assert(ctx);
+        assert(modules);
         assert(path);
 
         r = search_and_fopen_nulstr(path, "re", NULL, conf_file_dirs, &f);
@@ -93,9 +135,80 @@ static int apply_file(struct kmod_ctx *ctx, const char *path, bool ignore_enoent
                 if (strchr(COMMENTS "\n", *l))
                         continue;
 
-                k = module_load_and_warn(ctx, l, true);
-                if (k < 0 && r == 0)
-                        r = k;
+                k = add_module(modules, l);
+                if (k < 0)
+                        return k;
+        }
+
+        return r;
+}
+
+static void *load_thread(void *p) {
+        _cleanup_(kmod_unrefp) struct kmod_ctx *ctx = NULL;
+        LoadWorker *w = p;
+
+        /* libkmod contexts must not be used from more than one thread at a time, hence every thread gets its own */
+        ctx = context_new();
+        if (!ctx) {
+                w->r = log_oom();
+                return NULL;
+        }
+
+        for (;;) {
+                size_t i;
+                int k;
+
+                i = __sync_fetch_and_add(w->next, 1);
+                if (i >= w->n_modules)
+                        break;
+
+                k = module_load_and_warn(ctx, w->modules[i], true);
+                if (k < 0 && w->r == 0)
+                        w->r = k;
+        }
+
+        return NULL;
+}
+
+static int load_modules(char **modules) {
+        LoadWorker workers[LOAD_THREADS_MAX] = {};
+        size_t n_modules, next = 0;
+        unsigned n_threads, k;
+        long n_cpus;
+        int r = 0;
+
+        n_modules = strv_length(modules);
+        if (n_modules == 0)
+                return 0;
+
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = MIN3((unsigned) MIN(n_modules, (size_t) UINT_MAX),
+                         n_cpus > 0 ? (unsigned) n_cpus : 1U,
+                         LOAD_THREADS_MAX);
+
+        for (k = 0; k < n_threads; k++)
+                workers[k] = (LoadWorker) {
+                        .modules = modules,
+                        .n_modules = n_modules,
+                        .next = &next,
+                };
+
+        /* The first worker runs on this thread, hence we also make progress if we can't start any threads */
+        for (k = 1; k < n_threads; k++) {
+                if (pthread_create(&workers[k].thread, NULL, load_thread, workers + k) != 0)
+                        break;
+
+                workers[k].started = true;
+        }
+
+        (void) load_thread(workers);
+
+        for (k = 0; k < n_threads; k++) {
+                if (workers[k].started)
+                        assert_se(pthread_join(workers[k].thread, NULL) == 0);
+
+                if (workers[k].r < 0 && r == 0)
+                        r = workers[k].r;
         }
 
         return r;
@@ -159,8 +272,8 @@ static int parse_argv(int argc, char *argv[]) {
 }
 
 int main(int argc, char *argv[]) {
+        _cleanup_strv_free_ char **modules = NULL;
         int r, k;
-        _cleanup_(kmod_unrefp) struct kmod_ctx *ctx = NULL;
 
         r = parse_argv(argc, argv);
         if (r <= 0)
@@ -176,22 +289,17 @@ int main(int argc, char *argv[]) {
         if (r < 0)
                 log_warning_errno(r, "Failed to parse kernel command line, ignoring: %m");
 
-        ctx = kmod_new(NULL, NULL);
-        if (!ctx) {
-                log_error("Failed to allocate memory for kmod.");
-                goto finish;
-        }
-
-        kmod_load_resources(ctx);
-        kmod_set_log_fn(ctx, systemd_kmod_log, NULL);
-
         r = 0;
 
         if (argc > optind) {
                 int i;
 
                 for (i = optind; i < argc; i++) {
-                        k = apply_file(ctx, argv[i], false);
+                        k = read_file(&modules, argv[i], false);
+                        if (k == -ENOMEM) {
+                                r = k;
+                                goto finish;
+                        }
                         if (k < 0 && r == 0)
                                 r = k;
                 }
@@ -201,9 +309,11 @@ int main(int argc, char *argv[]) {
                 char **fn, **i;
 
                 STRV_FOREACH(i, arg_proc_cmdline_modules) {
-                        k = module_load_and_warn(ctx, *i, true);
-                        if (k < 0 && r == 0)
+                        k = add_module(&modules, *i);
+                        if (k < 0) {
                                 r = k;
+                                goto finish;
+                        }
                 }
 
                 k = conf_files_list_nulstr(&files, ".conf", NULL, 0, conf_file_dirs);
@@ -215,12 +325,20 @@ int main(int argc, char *argv[]) {
                 }
 
                 STRV_FOREACH(fn, files) {
-                        k = apply_file(ctx, *fn, true);
+                        k = read_file(&modules, *fn, true);
+                        if (k == -ENOMEM) {
+                                r = k;
+                                goto finish;
+                        }
                         if (k < 0 && r == 0)
                                 r = k;
                 }
         }
 
+        k = load_modules(modules);
+        if (k < 0 && r == 0)
+                r = k;
+
 finish:
         strv_free(arg_proc_cmdline_modules);
 
@@ -5,6 +5,7 @@
 
 #include <ctype.h>
 
+#include "bitmap.h"
 #include "conf-parser.h"
 #include "def.h"
 #include "dhcp-identifier.h"
@@ -12,6 +13,7 @@
 #include "hexdecoct.h"
 #include "networkd-conf.h"
 #include "networkd-network.h"
+#include "networkd-route.h"
 #include "string-table.h"
 
 int manager_parse_config_file(Manager *m) {
@@ -19,7 +21,7 @@ int manager_parse_config_file(Manager *m) {
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/networkd.conf",
                                         CONF_PATHS_NULSTR("systemd/networkd.conf.d"),
-                                        "DHCP\0",
+                                        "Network\0DHCP\0",
                                         config_item_perf_lookup, networkd_gperf_lookup,
                                         CONFIG_PARSE_WARN, m);
 }
@@ -164,3 +166,60 @@ int config_parse_duid_rawdata(
         ret->raw_data_len = count;
         return 0;
 }
+
+int config_parse_ignore_foreign_routes(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Bitmap **protocols = data;
+        const char *p = rvalue;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(protocols);
+
+        if (isempty(rvalue)) {
+                bitmap_free(*protocols);
+                *protocols = NULL;
+                return 0;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *word = NULL;
+                unsigned char protocol;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r, "Failed to parse %s= setting, ignoring: %s", lvalue, rvalue);
+                        return 0;
+                }
+                if (r == 0)
+                        return 0;
+
+                r = route_protocol_from_string(word, &protocol);
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r, "Could not parse route protocol \"%s\", ignoring: %m", word);
+                        continue;
+                }
+
+                r = bitmap_ensure_allocated(protocols);
+                if (r < 0)
+                        return log_oom();
+
+                r = bitmap_set(*protocols, protocol);
+                if (r < 0)
+                        return log_oom();
+        }
+}
@@ -834,9 +834,13 @@ static int link_enter_set_routes(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ROUTES);
 
+        /* Hand all routes to the kernel in as few datagrams as possible */
+        (void) sd_netlink_cork(link->manager->rtnl, true);
+
         LIST_FOREACH(routes, rt, link->network->static_routes) {
                 r = route_configure(rt, link, route_handler);
                 if (r < 0) {
+                        (void) sd_netlink_cork(link->manager->rtnl, false);
                         log_link_warning_errno(link, r, "Could not set routes: %m");
                         link_enter_failed(link);
                         return r;
@@ -845,6 +849,9 @@ static int link_enter_set_routes(Link *link) {
                 link->route_messages++;
         }
 
+        /* Failures to write are reported to the handlers of the individual messages */
+        (void) sd_netlink_cork(link->manager->rtnl, false);
+
         if (link->route_messages == 0) {
                 link->static_routes_configured = true;
                 link_check_ready(link);
@@ -1056,9 +1063,12 @@ static int link_enter_set_addresses(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ADDRESSES);
 
+        (void) sd_netlink_cork(link->manager->rtnl, true);
+
         LIST_FOREACH(addresses, ad, link->network->static_addresses) {
                 r = address_configure(ad, link, address_handler, false);
                 if (r < 0) {
+                        (void) sd_netlink_cork(link->manager->rtnl, false);
                         log_link_warning_errno(link, r, "Could not set addresses: %m");
                         link_enter_failed(link);
                         return r;
@@ -1070,6 +1080,7 @@ static int link_enter_set_addresses(Link *link) {
         LIST_FOREACH(labels, label, link->network->address_labels) {
                 r = address_label_configure(label, link, address_label_handler, false);
                 if (r < 0) {
+                        (void) sd_netlink_cork(link->manager->rtnl, false);
                         log_link_warning_errno(link, r, "Could not set address label: %m");
                         link_enter_failed(link);
                         return r;
@@ -1078,6 +1089,9 @@ static int link_enter_set_addresses(Link *link) {
                 link->address_label_messages++;
         }
 
+        /* Failures to write are reported to the handlers of the individual messages */
+        (void) sd_netlink_cork(link->manager->rtnl, false);
+
         /* now that we can figure out a default address for the dhcp server,
            start it */
         if (link_dhcp4_server_enabled(link) && (link->flags & IFF_UP)) {
@@ -441,6 +441,11 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         switch (type) {
         case RTM_NEWROUTE:
                 if (!route) {
+                        /* Skip routes installed by routing daemons and such if so configured: with a full table
+                         * there can easily be hundreds of thousands of them, and we have no business with them */
+                        if (bitmap_isset(m->ignore_foreign_routes, protocol))
+                                return 0;
+
                         /* A route appeared that we did not request */
                         r = route_add_foreign(link, family, &dst, dst_prefixlen, tos, priority, table, &route);
                         if (r < 0) {
@@ -1390,10 +1395,22 @@ int manager_new(Manager **ret) {
         (void) sd_event_add_signal(m->event, NULL, SIGTERM, NULL, NULL);
         (void) sd_event_add_signal(m->event, NULL, SIGINT, NULL, NULL);
 
-        r = sd_event_add_post(m->event, NULL, manager_dirty_handler, m);
+        /* State files are written once everything queued up has been processed, so that a burst of changes on
+         * many links results in a single write of each file, rather than one for every event dispatched. */
+        r = sd_event_add_defer(m->event, &m->dirty_event_source, manager_dirty_handler, m);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(m->dirty_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(m->dirty_event_source, SD_EVENT_OFF);
         if (r < 0)
                 return r;
 
+        (void) sd_event_source_set_description(m->dirty_event_source, "network-dirty");
+
         r = manager_connect_rtnl(m);
         if (r < 0)
                 return r;
@@ -1476,8 +1493,12 @@ void manager_free(Manager *m) {
 
         set_free_with_destructor(m->rules_saved, routing_policy_rule_free);
 
+        bitmap_free(m->ignore_foreign_routes);
+
         sd_netlink_unref(m->rtnl);
         sd_netlink_unref(m->genl);
+
+        sd_event_source_unref(m->dirty_event_source);
         sd_event_unref(m->event);
 
         sd_resolve_unref(m->resolve);
@@ -1739,6 +1760,8 @@ void manager_dirty(Manager *manager) {
 
         /* the serialized state in /run is no longer up-to-date */
         manager->dirty = true;
+
+        (void) sd_event_source_set_enabled(manager->dirty_event_source, SD_EVENT_ONESHOT);
 }
 
 static int set_hostname_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
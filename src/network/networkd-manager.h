@@ -10,6 +10,7 @@
 #include "sd-resolve.h"
 #include "libudev.h"
 
+#include "bitmap.h"
 #include "dhcp-identifier.h"
 #include "hashmap.h"
 #include "list.h"
@@ -34,6 +35,7 @@ struct Manager {
         bool dirty:1;
 
         Set *dirty_links;
+        sd_event_source *dirty_event_source;
 
         char *state_file;
         LinkOperationalState operational_state;
@@ -41,6 +43,7 @@ struct Manager {
         Hashmap *links;
         Hashmap *netdevs;
         Hashmap *networks_by_name;
+        Hashmap *networks_by_match_prefix;
         Hashmap *dhcp6_prefixes;
         LIST_HEAD(Network, networks);
         LIST_HEAD(AddressPool, address_pools);
@@ -59,6 +62,9 @@ struct Manager {
         Set *rules;
         Set *rules_foreign;
         Set *rules_saved;
+
+        /* Protocols (RTPROT_*) of routes that are neither tracked nor touched unless we configured them ourselves */
+        Bitmap *ignore_foreign_routes;
 };
 
 extern const sd_bus_vtable manager_vtable[];
@@ -103,6 +103,102 @@ void network_apply_anonymize_if_set(Network *network) {
         network->dhcp_use_timezone = false;
 }
 
+/* Networks are indexed by the literal beginning of their Name= patterns. A link may only match networks filed under
+ * one of the prefixes of its name, which spares us from looking at every single network for every link. Networks
+ * that do not match on the name, or only when it is not one of the listed, are filed under the empty prefix. */
+
+static bool network_match_name_indexable(Network *network) {
+        assert(network);
+
+        return !strv_isempty(network->match_name) && network->match_name[0][0] != '!';
+}
+
+static int network_index_add(Manager *manager, const char *pattern, size_t n, Network *network) {
+        _cleanup_free_ char *prefix = NULL;
+        Set *s;
+        int r;
+
+        prefix = strndup(pattern, n);
+        if (!prefix)
+                return -ENOMEM;
+
+        s = hashmap_get(manager->networks_by_match_prefix, prefix);
+        if (!s) {
+                r = hashmap_ensure_allocated(&manager->networks_by_match_prefix, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                s = set_new(NULL);
+                if (!s)
+                        return -ENOMEM;
+
+                r = hashmap_put(manager->networks_by_match_prefix, prefix, s);
+                if (r < 0) {
+                        set_free(s);
+                        return r;
+                }
+
+                prefix = NULL;
+        }
+
+        r = set_put(s, network);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+static void network_index_remove(Manager *manager, const char *pattern, size_t n, Network *network) {
+        char *prefix, *key;
+        Set *s;
+
+        prefix = strndupa(pattern, n);
+
+        s = hashmap_get(manager->networks_by_match_prefix, prefix);
+        if (!s)
+                return;
+
+        (void) set_remove(s, network);
+        if (!set_isempty(s))
+                return;
+
+        (void) hashmap_remove2(manager->networks_by_match_prefix, prefix, (void**) &key);
+        free(key);
+        set_free(s);
+}
+
+static size_t match_name_prefix_length(const char *pattern) {
+        return strcspn(pattern, "*?[\\");
+}
+
+static int network_index(Manager *manager, Network *network) {
+        char **p;
+        int r;
+
+        if (!network_match_name_indexable(network))
+                return network_index_add(manager, "", 0, network);
+
+        STRV_FOREACH(p, network->match_name) {
+                r = network_index_add(manager, *p, match_name_prefix_length(*p), network);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void network_unindex(Manager *manager, Network *network) {
+        char **p;
+
+        if (!network_match_name_indexable(network)) {
+                network_index_remove(manager, "", 0, network);
+                return;
+        }
+
+        STRV_FOREACH(p, network->match_name)
+                network_index_remove(manager, *p, match_name_prefix_length(*p), network);
+}
+
 static int network_load_one(Manager *manager, const char *filename) {
         _cleanup_(network_freep) Network *network = NULL;
         _cleanup_fclose_ FILE *file = NULL;
@@ -291,6 +387,10 @@ static int network_load_one(Manager *manager, const char *filename) {
         if (r < 0)
                 return r;
 
+        r = network_index(manager, network);
+        if (r < 0)
+                return r;
+
         LIST_FOREACH(routes, route, network->static_routes) {
                 if (!route->family) {
                         log_warning("Route section without Gateway field configured in %s. "
@@ -352,6 +452,10 @@ void network_free(Network *network) {
 
         free(network->filename);
 
+        /* Needs the patterns to find the entries */
+        if (network->manager && network->manager->networks_by_match_prefix)
+                network_unindex(network->manager, network);
+
         set_free_free(network->match_mac);
         strv_free(network->match_path);
         strv_free(network->match_driver);
@@ -453,12 +557,23 @@ int network_get_by_name(Manager *manager, const char *name, Network **ret) {
         return 0;
 }
 
+static int network_compare(const void *a, const void *b) {
+        Network * const *x = a, * const *y = b;
+
+        /* The order in which conf_files_list() returns the files */
+        return strcmp(basename((*x)->filename), basename((*y)->filename));
+}
+
 int network_get(Manager *manager, sd_device *device,
                 const char *ifname, const struct ether_addr *address,
                 Network **ret) {
         const char *path = NULL, *parent_driver = NULL, *driver = NULL, *devtype = NULL;
+        _cleanup_free_ Network **candidates = NULL;
+        size_t n_candidates = 0, n_allocated = 0, k, l;
+        _cleanup_free_ char *prefix = NULL;
         sd_device *parent;
         Network *network;
+        Iterator i;
 
         assert(manager);
         assert(ret);
@@ -474,7 +589,40 @@ int network_get(Manager *manager, sd_device *device,
                 (void) sd_device_get_devtype(device, &devtype);
         }
 
-        LIST_FOREACH(networks, network, manager->networks) {
+        /* Look up the candidates under all prefixes of the name, the empty one included */
+        if (ifname) {
+                prefix = strdup(ifname);
+                if (!prefix)
+                        return -ENOMEM;
+        }
+
+        for (l = prefix ? strlen(prefix) : 0;; l--) {
+                Set *s;
+
+                if (prefix)
+                        prefix[l] = 0;
+
+                s = hashmap_get(manager->networks_by_match_prefix, strempty(prefix));
+                SET_FOREACH(network, s, i) {
+                        if (!GREEDY_REALLOC(candidates, n_allocated, n_candidates + 1))
+                                return -ENOMEM;
+
+                        candidates[n_candidates++] = network;
+                }
+
+                if (l == 0)
+                        break;
+        }
+
+        /* The first matching file wins, as if we went through all of them in the usual order */
+        qsort_safe(candidates, n_candidates, sizeof(Network*), network_compare);
+
+        for (k = 0; k < n_candidates; k++) {
+                network = candidates[k];
+
+                if (k > 0 && network == candidates[k - 1])
+                        continue;
+
                 if (net_match_config(network->match_mac, network->match_path,
                                      network->match_driver, network->match_type,
                                      network->match_name, network->match_host,
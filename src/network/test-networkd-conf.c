@@ -1,5 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <linux/rtnetlink.h>
+
+#include "bitmap.h"
 #include "ether-addr-util.h"
 #include "hexdecoct.h"
 #include "log.h"
@@ -168,6 +171,22 @@ static void test_config_parse_hwaddr(void) {
         test_config_parse_hwaddrs_one("123.4567.89ab aa:bb:cc:dd:ee:fx hogehoge 01-23-45-67-89-ab aaaa aa:Bb:CC:dd:ee:ff", t, 2);
 }
 
+static void test_config_parse_ignore_foreign_routes(void) {
+        _cleanup_bitmap_free_ Bitmap *b = NULL;
+
+        assert_se(config_parse_ignore_foreign_routes("network", "filename", 1, "section", 1, "lvalue", 0, "boot 186 bird", &b, NULL) == 0);
+        assert_se(bitmap_isset(b, RTPROT_BOOT));
+        assert_se(bitmap_isset(b, 186));
+        assert_se(!bitmap_isset(b, RTPROT_STATIC));
+
+        assert_se(config_parse_ignore_foreign_routes("network", "filename", 1, "section", 1, "lvalue", 0, "static", &b, NULL) == 0);
+        assert_se(bitmap_isset(b, RTPROT_BOOT));
+        assert_se(bitmap_isset(b, RTPROT_STATIC));
+
+        assert_se(config_parse_ignore_foreign_routes("network", "filename", 1, "section", 1, "lvalue", 0, "", &b, NULL) == 0);
+        assert_se(!b);
+}
+
 int main(int argc, char **argv) {
         log_parse_environment();
         log_open();
@@ -175,6 +194,7 @@ int main(int argc, char **argv) {
         test_config_parse_duid_type();
         test_config_parse_duid_rawdata();
         test_config_parse_hwaddr();
+        test_config_parse_ignore_foreign_routes();
 
         return 0;
 }
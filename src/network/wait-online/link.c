@@ -6,6 +6,7 @@
 #include "hashmap.h"
 #include "link.h"
 #include "manager.h"
+#include "network-util.h"
 #include "string-util.h"
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
@@ -102,15 +103,8 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
 int link_update_monitor(Link *l) {
         assert(l);
 
-        l->required_for_online = sd_network_link_get_required_for_online(l->ifindex) != 0;
-
         l->operational_state = mfree(l->operational_state);
-
-        sd_network_link_get_operational_state(l->ifindex, &l->operational_state);
-
         l->state = mfree(l->state);
 
-        sd_network_link_get_setup_state(l->ifindex, &l->state);
-
-        return 0;
+        return network_link_get_state(l->ifindex, &l->required_for_online, &l->operational_state, &l->state);
 }
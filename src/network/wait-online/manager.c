@@ -9,6 +9,8 @@
 #include "manager.h"
 #include "netlink-util.h"
 #include "network-internal.h"
+#include "network-util.h"
+#include "set.h"
 #include "strv.h"
 #include "time-util.h"
 #include "util.h"
@@ -200,20 +202,36 @@ static int manager_rtnl_listen(Manager *m) {
 }
 
 static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_set_free_ Set *changed = NULL;
         Manager *m = userdata;
         Iterator i;
+        void *p;
         Link *l;
         int r;
 
         assert(m);
 
-        sd_network_monitor_flush(m->network_monitor);
+        /* Only reread the state of the links whose state files networkd actually rewrote, rather than of all of
+         * them, which matters with many links. */
+        r = network_monitor_flush_links(m->network_monitor, &changed);
+        if (r < 0)
+                log_debug_errno(r, "Failed to determine changed links, checking all of them: %m");
+        if (r != 0) {
+                HASHMAP_FOREACH(l, m->links, i) {
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
+        } else
+                SET_FOREACH(p, changed, i) {
+                        l = hashmap_get(m->links, p);
+                        if (!l)
+                                continue;
 
-        HASHMAP_FOREACH(l, m->links, i) {
-                r = link_update_monitor(l);
-                if (r < 0)
-                        log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
-        }
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
 
         if (manager_all_configured(m))
                 sd_event_exit(m->event, 0);
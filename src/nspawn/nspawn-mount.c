@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <stdio_ext.h>
 #include <sys/mount.h>
 #include <linux/magic.h>
 
@@ -660,7 +661,7 @@ int mount_all(const char *dest,
         return 0;
 }
 
-static int mount_bind(const char *dest, CustomMount *m) {
+static int mount_bind(const char *dest, CustomMount *m, FILE **proc_self_mountinfo) {
 
         _cleanup_free_ char *where = NULL;
         struct stat source_st, dest_st;
@@ -668,6 +669,7 @@ static int mount_bind(const char *dest, CustomMount *m) {
 
         assert(dest);
         assert(m);
+        assert(proc_self_mountinfo);
 
         if (stat(m->source, &source_st) < 0)
                 return log_error_errno(errno, "Failed to stat %s: %m", m->source);
@@ -713,7 +715,17 @@ static int mount_bind(const char *dest, CustomMount *m) {
                 return r;
 
         if (m->read_only) {
-                r = bind_remount_recursive(where, true, NULL);
+                /* The mount table is rescanned for each read-only bind mount anyway, hence open it only once for all
+                 * of them, instead of once per mount. */
+                if (!*proc_self_mountinfo) {
+                        *proc_self_mountinfo = fopen("/proc/self/mountinfo", "re");
+                        if (!*proc_self_mountinfo)
+                                return log_error_errno(errno, "Failed to open /proc/self/mountinfo: %m");
+
+                        (void) __fsetlocking(*proc_self_mountinfo, FSETLOCKING_BYCALLER);
+                }
+
+                r = bind_remount_recursive_with_mountinfo(where, true, NULL, *proc_self_mountinfo);
                 if (r < 0)
                         return log_error_errno(r, "Read-only bind mount failed: %m");
         }
@@ -815,6 +827,7 @@ int mount_custom(
                 bool userns, uid_t uid_shift, uid_t uid_range,
                 const char *selinux_apifs_context) {
 
+        _cleanup_fclose_ FILE *proc_self_mountinfo = NULL;
         size_t i;
         int r;
 
@@ -826,7 +839,7 @@ int mount_custom(
                 switch (m->type) {
 
                 case CUSTOM_MOUNT_BIND:
-                        r = mount_bind(dest, m);
+                        r = mount_bind(dest, m, &proc_self_mountinfo);
                         break;
 
                 case CUSTOM_MOUNT_TMPFS:
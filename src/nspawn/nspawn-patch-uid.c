@@ -175,8 +175,6 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
                 return 0;
 
         r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
-        if (r == -EOPNOTSUPP)
-                return 0;
         if (r < 0)
                 return r;
 
@@ -219,12 +217,12 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
 #else
 
 static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift) {
-        return 0;
+        return -EOPNOTSUPP;
 }
 
 #endif
 
-static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift, bool *acls) {
         uid_t new_uid;
         gid_t new_gid;
         bool changed = false;
@@ -232,6 +230,7 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
 
         assert(fd >= 0);
         assert(st);
+        assert(acls);
 
         new_uid =         shift | (st->st_uid & UINT32_C(0xFFFF));
         new_gid = (gid_t) shift | (st->st_gid & UINT32_C(0xFFFF));
@@ -247,21 +246,32 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
                 if (r < 0)
                         return -errno;
 
-                /* The Linux kernel alters the mode in some cases of chown(). Let's undo this. */
-                if (name) {
-                        if (!S_ISLNK(st->st_mode))
-                                r = fchmodat(fd, name, st->st_mode, 0);
-                        else /* AT_SYMLINK_NOFOLLOW is not available for fchmodat() */
-                                r = 0;
-                } else
-                        r = fchmod(fd, st->st_mode);
-                if (r < 0)
-                        return -errno;
+                /* The Linux kernel alters the mode in some cases of chown(). Let's undo this. It only ever drops the
+                 * SUID/SGID bits though, hence don't bother if neither is set. */
+                if (st->st_mode & (S_ISUID|S_ISGID)) {
+                        if (name) {
+                                if (!S_ISLNK(st->st_mode))
+                                        r = fchmodat(fd, name, st->st_mode, 0);
+                                else /* AT_SYMLINK_NOFOLLOW is not available for fchmodat() */
+                                        r = 0;
+                        } else
+                                r = fchmod(fd, st->st_mode);
+                        if (r < 0)
+                                return -errno;
+                }
 
                 changed = true;
         }
 
+        if (!*acls)
+                return changed;
+
         r = patch_acls(fd, name, st, shift);
+        if (r == -EOPNOTSUPP) {
+                /* ACLs are a property of the file system, hence don't bother asking again for every single inode */
+                *acls = false;
+                return changed;
+        }
         if (r < 0)
                 return r;
 
@@ -296,33 +306,44 @@ static int is_fs_fully_userns_compatible(const struct statfs *sfs) {
                F_TYPE_EQUAL(sfs->f_type, SYSFS_MAGIC);
 }
 
-static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift, bool is_toplevel) {
+static int recurse_fd(int fd, bool donate_fd, const struct stat *st, const struct stat *parent_st, bool parent_acls, uid_t shift, bool is_toplevel) {
         _cleanup_closedir_ DIR *d = NULL;
-        bool changed = false;
-        struct statfs sfs;
+        bool changed = false, acls;
         int r;
 
         assert(fd >= 0);
 
-        if (fstatfs(fd, &sfs) < 0)
-                return -errno;
+        if (!parent_st || st->st_dev != parent_st->st_dev) {
+                struct statfs sfs;
 
-        /* We generally want to permit crossing of mount boundaries when patching the UIDs/GIDs. However, we probably
-         * shouldn't do this for /proc and /sys if that is already mounted into place. Hence, let's stop the recursion
-         * when we hit procfs, sysfs or some other special file systems. */
+                if (fstatfs(fd, &sfs) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
 
-        r = is_fs_fully_userns_compatible(&sfs);
-        if (r < 0)
-                goto finish;
-        if (r > 0) {
-                r = 0; /* don't recurse */
-                goto finish;
-        }
+                /* We generally want to permit crossing of mount boundaries when patching the UIDs/GIDs. However, we
+                 * probably shouldn't do this for /proc and /sys if that is already mounted into place. Hence, let's
+                 * stop the recursion when we hit procfs, sysfs or some other special file systems. */
 
-        /* Also, if we hit a read-only file system, then don't bother, skip the whole subtree */
-        if ((sfs.f_flags & ST_RDONLY) ||
-            access_fd(fd, W_OK) == -EROFS)
-                goto read_only;
+                r = is_fs_fully_userns_compatible(&sfs);
+                if (r < 0)
+                        goto finish;
+                if (r > 0) {
+                        r = 0; /* don't recurse */
+                        goto finish;
+                }
+
+                /* Also, if we hit a read-only file system, then don't bother, skip the whole subtree */
+                if ((sfs.f_flags & ST_RDONLY) ||
+                    access_fd(fd, W_OK) == -EROFS)
+                        goto read_only;
+
+                /* A new file system, find out again whether it knows ACLs */
+                acls = true;
+        } else
+                /* Still on the same file system as our parent, hence the checks above would yield the same results,
+                 * skip them. Read-only bind mounts within the same file system are caught by -EROFS below. */
+                acls = parent_acls;
 
         if (S_ISDIR(st->st_mode)) {
                 struct dirent *de;
@@ -349,6 +370,7 @@ static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift
 
                 FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
                         struct stat fst;
+                        bool other_acls = true;
 
                         if (dot_or_dot_dot(de->d_name))
                                 continue;
@@ -368,14 +390,18 @@ static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift
 
                                 }
 
-                                r = recurse_fd(subdir_fd, true, &fst, shift, false);
+                                r = recurse_fd(subdir_fd, true, &fst, st, acls, shift, false);
                                 if (r < 0)
                                         goto finish;
                                 if (r > 0)
                                         changed = true;
 
                         } else {
-                                r = patch_fd(dirfd(d), de->d_name, &fst, shift);
+                                /* Files bind mounted in from elsewhere might live on a file system with different
+                                 * ACL support */
+                                r = patch_fd(dirfd(d), de->d_name, &fst, shift, fst.st_dev == st->st_dev ? &acls : &other_acls);
+                                if (r == -EROFS)
+                                        goto read_only;
                                 if (r < 0)
                                         goto finish;
                                 if (r > 0)
@@ -387,7 +413,7 @@ static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift
         /* After we descended, also patch the directory itself. It's key to do this in this order so that the top-level
          * directory is patched as very last object in the tree, so that we can use it as quick indicator whether the
          * tree is properly chown()ed already. */
-        r = patch_fd(d ? dirfd(d) : fd, NULL, st, shift);
+        r = patch_fd(d ? dirfd(d) : fd, NULL, st, shift, &acls);
         if (r == -EROFS)
                 goto read_only;
         if (r > 0)
@@ -401,7 +427,7 @@ read_only:
                 _cleanup_free_ char *name = NULL;
 
                 /* When we hit a ready-only subtree we simply skip it, but log about it. */
-                (void) fd_get_path(fd, &name);
+                (void) fd_get_path(d ? dirfd(d) : fd, &name);
                 log_debug("Skippping read-only file or directory %s.", strna(name));
                 r = changed;
         }
@@ -470,7 +496,7 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
                 }
         }
 
-        return recurse_fd(fd, donate_fd, &st, shift, true);
+        return recurse_fd(fd, donate_fd, &st, NULL, true, shift, true);
 
 finish:
         if (donate_fd)
@@ -9,12 +9,18 @@
 #include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
 #include "hostname-util.h"
 #include "in-addr-util.h"
 #include "macro.h"
 #include "nss-util.h"
+#include "parse-util.h"
+#include "process-util.h"
 #include "signal-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "user-util.h"
 #include "util.h"
 
@@ -403,15 +409,269 @@ fail:
 
 NSS_GETHOSTBYNAME_FALLBACKS(mymachines);
 
+/* machined publishes the class and leader PID of every machine in /run/systemd/machines/, and the kernel exposes the
+ * ID mappings of the leader in /proc/. That's all machined looks at itself when mapping users and groups, hence we
+ * can do the same here, and save the bus round trip for each lookup. We only go to machined if that fails, for
+ * example because we run in a different mount namespace and don't see the state files. */
+
+static int direct_get_leader(const char *machine, pid_t *ret) {
+        _cleanup_free_ char *class = NULL, *leader = NULL;
+        const char *p;
+        int r;
+
+        assert(machine);
+        assert(ret);
+
+        p = strjoina("/run/systemd/machines/", machine);
+        r = parse_env_file(NULL, p, NEWLINE,
+                           "CLASS", &class,
+                           "LEADER", &leader,
+                           NULL);
+        if (r == -ENOENT)
+                return access("/run/systemd/machines", F_OK) < 0 ? -errno : -ENXIO;
+        if (r < 0)
+                return r;
+
+        if (!streq_ptr(class, "container"))
+                return -ENXIO;
+        if (!leader)
+                return -ENODATA;
+
+        return parse_pid(leader, ret);
+}
+
+static int direct_map_from_machine(const char *machine, const char *map, uint32_t id, uint32_t *ret) {
+        char p[STRLEN("/proc//uid_map") + DECIMAL_STR_MAX(pid_t) + 1];
+        _cleanup_fclose_ FILE *f = NULL;
+        pid_t leader;
+        int r;
+
+        r = direct_get_leader(machine, &leader);
+        if (r < 0)
+                return r;
+
+        xsprintf(p, "/proc/" PID_FMT "/%s", leader, map);
+        f = fopen(p, "re");
+        if (!f)
+                return -errno;
+
+        for (;;) {
+                uint32_t base, shift, range, converted;
+                int k;
+
+                errno = 0;
+                k = fscanf(f, "%" SCNu32 " %" SCNu32 " %" SCNu32, &base, &shift, &range);
+                if (k < 0 && feof(f))
+                        break;
+                if (k != 3) {
+                        if (ferror(f) && errno > 0)
+                                return -errno;
+
+                        return -EIO;
+                }
+
+                if (id < base || id >= base + range)
+                        continue;
+
+                converted = id - base + shift;
+                if (!uid_is_valid(converted))
+                        return -EINVAL;
+
+                *ret = converted;
+                return 0;
+        }
+
+        return -ENXIO;
+}
+
+static int direct_map_to_machine(const char *map, uint32_t id, char **ret_machine, uint32_t *ret) {
+        _cleanup_strv_free_ char **machines = NULL;
+        char **m;
+        int r;
+
+        r = access("/run/systemd/machines", F_OK);
+        if (r < 0)
+                return -errno;
+
+        r = sd_get_machine_names(&machines);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(m, machines) {
+                char p[STRLEN("/proc//uid_map") + DECIMAL_STR_MAX(pid_t) + 1];
+                _cleanup_fclose_ FILE *f = NULL;
+                pid_t leader;
+
+                if (direct_get_leader(*m, &leader) < 0)
+                        continue;
+
+                xsprintf(p, "/proc/" PID_FMT "/%s", leader, map);
+                f = fopen(p, "re");
+                if (!f)
+                        continue;
+
+                for (;;) {
+                        uint32_t base, shift, range, converted;
+                        int k;
+
+                        errno = 0;
+                        k = fscanf(f, "%" SCNu32 " %" SCNu32 " %" SCNu32, &base, &shift, &range);
+                        if (k < 0 && feof(f))
+                                break;
+                        if (k != 3) {
+                                if (ferror(f) && errno > 0)
+                                        return -errno;
+
+                                return -EIO;
+                        }
+
+                        /* The private user namespace is disabled, ignoring. */
+                        if (shift == 0)
+                                continue;
+
+                        if (id < shift || id >= shift + range)
+                                continue;
+
+                        converted = id - shift + base;
+                        if (!uid_is_valid(converted))
+                                return -EINVAL;
+
+                        r = free_and_strdup(ret_machine, *m);
+                        if (r < 0)
+                                return r;
+
+                        *ret = converted;
+                        return 0;
+                }
+        }
+
+        return -ENXIO;
+}
+
+static int bus_map_from_machine(
+                const char *member,
+                const char *no_mapping_error,
+                const char *machine,
+                uint32_t id,
+                uint32_t *ret) {
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int r;
+
+        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                /* Make sure we can't deadlock if we are invoked by dbus-daemon. This way, it won't be able to resolve
+                 * these UIDs, but that should be unproblematic as containers should never be able to connect to a bus
+                 * running on the host. */
+                return -ENXIO;
+
+        if (avoid_deadlock())
+                return -EDEADLK;
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.machine1",
+                               "/org/freedesktop/machine1",
+                               "org.freedesktop.machine1.Manager",
+                               member,
+                               &error,
+                               &reply,
+                               "su",
+                               machine, id);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, no_mapping_error))
+                        return -ENXIO;
+
+                return r;
+        }
+
+        return sd_bus_message_read(reply, "u", ret);
+}
+
+static int bus_map_to_machine(
+                const char *member,
+                const char *no_mapping_error,
+                uint32_t id,
+                char **ret_machine,
+                uint32_t *ret) {
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        const char *machine;
+        int r;
+
+        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                return -ENXIO;
+
+        if (avoid_deadlock())
+                return -EDEADLK;
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.machine1",
+                               "/org/freedesktop/machine1",
+                               "org.freedesktop.machine1.Manager",
+                               member,
+                               &error,
+                               &reply,
+                               "u",
+                               id);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, no_mapping_error))
+                        return -ENXIO;
+
+                return r;
+        }
+
+        r = sd_bus_message_read(reply, "sou", &machine, NULL, ret);
+        if (r < 0)
+                return r;
+
+        return free_and_strdup(ret_machine, machine);
+}
+
+static int map_from_machine(const char *machine, bool group, uint32_t id, uint32_t *ret) {
+        int r;
+
+        /* Returns -ENXIO if there's no mapping */
+
+        r = direct_map_from_machine(machine, group ? "gid_map" : "uid_map", id, ret);
+        if (r >= 0 || r == -ENXIO)
+                return r;
+
+        if (group)
+                return bus_map_from_machine("MapFromMachineGroup", BUS_ERROR_NO_SUCH_GROUP_MAPPING, machine, id, ret);
+
+        return bus_map_from_machine("MapFromMachineUser", BUS_ERROR_NO_SUCH_USER_MAPPING, machine, id, ret);
+}
+
+static int map_to_machine(bool group, uint32_t id, char **ret_machine, uint32_t *ret) {
+        int r;
+
+        r = direct_map_to_machine(group ? "gid_map" : "uid_map", id, ret_machine, ret);
+        if (r >= 0 || r == -ENXIO)
+                return r;
+
+        if (group)
+                return bus_map_to_machine("MapToMachineGroup", BUS_ERROR_NO_SUCH_GROUP_MAPPING, id, ret_machine, ret);
+
+        return bus_map_to_machine("MapToMachineUser", BUS_ERROR_NO_SUCH_USER_MAPPING, id, ret_machine, ret);
+}
+
 enum nss_status _nss_mymachines_getpwnam_r(
                 const char *name,
                 struct passwd *pwd,
                 char *buffer, size_t buflen,
                 int *errnop) {
 
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         const char *p, *e, *machine;
         uint32_t mapped;
         uid_t uid;
@@ -443,38 +703,9 @@ enum nss_status _nss_mymachines_getpwnam_r(
         if (!machine_name_is_valid(machine))
                 return NSS_STATUS_NOTFOUND;
 
-        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
-                /* Make sure we can't deadlock if we are invoked by dbus-daemon. This way, it won't be able to resolve
-                 * these UIDs, but that should be unproblematic as containers should never be able to connect to a bus
-                 * running on the host. */
+        r = map_from_machine(machine, false, uid, &mapped);
+        if (r == -ENXIO)
                 return NSS_STATUS_NOTFOUND;
-
-        if (avoid_deadlock()) {
-                r = -EDEADLK;
-                goto fail;
-        }
-
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call_method(bus,
-                               "org.freedesktop.machine1",
-                               "/org/freedesktop/machine1",
-                               "org.freedesktop.machine1.Manager",
-                               "MapFromMachineUser",
-                               &error,
-                               &reply,
-                               "su",
-                               machine, (uint32_t) uid);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, BUS_ERROR_NO_SUCH_USER_MAPPING))
-                        return NSS_STATUS_NOTFOUND;
-
-                goto fail;
-        }
-
-        r = sd_bus_message_read(reply, "u", &mapped);
         if (r < 0)
                 goto fail;
 
@@ -511,10 +742,7 @@ enum nss_status _nss_mymachines_getpwuid_r(
                 char *buffer, size_t buflen,
                 int *errnop) {
 
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
-        const char *machine;
+        _cleanup_free_ char *machine = NULL;
         uint32_t mapped;
         int r;
 
@@ -528,35 +756,9 @@ enum nss_status _nss_mymachines_getpwuid_r(
         if (uid < HOST_UID_LIMIT)
                 return NSS_STATUS_NOTFOUND;
 
-        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+        r = map_to_machine(false, uid, &machine, &mapped);
+        if (r == -ENXIO)
                 return NSS_STATUS_NOTFOUND;
-
-        if (avoid_deadlock()) {
-                r = -EDEADLK;
-                goto fail;
-        }
-
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call_method(bus,
-                               "org.freedesktop.machine1",
-                               "/org/freedesktop/machine1",
-                               "org.freedesktop.machine1.Manager",
-                               "MapToMachineUser",
-                               &error,
-                               &reply,
-                               "u",
-                               (uint32_t) uid);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, BUS_ERROR_NO_SUCH_USER_MAPPING))
-                        return NSS_STATUS_NOTFOUND;
-
-                goto fail;
-        }
-
-        r = sd_bus_message_read(reply, "sou", &machine, NULL, &mapped);
         if (r < 0)
                 goto fail;
 
@@ -591,9 +793,6 @@ enum nss_status _nss_mymachines_getgrnam_r(
                 char *buffer, size_t buflen,
                 int *errnop) {
 
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         const char *p, *e, *machine;
         uint32_t mapped;
         uid_t gid;
@@ -625,35 +824,9 @@ enum nss_status _nss_mymachines_getgrnam_r(
         if (!machine_name_is_valid(machine))
                 return NSS_STATUS_NOTFOUND;
 
-        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+        r = map_from_machine(machine, true, gid, &mapped);
+        if (r == -ENXIO)
                 return NSS_STATUS_NOTFOUND;
-
-        if (avoid_deadlock()) {
-                r = -EDEADLK;
-                goto fail;
-        }
-
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call_method(bus,
-                               "org.freedesktop.machine1",
-                               "/org/freedesktop/machine1",
-                               "org.freedesktop.machine1.Manager",
-                               "MapFromMachineGroup",
-                               &error,
-                               &reply,
-                               "su",
-                               machine, (uint32_t) gid);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, BUS_ERROR_NO_SUCH_GROUP_MAPPING))
-                        return NSS_STATUS_NOTFOUND;
-
-                goto fail;
-        }
-
-        r = sd_bus_message_read(reply, "u", &mapped);
         if (r < 0)
                 goto fail;
 
@@ -687,10 +860,7 @@ enum nss_status _nss_mymachines_getgrgid_r(
                 char *buffer, size_t buflen,
                 int *errnop) {
 
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
-        const char *machine;
+        _cleanup_free_ char *machine = NULL;
         uint32_t mapped;
         int r;
 
@@ -704,35 +874,9 @@ enum nss_status _nss_mymachines_getgrgid_r(
         if (gid < HOST_GID_LIMIT)
                 return NSS_STATUS_NOTFOUND;
 
-        if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+        r = map_to_machine(true, gid, &machine, &mapped);
+        if (r == -ENXIO)
                 return NSS_STATUS_NOTFOUND;
-
-        if (avoid_deadlock()) {
-                r = -EDEADLK;
-                goto fail;
-        }
-
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call_method(bus,
-                               "org.freedesktop.machine1",
-                               "/org/freedesktop/machine1",
-                               "org.freedesktop.machine1.Manager",
-                               "MapToMachineGroup",
-                               &error,
-                               &reply,
-                               "u",
-                               (uint32_t) gid);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, BUS_ERROR_NO_SUCH_GROUP_MAPPING))
-                        return NSS_STATUS_NOTFOUND;
-
-                goto fail;
-        }
-
-        r = sd_bus_message_read(reply, "sou", &machine, NULL, &mapped);
         if (r < 0)
                 goto fail;
 
@@ -3,11 +3,15 @@
 #include <errno.h>
 #include <netdb.h>
 #include <nss.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "in-addr-util.h"
 #include "macro.h"
@@ -24,6 +28,7 @@ static bool bus_error_shall_fallback(sd_bus_error *e) {
         return sd_bus_error_has_name(e, SD_BUS_ERROR_SERVICE_UNKNOWN) ||
                sd_bus_error_has_name(e, SD_BUS_ERROR_NAME_HAS_NO_OWNER) ||
                sd_bus_error_has_name(e, SD_BUS_ERROR_NO_REPLY) ||
+               sd_bus_error_has_name(e, SD_BUS_ERROR_DISCONNECTED) ||
                sd_bus_error_has_name(e, SD_BUS_ERROR_ACCESS_DENIED);
 }
 
@@ -105,6 +110,125 @@ static bool avoid_deadlock(void) {
                streq_ptr(getenv("SYSTEMD_ACTIVATION_SCOPE"), "system");
 }
 
+/* Direct connection to systemd-resolved we keep around between lookups, so that applications doing many of them
+ * only pay for connecting once. It is handed to one lookup at a time: a lookup takes it out, and puts it back
+ * when done, unless another thread was quicker, in which case the spare one is closed. resolved closes connections
+ * that are idle for 30s, hence don't reuse one that was idle for a third of that, so that we never race against
+ * that. */
+#define CACHED_BUS_IDLE_USEC (10 * USEC_PER_SEC)
+
+static pthread_mutex_t cached_bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sd_bus *cached_bus = NULL;
+static ino_t cached_bus_inode = 0;
+static usec_t cached_bus_usec = 0;
+
+static int cached_bus_check(sd_bus *bus, ino_t inode, usec_t usec) {
+        struct pollfd pollfd = {
+                .events = POLLIN,
+        };
+        struct stat st;
+
+        /* Returns > 0 if the connection may be reused, 0 if it should be closed, and < 0 if it is not ours to
+         * close anymore. */
+
+        /* After fork(), sd-bus refuses to work on inherited connections, and we can't tell if the fd is still ours */
+        pollfd.fd = sd_bus_get_fd(bus);
+        if (pollfd.fd < 0)
+                return pollfd.fd;
+
+        /* The application might have closed our fd behind our back and opened something else under the same
+         * number, check that it still refers to our socket. */
+        if (fstat(pollfd.fd, &st) < 0)
+                return -errno;
+        if (!S_ISSOCK(st.st_mode) || st.st_ino != inode)
+                return -EBADF;
+
+        if (sd_bus_is_open(bus) <= 0)
+                return 0;
+
+        if (usec_add(usec, CACHED_BUS_IDLE_USEC) <= now(clock_boottime_or_monotonic()))
+                return 0;
+
+        /* resolved never sends anything on its own over this connection, hence if it is readable, the other side
+         * hung up, for example because the service was restarted. */
+        if (poll(&pollfd, 1, 0) != 0)
+                return 0;
+
+        return 1;
+}
+
+static int resolve_bus_open(sd_bus **ret) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        ino_t inode;
+        usec_t usec;
+        int r;
+
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&cached_bus_mutex) == 0);
+        bus = TAKE_PTR(cached_bus);
+        inode = cached_bus_inode;
+        usec = cached_bus_usec;
+        assert_se(pthread_mutex_unlock(&cached_bus_mutex) == 0);
+
+        if (bus) {
+                r = cached_bus_check(bus, inode, usec);
+                if (r > 0) {
+                        *ret = TAKE_PTR(bus);
+                        return 0;
+                }
+                if (r < 0)
+                        /* Rather leak the connection object than close an fd that isn't ours */
+                        bus = NULL;
+                else
+                        bus = sd_bus_flush_close_unref(bus);
+        }
+
+        /* Prefer the direct connection, as it doesn't require the authentication and Hello() round trips with the
+         * bus broker, but fall back to the system bus in case resolved is too old or not accessible from here. */
+        r = sd_bus_new(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_set_address(bus, "unix:path=" SD_RESOLVED_PRIVATE_BUS_PATH);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_start(bus);
+        if (r < 0) {
+                bus = sd_bus_unref(bus);
+                return sd_bus_open_system(ret);
+        }
+
+        *ret = TAKE_PTR(bus);
+        return 0;
+}
+
+static sd_bus *resolve_bus_release(sd_bus *bus) {
+        struct stat st;
+
+        if (!bus)
+                return NULL;
+
+        /* Only direct connections are kept: on the system bus we might get signals queued up in the meantime */
+        if (sd_bus_is_bus_client(bus) != 0 ||
+            sd_bus_is_open(bus) <= 0 ||
+            fstat(sd_bus_get_fd(bus), &st) < 0)
+                return sd_bus_flush_close_unref(bus);
+
+        assert_se(pthread_mutex_lock(&cached_bus_mutex) == 0);
+        if (!cached_bus) {
+                cached_bus = TAKE_PTR(bus);
+                cached_bus_inode = st.st_ino;
+                cached_bus_usec = now(clock_boottime_or_monotonic());
+        }
+        assert_se(pthread_mutex_unlock(&cached_bus_mutex) == 0);
+
+        return sd_bus_flush_close_unref(bus);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus*, resolve_bus_release);
+
 enum nss_status _nss_resolve_gethostbyname4_r(
                 const char *name,
                 struct gaih_addrtuple **pat,
@@ -112,10 +236,10 @@ enum nss_status _nss_resolve_gethostbyname4_r(
                 int *errnop, int *h_errnop,
                 int32_t *ttlp) {
 
+        _cleanup_(resolve_bus_releasep) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         struct gaih_addrtuple *r_tuple, *r_tuple_first = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         const char *canonical = NULL;
         size_t l, ms, idx;
@@ -136,7 +260,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = resolve_bus_open(&bus);
         if (r < 0)
                 goto fail;
 
@@ -285,10 +409,10 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 int32_t *ttlp,
                 char **canonp) {
 
+        _cleanup_(resolve_bus_releasep) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         size_t l, idx, ms, alen;
         const char *canonical;
@@ -316,7 +440,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = resolve_bus_open(&bus);
         if (r < 0)
                 goto fail;
 
@@ -472,10 +596,10 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 int *errnop, int *h_errnop,
                 int32_t *ttlp) {
 
+        _cleanup_(resolve_bus_releasep) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         unsigned c = 0, i = 0;
         size_t ms = 0, idx;
@@ -508,7 +632,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = resolve_bus_open(&bus);
         if (r < 0)
                 goto fail;
 
@@ -94,18 +94,23 @@ enum nss_status _nss_systemd_endgrent(void) _public_;
 enum nss_status _nss_systemd_setgrent(int stayopen) _public_;
 enum nss_status _nss_systemd_getgrent_r(struct group *result, char *buffer, size_t buflen, int *errnop) _public_;
 
-static int direct_lookup_name(const char *name, uid_t *ret) {
+static bool direct_lookup_available(void) {
+
+        /* The service manager maintains "direct:" symlinks for every dynamic user it allocated, in both directions.
+         * Reading them is a lot cheaper than a bus call to PID 1, and the answer is the same. Hence, we use them
+         * whenever they are accessible. If they aren't, for example because we run in a different mount namespace
+         * than the service manager, we go via the bus, which also works for that. */
+
+        return access("/run/systemd/dynamic-uid", F_OK) >= 0;
+}
+
+static int direct_lookup_name_raw(const char *name, uid_t *ret) {
         _cleanup_free_ char *s = NULL;
         const char *path;
         int r;
 
         assert(name);
 
-        /* Normally, we go via the bus to resolve names. That has the benefit that it is available from any mount
-         * namespace and subject to proper authentication. However, there's one problem: if our module is called from
-         * dbus-daemon itself we really can't use D-Bus to communicate. In this case, resort to a client-side hack,
-         * and look for the dynamic names directly. This is pretty ugly, but breaks the cyclic dependency. */
-
         path = strjoina("/run/systemd/dynamic-uid/direct:", name);
         r = readlink_malloc(path, &s);
         if (r < 0)
@@ -114,7 +119,7 @@ static int direct_lookup_name(const char *name, uid_t *ret) {
         return parse_uid(s, ret);
 }
 
-static int direct_lookup_uid(uid_t uid, char **ret) {
+static int direct_lookup_uid_raw(uid_t uid, char **ret) {
         char path[STRLEN("/run/systemd/dynamic-uid/direct:") + DECIMAL_STR_MAX(uid_t) + 1], *s;
         int r;
 
@@ -132,6 +137,48 @@ static int direct_lookup_uid(uid_t uid, char **ret) {
         return 0;
 }
 
+/* These are also used when our module is called from dbus-daemon itself, as we really can't use D-Bus to communicate
+ * then. The symlinks might be left over from an earlier allocation, hence only trust them if they agree with each
+ * other, much like the service manager checks the lock files against its own state. */
+
+static int direct_lookup_name(const char *name, uid_t *ret) {
+        _cleanup_free_ char *check = NULL;
+        uid_t uid;
+        int r;
+
+        r = direct_lookup_name_raw(name, &uid);
+        if (r < 0)
+                return r;
+
+        r = direct_lookup_uid_raw(uid, &check);
+        if (r < 0)
+                return r;
+        if (!streq(name, check))
+                return -ENOENT;
+
+        *ret = uid;
+        return 0;
+}
+
+static int direct_lookup_uid(uid_t uid, char **ret) {
+        _cleanup_free_ char *name = NULL;
+        uid_t check;
+        int r;
+
+        r = direct_lookup_uid_raw(uid, &name);
+        if (r < 0)
+                return r;
+
+        r = direct_lookup_name_raw(name, &check);
+        if (r < 0)
+                return r;
+        if (uid != check)
+                return -ENOENT;
+
+        *ret = TAKE_PTR(name);
+        return 0;
+}
+
 enum nss_status _nss_systemd_getpwnam_r(
                 const char *name,
                 struct passwd *pwd,
@@ -173,11 +220,15 @@ enum nss_status _nss_systemd_getpwnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 return NSS_STATUS_NOTFOUND;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
-                        bypass = 1;
+        if (direct_lookup_available())
+                bypass = 1;
+        else {
+                bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
+                if (bypass <= 0) {
+                        r = sd_bus_open_system(&bus);
+                        if (r < 0)
+                                bypass = 1;
+                }
         }
 
         if (bypass > 0) {
@@ -270,11 +321,15 @@ enum nss_status _nss_systemd_getpwuid_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 return NSS_STATUS_NOTFOUND;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
-                        bypass = 1;
+        if (direct_lookup_available())
+                bypass = 1;
+        else {
+                bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
+                if (bypass <= 0) {
+                        r = sd_bus_open_system(&bus);
+                        if (r < 0)
+                                bypass = 1;
+                }
         }
 
         if (bypass > 0) {
@@ -371,11 +426,15 @@ enum nss_status _nss_systemd_getgrnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 return NSS_STATUS_NOTFOUND;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
-                        bypass = 1;
+        if (direct_lookup_available())
+                bypass = 1;
+        else {
+                bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
+                if (bypass <= 0) {
+                        r = sd_bus_open_system(&bus);
+                        if (r < 0)
+                                bypass = 1;
+                }
         }
 
         if (bypass > 0) {
@@ -466,11 +525,15 @@ enum nss_status _nss_systemd_getgrgid_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 return NSS_STATUS_NOTFOUND;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
-                        bypass = 1;
+        if (direct_lookup_available())
+                bypass = 1;
+        else {
+                bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
+                if (bypass <= 0) {
+                        r = sd_bus_open_system(&bus);
+                        if (r < 0)
+                                bypass = 1;
+                }
         }
 
         if (bypass > 0) {
@@ -605,7 +668,7 @@ static int direct_enumeration(GetentData *p) {
 
         FOREACH_DIRENT(de, d, return -errno) {
                 _cleanup_free_ char *name = NULL;
-                uid_t uid, verified;
+                uid_t uid;
 
                 if (!dirent_is_file(de))
                         continue;
@@ -620,13 +683,6 @@ static int direct_enumeration(GetentData *p) {
                 if (r < 0)
                         continue;
 
-                r = direct_lookup_name(name, &verified);
-                if (r < 0)
-                        continue;
-
-                if (uid != verified)
-                        continue;
-
                 r = user_entry_add(p, name, uid);
                 if (r == -ENOMEM)
                         return r;
@@ -657,12 +713,15 @@ static enum nss_status systemd_setent(GetentData *p) {
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto finish;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-
-        if (bypass <= 0) {
-                r = sd_bus_open_system(&bus);
-                if (r < 0)
-                        bypass = 1;
+        if (direct_lookup_available())
+                bypass = 1;
+        else {
+                bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
+                if (bypass <= 0) {
+                        r = sd_bus_open_system(&bus);
+                        if (r < 0)
+                                bypass = 1;
+                }
         }
 
         if (bypass > 0) {
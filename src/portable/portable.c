@@ -19,6 +19,7 @@
 #include "mkdir.h"
 #include "os-util.h"
 #include "path-lookup.h"
+#include "path-util.h"
 #include "portable.h"
 #include "process-util.h"
 #include "set.h"
@@ -35,6 +36,26 @@ static const char profile_dirs[] = CONF_PATHS_NULSTR("systemd/portable/profile")
 #define PORTABLE_DROPIN_MARKER_BEGIN "# Drop-in created for image '"
 #define PORTABLE_DROPIN_MARKER_END "', do not edit."
 
+/* Metadata extracted from raw images is remembered, so that looking at the same image again doesn't require setting
+ * up a loopback device, dissecting and mounting it again. An image is considered unchanged as long as its inode,
+ * size and timestamps are. */
+#define EXTRACT_CACHE_MAX 16U
+
+typedef struct ExtractCacheEntry {
+        char *path;
+
+        dev_t dev;
+        ino_t ino;
+        uint64_t size;
+        usec_t mtime;
+        usec_t ctime;
+
+        PortableMetadata *os_release;
+        Hashmap *unit_files;
+} ExtractCacheEntry;
+
+static Hashmap *extract_cache = NULL;
+
 static bool prefix_match(const char *unit, const char *prefix) {
         const char *p;
 
@@ -355,7 +376,7 @@ static int extract_now(
         return 0;
 }
 
-static int portable_extract_by_path(
+static int portable_extract_by_path_uncached(
                 const char *path,
                 char **matches,
                 PortableMetadata **ret_os_release,
@@ -485,6 +506,189 @@ static int portable_extract_by_path(
                 child = 0;
         }
 
+        *ret_unit_files = TAKE_PTR(unit_files);
+        *ret_os_release = TAKE_PTR(os_release);
+
+        return 0;
+}
+
+static ExtractCacheEntry *extract_cache_entry_free(ExtractCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        portable_metadata_unref(e->os_release);
+        portable_metadata_hashmap_unref(e->unit_files);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ExtractCacheEntry*, extract_cache_entry_free);
+
+static bool extract_cache_entry_matches(const ExtractCacheEntry *e, const struct stat *st) {
+        assert(e);
+        assert(st);
+
+        return e->dev == st->st_dev &&
+                e->ino == st->st_ino &&
+                e->size == (uint64_t) st->st_size &&
+                e->mtime == timespec_load(&st->st_mtim) &&
+                e->ctime == timespec_load(&st->st_ctim);
+}
+
+static int extract_cache_add(
+                const char *path,
+                const struct stat *st,
+                PortableMetadata *os_release,
+                Hashmap *unit_files,
+                ExtractCacheEntry **ret) {
+
+        _cleanup_(extract_cache_entry_freep) ExtractCacheEntry *e = NULL;
+        int r;
+
+        assert(path);
+        assert(st);
+        assert(ret);
+
+        r = hashmap_ensure_allocated(&extract_cache, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        /* Drop whatever entry we might have for this path already, and make room if necessary */
+        extract_cache_entry_free(hashmap_remove(extract_cache, path));
+        if (hashmap_size(extract_cache) >= EXTRACT_CACHE_MAX)
+                extract_cache_entry_free(hashmap_steal_first(extract_cache));
+
+        e = new(ExtractCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        *e = (ExtractCacheEntry) {
+                .path = strdup(path),
+                .dev = st->st_dev,
+                .ino = st->st_ino,
+                .size = st->st_size,
+                .mtime = timespec_load(&st->st_mtim),
+                .ctime = timespec_load(&st->st_ctim),
+        };
+        if (!e->path)
+                return -ENOMEM;
+
+        r = hashmap_put(extract_cache, e->path, e);
+        if (r < 0)
+                return r;
+
+        /* Only take possession of the metadata once nothing can fail anymore */
+        e->os_release = os_release;
+        e->unit_files = unit_files;
+
+        *ret = TAKE_PTR(e);
+        return 0;
+}
+
+void portable_extract_cache_flush(void) {
+        extract_cache = hashmap_free_with_destructor(extract_cache, extract_cache_entry_free);
+}
+
+static int portable_metadata_clone(const PortableMetadata *m, PortableMetadata **ret) {
+        _cleanup_(portable_metadata_unrefp) PortableMetadata *c = NULL;
+        _cleanup_close_ int fd = -1;
+
+        assert(m);
+        assert(ret);
+
+        /* Reopen the file rather than duplicating the fd, so that each copy has its own file offset */
+        fd = fd_reopen(m->fd, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return fd;
+
+        c = portable_metadata_new(m->name, fd);
+        if (!c)
+                return -ENOMEM;
+        fd = -1;
+
+        if (m->source) {
+                c->source = strdup(m->source);
+                if (!c->source)
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+static int portable_extract_by_path(
+                const char *path,
+                char **matches,
+                PortableMetadata **ret_os_release,
+                Hashmap **ret_unit_files,
+                sd_bus_error *error) {
+
+        _cleanup_(portable_metadata_hashmap_unrefp) Hashmap *all_unit_files = NULL, *unit_files = NULL;
+        _cleanup_(portable_metadata_unrefp) PortableMetadata *all_os_release = NULL, *os_release = NULL;
+        ExtractCacheEntry *e = NULL;
+        PortableMetadata *item;
+        Iterator i;
+        struct stat st;
+        int r;
+
+        assert(path);
+
+        /* Only raw image files are cached: they are expensive to look into, and their timestamps change whenever
+         * anything in them does. For directory trees neither holds. */
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+                r = portable_extract_by_path_uncached(path, matches, &os_release, &unit_files, error);
+                if (r < 0)
+                        return r;
+
+                goto finish;
+        }
+
+        e = hashmap_get(extract_cache, path);
+        if (e && !extract_cache_entry_matches(e, &st))
+                e = NULL;
+        if (e)
+                log_debug("Using cached metadata of image '%s'.", path);
+        else {
+                r = portable_extract_by_path_uncached(path, NULL, &all_os_release, &all_unit_files, error);
+                if (r < 0)
+                        return r;
+
+                r = extract_cache_add(path, &st, all_os_release, all_unit_files, &e);
+                if (r < 0)
+                        return r;
+
+                all_os_release = NULL;
+                all_unit_files = NULL;
+        }
+
+        if (e->os_release) {
+                r = portable_metadata_clone(e->os_release, &os_release);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to reopen os-release file: %m");
+        }
+
+        unit_files = hashmap_new(&string_hash_ops);
+        if (!unit_files)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(item, e->unit_files, i) {
+                _cleanup_(portable_metadata_unrefp) PortableMetadata *c = NULL;
+
+                if (!unit_match(item->name, matches))
+                        continue;
+
+                r = portable_metadata_clone(item, &c);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to reopen unit file '%s': %m", item->name);
+
+                r = hashmap_put(unit_files, c->name, c);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to add unit to hashmap: %m");
+                c = NULL;
+        }
+
+finish:
         if (!os_release)
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image '%s' lacks os-release data, refusing.", path);
 
@@ -1182,7 +1386,7 @@ int portable_detach(
                 if (r == 0)
                         continue;
 
-                r = unit_file_lookup_state(UNIT_FILE_SYSTEM, &paths, de->d_name, &state);
+                r = unit_file_lookup_state(UNIT_FILE_SYSTEM, &paths, NULL, de->d_name, &state);
                 if (r < 0)
                         return log_debug_errno(r, "Failed to determine unit file state of '%s': %m", de->d_name);
                 if (!IN_SET(state, UNIT_FILE_STATIC, UNIT_FILE_DISABLED, UNIT_FILE_LINKED, UNIT_FILE_RUNTIME))
@@ -1344,7 +1548,7 @@ static int portable_get_state_internal(
                 if (r == 0)
                         continue;
 
-                r = unit_file_lookup_state(UNIT_FILE_SYSTEM, &paths, de->d_name, &state);
+                r = unit_file_lookup_state(UNIT_FILE_SYSTEM, &paths, NULL, de->d_name, &state);
                 if (r < 0)
                         return log_debug_errno(r, "Failed to determine unit file state of '%s': %m", de->d_name);
                 if (!IN_SET(state, UNIT_FILE_STATIC, UNIT_FILE_DISABLED, UNIT_FILE_LINKED, UNIT_FILE_LINKED_RUNTIME))
@@ -6,6 +6,7 @@
 #include "alloc-util.h"
 #include "bus-util.h"
 #include "def.h"
+#include "portable.h"
 #include "portabled-bus.h"
 #include "portabled-image-bus.h"
 #include "portabled.h"
@@ -47,6 +48,7 @@ static Manager* manager_unref(Manager *m) {
         assert(m);
 
         hashmap_free_with_destructor(m->image_cache, image_unref);
+        portable_extract_cache_flush();
 
         sd_event_source_unref(m->image_cache_defer_event);
 
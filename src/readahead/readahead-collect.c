@@ -0,0 +1,405 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-daemon.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "blockdev-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "mount-util.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "readahead-util.h"
+#include "readahead.h"
+#include "set.h"
+#include "signal-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+typedef struct Collector {
+        sd_event *event;
+        int fanotify_fd;
+
+        /* The paths we already saw, pointing into the pack entries */
+        Set *seen;
+        ReadaheadPack *pack;
+
+        /* Our own comm, to recognize the replaying and collecting processes */
+        char *comm;
+        pid_t last_pid;
+        bool last_pid_ignored;
+} Collector;
+
+static void collector_done(Collector *c) {
+        assert(c);
+
+        c->event = sd_event_unref(c->event);
+        c->fanotify_fd = safe_close(c->fanotify_fd);
+        c->seen = set_free(c->seen);
+        c->pack = readahead_pack_free(c->pack);
+        c->comm = mfree(c->comm);
+}
+
+static int root_is_rotational(void) {
+        _cleanup_free_ char *s = NULL;
+        char p[SYS_BLOCK_PATH_MAX("/queue/rotational")];
+        dev_t devno;
+        int r;
+
+        r = get_block_device("/", &devno);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return false; /* Not backed by a single block device, the physical location doesn't tell us much */
+
+        r = block_get_whole_disk(devno, &devno);
+        if (r < 0)
+                return r;
+
+        xsprintf_sys_block_path(p, "/queue/rotational", devno);
+
+        r = read_one_line_file(p, &s);
+        if (r < 0)
+                return r;
+
+        return parse_boolean(s);
+}
+
+static bool pid_ignored(Collector *c, pid_t pid) {
+        _cleanup_free_ char *comm = NULL;
+
+        assert(c);
+
+        if (pid == getpid_cached())
+                return true;
+
+        /* Files opened by the replaying process are not interesting, they'd just end up in the pack forever. Most
+         * events come in bursts from the same process, hence remember the last verdict. */
+        if (pid == c->last_pid)
+                return c->last_pid_ignored;
+
+        c->last_pid = pid;
+        c->last_pid_ignored = get_process_comm(pid, &comm) >= 0 && streq(comm, c->comm);
+
+        return c->last_pid_ignored;
+}
+
+static int collect_fd(Collector *c, int fd) {
+        _cleanup_free_ char *p = NULL;
+        struct stat st;
+        int block = 0, r;
+
+        assert(c);
+        assert(fd >= 0);
+
+        if (c->pack->n_entries >= READAHEAD_FILES_MAX)
+                return 0;
+
+        r = fd_get_path(fd, &p);
+        if (r < 0)
+                return r;
+
+        /* Volatile files won't be there on the next boot anyway */
+        if (endswith(p, " (deleted)") ||
+            PATH_STARTSWITH_SET(p, "/run", "/tmp", "/var/tmp", READAHEAD_PACK_DIR))
+                return 0;
+
+        if (set_contains(c->seen, p))
+                return 0;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return 0;
+
+        /* Only used for ordering, hence if the file system doesn't support this, or we lack the privileges, we
+         * simply keep the access order for this file. */
+        if (c->pack->rotational)
+                (void) ioctl(fd, FIBMAP, &block);
+
+        r = readahead_pack_add(c->pack, p, (uint64_t) (unsigned) block, MIN((uint64_t) st.st_size, READAHEAD_FILE_SIZE_MAX));
+        if (r < 0)
+                return r;
+
+        r = set_put(c->seen, c->pack->entries[c->pack->n_entries - 1].path);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int process_fanotify(Collector *c) {
+        union {
+                struct fanotify_event_metadata metadata;
+                uint8_t buffer[16 * 1024];
+        } data;
+
+        assert(c);
+
+        for (;;) {
+                struct fanotify_event_metadata *f;
+                ssize_t n;
+
+                n = read(c->fanotify_fd, &data, sizeof(data));
+                if (n < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                return 0;
+
+                        return log_error_errno(errno, "Failed to read fanotify events: %m");
+                }
+
+                for (f = &data.metadata; FAN_EVENT_OK(f, n); f = FAN_EVENT_NEXT(f, n)) {
+                        int r;
+
+                        if (f->vers != FANOTIFY_METADATA_VERSION) {
+                                log_error("Unexpected fanotify metadata version.");
+                                safe_close(f->fd);
+                                return -EPROTO;
+                        }
+
+                        if (f->mask & FAN_Q_OVERFLOW)
+                                log_warning("fanotify queue overflow, the pack will be incomplete.");
+
+                        if (f->fd < 0)
+                                continue;
+
+                        if (!pid_ignored(c, f->pid)) {
+                                r = collect_fd(c, f->fd);
+                                if (r == -ENOMEM) {
+                                        safe_close(f->fd);
+                                        return log_oom();
+                                }
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to record opened file, ignoring: %m");
+                        }
+
+                        safe_close(f->fd);
+                }
+        }
+}
+
+static int on_fanotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Collector *c = userdata;
+        int r;
+
+        assert(c);
+
+        r = process_fanotify(c);
+        if (r < 0)
+                return sd_event_exit(c->event, r);
+
+        if (c->pack->n_entries >= READAHEAD_FILES_MAX) {
+                log_info("Collected the maximum number of files, stopping.");
+                return sd_event_exit(c->event, 0);
+        }
+
+        return 0;
+}
+
+static int on_inotify(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Collector *c = userdata;
+
+        assert(c);
+
+        if (!streq_ptr(event->name, "done"))
+                return 0;
+
+        log_debug("Boot is done, stopping collection.");
+        return sd_event_exit(c->event, 0);
+}
+
+static int on_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
+        Collector *c = userdata;
+
+        assert(c);
+
+        log_info("Boot didn't finish in time, stopping collection.");
+        return sd_event_exit(c->event, 0);
+}
+
+static void trim_entry(ReadaheadEntry *e) {
+        _cleanup_free_ unsigned char *vec = NULL;
+        _cleanup_close_ int fd = -1;
+        size_t n_pages, i, length;
+        struct stat st;
+        void *p;
+
+        assert(e);
+
+        /* Only read as much of the file as was actually used during boot, i.e. up to the last page that is still
+         * in the page cache. Many binaries and libraries are only ever touched at the beginning. */
+
+        if (e->length == 0)
+                return;
+
+        fd = open(e->path, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW|O_NOATIME|O_NONBLOCK);
+        if (fd < 0)
+                return;
+
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+                return;
+
+        length = MIN(e->length, (uint64_t) st.st_size);
+
+        p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return;
+
+        n_pages = DIV_ROUND_UP(length, page_size());
+        vec = new(unsigned char, n_pages);
+        if (vec && mincore(p, length, vec) >= 0) {
+                for (i = n_pages; i > 0; i--)
+                        if (vec[i - 1] & 1)
+                                break;
+
+                e->length = MIN(e->length, (uint64_t) i * page_size());
+        }
+
+        (void) munmap(p, length);
+}
+
+static int collector_save(Collector *c) {
+        usec_t done_usec = 0;
+        size_t i;
+        int r;
+
+        assert(c);
+
+        /* Pick up whatever is still queued */
+        (void) process_fanotify(c);
+
+        if (c->pack->n_entries == 0) {
+                log_info("No files collected, not writing pack.");
+                return 0;
+        }
+
+        for (i = 0; i < c->pack->n_entries; i++)
+                trim_entry(c->pack->entries + i);
+
+        if (readahead_read_usec_file(READAHEAD_DONE, &done_usec) >= 0)
+                c->pack->done_usec = done_usec;
+
+        readahead_pack_sort(c->pack);
+
+        r = readahead_pack_save(READAHEAD_PACK, c->pack);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write " READAHEAD_PACK ": %m");
+
+        log_info("Collected %zu files.", c->pack->n_entries);
+        return 0;
+}
+
+static int pack_is_fresh(void) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL;
+        int r;
+
+        r = readahead_pack_load(READAHEAD_PACK, &p);
+        if (r < 0)
+                return r;
+
+        return p->done_usec > 0 && p->mtime + READAHEAD_PACK_MAX_AGE_USEC > now(CLOCK_REALTIME);
+}
+
+int readahead_collect(int argc, char *argv[], void *userdata) {
+        _cleanup_(collector_done) Collector c = {
+                .fanotify_fd = -1,
+        };
+        int r;
+
+        r = pack_is_fresh();
+        if (r > 0) {
+                log_info("Readahead pack is up-to-date, not collecting.");
+                (void) sd_notify(false, "READY=1");
+                return 0;
+        }
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to read existing pack, collecting a new one: %m");
+
+        if (access(READAHEAD_DONE, F_OK) >= 0) {
+                log_info("Boot is already done, not collecting.");
+                (void) sd_notify(false, "READY=1");
+                return 0;
+        }
+
+        c.pack = new0(ReadaheadPack, 1);
+        if (!c.pack)
+                return log_oom();
+
+        r = root_is_rotational();
+        if (r < 0)
+                log_debug_errno(r, "Failed to determine whether the root file system is on rotating media, assuming it is not: %m");
+        c.pack->rotational = r > 0;
+
+        c.seen = set_new(&path_hash_ops);
+        if (!c.seen)
+                return log_oom();
+
+        r = get_process_comm(0, &c.comm);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get our own process name: %m");
+
+        c.fanotify_fd = fanotify_init(FAN_CLOEXEC|FAN_NONBLOCK|FAN_CLASS_NOTIF, O_RDONLY|O_LARGEFILE|O_CLOEXEC|O_NOATIME);
+        if (c.fanotify_fd < 0)
+                return log_error_errno(errno, "Failed to create fanotify object: %m");
+
+        if (fanotify_mark(c.fanotify_fd, FAN_MARK_ADD|FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/") < 0)
+                return log_error_errno(errno, "Failed to mark root file system: %m");
+
+        /* With a split /usr most of what we are interested in is there */
+        if (path_is_mount_point("/usr", NULL, 0) > 0 &&
+            fanotify_mark(c.fanotify_fd, FAN_MARK_ADD|FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/usr") < 0)
+                return log_error_errno(errno, "Failed to mark /usr file system: %m");
+
+        r = sd_event_default(&c.event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, -1) >= 0);
+        (void) sd_event_add_signal(c.event, NULL, SIGTERM, NULL, NULL);
+        (void) sd_event_add_signal(c.event, NULL, SIGINT, NULL, NULL);
+
+        r = sd_event_add_io(c.event, NULL, c.fanotify_fd, EPOLLIN, on_fanotify, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch fanotify object: %m");
+
+        r = mkdir_p(READAHEAD_RUNTIME_DIR, 0755);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create " READAHEAD_RUNTIME_DIR ": %m");
+
+        r = sd_event_add_inotify(c.event, NULL, READAHEAD_RUNTIME_DIR, IN_CREATE|IN_MOVED_TO|IN_ONLYDIR, on_inotify, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch " READAHEAD_RUNTIME_DIR ": %m");
+
+        r = sd_event_add_time(c.event, NULL, CLOCK_MONOTONIC, usec_add(now(CLOCK_MONOTONIC), READAHEAD_COLLECT_TIMEOUT_USEC), 0, on_timeout, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add timeout: %m");
+
+        (void) sd_notify(false, "READY=1");
+
+        /* The done flag might have been created before the inotify watch was in place */
+        if (access(READAHEAD_DONE, F_OK) < 0) {
+                r = sd_event_loop(c.event);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to run event loop: %m");
+        }
+
+        return collector_save(&c);
+}
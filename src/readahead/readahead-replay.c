@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "readahead-util.h"
+#include "readahead.h"
+#include "string-util.h"
+#include "time-util.h"
+
+int readahead_replay(int argc, char *argv[], void *userdata) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL;
+        _cleanup_free_ char *stats = NULL;
+        char ts[FORMAT_TIMESPAN_MAX], bytes[FORMAT_BYTES_MAX];
+        size_t i, n_files = 0;
+        uint64_t n_bytes = 0;
+        usec_t t;
+        int r;
+
+        r = readahead_pack_load(READAHEAD_PACK, &p);
+        if (r == -ENOENT) {
+                log_debug("No readahead pack collected yet, nothing to replay.");
+                return 0;
+        }
+        if (r < 0) {
+                /* Not fatal, the collector will write a new pack on this boot */
+                log_warning_errno(r, "Failed to load " READAHEAD_PACK ", ignoring: %m");
+                return 0;
+        }
+
+        /* POSIX_FADV_WILLNEED only queues the reads and returns right away, hence this submits the whole pack to
+         * the block layer in one go, in the order of the pack. The I/O scheduler can then merge and order the
+         * requests much better than when the services start up and fault in their files one by one. The open()s
+         * themselves still block on the inodes, which is why on rotating media the pack is sorted by physical
+         * location. */
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < p->n_entries; i++) {
+                _cleanup_close_ int fd = -1;
+                struct stat st;
+
+                /* The pack might be stale, hence make sure we never block on a FIFO or device node that took the
+                 * place of a file since */
+                fd = open(p->entries[i].path, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW|O_NOATIME|O_NONBLOCK);
+                if (fd < 0) {
+                        log_debug_errno(errno, "Failed to open %s, skipping: %m", p->entries[i].path);
+                        continue;
+                }
+
+                if (fstat(fd, &st) < 0) {
+                        log_debug_errno(errno, "Failed to stat %s, skipping: %m", p->entries[i].path);
+                        continue;
+                }
+
+                if (!S_ISREG(st.st_mode)) {
+                        log_debug("%s is not a regular file, skipping.", p->entries[i].path);
+                        continue;
+                }
+
+                n_files++;
+
+                if (p->entries[i].length == 0)
+                        continue;
+
+                r = posix_fadvise(fd, 0, p->entries[i].length, POSIX_FADV_WILLNEED);
+                if (r != 0) {
+                        log_debug_errno(r, "Failed to read ahead %s, skipping: %m", p->entries[i].path);
+                        continue;
+                }
+
+                n_bytes += p->entries[i].length;
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Read ahead %zu files (%s) in %s.",
+                 n_files,
+                 format_bytes(bytes, sizeof(bytes), n_bytes),
+                 format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC));
+
+        /* Remember what we did, for systemd-analyze */
+        if (asprintf(&stats, "FILES=%zu\nBYTES=%" PRIu64 "\nUSEC=" USEC_FMT, n_files, n_bytes, t) < 0)
+                return log_oom();
+
+        (void) mkdir_p(READAHEAD_RUNTIME_DIR, 0755);
+
+        r = write_string_file(READAHEAD_REPLAY_STATS, stats, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0)
+                log_warning_errno(r, "Failed to write " READAHEAD_REPLAY_STATS ", ignoring: %m");
+
+        return 0;
+}
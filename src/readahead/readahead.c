@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "readahead-util.h"
+#include "readahead.h"
+#include "stdio-util.h"
+#include "terminal-util.h"
+#include "time-util.h"
+#include "util.h"
+#include "verbs.h"
+
+static int help(void) {
+        _cleanup_free_ char *link = NULL;
+        int r;
+
+        r = terminal_urlify_man("systemd-readahead-replay.service", "8", &link);
+        if (r < 0)
+                return log_oom();
+
+        printf("%s [OPTIONS...] COMMAND\n\n"
+               "Collect and replay the files accessed during boot.\n\n"
+               "  -h --help       Show this help\n"
+               "     --version    Show package version\n\n"
+               "Commands:\n"
+               "  collect         Record the files accessed until the boot is done\n"
+               "  replay          Read ahead the files recorded on a previous boot\n"
+               "  done            Mark the boot as done\n"
+               "\nSee the %s for details.\n"
+               , program_invocation_short_name
+               , link
+        );
+
+        return 0;
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_VERSION = 0x100,
+        };
+
+        static const struct option options[] = {
+                { "help",     no_argument,       NULL, 'h'         },
+                { "version",  no_argument,       NULL, ARG_VERSION },
+                {}
+        };
+
+        int c;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0) {
+                switch(c) {
+
+                case 'h':
+                        return help();
+
+                case ARG_VERSION:
+                        return version();
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached("Unknown option");
+                }
+        }
+
+        return 1;
+}
+
+static int readahead_done(int argc, char *argv[], void *userdata) {
+        char buf[DECIMAL_STR_MAX(usec_t)];
+        int r;
+
+        /* Records when the boot was done, which also tells the collector to stop */
+
+        r = mkdir_p(READAHEAD_RUNTIME_DIR, 0755);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create " READAHEAD_RUNTIME_DIR ": %m");
+
+        xsprintf(buf, USEC_FMT, now(CLOCK_MONOTONIC));
+
+        r = write_string_file(READAHEAD_DONE, buf, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write " READAHEAD_DONE ": %m");
+
+        return 0;
+}
+
+static int readahead_main(int argc, char *argv[]) {
+        static const Verb verbs[] = {
+                { "collect", 1, 1, 0, readahead_collect },
+                { "replay",  1, 1, 0, readahead_replay  },
+                { "done",    1, 1, 0, readahead_done    },
+                {},
+        };
+
+        return dispatch_verb(argc, argv, verbs, NULL);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_set_target(LOG_TARGET_AUTO);
+        log_parse_environment();
+        log_open();
+
+        umask(0022);
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                goto finish;
+
+        r = readahead_main(argc, argv);
+
+finish:
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "time-util.h"
+
+/* Stop collecting at the latest after this time, even if the boot didn't finish */
+#define READAHEAD_COLLECT_TIMEOUT_USEC (2*USEC_PER_MINUTE)
+
+/* Don't collect again if the pack is younger than this */
+#define READAHEAD_PACK_MAX_AGE_USEC (7*USEC_PER_DAY)
+
+#define READAHEAD_FILES_MAX 16384U
+#define READAHEAD_FILE_SIZE_MAX (128U*1024U*1024U)
+
+int readahead_collect(int argc, char *argv[], void *userdata);
+int readahead_replay(int argc, char *argv[], void *userdata);
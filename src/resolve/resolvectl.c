@@ -1010,7 +1010,7 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         sd_bus *bus = userdata;
         uint64_t n_current_transactions, n_total_transactions,
-                cache_size, n_cache_hit, n_cache_miss,
+                cache_size, n_cache_hit, n_cache_miss, n_cache_evicted,
                 n_dnssec_secure, n_dnssec_insecure, n_dnssec_bogus, n_dnssec_indeterminate;
         int r, dnssec_supported;
 
@@ -1077,17 +1077,30 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         if (r < 0)
                 return bus_log_parse_error(r);
 
+        reply = sd_bus_message_unref(reply);
+
+        r = sd_bus_get_property_trivial(bus,
+                                        "org.freedesktop.resolve1",
+                                        "/org/freedesktop/resolve1",
+                                        "org.freedesktop.resolve1.Manager",
+                                        "CacheEvictions",
+                                        &error,
+                                        't',
+                                        &n_cache_evicted);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cache evictions: %s", bus_error_message(&error, r));
+
         printf("\n%sCache%s\n"
                "  Current Cache Size: %" PRIu64 "\n"
                "          Cache Hits: %" PRIu64 "\n"
-               "        Cache Misses: %" PRIu64 "\n",
+               "        Cache Misses: %" PRIu64 "\n"
+               "     Cache Evictions: %" PRIu64 "\n",
                ansi_highlight(),
                ansi_normal(),
                cache_size,
                n_cache_hit,
-               n_cache_miss);
-
-        reply = sd_bus_message_unref(reply);
+               n_cache_miss,
+               n_cache_evicted);
 
         r = sd_bus_get_property(bus,
                                 "org.freedesktop.resolve1",
@@ -1,18 +1,32 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/resource.h>
+#include <sys/stat.h>
+
 #include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "dns-domain.h"
+#include "fd-util.h"
 #include "resolved-bus.h"
 #include "resolved-def.h"
 #include "resolved-dns-synthesize.h"
 #include "resolved-dnssd.h"
 #include "resolved-dnssd-bus.h"
 #include "resolved-link-bus.h"
+#include "set.h"
+#include "socket-util.h"
 #include "user-util.h"
 #include "utf8.h"
 
+/* Limit on the private connections, further limited to a quarter of RLIMIT_NOFILE, so that enough fds are left for
+ * the DNS transactions */
+#define PRIVATE_CONNECTIONS_MAX 1024U
+
+/* Private connections nothing was received on for this long are closed. nss-resolve stops reusing its connection
+ * well before that, so that it never talks to a connection we are about to close. */
+#define PRIVATE_CONNECTION_IDLE_USEC (30 * USEC_PER_SEC)
+
 BUS_DEFINE_PROPERTY_GET_ENUM(bus_property_get_resolve_support, resolve_support, ResolveSupport);
 
 static int reply_query_state(DnsQuery *q) {
@@ -204,7 +218,7 @@ static void bus_method_resolve_hostname_complete(DnsQuery *q) {
         if (r < 0)
                 goto finish;
 
-        r = sd_bus_send(q->manager->bus, reply, NULL);
+        r = sd_bus_send(sd_bus_message_get_bus(q->request), reply, NULL);
 
 finish:
         if (r < 0) {
@@ -432,7 +446,7 @@ static void bus_method_resolve_address_complete(DnsQuery *q) {
         if (r < 0)
                 goto finish;
 
-        r = sd_bus_send(q->manager->bus, reply, NULL);
+        r = sd_bus_send(sd_bus_message_get_bus(q->request), reply, NULL);
 
 finish:
         if (r < 0) {
@@ -598,7 +612,7 @@ static void bus_method_resolve_record_complete(DnsQuery *q) {
         if (r < 0)
                 goto finish;
 
-        r = sd_bus_send(q->manager->bus, reply, NULL);
+        r = sd_bus_send(sd_bus_message_get_bus(q->request), reply, NULL);
 
 finish:
         if (r < 0) {
@@ -972,7 +986,7 @@ static void resolve_service_all_complete(DnsQuery *q) {
         if (r < 0)
                 goto finish;
 
-        r = sd_bus_send(q->manager->bus, reply, NULL);
+        r = sd_bus_send(sd_bus_message_get_bus(q->request), reply, NULL);
 
 finish:
         if (r < 0) {
@@ -1396,7 +1410,7 @@ static int bus_property_get_cache_statistics(
                 void *userdata,
                 sd_bus_error *error) {
 
-        uint64_t size = 0, hit = 0, miss = 0;
+        uint64_t size = 0, hit = 0, miss = 0, evicted = 0;
         Manager *m = userdata;
         DnsScope *s;
 
@@ -1407,8 +1421,12 @@ static int bus_property_get_cache_statistics(
                 size += dns_cache_size(&s->cache);
                 hit += s->cache.n_hit;
                 miss += s->cache.n_miss;
+                evicted += s->cache.n_evicted;
         }
 
+        if (streq(property, "CacheEvictions"))
+                return sd_bus_message_append(reply, "t", evicted);
+
         return sd_bus_message_append(reply, "(ttt)", size, hit, miss);
 }
 
@@ -1476,7 +1494,7 @@ static int bus_method_reset_statistics(sd_bus_message *message, void *userdata,
         assert(m);
 
         LIST_FOREACH(scopes, s, m->dns_scopes)
-                s->cache.n_hit = s->cache.n_miss = 0;
+                s->cache.n_hit = s->cache.n_miss = s->cache.n_evicted = 0;
 
         m->n_transactions_total = 0;
         zero(m->n_dnssec_verdict);
@@ -1838,6 +1856,7 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_PROPERTY("Domains", "a(isb)", bus_property_get_domains, 0, 0),
         SD_BUS_PROPERTY("TransactionStatistics", "(tt)", bus_property_get_transaction_statistics, 0, 0),
         SD_BUS_PROPERTY("CacheStatistics", "(ttt)", bus_property_get_cache_statistics, 0, 0),
+        SD_BUS_PROPERTY("CacheEvictions", "t", bus_property_get_cache_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSEC", "s", bus_property_get_dnssec_mode, 0, 0),
         SD_BUS_PROPERTY("DNSSECStatistics", "(tttt)", bus_property_get_dnssec_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSECSupported", "b", bus_property_get_dnssec_supported, 0, 0),
@@ -1866,6 +1885,17 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_VTABLE_END,
 };
 
+/* On private connections we only expose the lookup methods: anything that changes state requires polkit or
+ * tracking of the peer on the bus, neither of which is available there. */
+static const sd_bus_vtable resolve_private_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("ResolveHostname", "isit", "a(iiay)st", bus_method_resolve_hostname, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveAddress", "iiayt", "a(is)t", bus_method_resolve_address, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveRecord", "isqqt", "a(iqqay)t", bus_method_resolve_record, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResolveService", "isssit", "a(qqqsa(iiay)s)aayssst", bus_method_resolve_service, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_VTABLE_END,
+};
+
 static int match_prepare_for_sleep(sd_bus_message *message, void *userdata, sd_bus_error *ret_error) {
         Manager *m = userdata;
         int b, r;
@@ -1943,3 +1973,291 @@ int manager_connect_bus(Manager *m) {
 
         return 0;
 }
+
+static void private_bus_close(Manager *m, sd_bus *bus) {
+        assert(m);
+        assert(bus);
+
+        (void) set_remove(m->private_buses_active, bus);
+
+        if (set_remove(m->private_buses, bus))
+                sd_bus_flush_close_unref(bus);
+}
+
+static int signal_private_disconnected(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = userdata;
+        sd_bus *bus;
+
+        assert(message);
+        assert(m);
+        assert_se(bus = sd_bus_message_get_bus(message));
+
+        private_bus_close(m, bus);
+
+        return 0;
+}
+
+static void private_bus_mark_active(Manager *m, sd_bus *bus) {
+        assert(m);
+        assert(bus);
+
+        /* Not being able to remember the connection as active only means it might be closed a bit early */
+        if (set_ensure_allocated(&m->private_buses_active, NULL) >= 0)
+                (void) set_put(m->private_buses_active, bus);
+}
+
+static int filter_private_activity(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = userdata;
+
+        assert(message);
+        assert(m);
+
+        private_bus_mark_active(m, sd_bus_message_get_bus(message));
+        return 0;
+}
+
+static int on_private_idle(sd_event_source *s, usec_t usec, void *userdata);
+
+static int private_bus_schedule_idle(Manager *m) {
+        usec_t usec;
+        int r;
+
+        assert(m);
+
+        /* Connections are checked every PRIVATE_CONNECTION_IDLE_USEC as long as there are any, and closed if
+         * nothing was received on them since the previous check */
+
+        if (m->private_idle_event_source) {
+                int enabled;
+
+                r = sd_event_source_get_enabled(m->private_idle_event_source, &enabled);
+                if (r < 0)
+                        return r;
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+        }
+
+        r = sd_event_now(m->event, clock_boottime_or_monotonic(), &usec);
+        if (r < 0)
+                return r;
+
+        usec = usec_add(usec, PRIVATE_CONNECTION_IDLE_USEC);
+
+        if (!m->private_idle_event_source) {
+                r = sd_event_add_time(m->event, &m->private_idle_event_source, clock_boottime_or_monotonic(),
+                                      usec, USEC_PER_SEC, on_private_idle, m);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(m->private_idle_event_source, "bus-private-idle");
+                return 0;
+        }
+
+        r = sd_event_source_set_time(m->private_idle_event_source, usec);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(m->private_idle_event_source, SD_EVENT_ONESHOT);
+}
+
+static int on_private_idle(sd_event_source *s, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        Iterator i;
+        sd_bus *bus;
+        unsigned n = 0;
+
+        assert(m);
+
+        SET_FOREACH(bus, m->private_buses, i)
+                if (!set_contains(m->private_buses_active, bus)) {
+                        private_bus_close(m, bus);
+                        n++;
+                }
+
+        if (n > 0)
+                log_debug("Closed %u idle private connections.", n);
+
+        set_clear(m->private_buses_active);
+
+        if (!set_isempty(m->private_buses))
+                (void) private_bus_schedule_idle(m);
+
+        return 0;
+}
+
+static int on_private_connection(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_ int nfd = -1;
+        Manager *m = userdata;
+        sd_id128_t id;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (nfd < 0) {
+                log_warning_errno(errno, "Failed to accept private connection, ignoring: %m");
+                return 0;
+        }
+
+        if (set_size(m->private_buses) >= m->private_buses_max) {
+                log_warning("Too many concurrent private connections, refusing.");
+                return 0;
+        }
+
+        r = set_ensure_allocated(&m->private_buses, NULL);
+        if (r < 0) {
+                log_oom();
+                return 0;
+        }
+
+        r = sd_bus_new(&bus);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to allocate private connection: %m");
+                return 0;
+        }
+
+        (void) sd_bus_set_description(bus, "private-bus-connection");
+
+        r = sd_bus_set_fd(bus, nfd, nfd);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to set fd on private connection: %m");
+                return 0;
+        }
+
+        nfd = -1;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        r = sd_bus_set_server(bus, 1, id);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable server support for private connection: %m");
+                return 0;
+        }
+
+        r = sd_bus_set_sender(bus, "org.freedesktop.resolve1");
+        if (r < 0) {
+                log_warning_errno(r, "Failed to set sender on private connection: %m");
+                return 0;
+        }
+
+        r = sd_bus_start(bus);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to start private connection: %m");
+                return 0;
+        }
+
+        r = sd_bus_attach_event(bus, m->event, 0);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to attach private connection to event loop: %m");
+                return 0;
+        }
+
+        r = sd_bus_match_signal_async(
+                        bus,
+                        NULL,
+                        "org.freedesktop.DBus.Local",
+                        "/org/freedesktop/DBus/Local",
+                        "org.freedesktop.DBus.Local",
+                        "Disconnected",
+                        signal_private_disconnected, NULL, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to request match for Disconnected message: %m");
+                return 0;
+        }
+
+        r = sd_bus_add_filter(bus, NULL, filter_private_activity, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to add filter for private connection: %m");
+                return 0;
+        }
+
+        r = sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/resolve1", "org.freedesktop.resolve1.Manager", resolve_private_vtable, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to register object on private connection: %m");
+                return 0;
+        }
+
+        r = set_put(m->private_buses, bus);
+        if (r < 0) {
+                log_oom();
+                return 0;
+        }
+
+        /* A new connection counts as active, so that the client has at least the full idle time before it is
+         * closed */
+        private_bus_mark_active(m, bus);
+
+        r = private_bus_schedule_idle(m);
+        if (r < 0)
+                log_warning_errno(r, "Failed to schedule closing of idle private connections, ignoring: %m");
+
+        bus = NULL;
+
+        log_debug("Accepted new private connection.");
+        return 0;
+}
+
+int manager_private_bus_listen(Manager *m) {
+        _cleanup_close_ int fd = -1;
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = SD_RESOLVED_PRIVATE_BUS_PATH,
+        };
+        struct rlimit rl;
+        int r;
+
+        assert(m);
+
+        /* Short-lived clients such as our NSS module pay for connecting and authenticating to the bus broker on every
+         * single lookup. Offer them a direct connection too, which is a lot cheaper to set up. */
+
+        if (m->private_listen_fd >= 0)
+                return 0;
+
+        m->private_buses_max = PRIVATE_CONNECTIONS_MAX;
+        if (getrlimit(RLIMIT_NOFILE, &rl) >= 0 && rl.rlim_cur != RLIM_INFINITY)
+                m->private_buses_max = MIN(m->private_buses_max, (unsigned) (rl.rlim_cur / 4));
+
+        (void) unlink(sa.un.sun_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (fd < 0)
+                return log_warning_errno(errno, "Failed to allocate private socket: %m");
+
+        if (bind(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return log_warning_errno(errno, "Failed to bind private socket: %m");
+
+        /* Everybody may look up names, just like on the bus */
+        if (chmod(sa.un.sun_path, 0666) < 0)
+                return log_warning_errno(errno, "Failed to change access mode of private socket: %m");
+
+        if (listen(fd, SOMAXCONN) < 0)
+                return log_warning_errno(errno, "Failed to make private socket listening: %m");
+
+        r = sd_event_add_io(m->event, &m->private_listen_event_source, fd, EPOLLIN, on_private_connection, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to allocate event source for private socket: %m");
+
+        (void) sd_event_source_set_description(m->private_listen_event_source, "bus-private-connection");
+
+        m->private_listen_fd = TAKE_FD(fd);
+        return 0;
+}
+
+void manager_private_bus_stop(Manager *m) {
+        sd_bus *bus;
+
+        assert(m);
+
+        while ((bus = set_steal_first(m->private_buses)))
+                sd_bus_flush_close_unref(bus);
+
+        m->private_buses = set_free(m->private_buses);
+        m->private_buses_active = set_free(m->private_buses_active);
+        m->private_idle_event_source = sd_event_source_unref(m->private_idle_event_source);
+
+        m->private_listen_event_source = sd_event_source_unref(m->private_listen_event_source);
+        m->private_listen_fd = safe_close(m->private_listen_fd);
+}
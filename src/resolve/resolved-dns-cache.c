@@ -10,10 +10,6 @@
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
- * leave DNS caches unbounded, but that's crazy. */
-#define CACHE_MAX 4096
-
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
 
@@ -21,8 +17,13 @@
  * now) */
 #define CACHE_TTL_STRANGE_RCODE_USEC (30 * USEC_PER_SEC)
 
+/* The TTL we hand out for entries served past their expiry, as suggested by RFC 8767, Section 4 */
+#define CACHE_STALE_TTL_SEC 30U
+
+/* Entries looked up in the last tenth of their lifetime are worth refreshing ahead of time */
+#define CACHE_PREFETCH_PERCENT 10U
+
 typedef enum DnsCacheItemType DnsCacheItemType;
-typedef struct DnsCacheItem DnsCacheItem;
 
 enum DnsCacheItemType {
         DNS_CACHE_POSITIVE,
@@ -37,9 +38,11 @@ struct DnsCacheItem {
         DnsResourceRecord *rr;
         int rcode;
 
-        usec_t until;
+        usec_t since, until;
         bool authenticated:1;
         bool shared_owner:1;
+        bool referenced:1; /* looked up since the clock hand passed last */
+        bool prefetched:1; /* a refresh was requested already */
 
         int ifindex;
         int owner_family;
@@ -47,6 +50,7 @@ struct DnsCacheItem {
 
         unsigned prioq_idx;
         LIST_FIELDS(DnsCacheItem, by_key);
+        LIST_FIELDS(DnsCacheItem, by_clock);
 };
 
 static const char *dns_cache_item_type_to_string(DnsCacheItem *item) {
@@ -81,6 +85,28 @@ static void dns_cache_item_free(DnsCacheItem *i) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(DnsCacheItem*, dns_cache_item_free);
 
+static void dns_cache_item_link_clock(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        /* New items are placed right behind the clock hand, so that they get a full revolution to be looked up
+         * before they are considered for eviction. */
+        if (!c->clock_hand)
+                c->clock_hand = c->by_clock;
+
+        LIST_INSERT_BEFORE(by_clock, c->by_clock, c->clock_hand, i);
+}
+
+static void dns_cache_item_unlink_clock(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        if (c->clock_hand == i)
+                c->clock_hand = i->by_clock_next;
+
+        LIST_REMOVE(by_clock, c->by_clock, i);
+}
+
 static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         DnsCacheItem *first;
 
@@ -98,6 +124,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
                 hashmap_remove(c->by_key, i->key);
 
         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_item_unlink_clock(c, i);
 
         dns_cache_item_free(i);
 }
@@ -132,6 +159,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
                 prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                dns_cache_item_unlink_clock(c, i);
                 dns_cache_item_free(i);
         }
 
@@ -148,39 +176,63 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(!c->by_clock && !c->clock_hand);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        unsigned max;
+
         assert(c);
 
         if (add <= 0)
                 return;
 
+        max = c->max_size > 0 ? c->max_size : DNS_CACHE_SIZE_DEFAULT;
+
         /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
+         * the cache to grow beyond the maximum size, but only when we
+         * shall add more RRs to the cache than that at once. In that
          * case the cache will be emptied completely otherwise. */
 
+        if (prioq_size(c->by_expiry) + add < max)
+                return;
+
+        /* Whatever expired already goes first */
+        dns_cache_prune(c);
+
+        /* Then sweep the clock: entries that were looked up since the hand passed them last get a second
+         * chance, the others are evicted. Thus popular entries survive a burst of one-off lookups, regardless
+         * of how soon they expire. */
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
                 DnsCacheItem *i;
+                unsigned n;
 
-                if (prioq_size(c->by_expiry) <= 0)
+                n = prioq_size(c->by_expiry);
+                if (n <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (n + add < max)
                         break;
 
-                i = prioq_peek(c->by_expiry);
+                i = c->clock_hand ?: c->by_clock;
                 assert(i);
 
+                if (i->referenced) {
+                        i->referenced = false;
+                        c->clock_hand = i->by_clock_next;
+                        continue;
+                }
+
                 /* Take an extra reference to the key so that it
                  * doesn't go away in the middle of the remove call */
                 key = dns_resource_key_ref(i->key);
                 dns_cache_remove_by_key(c, key);
+
+                c->n_evicted += n - prioq_size(c->by_expiry);
         }
 }
 
@@ -202,7 +254,8 @@ void dns_cache_prune(DnsCache *c) {
                 if (t <= 0)
                         t = now(clock_boottime_or_monotonic());
 
-                if (i->until > t)
+                /* Expired entries are kept around a bit longer if we may serve them stale */
+                if (usec_add(i->until, c->stale_retention_usec) > t)
                         break;
 
                 /* Depending whether this is an mDNS shared entry
@@ -283,6 +336,8 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 }
         }
 
+        dns_cache_item_link_clock(c, i);
+
         return 0;
 }
 
@@ -366,9 +421,11 @@ static void dns_cache_item_update_positive(
         dns_resource_key_unref(i->key);
         i->key = dns_resource_key_ref(rr->key);
 
+        i->since = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
+        i->prefetched = false;
 
         i->ifindex = ifindex;
 
@@ -442,6 +499,7 @@ static int dns_cache_put_positive(
         i->type = DNS_CACHE_POSITIVE;
         i->key = dns_resource_key_ref(rr->key);
         i->rr = dns_resource_record_ref(rr);
+        i->since = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
@@ -526,6 +584,7 @@ static int dns_cache_put_negative(
         i->type =
                 rcode == DNS_RCODE_SUCCESS ? DNS_CACHE_NODATA :
                 rcode == DNS_RCODE_NXDOMAIN ? DNS_CACHE_NXDOMAIN : DNS_CACHE_RCODE;
+        i->since = timestamp;
         i->until =
                 i->type == DNS_CACHE_RCODE ? timestamp + CACHE_TTL_STRANGE_RCODE_USEC :
                 calculate_until(soa, nsec_ttl, timestamp, true);
@@ -637,6 +696,10 @@ int dns_cache_put(
         assert(c);
         assert(owner_address);
 
+        /* If we may serve stale data, a failure must not flush what we would fall back to */
+        if (c->stale_retention_usec > 0 && !IN_SET(rcode, DNS_RCODE_SUCCESS, DNS_RCODE_NXDOMAIN))
+                return 0;
+
         dns_cache_remove_previous(c, key, answer);
 
         /* We only care for positive replies and NXDOMAINs, on all other replies we will simply flush the respective
@@ -812,7 +875,15 @@ static DnsCacheItem *dns_cache_get_by_key_follow_cname_dname_nsec(DnsCache *c, D
         return NULL;
 }
 
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **ret, bool *authenticated) {
+int dns_cache_lookup(
+                DnsCache *c,
+                DnsResourceKey *key,
+                DnsCacheLookupFlags flags,
+                int *rcode,
+                DnsAnswer **ret,
+                bool *authenticated,
+                bool *ret_prefetch) {
+
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
         char key_str[DNS_RESOURCE_KEY_STRING_MAX];
         unsigned n = 0;
@@ -820,6 +891,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         bool nxdomain = false;
         DnsCacheItem *j, *first, *nsec = NULL;
         bool have_authenticated = false, have_non_authenticated = false;
+        bool stale = false, expiring = false, prefetched = false;
         usec_t current;
         int found_rcode = -1;
 
@@ -829,6 +901,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         assert(ret);
         assert(authenticated);
 
+        if (ret_prefetch)
+                *ret_prefetch = false;
+
         if (key->type == DNS_TYPE_ANY || key->class == DNS_CLASS_ANY) {
                 /* If we have ANY lookups we don't use the cache, so
                  * that the caller refreshes via the network. */
@@ -861,7 +936,18 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
+        current = now(clock_boottime_or_monotonic());
+
         LIST_FOREACH(by_key, j, first) {
+                j->referenced = true;
+
+                if (j->until <= current)
+                        stale = true;
+                else if (j->until - current <= (j->until - j->since) * CACHE_PREFETCH_PERCENT / 100)
+                        expiring = true;
+                if (j->prefetched)
+                        prefetched = true;
+
                 if (j->rr) {
                         if (j->rr->key->type == DNS_TYPE_NSEC)
                                 nsec = j;
@@ -878,10 +964,34 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                         have_non_authenticated = true;
         }
 
+        if (stale && !FLAGS_SET(flags, DNS_CACHE_LOOKUP_STALE)) {
+                /* Only retained for serving it stale, hence treat it as absent otherwise */
+
+                log_debug("Cache miss for %s, entry expired",
+                          dns_resource_key_to_string(key, key_str, sizeof key_str));
+
+                c->n_miss++;
+
+                *ret = NULL;
+                *rcode = DNS_RCODE_SUCCESS;
+                *authenticated = false;
+
+                return 0;
+        }
+
+        if (ret_prefetch && expiring && !stale && !prefetched) {
+                /* Tell the caller to refresh the entry, but only once */
+                LIST_FOREACH(by_key, j, first)
+                        j->prefetched = true;
+
+                *ret_prefetch = true;
+        }
+
         if (found_rcode >= 0) {
-                log_debug("RCODE %s cache hit for %s",
+                log_debug("RCODE %s cache hit for %s%s",
                           dns_rcode_to_string(found_rcode),
-                          dns_resource_key_to_string(key, key_str, sizeof(key_str)));
+                          dns_resource_key_to_string(key, key_str, sizeof(key_str)),
+                          stale ? " (stale)" : "");
 
                 *ret = NULL;
                 *rcode = found_rcode;
@@ -895,8 +1005,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 /* Note that we won't derive information for DS RRs from an NSEC, because we only cache NSEC RRs from
                  * the lower-zone of a zone cut, but the DS RRs are on the upper zone. */
 
-                log_debug("NSEC NODATA cache hit for %s",
-                          dns_resource_key_to_string(key, key_str, sizeof key_str));
+                log_debug("NSEC NODATA cache hit for %s%s",
+                          dns_resource_key_to_string(key, key_str, sizeof key_str),
+                          stale ? " (stale)" : "");
 
                 /* We only found an NSEC record that matches our name.
                  * If it says the type doesn't exist report
@@ -917,10 +1028,11 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
-        log_debug("%s cache hit for %s",
+        log_debug("%s cache hit for %s%s",
                   n > 0    ? "Positive" :
                   nxdomain ? "NXDOMAIN" : "NODATA",
-                  dns_resource_key_to_string(key, key_str, sizeof key_str));
+                  dns_resource_key_to_string(key, key_str, sizeof key_str),
+                  stale ? " (stale)" : "");
 
         if (n <= 0) {
                 c->n_hit++;
@@ -935,19 +1047,25 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         if (!answer)
                 return -ENOMEM;
 
-        if (clamp_ttl)
-                current = now(clock_boottime_or_monotonic());
-
         LIST_FOREACH(by_key, j, first) {
                 _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
 
                 if (!j->rr)
                         continue;
 
-                if (clamp_ttl) {
+                if (stale || FLAGS_SET(flags, DNS_CACHE_LOOKUP_CLAMP_TTL)) {
+                        uint32_t ttl = (uint32_t) -1;
+
+                        if (FLAGS_SET(flags, DNS_CACHE_LOOKUP_CLAMP_TTL))
+                                ttl = LESS_BY(j->until, current) / USEC_PER_SEC;
+
+                        /* Stale answers are handed out with a short TTL, so that clients come back soon */
+                        if (stale)
+                                ttl = j->until > current ? MIN(ttl, CACHE_STALE_TTL_SEC) : CACHE_STALE_TTL_SEC;
+
                         rr = dns_resource_record_ref(j->rr);
 
-                        r = dns_resource_record_clamp_ttl(&rr, LESS_BY(j->until, current) / USEC_PER_SEC);
+                        r = dns_resource_record_clamp_ttl(&rr, ttl);
                         if (r < 0)
                                 return r;
                 }
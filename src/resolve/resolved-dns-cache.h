@@ -6,11 +6,26 @@
 #include "prioq.h"
 #include "time-util.h"
 
+/* Never cache more than 4K entries per scope by default. RFC 1536, Section 5 suggests to leave DNS caches
+ * unbounded, but that's crazy. */
+#define DNS_CACHE_SIZE_DEFAULT 4096U
+
+typedef struct DnsCacheItem DnsCacheItem;
+
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+
+        /* All items in a ring, swept by the clock hand when space needs to be made */
+        LIST_HEAD(DnsCacheItem, by_clock);
+        DnsCacheItem *clock_hand;
+
+        unsigned max_size; /* 0 means DNS_CACHE_SIZE_DEFAULT */
+        usec_t stale_retention_usec; /* how long to keep entries past their TTL, for serving them stale */
+
         unsigned n_hit;
         unsigned n_miss;
+        unsigned n_evicted;
 } DnsCache;
 
 #include "resolved-dns-answer.h"
@@ -22,7 +37,12 @@ void dns_cache_flush(DnsCache *c);
 void dns_cache_prune(DnsCache *c);
 
 int dns_cache_put(DnsCache *c, DnsResourceKey *key, int rcode, DnsAnswer *answer, bool authenticated, uint32_t nsec_ttl, usec_t timestamp, int owner_family, const union in_addr_union *owner_address);
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated);
+typedef enum DnsCacheLookupFlags {
+        DNS_CACHE_LOOKUP_CLAMP_TTL = 1 << 0, /* report the remaining TTL rather than the original one */
+        DNS_CACHE_LOOKUP_STALE     = 1 << 1, /* also return entries past their TTL that are still retained */
+} DnsCacheLookupFlags;
+
+int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, DnsCacheLookupFlags flags, int *rcode, DnsAnswer **answer, bool *authenticated, bool *ret_prefetch);
 
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address);
 
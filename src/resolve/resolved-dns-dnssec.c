@@ -524,6 +524,11 @@ static void md_add_uint16(gcry_md_hd_t md, uint16_t v) {
         gcry_md_write(md, &v, sizeof(v));
 }
 
+static void md_add_uint32(gcry_md_hd_t md, uint32_t v) {
+        v = htobe32(v);
+        gcry_md_write(md, &v, sizeof(v));
+}
+
 static void fwrite_uint8(FILE *fp, uint8_t v) {
         fwrite(&v, sizeof(v), 1, fp);
 }
@@ -538,6 +543,56 @@ static void fwrite_uint32(FILE *fp, uint32_t v) {
         fwrite(&v, sizeof(v), 1, fp);
 }
 
+static int dnssec_verify_cache_digest(
+                const void *data,
+                size_t size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                uint8_t ret[static DNSSEC_VERIFY_CACHE_DIGEST_SIZE]) {
+
+        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
+        void *digest;
+
+        /* Calculates the digest identifying a verification in the cache: everything the public key operation
+         * looks at, i.e. the signed data, the signature and the key. The sizes are included so that the
+         * concatenation is unambiguous. */
+
+        assert(gcry_md_get_algo_dlen(GCRY_MD_SHA256) == DNSSEC_VERIFY_CACHE_DIGEST_SIZE);
+
+        gcry_md_open(&md, GCRY_MD_SHA256, 0);
+        if (!md)
+                return -EIO;
+
+        md_add_uint32(md, size);
+        gcry_md_write(md, data, size);
+
+        md_add_uint16(md, rrsig->rrsig.signature_size);
+        gcry_md_write(md, rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+
+        md_add_uint16(md, dnskey->dnskey.flags);
+        md_add_uint8(md, dnskey->dnskey.protocol);
+        md_add_uint8(md, dnskey->dnskey.algorithm);
+        md_add_uint16(md, dnskey->dnskey.key_size);
+        gcry_md_write(md, dnskey->dnskey.key, dnskey->dnskey.key_size);
+
+        digest = gcry_md_read(md, 0);
+        if (!digest)
+                return -EIO;
+
+        memcpy(ret, digest, DNSSEC_VERIFY_CACHE_DIGEST_SIZE);
+        return 0;
+}
+
+static DnssecVerifyCacheEntry *dnssec_verify_cache_slot(
+                DnssecVerifyCache *cache,
+                const uint8_t digest[static DNSSEC_VERIFY_CACHE_DIGEST_SIZE]) {
+
+        assert(cache);
+
+        /* The digest is uniformly distributed, hence its first bytes make a fine index */
+        return cache->entries + (((size_t) digest[0] << 8 | digest[1]) % DNSSEC_VERIFY_CACHE_SIZE);
+}
+
 static int dnssec_rrsig_prepare(DnsResourceRecord *rrsig) {
         int n_key_labels, n_signer_labels;
         const char *name;
@@ -693,9 +748,12 @@ int dnssec_verify_rrset(
                 DnsResourceRecord *rrsig,
                 DnsResourceRecord *dnskey,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result) {
 
         uint8_t wire_format_name[DNS_WIRE_FORMAT_HOSTNAME_MAX];
+        uint8_t digest[DNSSEC_VERIFY_CACHE_DIGEST_SIZE];
+        DnssecVerifyCacheEntry *slot = NULL;
         DnsResourceRecord **list, *rr;
         const char *source, *name;
         _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
@@ -892,6 +950,21 @@ int dnssec_verify_rrset(
                         return -EIO;
         }
 
+        if (cache) {
+                r = dnssec_verify_cache_digest(sig_data, sig_size, rrsig, dnskey, digest);
+                if (r < 0)
+                        return r;
+
+                slot = dnssec_verify_cache_slot(cache, digest);
+                if (slot->used && memcmp(slot->digest, digest, sizeof(digest)) == 0) {
+                        cache->n_hit++;
+                        r = slot->verified;
+                        goto finish;
+                }
+
+                cache->n_miss++;
+        }
+
         switch (rrsig->rrsig.algorithm) {
 
         case DNSSEC_ALGORITHM_RSASHA1:
@@ -927,6 +1000,13 @@ int dnssec_verify_rrset(
         if (r < 0)
                 return r;
 
+        if (slot) {
+                memcpy(slot->digest, digest, sizeof(digest));
+                slot->used = true;
+                slot->verified = r > 0;
+        }
+
+finish:
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
                 dnssec_fix_rrset_ttl(list, n, rrsig, realtime);
@@ -992,6 +1072,7 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
@@ -1046,7 +1127,7 @@ int dnssec_verify_rrset_search(
                          * the RRSet against the RRSIG and DNSKEY
                          * combination. */
 
-                        r = dnssec_verify_rrset(a, key, rrsig, dnskey, realtime, &one_result);
+                        r = dnssec_verify_rrset(a, key, rrsig, dnskey, realtime, cache, &one_result);
                         if (r < 0)
                                 return r;
 
@@ -2225,6 +2306,7 @@ int dnssec_verify_rrset(
                 DnsResourceRecord *rrsig,
                 DnsResourceRecord *dnskey,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result) {
 
         return -EOPNOTSUPP;
@@ -2245,6 +2327,7 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
@@ -3,6 +3,7 @@
 
 typedef enum DnssecResult DnssecResult;
 typedef enum DnssecVerdict DnssecVerdict;
+typedef struct DnssecVerifyCache DnssecVerifyCache;
 
 #include "dns-domain.h"
 #include "resolved-dns-answer.h"
@@ -45,11 +46,29 @@ enum DnssecVerdict {
 /* The longest digest we'll ever generate, of all digest algorithms we support */
 #define DNSSEC_HASH_SIZE_MAX (MAX(20, 32))
 
+/* Number of slots in the cache of signature verification results, and the size of the digest identifying each */
+#define DNSSEC_VERIFY_CACHE_SIZE 1024U
+#define DNSSEC_VERIFY_CACHE_DIGEST_SIZE 32U
+
+typedef struct DnssecVerifyCacheEntry {
+        uint8_t digest[DNSSEC_VERIFY_CACHE_DIGEST_SIZE];
+        bool used:1;
+        bool verified:1;
+} DnssecVerifyCacheEntry;
+
+/* Remembers the outcome of the public key operation for a combination of signed data, RRSIG and DNSKEY, so that the
+ * same RRset signed by the same key (which is common for DNSKEY and DS RRsets shared by many lookups) is not verified
+ * over and over again. Entries are indexed by a SHA-256 digest of all the input, and simply replaced on conflict. */
+struct DnssecVerifyCache {
+        DnssecVerifyCacheEntry entries[DNSSEC_VERIFY_CACHE_SIZE];
+        uint64_t n_hit, n_miss;
+};
+
 int dnssec_rrsig_match_dnskey(DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, bool revoked_ok);
 int dnssec_key_match_rrsig(const DnsResourceKey *key, DnsResourceRecord *rrsig);
 
-int dnssec_verify_rrset(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecResult *result);
-int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecResult *result, DnsResourceRecord **rrsig);
+int dnssec_verify_rrset(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecVerifyCache *cache, DnssecResult *result);
+int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecVerifyCache *cache, DnssecResult *result, DnsResourceRecord **rrsig);
 
 int dnssec_verify_dnskey_by_ds(DnsResourceRecord *dnskey, DnsResourceRecord *ds, bool mask_revoke);
 int dnssec_verify_dnskey_by_ds_search(DnsResourceRecord *dnskey, DnsAnswer *validated_ds);
@@ -167,17 +167,13 @@ DnsPacket *dns_packet_ref(DnsPacket *p) {
 }
 
 static void dns_packet_free(DnsPacket *p) {
-        char *s;
-
         assert(p);
 
         dns_question_unref(p->question);
         dns_answer_unref(p->answer);
         dns_resource_record_unref(p->opt);
 
-        while ((s = hashmap_steal_first_key(p->names)))
-                free(s);
-        hashmap_free(p->names);
+        free(p->names);
 
         free(p->_data);
 
@@ -352,23 +348,14 @@ static int dns_packet_extend(DnsPacket *p, size_t add, void **ret, size_t *start
 }
 
 void dns_packet_truncate(DnsPacket *p, size_t sz) {
-        Iterator i;
-        char *s;
-        void *n;
-
         assert(p);
 
         if (p->size <= sz)
                 return;
 
-        HASHMAP_FOREACH_KEY(n, s, p->names, i) {
-
-                if (PTR_TO_SIZE(n) < sz)
-                        continue;
-
-                hashmap_remove(p->names, s);
-                free(s);
-        }
+        /* The label offsets are recorded in ascending order */
+        while (p->n_names > 0 && p->names[p->n_names - 1] >= sz)
+                p->n_names--;
 
         p->size = sz;
 }
@@ -498,6 +485,72 @@ int dns_packet_append_label(DnsPacket *p, const char *d, size_t l, bool canonica
         return 0;
 }
 
+static bool dns_packet_name_equal(DnsPacket *p, size_t offset, const uint8_t *name) {
+        const uint8_t *d;
+
+        assert(p);
+        assert(name);
+
+        /* Checks whether the name in wire format at the specified packet offset is the same as the specified one,
+         * also in wire format. Labels are compared case-insensitively, like dns_name_equal() does. */
+
+        d = DNS_PACKET_DATA(p);
+
+        for (;;) {
+                uint8_t c;
+
+                if (offset >= p->size)
+                        return false;
+
+                c = d[offset];
+
+                if ((c & 0xc0) == 0xc0) {
+                        size_t ptr;
+
+                        if (offset + 1 >= p->size)
+                                return false;
+
+                        /* We only ever generate pointers to prior occurrences, refuse anything else, so that
+                         * this is guaranteed to terminate */
+                        ptr = (size_t) (c & ~0xc0) << 8 | d[offset + 1];
+                        if (ptr >= offset)
+                                return false;
+
+                        offset = ptr;
+                        continue;
+                }
+
+                if (c != *name)
+                        return false;
+                if (c == 0)
+                        return true;
+
+                if (offset + 1 + c > p->size)
+                        return false;
+                if (ascii_strcasecmp_n((const char*) d + offset + 1, (const char*) name + 1, c) != 0)
+                        return false;
+
+                offset += 1 + c;
+                name += 1 + c;
+        }
+}
+
+static size_t dns_packet_find_name(DnsPacket *p, const uint8_t *name) {
+        size_t i;
+
+        assert(p);
+
+        /* Returns the offset of an earlier occurrence of the specified name, or 0 if there is none. There are
+         * only a few names in the typical packet, hence a linear search over the recorded label offsets is cheaper
+         * than maintaining an index of the names. */
+
+        for (i = 0; i < p->n_names; i++)
+                if (dns_packet_name_equal(p, p->names[i], name))
+                        return p->names[i];
+
+        return 0;
+}
+
 int dns_packet_append_name(
                 DnsPacket *p,
                 const char *name,
@@ -505,7 +558,8 @@ int dns_packet_append_name(
                 bool canonical_candidate,
                 size_t *start) {
 
-        size_t saved_size;
+        uint8_t wire[DNS_WIRE_FORMAT_HOSTNAME_MAX];
+        size_t saved_size, pos;
         int r;
 
         assert(p);
@@ -516,17 +570,16 @@ int dns_packet_append_name(
 
         saved_size = p->size;
 
-        while (!dns_name_is_root(name)) {
-                const char *z = name;
-                char label[DNS_LABEL_MAX];
-                size_t n = 0;
+        r = dns_name_to_wire_format(name, wire, sizeof(wire), false);
+        if (r < 0)
+                return r;
 
-                if (allow_compression)
-                        n = PTR_TO_SIZE(hashmap_get(p->names, name));
-                if (n > 0) {
-                        assert(n < p->size);
+        for (pos = 0; wire[pos] != 0; pos += 1 + wire[pos]) {
+                size_t n;
 
-                        if (n < 0x4000) {
+                if (allow_compression) {
+                        n = dns_packet_find_name(p, wire + pos);
+                        if (n > 0) {
                                 r = dns_packet_append_uint16(p, 0xC000 | n, NULL);
                                 if (r < 0)
                                         goto fail;
@@ -535,38 +588,24 @@ int dns_packet_append_name(
                         }
                 }
 
-                r = dns_label_unescape(&name, label, sizeof(label));
+                r = dns_packet_append_label(p, (const char*) wire + pos + 1, wire[pos], canonical_candidate, &n);
                 if (r < 0)
                         goto fail;
 
-                r = dns_packet_append_label(p, label, r, canonical_candidate, &n);
-                if (r < 0)
-                        goto fail;
-
-                if (allow_compression) {
-                        _cleanup_free_ char *s = NULL;
-
-                        s = strdup(z);
-                        if (!s) {
+                /* Compression pointers have 14 bits for the offset */
+                if (allow_compression && n < 0x4000) {
+                        if (!GREEDY_REALLOC(p->names, p->n_names_allocated, p->n_names + 1)) {
                                 r = -ENOMEM;
                                 goto fail;
                         }
 
-                        r = hashmap_ensure_allocated(&p->names, &dns_name_hash_ops);
-                        if (r < 0)
-                                goto fail;
-
-                        r = hashmap_put(p->names, s, SIZE_TO_PTR(n));
-                        if (r < 0)
-                                goto fail;
-
-                        s = NULL;
+                        p->names[p->n_names++] = n;
                 }
         }
 
         r = dns_packet_append_uint8(p, 0, NULL);
         if (r < 0)
-                return r;
+                goto fail;
 
 done:
         if (start)
@@ -1380,10 +1419,12 @@ int dns_packet_read_name(
                 size_t *start) {
 
         _cleanup_(rewind_dns_packet) DnsPacketRewinder rewinder;
-        size_t after_rindex = 0, jump_barrier;
-        _cleanup_free_ char *ret = NULL;
-        size_t n = 0, allocated = 0;
+        size_t after_rindex = 0, jump_barrier, wire_size = 1;
+        /* Every octet of a label needs at most 4 characters escaped, each length octet at most one for the dot */
+        char buf[DNS_WIRE_FORMAT_HOSTNAME_MAX * 4];
+        size_t n = 0;
         bool first = true;
+        char *ret;
         int r;
 
         assert(p);
@@ -1394,6 +1435,9 @@ int dns_packet_read_name(
         if (p->refuse_compression)
                 allow_compression = false;
 
+        /* The name is decoded on the stack, and only copied to the heap once complete, so that it takes up
+         * no more memory than necessary for as long as it is around. */
+
         for (;;) {
                 uint8_t c, d;
 
@@ -1412,15 +1456,18 @@ int dns_packet_read_name(
                         if (r < 0)
                                 return r;
 
-                        if (!GREEDY_REALLOC(ret, allocated, n + !first + DNS_LABEL_ESCAPED_MAX))
-                                return -ENOMEM;
+                        /* Refuse names longer than allowed (RFC 1035, Section 3.1), which can only be built with
+                         * compression pointers */
+                        wire_size += 1 + c;
+                        if (wire_size > DNS_WIRE_FORMAT_HOSTNAME_MAX)
+                                return -EBADMSG;
 
                         if (first)
                                 first = false;
                         else
-                                ret[n++] = '.';
+                                buf[n++] = '.';
 
-                        r = dns_label_escape(label, c, ret + n, DNS_LABEL_ESCAPED_MAX);
+                        r = dns_label_escape(label, c, buf + n, sizeof(buf) - n);
                         if (r < 0)
                                 return r;
 
@@ -1448,15 +1495,14 @@ int dns_packet_read_name(
                         return -EBADMSG;
         }
 
-        if (!GREEDY_REALLOC(ret, allocated, n + 1))
+        ret = strndup(buf, n);
+        if (!ret)
                 return -ENOMEM;
 
-        ret[n] = 0;
-
         if (after_rindex != 0)
                 p->rindex= after_rindex;
 
-        *_ret = TAKE_PTR(ret);
+        *_ret = ret;
 
         if (start)
                 *start = rewinder.saved_rindex;
@@ -57,7 +57,8 @@ struct DnsPacket {
         DnsProtocol protocol;
         size_t size, allocated, rindex, max_size;
         void *_data; /* don't access directly, use DNS_PACKET_DATA()! */
-        Hashmap *names; /* For name compression */
+        uint16_t *names; /* For name compression: offsets of the labels written so far */
+        size_t n_names, n_names_allocated;
         size_t opt_start, opt_size;
 
         /* Parsed data */
@@ -7,6 +7,7 @@
 #include "dns-type.h"
 #include "escape.h"
 #include "hexdecoct.h"
+#include "mempool.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-rr.h"
@@ -374,10 +375,14 @@ bool dns_resource_key_reduce(DnsResourceKey **a, DnsResourceKey **b) {
         return true;
 }
 
+/* Resource records are created and destroyed in large numbers for each packet parsed or synthesized, hence
+ * allocate them from a pool. */
+DEFINE_THREADED_MEMPOOL(dns_resource_record_pool, DnsResourceRecord, 64);
+
 DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
         DnsResourceRecord *rr;
 
-        rr = new0(DnsResourceRecord, 1);
+        rr = threaded_mempool_alloc0_tile(&dns_resource_record_pool);
         if (!rr)
                 return NULL;
 
@@ -491,7 +496,8 @@ static DnsResourceRecord* dns_resource_record_free(DnsResourceRecord *rr) {
         }
 
         free(rr->to_string);
-        return mfree(rr);
+        threaded_mempool_free_tile(&dns_resource_record_pool, rr);
+        return NULL;
 }
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(DnsResourceRecord, dns_resource_record, dns_resource_record_free);
@@ -39,6 +39,9 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
         s->protocol = protocol;
         s->family = family;
         s->resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC;
+        s->cache.max_size = m->cache_size;
+        if (protocol == DNS_PROTOCOL_DNS)
+                s->cache.stale_retention_usec = m->stale_retention_usec;
 
         if (protocol == DNS_PROTOCOL_DNS) {
                 /* Copy DNSSEC mode from the link if it is set there,
@@ -828,6 +831,10 @@ DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key,
         if (!t)
                 return NULL;
 
+        /* Don't make anyone wait for a refresh of an entry the cache can still answer from */
+        if (t->prefetch && DNS_TRANSACTION_IS_LIVE(t->state))
+                return NULL;
+
         /* Refuse reusing transactions that completed based on cached
          * data instead of a real packet, if that's requested. */
         if (!cache_ok &&
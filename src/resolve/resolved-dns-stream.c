@@ -8,6 +8,8 @@
 #include "missing.h"
 #include "resolved-dns-stream.h"
 
+/* Streams are closed after this period of inactivity. Upstream connections are reused for subsequent transactions,
+ * hence this is measured from the last packet sent or received, and not from when the connection was established. */
 #define DNS_STREAM_TIMEOUT_USEC (10 * USEC_PER_SEC)
 #define DNS_STREAMS_MAX 128
 
@@ -45,6 +47,15 @@ static int dns_stream_update_io(DnsStream *s) {
         return sd_event_source_set_io_events(s->io_event_source, f);
 }
 
+static int dns_stream_reset_timeout(DnsStream *s) {
+        assert(s);
+
+        if (!s->timeout_event_source)
+                return 0;
+
+        return sd_event_source_set_time(s->timeout_event_source, now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC);
+}
+
 static int dns_stream_complete(DnsStream *s, int error) {
         assert(s);
 
@@ -326,6 +337,10 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
                 /* Are we done? If so, disable the event source for EPOLLOUT */
                 if (s->n_written >= sizeof(s->write_size) + s->write_packet->size) {
+                        r = dns_stream_reset_timeout(s);
+                        if (r < 0)
+                                return dns_stream_complete(s, -r);
+
                         r = dns_stream_update_io(s);
                         if (r < 0)
                                 return dns_stream_complete(s, -r);
@@ -401,6 +416,10 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
                         /* Are we done? If so, disable the event source for EPOLLIN */
                         if (s->n_read >= sizeof(s->read_size) + be16toh(s->read_size)) {
+                                r = dns_stream_reset_timeout(s);
+                                if (r < 0)
+                                        return dns_stream_complete(s, -r);
+
                                 /* If there's a packet handler
                                  * installed, call that. Note that
                                  * this is optional... */
@@ -524,5 +543,9 @@ int dns_stream_write_packet(DnsStream *s, DnsPacket *p) {
 
         dns_packet_ref(p);
 
+        r = dns_stream_reset_timeout(s);
+        if (r < 0)
+                return r;
+
         return dns_stream_update_io(s);
 }
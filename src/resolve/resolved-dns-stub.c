@@ -8,6 +8,13 @@
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* How many UDP queries to read in one go before returning to the event loop, so that a flood of queries is worked
+ * through in batches, but doesn't starve the upstream transactions either */
+#define STUB_UDP_BATCH_MAX 32U
+
+/* Give bursts of queries some room to queue up, instead of dropping them */
+#define STUB_UDP_RCVBUF_SIZE (1U*1024U*1024U)
+
 static int manager_dns_stub_udp_fd(Manager *m);
 static int manager_dns_stub_tcp_fd(Manager *m);
 
@@ -373,20 +380,29 @@ fail:
 }
 
 static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         Manager *m = userdata;
+        unsigned n;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        /* Queries answered from the cache are replied to right away, hence under load read whatever is queued
+         * rather than going through the event loop for every single packet. */
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+        for (n = 0; n < STUB_UDP_BATCH_MAX; n++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-                dns_stub_process_query(m, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (IN_SET(r, -EAGAIN, -EINTR) && n > 0)
+                        break;
+                if (r <= 0)
+                        return r;
+
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -417,6 +433,8 @@ static int manager_dns_stub_udp_fd(Manager *m) {
         if (setsockopt(fd, IPPROTO_IP, IP_RECVTTL, &one, sizeof one) < 0)
                 return -errno;
 
+        (void) fd_inc_rcvbuf(fd, STUB_UDP_RCVBUF_SIZE);
+
         /* Make sure no traffic from outside the local host can leak to onto this socket */
         if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, "lo", 3) < 0)
                 return -errno;
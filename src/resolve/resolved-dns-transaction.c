@@ -296,6 +296,54 @@ static void dns_transaction_tentative(DnsTransaction *t, DnsPacket *p) {
         dns_transaction_gc(t);
 }
 
+static bool dns_transaction_serve_stale(DnsTransaction *t, DnsTransactionState *state) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        bool authenticated;
+        int rcode, r;
+
+        assert(t);
+        assert(state);
+
+        /* If the network could not answer, fall back to expired cache entries, if we retained them for that, see
+         * RFC 8767. */
+
+        if (t->scope->cache.stale_retention_usec <= 0)
+                return false;
+
+        if (t->prefetch || !set_isempty(t->notify_zone_items))
+                return false;
+
+        if (!IN_SET(*state,
+                    DNS_TRANSACTION_TIMEOUT,
+                    DNS_TRANSACTION_ATTEMPTS_MAX_REACHED,
+                    DNS_TRANSACTION_NETWORK_DOWN,
+                    DNS_TRANSACTION_ERRNO) &&
+            !(*state == DNS_TRANSACTION_RCODE_FAILURE &&
+              t->answer_source == DNS_TRANSACTION_NETWORK &&
+              t->answer_rcode == DNS_RCODE_SERVFAIL))
+                return false;
+
+        r = dns_cache_lookup(&t->scope->cache, t->key,
+                             DNS_CACHE_LOOKUP_STALE | (t->clamp_ttl ? DNS_CACHE_LOOKUP_CLAMP_TTL : 0),
+                             &rcode, &answer, &authenticated, NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to look up stale cache entries, ignoring: %m");
+        if (r <= 0)
+                return false;
+
+        log_debug("Transaction %" PRIu16 " failed with <%s>, answering from stale cache entries.",
+                  t->id, dns_transaction_state_to_string(*state));
+
+        dns_transaction_reset_answer(t);
+        t->answer = TAKE_PTR(answer);
+        t->answer_rcode = rcode;
+        t->answer_source = DNS_TRANSACTION_CACHE;
+        t->answer_authenticated = authenticated;
+
+        *state = rcode == DNS_RCODE_SUCCESS ? DNS_TRANSACTION_SUCCESS : DNS_TRANSACTION_RCODE_FAILURE;
+        return true;
+}
+
 void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         DnsQueryCandidate *c;
         DnsZoneItem *z;
@@ -306,6 +354,8 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         assert(t);
         assert(!DNS_TRANSACTION_IS_LIVE(state));
 
+        (void) dns_transaction_serve_stale(t, &state);
+
         if (state == DNS_TRANSACTION_DNSSEC_FAILED) {
                 dns_resource_key_to_string(t->key, key_str, sizeof key_str);
 
@@ -1338,6 +1388,44 @@ static usec_t transaction_get_resend_timeout(DnsTransaction *t) {
         }
 }
 
+static void dns_transaction_start_prefetch(DnsTransaction *t) {
+        DnsTransaction *p;
+        int r;
+
+        assert(t);
+
+        if (!t->scope->manager->cache_prefetch)
+                return;
+
+        /* mDNS and LLMNR have their own ways of keeping information current */
+        if (t->scope->protocol != DNS_PROTOCOL_DNS)
+                return;
+
+        /* The answer is about to expire, and is still asked for. Look it up again in the background, so that
+         * the cache is refreshed before anyone has to wait for the network. The transaction is not referenced
+         * by anything, hence it is freed as soon as it completed, after its answer has been cached. */
+
+        r = dns_transaction_new(&p, t->scope, t->key);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to create prefetch transaction, ignoring: %m");
+                return;
+        }
+
+        p->prefetch = true;
+
+        p->block_gc++;
+        r = dns_transaction_go(p);
+        p->block_gc--;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to start prefetch transaction, ignoring: %m");
+                dns_transaction_free(p);
+                return;
+        }
+
+        if (!DNS_TRANSACTION_IS_LIVE(p->state))
+                dns_transaction_gc(p);
+}
+
 static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         int r;
 
@@ -1433,8 +1521,10 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         }
 
         /* Check the cache, but only if this transaction is not used
-         * for probing or verifying a zone item. */
-        if (set_isempty(t->notify_zone_items)) {
+         * for probing or verifying a zone item, or for refreshing the
+         * cache itself. */
+        if (set_isempty(t->notify_zone_items) && !t->prefetch) {
+                bool prefetch;
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1444,10 +1534,15 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 /* Let's then prune all outdated entries */
                 dns_cache_prune(&t->scope->cache);
 
-                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated);
+                r = dns_cache_lookup(&t->scope->cache, t->key,
+                                     t->clamp_ttl ? DNS_CACHE_LOOKUP_CLAMP_TTL : 0,
+                                     &t->answer_rcode, &t->answer, &t->answer_authenticated, &prefetch);
                 if (r < 0)
                         return r;
                 if (r > 0) {
+                        if (prefetch)
+                                dns_transaction_start_prefetch(t);
+
                         t->answer_source = DNS_TRANSACTION_CACHE;
                         if (t->answer_rcode == DNS_RCODE_SUCCESS)
                                 dns_transaction_complete(t, DNS_TRANSACTION_SUCCESS);
@@ -2842,7 +2937,9 @@ static int dnssec_validate_records(
                                 continue;
                 }
 
-                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY, &result, &rrsig);
+                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY,
+                                               manager_get_dnssec_verify_cache(t->scope->manager),
+                                               &result, &rrsig);
                 if (r < 0)
                         return r;
 
@@ -62,6 +62,9 @@ struct DnsTransaction {
 
         bool probing:1;
 
+        /* Refreshes a cache entry ahead of its expiry, nobody waits for it */
+        bool prefetch:1;
+
         DnsPacket *sent, *received;
 
         DnsAnswer *answer;
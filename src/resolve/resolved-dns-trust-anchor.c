@@ -754,7 +754,7 @@ int dns_trust_anchor_check_revoked(DnsTrustAnchor *d, DnsResourceRecord *dnskey,
                 if (r == 0)
                         continue;
 
-                r = dnssec_verify_rrset(rrs, dnskey->key, rrsig, dnskey, USEC_INFINITY, &result);
+                r = dnssec_verify_rrset(rrs, dnskey->key, rrsig, dnskey, USEC_INFINITY, NULL, &result);
                 if (r < 0)
                         return r;
                 if (result != DNSSEC_VALIDATED)
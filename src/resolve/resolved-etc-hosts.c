@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/inotify.h>
+
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
@@ -122,10 +124,17 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
                         continue;
                 }
 
-                r = strv_extend(&item->names, name);
-                if (r < 0)
+                /* Hosts files used for blocking often map tens of thousands of names to the same address, hence
+                 * don't use strv_extend() here, which would make this quadratic */
+                if (!GREEDY_REALLOC(item->names, item->n_allocated, item->n_names + 2))
                         return log_oom();
 
+                item->names[item->n_names] = strdup(name);
+                if (!item->names[item->n_names])
+                        return log_oom();
+
+                item->names[++item->n_names] = NULL;
+
                 bn = hashmap_get(hosts->by_name, name);
                 if (!bn) {
                         r = hashmap_ensure_allocated(&hosts->by_name, &dns_name_hash_ops);
@@ -240,6 +249,54 @@ static int manager_etc_hosts_read(Manager *m) {
         return 1;
 }
 
+static int on_etc_hosts_change(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(event);
+
+        if (!(event->mask & IN_Q_OVERFLOW) &&
+            !(event->len > 0 && streq(event->name, "hosts")))
+                return 0;
+
+        /* Reread unconditionally, without checking the timestamps */
+        m->etc_hosts_last = m->etc_hosts_mtime = USEC_INFINITY;
+        (void) manager_etc_hosts_read(m);
+
+        return 0;
+}
+
+int manager_etc_hosts_watch(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (!m->read_etc_hosts)
+                return 0;
+
+        /* Watch the directory rather than the file, so that we also notice when the file is replaced by a rename(),
+         * or created after we started. Once this is set up, the file is only (re-)read when the watch tells us to,
+         * and lookups never touch the file system. If this fails, we check the file on lookups instead. */
+
+        r = sd_event_add_inotify(m->event, &m->etc_hosts_event_source, "/etc",
+                                 IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR,
+                                 on_etc_hosts_change, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to watch /etc/hosts, ignoring: %m");
+                return 0;
+        }
+
+        /* Rereading a big file takes a while, let's answer pending queries first */
+        r = sd_event_source_set_priority(m->etc_hosts_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set priority of /etc/hosts event source: %m");
+
+        (void) sd_event_source_set_description(m->etc_hosts_event_source, "etc-hosts");
+
+        (void) manager_etc_hosts_read(m);
+        return 0;
+}
+
 int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
         bool found_a = false, found_aaaa = false;
         struct in_addr_data k = {};
@@ -256,7 +313,8 @@ int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
         if (!m->read_etc_hosts)
                 return 0;
 
-        (void) manager_etc_hosts_read(m);
+        if (!m->etc_hosts_event_source)
+                (void) manager_etc_hosts_read(m);
 
         name = dns_question_first_name(q);
         if (!name)
@@ -9,6 +9,7 @@ typedef struct EtcHostsItem {
         struct in_addr_data address;
 
         char **names;
+        size_t n_names, n_allocated;
 } EtcHostsItem;
 
 typedef struct EtcHostsItemByName {
@@ -22,4 +23,5 @@ int etc_hosts_parse(EtcHosts *hosts, FILE *f);
 void etc_hosts_free(EtcHosts *hosts);
 
 void manager_etc_hosts_flush(Manager *m);
+int manager_etc_hosts_watch(Manager *m);
 int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer);
@@ -13,6 +13,7 @@
 #include "alloc-util.h"
 #include "dirent-util.h"
 #include "dns-domain.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fileio-label.h"
 #include "hostname-util.h"
@@ -526,6 +527,8 @@ static int manager_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si
                 LIST_FOREACH(servers, server, l->dns_servers)
                         dns_server_dump(server, f);
 
+        event_dump_statistics(m->event, f, NULL);
+
         if (fflush_and_check(f) < 0)
                 return log_oom();
 
@@ -571,12 +574,14 @@ int manager_new(Manager **ret) {
         m->mdns_ipv4_fd = m->mdns_ipv6_fd = -1;
         m->dns_stub_udp_fd = m->dns_stub_tcp_fd = -1;
         m->hostname_fd = -1;
+        m->private_listen_fd = -1;
 
         m->llmnr_support = RESOLVE_SUPPORT_YES;
         m->mdns_support = RESOLVE_SUPPORT_YES;
         m->dnssec_mode = DEFAULT_DNSSEC_MODE;
         m->dns_over_tls_mode = DEFAULT_DNS_OVER_TLS_MODE;
         m->enable_cache = true;
+        m->cache_size = DNS_CACHE_SIZE_DEFAULT;
         m->dns_stub_listener_mode = DNS_STUB_LISTENER_UDP;
         m->read_resolv_conf = true;
         m->need_builtin_fallbacks = true;
@@ -604,6 +609,10 @@ int manager_new(Manager **ret) {
         if (r < 0)
                 return r;
 
+        r = manager_etc_hosts_watch(m);
+        if (r < 0)
+                return r;
+
         r = dnssd_load(m);
         if (r < 0)
                 log_warning_errno(r, "Failed to load DNS-SD configuration files: %m");
@@ -624,6 +633,8 @@ int manager_new(Manager **ret) {
         if (r < 0)
                 return r;
 
+        (void) manager_private_bus_listen(m);
+
         (void) sd_event_add_signal(m->event, &m->sigusr1_event_source, SIGUSR1, manager_sigusr1, m);
         (void) sd_event_add_signal(m->event, &m->sigusr2_event_source, SIGUSR2, manager_sigusr2, m);
         (void) sd_event_add_signal(m->event, &m->sigrtmin1_event_source, SIGRTMIN+1, manager_sigrtmin1, m);
@@ -686,6 +697,8 @@ Manager *manager_free(Manager *m) {
 
         sd_bus_unref(m->bus);
 
+        manager_private_bus_stop(m);
+
         sd_event_source_unref(m->sigusr1_event_source);
         sd_event_source_unref(m->sigusr2_event_source);
         sd_event_source_unref(m->sigrtmin1_event_source);
@@ -698,6 +711,7 @@ Manager *manager_free(Manager *m) {
         dns_resource_key_unref(m->mdns_host_ipv6_key);
 
         sd_event_source_unref(m->hostname_event_source);
+        sd_event_source_unref(m->etc_hosts_event_source);
         safe_close(m->hostname_fd);
 
         free(m->full_hostname);
@@ -711,6 +725,8 @@ Manager *manager_free(Manager *m) {
         dns_trust_anchor_flush(&m->trust_anchor);
         manager_etc_hosts_flush(m);
 
+        free(m->dnssec_verify_cache);
+
         return mfree(m);
 }
 
@@ -1405,6 +1421,16 @@ void manager_dnssec_verdict(Manager *m, DnssecVerdict verdict, const DnsResource
         m->n_dnssec_verdict[verdict]++;
 }
 
+DnssecVerifyCache *manager_get_dnssec_verify_cache(Manager *m) {
+        assert(m);
+
+        /* The cache is merely an optimization, hence if we can't allocate it we'll just go without */
+        if (!m->dnssec_verify_cache)
+                m->dnssec_verify_cache = new0(DnssecVerifyCache, 1);
+
+        return m->dnssec_verify_cache;
+}
+
 bool manager_routable(Manager *m, int family) {
         Iterator i;
         Link *l;
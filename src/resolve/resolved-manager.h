@@ -37,6 +37,9 @@ struct Manager {
         DnssecMode dnssec_mode;
         DnsOverTlsMode dns_over_tls_mode;
         bool enable_cache;
+        unsigned cache_size;
+        bool cache_prefetch;
+        usec_t stale_retention_usec;
         DnsStubListenerMode dns_stub_listener_mode;
 
         /* Network */
@@ -99,6 +102,13 @@ struct Manager {
         /* dbus */
         sd_bus *bus;
 
+        int private_listen_fd;
+        sd_event_source *private_listen_event_source;
+        Set *private_buses;
+        Set *private_buses_active; /* Private connections something was received on since the last idle check */
+        sd_event_source *private_idle_event_source;
+        unsigned private_buses_max;
+
         /* The hostname we publish on LLMNR and mDNS */
         char *full_hostname;
         char *llmnr_hostname;
@@ -119,8 +129,12 @@ struct Manager {
         unsigned n_transactions_total;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
 
+        /* Allocated on first use */
+        DnssecVerifyCache *dnssec_verify_cache;
+
         /* Data from /etc/hosts */
         EtcHosts etc_hosts;
+        sd_event_source *etc_hosts_event_source;
         usec_t etc_hosts_last, etc_hosts_mtime;
         bool read_etc_hosts;
 
@@ -173,6 +187,7 @@ bool manager_dnssec_supported(Manager *m);
 DnsOverTlsMode manager_get_dns_over_tls_mode(Manager *m);
 
 void manager_dnssec_verdict(Manager *m, DnssecVerdict verdict, const DnsResourceKey *key);
+DnssecVerifyCache *manager_get_dnssec_verify_cache(Manager *m);
 
 bool manager_routable(Manager *m, int family);
 
@@ -193,7 +193,7 @@ static void test_dnssec_verify_rfc8080_ed25519_example1(void) {
         assert_se(dns_answer_add(answer, mx, 0, DNS_ANSWER_AUTHENTICATED) >= 0);
 
         assert_se(dnssec_verify_rrset(answer, mx->key, rrsig, dnskey,
-                                rrsig->rrsig.inception * USEC_PER_SEC, &result) >= 0);
+                                rrsig->rrsig.inception * USEC_PER_SEC, NULL, &result) >= 0);
 #if GCRYPT_VERSION_NUMBER >= 0x010600
         assert_se(result == DNSSEC_VALIDATED);
 #else
@@ -285,7 +285,7 @@ static void test_dnssec_verify_rfc8080_ed25519_example2(void) {
         assert_se(dns_answer_add(answer, mx, 0, DNS_ANSWER_AUTHENTICATED) >= 0);
 
         assert_se(dnssec_verify_rrset(answer, mx->key, rrsig, dnskey,
-                                rrsig->rrsig.inception * USEC_PER_SEC, &result) >= 0);
+                                rrsig->rrsig.inception * USEC_PER_SEC, NULL, &result) >= 0);
 #if GCRYPT_VERSION_NUMBER >= 0x010600
         assert_se(result == DNSSEC_VALIDATED);
 #else
@@ -319,6 +319,7 @@ static void test_dnssec_verify_rrset(void) {
 
         _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *a = NULL, *rrsig = NULL, *dnskey = NULL;
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        _cleanup_free_ DnssecVerifyCache *cache = NULL;
         DnssecResult result;
 
         a = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "nAsA.gov");
@@ -367,8 +368,26 @@ static void test_dnssec_verify_rrset(void) {
         assert_se(dns_answer_add(answer, a, 0, DNS_ANSWER_AUTHENTICATED) >= 0);
 
         /* Validate the RR as it if was 2015-12-2 today */
-        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, NULL, &result) >= 0);
         assert_se(result == DNSSEC_VALIDATED);
+
+        /* The second verification through the cache doesn't do the public key operation again */
+        assert_se(cache = new0(DnssecVerifyCache, 1));
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, cache, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+        assert_se(cache->n_hit == 0 && cache->n_miss == 1);
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, cache, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+        assert_se(cache->n_hit == 1 && cache->n_miss == 1);
+
+        /* A modified signature is not mistaken for the cached one, and its failure is cached as well */
+        ((uint8_t*) rrsig->rrsig.signature)[0] ^= 1;
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, cache, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+        assert_se(cache->n_hit == 1 && cache->n_miss == 2);
+        assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, cache, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+        assert_se(cache->n_hit == 2 && cache->n_miss == 2);
 }
 
 static void test_dnssec_verify_rrset2(void) {
@@ -459,7 +478,7 @@ static void test_dnssec_verify_rrset2(void) {
         assert_se(dns_answer_add(answer, nsec, 0, DNS_ANSWER_AUTHENTICATED) >= 0);
 
         /* Validate the RR as it if was 2015-12-11 today */
-        assert_se(dnssec_verify_rrset(answer, nsec->key, rrsig, dnskey, 1449849318*USEC_PER_SEC, &result) >= 0);
+        assert_se(dnssec_verify_rrset(answer, nsec->key, rrsig, dnskey, 1449849318*USEC_PER_SEC, NULL, &result) >= 0);
         assert_se(result == DNSSEC_VALIDATED);
 }
 
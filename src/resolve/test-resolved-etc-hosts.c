@@ -5,6 +5,7 @@
 #include "fs-util.h"
 #include "log.h"
 #include "resolved-etc-hosts.h"
+#include "strv.h"
 
 static void test_parse_etc_hosts_system(void) {
         _cleanup_fclose_ FILE *f = NULL;
@@ -73,6 +74,13 @@ static void test_parse_etc_hosts(const char *fname) {
         assert_se(memcmp(&bn->addresses[0]->address.in6,
                          &(struct in6_addr) { .s6_addr = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5} }, 16 ) == 0);
 
+        EtcHostsItem *item;
+        assert_se(item = hashmap_get(hosts.by_address, &(struct in_addr_data) {
+                                .family = AF_INET6,
+                                .address.in6 = { .s6_addr = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5} } }));
+        assert_se(item->n_names == 3);
+        assert_se(strv_equal(item->names, STRV_MAKE("some.where", "some.other", "foobar.foo.foo")));
+
         assert_se( set_contains(hosts.no_address, "some.where"));
         assert_se( set_contains(hosts.no_address, "some.other"));
         assert_se( set_contains(hosts.no_address, "black.listed"));
@@ -1,7 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
+#include "dns-domain.h"
 #include "log.h"
 #include "resolved-dns-packet.h"
+#include "string-util.h"
 
 static void test_dns_packet_new(void) {
         size_t i;
@@ -22,6 +25,38 @@ static void test_dns_packet_new(void) {
         assert_se(dns_packet_new(&p2, DNS_PROTOCOL_DNS, DNS_PACKET_SIZE_MAX + 1, DNS_PACKET_SIZE_MAX) == -EFBIG);
 }
 
+static void test_dns_packet_read_name(void) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        _cleanup_free_ char *name = NULL;
+        uint8_t label[1 + DNS_LABEL_MAX];
+        size_t offset[4], i;
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+
+        /* Chains of maximum size labels, each pointing to the previous one, so that each name is 64 octets
+         * longer than the one before. The fourth exceeds the maximum name length. */
+        label[0] = DNS_LABEL_MAX;
+        memset(label + 1, 'a', DNS_LABEL_MAX);
+
+        for (i = 0; i < ELEMENTSOF(offset); i++) {
+                offset[i] = p->size;
+                assert_se(dns_packet_append_blob(p, label, sizeof(label), NULL) >= 0);
+                if (i == 0)
+                        assert_se(dns_packet_append_uint8(p, 0, NULL) >= 0);
+                else
+                        assert_se(dns_packet_append_uint16(p, 0xc000 | offset[i-1], NULL) >= 0);
+        }
+
+        p->rindex = offset[2];
+        assert_se(dns_packet_read_name(p, &name, true, NULL) >= 0);
+        assert_se(strlen(name) == 3 * DNS_LABEL_MAX + 2);
+        assert_se(p->rindex == offset[3]);
+
+        p->rindex = offset[3];
+        assert_se(dns_packet_read_name(p, &name, true, NULL) == -EBADMSG);
+        assert_se(p->rindex == offset[3]);
+}
+
 int main(int argc, char **argv) {
 
         log_set_max_level(LOG_DEBUG);
@@ -29,6 +64,7 @@ int main(int argc, char **argv) {
         log_open();
 
         test_dns_packet_new();
+        test_dns_packet_read_name();
 
         return 0;
 }
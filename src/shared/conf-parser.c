@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include "alloc-util.h"
@@ -85,14 +86,27 @@ int config_item_perf_lookup(
         if (!section)
                 p = lookup(lvalue, strlen(lvalue));
         else {
-                char *key;
+                _cleanup_free_ char *allocated = NULL;
+                char buf[256], *key;
+                size_t a, b;
+
+                /* This is called for every single assignment, hence avoid the allocation for the key in the common
+                 * case. All our keys are way shorter than the buffer. */
+                a = strlen(section);
+                b = strlen(lvalue);
+                if (a + 1 + b < sizeof(buf))
+                        key = buf;
+                else {
+                        key = allocated = new(char, a + 1 + b + 1);
+                        if (!key)
+                                return -ENOMEM;
+                }
 
-                key = strjoin(section, ".", lvalue);
-                if (!key)
-                        return -ENOMEM;
+                memcpy(key, section, a);
+                key[a] = '.';
+                memcpy(key + a + 1, lvalue, b + 1);
 
-                p = lookup(key, strlen(key));
-                free(key);
+                p = lookup(key, a + 1 + b);
         }
 
         if (!p)
@@ -273,65 +287,58 @@ static int parse_line(
                                userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(const char *unit,
-                 const char *filename,
-                 FILE *f,
-                 const char *sections,
-                 ConfigItemLookup lookup,
-                 const void *table,
-                 ConfigParseFlags flags,
-                 void *userdata) {
+typedef int (*config_line_callback_t)(const char *filename, unsigned line, char *l, void *userdata);
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
-        _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false;
+/* Go through the file, join continuation lines and pass each resulting line to the callback */
+static int config_read_lines(
+                const char *filename,
+                FILE *f,
+                ConfigParseFlags flags,
+                config_line_callback_t callback,
+                void *userdata) {
+
+        _cleanup_free_ char *contents = NULL, *continuation = NULL;
+        unsigned line = 0;
+        char *next, *end;
+        size_t size;
         int r;
 
         assert(filename);
-        assert(lookup);
+        assert(f);
+        assert(callback);
 
-        if (!f) {
-                f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
-                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
-                                               "Failed to open configuration file '%s': %m", filename);
-                        return errno == ENOENT ? 0 : -errno;
-                }
-        }
+        /* Configuration files are small, hence read them in one go, and split the lines in place, rather than
+         * copying every single one into a buffer of its own. Like read_line(), we consider both newlines and NUL
+         * bytes line delimiters. */
+        r = read_full_stream(f, &contents, &size);
+        if (r < 0) {
+                if (flags & CONFIG_PARSE_WARN)
+                        log_error_errno(r, "%s: Error while reading configuration file: %m", filename);
 
-        fd_warn_permissions(filename, fileno(f));
+                return r;
+        }
 
-        for (;;) {
-                _cleanup_free_ char *buf = NULL;
+        for (next = contents, end = contents + size; next < end; ) {
                 bool escaped = false;
                 char *l, *p, *e;
+                size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
-                if (r == 0)
-                        break;
-                if (r == -ENOBUFS) {
+                l = next;
+                k = strcspn(l, "\n");
+                if (k >= LONG_LINE_MAX) {
                         if (flags & CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Line too long", filename, line);
+                                log_error("%s:%u: Line too long", filename, line);
 
-                        return r;
+                        return -ENOBUFS;
                 }
-                if (r < 0) {
-                        if (CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
 
-                        return r;
-                }
+                l[k] = 0;
+                next = l + k + 1;
 
-                l = buf;
                 if (!(flags & CONFIG_PARSE_REFUSE_BOM)) {
                         char *q;
 
-                        q = startswith(buf, UTF8_BYTE_ORDER_MARK);
+                        q = startswith(l, UTF8_BYTE_ORDER_MARK);
                         if (q) {
                                 l = q;
                                 flags |= CONFIG_PARSE_REFUSE_BOM;
@@ -377,18 +384,7 @@ int config_parse(const char *unit,
                         continue;
                 }
 
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               p,
-                               userdata);
+                r = callback(filename, ++line, p, userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
@@ -399,18 +395,7 @@ int config_parse(const char *unit,
         }
 
         if (continuation) {
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               continuation,
-                               userdata);
+                r = callback(filename, ++line, continuation, userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
@@ -421,6 +406,214 @@ int config_parse(const char *unit,
         return 0;
 }
 
+typedef struct ParseState {
+        const char *unit;
+        const char *sections;
+        ConfigItemLookup lookup;
+        const void *table;
+        ConfigParseFlags flags;
+        void *userdata;
+
+        char *section;
+        unsigned section_line;
+        bool section_ignored;
+} ParseState;
+
+static int parse_line_callback(const char *filename, unsigned line, char *l, void *userdata) {
+        ParseState *state = userdata;
+
+        return parse_line(state->unit,
+                          filename,
+                          line,
+                          state->sections,
+                          state->lookup,
+                          state->table,
+                          state->flags,
+                          &state->section,
+                          &state->section_line,
+                          &state->section_ignored,
+                          l,
+                          state->userdata);
+}
+
+/* Go through the file and parse each line */
+int config_parse(const char *unit,
+                 const char *filename,
+                 FILE *f,
+                 const char *sections,
+                 ConfigItemLookup lookup,
+                 const void *table,
+                 ConfigParseFlags flags,
+                 void *userdata) {
+
+        _cleanup_fclose_ FILE *ours = NULL;
+        ParseState state = {
+                .unit = unit,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        int r;
+
+        assert(filename);
+        assert(lookup);
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
+                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
+                                               "Failed to open configuration file '%s': %m", filename);
+                        return errno == ENOENT ? 0 : -errno;
+                }
+        }
+
+        fd_warn_permissions(filename, fileno(f));
+
+        r = config_read_lines(filename, f, flags, parse_line_callback, &state);
+        free(state.section);
+
+        return r;
+}
+
+static int preparse_line_callback(const char *filename, unsigned line, char *l, void *userdata) {
+        ConfigPreparsed *p = userdata;
+        char *t;
+
+        /* Comments and empty lines are dropped right away, parse_line() would ignore them anyway */
+        l = strstrip(l);
+        if (!*l || strchr(COMMENTS "\n", *l))
+                return 0;
+
+        if (!GREEDY_REALLOC(p->lines, p->n_allocated, p->n_lines + 1))
+                return -ENOMEM;
+
+        t = strdup(l);
+        if (!t)
+                return -ENOMEM;
+
+        p->lines[p->n_lines++] = (ConfigPreparsedLine) {
+                .line = line,
+                .text = t,
+        };
+
+        return 0;
+}
+
+int config_preparse(const char *filename, FILE *f, ConfigParseFlags flags, ConfigPreparsed **ret) {
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *p = NULL;
+        int r;
+
+        assert(filename);
+        assert(f);
+        assert(ret);
+
+        /* Reads the file and splits it into lines, without interpreting them yet. Doesn't log, and doesn't
+         * touch any global state, hence may be called from any thread. */
+
+        p = new0(ConfigPreparsed, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->filename = strdup(filename);
+        if (!p->filename)
+                return -ENOMEM;
+
+        if (fstat(fileno(f), &p->st) < 0)
+                return -errno;
+
+        r = config_read_lines(filename, f, flags & ~CONFIG_PARSE_WARN, preparse_line_callback, p);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+bool config_preparsed_matches(const ConfigPreparsed *p, const struct stat *st) {
+        assert(p);
+        assert(st);
+
+        /* Checks whether the file we preparsed is still the one found at the path and unmodified. The ctime is
+         * checked too, as the mtime can be set to anything from userspace, and is restored by many tools. */
+
+        return p->st.st_dev == st->st_dev &&
+               p->st.st_ino == st->st_ino &&
+               p->st.st_size == st->st_size &&
+               timespec_load_nsec(&p->st.st_mtim) == timespec_load_nsec(&st->st_mtim) &&
+               timespec_load_nsec(&p->st.st_ctim) == timespec_load_nsec(&st->st_ctim);
+}
+
+int config_parse_preparsed(
+                const char *unit,
+                const ConfigPreparsed *p,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata) {
+
+        ParseState state = {
+                .unit = unit,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        _cleanup_free_ char *buf = NULL;
+        size_t i, allocated = 0;
+        int r = 0;
+
+        assert(p);
+        assert(lookup);
+
+        /* Does what config_parse() would have done with the file. parse_line() modifies the line while
+         * parsing it, hence work on a copy, so that the same preparsed file may be applied many times, for
+         * example to all instances of a template. */
+
+        stat_warn_permissions(p->filename, &p->st);
+
+        for (i = 0; i < p->n_lines; i++) {
+                size_t l;
+
+                l = strlen(p->lines[i].text);
+                if (!GREEDY_REALLOC(buf, allocated, l + 1)) {
+                        r = -ENOMEM;
+                        break;
+                }
+                memcpy(buf, p->lines[i].text, l + 1);
+
+                r = parse_line_callback(p->filename, p->lines[i].line, buf, &state);
+                if (r < 0) {
+                        if (flags & CONFIG_PARSE_WARN)
+                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", p->filename, p->lines[i].line);
+                        break;
+                }
+        }
+
+        free(state.section);
+        return r;
+}
+
+ConfigPreparsed *config_preparsed_free(ConfigPreparsed *p) {
+        size_t i;
+
+        if (!p)
+                return NULL;
+
+        for (i = 0; i < p->n_lines; i++)
+                free(p->lines[i].text);
+
+        free(p->lines);
+        free(p->filename);
+        return mfree(p);
+}
+
 static int config_parse_many_files(
                 const char *conf_file,
                 char **files,
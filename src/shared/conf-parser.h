@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
 #include "alloc-util.h"
@@ -91,6 +92,34 @@ int config_parse(
                 ConfigParseFlags flags,
                 void *userdata);
 
+/* A configuration file that has been read and split into lines in advance, but not interpreted yet. Reading
+ * may happen on any thread, the result can then be applied with config_parse_preparsed(). */
+typedef struct ConfigPreparsedLine {
+        unsigned line;
+        char *text;
+} ConfigPreparsedLine;
+
+typedef struct ConfigPreparsed {
+        char *filename;
+        struct stat st;
+
+        ConfigPreparsedLine *lines;
+        size_t n_lines, n_allocated;
+} ConfigPreparsed;
+
+int config_preparse(const char *filename, FILE *f, ConfigParseFlags flags, ConfigPreparsed **ret);
+bool config_preparsed_matches(const ConfigPreparsed *p, const struct stat *st);
+int config_parse_preparsed(
+                const char *unit,
+                const ConfigPreparsed *p,
+                const char *sections,  /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata);
+ConfigPreparsed *config_preparsed_free(ConfigPreparsed *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigPreparsed*, config_preparsed_free);
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/wait.h>
@@ -95,6 +96,75 @@ not_found:
 #if HAVE_BLKID
 /* Detect RPMB and Boot partitions, which are not listed by blkid.
  * See https://github.com/systemd/systemd/issues/5806. */
+#if HAVE_BLKID
+typedef struct ProbeJob {
+        const char *node;
+        char *fstype;
+        int r;
+
+        pthread_t thread;
+        bool started;
+} ProbeJob;
+
+static void *probe_thread(void *p) {
+        ProbeJob *j = p;
+
+        j->r = probe_filesystem(j->node, &j->fstype);
+        return NULL;
+}
+
+static int probe_filesystems(DissectedImage *m) {
+        ProbeJob jobs[_PARTITION_DESIGNATOR_MAX] = {};
+        unsigned i, n = 0;
+        sigset_t ss, saved_ss;
+        int r = 0;
+
+        assert(m);
+
+        /* blkid reads the superblocks synchronously, hence probe all partitions at the same time, each on its own
+         * thread, instead of waiting for the storage one partition after the other */
+
+        for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                DissectedPartition *p = m->partitions + i;
+
+                if (p->found && !p->fstype && p->node) {
+                        jobs[i].node = p->node;
+                        n++;
+                }
+        }
+
+        if (n > 1) {
+                /* Make sure the threads don't receive any of our signals */
+                assert_se(sigfillset(&ss) >= 0);
+                assert_se(pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0);
+
+                for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++)
+                        if (jobs[i].node)
+                                jobs[i].started = pthread_create(&jobs[i].thread, NULL, probe_thread, jobs + i) == 0;
+
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        }
+
+        for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                if (!jobs[i].node)
+                        continue;
+
+                /* If the thread couldn't be started, probe here instead */
+                if (jobs[i].started)
+                        assert_se(pthread_join(jobs[i].thread, NULL) == 0);
+                else
+                        (void) probe_thread(jobs + i);
+
+                m->partitions[i].fstype = TAKE_PTR(jobs[i].fstype);
+
+                if (jobs[i].r < 0 && jobs[i].r != -EUCLEAN && r == 0)
+                        r = jobs[i].r;
+        }
+
+        return r;
+}
+#endif
+
 static bool device_is_mmc_special_partition(sd_device *d) {
         const char *sysname;
 
@@ -625,18 +695,16 @@ int dissect_image(
         b = NULL;
 
         /* Fill in file system types if we don't know them yet. */
+        r = probe_filesystems(m);
+        if (r < 0)
+                return r;
+
         for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
                 DissectedPartition *p = m->partitions + i;
 
                 if (!p->found)
                         continue;
 
-                if (!p->fstype && p->node) {
-                        r = probe_filesystem(p->node, &p->fstype);
-                        if (r < 0 && r != -EUCLEAN)
-                                return r;
-                }
-
                 if (streq_ptr(p->fstype, "crypto_LUKS"))
                         m->encrypted = true;
 
@@ -889,6 +957,51 @@ static int make_dm_name_and_node(const void *original_node, const char *suffix,
         return 0;
 }
 
+static int make_verity_name_and_node(const void *root_hash, size_t root_hash_size, char **ret_name, char **ret_node) {
+        _cleanup_free_ char *hex = NULL, *name = NULL, *node = NULL;
+
+        assert(root_hash);
+        assert(ret_name);
+        assert(ret_node);
+
+        hex = hexmem(root_hash, root_hash_size);
+        if (!hex)
+                return -ENOMEM;
+
+        name = strjoin(hex, "-verity");
+        if (!name)
+                return -ENOMEM;
+        if (strlen(name) >= DM_NAME_LEN)
+                return -ENAMETOOLONG;
+
+        node = strjoin(crypt_get_dir(), "/", name);
+        if (!node)
+                return -ENOMEM;
+
+        *ret_name = TAKE_PTR(name);
+        *ret_node = TAKE_PTR(node);
+
+        return 0;
+}
+
+static int verity_find_shared(const char *name, struct crypt_device **ret) {
+        _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        r = crypt_init_by_name(&cd, name);
+        if (r < 0)
+                return r;
+
+        if (!streq_ptr(crypt_get_type(cd), CRYPT_VERITY))
+                return -EEXIST;
+
+        *ret = TAKE_PTR(cd);
+        return 0;
+}
+
 static int decrypt_partition(
                 DissectedPartition *m,
                 const char *passphrase,
@@ -953,6 +1066,7 @@ static int verity_partition(
 
         _cleanup_free_ char *node = NULL, *name = NULL;
         _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        bool shared = false;
         int r;
 
         assert(m);
@@ -969,31 +1083,53 @@ static int verity_partition(
         if (!streq(v->fstype, "DM_verity_hash"))
                 return 0;
 
-        r = make_dm_name_and_node(m->node, "-verity", &name, &node);
+        /* The device is named after the root hash. As the root hash covers all of the data, a device of that name
+         * set up earlier for the same image, or a copy of it, is as good as a new one, and we can just use it, instead
+         * of setting up another one. */
+        r = make_verity_name_and_node(root_hash, root_hash_size, &name, &node);
+        if (r == -ENAMETOOLONG)
+                r = make_dm_name_and_node(m->node, "-verity", &name, &node);
+        else if (r >= 0)
+                shared = verity_find_shared(name, &cd) >= 0;
         if (r < 0)
                 return r;
 
         if (!GREEDY_REALLOC0(d->decrypted, d->n_allocated, d->n_decrypted + 1))
                 return -ENOMEM;
 
-        r = crypt_init(&cd, v->node);
-        if (r < 0)
-                return r;
+        if (!shared) {
+                r = crypt_init(&cd, v->node);
+                if (r < 0)
+                        return r;
 
-        r = crypt_load(cd, CRYPT_VERITY, NULL);
-        if (r < 0)
-                return r;
+                r = crypt_load(cd, CRYPT_VERITY, NULL);
+                if (r < 0)
+                        return r;
 
-        r = crypt_set_data_device(cd, m->node);
-        if (r < 0)
-                return r;
+                r = crypt_set_data_device(cd, m->node);
+                if (r < 0)
+                        return r;
 
-        r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
-        if (r < 0)
-                return r;
+                r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
+                if (r == -EEXIST) {
+                        /* Somebody else set up the same image in the meantime */
+                        crypt_free(cd);
+                        cd = NULL;
+
+                        r = verity_find_shared(name, &cd);
+                        shared = r >= 0;
+                }
+                if (r < 0)
+                        return r;
+        }
+
+        if (shared)
+                log_debug("Reusing verity device %s.", name);
 
+        /* Shared devices might still be in use by whoever set them up, hence never remove them */
         d->decrypted[d->n_decrypted].name = TAKE_PTR(name);
         d->decrypted[d->n_decrypted].device = TAKE_PTR(cd);
+        d->decrypted[d->n_decrypted].relinquished = shared;
         d->n_decrypted++;
 
         m->decrypted_node = TAKE_PTR(node);
@@ -23,6 +23,7 @@
 #include "hashmap.h"
 #include "install-printf.h"
 #include "install.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "macro.h"
@@ -49,8 +50,29 @@ typedef enum SearchFlags {
 typedef struct {
         OrderedHashmap *will_process;
         OrderedHashmap *have_processed;
+
+        /* If set, the full paths of all entries in the search path directories, see
+         * lookup_paths_build_unit_path_cache(). Not owned. */
+        Set *unit_path_cache;
 } InstallContext;
 
+typedef struct SymlinkIndexEntry SymlinkIndexEntry;
+
+struct SymlinkIndexEntry {
+        const char *config_path; /* the search path directory this symlink was found below */
+        char *path;
+        char *dest;
+
+        LIST_FIELDS(SymlinkIndexEntry, by_name);
+        LIST_FIELDS(SymlinkIndexEntry, by_dest);
+};
+
+typedef struct {
+        Hashmap *by_name;  /* symlink name → list of SymlinkIndexEntry */
+        Hashmap *by_dest;  /* file name of the symlink destination → list of SymlinkIndexEntry */
+        Hashmap *errors;   /* search path directory → first error encountered while indexing it */
+} SymlinkIndex;
+
 typedef enum {
         PRESET_UNKNOWN,
         PRESET_ENABLE,
@@ -709,6 +731,64 @@ static int is_symlink_with_known_name(const UnitFileInstallInfo *i, const char *
         return false;
 }
 
+static int match_symlink(
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *path,
+                const char *dest,
+                const char *config_path,
+                bool *same_name_link) {
+
+        bool found_path, found_dest, b = false;
+        int r;
+
+        assert(i);
+        assert(path);
+        assert(dest);
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Check if the symlink itself matches what we
+         * are looking for */
+        if (path_is_absolute(i->name))
+                found_path = path_equal(path, i->name);
+        else
+                found_path = streq(basename(path), i->name);
+
+        /* Check if what the symlink points to
+         * matches what we are looking for */
+        if (path_is_absolute(i->name))
+                found_dest = path_equal(dest, i->name);
+        else
+                found_dest = streq(basename(dest), i->name);
+
+        if (found_path && found_dest) {
+                _cleanup_free_ char *t = NULL;
+
+                /* Filter out same name links in the main
+                 * config path */
+                t = path_make_absolute(i->name, config_path);
+                if (!t)
+                        return -ENOMEM;
+
+                b = path_equal(t, path);
+        }
+
+        if (b)
+                *same_name_link = true;
+        else if (found_path || found_dest) {
+                if (!match_aliases)
+                        return 1;
+
+                /* Check if symlink name is in the set of names used by [Install] */
+                r = is_symlink_with_known_name(i, basename(path));
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int find_symlinks_fd(
                 const char *root_dir,
                 UnitFileInstallInfo *i,
@@ -768,7 +848,6 @@ static int find_symlinks_fd(
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path, found_dest, b = false;
                         int q;
 
                         /* Acquire symlink name */
@@ -798,45 +877,9 @@ static int find_symlinks_fd(
                                 dest = x;
                         }
 
-                        /* Check if the symlink itself matches what we
-                         * are looking for */
-                        if (path_is_absolute(i->name))
-                                found_path = path_equal(p, i->name);
-                        else
-                                found_path = streq(de->d_name, i->name);
-
-                        /* Check if what the symlink points to
-                         * matches what we are looking for */
-                        if (path_is_absolute(i->name))
-                                found_dest = path_equal(dest, i->name);
-                        else
-                                found_dest = streq(basename(dest), i->name);
-
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
-
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
-
-                                b = path_equal(t, p);
-                        }
-
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
-
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
-                        }
+                        q = match_symlink(i, match_aliases, p, dest, config_path, same_name_link);
+                        if (q != 0)
+                                return q;
                 }
         }
 
@@ -868,9 +911,280 @@ static int find_symlinks(
                                 config_path, config_path, same_name_link);
 }
 
+static SymlinkIndex* symlink_index_free(SymlinkIndex *index) {
+        SymlinkIndexEntry *e, *n;
+
+        if (!index)
+                return NULL;
+
+        /* Every entry is linked into exactly one of the by_name lists */
+        while ((e = hashmap_steal_first(index->by_name)))
+                LIST_FOREACH_SAFE(by_name, e, n, e) {
+                        free(e->path);
+                        free(e->dest);
+                        free(e);
+                }
+
+        hashmap_free(index->by_name);
+        hashmap_free(index->by_dest);
+        hashmap_free(index->errors);
+
+        return mfree(index);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(SymlinkIndex*, symlink_index_free);
+
+static int symlink_index_add_error(SymlinkIndex *index, const char *config_path, int error) {
+        int r;
+
+        assert(index);
+        assert(config_path);
+        assert(error < 0);
+
+        /* Only the first error is remembered, like find_symlinks() would return it */
+        r = hashmap_ensure_allocated(&index->errors, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(index->errors, config_path, INT_TO_PTR(error));
+        if (r < 0 && r != -EEXIST)
+                return r;
+
+        return 0;
+}
+
+static int symlink_index_add_symlink(SymlinkIndex *index, const char *config_path, char *path, char *dest) {
+        SymlinkIndexEntry *e, *head;
+        int r;
+
+        assert(index);
+        assert(config_path);
+        assert(path);
+        assert(dest);
+
+        /* Takes possession of path and dest */
+
+        e = new0(SymlinkIndexEntry, 1);
+        if (!e) {
+                free(path);
+                free(dest);
+                return -ENOMEM;
+        }
+
+        e->config_path = config_path;
+        e->path = path;
+        e->dest = dest;
+
+        head = hashmap_get(index->by_name, basename(e->path));
+        LIST_PREPEND(by_name, head, e);
+        r = hashmap_replace(index->by_name, basename(e->path), head);
+        if (r < 0) {
+                LIST_REMOVE(by_name, head, e);
+                free(e->path);
+                free(e->dest);
+                free(e);
+                return r;
+        }
+
+        /* From here on, the entry is owned by the by_name list */
+
+        head = hashmap_get(index->by_dest, basename(e->dest));
+        LIST_PREPEND(by_dest, head, e);
+        r = hashmap_replace(index->by_dest, basename(e->dest), head);
+        if (r < 0) {
+                LIST_REMOVE(by_dest, head, e);
+                return r;
+        }
+
+        return 0;
+}
+
+static int symlink_index_add_fd(
+                SymlinkIndex *index,
+                const char *root_dir,
+                int fd,
+                const char *path,
+                const char *config_path) {
+
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(index);
+        assert(fd >= 0);
+        assert(path);
+        assert(config_path);
+
+        /* Mirrors the directory walk of find_symlinks_fd(), but records every symlink instead of looking for a
+         * specific one. Errors are recorded per search path directory. Returns < 0 only on OOM. */
+
+        d = fdopendir(fd);
+        if (!d) {
+                r = -errno;
+                safe_close(fd);
+                return symlink_index_add_error(index, config_path, r);
+        }
+
+        FOREACH_DIRENT(de, d, return symlink_index_add_error(index, config_path, -errno)) {
+
+                dirent_ensure_type(d, de);
+
+                if (de->d_type == DT_DIR) {
+                        _cleanup_free_ char *p = NULL;
+                        int nfd;
+
+                        nfd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                        if (nfd < 0) {
+                                if (errno == ENOENT)
+                                        continue;
+
+                                r = symlink_index_add_error(index, config_path, -errno);
+                                if (r < 0)
+                                        return r;
+                                continue;
+                        }
+
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p) {
+                                safe_close(nfd);
+                                return -ENOMEM;
+                        }
+
+                        /* This will close nfd, regardless whether it succeeds or not */
+                        r = symlink_index_add_fd(index, root_dir, nfd, p, config_path);
+                        if (r < 0)
+                                return r;
+
+                } else if (de->d_type == DT_LNK) {
+                        _cleanup_free_ char *p = NULL, *dest = NULL;
+
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = readlink_malloc(p, &dest);
+                        if (r == -ENOENT)
+                                continue;
+                        if (r < 0) {
+                                r = symlink_index_add_error(index, config_path, r);
+                                if (r < 0)
+                                        return r;
+                                continue;
+                        }
+
+                        if (!path_is_absolute(dest)) {
+                                char *x;
+
+                                x = prefix_root(root_dir, dest);
+                                if (!x)
+                                        return -ENOMEM;
+
+                                free(dest);
+                                dest = x;
+                        }
+
+                        r = symlink_index_add_symlink(index, config_path, TAKE_PTR(p), TAKE_PTR(dest));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+static int symlink_index_new(const LookupPaths *paths, SymlinkIndex **ret) {
+        _cleanup_(symlink_index_freep) SymlinkIndex *index = NULL;
+        char **p;
+        int r;
+
+        assert(paths);
+        assert(ret);
+
+        /* Walks all search path directories once, and indexes every symlink by its own name and the name of
+         * its destination, so that the enablement state of many unit files can be determined without walking
+         * the directories again for each one of them. */
+
+        index = new0(SymlinkIndex, 1);
+        if (!index)
+                return -ENOMEM;
+
+        index->by_name = hashmap_new(&string_hash_ops);
+        index->by_dest = hashmap_new(&string_hash_ops);
+        if (!index->by_name || !index->by_dest)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, paths->search_path) {
+                int fd;
+
+                fd = open(*p, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+                if (fd < 0) {
+                        if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                                continue;
+
+                        r = symlink_index_add_error(index, *p, -errno);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                /* This takes possession of fd and closes it */
+                r = symlink_index_add_fd(index, paths->root_dir, fd, *p, *p);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(index);
+        return 0;
+}
+
+static int find_symlinks_in_index(
+                SymlinkIndex *index,
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *config_path,
+                bool *same_name_link) {
+
+        SymlinkIndexEntry *e;
+        int r;
+
+        assert(index);
+        assert(i);
+        assert(!path_is_absolute(i->name));
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Same as find_symlinks(), but only looks at the symlinks that may match, i.e. those named like the
+         * unit file, and those pointing to a file named like it. */
+
+        LIST_FOREACH(by_name, e, hashmap_get(index->by_name, i->name)) {
+                if (e->config_path != config_path)
+                        continue;
+
+                r = match_symlink(i, match_aliases, e->path, e->dest, config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        LIST_FOREACH(by_dest, e, hashmap_get(index->by_dest, i->name)) {
+                if (e->config_path != config_path)
+                        continue;
+
+                /* Already covered above */
+                if (streq(basename(e->path), i->name))
+                        continue;
+
+                r = match_symlink(i, match_aliases, e->path, e->dest, config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        return PTR_TO_INT(hashmap_get(index->errors, config_path));
+}
+
 static int find_symlinks_in_scope(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                SymlinkIndex *index,
                 UnitFileInstallInfo *i,
                 bool match_name,
                 UnitFileState *state) {
@@ -886,7 +1200,10 @@ static int find_symlinks_in_scope(
         STRV_FOREACH(p, paths->search_path)  {
                 bool same_name_link = false;
 
-                r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link);
+                if (index && !path_is_absolute(i->name))
+                        r = find_symlinks_in_index(index, i, match_name, *p, &same_name_link);
+                else
+                        r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -1414,6 +1731,9 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path))
+                        continue;
+
                 r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
                 if (r >= 0) {
                         info->path = TAKE_PTR(path);
@@ -1437,6 +1757,9 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path))
+                                continue;
+
                         r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
                         if (r >= 0) {
                                 info->path = TAKE_PTR(path);
@@ -1466,6 +1789,11 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path)) {
+                        free(path);
+                        continue;
+                }
+
                 r = strv_consume(&dirs, path);
                 if (r < 0)
                         return r;
@@ -1480,6 +1808,11 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path)) {
+                                free(path);
+                                continue;
+                        }
+
                         r = strv_consume(&dirs, path);
                         if (r < 0)
                                 return r;
@@ -2638,13 +2971,17 @@ int unit_file_get_default(
         return 0;
 }
 
-int unit_file_lookup_state(
+static int unit_file_lookup_state_internal(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Set *unit_path_cache,
+                SymlinkIndex *index,
                 const char *name,
                 UnitFileState *ret) {
 
-        _cleanup_(install_context_done) InstallContext c = {};
+        _cleanup_(install_context_done) InstallContext c = {
+                .unit_path_cache = unit_path_cache,
+        };
         UnitFileInstallInfo *i;
         UnitFileState state;
         int r;
@@ -2694,7 +3031,7 @@ int unit_file_lookup_state(
                 /* Check if any of the Alias= symlinks have been created.
                  * We ignore other aliases, and only check those that would
                  * be created by systemctl enable for this unit. */
-                r = find_symlinks_in_scope(scope, paths, i, true, &state);
+                r = find_symlinks_in_scope(scope, paths, index, i, true, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2702,7 +3039,7 @@ int unit_file_lookup_state(
 
                 /* Check if the file is known under other names. If it is,
                  * it might be in use. Report that as UNIT_FILE_INDIRECT. */
-                r = find_symlinks_in_scope(scope, paths, i, false, &state);
+                r = find_symlinks_in_scope(scope, paths, index, i, false, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2726,6 +3063,16 @@ int unit_file_lookup_state(
         return 0;
 }
 
+int unit_file_lookup_state(
+                UnitFileScope scope,
+                const LookupPaths *paths,
+                Set *unit_path_cache,
+                const char *name,
+                UnitFileState *ret) {
+
+        return unit_file_lookup_state_internal(scope, paths, unit_path_cache, NULL, name, ret);
+}
+
 int unit_file_get_state(
                 UnitFileScope scope,
                 const char *root_dir,
@@ -2743,7 +3090,7 @@ int unit_file_get_state(
         if (r < 0)
                 return r;
 
-        return unit_file_lookup_state(scope, &paths, name, ret);
+        return unit_file_lookup_state(scope, &paths, NULL, name, ret);
 }
 
 int unit_file_exists(UnitFileScope scope, const LookupPaths *paths, const char *name) {
@@ -3238,6 +3585,8 @@ int unit_file_get_list(
                 char **patterns) {
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
+        _cleanup_(symlink_index_freep) SymlinkIndex *index = NULL;
+        _cleanup_set_free_free_ Set *unit_path_cache = NULL;
         char **i;
         int r;
 
@@ -3249,6 +3598,18 @@ int unit_file_get_list(
         if (r < 0)
                 return r;
 
+        /* Determining the state of a unit file means looking for symlinks to it in all search path directories.
+         * Do that walk once for all unit files here, instead of once for every single one of them. */
+        r = symlink_index_new(&paths, &index);
+        if (r < 0)
+                return r;
+
+        /* Similarly, know upfront which unit files exist, instead of probing every search path directory for
+         * every unit file and its drop-ins */
+        r = lookup_paths_build_unit_path_cache(&paths, &unit_path_cache);
+        if (r < 0)
+                return r;
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -3290,7 +3651,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state_internal(scope, &paths, unit_path_cache, index, de->d_name, &f->state);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
@@ -204,6 +204,7 @@ int unit_file_add_dependency(
 int unit_file_lookup_state(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Set *unit_path_cache,
                 const char *name,
                 UnitFileState *ret);
 
@@ -16,6 +16,7 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "hashmap.h"
 #include "hostname-util.h"
@@ -695,6 +696,288 @@ static int output_export(
         return 0;
 }
 
+/* State of the export-binary stream, see doc/JOURNAL_EXPORT_BINARY.md. Fields and values are numbered in the order
+ * they are first defined in the stream. */
+#define BINARY_MAGIC "SDJEXB1\n"
+#define BINARY_VALUE_SIZE_MAX 256U
+#define BINARY_DICTIONARY_MAX (64U*1024U)
+#define BINARY_VALUE_REFERENCE UINT32_C(0x80000000)
+
+typedef struct BinaryField {
+        uint32_t index;
+        char name[];
+} BinaryField;
+
+typedef struct BinaryValue {
+        uint32_t index;
+        size_t length;
+        uint8_t data[];
+} BinaryValue;
+
+static void binary_value_hash_func(const void *p, struct siphash *state) {
+        const BinaryValue *v = p;
+
+        siphash24_compress(&v->length, sizeof(v->length), state);
+        siphash24_compress(v->data, v->length, state);
+}
+
+static int binary_value_compare_func(const void *a, const void *b) {
+        const BinaryValue *x = a, *y = b;
+
+        if (x->length < y->length)
+                return -1;
+        if (x->length > y->length)
+                return 1;
+
+        return memcmp(x->data, y->data, x->length);
+}
+
+static const struct hash_ops binary_value_hash_ops = {
+        .hash = binary_value_hash_func,
+        .compare = binary_value_compare_func,
+};
+
+static struct {
+        FILE *f;
+        Hashmap *fields;
+        Hashmap *values;
+} binary_state = {};
+
+static void binary_write_le32(FILE *f, uint32_t v) {
+        le32_t le = htole32(v);
+
+        fwrite(&le, sizeof(le), 1, f);
+}
+
+static void binary_write_le64(FILE *f, uint64_t v) {
+        le64_t le = htole64(v);
+
+        fwrite(&le, sizeof(le), 1, f);
+}
+
+static int binary_field_index(FILE *f, const char *name, size_t length, uint32_t *ret) {
+        BinaryField *field;
+        char *n;
+        int r;
+
+        n = strndupa(name, length);
+
+        field = hashmap_get(binary_state.fields, n);
+        if (field) {
+                *ret = field->index;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&binary_state.fields, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        field = malloc(offsetof(BinaryField, name) + length + 1);
+        if (!field)
+                return -ENOMEM;
+
+        field->index = hashmap_size(binary_state.fields);
+        memcpy(field->name, n, length + 1);
+
+        r = hashmap_put(binary_state.fields, field->name, field);
+        if (r < 0) {
+                free(field);
+                return r;
+        }
+
+        fputc('F', f);
+        binary_write_le32(f, length);
+        fwrite(name, length, 1, f);
+
+        *ret = field->index;
+        return 0;
+}
+
+static bool binary_value_shall_intern(const char *name, size_t name_length, size_t length) {
+
+        /* Only put values into the dictionary which are likely to repeat: the message itself and timestamps
+         * usually don't. */
+
+        if (length > BINARY_VALUE_SIZE_MAX)
+                return false;
+
+        if (memory_startswith(name, name_length, "MESSAGE") && name_length == STRLEN("MESSAGE"))
+                return false;
+
+        if (name_length >= STRLEN("_TIMESTAMP") &&
+            memcmp(name + name_length - STRLEN("_TIMESTAMP"), "_TIMESTAMP", STRLEN("_TIMESTAMP")) == 0)
+                return false;
+
+        return true;
+}
+
+static int binary_value_reference(FILE *f, const void *data, size_t length, size_t name_length, uint32_t field_index, uint32_t *ret) {
+        BinaryValue *key, *value;
+        int r;
+
+        key = alloca(offsetof(BinaryValue, data) + length);
+        key->length = length;
+        memcpy(key->data, data, length);
+
+        value = hashmap_get(binary_state.values, key);
+        if (value) {
+                *ret = value->index;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&binary_state.values, &binary_value_hash_ops);
+        if (r < 0)
+                return r;
+
+        value = memdup(key, offsetof(BinaryValue, data) + length);
+        if (!value)
+                return -ENOMEM;
+
+        value->index = hashmap_size(binary_state.values);
+
+        r = hashmap_put(binary_state.values, value, value);
+        if (r < 0) {
+                free(value);
+                return r;
+        }
+
+        fputc('V', f);
+        binary_write_le32(f, field_index);
+        binary_write_le64(f, length - name_length - 1);
+        fwrite((const uint8_t*) data + name_length + 1, length - name_length - 1, 1, f);
+
+        *ret = value->index;
+        return 0;
+}
+
+static int output_export_binary(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                Set *output_fields,
+                size_t highlight[2]) {
+
+        _cleanup_free_ char *cursor = NULL, *items = NULL;
+        _cleanup_fclose_ FILE *items_f = NULL;
+        uint32_t n_items = 0, idx;
+        usec_t realtime, monotonic;
+        size_t items_size = 0;
+        sd_id128_t boot_id;
+        const void *data;
+        size_t length;
+        int r;
+
+        assert(f);
+        assert(j);
+
+        sd_journal_set_data_threshold(j, 0);
+
+        r = sd_journal_get_realtime_usec(j, &realtime);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+        r = sd_journal_get_cursor(j, &cursor);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cursor: %m");
+
+        if (binary_state.f != f) {
+                binary_state.fields = hashmap_free_free(binary_state.fields);
+                binary_state.values = hashmap_free_free(binary_state.values);
+                binary_state.f = f;
+
+                fputs(BINARY_MAGIC, f);
+        }
+
+        /* Keep the memory we need for the dictionaries bounded */
+        if (hashmap_size(binary_state.fields) >= BINARY_DICTIONARY_MAX ||
+            hashmap_size(binary_state.values) >= BINARY_DICTIONARY_MAX) {
+                binary_state.fields = hashmap_free_free(binary_state.fields);
+                binary_state.values = hashmap_free_free(binary_state.values);
+
+                fputc('R', f);
+        }
+
+        /* Definitions of new fields and values go to the output right-away, the items of the entry are collected
+         * and written after them, so that readers never see references to something they don't know yet. */
+        items_f = open_memstream(&items, &items_size);
+        if (!items_f)
+                return log_oom();
+
+        r = binary_field_index(f, "__CURSOR", STRLEN("__CURSOR"), &idx);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add field to binary output: %m");
+
+        binary_write_le32(items_f, idx);
+        binary_write_le64(items_f, strlen(cursor));
+        fputs(cursor, items_f);
+        n_items++;
+
+        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
+                const char *c;
+                size_t name_length;
+
+                /* The boot ID is part of the entry header */
+                if (memory_startswith(data, length, "_BOOT_ID="))
+                        continue;
+
+                c = memchr(data, '=', length);
+                if (!c) {
+                        log_error("Invalid field.");
+                        return -EINVAL;
+                }
+                name_length = c - (const char*) data;
+
+                r = field_set_test(output_fields, data, name_length);
+                if (r < 0)
+                        return r;
+                if (!r)
+                        continue;
+
+                r = binary_field_index(f, data, name_length, &idx);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add field to binary output: %m");
+
+                if (binary_value_shall_intern(data, name_length, length - name_length - 1)) {
+                        r = binary_value_reference(f, data, length, name_length, idx, &idx);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to add value to binary output: %m");
+
+                        binary_write_le32(items_f, idx | BINARY_VALUE_REFERENCE);
+                } else {
+                        binary_write_le32(items_f, idx);
+                        binary_write_le64(items_f, length - name_length - 1);
+                        fwrite(c + 1, length - name_length - 1, 1, items_f);
+                }
+
+                n_items++;
+        }
+        if (r == -EBADMSG) {
+                log_debug_errno(r, "Skipping message we can't read: %m");
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(items_f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write binary entry: %m");
+
+        fputc('E', f);
+        binary_write_le64(f, realtime);
+        binary_write_le64(f, monotonic);
+        fwrite(boot_id.bytes, sizeof(boot_id.bytes), 1, f);
+        binary_write_le32(f, n_items);
+        fwrite(items, items_size, 1, f);
+
+        return 0;
+}
+
 void json_escape(
                 FILE *f,
                 const char* p,
@@ -729,6 +1012,19 @@ void json_escape(
                 fputc('\"', f);
 
                 while (l > 0) {
+                        size_t n;
+
+                        /* Write out runs of characters that need no escaping in one go */
+                        for (n = 0; n < l; n++)
+                                if (IN_SET(p[n], '"', '\\') || (uint8_t) p[n] < ' ')
+                                        break;
+                        if (n > 0) {
+                                fwrite(p, 1, n, f);
+                                p += n;
+                                l -= n;
+                                continue;
+                        }
+
                         if (IN_SET(*p, '"', '\\')) {
                                 fputc('\\', f);
                                 fputc(*p, f);
@@ -1034,6 +1330,7 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_SHORT_FULL] = output_short,
         [OUTPUT_VERBOSE] = output_verbose,
         [OUTPUT_EXPORT] = output_export,
+        [OUTPUT_EXPORT_BINARY] = output_export_binary,
         [OUTPUT_JSON] = output_json,
         [OUTPUT_JSON_PRETTY] = output_json,
         [OUTPUT_JSON_SSE] = output_json,
@@ -1041,24 +1338,45 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_WITH_UNIT] = output_short,
 };
 
-int show_journal_entry(
+int show_journal_entry_set(
                 FILE *f,
                 sd_journal *j,
                 OutputMode mode,
                 unsigned n_columns,
                 OutputFlags flags,
-                char **output_fields,
+                Set *output_fields,
                 size_t highlight[2],
                 bool *ellipsized) {
 
         int ret;
-        _cleanup_set_free_free_ Set *fields = NULL;
+
         assert(mode >= 0);
         assert(mode < _OUTPUT_MODE_MAX);
 
         if (n_columns <= 0)
                 n_columns = columns();
 
+        ret = output_funcs[mode](f, j, mode, n_columns, flags, output_fields, highlight);
+
+        if (ellipsized && ret > 0)
+                *ellipsized = true;
+
+        return ret;
+}
+
+int show_journal_entry(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                char **output_fields,
+                size_t highlight[2],
+                bool *ellipsized) {
+
+        int ret;
+        _cleanup_set_free_free_ Set *fields = NULL;
+
         if (output_fields) {
                 fields = set_new(&string_hash_ops);
                 if (!fields)
@@ -1069,12 +1387,7 @@ int show_journal_entry(
                         return ret;
         }
 
-        ret = output_funcs[mode](f, j, mode, n_columns, flags, fields, highlight);
-
-        if (ellipsized && ret > 0)
-                *ellipsized = true;
-
-        return ret;
+        return show_journal_entry_set(f, j, mode, n_columns, flags, fields, highlight, ellipsized);
 }
 
 static int maybe_print_begin_newline(FILE *f, OutputFlags *flags) {
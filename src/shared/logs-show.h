@@ -10,6 +10,7 @@
 
 #include "macro.h"
 #include "output-mode.h"
+#include "set.h"
 #include "time-util.h"
 #include "util.h"
 
@@ -22,6 +23,15 @@ int show_journal_entry(
                 char **output_fields,
                 size_t highlight[2],
                 bool *ellipsized);
+int show_journal_entry_set(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                Set *output_fields,
+                size_t highlight[2],
+                bool *ellipsized);
 int show_journal(
                 FILE *f,
                 sd_journal *j,
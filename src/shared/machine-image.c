@@ -33,6 +33,7 @@
 #include "os-util.h"
 #include "path-util.h"
 #include "rm-rf.h"
+#include "siphash24.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -41,6 +42,8 @@
 #include "util.h"
 #include "xattr-util.h"
 
+#define IMAGE_FINGERPRINT_KEY SD_ID128_MAKE(ae,1e,8b,82,9c,5c,4e,1c,b5,2f,93,0d,67,2a,ca,46)
+
 static const char* const image_search_path[_IMAGE_CLASS_MAX] = {
         [IMAGE_MACHINE] =  "/etc/machines\0"              /* only place symlinks here */
                            "/run/machines\0"              /* and here too */
@@ -596,6 +599,42 @@ int image_discover(ImageClass class, Hashmap *h) {
         return 0;
 }
 
+int image_discover_fingerprint(ImageClass class, uint64_t *ret) {
+        struct siphash state;
+        const char *path;
+
+        assert(class >= 0);
+        assert(class < _IMAGE_CLASS_MAX);
+        assert(ret);
+
+        /* Returns a hash over the identity and timestamps of all directories in the search path. It changes
+         * whenever an image is added, removed or renamed there, or a search path directory appears or goes away,
+         * so that callers may cache the results of image_discover() and only rescan when it differs. Note that
+         * changes inside images (and hence their disk usage) are not covered. */
+
+        siphash24_init(&state, IMAGE_FINGERPRINT_KEY.bytes);
+
+        NULSTR_FOREACH(path, image_search_path[class]) {
+                struct stat st;
+
+                if (stat(path, &st) < 0) {
+                        if (errno != ENOENT)
+                                return -errno;
+
+                        zero(st);
+                }
+
+                siphash24_compress(&st.st_dev, sizeof(st.st_dev), &state);
+                siphash24_compress(&st.st_ino, sizeof(st.st_ino), &state);
+                siphash24_compress(&st.st_nlink, sizeof(st.st_nlink), &state);
+                siphash24_compress(&st.st_size, sizeof(st.st_size), &state);
+                siphash24_compress(&st.st_mtim, sizeof(st.st_mtim), &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
 int image_remove(Image *i) {
         _cleanup_(release_lock_file) LockFile global_lock = LOCK_FILE_INIT, local_lock = LOCK_FILE_INIT;
         _cleanup_strv_free_ char **settings = NULL;
@@ -867,7 +906,7 @@ int image_clone(Image *i, const char *new_name, bool read_only) {
         case IMAGE_RAW:
                 new_path = strjoina("/var/lib/machines/", new_name, ".raw");
 
-                r = copy_file_atomic(i->path, new_path, read_only ? 0444 : 0644, FS_NOCOW_FL, COPY_REFLINK);
+                r = copy_file_atomic(i->path, new_path, read_only ? 0444 : 0644, FS_NOCOW_FL, COPY_REFLINK|COPY_HOLES);
                 break;
 
         case IMAGE_BLOCK:
@@ -68,6 +68,7 @@ int image_find(ImageClass class, const char *name, Image **ret);
 int image_from_path(const char *path, Image **ret);
 int image_find_harder(ImageClass class, const char *name_or_path, Image **ret);
 int image_discover(ImageClass class, Hashmap *map);
+int image_discover_fingerprint(ImageClass class, uint64_t *ret);
 
 int image_remove(Image *i);
 int image_rename(Image *i, const char *new_name);
@@ -6,6 +6,8 @@
 #include <string.h>
 
 #include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "install.h"
@@ -15,6 +17,7 @@
 #include "path-lookup.h"
 #include "path-util.h"
 #include "rm-rf.h"
+#include "set.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -710,6 +713,50 @@ void lookup_paths_free(LookupPaths *p) {
         p->temporary_dir = mfree(p->temporary_dir);
 }
 
+int lookup_paths_build_unit_path_cache(const LookupPaths *p, Set **ret) {
+        _cleanup_set_free_free_ Set *cache = NULL;
+        char **i;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        /* Builds a set of the full paths of all entries in the search path directories, so that looking for a
+         * unit file doesn't need to probe every single directory for it. This is the same format as the manager's
+         * unit path cache, hence it may be passed to the same functions. */
+
+        cache = set_new(&path_hash_ops);
+        if (!cache)
+                return -ENOMEM;
+
+        STRV_FOREACH(i, p->search_path) {
+                _cleanup_closedir_ DIR *d = NULL;
+                struct dirent *de;
+
+                d = opendir(*i);
+                if (!d) {
+                        if (errno != ENOENT)
+                                log_debug_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
+                        continue;
+                }
+
+                FOREACH_DIRENT(de, d, return -errno) {
+                        char *j;
+
+                        j = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
+                        if (!j)
+                                return -ENOMEM;
+
+                        r = set_consume(cache, j);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(cache);
+        return 0;
+}
+
 int lookup_paths_reduce(LookupPaths *p) {
         _cleanup_free_ struct stat *stats = NULL;
         size_t n_stats = 0, allocated = 0;
@@ -835,6 +882,18 @@ void lookup_paths_flush_generator(LookupPaths *p) {
 }
 
 char **generator_binary_paths(UnitFileScope scope) {
+        const char *e;
+
+        /* Whatever has been passed to us via env vars takes precedence, this is mostly useful for testing */
+        e = getenv("SYSTEMD_GENERATOR_PATH");
+        if (e) {
+                char **paths = NULL;
+
+                if (path_split_and_make_absolute(e, &paths) < 0)
+                        return NULL;
+
+                return paths;
+        }
 
         switch (scope) {
 
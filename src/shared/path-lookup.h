@@ -7,6 +7,7 @@ typedef struct LookupPaths LookupPaths;
 
 #include "install.h"
 #include "macro.h"
+#include "set.h"
 
 typedef enum LookupPathsFlags {
         LOOKUP_PATHS_EXCLUDE_GENERATED   = 1 << 0,
@@ -65,4 +66,6 @@ void lookup_paths_flush_generator(LookupPaths *p);
 
 void lookup_paths_free(LookupPaths *p);
 
+int lookup_paths_build_unit_path_cache(const LookupPaths *p, Set **ret);
+
 char **generator_binary_paths(UnitFileScope scope);
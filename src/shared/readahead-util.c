@@ -0,0 +1,281 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdio_ext.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "def.h"
+#include "escape.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "readahead-util.h"
+#include "string-util.h"
+#include "util.h"
+
+/* The pack is a simple text file: a few header lines, followed by one line per file, consisting of the block, the
+ * number of bytes to read and the C-escaped path, in the order the files shall be read in. */
+
+#define READAHEAD_PACK_MAGIC "READAHEAD=1"
+
+ReadaheadPack *readahead_pack_free(ReadaheadPack *p) {
+        size_t i;
+
+        if (!p)
+                return NULL;
+
+        for (i = 0; i < p->n_entries; i++)
+                free(p->entries[i].path);
+
+        free(p->entries);
+        return mfree(p);
+}
+
+int readahead_pack_add(ReadaheadPack *p, const char *path, uint64_t block, uint64_t length) {
+        char *t;
+
+        assert(p);
+        assert(path);
+
+        if (!GREEDY_REALLOC(p->entries, p->n_allocated, p->n_entries + 1))
+                return -ENOMEM;
+
+        t = strdup(path);
+        if (!t)
+                return -ENOMEM;
+
+        p->entries[p->n_entries++] = (ReadaheadEntry) {
+                .path = t,
+                .block = block,
+                .length = length,
+        };
+
+        return 0;
+}
+
+static int entry_compare(const ReadaheadEntry *x, const ReadaheadEntry *y) {
+        int r;
+
+        r = CMP(x->block, y->block);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->path, y->path);
+}
+
+void readahead_pack_sort(ReadaheadPack *p) {
+        assert(p);
+
+        /* On rotating media, read in the order of the physical location, so that we don't seek back and forth. On
+         * everything else the order in which the files were accessed is best, hence leave it as it is. */
+        if (!p->rotational)
+                return;
+
+        typesafe_qsort(p->entries, p->n_entries, entry_compare);
+}
+
+uint64_t readahead_pack_bytes(const ReadaheadPack *p) {
+        uint64_t sum = 0;
+        size_t i;
+
+        assert(p);
+
+        for (i = 0; i < p->n_entries; i++)
+                sum += p->entries[i].length;
+
+        return sum;
+}
+
+static int parse_entry(ReadaheadPack *p, const char *line) {
+        _cleanup_free_ char *block = NULL, *length = NULL, *path = NULL;
+        uint64_t b, l;
+        const char *q;
+        int r;
+
+        q = line;
+        r = extract_many_words(&q, NULL, 0, &block, &length, NULL);
+        if (r < 0)
+                return r;
+        if (r < 2 || !q)
+                return -EBADMSG;
+
+        q += strspn(q, WHITESPACE);
+        if (isempty(q))
+                return -EBADMSG;
+
+        r = safe_atou64(block, &b);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(length, &l);
+        if (r < 0)
+                return r;
+
+        r = cunescape(q, 0, &path);
+        if (r < 0)
+                return r;
+
+        return readahead_pack_add(p, path, b, l);
+}
+
+int readahead_pack_load(const char *path, ReadaheadPack **ret) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        bool header = true;
+        struct stat st;
+        unsigned line = 0;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        f = fopen(path, "re");
+        if (!f)
+                return -errno;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        if (fstat(fileno(f), &st) < 0)
+                return -errno;
+
+        p = new0(ReadaheadPack, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->mtime = timespec_load(&st.st_mtim);
+
+        for (;;) {
+                _cleanup_free_ char *l = NULL;
+                const char *v;
+
+                r = read_line(f, LONG_LINE_MAX, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                line++;
+
+                if (line == 1) {
+                        /* Refuse packs written by a different version, they'll simply be regenerated */
+                        if (!streq(l, READAHEAD_PACK_MAGIC))
+                                return -EPROTO;
+                        continue;
+                }
+
+                if (header) {
+                        if ((v = startswith(l, "ROTATIONAL="))) {
+                                r = parse_boolean(v);
+                                if (r < 0)
+                                        return r;
+
+                                p->rotational = r;
+                                continue;
+                        }
+
+                        if ((v = startswith(l, "DONE_USEC="))) {
+                                r = safe_atou64(v, &p->done_usec);
+                                if (r < 0)
+                                        return r;
+                                continue;
+                        }
+
+                        /* An empty line terminates the header */
+                        if (isempty(l)) {
+                                header = false;
+                                continue;
+                        }
+
+                        /* Ignore unknown header fields, so that we can add more later */
+                        if (strchr(l, '='))
+                                continue;
+
+                        return -EBADMSG;
+                }
+
+                r = parse_entry(p, l);
+                if (r < 0)
+                        return r;
+        }
+
+        if (line == 0)
+                return -EPROTO;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+int readahead_pack_save(const char *path, const ReadaheadPack *p) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        size_t i;
+        int r;
+
+        assert(path);
+        assert(p);
+
+        r = mkdir_parents(path, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return r;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+        /* The pack lists every file accessed during boot, that's nobody else's business */
+        (void) fchmod(fileno(f), 0600);
+
+        fprintf(f,
+                READAHEAD_PACK_MAGIC "\n"
+                "ROTATIONAL=%s\n"
+                "DONE_USEC=" USEC_FMT "\n"
+                "\n",
+                yes_no(p->rotational),
+                p->done_usec);
+
+        for (i = 0; i < p->n_entries; i++) {
+                _cleanup_free_ char *e = NULL;
+
+                e = cescape(p->entries[i].path);
+                if (!e) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                fprintf(f, "%" PRIu64 " %" PRIu64 " %s\n", p->entries[i].block, p->entries[i].length, e);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
+
+int readahead_read_usec_file(const char *path, usec_t *ret) {
+        _cleanup_free_ char *s = NULL;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        r = read_one_line_file(path, &s);
+        if (r < 0)
+                return r;
+
+        return safe_atou64(s, ret);
+}
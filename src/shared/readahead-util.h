@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+#define READAHEAD_PACK_DIR "/var/lib/systemd/readahead"
+#define READAHEAD_PACK READAHEAD_PACK_DIR "/pack"
+
+/* Flag files and statistics of the current boot */
+#define READAHEAD_RUNTIME_DIR "/run/systemd/readahead"
+#define READAHEAD_DONE READAHEAD_RUNTIME_DIR "/done"
+#define READAHEAD_REPLAY_STATS READAHEAD_RUNTIME_DIR "/replay"
+
+typedef struct ReadaheadEntry {
+        char *path;
+        uint64_t block;  /* physical location of the first block, for ordering only */
+        uint64_t length; /* how much of the file to read, in bytes */
+} ReadaheadEntry;
+
+typedef struct ReadaheadPack {
+        bool rotational; /* whether the entries are ordered by physical location */
+        usec_t done_usec; /* CLOCK_MONOTONIC when the collecting boot was done, or 0 */
+        usec_t mtime;
+
+        ReadaheadEntry *entries;
+        size_t n_entries, n_allocated;
+} ReadaheadPack;
+
+ReadaheadPack *readahead_pack_free(ReadaheadPack *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ReadaheadPack*, readahead_pack_free);
+
+int readahead_pack_add(ReadaheadPack *p, const char *path, uint64_t block, uint64_t length);
+void readahead_pack_sort(ReadaheadPack *p);
+uint64_t readahead_pack_bytes(const ReadaheadPack *p);
+
+int readahead_pack_load(const char *path, ReadaheadPack **ret);
+int readahead_pack_save(const char *path, const ReadaheadPack *p);
+
+int readahead_read_usec_file(const char *path, usec_t *ret);
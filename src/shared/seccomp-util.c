@@ -1,16 +1,22 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <limits.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <seccomp.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/shm.h>
+#include <sys/stat.h>
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "process-util.h"
 #include "seccomp-util.h"
@@ -250,6 +256,82 @@ bool is_seccomp_available(void) {
         return cached_enabled;
 }
 
+struct SeccompPrograms {
+        struct sock_fprog *programs;
+        size_t n_programs, n_allocated;
+};
+
+/* While seccomp_compile() runs, filters are collected here instead of being installed */
+static SeccompPrograms *compiling = NULL;
+static int compiling_error = 0;
+
+static int seccomp_export(scmp_filter_ctx seccomp, SeccompPrograms *p) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ struct sock_filter *filter = NULL;
+        struct stat st;
+        ssize_t n;
+        int r;
+
+        assert(seccomp);
+        assert(p);
+
+        fd = memfd_new("seccomp");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size <= 0 ||
+            st.st_size % sizeof(struct sock_filter) != 0 ||
+            st.st_size / sizeof(struct sock_filter) > USHRT_MAX)
+                return -EBADMSG;
+
+        filter = malloc(st.st_size);
+        if (!filter)
+                return -ENOMEM;
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        n = loop_read(fd, filter, st.st_size, false);
+        if (n < 0)
+                return (int) n;
+        if (n != st.st_size)
+                return -EIO;
+
+        if (!GREEDY_REALLOC(p->programs, p->n_allocated, p->n_programs + 1))
+                return -ENOMEM;
+
+        p->programs[p->n_programs++] = (struct sock_fprog) {
+                .len = st.st_size / sizeof(struct sock_filter),
+                .filter = TAKE_PTR(filter),
+        };
+
+        return 0;
+}
+
+static int seccomp_load_or_compile(scmp_filter_ctx seccomp) {
+        int r;
+
+        if (!compiling)
+                return seccomp_load(seccomp);
+
+        /* The callers skip filters that fail to load, but a compiled set missing a filter must never be used */
+        if (compiling_error < 0)
+                return compiling_error;
+
+        r = seccomp_export(seccomp, compiling);
+        if (r < 0)
+                compiling_error = r;
+
+        return r;
+}
+
 const SyscallFilterSet syscall_filter_sets[_SYSCALL_FILTER_SET_MAX] = {
         [SYSCALL_FILTER_SET_DEFAULT] = {
                 .name = "@default",
@@ -944,7 +1026,7 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -992,7 +1074,7 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
                         }
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1170,7 +1252,7 @@ int seccomp_restrict_namespaces(unsigned long retain) {
                 if (r < 0)
                         continue;
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1207,7 +1289,7 @@ int seccomp_protect_sysctl(void) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1371,7 +1453,7 @@ int seccomp_restrict_address_families(Set *address_families, bool whitelist) {
                         }
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1448,7 +1530,7 @@ int seccomp_restrict_realtime(void) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1579,7 +1661,7 @@ int seccomp_memory_deny_write_execute(void) {
                                 continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1632,7 +1714,7 @@ int seccomp_restrict_archs(Set *archs) {
         if (r < 0)
                 return r;
 
-        r = seccomp_load(seccomp);
+        r = seccomp_load_or_compile(seccomp);
         if (IN_SET(r, -EPERM, -EACCES))
                 return r;
         if (r < 0)
@@ -1734,7 +1816,7 @@ int seccomp_lock_personality(unsigned long personality) {
                         continue;
                 }
 
-                r = seccomp_load(seccomp);
+                r = seccomp_load_or_compile(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
                 if (r < 0)
@@ -1743,3 +1825,74 @@ int seccomp_lock_personality(unsigned long personality) {
 
         return 0;
 }
+
+SeccompPrograms *seccomp_programs_free(SeccompPrograms *p) {
+        size_t i;
+
+        if (!p)
+                return NULL;
+
+        for (i = 0; i < p->n_programs; i++)
+                free(p->programs[i].filter);
+
+        free(p->programs);
+        return mfree(p);
+}
+
+int seccomp_compile(int (*load)(void *userdata), void *userdata, SeccompPrograms **ret) {
+        _cleanup_(seccomp_programs_freep) SeccompPrograms *p = NULL;
+        int r;
+
+        assert(load);
+        assert(ret);
+        assert(!compiling);
+
+        /* Calls load(), which is expected to call the seccomp_restrict_xyz() and seccomp_load_xyz() functions above,
+         * but instead of installing the filters they build, they are compiled and returned in order, so that they
+         * can be installed later with seccomp_programs_install(), without involving libseccomp anymore. This is
+         * useful for building the filters once in a parent process and installing them in many children. */
+
+        p = new0(SeccompPrograms, 1);
+        if (!p)
+                return -ENOMEM;
+
+        compiling = p;
+        compiling_error = 0;
+
+        r = load(userdata);
+        if (r >= 0)
+                r = compiling_error;
+
+        compiling = NULL;
+        compiling_error = 0;
+
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+int seccomp_programs_install(const SeccompPrograms *p) {
+        size_t i;
+
+        assert(p);
+
+        /* Installs the filters in the same order as seccomp_load() would have, with the same error handling */
+
+        for (i = 0; i < p->n_programs; i++)
+                if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &p->programs[i], 0, 0) < 0) {
+                        if (IN_SET(errno, EPERM, EACCES))
+                                return -errno;
+
+                        log_debug_errno(errno, "Failed to install compiled seccomp filter, skipping: %m");
+                }
+
+        return 0;
+}
+
+size_t seccomp_programs_size(const SeccompPrograms *p) {
+        assert(p);
+
+        return p->n_programs;
+}
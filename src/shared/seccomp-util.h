@@ -96,3 +96,12 @@ extern const uint32_t seccomp_local_archs[];
 DEFINE_TRIVIAL_CLEANUP_FUNC(scmp_filter_ctx, seccomp_release);
 
 int parse_syscall_archs(char **l, Set **archs);
+
+typedef struct SeccompPrograms SeccompPrograms;
+
+SeccompPrograms *seccomp_programs_free(SeccompPrograms *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SeccompPrograms*, seccomp_programs_free);
+
+int seccomp_compile(int (*load)(void *userdata), void *userdata, SeccompPrograms **ret);
+int seccomp_programs_install(const SeccompPrograms *p);
+size_t seccomp_programs_size(const SeccompPrograms *p);
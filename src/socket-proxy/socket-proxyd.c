@@ -4,6 +4,8 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,6 +19,7 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "list.h"
 #include "log.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -27,20 +30,51 @@
 #include "util.h"
 
 #define BUFFER_SIZE (256 * 1024)
+
+/* How long to use the result of resolving the remote host for new connections */
+#define REMOTE_CACHE_USEC (60 * USEC_PER_SEC)
+
 static unsigned arg_connections_max = 256;
+static unsigned arg_threads = 1;
+static unsigned arg_backend_pool = 0;
 
 static const char *arg_remote_host = NULL;
 
+/* The number of connections across all threads */
+static unsigned n_connections = 0;
+
+typedef struct Connection Connection;
+
 typedef struct Context {
         sd_event *event;
         sd_resolve *resolve;
 
+        int *listen_fds;
+        size_t n_listen_fds;
+
         Set *listen;
         Set *connections;
+
+        /* The address of the remote host, and until when it may be used. For AF_UNIX addresses, that's forever,
+         * otherwise it's looked up again after a while, or whenever connecting to it failed. */
+        union sockaddr_union remote;
+        socklen_t remote_len;
+        usec_t remote_until;
+
+        /* The lookup of the remote host in progress, and the connections waiting for it */
+        sd_resolve_query *resolve_query;
+        LIST_HEAD(Connection, resolving);
+
+        /* Connections to the remote host established in advance */
+        int *pool;
+        size_t n_pool;
+
+        pthread_t thread;
 } Context;
 
-typedef struct Connection {
+struct Connection {
         Context *context;
+        char *peer;
 
         int server_fd, client_fd;
         int server_to_client_buffer[2]; /* a pipe */
@@ -51,15 +85,33 @@ typedef struct Connection {
 
         sd_event_source *server_event_source, *client_event_source;
 
-        sd_resolve_query *resolve_query;
-} Connection;
+        bool in_resolving;
+        LIST_FIELDS(Connection, resolving);
+
+        usec_t accept_timestamp, connect_timestamp;
+        uint64_t server_to_client_bytes, client_to_server_bytes;
+};
 
 static void connection_free(Connection *c) {
         assert(c);
 
-        if (c->context)
+        if (c->context) {
                 set_remove(c->context->connections, c);
 
+                if (c->in_resolving)
+                        LIST_REMOVE(resolving, c->context->resolving, c);
+        }
+
+        if (c->connect_timestamp > 0) {
+                char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Connection from %s closed after %s, connecting took %s, %" PRIu64 " bytes received, %" PRIu64 " bytes sent.",
+                          strna(c->peer),
+                          format_timespan(a, sizeof(a), now(CLOCK_MONOTONIC) - c->accept_timestamp, USEC_PER_MSEC),
+                          format_timespan(b, sizeof(b), c->connect_timestamp - c->accept_timestamp, 1),
+                          c->client_to_server_bytes, c->server_to_client_bytes);
+        }
+
         sd_event_source_unref(c->server_event_source);
         sd_event_source_unref(c->client_event_source);
 
@@ -69,9 +121,17 @@ static void connection_free(Connection *c) {
         safe_close_pair(c->server_to_client_buffer);
         safe_close_pair(c->client_to_server_buffer);
 
-        sd_resolve_query_unref(c->resolve_query);
-
+        free(c->peer);
         free(c);
+
+        (void) __sync_sub_and_fetch(&n_connections, 1);
+}
+
+static void context_flush_pool(Context *context) {
+        assert(context);
+
+        while (context->n_pool > 0)
+                safe_close(context->pool[--context->n_pool]);
 }
 
 static void context_free(Context *context) {
@@ -80,6 +140,14 @@ static void context_free(Context *context) {
         set_free_with_destructor(context->listen, sd_event_source_unref);
         set_free_with_destructor(context->connections, connection_free);
 
+        /* Listening sockets that didn't make it into an event source yet */
+        close_many(context->listen_fds, context->n_listen_fds);
+        free(context->listen_fds);
+
+        context_flush_pool(context);
+        free(context->pool);
+
+        sd_resolve_query_unref(context->resolve_query);
         sd_event_unref(context->event);
         sd_resolve_unref(context->resolve);
 }
@@ -113,7 +181,7 @@ static int connection_create_pipes(Connection *c, int buffer[2], size_t *sz) {
 static int connection_shovel(
                 Connection *c,
                 int *from, int buffer[2], int *to,
-                size_t *full, size_t *sz,
+                size_t *full, size_t *sz, uint64_t *n_bytes,
                 sd_event_source **from_source, sd_event_source **to_source) {
 
         bool shoveled;
@@ -126,6 +194,7 @@ static int connection_shovel(
         assert(to);
         assert(full);
         assert(sz);
+        assert(n_bytes);
         assert(from_source);
         assert(to_source);
 
@@ -150,6 +219,7 @@ static int connection_shovel(
                         z = splice(buffer[0], NULL, *to, NULL, *full, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
                         if (z > 0) {
                                 *full -= z;
+                                *n_bytes += z;
                                 shoveled = true;
                         } else if (z == 0 || IN_SET(errno, EPIPE, ECONNRESET)) {
                                 *to_source = sd_event_source_unref(*to_source);
@@ -175,6 +245,7 @@ static int traffic_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
         r = connection_shovel(c,
                               &c->server_fd, c->server_to_client_buffer, &c->client_fd,
                               &c->server_to_client_buffer_full, &c->server_to_client_buffer_size,
+                              &c->server_to_client_bytes,
                               &c->server_event_source, &c->client_event_source);
         if (r < 0)
                 goto quit;
@@ -182,6 +253,7 @@ static int traffic_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
         r = connection_shovel(c,
                               &c->client_fd, c->client_to_server_buffer, &c->server_fd,
                               &c->client_to_server_buffer_full, &c->client_to_server_buffer_size,
+                              &c->client_to_server_bytes,
                               &c->client_event_source, &c->server_event_source);
         if (r < 0)
                 goto quit;
@@ -253,6 +325,8 @@ static int connection_complete(Connection *c) {
 
         assert(c);
 
+        c->connect_timestamp = now(CLOCK_MONOTONIC);
+
         r = connection_create_pipes(c, c->server_to_client_buffer, &c->server_to_client_buffer_size);
         if (r < 0)
                 goto fail;
@@ -272,6 +346,18 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
+static void context_invalidate_remote(Context *context) {
+        assert(context);
+
+        /* Connecting failed, hence resolve the remote host again for the next connection, maybe it moved.
+         * Connections established in advance to the old address are likely broken too. */
+
+        if (context->remote_until != USEC_INFINITY)
+                context->remote_until = 0;
+
+        context_flush_pool(context);
+}
+
 static int connect_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Connection *c = userdata;
         socklen_t solen;
@@ -290,6 +376,7 @@ static int connect_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
 
         if (error != 0) {
                 log_error_errno(error, "Failed to connect to remote host: %m");
+                context_invalidate_remote(c->context);
                 goto fail;
         }
 
@@ -302,43 +389,110 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
-static int connection_start(Connection *c, struct sockaddr *sa, socklen_t salen) {
+static int remote_connect(const union sockaddr_union *sa, socklen_t salen) {
+        int fd;
+
+        assert(sa);
+        assert(salen > 0);
+
+        fd = socket(sa->sa.sa_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to get remote socket: %m");
+
+        if (connect(fd, &sa->sa, salen) < 0 && errno != EINPROGRESS) {
+                log_error_errno(errno, "Failed to connect to remote host: %m");
+                safe_close(fd);
+                return -errno;
+        }
+
+        return fd;
+}
+
+static void context_fill_pool(Context *context) {
+        int fd;
+
+        assert(context);
+        assert(context->remote_len > 0);
+
+        if (context->n_pool >= arg_backend_pool)
+                return;
+
+        if (!context->pool) {
+                context->pool = new(int, arg_backend_pool);
+                if (!context->pool) {
+                        log_oom();
+                        return;
+                }
+        }
+
+        /* The connections are not waited for, whoever takes one out of the pool does that */
+        while (context->n_pool < arg_backend_pool) {
+                fd = remote_connect(&context->remote, context->remote_len);
+                if (fd < 0)
+                        return;
+
+                context->pool[context->n_pool++] = fd;
+        }
+}
+
+static int context_take_pool(Context *context) {
+        int fd;
+
+        assert(context);
+
+        while (context->n_pool > 0) {
+                ssize_t n;
+                char x;
+
+                /* Take the most recently established connection, and check that the remote host didn't give up
+                 * on it in the meantime. Note that data it sent already is not consumed here. */
+                fd = context->pool[--context->n_pool];
+
+                n = recv(fd, &x, sizeof(x), MSG_PEEK|MSG_DONTWAIT);
+                if (n > 0 || (n < 0 && errno == EAGAIN))
+                        return fd;
+
+                safe_close(fd);
+        }
+
+        return -ENOENT;
+}
+
+static int connection_start(Connection *c) {
+        Context *context;
         int r;
 
         assert(c);
-        assert(sa);
-        assert(salen);
+        assert(c->context);
 
-        c->client_fd = socket(sa->sa_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        context = c->context;
+        assert(context->remote_len > 0);
+
+        c->client_fd = context_take_pool(context);
         if (c->client_fd < 0) {
-                log_error_errno(errno, "Failed to get remote socket: %m");
-                goto fail;
+                c->client_fd = remote_connect(&context->remote, context->remote_len);
+                if (c->client_fd < 0) {
+                        context_invalidate_remote(context);
+                        goto fail;
+                }
         }
 
-        r = connect(c->client_fd, sa, salen);
+        /* Whether the socket is connected already or not, the connection is complete once it is writable */
+        r = sd_event_add_io(context->event, &c->client_event_source, c->client_fd, EPOLLOUT, connect_cb, c);
         if (r < 0) {
-                if (errno == EINPROGRESS) {
-                        r = sd_event_add_io(c->context->event, &c->client_event_source, c->client_fd, EPOLLOUT, connect_cb, c);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to add connection socket: %m");
-                                goto fail;
-                        }
+                log_error_errno(r, "Failed to add connection socket: %m");
+                goto fail;
+        }
 
-                        r = sd_event_source_set_enabled(c->client_event_source, SD_EVENT_ONESHOT);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to enable oneshot event source: %m");
-                                goto fail;
-                        }
-                } else {
-                        log_error_errno(errno, "Failed to connect to remote host: %m");
-                        goto fail;
-                }
-        } else {
-                r = connection_complete(c);
-                if (r < 0)
-                        goto fail;
+        r = sd_event_source_set_enabled(c->client_event_source, SD_EVENT_ONESHOT);
+        if (r < 0) {
+                log_error_errno(r, "Failed to enable oneshot event source: %m");
+                goto fail;
         }
 
+        if (arg_backend_pool > 0)
+                context_fill_pool(context);
+
         return 0;
 
 fail:
@@ -347,23 +501,75 @@ fail:
 }
 
 static int resolve_cb(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
-        Connection *c = userdata;
+        Context *context = userdata;
+        LIST_HEAD(Connection, waiting);
+        Connection *c;
+        bool resolved = false;
+        usec_t n;
 
         assert(q);
-        assert(c);
+        assert(context);
 
-        if (ret != 0) {
+        context->resolve_query = sd_resolve_query_unref(context->resolve_query);
+
+        if (ret != 0)
                 log_error("Failed to resolve host: %s", gai_strerror(ret));
-                goto fail;
+        else if (ai->ai_addrlen > sizeof(context->remote))
+                log_error("Resolved address of host is too long.");
+        else {
+                assert_se(sd_event_now(context->event, CLOCK_MONOTONIC, &n) >= 0);
+
+                memcpy(&context->remote, ai->ai_addr, ai->ai_addrlen);
+                context->remote_len = ai->ai_addrlen;
+                context->remote_until = usec_add(n, REMOTE_CACHE_USEC);
+                resolved = true;
         }
 
-        c->resolve_query = sd_resolve_query_unref(c->resolve_query);
+        /* Start or fail all connections that waited for this lookup. A failing connection_start() invalidates
+         * the address again, which must not fail the others, hence decide on the outcome of the lookup and take
+         * the list of waiting connections first. Connections arriving meanwhile wait for a new lookup. */
+        waiting = TAKE_PTR(context->resolving);
 
-        return connection_start(c, ai->ai_addr, ai->ai_addrlen);
+        while ((c = waiting)) {
+                LIST_REMOVE(resolving, waiting, c);
+                c->in_resolving = false;
 
-fail:
-        connection_free(c);
-        return 0; /* ignore errors, continue serving */
+                if (!resolved)
+                        connection_free(c);
+                else
+                        (void) connection_start(c);
+        }
+
+        return 0;
+}
+
+static int context_setup_remote(Context *context) {
+        union sockaddr_union *sa;
+
+        assert(context);
+
+        sa = &context->remote;
+
+        /* AF_UNIX addresses don't need to be resolved, set them up right-away, and for good */
+
+        if (path_is_absolute(arg_remote_host)) {
+                sa->un.sun_family = AF_UNIX;
+                strncpy(sa->un.sun_path, arg_remote_host, sizeof(sa->un.sun_path));
+                context->remote_len = SOCKADDR_UN_LEN(sa->un);
+                context->remote_until = USEC_INFINITY;
+                return 1;
+        }
+
+        if (arg_remote_host[0] == '@') {
+                sa->un.sun_family = AF_UNIX;
+                sa->un.sun_path[0] = 0;
+                strncpy(sa->un.sun_path+1, arg_remote_host+1, sizeof(sa->un.sun_path)-1);
+                context->remote_len = SOCKADDR_UN_LEN(sa->un);
+                context->remote_until = USEC_INFINITY;
+                return 1;
+        }
+
+        return 0;
 }
 
 static int resolve_remote(Connection *c) {
@@ -374,22 +580,33 @@ static int resolve_remote(Connection *c) {
                 .ai_flags = AI_ADDRCONFIG
         };
 
-        union sockaddr_union sa = {};
+        Context *context;
         const char *node, *service;
+        usec_t n;
         int r;
 
-        if (path_is_absolute(arg_remote_host)) {
-                sa.un.sun_family = AF_UNIX;
-                strncpy(sa.un.sun_path, arg_remote_host, sizeof(sa.un.sun_path));
-                return connection_start(c, &sa.sa, SOCKADDR_UN_LEN(sa.un));
-        }
+        assert(c);
+        assert(c->context);
 
-        if (arg_remote_host[0] == '@') {
-                sa.un.sun_family = AF_UNIX;
-                sa.un.sun_path[0] = 0;
-                strncpy(sa.un.sun_path+1, arg_remote_host+1, sizeof(sa.un.sun_path)-1);
-                return connection_start(c, &sa.sa, SOCKADDR_UN_LEN(sa.un));
-        }
+        context = c->context;
+
+        /* Use the cached address as long as it is valid */
+        if (context->remote_until == USEC_INFINITY)
+                return connection_start(c);
+
+        assert_se(sd_event_now(context->event, CLOCK_MONOTONIC, &n) >= 0);
+        if (n < context->remote_until)
+                return connection_start(c);
+
+        /* Otherwise wait for the lookup, and start one unless somebody else did so already */
+        LIST_PREPEND(resolving, context->resolving, c);
+        c->in_resolving = true;
+
+        if (context->resolve_query)
+                return 0;
+
+        context->remote_until = 0;
+        context_flush_pool(context);
 
         service = strrchr(arg_remote_host, ':');
         if (service) {
@@ -401,7 +618,7 @@ static int resolve_remote(Connection *c) {
         }
 
         log_debug("Looking up address info for %s:%s", node, service);
-        r = sd_resolve_getaddrinfo(c->context->resolve, &c->resolve_query, node, service, &hints, resolve_cb, c);
+        r = sd_resolve_getaddrinfo(context->resolve, &context->resolve_query, node, service, &hints, resolve_cb, context);
         if (r < 0) {
                 log_error_errno(r, "Failed to resolve remote host: %m");
                 goto fail;
@@ -414,45 +631,55 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
-static int add_connection_socket(Context *context, int fd) {
+static int add_connection_socket(Context *context, int fd, char *peer) {
         Connection *c;
         int r;
 
         assert(context);
         assert(fd >= 0);
 
-        if (set_size(context->connections) > arg_connections_max) {
+        /* Takes possession of peer */
+
+        if (__sync_add_and_fetch(&n_connections, 1) > arg_connections_max) {
                 log_warning("Hit connection limit, refusing connection.");
-                safe_close(fd);
-                return 0;
+                goto refuse;
         }
 
         r = set_ensure_allocated(&context->connections, NULL);
         if (r < 0) {
                 log_oom();
-                return 0;
+                goto refuse;
         }
 
         c = new0(Connection, 1);
         if (!c) {
                 log_oom();
-                return 0;
+                goto refuse;
         }
 
         c->context = context;
+        c->peer = peer;
         c->server_fd = fd;
         c->client_fd = -1;
         c->server_to_client_buffer[0] = c->server_to_client_buffer[1] = -1;
         c->client_to_server_buffer[0] = c->client_to_server_buffer[1] = -1;
+        c->accept_timestamp = now(CLOCK_MONOTONIC);
 
         r = set_put(context->connections, c);
         if (r < 0) {
-                free(c);
+                c->context = NULL;
+                connection_free(c);
                 log_oom();
                 return 0;
         }
 
         return resolve_remote(c);
+
+refuse:
+        (void) __sync_sub_and_fetch(&n_connections, 1);
+        safe_close(fd);
+        free(peer);
+        return 0;
 }
 
 static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
@@ -467,13 +694,14 @@ static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdat
 
         nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
         if (nfd < 0) {
-                if (errno != -EAGAIN)
+                /* With several threads waiting on the same socket, we might not be the first to get here */
+                if (errno != EAGAIN)
                         log_warning_errno(errno, "Failed to accept() socket: %m");
         } else {
                 getpeername_pretty(nfd, true, &peer);
                 log_debug("New connection from %s", strna(peer));
 
-                r = add_connection_socket(context, nfd);
+                r = add_connection_socket(context, nfd, TAKE_PTR(peer));
                 if (r < 0) {
                         log_error_errno(r, "Failed to accept connection, ignoring: %m");
                         safe_close(fd);
@@ -519,6 +747,9 @@ static int add_listen_socket(Context *context, int fd) {
         if (r < 0)
                 return log_error_errno(r, "Failed to add event source: %m");
 
+        /* From here on, the event source owns the socket */
+        (void) sd_event_source_set_io_fd_own(source, true);
+
         r = set_put(context->listen, source);
         if (r < 0) {
                 log_error_errno(r, "Failed to add source to set: %m");
@@ -535,6 +766,112 @@ static int add_listen_socket(Context *context, int fd) {
         return 0;
 }
 
+static int clone_listen_socket(int fd) {
+        union sockaddr_union sa = {};
+        socklen_t salen = sizeof(sa), l;
+        _cleanup_close_ int nfd = -1;
+        int v;
+
+        assert(fd >= 0);
+
+        /* Returns a socket for another thread to accept() connections on. If the socket we got passed has
+         * SO_REUSEPORT set, that's a new socket listening on the same address, so that the kernel distributes
+         * incoming connections among the threads. Otherwise, all threads wait on the same socket, and
+         * whoever gets to accept() first wins. */
+
+        l = sizeof(v);
+        if (getsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &v, &l) < 0 || v == 0)
+                goto share;
+
+        if (getsockname(fd, &sa.sa, &salen) < 0)
+                goto share;
+
+        if (!IN_SET(sa.sa.sa_family, AF_INET, AF_INET6))
+                goto share;
+
+        nfd = socket(sa.sa.sa_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (nfd < 0)
+                goto share;
+
+        v = 1;
+        if (setsockopt(nfd, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v)) < 0)
+                goto share;
+
+        if (sa.sa.sa_family == AF_INET6) {
+                l = sizeof(v);
+                if (getsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v, &l) < 0 ||
+                    setsockopt(nfd, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v)) < 0)
+                        goto share;
+        }
+
+        if (bind(nfd, &sa.sa, salen) < 0 ||
+            listen(nfd, SOMAXCONN) < 0) {
+                log_debug_errno(errno, "Failed to open another socket with SO_REUSEPORT, sharing the passed one: %m");
+                goto share;
+        }
+
+        return TAKE_FD(nfd);
+
+share:
+        safe_close(nfd);
+
+        nfd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (nfd < 0)
+                return log_error_errno(errno, "Failed to duplicate listening socket: %m");
+
+        return TAKE_FD(nfd);
+}
+
+static int context_run(Context *context, bool watchdog) {
+        size_t i;
+        int r;
+
+        assert(context);
+
+        /* These are per-thread */
+        r = sd_event_default(&context->event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        if (watchdog)
+                (void) sd_event_set_watchdog(context->event, true);
+
+        r = sd_resolve_default(&context->resolve);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate resolver: %m");
+
+        r = sd_resolve_attach_event(context->resolve, context->event, 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to attach resolver: %m");
+
+        if (context_setup_remote(context) > 0 && arg_backend_pool > 0)
+                context_fill_pool(context);
+
+        for (i = 0; i < context->n_listen_fds; i++) {
+                r = add_listen_socket(context, context->listen_fds[i]);
+                if (r < 0)
+                        return r;
+
+                context->listen_fds[i] = -1;
+        }
+
+        r = sd_event_loop(context->event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to run event loop: %m");
+
+        return 0;
+}
+
+static void *context_thread(void *p) {
+        Context *context = p;
+
+        (void) context_run(context, false);
+
+        /* The other threads continue serving */
+        context_free(context);
+        return NULL;
+}
+
 static int help(void) {
         _cleanup_free_ char *link = NULL;
         int r;
@@ -547,6 +884,9 @@ static int help(void) {
                "%1$s [SOCKET]\n\n"
                "Bidirectionally proxy local sockets to another (possibly remote) socket.\n\n"
                "  -c --connections-max=  Set the maximum number of connections to be accepted\n"
+               "     --threads=          Number of threads to serve connections on\n"
+               "     --backend-pool=     Number of connections to the remote host to establish\n"
+               "                         in advance, per thread\n"
                "  -h --help              Show this help\n"
                "     --version           Show package version\n"
                "\nSee the %2$s for details.\n"
@@ -561,13 +901,17 @@ static int parse_argv(int argc, char *argv[]) {
 
         enum {
                 ARG_VERSION = 0x100,
-                ARG_IGNORE_ENV
+                ARG_IGNORE_ENV,
+                ARG_THREADS,
+                ARG_BACKEND_POOL,
         };
 
         static const struct option options[] = {
-                { "connections-max", required_argument, NULL, 'c'           },
-                { "help",            no_argument,       NULL, 'h'           },
-                { "version",         no_argument,       NULL, ARG_VERSION   },
+                { "connections-max", required_argument, NULL, 'c'              },
+                { "threads",         required_argument, NULL, ARG_THREADS      },
+                { "backend-pool",    required_argument, NULL, ARG_BACKEND_POOL },
+                { "help",            no_argument,       NULL, 'h'              },
+                { "version",         no_argument,       NULL, ARG_VERSION      },
                 {}
         };
 
@@ -600,6 +944,29 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
 
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0) {
+                                log_error("Failed to parse --threads= argument: %s", optarg);
+                                return r;
+                        }
+
+                        if (arg_threads < 1) {
+                                log_error("Number of threads is too low.");
+                                return -EINVAL;
+                        }
+
+                        break;
+
+                case ARG_BACKEND_POOL:
+                        r = safe_atou(optarg, &arg_backend_pool);
+                        if (r < 0) {
+                                log_error("Failed to parse --backend-pool= argument: %s", optarg);
+                                return r;
+                        }
+
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -622,7 +989,9 @@ static int parse_argv(int argc, char *argv[]) {
 }
 
 int main(int argc, char *argv[]) {
-        Context context = {};
+        Context *contexts = NULL;
+        sigset_t ss, saved_ss;
+        unsigned i;
         int r, n, fd;
 
         log_parse_environment();
@@ -632,26 +1001,6 @@ int main(int argc, char *argv[]) {
         if (r <= 0)
                 goto finish;
 
-        r = sd_event_default(&context.event);
-        if (r < 0) {
-                log_error_errno(r, "Failed to allocate event loop: %m");
-                goto finish;
-        }
-
-        r = sd_resolve_default(&context.resolve);
-        if (r < 0) {
-                log_error_errno(r, "Failed to allocate resolver: %m");
-                goto finish;
-        }
-
-        r = sd_resolve_attach_event(context.resolve, context.event, 0);
-        if (r < 0) {
-                log_error_errno(r, "Failed to attach resolver: %m");
-                goto finish;
-        }
-
-        sd_event_set_watchdog(context.event, true);
-
         n = sd_listen_fds(1);
         if (n < 0) {
                 log_error("Failed to receive sockets from parent.");
@@ -663,20 +1012,73 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
-        for (fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n; fd++) {
-                r = add_listen_socket(&context, fd);
-                if (r < 0)
+        contexts = new0(Context, arg_threads);
+        if (!contexts) {
+                r = log_oom();
+                goto finish;
+        }
+
+        /* The first context runs in the main thread, and gets the sockets we got passed in. All others get their
+         * own sockets listening on the same addresses. */
+        for (i = 0; i < arg_threads; i++) {
+                contexts[i].listen_fds = new(int, n);
+                if (!contexts[i].listen_fds) {
+                        r = log_oom();
                         goto finish;
+                }
+
+                for (fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n; fd++) {
+                        int nfd;
+
+                        if (i == 0)
+                                nfd = fd;
+                        else {
+                                nfd = clone_listen_socket(fd);
+                                if (nfd < 0) {
+                                        r = nfd;
+                                        goto finish;
+                                }
+                        }
+
+                        contexts[i].listen_fds[contexts[i].n_listen_fds++] = nfd;
+                }
         }
 
-        r = sd_event_loop(context.event);
-        if (r < 0) {
-                log_error_errno(r, "Failed to run event loop: %m");
+        /* Signals are left to the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                r = log_error_errno(r, "Failed to block signals: %m");
                 goto finish;
         }
 
+        for (i = 1; i < arg_threads; i++) {
+                r = pthread_create(&contexts[i].thread, NULL, context_thread, contexts + i);
+                if (r > 0) {
+                        r = log_error_errno(r, "Failed to start thread: %m");
+                        break;
+                }
+        }
+
+        (void) pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+
+        if (r < 0)
+                goto finish;
+
+        r = context_run(&contexts[0], true);
+
 finish:
-        context_free(&context);
+        /* The other threads are not stopped, they go away with the process. Hence, only release what the
+         * main thread owns. */
+        if (contexts) {
+                context_free(&contexts[0]);
+
+                for (i = 1; i < arg_threads; i++)
+                        if (!contexts[i].thread) {
+                                close_many(contexts[i].listen_fds, contexts[i].n_listen_fds);
+                                free(contexts[i].listen_fds);
+                        }
+        }
 
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <poll.h>
 #include <stddef.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "sd-bus.h"
@@ -14,11 +16,15 @@
 #include "bus-internal.h"
 #include "bus-util.h"
 #include "build.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "util.h"
 
 #define DEFAULT_BUS_PATH "unix:path=/run/dbus/system_bus_socket"
 
+#define BUFFER_SIZE (256 * 1024)
+
 static const char *arg_bus_path = DEFAULT_BUS_PATH;
 static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 
@@ -89,10 +95,199 @@ static int parse_argv(int argc, char *argv[]) {
         return 1;
 }
 
+typedef struct Shovel {
+        int from, to;
+        int buffer[2];
+        size_t full, size;
+        bool eof;
+} Shovel;
+
+static void shovel_done(Shovel *s) {
+        assert(s);
+
+        safe_close_pair(s->buffer);
+}
+
+static int shovel_init(Shovel *s, int from, int to, const void *p, size_t n) {
+        int r;
+
+        assert(s);
+
+        *s = (Shovel) {
+                .from = from,
+                .to = to,
+                .buffer = { -1, -1 },
+        };
+
+        if (pipe2(s->buffer, O_CLOEXEC|O_NONBLOCK) < 0)
+                return log_error_errno(errno, "Failed to allocate pipe buffer: %m");
+
+        (void) fcntl(s->buffer[0], F_SETPIPE_SZ, BUFFER_SIZE);
+
+        r = fcntl(s->buffer[0], F_GETPIPE_SZ);
+        if (r < 0)
+                return log_error_errno(errno, "Failed to get pipe buffer size: %m");
+
+        assert(r > 0);
+        s->size = r;
+
+        /* Whatever sd-bus already read, but didn't turn into a message yet, needs to go out first */
+        if (n > 0) {
+                r = loop_write(s->to, p, n, true);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write buffered data: %m");
+        }
+
+        return 0;
+}
+
+static int shovel(Shovel *s) {
+        bool shoveled;
+
+        assert(s);
+
+        do {
+                ssize_t z;
+
+                shoveled = false;
+
+                if (s->full < s->size && !s->eof) {
+                        z = splice(s->from, NULL, s->buffer[1], NULL, s->size - s->full, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+                        if (z > 0) {
+                                s->full += z;
+                                shoveled = true;
+                        } else if (z == 0 || IN_SET(errno, EPIPE, ECONNRESET))
+                                s->eof = true;
+                        else if (!IN_SET(errno, EAGAIN, EINTR))
+                                return log_error_errno(errno, "Failed to splice: %m");
+                }
+
+                if (s->full > 0) {
+                        z = splice(s->buffer[0], NULL, s->to, NULL, s->full, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+                        if (z > 0) {
+                                s->full -= z;
+                                shoveled = true;
+                        } else if (z < 0 && IN_SET(errno, EPIPE, ECONNRESET))
+                                return -ECONNRESET;
+                        else if (z < 0 && !IN_SET(errno, EAGAIN, EINTR))
+                                return log_error_errno(errno, "Failed to splice: %m");
+                }
+        } while (shoveled);
+
+        /* Only done once everything read was passed on, too */
+        return s->eof && s->full == 0;
+}
+
+static bool fd_can_splice(int fd) {
+        struct stat st;
+
+        if (fstat(fd, &st) < 0)
+                return false;
+
+        return S_ISSOCK(st.st_mode) || S_ISFIFO(st.st_mode);
+}
+
+static int bus_can_splice(sd_bus *bus) {
+        uint64_t n;
+        int r;
+
+        assert(bus);
+
+        /* Once authentication is complete, the stream is just a sequence of messages. We just pass them on
+         * unmodified anyway, hence unless file descriptors are passed along with them, the bytes can be forwarded
+         * directly. Returns -EAGAIN if this might become possible later on. */
+
+        r = sd_bus_is_ready(bus);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EAGAIN;
+
+        r = sd_bus_can_send(bus, SD_BUS_TYPE_UNIX_FD);
+        if (r != 0)
+                return false;
+
+        if (!fd_can_splice(bus->input_fd) || !fd_can_splice(bus->output_fd))
+                return false;
+
+        r = sd_bus_get_n_queued_read(bus, &n);
+        if (r < 0)
+                return r;
+        if (n > 0)
+                return -EAGAIN;
+
+        r = sd_bus_get_n_queued_write(bus, &n);
+        if (r < 0)
+                return r;
+        if (n > 0)
+                return -EAGAIN;
+
+        return true;
+}
+
+static int splice_loop(sd_bus *a, sd_bus *b) {
+        Shovel to_a = { .buffer = { -1, -1 } }, to_b = { .buffer = { -1, -1 } };
+        int r;
+
+        assert(a);
+        assert(b);
+
+        log_debug("Authentication complete and no file descriptor passing negotiated, forwarding data directly.");
+
+        /* From here on the bus objects are only used for their fds and the data they buffered */
+        r = shovel_init(&to_a, b->input_fd, a->output_fd, b->rbuffer, b->rbuffer_size);
+        if (r < 0)
+                goto finish;
+
+        r = shovel_init(&to_b, a->input_fd, b->output_fd, a->rbuffer, a->rbuffer_size);
+        if (r < 0)
+                goto finish;
+
+        for (;;) {
+                r = shovel(&to_a);
+                if (r != 0) /* Client went away, or error */
+                        break;
+
+                r = shovel(&to_b);
+                if (r < 0)
+                        break;
+                if (r > 0) {
+                        log_error("Connection to bus closed.");
+                        r = -ECONNRESET;
+                        break;
+                }
+
+                {
+                        struct pollfd p[4] = {
+                                { .fd = to_a.from, .events = to_a.full < to_a.size ? POLLIN : 0,  },
+                                { .fd = to_a.to,   .events = to_a.full > 0 ? POLLOUT : 0,         },
+                                { .fd = to_b.from, .events = to_b.full < to_b.size ? POLLIN : 0,  },
+                                { .fd = to_b.to,   .events = to_b.full > 0 ? POLLOUT : 0,         },
+                        };
+
+                        r = ppoll(p, ELEMENTSOF(p), NULL, NULL);
+                }
+                if (r < 0) {
+                        r = log_error_errno(errno, "ppoll() failed: %m");
+                        break;
+                }
+        }
+
+        /* treat 'connection reset by peer' as clean exit condition */
+        if (IN_SET(r, -ECONNRESET, 1))
+                r = 0;
+
+finish:
+        shovel_done(&to_a);
+        shovel_done(&to_b);
+
+        return r;
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
         sd_id128_t server_id;
-        bool is_unix;
+        bool is_unix, check_splice = true;
         int r, in_fd, out_fd;
 
         log_set_target(LOG_TARGET_JOURNAL_OR_KMSG);
@@ -231,6 +426,22 @@ int main(int argc, char *argv[]) {
                 if (r > 0)
                         continue;
 
+                /* Everything that was queued has been processed. See if we can switch to forwarding the data
+                 * directly, without parsing and reassembling every single message. */
+                if (check_splice) {
+                        int q;
+
+                        q = bus_can_splice(a);
+                        if (q > 0)
+                                q = bus_can_splice(b);
+                        if (q > 0) {
+                                r = splice_loop(a, b);
+                                goto finish;
+                        }
+                        if (q != -EAGAIN)
+                                check_splice = false;
+                }
+
                 fd = sd_bus_get_fd(a);
                 if (fd < 0) {
                         r = fd;
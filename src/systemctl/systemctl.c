@@ -4966,6 +4966,7 @@ static int show_one(
                 sd_bus *bus,
                 const char *path,
                 const char *unit,
+                sd_bus_message *properties,
                 SystemctlShowMode show_mode,
                 bool *new_line,
                 bool *ellipsized) {
@@ -5069,15 +5070,26 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
-                        BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        &reply,
-                        &info);
+        if (properties) {
+                /* The properties have already been requested by show_batch() */
+                reply = sd_bus_message_ref(properties);
+
+                r = bus_message_map_all_properties(
+                                reply,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &info);
+        } else
+                r = bus_map_all_properties(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &reply,
+                                &info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
 
@@ -5124,6 +5136,222 @@ static int show_one(
         return 0;
 }
 
+/* How many units to request with a single GetUnitsProperties() call */
+#define SHOW_BULK_MAX 1024U
+
+static int show_bulk(
+                sd_bus *bus,
+                char **units,
+                size_t n,
+                char **properties,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        size_t k;
+        int r, ret = 0;
+
+        /* Requests the properties of the specified units from PID 1 in a single call, and shows them like
+         * show_one() would. Returns -EOPNOTSUPP if the call failed before anything was shown, in which case
+         * the caller should fall back to asking for each unit individually. */
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &call,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetUnitsProperties");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_open_container(call, 'a', "s");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        for (k = 0; k < n; k++) {
+                r = sd_bus_message_append(call, "s", units[k]);
+                if (r < 0)
+                        return bus_log_create_error(r);
+        }
+
+        r = sd_bus_message_close_container(call);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(call, properties);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, call, 0, &error, &reply);
+        if (r < 0) {
+                /* Older PID 1 versions don't know the call, and it fails as a whole if any of the units is
+                 * not accessible. Either way, the individual requests will show what's going on. */
+                log_debug_errno(r, "Failed to get properties of %zu units, requesting them individually: %s",
+                                n, bus_error_message(&error, r));
+                return -EOPNOTSUPP;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (k = 0; k < n; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                _cleanup_free_ char *path = NULL;
+
+                r = sd_bus_message_enter_container(reply, 'r', "sa{sv}");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0) {
+                        log_error("Unexpected number of units in reply.");
+                        return -EBADMSG;
+                }
+
+                r = sd_bus_message_skip(reply, "s");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                /* show_one() wants to go through the properties more than once, hence give it a message of
+                 * its own for each unit */
+                r = sd_bus_message_new(bus, &m, SD_BUS_MESSAGE_METHOD_RETURN);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_message_copy(m, reply, false);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                path = unit_dbus_path_from_name(units[k]);
+                if (!path)
+                        return log_oom();
+
+                r = show_one(bus, path, units[k], m, show_mode, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        return ret;
+}
+
+/* How many GetAll() calls to have in flight at the same time */
+#define SHOW_BATCH_MAX 128U
+
+static int show_batch(
+                sd_bus *bus,
+                char **units,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_strv_free_ char **properties = NULL;
+        bool bulk = true;
+        size_t n, i, k, m;
+        int r, ret = 0;
+
+        /* Shows the specified units, like show_one() would one after the other, but requests their
+         * properties in bulk, so that we don't have to wait for a full round trip to PID 1 for every
+         * single unit. If PID 1 doesn't support that, fall back to requesting them individually, but
+         * in batches. */
+
+        /* If only some properties are to be shown, request only those, plus the ones show_one() needs */
+        if (show_mode == SYSTEMCTL_SHOW_PROPERTIES && !strv_isempty(arg_properties)) {
+                properties = strv_new("LoadState", "ActiveState", "Documentation", NULL);
+                if (!properties)
+                        return log_oom();
+
+                r = strv_extend_strv(&properties, arg_properties, true);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        n = strv_length(units);
+
+        for (i = 0; i < n; i += m) {
+                sd_bus_message *calls[SHOW_BATCH_MAX] = {}, *replies[SHOW_BATCH_MAX] = {};
+                char *paths[SHOW_BATCH_MAX] = {};
+
+                if (bulk) {
+                        m = MIN(n - i, SHOW_BULK_MAX);
+
+                        r = show_bulk(bus, units + i, m, properties, show_mode, new_line, ellipsized);
+                        if (r != -EOPNOTSUPP) {
+                                if (r < 0)
+                                        return r;
+                                if (r > 0 && ret == 0)
+                                        ret = r;
+
+                                continue;
+                        }
+
+                        bulk = false;
+                }
+
+                m = MIN(n - i, SHOW_BATCH_MAX);
+
+                for (k = 0; k < m; k++) {
+                        paths[k] = unit_dbus_path_from_name(units[i + k]);
+                        if (!paths[k]) {
+                                r = log_oom();
+                                goto finish;
+                        }
+
+                        r = sd_bus_message_new_method_call(
+                                        bus,
+                                        &calls[k],
+                                        "org.freedesktop.systemd1",
+                                        paths[k],
+                                        "org.freedesktop.DBus.Properties",
+                                        "GetAll");
+                        if (r >= 0)
+                                r = sd_bus_message_append(calls[k], "s", "");
+                        if (r < 0) {
+                                r = bus_log_create_error(r);
+                                goto finish;
+                        }
+                }
+
+                /* If this fails for any unit, show_one() will simply try again, and report the error */
+                r = sd_bus_call_batch(bus, calls, m, 0, NULL, replies);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to request unit properties, ignoring: %m");
+
+                for (k = 0; k < m; k++) {
+                        r = show_one(bus, paths[k], units[i + k], replies[k], show_mode, new_line, ellipsized);
+                        if (r < 0)
+                                goto finish;
+                        if (r > 0 && ret == 0)
+                                ret = r;
+                }
+
+                r = 0;
+
+        finish:
+                for (k = 0; k < m; k++) {
+                        sd_bus_message_unref(calls[k]);
+                        sd_bus_message_unref(replies[k]);
+                        free(paths[k]);
+                }
+
+                if (r < 0)
+                        return r;
+        }
+
+        return ret;
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -5165,9 +5393,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **units = NULL;
+        unsigned c, k;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5179,21 +5407,15 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
-
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        /* The names are owned by the reply */
+        units = new0(char*, c + 1);
+        if (!units)
+                return log_oom();
 
-                r = show_one(bus, p, u->id, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
+        for (k = 0; k < c; k++)
+                units[k] = (char*) unit_infos[k].id;
 
-        return ret;
+        return show_batch(bus, units, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5295,7 +5517,7 @@ static int show(int argc, char *argv[], void *userdata) {
 
         /* If no argument is specified inspect the manager itself */
         if (show_mode == SYSTEMCTL_SHOW_PROPERTIES && argc <= 1)
-                return show_one(bus, "/org/freedesktop/systemd1", NULL, show_mode, &new_line, &ellipsized);
+                return show_one(bus, "/org/freedesktop/systemd1", NULL, NULL, show_mode, &new_line, &ellipsized);
 
         if (show_mode == SYSTEMCTL_SHOW_STATUS && argc <= 1) {
 
@@ -5335,7 +5557,7 @@ static int show(int argc, char *argv[], void *userdata) {
                                         return log_oom();
                         }
 
-                        r = show_one(bus, path, unit, show_mode, &new_line, &ellipsized);
+                        r = show_one(bus, path, unit, NULL, show_mode, &new_line, &ellipsized);
                         if (r < 0)
                                 return r;
                         else if (r > 0 && ret == 0)
@@ -5349,19 +5571,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(bus, path, *name, show_mode, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_batch(bus, names, show_mode, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
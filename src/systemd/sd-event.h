@@ -66,6 +66,15 @@ enum {
         SD_EVENT_PRIORITY_IDLE = 100
 };
 
+/* Fields are only ever appended, callers pass the size of the structure they know. */
+typedef struct sd_event_source_statistics {
+        uint64_t n_dispatched;
+        uint64_t dispatch_usec;
+        uint64_t dispatch_usec_max;
+        uint64_t pending_usec;
+        uint64_t n_ratelimited;
+} sd_event_source_statistics;
+
 typedef int (*sd_event_handler_t)(sd_event_source *s, void *userdata);
 typedef int (*sd_event_io_handler_t)(sd_event_source *s, int fd, uint32_t revents, void *userdata);
 typedef int (*sd_event_time_handler_t)(sd_event_source *s, uint64_t usec, void *userdata);
@@ -109,6 +118,11 @@ int sd_event_get_exit_code(sd_event *e, int *code);
 int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
+int sd_event_set_offload_threads(sd_event *e, unsigned n);
+int sd_event_get_offload_threads(sd_event *e, unsigned *ret);
+int sd_event_set_timer_wheel(sd_event *e, int b);
+int sd_event_get_timer_wheel(sd_event *e);
+int sd_event_get_latency_histogram(sd_event *e, uint64_t *buckets, size_t n_buckets);
 
 sd_event_source* sd_event_source_ref(sd_event_source *s);
 sd_event_source* sd_event_source_unref(sd_event_source *s);
@@ -142,6 +156,14 @@ int sd_event_source_get_child_pid(sd_event_source *s, pid_t *pid);
 int sd_event_source_get_inotify_mask(sd_event_source *s, uint32_t *ret);
 int sd_event_source_set_destroy_callback(sd_event_source *s, sd_event_destroy_t callback);
 int sd_event_source_get_destroy_callback(sd_event_source *s, sd_event_destroy_t *ret);
+int sd_event_source_set_offload(sd_event_source *s, int b);
+int sd_event_source_get_offload(sd_event_source *s);
+int sd_event_source_set_offload_callback(sd_event_source *s, sd_event_handler_t callback);
+int sd_event_source_get_offload_callback(sd_event_source *s, sd_event_handler_t *ret);
+int sd_event_source_get_statistics(sd_event_source *s, sd_event_source_statistics *ret, size_t size);
+int sd_event_source_set_ratelimit(sd_event_source *s, uint64_t interval_usec, unsigned burst);
+int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_interval_usec, unsigned *ret_burst);
+int sd_event_source_is_ratelimited(sd_event_source *s);
 
 /* Define helpers so that __attribute__((cleanup(sd_event_unrefp))) and similar may be used. */
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_event, sd_event_unref);
@@ -69,6 +69,7 @@ enum {
         SD_JOURNAL_SYSTEM       = 1 << 2,
         SD_JOURNAL_CURRENT_USER = 1 << 3,
         SD_JOURNAL_OS_ROOT      = 1 << 4,
+        SD_JOURNAL_SEQUENTIAL   = 1 << 5,
 
         SD_JOURNAL_SYSTEM_ONLY = SD_JOURNAL_SYSTEM /* deprecated name */
 };
@@ -94,6 +95,11 @@ int sd_journal_next(sd_journal *j);
 int sd_journal_previous_skip(sd_journal *j, uint64_t skip);
 int sd_journal_next_skip(sd_journal *j, uint64_t skip);
 
+typedef int (*sd_journal_entry_handler_t)(sd_journal *j, void *userdata);
+
+int sd_journal_previous_entries(sd_journal *j, uint64_t n, sd_journal_entry_handler_t callback, void *userdata);
+int sd_journal_next_entries(sd_journal *j, uint64_t n, sd_journal_entry_handler_t callback, void *userdata);
+
 int sd_journal_get_realtime_usec(sd_journal *j, uint64_t *ret);
 int sd_journal_get_monotonic_usec(sd_journal *j, uint64_t *ret, sd_id128_t *ret_boot_id);
 
@@ -48,6 +48,7 @@ sd_netlink *sd_netlink_ref(sd_netlink *nl);
 sd_netlink *sd_netlink_unref(sd_netlink *nl);
 
 int sd_netlink_send(sd_netlink *nl, sd_netlink_message *message, uint32_t *serial);
+int sd_netlink_cork(sd_netlink *nl, int b);
 int sd_netlink_call_async(sd_netlink *nl, sd_netlink_message *message,
                        sd_netlink_message_handler_t callback,
                        void *userdata, uint64_t usec, uint32_t *serial);
@@ -76,6 +76,11 @@ int sd_resolve_wait(sd_resolve *resolve, uint64_t timeout_usec);
 
 int sd_resolve_get_tid(sd_resolve *resolve, pid_t *tid);
 
+/* Remember successful getaddrinfo() results for the specified time,
+ * and answer identical queries from that. Pass 0 to turn this off,
+ * which is the default. */
+int sd_resolve_set_cache_timeout(sd_resolve *resolve, uint64_t usec);
+
 int sd_resolve_attach_event(sd_resolve *resolve, sd_event *e, int64_t priority);
 int sd_resolve_detach_event(sd_resolve *resolve);
 sd_event *sd_resolve_get_event(sd_resolve *resolve);
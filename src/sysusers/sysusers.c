@@ -10,6 +10,7 @@
 #include "fd-util.h"
 #include "fileio-label.h"
 #include "format-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "pager.h"
@@ -71,6 +72,9 @@ static OrderedHashmap *members = NULL;
 static Hashmap *database_uid = NULL, *database_user = NULL;
 static Hashmap *database_gid = NULL, *database_group = NULL;
 
+/* Whether to double-check with NSS, see check_nss() */
+static bool use_nss = true;
+
 static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
 static unsigned n_uid_range = 0;
@@ -173,6 +177,70 @@ static int load_group_database(void) {
         return 0;
 }
 
+static bool nss_source_is_files_only(const char *sources) {
+        _cleanup_strv_free_ char **l = NULL;
+        char **i;
+
+        l = strv_split(sources, WHITESPACE);
+        if (!l)
+                return false;
+
+        if (strv_isempty(l))
+                return false;
+
+        STRV_FOREACH(i, l)
+                /* Skip over action specifications such as "[NOTFOUND=return]" */
+                if (!streq(*i, "files") && !startswith(*i, "["))
+                        return false;
+
+        return true;
+}
+
+static void check_nss(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        bool passwd = false, group = false;
+        char line[LINE_MAX];
+
+        /* When operating on the host we also ask NSS about UIDs and GIDs, to avoid clashes with users from LDAP and
+         * such. If NSS is only configured to look into the very files we loaded ourselves already, this is redundant
+         * though, and can be expensive for large databases, hence skip it in that case. */
+
+        if (arg_root) {
+                use_nss = false;
+                return;
+        }
+
+        f = fopen("/etc/nsswitch.conf", "re");
+        if (!f)
+                return;
+
+        FOREACH_LINE(line, f, return) {
+                const char *p;
+                char *e;
+
+                e = strchr(line, '#');
+                if (e)
+                        *e = 0;
+
+                p = skip_leading_chars(line, WHITESPACE);
+
+                e = startswith(p, "passwd:");
+                if (e) {
+                        passwd = nss_source_is_files_only(e);
+                        continue;
+                }
+
+                e = startswith(p, "group:");
+                if (e)
+                        group = nss_source_is_files_only(e);
+        }
+
+        if (passwd && group) {
+                log_debug("NSS only looks at local files for users and groups, not consulting it.");
+                use_nss = false;
+        }
+}
+
 static int make_backup(const char *target, const char *x) {
         _cleanup_close_ int src = -1;
         _cleanup_fclose_ FILE *dst = NULL;
@@ -832,7 +900,7 @@ static int uid_is_ok(uid_t uid, const char *name, bool check_with_gid) {
         }
 
         /* Let's also check via NSS, to avoid UID clashes over LDAP and such, just in case */
-        if (!arg_root) {
+        if (use_nss) {
                 errno = 0;
                 p = getpwuid(uid);
                 if (p)
@@ -937,7 +1005,7 @@ static int add_user(Item *i) {
                 return 0;
         }
 
-        if (!arg_root) {
+        if (use_nss) {
                 struct passwd *p;
 
                 /* Also check NSS */
@@ -1052,7 +1120,7 @@ static int gid_is_ok(gid_t gid) {
         if (hashmap_contains(database_uid, UID_TO_PTR(gid)))
                 return 0;
 
-        if (!arg_root) {
+        if (use_nss) {
                 errno = 0;
                 g = getgrgid(gid);
                 if (g)
@@ -1087,7 +1155,7 @@ static int add_group(Item *i) {
         }
 
         /* Also check NSS */
-        if (!arg_root) {
+        if (use_nss) {
                 struct group *g;
 
                 errno = 0;
@@ -1998,6 +2066,8 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        check_nss();
+
         ORDERED_HASHMAP_FOREACH(i, groups, iterator)
                 (void) process_item(i);
 
@@ -0,0 +1,472 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "prioq.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "unit-name.h"
+#include "util.h"
+
+/* Measures the primitives that the hot paths of all our daemons are built from. Every benchmark is run with
+ * twice as many iterations each round, until it took at least the configured duration, and is then reported as
+ * one line of "name iterations ns/op" on stdout, so that the output of two builds can be compared directly.
+ *
+ * Usage: test-basic-benchmark [SECONDS [BENCHMARK...]] */
+
+#define N_KEYS 1024U
+#define ENV_FILE_TEMPLATE "/tmp/test-basic-benchmark.XXXXXX"
+
+typedef struct Benchmark {
+        const char *name;
+        void (*run)(uint64_t n);
+        void (*setup)(void);
+        void (*teardown)(void);
+} Benchmark;
+
+static usec_t arg_duration;
+
+static char *keys[N_KEYS];
+static Hashmap *hashmap;
+static OrderedHashmap *ordered_hashmap;
+static Set *set;
+static char **strv_unsorted, **strv_work;
+static char env_file[] = ENV_FILE_TEMPLATE;
+
+static uint64_t sink = 0;
+
+static void setup_keys(void) {
+        unsigned i;
+
+        for (i = 0; i < N_KEYS; i++)
+                assert_se(asprintf(&keys[i], "key-%u.service", (i * 7919) % N_KEYS) >= 0);
+}
+
+static void free_keys(void) {
+        unsigned i;
+
+        for (i = 0; i < N_KEYS; i++)
+                keys[i] = mfree(keys[i]);
+}
+
+static void bench_hashmap_put(uint64_t n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        uint64_t i;
+
+        assert_se(h = hashmap_new(&string_hash_ops));
+
+        for (i = 0; i < n; i++) {
+                assert_se(hashmap_put(h, keys[i % N_KEYS], keys[i % N_KEYS]) > 0);
+
+                if (i % N_KEYS == N_KEYS - 1)
+                        hashmap_clear(h);
+        }
+}
+
+static void setup_hashmap(void) {
+        unsigned i;
+
+        assert_se(hashmap = hashmap_new(&string_hash_ops));
+
+        for (i = 0; i < N_KEYS; i++)
+                assert_se(hashmap_put(hashmap, keys[i], keys[i]) > 0);
+}
+
+static void teardown_hashmap(void) {
+        hashmap = hashmap_free(hashmap);
+}
+
+static void bench_hashmap_get(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_get(hashmap, keys[i % N_KEYS]));
+}
+
+static void bench_hashmap_iterate(uint64_t n) {
+        uint64_t i = 0;
+
+        while (i < n) {
+                Iterator it;
+                char *k;
+
+                HASHMAP_FOREACH(k, hashmap, it) {
+                        sink += (uintptr_t) k;
+
+                        if (++i >= n)
+                                break;
+                }
+        }
+}
+
+static void bench_ordered_hashmap_put(uint64_t n) {
+        _cleanup_ordered_hashmap_free_ OrderedHashmap *h = NULL;
+        uint64_t i;
+
+        assert_se(h = ordered_hashmap_new(&string_hash_ops));
+
+        for (i = 0; i < n; i++) {
+                assert_se(ordered_hashmap_put(h, keys[i % N_KEYS], keys[i % N_KEYS]) > 0);
+
+                if (i % N_KEYS == N_KEYS - 1)
+                        ordered_hashmap_clear(h);
+        }
+}
+
+static void setup_ordered_hashmap(void) {
+        unsigned i;
+
+        assert_se(ordered_hashmap = ordered_hashmap_new(&string_hash_ops));
+
+        for (i = 0; i < N_KEYS; i++)
+                assert_se(ordered_hashmap_put(ordered_hashmap, keys[i], keys[i]) > 0);
+}
+
+static void teardown_ordered_hashmap(void) {
+        ordered_hashmap = ordered_hashmap_free(ordered_hashmap);
+}
+
+static void bench_ordered_hashmap_iterate(uint64_t n) {
+        uint64_t i = 0;
+
+        while (i < n) {
+                Iterator it;
+                char *k;
+
+                ORDERED_HASHMAP_FOREACH(k, ordered_hashmap, it) {
+                        sink += (uintptr_t) k;
+
+                        if (++i >= n)
+                                break;
+                }
+        }
+}
+
+static void bench_set_put(uint64_t n) {
+        _cleanup_set_free_ Set *s = NULL;
+        uint64_t i;
+
+        assert_se(s = set_new(NULL));
+
+        for (i = 0; i < n; i++) {
+                assert_se(set_put(s, UINT_TO_PTR(i % N_KEYS + 1)) > 0);
+
+                if (i % N_KEYS == N_KEYS - 1)
+                        set_clear(s);
+        }
+}
+
+static void setup_set(void) {
+        unsigned i;
+
+        assert_se(set = set_new(NULL));
+
+        for (i = 0; i < N_KEYS; i++)
+                assert_se(set_put(set, UINT_TO_PTR(i + 1)) > 0);
+}
+
+static void teardown_set(void) {
+        set = set_free(set);
+}
+
+static void bench_set_contains(uint64_t n) {
+        uint64_t i;
+
+        /* Half hits, half misses */
+        for (i = 0; i < n; i++)
+                sink += set_contains(set, UINT_TO_PTR(i % (2 * N_KEYS) + 1));
+}
+
+static void bench_prioq_put_pop(uint64_t n) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        uint64_t i;
+
+        assert_se(q = prioq_new(trivial_compare_func));
+
+        for (i = 0; i < N_KEYS; i++)
+                assert_se(prioq_put(q, UINT_TO_PTR((i * 7919) % N_KEYS + 1), NULL) >= 0);
+
+        /* Like an event loop: take the earliest item, and requeue it for later */
+        for (i = 0; i < n; i++) {
+                unsigned u;
+
+                u = PTR_TO_UINT(prioq_pop(q));
+                assert_se(prioq_put(q, UINT_TO_PTR(u + (i * 7919) % N_KEYS + 1), NULL) >= 0);
+        }
+}
+
+static void bench_strv_extend(uint64_t n) {
+        _cleanup_strv_free_ char **l = NULL;
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                assert_se(strv_extend(&l, keys[i % N_KEYS]) >= 0);
+
+                if (i % N_KEYS == N_KEYS - 1)
+                        l = strv_free(l);
+        }
+}
+
+static void setup_strv(void) {
+        assert_se(strv_unsorted = new0(char*, N_KEYS + 1));
+        assert_se(strv_work = new0(char*, N_KEYS + 1));
+
+        memcpy(strv_unsorted, keys, sizeof(char*) * N_KEYS);
+}
+
+static void teardown_strv(void) {
+        /* The strings are owned by keys[] */
+        strv_unsorted = mfree(strv_unsorted);
+        strv_work = mfree(strv_work);
+}
+
+static void bench_strv_sort(uint64_t n) {
+        uint64_t i;
+
+        /* One op is sorting N_KEYS strings */
+        for (i = 0; i < n; i++) {
+                memcpy(strv_work, strv_unsorted, sizeof(char*) * N_KEYS);
+                strv_sort(strv_work);
+        }
+}
+
+static void bench_extract_first_word(uint64_t n) {
+        uint64_t i;
+
+        /* One op is splitting the whole line */
+        for (i = 0; i < n; i++) {
+                const char *p = "-/usr/bin/foo --bar 'baz quux' \"a b c\" --verbose=\\x41 last";
+
+                for (;;) {
+                        _cleanup_free_ char *word = NULL;
+                        int r;
+
+                        r = extract_first_word(&p, &word, NULL, EXTRACT_QUOTES|EXTRACT_CUNESCAPE);
+                        assert_se(r >= 0);
+                        if (r == 0)
+                                break;
+
+                        sink += word[0];
+                }
+        }
+}
+
+static void bench_path_simplify(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                char p[] = "/usr//lib/./systemd/system///../system/foo.service.d/./override.conf/";
+
+                sink += strlen(path_simplify(p, true));
+        }
+}
+
+static void bench_path_equal(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++)
+                sink += path_equal("/usr/lib/systemd/system/foo.service", "/usr//lib/systemd/system/foo.service/");
+}
+
+static void setup_env_file(void) {
+        _cleanup_close_ int fd = -1;
+        static const char contents[] =
+                "# Some comment\n"
+                "NAME=Fedora\n"
+                "VERSION=\"28 (Twenty Eight)\"\n"
+                "ID=fedora\n"
+                "VERSION_ID=28\n"
+                "PLATFORM_ID=\"platform:f28\"\n"
+                "PRETTY_NAME=\"Fedora 28 (Twenty Eight)\"\n"
+                "ANSI_COLOR=\"0;34\"\n"
+                "CPE_NAME=\"cpe:/o:fedoraproject:fedora:28\"\n"
+                "HOME_URL=\"https://fedoraproject.org/\"\n"
+                "SUPPORT_URL=\"https://fedoraproject.org/wiki/Communicating_and_getting_help\"\n"
+                "BUG_REPORT_URL=\"https://bugzilla.redhat.com/\"\n"
+                "REDHAT_BUGZILLA_PRODUCT=\"Fedora\"\n"
+                "REDHAT_BUGZILLA_PRODUCT_VERSION=28\n"
+                "REDHAT_SUPPORT_PRODUCT=\"Fedora\"\n"
+                "REDHAT_SUPPORT_PRODUCT_VERSION=28\n"
+                "PRIVACY_POLICY_URL=\"https://fedoraproject.org/wiki/Legal:PrivacyPolicy\"\n";
+
+        strcpy(env_file, ENV_FILE_TEMPLATE);
+        fd = mkostemp_safe(env_file);
+        assert_se(fd >= 0);
+        assert_se(write(fd, contents, strlen(contents)) == (ssize_t) strlen(contents));
+}
+
+static void teardown_env_file(void) {
+        (void) unlink(env_file);
+}
+
+static void bench_parse_env_file(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *id = NULL, *version_id = NULL, *pretty_name = NULL;
+
+                assert_se(parse_env_file(NULL, env_file, NEWLINE,
+                                         "ID", &id,
+                                         "VERSION_ID", &version_id,
+                                         "PRETTY_NAME", &pretty_name,
+                                         NULL) >= 0);
+                assert_se(id && version_id && pretty_name);
+        }
+}
+
+static void bench_read_full_file(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *buf = NULL;
+                size_t size;
+
+                assert_se(read_full_file(env_file, &buf, &size) >= 0);
+                sink += size;
+        }
+}
+
+static void bench_unit_name_is_valid(uint64_t n) {
+        static const char *const names[] = {
+                "foo.service",
+                "getty@tty1.service",
+                "getty@.service",
+                "dev-disk-by\\x2duuid-1234.device",
+                "not a unit",
+                "-.mount",
+                "system-systemd\\x2dfsck.slice",
+                "foo.invalid",
+        };
+        uint64_t i;
+
+        for (i = 0; i < n; i++)
+                sink += unit_name_is_valid(names[i % ELEMENTSOF(names)], UNIT_NAME_ANY);
+}
+
+static void bench_unit_name_from_path(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *u = NULL;
+
+                assert_se(unit_name_from_path("/dev/disk/by-uuid/1234-abcd", ".device", &u) >= 0);
+        }
+}
+
+static void bench_unit_name_replace_instance(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *u = NULL;
+
+                assert_se(unit_name_replace_instance("getty@.service", "tty1", &u) >= 0);
+        }
+}
+
+static void bench_unit_name_to_prefix(uint64_t n) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *u = NULL;
+
+                assert_se(unit_name_to_prefix("systemd-fsck@dev-sda1.service", &u) >= 0);
+        }
+}
+
+static const Benchmark benchmarks[] = {
+        { "hashmap_put",                bench_hashmap_put },
+        { "hashmap_get",                bench_hashmap_get, setup_hashmap, teardown_hashmap },
+        { "hashmap_iterate",            bench_hashmap_iterate, setup_hashmap, teardown_hashmap },
+        { "ordered_hashmap_put",        bench_ordered_hashmap_put },
+        { "ordered_hashmap_iterate",    bench_ordered_hashmap_iterate, setup_ordered_hashmap, teardown_ordered_hashmap },
+        { "set_put",                    bench_set_put },
+        { "set_contains",               bench_set_contains, setup_set, teardown_set },
+        { "prioq_put_pop",              bench_prioq_put_pop },
+        { "strv_extend",                bench_strv_extend },
+        { "strv_sort",                  bench_strv_sort, setup_strv, teardown_strv },
+        { "extract_first_word",         bench_extract_first_word },
+        { "path_simplify",              bench_path_simplify },
+        { "path_equal",                 bench_path_equal },
+        { "parse_env_file",             bench_parse_env_file, setup_env_file, teardown_env_file },
+        { "read_full_file",             bench_read_full_file, setup_env_file, teardown_env_file },
+        { "unit_name_is_valid",         bench_unit_name_is_valid },
+        { "unit_name_from_path",        bench_unit_name_from_path },
+        { "unit_name_replace_instance", bench_unit_name_replace_instance },
+        { "unit_name_to_prefix",        bench_unit_name_to_prefix },
+};
+
+static void run_benchmark(const Benchmark *b) {
+        uint64_t n = 1;
+        usec_t t;
+
+        assert(b);
+
+        if (b->setup)
+                b->setup();
+
+        for (;;) {
+                t = now(CLOCK_MONOTONIC);
+                b->run(n);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                if (t >= arg_duration || n >= UINT64_MAX / 2)
+                        break;
+
+                n *= 2;
+        }
+
+        if (b->teardown)
+                b->teardown();
+
+        printf("%-28s %12" PRIu64 " %12.1f ns/op\n", b->name, n, (double) t * NSEC_PER_USEC / n);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned i;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2) {
+                unsigned x;
+
+                assert_se(safe_atou(argv[1], &x) >= 0);
+                arg_duration = x * USEC_PER_SEC;
+        } else {
+                bool slow;
+
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+                arg_duration = slow ? USEC_PER_SEC : USEC_PER_SEC / 50;
+        }
+
+        setup_keys();
+
+        for (i = 0; i < ELEMENTSOF(benchmarks); i++) {
+                if (argc > 2 && !strv_contains(argv + 2, benchmarks[i].name))
+                        continue;
+
+                run_benchmark(benchmarks + i);
+        }
+
+        free_keys();
+
+        /* Make sure nothing is optimized away */
+        log_debug("%" PRIu64, sink);
+
+        return EXIT_SUCCESS;
+}
@@ -24,7 +24,7 @@ int main(int argc, char *argv[]) {
         CGroupContext *cc = NULL;
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
         _cleanup_(manager_freep) Manager *m = NULL;
-        Unit *u;
+        Unit *u, *v, *w;
         char log_buf[65535];
         int r;
 
@@ -115,10 +115,10 @@ int main(int argc, char *argv[]) {
                 return EXIT_TEST_SKIP;
         assert_se(r >= 0);
 
-        assert(u->ip_bpf_ingress);
-        assert(u->ip_bpf_egress);
+        assert(u->accounting->ip_bpf_ingress);
+        assert(u->accounting->ip_bpf_egress);
 
-        r = bpf_program_load_kernel(u->ip_bpf_ingress, log_buf, ELEMENTSOF(log_buf));
+        r = bpf_program_load_kernel(u->accounting->ip_bpf_ingress, log_buf, ELEMENTSOF(log_buf));
 
         log_notice("log:");
         log_notice("-------");
@@ -127,7 +127,7 @@ int main(int argc, char *argv[]) {
 
         assert(r >= 0);
 
-        r = bpf_program_load_kernel(u->ip_bpf_egress, log_buf, ELEMENTSOF(log_buf));
+        r = bpf_program_load_kernel(u->accounting->ip_bpf_egress, log_buf, ELEMENTSOF(log_buf));
 
         log_notice("log:");
         log_notice("-------");
@@ -136,6 +136,47 @@ int main(int argc, char *argv[]) {
 
         assert(r >= 0);
 
+        /* A second unit with the same access lists shares the maps with the first one */
+        assert_se(v = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(v, "bar.service") == 0);
+        assert_se(cc = unit_get_cgroup_context(v));
+        v->perpetual = true;
+
+        assert_se(config_parse_ip_address_access(v->id, "filename", 1, "Service", 1, "IPAddressAllow", 0, "10.0.1.0/24 127.0.0.2", &cc->ip_address_allow, NULL) == 0);
+        assert_se(config_parse_ip_address_access(v->id, "filename", 1, "Service", 1, "IPAddressDeny", 0, "127.0.0.3", &cc->ip_address_deny, NULL) == 0);
+
+        v->load_state = UNIT_LOADED;
+
+        assert_se(bpf_firewall_compile(v) >= 0);
+        assert_se(v->accounting->ip_allow_maps == u->accounting->ip_allow_maps);
+        assert_se(v->accounting->ip_deny_maps);
+        assert_se(v->accounting->ip_deny_maps != u->accounting->ip_deny_maps);
+
+        /* … and recompiling keeps them */
+        assert_se(bpf_firewall_compile(v) >= 0);
+        assert_se(v->accounting->ip_allow_maps == u->accounting->ip_allow_maps);
+
+        /* Without accounting, a third unit with the same access lists ends up with the very same program, which is
+         * hence loaded only once */
+        assert_se(w = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(w, "baz.service") == 0);
+        assert_se(cc = unit_get_cgroup_context(w));
+        w->perpetual = true;
+
+        assert_se(config_parse_ip_address_access(w->id, "filename", 1, "Service", 1, "IPAddressAllow", 0, "10.0.1.0/24 127.0.0.2", &cc->ip_address_allow, NULL) == 0);
+        assert_se(config_parse_ip_address_access(w->id, "filename", 1, "Service", 1, "IPAddressDeny", 0, "127.0.0.3", &cc->ip_address_deny, NULL) == 0);
+
+        w->load_state = UNIT_LOADED;
+
+        assert_se(bpf_firewall_compile(w) >= 0);
+        assert_se(v->accounting->ip_bpf_ingress_shared);
+        assert_se(v->accounting->ip_bpf_egress_shared);
+        assert_se(w->accounting->ip_bpf_ingress_shared == v->accounting->ip_bpf_ingress_shared);
+        assert_se(w->accounting->ip_bpf_egress_shared == v->accounting->ip_bpf_egress_shared);
+        assert_se(w->accounting->ip_bpf_ingress != v->accounting->ip_bpf_ingress);
+        assert_se(w->accounting->ip_bpf_ingress->kernel_fd >= 0);
+        assert_se(!u->accounting->ip_bpf_ingress_shared);
+
         assert_se(unit_start(u) >= 0);
 
         while (!IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED))
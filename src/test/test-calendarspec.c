@@ -116,6 +116,45 @@ static void test_hourly_bug_4031(void) {
         calendar_spec_free(c);
 }
 
+static void test_next_benchmark(void) {
+        static const char * const specs[] = {
+                "hourly",
+                "daily",
+                "weekly",
+                "*:0/5",
+                "*-02-29",
+                "Mon *-*-1..7",
+                "Fri *-*-13 12:00",
+                "Wed *-*~1..7 03:00",
+                "*-*~1 UTC",
+                "Mon..Fri 9..17:0/15 UTC",
+        };
+        unsigned i, k;
+
+        for (i = 0; i < ELEMENTSOF(specs); i++) {
+                CalendarSpec *c;
+                usec_t u, t;
+
+                assert_se(calendar_spec_from_string(specs[i], &c) >= 0);
+
+                /* Walk through a thousand consecutive elapses, starting 2000-01-01 */
+                u = 946684800 * USEC_PER_SEC;
+                t = now(CLOCK_MONOTONIC);
+                for (k = 0; k < 1000; k++) {
+                        usec_t n;
+
+                        if (calendar_spec_next_usec(c, u, &n) < 0)
+                                break;
+
+                        assert_se(n > u);
+                        u = n;
+                }
+
+                printf("\"%s\": %u elapses in "USEC_FMT"us\n", specs[i], k, now(CLOCK_MONOTONIC) - t);
+                calendar_spec_free(c);
+        }
+}
+
 int main(int argc, char* argv[]) {
         CalendarSpec *c;
 
@@ -214,6 +253,13 @@ int main(int argc, char* argv[]) {
         // Confirm that timezones in the Spec work regardless of current timezone
         test_next("2017-09-09 20:42:00 Pacific/Auckland", "", 12345, 1504946520000000);
         test_next("2017-09-09 20:42:00 Pacific/Auckland", "EET", 12345, 1504946520000000);
+        // Sparse specifications
+        test_next("*-02-29 UTC", "", 946684800012345, 951782400000000);
+        test_next("Tue *-02-29 UTC", "", 946684800012345, 951782400000000);
+        test_next("Fri *-*-13 12:00 UTC", "", 946684800012345, 971438400000000);
+        test_next("Fri *-*-13 12:00 UTC", "", 971438400000000, 987163200000000);
+        test_next("*-*~1 UTC", "", 946684800012345, 949276800000000);
+        test_next("Wed *-*~1..7 03:00", "Europe/Berlin", 946684800012345, 948852000000000);
 
         assert_se(calendar_spec_from_string("test", &c) < 0);
         assert_se(calendar_spec_from_string(" utc", &c) < 0);
@@ -245,6 +291,7 @@ int main(int argc, char* argv[]) {
 
         test_timestamp();
         test_hourly_bug_4031();
+        test_next_benchmark();
 
         return 0;
 }
@@ -446,6 +446,59 @@ static void test_cg_get_keyed_attribute(void) {
         }
 }
 
+static void test_cg_read_pids(void) {
+        _cleanup_free_ char *path = NULL, *fs = NULL, *val = NULL;
+        _cleanup_free_ pid_t *pids = NULL, *pids_at = NULL;
+        _cleanup_close_ int fd = -1;
+        size_t n = 0, n_at = 0, i;
+        uint64_t id, id_at;
+        bool found = false;
+        pid_t pid;
+        int r;
+
+        r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &path);
+        if (r < 0) {
+                log_info_errno(r, "Skipping %s, can't determine own cgroup: %m", __func__);
+                return;
+        }
+
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, path, &pids, &n);
+        if (r < 0) {
+                log_info_errno(r, "Skipping %s, can't read own cgroup: %m", __func__);
+                return;
+        }
+
+        for (i = 0; i < n; i++)
+                if (pids[i] == getpid_cached())
+                        found = true;
+        assert_se(found);
+
+        fd = cg_open(SYSTEMD_CGROUP_CONTROLLER, path);
+        assert_se(fd >= 0);
+
+        assert_se(cg_read_pids_at(fd, &pids_at, &n_at) >= 0);
+        found = false;
+        for (i = 0; i < n_at; i++)
+                if (pids_at[i] == getpid_cached())
+                        found = true;
+        assert_se(found);
+
+        assert_se(cg_get_attribute_at(fd, "cgroup.procs", &val) >= 0);
+        assert_se(parse_pid(val, &pid) >= 0);
+        assert_se(cg_get_attribute_at(fd, "no_such_file", &val) == -ENOENT);
+
+        r = cg_fd_get_cgroupid(fd, &id_at);
+        if (r < 0) {
+                log_info_errno(r, "Skipping cgroup ID check, not supported: %m");
+                return;
+        }
+
+        assert_se(cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, NULL, &fs) >= 0);
+        assert_se(cg_path_get_cgroupid(fs, &id) >= 0);
+        assert_se(id == id_at);
+        log_info("%s → cgroup ID %" PRIu64, path, id);
+}
+
 int main(void) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -472,6 +525,7 @@ int main(void) {
         test_is_wanted();
         test_cg_tests();
         test_cg_get_keyed_attribute();
+        test_cg_read_pids();
 
         return 0;
 }
@@ -92,6 +92,54 @@ static void test_conf_files_list(bool use_root) {
         assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
 }
 
+static void test_conf_files_list_changed(void) {
+        char tmp_dir[] = "/tmp/test-conf-files-XXXXXX";
+        _cleanup_strv_free_ char **l = NULL;
+        const char *dir1, *dir2, *a1, *a2, *b2;
+
+        log_debug("/* %s */", __func__);
+
+        /* Enumerate the same directories repeatedly while changing them, to verify that we don't return stale
+         * results */
+
+        setup_test_dir(tmp_dir,
+                       "/dir1/a.conf",
+                       "/dir2/a.conf",
+                       NULL);
+
+        dir1 = strjoina(tmp_dir, "/dir1");
+        dir2 = strjoina(tmp_dir, "/dir2");
+        a1 = strjoina(tmp_dir, "/dir1/a.conf");
+        a2 = strjoina(tmp_dir, "/dir2/a.conf");
+        b2 = strjoina(tmp_dir, "/dir2/b.conf");
+
+        assert_se(conf_files_list(&l, ".conf", NULL, CONF_FILES_FILTER_MASKED, dir1, dir2, NULL) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a1)));
+        l = strv_free(l);
+
+        assert_se(write_string_file(b2, "foobar", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(conf_files_list(&l, ".conf", NULL, CONF_FILES_FILTER_MASKED, dir1, dir2, NULL) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a1, b2)));
+        l = strv_free(l);
+
+        /* Turning a file into a mask doesn't change the directory */
+        assert_se(truncate(a1, 0) >= 0);
+        assert_se(conf_files_list(&l, ".conf", NULL, CONF_FILES_FILTER_MASKED, dir1, dir2, NULL) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(b2)));
+        l = strv_free(l);
+
+        assert_se(unlink(a1) >= 0);
+        assert_se(conf_files_list(&l, ".conf", NULL, CONF_FILES_FILTER_MASKED, dir1, dir2, NULL) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a2, b2)));
+        l = strv_free(l);
+
+        assert_se(rm_rf(dir2, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
+        assert_se(conf_files_list(&l, ".conf", NULL, CONF_FILES_FILTER_MASKED, dir1, dir2, NULL) == 0);
+        assert_se(strv_isempty(l));
+
+        assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
+}
+
 int main(int argc, char **argv) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -99,5 +147,6 @@ int main(int argc, char **argv) {
 
         test_conf_files_list(false);
         test_conf_files_list(true);
+        test_conf_files_list_changed();
         return 0;
 }
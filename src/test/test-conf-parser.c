@@ -309,8 +309,9 @@ static const char* const config_file[] = {
         x1000(x1000("x") x10("abcde") "\\\n") "xxx",
 };
 
-static void test_config_parse(unsigned i, const char *s) {
+static void test_config_parse(unsigned i, const char *s, bool preparse) {
         _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-conf-parser.XXXXXX";
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *p = NULL;
         int fd, r;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *setting1 = NULL;
@@ -320,7 +321,7 @@ static void test_config_parse(unsigned i, const char *s) {
                 {}
         };
 
-        log_info("== %s[%i] ==", __func__, i);
+        log_info("== %s[%i]%s ==", __func__, i, preparse ? " (preparsed)" : "");
 
         fd = mkostemp_safe(name);
         assert_se(fd >= 0);
@@ -342,10 +343,26 @@ static void test_config_parse(unsigned i, const char *s) {
                          void *userdata)
         */
 
-        r = config_parse(NULL, name, f,
-                         "Section\0",
-                         config_item_table_lookup, items,
-                         CONFIG_PARSE_WARN, NULL);
+        if (preparse) {
+                r = config_preparse(name, f, 0, &p);
+                if (r >= 0) {
+                        /* A preparsed file may be applied any number of times, with the same result */
+                        assert_se(config_parse_preparsed(NULL, p,
+                                                         "Section\0",
+                                                         config_item_table_lookup, items,
+                                                         CONFIG_PARSE_WARN, NULL) == 0);
+                        setting1 = mfree(setting1);
+
+                        r = config_parse_preparsed(NULL, p,
+                                                   "Section\0",
+                                                   config_item_table_lookup, items,
+                                                   CONFIG_PARSE_WARN, NULL);
+                }
+        } else
+                r = config_parse(NULL, name, f,
+                                 "Section\0",
+                                 config_item_table_lookup, items,
+                                 CONFIG_PARSE_WARN, NULL);
 
         switch (i) {
         case 0 ... 3:
@@ -400,8 +417,10 @@ int main(int argc, char **argv) {
         test_config_parse_iec_uint64();
         test_config_parse_join_controllers();
 
-        for (i = 0; i < ELEMENTSOF(config_file); i++)
-                test_config_parse(i, config_file[i]);
+        for (i = 0; i < ELEMENTSOF(config_file); i++) {
+                test_config_parse(i, config_file[i], false);
+                test_config_parse(i, config_file[i], true);
+        }
 
         return 0;
 }
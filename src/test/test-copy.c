@@ -235,6 +235,99 @@ static void test_copy_bytes_regular_file(const char *src, bool try_reflink, uint
         unlink(fn3);
 }
 
+static void test_copy_holes(void) {
+        char fn[] = "/tmp/test-copy-hole-fd-XXXXXX";
+        char fn_copy[] = "/tmp/test-copy-hole-fd-XXXXXX";
+        _cleanup_close_ int fd = -1, fd_copy = -1;
+        char buf[4096], buf_copy[4096];
+        struct stat st;
+        off_t blksz;
+
+        log_info("%s", __func__);
+
+        fd = mkostemp_safe(fn);
+        assert_se(fd >= 0);
+
+        fd_copy = mkostemp_safe(fn_copy);
+        assert_se(fd_copy >= 0);
+
+        assert_se(fstat(fd, &st) >= 0);
+        blksz = st.st_blksize;
+
+        /* Data, a hole, more data, and a hole until the end */
+        memset(buf, 'a', sizeof(buf));
+        assert_se(pwrite(fd, buf, sizeof(buf), 0) == sizeof(buf));
+        assert_se(pwrite(fd, buf, sizeof(buf), 64 * blksz) == sizeof(buf));
+        assert_se(ftruncate(fd, 128 * blksz) >= 0);
+
+        if (lseek(fd, 0, SEEK_HOLE) != (off_t) sizeof(buf)) {
+                log_info("File system does not report holes precisely, skipping");
+                unlink(fn);
+                unlink(fn_copy);
+                return;
+        }
+
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(copy_bytes(fd, fd_copy, (uint64_t) -1, COPY_HOLES) >= 0);
+
+        assert_se(fstat(fd_copy, &st) >= 0);
+        assert_se(st.st_size == 128 * blksz);
+
+        /* Only the two runs of data take up space */
+        assert_se(lseek(fd_copy, 0, SEEK_HOLE) == (off_t) sizeof(buf));
+        assert_se(lseek(fd_copy, 0, SEEK_END) == st.st_size);
+        assert_se(lseek(fd_copy, sizeof(buf), SEEK_DATA) == 64 * blksz);
+        assert_se(lseek(fd_copy, 64 * blksz, SEEK_HOLE) == 64 * blksz + (off_t) sizeof(buf));
+
+        assert_se(pread(fd_copy, buf_copy, sizeof(buf_copy), 64 * blksz) == sizeof(buf_copy));
+        assert_se(memcmp(buf, buf_copy, sizeof(buf)) == 0);
+
+        assert_se(pread(fd_copy, buf_copy, sizeof(buf_copy), 32 * blksz) == sizeof(buf_copy));
+        memzero(buf, sizeof(buf));
+        assert_se(memcmp(buf, buf_copy, sizeof(buf)) == 0);
+
+        unlink(fn);
+        unlink(fn_copy);
+}
+
+static void test_copy_holes_stream(void) {
+        char fn[] = "/tmp/test-copy-hole-stream-XXXXXX";
+        _cleanup_close_pair_ int pipefd[2] = { -1, -1 };
+        _cleanup_close_ int fd = -1;
+        char buf[4096], buf_copy[4096];
+        struct stat st;
+
+        log_info("%s", __func__);
+
+        fd = mkostemp_safe(fn);
+        assert_se(fd >= 0);
+
+        assert_se(pipe2(pipefd, O_CLOEXEC) >= 0);
+
+        /* Data, zeroes, and data again, followed by zeroes until the end */
+        memset(buf, 'a', sizeof(buf));
+        assert_se(write(pipefd[1], buf, sizeof(buf)) == sizeof(buf));
+        memzero(buf_copy, sizeof(buf_copy));
+        assert_se(write(pipefd[1], buf_copy, sizeof(buf_copy)) == sizeof(buf_copy));
+        assert_se(write(pipefd[1], buf, sizeof(buf)) == sizeof(buf));
+        assert_se(write(pipefd[1], buf_copy, sizeof(buf_copy)) == sizeof(buf_copy));
+        pipefd[1] = safe_close(pipefd[1]);
+
+        assert_se(copy_bytes(pipefd[0], fd, (uint64_t) -1, COPY_HOLES) == 0);
+
+        assert_se(fstat(fd, &st) >= 0);
+        assert_se(st.st_size == 4 * sizeof(buf));
+
+        assert_se(pread(fd, buf_copy, sizeof(buf_copy), 2 * sizeof(buf)) == sizeof(buf_copy));
+        assert_se(memcmp(buf, buf_copy, sizeof(buf)) == 0);
+
+        assert_se(pread(fd, buf_copy, sizeof(buf_copy), 3 * sizeof(buf)) == sizeof(buf_copy));
+        memzero(buf, sizeof(buf));
+        assert_se(memcmp(buf, buf_copy, sizeof(buf)) == 0);
+
+        unlink(fn);
+}
+
 static void test_copy_atomic(void) {
         _cleanup_(rm_rf_physical_and_freep) char *p = NULL;
         const char *q;
@@ -266,6 +359,8 @@ int main(int argc, char *argv[]) {
         test_copy_bytes_regular_file(argv[0], true, 1000);
         test_copy_bytes_regular_file(argv[0], false, 32000); /* larger than copy buffer size */
         test_copy_bytes_regular_file(argv[0], true, 32000);
+        test_copy_holes();
+        test_copy_holes_stream();
         test_copy_atomic();
 
         return 0;
@@ -96,6 +96,30 @@ static void test_strv_env_merge(void) {
         assert_se(strv_length(r) == 5);
 }
 
+static void test_strv_env_merge_consume(void) {
+        _cleanup_strv_free_ char **a = NULL, **b = NULL, **r = NULL;
+
+        a = strv_new("FOO=BAR", "WALDO=", "PIEP", "SCHLUMPF=SMURF", NULL);
+        assert_se(a);
+
+        b = strv_new("FOO=KKK", "FOO=", "PIEP=", "SCHLUMPF=SMURFF", "NANANANA=YES", NULL);
+        assert_se(b);
+
+        /* Same result as strv_env_merge() */
+        r = strv_env_merge(2, a, b);
+        assert_se(r);
+
+        assert_se(strv_env_merge_consume(&a, TAKE_PTR(b)) >= 0);
+        assert_se(strv_equal(a, r));
+
+        assert_se(strv_env_merge_consume(&a, NULL) >= 0);
+        assert_se(strv_equal(a, r));
+
+        r = strv_free(r);
+        assert_se(strv_env_merge_consume(&r, strv_new("A=B", NULL)) >= 0);
+        assert_se(strv_equal(r, STRV_MAKE("A=B")));
+}
+
 static void test_env_strv_get_n(void) {
         const char *_env[] = {
                 "FOO=NO NO NO",
@@ -364,6 +388,7 @@ int main(int argc, char *argv[]) {
         test_strv_env_unset();
         test_strv_env_set();
         test_strv_env_merge();
+        test_strv_env_merge_consume();
         test_env_strv_get_n();
         test_replace_env(false);
         test_replace_env(true);
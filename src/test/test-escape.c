@@ -9,6 +9,10 @@ static void test_cescape(void) {
 
         assert_se(escaped = cescape("abc\\\"\b\f\n\r\t\v\a\003\177\234\313"));
         assert_se(streq(escaped, "abc\\\\\\\"\\b\\f\\n\\r\\t\\v\\a\\003\\177\\234\\313"));
+        escaped = mfree(escaped);
+
+        assert_se(escaped = cescape("it's a \"quoted\" ~ string"));
+        assert_se(streq(escaped, "it\\'s a \\\"quoted\\\" ~ string"));
 }
 
 static void test_cunescape(void) {
@@ -29,6 +29,34 @@ static void test_issue_9549(void) {
                         ));
 }
 
+static void test_sort_and_wide(void) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        _cleanup_free_ char *formatted = NULL;
+
+        assert_se(table = table_new("NAME", "SIZE"));
+        assert_se(table_set_align_percent(table, TABLE_HEADER_CELL(1), 100) >= 0);
+        assert_se(table_set_sort(table, (size_t) 1, (size_t) -1) >= 0);
+        assert_se(table_add_many(table,
+                                 TABLE_STRING, "b",
+                                 TABLE_UINT32, UINT32_C(20)) >= 0);
+        assert_se(table_add_many(table,
+                                 TABLE_STRING, "串串",
+                                 TABLE_UINT32, UINT32_C(3)) >= 0);
+        assert_se(table_add_many(table,
+                                 TABLE_STRING, "zażółć",
+                                 TABLE_UINT32, UINT32_C(100)) >= 0);
+
+        table_set_width(table, 12);
+        assert_se(table_format(table, &formatted) >= 0);
+
+        printf("%s\n", formatted);
+        assert_se(streq(formatted,
+                        "NAME    SIZE\n"
+                        "串串       3\n"
+                        "b         20\n"
+                        "zażółć   100\n"));
+}
+
 int main(int argc, char *argv[]) {
 
         _cleanup_(table_unrefp) Table *t = NULL;
@@ -160,6 +188,7 @@ int main(int argc, char *argv[]) {
                         "5min           5min                     \n"));
 
         test_issue_9549();
+        test_sort_and_wide();
 
         return 0;
 }
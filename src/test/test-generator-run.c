@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "generator-run.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+
+static void write_generator(const char *dir, const char *name, const char *script) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, script, WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(chmod(p, 0755) >= 0);
+}
+
+static void test_generators_run(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *root = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_free_ char *contents = NULL, *target = NULL;
+        const char *bin_lo, *bin_hi, *normal, *early, *late;
+        GeneratorTiming *t = NULL;
+        struct dirent *de;
+        size_t n = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-generator-run-XXXXXX", &root) >= 0);
+
+        bin_lo = strjoina(root, "/bin-lo");
+        bin_hi = strjoina(root, "/bin-hi");
+        normal = strjoina(root, "/normal");
+        early = strjoina(root, "/early");
+        late = strjoina(root, "/late");
+
+        assert_se(mkdir_p(bin_lo, 0755) >= 0);
+        assert_se(mkdir_p(bin_hi, 0755) >= 0);
+        assert_se(mkdir_p(normal, 0755) >= 0);
+        assert_se(mkdir_p(early, 0755) >= 0);
+        assert_se(mkdir_p(late, 0755) >= 0);
+
+        write_generator(bin_lo, "gen-a",
+                        "#!/bin/sh\n"
+                        "echo a >$1/a.service\n"
+                        "mkdir $1/multi-user.target.wants\n"
+                        "ln -s ../a.service $1/multi-user.target.wants/a.service\n"
+                        "echo abs >$1/abs.service\n"
+                        "ln -s $1/abs.service $1/multi-user.target.wants/abs.service\n"
+                        "ln -s $1/abs.service $1/alias.service\n"
+                        "ln -s /dev/null $1/masked.service\n"
+                        "echo early >$2/early.service\n");
+        write_generator(bin_lo, "gen-b",
+                        "#!/bin/sh\n"
+                        "echo b >$1/a.service\n"
+                        "mkdir $1/multi-user.target.wants\n"
+                        "ln -s ../b.service $1/multi-user.target.wants/b.service\n"
+                        "echo late >$3/late.service\n"
+                        "exit 3\n");
+        write_generator(bin_lo, "gen-slow",
+                        "#!/bin/sh\n"
+                        "echo slow >$1/slow.service\n"
+                        "exec sleep 100\n");
+        /* Overridden by the one with the same name in bin-lo */
+        write_generator(bin_hi, "gen-b", "#!/bin/sh\nexit 1\n");
+
+        assert_se(generators_run(STRV_MAKE(bin_lo, bin_hi), normal, early, late, 2 * USEC_PER_SEC, &t, &n) >= 0);
+
+        assert_se(n == 3);
+        assert_se(streq(t[0].name, "gen-a"));
+        assert_se(t[0].status == 0);
+        assert_se(streq(t[1].name, "gen-b"));
+        assert_se(t[1].status == 3);
+        assert_se(streq(t[2].name, "gen-slow"));
+        assert_se(t[2].status == -1);
+        assert_se(t[2].duration > USEC_PER_SEC);
+
+        /* The earlier generator wins a conflict, and directories are merged */
+        assert_se(read_one_line_file(strjoina(normal, "/a.service"), &contents) >= 0);
+        assert_se(streq(contents, "a"));
+        assert_se(laccess(strjoina(normal, "/multi-user.target.wants/a.service"), F_OK) >= 0);
+        assert_se(laccess(strjoina(normal, "/multi-user.target.wants/b.service"), F_OK) >= 0);
+
+        /* Absolute symlinks into the staging directory are redirected to the real one, others are left alone */
+        assert_se(readlink_malloc(strjoina(normal, "/multi-user.target.wants/abs.service"), &target) >= 0);
+        assert_se(path_equal(target, strjoina(normal, "/abs.service")));
+        target = mfree(target);
+        assert_se(readlink_malloc(strjoina(normal, "/alias.service"), &target) >= 0);
+        assert_se(path_equal(target, strjoina(normal, "/abs.service")));
+        target = mfree(target);
+        assert_se(readlink_malloc(strjoina(normal, "/masked.service"), &target) >= 0);
+        assert_se(streq(target, "/dev/null"));
+        assert_se(access(strjoina(normal, "/multi-user.target.wants/abs.service"), F_OK) >= 0);
+        assert_se(access(strjoina(early, "/early.service"), F_OK) >= 0);
+        assert_se(access(strjoina(late, "/late.service"), F_OK) >= 0);
+
+        /* The output of a generator that timed out is dropped */
+        assert_se(access(strjoina(normal, "/slow.service"), F_OK) < 0);
+
+        /* … and nothing is left of the staging directories */
+        assert_se(d = opendir(root));
+        FOREACH_DIRENT(de, d, assert_not_reached("readdir"))
+                assert_se(!startswith(de->d_name, "normal.staging-"));
+
+        generator_timings_free(t, n);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_generators_run();
+
+        return 0;
+}
@@ -265,6 +265,43 @@ static void test_hashmap_put(void) {
         hashmap_free(m);
 }
 
+static void test_hashmap_put_many(void) {
+        _cleanup_hashmap_free_ Hashmap *m = NULL;
+        const void *keys[1000];
+        void *values[1000];
+        unsigned i, n_buckets;
+
+        log_info("%s", __func__);
+
+        for (i = 0; i < ELEMENTSOF(keys); i++) {
+                keys[i] = UINT_TO_PTR(i + 1);
+                values[i] = UINT_TO_PTR(i + 2);
+        }
+
+        assert_se(m = hashmap_new(NULL));
+        assert_se(hashmap_put_many(m, NULL, NULL, 0) == 0);
+
+        /* Everything is sized in one go */
+        assert_se(hashmap_put_many(m, keys, values, ELEMENTSOF(keys)) == ELEMENTSOF(keys));
+        assert_se(hashmap_size(m) == ELEMENTSOF(keys));
+        n_buckets = hashmap_buckets(m);
+        assert_se(n_buckets >= ELEMENTSOF(keys));
+
+        for (i = 0; i < ELEMENTSOF(keys); i++)
+                assert_se(hashmap_get(m, keys[i]) == values[i]);
+
+        /* Entries that are already there with the same value are fine */
+        assert_se(hashmap_put_many(m, keys, values, 10) == 0);
+
+        /* Conflicting ones are not, but what was added before stays */
+        keys[0] = UINT_TO_PTR(ELEMENTSOF(keys) + 1);
+        keys[1] = UINT_TO_PTR(1);
+        assert_se(hashmap_put_many(m, keys, values, 2) == -EEXIST);
+        assert_se(hashmap_get(m, keys[0]) == values[0]);
+        assert_se(hashmap_get(m, keys[1]) == UINT_TO_PTR(2));
+        assert_se(hashmap_size(m) == ELEMENTSOF(keys) + 1);
+}
+
 static void test_hashmap_remove(void) {
         _cleanup_hashmap_free_ Hashmap *m = NULL;
         char *r;
@@ -901,6 +938,7 @@ void test_hashmap_funcs(void) {
         test_hashmap_replace();
         test_hashmap_update();
         test_hashmap_put();
+        test_hashmap_put_many();
         test_hashmap_remove();
         test_hashmap_remove2();
         test_hashmap_remove_value();
@@ -1,6 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
+#include "env-util.h"
 #include "hashmap.h"
+#include "log.h"
+#include "set.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
 void test_hashmap_funcs(void);
@@ -147,6 +155,141 @@ static void test_path_hashmap(void) {
         assert_se(!hashmap_get(h, "/foo////bar////quux/////"));
 }
 
+static void test_path_hash_func(void) {
+        static const uint8_t key[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+        static const char* const table[] = {
+                "/",                    "/",
+                "///",                  "/",
+                "",                     "",
+                "foo",                  "foo",
+                "foo/",                 "foo",
+                "/foo/bar",             "/foo/bar",
+                "//foo///bar//",        "/foo/bar",
+                "foo//bar/baz",         "foo/bar/baz",
+                "/sys/devices//virtual","/sys/devices/virtual",
+        };
+        unsigned i;
+
+        /* A path hashes like its normalized form */
+        for (i = 0; i < ELEMENTSOF(table); i += 2) {
+                struct siphash state;
+
+                siphash24_init(&state, key);
+                path_hash_func(table[i], &state);
+                assert_se(siphash24_finalize(&state) == siphash24(table[i+1], strlen(table[i+1]), key));
+        }
+}
+
+static void bench_log(const char *type, const char *what, unsigned n, usec_t t) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        log_info("%s %s: %u entries in %s, %.1f ns per entry",
+                 type, what, n, format_timespan(buf, sizeof(buf), t, 1), (double) t * NSEC_PER_USEC / n);
+}
+
+static void bench_hashmap(const char *type, const struct hash_ops *ops, char **keys, unsigned n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL, *g = NULL;
+        _cleanup_free_ void **values = NULL;
+        unsigned i, c = 0;
+        Iterator it;
+        usec_t t;
+        void *v;
+
+        assert_se(h = hashmap_new(ops));
+        assert_se(g = hashmap_new(ops));
+
+        assert_se(values = new(void*, n));
+        for (i = 0; i < n; i++)
+                values[i] = UINT_TO_PTR(i + 1);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_put(h, keys[i], UINT_TO_PTR(i + 1)) > 0);
+        bench_log(type, "insert", n, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(hashmap_put_many(g, (const void**) keys, values, n) == (int) n);
+        bench_log(type, "bulk insert", n, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_get(h, keys[i]) == UINT_TO_PTR(i + 1));
+        bench_log(type, "lookup", n, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        HASHMAP_FOREACH(v, h, it)
+                c++;
+        bench_log(type, "iterate", n, now(CLOCK_MONOTONIC) - t);
+        assert_se(c == n);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_remove(h, keys[i]) == UINT_TO_PTR(i + 1));
+        bench_log(type, "remove", n, now(CLOCK_MONOTONIC) - t);
+}
+
+static void test_small_set_benchmark(void) {
+        const unsigned n_sets = 100000, n_entries = 4;
+        Set **sets;
+        unsigned i, j;
+        usec_t t;
+
+        /* Like the dependency sets of units: lots of them, with a few pointers each */
+
+        assert_se(sets = new0(Set*, n_sets));
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n_sets; i++) {
+                assert_se(set_ensure_allocated(&sets[i], NULL) >= 0);
+
+                for (j = 0; j < n_entries; j++)
+                        assert_se(set_put(sets[i], sets + i + j) > 0);
+        }
+        bench_log("small set", "insert", n_sets * n_entries, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n_sets; i++)
+                for (j = 0; j < n_entries; j++)
+                        assert_se(set_contains(sets[i], sets + i + j));
+        bench_log("small set", "lookup", n_sets * n_entries, now(CLOCK_MONOTONIC) - t);
+
+        for (i = 0; i < n_sets; i++)
+                set_free(sets[i]);
+        free(sets);
+}
+
+static void test_hashmap_benchmark(void) {
+        unsigned n, max;
+        int r;
+
+        /* Not a test as such, but shows how long the common operations take for the hash functions used
+         * most, i.e. for unit names, paths and pointers */
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        max = (r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT) ? 10000000 : 100000;
+
+        for (n = 1000; n <= max; n *= 10) {
+                _cleanup_strv_free_ char **names = NULL, **paths = NULL;
+                char **ptrs;
+                unsigned i;
+
+                assert_se(names = new0(char*, n + 1));
+                assert_se(paths = new0(char*, n + 1));
+
+                for (i = 0; i < n; i++) {
+                        assert_se(asprintf(&names[i], "systemd-benchmark-%u.service", i) >= 0);
+                        assert_se(asprintf(&paths[i], "/sys/devices/virtual/benchmark/bench%u/uevent", i) >= 0);
+                }
+
+                /* The pointers are the names themselves */
+                ptrs = names;
+
+                bench_hashmap("string", &string_hash_ops, names, n);
+                bench_hashmap("path", &path_hash_ops, paths, n);
+                bench_hashmap("trivial", &trivial_hash_ops, ptrs, n);
+        }
+}
+
 int main(int argc, const char *argv[]) {
         test_hashmap_funcs();
         test_ordered_hashmap_funcs();
@@ -158,6 +301,9 @@ int main(int argc, const char *argv[]) {
         test_string_compare_func();
         test_iterated_cache();
         test_path_hashmap();
+        test_path_hash_func();
+        test_hashmap_benchmark();
+        test_small_set_benchmark();
 
         return 0;
 }
@@ -1040,6 +1040,34 @@ static void test_preset_multiple_instances(const char *root) {
         unit_file_changes_free(changes, n_changes);
 }
 
+static void test_list_matches_state(const char *root) {
+        UnitFileList *fl;
+        UnitFileState state;
+        unsigned n = 0;
+        Hashmap *h;
+        Iterator j;
+
+        /* unit_file_get_list() uses a symlink index built once for all unit files, make sure it comes to the same
+         * conclusions as looking at every unit file individually does, for everything the other tests left
+         * behind */
+
+        assert_se(h = hashmap_new(&string_hash_ops));
+        assert_se(unit_file_get_list(UNIT_FILE_SYSTEM, root, h, NULL, NULL) >= 0);
+
+        HASHMAP_FOREACH(fl, h, j) {
+                if (unit_file_get_state(UNIT_FILE_SYSTEM, root, basename(fl->path), &state) < 0)
+                        state = UNIT_FILE_BAD;
+
+                log_debug("%s: %s", fl->path, unit_file_state_to_string(fl->state));
+                assert_se(fl->state == state);
+                n++;
+        }
+
+        assert_se(n > 0);
+
+        unit_file_list_free(h);
+}
+
 int main(int argc, char *argv[]) {
         char root[] = "/tmp/rootXXXXXX";
         const char *p;
@@ -1074,6 +1102,7 @@ int main(int argc, char *argv[]) {
         test_static_instance(root);
         test_with_dropin(root);
         test_with_dropin_template(root);
+        test_list_matches_state(root);
 
         assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
@@ -4,6 +4,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "fd-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "journal-importer.h"
 #include "string-util.h"
@@ -62,12 +64,51 @@ static void test_bad_input(void) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static void test_multiple_entries(void) {
+        static const char data[] =
+                "__REALTIME_TIMESTAMP=1478389147837945\n"
+                "MESSAGE=first\n"
+                "BINARY\n"
+                "\003\0\0\0\0\0\0\0a\nb\n"
+                "\n"
+                "MESSAGE=second\n"
+                "\n";
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = {};
+        int pipefd[2];
+        struct iovec *iovec;
+
+        assert_se(pipe2(pipefd, O_CLOEXEC) >= 0);
+        assert_se(loop_write(pipefd[1], data, sizeof(data) - 1, false) >= 0);
+        safe_close(pipefd[1]);
+        imp.fd = pipefd[0];
+
+        /* Each call returns a complete entry, without stopping in between fields */
+        assert_se(journal_importer_process_data(&imp) == 1);
+        assert_se(imp.ts.realtime == 1478389147837945);
+        assert_se(imp.iovw.count == 2);
+        assert_iovec_entry(&imp.iovw.iovec[0], "MESSAGE=first");
+        assert_iovec_entry(&imp.iovw.iovec[1], "BINARY=a\nb");
+        iovec = imp.iovw.iovec;
+        journal_importer_drop_iovw(&imp);
+
+        /* The iovec array is reused for the next entry */
+        assert_se(journal_importer_process_data(&imp) == 1);
+        assert_se(imp.iovw.iovec == iovec);
+        assert_se(imp.iovw.count == 1);
+        assert_iovec_entry(&imp.iovw.iovec[0], "MESSAGE=second");
+        journal_importer_drop_iovw(&imp);
+
+        assert_se(journal_importer_process_data(&imp) == 0);
+        assert_se(journal_importer_eof(&imp));
+}
+
 int main(int argc, char **argv) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
 
         test_basic_parsing();
         test_bad_input();
+        test_multiple_entries();
 
         return 0;
 }
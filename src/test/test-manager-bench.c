@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-util.h"
+#include "dbus.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit.h"
+
+/* Measures the throughput of the hot paths of the service manager with a large number of synthesized units, so
+ * that regressions show up before they hit a machine with tens of thousands of units. Pass the number of units as
+ * argument to run it with a different size than the default. */
+
+static unsigned n_units = 1000;
+
+static void log_elapsed(const char *what, unsigned n, usec_t start) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC) - start;
+        log_info("%-12s %6u in %10s (%.0f/s)", what, n, format_timespan(ts, sizeof(ts), t, 1),
+                 t > 0 ? (double) n * USEC_PER_SEC / t : 0.0);
+}
+
+static void write_units(const char *dir, unsigned n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        /* A target pulling in n services, which are ordered in a tree among each other */
+
+        assert_se(f = fopen(strjoina(dir, "/bench.target"), "we"));
+        fputs("[Unit]\n", f);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *p = NULL, *contents = NULL;
+
+                assert_se(asprintf(&p, "%s/bench-%u.service", dir, i) >= 0);
+                if (i == 0)
+                        assert_se(contents = strdup("[Service]\n"
+                                                    "ExecStart=/bin/true\n"));
+                else
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\n"
+                                           "After=bench-%u.service\n"
+                                           "[Service]\n"
+                                           "ExecStart=/bin/true\n",
+                                           i / 2) >= 0);
+                assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+                fprintf(f, "Wants=bench-%u.service\n", i);
+        }
+
+        assert_se(fflush_and_check(f) >= 0);
+}
+
+static void bench_load(Manager *m, Unit **ret) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_startable_unit_or_warn(m, "bench.target", NULL, ret) >= 0);
+        log_elapsed("load", hashmap_size(m->units), t);
+}
+
+static void bench_transaction(Manager *m, Unit *u) {
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, &err, NULL) >= 0);
+        log_elapsed("transaction", hashmap_size(m->jobs), t);
+
+        manager_clear_jobs(m);
+}
+
+static void bench_serialize(Manager *m) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t t;
+
+        assert_se(fds = fdset_new());
+        assert_se(manager_open_serialization(m, &f) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        log_elapsed("serialize", hashmap_size(m->units), t);
+
+        assert_se(fseeko(f, 0, SEEK_SET) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_deserialize(m, f, fds) >= 0);
+        log_elapsed("deserialize", hashmap_size(m->units), t);
+}
+
+static int count_message(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void bench_dbus_queue(Manager *m) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL;
+        int pair[2] = { -1, -1 };
+        unsigned n = 0, n_received = 0;
+        uint64_t q;
+        sd_id128_t id;
+        Iterator i;
+        usec_t t;
+        Unit *u;
+
+        /* Hook up a direct connection the way a "systemctl" client would, so that change signals are actually
+         * generated and written, and drain it from the same event loop. */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&server) >= 0);
+        assert_se(sd_bus_set_fd(server, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(server, 1, id) >= 0);
+        assert_se(sd_bus_set_sender(server, "org.freedesktop.systemd1") >= 0);
+        assert_se(sd_bus_start(server) >= 0);
+
+        assert_se(sd_bus_new(&client) >= 0);
+        assert_se(sd_bus_set_fd(client, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_add_filter(client, NULL, count_message, &n_received) >= 0);
+        assert_se(sd_bus_start(client) >= 0);
+
+        /* The client pipelines the whole authentication and then stays silent, hence drive both ends manually
+         * until they are through with it, the event loop would not wake up the server for the final step */
+        while (sd_bus_is_ready(server) <= 0 || sd_bus_is_ready(client) <= 0) {
+                assert_se(sd_bus_process(server, NULL) >= 0);
+                assert_se(sd_bus_process(client, NULL) >= 0);
+        }
+
+        assert_se(bus_setup_api_vtables(m, server) >= 0);
+        assert_se(sd_bus_attach_event(server, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_attach_event(client, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        assert_se(set_ensure_allocated(&m->private_buses, NULL) >= 0);
+        assert_se(set_put(m->private_buses, server) >= 0);
+
+        HASHMAP_FOREACH(u, m->units, i)
+                if (!u->in_dbus_queue) {
+                        unit_add_to_dbus_queue(u);
+                        n++;
+                }
+
+        t = now(CLOCK_MONOTONIC);
+        for (;;) {
+                (void) manager_dispatch_dbus_queue(m);
+                assert_se(sd_event_run(m->event, USEC_PER_SEC) >= 0);
+
+                assert_se(sd_bus_get_n_queued_write(server, &q) >= 0);
+                if (!m->dbus_unit_queue && q == 0)
+                        break;
+        }
+
+        /* Whatever is still in flight sits in the socket buffer, pick that up too */
+        while (sd_bus_process(client, NULL) > 0)
+                ;
+        log_elapsed("dbus queue", n, t);
+        log_info("%u messages received", n_received);
+
+        assert_se(set_remove(m->private_buses, server) == server);
+}
+
+static void bench_gc(Manager *m) {
+        unsigned n = 0;
+        Iterator i;
+        usec_t t;
+        Unit *u;
+
+        /* Nothing references the units anymore at this point, hence this sweeps and collects all of them */
+
+        HASHMAP_FOREACH(u, m->units, i)
+                unit_add_to_gc_queue(u);
+
+        t = now(CLOCK_MONOTONIC);
+        n = manager_dispatch_gc_unit_queue(m);
+        log_elapsed("gc sweep", n, t);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *u = NULL;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n_units) >= 0);
+        else {
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                if (r > 0 || (r < 0 && SYSTEMD_SLOW_TESTS_DEFAULT))
+                        n_units = 20000;
+        }
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-manager-bench-XXXXXX", &unit_dir) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+        write_units(unit_dir, n_units);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        bench_load(m, &u);
+        bench_transaction(m, u);
+        bench_serialize(m);
+        bench_dbus_queue(m);
+        bench_gc(m);
+
+        return 0;
+}
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "manager.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "socket.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+static void write_file(const char *dir, const char *name, const char *contents) {
+        assert_se(write_string_file(strjoina(dir, "/", name), contents,
+                                    WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+}
+
+static bool has_dependency(Unit *u, UnitDependency d, Unit *other, UnitDependencyMask mask) {
+        UnitDependencyInfo di;
+
+        di.data = hashmap_get(u->dependencies[d], other);
+        if (!di.data)
+                return false;
+
+        /* The reverse dependency carries the mask as destination mask */
+        return ((di.origin_mask | di.destination_mask) & mask) == mask;
+}
+
+static void test_reload_incremental(const char *unit_dir, const char *data_dir) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c, *d, *e, *s, *t, *x, *y, *u;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        write_file(unit_dir, "a.service", "[Service]\nExecStart=/bin/true\n");
+        write_file(unit_dir, "b.service", "[Unit]\nDescription=B\n[Service]\nExecStart=/bin/true\n");
+        write_file(unit_dir, "c.service", "[Unit]\nWants=b.service\nAfter=b.service\n[Service]\nExecStart=/bin/true\n");
+        write_file(unit_dir, "d.service", "[Service]\nExecStart=/bin/true\n");
+        write_file(unit_dir, "s.socket", "[Socket]\nListenFIFO=/tmp/test-manager-reload.fifo\nService=b.service\n");
+        write_file(unit_dir, "t.target", "[Unit]\nDescription=T\n");
+        assert_se(mkdir(strjoina(unit_dir, "/t.target.wants"), 0755) >= 0);
+        assert_se(symlink(strjoina(unit_dir, "/a.service"), strjoina(unit_dir, "/t.target.wants/a.service")) >= 0);
+        write_file(data_dir, "x.service", "[Unit]\nDescription=X\n[Service]\nExecStart=/bin/true\n");
+        write_file(data_dir, "y.service", "[Unit]\nDescription=Y\n[Service]\nExecStart=/bin/true\n");
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC|MANAGER_TEST_RUN_GENERATORS, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        /* In test mode the generators write into a temporary directory on startup, a reload switches over to the
+         * one in the runtime directory, which is in our search path */
+        assert_se(manager_reload(m) >= 0);
+
+        assert_se(manager_load_unit(m, "a.service", NULL, NULL, &a) >= 0);
+        assert_se(manager_load_unit(m, "b.service", NULL, NULL, &b) >= 0);
+        assert_se(manager_load_unit(m, "c.service", NULL, NULL, &c) >= 0);
+        assert_se(manager_load_unit(m, "d.service", NULL, NULL, &d) >= 0);
+        assert_se(manager_load_unit(m, "e.service", NULL, NULL, &e) >= 0);
+        assert_se(manager_load_unit(m, "s.socket", NULL, NULL, &s) >= 0);
+        assert_se(manager_load_unit(m, "t.target", NULL, NULL, &t) >= 0);
+        assert_se(manager_load_unit(m, "x.service", NULL, NULL, &x) >= 0);
+        assert_se(manager_load_unit(m, "y.service", NULL, NULL, &y) >= 0);
+
+        assert_se(a->load_state == UNIT_LOADED);
+        assert_se(d->load_state == UNIT_LOADED);
+        assert_se(e->load_state == UNIT_NOT_FOUND);
+        assert_se(x->load_state == UNIT_LOADED);
+        assert_se(streq(y->description, "Y"));
+        assert_se(UNIT_DEREF(SOCKET(s)->service) == b);
+        assert_se(has_dependency(t, UNIT_WANTS, a, UNIT_DEPENDENCY_FILE));
+
+        /* A dependency on the changed unit that doesn't come from any configuration */
+        assert_se(unit_add_dependency(b, UNIT_BEFORE, a, true, UNIT_DEPENDENCY_UDEV) >= 0);
+
+        /* b.service changes, d.service goes away, e.service shows up, and of the generated units only y.service
+         * changes, even though the generator writes both of them again */
+        write_file(unit_dir, "b.service", "[Unit]\nDescription=B2\n[Service]\nExecStart=/bin/true\n");
+        assert_se(unlink(strjoina(unit_dir, "/d.service")) >= 0);
+        write_file(unit_dir, "e.service", "[Service]\nExecStart=/bin/true\n");
+        write_file(data_dir, "y.service", "[Unit]\nDescription=Y2\n[Service]\nExecStart=/bin/true\n");
+
+        /* t.target's .wants/ directory changes, as on "systemctl disable a.service" and "systemctl enable
+         * c.service", while t.target itself doesn't */
+        assert_se(unlink(strjoina(unit_dir, "/t.target.wants/a.service")) >= 0);
+        assert_se(symlink(strjoina(unit_dir, "/c.service"), strjoina(unit_dir, "/t.target.wants/c.service")) >= 0);
+
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(!MANAGER_IS_RELOADING(m));
+        assert_se(m->send_reloading_done);
+
+        /* Unchanged units are left alone */
+        assert_se(manager_get_unit(m, "a.service") == a);
+        assert_se(manager_get_unit(m, "c.service") == c);
+        assert_se(manager_get_unit(m, "s.socket") == s);
+        assert_se(manager_get_unit(m, "x.service") == x);
+        assert_se(!unit_need_daemon_reload(x));
+
+        /* Changed, added and removed units are loaded again */
+        assert_se(b = manager_get_unit(m, "b.service"));
+        assert_se(streq(b->description, "B2"));
+        assert_se(b->load_state == UNIT_LOADED);
+        assert_se(!unit_need_daemon_reload(b));
+
+        assert_se(e = manager_get_unit(m, "e.service"));
+        assert_se(e->load_state == UNIT_LOADED);
+
+        u = manager_get_unit(m, "d.service");
+        assert_se(!u || u->load_state == UNIT_NOT_FOUND);
+
+        assert_se(y = manager_get_unit(m, "y.service"));
+        assert_se(streq(y->description, "Y2"));
+
+        /* Dependencies on and of the reloaded unit are restored, whether configured by the reloaded unit, an
+         * unchanged one, or no configuration at all */
+        assert_se(has_dependency(c, UNIT_WANTS, b, UNIT_DEPENDENCY_FILE));
+        assert_se(has_dependency(b, UNIT_WANTED_BY, c, UNIT_DEPENDENCY_FILE));
+        assert_se(has_dependency(c, UNIT_AFTER, b, UNIT_DEPENDENCY_FILE));
+        assert_se(has_dependency(b, UNIT_BEFORE, c, UNIT_DEPENDENCY_FILE));
+        assert_se(has_dependency(b, UNIT_BEFORE, a, UNIT_DEPENDENCY_UDEV));
+        assert_se(has_dependency(a, UNIT_AFTER, b, UNIT_DEPENDENCY_UDEV));
+        assert_se(has_dependency(s, UNIT_TRIGGERS, b, 0));
+        assert_se(has_dependency(b, UNIT_TRIGGERED_BY, s, 0));
+
+        /* … and so are references to it */
+        assert_se(UNIT_DEREF(SOCKET(s)->service) == b);
+
+        /* The unit whose .wants/ directory changed is loaded again, with the new dependencies only */
+        assert_se(t = manager_get_unit(m, "t.target"));
+        assert_se(has_dependency(t, UNIT_WANTS, c, UNIT_DEPENDENCY_FILE));
+        assert_se(has_dependency(c, UNIT_WANTED_BY, t, UNIT_DEPENDENCY_FILE));
+        assert_se(!has_dependency(t, UNIT_WANTS, a, 0));
+        assert_se(!has_dependency(a, UNIT_WANTED_BY, t, 0));
+
+        /* Nothing changed, hence nothing is loaded again */
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(manager_get_unit(m, "b.service") == b);
+        assert_se(manager_get_unit(m, "y.service") == y);
+        assert_se(manager_get_unit(m, "t.target") == t);
+        assert_se(!unit_need_daemon_reload(y));
+}
+
+static void test_reload_transient(void) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_free_ char *path = NULL;
+        Unit *u;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        /* Switch over from the temporary directories of the test mode, see above */
+        assert_se(manager_reload(m) >= 0);
+
+        assert_se(manager_load_unit_prepare(m, "transient.slice", NULL, NULL, &u) >= 0);
+        assert_se(unit_make_transient(u) >= 0);
+        assert_se(unit_write_setting(u, UNIT_RUNTIME, "Description", "Description=Transient") >= 0);
+        unit_add_to_load_queue(u);
+        manager_dispatch_load_queue(m);
+
+        /* The unit file is not written right-away, but install.c is told about it all the same */
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(path = strdup(u->fragment_path));
+        assert_se(access(path, F_OK) < 0 && errno == ENOENT);
+        assert_se(unit_get_unit_file_state(u) == UNIT_FILE_TRANSIENT);
+        assert_se(u->in_transient_write_queue);
+
+        /* A reload loads the unit from disk again, hence writes it out first */
+        assert_se(manager_reload(m) >= 0);
+        assert_se(access(path, F_OK) >= 0);
+
+        assert_se(u = manager_get_unit(m, "transient.slice"));
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(u->transient);
+        assert_se(streq(u->description, "Transient"));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *dir = NULL;
+        const char *unit_dir, *generator_dir, *data_dir, *unit_path;
+        int r;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-manager-reload-XXXXXX", &dir) >= 0);
+
+        unit_dir = strjoina(dir, "/units");
+        generator_dir = strjoina(dir, "/generators");
+        data_dir = strjoina(dir, "/data");
+        assert_se(mkdir_p(unit_dir, 0755) >= 0);
+        assert_se(mkdir_p(generator_dir, 0755) >= 0);
+        assert_se(mkdir_p(data_dir, 0755) >= 0);
+
+        /* A generator that copies whatever we put into the data directory */
+        write_file(generator_dir, "copy", strjoina("#!/bin/sh\ncp ", data_dir, "/x.service ", data_dir, "/y.service $1/\n"));
+        assert_se(chmod(strjoina(generator_dir, "/copy"), 0755) >= 0);
+        assert_se(setenv("SYSTEMD_GENERATOR_PATH", generator_dir, 1) >= 0);
+
+        unit_path = strjoina(unit_dir, ":", runtime_dir, "/systemd/generator", ":", runtime_dir, "/systemd/transient");
+        assert_se(setenv("SYSTEMD_UNIT_PATH", unit_path, 1) >= 0);
+
+        test_reload_incremental(unit_dir, data_dir);
+        test_reload_transient();
+
+        return 0;
+}
@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "mempool.h"
+#include "set.h"
+#include "util.h"
+
+struct tile {
+        uint64_t a, b, c;
+};
+
+DEFINE_THREADED_MEMPOOL(test_pool, struct tile, 4);
+
+#define N_THREADS 4
+#define N_TILES 10000
+
+static struct tile *tiles[N_THREADS][N_TILES];
+static pthread_barrier_t barrier;
+
+static void test_local(void) {
+        struct tile *t, *u;
+
+        t = threaded_mempool_alloc0_tile(&test_pool);
+        assert_se(t);
+        assert_se(t->a == 0 && t->b == 0 && t->c == 0);
+        t->a = 1;
+
+        threaded_mempool_free_tile(&test_pool, t);
+        threaded_mempool_free_tile(&test_pool, NULL);
+
+        /* Freed tiles are recycled right away */
+        u = threaded_mempool_alloc0_tile(&test_pool);
+        assert_se(u);
+        if (mempool_enabled())
+                assert_se(u == t);
+        assert_se(u->a == 0);
+
+        threaded_mempool_free_tile(&test_pool, u);
+}
+
+static void *free_thread(void *p) {
+        threaded_mempool_free_tile(&test_pool, p);
+        return NULL;
+}
+
+static void test_remote_free(void) {
+        struct tile *t, *u;
+        pthread_t thread;
+
+        if (!mempool_enabled())
+                return;
+
+        /* Drain the local free list, so that the tile freed by the other thread is picked up next */
+        u = threaded_mempool_alloc_tile(&test_pool);
+        assert_se(u);
+
+        t = threaded_mempool_alloc_tile(&test_pool);
+        assert_se(t);
+
+        assert_se(pthread_create(&thread, NULL, free_thread, t) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        assert_se(threaded_mempool_alloc_tile(&test_pool) == t);
+
+        threaded_mempool_free_tile(&test_pool, t);
+        threaded_mempool_free_tile(&test_pool, u);
+}
+
+static void *alloc_thread(void *p) {
+        struct tile **l = p;
+        unsigned i;
+
+        for (i = 0; i < N_TILES; i++) {
+                l[i] = threaded_mempool_alloc_tile(&test_pool);
+                assert_se(l[i]);
+                l[i]->a = i;
+        }
+
+        return NULL;
+}
+
+static void test_orphans(void) {
+        _cleanup_set_free_ Set *s = NULL;
+        pthread_t thread;
+        unsigned i, n = 0;
+
+        /* The tiles outlive the thread which allocated them. Free them here, and let another thread
+         * inherit the cache and recycle them. */
+
+        assert_se(pthread_create(&thread, NULL, alloc_thread, tiles[0]) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        assert_se(s = set_new(NULL));
+        for (i = 0; i < N_TILES; i++) {
+                assert_se(tiles[0][i]->a == i);
+                assert_se(set_put(s, tiles[0][i]) > 0);
+                threaded_mempool_free_tile(&test_pool, tiles[0][i]);
+        }
+
+        assert_se(pthread_create(&thread, NULL, alloc_thread, tiles[1]) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        for (i = 0; i < N_TILES; i++) {
+                if (set_contains(s, tiles[1][i]))
+                        n++;
+                threaded_mempool_free_tile(&test_pool, tiles[1][i]);
+        }
+
+        if (mempool_enabled())
+                assert_se(n == N_TILES);
+}
+
+static void *shuffle_thread(void *p) {
+        unsigned k = PTR_TO_UINT(p), round, i;
+
+        for (round = 0; round < 10; round++) {
+                alloc_thread(tiles[k]);
+                pthread_barrier_wait(&barrier);
+
+                /* Free the tiles of the next thread, while it frees the ones of the thread after it */
+                for (i = 0; i < N_TILES; i++) {
+                        struct tile *t = tiles[(k + 1) % N_THREADS][i];
+
+                        assert_se(t->a == i);
+                        threaded_mempool_free_tile(&test_pool, t);
+                }
+                pthread_barrier_wait(&barrier);
+        }
+
+        return NULL;
+}
+
+static void test_shuffle(void) {
+        pthread_t threads[N_THREADS];
+        unsigned k;
+
+        assert_se(pthread_barrier_init(&barrier, NULL, N_THREADS) == 0);
+
+        for (k = 0; k < N_THREADS; k++)
+                assert_se(pthread_create(threads + k, NULL, shuffle_thread, UINT_TO_PTR(k)) == 0);
+        for (k = 0; k < N_THREADS; k++)
+                assert_se(pthread_join(threads[k], NULL) == 0);
+
+        assert_se(pthread_barrier_destroy(&barrier) == 0);
+}
+
+static void *hashmap_thread(void *p) {
+        Hashmap **h = p;
+
+        assert_se(*h = hashmap_new(NULL));
+        assert_se(hashmap_put(*h, UINT_TO_PTR(1), UINT_TO_PTR(2)) > 0);
+
+        return NULL;
+}
+
+static void test_hashmap_migrate(void) {
+        Hashmap *h = NULL;
+        pthread_t thread;
+
+        /* Hashmaps may be freed by a different thread than the one which allocated them */
+        assert_se(pthread_create(&thread, NULL, hashmap_thread, &h) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        assert_se(hashmap_get(h, UINT_TO_PTR(1)) == UINT_TO_PTR(2));
+        hashmap_free(h);
+}
+
+static void *exit_thread(void *p) {
+        struct tile *t;
+
+        t = threaded_mempool_alloc_tile(&test_pool);
+        assert_se(t);
+        threaded_mempool_free_tile(&test_pool, t);
+
+        return NULL;
+}
+
+static void test_shutdown(void) {
+        struct tile *t, *u;
+        pthread_t thread;
+
+        /* One tile remains in use over the shutdown, hence its cache has to stay around */
+        t = threaded_mempool_alloc_tile(&test_pool);
+        assert_se(t);
+        t->a = 42;
+
+        threaded_mempool_shutdown();
+        assert_se(!test_pool.key_allocated);
+
+        /* Threads exiting don't call into the pool anymore, and a new key is allocated on demand */
+        assert_se(pthread_create(&thread, NULL, exit_thread, NULL) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        u = threaded_mempool_alloc_tile(&test_pool);
+        assert_se(u);
+        if (mempool_enabled())
+                assert_se(test_pool.key_allocated);
+
+        assert_se(t->a == 42);
+        threaded_mempool_free_tile(&test_pool, t);
+        threaded_mempool_free_tile(&test_pool, u);
+
+        threaded_mempool_shutdown();
+}
+
+int main(int argc, char *argv[]) {
+        test_local();
+        test_remote_free();
+        test_orphans();
+        test_shuffle();
+        test_hashmap_migrate();
+        test_shutdown();
+
+        threaded_mempool_drop(&test_pool);
+
+        return 0;
+}
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <sys/mount.h>
+#include <sys/statvfs.h>
 
 #include "alloc-util.h"
 #include "def.h"
@@ -11,6 +12,7 @@
 #include "log.h"
 #include "mount-util.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "rm-rf.h"
 #include "string-util.h"
 
@@ -293,6 +295,62 @@ static void test_mount_option_mangle(void) {
         assert_se(mount_option_mangle("rw,relatime,fmask=0022,dmask=0022,\"hogehoge", MS_RDONLY, &f, &opts) < 0);
 }
 
+static bool path_is_read_only(const char *p) {
+        struct statvfs st;
+
+        assert_se(statvfs(p, &st) >= 0);
+        return st.f_flag & ST_RDONLY;
+}
+
+static void test_bind_remount_recursive(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        const char *sub, *subsub, *blacklisted;
+        char *blacklist[2] = {};
+        int r;
+
+        if (geteuid() != 0)
+                return;
+
+        assert_se(mkdtemp_malloc("/tmp/test-bind-remount-recursive-XXXXXX", &tmp) >= 0);
+
+        r = safe_fork("(bind-remount)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG|FORK_WAIT|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                /* A tree of mounts, where the top-level directory is not a mount point itself */
+                sub = strjoina(tmp, "/sub");
+                subsub = strjoina(tmp, "/sub/sub");
+                blacklisted = strjoina(tmp, "/blacklisted");
+
+                assert_se(mkdir(sub, 0755) >= 0);
+                assert_se(mount("tmpfs", sub, "tmpfs", 0, NULL) >= 0);
+                assert_se(mkdir(subsub, 0755) >= 0);
+                assert_se(mount("tmpfs", subsub, "tmpfs", 0, NULL) >= 0);
+                assert_se(mkdir(blacklisted, 0755) >= 0);
+                assert_se(mount("tmpfs", blacklisted, "tmpfs", 0, NULL) >= 0);
+
+                blacklist[0] = (char*) blacklisted;
+
+                assert_se(bind_remount_recursive(tmp, true, blacklist) >= 0);
+                assert_se(path_is_read_only(tmp));
+                assert_se(path_is_read_only(sub));
+                assert_se(path_is_read_only(subsub));
+                assert_se(!path_is_read_only(blacklisted));
+
+                /* Now, the top-level directory is a mount point already */
+                assert_se(bind_remount_recursive(tmp, false, NULL) >= 0);
+                assert_se(!path_is_read_only(tmp));
+                assert_se(!path_is_read_only(sub));
+                assert_se(!path_is_read_only(subsub));
+
+                assert_se(bind_remount_recursive(sub, true, NULL) >= 0);
+                assert_se(!path_is_read_only(tmp));
+                assert_se(path_is_read_only(sub));
+                assert_se(path_is_read_only(subsub));
+
+                _exit(EXIT_SUCCESS);
+        }
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -308,6 +366,7 @@ int main(int argc, char *argv[]) {
         test_mnt_id();
         test_path_is_mount_point();
         test_mount_option_mangle();
+        test_bind_remount_recursive();
 
         return 0;
 }
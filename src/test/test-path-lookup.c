@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 
+#include "fileio.h"
 #include "log.h"
 #include "path-lookup.h"
 #include "rm-rf.h"
@@ -34,6 +35,37 @@ static void test_paths(UnitFileScope scope) {
         assert_se(rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 }
 
+static void test_unit_path_cache(void) {
+        char template[] = "/tmp/test-path-lookup.XXXXXXX";
+        _cleanup_(lookup_paths_free) LookupPaths lp = {};
+        _cleanup_set_free_free_ Set *cache = NULL;
+        const char *a, *b;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(template));
+
+        a = strjoina(template, "/a");
+        b = strjoina(template, "/b");
+        assert_se(mkdir(a, 0755) >= 0);
+
+        assert_se(write_string_file(strjoina(a, "/foo.service"), "", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(mkdir(strjoina(a, "/foo.service.d"), 0755) >= 0);
+
+        /* The second directory doesn't exist, which is fine */
+        assert_se(setenv("SYSTEMD_UNIT_PATH", strjoina(a, ":", b), 1) == 0);
+        assert_se(lookup_paths_init(&lp, UNIT_FILE_SYSTEM, 0, NULL) == 0);
+        assert_se(lookup_paths_build_unit_path_cache(&lp, &cache) >= 0);
+
+        assert_se(set_size(cache) == 2);
+        assert_se(set_contains(cache, strjoina(a, "/foo.service")));
+        assert_se(set_contains(cache, strjoina(a, "/foo.service.d")));
+        assert_se(!set_contains(cache, strjoina(b, "/foo.service")));
+
+        assert_se(unsetenv("SYSTEMD_UNIT_PATH") == 0);
+        assert_se(rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 static void test_user_and_global_paths(void) {
         _cleanup_(lookup_paths_free) LookupPaths lp_global = {}, lp_user = {};
         char **u, **g, **p;
@@ -84,6 +116,7 @@ int main(int argc, char **argv) {
         test_paths(UNIT_FILE_USER);
         test_paths(UNIT_FILE_GLOBAL);
 
+        test_unit_path_cache();
         test_user_and_global_paths();
 
         print_generator_binary_paths(UNIT_FILE_SYSTEM);
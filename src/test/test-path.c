@@ -209,6 +209,35 @@ static void test_path_directorynotempty(Manager *m) {
         check_stop_unlink(m, unit, test_path, NULL);
 }
 
+static void test_path_shared_watches(Manager *m) {
+        const char *test_path = "/tmp/test-path_exists";
+        Unit *exists = NULL, *changed = NULL;
+
+        assert_se(m);
+
+        assert_se(touch("/tmp/test-path_changed") >= 0);
+
+        assert_se(manager_load_startable_unit_or_warn(m, "path-exists.path", NULL, &exists) >= 0);
+        assert_se(manager_load_startable_unit_or_warn(m, "path-changed.path", NULL, &changed) >= 0);
+        assert_se(UNIT_VTABLE(exists)->start(exists) >= 0);
+        assert_se(UNIT_VTABLE(changed)->start(changed) >= 0);
+
+        /* Both units watch / and /tmp, and those watches are shared, only the changed file gets its own */
+        assert_se(PATH(exists)->specs->n_watches == 2);
+        assert_se(PATH(changed)->specs->n_watches == 3);
+        assert_se(hashmap_size(m->path_inotify_watches) == 3);
+
+        /* Creating the file in /tmp only wakes up the unit interested in it */
+        assert_se(touch(test_path) >= 0);
+        check_stop_unlink(m, exists, test_path, NULL);
+
+        assert_se(!PATH(changed)->inotify_triggered);
+        assert_se(PATH(changed)->state == PATH_WAITING);
+
+        assert_se(UNIT_VTABLE(changed)->stop(changed) >= 0);
+        (void) rm_rf("/tmp/test-path_changed", REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_path_makedirectory_directorymode(Manager *m) {
         const char *test_path = "/tmp/test-path_makedirectory/";
         Unit *unit = NULL;
@@ -242,6 +271,7 @@ int main(int argc, char *argv[]) {
                 test_path_modified,
                 test_path_unit,
                 test_path_directorynotempty,
+                test_path_shared_watches,
                 test_path_makedirectory_directorymode,
                 NULL,
         };
@@ -32,6 +32,7 @@ static void test_get_process_comm(pid_t pid) {
         _cleanup_free_ char *a = NULL, *c = NULL, *d = NULL, *f = NULL, *i = NULL;
         _cleanup_free_ char *env = NULL;
         char path[STRLEN("/proc//comm") + DECIMAL_STR_MAX(pid_t)];
+        unsigned long long t;
         pid_t e;
         uid_t u;
         gid_t g;
@@ -60,6 +61,9 @@ static void test_get_process_comm(pid_t pid) {
         log_info("PID"PID_FMT" PPID: "PID_FMT, pid, e);
         assert_se(pid == 1 ? e == 0 : e > 0);
 
+        assert_se(get_process_starttime(pid, &t) >= 0);
+        log_info("PID"PID_FMT" start time: %llu", pid, t);
+
         assert_se(is_kernel_thread(pid) == 0 || pid != 1);
 
         r = get_process_exe(pid, &f);
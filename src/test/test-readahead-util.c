@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "readahead-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+
+static void test_pack_roundtrip(const char *dir) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL, *q = NULL;
+        const char *fn;
+        struct stat st;
+
+        fn = strjoina(dir, "/pack");
+
+        assert_se(p = new0(ReadaheadPack, 1));
+        p->rotational = true;
+        p->done_usec = 4711;
+
+        assert_se(readahead_pack_add(p, "/usr/lib/libfoo.so", 300, 8192) >= 0);
+        assert_se(readahead_pack_add(p, "/usr/bin/with space", 100, 4096) >= 0);
+        assert_se(readahead_pack_add(p, "/etc/new\nline", 200, 0) >= 0);
+        assert_se(readahead_pack_add(p, "/etc/a", 200, 1) >= 0);
+        assert_se(readahead_pack_bytes(p) == 8192 + 4096 + 1);
+
+        /* Rotating media are read in physical order */
+        readahead_pack_sort(p);
+        assert_se(streq(p->entries[0].path, "/usr/bin/with space"));
+        assert_se(streq(p->entries[1].path, "/etc/a"));
+        assert_se(streq(p->entries[2].path, "/etc/new\nline"));
+        assert_se(streq(p->entries[3].path, "/usr/lib/libfoo.so"));
+
+        assert_se(readahead_pack_save(fn, p) >= 0);
+        assert_se(stat(fn, &st) >= 0);
+        assert_se((st.st_mode & 07777) == 0600);
+        assert_se(readahead_pack_load(fn, &q) >= 0);
+
+        assert_se(q->rotational);
+        assert_se(q->done_usec == 4711);
+        assert_se(q->mtime > 0);
+        assert_se(q->n_entries == 4);
+        assert_se(streq(q->entries[0].path, "/usr/bin/with space"));
+        assert_se(q->entries[0].block == 100);
+        assert_se(q->entries[0].length == 4096);
+        assert_se(streq(q->entries[2].path, "/etc/new\nline"));
+        assert_se(q->entries[2].length == 0);
+        assert_se(streq(q->entries[3].path, "/usr/lib/libfoo.so"));
+        assert_se(q->entries[3].block == 300);
+}
+
+static void test_pack_invalid(const char *dir) {
+        _cleanup_(readahead_pack_freep) ReadaheadPack *p = NULL;
+        const char *fn;
+
+        fn = strjoina(dir, "/invalid");
+
+        assert_se(readahead_pack_load(fn, &p) == -ENOENT);
+
+        assert_se(write_string_file(fn, "READAHEAD=0\n\n1 1 /foo", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+        assert_se(readahead_pack_load(fn, &p) == -EPROTO);
+
+        assert_se(write_string_file(fn, "READAHEAD=1\nFOO=bar\n\n1 /foo", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+        assert_se(readahead_pack_load(fn, &p) == -EBADMSG);
+
+        /* Unknown header fields are fine, for compatibility with later versions */
+        assert_se(write_string_file(fn, "READAHEAD=1\nFOO=bar\n\n1 2 /foo", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+        assert_se(readahead_pack_load(fn, &p) >= 0);
+        assert_se(!p->rotational);
+        assert_se(p->n_entries == 1);
+        assert_se(streq(p->entries[0].path, "/foo"));
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-readahead-util.XXXXXX";
+
+        assert_se(mkdtemp(dir));
+
+        test_pack_roundtrip(dir);
+        test_pack_invalid(dir);
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
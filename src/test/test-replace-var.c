@@ -12,6 +12,7 @@ static char *lookup(const char *variable, void *userdata) {
 }
 
 int main(int argc, char *argv[]) {
+        ReplaceVarTemplate *t = NULL;
         char *r;
 
         assert_se(r = replace_var("@@@foobar@xyz@HALLO@foobar@test@@testtest@TEST@...@@@", lookup, NULL));
@@ -19,6 +20,20 @@ int main(int argc, char *argv[]) {
         assert_se(streq(r, "@@@foobar@xyz<<<HALLO>>>foobar@test@@testtest<<<TEST>>>...@@@"));
         free(r);
 
+        assert_se(replace_var_template_new("@FOO@ and @BAR@@", &t) >= 0);
+        assert_se(r = replace_var_template_apply(t, lookup, NULL));
+        assert_se(streq(r, "<<<FOO>>> and <<<BAR>>>@"));
+        free(r);
+        /* Templates can be applied any number of times */
+        assert_se(r = replace_var_template_apply(t, lookup, NULL));
+        assert_se(streq(r, "<<<FOO>>> and <<<BAR>>>@"));
+        free(r);
+        t = replace_var_template_free(t);
+
+        assert_se(r = replace_var("", lookup, NULL));
+        assert_se(streq(r, ""));
+        free(r);
+
         assert_se(r = strreplace("XYZFFFFXYZFFFFXYZ", "XYZ", "ABC"));
         puts(r);
         assert_se(streq(r, "ABCFFFFABCFFFFABC"));
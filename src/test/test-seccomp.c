@@ -636,6 +636,48 @@ static void test_lock_personality(void) {
         assert_se(wait_for_terminate_and_check("lockpersonalityseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
 }
 
+static int compile_realtime(void *userdata) {
+        return seccomp_restrict_realtime();
+}
+
+static void test_compile(void) {
+        _cleanup_(seccomp_programs_freep) SeccompPrograms *p = NULL;
+        pid_t pid;
+
+        if (!is_seccomp_available())
+                return;
+        if (geteuid() != 0)
+                return;
+
+        if (detect_container() > 0) /* in containers RT privs are likely missing anyway */
+                return;
+
+        /* Nothing is installed while compiling, hence this must not affect us */
+        assert_se(seccomp_compile(compile_realtime, NULL, &p) >= 0);
+        assert_se(seccomp_programs_size(p) > 0);
+
+        assert_se(sched_setscheduler(0, SCHED_BATCH, &(struct sched_param) { .sched_priority = 0 }) >= 0);
+        assert_se(sched_setscheduler(0, SCHED_OTHER, &(struct sched_param) {}) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(sched_setscheduler(0, SCHED_FIFO, &(struct sched_param) { .sched_priority = 1 }) >= 0);
+                assert_se(sched_setscheduler(0, SCHED_OTHER, &(struct sched_param) {}) >= 0);
+
+                assert_se(seccomp_programs_install(p) >= 0);
+
+                assert_se(sched_setscheduler(0, SCHED_OTHER, &(struct sched_param) {}) >= 0);
+                assert_se(sched_setscheduler(0, SCHED_FIFO, &(struct sched_param) { .sched_priority = 1 }) < 0);
+                assert_se(errno == EPERM);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_check("compileseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
+}
+
 static void test_filter_sets_ordered(void) {
         size_t i;
 
@@ -683,6 +725,7 @@ int main(int argc, char *argv[]) {
         test_restrict_archs();
         test_load_syscall_filter_set_raw();
         test_lock_personality();
+        test_compile();
         test_filter_sets_ordered();
 
         return 0;
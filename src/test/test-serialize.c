@@ -0,0 +1,325 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "capability-util.h"
+#include "execute-serialize.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "serialize.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+static void test_serialize_one(SerializationFormat format) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer b = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *big = NULL;
+        dual_timestamp t = { .realtime = 1234, .monotonic = 5678 }, zero = {};
+        SerializationFormat detected;
+        char *l;
+
+        log_info("/* %s(%s) */", __func__, serialization_format_to_string(format));
+
+        assert_se(f = tmpfile());
+
+        /* Longer than LINE_MAX, which only the binary format can carry */
+        assert_se(big = malloc(LINE_MAX * 2));
+        memset(big, 'x', LINE_MAX * 2 - 1);
+        big[LINE_MAX * 2 - 1] = 0;
+
+        assert_se(serialize_header(f, format) >= 0);
+        serialize_item(f, format, "foo", "bar");
+        serialize_item_format(f, format, "number", "%i %s", 42, "quux");
+        serialize_dual_timestamp(f, format, "timestamp", &t);
+        serialize_dual_timestamp(f, format, "unset", &zero);
+        if (format == SERIALIZATION_BINARY)
+                serialize_item(f, format, "big", big);
+        serialize_end(f, format);
+
+        serialize_unit(f, format, "a.service");
+        serialize_item(f, format, "state", "running");
+        serialize_marker(f, format, "job");
+        serialize_item(f, format, "job-id", "7");
+        serialize_end(f, format);
+        serialize_item(f, format, "after-job", "yes");
+        serialize_end(f, format);
+
+        serialize_unit(f, format, "b.service");
+        serialize_item(f, format, "state", "dead");
+        serialize_end(f, format);
+
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        assert_se(deserialize_header(f, &detected) >= 0);
+        assert_se(detected == format);
+
+        assert_se(deserialize_line(f, format, &b, &l) > 0);
+        assert_se(streq(l, "foo=bar"));
+        assert_se(deserialize_line(f, format, &b, &l) > 0);
+        assert_se(streq(l, "number=42 quux"));
+        assert_se(deserialize_line(f, format, &b, &l) > 0);
+        assert_se(streq(l, "timestamp=1234 5678"));
+        if (format == SERIALIZATION_BINARY) {
+                assert_se(deserialize_line(f, format, &b, &l) > 0);
+                assert_se(startswith(l, "big="));
+                assert_se(streq(l + 4, big));
+        }
+        assert_se(deserialize_line(f, format, &b, &l) == 0);
+
+        /* Skipping a unit also skips the job nested in it */
+        assert_se(deserialize_unit(f, format, &b, &l) > 0);
+        assert_se(streq(l, "a.service"));
+        assert_se(deserialize_skip(f, format, &b) == 0);
+
+        assert_se(deserialize_unit(f, format, &b, &l) > 0);
+        assert_se(streq(l, "b.service"));
+        assert_se(deserialize_line(f, format, &b, &l) > 0);
+        assert_se(streq(l, "state=dead"));
+        assert_se(deserialize_line(f, format, &b, &l) == 0);
+
+        assert_se(deserialize_unit(f, format, &b, &l) == 0);
+}
+
+static void test_deserialize_truncated(void) {
+        _cleanup_(deserialization_buffer_done) DeserializationBuffer b = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        SerializationFormat format;
+        char *l;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(f = tmpfile());
+
+        assert_se(serialize_header(f, SERIALIZATION_BINARY) >= 0);
+        serialize_item(f, SERIALIZATION_BINARY, "foo", "bar");
+        assert_se(fflush_and_check(f) >= 0);
+
+        /* Cut off the last byte of the record */
+        assert_se(ftruncate(fileno(f), ftello(f) - 1) >= 0);
+        rewind(f);
+
+        assert_se(deserialize_header(f, &format) >= 0);
+        assert_se(format == SERIALIZATION_BINARY);
+        assert_se(deserialize_line(f, format, &b, &l) == -EBADMSG);
+}
+
+static void test_serialization_format_from_string(void) {
+        log_info("/* %s */", __func__);
+
+        assert_se(serialization_format_from_string("text") == SERIALIZATION_TEXT);
+        assert_se(serialization_format_from_string("binary") == SERIALIZATION_BINARY);
+        assert_se(serialization_format_from_string("foo") < 0);
+}
+
+static void test_exec_invocation_round_trip(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        Manager m = {
+                .unit_file_scope = UNIT_FILE_USER,
+        };
+        Unit u = {
+                .manager = &m,
+                .id = (char*) "foo.service",
+                .invocation_id = SD_ID128_MAKE(a6,5c,99,8b,1a,71,4c,9c,9e,3f,2a,22,3b,ac,f0,51),
+        };
+        ExecCommand command = {
+                .path = (char*) "/bin/true",
+                .argv = STRV_MAKE("true", "--foo", ""),
+                .flags = EXEC_COMMAND_IGNORE_FAILURE|EXEC_COMMAND_NO_SETUID,
+        };
+        struct rlimit nofile = { .rlim_cur = 1024, .rlim_max = 4096 };
+        char *prefix[_EXEC_DIRECTORY_TYPE_MAX] = {
+                [EXEC_DIRECTORY_RUNTIME] = (char*) "/run/user/1000",
+                [EXEC_DIRECTORY_STATE] = (char*) "/var/lib",
+        };
+        int fds[] = { 7, 8, 9 };
+        const int from[] = { 7, 8, 9, 10, 11, 12 }, to[] = { 3, 4, 5, 6, 13, 14 };
+        ExecParameters p = {
+                .environment = STRV_MAKE("FOO=bar"),
+                .fds = fds,
+                .fd_names = STRV_MAKE("sock", "sock", "stored"),
+                .n_socket_fds = 2,
+                .n_storage_fds = 1,
+                .flags = EXEC_APPLY_SANDBOXING|EXEC_NEW_KEYRING,
+                .selinux_context_net = true,
+                .cgroup_supported = CGROUP_MASK_CPU|CGROUP_MASK_MEMORY,
+                .cgroup_path = "/system.slice/foo.service",
+                .prefix = prefix,
+                .watchdog_usec = 5 * USEC_PER_SEC,
+                .stdin_fd = -1,
+                .stdout_fd = 10,
+                .stderr_fd = -1,
+                .exec_fd = 11,
+        };
+        ExecContext c = {};
+        ExecInvocation i;
+
+        log_info("/* %s */", __func__);
+
+        sd_id128_to_string(u.invocation_id, u.invocation_id_string);
+
+        exec_context_init(&c);
+        c.environment = strv_new("A=1", "B=2", NULL);
+        c.unset_environment = strv_new("C", NULL);
+        c.rlimit[RLIMIT_NOFILE] = &nofile;
+        c.working_directory = (char*) "/srv";
+        c.working_directory_missing_ok = true;
+        c.umask = 0027;
+        c.nice = -5;
+        c.nice_set = true;
+        c.cpu_sched_policy = SCHED_BATCH;
+        c.cpu_sched_set = true;
+        c.std_input = EXEC_INPUT_NULL;
+        c.std_output = EXEC_OUTPUT_FILE;
+        c.stdio_file[STDOUT_FILENO] = (char*) "/var/log/foo.log";
+        c.timer_slack_nsec = 50000;
+        c.user = (char*) "foo";
+        c.supplementary_groups = strv_new("wheel", "adm", NULL);
+        c.utmp_mode = EXEC_UTMP_USER;
+        c.keyring_mode = EXEC_KEYRING_PRIVATE;
+        c.read_only_paths = strv_new("/etc", "-/opt", NULL);
+        c.mount_flags = MS_SLAVE;
+        c.capability_bounding_set = UINT64_C(1) << CAP_NET_BIND_SERVICE;
+        c.syslog_identifier = (char*) "foo";
+        c.log_level_max = LOG_INFO;
+        c.protect_system = PROTECT_SYSTEM_STRICT;
+        c.protect_home = PROTECT_HOME_READ_ONLY;
+        c.no_new_privileges = true;
+        c.syscall_errno = EPERM;
+        c.runtime_directory_preserve_mode = EXEC_PRESERVE_YES;
+        c.directories[EXEC_DIRECTORY_RUNTIME].mode = 0700;
+        c.directories[EXEC_DIRECTORY_RUNTIME].paths = strv_new("foo", "foo/bar", NULL);
+        c.restrict_realtime = true;
+
+        assert_se(exec_context_can_serialize(&c));
+        assert_se(exec_parameters_can_serialize(&p));
+
+        assert_se(f = tmpfile());
+        assert_se(exec_serialize_invocation(f, &u, &command, &c, &p, STRV_MAKE("FILE=1"), 12) >= 0);
+        rewind(f);
+
+        exec_invocation_init(&i);
+        assert_se(exec_deserialize_invocation(f, &i) >= 0);
+
+        assert_se(!MANAGER_IS_SYSTEM(&i.manager));
+        assert_se(i.log_level == log_get_max_level());
+        assert_se(i.log_target == log_get_target());
+        assert_se(streq(i.unit.id, u.id));
+        assert_se(sd_id128_equal(i.unit.invocation_id, u.invocation_id));
+        assert_se(streq(i.unit.invocation_id_string, "a65c998b1a714c9c9e3f2a223bacf051"));
+
+        assert_se(streq(i.command.path, command.path));
+        assert_se(strv_equal(i.command.argv, command.argv));
+        assert_se(i.command.flags == command.flags);
+
+        assert_se(strv_equal(i.context.environment, c.environment));
+        assert_se(strv_isempty(i.context.pass_environment));
+        assert_se(strv_equal(i.context.unset_environment, c.unset_environment));
+        assert_se(i.context.rlimit[RLIMIT_NOFILE]);
+        assert_se(i.context.rlimit[RLIMIT_NOFILE]->rlim_cur == nofile.rlim_cur);
+        assert_se(i.context.rlimit[RLIMIT_NOFILE]->rlim_max == nofile.rlim_max);
+        assert_se(!i.context.rlimit[RLIMIT_CORE]);
+        assert_se(streq(i.context.working_directory, c.working_directory));
+        assert_se(!i.context.root_directory);
+        assert_se(i.context.working_directory_missing_ok);
+        assert_se(!i.context.working_directory_home);
+        assert_se(i.context.umask == c.umask);
+        assert_se(i.context.nice_set);
+        assert_se(i.context.nice == c.nice);
+        assert_se(!i.context.oom_score_adjust_set);
+        assert_se(!i.context.ioprio_set);
+        assert_se(i.context.cpu_sched_set);
+        assert_se(i.context.cpu_sched_policy == c.cpu_sched_policy);
+        assert_se(i.context.cpu_sched_priority == c.cpu_sched_priority);
+        assert_se(i.context.std_input == c.std_input);
+        assert_se(i.context.std_output == c.std_output);
+        assert_se(i.context.std_error == c.std_error);
+        assert_se(streq(i.context.stdio_file[STDOUT_FILENO], c.stdio_file[STDOUT_FILENO]));
+        assert_se(!i.context.stdio_file[STDERR_FILENO]);
+        assert_se(i.context.timer_slack_nsec == c.timer_slack_nsec);
+        assert_se(streq(i.context.user, c.user));
+        assert_se(!i.context.group);
+        assert_se(strv_equal(i.context.supplementary_groups, c.supplementary_groups));
+        assert_se(i.context.utmp_mode == c.utmp_mode);
+        assert_se(i.context.keyring_mode == c.keyring_mode);
+        assert_se(strv_equal(i.context.read_only_paths, c.read_only_paths));
+        assert_se(strv_isempty(i.context.read_write_paths));
+        assert_se(i.context.mount_flags == c.mount_flags);
+        assert_se(i.context.capability_bounding_set == c.capability_bounding_set);
+        assert_se(i.context.capability_ambient_set == c.capability_ambient_set);
+        assert_se(streq(i.context.syslog_identifier, c.syslog_identifier));
+        assert_se(i.context.syslog_priority == c.syslog_priority);
+        assert_se(i.context.log_level_max == c.log_level_max);
+        assert_se(i.context.protect_system == c.protect_system);
+        assert_se(i.context.protect_home == c.protect_home);
+        assert_se(i.context.no_new_privileges);
+        assert_se(!i.context.private_devices);
+        assert_se(i.context.personality == c.personality);
+        assert_se(i.context.restrict_namespaces == c.restrict_namespaces);
+        assert_se(i.context.syscall_errno == c.syscall_errno);
+        assert_se(i.context.runtime_directory_preserve_mode == c.runtime_directory_preserve_mode);
+        assert_se(i.context.directories[EXEC_DIRECTORY_RUNTIME].mode == 0700);
+        assert_se(strv_equal(i.context.directories[EXEC_DIRECTORY_RUNTIME].paths, c.directories[EXEC_DIRECTORY_RUNTIME].paths));
+        assert_se(i.context.directories[EXEC_DIRECTORY_STATE].mode == c.directories[EXEC_DIRECTORY_STATE].mode);
+        assert_se(strv_isempty(i.context.directories[EXEC_DIRECTORY_STATE].paths));
+        assert_se(i.context.restrict_realtime);
+        assert_se(!i.context.memory_deny_write_execute);
+
+        assert_se(strv_equal(i.parameters.environment, p.environment));
+        assert_se(i.n_fds == ELEMENTSOF(fds));
+        assert_se(memcmp(i.parameters.fds, fds, sizeof(fds)) == 0);
+        assert_se(strv_equal(i.parameters.fd_names, p.fd_names));
+        assert_se(i.parameters.n_socket_fds == p.n_socket_fds);
+        assert_se(i.parameters.n_storage_fds == p.n_storage_fds);
+        assert_se(i.parameters.flags == p.flags);
+        assert_se(i.parameters.selinux_context_net);
+        assert_se(i.parameters.cgroup_supported == p.cgroup_supported);
+        assert_se(streq(i.parameters.cgroup_path, p.cgroup_path));
+        assert_se(streq(i.parameters.prefix[EXEC_DIRECTORY_RUNTIME], prefix[EXEC_DIRECTORY_RUNTIME]));
+        assert_se(streq(i.parameters.prefix[EXEC_DIRECTORY_STATE], prefix[EXEC_DIRECTORY_STATE]));
+        assert_se(!i.parameters.prefix[EXEC_DIRECTORY_CACHE]);
+        assert_se(i.parameters.watchdog_usec == p.watchdog_usec);
+        assert_se(i.parameters.stdin_fd == -1);
+        assert_se(i.parameters.stdout_fd == p.stdout_fd);
+        assert_se(i.parameters.stderr_fd == -1);
+        assert_se(i.parameters.exec_fd == p.exec_fd);
+
+        assert_se(strv_equal(i.files_env, STRV_MAKE("FILE=1")));
+        assert_se(i.user_lookup_fd == 12);
+
+        assert_se(exec_invocation_remap_fds(&i, from, to, ELEMENTSOF(from)) >= 0);
+        assert_se(i.parameters.fds[0] == 3);
+        assert_se(i.parameters.fds[2] == 5);
+        assert_se(i.parameters.stdin_fd == -1);
+        assert_se(i.parameters.stdout_fd == 6);
+        assert_se(i.parameters.exec_fd == 13);
+        assert_se(i.user_lookup_fd == 14);
+
+        /* Every fd the serialization refers to has to be accounted for */
+        assert_se(exec_invocation_remap_fds(&i, from, to, ELEMENTSOF(from)) == -EBADF);
+
+        exec_invocation_done(&i);
+
+        c.rlimit[RLIMIT_NOFILE] = NULL;
+        c.working_directory = c.stdio_file[STDOUT_FILENO] = c.user = c.syslog_identifier = NULL;
+        exec_context_done(&c);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_serialize_one(SERIALIZATION_TEXT);
+        test_serialize_one(SERIALIZATION_BINARY);
+        test_deserialize_truncated();
+        test_serialization_format_from_string();
+        test_exec_invocation_round_trip();
+
+        return 0;
+}
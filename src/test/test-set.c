@@ -61,10 +61,25 @@ static void test_set_put(void) {
         assert_se(set_put(m, (void*) "22") == 0);
 }
 
+static void test_set_put_many(void) {
+        _cleanup_set_free_ Set *m = NULL;
+        const void *keys[] = { "1", "22", "333", "22" };
+
+        m = set_new(&string_hash_ops);
+        assert_se(m);
+
+        assert_se(set_put(m, (void*) "1") == 1);
+        assert_se(set_put_many(m, keys, ELEMENTSOF(keys)) == 2);
+        assert_se(set_size(m) == 3);
+        assert_se(set_contains(m, "22"));
+        assert_se(set_contains(m, "333"));
+}
+
 int main(int argc, const char *argv[]) {
         test_set_steal_first();
         test_set_free_with_destructor();
         test_set_put();
+        test_set_put_many();
 
         return 0;
 }
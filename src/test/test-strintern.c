@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <string.h>
+
+#include "alloc-util.h"
+#include "string-util.h"
+#include "strintern.h"
+#include "util.h"
+
+static void test_strintern(void) {
+        _cleanup_free_ char *copy = NULL;
+        const char *a, *b, *c, *d;
+
+        assert_se(strintern_size() == 0);
+        assert_se(!strintern(NULL));
+        assert_se(!strintern_is_interned(NULL));
+
+        a = strintern("foo.service");
+        assert_se(a);
+        assert_se(streq(a, "foo.service"));
+        assert_se(strintern_is_interned(a));
+        assert_se(strintern_size() == 1);
+
+        /* Interning an equal string from a different buffer must return the very same pointer */
+        copy = strdup("foo.service");
+        assert_se(copy);
+        assert_se(!strintern_is_interned(copy));
+        b = strintern(copy);
+        assert_se(b == a);
+        assert_se(strintern_size() == 1);
+
+        c = strintern("bar.service");
+        assert_se(c && c != a);
+        assert_se(strintern_size() == 2);
+
+        d = strintern("");
+        assert_se(d && isempty(d));
+        assert_se(strintern_size() == 3);
+
+        assert_se(strintern_ref(a) == a);
+
+        /* Three references on "foo.service" now, drop them one by one */
+        assert_se(!strintern_unref(a));
+        assert_se(!strintern_unref(b));
+        assert_se(strintern_is_interned(copy) == false);
+        assert_se(strintern_size() == 3);
+        assert_se(strintern(copy) == a);
+        assert_se(!strintern_unref(a));
+        assert_se(!strintern_unref(a));
+        assert_se(strintern_size() == 2);
+
+        assert_se(!strintern_unref(c));
+        assert_se(!strintern_unref(d));
+        assert_se(strintern_size() == 0);
+        assert_se(!strintern_unref(NULL));
+}
+
+static void test_strintern_cleanup(void) {
+        {
+                _cleanup_(strintern_unrefp) const char *a = NULL, *b = NULL;
+
+                a = strintern("/var/lib");
+                b = strintern("/var/lib");
+                assert_se(a && a == b);
+                assert_se(strintern_size() == 1);
+        }
+
+        assert_se(strintern_size() == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_strintern();
+        test_strintern_cleanup();
+
+        return 0;
+}
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "bus-util.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "time-util.h"
+#include "transaction.h"
+#include "unit-order.h"
+#include "unit.h"
+
+static bool arg_slow = false;
+
+static void check_ranks(Manager *m) {
+        UnitType t;
+        Unit *u;
+
+        assert_se(manager_order_is_acyclic(m));
+
+        for (t = 0; t < _UNIT_TYPE_MAX; t++)
+                LIST_FOREACH(units_by_type, u, m->units_by_type[t]) {
+                        Unit *other;
+                        Iterator i;
+                        void *v;
+
+                        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+                                assert_se(u->order_rank < other->order_rank);
+                }
+}
+
+static void test_order_ranks(Manager *m) {
+        Unit *a, *b, *c, *d;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(unit_new_for_name(m, sizeof(Service), "order-a.service", &a) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "order-b.service", &b) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "order-c.service", &c) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "order-d.service", &d) >= 0);
+
+        /* All of these go against the order the units were created in */
+        assert_se(unit_add_dependency(d, UNIT_BEFORE, c, false, UNIT_DEPENDENCY_FILE) >= 0);
+        check_ranks(m);
+        assert_se(unit_add_dependency(b, UNIT_AFTER, c, false, UNIT_DEPENDENCY_FILE) >= 0);
+        check_ranks(m);
+        assert_se(unit_add_dependency(b, UNIT_BEFORE, a, false, UNIT_DEPENDENCY_FILE) >= 0);
+        check_ranks(m);
+        assert_se(unit_add_dependency(d, UNIT_BEFORE, a, false, UNIT_DEPENDENCY_FILE) >= 0);
+        check_ranks(m);
+
+        /* Closing a cycle, a → d → c → b → a */
+        assert_se(unit_add_dependency(a, UNIT_BEFORE, d, false, UNIT_DEPENDENCY_UDEV) >= 0);
+        assert_se(!manager_order_is_acyclic(m));
+
+        /* Further dependencies don't change anything about that */
+        assert_se(unit_add_dependency(c, UNIT_BEFORE, a, false, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(!manager_order_is_acyclic(m));
+
+        /* Dropping the dependency breaks the cycle again */
+        unit_remove_dependencies(a, UNIT_DEPENDENCY_UDEV);
+        check_ranks(m);
+}
+
+static void test_gc(Manager *m) {
+        Unit *a, *b, *c, *d, *keep, *kept;
+
+        log_info("/* %s */", __func__);
+
+        /* Get whatever is left over from earlier tests out of the way */
+        (void) manager_dispatch_gc_unit_queue(m);
+
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-a.service", &a) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-b.service", &b) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-c.service", &c) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-d.service", &d) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-keep.service", &keep) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "gc-kept.service", &kept) >= 0);
+
+        /* A chain and a loop nobody references, and a unit referenced by one that stays */
+        assert_se(unit_add_dependency(a, UNIT_WANTS, b, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(unit_add_dependency(c, UNIT_WANTS, d, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(unit_add_dependency(d, UNIT_WANTS, c, true, UNIT_DEPENDENCY_FILE) >= 0);
+        keep->perpetual = true;
+        assert_se(unit_add_dependency(keep, UNIT_WANTS, kept, true, UNIT_DEPENDENCY_FILE) >= 0);
+
+        unit_add_to_gc_queue(b);
+        unit_add_to_gc_queue(a);
+        unit_add_to_gc_queue(c);
+        unit_add_to_gc_queue(d);
+        unit_add_to_gc_queue(kept);
+        unit_add_to_gc_queue(keep);
+
+        assert_se(manager_dispatch_gc_unit_queue(m) == 5);
+
+        assert_se(a->in_cleanup_queue);
+        assert_se(b->in_cleanup_queue);
+        assert_se(c->in_cleanup_queue);
+        assert_se(d->in_cleanup_queue);
+        assert_se(!keep->in_cleanup_queue);
+        assert_se(!kept->in_cleanup_queue);
+}
+
+static void test_trivial_job(Manager *m) {
+        Unit *a, *b, *c;
+        Job *j;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(unit_new_for_name(m, sizeof(Service), "trivial-a.service", &a) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "trivial-b.service", &b) >= 0);
+        assert_se(unit_new_for_name(m, sizeof(Service), "trivial-c.service", &c) >= 0);
+        a->load_state = b->load_state = c->load_state = UNIT_LOADED;
+
+        /* Nothing to pull in, so the job is installed without a transaction */
+        assert_se(transaction_add_trivial_job(m, JOB_START, a, JOB_REPLACE, &j) > 0);
+        assert_se(a->job == j);
+        assert_se(j->installed);
+        assert_se(transaction_add_trivial_job(m, JOB_START, a, JOB_REPLACE, NULL) == 0);
+        assert_se(transaction_add_trivial_job(m, JOB_STOP, b, JOB_REPLACE, NULL) == 0);
+        assert_se(transaction_add_trivial_job(m, JOB_START, b, JOB_ISOLATE, NULL) == 0);
+
+        /* Requirements that still need to be started, and conflicts that are pending, need a transaction */
+        assert_se(unit_add_dependency(b, UNIT_REQUIRES, c, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(transaction_add_trivial_job(m, JOB_START, b, JOB_REPLACE, NULL) == 0);
+        assert_se(manager_add_job(m, JOB_START, b, JOB_REPLACE, NULL, &j) >= 0);
+        assert_se(b->job == j);
+        assert_se(c->job);
+
+        manager_clear_jobs(m);
+
+        assert_se(unit_add_dependency(c, UNIT_CONFLICTS, a, true, UNIT_DEPENDENCY_FILE) >= 0);
+        assert_se(manager_add_job(m, JOB_START, a, JOB_REPLACE, NULL, &j) >= 0);
+        assert_se(transaction_add_trivial_job(m, JOB_START, c, JOB_REPLACE, NULL) == 0);
+
+        manager_clear_jobs(m);
+
+        assert_se(transaction_add_trivial_job(m, JOB_START, c, JOB_REPLACE, &j) > 0);
+        assert_se(c->job == j);
+
+        manager_clear_jobs(m);
+}
+
+static void write_benchmark_units(const char *dir, unsigned n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        /* A target pulling in n services, ordered after the basic.target fixture, and in a tree among each other
+         * that is loaded in the opposite direction of the ordering */
+
+        assert_se(f = fopen(strjoina(dir, "/bench.target"), "we"));
+        fputs("[Unit]\nAllowIsolate=yes\n", f);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *p = NULL, *contents = NULL;
+
+                assert_se(asprintf(&p, "%s/bench-%u.service", dir, i) >= 0);
+                if (i == 0)
+                        assert_se(contents = strdup("[Unit]\n"
+                                                    "After=basic.target\n"
+                                                    "[Service]\n"
+                                                    "ExecStart=/bin/true\n"));
+                else
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\n"
+                                           "After=basic.target\n"
+                                           "Before=bench-%u.service\n"
+                                           "[Service]\n"
+                                           "ExecStart=/bin/true\n",
+                                           i / 2) >= 0);
+                assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+                fprintf(f, "Wants=bench-%u.service\n", i);
+        }
+
+        assert_se(fflush_and_check(f) >= 0);
+}
+
+static void test_transaction_benchmark(Manager *m, unsigned n) {
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        usec_t t;
+        Unit *u;
+        unsigned i;
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_startable_unit_or_warn(m, "bench.target", NULL, &u) >= 0);
+        log_info("load: %u units in "USEC_FMT"us", n, now(CLOCK_MONOTONIC) - t);
+        check_ranks(m);
+
+        for (i = 0; i < 3; i++) {
+                t = now(CLOCK_MONOTONIC);
+                assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, &err, NULL) >= 0);
+                log_info("start: %u units in "USEC_FMT"us", n, now(CLOCK_MONOTONIC) - t);
+
+                manager_clear_jobs(m);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_ISOLATE, &err, NULL) >= 0);
+        log_info("isolate: %u units in "USEC_FMT"us", n, now(CLOCK_MONOTONIC) - t);
+        manager_clear_jobs(m);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        unsigned n;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        arg_slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+        n = arg_slow ? 15000 : 300;
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-transaction-XXXXXX", &unit_dir) >= 0);
+        assert_se(set_unit_path(strjoina(get_testdata_dir(""), ":", unit_dir)) >= 0);
+        write_benchmark_units(unit_dir, n);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_order_ranks(m);
+        test_transaction_benchmark(m, n);
+        test_trivial_job(m);
+        test_gc(m);
+
+        return 0;
+}
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "conf-parser.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "unit-file-cache.h"
+#include "util.h"
+
+static void test_unit_file_cache(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_free_ char *cache = NULL, *a = NULL, *b = NULL, *sub = NULL;
+        _cleanup_(config_preparsed_freep) ConfigPreparsed *racy = NULL;
+        Hashmap *configs = NULL, *dirs = NULL, *configs2 = NULL, *dirs2 = NULL;
+        ConfigPreparsed *p, *q;
+        UnitFileCacheDir *d;
+        struct stat st;
+        struct timespec ts[2];
+        usec_t timestamp;
+        FILE *f;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-cache-XXXXXX", &dir) >= 0);
+        assert_se(cache = path_join(NULL, dir, "cache"));
+        assert_se(a = path_join(NULL, dir, "a.service"));
+        assert_se(b = path_join(NULL, dir, "b.service"));
+        assert_se(sub = path_join(NULL, dir, "units"));
+
+        assert_se(write_string_file(a, "[Unit]\nDescription=A\n# comment\n\n[Service]\nExecStart=/bin/true \\\n  --foo\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(b, "[Unit]\nDescription=B\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(mkdir(sub, 0755) >= 0);
+
+        /* Pretend we started reading a while after everything was written, but b.service was modified after
+         * that. As the ctime can't be set, that's how everything but b.service is made old enough to be cached. */
+        timestamp = usec_add(now(CLOCK_REALTIME), 2 * USEC_PER_SEC);
+        timespec_store(&ts[0], usec_add(timestamp, USEC_PER_HOUR));
+        ts[1] = ts[0];
+        assert_se(utimensat(AT_FDCWD, b, ts, 0) >= 0);
+
+        assert_se(configs = hashmap_new(&path_hash_ops));
+        assert_se(dirs = hashmap_new(&path_hash_ops));
+
+        assert_se(f = fopen(a, "re"));
+        assert_se(config_preparse(a, f, 0, &p) >= 0);
+        fclose(f);
+        assert_se(p->n_lines > 0);
+        assert_se(hashmap_put(configs, p->filename, p) > 0);
+
+        assert_se(f = fopen(b, "re"));
+        assert_se(config_preparse(b, f, 0, &racy) >= 0);
+        fclose(f);
+        assert_se(hashmap_put(configs, racy->filename, racy) > 0);
+
+        assert_se(stat(sub, &st) >= 0);
+        assert_se(d = new0(UnitFileCacheDir, 1));
+        assert_se(d->path = strdup(sub));
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        d->mtime = timespec_load_nsec(&st.st_mtim);
+        d->ctime = timespec_load_nsec(&st.st_ctim);
+        assert_se(d->entries = strv_new("foo.service", "bar.socket", NULL));
+        assert_se(hashmap_put(dirs, d->path, d) > 0);
+
+        assert_se(unit_file_cache_write(cache, configs, dirs, timestamp) >= 0);
+        assert_se(hashmap_remove(configs, racy->filename) == racy);
+
+        assert_se(unit_file_cache_read(cache, &configs2, &dirs2) >= 0);
+
+        /* b.service was modified after we started reading, hence must not have been stored */
+        assert_se(hashmap_size(configs2) == 1);
+        assert_se(!hashmap_get(configs2, b));
+
+        assert_se(q = hashmap_get(configs2, a));
+        assert_se(streq(q->filename, a));
+        assert_se(q->n_lines == p->n_lines);
+        assert_se(stat(a, &st) >= 0);
+        assert_se(config_preparsed_matches(q, &st));
+        assert_se(q->st.st_mode == st.st_mode);
+        for (size_t i = 0; i < p->n_lines; i++) {
+                assert_se(q->lines[i].line == p->lines[i].line);
+                assert_se(streq(q->lines[i].text, p->lines[i].text));
+        }
+
+        assert_se(hashmap_size(dirs2) == 1);
+        assert_se(d = hashmap_get(dirs2, sub));
+        assert_se(strv_equal(d->entries, STRV_MAKE("foo.service", "bar.socket")));
+
+        /* Once its timestamps are changed, the file doesn't match the cached version anymore, even if they're set
+         * back, as tools restoring the mtime after modifying a file do */
+        ts[0] = ts[1] = st.st_mtim;
+        usleep(10 * USEC_PER_MSEC);
+        assert_se(utimensat(AT_FDCWD, a, ts, 0) >= 0);
+        assert_se(stat(a, &st) >= 0);
+        assert_se(timespec_load_nsec(&st.st_mtim) == timespec_load_nsec(&q->st.st_mtim));
+        assert_se(!config_preparsed_matches(q, &st));
+
+        /* … and neither does it once modified */
+        assert_se(write_string_file(a, "[Unit]\nDescription=C\n", 0) >= 0);
+        assert_se(stat(a, &st) >= 0);
+        assert_se(!config_preparsed_matches(q, &st));
+
+        /* Garbage is refused */
+        assert_se(write_string_file(cache, "SDUFC02\nfoo", 0) >= 0);
+        hashmap_free_with_destructor(configs2, config_preparsed_free);
+        hashmap_free_with_destructor(dirs2, unit_file_cache_dir_free);
+        configs2 = dirs2 = NULL;
+        assert_se(unit_file_cache_read(cache, &configs2, &dirs2) < 0);
+
+        hashmap_free_with_destructor(configs, config_preparsed_free);
+        hashmap_free_with_destructor(dirs, unit_file_cache_dir_free);
+        hashmap_free_with_destructor(configs2, config_preparsed_free);
+        hashmap_free_with_destructor(dirs2, unit_file_cache_dir_free);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_unit_file_cache();
+
+        return 0;
+}
@@ -10,6 +10,17 @@ static void test_utf8_is_printable(void) {
         assert_se(utf8_is_printable("\342\204\242", 3));
         assert_se(!utf8_is_printable("\341\204", 2));
         assert_se(utf8_is_printable("ąę", 4));
+
+        /* Long runs of ASCII, with the odd character at various positions within a word */
+        assert_se(utf8_is_printable("0123456789abcdef0123456789abcdef", 32));
+        assert_se(utf8_is_printable("0123456789abc\tef0123456\n89abcdef", 32));
+        assert_se(!utf8_is_printable_newline("0123456789abcdef0123456\n89abcdef", 32, false));
+        assert_se(!utf8_is_printable("0123456789\177bcdef", 16));
+        assert_se(!utf8_is_printable("0123456789abcdef\001", 17));
+        assert_se(!utf8_is_printable("\0010123456789abcdef", 17));
+        assert_se(!utf8_is_printable("0123456\0009abcdef", 16));
+        assert_se(!utf8_is_printable("0123456\3419abcdef", 16));
+        assert_se(utf8_is_printable("0123456\342\204\242abcdef0123", 20));
 }
 
 static void test_utf8_is_valid(void) {
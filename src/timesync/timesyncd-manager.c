@@ -17,13 +17,16 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "list.h"
 #include "log.h"
 #include "missing.h"
 #include "network-util.h"
+#include "parse-util.h"
 #include "ratelimit.h"
 #include "socket-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
@@ -51,12 +54,30 @@
 /* Maximum number of missed replies before selecting another source. */
 #define NTP_MAX_MISSED_REPLIES          2
 
+/* Maximum number of addresses of a server that are queried at the same time when connecting to it. */
+#define NTP_PROBES_MAX                  4U
+
+/* Number of samples taken in short succession after connecting to a server, so that the spike detection has enough
+ * data early on, instead of only after a couple of poll intervals. */
+#define NTP_BURST_SAMPLES               4U
+#define NTP_BURST_INTERVAL_USEC         (2 * USEC_PER_SEC)
+
+/* The frequency correction of the system clock is saved, so that it can be put into effect right away on the next
+ * boot. It is only saved again after it changed by at least 1 ppm, the kernel does not accept more than 500 ppm. */
+#define DRIFT_FILE                      "/var/lib/systemd/timesync/drift"
+#define DRIFT_SAVE_DELTA                (1LL << 16)
+#define DRIFT_MAX                       (500LL << 16)
+
 #define RETRY_USEC (30*USEC_PER_SEC)
 #define RATELIMIT_INTERVAL_USEC (10*USEC_PER_SEC)
 #define RATELIMIT_BURST 10
 
 #define TIMEOUT_USEC (10*USEC_PER_SEC)
 
+/* Time to wait for the first reply of a server before trying the next one. This is doubled every time all servers
+ * were tried without success, up to TIMEOUT_USEC. */
+#define CONNECT_TIMEOUT_USEC (1*USEC_PER_SEC)
+
 static int manager_arm_timer(Manager *m, usec_t next);
 static int manager_clock_watch_setup(Manager *m);
 static int manager_listen_setup(Manager *m);
@@ -85,6 +106,10 @@ static int manager_timeout(sd_event_source *source, usec_t usec, void *userdata)
         server_address_pretty(m->current_server_address, &pretty);
         log_info("Timed out waiting for reply from %s (%s).", strna(pretty), m->current_server_name->string);
 
+        /* None of the other addresses we queried along with this one answered either, skip them too */
+        for (; m->n_probes > 1; m->n_probes--)
+                m->current_server_address = m->current_server_address->addresses_next;
+
         return manager_connect(m);
 }
 
@@ -100,6 +125,8 @@ static int manager_send_request(Manager *m) {
                  */
                 .field = NTP_FIELD(0, 4, NTP_MODE_CLIENT),
         };
+        ServerAddress *a;
+        unsigned i;
         ssize_t len;
         int r;
 
@@ -137,6 +164,22 @@ static int manager_send_request(Manager *m) {
                 return manager_connect(m);
         }
 
+        /* While connecting, query the next few addresses of the server too, and continue with whichever gives us
+         * the first valid reply, instead of waiting for each of them to time out in turn. */
+        for (a = m->current_server_address->addresses_next, i = 1; i < m->n_probes; a = a->addresses_next, i++) {
+                _cleanup_free_ char *p = NULL;
+
+                assert(a);
+
+                server_address_pretty(a, &p);
+
+                len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &a->sockaddr.sa, a->socklen);
+                if (len == sizeof(ntpmsg))
+                        log_debug("Sent NTP request to %s (%s).", strna(p), m->current_server_name->string);
+                else
+                        log_debug_errno(errno, "Sending NTP request to %s (%s) failed, ignoring: %m", strna(p), m->current_server_name->string);
+        }
+
         /* re-arm timer with increasing timeout, in case the packets never arrive back */
         if (m->retry_interval > 0) {
                 if (m->retry_interval < m->poll_interval_max_usec)
@@ -154,7 +197,7 @@ static int manager_send_request(Manager *m) {
                                 m->event,
                                 &m->event_timeout,
                                 clock_boottime_or_monotonic(),
-                                now(clock_boottime_or_monotonic()) + TIMEOUT_USEC, 0,
+                                now(clock_boottime_or_monotonic()) + (m->good ? TIMEOUT_USEC : m->connect_timeout_usec), 0,
                                 manager_timeout, m);
                 if (r < 0)
                         return log_error_errno(r, "Failed to arm timeout timer: %m");
@@ -238,6 +281,65 @@ static int manager_clock_watch_setup(Manager *m) {
         return 0;
 }
 
+static void manager_save_drift(Manager *m) {
+        char buf[DECIMAL_STR_MAX(int64_t)];
+        int r;
+
+        assert(m);
+
+        xsprintf(buf, "%" PRIi64, m->drift_freq);
+
+        r = write_string_file(DRIFT_FILE, buf, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to save frequency correction, ignoring: %m");
+                return;
+        }
+
+        m->drift_freq_saved = m->drift_freq;
+}
+
+int manager_restore_drift(Manager *m) {
+        _cleanup_free_ char *s = NULL;
+        struct timex tmx = {};
+        int64_t freq;
+        int r;
+
+        assert(m);
+
+        /* The kernel starts without any frequency correction, and the PLL needs quite a while to find it again from
+         * scratch. Hence, start out with the one we determined last time, unless somebody else set one already. */
+
+        r = read_one_line_file(DRIFT_FILE, &s);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read %s, ignoring: %m", DRIFT_FILE);
+
+        r = safe_atoi64(s, &freq);
+        if (r < 0 || freq < -DRIFT_MAX || freq > DRIFT_MAX) {
+                log_debug("Invalid frequency correction in %s, ignoring: %s", DRIFT_FILE, s);
+                return 0;
+        }
+
+        if (clock_adjtime(CLOCK_REALTIME, &tmx) < 0)
+                return log_debug_errno(errno, "Failed to query frequency correction, ignoring: %m");
+        if (tmx.freq != 0)
+                return 0;
+
+        tmx = (struct timex) {
+                .modes = ADJ_FREQUENCY,
+                .freq = freq,
+        };
+
+        if (clock_adjtime(CLOCK_REALTIME, &tmx) < 0)
+                return log_warning_errno(errno, "Failed to restore frequency correction, ignoring: %m");
+
+        m->drift_freq = m->drift_freq_saved = freq;
+        log_debug("Restored frequency correction of %+"PRIi64" ppm.", freq / 65536);
+
+        return 0;
+}
+
 static int manager_adjust_clock(Manager *m, double offset, int leap_sec) {
         struct timex tmx = {};
         int r;
@@ -305,6 +407,11 @@ static int manager_adjust_clock(Manager *m, double offset, int leap_sec) {
 
         m->drift_freq = tmx.freq;
 
+        /* Only save the frequency correction once the clock is stable, i.e. we started to poll less often */
+        if (m->poll_interval_usec > m->poll_interval_min_usec &&
+            llabs(m->drift_freq - m->drift_freq_saved) >= DRIFT_SAVE_DELTA)
+                manager_save_drift(m);
+
         log_debug("  status       : %04i %s\n"
                   "  time now     : %"PRI_TIME".%03"PRI_USEC"\n"
                   "  constant     : %"PRI_TIMEX"\n"
@@ -400,6 +507,49 @@ static void manager_adjust_poll(Manager *m, double offset, bool spike) {
         }
 }
 
+static ServerAddress *manager_find_probe(Manager *m, const union sockaddr_union *sa) {
+        ServerAddress *a;
+        unsigned i;
+
+        assert(m);
+        assert(sa);
+
+        for (a = m->current_server_address, i = 0; a && i < MAX(m->n_probes, 1U); a = a->addresses_next, i++)
+                if (sockaddr_equal(sa, &a->sockaddr))
+                        return a;
+
+        return NULL;
+}
+
+static unsigned manager_count_probes(Manager *m) {
+        ServerAddress *a;
+        unsigned n = 1;
+
+        assert(m);
+        assert(m->current_server_address);
+
+        /* When starting out with a server, query its first addresses of the same family all at once, as they can
+         * share the socket */
+        if (m->current_server_address->addresses_prev)
+                return 1;
+
+        for (a = m->current_server_address->addresses_next; a && n < NTP_PROBES_MAX; a = a->addresses_next, n++)
+                if (a->sockaddr.sa.sa_family != m->current_server_address->sockaddr.sa.sa_family)
+                        break;
+
+        return n;
+}
+
+static int manager_reject_reply(Manager *m) {
+        assert(m);
+
+        /* If other addresses are still being queried, wait for their replies, otherwise move on */
+        if (m->n_probes > 1)
+                return 0;
+
+        return manager_connect(m);
+}
+
 static int manager_receive_response(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
         struct ntp_msg ntpmsg;
@@ -423,6 +573,7 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         };
         struct cmsghdr *cmsg;
         struct timespec *recv_time = NULL;
+        ServerAddress *a;
         ssize_t len;
         double origin, receive, trans, dest;
         double delay, offset;
@@ -454,9 +605,8 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return manager_connect(m);
         }
 
-        if (!m->current_server_name ||
-            !m->current_server_address ||
-            !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr)) {
+        a = m->current_server_name && m->current_server_address ? manager_find_probe(m, &server_addr) : NULL;
+        if (!a) {
                 log_debug("Response from unknown server.");
                 return 0;
         }
@@ -481,8 +631,6 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return 0;
         }
 
-        m->missed_replies = 0;
-
         /* check our "time cookie" (we just stored nanoseconds in the fraction field) */
         if (be32toh(ntpmsg.origin_time.sec) != m->trans_time.tv_sec + OFFSET_1900_1970 ||
             be32toh(ntpmsg.origin_time.frac) != (unsigned long) m->trans_time.tv_nsec) {
@@ -490,39 +638,50 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return 0;
         }
 
-        m->event_timeout = sd_event_source_unref(m->event_timeout);
-
         if (be32toh(ntpmsg.recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
             be32toh(ntpmsg.trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970) {
                 log_debug("Invalid reply, returned times before epoch. Ignoring.");
-                return manager_connect(m);
+                return manager_reject_reply(m);
         }
 
         if (NTP_FIELD_LEAP(ntpmsg.field) == NTP_LEAP_NOTINSYNC ||
             ntpmsg.stratum == 0 || ntpmsg.stratum >= 16) {
                 log_debug("Server is not synchronized. Disconnecting.");
-                return manager_connect(m);
+                return manager_reject_reply(m);
         }
 
         if (!IN_SET(NTP_FIELD_VERSION(ntpmsg.field), 3, 4)) {
                 log_debug("Response NTPv%d. Disconnecting.", NTP_FIELD_VERSION(ntpmsg.field));
-                return manager_connect(m);
+                return manager_reject_reply(m);
         }
 
         if (NTP_FIELD_MODE(ntpmsg.field) != NTP_MODE_SERVER) {
                 log_debug("Unsupported mode %d. Disconnecting.", NTP_FIELD_MODE(ntpmsg.field));
-                return manager_connect(m);
+                return manager_reject_reply(m);
         }
 
         root_distance = ntp_ts_short_to_d(&ntpmsg.root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg.root_dispersion);
         if (root_distance > (double) m->max_root_distance_usec / (double) USEC_PER_SEC) {
                 log_debug("Server has too large root distance. Disconnecting.");
-                return manager_connect(m);
+                return manager_reject_reply(m);
         }
 
         /* valid packet */
         m->pending = false;
         m->retry_interval = 0;
+        m->missed_replies = 0;
+        m->event_timeout = sd_event_source_unref(m->event_timeout);
+
+        /* If this was one of several addresses we queried, the others are of no interest anymore */
+        if (a != m->current_server_address) {
+                _cleanup_free_ char *pretty = NULL;
+
+                m->current_server_address = a;
+
+                server_address_pretty(a, &pretty);
+                log_debug("Selected address %s of server %s.", strna(pretty), a->name->string);
+        }
+        m->n_probes = 1;
 
         /* Stop listening */
         manager_listen_stop(m);
@@ -614,13 +773,19 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 _cleanup_free_ char *pretty = NULL;
 
                 m->good = true;
+                m->connect_timeout_usec = CONNECT_TIMEOUT_USEC;
 
                 server_address_pretty(m->current_server_address, &pretty);
                 log_info("Synchronized to time server %s (%s).", strna(pretty), m->current_server_name->string);
                 sd_notifyf(false, "STATUS=Synchronized to time server %s (%s).", strna(pretty), m->current_server_name->string);
         }
 
-        r = manager_arm_timer(m, m->poll_interval_usec);
+        /* Take the first couple of samples in short succession, before falling back to the poll interval */
+        if (m->burst > 0) {
+                m->burst--;
+                r = manager_arm_timer(m, NTP_BURST_INTERVAL_USEC);
+        } else
+                r = manager_arm_timer(m, m->poll_interval_usec);
         if (r < 0)
                 return log_error_errno(r, "Failed to rearm timer: %m");
 
@@ -677,6 +842,8 @@ static int manager_begin(Manager *m) {
 
         m->good = false;
         m->missed_replies = NTP_MAX_MISSED_REPLIES;
+        m->n_probes = manager_count_probes(m);
+        m->burst = NTP_BURST_SAMPLES - 1;
         if (m->poll_interval_usec == 0)
                 m->poll_interval_usec = m->poll_interval_min_usec;
 
@@ -859,6 +1026,9 @@ int manager_connect(Manager *m) {
                                 if (m->poll_interval_usec < m->poll_interval_max_usec)
                                         m->poll_interval_usec *= 2;
 
+                                /* Maybe the servers are just far away, give them more time next round */
+                                m->connect_timeout_usec = MIN(m->connect_timeout_usec * 2, TIMEOUT_USEC);
+
                                 return 0;
                         }
 
@@ -1092,6 +1262,7 @@ int manager_new(Manager **ret) {
         m->max_root_distance_usec = NTP_MAX_ROOT_DISTANCE;
         m->poll_interval_min_usec = NTP_POLL_INTERVAL_MIN_USEC;
         m->poll_interval_max_usec = NTP_POLL_INTERVAL_MAX_USEC;
+        m->connect_timeout_usec = CONNECT_TIMEOUT_USEC;
 
         m->server_socket = m->clock_watch_fd = -1;
 
@@ -51,6 +51,9 @@ struct Manager {
         int missed_replies;
         uint64_t packet_count;
         sd_event_source *event_timeout;
+        usec_t connect_timeout_usec;
+        unsigned n_probes;
+        unsigned burst;
         bool good;
 
         /* last sent packet */
@@ -79,6 +82,7 @@ struct Manager {
         bool jumped;
         bool sync;
         int64_t drift_freq;
+        int64_t drift_freq_saved;
 
         /* watch for time changes */
         sd_event_source *event_clock_watch;
@@ -107,3 +111,5 @@ void manager_flush_server_names(Manager *m, ServerType t);
 
 int manager_connect(Manager *m);
 void manager_disconnect(Manager *m);
+
+int manager_restore_drift(Manager *m);
@@ -140,6 +140,8 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        (void) manager_restore_drift(m);
+
         if (clock_is_localtime(NULL) > 0) {
                 log_info("The system is configured to read the RTC time in the local time zone. "
                          "This mode cannot be fully supported. All system time to RTC updates are disabled.");
@@ -59,6 +59,7 @@
 #include "umask-util.h"
 #include "user-util.h"
 #include "util.h"
+#include "xattr-util.h"
 
 /* This reads all files listed in /etc/tmpfiles.d/?*.conf and creates
  * them in the file system. This is intended to be used to create
@@ -151,6 +152,7 @@ static bool arg_create = false;
 static bool arg_clean = false;
 static bool arg_remove = false;
 static bool arg_boot = false;
+static bool arg_incremental = false;
 static bool arg_no_pager = false;
 
 static char **arg_include_prefixes = NULL;
@@ -160,6 +162,10 @@ static char *arg_replace = NULL;
 
 #define MAX_DEPTH 256
 
+/* Extended attribute on directories in which we remember what we found during the last --clean run, see
+ * dir_cleanup_summary_valid(). This is in the "trusted." namespace so that only privileged code can forge it. */
+#define CLEANUP_SUMMARY_XATTR "trusted.tmpfiles_clean"
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
 
@@ -361,6 +367,41 @@ static struct Item* find_glob(OrderedHashmap *h, const char *match) {
         return NULL;
 }
 
+static bool glob_may_match_below(OrderedHashmap *h, const char *p) {
+        ItemArray *j;
+        Iterator i;
+        size_t l;
+
+        assert(p);
+
+        /* Checks whether any of the globs could possibly match a path below the specified directory, by comparing
+         * the literal part of the glob before the first wildcard. This is much cheaper than calling find_glob()
+         * for each and every file, and allows us to skip that entirely for directories no glob reaches into. */
+
+        l = strlen(p);
+
+        ORDERED_HASHMAP_FOREACH(j, h, i) {
+                unsigned n;
+
+                for (n = 0; n < j->count; n++) {
+                        const char *g = j->items[n].path;
+                        size_t k;
+
+                        k = strcspn(g, "*?[\\");
+
+                        if (strncmp(g, p, MIN(k, l)) != 0)
+                                continue;
+
+                        if (k > l && g[l] != '/')
+                                continue;
+
+                        return true;
+                }
+        }
+
+        return false;
+}
+
 static void load_unix_sockets(void) {
         _cleanup_fclose_ FILE *f = NULL;
         int r;
@@ -454,18 +495,21 @@ static bool unix_socket_alive(const char *fn) {
         return true;
 }
 
-static int dir_is_mount_point(DIR *d, const char *subdir) {
+static int dir_is_mount_point(DIR *d, const char *subdir, int *r_parent, int *mount_id_parent) {
 
-        int mount_id_parent, mount_id;
+        int mount_id;
         int r_p, r;
 
-        r_p = name_to_handle_at_loop(dirfd(d), ".", NULL, &mount_id_parent, 0);
-        if (r_p < 0)
-                r_p = -errno;
+        assert(r_parent);
+        assert(mount_id_parent);
+
+        /* The mount ID of the directory itself is the same for all its entries, hence the caller caches it for us.
+         * A positive *r_parent means it wasn't queried yet. */
+        if (*r_parent > 0)
+                *r_parent = name_to_handle_at_loop(dirfd(d), ".", NULL, mount_id_parent, 0);
+        r_p = *r_parent;
 
         r = name_to_handle_at_loop(dirfd(d), subdir, NULL, &mount_id, 0);
-        if (r < 0)
-                r = -errno;
 
         /* got no handle; make no assumptions, return error */
         if (r_p < 0 && r < 0)
@@ -473,7 +517,7 @@ static int dir_is_mount_point(DIR *d, const char *subdir) {
 
         /* got both handles; if they differ, it is a mount point */
         if (r_p >= 0 && r >= 0)
-                return mount_id_parent != mount_id;
+                return *mount_id_parent != mount_id;
 
         /* got only one handle; assume different mount points if one
          * of both queries was not supported by the filesystem */
@@ -508,6 +552,34 @@ static DIR* opendir_nomod(const char *path) {
         return xopendirat_nomod(AT_FDCWD, path);
 }
 
+static bool dir_cleanup_summary_valid(DIR *d, const struct stat *ds, usec_t cutoff) {
+        _cleanup_free_ char *value = NULL;
+        uint64_t mtime, oldest;
+
+        /* With --incremental we store the modification time of the directory and the oldest timestamp of all
+         * non-directory entries left over after cleaning it. If the directory wasn't modified since, no entries
+         * were added or removed, and the entries that are still there can only have become newer, as changing
+         * their timestamps updates their ctime. Hence, if even the oldest of them can't have expired yet, there's
+         * no need to look at any of the non-directory entries again. */
+
+        if (fgetxattr_malloc(dirfd(d), CLEANUP_SUMMARY_XATTR, &value) < 0)
+                return false;
+
+        if (sscanf(value, "%" SCNu64 " %" SCNu64, &mtime, &oldest) != 2)
+                return false;
+
+        return mtime == timespec_load_nsec(&ds->st_mtim) && oldest >= cutoff;
+}
+
+static void dir_cleanup_summary_save(DIR *d, const char *p, const struct stat *ds, usec_t oldest) {
+        char value[DECIMAL_STR_MAX(uint64_t) * 2 + 2];
+
+        xsprintf(value, "%" PRIu64 " %" PRIu64, timespec_load_nsec(&ds->st_mtim), oldest);
+
+        if (fsetxattr(dirfd(d), CLEANUP_SUMMARY_XATTR, value, strlen(value), 0) < 0)
+                log_debug_errno(errno, "Failed to store cleanup summary on \"%s\", ignoring: %m", p);
+}
+
 static int dir_cleanup(
                 Item *i,
                 const char *p,
@@ -521,17 +593,33 @@ static int dir_cleanup(
 
         struct dirent *dent;
         struct timespec times[2];
-        bool deleted = false;
-        int r = 0;
+        bool deleted = false, check_globs, skip_files = false, incomplete = false;
+        int r = 0, r_parent = 1, mount_id_parent = -1;
+        usec_t oldest = USEC_INFINITY;
+
+        check_globs = glob_may_match_below(globs, p);
 
-        FOREACH_DIRENT_ALL(dent, d, break) {
+        if (arg_incremental) {
+                skip_files = dir_cleanup_summary_valid(d, ds, cutoff);
+                if (skip_files)
+                        log_debug("Directory \"%s\" unchanged since last cleanup, only descending.", p);
+
+                /* Should this directory be modified while we are looking at it, whatever shows up can't be older
+                 * than now */
+                oldest = now(CLOCK_REALTIME);
+        }
+
+        FOREACH_DIRENT_ALL(dent, d, incomplete = true; break) {
                 struct stat s;
-                usec_t age;
+                usec_t age, oldest_before;
                 _cleanup_free_ char *sub_path = NULL;
 
                 if (dot_or_dot_dot(dent->d_name))
                         continue;
 
+                if (skip_files && !IN_SET(dent->d_type, DT_DIR, DT_UNKNOWN))
+                        continue;
+
                 if (fstatat(dirfd(d), dent->d_name, &s, AT_SYMLINK_NOFOLLOW) < 0) {
                         if (errno == ENOENT)
                                 continue;
@@ -542,6 +630,17 @@ static int dir_cleanup(
                         continue;
                 }
 
+                if (skip_files && !S_ISDIR(s.st_mode))
+                        continue;
+
+                /* Track the oldest entry we leave behind, for the summary. Whatever we skip below for reasons other
+                 * than its age is included too, so that it is looked at again once it is old enough. */
+                oldest_before = oldest;
+                if (!S_ISDIR(s.st_mode))
+                        oldest = MIN(oldest, MAX3(timespec_load(&s.st_mtim),
+                                                  timespec_load(&s.st_atim),
+                                                  timespec_load(&s.st_ctim)));
+
                 /* Stay on the same filesystem */
                 if (s.st_dev != rootdev) {
                         log_debug("Ignoring \"%s/%s\": different filesystem.", p, dent->d_name);
@@ -551,7 +650,7 @@ static int dir_cleanup(
                 /* Try to detect bind mounts of the same filesystem instance; they
                  * do not differ in device major/minors. This type of query is not
                  * supported on all kernels or filesystem types though. */
-                if (S_ISDIR(s.st_mode) && dir_is_mount_point(d, dent->d_name) > 0) {
+                if (S_ISDIR(s.st_mode) && dir_is_mount_point(d, dent->d_name, &r_parent, &mount_id_parent) > 0) {
                         log_debug("Ignoring \"%s/%s\": different mount of the same filesystem.",
                                   p, dent->d_name);
                         continue;
@@ -569,7 +668,7 @@ static int dir_cleanup(
                         continue;
                 }
 
-                if (find_glob(globs, sub_path)) {
+                if (check_globs && find_glob(globs, sub_path)) {
                         log_debug("Ignoring \"%s\": a separate glob exists.", sub_path);
                         continue;
                 }
@@ -707,9 +806,11 @@ static int dir_cleanup(
 
                         log_debug("unlink \"%s\"", sub_path);
 
-                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0)
+                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0) {
                                 if (errno != ENOENT)
                                         r = log_error_errno(errno, "unlink(%s): %m", sub_path);
+                        } else
+                                oldest = oldest_before;
 
                         deleted = true;
                 }
@@ -730,10 +831,16 @@ finish:
                           p,
                           format_timestamp_us(a, sizeof(a), age1),
                           format_timestamp_us(b, sizeof(b), age2));
-                if (futimens(dirfd(d), times) < 0)
+                if (futimens(dirfd(d), times) < 0) {
                         log_error_errno(errno, "utimensat(%s): %m", p);
+                        incomplete = true;
+                }
         }
 
+        /* Only remember what we found if we actually looked at everything */
+        if (arg_incremental && !skip_files && !incomplete && r >= 0)
+                dir_cleanup_summary_save(d, p, ds, oldest);
+
         return r;
 }
 
@@ -2828,6 +2935,7 @@ static int help(void) {
                "     --clean                Clean up marked directories\n"
                "     --remove               Remove marked files/directories\n"
                "     --boot                 Execute actions only safe at boot\n"
+               "     --incremental          Skip unchanged directories when cleaning\n"
                "     --prefix=PATH          Only apply rules with the specified prefix\n"
                "     --exclude-prefix=PATH  Ignore rules with the specified prefix\n"
                "     --root=PATH            Operate on an alternate filesystem root\n"
@@ -2851,6 +2959,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CLEAN,
                 ARG_REMOVE,
                 ARG_BOOT,
+                ARG_INCREMENTAL,
                 ARG_PREFIX,
                 ARG_EXCLUDE_PREFIX,
                 ARG_ROOT,
@@ -2867,6 +2976,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "clean",          no_argument,         NULL, ARG_CLEAN          },
                 { "remove",         no_argument,         NULL, ARG_REMOVE         },
                 { "boot",           no_argument,         NULL, ARG_BOOT           },
+                { "incremental",    no_argument,         NULL, ARG_INCREMENTAL    },
                 { "prefix",         required_argument,   NULL, ARG_PREFIX         },
                 { "exclude-prefix", required_argument,   NULL, ARG_EXCLUDE_PREFIX },
                 { "root",           required_argument,   NULL, ARG_ROOT           },
@@ -2914,6 +3024,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_boot = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_PREFIX:
                         if (strv_push(&arg_include_prefixes, optarg) < 0)
                                 return log_oom();
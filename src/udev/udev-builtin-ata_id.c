@@ -8,7 +8,6 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <getopt.h>
 #include <linux/bsg.h>
 #include <linux/hdreg.h>
 #include <scsi/scsi.h>
@@ -28,7 +27,9 @@
 #include "fd-util.h"
 #include "libudev-private.h"
 #include "log.h"
+#include "stdio-util.h"
 #include "udev-util.h"
+#include "udev.h"
 
 #define COMMAND_TIMEOUT_MSEC (30 * 1000)
 
@@ -294,7 +295,6 @@ static void disk_identify_fixup_uint16 (uint8_t identify[512], unsigned int offs
 
 /**
  * disk_identify:
- * @udev: The libudev context.
  * @fd: File descriptor for the block device.
  * @out_identify: Return location for IDENTIFY data.
  * @out_is_packet_device: Return location for whether returned data is from a IDENTIFY PACKET DEVICE.
@@ -308,8 +308,7 @@ static void disk_identify_fixup_uint16 (uint8_t identify[512], unsigned int offs
  * Returns: 0 if the data was successfully obtained, otherwise
  * non-zero with errno set.
  */
-static int disk_identify(struct udev *udev,
-                         int fd,
+static int disk_identify(int fd,
                          uint8_t out_identify[512],
                          int *out_is_packet_device)
 {
@@ -389,8 +388,14 @@ out:
         return ret;
 }
 
-int main(int argc, char *argv[]) {
-        _cleanup_(udev_unrefp) struct udev *udev = NULL;
+static void add_property_int(struct udev_device *dev, bool test, const char *key, int val) {
+        char s[DECIMAL_STR_MAX(int)];
+
+        xsprintf(s, "%i", val);
+        udev_builtin_add_property(dev, test, key, s);
+}
+
+static int builtin_ata_id(struct udev_device *dev, int argc, char *argv[], bool test) {
         struct hd_driveid id;
         union {
                 uint8_t  byte[512];
@@ -400,58 +405,23 @@ int main(int argc, char *argv[]) {
         char model_enc[256];
         char serial[21];
         char revision[9];
-        const char *node = NULL;
-        int export = 0;
+        char serial_full[sizeof(model) + sizeof(serial)];
+        const char *node;
         _cleanup_close_ int fd = -1;
         uint16_t word;
         int is_packet_device = 0;
-        static const struct option options[] = {
-                { "export", no_argument, NULL, 'x' },
-                { "help", no_argument, NULL, 'h' },
-                {}
-        };
-
-        log_set_target(LOG_TARGET_AUTO);
-        udev_parse_config();
-        log_parse_environment();
-        log_open();
-
-        udev = udev_new();
-        if (udev == NULL)
-                return 0;
-
-        for (;;) {
-                int option;
-
-                option = getopt_long(argc, argv, "xh", options, NULL);
-                if (option == -1)
-                        break;
-
-                switch (option) {
-                case 'x':
-                        export = 1;
-                        break;
-                case 'h':
-                        printf("Usage: ata_id [--export] [--help] <device>\n"
-                               "  -x,--export    print values as environment keys\n"
-                               "  -h,--help      print this help text\n\n");
-                        return 0;
-                }
-        }
 
-        node = argv[optind];
-        if (node == NULL) {
-                log_error("no node specified");
-                return 1;
-        }
+        node = udev_device_get_devnode(dev);
+        if (!node)
+                return EXIT_FAILURE;
 
         fd = open(node, O_RDONLY|O_NONBLOCK|O_CLOEXEC);
         if (fd < 0) {
-                log_error("unable to open '%s'", node);
-                return 1;
+                log_debug_errno(errno, "Unable to open '%s': %m", node);
+                return EXIT_FAILURE;
         }
 
-        if (disk_identify(udev, fd, identify.byte, &is_packet_device) == 0) {
+        if (disk_identify(fd, identify.byte, &is_packet_device) == 0) {
                 /*
                  * fix up only the fields from the IDENTIFY data that we are going to
                  * use and copy it into the hd_driveid struct for convenience
@@ -483,7 +453,7 @@ int main(int argc, char *argv[]) {
                 /* If this fails, then try HDIO_GET_IDENTITY */
                 if (ioctl(fd, HDIO_GET_IDENTITY, &id) != 0) {
                         log_debug_errno(errno, "HDIO_GET_IDENTITY failed for '%s': %m", node);
-                        return 2;
+                        return EXIT_FAILURE;
                 }
         }
 
@@ -497,163 +467,163 @@ int main(int argc, char *argv[]) {
         util_replace_whitespace((char *) id.fw_rev, revision, 8);
         util_replace_chars(revision, NULL);
 
-        if (export) {
-                /* Set this to convey the disk speaks the ATA protocol */
-                printf("ID_ATA=1\n");
-
-                if ((id.config >> 8) & 0x80) {
-                        /* This is an ATAPI device */
-                        switch ((id.config >> 8) & 0x1f) {
-                        case 0:
-                                printf("ID_TYPE=cd\n");
-                                break;
-                        case 1:
-                                printf("ID_TYPE=tape\n");
-                                break;
-                        case 5:
-                                printf("ID_TYPE=cd\n");
-                                break;
-                        case 7:
-                                printf("ID_TYPE=optical\n");
-                                break;
-                        default:
-                                printf("ID_TYPE=generic\n");
-                                break;
-                        }
-                } else {
-                        printf("ID_TYPE=disk\n");
-                }
-                printf("ID_BUS=ata\n");
-                printf("ID_MODEL=%s\n", model);
-                printf("ID_MODEL_ENC=%s\n", model_enc);
-                printf("ID_REVISION=%s\n", revision);
-                if (serial[0] != '\0') {
-                        printf("ID_SERIAL=%s_%s\n", model, serial);
-                        printf("ID_SERIAL_SHORT=%s\n", serial);
-                } else {
-                        printf("ID_SERIAL=%s\n", model);
-                }
+        /* Set this to convey the disk speaks the ATA protocol */
+        udev_builtin_add_property(dev, test, "ID_ATA", "1");
 
-                if (id.command_set_1 & (1<<5)) {
-                        printf("ID_ATA_WRITE_CACHE=1\n");
-                        printf("ID_ATA_WRITE_CACHE_ENABLED=%d\n", (id.cfs_enable_1 & (1<<5)) ? 1 : 0);
-                }
-                if (id.command_set_1 & (1<<10)) {
-                        printf("ID_ATA_FEATURE_SET_HPA=1\n");
-                        printf("ID_ATA_FEATURE_SET_HPA_ENABLED=%d\n", (id.cfs_enable_1 & (1<<10)) ? 1 : 0);
-
-                        /*
-                         * TODO: use the READ NATIVE MAX ADDRESS command to get the native max address
-                         * so it is easy to check whether the protected area is in use.
-                         */
-                }
-                if (id.command_set_1 & (1<<3)) {
-                        printf("ID_ATA_FEATURE_SET_PM=1\n");
-                        printf("ID_ATA_FEATURE_SET_PM_ENABLED=%d\n", (id.cfs_enable_1 & (1<<3)) ? 1 : 0);
-                }
-                if (id.command_set_1 & (1<<1)) {
-                        printf("ID_ATA_FEATURE_SET_SECURITY=1\n");
-                        printf("ID_ATA_FEATURE_SET_SECURITY_ENABLED=%d\n", (id.cfs_enable_1 & (1<<1)) ? 1 : 0);
-                        printf("ID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN=%d\n", id.trseuc * 2);
-                        if ((id.cfs_enable_1 & (1<<1))) /* enabled */ {
-                                if (id.dlf & (1<<8))
-                                        printf("ID_ATA_FEATURE_SET_SECURITY_LEVEL=maximum\n");
-                                else
-                                        printf("ID_ATA_FEATURE_SET_SECURITY_LEVEL=high\n");
-                        }
-                        if (id.dlf & (1<<5))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN=%d\n", id.trsEuc * 2);
-                        if (id.dlf & (1<<4))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_EXPIRE=1\n");
-                        if (id.dlf & (1<<3))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_FROZEN=1\n");
-                        if (id.dlf & (1<<2))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_LOCKED=1\n");
-                }
-                if (id.command_set_1 & (1<<0)) {
-                        printf("ID_ATA_FEATURE_SET_SMART=1\n");
-                        printf("ID_ATA_FEATURE_SET_SMART_ENABLED=%d\n", (id.cfs_enable_1 & (1<<0)) ? 1 : 0);
-                }
-                if (id.command_set_2 & (1<<9)) {
-                        printf("ID_ATA_FEATURE_SET_AAM=1\n");
-                        printf("ID_ATA_FEATURE_SET_AAM_ENABLED=%d\n", (id.cfs_enable_2 & (1<<9)) ? 1 : 0);
-                        printf("ID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE=%d\n", id.acoustic >> 8);
-                        printf("ID_ATA_FEATURE_SET_AAM_CURRENT_VALUE=%d\n", id.acoustic & 0xff);
-                }
-                if (id.command_set_2 & (1<<5)) {
-                        printf("ID_ATA_FEATURE_SET_PUIS=1\n");
-                        printf("ID_ATA_FEATURE_SET_PUIS_ENABLED=%d\n", (id.cfs_enable_2 & (1<<5)) ? 1 : 0);
-                }
-                if (id.command_set_2 & (1<<3)) {
-                        printf("ID_ATA_FEATURE_SET_APM=1\n");
-                        printf("ID_ATA_FEATURE_SET_APM_ENABLED=%d\n", (id.cfs_enable_2 & (1<<3)) ? 1 : 0);
-                        if ((id.cfs_enable_2 & (1<<3)))
-                                printf("ID_ATA_FEATURE_SET_APM_CURRENT_VALUE=%d\n", id.CurAPMvalues & 0xff);
+        if ((id.config >> 8) & 0x80) {
+                /* This is an ATAPI device */
+                switch ((id.config >> 8) & 0x1f) {
+                case 0:
+                        udev_builtin_add_property(dev, test, "ID_TYPE", "cd");
+                        break;
+                case 1:
+                        udev_builtin_add_property(dev, test, "ID_TYPE", "tape");
+                        break;
+                case 5:
+                        udev_builtin_add_property(dev, test, "ID_TYPE", "cd");
+                        break;
+                case 7:
+                        udev_builtin_add_property(dev, test, "ID_TYPE", "optical");
+                        break;
+                default:
+                        udev_builtin_add_property(dev, test, "ID_TYPE", "generic");
+                        break;
                 }
-                if (id.command_set_2 & (1<<0))
-                        printf("ID_ATA_DOWNLOAD_MICROCODE=1\n");
+        } else {
+                udev_builtin_add_property(dev, test, "ID_TYPE", "disk");
+        }
+        udev_builtin_add_property(dev, test, "ID_BUS", "ata");
+        udev_builtin_add_property(dev, test, "ID_MODEL", model);
+        udev_builtin_add_property(dev, test, "ID_MODEL_ENC", model_enc);
+        udev_builtin_add_property(dev, test, "ID_REVISION", revision);
+        if (serial[0] != '\0') {
+                xsprintf(serial_full, "%s_%s", model, serial);
+                udev_builtin_add_property(dev, test, "ID_SERIAL", serial_full);
+                udev_builtin_add_property(dev, test, "ID_SERIAL_SHORT", serial);
+        } else
+                udev_builtin_add_property(dev, test, "ID_SERIAL", model);
+
+        if (id.command_set_1 & (1<<5)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_WRITE_CACHE", "1");
+                add_property_int(dev, test, "ID_ATA_WRITE_CACHE_ENABLED", (id.cfs_enable_1 & (1<<5)) ? 1 : 0);
+        }
+        if (id.command_set_1 & (1<<10)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_HPA", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_HPA_ENABLED", (id.cfs_enable_1 & (1<<10)) ? 1 : 0);
 
                 /*
-                 * Word 76 indicates the capabilities of a SATA device. A PATA device shall set
-                 * word 76 to 0000h or FFFFh. If word 76 is set to 0000h or FFFFh, then
-                 * the device does not claim compliance with the Serial ATA specification and words
-                 * 76 through 79 are not valid and shall be ignored.
+                 * TODO: use the READ NATIVE MAX ADDRESS command to get the native max address
+                 * so it is easy to check whether the protected area is in use.
                  */
-
-                word = identify.wyde[76];
-                if (!IN_SET(word, 0x0000, 0xffff)) {
-                        printf("ID_ATA_SATA=1\n");
-                        /*
-                         * If bit 2 of word 76 is set to one, then the device supports the Gen2
-                         * signaling rate of 3.0 Gb/s (see SATA 2.6).
-                         *
-                         * If bit 1 of word 76 is set to one, then the device supports the Gen1
-                         * signaling rate of 1.5 Gb/s (see SATA 2.6).
-                         */
-                        if (word & (1<<2))
-                                printf("ID_ATA_SATA_SIGNAL_RATE_GEN2=1\n");
-                        if (word & (1<<1))
-                                printf("ID_ATA_SATA_SIGNAL_RATE_GEN1=1\n");
+        }
+        if (id.command_set_1 & (1<<3)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_PM", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_PM_ENABLED", (id.cfs_enable_1 & (1<<3)) ? 1 : 0);
+        }
+        if (id.command_set_1 & (1<<1)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_SECURITY_ENABLED", (id.cfs_enable_1 & (1<<1)) ? 1 : 0);
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN", id.trseuc * 2);
+                if ((id.cfs_enable_1 & (1<<1))) /* enabled */ {
+                        if (id.dlf & (1<<8))
+                                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY_LEVEL", "maximum");
+                        else
+                                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY_LEVEL", "high");
                 }
+                if (id.dlf & (1<<5))
+                        add_property_int(dev, test, "ID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN", id.trsEuc * 2);
+                if (id.dlf & (1<<4))
+                        udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY_EXPIRE", "1");
+                if (id.dlf & (1<<3))
+                        udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY_FROZEN", "1");
+                if (id.dlf & (1<<2))
+                        udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SECURITY_LOCKED", "1");
+        }
+        if (id.command_set_1 & (1<<0)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_SMART", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_SMART_ENABLED", (id.cfs_enable_1 & (1<<0)) ? 1 : 0);
+        }
+        if (id.command_set_2 & (1<<9)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_AAM", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_AAM_ENABLED", (id.cfs_enable_2 & (1<<9)) ? 1 : 0);
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE", id.acoustic >> 8);
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_AAM_CURRENT_VALUE", id.acoustic & 0xff);
+        }
+        if (id.command_set_2 & (1<<5)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_PUIS", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_PUIS_ENABLED", (id.cfs_enable_2 & (1<<5)) ? 1 : 0);
+        }
+        if (id.command_set_2 & (1<<3)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_FEATURE_SET_APM", "1");
+                add_property_int(dev, test, "ID_ATA_FEATURE_SET_APM_ENABLED", (id.cfs_enable_2 & (1<<3)) ? 1 : 0);
+                if ((id.cfs_enable_2 & (1<<3)))
+                        add_property_int(dev, test, "ID_ATA_FEATURE_SET_APM_CURRENT_VALUE", id.CurAPMvalues & 0xff);
+        }
+        if (id.command_set_2 & (1<<0))
+                udev_builtin_add_property(dev, test, "ID_ATA_DOWNLOAD_MICROCODE", "1");
+
+        /*
+         * Word 76 indicates the capabilities of a SATA device. A PATA device shall set
+         * word 76 to 0000h or FFFFh. If word 76 is set to 0000h or FFFFh, then
+         * the device does not claim compliance with the Serial ATA specification and words
+         * 76 through 79 are not valid and shall be ignored.
+         */
 
-                /* Word 217 indicates the nominal media rotation rate of the device */
-                word = identify.wyde[217];
-                if (word == 0x0001)
-                        printf ("ID_ATA_ROTATION_RATE_RPM=0\n"); /* non-rotating e.g. SSD */
-                else if (word >= 0x0401 && word <= 0xfffe)
-                        printf ("ID_ATA_ROTATION_RATE_RPM=%d\n", word);
-
+        word = identify.wyde[76];
+        if (!IN_SET(word, 0x0000, 0xffff)) {
+                udev_builtin_add_property(dev, test, "ID_ATA_SATA", "1");
                 /*
-                 * Words 108-111 contain a mandatory World Wide Name (WWN) in the NAA IEEE Registered identifier
-                 * format. Word 108 bits (15:12) shall contain 5h, indicating that the naming authority is IEEE.
-                 * All other values are reserved.
+                 * If bit 2 of word 76 is set to one, then the device supports the Gen2
+                 * signaling rate of 3.0 Gb/s (see SATA 2.6).
+                 *
+                 * If bit 1 of word 76 is set to one, then the device supports the Gen1
+                 * signaling rate of 1.5 Gb/s (see SATA 2.6).
                  */
-                word = identify.wyde[108];
-                if ((word & 0xf000) == 0x5000) {
-                        uint64_t wwwn;
-
-                        wwwn   = identify.wyde[108];
-                        wwwn <<= 16;
-                        wwwn  |= identify.wyde[109];
-                        wwwn <<= 16;
-                        wwwn  |= identify.wyde[110];
-                        wwwn <<= 16;
-                        wwwn  |= identify.wyde[111];
-                        printf("ID_WWN=0x%1$" PRIx64 "\n"
-                               "ID_WWN_WITH_EXTENSION=0x%1$" PRIx64 "\n",
-                               wwwn);
-                }
+                if (word & (1<<2))
+                        udev_builtin_add_property(dev, test, "ID_ATA_SATA_SIGNAL_RATE_GEN2", "1");
+                if (word & (1<<1))
+                        udev_builtin_add_property(dev, test, "ID_ATA_SATA_SIGNAL_RATE_GEN1", "1");
+        }
 
-                /* from Linux's include/linux/ata.h */
-                if (IN_SET(identify.wyde[0], 0x848a, 0x844a) ||
-                    (identify.wyde[83] & 0xc004) == 0x4004)
-                        printf("ID_ATA_CFA=1\n");
-        } else {
-                if (serial[0] != '\0')
-                        printf("%s_%s\n", model, serial);
-                else
-                        printf("%s\n", model);
+        /* Word 217 indicates the nominal media rotation rate of the device */
+        word = identify.wyde[217];
+        if (word == 0x0001)
+                udev_builtin_add_property(dev, test, "ID_ATA_ROTATION_RATE_RPM", "0"); /* non-rotating e.g. SSD */
+        else if (word >= 0x0401 && word <= 0xfffe)
+                add_property_int(dev, test, "ID_ATA_ROTATION_RATE_RPM", word);
+
+        /*
+         * Words 108-111 contain a mandatory World Wide Name (WWN) in the NAA IEEE Registered identifier
+         * format. Word 108 bits (15:12) shall contain 5h, indicating that the naming authority is IEEE.
+         * All other values are reserved.
+         */
+        word = identify.wyde[108];
+        if ((word & 0xf000) == 0x5000) {
+                char wwn[2 + 16 + 1];
+                uint64_t wwwn;
+
+                wwwn   = identify.wyde[108];
+                wwwn <<= 16;
+                wwwn  |= identify.wyde[109];
+                wwwn <<= 16;
+                wwwn  |= identify.wyde[110];
+                wwwn <<= 16;
+                wwwn  |= identify.wyde[111];
+                xsprintf(wwn, "0x%" PRIx64, wwwn);
+                udev_builtin_add_property(dev, test, "ID_WWN", wwn);
+                udev_builtin_add_property(dev, test, "ID_WWN_WITH_EXTENSION", wwn);
         }
 
-        return 0;
+        /* from Linux's include/linux/ata.h */
+        if (IN_SET(identify.wyde[0], 0x848a, 0x844a) ||
+            (identify.wyde[83] & 0xc004) == 0x4004)
+                udev_builtin_add_property(dev, test, "ID_ATA_CFA", "1");
+
+        return EXIT_SUCCESS;
 }
+
+const struct udev_builtin udev_builtin_ata_id = {
+        .name = "ata_id",
+        .cmd = builtin_ata_id,
+        .help = "ATA disk identification",
+};
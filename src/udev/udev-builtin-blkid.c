@@ -23,8 +23,15 @@
 #include "gpt.h"
 #include "parse-util.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "udev.h"
 
+/* Most superblocks and partition tables live within the first MiB of a device */
+#define PROBE_READAHEAD_BYTES (1024U * 1024U)
+
+/* Probes taking longer than this are logged without debugging enabled */
+#define PROBE_SLOW_USEC (1 * USEC_PER_SEC)
+
 static void print_property(struct udev_device *dev, bool test, const char *name, const char *value) {
         char s[256];
 
@@ -211,6 +218,8 @@ static int probe_superblocks(blkid_probe pr) {
 
 static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool test) {
         const char *root_partition;
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t begin, elapsed;
         int64_t offset = 0;
         bool noraid = false;
         _cleanup_close_ int fd = -1;
@@ -277,7 +286,17 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                   udev_device_get_devnode(dev),
                   noraid ? "no" : "", offset);
 
+        /* Have the kernel read the region most probes look at in one go, instead of libblkid issuing small
+         * reads one after another. It then stays in the page cache, where the partitions of a disk, which are
+         * probed right after the disk itself, find the partition table again. */
+        (void) posix_fadvise(fd, offset, PROBE_READAHEAD_BYTES, POSIX_FADV_WILLNEED);
+
+        begin = now(CLOCK_MONOTONIC);
         err = probe_superblocks(pr);
+        elapsed = now(CLOCK_MONOTONIC) - begin;
+
+        log_full(elapsed >= PROBE_SLOW_USEC ? LOG_NOTICE : LOG_DEBUG,
+                 "probing %s took %s", udev_device_get_devnode(dev), format_timespan(ts, sizeof(ts), elapsed, USEC_PER_MSEC));
         if (err < 0)
                 goto out;
 
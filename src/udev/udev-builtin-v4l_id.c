@@ -13,76 +13,62 @@
  * General Public License for more details:
  */
 
-#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <linux/videodev2.h>
 
 #include "fd-util.h"
+#include "udev.h"
 #include "util.h"
 
-int main(int argc, char *argv[]) {
-        static const struct option options[] = {
-                { "help", no_argument, NULL, 'h' },
-                {}
-        };
+static int builtin_v4l_id(struct udev_device *dev, int argc, char *argv[], bool test) {
         _cleanup_close_ int fd = -1;
-        char *device;
+        const char *devnode;
         struct v4l2_capability v2cap;
-        int c;
+        char caps[128] = ":";
 
-        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0)
+        devnode = udev_device_get_devnode(dev);
+        if (!devnode)
+                return EXIT_FAILURE;
 
-                switch (c) {
-                case 'h':
-                        printf("%s [-h,--help] <device file>\n\n"
-                               "Video4Linux device identification.\n\n"
-                               "  -h  Print this message\n"
-                               , program_invocation_short_name);
-                        return 0;
-                case '?':
-                        return -EINVAL;
-
-                default:
-                        assert_not_reached("Unhandled option");
-                }
-
-        device = argv[optind];
-        if (device == NULL)
-                return 2;
-
-        fd = open(device, O_RDONLY);
-        if (fd < 0)
-                return 3;
+        fd = open(devnode, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0) {
+                log_debug_errno(errno, "Failed to open '%s': %m", devnode);
+                return EXIT_FAILURE;
+        }
 
         if (ioctl(fd, VIDIOC_QUERYCAP, &v2cap) == 0) {
-                printf("ID_V4L_VERSION=2\n");
-                printf("ID_V4L_PRODUCT=%s\n", v2cap.card);
-                printf("ID_V4L_CAPABILITIES=:");
+                udev_builtin_add_property(dev, test, "ID_V4L_VERSION", "2");
+                udev_builtin_add_property(dev, test, "ID_V4L_PRODUCT", (const char *) v2cap.card);
+
                 if ((v2cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) > 0 ||
                     (v2cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE) > 0)
-                        printf("capture:");
+                        strcat(caps, "capture:");
                 if ((v2cap.capabilities & V4L2_CAP_VIDEO_OUTPUT) > 0 ||
                     (v2cap.capabilities & V4L2_CAP_VIDEO_OUTPUT_MPLANE) > 0)
-                        printf("video_output:");
+                        strcat(caps, "video_output:");
                 if ((v2cap.capabilities & V4L2_CAP_VIDEO_OVERLAY) > 0)
-                        printf("video_overlay:");
+                        strcat(caps, "video_overlay:");
                 if ((v2cap.capabilities & V4L2_CAP_AUDIO) > 0)
-                        printf("audio:");
+                        strcat(caps, "audio:");
                 if ((v2cap.capabilities & V4L2_CAP_TUNER) > 0)
-                        printf("tuner:");
+                        strcat(caps, "tuner:");
                 if ((v2cap.capabilities & V4L2_CAP_RADIO) > 0)
-                        printf("radio:");
-                printf("\n");
+                        strcat(caps, "radio:");
+                udev_builtin_add_property(dev, test, "ID_V4L_CAPABILITIES", caps);
         }
 
-        return 0;
+        return EXIT_SUCCESS;
 }
+
+const struct udev_builtin udev_builtin_v4l_id = {
+        .name = "v4l_id",
+        .cmd = builtin_v4l_id,
+        .help = "Video4Linux device properties",
+};
@@ -13,6 +13,7 @@ static const struct udev_builtin *builtins[] = {
 #if HAVE_BLKID
         [UDEV_BUILTIN_BLKID] = &udev_builtin_blkid,
 #endif
+        [UDEV_BUILTIN_ATA_ID] = &udev_builtin_ata_id,
         [UDEV_BUILTIN_BTRFS] = &udev_builtin_btrfs,
         [UDEV_BUILTIN_HWDB] = &udev_builtin_hwdb,
         [UDEV_BUILTIN_INPUT_ID] = &udev_builtin_input_id,
@@ -24,6 +25,7 @@ static const struct udev_builtin *builtins[] = {
         [UDEV_BUILTIN_NET_LINK] = &udev_builtin_net_setup_link,
         [UDEV_BUILTIN_PATH_ID] = &udev_builtin_path_id,
         [UDEV_BUILTIN_USB_ID] = &udev_builtin_usb_id,
+        [UDEV_BUILTIN_V4L_ID] = &udev_builtin_v4l_id,
 #if HAVE_ACL
         [UDEV_BUILTIN_UACCESS] = &udev_builtin_uaccess,
 #endif
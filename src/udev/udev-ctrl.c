@@ -36,6 +36,7 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_GET_QUEUE_STATS,
 };
 
 struct udev_ctrl_msg_wire {
@@ -233,7 +234,8 @@ struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connect
         return NULL;
 }
 
-static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout) {
+static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout,
+                     struct udev_ctrl_msg_wire *reply) {
         struct udev_ctrl_msg_wire ctrl_msg_wire;
         int err = 0;
 
@@ -279,8 +281,23 @@ static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int
                         break;
                 }
 
-                if (r == 0)
+                if (r == 0) {
                         err = -ETIMEDOUT;
+                        break;
+                }
+
+                /* the peer answers before it closes the connection, if the request asks for an answer */
+                if (reply) {
+                        ssize_t size;
+
+                        size = recv(uctrl->sock, reply, sizeof(*reply), 0);
+                        if (size < 0)
+                                err = -errno;
+                        else if (size != sizeof(*reply) || reply->magic != UDEV_CTRL_MAGIC)
+                                err = -EBADMSG;
+                        else
+                                reply->buf[sizeof(reply->buf) - 1] = '\0';
+                }
                 break;
         }
 out:
@@ -288,35 +305,54 @@ out:
 }
 
 int udev_ctrl_send_set_log_level(struct udev_ctrl *uctrl, int priority, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_stop_exec_queue(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_STOP_EXEC_QUEUE, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_STOP_EXEC_QUEUE, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_start_exec_queue(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_START_EXEC_QUEUE, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_START_EXEC_QUEUE, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_reload(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_RELOAD, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_RELOAD, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_ENV, 0, key, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_ENV, 0, key, timeout, NULL);
 }
 
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_CHILDREN_MAX, count, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_CHILDREN_MAX, count, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_PING, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_PING, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout, NULL);
+}
+
+int udev_ctrl_send_get_queue_stats(struct udev_ctrl *uctrl, int timeout, char **ret) {
+        struct udev_ctrl_msg_wire reply = {};
+        char *s;
+        int r;
+
+        assert(ret);
+
+        r = ctrl_send(uctrl, UDEV_CTRL_GET_QUEUE_STATS, 0, NULL, timeout, &reply);
+        if (r < 0)
+                return r;
+
+        s = strdup(reply.buf);
+        if (!s)
+                return -ENOMEM;
+
+        *ret = s;
+        return 0;
 }
 
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn) {
@@ -458,3 +494,23 @@ int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg) {
                 return 1;
         return -1;
 }
+
+int udev_ctrl_get_queue_stats(struct udev_ctrl_msg *ctrl_msg) {
+        if (ctrl_msg->ctrl_msg_wire.type == UDEV_CTRL_GET_QUEUE_STATS)
+                return 1;
+        return -1;
+}
+
+int udev_ctrl_msg_reply(struct udev_ctrl_msg *ctrl_msg, const char *buf) {
+        struct udev_ctrl_msg_wire reply = {};
+
+        strcpy(reply.version, "udev-" PACKAGE_VERSION);
+        reply.magic = UDEV_CTRL_MAGIC;
+        reply.type = ctrl_msg->ctrl_msg_wire.type;
+        strscpy(reply.buf, sizeof(reply.buf), buf);
+
+        if (send(ctrl_msg->conn->sock, &reply, sizeof(reply), MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
+}
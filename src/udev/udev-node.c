@@ -13,6 +13,8 @@
 #include "dirent-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "parse-util.h"
+#include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
 #include "stdio-util.h"
@@ -111,6 +113,34 @@ exit:
         return err;
 }
 
+/* Every device claiming a link has an entry in the link's stack directory, a symlink pointing to
+ * "<priority>:<devnode>", so that finding the winner does not require loading the database of every
+ * competing device. Returns 0 if the entry has no such encoding, e.g. because it was created by an
+ * older udev as an empty file. */
+static int link_stack_entry_read(int dir_fd, const char *name, int *ret_priority, char *buf, size_t bufsize) {
+        char target[UTIL_PATH_SIZE];
+        char *devnode;
+        ssize_t len;
+
+        len = readlinkat(dir_fd, name, target, sizeof(target));
+        if (len < 0)
+                return errno == EINVAL ? 0 : -errno;
+        if ((size_t) len >= sizeof(target))
+                return 0;
+        target[len] = '\0';
+
+        devnode = strchr(target, ':');
+        if (!devnode || !path_startswith(devnode + 1, "/dev"))
+                return 0;
+        *devnode++ = '\0';
+
+        if (safe_atoi(target, ret_priority) < 0)
+                return 0;
+
+        strscpy(buf, bufsize, devnode);
+        return 1;
+}
+
 /* find device node of device with highest priority */
 static const char *link_find_prioritized(struct udev_device *dev, bool add, const char *stackdir, char *buf, size_t bufsize) {
         struct udev *udev = udev_device_get_udev(dev);
@@ -130,6 +160,8 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 return target;
         FOREACH_DIRENT_ALL(dent, dir, break) {
                 struct udev_device *dev_db;
+                char devnode_buf[UTIL_PATH_SIZE];
+                int prio, r;
 
                 if (dent->d_name[0] == '\0')
                         break;
@@ -142,6 +174,19 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 if (streq(dent->d_name, udev_device_get_id_filename(dev)))
                         continue;
 
+                r = link_stack_entry_read(dirfd(dir), dent->d_name, &prio, devnode_buf, sizeof(devnode_buf));
+                if (r == -ENOENT)
+                        continue;
+                if (r > 0) {
+                        if (target == NULL || prio > priority) {
+                                log_debug("'%s' claims priority %i for '%s'", dent->d_name, prio, stackdir);
+                                priority = prio;
+                                strscpy(buf, bufsize, devnode_buf);
+                                target = buf;
+                        }
+                        continue;
+                }
+
                 dev_db = udev_device_new_from_device_id(udev, dent->d_name);
                 if (dev_db != NULL) {
                         const char *devnode;
@@ -189,19 +234,16 @@ static void link_update(struct udev_device *dev, const char *slink, bool add) {
         }
 
         if (add) {
+                char entry[DECIMAL_STR_MAX(int) + 1 + UTIL_PATH_SIZE];
                 int err;
 
-                do {
-                        int fd;
+                xsprintf(entry, "%i:%s", udev_device_get_devlink_priority(dev), udev_device_get_devnode(dev));
 
+                do {
                         err = mkdir_parents(filename, 0755);
                         if (!IN_SET(err, 0, -ENOENT))
                                 break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd >= 0)
-                                close(fd);
-                        else
-                                err = -errno;
+                        err = symlink_atomic(entry, filename);
                 } while (err == -ENOENT);
         }
 }
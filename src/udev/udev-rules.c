@@ -10,18 +10,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "sd-id128.h"
+
 #include "alloc-util.h"
 #include "conf-files.h"
 #include "dirent-util.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
+#include "mkdir.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "strbuf.h"
@@ -34,6 +41,11 @@
 
 #define PREALLOC_TOKEN          2048
 
+/* the compiled rules of the last parse, mapped directly as long as no rules file changed */
+#define RULES_CACHE             "/run/udev/rules.bin"
+#define RULES_CACHE_SIGNATURE   "UDEVRUL1"
+#define RULES_CACHE_HASH_KEY    SD_ID128_MAKE(85,1c,3b,a9,1f,6d,4e,07,b7,53,35,2c,8e,a1,0d,94)
+
 struct uid_gid {
         unsigned int name_off;
         union {
@@ -49,6 +61,14 @@ static const char* const rules_dirs[] = {
         NULL
 };
 
+/* the indices of the TK_RULE tokens of the rules restricted to one subsystem, in rule order */
+struct rule_list {
+        char *subsystem;
+        unsigned int *rules;
+        size_t n_rules;
+        size_t n_allocated;
+};
+
 struct udev_rules {
         struct udev *udev;
         usec_t dirs_ts_usec;
@@ -62,6 +82,14 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* tokens and strings mapped from the cache file, instead of parsed */
+        void *cache;
+        size_t cache_size;
+
+        /* rules by the subsystem they are restricted to, and all others, see rules_build_index() */
+        Hashmap *subsystem_rules;
+        struct rule_list generic_rules;
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -100,6 +128,7 @@ enum string_glob_type {
         GL_SPLIT,                       /* multi-value A|B */
         GL_SPLIT_GLOB,                  /* multi-value with glob A*|B* */
         GL_SOMETHING,                   /* commonly used "?*" */
+        GL_PREFIX,                      /* glob with only a trailing "*" */
 };
 
 enum string_subst_type {
@@ -240,6 +269,7 @@ static const char *string_glob_str(enum string_glob_type type) {
                 [GL_SPLIT] =            "split",
                 [GL_SPLIT_GLOB] =       "split-glob",
                 [GL_SOMETHING] =        "split-glob",
+                [GL_PREFIX] =           "prefix",
         };
 
         return string_glob_strs[type];
@@ -925,8 +955,15 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
                 } else if (has_split) {
                         glob = GL_SPLIT;
                 } else if (has_glob) {
+                        size_t len = strlen(value);
+
                         if (streq(value, "?*"))
                                 glob = GL_SOMETHING;
+                        else if (value[len-1] == '*' &&
+                                 strcspn(value, GLOB_CHARS "\\") == len-1)
+                                /* "sd*" and friends are by far the most common globs, a prefix comparison is all
+                                 * they need */
+                                glob = GL_PREFIX;
                         else
                                 glob = GL_GLOB;
                 } else {
@@ -1513,11 +1550,332 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
         return 0;
 }
 
+static struct rule_list *rule_list_free(struct rule_list *l) {
+        if (l == NULL)
+                return NULL;
+
+        free(l->subsystem);
+        free(l->rules);
+        return mfree(l);
+}
+
+static int rule_list_add(struct rule_list *l, unsigned int i) {
+        /* the same subsystem may be listed more than once in a rule */
+        if (l->n_rules > 0 && l->rules[l->n_rules-1] == i)
+                return 0;
+
+        if (!GREEDY_REALLOC(l->rules, l->n_allocated, l->n_rules + 1))
+                return -ENOMEM;
+
+        l->rules[l->n_rules++] = i;
+        return 0;
+}
+
+static int rules_add_to_subsystem(struct udev_rules *rules, const char *subsystem, size_t len, unsigned int i) {
+        _cleanup_free_ char *k = NULL;
+        struct rule_list *l;
+        int r;
+
+        k = strndup(subsystem, len);
+        if (k == NULL)
+                return -ENOMEM;
+
+        l = hashmap_get(rules->subsystem_rules, k);
+        if (l == NULL) {
+                l = new0(struct rule_list, 1);
+                if (l == NULL)
+                        return -ENOMEM;
+
+                l->subsystem = TAKE_PTR(k);
+
+                r = hashmap_put(rules->subsystem_rules, l->subsystem, l);
+                if (r < 0) {
+                        rule_list_free(l);
+                        return r;
+                }
+        }
+
+        return rule_list_add(l, i);
+}
+
+static void rules_free_index(struct udev_rules *rules) {
+        struct rule_list *l;
+
+        while ((l = hashmap_steal_first(rules->subsystem_rules)))
+                rule_list_free(l);
+        rules->subsystem_rules = hashmap_free(rules->subsystem_rules);
+
+        rules->generic_rules.rules = mfree(rules->generic_rules.rules);
+        rules->generic_rules.n_rules = rules->generic_rules.n_allocated = 0;
+}
+
+static int rules_build_index(struct udev_rules *rules) {
+        unsigned int i;
+        int r;
+
+        /*
+         * Sort the rules by the subsystem they are restricted to with a plain SUBSYSTEM=="…" match, if any. The
+         * keys of a rule are sorted by type, and the subsystem is compared before any key with side effects
+         * (PROGRAM, IMPORT, …), hence a rule for another subsystem can't do anything for an event, and
+         * udev_rules_apply_to_event() skips right over it, instead of looking at every single rule.
+         */
+
+        rules->subsystem_rules = hashmap_new(&string_hash_ops);
+        if (rules->subsystem_rules == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < rules->token_cur; i++) {
+                struct token *rule = &rules->tokens[i];
+                const char *subsystems = NULL;
+                unsigned int j;
+
+                if (rule->type != TK_RULE)
+                        continue;
+
+                for (j = 1; j < rule->rule.token_count; j++) {
+                        if (rule[j].type > TK_M_SUBSYSTEM)
+                                break;
+
+                        if (rule[j].type == TK_M_SUBSYSTEM &&
+                            rule[j].key.op == OP_MATCH &&
+                            IN_SET(rule[j].key.glob, GL_PLAIN, GL_SPLIT)) {
+                                subsystems = rules_str(rules, rule[j].key.value_off);
+                                break;
+                        }
+                }
+
+                if (subsystems == NULL) {
+                        r = rule_list_add(&rules->generic_rules, i);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                for (;;) {
+                        size_t len = strcspn(subsystems, "|");
+
+                        r = rules_add_to_subsystem(rules, subsystems, len, i);
+                        if (r < 0)
+                                return r;
+
+                        if (subsystems[len] == '\0')
+                                break;
+                        subsystems += len + 1;
+                }
+        }
+
+        log_debug("rules indexed by %u subsystems, %zu rules for any subsystem",
+                  hashmap_size(rules->subsystem_rules), rules->generic_rules.n_rules);
+        return 0;
+}
+
+static struct token *rules_next_candidate(struct udev_rules *rules, const struct rule_list *specific,
+                                          size_t *g, size_t *s, unsigned int i) {
+        unsigned int next = rules->token_cur - 1; /* TK_END */
+
+        /* GOTOs only jump forward, hence the positions in both lists only ever move forward too */
+
+        while (*g < rules->generic_rules.n_rules && rules->generic_rules.rules[*g] < i)
+                (*g)++;
+        if (*g < rules->generic_rules.n_rules)
+                next = MIN(next, rules->generic_rules.rules[*g]);
+
+        if (specific != NULL) {
+                while (*s < specific->n_rules && specific->rules[*s] < i)
+                        (*s)++;
+                if (*s < specific->n_rules)
+                        next = MIN(next, specific->rules[*s]);
+        }
+
+        return &rules->tokens[next];
+}
+
+struct rules_cache_header {
+        char signature[8];
+        uint64_t stamp;
+        uint64_t header_size;
+        uint64_t token_size;
+        uint64_t tokens_count;
+        uint64_t strings_len;
+};
+
+static int rules_cache_stamp(char **files, int resolve_names, uint64_t *ret) {
+        struct siphash state;
+        const char *p;
+        char **f;
+
+        /*
+         * Everything the compiled rules depend on: the rules files themselves, the user and group
+         * databases since names are resolved at parse time, the way they are resolved, and the
+         * token layout of this build.
+         */
+
+        siphash24_init(&state, RULES_CACHE_HASH_KEY.bytes);
+        siphash24_compress(PACKAGE_VERSION, sizeof(PACKAGE_VERSION), &state);
+        siphash24_compress(&(const unsigned[]) { TK_END, sizeof(struct token) }, 2 * sizeof(unsigned), &state);
+        siphash24_compress(&resolve_names, sizeof(resolve_names), &state);
+
+        STRV_FOREACH(f, files) {
+                struct stat st;
+                uint64_t v[5];
+
+                if (stat(*f, &st) < 0)
+                        return -errno;
+
+                /* The mtime may be set back after modifying the file, the ctime can't */
+                v[0] = timespec_load_nsec(&st.st_mtim);
+                v[1] = timespec_load_nsec(&st.st_ctim);
+                v[2] = st.st_size;
+                v[3] = st.st_ino;
+                v[4] = st.st_dev;
+
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+                siphash24_compress(v, sizeof(v), &state);
+        }
+
+        FOREACH_STRING(p, "/etc/passwd", "/etc/group") {
+                struct stat st;
+                uint64_t v[4];
+
+                if (stat(p, &st) < 0) {
+                        if (errno != ENOENT)
+                                return -errno;
+                        continue;
+                }
+
+                v[0] = timespec_load_nsec(&st.st_mtim);
+                v[1] = timespec_load_nsec(&st.st_ctim);
+                v[2] = st.st_size;
+                v[3] = st.st_ino;
+
+                siphash24_compress(p, strlen(p) + 1, &state);
+                siphash24_compress(v, sizeof(v), &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static int rules_load_cache(struct udev_rules *rules, uint64_t stamp) {
+        const struct rules_cache_header *h;
+        _cleanup_close_ int fd = -1;
+        const char *strings;
+        struct stat st;
+        void *map;
+
+        fd = open(RULES_CACHE, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* only trust what we wrote ourselves */
+        if (st.st_uid != geteuid() || (st.st_mode & 0022) != 0)
+                return -EPERM;
+
+        if ((size_t) st.st_size < sizeof(struct rules_cache_header))
+                return -EBADMSG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        h = map;
+        if (memcmp(h->signature, RULES_CACHE_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->header_size != sizeof(struct rules_cache_header) ||
+            h->token_size != sizeof(struct token) ||
+            h->tokens_count == 0 || h->tokens_count > UINT_MAX ||
+            h->strings_len == 0 ||
+            h->header_size + h->tokens_count * h->token_size + h->strings_len != (uint64_t) st.st_size)
+                goto fail;
+
+        if (h->stamp != stamp) {
+                log_debug("rules files changed, not using compiled rules from %s", RULES_CACHE);
+                goto fail;
+        }
+
+        rules->tokens = (struct token*) ((uint8_t*) map + h->header_size);
+        rules->token_cur = rules->token_max = h->tokens_count;
+        strings = (const char*) (rules->tokens + rules->token_cur);
+
+        if (rules->tokens[rules->token_cur-1].type != TK_END || strings[h->strings_len-1] != '\0')
+                goto fail;
+
+        /* a strbuf that just wraps the mapped strings, it must never be completed or cleaned up */
+        rules->strbuf = new0(struct strbuf, 1);
+        if (rules->strbuf == NULL) {
+                munmap(map, st.st_size);
+                return -ENOMEM;
+        }
+        rules->strbuf->buf = (char*) strings;
+        rules->strbuf->len = h->strings_len;
+
+        rules->cache = map;
+        rules->cache_size = st.st_size;
+
+        log_debug("loaded %u compiled rules tokens, %zu bytes strings from %s",
+                  rules->token_cur, rules->strbuf->len, RULES_CACHE);
+        return 0;
+
+fail:
+        rules->tokens = NULL;
+        rules->token_cur = rules->token_max = 0;
+        munmap(map, st.st_size);
+        return -EBADMSG;
+}
+
+static int rules_write_cache(struct udev_rules *rules, uint64_t stamp) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *temp = NULL;
+        struct rules_cache_header h = {
+                .signature = RULES_CACHE_SIGNATURE,
+                .stamp = stamp,
+                .header_size = sizeof(struct rules_cache_header),
+                .token_size = sizeof(struct token),
+                .tokens_count = rules->token_cur,
+                .strings_len = rules->strbuf->len,
+        };
+        int r;
+
+        r = mkdir_parents(RULES_CACHE, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(RULES_CACHE, &f, &temp);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(rules->tokens, sizeof(struct token), rules->token_cur, f);
+        fwrite(rules->strbuf->buf, 1, rules->strbuf->len, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp, RULES_CACHE) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        log_debug("wrote compiled rules to %s", RULES_CACHE);
+        return 0;
+
+fail:
+        (void) unlink(temp);
+        return r;
+}
+
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         struct udev_rules *rules;
         struct udev_list file_list;
         struct token end_token;
         char **files, **f;
+        uint64_t stamp;
+        bool have_stamp;
         int r;
 
         rules = new0(struct udev_rules, 1);
@@ -1527,21 +1885,36 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         rules->resolve_names = resolve_names;
         udev_list_init(udev, &file_list, true);
 
+        udev_rules_check_timestamp(rules);
+
+        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules_dirs);
+        if (r < 0) {
+                log_error_errno(r, "failed to enumerate rules files: %m");
+                return udev_rules_unref(rules);
+        }
+
+        /* skip parsing entirely if nothing changed since the rules were compiled the last time */
+        r = rules_cache_stamp(files, resolve_names, &stamp);
+        if (r < 0)
+                log_debug_errno(r, "failed to check rules files, not using compiled rules: %m");
+        have_stamp = r >= 0;
+
+        if (have_stamp && rules_load_cache(rules, stamp) >= 0) {
+                strv_free(files);
+                goto finish;
+        }
+
         /* init token array and string buffer */
         rules->tokens = malloc_multiply(PREALLOC_TOKEN, sizeof(struct token));
-        if (rules->tokens == NULL)
+        if (rules->tokens == NULL) {
+                strv_free(files);
                 return udev_rules_unref(rules);
+        }
         rules->token_max = PREALLOC_TOKEN;
 
         rules->strbuf = strbuf_new();
-        if (!rules->strbuf)
-                return udev_rules_unref(rules);
-
-        udev_rules_check_timestamp(rules);
-
-        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules_dirs);
-        if (r < 0) {
-                log_error_errno(r, "failed to enumerate rules files: %m");
+        if (!rules->strbuf) {
+                strv_free(files);
                 return udev_rules_unref(rules);
         }
 
@@ -1577,6 +1950,19 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         rules->gids_cur = 0;
         rules->gids_max = 0;
 
+        if (have_stamp) {
+                r = rules_write_cache(rules, stamp);
+                if (r < 0)
+                        log_debug_errno(r, "failed to write compiled rules to %s, ignoring: %m", RULES_CACHE);
+        }
+
+finish:
+        r = rules_build_index(rules);
+        if (r < 0) {
+                log_warning_errno(r, "failed to index rules, looking at all of them for every event: %m");
+                rules_free_index(rules);
+        }
+
         dump_rules(rules);
         return rules;
 }
@@ -1584,8 +1970,15 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
 struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
         if (rules == NULL)
                 return NULL;
-        free(rules->tokens);
-        strbuf_cleanup(rules->strbuf);
+        rules_free_index(rules);
+        if (rules->cache) {
+                /* tokens and strings point into the mapping */
+                munmap(rules->cache, rules->cache_size);
+                free(rules->strbuf);
+        } else {
+                free(rules->tokens);
+                strbuf_cleanup(rules->strbuf);
+        }
         free(rules->uids);
         free(rules->gids);
         return mfree(rules);
@@ -1660,6 +2053,9 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
         case GL_SOMETHING:
                 match = (val[0] != '\0');
                 break;
+        case GL_PREFIX:
+                match = strneq(key_value, val, strlen(key_value) - 1);
+                break;
         case GL_UNSET:
                 return -1;
         }
@@ -1732,6 +2128,8 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                struct udev_list *properties_list) {
         struct token *cur;
         struct token *rule;
+        const struct rule_list *specific = NULL;
+        size_t g = 0, s = 0;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
         int r;
@@ -1739,6 +2137,9 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
         if (rules->tokens == NULL)
                 return;
 
+        if (rules->subsystem_rules != NULL)
+                specific = hashmap_get(rules->subsystem_rules, strempty(udev_device_get_subsystem(event->dev)));
+
         can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
@@ -1750,6 +2151,17 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
+                        /* fast-forward to the next rule that may apply to this subsystem */
+                        if (rules->subsystem_rules != NULL) {
+                                struct token *next;
+
+                                next = rules_next_candidate(rules, specific, &g, &s, cur - rules->tokens);
+                                if (next != cur) {
+                                        cur = next;
+                                        continue;
+                                }
+                        }
+
                         /* current rule */
                         rule = cur;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
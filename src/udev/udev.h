@@ -115,6 +115,7 @@ int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout);
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout);
+int udev_ctrl_send_get_queue_stats(struct udev_ctrl *uctrl, int timeout, char **ret);
 struct udev_ctrl_connection;
 struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl);
 struct udev_ctrl_connection *udev_ctrl_connection_ref(struct udev_ctrl_connection *conn);
@@ -130,12 +131,15 @@ int udev_ctrl_get_ping(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg);
 const char *udev_ctrl_get_set_env(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_set_children_max(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_get_queue_stats(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_msg_reply(struct udev_ctrl_msg *ctrl_msg, const char *buf);
 
 /* built-in commands */
 enum udev_builtin_cmd {
 #if HAVE_BLKID
         UDEV_BUILTIN_BLKID,
 #endif
+        UDEV_BUILTIN_ATA_ID,
         UDEV_BUILTIN_BTRFS,
         UDEV_BUILTIN_HWDB,
         UDEV_BUILTIN_INPUT_ID,
@@ -147,6 +151,7 @@ enum udev_builtin_cmd {
         UDEV_BUILTIN_NET_LINK,
         UDEV_BUILTIN_PATH_ID,
         UDEV_BUILTIN_USB_ID,
+        UDEV_BUILTIN_V4L_ID,
 #if HAVE_ACL
         UDEV_BUILTIN_UACCESS,
 #endif
@@ -164,6 +169,7 @@ struct udev_builtin {
 #if HAVE_BLKID
 extern const struct udev_builtin udev_builtin_blkid;
 #endif
+extern const struct udev_builtin udev_builtin_ata_id;
 extern const struct udev_builtin udev_builtin_btrfs;
 extern const struct udev_builtin udev_builtin_hwdb;
 extern const struct udev_builtin udev_builtin_input_id;
@@ -175,6 +181,7 @@ extern const struct udev_builtin udev_builtin_net_id;
 extern const struct udev_builtin udev_builtin_net_setup_link;
 extern const struct udev_builtin udev_builtin_path_id;
 extern const struct udev_builtin udev_builtin_usb_id;
+extern const struct udev_builtin udev_builtin_v4l_id;
 extern const struct udev_builtin udev_builtin_uaccess;
 void udev_builtin_init(struct udev *udev);
 void udev_builtin_exit(struct udev *udev);
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "process-util.h"
 #include "time-util.h"
 #include "udev.h"
@@ -36,6 +37,7 @@ static void print_help(void) {
                "  -R --reload              Reload rules and databases\n"
                "  -p --property=KEY=VALUE  Set a global property for all events\n"
                "  -m --children-max=N      Maximum number of children\n"
+               "  -Q --queue-stats         Show event queue statistics\n"
                "  -t --timeout=SECONDS     Maximum time to block for a reply\n"
                , program_invocation_short_name);
 }
@@ -55,6 +57,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
                 { "property",         required_argument, NULL, 'p' },
                 { "env",              required_argument, NULL, 'p' }, /* alias for -p */
                 { "children-max",     required_argument, NULL, 'm' },
+                { "queue-stats",      no_argument,       NULL, 'Q' },
                 { "timeout",          required_argument, NULL, 't' },
                 { "version",          no_argument,       NULL, 'V' },
                 { "help",             no_argument,       NULL, 'h' },
@@ -68,7 +71,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
         if (uctrl == NULL)
                 return 2;
 
-        while ((c = getopt_long(argc, argv, "el:sSRp:m:t:Vh", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "el:sSRp:m:Qt:Vh", options, NULL)) >= 0)
                 switch (c) {
                 case 'e':
                         if (udev_ctrl_send_exit(uctrl, timeout) < 0)
@@ -133,6 +136,17 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
                                 rc = 0;
                         break;
                 }
+                case 'Q': {
+                        _cleanup_free_ char *stats = NULL;
+
+                        if (udev_ctrl_send_get_queue_stats(uctrl, timeout, &stats) < 0)
+                                rc = 2;
+                        else {
+                                fputs(stats, stdout);
+                                rc = 0;
+                        }
+                        break;
+                }
                 case 't': {
                         int r, seconds;
                         usec_t s;
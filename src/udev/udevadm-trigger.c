@@ -8,7 +8,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "fd-util.h"
+#include "parse-util.h"
 #include "set.h"
 #include "string-util.h"
 #include "udev.h"
@@ -18,7 +20,79 @@
 static int verbose;
 static int dry_run;
 
-static int exec_list(struct udev_enumerate *udev_enumerate, const char *action, Set *settle_set) {
+/* If no triggered event completes for this long, ask udevd whether it is still busy at all, the monitor might
+ * have missed the results when its socket buffer overflowed */
+#define PENDING_STALL_TIMEOUT_MSEC (5 * MSEC_PER_SEC)
+
+static bool udevd_queue_is_empty(struct udev *udev) {
+        _cleanup_(udev_ctrl_unrefp) struct udev_ctrl *uctrl = NULL;
+        _cleanup_free_ char *stats = NULL;
+
+        uctrl = udev_ctrl_new(udev);
+        if (!uctrl)
+                return false;
+
+        if (udev_ctrl_send_get_queue_stats(uctrl, 5, &stats) < 0)
+                return false;
+
+        return startswith(stats, "QUEUED=0\n");
+}
+
+static int wait_pending(struct udev *udev, struct udev_monitor *udev_monitor, int fd_ep, Set *settle_set, unsigned max) {
+        int fd_udev;
+
+        assert(udev_monitor);
+        assert(fd_ep >= 0);
+
+        fd_udev = udev_monitor_get_fd(udev_monitor);
+
+        /* Waits until at most 'max' of the triggered events are still being processed */
+        while (set_size(settle_set) > max) {
+                int fdcount;
+                struct epoll_event ev[4];
+                int i;
+
+                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), PENDING_STALL_TIMEOUT_MSEC);
+                if (fdcount < 0) {
+                        if (errno != EINTR)
+                                log_error_errno(errno, "error receiving uevent message: %m");
+                        continue;
+                }
+
+                if (fdcount == 0) {
+                        if (udevd_queue_is_empty(udev)) {
+                                log_debug("udevd is idle, assuming the remaining %u events have been processed", set_size(settle_set));
+                                set_clear_free(settle_set);
+                        }
+                        continue;
+                }
+
+                for (i = 0; i < fdcount; i++) {
+                        if (ev[i].data.fd == fd_udev && ev[i].events & EPOLLIN) {
+                                _cleanup_(udev_device_unrefp) struct udev_device *device;
+                                const char *syspath = NULL;
+                                char *p;
+
+                                device = udev_monitor_receive_device(udev_monitor);
+                                if (!device)
+                                        continue;
+
+                                syspath = udev_device_get_syspath(device);
+                                if (verbose)
+                                        printf("settle %s\n", syspath);
+                                p = set_remove(settle_set, syspath);
+                                if (!p)
+                                        log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
+                                free(p);
+                        }
+                }
+        }
+
+        return 0;
+}
+
+static int exec_list(struct udev *udev, struct udev_enumerate *udev_enumerate, const char *action,
+                     struct udev_monitor *udev_monitor, int fd_ep, Set *settle_set, unsigned max_pending) {
         struct udev_list_entry *entry;
         int r;
 
@@ -39,13 +113,26 @@ static int exec_list(struct udev_enumerate *udev_enumerate, const char *action,
                         continue;
 
                 if (settle_set) {
+                        /* Triggering everything at once might overflow the kernel's netlink buffers and
+                         * udevd's queue on large machines, hence only keep a window of events outstanding */
+                        if (max_pending > 0) {
+                                r = wait_pending(udev, udev_monitor, fd_ep, settle_set, max_pending - 1);
+                                if (r < 0)
+                                        return r;
+                        }
+
                         r = set_put_strdup(settle_set, syspath);
                         if (r < 0)
                                 return log_oom();
                 }
 
-                if (write(fd, action, strlen(action)) < 0)
+                if (write(fd, action, strlen(action)) < 0) {
                         log_debug_errno(errno, "error writing '%s' to '%s': %m", action, filename);
+
+                        /* no event will show up for this one */
+                        if (settle_set)
+                                free(set_remove(settle_set, syspath));
+                }
         }
 
         return 0;
@@ -85,12 +172,14 @@ static void help(void) {
                "     --name-match=NAME              Trigger devices with this /dev name\n"
                "  -b --parent-match=NAME            Trigger devices with that parent device\n"
                "  -w --settle                       Wait for the triggered events to complete\n"
+               "     --max-pending=NUMBER           Maximum number of triggered events being processed at a time\n"
                , program_invocation_short_name);
 }
 
 static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         enum {
                 ARG_NAME = 0x100,
+                ARG_MAX_PENDING,
         };
 
         static const struct option options[] = {
@@ -108,6 +197,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 { "name-match",        required_argument, NULL, ARG_NAME },
                 { "parent-match",      required_argument, NULL, 'b'      },
                 { "settle",            no_argument,       NULL, 'w'      },
+                { "max-pending",       required_argument, NULL, ARG_MAX_PENDING },
                 { "version",           no_argument,       NULL, 'V'      },
                 { "help",              no_argument,       NULL, 'h'      },
                 {}
@@ -123,6 +213,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         int fd_udev = -1;
         struct epoll_event ep_udev;
         bool settle = false;
+        unsigned max_pending = 0;
         _cleanup_set_free_free_ Set *settle_set = NULL;
         int c, r;
 
@@ -232,6 +323,14 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                         settle = true;
                         break;
 
+                case ARG_MAX_PENDING:
+                        r = safe_atou(optarg, &max_pending);
+                        if (r < 0) {
+                                log_error_errno(r, "invalid number '%s': %m", optarg);
+                                return 2;
+                        }
+                        break;
+
                 case ARG_NAME: {
                         _cleanup_(udev_device_unrefp) struct udev_device *dev;
 
@@ -278,7 +377,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 }
         }
 
-        if (settle) {
+        if (settle || max_pending > 0) {
                 fd_ep = epoll_create1(EPOLL_CLOEXEC);
                 if (fd_ep < 0) {
                         log_error_errno(errno, "error creating epoll fd: %m");
@@ -320,38 +419,14 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         default:
                 assert_not_reached("device_type");
         }
-        r = exec_list(udev_enumerate, action, settle_set);
+        r = exec_list(udev, udev_enumerate, action, udev_monitor, fd_ep, settle_set, max_pending);
         if (r < 0)
                 return 1;
 
-        while (!set_isempty(settle_set)) {
-                int fdcount;
-                struct epoll_event ev[4];
-                int i;
-
-                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
-                if (fdcount < 0) {
-                        if (errno != EINTR)
-                                log_error_errno(errno, "error receiving uevent message: %m");
-                        continue;
-                }
-
-                for (i = 0; i < fdcount; i++) {
-                        if (ev[i].data.fd == fd_udev && ev[i].events & EPOLLIN) {
-                                _cleanup_(udev_device_unrefp) struct udev_device *device;
-                                const char *syspath = NULL;
-
-                                device = udev_monitor_receive_device(udev_monitor);
-                                if (!device)
-                                        continue;
-
-                                syspath = udev_device_get_syspath(device);
-                                if (verbose)
-                                        printf("settle %s\n", syspath);
-                                if (!set_remove(settle_set, syspath))
-                                        log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
-                        }
-                }
+        if (settle) {
+                r = wait_pending(udev, udev_monitor, fd_ep, settle_set, 0);
+                if (r < 0)
+                        return 1;
         }
 
         return 0;
@@ -34,6 +34,8 @@
 #include "cgroup-util.h"
 #include "cpu-set-util.h"
 #include "dev-setup.h"
+#include "device-db-store.h"
+#include "dirent-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
@@ -41,11 +43,13 @@
 #include "hashmap.h"
 #include "io-util.h"
 #include "list.h"
+#include "mkdir.h"
 #include "netlink-util.h"
 #include "parse-util.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
 #include "selinux-util.h"
+#include "set.h"
 #include "signal-util.h"
 #include "socket-util.h"
 #include "string-util.h"
@@ -62,11 +66,37 @@ static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
 
+typedef struct QueueStats {
+        unsigned n_events;
+        unsigned n_events_max;
+        unsigned n_ready;
+        unsigned n_running;
+        uint64_t n_processed;
+        usec_t wait_total;
+        usec_t wait_max;
+        usec_t latency_total;
+        usec_t latency_max;
+} QueueStats;
+
 typedef struct Manager {
         struct udev *udev;
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        struct event *events_tail;
+
+        /* The queued events that do not wait for any earlier event anymore, in the order they became runnable */
+        LIST_HEAD(struct event, ready_events);
+        struct event *ready_tail;
+
+        /* Indexes of the queued events, to find the earlier events a new one has to wait for */
+        Hashmap *devpath_nodes;
+        Hashmap *last_block_event;
+        Hashmap *last_char_event;
+        Hashmap *last_ifindex_event;
+
+        QueueStats stats;
+
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -83,10 +113,17 @@ typedef struct Manager {
         sd_event_source *uevent_event;
         sd_event_source *inotify_event;
 
+        /* The contents of the database directory, by device id, to write the store from */
+        Hashmap *db_entries;
+        int fd_db_inotify;
+        sd_event_source *db_inotify_event;
+        sd_event_source *db_store_timer;
+
         usec_t last_usec;
 
         bool stop_exec_queue:1;
         bool exit:1;
+        bool db_dirty:1;
 } Manager;
 
 enum event_state {
@@ -103,16 +140,38 @@ struct event {
         struct udev_device *dev_kernel;
         struct worker *worker;
         enum event_state state;
-        unsigned long long int delaying_seqnum;
         unsigned long long int seqnum;
         const char *devpath;
-        size_t devpath_len;
         const char *devpath_old;
         dev_t devnum;
         int ifindex;
         bool is_block;
         sd_event_source *timeout_warning;
         sd_event_source *timeout;
+
+        struct devpath_node *node;
+        LIST_FIELDS(struct event, same_devpath);
+
+        /* earlier events for the same, a parent or a child device, which need to finish before this one runs */
+        Set *blockers;
+        /* later events waiting for this one */
+        Set *dependents;
+        bool ready;
+        LIST_FIELDS(struct event, ready);
+
+        usec_t queued_usec;
+        usec_t started_usec;
+};
+
+/* One node for every devpath of a queued event and for all its parent directories, linking the events of a
+ * device to the ones of its parent and child devices */
+struct devpath_node {
+        char *path;
+        struct devpath_node *parent;
+        unsigned n_ref; /* events on this node and child nodes */
+        LIST_HEAD(struct event, events);
+        LIST_HEAD(struct devpath_node, children);
+        LIST_FIELDS(struct devpath_node, siblings);
 };
 
 static void event_queue_cleanup(Manager *manager, enum event_state type);
@@ -137,14 +196,172 @@ struct worker {
 struct worker_message {
 };
 
+static void devpath_node_unref(Manager *manager, struct devpath_node *node) {
+        while (node) {
+                struct devpath_node *parent = node->parent;
+
+                assert(node->n_ref > 0);
+
+                if (--node->n_ref > 0)
+                        return;
+
+                assert(LIST_IS_EMPTY(node->events));
+                assert(LIST_IS_EMPTY(node->children));
+
+                if (parent)
+                        LIST_REMOVE(siblings, parent->children, node);
+
+                hashmap_remove(manager->devpath_nodes, node->path);
+                free(node->path);
+                free(node);
+
+                /* the node held a reference to its parent */
+                node = parent;
+        }
+}
+
+/* Returns the node for the devpath with a reference taken, creating it and its parents as needed */
+static int devpath_node_get(Manager *manager, const char *devpath, struct devpath_node **ret) {
+        _cleanup_free_ char *path = NULL;
+        struct devpath_node *node, *parent = NULL;
+        const char *slash;
+        int r;
+
+        node = hashmap_get(manager->devpath_nodes, devpath);
+        if (node) {
+                node->n_ref++;
+                *ret = node;
+                return 0;
+        }
+
+        path = strdup(devpath);
+        if (!path)
+                return -ENOMEM;
+
+        slash = strrchr(devpath, '/');
+        if (slash && slash != devpath) {
+                r = devpath_node_get(manager, strndupa(devpath, slash - devpath), &parent);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_ensure_allocated(&manager->devpath_nodes, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        node = new0(struct devpath_node, 1);
+        if (!node) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        node->path = TAKE_PTR(path);
+        node->parent = parent;
+        node->n_ref = 1;
+
+        r = hashmap_put(manager->devpath_nodes, node->path, node);
+        if (r < 0) {
+                free(node->path);
+                free(node);
+                goto fail;
+        }
+
+        if (parent)
+                LIST_PREPEND(siblings, parent->children, node);
+
+        *ret = node;
+        return 1;
+
+fail:
+        devpath_node_unref(manager, parent);
+        return r;
+}
+
+static Hashmap **event_devnum_index(Manager *manager, struct event *event) {
+        return event->is_block ? &manager->last_block_event : &manager->last_char_event;
+}
+
+static void event_set_ready(struct event *event) {
+        Manager *manager = event->manager;
+
+        assert(!event->ready);
+
+        LIST_INSERT_AFTER(ready, manager->ready_events, manager->ready_tail, event);
+        manager->ready_tail = event;
+        event->ready = true;
+        manager->stats.n_ready++;
+}
+
+static void event_unset_ready(struct event *event) {
+        Manager *manager = event->manager;
+
+        if (!event->ready)
+                return;
+
+        if (manager->ready_tail == event)
+                manager->ready_tail = event->ready_prev;
+        LIST_REMOVE(ready, manager->ready_events, event);
+        event->ready = false;
+        manager->stats.n_ready--;
+}
+
+static void event_unlink(struct event *event) {
+        Manager *manager = event->manager;
+        struct event *other;
+        Iterator i;
+
+        event_unset_ready(event);
+
+        SET_FOREACH(other, event->blockers, i)
+                set_remove(other->dependents, event);
+        event->blockers = set_free(event->blockers);
+
+        SET_FOREACH(other, event->dependents, i) {
+                set_remove(other->blockers, event);
+
+                if (set_isempty(other->blockers) && other->state == EVENT_QUEUED)
+                        event_set_ready(other);
+        }
+        event->dependents = set_free(event->dependents);
+
+        if (event->node) {
+                LIST_REMOVE(same_devpath, event->node->events, event);
+                devpath_node_unref(manager, event->node);
+                event->node = NULL;
+        }
+
+        if (major(event->devnum) != 0 && hashmap_get(*event_devnum_index(manager, event), &event->devnum) == event)
+                hashmap_remove(*event_devnum_index(manager, event), &event->devnum);
+
+        if (event->ifindex != 0 && hashmap_get(manager->last_ifindex_event, INT_TO_PTR(event->ifindex)) == event)
+                hashmap_remove(manager->last_ifindex_event, INT_TO_PTR(event->ifindex));
+}
+
 static void event_free(struct event *event) {
+        Manager *manager;
         int r;
 
         if (!event)
                 return;
         assert(event->manager);
+        manager = event->manager;
 
-        LIST_REMOVE(event, event->manager->events, event);
+        if (event->state == EVENT_RUNNING) {
+                usec_t latency;
+
+                latency = now(CLOCK_MONOTONIC) - event->queued_usec;
+                manager->stats.n_running--;
+                manager->stats.n_processed++;
+                manager->stats.latency_total += latency;
+                manager->stats.latency_max = MAX(manager->stats.latency_max, latency);
+        }
+        manager->stats.n_events--;
+
+        event_unlink(event);
+
+        if (manager->events_tail == event)
+                manager->events_tail = event->event_prev;
+        LIST_REMOVE(event, manager->events, event);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -267,6 +484,12 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
 
+        event_unset_ready(event);
+        event->started_usec = now(CLOCK_MONOTONIC);
+        worker->manager->stats.n_running++;
+        worker->manager->stats.wait_total += event->started_usec - event->queued_usec;
+        worker->manager->stats.wait_max = MAX(worker->manager->stats.wait_max, event->started_usec - event->queued_usec);
+
         (void) sd_event_add_time(e, &event->timeout_warning, CLOCK_MONOTONIC,
                                  usec + arg_event_timeout_warn_usec, USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -283,11 +506,17 @@ static void manager_free(Manager *manager) {
         sd_event_source_unref(manager->ctrl_event);
         sd_event_source_unref(manager->uevent_event);
         sd_event_source_unref(manager->inotify_event);
+        sd_event_source_unref(manager->db_inotify_event);
+        sd_event_source_unref(manager->db_store_timer);
 
         udev_unref(manager->udev);
         sd_event_unref(manager->event);
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        hashmap_free(manager->devpath_nodes);
+        hashmap_free(manager->last_block_event);
+        hashmap_free(manager->last_char_event);
+        hashmap_free(manager->last_ifindex_event);
 
         udev_monitor_unref(manager->monitor);
         udev_ctrl_unref(manager->ctrl);
@@ -296,7 +525,10 @@ static void manager_free(Manager *manager) {
         udev_list_cleanup(&manager->properties);
         udev_rules_unref(manager->rules);
 
+        hashmap_free_free_free(manager->db_entries);
+
         safe_close(manager->fd_inotify);
+        safe_close(manager->fd_db_inotify);
         safe_close_pair(manager->worker_watch);
 
         free(manager);
@@ -574,6 +806,146 @@ static void event_run(Manager *manager, struct event *event) {
         worker_spawn(manager, event);
 }
 
+static int event_add_blocker(struct event *event, struct event *blocker) {
+        int r;
+
+        if (blocker == event)
+                return 0;
+
+        r = set_ensure_allocated(&event->blockers, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_ensure_allocated(&blocker->dependents, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(event->blockers, blocker);
+        if (r <= 0)
+                return r;
+
+        r = set_put(blocker->dependents, event);
+        if (r < 0) {
+                set_remove(event->blockers, blocker);
+                return r;
+        }
+
+        return 0;
+}
+
+static int event_add_blockers_on_subtree(struct event *event, struct devpath_node *node) {
+        struct devpath_node *child;
+        struct event *other;
+        int r;
+
+        LIST_FOREACH(siblings, child, node->children) {
+                LIST_FOREACH(same_devpath, other, child->events) {
+                        r = event_add_blocker(event, other);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = event_add_blockers_on_subtree(event, child);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+/* Every event already in the queue is an earlier one, hence the new event has to wait for all of them which are
+ * for the same device, for a parent or a child device, for its old name or which share its device number or
+ * network interface index */
+static int event_link(Manager *manager, struct event *event) {
+        struct devpath_node *node;
+        struct event *other;
+        int r;
+
+        r = devpath_node_get(manager, event->devpath, &event->node);
+        if (r < 0)
+                return r;
+        LIST_PREPEND(same_devpath, event->node->events, event);
+
+        LIST_FOREACH(same_devpath, other, event->node->events) {
+                if (other == event)
+                        continue;
+
+                /* devices names might have changed/swapped in the meantime */
+                if (major(event->devnum) != 0 && (event->devnum != other->devnum || event->is_block != other->is_block))
+                        continue;
+                if (event->ifindex != 0 && event->ifindex != other->ifindex)
+                        continue;
+
+                r = event_add_blocker(event, other);
+                if (r < 0)
+                        return r;
+        }
+
+        for (node = event->node->parent; node; node = node->parent)
+                LIST_FOREACH(same_devpath, other, node->events) {
+                        r = event_add_blocker(event, other);
+                        if (r < 0)
+                                return r;
+                }
+
+        r = event_add_blockers_on_subtree(event, event->node);
+        if (r < 0)
+                return r;
+
+        if (event->devpath_old) {
+                node = hashmap_get(manager->devpath_nodes, event->devpath_old);
+                if (node)
+                        LIST_FOREACH(same_devpath, other, node->events) {
+                                r = event_add_blocker(event, other);
+                                if (r < 0)
+                                        return r;
+                        }
+        }
+
+        /* All events for the same device number or interface index wait for each other already, hence waiting
+         * for the latest one of them is enough */
+        if (major(event->devnum) != 0) {
+                Hashmap **index = event_devnum_index(manager, event);
+
+                r = hashmap_ensure_allocated(index, &devt_hash_ops);
+                if (r < 0)
+                        return r;
+
+                other = hashmap_get(*index, &event->devnum);
+                if (other) {
+                        r = event_add_blocker(event, other);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = hashmap_replace(*index, &event->devnum, event);
+                if (r < 0)
+                        return r;
+        }
+
+        if (event->ifindex != 0) {
+                r = hashmap_ensure_allocated(&manager->last_ifindex_event, NULL);
+                if (r < 0)
+                        return r;
+
+                other = hashmap_get(manager->last_ifindex_event, INT_TO_PTR(event->ifindex));
+                if (other) {
+                        r = event_add_blocker(event, other);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = hashmap_replace(manager->last_ifindex_event, INT_TO_PTR(event->ifindex), event);
+                if (r < 0)
+                        return r;
+        }
+
+        if (set_isempty(event->blockers))
+                event_set_ready(event);
+
+        return 0;
+}
+
 static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         struct event *event;
         int r;
@@ -598,7 +970,6 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         udev_device_copy_properties(event->dev_kernel, dev);
         event->seqnum = udev_device_get_seqnum(dev);
         event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
         event->devpath_old = udev_device_get_devpath_old(dev);
         event->devnum = udev_device_get_devnum(dev);
         event->is_block = streq("block", udev_device_get_subsystem(dev));
@@ -608,6 +979,7 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
 
         event->state = EVENT_QUEUED;
+        event->queued_usec = now(CLOCK_MONOTONIC);
 
         if (LIST_IS_EMPTY(manager->events)) {
                 r = touch("/run/udev/queue");
@@ -615,7 +987,18 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
                         log_warning_errno(r, "could not touch /run/udev/queue: %m");
         }
 
-        LIST_APPEND(event, manager->events, event);
+        LIST_INSERT_AFTER(event, manager->events, manager->events_tail, event);
+        manager->events_tail = event;
+        manager->stats.n_events++;
+        manager->stats.n_events_max = MAX(manager->stats.n_events_max, manager->stats.n_events);
+
+        r = event_link(manager, event);
+        if (r < 0) {
+                /* the device is still owned by the caller */
+                event->dev = NULL;
+                event_free(event);
+                return r;
+        }
 
         return 0;
 }
@@ -635,76 +1018,6 @@ static void manager_kill_workers(Manager *manager) {
         }
 }
 
-/* lookup event for identical, parent, child device */
-static bool is_devpath_busy(Manager *manager, struct event *event) {
-        struct event *loop_event;
-        size_t common;
-
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                /* we already found a later event, earlier cannot block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
-
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
-
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
-
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
-
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
-
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
-
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-                /* no matching device */
-                continue;
-        }
-
-        return false;
-}
-
 static int on_exit_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         Manager *manager = userdata;
 
@@ -798,15 +1111,13 @@ static void event_queue_start(Manager *manager) {
                         return;
         }
 
-        LIST_FOREACH(event,event,manager->events) {
-                if (event->state != EVENT_QUEUED)
-                        continue;
-
-                /* do not start event if parent or child event is still running */
-                if (is_devpath_busy(manager, event))
-                        continue;
-
+        /* events for which the event of a parent or child device is still queued or running are not ready */
+        while ((event = manager->ready_events)) {
                 event_run(manager, event);
+
+                /* no worker available, try again once one is idle */
+                if (event->state != EVENT_RUNNING)
+                        break;
         }
 }
 
@@ -993,6 +1304,34 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         if (udev_ctrl_get_ping(ctrl_msg) > 0)
                 log_debug("udevd message (SYNC) received");
 
+        if (udev_ctrl_get_queue_stats(ctrl_msg) > 0) {
+                QueueStats *stats = &manager->stats;
+                char buf[256];
+                int r;
+
+                log_debug("udevd message (GET_QUEUE_STATS) received");
+
+                (void) snprintf(buf, sizeof(buf),
+                                "QUEUED=%u\n"
+                                "QUEUED_MAX=%u\n"
+                                "READY=%u\n"
+                                "RUNNING=%u\n"
+                                "PROCESSED=%" PRIu64 "\n"
+                                "WAIT_AVG_USEC=%" PRIu64 "\n"
+                                "WAIT_MAX_USEC=%" PRIu64 "\n"
+                                "LATENCY_AVG_USEC=%" PRIu64 "\n"
+                                "LATENCY_MAX_USEC=%" PRIu64 "\n",
+                                stats->n_events, stats->n_events_max, stats->n_ready, stats->n_running, stats->n_processed,
+                                stats->n_processed + stats->n_running > 0 ? stats->wait_total / (stats->n_processed + stats->n_running) : 0,
+                                stats->wait_max,
+                                stats->n_processed > 0 ? stats->latency_total / stats->n_processed : 0,
+                                stats->latency_max);
+
+                r = udev_ctrl_msg_reply(ctrl_msg, buf);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to send queue statistics: %m");
+        }
+
         if (udev_ctrl_get_exit(ctrl_msg) > 0) {
                 log_debug("udevd message (EXIT) received");
                 manager_exit(manager);
@@ -1148,6 +1487,230 @@ static int on_inotify(sd_event_source *s, int fd, uint32_t revents, void *userda
         return 1;
 }
 
+/* A database file replaced within the timestamp granularity of the file system after the snapshot was taken
+ * would not move the generation, hence only write the store once the directory has been quiet for a while */
+#define DB_STORE_SETTLE_USEC (100 * USEC_PER_MSEC)
+
+static void manager_db_remove_entry(Manager *manager, const char *id) {
+        char *key = NULL;
+
+        assert(manager);
+        assert(id);
+
+        free(hashmap_remove2(manager->db_entries, id, (void**) &key));
+        free(key);
+}
+
+static int manager_db_update_entry(Manager *manager, const char *id) {
+        _cleanup_free_ char *data = NULL, *key = NULL;
+        char *old_key = NULL, *path;
+        int r;
+
+        assert(manager);
+        assert(id);
+
+        path = strjoina("/run/udev/data/", id);
+        r = read_full_file(path, &data, NULL);
+        if (r == -ENOENT) {
+                manager_db_remove_entry(manager, id);
+                return 0;
+        }
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read %s: %m", path);
+
+        free(hashmap_get2(manager->db_entries, id, (void**) &old_key));
+        if (old_key)
+                return hashmap_update(manager->db_entries, old_key, TAKE_PTR(data));
+
+        r = hashmap_ensure_allocated(&manager->db_entries, &string_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        key = strdup(id);
+        if (!key)
+                return log_oom();
+
+        r = hashmap_put(manager->db_entries, key, data);
+        if (r < 0)
+                return log_oom();
+
+        key = NULL;
+        data = NULL;
+
+        return 0;
+}
+
+static int manager_db_scan(Manager *manager) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+
+        assert(manager);
+
+        hashmap_clear_free_free(manager->db_entries);
+        manager->db_dirty = true;
+
+        d = opendir("/run/udev/data");
+        if (!d)
+                return errno == ENOENT ? 0 : log_error_errno(errno, "Failed to open /run/udev/data: %m");
+
+        FOREACH_DIRENT(de, d, return log_error_errno(errno, "Failed to read /run/udev/data: %m"))
+                (void) manager_db_update_entry(manager, de->d_name);
+
+        return 0;
+}
+
+static void manager_db_stop(Manager *manager) {
+        assert(manager);
+
+        /* Without a complete view of the database, the store can't be kept current anymore. Its generation
+         * would mostly catch that, but a store nobody maintains is better not left around at all. */
+        manager->db_inotify_event = sd_event_source_unref(manager->db_inotify_event);
+        manager->db_store_timer = sd_event_source_unref(manager->db_store_timer);
+        manager->fd_db_inotify = safe_close(manager->fd_db_inotify);
+        hashmap_clear_free_free(manager->db_entries);
+        manager->db_dirty = false;
+
+        (void) unlink(DEVICE_DB_STORE);
+}
+
+/* Returns > 0 if anything changed */
+static int manager_db_process_inotify(Manager *manager) {
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        bool changed = false;
+        ssize_t l;
+
+        assert(manager);
+
+        while (manager->fd_db_inotify >= 0) {
+                l = read(manager->fd_db_inotify, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                break;
+
+                        log_error_errno(errno, "Failed to read database inotify fd, not maintaining %s anymore: %m", DEVICE_DB_STORE);
+                        manager_db_stop(manager);
+                        return 0;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        if (e->mask & IN_IGNORED) {
+                                log_debug("/run/udev/data went away, not maintaining %s anymore.", DEVICE_DB_STORE);
+                                manager_db_stop(manager);
+                                return 0;
+                        }
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                (void) manager_db_scan(manager);
+                                changed = true;
+                                continue;
+                        }
+
+                        /* Skip the temporary files the database entries are written to */
+                        if (e->len == 0 || e->name[0] == '.')
+                                continue;
+
+                        if (e->mask & (IN_DELETE|IN_MOVED_FROM))
+                                manager_db_remove_entry(manager, e->name);
+                        else
+                                (void) manager_db_update_entry(manager, e->name);
+
+                        changed = true;
+                }
+        }
+
+        if (changed)
+                manager->db_dirty = true;
+
+        return changed;
+}
+
+static int on_db_inotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *manager = userdata;
+
+        assert(manager);
+
+        (void) manager_db_process_inotify(manager);
+
+        return 1;
+}
+
+static void manager_db_store_flush(Manager *manager);
+
+static int on_db_store_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+
+        assert(manager);
+
+        manager->db_store_timer = sd_event_source_unref(manager->db_store_timer);
+        manager_db_store_flush(manager);
+
+        return 1;
+}
+
+static void manager_db_store_flush(Manager *manager) {
+        uint64_t generation;
+        int r;
+
+        assert(manager);
+
+        if (!manager->db_dirty || manager->fd_db_inotify < 0 || manager->db_store_timer)
+                return;
+
+        (void) manager_db_process_inotify(manager);
+
+        r = device_db_store_get_generation(&generation);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to get database generation, not writing %s: %m", DEVICE_DB_STORE);
+                return;
+        }
+
+        /* Check again after taking the generation, anything that came in meanwhile might not be covered by it */
+        if (generation / NSEC_PER_USEC + DB_STORE_SETTLE_USEC > now(CLOCK_REALTIME) ||
+            manager_db_process_inotify(manager) > 0) {
+                r = sd_event_add_time(manager->event, &manager->db_store_timer, CLOCK_MONOTONIC,
+                                      now(CLOCK_MONOTONIC) + DB_STORE_SETTLE_USEC, 0,
+                                      on_db_store_timer, manager);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to create database store timer, ignoring: %m");
+                return;
+        }
+
+        r = device_db_store_write(manager->db_entries, generation);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write %s, ignoring: %m", DEVICE_DB_STORE);
+
+        manager->db_dirty = false;
+}
+
+static int manager_db_init(Manager *manager) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(manager);
+
+        r = mkdir_p("/run/udev/data", 0755);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create /run/udev/data: %m");
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to create database inotify fd: %m");
+
+        if (inotify_add_watch(fd, "/run/udev/data", IN_ONLYDIR|IN_CLOSE_WRITE|IN_MOVED_TO|IN_MOVED_FROM|IN_DELETE) < 0)
+                return log_error_errno(errno, "Failed to watch /run/udev/data: %m");
+
+        r = sd_event_add_io(manager->event, &manager->db_inotify_event, fd, EPOLLIN, on_db_inotify, manager);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create database inotify event source: %m");
+
+        manager->fd_db_inotify = TAKE_FD(fd);
+
+        return manager_db_scan(manager);
+}
+
 static int on_sigterm(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         Manager *manager = userdata;
 
@@ -1232,6 +1795,8 @@ static int on_post(sd_event_source *s, void *userdata) {
 
         if (LIST_IS_EMPTY(manager->events)) {
                 /* no pending events */
+                manager_db_store_flush(manager);
+
                 if (!hashmap_isempty(manager->workers)) {
                         /* there are idle workers */
                         log_debug("cleanup idle workers");
@@ -1513,6 +2078,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 return log_oom();
 
         manager->fd_inotify = -1;
+        manager->fd_db_inotify = -1;
         manager->worker_watch[WRITE_END] = -1;
         manager->worker_watch[READ_END] = -1;
 
@@ -1611,6 +2177,11 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
         if (r < 0)
                 return log_error_errno(r, "error creating post event source: %m");
 
+        /* The store is only an optimization for readers, which fall back to the individual files */
+        r = manager_db_init(manager);
+        if (r < 0)
+                manager_db_stop(manager);
+
         *ret = TAKE_PTR(manager);
 
         return 0;